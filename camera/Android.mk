@@ -21,6 +21,7 @@ LOCAL_PATH := $(CAMERA_CLIENT_LOCAL_PATH)
 LOCAL_SRC_FILES:= \
 	Camera.cpp \
 	CameraMetadata.cpp \
+	CameraMetadataArena.cpp \
 	CameraParameters.cpp \
 	CaptureResult.cpp \
 	CameraParameters2.cpp \
@@ -21,6 +21,7 @@
 #include <utils/Errors.h>
 
 #include <camera/CameraMetadata.h>
+#include <camera/CameraMetadataArena.h>
 #include <binder/Parcel.h>
 
 namespace android {
@@ -32,22 +33,22 @@ typedef Parcel::WritableBlob WritableBlob;
 typedef Parcel::ReadableBlob ReadableBlob;
 
 CameraMetadata::CameraMetadata() :
-        mBuffer(NULL), mLocked(false) {
+        mBuffer(NULL), mLocked(false), mIndexed(false), mIndexValid(false) {
 }
 
 CameraMetadata::CameraMetadata(size_t entryCapacity, size_t dataCapacity) :
-        mLocked(false)
+        mLocked(false), mIndexed(false), mIndexValid(false)
 {
     mBuffer = allocate_camera_metadata(entryCapacity, dataCapacity);
 }
 
 CameraMetadata::CameraMetadata(const CameraMetadata &other) :
-        mLocked(false) {
+        mLocked(false), mIndexed(false), mIndexValid(false) {
     mBuffer = clone_camera_metadata(other.mBuffer);
 }
 
 CameraMetadata::CameraMetadata(camera_metadata_t *buffer) :
-        mBuffer(NULL), mLocked(false) {
+        mBuffer(NULL), mLocked(false), mIndexed(false), mIndexValid(false) {
     acquire(buffer);
 }
 
@@ -65,6 +66,7 @@ CameraMetadata &CameraMetadata::operator=(const camera_metadata_t *buffer) {
         camera_metadata_t *newBuffer = clone_camera_metadata(buffer);
         clear();
         mBuffer = newBuffer;
+        mIndexValid = false;
     }
     return *this;
 }
@@ -100,6 +102,7 @@ camera_metadata_t* CameraMetadata::release() {
     }
     camera_metadata_t *released = mBuffer;
     mBuffer = NULL;
+    mIndexValid = false;
     return released;
 }
 
@@ -112,6 +115,7 @@ void CameraMetadata::clear() {
         free_camera_metadata(mBuffer);
         mBuffer = NULL;
     }
+    mIndexValid = false;
 }
 
 void CameraMetadata::acquire(camera_metadata_t *buffer) {
@@ -121,6 +125,7 @@ void CameraMetadata::acquire(camera_metadata_t *buffer) {
     }
     clear();
     mBuffer = buffer;
+    mIndexValid = false;
 
     ALOGE_IF(validate_camera_metadata_structure(mBuffer, /*size*/NULL) != OK,
              "%s: Failed to validate metadata structure %p",
@@ -148,6 +153,7 @@ status_t CameraMetadata::append(const camera_metadata_t* other) {
     size_t extraData = get_camera_metadata_data_count(other);
     resizeIfNeeded(extraEntries, extraData);
 
+    mIndexValid = false;
     return append_camera_metadata(mBuffer, other);
 }
 
@@ -165,9 +171,89 @@ status_t CameraMetadata::sort() {
         ALOGE("%s: CameraMetadata is locked", __FUNCTION__);
         return INVALID_OPERATION;
     }
+    mIndexValid = false;
     return sort_camera_metadata(mBuffer);
 }
 
+void CameraMetadata::setIndexed(bool indexed) {
+    mIndexed = indexed;
+    mIndexValid = false;
+    if (!indexed) {
+        mIndex.clear();
+    }
+}
+
+ssize_t CameraMetadata::indexSlot(uint32_t tag) {
+    uint32_t section = tag >> 16;
+    uint32_t tagIndex = tag & 0xFFFF;
+    if (section >= ANDROID_SECTION_COUNT || tagIndex >= kIndexSectionTags) {
+        return -1;
+    }
+    return section * kIndexSectionTags + tagIndex;
+}
+
+bool CameraMetadata::buildIndex() const {
+    size_t entryCount = get_camera_metadata_entry_count(mBuffer);
+    // Entry indices are kept on 16 bits
+    if (entryCount >= UINT16_MAX) {
+        return false;
+    }
+    mIndex.clear();
+    mIndex.insertAt((uint16_t) 0, 0, ANDROID_SECTION_COUNT * kIndexSectionTags);
+    uint16_t *index = mIndex.editArray();
+    for (size_t i = 0; i < entryCount; i++) {
+        camera_metadata_ro_entry_t entry;
+        if (get_camera_metadata_ro_entry(mBuffer, i, &entry) != OK) {
+            return false;
+        }
+        ssize_t slot = indexSlot(entry.tag);
+        if (slot >= 0) {
+            index[slot] = i + 1;
+        }
+    }
+    mIndexValid = true;
+    return true;
+}
+
+status_t CameraMetadata::findIndexed(uint32_t tag, size_t *index) const {
+    ssize_t slot = indexSlot(tag);
+    if (!mIndexed || mBuffer == NULL || slot < 0) {
+        return NO_INIT;
+    }
+    if (!mIndexValid && !buildIndex()) {
+        return NO_INIT;
+    }
+    uint16_t entryIndex = mIndex[slot];
+    if (entryIndex == 0) {
+        return NAME_NOT_FOUND;
+    }
+    *index = entryIndex - 1;
+    return OK;
+}
+
+status_t CameraMetadata::findEntry(uint32_t tag, camera_metadata_entry_t *entry) {
+    size_t index;
+    status_t res = findIndexed(tag, &index);
+    if (res == OK) {
+        return get_camera_metadata_entry(mBuffer, index, entry);
+    } else if (res == NAME_NOT_FOUND) {
+        return res;
+    }
+    return find_camera_metadata_entry(mBuffer, tag, entry);
+}
+
+status_t CameraMetadata::findEntry(uint32_t tag,
+        camera_metadata_ro_entry_t *entry) const {
+    size_t index;
+    status_t res = findIndexed(tag, &index);
+    if (res == OK) {
+        return get_camera_metadata_ro_entry(mBuffer, index, entry);
+    } else if (res == NAME_NOT_FOUND) {
+        return res;
+    }
+    return find_camera_metadata_ro_entry(mBuffer, tag, entry);
+}
+
 status_t CameraMetadata::checkType(uint32_t tag, uint8_t expectedType) {
     int tagType = get_camera_metadata_tag_type(tag);
     if ( CC_UNLIKELY(tagType == -1)) {
@@ -296,10 +382,20 @@ status_t CameraMetadata::updateImpl(uint32_t tag, const void *data,
 
     if (res == OK) {
         camera_metadata_entry_t entry;
-        res = find_camera_metadata_entry(mBuffer, tag, &entry);
+        res = findEntry(tag, &entry);
         if (res == NAME_NOT_FOUND) {
             res = add_camera_metadata_entry(mBuffer,
                     tag, data, data_count);
+            // The new entry goes last, the others don't move
+            if (res == OK && mIndexValid) {
+                size_t entryIndex = get_camera_metadata_entry_count(mBuffer) - 1;
+                ssize_t slot = indexSlot(tag);
+                if (entryIndex >= UINT16_MAX) {
+                    mIndexValid = false;
+                } else if (slot >= 0) {
+                    mIndex.editItemAt(slot) = entryIndex + 1;
+                }
+            }
         } else if (res == OK) {
             res = update_camera_metadata_entry(mBuffer,
                     entry.index, data, data_count, NULL);
@@ -325,7 +421,7 @@ status_t CameraMetadata::updateImpl(uint32_t tag, const void *data,
 
 bool CameraMetadata::exists(uint32_t tag) const {
     camera_metadata_ro_entry entry;
-    return find_camera_metadata_ro_entry(mBuffer, tag, &entry) == 0;
+    return findEntry(tag, &entry) == 0;
 }
 
 camera_metadata_entry_t CameraMetadata::find(uint32_t tag) {
@@ -336,7 +432,7 @@ camera_metadata_entry_t CameraMetadata::find(uint32_t tag) {
         entry.count = 0;
         return entry;
     }
-    res = find_camera_metadata_entry(mBuffer, tag, &entry);
+    res = findEntry(tag, &entry);
     if (CC_UNLIKELY( res != OK )) {
         entry.count = 0;
         entry.data.u8 = NULL;
@@ -347,7 +443,7 @@ camera_metadata_entry_t CameraMetadata::find(uint32_t tag) {
 camera_metadata_ro_entry_t CameraMetadata::find(uint32_t tag) const {
     status_t res;
     camera_metadata_ro_entry entry;
-    res = find_camera_metadata_ro_entry(mBuffer, tag, &entry);
+    res = findEntry(tag, &entry);
     if (CC_UNLIKELY( res != OK )) {
         entry.count = 0;
         entry.data.u8 = NULL;
@@ -362,7 +458,7 @@ status_t CameraMetadata::erase(uint32_t tag) {
         ALOGE("%s: CameraMetadata is locked", __FUNCTION__);
         return INVALID_OPERATION;
     }
-    res = find_camera_metadata_entry(mBuffer, tag, &entry);
+    res = findEntry(tag, &entry);
     if (res == NAME_NOT_FOUND) {
         return OK;
     } else if (res != OK) {
@@ -372,6 +468,8 @@ status_t CameraMetadata::erase(uint32_t tag) {
                 get_camera_metadata_tag_name(tag), tag, strerror(-res), res);
         return res;
     }
+    // Later entries move down
+    mIndexValid = false;
     res = delete_camera_metadata_entry(mBuffer, entry.index);
     if (res != OK) {
         ALOGE("%s: Error deleting entry %s.%s (%x): %s %d",
@@ -443,6 +541,9 @@ status_t CameraMetadata::readFromParcel(const Parcel& data,
               __FUNCTION__, err, strerror(-err));
         return err;
     }
+    if (blobSizeTmp == CameraMetadataArena::kParcelMarker) {
+        return CameraMetadataArena::readFromParcel(data, out);
+    }
     const size_t blobSize = static_cast<size_t>(blobSizeTmp);
     const size_t alignment = get_camera_metadata_alignment();
 
@@ -638,6 +739,7 @@ status_t CameraMetadata::readFromParcel(Parcel *parcel) {
 
     clear();
     mBuffer = buffer;
+    mIndexValid = false;
 
     return OK;
 }
@@ -654,6 +756,20 @@ status_t CameraMetadata::writeToParcel(Parcel *parcel) const {
     return CameraMetadata::writeToParcel(*parcel, mBuffer);
 }
 
+status_t CameraMetadata::writeToParcel(Parcel *parcel,
+        CameraMetadataArena *arena, int *slot) const {
+
+    ALOGV("%s: parcel = %p", __FUNCTION__, parcel);
+
+    *slot = -1;
+    if (parcel == NULL) {
+        ALOGE("%s: parcel is null", __FUNCTION__);
+        return BAD_VALUE;
+    }
+
+    return arena->writeToParcel(*parcel, mBuffer, slot);
+}
+
 void CameraMetadata::swap(CameraMetadata& other) {
     if (mLocked) {
         ALOGE("%s: CameraMetadata is locked", __FUNCTION__);
@@ -668,6 +784,8 @@ void CameraMetadata::swap(CameraMetadata& other) {
 
     other.mBuffer = thisBuf;
     mBuffer = otherBuf;
+    other.mIndexValid = false;
+    mIndexValid = false;
 }
 
 }; // namespace android
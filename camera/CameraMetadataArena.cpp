@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define LOG_NDEBUG 0
+
+#define LOG_TAG "Camera2-MetadataArena"
+#include <utils/Log.h>
+#include <utils/Errors.h>
+#include <utils/Vector.h>
+
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cutils/ashmem.h>
+#include <cutils/atomic.h>
+#include <binder/Parcel.h>
+#include <camera/CameraMetadata.h>
+#include <camera/CameraMetadataArena.h>
+
+namespace android {
+
+CameraMetadataArena::CameraMetadataArena() :
+        mFd(-1), mBase(NULL), mInitFailed(false) {
+}
+
+CameraMetadataArena::~CameraMetadataArena() {
+    if (mBase != NULL) {
+        munmap(mBase, kArenaSize);
+    }
+    if (mFd >= 0) {
+        close(mFd);
+    }
+}
+
+volatile int32_t *CameraMetadataArena::slotState(uint8_t *base, int slot) {
+    return reinterpret_cast<volatile int32_t *>(base + slot * kSlotSize);
+}
+
+bool CameraMetadataArena::init_l() {
+    if (mBase != NULL) {
+        return true;
+    }
+    if (mInitFailed) {
+        return false;
+    }
+
+    // Only tried once: on failure every result goes as a blob, as before
+    mInitFailed = true;
+    mFd = ashmem_create_region("CameraMetadataArena", kArenaSize);
+    if (mFd < 0) {
+        ALOGE("%s: Unable to create the arena: %s", __FUNCTION__,
+                strerror(errno));
+        return false;
+    }
+    void *base = mmap(NULL, kArenaSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+            mFd, 0);
+    if (base == MAP_FAILED) {
+        ALOGE("%s: Unable to map the arena: %s", __FUNCTION__,
+                strerror(errno));
+        close(mFd);
+        mFd = -1;
+        return false;
+    }
+    // A new region reads as zeroes, all the slots SLOT_FREE
+    mBase = static_cast<uint8_t *>(base);
+    mInitFailed = false;
+    return true;
+}
+
+status_t CameraMetadataArena::writeToParcel(Parcel &data,
+        const camera_metadata_t *metadata, int *slot) {
+    *slot = -1;
+
+    if (metadata == NULL ||
+            get_camera_metadata_alignment() > kSlotHeaderSize) {
+        return CameraMetadata::writeToParcel(data, metadata);
+    }
+    const size_t metadataSize = get_camera_metadata_compact_size(metadata);
+    if (metadataSize < kMinArenaMetadataSize ||
+            metadataSize > kSlotSize - kSlotHeaderSize) {
+        return CameraMetadata::writeToParcel(data, metadata);
+    }
+
+    uint8_t *base;
+    {
+        Mutex::Autolock l(mLock);
+        if (!init_l()) {
+            return CameraMetadata::writeToParcel(data, metadata);
+        }
+        base = mBase;
+    }
+
+    int i = 0;
+    while (i < kNumSlots &&
+            android_atomic_acquire_cas(SLOT_FREE, SLOT_BUSY,
+                    slotState(base, i)) != 0) {
+        i++;
+    }
+    if (i == kNumSlots) {
+        ALOGV("%s: All the slots are in flight, writing a blob",
+                __FUNCTION__);
+        return CameraMetadata::writeToParcel(data, metadata);
+    }
+
+    copy_camera_metadata(base + i * kSlotSize + kSlotHeaderSize,
+            metadataSize, metadata);
+
+    status_t res = data.writeInt32(kParcelMarker);
+    if (res == OK) {
+        res = data.writeFileDescriptor(mFd);
+    }
+    if (res == OK) {
+        res = data.writeInt32(i);
+    }
+    if (res == OK) {
+        res = data.writeInt32(static_cast<int32_t>(metadataSize));
+    }
+    if (res != OK) {
+        release(i);
+        return res;
+    }
+    ALOGV("%s: Wrote %zu bytes of metadata to slot %d", __FUNCTION__,
+            metadataSize, i);
+    *slot = i;
+    return OK;
+}
+
+void CameraMetadataArena::release(int slot) {
+    if (slot < 0 || slot >= kNumSlots || mBase == NULL) {
+        return;
+    }
+    android_atomic_release_store(SLOT_FREE, slotState(mBase, slot));
+}
+
+namespace {
+
+// The arenas mapped by this process, as receiver, by the identity of their
+// region. They stay mapped for the next results.
+struct ArenaMapping {
+    dev_t    dev;
+    ino_t    ino;
+    uint8_t *base;
+};
+
+// Arenas of devices closed since are unmapped as new ones come
+const size_t kMaxArenaMappings = 4;
+
+Mutex gArenaMappingsLock;
+Vector<ArenaMapping> gArenaMappings;
+
+} // anonymous namespace
+
+status_t CameraMetadataArena::readFromParcel(const Parcel &data,
+        camera_metadata_t **out) {
+    int fd = data.readFileDescriptor();
+    int32_t slot = -1;
+    int32_t metadataSize = 0;
+    status_t res = data.readInt32(&slot);
+    if (res == OK) {
+        res = data.readInt32(&metadataSize);
+    }
+    if (res != OK || fd < 0 || slot < 0 || slot >= kNumSlots ||
+            metadataSize <= 0 ||
+            static_cast<size_t>(metadataSize) > kSlotSize - kSlotHeaderSize) {
+        ALOGE("%s: Malformed arena metadata (fd %d, slot %d, size %d)",
+                __FUNCTION__, fd, slot, metadataSize);
+        return BAD_VALUE;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ALOGE("%s: Unable to stat the arena: %s", __FUNCTION__,
+                strerror(errno));
+        return BAD_VALUE;
+    }
+
+    Mutex::Autolock l(gArenaMappingsLock);
+
+    uint8_t *base = NULL;
+    for (size_t i = 0; i < gArenaMappings.size(); i++) {
+        if (gArenaMappings[i].dev == st.st_dev &&
+                gArenaMappings[i].ino == st.st_ino) {
+            base = gArenaMappings[i].base;
+            break;
+        }
+    }
+    if (base == NULL) {
+        if (ashmem_get_size_region(fd) != static_cast<int>(kArenaSize)) {
+            ALOGE("%s: The arena is not %zu bytes", __FUNCTION__, kArenaSize);
+            return BAD_VALUE;
+        }
+        void *addr = mmap(NULL, kArenaSize, PROT_READ | PROT_WRITE,
+                MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            ALOGE("%s: Unable to map the arena: %s", __FUNCTION__,
+                    strerror(errno));
+            return NO_MEMORY;
+        }
+        if (gArenaMappings.size() == kMaxArenaMappings) {
+            munmap(gArenaMappings[0].base, kArenaSize);
+            gArenaMappings.removeAt(0);
+        }
+        ArenaMapping mapping;
+        mapping.dev = st.st_dev;
+        mapping.ino = st.st_ino;
+        mapping.base = static_cast<uint8_t *>(addr);
+        gArenaMappings.push_back(mapping);
+        base = mapping.base;
+        ALOGV("%s: Mapped a new arena at %p", __FUNCTION__, base);
+    }
+
+    // Validated as it is copied out, the sender writing it being as
+    // untrusted as a blob's
+    camera_metadata_t *metadata = allocate_copy_camera_metadata_checked(
+            reinterpret_cast<const camera_metadata_t *>(
+                    base + slot * kSlotSize + kSlotHeaderSize),
+            metadataSize);
+    android_atomic_release_store(SLOT_FREE, slotState(base, slot));
+
+    if (metadata == NULL) {
+        ALOGE("%s: metadata allocation and copy failed", __FUNCTION__);
+        return BAD_VALUE;
+    }
+    if (out) {
+        *out = metadata;
+    } else {
+        free_camera_metadata(metadata);
+    }
+    return OK;
+}
+
+}; // namespace android
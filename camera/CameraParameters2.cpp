@@ -39,17 +39,32 @@ String8 CameraParameters2::flatten() const
     String8 flattened("");
     size_t size = mMap.size();
 
+    // Size the string once, rather than growing it for every key and value
+    size_t length = 0;
     for (size_t i = 0; i < size; i++) {
-        String8 k, v;
-        k = mMap.keyAt(i);
-        v = mMap.valueAt(i);
+        length += mMap.keyAt(i).length() + 1 + mMap.valueAt(i).length();
+        if (i != size-1)
+            length++;
+    }
 
-        flattened += k;
-        flattened += "=";
-        flattened += v;
+    char *out = flattened.lockBuffer(length);
+    if (out == NULL) {
+        ALOGE("%s: Unable to allocate %zu bytes", __FUNCTION__, length);
+        return flattened;
+    }
+    for (size_t i = 0; i < size; i++) {
+        const String8& k = mMap.keyAt(i);
+        const String8& v = mMap.valueAt(i);
+
+        memcpy(out, k.string(), k.length());
+        out += k.length();
+        *out++ = '=';
+        memcpy(out, v.string(), v.length());
+        out += v.length();
         if (i != size-1)
-            flattened += ";";
+            *out++ = ';';
     }
+    flattened.unlockBuffer(length);
 
     ALOGV("%s: Flattened params = %s", __FUNCTION__, flattened.string());
 
@@ -46,13 +46,81 @@ static int vendor_tag_descriptor_get_tag_type(const vendor_tag_ops_t* v, uint32_
 static Mutex sLock;
 static sp<VendorTagDescriptor> sGlobalVendorTagDescriptor;
 
-VendorTagDescriptor::VendorTagDescriptor() {}
+VendorTagDescriptor::VendorTagDescriptor() : mTagCount(0), mIndexMask(0) {}
 
-VendorTagDescriptor::~VendorTagDescriptor() {
-    size_t len = mReverseMapping.size();
-    for (size_t i = 0; i < len; ++i)  {
-        delete mReverseMapping[i];
+VendorTagDescriptor::~VendorTagDescriptor() {}
+
+uint32_t VendorTagDescriptor::hashTag(uint32_t tag) {
+    // Tags are (section << 16 | index), fold the section in before the multiplicative hash
+    return (tag ^ (tag >> 16)) * 2654435761u;
+}
+
+uint32_t VendorTagDescriptor::hashName(const char* section, const char* name) {
+    // FNV-1a over "section\0name"
+    uint32_t hash = 2166136261u;
+    for (const char* c = section; *c != '\0'; ++c) {
+        hash = (hash ^ static_cast<uint8_t>(*c)) * 16777619u;
+    }
+    hash *= 16777619u;
+    for (const char* c = name; *c != '\0'; ++c) {
+        hash = (hash ^ static_cast<uint8_t>(*c)) * 16777619u;
+    }
+    return hash;
+}
+
+void VendorTagDescriptor::buildIndex() {
+    size_t count = mTagToNameMap.size();
+    size_t slots = 1;
+    while (slots < 2 * count) {
+        slots <<= 1;
+    }
+    mIndexMask = static_cast<uint32_t>(slots - 1);
+
+    mTagIndex.clear();
+    mNameIndex.clear();
+    mTagIndex.insertAt(-1, 0, slots);
+    mNameIndex.insertAt(-1, 0, slots);
+    int32_t* tagSlots = mTagIndex.editArray();
+    int32_t* nameSlots = mNameIndex.editArray();
+
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t tag = mTagToNameMap.keyAt(i);
+        uint32_t slot = hashTag(tag) & mIndexMask;
+        while (tagSlots[slot] >= 0) {
+            slot = (slot + 1) & mIndexMask;
+        }
+        tagSlots[slot] = static_cast<int32_t>(i);
+
+        const char* section = mSections[mTagToSectionMap.valueAt(i)].string();
+        const char* name = mTagToNameMap.valueAt(i).string();
+        slot = hashName(section, name) & mIndexMask;
+        while (nameSlots[slot] >= 0) {
+            ssize_t other = nameSlots[slot];
+            if (mTagToSectionMap.valueAt(other) == mTagToSectionMap.valueAt(i) &&
+                    mTagToNameMap.valueAt(other) == mTagToNameMap.valueAt(i)) {
+                // The same name defined twice in a section, the last tag defined wins.
+                break;
+            }
+            slot = (slot + 1) & mIndexMask;
+        }
+        nameSlots[slot] = static_cast<int32_t>(i);
+    }
+}
+
+ssize_t VendorTagDescriptor::indexOfTag(uint32_t tag) const {
+    if (mTagIndex.isEmpty()) {
+        return -1;
+    }
+    const int32_t* tagSlots = mTagIndex.array();
+    uint32_t slot = hashTag(tag) & mIndexMask;
+    int32_t index;
+    while ((index = tagSlots[slot]) >= 0) {
+        if (mTagToNameMap.keyAt(index) == tag) {
+            return index;
+        }
+        slot = (slot + 1) & mIndexMask;
     }
+    return -1;
 }
 
 status_t VendorTagDescriptor::createDescriptorFromOps(const vendor_tag_ops_t* vOps,
@@ -122,16 +190,11 @@ status_t VendorTagDescriptor::createDescriptorFromOps(const vendor_tag_ops_t* vO
         ssize_t index = sections.indexOf(sectionString);
         LOG_ALWAYS_FATAL_IF(index < 0, "index %zd must be non-negative", index);
         desc->mTagToSectionMap.add(tag, static_cast<uint32_t>(index));
-
-        // Set up reverse mapping
-        ssize_t reverseIndex = -1;
-        if ((reverseIndex = desc->mReverseMapping.indexOfKey(sectionString)) < 0) {
-            KeyedVector<String8, uint32_t>* nameMapper = new KeyedVector<String8, uint32_t>();
-            reverseIndex = desc->mReverseMapping.add(sectionString, nameMapper);
-        }
-        desc->mReverseMapping[reverseIndex]->add(desc->mTagToNameMap.valueFor(tag), tag);
     }
 
+    // Set up the tag and reverse mapping indices
+    desc->buildIndex();
+
     descriptor = desc;
     return OK;
 }
@@ -232,18 +295,8 @@ status_t VendorTagDescriptor::createFromParcel(const Parcel* parcel,
 
     LOG_ALWAYS_FATAL_IF(static_cast<size_t>(tagCount) != allTags.size(),
                         "tagCount must be the same as allTags size");
-    // Set up reverse mapping
-    for (size_t i = 0; i < static_cast<size_t>(tagCount); ++i) {
-        uint32_t tag = allTags[i];
-        String8 sectionString = desc->mSections[desc->mTagToSectionMap.valueFor(tag)];
-
-        ssize_t reverseIndex = -1;
-        if ((reverseIndex = desc->mReverseMapping.indexOfKey(sectionString)) < 0) {
-            KeyedVector<String8, uint32_t>* nameMapper = new KeyedVector<String8, uint32_t>();
-            reverseIndex = desc->mReverseMapping.add(sectionString, nameMapper);
-        }
-        desc->mReverseMapping[reverseIndex]->add(desc->mTagToNameMap.valueFor(tag), tag);
-    }
+    // Set up the tag and reverse mapping indices
+    desc->buildIndex();
 
     descriptor = desc;
     return res;
@@ -265,7 +318,7 @@ void VendorTagDescriptor::getTagArray(uint32_t* tagArray) const {
 }
 
 const char* VendorTagDescriptor::getSectionName(uint32_t tag) const {
-    ssize_t index = mTagToSectionMap.indexOfKey(tag);
+    ssize_t index = indexOfTag(tag);
     if (index < 0) {
         return VENDOR_SECTION_NAME_ERR;
     }
@@ -273,7 +326,7 @@ const char* VendorTagDescriptor::getSectionName(uint32_t tag) const {
 }
 
 const char* VendorTagDescriptor::getTagName(uint32_t tag) const {
-    ssize_t index = mTagToNameMap.indexOfKey(tag);
+    ssize_t index = indexOfTag(tag);
     if (index < 0) {
         return VENDOR_TAG_NAME_ERR;
     }
@@ -281,11 +334,11 @@ const char* VendorTagDescriptor::getTagName(uint32_t tag) const {
 }
 
 int VendorTagDescriptor::getTagType(uint32_t tag) const {
-    ssize_t index = mTagToNameMap.indexOfKey(tag);
+    ssize_t index = indexOfTag(tag);
     if (index < 0) {
         return VENDOR_TAG_TYPE_ERR;
     }
-    return mTagToTypeMap.valueFor(tag);
+    return mTagToTypeMap.valueAt(index);
 }
 
 status_t VendorTagDescriptor::writeToParcel(Parcel* parcel) const {
@@ -304,9 +357,9 @@ status_t VendorTagDescriptor::writeToParcel(Parcel* parcel) const {
     int32_t tagType;
     for (size_t i = 0; i < size; ++i) {
         tag = mTagToNameMap.keyAt(i);
-        String8 tagName = mTagToNameMap[i];
-        sectionIndex = mTagToSectionMap.valueFor(tag);
-        tagType = mTagToTypeMap.valueFor(tag);
+        const String8& tagName = mTagToNameMap.valueAt(i);
+        sectionIndex = mTagToSectionMap.valueAt(i);
+        tagType = mTagToTypeMap.valueAt(i);
         if ((res = parcel->writeInt32(tag)) != OK) break;
         if ((res = parcel->writeInt32(tagType)) != OK) break;
         if ((res = parcel->writeString8(tagName)) != OK) break;
@@ -329,22 +382,30 @@ SortedVector<String8> VendorTagDescriptor::getAllSectionNames() const {
 }
 
 status_t VendorTagDescriptor::lookupTag(String8 name, String8 section, /*out*/uint32_t* tag) const {
-    ssize_t index = mReverseMapping.indexOfKey(section);
-    if (index < 0) {
+    ssize_t sectionIndex = mSections.indexOf(section);
+    if (sectionIndex < 0) {
         ALOGE("%s: Section '%s' does not exist.", __FUNCTION__, section.string());
         return BAD_VALUE;
     }
 
-    ssize_t nameIndex = mReverseMapping[index]->indexOfKey(name);
-    if (nameIndex < 0) {
-        ALOGE("%s: Tag name '%s' does not exist.", __FUNCTION__, name.string());
-        return BAD_VALUE;
+    if (!mNameIndex.isEmpty()) {
+        const int32_t* nameSlots = mNameIndex.array();
+        uint32_t slot = hashName(section.string(), name.string()) & mIndexMask;
+        int32_t index;
+        while ((index = nameSlots[slot]) >= 0) {
+            if (mTagToSectionMap.valueAt(index) == static_cast<uint32_t>(sectionIndex) &&
+                    mTagToNameMap.valueAt(index) == name) {
+                if (tag != NULL) {
+                    *tag = mTagToNameMap.keyAt(index);
+                }
+                return OK;
+            }
+            slot = (slot + 1) & mIndexMask;
+        }
     }
 
-    if (tag != NULL) {
-        *tag = mReverseMapping[index]->valueAt(nameIndex);
-    }
-    return OK;
+    ALOGE("%s: Tag name '%s' does not exist.", __FUNCTION__, name.string());
+    return BAD_VALUE;
 }
 
 void VendorTagDescriptor::dump(int fd, int verbosity, int indentation) const {
@@ -366,9 +427,9 @@ void VendorTagDescriptor::dump(int fd, int verbosity, int indentation) const {
             continue;
         }
         String8 name = mTagToNameMap.valueAt(i);
-        uint32_t sectionId = mTagToSectionMap.valueFor(tag);
+        uint32_t sectionId = mTagToSectionMap.valueAt(i);
         String8 sectionName = mSections[sectionId];
-        int type = mTagToTypeMap.valueFor(tag);
+        int type = mTagToTypeMap.valueAt(i);
         const char* typeName = (type >= 0 && type < NUM_TYPES) ?
                 camera_metadata_type_names[type] : "UNKNOWN";
         dprintf(fd, "%*s0x%x (%s) with type %d (%s) defined in section %s\n", indentation + 2,
@@ -28,6 +28,7 @@
 
 #include <camera/camera2/ICameraDeviceCallbacks.h>
 #include "camera/CameraMetadata.h"
+#include "camera/CameraMetadataArena.h"
 #include "camera/CaptureResult.h"
 
 namespace android {
@@ -87,12 +88,21 @@ public:
         Parcel data, reply;
         data.writeInterfaceToken(ICameraDeviceCallbacks::getInterfaceDescriptor());
         data.writeInt32(1); // to mark presence of metadata object
-        metadata.writeToParcel(&data);
+        int slot;
+        metadata.writeToParcel(&data, &mResultArena, &slot);
         data.writeInt32(1); // to mark presence of CaptureResult object
         resultExtras.writeToParcel(&data);
-        remote()->transact(RESULT_RECEIVED, data, &reply, IBinder::FLAG_ONEWAY);
+        status_t res = remote()->transact(RESULT_RECEIVED, data, &reply, IBinder::FLAG_ONEWAY);
+        if (res != OK) {
+            // never read, the slot is not given back by the receiver
+            mResultArena.release(slot);
+        }
         data.writeNoException();
     }
+
+private:
+    // The results of this client only: the receiver can read all of it
+    CameraMetadataArena mResultArena;
 };
 
 IMPLEMENT_META_INTERFACE(CameraDeviceCallbacks,
@@ -18,6 +18,7 @@ include $(CLEAR_VARS)
 LOCAL_SRC_FILES:= \
 	main.cpp \
 	ProCameraTests.cpp \
+	CameraMetadataTests.cpp \
 	VendorTagDescriptorTests.cpp
 
 LOCAL_SHARED_LIBRARIES := \
@@ -53,3 +54,28 @@ LOCAL_MODULE:= camera_client_test
 LOCAL_MODULE_TAGS := tests
 
 include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	CameraServiceBenchmark.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libutils \
+	libcutils \
+	libcamera_metadata \
+	libcamera_client \
+	libgui \
+	libui \
+	libbinder
+
+LOCAL_C_INCLUDES += \
+	system/media/camera/include \
+	frameworks/native/include \
+
+LOCAL_CFLAGS += -Wall -Wextra
+
+LOCAL_MODULE:= camera_service_benchmark
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
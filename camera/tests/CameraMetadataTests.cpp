@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_NDEBUG 0
+#define LOG_TAG "CameraMetadataTests"
+
+#include <camera/CameraMetadata.h>
+#include <system/camera_metadata.h>
+#include <utils/Errors.h>
+#include <utils/Log.h>
+
+#include <gtest/gtest.h>
+#include <stdint.h>
+#include <string.h>
+
+using namespace android;
+
+static const uint32_t kTags[] = {
+    ANDROID_CONTROL_AE_MODE,
+    ANDROID_CONTROL_AF_MODE,
+    ANDROID_CONTROL_AWB_MODE,
+    ANDROID_FLASH_MODE,
+    ANDROID_JPEG_QUALITY,
+    ANDROID_LED_TRANSMIT,
+    ANDROID_SCALER_CROP_REGION,
+    ANDROID_STATISTICS_FACE_DETECT_MODE,
+};
+
+#define ARRAY_SIZE(a)      (sizeof(a) / sizeof((a)[0]))
+
+// Puts the same byte or int32 values for all of kTags in both objects
+static void updateAll(CameraMetadata &a, CameraMetadata &b, uint8_t value) {
+    for (size_t i = 0; i < ARRAY_SIZE(kTags); ++i) {
+        int type = get_camera_metadata_tag_type(kTags[i]);
+        if (type == TYPE_BYTE) {
+            ASSERT_EQ(OK, a.update(kTags[i], &value, 1));
+            ASSERT_EQ(OK, b.update(kTags[i], &value, 1));
+        } else {
+            int32_t values[4] = { value, value + 1, value + 2, value + 3 };
+            ASSERT_EQ(OK, a.update(kTags[i], values, 4));
+            ASSERT_EQ(OK, b.update(kTags[i], values, 4));
+        }
+    }
+}
+
+static void expectSameEntries(const CameraMetadata &a, const CameraMetadata &b) {
+    ASSERT_EQ(a.entryCount(), b.entryCount());
+    for (size_t i = 0; i < ARRAY_SIZE(kTags); ++i) {
+        camera_metadata_ro_entry_t entryA = a.find(kTags[i]);
+        camera_metadata_ro_entry_t entryB = b.find(kTags[i]);
+        EXPECT_EQ(a.exists(kTags[i]), b.exists(kTags[i]));
+        ASSERT_EQ(entryA.count, entryB.count);
+        if (entryA.count > 0) {
+            EXPECT_EQ(entryA.tag, kTags[i]);
+            EXPECT_EQ(0, memcmp(entryA.data.u8, entryB.data.u8,
+                    entryA.count * camera_metadata_type_size[entryA.type]));
+        }
+    }
+}
+
+TEST(CameraMetadataTest, IndexedMatchesSearch) {
+    CameraMetadata indexed, searched;
+    indexed.setIndexed(true);
+
+    // Missing tags, on an empty object and then with the first entries
+    expectSameEntries(indexed, searched);
+    uint8_t mode = ANDROID_CONTROL_AE_MODE_ON;
+    ASSERT_EQ(OK, indexed.update(ANDROID_CONTROL_AE_MODE, &mode, 1));
+    ASSERT_EQ(OK, searched.update(ANDROID_CONTROL_AE_MODE, &mode, 1));
+    expectSameEntries(indexed, searched);
+
+    // Additions, growing the buffer, and in place updates
+    updateAll(indexed, searched, 1);
+    expectSameEntries(indexed, searched);
+    updateAll(indexed, searched, 2);
+    expectSameEntries(indexed, searched);
+
+    // Changes that move entries
+    ASSERT_EQ(OK, indexed.sort());
+    expectSameEntries(indexed, searched);
+    ASSERT_EQ(OK, indexed.erase(ANDROID_CONTROL_AF_MODE));
+    ASSERT_EQ(OK, searched.erase(ANDROID_CONTROL_AF_MODE));
+    expectSameEntries(indexed, searched);
+    EXPECT_FALSE(indexed.exists(ANDROID_CONTROL_AF_MODE));
+    updateAll(indexed, searched, 3);
+    expectSameEntries(indexed, searched);
+}
+
+TEST(CameraMetadataTest, IndexedAcrossContents) {
+    CameraMetadata source;
+    uint8_t quality = 90;
+    ASSERT_EQ(OK, source.update(ANDROID_JPEG_QUALITY, &quality, 1));
+
+    CameraMetadata indexed;
+    indexed.setIndexed(true);
+    EXPECT_FALSE(indexed.exists(ANDROID_JPEG_QUALITY));
+
+    // Assignment replaces the contents, the index follows
+    indexed = source;
+    ASSERT_TRUE(indexed.exists(ANDROID_JPEG_QUALITY));
+    EXPECT_EQ(quality, indexed.find(ANDROID_JPEG_QUALITY).data.u8[0]);
+
+    CameraMetadata other;
+    uint8_t mode = ANDROID_FLASH_MODE_TORCH;
+    ASSERT_EQ(OK, other.update(ANDROID_FLASH_MODE, &mode, 1));
+    indexed.swap(other);
+    EXPECT_FALSE(indexed.exists(ANDROID_JPEG_QUALITY));
+    ASSERT_TRUE(indexed.exists(ANDROID_FLASH_MODE));
+    EXPECT_EQ(mode, indexed.find(ANDROID_FLASH_MODE).data.u8[0]);
+
+    ASSERT_EQ(OK, indexed.append(source));
+    ASSERT_TRUE(indexed.exists(ANDROID_JPEG_QUALITY));
+    ASSERT_TRUE(indexed.exists(ANDROID_FLASH_MODE));
+
+    indexed.clear();
+    EXPECT_FALSE(indexed.exists(ANDROID_FLASH_MODE));
+    EXPECT_EQ(0u, indexed.find(ANDROID_FLASH_MODE).count);
+}
@@ -0,0 +1,539 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Measures the overhead of the camera service on the camera2 API path:
+ * connects to a camera through ICameraService::connectDevice, configures a set
+ * of streams, then runs a repeating request or back to back bursts and reports
+ * the request to result latencies, the frames dropped and the CPU time used by
+ * the process hosting the camera service.
+ *
+ * Usage: camera_service_benchmark [-c cameraId] [-s WxH[:format]]... [-n frames]
+ *            [-w warmupFrames] [-b burstLength] [-t template] [-p servicePid]
+ */
+
+#define LOG_TAG "CameraServiceBenchmark"
+//#define LOG_NDEBUG 0
+
+#include <dirent.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <binder/IServiceManager.h>
+#include <binder/ProcessState.h>
+#include <gui/BufferItemConsumer.h>
+#include <gui/BufferQueue.h>
+#include <gui/Surface.h>
+#include <utils/Condition.h>
+#include <utils/KeyedVector.h>
+#include <utils/Log.h>
+#include <utils/Mutex.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+#include <system/camera_metadata.h>
+#include <hardware/camera3.h>
+#include <camera/CameraMetadata.h>
+#include <camera/ICameraService.h>
+#include <camera/camera2/CaptureRequest.h>
+#include <camera/camera2/ICameraDeviceCallbacks.h>
+#include <camera/camera2/ICameraDeviceUser.h>
+
+namespace android {
+namespace camera2 {
+namespace benchmark {
+
+static const int kDefaultFrameCount = 300;
+static const int kDefaultWarmupFrames = 30;
+static const nsecs_t kResultTimeout = 5000000000LL; // 5 s
+static const size_t kConsumerBuffers = 4;
+
+struct StreamConfig {
+    int width;
+    int height;
+    int format;
+};
+
+/**
+ * Consumer for one output stream, returns each buffer as soon as it arrives
+ * and counts them.
+ */
+class BenchmarkStream : public BufferItemConsumer::FrameAvailableListener {
+  public:
+    BenchmarkStream(const StreamConfig& config) :
+            mConfig(config),
+            mStreamId(-1),
+            mFrameCount(0) {
+    }
+
+    status_t init() {
+        sp<IGraphicBufferConsumer> consumer;
+        BufferQueue::createBufferQueue(&mProducer, &consumer);
+        mConsumer = new BufferItemConsumer(consumer, GRALLOC_USAGE_HW_TEXTURE,
+                kConsumerBuffers);
+        mConsumer->setName(String8("CameraServiceBenchmark"));
+        mConsumer->setFrameAvailableListener(this);
+        mSurface = new Surface(mProducer);
+        return OK;
+    }
+
+    virtual void onFrameAvailable() {
+        BufferItemConsumer::BufferItem item;
+        while (mConsumer->acquireBuffer(&item, 0) == OK) {
+            mConsumer->releaseBuffer(item);
+            Mutex::Autolock l(mLock);
+            mFrameCount++;
+        }
+    }
+
+    size_t getFrameCount() {
+        Mutex::Autolock l(mLock);
+        return mFrameCount;
+    }
+
+    void resetFrameCount() {
+        Mutex::Autolock l(mLock);
+        mFrameCount = 0;
+    }
+
+    const StreamConfig mConfig;
+    int mStreamId;
+    sp<IGraphicBufferProducer> mProducer;
+    sp<Surface> mSurface;
+
+  private:
+    sp<BufferItemConsumer> mConsumer;
+    Mutex mLock;
+    size_t mFrameCount;
+};
+
+/**
+ * Records the arrival time of the shutter notification and of the final
+ * result for each frame number.
+ */
+class BenchmarkCallbacks : public BnCameraDeviceCallbacks {
+  public:
+    BenchmarkCallbacks() :
+            mErrorCount(0),
+            mLatestFrame(-1),
+            mDeviceFailed(false) {
+    }
+
+    virtual void onDeviceError(CameraErrorCode errorCode,
+            const CaptureResultExtras& resultExtras) {
+        ALOGV("%s: Error %d for frame %" PRId64, __FUNCTION__, errorCode,
+                resultExtras.frameNumber);
+        Mutex::Autolock l(mLock);
+        mErrorCount++;
+        switch (errorCode) {
+            case ERROR_CAMERA_REQUEST:
+            case ERROR_CAMERA_RESULT:
+            case ERROR_CAMERA_BUFFER:
+                // The frame is done with, if not successfully
+                if (resultExtras.frameNumber > mLatestFrame) {
+                    mLatestFrame = resultExtras.frameNumber;
+                }
+                break;
+            default:
+                mDeviceFailed = true;
+                break;
+        }
+        mResultSignal.signal();
+    }
+
+    virtual void onDeviceIdle() {
+    }
+
+    virtual void onCaptureStarted(const CaptureResultExtras& resultExtras,
+            int64_t /*timestamp*/) {
+        nsecs_t now = systemTime();
+        Mutex::Autolock l(mLock);
+        mShutterTimes.add(resultExtras.frameNumber, now);
+    }
+
+    virtual void onResultReceived(const CameraMetadata& metadata,
+            const CaptureResultExtras& resultExtras) {
+        // Partial results don't carry the sensor timestamp
+        if (!metadata.exists(ANDROID_SENSOR_TIMESTAMP)) return;
+        nsecs_t now = systemTime();
+        Mutex::Autolock l(mLock);
+        mResultTimes.add(resultExtras.frameNumber, now);
+        if (resultExtras.frameNumber > mLatestFrame) {
+            mLatestFrame = resultExtras.frameNumber;
+        }
+        mResultSignal.signal();
+    }
+
+    // Waits until frameNumber, or a later frame, is done with. Results come in
+    // frame order, so a frame without a result by then was dropped.
+    status_t waitForResult(int64_t frameNumber) {
+        Mutex::Autolock l(mLock);
+        while (mLatestFrame < frameNumber) {
+            if (mDeviceFailed) {
+                return INVALID_OPERATION;
+            }
+            status_t res = mResultSignal.waitRelative(mLock, kResultTimeout);
+            if (res != OK) {
+                return res;
+            }
+        }
+        return OK;
+    }
+
+    Mutex mLock;
+    KeyedVector<int64_t, nsecs_t> mShutterTimes;
+    KeyedVector<int64_t, nsecs_t> mResultTimes;
+    size_t mErrorCount;
+
+  private:
+    Condition mResultSignal;
+    int64_t mLatestFrame;
+    bool mDeviceFailed;
+};
+
+static int compareNsecs(const void* a, const void* b) {
+    nsecs_t x = *static_cast<const nsecs_t*>(a);
+    nsecs_t y = *static_cast<const nsecs_t*>(b);
+    return (x < y) ? -1 : (x > y) ? 1 : 0;
+}
+
+static void printLatencies(const char* name, Vector<nsecs_t>& latencies) {
+    size_t count = latencies.size();
+    if (count == 0) {
+        printf("  %s latency: no samples\n", name);
+        return;
+    }
+    qsort(latencies.editArray(), count, sizeof(nsecs_t), compareNsecs);
+    const nsecs_t* l = latencies.array();
+    printf("  %s latency (ms): min %.2f  p50 %.2f  p90 %.2f  p99 %.2f  max %.2f"
+            "  (%zu frames)\n", name,
+            l[0] / 1e6, l[count / 2] / 1e6, l[count * 9 / 10] / 1e6,
+            l[count * 99 / 100] / 1e6, l[count - 1] / 1e6, count);
+}
+
+// Finds the process hosting media.camera, mediaserver unless configured otherwise
+static pid_t findServicePid() {
+    DIR* proc = opendir("/proc");
+    if (proc == NULL) return -1;
+    pid_t pid = -1;
+    struct dirent* entry;
+    while (pid < 0 && (entry = readdir(proc)) != NULL) {
+        char path[64];
+        char cmdline[256];
+        snprintf(path, sizeof(path), "/proc/%s/cmdline", entry->d_name);
+        FILE* f = fopen(path, "r");
+        if (f == NULL) continue;
+        size_t len = fread(cmdline, 1, sizeof(cmdline) - 1, f);
+        fclose(f);
+        cmdline[len] = '\0';
+        const char* name = strrchr(cmdline, '/');
+        name = (name != NULL) ? name + 1 : cmdline;
+        if (strcmp(name, "mediaserver") == 0) {
+            pid = atoi(entry->d_name);
+        }
+    }
+    closedir(proc);
+    return pid;
+}
+
+// Returns the user and system CPU time of a process, in ns, or -1
+static nsecs_t getProcessCpuTime(pid_t pid) {
+    if (pid < 0) return -1;
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    FILE* f = fopen(path, "r");
+    if (f == NULL) return -1;
+    char stat[1024];
+    size_t len = fread(stat, 1, sizeof(stat) - 1, f);
+    fclose(f);
+    stat[len] = '\0';
+
+    // Fields after the command name, which may contain spaces
+    const char* fields = strrchr(stat, ')');
+    if (fields == NULL) return -1;
+    unsigned long utime, stime;
+    if (sscanf(fields + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+            &utime, &stime) != 2) {
+        return -1;
+    }
+    long ticksPerSecond = sysconf(_SC_CLK_TCK);
+    return (nsecs_t)(utime + stime) * 1000000000LL / ticksPerSecond;
+}
+
+// Starts measuring the CPU time of the service, and counting stream buffers
+static void startMeasuring(pid_t servicePid, const Vector<sp<BenchmarkStream> >& streams,
+        nsecs_t* cpuStart, nsecs_t* runStart) {
+    *cpuStart = getProcessCpuTime(servicePid);
+    *runStart = systemTime();
+    for (size_t i = 0; i < streams.size(); i++) {
+        streams[i]->resetFrameCount();
+    }
+}
+
+static bool parseStream(const char* arg, StreamConfig* config) {
+    config->format = HAL_PIXEL_FORMAT_YCbCr_420_888;
+    char* end;
+    config->width = strtol(arg, &end, 10);
+    if (*end != 'x') return false;
+    config->height = strtol(end + 1, &end, 10);
+    if (*end == ':') {
+        config->format = strtol(end + 1, &end, 0);
+    }
+    return *end == '\0' && config->width > 0 && config->height > 0;
+}
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s [-c cameraId] [-s WxH[:format]]... [-n frames] [-w warmupFrames]\n"
+            "          [-b burstLength] [-t template] [-p servicePid]\n"
+            "  -s  adds an output stream, 640x480 YCbCr_420_888 if none is given\n"
+            "  -b  submits bursts of that many requests back to back instead of\n"
+            "      a repeating request\n"
+            "  -t  request template, %d (preview) by default\n",
+            name, CAMERA3_TEMPLATE_PREVIEW);
+}
+
+static int run(int argc, char** argv) {
+    int cameraId = 0;
+    int frameCount = kDefaultFrameCount;
+    int warmupFrames = kDefaultWarmupFrames;
+    int burstLength = 0;
+    int templateId = CAMERA3_TEMPLATE_PREVIEW;
+    pid_t servicePid = -1;
+    Vector<StreamConfig> configs;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "c:s:n:w:b:t:p:h")) != -1) {
+        StreamConfig config;
+        switch (opt) {
+            case 'c': cameraId = atoi(optarg); break;
+            case 'n': frameCount = atoi(optarg); break;
+            case 'w': warmupFrames = atoi(optarg); break;
+            case 'b': burstLength = atoi(optarg); break;
+            case 't': templateId = atoi(optarg); break;
+            case 'p': servicePid = atoi(optarg); break;
+            case 's':
+                if (!parseStream(optarg, &config)) {
+                    fprintf(stderr, "Invalid stream '%s'\n", optarg);
+                    return 1;
+                }
+                configs.add(config);
+                break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (frameCount <= 0 || warmupFrames < 0 || burstLength < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (configs.isEmpty()) {
+        StreamConfig config = { 640, 480, HAL_PIXEL_FORMAT_YCbCr_420_888 };
+        configs.add(config);
+    }
+    if (servicePid < 0) {
+        servicePid = findServicePid();
+        if (servicePid < 0) {
+            fprintf(stderr, "Can't find the camera service process, CPU time not measured\n");
+        }
+    }
+
+    ProcessState::self()->startThreadPool();
+
+    sp<IBinder> binder = defaultServiceManager()->getService(String16("media.camera"));
+    if (binder == NULL) {
+        fprintf(stderr, "Camera service not available\n");
+        return 1;
+    }
+    sp<ICameraService> service = interface_cast<ICameraService>(binder);
+
+    sp<BenchmarkCallbacks> callbacks = new BenchmarkCallbacks();
+    sp<ICameraDeviceUser> device;
+    status_t res = service->connectDevice(callbacks, cameraId,
+            String16("camera_service_benchmark"), ICameraService::USE_CALLING_UID,
+            /*out*/device);
+    if (res != OK || device == NULL) {
+        fprintf(stderr, "Can't connect to camera %d: %s (%d)\n", cameraId,
+                strerror(-res), res);
+        return 1;
+    }
+
+    // Configure the streams
+    Vector<sp<BenchmarkStream> > streams;
+    res = device->beginConfigure();
+    for (size_t i = 0; res == OK && i < configs.size(); i++) {
+        sp<BenchmarkStream> stream = new BenchmarkStream(configs[i]);
+        res = stream->init();
+        if (res != OK) break;
+        int streamId = device->createStream(configs[i].width, configs[i].height,
+                configs[i].format, stream->mProducer);
+        if (streamId < 0) {
+            fprintf(stderr, "Can't create %dx%d stream of format %#x: %s (%d)\n",
+                    configs[i].width, configs[i].height, configs[i].format,
+                    strerror(-streamId), streamId);
+            res = streamId;
+            break;
+        }
+        stream->mStreamId = streamId;
+        streams.add(stream);
+    }
+    nsecs_t configureStart = systemTime();
+    if (res == OK) {
+        res = device->endConfigure();
+    }
+    nsecs_t configureTime = systemTime() - configureStart;
+
+    sp<CaptureRequest> request = new CaptureRequest();
+    if (res == OK) {
+        res = device->createDefaultRequest(templateId, &request->mMetadata);
+    }
+    if (res != OK) {
+        fprintf(stderr, "Can't set up the capture: %s (%d)\n", strerror(-res), res);
+        device->disconnect();
+        return 1;
+    }
+    for (size_t i = 0; i < streams.size(); i++) {
+        request->mSurfaceList.add(streams[i]->mSurface);
+    }
+
+    // Run the requests. Errors past this point still report what was measured.
+    // Frame numbers of a new connection start at 0.
+    KeyedVector<int64_t, nsecs_t> submitTimes;
+    int64_t lastFrame = -1;
+    int64_t measuredFirst = -1;
+    nsecs_t cpuStart = -1;
+    nsecs_t runStart = 0;
+    int64_t totalFrames = warmupFrames + frameCount;
+
+    if (burstLength == 0) {
+        int requestId = device->submitRequest(request, /*streaming*/true);
+        if (requestId < 0) {
+            fprintf(stderr, "Can't submit repeating request: %s (%d)\n",
+                    strerror(-requestId), requestId);
+            res = requestId;
+        }
+        for (int64_t frame = 0; res == OK && frame < totalFrames; frame++) {
+            if (frame == warmupFrames) {
+                startMeasuring(servicePid, streams, &cpuStart, &runStart);
+                measuredFirst = frame;
+            }
+            res = callbacks->waitForResult(frame);
+        }
+        if (requestId >= 0) {
+            device->cancelRequest(requestId, &lastFrame);
+        }
+    } else {
+        List<sp<CaptureRequest> > burst;
+        for (int i = 0; i < burstLength; i++) {
+            burst.push_back(request);
+        }
+        while (res == OK && lastFrame + 1 < totalFrames) {
+            if (measuredFirst < 0 && lastFrame + 1 >= warmupFrames) {
+                startMeasuring(servicePid, streams, &cpuStart, &runStart);
+                measuredFirst = lastFrame + 1;
+            }
+            nsecs_t submitTime = systemTime();
+            int64_t burstLastFrame;
+            int requestId = device->submitRequestList(burst, /*streaming*/false,
+                    &burstLastFrame);
+            if (requestId < 0) {
+                fprintf(stderr, "Can't submit burst: %s (%d)\n",
+                        strerror(-requestId), requestId);
+                res = requestId;
+                break;
+            }
+            for (int64_t frame = lastFrame + 1; frame <= burstLastFrame; frame++) {
+                submitTimes.add(frame, submitTime);
+            }
+            lastFrame = burstLastFrame;
+            res = callbacks->waitForResult(lastFrame);
+        }
+    }
+    device->waitUntilIdle();
+    nsecs_t runTime = systemTime() - runStart;
+    nsecs_t cpuTime = (cpuStart >= 0) ? getProcessCpuTime(servicePid) - cpuStart : -1;
+    device->disconnect();
+
+    if (res != OK) {
+        fprintf(stderr, "Run stopped early: %s (%d)\n", strerror(-res), res);
+    }
+
+    // Report
+    if (measuredFirst < 0) {
+        // Stopped during the warm-up
+        measuredFirst = lastFrame + 1;
+    }
+    Vector<nsecs_t> shutterLatencies;
+    Vector<nsecs_t> submitLatencies;
+    size_t measuredFrames = 0;
+    size_t droppedFrames = 0;
+    {
+        Mutex::Autolock l(callbacks->mLock);
+        for (int64_t frame = measuredFirst; frame <= lastFrame; frame++) {
+            measuredFrames++;
+            ssize_t resultIdx = callbacks->mResultTimes.indexOfKey(frame);
+            if (resultIdx < 0) {
+                droppedFrames++;
+                continue;
+            }
+            nsecs_t resultTime = callbacks->mResultTimes.valueAt(resultIdx);
+            ssize_t idx = callbacks->mShutterTimes.indexOfKey(frame);
+            if (idx >= 0) {
+                shutterLatencies.add(resultTime - callbacks->mShutterTimes.valueAt(idx));
+            }
+            idx = submitTimes.indexOfKey(frame);
+            if (idx >= 0) {
+                submitLatencies.add(resultTime - submitTimes.valueAt(idx));
+            }
+        }
+        printf("Camera %d, %s, %zu stream(s), stream configuration %.2f ms\n", cameraId,
+                burstLength == 0 ? "repeating request" : "bursts", streams.size(),
+                configureTime / 1e6);
+        printf("  %zu frames measured after %d warm-up frames, %zu dropped, %zu errors\n",
+                measuredFrames, warmupFrames, droppedFrames, callbacks->mErrorCount);
+    }
+    if (measuredFrames > 0 && runTime > 0) {
+        printf("  %.2f fps\n", (measuredFrames - droppedFrames) * 1e9 / runTime);
+    }
+    printLatencies("shutter to result", shutterLatencies);
+    if (burstLength > 0) {
+        printLatencies("submit to result", submitLatencies);
+    }
+    for (size_t i = 0; i < streams.size(); i++) {
+        const StreamConfig& c = streams[i]->mConfig;
+        printf("  stream %d (%dx%d, format %#x): %zu buffers\n", streams[i]->mStreamId,
+                c.width, c.height, c.format, streams[i]->getFrameCount());
+    }
+    if (cpuTime >= 0 && measuredFrames > 0) {
+        printf("  service process %d CPU: %.3f ms per frame, %.1f%% of one core\n",
+                servicePid, cpuTime / 1e6 / measuredFrames,
+                runTime > 0 ? cpuTime * 100.0 / runTime : 0.0);
+    }
+    return (res == OK) ? 0 : 1;
+}
+
+}; // namespace benchmark
+}; // namespace camera2
+}; // namespace android
+
+int main(int argc, char** argv) {
+    return android::camera2::benchmark::run(argc, argv);
+}
@@ -34,6 +34,8 @@
 
 #include <binder/IPCThreadState.h>
 #include <utils/Errors.h>
+#include <utils/List.h>
+#include <utils/Thread.h>
 #include <utils/Timers.h>
 #include <utils/Trace.h>
 
@@ -302,17 +304,110 @@ static status_t prepareVirtualDisplay(const DisplayInfo& mainDpyInfo,
     return NO_ERROR;
 }
 
+/*
+ * Writes the encoded frames to the MediaMuxer on a thread of its own, so
+ * that a slow write to storage doesn't hold up draining the encoder (and
+ * make SurfaceFlinger drop frames for lack of encoder input buffers).
+ */
+class MuxerWriter : public Thread {
+public:
+    MuxerWriter(const sp<MediaMuxer>& muxer) : Thread(false),
+        mMuxer(muxer),
+        mError(NO_ERROR),
+        mMaxQueued(0) {}
+
+    // Queues a copy of the data, the encoder gets its buffer back at once.
+    // Returns the error of an earlier write, if any.
+    status_t writeSampleData(const void* data, size_t size, size_t trackIdx,
+            int64_t ptsUsec, uint32_t flags) {
+        Sample sample;
+        sample.buffer = new ABuffer(size);
+        memcpy(sample.buffer->data(), data, size);
+        sample.trackIdx = trackIdx;
+        sample.ptsUsec = ptsUsec;
+        sample.flags = flags;
+
+        Mutex::Autolock _l(mMutex);
+        if (mError != NO_ERROR) {
+            return mError;
+        }
+        mQueue.push_back(sample);
+        if (mQueue.size() > mMaxQueued) {
+            mMaxQueued = mQueue.size();
+        }
+        mCondition.signal();
+        return NO_ERROR;
+    }
+
+    // Writes out what is still queued and stops the thread.  Returns the
+    // first error the muxer reported.
+    status_t finish() {
+        {
+            Mutex::Autolock _l(mMutex);
+            requestExit();
+            mCondition.signal();
+        }
+        requestExitAndWait();
+        ALOGV("MuxerWriter done, at most %zu frames queued", mMaxQueued);
+        return mError;
+    }
+
+private:
+    struct Sample {
+        sp<ABuffer> buffer;
+        size_t trackIdx;
+        int64_t ptsUsec;
+        uint32_t flags;
+    };
+
+    virtual bool threadLoop() {
+        Sample sample;
+        {
+            Mutex::Autolock _l(mMutex);
+            while (mQueue.empty()) {
+                if (exitPending()) {
+                    return false;
+                }
+                mCondition.wait(mMutex);
+            }
+            sample = *mQueue.begin();
+            mQueue.erase(mQueue.begin());
+        }
+
+        ATRACE_NAME("write sample");
+        status_t err = mMuxer->writeSampleData(sample.buffer, sample.trackIdx,
+                sample.ptsUsec, sample.flags);
+        if (err != NO_ERROR) {
+            fprintf(stderr, "Failed writing data to muxer (err=%d)\n", err);
+            Mutex::Autolock _l(mMutex);
+            mError = err;
+            mQueue.clear();
+            return false;
+        }
+        return true;
+    }
+
+    sp<MediaMuxer> mMuxer;
+    Mutex mMutex;
+    Condition mCondition;
+    List<Sample> mQueue;
+    status_t mError;
+    size_t mMaxQueued;
+};
+
 /*
  * Runs the MediaCodec encoder, sending the output to the MediaMuxer.  The
  * input frames are coming from the virtual display as fast as SurfaceFlinger
  * wants to send them.
  *
- * Exactly one of muxer or rawFp must be non-null.
+ * Exactly one of muxer or rawFp must be non-null.  The frames for the muxer
+ * go through writer, which the caller finishes after this returns.
  *
  * The muxer must *not* have been started before calling.
  */
 static status_t runEncoder(const sp<MediaCodec>& encoder,
-        const sp<MediaMuxer>& muxer, FILE* rawFp, const sp<IBinder>& mainDpy,
+        const sp<MediaMuxer>& muxer, const sp<MuxerWriter>& writer,
+        FILE* rawFp, const sp<IBinder>& mainDpy,
         const sp<IBinder>& virtualDpy, uint8_t orientation) {
     static int kTimeout = 250000;   // be responsive on signal
     status_t err;
@@ -405,16 +500,10 @@ static status_t runEncoder(const sp<MediaCodec>& encoder,
                     // The MediaMuxer docs are unclear, but it appears that we
                     // need to pass either the full set of BufferInfo flags, or
                     // (flags & BUFFER_FLAG_SYNCFRAME).
-                    //
-                    // If this blocks for too long we could drop frames.  We may
-                    // want to queue these up and do them on a different thread.
-                    ATRACE_NAME("write sample");
                     assert(trackIdx != -1);
-                    err = muxer->writeSampleData(buffers[bufIndex], trackIdx,
-                            ptsUsec, flags);
+                    err = writer->writeSampleData(buffers[bufIndex]->data(), size,
+                            trackIdx, ptsUsec, flags);
                     if (err != NO_ERROR) {
-                        fprintf(stderr,
-                            "Failed writing data to muxer (err=%d)\n", err);
                         return err;
                     }
                 }
@@ -632,6 +721,7 @@ static status_t recordScreen(const char* fileName) {
     }
 
     sp<MediaMuxer> muxer = NULL;
+    sp<MuxerWriter> writer = NULL;
     FILE* rawFp = NULL;
     switch (gOutputFormat) {
         case FORMAT_MP4: {
@@ -641,6 +731,8 @@ static status_t recordScreen(const char* fileName) {
             if (gRotate) {
                 muxer->setOrientationHint(90);  // TODO: does this do anything?
             }
+            writer = new MuxerWriter(muxer);
+            writer->run("screenrecord-mux");
             break;
         }
         case FORMAT_H264:
@@ -689,7 +781,7 @@ static status_t recordScreen(const char* fileName) {
         }
     } else {
         // Main encoder loop.
-        err = runEncoder(encoder, muxer, rawFp, mainDpy, dpy,
+        err = runEncoder(encoder, muxer, writer, rawFp, mainDpy, dpy,
                 mainDpyInfo.orientation);
         if (err != NO_ERROR) {
             fprintf(stderr, "Encoder failed (err=%d)\n", err);
@@ -707,6 +799,11 @@ static status_t recordScreen(const char* fileName) {
     if (overlay != NULL) overlay->stop();
     if (encoder != NULL) encoder->stop();
     if (muxer != NULL) {
+        // Everything queued goes into the file before the muxer stops.
+        status_t writeErr = writer->finish();
+        if (err == NO_ERROR) {
+            err = writeErr;
+        }
         // If we don't stop muxer explicitly, i.e. let the destructor run,
         // it may hang (b/11050628).
         muxer->stop();
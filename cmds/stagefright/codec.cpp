@@ -17,6 +17,7 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "codec"
 #include <inttypes.h>
+#include <sys/resource.h>
 #include <utils/Log.h>
 
 #include "SimplePlayer.h"
@@ -26,6 +27,7 @@
 #include <media/ICrypto.h>
 #include <media/IMediaHTTPService.h>
 #include <media/IMediaPlayerService.h>
+#include <media/MediaCodecInfo.h>
 #include <media/stagefright/foundation/ABuffer.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/ALooper.h>
@@ -45,7 +47,9 @@ static void usage(const char *me) {
     fprintf(stderr, "usage: %s [-a] use audio\n"
                     "\t\t[-v] use video\n"
                     "\t\t[-p] playback\n"
-                    "\t\t[-S] allocate buffers from a surface\n",
+                    "\t\t[-S] allocate buffers from a surface\n"
+                    "\t\t[-b runs] decode with every codec of each track "
+                    "this many times, print the results as JSON\n",
                     me);
 
     exit(1);
@@ -311,6 +315,274 @@ static int decode(
     return 0;
 }
 
+namespace android {
+
+struct BenchmarkRun {
+    status_t mStatus;
+    int64_t mNumFrames;
+    int64_t mElapsedTimeUs;
+    int64_t mCpuTimeUs;
+    long mMaxRssKb;
+
+    // from queueing the input of a frame to its output coming out
+    Vector<int64_t> mLatenciesUs;
+};
+
+static int64_t cpuTimeUs(const struct rusage &usage) {
+    return usage.ru_utime.tv_sec * 1000000ll + usage.ru_utime.tv_usec
+            + usage.ru_stime.tv_sec * 1000000ll + usage.ru_stime.tv_usec;
+}
+
+static int compareLatencies(const int64_t *a, const int64_t *b) {
+    return (*a < *b) ? -1 : (*a > *b) ? 1 : 0;
+}
+
+static int64_t percentile(const Vector<int64_t> &sorted, double p) {
+    if (sorted.isEmpty()) {
+        return -1ll;
+    }
+    size_t index = (size_t)(p * (sorted.size() - 1) + 0.5);
+    return sorted[index];
+}
+
+static AString jsonString(const char *s) {
+    AString out = "\"";
+    for (; *s != '\0'; ++s) {
+        if (*s == '"' || *s == '\\') {
+            out.append('\\');
+            out.append(*s);
+        } else if ((unsigned char)*s < 0x20) {
+            out.append(StringPrintf("\\u%04x", *s).c_str());
+        } else {
+            out.append(*s);
+        }
+    }
+    out.append('"');
+    return out;
+}
+
+// Decodes one track of the file with the codec of that name, as fast as it
+// will go and without rendering.
+static void benchmarkCodec(
+        const sp<ALooper> &looper,
+        const char *path,
+        size_t trackIndex,
+        const char *codecName,
+        BenchmarkRun *run) {
+    static int64_t kTimeout = 500ll;
+
+    run->mStatus = OK;
+    run->mNumFrames = 0;
+    run->mElapsedTimeUs = 0;
+    run->mCpuTimeUs = 0;
+    run->mMaxRssKb = 0;
+    run->mLatenciesUs.clear();
+
+    sp<NuMediaExtractor> extractor = new NuMediaExtractor;
+    sp<AMessage> format;
+    status_t err = extractor->setDataSource(NULL /* httpService */, path);
+    if (err == OK) {
+        err = extractor->getTrackFormat(trackIndex, &format);
+    }
+    if (err == OK) {
+        err = extractor->selectTrack(trackIndex);
+    }
+    if (err != OK) {
+        run->mStatus = err;
+        return;
+    }
+
+    sp<MediaCodec> codec = MediaCodec::CreateByComponentName(looper, codecName);
+    if (codec == NULL) {
+        run->mStatus = NAME_NOT_FOUND;
+        return;
+    }
+
+    Vector<sp<ABuffer> > inBuffers;
+    err = codec->configure(format, NULL /* surface */, NULL /* crypto */, 0 /* flags */);
+    if (err == OK) {
+        err = codec->start();
+    }
+    if (err == OK) {
+        err = codec->getInputBuffers(&inBuffers);
+    }
+    if (err != OK) {
+        codec->release();
+        run->mStatus = err;
+        return;
+    }
+
+    // presentation time -> time the input was queued
+    KeyedVector<int64_t, int64_t> queueTimesUs;
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    int64_t startCpuTimeUs = cpuTimeUs(usage);
+    int64_t startTimeUs = ALooper::GetNowUs();
+
+    bool signalledInputEOS = false;
+    bool sawOutputEOS = false;
+    while (!sawOutputEOS && err == OK) {
+        if (!signalledInputEOS) {
+            size_t index;
+            err = codec->dequeueInputBuffer(&index, kTimeout);
+            if (err == OK) {
+                const sp<ABuffer> &buffer = inBuffers.itemAt(index);
+                int64_t timeUs = 0ll;
+                uint32_t bufferFlags = 0;
+
+                if (extractor->readSampleData(buffer) != OK) {
+                    buffer->setRange(0, 0);
+                    bufferFlags = MediaCodec::BUFFER_FLAG_EOS;
+                    signalledInputEOS = true;
+                } else {
+                    CHECK_EQ(extractor->getSampleTime(&timeUs), (status_t)OK);
+                    queueTimesUs.add(timeUs, ALooper::GetNowUs());
+                    extractor->advance();
+                }
+
+                err = codec->queueInputBuffer(
+                        index, 0 /* offset */, buffer->size(), timeUs, bufferFlags);
+            } else if (err == -EAGAIN) {
+                err = OK;
+            }
+        }
+
+        if (err != OK) {
+            break;
+        }
+
+        size_t index;
+        size_t offset;
+        size_t size;
+        int64_t presentationTimeUs;
+        uint32_t flags;
+        err = codec->dequeueOutputBuffer(
+                &index, &offset, &size, &presentationTimeUs, &flags,
+                kTimeout);
+
+        if (err == OK) {
+            ssize_t queued = queueTimesUs.indexOfKey(presentationTimeUs);
+            if (queued >= 0) {
+                run->mLatenciesUs.push(
+                        ALooper::GetNowUs() - queueTimesUs.valueAt(queued));
+                queueTimesUs.removeItemsAt(queued);
+            }
+            if (size > 0 && !(flags & MediaCodec::BUFFER_FLAG_CODECCONFIG)) {
+                ++run->mNumFrames;
+            }
+            if (flags & MediaCodec::BUFFER_FLAG_EOS) {
+                sawOutputEOS = true;
+            }
+            err = codec->releaseOutputBuffer(index);
+        } else if (err == INFO_OUTPUT_BUFFERS_CHANGED
+                || err == INFO_FORMAT_CHANGED
+                || err == -EAGAIN) {
+            err = OK;
+        }
+    }
+
+    run->mElapsedTimeUs = ALooper::GetNowUs() - startTimeUs;
+    getrusage(RUSAGE_SELF, &usage);
+    run->mCpuTimeUs = cpuTimeUs(usage) - startCpuTimeUs;
+    run->mMaxRssKb = usage.ru_maxrss;
+    run->mStatus = err;
+
+    codec->release();
+
+    run->mLatenciesUs.sort(compareLatencies);
+}
+
+// Runs every decoder there is for the tracks asked for, runs times each,
+// and prints the results as one JSON object for them to be compared across
+// builds and devices.
+static int benchmark(
+        const sp<ALooper> &looper,
+        const char *path,
+        bool useAudio,
+        bool useVideo,
+        int runs) {
+    sp<NuMediaExtractor> extractor = new NuMediaExtractor;
+    if (extractor->setDataSource(NULL /* httpService */, path) != OK) {
+        fprintf(stderr, "unable to instantiate extractor.\n");
+        return 1;
+    }
+
+    sp<IMediaCodecList> list = MediaCodecList::getInstance();
+    if (list == NULL) {
+        fprintf(stderr, "unable to get the codec list.\n");
+        return 1;
+    }
+
+    printf("{\n  \"file\": %s,\n  \"runs\": %d,\n  \"results\": [",
+           jsonString(path).c_str(), runs);
+
+    bool first = true;
+    bool haveAudio = false;
+    bool haveVideo = false;
+    for (size_t i = 0; i < extractor->countTracks(); ++i) {
+        sp<AMessage> format;
+        CHECK_EQ(extractor->getTrackFormat(i, &format), (status_t)OK);
+
+        AString mime;
+        CHECK(format->findString("mime", &mime));
+
+        bool isAudio = !strncasecmp(mime.c_str(), "audio/", 6);
+        bool isVideo = !strncasecmp(mime.c_str(), "video/", 6);
+
+        if (useAudio && !haveAudio && isAudio) {
+            haveAudio = true;
+        } else if (useVideo && !haveVideo && isVideo) {
+            haveVideo = true;
+        } else {
+            continue;
+        }
+
+        for (ssize_t codecIndex = list->findCodecByType(mime.c_str(), false /* encoder */);
+                codecIndex >= 0;
+                codecIndex = list->findCodecByType(
+                        mime.c_str(), false /* encoder */, codecIndex + 1)) {
+            sp<MediaCodecInfo> info = list->getCodecInfo(codecIndex);
+            if (info == NULL) {
+                continue;
+            }
+            const char *codecName = info->getCodecName();
+
+            for (int r = 0; r < runs; ++r) {
+                BenchmarkRun run;
+                benchmarkCodec(looper, path, i, codecName, &run);
+
+                double fps = run.mElapsedTimeUs > 0
+                        ? run.mNumFrames * 1E6 / run.mElapsedTimeUs : 0.0;
+
+                printf("%s\n    {\"track\": %zu, \"mime\": %s, \"codec\": %s, "
+                       "\"run\": %d, \"status\": %d, \"frames\": %" PRId64 ", "
+                       "\"elapsed_us\": %" PRId64 ", \"fps\": %.2f, "
+                       "\"latency_us\": {\"p50\": %" PRId64 ", \"p90\": %" PRId64
+                       ", \"p99\": %" PRId64 ", \"max\": %" PRId64 "}, "
+                       "\"cpu_us\": %" PRId64 ", \"max_rss_kb\": %ld}",
+                       first ? "" : ",",
+                       i, jsonString(mime.c_str()).c_str(),
+                       jsonString(codecName).c_str(),
+                       r, run.mStatus, run.mNumFrames,
+                       run.mElapsedTimeUs, fps,
+                       percentile(run.mLatenciesUs, 0.5),
+                       percentile(run.mLatenciesUs, 0.9),
+                       percentile(run.mLatenciesUs, 0.99),
+                       percentile(run.mLatenciesUs, 1.0),
+                       run.mCpuTimeUs, run.mMaxRssKb);
+                fflush(stdout);
+                first = false;
+            }
+        }
+    }
+
+    printf("\n  ]\n}\n");
+    return 0;
+}
+
+}  // namespace android
+
 int main(int argc, char **argv) {
     using namespace android;
 
@@ -320,9 +592,10 @@ int main(int argc, char **argv) {
     bool useVideo = false;
     bool playback = false;
     bool useSurface = false;
+    int benchmarkRuns = 0;
 
     int res;
-    while ((res = getopt(argc, argv, "havpSD")) >= 0) {
+    while ((res = getopt(argc, argv, "havpSDb:")) >= 0) {
         switch (res) {
             case 'a':
             {
@@ -348,6 +621,15 @@ int main(int argc, char **argv) {
                 break;
             }
 
+            case 'b':
+            {
+                benchmarkRuns = atoi(optarg);
+                if (benchmarkRuns <= 0) {
+                    usage(me);
+                }
+                break;
+            }
+
             case '?':
             case 'h':
             default:
@@ -375,6 +657,12 @@ int main(int argc, char **argv) {
     sp<ALooper> looper = new ALooper;
     looper->start();
 
+    if (benchmarkRuns > 0) {
+        int ret = benchmark(looper, argv[0], useAudio, useVideo, benchmarkRuns);
+        looper->stop();
+        return ret;
+    }
+
     sp<SurfaceComposerClient> composerClient;
     sp<SurfaceControl> control;
     sp<Surface> surface;
@@ -18,50 +18,68 @@
 #define LOG_TAG "ClearKeyCryptoPlugin"
 #include <utils/Log.h>
 
-#include <openssl/aes.h>
+#include <media/stagefright/MediaErrors.h>
+#include <openssl/evp.h>
 
 #include "AesCtrDecryptor.h"
 
 namespace clearkeydrm {
 
-static const size_t kBlockBitCount = kBlockSize * 8;
-
+// Through EVP, for libcrypto to use the AES instructions of the CPU when it
+// has them.  The counter runs on across the encrypted ranges of a sample as
+// if they were one, so they all go through the one context.
 android::status_t AesCtrDecryptor::decrypt(const android::Vector<uint8_t>& key,
         const Iv iv, const uint8_t* source,
         uint8_t* destination,
         const SubSample* subSamples,
         size_t numSubSamples,
         size_t* bytesDecryptedOut) {
-    uint32_t blockOffset = 0;
-    uint8_t previousEncryptedCounter[kBlockSize];
-    memset(previousEncryptedCounter, 0, kBlockSize);
+    if (key.size() != kBlockSize) {
+        ALOGE("key of %zu bytes for AES-128", key.size());
+        return android::ERROR_DRM_DECRYPT;
+    }
+
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    if (ctx == NULL) {
+        return android::ERROR_DRM_DECRYPT;
+    }
+    if (!EVP_DecryptInit_ex(ctx, EVP_aes_128_ctr(), NULL, key.array(), iv)) {
+        EVP_CIPHER_CTX_free(ctx);
+        return android::ERROR_DRM_DECRYPT;
+    }
 
+    // decrypting in place leaves the clear data where it is
+    bool inPlace = (source == destination);
+    android::status_t err = android::OK;
     size_t offset = 0;
-    AES_KEY opensslKey;
-    AES_set_encrypt_key(key.array(), kBlockBitCount, &opensslKey);
-    Iv opensslIv;
-    memcpy(opensslIv, iv, sizeof(opensslIv));
 
     for (size_t i = 0; i < numSubSamples; ++i) {
         const SubSample& subSample = subSamples[i];
 
         if (subSample.mNumBytesOfClearData > 0) {
-            memcpy(destination + offset, source + offset,
-                    subSample.mNumBytesOfClearData);
+            if (!inPlace) {
+                memcpy(destination + offset, source + offset,
+                        subSample.mNumBytesOfClearData);
+            }
             offset += subSample.mNumBytesOfClearData;
         }
 
         if (subSample.mNumBytesOfEncryptedData > 0) {
-            AES_ctr128_encrypt(source + offset, destination + offset,
-                    subSample.mNumBytesOfEncryptedData, &opensslKey,
-                    opensslIv, previousEncryptedCounter,
-                    &blockOffset);
+            int outLength = 0;
+            if (!EVP_DecryptUpdate(ctx, destination + offset, &outLength,
+                    source + offset, subSample.mNumBytesOfEncryptedData)
+                    || outLength != (int)subSample.mNumBytesOfEncryptedData) {
+                err = android::ERROR_DRM_DECRYPT;
+                break;
+            }
             offset += subSample.mNumBytesOfEncryptedData;
         }
     }
 
+    EVP_CIPHER_CTX_free(ctx);
+
     *bytesDecryptedOut = offset;
-    return android::OK;
+    return err;
 }
 
 } // namespace clearkeydrm
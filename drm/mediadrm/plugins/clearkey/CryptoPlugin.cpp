@@ -55,9 +55,11 @@ ssize_t CryptoPlugin::decrypt(bool secure, const KeyId keyId, const Iv iv,
             }
 
             if (subSample.mNumBytesOfClearData != 0) {
-                memcpy(reinterpret_cast<uint8_t*>(dstPtr) + offset,
-                       reinterpret_cast<const uint8_t*>(srcPtr) + offset,
-                       subSample.mNumBytesOfClearData);
+                if (dstPtr != srcPtr) {
+                    memcpy(reinterpret_cast<uint8_t*>(dstPtr) + offset,
+                           reinterpret_cast<const uint8_t*>(srcPtr) + offset,
+                           subSample.mNumBytesOfClearData);
+                }
                 offset += subSample.mNumBytesOfClearData;
             }
         }
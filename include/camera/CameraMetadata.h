@@ -23,6 +23,7 @@
 
 namespace android {
 class Parcel;
+class CameraMetadataArena;
 
 /**
  * A convenience wrapper around the C-based camera_metadata_t library.
@@ -118,6 +119,17 @@ class CameraMetadata {
      */
     status_t sort();
 
+    /**
+     * Keep a tag to entry index, so that find(), exists(), update() and erase()
+     * take constant time instead of searching the buffer. Meant for objects
+     * that are looked up a lot, such as the static info or a repeating request.
+     * The index is built on the first lookup, and rebuilt after any change
+     * that moves entries around; it costs a few KB. Vendor tags are still
+     * searched. The setting is kept across changes of the metadata itself,
+     * but not by copies.
+     */
+    void setIndexed(bool indexed);
+
     /**
      * Update metadata entry. Will create entry if it doesn't exist already, and
      * will reallocate the buffer if insufficient space exists. Overloaded for
@@ -188,6 +200,10 @@ class CameraMetadata {
     // Metadata object is unchanged when reading from parcel fails.
     status_t readFromParcel(Parcel *parcel);
     status_t writeToParcel(Parcel *parcel) const;
+    // Large metadata goes through a slot of the arena, *slot set to it or -1,
+    // see CameraMetadataArena
+    status_t writeToParcel(Parcel *parcel, CameraMetadataArena *arena,
+                           int *slot) const;
 
     /**
       * Caller becomes the owner of the new metadata
@@ -210,6 +226,29 @@ class CameraMetadata {
     camera_metadata_t *mBuffer;
     bool               mLocked;
 
+    // Tags per section kept by the index, beyond which tags are searched
+    static const size_t kIndexSectionTags = 64;
+
+    bool               mIndexed;
+    // Whether mIndex matches mBuffer, always false unless mIndexed
+    mutable bool       mIndexValid;
+    // Entry index + 1 of each tag by section and tag, 0 for a missing tag
+    mutable Vector<uint16_t> mIndex;
+
+    /**
+     * Find the entry of a tag with the index if possible, searching otherwise
+     */
+    status_t findEntry(uint32_t tag, camera_metadata_entry_t *entry);
+    status_t findEntry(uint32_t tag, camera_metadata_ro_entry_t *entry) const;
+
+    /**
+     * Look up the entry index of a tag: OK if found, NAME_NOT_FOUND if
+     * missing, NO_INIT if the index can't tell.
+     */
+    status_t findIndexed(uint32_t tag, size_t *index) const;
+    bool buildIndex() const;
+    static ssize_t indexSlot(uint32_t tag);
+
     /**
      * Check if tag has a given type
      */
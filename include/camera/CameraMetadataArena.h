@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_CLIENT_CAMERA2_CAMERAMETADATAARENA_CPP
+#define ANDROID_CLIENT_CAMERA2_CAMERAMETADATAARENA_CPP
+
+#include "system/camera_metadata.h"
+#include <utils/Errors.h>
+#include <utils/Mutex.h>
+
+namespace android {
+
+class Parcel;
+
+/**
+ * A shared memory region the metadata sent to one receiver is written to,
+ * for a large capture result to cost a copy in and a copy out instead of a
+ * new blob region, mapped on both sides, per result.
+ *
+ * The region is split in kNumSlots slots. A slot is taken by writeToParcel()
+ * and given back by the receiving CameraMetadata::readFromParcel() once it
+ * copied the metadata out, the receiver mapping the region once and keeping
+ * it mapped. The parcel holds the region, the slot and the size.
+ *
+ * An arena is shared with the one process it sends to. The receiver can write
+ * to the region, so the sender never reads anything back from it but the
+ * state of the slots.
+ */
+class CameraMetadataArena {
+  public:
+    CameraMetadataArena();
+    ~CameraMetadataArena();
+
+    /**
+     * Write the metadata through a free slot, or as a blob like
+     * CameraMetadata::writeToParcel() does when it is small, too large for a
+     * slot or all the slots are in flight. *slot is set to the slot taken, -1
+     * for none, to be released if the transaction fails.
+     */
+    status_t writeToParcel(Parcel &parcel, const camera_metadata_t *metadata,
+                           int *slot);
+    void release(int slot);
+
+    /**
+     * Receiving side, from CameraMetadata::readFromParcel() once it read
+     * kParcelMarker.
+     */
+    static status_t readFromParcel(const Parcel &parcel,
+                                   camera_metadata_t **out);
+
+    // In place of the blob size of CameraMetadata::writeToParcel()
+    static const int32_t kParcelMarker = -1;
+
+  private:
+    static const size_t kArenaSize = 4 * 1024 * 1024;
+    static const int kNumSlots = 8;
+    static const size_t kSlotSize = kArenaSize / kNumSlots;
+    // The state of a slot, at its start, the metadata after it
+    static const size_t kSlotHeaderSize = 64;
+    // Smaller metadata is written inline in the parcel by writeBlob()
+    static const size_t kMinArenaMetadataSize = 16 * 1024;
+
+    enum {
+        SLOT_FREE = 0,
+        SLOT_BUSY = 1,
+    };
+
+    Mutex    mLock;
+    int      mFd;
+    uint8_t *mBase;
+    bool     mInitFailed;
+
+    bool init_l();
+
+    static volatile int32_t *slotState(uint8_t *base, int slot);
+
+    CameraMetadataArena(const CameraMetadataArena&);
+    CameraMetadataArena &operator=(const CameraMetadataArena&);
+};
+
+}; // namespace android
+
+#endif
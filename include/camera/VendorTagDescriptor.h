@@ -128,11 +128,25 @@ class VendorTagDescriptor
         static sp<VendorTagDescriptor> getGlobalVendorTagDescriptor();
     protected:
         VendorTagDescriptor();
-        KeyedVector<String8, KeyedVector<String8, uint32_t>*> mReverseMapping;
+
+        // Builds mTagIndex and mNameIndex, once the maps below are filled.
+        void buildIndex();
+        // Returns the index of the tag in the maps below, or -1 if it is not defined.
+        ssize_t indexOfTag(uint32_t tag) const;
+        static uint32_t hashTag(uint32_t tag);
+        static uint32_t hashName(const char* section, const char* name);
+
+        // The three maps hold the same tags, so an index is valid in all of them.
         KeyedVector<uint32_t, String8> mTagToNameMap;
         KeyedVector<uint32_t, uint32_t> mTagToSectionMap; // Value is offset in mSections
         KeyedVector<uint32_t, int32_t> mTagToTypeMap;
         SortedVector<String8> mSections;
+        // Open addressing tables of indices in the maps above, or -1 for an empty slot,
+        // hashed on the tag and on the section and tag names respectively. Both have
+        // mIndexMask + 1 slots, a power of two at least twice the tag count.
+        Vector<int32_t> mTagIndex;
+        Vector<int32_t> mNameIndex;
+        uint32_t mIndexMask;
         // must be int32_t to be compatible with Parcel::writeInt32
         int32_t mTagCount;
     private:
@@ -19,6 +19,7 @@
 
 #include <stdint.h>
 #include <common_time/ICommonClock.h>
+#include <common_time/local_clock.h>
 #include <utils/threads.h>
 
 namespace android {
@@ -40,6 +41,11 @@ namespace android {
 // ref counted ICommonClock interface across all clients and automatically
 // registering and unregistering a listener whenever there are CCHelper
 // instances active in the process.
+//
+// The local time and its frequency come from the local time HAL the service
+// itself reads, in process instead of through a binder call, whenever the HAL
+// can be opened here.  The common frequency never changes and is only asked
+// for once.
 class CCHelper {
   public:
     CCHelper();
@@ -61,10 +67,18 @@ class CCHelper {
 
     static bool verifyClock_l();
 
+    status_t getServiceCommonFreq(uint64_t* freq);
+    status_t getServiceLocalTime(int64_t* localTime);
+    status_t getServiceLocalFreq(uint64_t* freq);
+
+    LocalClock local_clock_;
+
     static Mutex lock_;
     static sp<ICommonClock> common_clock_;
     static sp<ICommonClockListener> common_clock_listener_;
     static uint32_t ref_count_;
+    // 0 until the service has told it
+    static uint64_t common_freq_;
 };
 
 
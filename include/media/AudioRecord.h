@@ -79,6 +79,19 @@ public:
         };
     };
 
+    /* Passed to EVENT_MORE_DATA in TRANSFER_CALLBACK_SPLIT mode: the data available at the
+     * read position, which may wrap around the end of the shared buffer into 'second'.
+     * Both parts point directly into the shared buffer. 'first' is the first field so that
+     * the info can also be read as a Buffer.
+     */
+    class SplitBuffer
+    {
+    public:
+        Buffer      first;          // contiguous data at the read position
+        Buffer      second;         // data continued at the start of the shared buffer,
+                                    // frameCount and size are zero if the data does not wrap
+    };
+
     /* As a convenience, if a callback is supplied, a handler thread
      * is automatically created with the appropriate priority. This thread
      * invokes the callback when a new buffer becomes available or various conditions occur.
@@ -90,6 +103,9 @@ public:
      *          - EVENT_MORE_DATA: pointer to AudioRecord::Buffer struct. The callback must not read
      *            more bytes than indicated by 'size' field and update 'size' if fewer bytes are
      *            consumed.
+     *            In TRANSFER_CALLBACK_SPLIT mode, pointer to AudioRecord::SplitBuffer struct.
+     *            The callback updates the 'size' field of both parts, and may only consume
+     *            from 'second' after consuming all of 'first'.
      *          - EVENT_OVERRUN: unused.
      *          - EVENT_MARKER: pointer to const uint32_t containing the marker position in frames.
      *          - EVENT_NEW_POS: pointer to const uint32_t containing the new position in frames.
@@ -120,6 +136,7 @@ public:
         TRANSFER_CALLBACK,  // callback EVENT_MORE_DATA
         TRANSFER_OBTAIN,    // FIXME deprecated: call obtainBuffer() and releaseBuffer()
         TRANSFER_SYNC,      // synchronous read()
+        TRANSFER_CALLBACK_SPLIT, // callback EVENT_MORE_DATA with wraparound in one SplitBuffer
     };
 
     /* Constructs an uninitialized AudioRecord. No connection with
@@ -502,6 +519,7 @@ private:
     sp<IMemory>             mCblkMemory;
     audio_track_cblk_t*     mCblk;              // re-load after mLock.unlock()
     sp<IMemory>             mBufferMemory;
+    void*                   mBuffers;           // start of the shared buffer
     audio_io_handle_t       mInput;             // returned by AudioSystem::getInput()
 
     int                     mPreviousPriority;  // before start()
@@ -276,7 +276,7 @@ public:
     static status_t setEffectEnabled(int id, bool enabled);
 
     // clear stream to output mapping cache (gStreamOutputMap)
-    // and output configuration cache (gOutputs)
+    // and output configuration cache
     static void clearAudioConfigCache();
 
     static const sp<IAudioPolicyService>& get_audio_policy_service();
@@ -394,10 +394,6 @@ private:
 
     static sp<IAudioPolicyService> gAudioPolicyService;
 
-    // list of output descriptors containing cached parameters
-    // (sampling rate, framecount, channel count...)
-    static DefaultKeyedVector<audio_io_handle_t, OutputDescriptor *> gOutputs;
-
     static sp<AudioPortCallback> gAudioPortCallback;
 };
 
@@ -69,6 +69,8 @@ public:
 #ifdef QCOM_DIRECTTRACK
         EVENT_HW_FAIL = 9,          // ADSP failure.
 #endif
+        EVENT_UNDERRUN_RISK = 10,   // AudioFlinger predicts an underrun from the recent pattern
+                                    // of buffer refills.  Delivered at most once per episode.
     };
 
     /* Client should declare Buffer on the stack and pass address to obtainBuffer()
@@ -117,6 +119,9 @@ public:
      *          - EVENT_NEW_IAUDIOTRACK: unused.
      *          - EVENT_STREAM_END: unused.
      *          - EVENT_NEW_TIMESTAMP: pointer to const AudioTimestamp.
+     *          - EVENT_UNDERRUN_RISK: pointer to const uint32_t containing the number of frames
+     *            AudioFlinger recommends to keep written ahead of playback, at most frameCount().
+     *            A client with a flexible write size can write larger or earlier chunks.
      */
 
     typedef void (*callback_t)(int event, void* user, void *info);
@@ -467,6 +472,13 @@ public:
      */
             audio_io_handle_t    getOutput() const;
 
+    /* Returns the server side of the track, to batch updates of several tracks with
+     * IAudioFlinger::setTrackParameters(), or 0 if the track is not initialized.
+     * It changes when the track is re-created after an invalidation, and values set through
+     * setTrackParameters() are not seen by getVolume() and getSampleRate().
+     */
+            sp<IAudioTrack>      getIAudioTrack() const;
+
     /* Returns the unique session ID associated with this track.
      *
      * Parameters:
@@ -567,6 +579,16 @@ public:
      */
             ssize_t     write(const void* buffer, size_t size, bool blocking = true);
 
+    /* Opt in to polling the shared control block for up to spinUs microseconds before blocking
+     * in obtainBuffer(), write() or the callback thread.  This trades CPU time for fewer futex
+     * syscalls on both sides, and is intended for streaming tracks with short periods.
+     * The budget adapts to how often polling succeeds.  0 disables polling, which is the default.
+     * Returned status (from utils/Errors.h) can be:
+     *  - NO_ERROR: successful operation
+     *  - INVALID_OPERATION: the AudioTrack uses a static buffer
+     */
+            status_t    setObtainSpinBudget(uint32_t spinUs);
+
     /*
      * Dumps the state of an audio track.
      */
@@ -811,6 +833,7 @@ protected:
 
     bool                    mInUnderrun;            // whether track is currently in underrun state
     uint32_t                mPausedPosition;
+    uint32_t                mSpinBudgetUs;          // see setObtainSpinBudget(), 0 if disabled
 
     //the following structures are used for tracks with PCM data that are offloaded
     audio_offload_info_t    mPcmTrackOffloadInfo;   //offload info structure for pcm tracks
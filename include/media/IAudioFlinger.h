@@ -40,6 +40,7 @@
 #include <media/IEffect.h>
 #include <media/IEffectClient.h>
 #include <utils/String8.h>
+#include <utils/Vector.h>
 
 namespace android {
 
@@ -60,6 +61,23 @@ public:
     };
     typedef uint32_t track_flags_t;
 
+    // An update of one parameter of a playback track, see setTrackParameters()
+    struct TrackParameter {
+        enum Key {
+            VOLUME_LEFT,        // gain of the left channel, 0.0 to 1.0
+            VOLUME_RIGHT,       // gain of the right channel, 0.0 to 1.0
+            SEND_LEVEL,         // gain of the auxiliary effect send, 0.0 to 1.0
+            SAMPLE_RATE,        // playback sample rate in Hz
+        };
+        sp<IAudioTrack> mTrack;
+        Key             mKey;
+        float           mValue;
+    };
+    // Maximum number of updates in one call to setTrackParameters()
+    static const size_t kMaxTrackParameters = 256;
+    // Maximum size of a buffer given to shareStaticBuffer()
+    static const size_t kMaxSharedStaticBufferSize = 1024 * 1024;
+
     // invariant on exit for all APIs that return an sp<>:
     //   (return value != 0) == (*status == NO_ERROR)
 
@@ -258,6 +276,23 @@ public:
 
     /* Get the HW synchronization source used for an audio session */
     virtual audio_hw_sync_t getAudioHwSyncForSession(audio_session_t sessionId) = 0;
+
+    /* Set parameters of several playback tracks in one call.  The updates of the tracks of
+     * one playback thread are applied together, in order, so that they all take effect at the
+     * same mix cycle.  They are written to the track control blocks as if the client had set
+     * them, but are not seen by the client side AudioTrack.
+     * Returns BAD_VALUE, and applies none, if a track is not a track of this AudioFlinger or a
+     * value is out of range.
+     */
+    virtual status_t setTrackParameters(const Vector<TrackParameter>& parameters) = 0;
+
+    /* Share the PCM of a static track with the other clients, so that a sound loaded by many
+     * processes is in memory once.  Returns a read-only copy of 'buffer', the one already shared
+     * if a client shared the same content before, or 0 if the buffer is empty or larger than
+     * kMaxSharedStaticBufferSize.  The copy lives for as long as a client or a track holds it:
+     * the caller can release its own buffer and use the copy as the shared buffer of its tracks.
+     */
+    virtual sp<IMemory> shareStaticBuffer(const sp<IMemory>& buffer) = 0;
 };
 
 
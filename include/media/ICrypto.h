@@ -25,6 +25,7 @@
 namespace android {
 
 struct AString;
+class IMemory;
 
 struct ICrypto : public IInterface {
     DECLARE_META_INTERFACE(Crypto);
@@ -51,6 +52,18 @@ struct ICrypto : public IInterface {
             void *dstPtr,
             AString *errorDetailMsg) = 0;
 
+    // As above, the source data at offset in sharedBuffer instead, which
+    // the service maps rather than have every byte copied into the parcel.
+    virtual ssize_t decrypt(
+            bool secure,
+            const uint8_t key[16],
+            const uint8_t iv[16],
+            CryptoPlugin::Mode mode,
+            const sp<IMemory> &sharedBuffer, size_t offset,
+            const CryptoPlugin::SubSample *subSamples, size_t numSubSamples,
+            void *dstPtr,
+            AString *errorDetailMsg) = 0;
+
 private:
     DISALLOW_EVIL_CONSTRUCTORS(ICrypto);
 };
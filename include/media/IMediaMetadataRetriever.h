@@ -23,6 +23,8 @@
 #include <binder/IMemory.h>
 #include <utils/KeyedVector.h>
 #include <utils/RefBase.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
 
 namespace android {
 
@@ -41,8 +43,21 @@ public:
 
     virtual status_t        setDataSource(int fd, int64_t offset, int64_t length) = 0;
     virtual sp<IMemory>     getFrameAtTime(int64_t timeUs, int option) = 0;
+    virtual sp<IMemory>     getThumbnailAtTime(
+            int64_t timeUs, int option, int32_t width, int32_t height) = 0;
     virtual sp<IMemory>     extractAlbumArt() = 0;
     virtual const char*     extractMetadata(int keyCode) = 0;
+
+    // Most files, and keys, of one extractMetadataBatch() call, for the fds
+    // of a transaction to stay well within the file limit of both ends.
+    static const size_t kMaxBatchSize = 256;
+
+    // The metadata of many files in one transaction, each file's values
+    // under the keys it has, independent of any data source set. The fds
+    // stay the caller's, read from during the call only.
+    virtual status_t        extractMetadataBatch(
+            const Vector<int> &fds, const Vector<int> &keyCodes,
+            Vector<KeyedVector<int, String8> > *values) = 0;
 };
 
 // ----------------------------------------------------------------------------
@@ -198,6 +198,11 @@ public:
     DECLARE_META_INTERFACE(OMXObserver);
 
     virtual void onMessage(const omx_message &msg) = 0;
+
+    // Messages that were queued up together are delivered in one call (and
+    // one transaction), in order. The default hands them to onMessage() one
+    // by one.
+    virtual void onMessages(const List<omx_message> &messages);
 };
 
 ////////////////////////////////////////////////////////////////////////////////
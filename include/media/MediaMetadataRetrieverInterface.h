@@ -41,6 +41,10 @@ public:
 
     virtual status_t    setDataSource(int fd, int64_t offset, int64_t length) = 0;
     virtual VideoFrame* getFrameAtTime(int64_t timeUs, int option) = 0;
+    // A frame downscaled by as much as leaves it at least width x height as
+    // displayed, for a thumbnail of that size to be scaled from.
+    virtual VideoFrame* getThumbnailAtTime(
+            int64_t timeUs, int option, int32_t width, int32_t height) = 0;
     virtual MediaAlbumArt* extractAlbumArt() = 0;
     virtual const char* extractMetadata(int keyCode) = 0;
 };
@@ -53,6 +57,10 @@ public:
 
     virtual             ~MediaMetadataRetrieverInterface() {}
     virtual VideoFrame* getFrameAtTime(int64_t timeUs, int option) { return NULL; }
+    virtual VideoFrame* getThumbnailAtTime(
+            int64_t timeUs, int option, int32_t width, int32_t height) {
+        return getFrameAtTime(timeUs, option);
+    }
     virtual MediaAlbumArt* extractAlbumArt() { return NULL; }
     virtual const char* extractMetadata(int keyCode) { return NULL; }
 };
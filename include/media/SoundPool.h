@@ -32,6 +32,8 @@ static const int IDLE_PRIORITY = -1;
 // forward declarations
 class SoundEvent;
 class SoundPoolThread;
+class SoundPoolCache;
+class SoundPoolMixer;
 class SoundPool;
 
 // for queued events
@@ -62,7 +64,7 @@ public:
     size_t size() { return mSize; }
     int state() { return mState; }
     uint8_t* data() { return static_cast<uint8_t*>(mData->pointer()); }
-    status_t doLoad();
+    status_t doLoad(const SoundPoolCache* cache = NULL);
     void startLoad() { mState = LOADING; }
     sp<IMemory> getIMemory() { return mData; }
 
@@ -74,6 +76,7 @@ public:
 
 private:
     void init();
+    void shareData();
 
     size_t              mSize;
     volatile int32_t    mRefCount;
@@ -149,6 +152,8 @@ private:
     static void callback(int event, void* user, void *info);
     void process(int event, void *info, unsigned long toggle);
     bool doStop_l();
+    // non NULL when the pool mixes its channels into a single track
+    SoundPoolMixer* mixer();
 
     SoundPool*          mSoundPool;
     sp<AudioTrack>      mAudioTrack;
@@ -185,6 +190,11 @@ public:
     void setRate(int channelID, float rate);
     const audio_attributes_t* attributes() { return &mAttributes; }
 
+    // Keeps the decoded PCM of samples loaded from local files in directory, and maps
+    // it instead of decoding the next time the same unmodified file is loaded. Must be
+    // called before the first load; the directory must exist and be private to the caller.
+    status_t setCacheDirectory(const char* directory);
+
     // called from SoundPoolThread
     void sampleLoaded(int sampleID);
 
@@ -218,6 +228,8 @@ private:
     Mutex                   mRestartLock;
     Condition               mCondition;
     SoundPoolThread*        mDecodeThread;
+    SoundPoolCache*         mCache;
+    SoundPoolMixer*         mMixer;
     SoundChannel*           mChannelPool;
     List<SoundChannel*>     mChannels;
     List<SoundChannel*>     mRestart;
@@ -20,6 +20,8 @@
 #include <utils/RefBase.h>
 #include <utils/KeyedVector.h>
 #include <utils/threads.h>
+#include <utils/Vector.h>
+#include <binder/IMemory.h>
 #include <media/AudioSystem.h>
 #include <media/AudioTrack.h>
 
@@ -212,6 +214,8 @@ private:
     static const unsigned int TONEGEN_MAX_SEGMENTS = 12;  // Maximun number of segments in a tone descriptor
     static const unsigned int TONEGEN_INF = 0xFFFFFFFF;  // Represents infinite time duration
     static const float TONEGEN_GAIN = 0.9;  // Default gain passed to  WaveGenerator().
+    static const unsigned int TONEGEN_MAX_STATIC_MS = 6000;  // Longest tone rendered in static mode
+    static const unsigned int TONEGEN_MAX_STATIC_TONES = 8;  // Rendered tones kept for reuse
 
     // ToneDescriptor class contains all parameters needed to generate a tone:
     //    - The array waveFreq[]:
@@ -277,12 +281,39 @@ private:
     unsigned int mProcessSize;  // Size of audio blocks generated at a time by audioCallback() (in PCM frames).
     struct timespec mStartTime; // tone start time: needed to guaranty actual tone duration
 
+    // Static mode, enabled by property media.tonegen.static: a tone of finite duration, or whose
+    // sequence repeats from its first segment, is rendered once into shared memory and played,
+    // and looped if needed, by a static AudioTrack instead of being generated by audioCallback().
+    // Rendered tones are kept for reuse by later requests of the same tone and duration.
+    class StaticTone {
+    public:
+        const ToneDescriptor *mpToneDesc;  // rendered tone
+        int mDurationMs;  // requested tone duration, -1 if not limited
+        sp<IMemory> mBuffer;  // rendered PCM
+        unsigned int mFrameCount;  // number of PCM frames in mBuffer
+        int mLoopCount;  // number of times mBuffer is repeated after the first time, -1 for ever
+    };
+
+    bool mStaticMode;  // whether static mode is enabled
+    Vector<StaticTone> mStaticTones;  // rendered tones, least recently used first
+    sp<AudioTrack> mpStaticTrack;  // static track playing the most recently used rendered tone
+    sp<IMemory> mStaticTrackBuffer;  // shared buffer of mpStaticTrack
+    bool mStaticPlaying;  // whether a tone was started on mpStaticTrack and not stopped
+
     bool initAudioTrack();
     static void audioCallback(int event, void* user, void *info);
     bool prepareWave();
     unsigned int numWaves(unsigned int segmentIdx);
     void clearWaveGens();
     tone_type getToneForRegion(tone_type toneType);
+    bool startStaticTone_l();
+    void stopStaticTone_l();
+    bool renderStaticTone(StaticTone *pTone);
+    unsigned int segmentSmp(unsigned int segmentIdx) const;
+    uint64_t sequenceSmp(unsigned int segmentIdx) const;
+    unsigned int nextSegment(unsigned int segmentIdx, unsigned short *pLoopCounter) const;
+    void renderSegment(short *outBuffer, unsigned int segmentIdx, unsigned int count,
+            bool rampDown);
 
     // WaveGenerator generates a single sine wave
     class WaveGenerator {
@@ -301,14 +332,17 @@ private:
                 unsigned int command);
 
     private:
-        static const short GEN_AMP = 32000;  // amplitude of generator
-        static const short S_Q14 = 14;  // shift for Q14
         static const short S_Q15 = 15;  // shift for Q15
-
-        short mA1_Q14;  // Q14 coefficient
-        // delay line of full amplitude generator
-        short mS1, mS2;  // delay line S2 oldest
-        short mS2_0;  // saved value for reinitialisation
+        // The sine wave is read from a table shared by all generators, with linear interpolation.
+        static const unsigned int SINE_TABLE_BITS = 10;  // log2 of the table size for one period
+        static const unsigned int SINE_FRAC_BITS = 32 - SINE_TABLE_BITS;  // phase bits below index
+        static short sSineTable[(1 << SINE_TABLE_BITS) + 1];  // Q15 sine, plus a guard entry
+        static pthread_once_t sSineTableOnce;
+        static void initSineTable();
+        static inline long sine(uint32_t phase);
+
+        uint32_t mPhase;  // current phase, in 2^-32 periods
+        uint32_t mPhaseInc;  // phase increment per sample, in 2^-32 periods
         short mAmplitude_Q15;  // Q15 amplitude
     };
 
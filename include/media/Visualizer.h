@@ -19,6 +19,7 @@
 
 #include <media/AudioEffect.h>
 #include <audio_effects/effect_visualizer.h>
+#include <media/VisualizerFrame.h>
 #include <utils/Thread.h>
 
 /**
@@ -43,6 +44,9 @@
  * In addition to the polling capture mode, a callback mode is also available by installing a
  * callback function by use of the setCaptureCallBack() method. The rate at which the callback
  * is called as well as the type of data returned is specified.
+ * For display, getFrame() and setFrameCallBack() return frames made of a spectrum already
+ * decimated to a number of bands and of the peak and RMS measurements, computed by the effect
+ * in a single command instead of a waveform capture followed by an FFT in the client.
  * Before capturing data, the Visualizer must be enabled by calling the setEnabled() method.
  * When data capture is not needed any more, the Visualizer should be disabled.
  */
@@ -97,6 +101,16 @@ public:
     status_t setCaptureCallBack(capture_cbk_t cbk, void* user, uint32_t flags, uint32_t rate);
     void cancelCaptureCallBack();
 
+    // callback used to return periodic frames to the application. It is only called when the
+    // effect processed new audio since the previous frame.
+    typedef void (*frame_cbk_t)(void* user, const visualizer_frame_t *frame);
+
+    // install a callback to receive frames of the given number of bands at the rate specified
+    // in milliHertz. Only CAPTURE_CALL_JAVA is used in flags. Replaces a callback installed
+    // with setCaptureCallBack() and vice versa. Cancelled by cancelCaptureCallBack().
+    status_t setFrameCallBack(frame_cbk_t cbk, void* user, uint32_t bands, uint32_t flags,
+                              uint32_t rate);
+
     // set the capture size capture size must be a power of two in the range
     // [VISUALIZER_CAPTURE_SIZE_MAX. VISUALIZER_CAPTURE_SIZE_MIN]
     // must be called when the visualizer is not enabled
@@ -132,6 +146,11 @@ public:
     // are returned
     status_t getFft(uint8_t *fft);
 
+    // return a frame with a spectrum decimated to the given number of bands (a power of 2 in
+    // [VISUALIZER_FRAME_BANDS_MIN, VISUALIZER_FRAME_BANDS_MAX], at most half the capture size)
+    // and with the peak and RMS measurements if MEASUREMENT_MODE_PEAK_RMS is set.
+    status_t getFrame(uint32_t bands, visualizer_frame_t *frame);
+
 protected:
     // from IEffectClient
     virtual void controlStatusChanged(bool controlGranted);
@@ -170,6 +189,11 @@ private:
     void *mCaptureCbkUser;
     sp<CaptureThread> mCaptureThread;
     uint32_t mCaptureFlags;
+    frame_cbk_t mFrameCallBack;
+    void *mFrameCbkUser;
+    uint32_t mFrameBands;
+    bool mFrameDelivered;           // mLastFrameSequence is valid
+    uint32_t mLastFrameSequence;    // sequence of the last frame delivered to mFrameCallBack
 };
 
 
@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_MEDIA_VISUALIZERFRAME_H
+#define ANDROID_MEDIA_VISUALIZERFRAME_H
+
+#include <stdint.h>
+#include <hardware/audio_effect.h>
+
+#if __cplusplus
+extern "C" {
+#endif
+
+// Command returning a visualizer_frame_t computed by the visualizer effect in one call:
+// a spectrum decimated to the requested number of bands and the peak and RMS measurements.
+// Command data is a uint32_t, the number of bands: a power of two, at least
+// VISUALIZER_FRAME_BANDS_MIN, at most VISUALIZER_FRAME_BANDS_MAX and at most half the
+// capture size. Reply is a visualizer_frame_t.
+#define VISUALIZER_CMD_CAPTURE_FRAME (EFFECT_CMD_FIRST_PROPRIETARY + 2)
+
+#define VISUALIZER_FRAME_BANDS_MIN 4
+#define VISUALIZER_FRAME_BANDS_MAX 128
+
+// A band value of 0 is VISUALIZER_FRAME_FLOOR_MB or less below full scale, 255 is full scale.
+#define VISUALIZER_FRAME_FLOOR_MB (-9600)
+
+typedef struct visualizer_frame_s {
+    uint32_t sequence;      // incremented each time the effect processes a new buffer, so that
+                            // an unchanged value means that no audio was played since last frame
+    uint32_t samplingRate;  // sampling rate of the audio, in Hz
+    int32_t peakmB;         // peak and RMS over the measurement window, in mB, or
+    int32_t rmsmB;          // VISUALIZER_FRAME_FLOOR_MB if MEASUREMENT_MODE_PEAK_RMS is not set
+    uint32_t bands;         // number of valid entries in magnitudes
+    uint8_t magnitudes[VISUALIZER_FRAME_BANDS_MAX];  // log magnitude of each band, from DC up
+} visualizer_frame_t;
+
+#if __cplusplus
+}  // extern "C"
+#endif
+
+#endif // ANDROID_MEDIA_VISUALIZERFRAME_H
@@ -75,8 +75,15 @@ public:
 
     status_t setDataSource(int fd, int64_t offset, int64_t length);
     sp<IMemory> getFrameAtTime(int64_t timeUs, int option);
+    sp<IMemory> getThumbnailAtTime(
+            int64_t timeUs, int option, int32_t width, int32_t height);
     sp<IMemory> extractAlbumArt();
     const char* extractMetadata(int keyCode);
+    // Any number of files, in transactions of up to
+    // IMediaMetadataRetriever::kMaxBatchSize of them.
+    status_t extractMetadataBatch(
+            const Vector<int> &fds, const Vector<int> &keyCodes,
+            Vector<KeyedVector<int, String8> > *values);
 
 private:
     static const sp<IMediaPlayerService>& getService();
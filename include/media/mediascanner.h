@@ -24,8 +24,6 @@
 #include <utils/String8.h>
 #include <pthread.h>
 
-struct dirent;
-
 namespace android {
 
 class MediaScannerClient;
@@ -91,13 +89,21 @@ private:
     char *mSkipList;
     int *mSkipIndex;
 
+    // Lists directories, stat()ing their entries, ahead of the scan on
+    // worker threads, during processDirectory only. The client is still
+    // called on the scanning thread, in the order the tree is walked.
+    struct DirectoryEntry;
+    struct DirectoryListing;
+    struct DirectoryPrefetcher;
+    DirectoryPrefetcher *mPrefetcher;
+
     MediaScanResult doProcessDirectory(
             char *path, int pathRemaining, MediaScannerClient &client, bool noMedia);
     MediaScanResult doProcessDirectoryEntry(
             char *path, int pathRemaining, MediaScannerClient &client, bool noMedia,
-            struct dirent* entry, char* fileSpot);
+            const DirectoryEntry &entry, char* fileSpot);
     void loadSkipList();
-    bool shouldSkipDirectory(char *path);
+    bool shouldSkipDirectory(const char *path);
 
 
     MediaScanner(const MediaScanner &);
@@ -21,12 +21,12 @@
 
 #include <binder/IMemory.h>
 #include <utils/Mutex.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
 #include <media/nbaio/roundup.h>
 
 namespace android {
 
-class String8;
-
 class NBLog {
 
 public:
@@ -40,8 +40,41 @@ enum Event {
     EVENT_RESERVED,
     EVENT_STRING,               // ASCII string, not NUL-terminated
     EVENT_TIMESTAMP,            // clock_gettime(CLOCK_MONOTONIC)
+    EVENT_FORMAT,               // index into Shared::mFormats, followed by packed arguments
+};
+
+// Deferred formatting: logf() and logvf() store each distinct format string once in
+// Shared::mFormats, and then log only its index and the raw arguments as an EVENT_FORMAT.
+// The Reader does the printf-style expansion when the log is dumped.
+static const size_t kMaxFormats = 16;       // format strings per timeline
+static const size_t kMaxFormatLength = 64;  // including the terminating NUL
+static const size_t kMaxFormatArgs = 16;    // conversions per format string
+static const size_t kMaxCachedFormats = 32; // format strings remembered by each Writer
+
+// Argument types for EVENT_FORMAT, as determined from the format string by scanFormat().
+// Integers and pointers are packed as 8 bytes, so that the writer and reader need not agree
+// on the size of long, size_t and pointers.  Doubles are packed as 8 bytes, and strings as a
+// length byte followed by the truncated characters.
+enum FormatArg {
+    FORMAT_ARG_NONE,            // "%%", no argument consumed
+    FORMAT_ARG_INT,             // int, including the promoted types of "h" and "hh"
+    FORMAT_ARG_LONG,            // "l"
+    FORMAT_ARG_LONG_LONG,       // "ll"
+    FORMAT_ARG_SIZE,            // "z"
+    FORMAT_ARG_INTMAX,          // "j"
+    FORMAT_ARG_PTRDIFF,         // "t"
+    FORMAT_ARG_DOUBLE,          // "e", "f", "g", "a" and uppercase
+    FORMAT_ARG_STRING,          // "s"
+    FORMAT_ARG_POINTER,         // "p"
+    FORMAT_ARG_INVALID,         // not supported by deferred formatting, e.g. "*", "n", "L"
+    FORMAT_ARG_UNSIGNED = 0x80, // flag for the integer types, set for "o", "u", "x", "X", "c"
 };
 
+// Scan fmt for the next conversion.  Returns NULL if there are no more conversions, otherwise
+// returns a pointer just past the conversion, and sets *spec to the '%' which starts it
+// and *arg to the argument type.
+static const char *scanFormat(const char *fmt, const char **spec, int *arg);
+
 // ---------------------------------------------------------------------------
 
 // representation of a single log entry in private memory
@@ -72,10 +105,12 @@ private:
 
 // located in shared memory
 struct Shared {
-    Shared() : mRear(0) { }
+    Shared() : mRear(0), mFormatCount(0) { }
     /*virtual*/ ~Shared() { }
 
     volatile int32_t mRear;     // index one byte past the end of most recent Entry
+    volatile int32_t mFormatCount;  // number of valid entries in mFormats, release by Writer
+    char    mFormats[kMaxFormats][kMaxFormatLength];    // NUL-terminated, append-only
     char    mBuffer[0];         // circular buffer for entries
 };
 
@@ -141,11 +176,27 @@ private:
     void    log(Event event, const void *data, size_t length);
     void    log(const Entry *entry, bool trusted = false);
 
+    // deferred formatting of logvf(), returns false if fmt must be formatted immediately
+    bool    logFormat(const char *fmt, va_list ap);
+
+    // a format string seen by logvf(), recognized by its address
+    struct Format {
+        const char *mFmt;
+        int8_t      mIndex;         // index in mShared->mFormats, or -1 if not deferrable
+        uint8_t     mArgCount;      // number of entries used in mArgs
+        uint8_t     mFixedLength;   // packed length of the arguments other than strings
+        uint8_t     mArgs[kMaxFormatArgs];  // FormatArg, without FORMAT_ARG_NONE
+    };
+    const Format *findFormat(const char *fmt);
+
     const size_t    mSize;      // circular buffer size in bytes, must be a power of 2
     Shared* const   mShared;    // raw pointer to shared memory
     const sp<IMemory> mIMemory; // ref-counted version
     int32_t         mRear;      // my private copy of mShared->mRear
     bool            mEnabled;   // whether to actually log
+    size_t          mFormatCount;   // number of valid entries in mFormats
+    int32_t         mSharedFormatCount; // my private copy of mShared->mFormatCount
+    Format          mFormats[kMaxCachedFormats];
 };
 
 // ---------------------------------------------------------------------------
@@ -181,7 +232,16 @@ public:
 
     virtual ~Reader() { }
 
+    // A formatted line of the log, with the CLOCK_MONOTONIC time in ns of the most recent
+    // timestamp event at or before it, or 0 if no timestamp has been seen yet
+    struct Line {
+        int64_t     mTimestampNs;
+        String8     mBody;
+    };
+
+    // Both dump() and read() consume the entries logged since the previous call to either
     void    dump(int fd, size_t indent = 0);
+    void    read(Vector<Line>& lines);  // append to lines instead of printing
     bool    isIMemory(const sp<IMemory>& iMemory) const;
 
 private:
@@ -191,8 +251,13 @@ private:
     int32_t     mFront;         // index of oldest acknowledged Entry
     int     mFd;                // file descriptor
     int     mIndent;            // indentation level
+    Vector<Line> *mLines;       // non-NULL while in read()
+    int64_t mTimestampNs;       // most recent timestamp event, for Line::mTimestampNs
+
+    void    format();
 
     void    dumpLine(const String8& timestamp, String8& body);
+    void    appendFormat(String8& body, const uint8_t *data, size_t length);
 
     static const size_t kSquashTimestamp = 5; // squash this many or more adjacent timestamps
 };
@@ -56,12 +56,38 @@ public:
     virtual ssize_t write(const void *buffer, size_t count);
     //virtual ssize_t writeVia(writeVia_t via, size_t total, void *user, size_t block);
 
+    // Statistics for the first kMaxReaderStats attached readers, see getReaderStats()
+    static const size_t kMaxReaderStats = 8;
+
+    struct ReaderStats {
+        size_t      mLag;           // frames written but not yet read, may exceed the pipe size
+        size_t      mMaxLag;        // largest lag seen by the reader at a read, since attached
+        size_t      mOverruns;      // see NBAIO_Source::overruns()
+        size_t      mFramesOverrun; // see NBAIO_Source::framesOverrun()
+        bool        mLowestLatency; // reader uses PipeReader::OVERRUN_LOWEST_LATENCY
+    };
+
+    // Fill in up to maxStats entries for the currently attached readers, and return the number
+    // filled in.  May be called from any thread; the values are not mutually consistent.
+    size_t          getReaderStats(ReaderStats stats[], size_t maxStats) const;
+
 private:
+    // Published by each PipeReader that obtained a slot; written only by that reader
+    struct ReaderSlot {
+        volatile int32_t mInUse;        // 0 if free, claimed by android_atomic_cmpxchg
+        volatile int32_t mFront;        // last value of PipeReader::mFront
+        volatile int32_t mMaxLag;
+        volatile int32_t mOverruns;
+        volatile int32_t mFramesOverrun;
+        volatile int32_t mLowestLatency;
+    };
+
     const size_t    mMaxFrames;     // always a power of 2
     void * const    mBuffer;
     volatile int32_t mRear;         // written by android_atomic_release_store
     volatile int32_t mReaders;      // number of PipeReader clients currently attached to this Pipe
     const bool      mFreeBufferInDestructor;
+    ReaderSlot      mReaderSlots[kMaxReaderStats];
 };
 
 }   // namespace android
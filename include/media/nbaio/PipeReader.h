@@ -26,9 +26,19 @@ class PipeReader : public NBAIO_Source {
 
 public:
 
+    // What to do once the writer has overwritten data that was not yet read
+    enum OverrunPolicy {
+        // discard only 1/16 of the most recent data, to avoid another overrun immediately,
+        // but keep as much of the rest as possible
+        OVERRUN_KEEP_DEPTH,
+        // resume with only the most recent 1/16 of the pipe, for readers such as visualizers
+        // that prefer recent data over continuity
+        OVERRUN_LOWEST_LATENCY,
+    };
+
     // Construct a PipeReader and associate it with a Pipe
     // FIXME make this constructor a factory method of Pipe.
-    PipeReader(Pipe& pipe);
+    PipeReader(Pipe& pipe, OverrunPolicy policy = OVERRUN_KEEP_DEPTH);
     virtual ~PipeReader();
 
     // NBAIO_Port interface
@@ -55,9 +65,12 @@ public:
 
 private:
     Pipe&       mPipe;
+    const OverrunPolicy mPolicy;
     int32_t     mFront;         // follows behind mPipe.mRear
     size_t      mFramesOverrun;
     size_t      mOverruns;
+    Pipe::ReaderSlot *mSlot;    // for statistics, or NULL if all slots were taken
+    int32_t     mMaxLag;
 };
 
 }   // namespace android
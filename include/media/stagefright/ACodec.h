@@ -160,6 +160,12 @@ private:
 
         sp<ABuffer> mData;
         sp<GraphicBuffer> mGraphicBuffer;
+
+        // The notification to the client and the reply it sends back are
+        // allocated on the buffer's first trip and reused for every later
+        // one; a buffer is only ever on one trip at a time.
+        sp<AMessage> mNotifyMsg;
+        sp<AMessage> mReplyMsg;
     };
 
 #if TRACK_BUFFER_TIMING
@@ -301,6 +307,7 @@ private:
             OMX_U32 portIndex, OMX_AUDIO_CODINGTYPE desiredFormat);
 
     status_t setupAMRCodec(bool encoder, bool isWAMR, int32_t bitRate);
+    status_t setupFramesPerBuffer(int32_t framesPerBuffer);
     status_t setupG711Codec(bool encoder, int32_t numChannels);
 
     status_t setupFlacCodec(
@@ -72,13 +72,16 @@ private:
         // This is the initial mute duration to suppress
         // the video recording signal tone
         kAutoRampStartUs = 500000,
+
+        // Buffers of mMaxBufferSize allocated at start, more are added
+        // when the encoder holds on to all of them.
+        kNumPreallocatedBuffers = 4,
     };
 
     Mutex mLock;
     Condition mFrameAvailableCondition;
     Condition mFrameEncodingCompletionCondition;
 
-    AudioRecord::Buffer mTempBuf;
     uint32_t mPrevPosition;
     uint32_t mAllocBytes;
     int32_t mAudioSessionId;
@@ -99,6 +102,7 @@ private:
     int64_t mAutoRampStartUs;
 
     List<MediaBuffer * > mBuffersReceived;
+    List<MediaBuffer * > mFreeBuffers;
     void trackMaxAmplitude(int16_t *data, int nSamples);
 
     // This is used to raise the volume from mute to the
@@ -107,7 +111,11 @@ private:
         int32_t startFrame, int32_t rampDurationFrames,
         uint8_t *data,   size_t bytes);
 
+    status_t onAudioData(const void *data, size_t size, MediaBuffer *filled);
+    void appendInput_l(const void *data, size_t size, int64_t timeUs);
     void queueInputBuffer_l(MediaBuffer *buffer, int64_t timeUs);
+    MediaBuffer *acquireBuffer_l();
+    void recycleBuffer_l(MediaBuffer *buffer);
     void releaseQueuedFrames_l();
     void waitOutstandingEncodingFrames_l();
     status_t reset();
@@ -124,6 +132,12 @@ private:
     audio_format_t mFormat;
     String8 mMime;
     int32_t mMaxBufferSize;
+
+    // where callbacks are copied until it holds mBatchBytes, 0 to queue
+    // the data of each callback as it comes
+    MediaBuffer *mBatchBuffer;
+    int64_t mBatchTimeUs;
+    size_t mBatchBytes;
 };
 
 }  // namespace android
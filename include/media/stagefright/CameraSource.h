@@ -26,6 +26,7 @@
 #include <utils/List.h>
 #include <utils/RefBase.h>
 #include <utils/String16.h>
+#include <utils/Vector.h>
 
 #include <media/stagefright/ExtendedStats.h>
 #define RECORDER_STATS(func, ...) \
@@ -128,6 +129,12 @@ public:
      */
     bool isMetaDataStoredInVideoBuffers() const;
 
+    /**
+     * Writes the frame counts and the statistics of the intervals
+     * between the timestamps of the frames recorded so far.
+     */
+    status_t dump(int fd, const Vector<String16>& args);
+
     virtual void signalBufferReturned(MediaBuffer* buffer);
 
 protected:
@@ -214,8 +221,16 @@ private:
 
     int64_t mFirstFrameTimeUs;
     int32_t mNumFramesDropped;
+    // released as they came in, not counted as received
+    int32_t mNumFramesSkipped;
     int32_t mNumGlitches;
     int64_t mGlitchDurationThresholdUs;
+
+    // between the timestamps of received frames
+    int32_t mNumFrameIntervals;
+    int64_t mFrameIntervalSumUs;
+    double mFrameIntervalSquaresUs;
+    int64_t mMaxFrameIntervalUs;
     bool mCollectStats;
     bool mIsMetaDataStoredInVideoBuffers;
 
@@ -147,6 +147,11 @@ private:
     // Otherwise returns false.
     bool trySettingVideoSize(int32_t width, int32_t height);
 
+    // Programs the camera for the lowest of its preview fps ranges that
+    // still delivers a frame per mTimeBetweenFrameCaptureUs, leaving it
+    // as it is when there is none lower than the current one.
+    void trySettingCaptureFrameRate();
+
     // When video camera is used for time lapse capture, returns true
     // until enough time has passed for the next time lapse frame. When
     // the frame needs to be encoded, it returns false and also modifies
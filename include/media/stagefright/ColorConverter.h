@@ -18,6 +18,7 @@
 
 #define COLOR_CONVERTER_H_
 
+#include <pthread.h>
 #include <sys/types.h>
 
 #include <stdint.h>
@@ -27,12 +28,24 @@
 
 namespace android {
 
+// 8-bit red, green, blue and alpha, in that order in memory, as
+// HAL_PIXEL_FORMAT_RGBA_8888 and Android's ARGB_8888 bitmaps. OpenMAX has no
+// such format, the value is one of the vendor extension range.
+static const OMX_COLOR_FORMATTYPE kColorFormat32bitRGBA8888 =
+        (OMX_COLOR_FORMATTYPE)0x7F00A000;
+
 struct ColorConverter {
     ColorConverter(OMX_COLOR_FORMATTYPE from, OMX_COLOR_FORMATTYPE to);
     ~ColorConverter();
 
     bool isValid() const;
 
+    // Whether convert() also takes a destination crop smaller than the
+    // source's by an integer factor in both directions, each destination
+    // pixel then being the average of the top left 2x2 source pixels of its
+    // block.
+    bool canDownscale() const;
+
     status_t convert(
             const void *srcBits,
             size_t srcWidth, size_t srcHeight,
@@ -59,11 +72,55 @@ private:
         size_t mCropLeft, mCropTop, mCropRight, mCropBottom;
     };
 
+    // Where the rows of the source crop of a 4:2:0 format start, one chroma row
+    // for every two luma rows. The semi-planar formats have mU and mV one byte
+    // apart and an mUVStep of 2.
+    struct YUV420Layout {
+        const uint8_t *mY;
+        const uint8_t *mU;
+        const uint8_t *mV;
+        size_t mYStride;
+        size_t mUVStride;
+        size_t mUVStep;
+        // source pixels per destination pixel in both directions, 1 unless
+        // downscaling
+        size_t mScale;
+        // pack blue where red goes, as the semi-planar formats always have
+        bool mSwapRB;
+        // as initClip() returns it
+        const uint8_t *mClip;
+    };
+
+    // The rows of a large frame are converted in bands, one thread each.
+    struct Band {
+        const ColorConverter *mConverter;
+        const YUV420Layout *mLayout;
+        const BitmapParams *mDst;
+        size_t mFirstRow;
+        size_t mNumRows;
+        pthread_t mThread;
+    };
+
     OMX_COLOR_FORMATTYPE mSrcFormat, mDstFormat;
     uint8_t *mClip;
+    size_t mNumThreads;
 
     uint8_t *initClip();
 
+    status_t convertYUV420(
+            const YUV420Layout &layout,
+            const BitmapParams &src, const BitmapParams &dst);
+
+    void convertYUV420Rows(
+            const YUV420Layout &layout, const BitmapParams &dst,
+            size_t firstRow, size_t numRows) const;
+
+    void convertYUV420ScaledRows(
+            const YUV420Layout &layout, const BitmapParams &dst,
+            size_t firstRow, size_t numRows) const;
+
+    static void *ThreadWrapper(void *me);
+
     status_t convertCbYCrY(
             const BitmapParams &src, const BitmapParams &dst);
 
@@ -111,6 +111,13 @@ public:
         return ERROR_UNSUPPORTED;
     }
 
+    // Returns "size" bytes at "offset" if the source has them mapped into
+    // memory, saving the copy readAt() makes, or NULL. The memory is
+    // read-only and stays valid for as long as the source does.
+    virtual const void *getMappedRange(off64_t offset, size_t size) {
+        return NULL;
+    }
+
     ////////////////////////////////////////////////////////////////////////////
 
     bool sniff(String8 *mimeType, float *confidence, sp<AMessage> *meta);
@@ -166,6 +166,11 @@ protected:
     KeyedVector<AString, sp<LogEntry> > mLogEntry;
     Mutex mLock;
 
+    // the entry last logged to, the per frame logs going to the same one
+    // without building an AString key and searching for it
+    AString mLastKey;
+    sp<LogEntry> mLastEntry;
+
     ExtendedStats(const ExtendedStats&) {}
     AString mName;
     pid_t mTid;
@@ -259,8 +264,16 @@ public:
     virtual void notifyPause(int64_t pauseTimeUs);
 
 private:
+    // upper bounds of the buckets of the intervals between rendered frames,
+    // the last bucket holding the longer ones
+    static const int32_t kNumRenderIntervalBuckets = 8;
+    static const int64_t kRenderIntervalBoundsUs[kNumRenderIntervalBuckets - 1];
+
     int64_t mFramesRendered;
 
+    int64_t mLastRenderTimeUs;
+    int64_t mRenderIntervals[kNumRenderIntervalBuckets];
+
     int64_t mTotalPlayingTime;
     int64_t mStartPlayingTime;
     int64_t mLastSeekTime;
@@ -39,6 +39,8 @@ public:
 
     virtual status_t getSize(off64_t *size);
 
+    virtual const void *getMappedRange(off64_t offset, size_t size);
+
     virtual String8 getUri() {
         return mUri;
     }
@@ -55,8 +57,24 @@ private:
     String8 mUri;
     int64_t mOffset;
     int64_t mLength;
+
+    // Serializes DRM reads and guards the access pattern below, plain reads
+    // use pread64() on the shared fd and need no lock.
     Mutex mLock;
 
+    // The whole file when media.stagefright.mmap-files is set.
+    void *mMapAddress;
+    size_t mMapSize;
+    const uint8_t *mMappedData;
+
+    enum AccessHint {
+        kAccessNormal,
+        kAccessSequential,
+    };
+    AccessHint mAccessHint;
+    off64_t mLastReadEnd;
+    size_t mNumLocalReads;
+
     /*for DRM*/
     sp<DecryptHandle> mDecryptHandle;
     DrmManagerClient *mDrmManagerClient;
@@ -65,6 +83,8 @@ private:
     unsigned char *mDrmBuf;
 
     ssize_t readAtDRM(off64_t offset, void *data, size_t size);
+    void mapFile();
+    void updateAccessHint(off64_t offset, size_t size);
     void fetchUriFromFd(int fd);
 
     FileSource(const FileSource &);
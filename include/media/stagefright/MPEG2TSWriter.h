@@ -71,7 +71,9 @@ private:
     int64_t mNumTSPacketsBeforeMeta;
     int mPATContinuityCounter;
     int mPMTContinuityCounter;
-    uint32_t mCrcTable[256];
+
+    // Packets laid out but not yet written, see appendPackets().
+    sp<ABuffer> mPacketBuffer;
 
     void init();
 
@@ -79,8 +81,9 @@ private:
     void writeProgramAssociationTable();
     void writeProgramMap();
     void writeAccessUnit(int32_t sourceIndex, const sp<ABuffer> &buffer);
-    void initCrcTable();
-    uint32_t crc32(const uint8_t *start, size_t length);
+
+    uint8_t *appendPackets(size_t numPackets);
+    void flushPackets();
 
     ssize_t internalWrite(const void *data, size_t size);
     status_t reset();
@@ -22,11 +22,13 @@
 
 #include <media/stagefright/MediaWriter.h>
 #include <utils/List.h>
+#include <utils/Vector.h>
 #include <utils/threads.h>
 #include <media/stagefright/ExtendedStats.h>
 
 namespace android {
 
+struct BlockFileWriter;
 class MediaBuffer;
 class MediaSource;
 class MetaData;
@@ -74,6 +76,7 @@ private:
     class Track;
 
     int  mFd;
+    BlockFileWriter *mFileWriter;
     status_t mInitCheck;
     bool mIsRealTimeRecording;
     bool mUse4ByteNalLength;
@@ -91,6 +94,9 @@ private:
     bool mStreamableFile;
     off64_t mEstimatedMoovBoxSize;
     uint32_t mInterleaveDurationUs;
+    int64_t mFragmentDurationUs;  // 0 unless writing movie fragments
+    bool mMoovWritten;            // Initial moov of a fragmented file
+    uint32_t mFragmentSequenceNumber;
     int32_t mTimeScale;
     int64_t mStartTimestampUs;
     int mLatitudex10000;
@@ -111,16 +117,29 @@ private:
     size_t numTracks();
     int64_t estimateMoovBoxSize(int32_t bitRate);
 
+    // Per sample information a movie fragment carries in its trun box
+    struct FragmentSample {
+        uint32_t mSize;
+        uint32_t mDurationTicks;
+        uint32_t mCttsOffsetTicks;
+        bool     mIsSync;
+    };
+
     struct Chunk {
         Track               *mTrack;        // Owner
         int64_t             mTimeStampUs;   // Timestamp of the 1st sample
         List<MediaBuffer *> mSamples;       // Sample data
 
+        // Only set when the chunk is a movie fragment
+        Vector<FragmentSample> mFragmentSamples;
+        int64_t             mBaseDecodeTimeTicks;
+
         // Convenient constructor
-        Chunk(): mTrack(NULL), mTimeStampUs(0) {}
+        Chunk(): mTrack(NULL), mTimeStampUs(0), mBaseDecodeTimeTicks(0) {}
 
         Chunk(Track *track, int64_t timeUs, List<MediaBuffer *> samples)
-            : mTrack(track), mTimeStampUs(timeUs), mSamples(samples) {
+            : mTrack(track), mTimeStampUs(timeUs), mSamples(samples),
+              mBaseDecodeTimeTicks(0) {
         }
 
     };
@@ -161,6 +180,16 @@ private:
     // Actually write the given chunk to the file.
     void writeChunkToFile(Chunk* chunk);
 
+    // Write the given chunk as a moof box followed by its mdat box.
+    void writeFragmentToFile(Chunk* chunk);
+
+    // Whether the initial moov of a fragmented file can be written,
+    // that is, every track has either data or reached EOS.
+    bool allTracksBuffered_l();
+
+    bool isFragmented() const { return mFragmentDurationUs > 0; }
+    int64_t fragmentDuration() const { return mFragmentDurationUs; }
+
     // Adjust other track media clock (presumably wall clock)
     // based on audio track media clock with the drift time.
     int64_t mDriftTimeUs;
@@ -193,6 +222,7 @@ private:
     void writeCompositionMatrix(int32_t degrees);
     void writeMvhdBox(int64_t durationUs);
     void writeMoovBox(int64_t durationUs);
+    void writeMvexBox();
     void writeFtypBox(MetaData *param);
     void writeUdtaBox();
     void writeGeoDataBox();
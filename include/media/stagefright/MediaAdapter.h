@@ -21,7 +21,9 @@
 #include <media/stagefright/MediaSource.h>
 #include <media/stagefright/MediaBuffer.h>
 #include <media/stagefright/MetaData.h>
+#include <utils/List.h>
 #include <utils/threads.h>
+#include <utils/Vector.h>
 
 namespace android {
 
@@ -30,7 +32,10 @@ namespace android {
 struct MediaAdapter : public MediaSource, public MediaBufferObserver {
 public:
     // MetaData is used to set the format and returned at getFormat.
-    MediaAdapter(const sp<MetaData> &meta);
+    // With maxQueuedBuffers > 0, up to that many pushed buffers may be
+    // waiting for or held by the reader before pushBuffer() blocks, and
+    // stop() lets the reader drain them first.
+    MediaAdapter(const sp<MetaData> &meta, size_t maxQueuedBuffers = 0);
     virtual ~MediaAdapter();
     /////////////////////////////////////////////////
     // Inherited functions from MediaSource
@@ -54,8 +59,15 @@ public:
 
     // pushBuffer() will wait for the read() finish, and read() will have a
     // deep copy, such that after pushBuffer return, the buffer can be re-used.
+    // When queueing, pushBuffer() only waits for room in the queue and takes
+    // over the buffer, which should come from acquireBuffer().
     status_t pushBuffer(MediaBuffer *buffer);
 
+    // When queueing, returns a buffer of at least size bytes with a
+    // reference held for pushBuffer(), reusing one the reader returned if
+    // it is large enough.
+    MediaBuffer *acquireBuffer(size_t size);
+
 private:
     Mutex mAdapterLock;
     // Make sure the read() wait for the incoming buffer.
@@ -63,11 +75,20 @@ private:
     // Make sure the pushBuffer() wait for the current buffer consumed.
     Condition mBufferReturnedCond;
 
-    MediaBuffer *mCurrentMediaBuffer;
+    // Buffers pushed and not read yet, and the number of pushed buffers
+    // that have not been returned.
+    List<MediaBuffer *> mQueuedBuffers;
+    size_t mNumPendingBuffers;
+    const size_t mMaxQueuedBuffers;
+    Vector<MediaBuffer *> mFreeBuffers;
 
     bool mStarted;
+    bool mStopping;
     sp<MetaData> mOutputFormat;
 
+    void recycleBuffer_l(MediaBuffer *buffer);
+    void flushQueuedBuffers_l();
+
     DISALLOW_EVIL_CONSTRUCTORS(MediaAdapter);
 };
 
@@ -20,10 +20,13 @@
 
 #include <media/stagefright/MediaBuffer.h>
 #include <utils/Errors.h>
+#include <utils/List.h>
 #include <utils/threads.h>
+#include <utils/Vector.h>
 
 namespace android {
 
+struct AMessage;
 class MediaBuffer;
 class MetaData;
 
@@ -41,6 +44,16 @@ public:
     // buffer is set to NULL and it returns WOULD_BLOCK.
     status_t acquire_buffer(MediaBuffer **buffer, bool nonBlocking = false);
 
+    // Posts a copy of "notify" with the buffer as pointer "buffer" as soon as
+    // one is available, possibly right away. The buffer has a reference count
+    // of 1 and the receiver is responsible for releasing it.
+    void acquire_buffer_async(const sp<AMessage> &notify);
+
+    // Lets acquire_buffer() and acquire_buffer_async() add buffers of
+    // "bufferSize" bytes while all of the group's buffers are in use, until
+    // the group holds "maxBuffers" of them.
+    void setGrowthLimit(size_t maxBuffers, size_t bufferSize);
+
 protected:
     virtual void signalBufferReturned(MediaBuffer *buffer);
 
@@ -51,6 +64,18 @@ private:
     Condition mCondition;
 
     MediaBuffer *mFirstBuffer, *mLastBuffer;
+    size_t mNumBuffers;
+
+    // buffers with a reference count of 0, most recently returned last
+    Vector<MediaBuffer *> mFreeBuffers;
+
+    List<sp<AMessage> > mPendingNotifies;
+
+    size_t mMaxBuffers;
+    size_t mGrowthBufferSize;
+
+    void addBufferLocked(MediaBuffer *buffer);
+    MediaBuffer *takeFreeBufferLocked();
 
     MediaBufferGroup(const MediaBufferGroup &);
     MediaBufferGroup &operator=(const MediaBufferGroup &);
@@ -21,6 +21,7 @@
 #include <gui/IGraphicBufferProducer.h>
 #include <media/hardware/CryptoAPI.h>
 #include <media/stagefright/foundation/AHandler.h>
+#include <utils/KeyedVector.h>
 #include <utils/Vector.h>
 
 namespace android {
@@ -31,6 +32,8 @@ struct AString;
 struct CodecBase;
 struct ICrypto;
 struct IBatteryStats;
+class IMemory;
+struct MemoryDealer;
 struct SoftwareRenderer;
 struct Surface;
 
@@ -43,6 +46,9 @@ struct MediaCodec : public AHandler {
         BUFFER_FLAG_SYNCFRAME   = 1,
         BUFFER_FLAG_CODECCONFIG = 2,
         BUFFER_FLAG_EOS         = 4,
+        // More of the frame follows in the next buffers, reported only by
+        // the encoders configured with "output-partial-frames".
+        BUFFER_FLAG_PARTIAL_FRAME = 8,
         BUFFER_FLAG_EXTRADATA   = 0x1000,
     };
 
@@ -144,6 +150,11 @@ struct MediaCodec : public AHandler {
 
     status_t setParameters(const sp<AMessage> &params);
 
+    // Latency histograms of this instance since it was created, one group
+    // of "<name>-count", "<name>-mean-us", "<name>-p50-us", "<name>-p90-us",
+    // "<name>-p99-us" and "<name>-max-us" entries per histogram, all int64.
+    status_t getMetrics(sp<AMessage> *metrics) const;
+
 protected:
     virtual ~MediaCodec();
     virtual void onMessageReceived(const sp<AMessage> &msg);
@@ -192,6 +203,7 @@ private:
         kWhatGetName                        = 'getN',
         kWhatSetParameters                  = 'setP',
         kWhatSetCallback                    = 'setC',
+        kWhatGetMetrics                     = 'getM',
     };
 
     enum {
@@ -207,15 +219,52 @@ private:
         kFlagGatherCodecSpecificData    = 512,
         kFlagIsAsync                    = 1024,
         kFlagIsComponentAllocated       = 2048,
+        kFlagOutputPartialFrames        = 4096,
     };
 
     struct BufferInfo {
         uint32_t mBufferID;
         sp<ABuffer> mData;
         sp<ABuffer> mEncryptedData;
+        // holding mEncryptedData, for ICrypto to map instead of copying
+        sp<IMemory> mSharedEncryptedBuffer;
         sp<AMessage> mNotify;
         sp<AMessage> mFormat;
         bool mOwnedByClient;
+        int64_t mAvailableTimeUs;   // handed to us by the codec
+        int64_t mDequeuedTimeUs;    // handed to the client
+    };
+
+    // Log2 buckets of microseconds, cheap enough to update for every
+    // buffer; only touched on our looper.
+    struct LatencyHistogram {
+        enum {
+            kNumBuckets = 24,   // the last one holds anything above 8s
+        };
+
+        LatencyHistogram();
+
+        void add(int64_t latencyUs);
+        void addTo(const sp<AMessage> &metrics, const char *name) const;
+
+    private:
+        uint32_t mBuckets[kNumBuckets];
+        int64_t mCount;
+        int64_t mSumUs;
+        int64_t mMaxUs;
+
+        int64_t percentileUs(int percent) const;
+    };
+
+    struct PendingFrame {
+        int64_t mQueuedTimeUs;
+        bool mIsSync;
+    };
+
+    enum {
+        // Frames the codec dropped never come out, forget the oldest ones
+        // beyond this many.
+        kMaxPendingFrames = 64,
     };
 
     State mState;
@@ -256,6 +305,8 @@ private:
     uint32_t mDequeueOutputReplyID;
 
     sp<ICrypto> mCrypto;
+    // of the input mSharedEncryptedBuffers
+    sp<MemoryDealer> mDealer;
 
     List<sp<ABuffer> > mCSD;
 
@@ -263,6 +314,15 @@ private:
 
     bool mHaveInputSurface;
 
+    // input queued by the client, by presentation time
+    KeyedVector<int64_t, PendingFrame> mPendingFrames;
+    LatencyHistogram mInputWait;        // codec -> client
+    LatencyHistogram mInputHold;        // client -> queueInputBuffer
+    LatencyHistogram mSyncFrameLatency; // queueInputBuffer -> output
+    LatencyHistogram mFrameLatency;
+    LatencyHistogram mOutputWait;       // codec -> client
+    LatencyHistogram mOutputHold;       // client -> releaseOutputBuffer
+
     MediaCodec(const sp<ALooper> &looper);
 
     static status_t PostAndAwaitResponse(
@@ -305,6 +365,8 @@ private:
 
     status_t amendOutputFormatWithCodecSpecificData(const sp<ABuffer> &buffer);
     void updateBatteryStat();
+    void onFrameQueued(int64_t timeUs, bool isSync);
+    void onFrameDecoded(int64_t timeUs, bool isSync);
     bool isExecuting() const;
 
     /* called to get the last codec error when the sticky flag is set.
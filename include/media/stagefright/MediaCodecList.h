@@ -76,6 +76,12 @@ private:
     sp<MediaCodecInfo> mCurrentInfo;
     sp<IOMX> mOMX;
 
+    // every xml file parsed, the cache is only good while they are unchanged
+    Vector<AString> mParsedFiles;
+
+    // indices into mCodecInfos of the codecs supporting each (lowercase) type
+    KeyedVector<AString, Vector<size_t> > mTypeIndex;
+
     MediaCodecList();
     ~MediaCodecList();
 
@@ -83,6 +89,10 @@ private:
     void parseXMLFile(const char *path);
     void parseTopLevelXMLFile(const char *path);
 
+    bool readCache(const char *path);
+    void writeCache(const char *path) const;
+    void buildTypeIndex();
+
     static void StartElementHandlerWrapper(
             void *me, const char *name, const char **attrs);
 
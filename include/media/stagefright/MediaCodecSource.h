@@ -22,6 +22,7 @@
 #include <media/stagefright/MediaSource.h>
 
 #include <media/stagefright/ExtendedStats.h>
+#include <utils/KeyedVector.h>
 #define RECORDER_STATS(func, ...) \
     do { \
         if(mRecorderExtendedStats != NULL) { \
@@ -80,6 +81,7 @@ private:
         kWhatStart,
         kWhatStop,
         kWhatPause,
+        kWhatReleaseOutputBuffer,
     };
 
     MediaCodecSource(
@@ -92,6 +94,7 @@ private:
     status_t init();
     status_t initEncoder();
     void releaseEncoder();
+    void onReleaseOutputBuffer(size_t index);
     status_t feedEncoderInputBuffers();
     void suspend();
     void resume(int64_t skipFramesBeforeUs = -1ll);
@@ -132,6 +135,15 @@ private:
     bool mEncoderReachedEOS;
     status_t mErrorCode;
 
+    // Encoder output buffers handed out without a copy, by the MediaBuffer
+    // wrapping each. They go back to the encoder when the reader releases
+    // them, and the encoder is only released once all of them are back.
+    Mutex mHeldOutputBufferLock;
+    KeyedVector<MediaBuffer *, size_t> mHeldOutputBuffers;
+    size_t mNumOutputBuffersHeld;     // not yet back with the encoder, looper only
+    size_t mNumEncoderOutputBuffers;  // highest output index seen + 1
+    bool mReleaseEncoderPending;
+
     DISALLOW_EVIL_CONSTRUCTORS(MediaCodecSource);
 };
 
@@ -40,8 +40,15 @@ public:
         return &sPlugin;
     }
 
+    enum CreateFlags {
+        // Parse only what getMetaData and getTrackMetaData report, for
+        // metadata retrieval that doesn't read any samples.
+        kMetaDataOnly = 1,
+    };
+
     static sp<MediaExtractor> Create(
-            const sp<DataSource> &source, const char *mime = NULL);
+            const sp<DataSource> &source, const char *mime = NULL,
+            uint32_t createFlags = 0);
 
     virtual size_t countTracks() = 0;
     virtual sp<MediaSource> getTrack(size_t index) = 0;
@@ -80,6 +87,12 @@ public:
     virtual void setUID(uid_t uid) {
     }
 
+    // Set by Create for kMetaDataOnly, before anything is parsed: the
+    // tables needed to read samples may be left out, getTrack failing
+    // then. Extractors that parse only their headers anyway ignore it.
+    virtual void setMetaDataOnly() {
+    }
+
 protected:
     MediaExtractor() : mIsDrm(false) {}
     virtual ~MediaExtractor() {}
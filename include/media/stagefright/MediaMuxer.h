@@ -89,6 +89,17 @@ public:
      */
     status_t setLocation(int latitude, int longitude);
 
+    /**
+     * Set how much media time of a track is gathered into one chunk
+     * before the writer moves on to another track, i.e. how finely the
+     * tracks are interleaved in the file. Only supported for .mp4 output,
+     * and must be called before start().
+     * @param windowUs the interleave window in microseconds, 0 writes
+     *                 every sample as its own chunk.
+     * @return OK if no error.
+     */
+    status_t setInterleaveWindow(int64_t windowUs);
+
     /**
      * Stop muxing.
      * This method is a blocking call. Depending on how
@@ -101,10 +112,10 @@ public:
 
     /**
      * Send a sample buffer for muxing.
-     * The buffer can be reused once this method returns. Typically,
-     * this function won't be blocked for very long, and thus there
-     * is no need to use a separate thread calling this method to
-     * push a buffer.
+     * The buffer can be reused once this method returns. The sample is
+     * copied and queued for the writer, up to a limited number of samples
+     * per track, so that this only blocks when the writer falls behind.
+     * Tracks may be fed from different threads.
      * @param buffer the incoming sample buffer.
      * @param trackIndex the buffer's track index number.
      * @param timeUs the buffer's time stamp.
@@ -120,6 +131,7 @@ private:
     sp<MediaWriter> mWriter;
     Vector< sp<MediaAdapter> > mTrackList;  // Each track has its MediaAdapter.
     sp<MetaData> mFileMeta;  // Metadata for the whole file.
+    size_t mMaxQueuedSamples;  // Per track, 0 if writeSampleData() waits.
 
     Mutex mMuxerLock;
 
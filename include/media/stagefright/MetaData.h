@@ -113,6 +113,10 @@ enum {
     kKey64BitFileOffset   = 'fobt',  // int32_t (bool)
     kKey2ByteNalLength    = '2NAL',  // int32_t (bool)
 
+    // Set this key to author a fragmented file, with a movie fragment
+    // written every so many microseconds
+    kKeyMovieFragmentDurationUs = 'mfdu',  // int64_t
+
     // Identify the file output format for authoring
     // Please see <media/mediarecorder.h> for the supported
     // file output formats.
@@ -307,7 +311,7 @@ private:
 
         union {
             void *ext_data;
-            float reservoir;
+            int64_t reservoir;
         } u;
 
         bool usesReservoir() const {
@@ -330,6 +334,16 @@ private:
         int32_t mLeft, mTop, mRight, mBottom;
     };
 
+    // The keys set on nearly every sample are kept in fixed slots rather
+    // than in mItems, so that tagging a MediaBuffer allocates nothing.
+    enum {
+        kNumFixedItems = 4,
+    };
+    static ssize_t FixedItemIndex(uint32_t key);
+
+    typed_data mFixedItems[kNumFixedItems];
+    uint32_t mFixedItemsSet;  // bit i set if mFixedItems[i] holds a value
+
     KeyedVector<uint32_t, typed_data> mItems;
 
     // MetaData &operator=(const MetaData &);
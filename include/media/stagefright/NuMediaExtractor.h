@@ -83,13 +83,20 @@ private:
         kIsVorbis       = 1,
     };
 
+    struct SamplePrefetcher;
+
     struct TrackInfo {
         sp<MediaSource> mSource;
         size_t mTrackIndex;
         status_t mFinalResult;
         MediaBuffer *mSample;
+        sp<MetaData> mSampleMeta;
         int64_t mSampleTimeUs;
 
+        // reads the samples ahead of the client, NULL for the sources
+        // that are read on the client's thread
+        sp<SamplePrefetcher> mPrefetcher;
+
         uint32_t mTrackFlags;  // bitmask of "TrackFlags"
     };
 
@@ -110,6 +117,7 @@ private:
                 MediaSource::ReadOptions::SEEK_CLOSEST_SYNC);
 
     void releaseTrackSamples();
+    static void releaseSample(TrackInfo *info);
 
     bool getTotalBitrate(int64_t *bitRate) const;
     void updateDurationAndBitrate();
@@ -19,6 +19,9 @@
 #define STAGEFRIGHT_MEDIA_SCANNER_H_
 
 #include <media/mediascanner.h>
+#include <media/stagefright/foundation/AString.h>
+#include <utils/KeyedVector.h>
+#include <utils/Vector.h>
 
 namespace android {
 
@@ -32,13 +35,59 @@ struct StagefrightMediaScanner : public MediaScanner {
 
     virtual MediaAlbumArt *extractAlbumArt(int fd);
 
+    // The file the metadata extracted is kept in across scans, for the
+    // files processed again unchanged, of the same size and modification
+    // time, to be reported from it rather than extracted again. Defaults to
+    // media.scanner.metadata-cache, no cache if that isn't set either.
+    void setMetadataCachePath(const char *path);
+
 private:
+    // an empty name for the MIME type
+    struct CachedTag {
+        AString mName;
+        AString mValue;
+    };
+
+    struct CachedFile {
+        AString mPath;
+        int64_t mSize;
+        int64_t mModified;
+        // hit during this scan, or added by it
+        bool mUsed;
+        // in the order it was added, the last of a path being kept
+        uint32_t mOrder;
+        Vector<CachedTag> mTags;
+    };
+
+    AString mCachePath;
+    bool mCacheLoaded;
+    // loaded from mCachePath, sorted by path
+    KeyedVector<AString, CachedFile> mCache;
+    // extracted during this scan, merged into the file on destruction
+    Vector<CachedFile> mAddedFiles;
+    size_t mNumCacheHits;
+
     StagefrightMediaScanner(const StagefrightMediaScanner &);
     StagefrightMediaScanner &operator=(const StagefrightMediaScanner &);
 
     MediaScanResult processFileInternal(
             const char *path, const char *mimeType,
             MediaScannerClient &client);
+
+    MediaScanResult extractMetadata(
+            const char *path, const char *extension, Vector<CachedTag> *tags);
+
+    bool lookUpCache(
+            const char *path, int64_t size, int64_t modified,
+            Vector<CachedTag> *tags);
+    void addToCache(
+            const char *path, int64_t size, int64_t modified,
+            const Vector<CachedTag> &tags);
+    void loadCache();
+    void saveCache();
+
+    static int CompareCachedFiles(
+            const CachedFile *fileA, const CachedFile *fileB);
 };
 
 }  // namespace android
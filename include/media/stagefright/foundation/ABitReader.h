@@ -30,7 +30,7 @@ public:
     ABitReader(const uint8_t *data, size_t size);
     virtual ~ABitReader();
 
-    uint32_t getBits(size_t n);
+    inline uint32_t getBits(size_t n);
     void skipBits(size_t n);
 
     void putBits(uint32_t x, size_t n);
@@ -43,14 +43,28 @@ protected:
     const uint8_t *mData;
     size_t mSize;
 
-    uint32_t mReservoir;  // left-aligned bits
+    uint64_t mReservoir;  // left-aligned bits
     size_t mNumBitsLeft;
 
     virtual void fillReservoir();
 
+    uint32_t getBitsSlow(size_t n);
+
     DISALLOW_EVIL_CONSTRUCTORS(ABitReader);
 };
 
+uint32_t ABitReader::getBits(size_t n) {
+    // the reservoir holds up to 64 bits, most reads are served from it
+    if (n > 0 && n <= 32 && n <= mNumBitsLeft) {
+        uint32_t result = mReservoir >> (64 - n);
+        mReservoir <<= n;
+        mNumBitsLeft -= n;
+        return result;
+    }
+
+    return getBitsSlow(n);
+}
+
 class NALBitReader : public ABitReader {
 public:
     NALBitReader(const uint8_t *data, size_t size);
@@ -46,6 +46,12 @@ struct ABuffer : public RefBase {
     // create buffer from dup of some memory block
     static sp<ABuffer> CreateAsCopy(const void *data, size_t capacity);
 
+    // create buffer referring to "size" bytes at "offset" into the range of
+    // "buffer" without copying them. "buffer" is kept alive by the slice, and
+    // those bytes must not be rewritten through it while the slice is in use.
+    static sp<ABuffer> CreateAsSlice(
+            const sp<ABuffer> &buffer, size_t offset, size_t size);
+
     void setInt32Data(int32_t data) { mInt32Data = data; }
     int32_t int32Data() const { return mInt32Data; }
 
@@ -61,6 +67,9 @@ private:
     sp<AMessage> mFarewell;
     sp<AMessage> mMeta;
 
+    // the buffer a slice refers into, see CreateAsSlice()
+    sp<ABuffer> mParent;
+
     MediaBufferBase *mMediaBufferBase;
 
     void *mData;
@@ -24,6 +24,7 @@
 #include <utils/KeyedVector.h>
 #include <utils/List.h>
 #include <utils/RefBase.h>
+#include <utils/Vector.h>
 #include <utils/threads.h>
 
 namespace android {
@@ -53,6 +54,16 @@ struct ALooper : public RefBase {
 
     static int64_t GetNowUs();
 
+    struct Stats {
+        size_t mDelivered;          // messages delivered
+        size_t mMaxQueueDepth;      // most messages pending at once
+        int64_t mTotalLatencyUs;    // sum of the delays past the due time of
+        int64_t mMaxLatencyUs;      // delivered messages, and the largest one
+    };
+
+    // Stats since the looper was created.
+    void getStats(Stats *stats);
+
 protected:
     virtual ~ALooper();
 
@@ -61,6 +72,7 @@ private:
 
     struct Event {
         int64_t mWhenUs;
+        uint32_t mSeq;  // posting order, among events due at the same time
         sp<AMessage> mMessage;
     };
 
@@ -69,7 +81,15 @@ private:
 
     AString mName;
 
-    List<Event> mEventQueue;
+    // Events are delivered in order of due time, and of posting for the same
+    // due time. Messages posted without delay are due when posted, so they
+    // queue up in order in mImmediateQueue; the others go to mTimerHeap, a
+    // binary min-heap on (mWhenUs, mSeq).
+    List<Event> mImmediateQueue;
+    Vector<Event> mTimerHeap;
+    uint32_t mNextSeq;
+
+    Stats mStats;
 
     struct LooperThread;
     sp<LooperThread> mThread;
@@ -78,6 +98,12 @@ private:
     void post(const sp<AMessage> &msg, int64_t delayUs);
     bool loop();
 
+    static bool isBefore(const Event &a, const Event &b);
+    void pushTimerLocked(const Event &event);
+    void popTimerLocked(Event *event);
+    // Returns the next event due, or NULL if there are none.
+    const Event *nextEventLocked() const;
+
     DISALLOW_EVIL_CONSTRUCTORS(ALooper);
 };
 
@@ -20,6 +20,7 @@
 
 #include <media/stagefright/foundation/ALooper.h>
 #include <utils/KeyedVector.h>
+#include <utils/RWLock.h>
 
 namespace android {
 
@@ -48,14 +49,23 @@ private:
         wp<AHandler> mHandler;
     };
 
-    Mutex mLock;
+    // Guards mHandlers and mNextHandlerID. Every message posted and delivered
+    // in the process looks up its handler, so lookups share the lock and only
+    // registration and the removal of stale handlers take it exclusively.
+    RWLock mLock;
     KeyedVector<ALooper::handler_id, HandlerInfo> mHandlers;
     ALooper::handler_id mNextHandlerID;
+
+    // Guards mNextReplyID and mReplies
+    Mutex mRepliesLock;
     uint32_t mNextReplyID;
     Condition mRepliesCondition;
 
     KeyedVector<uint32_t, sp<AMessage> > mReplies;
 
+    // Removes the handler if it or its looper is gone
+    void removeStaleHandler(ALooper::handler_id handlerID);
+
     DISALLOW_EVIL_CONSTRUCTORS(ALooperRoster);
 };
 
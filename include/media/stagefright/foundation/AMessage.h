@@ -124,6 +124,10 @@ private:
         int32_t mLeft, mTop, mRight, mBottom;
     };
 
+    enum {
+        kMaxInlineNameLength = 15
+    };
+
     struct Item {
         union {
             int32_t int32Value;
@@ -138,8 +142,13 @@ private:
         } u;
         const char *mName;
         size_t      mNameLength;
+        uint32_t    mNameHash;
         Type mType;
-        void setName(const char *name, size_t len);
+        // Short names, which are nearly all of them, are kept in mNameBuffer
+        // so that setting or dup'ing an item does not allocate for its name.
+        char        mNameBuffer[kMaxInlineNameLength + 1];
+        void setName(const char *name, size_t len, uint32_t hash);
+        void freeName();
     };
 
     enum {
@@ -155,7 +164,9 @@ private:
     void setObjectInternal(
             const char *name, const sp<RefBase> &obj, Type type);
 
-    size_t findItemIndex(const char *name, size_t len) const;
+    // Returns the length of name and sets *hash, in a single pass.
+    static size_t HashName(const char *name, uint32_t *hash);
+    size_t findItemIndex(const char *name, size_t len, uint32_t hash) const;
 
     DISALLOW_EVIL_CONSTRUCTORS(AMessage);
 };
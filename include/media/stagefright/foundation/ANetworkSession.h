@@ -79,6 +79,19 @@ struct ANetworkSession : public RefBase {
 
     status_t switchToWebSocketMode(int32_t sessionID);
 
+    // Traffic on a session since it was created, datagrams count as packets
+    // and so do the successful reads and writes of stream sessions.
+    // mBytesQueued is what is still waiting to be sent at the time of the
+    // call, by the session and in the socket's send buffer.
+    struct SessionStats {
+        uint64_t mBytesReceived;
+        uint64_t mBytesSent;
+        uint32_t mPacketsReceived;
+        uint32_t mPacketsSent;
+        size_t mBytesQueued;
+    };
+    status_t getSessionStats(int32_t sessionID, SessionStats *stats);
+
     enum NotificationReason {
         kWhatError,
         kWhatConnected,
@@ -103,6 +116,7 @@ private:
     int32_t mNextSessionID;
 
     int mPipeFd[2];
+    int mEpollFd;
 
     KeyedVector<int32_t, sp<Session> > mSessions;
 
@@ -125,6 +139,12 @@ private:
     void threadLoop();
     void interrupt();
 
+    // epoll interest of a session's socket, updated as what it waits for
+    // changes.
+    void updateEventsLocked(const sp<Session> &session);
+    void unregisterLocked(const sp<Session> &session);
+    void closeEpoll();
+
     static status_t MakeSocketNonBlocking(int s);
 
     DISALLOW_EVIL_CONSTRUCTORS(ANetworkSession);
@@ -58,6 +58,54 @@ enum {
     AMEDIACODEC_INFO_TRY_AGAIN_LATER = -1
 };
 
+/**
+ * Called when an input buffer becomes available.
+ * The specified index is the index of the available input buffer.
+ */
+typedef void (*AMediaCodecOnAsyncInputAvailable)(
+        AMediaCodec *codec,
+        void *userdata,
+        int32_t index);
+
+/**
+ * Called when an output buffer becomes available.
+ * The specified index is the index of the available output buffer.
+ * The bufferInfo contains information regarding the available output buffer.
+ */
+typedef void (*AMediaCodecOnAsyncOutputAvailable)(
+        AMediaCodec *codec,
+        void *userdata,
+        int32_t index,
+        AMediaCodecBufferInfo *bufferInfo);
+
+/**
+ * Called when the output format has changed.
+ * The format is only valid during the callback, copy what you need of it.
+ */
+typedef void (*AMediaCodecOnAsyncFormatChanged)(
+        AMediaCodec *codec,
+        void *userdata,
+        AMediaFormat *format);
+
+/**
+ * Called when the codec encountered an error.
+ * The actionCode and detail are those of MediaCodec.CodecException.
+ */
+typedef void (*AMediaCodecOnAsyncError)(
+        AMediaCodec *codec,
+        void *userdata,
+        media_status_t error,
+        int32_t actionCode,
+        const char *detail);
+
+struct AMediaCodecOnAsyncNotifyCallback {
+      AMediaCodecOnAsyncInputAvailable  onAsyncInputAvailable;
+      AMediaCodecOnAsyncOutputAvailable onAsyncOutputAvailable;
+      AMediaCodecOnAsyncFormatChanged   onAsyncFormatChanged;
+      AMediaCodecOnAsyncError           onAsyncError;
+};
+typedef struct AMediaCodecOnAsyncNotifyCallback AMediaCodecOnAsyncNotifyCallback;
+
 /**
  * Create codec by name. Use this if you know the exact codec you want to use.
  * When configuring, you will need to specify whether to use the codec as an
@@ -163,6 +211,31 @@ media_status_t AMediaCodec_releaseOutputBuffer(AMediaCodec*, size_t idx, bool re
 media_status_t AMediaCodec_releaseOutputBufferAtTime(
         AMediaCodec *mData, size_t idx, int64_t timestampNs);
 
+/**
+ * Set an asynchronous callback for actionable AMediaCodec events.
+ * When asynchronous callback is enabled, the client should not call
+ * AMediaCodec_dequeueInputBuffer or AMediaCodec_dequeueOutputBuffer, the
+ * buffer indices are handed to the callback as they become available.
+ *
+ * This must be called after AMediaCodec_configure and before
+ * AMediaCodec_start. After AMediaCodec_flush, call AMediaCodec_start again
+ * for the codec to resume handing out input buffers.
+ *
+ * The callbacks are called on the codec's own looper thread, and must not
+ * block it.
+ */
+media_status_t AMediaCodec_setAsyncNotifyCallback(
+        AMediaCodec*,
+        AMediaCodecOnAsyncNotifyCallback callback,
+        void *userdata);
+
+/**
+ * Get the latency histograms this codec has gathered since it was created,
+ * as int64 entries such as "frame-latency-p90-us". The caller must release
+ * the returned format with AMediaFormat_delete.
+ */
+AMediaFormat* AMediaCodec_getMetrics(AMediaCodec*);
+
 
 typedef enum {
     AMEDIACODECRYPTOINFO_MODE_CLEAR = 0,
@@ -40,7 +40,8 @@ namespace android {
 #define CBLK_DISABLED   0x08 // output track disabled by AudioFlinger due to underrun,
                              // need to re-start.  Unlike CBLK_UNDERRUN, this is not set
                              // immediately, but only after a long string of underruns.
-// 0x10 unused
+#define CBLK_UNDERRUN_RISK 0x10 // set by server when an output underrun is predicted, cleared by
+                                // client.  See AudioTrackSharedStreaming::mUnderrunRiskFrames.
 #define CBLK_LOOP_CYCLE 0x20 // set by server each time a loop cycle other than final one completes
 #define CBLK_LOOP_FINAL 0x40 // set by server when the final loop cycle completes
 #define CBLK_BUFFER_END 0x80 // set by server when the position reaches end of buffer if not looping
@@ -60,6 +61,9 @@ struct AudioTrackSharedStreaming {
     volatile int32_t mFlush;    // incremented by client to indicate a request to flush;
                                 // server notices and discards all data between mFront and mRear
     volatile uint32_t mUnderrunFrames;  // server increments for each unavailable but desired frame
+    volatile uint32_t mUnderrunRiskFrames;  // server sets before raising CBLK_UNDERRUN_RISK to the
+                                // number of filled frames it estimates the client must keep
+                                // ahead of the server to avoid the predicted underrun
 };
 
 typedef SingleStateQueue<StaticAudioTrackState> StaticAudioTrackSingleStateQueue;
@@ -260,8 +264,31 @@ public:
 
     size_t      getFramesFilled();
 
+    // Opt-in polling mode for a blocking obtainBuffer(): before sleeping on the futex, poll the
+    // control block for up to spinNs, while asking the server to skip its futex wake syscall.
+    // The budget actually spent adapts between spinNs / kSpinFloorDivisor and spinNs,
+    // halving each time the poll gives up and doubling each time it succeeds.
+    // 0 disables polling, which is the default.
+    void        setSpinBudget(uint32_t spinNs);
+
+    struct SpinStats {
+        uint32_t    mSpins;         // number of polls started
+        uint32_t    mSpinHits;      // polls that saw the server make progress
+        uint32_t    mFutexWaits;    // futex waits, i.e. slow path taken while blocking
+    };
+
+    // Counters are updated without a barrier and are for statistics only
+    SpinStats   getSpinStats() const { return mSpinStats; }
+
 private:
+    bool        spinUntilChanged(int32_t observed);
+
+    static const uint32_t kSpinFloorDivisor = 16;
+
     size_t      mEpoch;
+    uint32_t    mSpinBudgetNs;  // as requested by setSpinBudget()
+    uint32_t    mSpinNs;        // current adaptive budget
+    SpinStats   mSpinStats;
 };
 
 // ----------------------------------------------------------------------------
@@ -298,6 +325,11 @@ public:
         return mCblk->u.mStreaming.mUnderrunFrames;
     }
 
+    // Return the fill level in frames recommended by the server with the last CBLK_UNDERRUN_RISK
+    uint32_t    getUnderrunRiskFrames() const {
+        return mCblk->u.mStreaming.mUnderrunRiskFrames;
+    }
+
     bool        clearStreamEndDone();   // and return previous value
 
     bool        getStreamEndDone() const;
@@ -395,12 +427,26 @@ class AudioTrackServerProxy : public ServerProxy {
 public:
     AudioTrackServerProxy(audio_track_cblk_t* cblk, void *buffers, size_t frameCount,
             size_t frameSize, bool clientInServer = false, uint32_t sampleRate = 0)
-        : ServerProxy(cblk, buffers, frameCount, frameSize, true /*isOut*/, clientInServer) {
+        : ServerProxy(cblk, buffers, frameCount, frameSize, true /*isOut*/, clientInServer),
+          mFillObservations(0), mLastFill(0), mLastServer(0),
+          mDeliveryMeanQ4(0), mDeliveryDevQ4(0), mRiskSignaled(false), mSafeCycles(0) {
         mCblk->mSampleRate = sampleRate;
     }
 protected:
     virtual ~AudioTrackServerProxy() { }
 
+    // Underrun predictor state, updated only by observeFramesReady()
+    static const uint32_t kFillWarmup = 8;  // observations before predicting
+    static const int kFillShift = 3;        // EWMA weight of 1/8 per observation
+    static const uint32_t kRiskRearm = 16;  // safe observations before signaling again
+    uint32_t    mFillObservations;  // number of observations since last reset, up to kFillWarmup
+    size_t      mLastFill;          // framesReady at the previous observation
+    uint32_t    mLastServer;        // cblk->mServer at the previous observation
+    int32_t     mDeliveryMeanQ4;    // mean frames delivered by client per observation, in Q4
+    int32_t     mDeliveryDevQ4;     // mean absolute deviation of the above, in Q4
+    bool        mRiskSignaled;      // CBLK_UNDERRUN_RISK raised and not yet re-armed
+    uint32_t    mSafeCycles;        // consecutive observations without predicted underrun
+
 public:
     // return value of these methods must be validated by the caller
     uint32_t    getSampleRate() const { return mCblk->mSampleRate; }
@@ -424,6 +470,13 @@ public:
     // Add to the tally of underrun frames, and inform client of underrun
     virtual void        tallyUnderrunFrames(uint32_t frameCount);
 
+    // Called by the normal mixer once per mix cycle for an active streaming track, with the
+    // frames ready at the start of the cycle and the frames the cycle will consume.
+    // Learns how regularly the client refills the buffer, and raises CBLK_UNDERRUN_RISK
+    // when the fill level is predicted to fall below desiredFrames at the next cycle.
+    // The estimate relies on consecutive calls being made from the same thread.
+    virtual void        observeFramesReady(size_t framesReady, size_t desiredFrames);
+
     // Return the total number of frames which AudioFlinger desired but were unavailable,
     // and thus which resulted in an underrun.
     virtual uint32_t    getUnderrunFrames() const { return mCblk->u.mStreaming.mUnderrunFrames; }
@@ -446,6 +499,8 @@ public:
     virtual void        releaseBuffer(Buffer* buffer);
     virtual void        tallyUnderrunFrames(uint32_t frameCount);
     virtual uint32_t    getUnderrunFrames() const { return 0; }
+    virtual void        observeFramesReady(size_t framesReady __unused,
+                                size_t desiredFrames __unused) { }
 
 private:
     ssize_t             pollPosition(); // poll for state queue update, and return current position
@@ -26,6 +26,7 @@ Mutex CCHelper::lock_;
 sp<ICommonClock> CCHelper::common_clock_;
 sp<ICommonClockListener> CCHelper::common_clock_listener_;
 uint32_t CCHelper::ref_count_ = 0;
+uint64_t CCHelper::common_freq_ = 0;
 
 bool CCHelper::verifyClock_l() {
     bool ret = false;
@@ -119,11 +120,44 @@ CCHELPER_METHOD(localTimeToCommonTime(int64_t localTime, int64_t* commonTime),
                 localTimeToCommonTime(localTime, commonTime))
 CCHELPER_METHOD(getCommonTime(int64_t* commonTime),
                 getCommonTime(commonTime))
-CCHELPER_METHOD(getCommonFreq(uint64_t* freq),
+CCHELPER_METHOD(getServiceCommonFreq(uint64_t* freq),
                 getCommonFreq(freq))
-CCHELPER_METHOD(getLocalTime(int64_t* localTime),
+CCHELPER_METHOD(getServiceLocalTime(int64_t* localTime),
                 getLocalTime(localTime))
-CCHELPER_METHOD(getLocalFreq(uint64_t* freq),
+CCHELPER_METHOD(getServiceLocalFreq(uint64_t* freq),
                 getLocalFreq(freq))
 
+status_t CCHelper::getCommonFreq(uint64_t* freq) {
+    {
+        Mutex::Autolock lock(&lock_);
+        if (common_freq_) {
+            *freq = common_freq_;
+            return OK;
+        }
+    }
+
+    status_t status = getServiceCommonFreq(freq);
+    if (OK == status) {
+        Mutex::Autolock lock(&lock_);
+        common_freq_ = *freq;
+    }
+    return status;
+}
+
+status_t CCHelper::getLocalTime(int64_t* localTime) {
+    if (local_clock_.initCheck()) {
+        *localTime = local_clock_.getLocalTime();
+        return OK;
+    }
+    return getServiceLocalTime(localTime);
+}
+
+status_t CCHelper::getLocalFreq(uint64_t* freq) {
+    if (local_clock_.initCheck()) {
+        *freq = local_clock_.getLocalFreq();
+        return OK;
+    }
+    return getServiceLocalFreq(freq);
+}
+
 }  // namespace android
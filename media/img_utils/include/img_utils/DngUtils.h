@@ -72,6 +72,9 @@ class ANDROID_API OpcodeListBuilder : public LightRefBase<OpcodeListBuilder> {
          * CFA layout must match the layout of the shading map passed into the
          * lensShadingMap parameter.
          *
+         * The opcodes of the last call are cached, so that a burst of captures with the same
+         * shading map and active area only builds them once.
+         *
          * Returns OK on success, or a negative error code.
          */
         virtual status_t addGainMapsForMetadata(uint32_t lsmWidth,
@@ -112,6 +115,18 @@ class ANDROID_API OpcodeListBuilder : public LightRefBase<OpcodeListBuilder> {
         static const uint32_t FLAG_OPTIONAL = 0x1u;
         static const uint32_t FLAG_OPTIONAL_FOR_PREVIEW = 0x2u;
 
+        /**
+         * Split the lens shading map and add its GainMap opcodes, without using the cache.
+         */
+        status_t addGainMapsForMetadataUncached(uint32_t lsmWidth,
+                                                uint32_t lsmHeight,
+                                                uint32_t activeAreaTop,
+                                                uint32_t activeAreaLeft,
+                                                uint32_t activeAreaBottom,
+                                                uint32_t activeAreaRight,
+                                                CfaLayout cfa,
+                                                const float* lensShadingMap);
+
         enum {
             GAIN_MAP_ID = 9,
             LSM_R_IND = 0,
@@ -133,32 +133,33 @@ inline status_t EndianOutput::writeHelper(const T* buf, size_t offset, size_t co
     assert(offset <= count);
     status_t res = OK;
     size_t size = sizeof(T);
-    switch(mEndian) {
-        case BIG: {
-            for (size_t i = offset; i < count; ++i) {
-                T tmp = convertToBigEndian<T>(buf[offset + i]);
-                if ((res = mOutput->write(reinterpret_cast<uint8_t*>(&tmp), 0, size))
-                        != OK) {
-                    return res;
-                }
-                mOffset += size;
-            }
-            break;
+    if (mEndian != BIG && mEndian != LITTLE) {
+        return BAD_VALUE;
+    }
+    // Convert a batch of elements at a time, so that the output sees one
+    // write per batch rather than one per element
+    const size_t BATCH_SIZE = 64;
+    T tmp[BATCH_SIZE];
+    for (size_t i = offset; i < count; ) {
+        size_t batch = count - i;
+        if (batch > BATCH_SIZE) {
+            batch = BATCH_SIZE;
         }
-        case LITTLE: {
-            for (size_t i = offset; i < count; ++i) {
-                T tmp = convertToLittleEndian<T>(buf[offset + i]);
-                if ((res = mOutput->write(reinterpret_cast<uint8_t*>(&tmp), 0, size))
-                        != OK) {
-                    return res;
-                }
-                mOffset += size;
+        if (mEndian == BIG) {
+            for (size_t j = 0; j < batch; ++j) {
+                tmp[j] = convertToBigEndian<T>(buf[offset + i + j]);
+            }
+        } else {
+            for (size_t j = 0; j < batch; ++j) {
+                tmp[j] = convertToLittleEndian<T>(buf[offset + i + j]);
             }
-            break;
         }
-        default: {
-            return BAD_VALUE;
+        if ((res = mOutput->write(reinterpret_cast<uint8_t*>(tmp), 0, batch * size))
+                != OK) {
+            return res;
         }
+        mOffset += batch * size;
+        i += batch;
     }
     return res;
 }
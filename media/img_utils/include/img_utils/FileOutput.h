@@ -35,7 +35,12 @@ class ANDROID_API FileOutput : public Output {
         virtual status_t write(const uint8_t* buf, size_t offset, size_t count);
         virtual status_t close();
     private:
+        // Size and alignment of the stdio buffer set up by open().
+        static const size_t BUFFER_SIZE = 256 * 1024;
+        static const size_t BUFFER_ALIGNMENT = 4096;
+
         FILE *mFp;
+        void *mBuffer;
         String8 mPath;
         bool mOpen;
 };
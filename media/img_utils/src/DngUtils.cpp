@@ -16,9 +16,44 @@
 
 #include <img_utils/DngUtils.h>
 
+#include <utils/Mutex.h>
+#include <utils/Vector.h>
+
+#include <string.h>
+
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 namespace android {
 namespace img_utils {
 
+namespace {
+
+/**
+ * The GainMap opcodes written by the last addGainMapsForMetadata call. A burst of RAW
+ * captures usually has the same lens shading map on every frame, which then only needs to
+ * be split and serialized once.
+ */
+struct GainMapCache {
+    enum {
+        PARAM_COUNT = 7,
+    };
+
+    bool valid;
+    uint32_t params[PARAM_COUNT];
+    Vector<float> lensShadingMap;
+    uint32_t opcodeCount;
+    Vector<uint8_t> opcodes;
+
+    GainMapCache() : valid(false), opcodeCount(0) {}
+};
+
+Mutex sGainMapCacheLock;
+GainMapCache sGainMapCache;
+
+} // namespace anonymous
+
 OpcodeListBuilder::OpcodeListBuilder() : mCount(0), mOpList(), mEndianOut(&mOpList, BIG) {
     if(mEndianOut.open() != OK) {
         ALOGE("%s: Open failed.", __FUNCTION__);
@@ -54,6 +89,52 @@ status_t OpcodeListBuilder::addGainMapsForMetadata(uint32_t lsmWidth,
                                                    uint32_t activeAreaRight,
                                                    CfaLayout cfa,
                                                    const float* lensShadingMap) {
+    const uint32_t params[GainMapCache::PARAM_COUNT] = { lsmWidth, lsmHeight, activeAreaTop,
+            activeAreaLeft, activeAreaBottom, activeAreaRight, static_cast<uint32_t>(cfa) };
+    const size_t lsmMapSize = lsmWidth * lsmHeight * 4;
+
+    Mutex::Autolock l(sGainMapCacheLock);
+
+    if (sGainMapCache.valid &&
+            memcmp(sGainMapCache.params, params, sizeof(params)) == 0 &&
+            memcmp(sGainMapCache.lensShadingMap.array(), lensShadingMap,
+                    lsmMapSize * sizeof(float)) == 0) {
+        status_t err = mEndianOut.write(sGainMapCache.opcodes.array(), 0,
+                sGainMapCache.opcodes.size());
+        if (err != OK) return err;
+        mCount += sGainMapCache.opcodeCount;
+        return OK;
+    }
+
+    size_t sizeBefore = mOpList.getSize();
+    uint32_t countBefore = mCount;
+
+    status_t err = addGainMapsForMetadataUncached(lsmWidth, lsmHeight, activeAreaTop,
+            activeAreaLeft, activeAreaBottom, activeAreaRight, cfa, lensShadingMap);
+    if (err != OK) {
+        sGainMapCache.valid = false;
+        return err;
+    }
+
+    memcpy(sGainMapCache.params, params, sizeof(params));
+    sGainMapCache.lensShadingMap.clear();
+    sGainMapCache.lensShadingMap.appendArray(lensShadingMap, lsmMapSize);
+    sGainMapCache.opcodeCount = mCount - countBefore;
+    sGainMapCache.opcodes.clear();
+    sGainMapCache.opcodes.appendArray(mOpList.getArray() + sizeBefore,
+            mOpList.getSize() - sizeBefore);
+    sGainMapCache.valid = true;
+    return OK;
+}
+
+status_t OpcodeListBuilder::addGainMapsForMetadataUncached(uint32_t lsmWidth,
+                                                           uint32_t lsmHeight,
+                                                           uint32_t activeAreaTop,
+                                                           uint32_t activeAreaLeft,
+                                                           uint32_t activeAreaBottom,
+                                                           uint32_t activeAreaRight,
+                                                           CfaLayout cfa,
+                                                           const float* lensShadingMap) {
     uint32_t activeAreaWidth = activeAreaRight - activeAreaLeft;
     uint32_t activeAreaHeight = activeAreaBottom - activeAreaTop;
     double spacingV = 1.0 / lsmHeight;
@@ -67,8 +148,18 @@ status_t OpcodeListBuilder::addGainMapsForMetadata(uint32_t lsmWidth,
     size_t lsmMapSize = lsmWidth * lsmHeight * 4;
 
     // Split lens shading map channels into separate arrays
+    size_t i = 0;
     size_t j = 0;
-    for (size_t i = 0; i < lsmMapSize; i += 4, ++j) {
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+    for (; i + 16 <= lsmMapSize; i += 16, j += 4) {
+        float32x4x4_t channels = vld4q_f32(lensShadingMap + i);
+        vst1q_f32(redMap + j, channels.val[LSM_R_IND]);
+        vst1q_f32(greenEvenMap + j, channels.val[LSM_GE_IND]);
+        vst1q_f32(greenOddMap + j, channels.val[LSM_GO_IND]);
+        vst1q_f32(blueMap + j, channels.val[LSM_B_IND]);
+    }
+#endif
+    for (; i < lsmMapSize; i += 4, ++j) {
         redMap[j] = lensShadingMap[i + LSM_R_IND];
         greenEvenMap[j] = lensShadingMap[i + LSM_GE_IND];
         greenOddMap[j] = lensShadingMap[i + LSM_GO_IND];
@@ -18,16 +18,19 @@
 
 #include <utils/Log.h>
 
+#include <stdlib.h>
+
 namespace android {
 namespace img_utils {
 
-FileOutput::FileOutput(String8 path) : mFp(NULL), mPath(path), mOpen(false) {}
+FileOutput::FileOutput(String8 path) : mFp(NULL), mBuffer(NULL), mPath(path), mOpen(false) {}
 
 FileOutput::~FileOutput() {
     if (mOpen) {
         ALOGW("%s: Destructor called with %s still open.", __FUNCTION__, mPath.string());
         close();
     }
+    free(mBuffer);
 }
 
 status_t FileOutput::open() {
@@ -40,6 +43,19 @@ status_t FileOutput::open() {
         ALOGE("%s: Could not open file %s", __FUNCTION__, mPath.string());
         return BAD_VALUE;
     }
+
+    // The TIFF header and IFDs are written a few bytes at a time, gather them
+    // into large page aligned writes; strip data larger than the buffer still
+    // goes straight to the file
+    if (mBuffer == NULL &&
+            posix_memalign(&mBuffer, BUFFER_ALIGNMENT, BUFFER_SIZE) != 0) {
+        mBuffer = NULL;
+    }
+    if (mBuffer == NULL ||
+            ::setvbuf(mFp, static_cast<char*>(mBuffer), _IOFBF, BUFFER_SIZE) != 0) {
+        ALOGW("%s: Could not set up write buffer for file %s, using default.",
+                __FUNCTION__, mPath.string());
+    }
     mOpen = true;
     return OK;
 }
@@ -72,7 +88,7 @@ status_t FileOutput::close() {
         ret = BAD_VALUE;
     }
     mOpen = false;
-    return OK;
+    return ret;
 }
 
 } /*namespace img_utils*/
@@ -111,7 +111,7 @@ status_t TiffWriter::write(Output* out, StripSource** sources, size_t sourcesCou
         bool found = false;
         for (size_t j = 0; j < sourcesCount; ++j) {
             if (sources[j]->getIfd() == ifdKey) {
-                if ((ret = sources[i]->writeToStream(endOut, sizeToWrite)) != OK) {
+                if ((ret = sources[j]->writeToStream(endOut, sizeToWrite)) != OK) {
                     ALOGE("%s: Could not write to stream, received %d.", __FUNCTION__, ret);
                     return ret;
                 }
@@ -0,0 +1,32 @@
+LOCAL_PATH:= $(call my-dir)
+
+# Convolution reverb library
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	EffectConvolutionReverb.cpp \
+	dsp/core/fft.cpp \
+	dsp/core/partitioned_convolution.cpp
+
+LOCAL_CFLAGS+= -O2 -fvisibility=hidden -fno-strict-aliasing
+
+LOCAL_ARM_NEON := true
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils \
+	liblog \
+	libstlport
+
+LOCAL_MODULE_RELATIVE_PATH := soundfx
+LOCAL_MODULE:= libconvreverb
+
+LOCAL_C_INCLUDES := \
+	$(call include-path-for, audio-effects) \
+	bionic \
+	bionic/libstdc++/include \
+	external/stlport/stlport
+
+
+include $(BUILD_SHARED_LIBRARY)
+
+include $(call all-makefiles-under,$(LOCAL_PATH))
@@ -0,0 +1,611 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "EffectConvolutionReverb"
+//#define LOG_NDEBUG 0
+#include <cutils/log.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <math.h>
+#include "effect_convolutionreverb.h"
+#include "dsp/core/partitioned_convolution.h"
+
+extern "C" {
+
+// effect_handle_t interface implementation for convolution reverb effect
+extern const struct effect_interface_s gCRInterface;
+
+// AOSP Convolution Reverb UUID: be398a86-719f-4fbb-9732-bab124b3bbdd
+const effect_descriptor_t gCRDescriptor = {
+        {0x899613e5, 0xcf03, 0x4910, 0xb30b, {0x7a, 0xa5, 0x2f, 0x2b, 0xd7, 0x9a}}, // type
+        {0xbe398a86, 0x719f, 0x4fbb, 0x9732, {0xba, 0xb1, 0x24, 0xb3, 0xbb, 0xdd}}, // uuid
+        EFFECT_CONTROL_API_VERSION,
+        (EFFECT_FLAG_TYPE_INSERT | EFFECT_FLAG_INSERT_LAST),
+        0, // TODO
+        1,
+        "Convolution Reverb",
+        "The Android Open Source Project",
+};
+
+// Head and partition size of the convolution. The head is applied in the time
+// domain at a cost of kBlockSize multiply-adds per frame and response, the
+// tail costs about one complex multiply-add per frame and kBlockSize taps.
+static const size_t kBlockSize = 256;
+// Number of frames converted at once to and from the float engine
+static const size_t kChunkSize = 256;
+
+enum cr_state_e {
+    CONVOLUTION_REVERB_STATE_UNINITIALIZED,
+    CONVOLUTION_REVERB_STATE_INITIALIZED,
+    CONVOLUTION_REVERB_STATE_ACTIVE,
+};
+
+struct ConvolutionReverbContext {
+    const struct effect_interface_s *mItfe;
+    effect_config_t mConfig;
+    uint8_t mState;
+    int16_t mWetLevelmB;
+    int16_t mDryLevelmB;
+    float mWetGain;
+    float mDryGain;
+    conv_fx::PartitionedConvolution* mConvolution;
+    float mInput[kChunkSize * 2];
+    float mOutput[kChunkSize * 2];
+};
+
+//
+//--- Local functions (not directly used by effect interface)
+//
+
+void CR_reset(ConvolutionReverbContext *pContext)
+{
+    ALOGV("  > CR_reset(%p)", pContext);
+
+    if (pContext->mConvolution != NULL) {
+        pContext->mConvolution->Reset();
+    } else {
+        ALOGE("CR_reset(%p): null convolution", pContext);
+    }
+}
+
+static inline float mBToGain(int16_t level)
+{
+    if (level <= -9600) {
+        return 0.0f;
+    }
+    return pow(10, level / 2000.0f);
+}
+
+static inline int16_t clamp16(int32_t sample)
+{
+    if ((sample>>15) ^ (sample>>31))
+        sample = 0x7FFF ^ (sample>>31);
+    return sample;
+}
+
+static inline int16_t clamp16_from_float(float f)
+{
+    f *= 1 << 15;
+    if (f >= 32767.0f) {
+        return 32767;
+    }
+    if (f <= -32768.0f) {
+        return -32768;
+    }
+    return (int16_t) lrintf(f);
+}
+
+//----------------------------------------------------------------------------
+// CR_setLayout()
+//----------------------------------------------------------------------------
+// Purpose: Allocate the engine for new impulse responses. Tap 0 of every
+//  response is set to unity when identity is true, otherwise the responses
+//  are silent.
+//
+// Inputs:
+//  pContext:   effect engine context
+//  responses:  number of impulse responses: 1, 2 or 4
+//  frames:     length of the impulse responses
+//  identity:   start with unit responses
+//
+// Outputs:
+//
+//----------------------------------------------------------------------------
+
+int CR_setLayout(ConvolutionReverbContext *pContext, uint32_t responses, uint32_t frames,
+        bool identity)
+{
+    ALOGV("CR_setLayout(%p) %u responses of %u frames", pContext, responses, frames);
+
+    if (frames == 0 || frames > CONVOLUTION_REVERB_MAX_FRAMES) return -EINVAL;
+
+    if (pContext->mConvolution == NULL) {
+        pContext->mConvolution = new conv_fx::PartitionedConvolution();
+    }
+    if (!pContext->mConvolution->Initialize(kBlockSize, 2, frames, responses)) {
+        return -EINVAL;
+    }
+    if (identity) {
+        const float tap = 1.0f;
+        for (uint32_t i = 0; i < responses; i++) {
+            pContext->mConvolution->SetImpulseResponse(i, 0, &tap, 1);
+        }
+    }
+    return 0;
+}
+
+//----------------------------------------------------------------------------
+// CR_setConfig()
+//----------------------------------------------------------------------------
+// Purpose: Set input and output audio configuration.
+//
+// Inputs:
+//  pContext:   effect engine context
+//  pConfig:    pointer to effect_config_t structure holding input and output
+//      configuration parameters
+//
+// Outputs:
+//
+//----------------------------------------------------------------------------
+
+int CR_setConfig(ConvolutionReverbContext *pContext, effect_config_t *pConfig)
+{
+    ALOGV("CR_setConfig(%p)", pContext);
+
+    if (pConfig->inputCfg.samplingRate != pConfig->outputCfg.samplingRate) return -EINVAL;
+    if (pConfig->inputCfg.channels != pConfig->outputCfg.channels) return -EINVAL;
+    if (pConfig->inputCfg.format != pConfig->outputCfg.format) return -EINVAL;
+    if (pConfig->inputCfg.channels != AUDIO_CHANNEL_OUT_STEREO) return -EINVAL;
+    if (pConfig->outputCfg.accessMode != EFFECT_BUFFER_ACCESS_WRITE &&
+            pConfig->outputCfg.accessMode != EFFECT_BUFFER_ACCESS_ACCUMULATE) return -EINVAL;
+    if (pConfig->inputCfg.format != AUDIO_FORMAT_PCM_16_BIT &&
+            pConfig->inputCfg.format != AUDIO_FORMAT_PCM_FLOAT) return -EINVAL;
+
+    pContext->mConfig = *pConfig;
+
+    CR_reset(pContext);
+
+    return 0;
+}
+
+
+//----------------------------------------------------------------------------
+// CR_getConfig()
+//----------------------------------------------------------------------------
+// Purpose: Get input and output audio configuration.
+//
+// Inputs:
+//  pContext:   effect engine context
+//  pConfig:    pointer to effect_config_t structure holding input and output
+//      configuration parameters
+//
+// Outputs:
+//
+//----------------------------------------------------------------------------
+
+void CR_getConfig(ConvolutionReverbContext *pContext, effect_config_t *pConfig)
+{
+    *pConfig = pContext->mConfig;
+}
+
+
+//----------------------------------------------------------------------------
+// CR_init()
+//----------------------------------------------------------------------------
+// Purpose: Initialize engine with default configuration.
+//
+// Inputs:
+//  pContext:   effect engine context
+//
+// Outputs:
+//
+//----------------------------------------------------------------------------
+
+int CR_init(ConvolutionReverbContext *pContext)
+{
+    ALOGV("CR_init(%p)", pContext);
+
+    pContext->mConfig.inputCfg.accessMode = EFFECT_BUFFER_ACCESS_READ;
+    pContext->mConfig.inputCfg.channels = AUDIO_CHANNEL_OUT_STEREO;
+    pContext->mConfig.inputCfg.format = AUDIO_FORMAT_PCM_16_BIT;
+    pContext->mConfig.inputCfg.samplingRate = 44100;
+    pContext->mConfig.inputCfg.bufferProvider.getBuffer = NULL;
+    pContext->mConfig.inputCfg.bufferProvider.releaseBuffer = NULL;
+    pContext->mConfig.inputCfg.bufferProvider.cookie = NULL;
+    pContext->mConfig.inputCfg.mask = EFFECT_CONFIG_ALL;
+    pContext->mConfig.outputCfg.accessMode = EFFECT_BUFFER_ACCESS_ACCUMULATE;
+    pContext->mConfig.outputCfg.channels = AUDIO_CHANNEL_OUT_STEREO;
+    pContext->mConfig.outputCfg.format = AUDIO_FORMAT_PCM_16_BIT;
+    pContext->mConfig.outputCfg.samplingRate = 44100;
+    pContext->mConfig.outputCfg.bufferProvider.getBuffer = NULL;
+    pContext->mConfig.outputCfg.bufferProvider.releaseBuffer = NULL;
+    pContext->mConfig.outputCfg.bufferProvider.cookie = NULL;
+    pContext->mConfig.outputCfg.mask = EFFECT_CONFIG_ALL;
+
+    pContext->mWetLevelmB = CONVOLUTION_REVERB_DEFAULT_WET_LEVEL_MB;
+    pContext->mDryLevelmB = CONVOLUTION_REVERB_DEFAULT_DRY_LEVEL_MB;
+    pContext->mWetGain = mBToGain(pContext->mWetLevelmB);
+    pContext->mDryGain = mBToGain(pContext->mDryLevelmB);
+
+    int ret = CR_setLayout(pContext, 1, 1, true);
+    if (ret < 0) {
+        return ret;
+    }
+
+    CR_setConfig(pContext, &pContext->mConfig);
+
+    return 0;
+}
+
+//
+//--- Effect Library Interface Implementation
+//
+
+int CRLib_Create(const effect_uuid_t *uuid,
+                         int32_t sessionId,
+                         int32_t ioId,
+                         effect_handle_t *pHandle) {
+    ALOGV("CRLib_Create()");
+    int ret;
+
+    if (pHandle == NULL || uuid == NULL) {
+        return -EINVAL;
+    }
+
+    if (memcmp(uuid, &gCRDescriptor.uuid, sizeof(effect_uuid_t)) != 0) {
+        return -EINVAL;
+    }
+
+    ConvolutionReverbContext *pContext = new ConvolutionReverbContext;
+
+    pContext->mItfe = &gCRInterface;
+    pContext->mState = CONVOLUTION_REVERB_STATE_UNINITIALIZED;
+
+    pContext->mConvolution = NULL;
+    ret = CR_init(pContext);
+    if (ret < 0) {
+        ALOGW("CRLib_Create() init failed");
+        delete pContext->mConvolution;
+        delete pContext;
+        return ret;
+    }
+
+    *pHandle = (effect_handle_t)pContext;
+
+    pContext->mState = CONVOLUTION_REVERB_STATE_INITIALIZED;
+
+    ALOGV("  CRLib_Create context is %p", pContext);
+
+    return 0;
+
+}
+
+int CRLib_Release(effect_handle_t handle) {
+    ConvolutionReverbContext * pContext = (ConvolutionReverbContext *)handle;
+
+    ALOGV("CRLib_Release %p", handle);
+    if (pContext == NULL) {
+        return -EINVAL;
+    }
+    pContext->mState = CONVOLUTION_REVERB_STATE_UNINITIALIZED;
+    if (pContext->mConvolution != NULL) {
+        delete pContext->mConvolution;
+        pContext->mConvolution = NULL;
+    }
+    delete pContext;
+
+    return 0;
+}
+
+int CRLib_GetDescriptor(const effect_uuid_t *uuid,
+                                effect_descriptor_t *pDescriptor) {
+
+    if (pDescriptor == NULL || uuid == NULL){
+        ALOGV("CRLib_GetDescriptor() called with NULL pointer");
+        return -EINVAL;
+    }
+
+    if (memcmp(uuid, &gCRDescriptor.uuid, sizeof(effect_uuid_t)) == 0) {
+        *pDescriptor = gCRDescriptor;
+        return 0;
+    }
+
+    return  -EINVAL;
+} /* end CRLib_GetDescriptor */
+
+//
+//--- Effect Control Interface Implementation
+//
+int CR_process(
+        effect_handle_t self, audio_buffer_t *inBuffer, audio_buffer_t *outBuffer)
+{
+    ConvolutionReverbContext * pContext = (ConvolutionReverbContext *)self;
+
+    if (pContext == NULL) {
+        return -EINVAL;
+    }
+
+    if (inBuffer == NULL || inBuffer->raw == NULL ||
+        outBuffer == NULL || outBuffer->raw == NULL ||
+        inBuffer->frameCount != outBuffer->frameCount ||
+        inBuffer->frameCount == 0) {
+        return -EINVAL;
+    }
+
+    const bool isFloat = pContext->mConfig.inputCfg.format == AUDIO_FORMAT_PCM_FLOAT;
+    const bool accumulate =
+            pContext->mConfig.outputCfg.accessMode == EFFECT_BUFFER_ACCESS_ACCUMULATE;
+    const float wet = pContext->mWetGain;
+    const float dry = pContext->mDryGain;
+    float *in = pContext->mInput;
+    float *out = pContext->mOutput;
+
+    for (size_t frame = 0; frame < inBuffer->frameCount; ) {
+        size_t frames = inBuffer->frameCount - frame;
+        if (frames > kChunkSize) {
+            frames = kChunkSize;
+        }
+        const size_t samples = frames * 2;
+        if (isFloat) {
+            memcpy(in, (float *)inBuffer->raw + frame * 2, samples * sizeof(float));
+        } else {
+            const int16_t *src = inBuffer->s16 + frame * 2;
+            for (size_t i = 0; i < samples; i++) {
+                in[i] = src[i] * (1.0f / (1 << 15));
+            }
+        }
+        pContext->mConvolution->Process(in, out, frames);
+        for (size_t i = 0; i < samples; i++) {
+            out[i] = wet * out[i] + dry * in[i];
+        }
+        if (isFloat) {
+            float *dst = (float *)outBuffer->raw + frame * 2;
+            if (accumulate) {
+                for (size_t i = 0; i < samples; i++) {
+                    dst[i] += out[i];
+                }
+            } else {
+                memcpy(dst, out, samples * sizeof(float));
+            }
+        } else {
+            int16_t *dst = outBuffer->s16 + frame * 2;
+            if (accumulate) {
+                for (size_t i = 0; i < samples; i++) {
+                    dst[i] = clamp16(dst[i] + clamp16_from_float(out[i]));
+                }
+            } else {
+                for (size_t i = 0; i < samples; i++) {
+                    dst[i] = clamp16_from_float(out[i]);
+                }
+            }
+        }
+        frame += frames;
+    }
+
+    if (pContext->mState != CONVOLUTION_REVERB_STATE_ACTIVE) {
+        return -ENODATA;
+    }
+    return 0;
+}
+
+int CR_command(effect_handle_t self, uint32_t cmdCode, uint32_t cmdSize,
+        void *pCmdData, uint32_t *replySize, void *pReplyData) {
+
+    ConvolutionReverbContext * pContext = (ConvolutionReverbContext *)self;
+
+    if (pContext == NULL || pContext->mState == CONVOLUTION_REVERB_STATE_UNINITIALIZED) {
+        return -EINVAL;
+    }
+
+//    ALOGV("CR_command command %d cmdSize %d",cmdCode, cmdSize);
+    switch (cmdCode) {
+    case EFFECT_CMD_INIT:
+        if (pReplyData == NULL || *replySize != sizeof(int)) {
+            return -EINVAL;
+        }
+        *(int *) pReplyData = CR_init(pContext);
+        break;
+    case EFFECT_CMD_SET_CONFIG:
+        if (pCmdData == NULL || cmdSize != sizeof(effect_config_t)
+                || pReplyData == NULL || *replySize != sizeof(int)) {
+            return -EINVAL;
+        }
+        *(int *) pReplyData = CR_setConfig(pContext,
+                (effect_config_t *) pCmdData);
+        break;
+    case EFFECT_CMD_GET_CONFIG:
+        if (pReplyData == NULL ||
+            *replySize != sizeof(effect_config_t)) {
+            return -EINVAL;
+        }
+        CR_getConfig(pContext, (effect_config_t *)pReplyData);
+        break;
+    case EFFECT_CMD_RESET:
+        CR_reset(pContext);
+        break;
+    case EFFECT_CMD_ENABLE:
+        if (pReplyData == NULL || *replySize != sizeof(int)) {
+            return -EINVAL;
+        }
+        if (pContext->mState != CONVOLUTION_REVERB_STATE_INITIALIZED) {
+            return -ENOSYS;
+        }
+        pContext->mState = CONVOLUTION_REVERB_STATE_ACTIVE;
+        ALOGV("EFFECT_CMD_ENABLE() OK");
+        *(int *)pReplyData = 0;
+        break;
+    case EFFECT_CMD_DISABLE:
+        if (pReplyData == NULL || *replySize != sizeof(int)) {
+            return -EINVAL;
+        }
+        if (pContext->mState != CONVOLUTION_REVERB_STATE_ACTIVE) {
+            return -ENOSYS;
+        }
+        pContext->mState = CONVOLUTION_REVERB_STATE_INITIALIZED;
+        ALOGV("EFFECT_CMD_DISABLE() OK");
+        *(int *)pReplyData = 0;
+        break;
+    case EFFECT_CMD_GET_PARAM: {
+        if (pCmdData == NULL ||
+            cmdSize != (int)(sizeof(effect_param_t) + sizeof(uint32_t)) ||
+            pReplyData == NULL ||
+            *replySize < (int)(sizeof(effect_param_t) + sizeof(uint32_t) +
+                    2 * sizeof(uint32_t))) {
+            return -EINVAL;
+        }
+        memcpy(pReplyData, pCmdData, sizeof(effect_param_t) + sizeof(uint32_t));
+        effect_param_t *p = (effect_param_t *)pReplyData;
+        p->status = 0;
+        *replySize = sizeof(effect_param_t) + sizeof(uint32_t);
+        if (p->psize != sizeof(uint32_t)) {
+            p->status = -EINVAL;
+            break;
+        }
+        switch (*(uint32_t *)p->data) {
+        case CONVOLUTION_REVERB_PARAM_IMPULSE_RESPONSE_LAYOUT:
+            *((uint32_t *)p->data + 1) = pContext->mConvolution->responses();
+            *((uint32_t *)p->data + 2) = pContext->mConvolution->length();
+            p->vsize = 2 * sizeof(uint32_t);
+            *replySize += 2 * sizeof(uint32_t);
+            break;
+        case CONVOLUTION_REVERB_PARAM_WET_LEVEL:
+            ALOGV("get wet level(mB) = %d", pContext->mWetLevelmB);
+            *(int16_t *)((uint32_t *)p->data + 1) = pContext->mWetLevelmB;
+            p->vsize = sizeof(int16_t);
+            *replySize += sizeof(int16_t);
+            break;
+        case CONVOLUTION_REVERB_PARAM_DRY_LEVEL:
+            ALOGV("get dry level(mB) = %d", pContext->mDryLevelmB);
+            *(int16_t *)((uint32_t *)p->data + 1) = pContext->mDryLevelmB;
+            p->vsize = sizeof(int16_t);
+            *replySize += sizeof(int16_t);
+            break;
+        default:
+            p->status = -EINVAL;
+        }
+        } break;
+    case EFFECT_CMD_SET_PARAM: {
+        if (pCmdData == NULL || cmdSize < (int)(sizeof(effect_param_t) + sizeof(uint32_t)) ||
+                pReplyData == NULL || *replySize != sizeof(int32_t)) {
+            return -EINVAL;
+        }
+        *(int32_t *)pReplyData = 0;
+        effect_param_t *p = (effect_param_t *)pCmdData;
+        if (p->psize < sizeof(uint32_t) || p->psize > 3 * sizeof(uint32_t)) {
+            *(int32_t *)pReplyData = -EINVAL;
+            break;
+        }
+        // the value starts at the next 32 bit boundary after the parameter
+        const uint32_t voffset = ((p->psize - 1) / sizeof(int32_t) + 1) * sizeof(int32_t);
+        if (cmdSize < sizeof(effect_param_t) + voffset + p->vsize) {
+            *(int32_t *)pReplyData = -EINVAL;
+            break;
+        }
+        const uint32_t *param = (uint32_t *)p->data;
+        void *value = p->data + voffset;
+        switch (param[0]) {
+        case CONVOLUTION_REVERB_PARAM_IMPULSE_RESPONSE_LAYOUT:
+            if (p->psize != sizeof(uint32_t) || p->vsize != 2 * sizeof(uint32_t)) {
+                *(int32_t *)pReplyData = -EINVAL;
+                break;
+            }
+            *(int32_t *)pReplyData = CR_setLayout(pContext,
+                    ((uint32_t *)value)[0], ((uint32_t *)value)[1], false);
+            if (*(int32_t *)pReplyData != 0) {
+                // keep a usable engine
+                CR_setLayout(pContext, 1, 1, true);
+            }
+            break;
+        case CONVOLUTION_REVERB_PARAM_IMPULSE_RESPONSE:
+            if (p->psize != 3 * sizeof(uint32_t) || p->vsize % sizeof(float) != 0 ||
+                    !pContext->mConvolution->SetImpulseResponse(param[1], param[2],
+                            (float *)value, p->vsize / sizeof(float))) {
+                *(int32_t *)pReplyData = -EINVAL;
+            }
+            break;
+        case CONVOLUTION_REVERB_PARAM_WET_LEVEL:
+            if (p->psize != sizeof(uint32_t) || p->vsize != sizeof(int16_t)) {
+                *(int32_t *)pReplyData = -EINVAL;
+                break;
+            }
+            pContext->mWetLevelmB = *(int16_t *)value;
+            pContext->mWetGain = mBToGain(pContext->mWetLevelmB);
+            ALOGV("set wet level(mB) = %d", pContext->mWetLevelmB);
+            break;
+        case CONVOLUTION_REVERB_PARAM_DRY_LEVEL:
+            if (p->psize != sizeof(uint32_t) || p->vsize != sizeof(int16_t)) {
+                *(int32_t *)pReplyData = -EINVAL;
+                break;
+            }
+            pContext->mDryLevelmB = *(int16_t *)value;
+            pContext->mDryGain = mBToGain(pContext->mDryLevelmB);
+            ALOGV("set dry level(mB) = %d", pContext->mDryLevelmB);
+            break;
+        default:
+            *(int32_t *)pReplyData = -EINVAL;
+        }
+        } break;
+    case EFFECT_CMD_SET_DEVICE:
+    case EFFECT_CMD_SET_VOLUME:
+    case EFFECT_CMD_SET_AUDIO_MODE:
+        break;
+
+    default:
+        ALOGW("CR_command invalid command %d",cmdCode);
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+/* Effect Control Interface Implementation: get_descriptor */
+int CR_getDescriptor(effect_handle_t   self,
+                                    effect_descriptor_t *pDescriptor)
+{
+    ConvolutionReverbContext * pContext = (ConvolutionReverbContext *) self;
+
+    if (pContext == NULL || pDescriptor == NULL) {
+        ALOGV("CR_getDescriptor() invalid param");
+        return -EINVAL;
+    }
+
+    *pDescriptor = gCRDescriptor;
+
+    return 0;
+}   /* end CR_getDescriptor */
+
+// effect_handle_t interface implementation for convolution reverb effect
+const struct effect_interface_s gCRInterface = {
+        CR_process,
+        CR_command,
+        CR_getDescriptor,
+        NULL,
+};
+
+// This is the only symbol that needs to be exported
+__attribute__ ((visibility ("default")))
+audio_effect_library_t AUDIO_EFFECT_LIBRARY_INFO_SYM = {
+    .tag = AUDIO_EFFECT_LIBRARY_TAG,
+    .version = EFFECT_LIBRARY_API_VERSION,
+    .name = "Convolution Reverb Library",
+    .implementor = "The Android Open Source Project",
+    .create_effect = CRLib_Create,
+    .release_effect = CRLib_Release,
+    .get_descriptor = CRLib_GetDescriptor,
+};
+
+}; // extern "C"
@@ -0,0 +1,205 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dsp/core/fft.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+#if CONV_FX_NEON
+#include <arm_neon.h>
+#endif
+
+namespace conv_fx {
+
+RealFft::RealFft()
+    : size_(0),
+      half_(0),
+      swaps_(NULL),
+      num_swaps_(0),
+      twiddle_re_(NULL),
+      twiddle_im_(NULL),
+      split_re_(NULL),
+      split_im_(NULL),
+      work_re_(NULL),
+      work_im_(NULL) {
+}
+
+RealFft::~RealFft() {
+  delete[] swaps_;
+  delete[] twiddle_re_;
+  delete[] twiddle_im_;
+  delete[] split_re_;
+  delete[] split_im_;
+  delete[] work_re_;
+  delete[] work_im_;
+}
+
+bool RealFft::Initialize(size_t size) {
+  if (size < 8 || (size & (size - 1)) != 0) {
+    return false;
+  }
+  size_ = size;
+  half_ = size / 2;
+
+  size_t bits = 0;
+  while (((size_t)1 << bits) < half_) {
+    bits++;
+  }
+  delete[] swaps_;
+  swaps_ = new size_t[half_];
+  num_swaps_ = 0;
+  for (size_t i = 0; i < half_; i++) {
+    size_t r = 0;
+    for (size_t b = 0; b < bits; b++) {
+      r |= ((i >> b) & 1) << (bits - 1 - b);
+    }
+    if (i < r) {
+      swaps_[num_swaps_++] = i;
+      swaps_[num_swaps_++] = r;
+    }
+  }
+
+  delete[] twiddle_re_;
+  delete[] twiddle_im_;
+  twiddle_re_ = new float[half_];
+  twiddle_im_ = new float[half_];
+  twiddle_re_[0] = 1.0f;
+  twiddle_im_[0] = 0.0f;
+  for (size_t h = 1; h < half_; h <<= 1) {
+    for (size_t j = 0; j < h; j++) {
+      double phase = -M_PI * j / h;
+      twiddle_re_[h + j] = cos(phase);
+      twiddle_im_[h + j] = sin(phase);
+    }
+  }
+
+  delete[] split_re_;
+  delete[] split_im_;
+  split_re_ = new float[half_ + 1];
+  split_im_ = new float[half_ + 1];
+  for (size_t k = 0; k <= half_; k++) {
+    double phase = -2 * M_PI * k / size_;
+    split_re_[k] = cos(phase);
+    split_im_[k] = sin(phase);
+  }
+
+  delete[] work_re_;
+  delete[] work_im_;
+  work_re_ = new float[half_];
+  work_im_ = new float[half_];
+  return true;
+}
+
+void RealFft::Complex(float *re, float *im) {
+  for (size_t i = 0; i < num_swaps_; i += 2) {
+    size_t a = swaps_[i];
+    size_t b = swaps_[i + 1];
+    float t = re[a];
+    re[a] = re[b];
+    re[b] = t;
+    t = im[a];
+    im[a] = im[b];
+    im[b] = t;
+  }
+
+  // radix-2 decimation in time: the first two stages run scalar, the
+  // following ones have spans of at least 4 points and run 4 lanes at a time
+  // with NEON.
+  for (size_t h = 1; h < half_; h <<= 1) {
+    const float *wr = twiddle_re_ + h;
+    const float *wi = twiddle_im_ + h;
+    for (size_t g = 0; g < half_; g += 2 * h) {
+      float *ar = re + g;
+      float *ai = im + g;
+      float *br = ar + h;
+      float *bi = ai + h;
+      size_t j = 0;
+#if CONV_FX_NEON
+      for (; j + 4 <= h; j += 4) {
+        float32x4_t vwr = vld1q_f32(wr + j);
+        float32x4_t vwi = vld1q_f32(wi + j);
+        float32x4_t vbr = vld1q_f32(br + j);
+        float32x4_t vbi = vld1q_f32(bi + j);
+        float32x4_t tr = vmlsq_f32(vmulq_f32(vwr, vbr), vwi, vbi);
+        float32x4_t ti = vmlaq_f32(vmulq_f32(vwr, vbi), vwi, vbr);
+        float32x4_t var = vld1q_f32(ar + j);
+        float32x4_t vai = vld1q_f32(ai + j);
+        vst1q_f32(br + j, vsubq_f32(var, tr));
+        vst1q_f32(bi + j, vsubq_f32(vai, ti));
+        vst1q_f32(ar + j, vaddq_f32(var, tr));
+        vst1q_f32(ai + j, vaddq_f32(vai, ti));
+      }
+#endif
+      for (; j < h; j++) {
+        float tr = wr[j] * br[j] - wi[j] * bi[j];
+        float ti = wr[j] * bi[j] + wi[j] * br[j];
+        br[j] = ar[j] - tr;
+        bi[j] = ai[j] - ti;
+        ar[j] += tr;
+        ai[j] += ti;
+      }
+    }
+  }
+}
+
+void RealFft::Forward(const float *in, float *re, float *im) {
+  // pack even samples as real and odd samples as imaginary parts
+  for (size_t n = 0; n < half_; n++) {
+    work_re_[n] = in[2 * n];
+    work_im_[n] = in[2 * n + 1];
+  }
+  Complex(work_re_, work_im_);
+
+  // X[k] = E[k] + W^k O[k] with E and O the spectra of the even and odd samples
+  for (size_t k = 0; k <= half_; k++) {
+    size_t a = k < half_ ? k : 0;
+    size_t b = k > 0 ? half_ - k : 0;
+    float er = 0.5f * (work_re_[a] + work_re_[b]);
+    float ei = 0.5f * (work_im_[a] - work_im_[b]);
+    float orr = 0.5f * (work_im_[a] + work_im_[b]);
+    float oi = -0.5f * (work_re_[a] - work_re_[b]);
+    re[k] = er + split_re_[k] * orr - split_im_[k] * oi;
+    im[k] = ei + split_re_[k] * oi + split_im_[k] * orr;
+  }
+}
+
+void RealFft::Inverse(const float *re, const float *im, float *out) {
+  // rebuild the half size spectrum Z[k] = E[k] + i O[k]
+  for (size_t k = 0; k < half_; k++) {
+    float ar = re[k];
+    float ai = k > 0 ? im[k] : 0.0f;
+    float br = re[half_ - k];
+    float bi = k > 0 ? im[half_ - k] : 0.0f;
+    float er = 0.5f * (ar + br);
+    float ei = 0.5f * (ai - bi);
+    float dr = 0.5f * (ar - br);
+    float di = 0.5f * (ai + bi);
+    // O = D conj(W^k)
+    float orr = dr * split_re_[k] + di * split_im_[k];
+    float oi = di * split_re_[k] - dr * split_im_[k];
+    work_re_[k] = er - oi;
+    work_im_[k] = ei + orr;
+  }
+  // inverse transform by exchanging the real and imaginary parts
+  Complex(work_im_, work_re_);
+  for (size_t n = 0; n < half_; n++) {
+    out[2 * n] = work_re_[n];
+    out[2 * n + 1] = work_im_[n];
+  }
+}
+
+}  // namespace conv_fx
@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CONV_FX_ENGINE_DSP_CORE_FFT_H_
+#define CONV_FX_ENGINE_DSP_CORE_FFT_H_
+
+#include <stddef.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define CONV_FX_NEON 1
+#else
+#define CONV_FX_NEON 0
+#endif
+
+namespace conv_fx {
+
+// Real to complex FFT of a power of two size, computed with a complex FFT of
+// half the size. Spectra are kept in split format, with the real and the
+// imaginary parts in separate arrays, so that the butterflies and the
+// spectrum multiplications vectorize without deinterleaving.
+//
+// A spectrum has size() / 2 + 1 bins, from DC to Nyquist. The transforms are
+// not normalized: Inverse(Forward(x)) returns x scaled by size() / 2.
+class RealFft {
+ public:
+  RealFft();
+  ~RealFft();
+
+  // Prepares the tables for a transform of `size` real samples. `size` must
+  // be a power of two, at least 8. Returns false on an invalid size.
+  bool Initialize(size_t size);
+
+  size_t size() const { return size_; }
+
+  // Computes the spectrum of `size()` real samples in `in`. `re` and `im`
+  // receive size() / 2 + 1 bins and must not alias `in`.
+  void Forward(const float *in, float *re, float *im);
+
+  // Computes `size()` real samples from the size() / 2 + 1 bins in `re` and
+  // `im`. The imaginary parts of the DC and Nyquist bins are ignored.
+  void Inverse(const float *re, const float *im, float *out);
+
+ private:
+  // In place forward complex FFT of half_ points in split format.
+  // The inverse transform is obtained by exchanging re and im.
+  void Complex(float *re, float *im);
+
+  size_t size_;
+  size_t half_;
+  // bit reversal swaps for the complex FFT, as pairs of indices
+  size_t *swaps_;
+  size_t num_swaps_;
+  // complex FFT twiddles: stage with span h uses entries h to 2h - 1
+  float *twiddle_re_;
+  float *twiddle_im_;
+  // twiddles of the real to complex split, half_ + 1 entries
+  float *split_re_;
+  float *split_im_;
+  // work buffers of half_ points
+  float *work_re_;
+  float *work_im_;
+
+  RealFft(const RealFft&);
+  RealFft& operator=(const RealFft&);
+};
+
+}  // namespace conv_fx
+
+#endif  // CONV_FX_ENGINE_DSP_CORE_FFT_H_
@@ -0,0 +1,321 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "dsp/core/partitioned_convolution.h"
+
+#include <string.h>
+
+#if CONV_FX_NEON
+#include <arm_neon.h>
+#endif
+
+namespace conv_fx {
+
+namespace {
+
+// Returns the dot product of `count` values, `count` a multiple of 4.
+inline float Dot(const float *a, const float *b, size_t count) {
+#if CONV_FX_NEON
+  float32x4_t acc = vdupq_n_f32(0.0f);
+  for (size_t i = 0; i < count; i += 4) {
+    acc = vmlaq_f32(acc, vld1q_f32(a + i), vld1q_f32(b + i));
+  }
+  float32x2_t sum = vadd_f32(vget_low_f32(acc), vget_high_f32(acc));
+  return vget_lane_f32(vpadd_f32(sum, sum), 0);
+#else
+  float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+  for (size_t i = 0; i < count; i += 4) {
+    acc[0] += a[i] * b[i];
+    acc[1] += a[i + 1] * b[i + 1];
+    acc[2] += a[i + 2] * b[i + 2];
+    acc[3] += a[i + 3] * b[i + 3];
+  }
+  return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+#endif
+}
+
+// Accumulates the product of two split format spectra of `bins` bins, `bins`
+// a multiple of 4.
+inline void MultiplyAccumulate(const float *are, const float *aim,
+                               const float *bre, const float *bim,
+                               float *accre, float *accim, size_t bins) {
+#if CONV_FX_NEON
+  for (size_t k = 0; k < bins; k += 4) {
+    float32x4_t ar = vld1q_f32(are + k);
+    float32x4_t ai = vld1q_f32(aim + k);
+    float32x4_t br = vld1q_f32(bre + k);
+    float32x4_t bi = vld1q_f32(bim + k);
+    float32x4_t cr = vld1q_f32(accre + k);
+    float32x4_t ci = vld1q_f32(accim + k);
+    cr = vmlsq_f32(vmlaq_f32(cr, ar, br), ai, bi);
+    ci = vmlaq_f32(vmlaq_f32(ci, ar, bi), ai, br);
+    vst1q_f32(accre + k, cr);
+    vst1q_f32(accim + k, ci);
+  }
+#else
+  for (size_t k = 0; k < bins; k++) {
+    accre[k] += are[k] * bre[k] - aim[k] * bim[k];
+    accim[k] += are[k] * bim[k] + aim[k] * bre[k];
+  }
+#endif
+}
+
+}  // namespace
+
+PartitionedConvolution::PartitionedConvolution()
+    : block_(0),
+      bins_(0),
+      partitions_(0),
+      channels_(0),
+      length_(0),
+      responses_(0),
+      num_paths_(0),
+      fdl_pos_(0),
+      pos_(0),
+      acc_re_(NULL),
+      acc_im_(NULL),
+      time_(NULL) {
+  memset(response_, 0, sizeof(response_));
+  memset(input_, 0, sizeof(input_));
+  memset(fdl_re_, 0, sizeof(fdl_re_));
+  memset(fdl_im_, 0, sizeof(fdl_im_));
+  memset(tail_, 0, sizeof(tail_));
+}
+
+PartitionedConvolution::~PartitionedConvolution() {
+  Free();
+}
+
+void PartitionedConvolution::Free() {
+  for (size_t r = 0; r < kMaxImpulseResponses; r++) {
+    delete[] response_[r].taps;
+    delete[] response_[r].head;
+    delete[] response_[r].spectra_re;
+    delete[] response_[r].spectra_im;
+  }
+  memset(response_, 0, sizeof(response_));
+  for (size_t c = 0; c < kMaxChannels; c++) {
+    delete[] input_[c];
+    delete[] fdl_re_[c];
+    delete[] fdl_im_[c];
+    delete[] tail_[c];
+    input_[c] = NULL;
+    fdl_re_[c] = NULL;
+    fdl_im_[c] = NULL;
+    tail_[c] = NULL;
+  }
+  delete[] acc_re_;
+  delete[] acc_im_;
+  delete[] time_;
+  acc_re_ = NULL;
+  acc_im_ = NULL;
+  time_ = NULL;
+  num_paths_ = 0;
+  channels_ = 0;
+}
+
+bool PartitionedConvolution::Initialize(size_t block_size, size_t channels, size_t length,
+                                        size_t responses) {
+  if (block_size < 16 || (block_size & (block_size - 1)) != 0 ||
+      channels == 0 || channels > kMaxChannels || length == 0 ||
+      (responses != 1 && responses != channels && responses != channels * channels)) {
+    return false;
+  }
+  if (!fft_.Initialize(2 * block_size)) {
+    return false;
+  }
+  Free();
+
+  block_ = block_size;
+  bins_ = (block_ + 1 + 3) & ~(size_t)3;
+  partitions_ = length > block_ ? (length - block_ + block_ - 1) / block_ : 0;
+  channels_ = channels;
+  length_ = length;
+  responses_ = responses;
+
+  const size_t spectra = partitions_ * bins_;
+  for (size_t r = 0; r < responses_; r++) {
+    response_[r].taps = new float[length_];
+    response_[r].head = new float[block_];
+    memset(response_[r].taps, 0, length_ * sizeof(float));
+    memset(response_[r].head, 0, block_ * sizeof(float));
+    if (spectra != 0) {
+      response_[r].spectra_re = new float[spectra];
+      response_[r].spectra_im = new float[spectra];
+      memset(response_[r].spectra_re, 0, spectra * sizeof(float));
+      memset(response_[r].spectra_im, 0, spectra * sizeof(float));
+    }
+  }
+
+  num_paths_ = 0;
+  for (size_t i = 0; i < channels_; i++) {
+    for (size_t o = 0; o < channels_; o++) {
+      if (responses_ == channels_ * channels_) {
+        path_[num_paths_].response = i * channels_ + o;
+      } else if (i == o) {
+        path_[num_paths_].response = responses_ == 1 ? 0 : i;
+      } else {
+        continue;
+      }
+      path_[num_paths_].input = i;
+      path_[num_paths_].output = o;
+      num_paths_++;
+    }
+  }
+
+  for (size_t c = 0; c < channels_; c++) {
+    input_[c] = new float[2 * block_];
+    tail_[c] = new float[block_];
+    if (spectra != 0) {
+      fdl_re_[c] = new float[spectra];
+      fdl_im_[c] = new float[spectra];
+    }
+  }
+  acc_re_ = new float[bins_];
+  acc_im_ = new float[bins_];
+  time_ = new float[2 * block_];
+  Reset();
+  return true;
+}
+
+bool PartitionedConvolution::SetImpulseResponse(size_t response, size_t offset,
+                                                const float *taps, size_t count) {
+  if (response >= responses_ || offset > length_ || count > length_ - offset) {
+    return false;
+  }
+  if (count == 0) {
+    return true;
+  }
+  ImpulseResponse *r = &response_[response];
+  memcpy(r->taps + offset, taps, count * sizeof(float));
+
+  size_t end = offset + count;
+  if (offset < block_) {
+    for (size_t j = offset; j < end && j < block_; j++) {
+      r->head[block_ - 1 - j] = r->taps[j];
+    }
+  }
+  if (end > block_) {
+    size_t first = offset > block_ ? (offset - block_) / block_ : 0;
+    size_t last = (end - block_ - 1) / block_;
+    for (size_t p = first; p <= last; p++) {
+      UpdatePartition(r, p);
+    }
+  }
+  return true;
+}
+
+void PartitionedConvolution::UpdatePartition(ImpulseResponse *response, size_t partition) {
+  size_t start = block_ + partition * block_;
+  size_t count = length_ - start < block_ ? length_ - start : block_;
+  memcpy(time_, response->taps + start, count * sizeof(float));
+  memset(time_ + count, 0, (2 * block_ - count) * sizeof(float));
+
+  float *re = response->spectra_re + partition * bins_;
+  float *im = response->spectra_im + partition * bins_;
+  fft_.Forward(time_, re, im);
+  // fold the scale of the inverse transform in the partition
+  const float scale = 1.0f / block_;
+  for (size_t k = 0; k <= block_; k++) {
+    re[k] *= scale;
+    im[k] *= scale;
+  }
+  for (size_t k = block_ + 1; k < bins_; k++) {
+    re[k] = 0.0f;
+    im[k] = 0.0f;
+  }
+}
+
+void PartitionedConvolution::Reset() {
+  const size_t spectra = partitions_ * bins_;
+  for (size_t c = 0; c < channels_; c++) {
+    memset(input_[c], 0, 2 * block_ * sizeof(float));
+    memset(tail_[c], 0, block_ * sizeof(float));
+    if (spectra != 0) {
+      memset(fdl_re_[c], 0, spectra * sizeof(float));
+      memset(fdl_im_[c], 0, spectra * sizeof(float));
+    }
+  }
+  fdl_pos_ = 0;
+  pos_ = 0;
+}
+
+void PartitionedConvolution::Process(const float *in, float *out, size_t frames) {
+  float y[kMaxChannels];
+  for (size_t f = 0; f < frames; f++) {
+    for (size_t c = 0; c < channels_; c++) {
+      input_[c][block_ + pos_] = in[c];
+      y[c] = tail_[c][pos_];
+    }
+    for (size_t p = 0; p < num_paths_; p++) {
+      const Path& path = path_[p];
+      y[path.output] += Dot(response_[path.response].head,
+                            input_[path.input] + pos_ + 1, block_);
+    }
+    for (size_t c = 0; c < channels_; c++) {
+      out[c] = y[c];
+    }
+    in += channels_;
+    out += channels_;
+    if (++pos_ == block_) {
+      ProcessBlock();
+      pos_ = 0;
+    }
+  }
+}
+
+void PartitionedConvolution::ProcessBlock() {
+  if (partitions_ != 0) {
+    fdl_pos_ = fdl_pos_ == 0 ? partitions_ - 1 : fdl_pos_ - 1;
+    for (size_t c = 0; c < channels_; c++) {
+      fft_.Forward(input_[c], fdl_re_[c] + fdl_pos_ * bins_, fdl_im_[c] + fdl_pos_ * bins_);
+      for (size_t k = block_ + 1; k < bins_; k++) {
+        fdl_re_[c][fdl_pos_ * bins_ + k] = 0.0f;
+        fdl_im_[c][fdl_pos_ * bins_ + k] = 0.0f;
+      }
+    }
+    for (size_t o = 0; o < channels_; o++) {
+      memset(acc_re_, 0, bins_ * sizeof(float));
+      memset(acc_im_, 0, bins_ * sizeof(float));
+      for (size_t p = 0; p < num_paths_; p++) {
+        const Path& path = path_[p];
+        if (path.output != o) {
+          continue;
+        }
+        const ImpulseResponse& r = response_[path.response];
+        // partition q applies to the input spectrum q blocks old
+        size_t slot = fdl_pos_;
+        for (size_t q = 0; q < partitions_; q++) {
+          MultiplyAccumulate(r.spectra_re + q * bins_, r.spectra_im + q * bins_,
+                             fdl_re_[path.input] + slot * bins_,
+                             fdl_im_[path.input] + slot * bins_,
+                             acc_re_, acc_im_, bins_);
+          if (++slot == partitions_) {
+            slot = 0;
+          }
+        }
+      }
+      // the second half of the circular convolution is the linear one
+      fft_.Inverse(acc_re_, acc_im_, time_);
+      memcpy(tail_[o], time_ + block_, block_ * sizeof(float));
+    }
+  }
+  for (size_t c = 0; c < channels_; c++) {
+    memcpy(input_[c], input_[c] + block_, block_ * sizeof(float));
+  }
+}
+
+}  // namespace conv_fx
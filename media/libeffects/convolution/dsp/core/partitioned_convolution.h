@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CONV_FX_ENGINE_DSP_CORE_PARTITIONED_CONVOLUTION_H_
+#define CONV_FX_ENGINE_DSP_CORE_PARTITIONED_CONVOLUTION_H_
+
+#include <stddef.h>
+
+#include "dsp/core/fft.h"
+
+namespace conv_fx {
+
+// Zero latency convolution of an interleaved signal with long impulse
+// responses.
+//
+// The first block_size taps of each impulse response, the head, are applied
+// directly in the time domain. The remaining taps are cut in partitions of
+// block_size taps that are applied in the frequency domain with uniformly
+// partitioned overlap-save: every block_size input frames, the spectrum of
+// the last two blocks is computed once per input channel and kept in a
+// frequency domain delay line, and each output block is the inverse
+// transform of the sum of the delayed input spectra multiplied by the
+// partition spectra. The one block latency of the frequency domain part is
+// exactly covered by the head, so the output is not delayed.
+//
+// The cost per frame is block_size multiply-adds for the head plus about
+// (length - block_size) / block_size complex multiply-adds and two FFTs of
+// 2 * block_size points per block for the tail.
+class PartitionedConvolution {
+ public:
+  static const size_t kMaxChannels = 2;
+  static const size_t kMaxImpulseResponses = kMaxChannels * kMaxChannels;
+
+  PartitionedConvolution();
+  ~PartitionedConvolution();
+
+  // Allocates the engine for `channels` interleaved input and output
+  // channels and impulse responses of `length` frames. The responses are
+  // initially silent.
+  //
+  // `block_size` is the head and partition size, a power of two of at least
+  // 16. `responses` selects how the channels are filtered:
+  //  - 1: every channel is filtered by the same response,
+  //  - channels: channel c is filtered by response c,
+  //  - channels * channels: output o receives input i filtered by response
+  //    i * channels + o.
+  // Returns false on an invalid configuration.
+  bool Initialize(size_t block_size, size_t channels, size_t length, size_t responses);
+
+  // Sets `count` taps of response `response` starting at tap `offset`. Only
+  // the head and the partitions covering the modified taps are recomputed,
+  // so a long response can be loaded in chunks. Returns false if the taps
+  // are out of range.
+  bool SetImpulseResponse(size_t response, size_t offset, const float *taps, size_t count);
+
+  // Clears the signal history, not the impulse responses.
+  void Reset();
+
+  // Filters `frames` interleaved frames. `out` may be equal to `in`.
+  void Process(const float *in, float *out, size_t frames);
+
+  size_t channels() const { return channels_; }
+  size_t length() const { return length_; }
+  size_t responses() const { return responses_; }
+
+ private:
+  struct ImpulseResponse {
+    float *taps;        // length_ taps
+    float *head;        // first block_ taps, time reversed
+    float *spectra_re;  // partitions_ spectra of bins_ bins
+    float *spectra_im;
+  };
+
+  struct Path {
+    size_t input;
+    size_t output;
+    size_t response;
+  };
+
+  void Free();
+  void UpdatePartition(ImpulseResponse *response, size_t partition);
+  void ProcessBlock();
+
+  size_t block_;
+  // number of bins of a spectrum, block_ + 1 rounded up to a multiple of 4
+  size_t bins_;
+  size_t partitions_;
+  size_t channels_;
+  size_t length_;
+  size_t responses_;
+  RealFft fft_;
+
+  ImpulseResponse response_[kMaxImpulseResponses];
+  Path path_[kMaxImpulseResponses];
+  size_t num_paths_;
+
+  // per input channel: the previous and the current block of input
+  float *input_[kMaxChannels];
+  // per input channel: frequency domain delay line of partitions_ spectra,
+  // the newest spectrum is at slot fdl_pos_
+  float *fdl_re_[kMaxChannels];
+  float *fdl_im_[kMaxChannels];
+  size_t fdl_pos_;
+  // per output channel: tail output for the current block
+  float *tail_[kMaxChannels];
+  // position in the current block
+  size_t pos_;
+
+  float *acc_re_;
+  float *acc_im_;
+  float *time_;
+
+  PartitionedConvolution(const PartitionedConvolution&);
+  PartitionedConvolution& operator=(const PartitionedConvolution&);
+};
+
+}  // namespace conv_fx
+
+#endif  // CONV_FX_ENGINE_DSP_CORE_PARTITIONED_CONVOLUTION_H_
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_EFFECT_CONVOLUTIONREVERB_H_
+#define ANDROID_EFFECT_CONVOLUTIONREVERB_H_
+
+#include <hardware/audio_effect.h>
+
+#if __cplusplus
+extern "C" {
+#endif
+
+// this effect is not defined in OpenSL ES as one of the standard effects
+static const effect_uuid_t FX_IID_CONVOLUTION_REVERB_ =
+    {0x899613e5, 0xcf03, 0x4910, 0xb30b, {0x7a, 0xa5, 0x2f, 0x2b, 0xd7, 0x9a}};
+const effect_uuid_t * const FX_IID_CONVOLUTION_REVERB = &FX_IID_CONVOLUTION_REVERB_;
+
+#define CONVOLUTION_REVERB_MAX_FRAMES (4 * 48000) // longest impulse response, in frames
+#define CONVOLUTION_REVERB_DEFAULT_WET_LEVEL_MB 0
+#define CONVOLUTION_REVERB_DEFAULT_DRY_LEVEL_MB (-9600)
+
+// enumerated parameters for the convolution reverb effect
+typedef enum
+{
+    // Impulse response layout: value is two uint32_t, the number of responses
+    // and the number of frames per response. For a stereo stream, 1 response
+    // filters both channels, 2 responses filter left and right independently
+    // and 4 responses are a matrix where response i * 2 + o takes input
+    // channel i to output channel o. Setting the layout silences the responses.
+    // The default layout is a single response made of one unit tap.
+    CONVOLUTION_REVERB_PARAM_IMPULSE_RESPONSE_LAYOUT,
+    // Impulse response taps: parameter is three uint32_t, the parameter code,
+    // the response index and the offset of the first tap in frames; value is
+    // an array of float taps. Long responses are loaded in several chunks.
+    // Set only.
+    CONVOLUTION_REVERB_PARAM_IMPULSE_RESPONSE,
+    // Level of the filtered signal in millibels, int16_t.
+    CONVOLUTION_REVERB_PARAM_WET_LEVEL,
+    // Level of the unfiltered signal in millibels, int16_t. Muted by default as
+    // measured responses normally include the direct path.
+    CONVOLUTION_REVERB_PARAM_DRY_LEVEL,
+} t_convolution_reverb_params;
+
+#if __cplusplus
+}  // extern "C"
+#endif
+
+
+#endif /*ANDROID_EFFECT_CONVOLUTIONREVERB_H_*/
@@ -0,0 +1,35 @@
+# Build the unit tests for the convolution reverb engine
+
+#
+# FFT and partitioned convolution test
+#
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils \
+	libstlport
+
+LOCAL_STATIC_LIBRARIES := \
+	libgtest \
+	libgtest_main
+
+LOCAL_C_INCLUDES := \
+	bionic \
+	bionic/libstdc++/include \
+	external/gtest/include \
+	external/stlport/stlport \
+	$(LOCAL_PATH)/..
+
+LOCAL_SRC_FILES := \
+	convolution_tests.cpp \
+	../dsp/core/fft.cpp \
+	../dsp/core/partitioned_convolution.cpp
+
+LOCAL_ARM_NEON := true
+
+LOCAL_MODULE := convolution_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "convolution_tests"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "dsp/core/fft.h"
+#include "dsp/core/partitioned_convolution.h"
+
+using conv_fx::PartitionedConvolution;
+using conv_fx::RealFft;
+
+static void fillRandom(std::vector<float>& v)
+{
+    for (size_t i = 0; i < v.size(); i++) {
+        v[i] = (float) rand() / RAND_MAX * 2.0f - 1.0f;
+    }
+}
+
+TEST(conv_fx, fft_matches_dft)
+{
+    const size_t n = 64;
+    RealFft fft;
+    ASSERT_TRUE(fft.Initialize(n));
+    std::vector<float> x(n), re(n / 2 + 1), im(n / 2 + 1), y(n);
+    fillRandom(x);
+    fft.Forward(&x[0], &re[0], &im[0]);
+    for (size_t k = 0; k <= n / 2; k++) {
+        double dr = 0., di = 0.;
+        for (size_t t = 0; t < n; t++) {
+            dr += x[t] * cos(-2 * M_PI * k * t / n);
+            di += x[t] * sin(-2 * M_PI * k * t / n);
+        }
+        EXPECT_NEAR(dr, re[k], 1e-4);
+        EXPECT_NEAR(di, im[k], 1e-4);
+    }
+    fft.Inverse(&re[0], &im[0], &y[0]);
+    for (size_t t = 0; t < n; t++) {
+        EXPECT_NEAR(x[t] * (n / 2), y[t], 1e-3);
+    }
+}
+
+// Compares the engine against a direct convolution, processing the input in
+// chunks that do not align with the partitions.
+static void testConvolution(size_t block, size_t channels, size_t length, size_t responses)
+{
+    PartitionedConvolution conv;
+    ASSERT_TRUE(conv.Initialize(block, channels, length, responses));
+
+    std::vector< std::vector<float> > ir(responses, std::vector<float>(length));
+    for (size_t r = 0; r < responses; r++) {
+        fillRandom(ir[r]);
+        // load in uneven chunks
+        for (size_t offset = 0; offset < length; offset += 37) {
+            size_t count = length - offset < 37 ? length - offset : 37;
+            ASSERT_TRUE(conv.SetImpulseResponse(r, offset, &ir[r][offset], count));
+        }
+    }
+
+    const size_t frames = length * 2 + 3 * block + 5;
+    std::vector<float> in(frames * channels), out(frames * channels);
+    fillRandom(in);
+    std::vector<float> buffer(in);
+    static const size_t kChunks[] = { 1, 7, 64, block, 3 * block + 1 };
+    size_t chunk = 0;
+    for (size_t f = 0; f < frames; ) {
+        size_t count = kChunks[chunk++ % (sizeof(kChunks) / sizeof(kChunks[0]))];
+        if (count > frames - f) {
+            count = frames - f;
+        }
+        // in place
+        conv.Process(&buffer[f * channels], &buffer[f * channels], count);
+        f += count;
+    }
+
+    for (size_t o = 0; o < channels; o++) {
+        for (size_t n = 0; n < frames; n++) {
+            double expected = 0.;
+            for (size_t i = 0; i < channels; i++) {
+                size_t r;
+                if (responses == channels * channels) {
+                    r = i * channels + o;
+                } else if (i == o) {
+                    r = responses == 1 ? 0 : i;
+                } else {
+                    continue;
+                }
+                for (size_t j = 0; j < length && j <= n; j++) {
+                    expected += ir[r][j] * in[(n - j) * channels + i];
+                }
+            }
+            ASSERT_NEAR(expected, buffer[n * channels + o], 2e-3)
+                    << "output " << o << " frame " << n;
+        }
+    }
+}
+
+TEST(conv_fx, head_only)
+{
+    testConvolution(32, 1, 20, 1);
+}
+
+TEST(conv_fx, mono)
+{
+    testConvolution(16, 1, 1000, 1);
+}
+
+TEST(conv_fx, stereo_shared_response)
+{
+    testConvolution(64, 2, 1500, 1);
+}
+
+TEST(conv_fx, stereo_per_channel)
+{
+    testConvolution(32, 2, 777, 2);
+}
+
+TEST(conv_fx, stereo_matrix)
+{
+    testConvolution(128, 2, 2049, 4);
+}
+
+TEST(conv_fx, reset_clears_history)
+{
+    PartitionedConvolution conv;
+    ASSERT_TRUE(conv.Initialize(16, 1, 100, 1));
+    std::vector<float> ir(100, 0.5f), x(256, 1.0f);
+    ASSERT_TRUE(conv.SetImpulseResponse(0, 0, &ir[0], ir.size()));
+    conv.Process(&x[0], &x[0], x.size());
+    conv.Reset();
+    std::vector<float> zero(256, 0.0f);
+    conv.Process(&zero[0], &zero[0], zero.size());
+    for (size_t i = 0; i < zero.size(); i++) {
+        ASSERT_EQ(0.0f, zero[i]);
+    }
+}
+
+TEST(conv_fx, invalid_configuration)
+{
+    PartitionedConvolution conv;
+    EXPECT_FALSE(conv.Initialize(24, 2, 100, 2));
+    EXPECT_FALSE(conv.Initialize(8, 2, 100, 2));
+    EXPECT_FALSE(conv.Initialize(16, 3, 100, 3));
+    EXPECT_FALSE(conv.Initialize(16, 2, 100, 3));
+    EXPECT_FALSE(conv.Initialize(16, 2, 0, 2));
+    ASSERT_TRUE(conv.Initialize(16, 2, 100, 2));
+    float tap = 1.0f;
+    EXPECT_FALSE(conv.SetImpulseResponse(2, 0, &tap, 1));
+    EXPECT_FALSE(conv.SetImpulseResponse(0, 100, &tap, 1));
+    EXPECT_TRUE(conv.SetImpulseResponse(0, 99, &tap, 1));
+}
@@ -21,23 +21,20 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 #include "EffectDownmix.h"
 
-// Do not submit with DOWNMIX_TEST_CHANNEL_INDEX defined, strictly for testing
-//#define DOWNMIX_TEST_CHANNEL_INDEX 0
-// Do not submit with DOWNMIX_ALWAYS_USE_GENERIC_DOWNMIXER defined, strictly for testing
-//#define DOWNMIX_ALWAYS_USE_GENERIC_DOWNMIXER 0
-
-#define MINUS_3_DB_IN_Q19_12 2896 // -3dB = 0.707 * 2^12 = 2896
+// Do not submit with DOWNMIX_TEST_MATRIX defined, strictly for testing
+//#define DOWNMIX_TEST_MATRIX 0
 
-// subset of possible audio_channel_mask_t values, and AUDIO_CHANNEL_OUT_* renamed to CHANNEL_MASK_*
-typedef enum {
-    CHANNEL_MASK_QUAD_BACK = AUDIO_CHANNEL_OUT_QUAD_BACK,
-    CHANNEL_MASK_QUAD_SIDE = AUDIO_CHANNEL_OUT_QUAD_SIDE,
-    CHANNEL_MASK_5POINT1_BACK = AUDIO_CHANNEL_OUT_5POINT1_BACK,
-    CHANNEL_MASK_5POINT1_SIDE = AUDIO_CHANNEL_OUT_5POINT1_SIDE,
-    CHANNEL_MASK_7POINT1 = AUDIO_CHANNEL_OUT_7POINT1,
-} downmix_input_channel_mask_t;
+#define MINUS_3_DB 0.70710678f
+// gain applied to every input channel so that a full scale front and surround pair does not
+// clip, same headroom as the former fixed point fold functions
+#define DOWNMIX_FOLD_GAIN 0.5f
+// frames converted to float at a time by Downmix_mix16()
+#define DOWNMIX_BLOCK_FRAMES 32
 
 // effect_handle_t interface implementation for downmix effect
 const struct effect_interface_s gDownmixInterface = {
@@ -84,60 +81,20 @@ const int kNbEffects = sizeof(gDescriptors) / sizeof(const effect_descriptor_t *
 /*----------------------------------------------------------------------------
  * Test code
  *--------------------------------------------------------------------------*/
-#ifdef DOWNMIX_TEST_CHANNEL_INDEX
-// strictly for testing, logs the indices of the channels for a given mask,
-// uses the same code as Downmix_foldGeneric()
-void Downmix_testIndexComputation(uint32_t mask) {
-    ALOGI("Testing index computation for 0x%" PRIx32 ":", mask);
-    // check against unsupported channels
-    if (mask & kUnsupported) {
-        ALOGE("Unsupported channels (top or front left/right of center)");
-        return;
-    }
-    // verify has FL/FR
-    if ((mask & AUDIO_CHANNEL_OUT_STEREO) != AUDIO_CHANNEL_OUT_STEREO) {
-        ALOGE("Front channels must be present");
-        return;
-    }
-    // verify uses SIDE as a pair (ok if not using SIDE at all)
-    bool hasSides = false;
-    if ((mask & kSides) != 0) {
-        if ((mask & kSides) != kSides) {
-            ALOGE("Side channels must be used as a pair");
-            return;
-        }
-        hasSides = true;
-    }
-    // verify uses BACK as a pair (ok if not using BACK at all)
-    bool hasBacks = false;
-    if ((mask & kBacks) != 0) {
-        if ((mask & kBacks) != kBacks) {
-            ALOGE("Back channels must be used as a pair");
-            return;
-        }
-        hasBacks = true;
+#ifdef DOWNMIX_TEST_MATRIX
+// strictly for testing, logs the downmix matrix computed for a given mask
+void Downmix_testMatrixComputation(uint32_t mask) {
+    downmix_object_t downmixer;
+    memset(&downmixer, 0, sizeof(downmixer));
+    downmixer.type = DOWNMIX_TYPE_FOLD;
+    downmixer.input_channel_mask = mask;
+    downmixer.input_channel_count = audio_channel_count_from_out_mask(mask);
+    Downmix_computeMatrix(&downmixer);
+    ALOGI("Testing matrix computation for 0x%" PRIx32 ":", mask);
+    for (int i = 0; i < downmixer.input_channel_count; i++) {
+        ALOGI("  channel %d: left %f right %f", i,
+                downmixer.matrix[0][i], downmixer.matrix[1][i]);
     }
-
-    const int numChan = audio_channel_count_from_out_mask(mask);
-    const bool hasFC = ((mask & AUDIO_CHANNEL_OUT_FRONT_CENTER) == AUDIO_CHANNEL_OUT_FRONT_CENTER);
-    const bool hasLFE =
-            ((mask & AUDIO_CHANNEL_OUT_LOW_FREQUENCY) == AUDIO_CHANNEL_OUT_LOW_FREQUENCY);
-    const bool hasBC = ((mask & AUDIO_CHANNEL_OUT_BACK_CENTER) == AUDIO_CHANNEL_OUT_BACK_CENTER);
-    // compute at what index each channel is: samples will be in the following order:
-    //   FL FR FC LFE BL BR BC SL SR
-    // when a channel is not present, its index is set to the same as the index of the preceding
-    // channel
-    const int indexFC  = hasFC    ? 2            : 1;        // front center
-    const int indexLFE = hasLFE   ? indexFC + 1  : indexFC;  // low frequency
-    const int indexBL  = hasBacks ? indexLFE + 1 : indexLFE; // back left
-    const int indexBR  = hasBacks ? indexBL + 1  : indexBL;  // back right
-    const int indexBC  = hasBC    ? indexBR + 1  : indexBR;  // back center
-    const int indexSL  = hasSides ? indexBC + 1  : indexBC;  // side left
-    const int indexSR  = hasSides ? indexSL + 1  : indexSL;  // side right
-
-    ALOGI("  FL FR FC LFE BL BR BC SL SR");
-    ALOGI("   %d  %d  %d   %d  %d  %d  %d  %d  %d",
-            0, 1, indexFC, indexLFE, indexBL, indexBR, indexBC, indexSL, indexSR);
 }
 #endif
 
@@ -159,24 +116,15 @@ int32_t DownmixLib_Create(const effect_uuid_t *uuid,
 
     ALOGV("DownmixLib_Create()");
 
-#ifdef DOWNMIX_TEST_CHANNEL_INDEX
-    // should work (won't log an error)
-    ALOGI("DOWNMIX_TEST_CHANNEL_INDEX: should work:");
-    Downmix_testIndexComputation(AUDIO_CHANNEL_OUT_FRONT_LEFT | AUDIO_CHANNEL_OUT_FRONT_RIGHT |
-                    AUDIO_CHANNEL_OUT_LOW_FREQUENCY | AUDIO_CHANNEL_OUT_BACK_CENTER);
-    Downmix_testIndexComputation(CHANNEL_MASK_QUAD_SIDE | CHANNEL_MASK_QUAD_BACK);
-    Downmix_testIndexComputation(CHANNEL_MASK_5POINT1_SIDE | AUDIO_CHANNEL_OUT_BACK_CENTER);
-    Downmix_testIndexComputation(CHANNEL_MASK_5POINT1_BACK | AUDIO_CHANNEL_OUT_BACK_CENTER);
-    // shouldn't work (will log an error, won't display channel indices)
-    ALOGI("DOWNMIX_TEST_CHANNEL_INDEX: should NOT work:");
-    Downmix_testIndexComputation(AUDIO_CHANNEL_OUT_FRONT_LEFT | AUDIO_CHANNEL_OUT_FRONT_RIGHT |
-                        AUDIO_CHANNEL_OUT_LOW_FREQUENCY | AUDIO_CHANNEL_OUT_BACK_LEFT);
-    Downmix_testIndexComputation(AUDIO_CHANNEL_OUT_FRONT_LEFT | AUDIO_CHANNEL_OUT_FRONT_RIGHT |
-                            AUDIO_CHANNEL_OUT_LOW_FREQUENCY | AUDIO_CHANNEL_OUT_SIDE_LEFT);
-    Downmix_testIndexComputation(AUDIO_CHANNEL_OUT_FRONT_LEFT |
-                        AUDIO_CHANNEL_OUT_BACK_LEFT | AUDIO_CHANNEL_OUT_BACK_RIGHT);
-    Downmix_testIndexComputation(AUDIO_CHANNEL_OUT_FRONT_LEFT |
-                            AUDIO_CHANNEL_OUT_SIDE_LEFT | AUDIO_CHANNEL_OUT_SIDE_RIGHT);
+#ifdef DOWNMIX_TEST_MATRIX
+    Downmix_testMatrixComputation(AUDIO_CHANNEL_OUT_QUAD);
+    Downmix_testMatrixComputation(AUDIO_CHANNEL_OUT_5POINT1);
+    Downmix_testMatrixComputation(AUDIO_CHANNEL_OUT_7POINT1);
+    Downmix_testMatrixComputation(AUDIO_CHANNEL_OUT_5POINT1_SIDE | AUDIO_CHANNEL_OUT_BACK_CENTER);
+    Downmix_testMatrixComputation(AUDIO_CHANNEL_OUT_FRONT_LEFT | AUDIO_CHANNEL_OUT_FRONT_RIGHT |
+                    AUDIO_CHANNEL_OUT_LOW_FREQUENCY | AUDIO_CHANNEL_OUT_BACK_LEFT);
+    Downmix_testMatrixComputation(AUDIO_CHANNEL_OUT_7POINT1 | AUDIO_CHANNEL_OUT_TOP_FRONT_LEFT |
+                    AUDIO_CHANNEL_OUT_TOP_FRONT_RIGHT);
 #endif
 
     if (pHandle == NULL || uuid == NULL) {
@@ -259,7 +207,6 @@ static int Downmix_Process(effect_handle_t self,
         audio_buffer_t *inBuffer, audio_buffer_t *outBuffer) {
 
     downmix_object_t *pDownmixer;
-    int16_t *pSrc, *pDst;
     downmix_module_t *pDwmModule = (downmix_module_t *)self;
 
     if (pDwmModule == NULL) {
@@ -282,71 +229,16 @@ static int Downmix_Process(effect_handle_t self,
         return -ENODATA;
     }
 
-    pSrc = inBuffer->s16;
-    pDst = outBuffer->s16;
-    size_t numFrames = outBuffer->frameCount;
-
+    const size_t numFrames = outBuffer->frameCount;
     const bool accumulate =
             (pDwmModule->config.outputCfg.accessMode == EFFECT_BUFFER_ACCESS_ACCUMULATE);
-    const uint32_t downmixInputChannelMask = pDwmModule->config.inputCfg.channels;
-
-    switch(pDownmixer->type) {
-
-      case DOWNMIX_TYPE_STRIP:
-          if (accumulate) {
-              while (numFrames) {
-                  pDst[0] = clamp16(pDst[0] + pSrc[0]);
-                  pDst[1] = clamp16(pDst[1] + pSrc[1]);
-                  pSrc += pDownmixer->input_channel_count;
-                  pDst += 2;
-                  numFrames--;
-              }
-          } else {
-              while (numFrames) {
-                  pDst[0] = pSrc[0];
-                  pDst[1] = pSrc[1];
-                  pSrc += pDownmixer->input_channel_count;
-                  pDst += 2;
-                  numFrames--;
-              }
-          }
-          break;
-
-      case DOWNMIX_TYPE_FOLD:
-#ifdef DOWNMIX_ALWAYS_USE_GENERIC_DOWNMIXER
-          // bypass the optimized downmix routines for the common formats
-          if (!Downmix_foldGeneric(
-                  downmixInputChannelMask, pSrc, pDst, numFrames, accumulate)) {
-              ALOGE("Multichannel configuration 0x%" PRIx32 " is not supported", downmixInputChannelMask);
-              return -EINVAL;
-          }
-          break;
-#endif
-        // optimize for the common formats
-        switch((downmix_input_channel_mask_t)downmixInputChannelMask) {
-        case CHANNEL_MASK_QUAD_BACK:
-        case CHANNEL_MASK_QUAD_SIDE:
-            Downmix_foldFromQuad(pSrc, pDst, numFrames, accumulate);
-            break;
-        case CHANNEL_MASK_5POINT1_BACK:
-        case CHANNEL_MASK_5POINT1_SIDE:
-            Downmix_foldFrom5Point1(pSrc, pDst, numFrames, accumulate);
-            break;
-        case CHANNEL_MASK_7POINT1:
-            Downmix_foldFrom7Point1(pSrc, pDst, numFrames, accumulate);
-            break;
-        default:
-            if (!Downmix_foldGeneric(
-                    downmixInputChannelMask, pSrc, pDst, numFrames, accumulate)) {
-                ALOGE("Multichannel configuration 0x%" PRIx32 " is not supported", downmixInputChannelMask);
-                return -EINVAL;
-            }
-            break;
-        }
-        break;
 
-      default:
-        return -EINVAL;
+    // both downmix types are a matrix, see Downmix_computeMatrix()
+    if (pDwmModule->config.inputCfg.format == AUDIO_FORMAT_PCM_FLOAT) {
+        Downmix_mixFloat(pDownmixer, (const float *)inBuffer->raw, (float *)outBuffer->raw,
+                numFrames, accumulate);
+    } else {
+        Downmix_mix16(pDownmixer, inBuffer->s16, outBuffer->s16, numFrames, accumulate);
     }
 
     return 0;
@@ -609,8 +501,9 @@ int Downmix_Configure(downmix_module_t *pDwmModule, effect_config_t *pConfig, bo
     // Check configuration compatibility with build options, and effect capabilities
     if (pConfig->inputCfg.samplingRate != pConfig->outputCfg.samplingRate
         || pConfig->outputCfg.channels != DOWNMIX_OUTPUT_CHANNELS
-        || pConfig->inputCfg.format != AUDIO_FORMAT_PCM_16_BIT
-        || pConfig->outputCfg.format != AUDIO_FORMAT_PCM_16_BIT) {
+        || (pConfig->inputCfg.format != AUDIO_FORMAT_PCM_16_BIT
+                && pConfig->inputCfg.format != AUDIO_FORMAT_PCM_FLOAT)
+        || pConfig->outputCfg.format != pConfig->inputCfg.format) {
         ALOGE("Downmix_Configure error: invalid config");
         return -EINVAL;
     }
@@ -623,6 +516,7 @@ int Downmix_Configure(downmix_module_t *pDwmModule, effect_config_t *pConfig, bo
         pDownmixer->type = DOWNMIX_TYPE_FOLD;
         pDownmixer->apply_volume_correction = false;
         pDownmixer->input_channel_count = 8; // matches default input of AUDIO_CHANNEL_OUT_7POINT1
+        pDownmixer->input_channel_mask = AUDIO_CHANNEL_OUT_7POINT1;
     } else {
         // when configuring the effect, do not allow a blank channel mask
         if (pConfig->inputCfg.channels == 0) {
@@ -631,6 +525,7 @@ int Downmix_Configure(downmix_module_t *pDwmModule, effect_config_t *pConfig, bo
         }
         pDownmixer->input_channel_count =
                 audio_channel_count_from_out_mask(pConfig->inputCfg.channels);
+        pDownmixer->input_channel_mask = pConfig->inputCfg.channels;
     }
 
     Downmix_Reset(pDownmixer, init);
@@ -643,7 +538,7 @@ int Downmix_Configure(downmix_module_t *pDwmModule, effect_config_t *pConfig, bo
  * Downmix_Reset()
  *----------------------------------------------------------------------------
  * Purpose:
- *  Reset internal states.
+ *  Reset internal states, and recompute the downmix matrix.
  *
  * Inputs:
  *  pDownmixer   pointer to downmix context
@@ -660,7 +555,7 @@ int Downmix_Configure(downmix_module_t *pDwmModule, effect_config_t *pConfig, bo
  */
 
 int Downmix_Reset(downmix_object_t *pDownmixer, bool init) {
-    // nothing to do here
+    Downmix_computeMatrix(pDownmixer);
     return 0;
 }
 
@@ -707,6 +602,7 @@ int Downmix_setParameter(downmix_object_t *pDownmixer, int32_t param, uint32_t s
             return -EINVAL;
         } else {
             pDownmixer->type = (downmix_type_t) value16;
+            Downmix_computeMatrix(pDownmixer);
         break;
 
       default:
@@ -767,315 +663,231 @@ int Downmix_getParameter(downmix_object_t *pDownmixer, int32_t param, uint32_t *
 } /* end Downmix_getParameter */
 
 
+
+
 /*----------------------------------------------------------------------------
- * Downmix_foldFromQuad()
+ * Downmix_computeMatrix()
  *----------------------------------------------------------------------------
  * Purpose:
- * downmix a quad signal to stereo
+ * Compute the gain of each input channel in each output channel for the current input channel
+ * mask and downmix type.
+ * DOWNMIX_TYPE_STRIP keeps the first two channels.
+ * DOWNMIX_TYPE_FOLD mixes each channel of a positional mask into the output on its side, and
+ * the center and low frequency channels into both outputs at -3dB, all attenuated by 6dB. A
+ * mask with a single channel, or an index mask, is folded as if it was stripped.
  *
  * Inputs:
- *  pSrc       quad audio samples to downmix
- *  numFrames  the number of quad frames to downmix
- *  accumulate whether to mix (when true) the result of the downmix with the contents of pDst,
- *               or overwrite pDst (when false)
+ *  pDownmixer  downmix context, with type and input_channel_mask set
  *
  * Outputs:
- *  pDst       downmixed stereo audio samples
+ *  pDownmixer->matrix
  *
  *----------------------------------------------------------------------------
  */
-void Downmix_foldFromQuad(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate) {
-    // sample at index 0 is FL
-    // sample at index 1 is FR
-    // sample at index 2 is RL
-    // sample at index 3 is RR
-    if (accumulate) {
-        while (numFrames) {
-            // FL + RL
-            pDst[0] = clamp16(pDst[0] + ((pSrc[0] + pSrc[2]) >> 1));
-            // FR + RR
-            pDst[1] = clamp16(pDst[1] + ((pSrc[1] + pSrc[3]) >> 1));
-            pSrc += 4;
-            pDst += 2;
-            numFrames--;
-        }
-    } else { // same code as above but without adding and clamping pDst[i] to itself
-        while (numFrames) {
-            // FL + RL
-            pDst[0] = clamp16((pSrc[0] + pSrc[2]) >> 1);
-            // FR + RR
-            pDst[1] = clamp16((pSrc[1] + pSrc[3]) >> 1);
-            pSrc += 4;
-            pDst += 2;
-            numFrames--;
+void Downmix_computeMatrix(downmix_object_t *pDownmixer) {
+    const uint32_t mask = pDownmixer->input_channel_mask;
+    const int numChan = pDownmixer->input_channel_count;
+
+    memset(pDownmixer->matrix, 0, sizeof(pDownmixer->matrix));
+    if (numChan == 0 || numChan > DOWNMIX_MAX_INPUT_CHANNELS) {
+        return;
+    }
+
+    if (pDownmixer->type != DOWNMIX_TYPE_FOLD || numChan == 1 ||
+            audio_channel_mask_get_representation(mask) != AUDIO_CHANNEL_REPRESENTATION_POSITION) {
+        pDownmixer->matrix[0][0] = 1.0f;
+        pDownmixer->matrix[1][numChan > 1 ? 1 : 0] = 1.0f;
+        return;
+    }
+
+    // samples are interleaved in increasing order of the channel bits
+    uint32_t bits = audio_channel_mask_get_bits(mask);
+    for (int i = 0; bits != 0; i++) {
+        const uint32_t channel = bits & -bits;
+        bits &= ~channel;
+        if (channel & kLeftChannels) {
+            pDownmixer->matrix[0][i] = DOWNMIX_FOLD_GAIN;
+        } else if (channel & kRightChannels) {
+            pDownmixer->matrix[1][i] = DOWNMIX_FOLD_GAIN;
+        } else if (channel & kCenterChannels) {
+            pDownmixer->matrix[0][i] = DOWNMIX_FOLD_GAIN * MINUS_3_DB;
+            pDownmixer->matrix[1][i] = DOWNMIX_FOLD_GAIN * MINUS_3_DB;
         }
+        // other bits do not name a position and are dropped
     }
 }
 
 
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
 /*----------------------------------------------------------------------------
- * Downmix_foldFrom5Point1()
+ * Downmix_mixFloatNeon()
  *----------------------------------------------------------------------------
  * Purpose:
- * downmix a 5.1 signal to stereo
+ * NEON kernel of Downmix_mixFloat(): each frame is loaded 4 channels at a time and multiplied
+ * by the matching columns of both matrix rows, then both accumulators are reduced into the
+ * output pair. The loads of the last group of a frame can extend into the next frame when the
+ * channel count is not a multiple of 4, the matching columns are 0, so the frames whose loads
+ * would extend past the end of pSrc are left to the caller.
  *
- * Inputs:
- *  pSrc       5.1 audio samples to downmix
- *  numFrames  the number of 5.1 frames to downmix
- *  accumulate whether to mix (when true) the result of the downmix with the contents of pDst,
- *               or overwrite pDst (when false)
- *
- * Outputs:
- *  pDst       downmixed stereo audio samples
+ * Returns: the number of frames mixed
  *
  *----------------------------------------------------------------------------
  */
-void Downmix_foldFrom5Point1(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate) {
-    int32_t lt, rt, centerPlusLfeContrib; // samples in Q19.12 format
-    // sample at index 0 is FL
-    // sample at index 1 is FR
-    // sample at index 2 is FC
-    // sample at index 3 is LFE
-    // sample at index 4 is RL
-    // sample at index 5 is RR
-    // code is mostly duplicated between the two values of accumulate to avoid repeating the test
-    // for every sample
-    if (accumulate) {
-        while (numFrames) {
-            // centerPlusLfeContrib = FC(-3dB) + LFE(-3dB)
-            centerPlusLfeContrib = (pSrc[2] * MINUS_3_DB_IN_Q19_12)
-                    + (pSrc[3] * MINUS_3_DB_IN_Q19_12);
-            // FL + centerPlusLfeContrib + RL
-            lt = (pSrc[0] << 12) + centerPlusLfeContrib + (pSrc[4] << 12);
-            // FR + centerPlusLfeContrib + RR
-            rt = (pSrc[1] << 12) + centerPlusLfeContrib + (pSrc[5] << 12);
-            // accumulate in destination
-            pDst[0] = clamp16(pDst[0] + (lt >> 13));
-            pDst[1] = clamp16(pDst[1] + (rt >> 13));
-            pSrc += 6;
+static size_t Downmix_mixFloatNeon(const downmix_object_t *pDownmixer,
+        const float *pSrc, float *pDst, size_t numFrames, bool accumulate) {
+    const size_t numChan = pDownmixer->input_channel_count;
+    const size_t numGroups = (numChan + 3) >> 2;
+    const size_t overread = (numGroups << 2) - numChan;
+    const size_t tailFrames = (overread + numChan - 1) / numChan;
+    if (numFrames <= tailFrames) {
+        return 0;
+    }
+    const size_t count = numFrames - tailFrames;
+    const float *left = pDownmixer->matrix[0];
+    const float *right = pDownmixer->matrix[1];
+
+    if (numGroups <= 2) {
+        // up to 7.1, both rows stay in registers
+        const float32x4_t l0 = vld1q_f32(left);
+        const float32x4_t r0 = vld1q_f32(right);
+        const float32x4_t l1 = vld1q_f32(left + 4);
+        const float32x4_t r1 = vld1q_f32(right + 4);
+        for (size_t i = 0; i < count; i++) {
+            const float32x4_t s0 = vld1q_f32(pSrc);
+            float32x4_t accL = vmulq_f32(s0, l0);
+            float32x4_t accR = vmulq_f32(s0, r0);
+            if (numGroups == 2) {
+                const float32x4_t s1 = vld1q_f32(pSrc + 4);
+                accL = vmlaq_f32(accL, s1, l1);
+                accR = vmlaq_f32(accR, s1, r1);
+            }
+            float32x2_t out = vpadd_f32(vadd_f32(vget_low_f32(accL), vget_high_f32(accL)),
+                    vadd_f32(vget_low_f32(accR), vget_high_f32(accR)));
+            if (accumulate) {
+                out = vadd_f32(out, vld1_f32(pDst));
+            }
+            vst1_f32(pDst, out);
+            pSrc += numChan;
             pDst += 2;
-            numFrames--;
         }
-    } else { // same code as above but without adding and clamping pDst[i] to itself
-        while (numFrames) {
-            // centerPlusLfeContrib = FC(-3dB) + LFE(-3dB)
-            centerPlusLfeContrib = (pSrc[2] * MINUS_3_DB_IN_Q19_12)
-                    + (pSrc[3] * MINUS_3_DB_IN_Q19_12);
-            // FL + centerPlusLfeContrib + RL
-            lt = (pSrc[0] << 12) + centerPlusLfeContrib + (pSrc[4] << 12);
-            // FR + centerPlusLfeContrib + RR
-            rt = (pSrc[1] << 12) + centerPlusLfeContrib + (pSrc[5] << 12);
-            // store in destination
-            pDst[0] = clamp16(lt >> 13); // differs from when accumulate is true above
-            pDst[1] = clamp16(rt >> 13); // differs from when accumulate is true above
-            pSrc += 6;
-            pDst += 2;
-            numFrames--;
+        return count;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        float32x4_t accL = vdupq_n_f32(0.0f);
+        float32x4_t accR = vdupq_n_f32(0.0f);
+        for (size_t j = 0; j < numGroups << 2; j += 4) {
+            const float32x4_t s = vld1q_f32(pSrc + j);
+            accL = vmlaq_f32(accL, s, vld1q_f32(left + j));
+            accR = vmlaq_f32(accR, s, vld1q_f32(right + j));
+        }
+        float32x2_t out = vpadd_f32(vadd_f32(vget_low_f32(accL), vget_high_f32(accL)),
+                vadd_f32(vget_low_f32(accR), vget_high_f32(accR)));
+        if (accumulate) {
+            out = vadd_f32(out, vld1_f32(pDst));
         }
+        vst1_f32(pDst, out);
+        pSrc += numChan;
+        pDst += 2;
     }
+    return count;
 }
+#endif
 
 
 /*----------------------------------------------------------------------------
- * Downmix_foldFrom7Point1()
+ * Downmix_mixFloat()
  *----------------------------------------------------------------------------
  * Purpose:
- * downmix a 7.1 signal to stereo
+ * downmix a multichannel float signal to stereo with the downmix matrix
  *
  * Inputs:
- *  pSrc       7.1 audio samples to downmix
- *  numFrames  the number of 7.1 frames to downmix
+ *  pDownmixer downmix context
+ *  pSrc       multichannel audio samples to downmix
+ *  numFrames  the number of multichannel frames to downmix
  *  accumulate whether to mix (when true) the result of the downmix with the contents of pDst,
  *               or overwrite pDst (when false)
  *
  * Outputs:
- *  pDst       downmixed stereo audio samples
+ *  pDst       downmixed stereo audio samples, may be pSrc if the input has at least 2 channels
  *
  *----------------------------------------------------------------------------
  */
-void Downmix_foldFrom7Point1(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate) {
-    int32_t lt, rt, centerPlusLfeContrib; // samples in Q19.12 format
-    // sample at index 0 is FL
-    // sample at index 1 is FR
-    // sample at index 2 is FC
-    // sample at index 3 is LFE
-    // sample at index 4 is RL
-    // sample at index 5 is RR
-    // sample at index 6 is SL
-    // sample at index 7 is SR
-    // code is mostly duplicated between the two values of accumulate to avoid repeating the test
-    // for every sample
-    if (accumulate) {
-        while (numFrames) {
-            // centerPlusLfeContrib = FC(-3dB) + LFE(-3dB)
-            centerPlusLfeContrib = (pSrc[2] * MINUS_3_DB_IN_Q19_12)
-                    + (pSrc[3] * MINUS_3_DB_IN_Q19_12);
-            // FL + centerPlusLfeContrib + SL + RL
-            lt = (pSrc[0] << 12) + centerPlusLfeContrib + (pSrc[6] << 12) + (pSrc[4] << 12);
-            // FR + centerPlusLfeContrib + SR + RR
-            rt = (pSrc[1] << 12) + centerPlusLfeContrib + (pSrc[7] << 12) + (pSrc[5] << 12);
-            //accumulate in destination
-            pDst[0] = clamp16(pDst[0] + (lt >> 13));
-            pDst[1] = clamp16(pDst[1] + (rt >> 13));
-            pSrc += 8;
-            pDst += 2;
-            numFrames--;
-    }
-    } else { // same code as above but without adding and clamping pDst[i] to itself
-        while (numFrames) {
-            // centerPlusLfeContrib = FC(-3dB) + LFE(-3dB)
-            centerPlusLfeContrib = (pSrc[2] * MINUS_3_DB_IN_Q19_12)
-                    + (pSrc[3] * MINUS_3_DB_IN_Q19_12);
-            // FL + centerPlusLfeContrib + SL + RL
-            lt = (pSrc[0] << 12) + centerPlusLfeContrib + (pSrc[6] << 12) + (pSrc[4] << 12);
-            // FR + centerPlusLfeContrib + SR + RR
-            rt = (pSrc[1] << 12) + centerPlusLfeContrib + (pSrc[7] << 12) + (pSrc[5] << 12);
-            // store in destination
-            pDst[0] = clamp16(lt >> 13); // differs from when accumulate is true above
-            pDst[1] = clamp16(rt >> 13); // differs from when accumulate is true above
-            pSrc += 8;
-            pDst += 2;
-            numFrames--;
+void Downmix_mixFloat(const downmix_object_t *pDownmixer,
+        const float *pSrc, float *pDst, size_t numFrames, bool accumulate) {
+    const size_t numChan = pDownmixer->input_channel_count;
+    const float *left = pDownmixer->matrix[0];
+    const float *right = pDownmixer->matrix[1];
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+    const size_t done = Downmix_mixFloatNeon(pDownmixer, pSrc, pDst, numFrames, accumulate);
+    pSrc += done * numChan;
+    pDst += done * 2;
+    numFrames -= done;
+#endif
+    while (numFrames) {
+        float lt = 0.0f;
+        float rt = 0.0f;
+        for (size_t i = 0; i < numChan; i++) {
+            lt += pSrc[i] * left[i];
+            rt += pSrc[i] * right[i];
         }
+        if (accumulate) {
+            lt += pDst[0];
+            rt += pDst[1];
+        }
+        pDst[0] = lt;
+        pDst[1] = rt;
+        pSrc += numChan;
+        pDst += 2;
+        numFrames--;
     }
 }
 
 
 /*----------------------------------------------------------------------------
- * Downmix_foldGeneric()
+ * Downmix_mix16()
  *----------------------------------------------------------------------------
  * Purpose:
- * downmix to stereo a multichannel signal whose format is:
- *  - has FL/FR
- *  - if using AUDIO_CHANNEL_OUT_SIDE*, it contains both left and right
- *  - if using AUDIO_CHANNEL_OUT_BACK*, it contains both left and right
- *  - doesn't use any of the AUDIO_CHANNEL_OUT_TOP* channels
- *  - doesn't use any of the AUDIO_CHANNEL_OUT_FRONT_*_OF_CENTER channels
- * Only handles channel masks not enumerated in downmix_input_channel_mask_t
+ * downmix a multichannel 16 bit signal to stereo with the downmix matrix, converting blocks of
+ * DOWNMIX_BLOCK_FRAMES frames to float for Downmix_mixFloat()
  *
  * Inputs:
- *  mask       the channel mask of pSrc
- *  pSrc       multichannel audio buffer to downmix
+ *  pDownmixer downmix context
+ *  pSrc       multichannel audio samples to downmix
  *  numFrames  the number of multichannel frames to downmix
  *  accumulate whether to mix (when true) the result of the downmix with the contents of pDst,
  *               or overwrite pDst (when false)
  *
  * Outputs:
- *  pDst       downmixed stereo audio samples
- *
- * Returns: false if multichannel format is not supported
+ *  pDst       downmixed stereo audio samples, may be pSrc if the input has at least 2 channels
  *
  *----------------------------------------------------------------------------
  */
-bool Downmix_foldGeneric(
-        uint32_t mask, int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate) {
-    // check against unsupported channels
-    if (mask & kUnsupported) {
-        ALOGE("Unsupported channels (top or front left/right of center)");
-        return false;
-    }
-    // verify has FL/FR
-    if ((mask & AUDIO_CHANNEL_OUT_STEREO) != AUDIO_CHANNEL_OUT_STEREO) {
-        ALOGE("Front channels must be present");
-        return false;
-    }
-    // verify uses SIDE as a pair (ok if not using SIDE at all)
-    bool hasSides = false;
-    if ((mask & kSides) != 0) {
-        if ((mask & kSides) != kSides) {
-            ALOGE("Side channels must be used as a pair");
-            return false;
+void Downmix_mix16(const downmix_object_t *pDownmixer,
+        const int16_t *pSrc, int16_t *pDst, size_t numFrames, bool accumulate) {
+    const size_t numChan = pDownmixer->input_channel_count;
+    float in[DOWNMIX_BLOCK_FRAMES * DOWNMIX_MAX_INPUT_CHANNELS] __attribute__((aligned(16)));
+    float out[DOWNMIX_BLOCK_FRAMES * DOWNMIX_OUTPUT_CHANNEL_COUNT] __attribute__((aligned(16)));
+
+    while (numFrames) {
+        const size_t count = numFrames < DOWNMIX_BLOCK_FRAMES ? numFrames : DOWNMIX_BLOCK_FRAMES;
+        const size_t numSamples = count * numChan;
+        for (size_t i = 0; i < numSamples; i++) {
+            in[i] = pSrc[i] * (1.0f / (1 << 15));
         }
-        hasSides = true;
-    }
-    // verify uses BACK as a pair (ok if not using BACK at all)
-    bool hasBacks = false;
-    if ((mask & kBacks) != 0) {
-        if ((mask & kBacks) != kBacks) {
-            ALOGE("Back channels must be used as a pair");
-            return false;
-        }
-        hasBacks = true;
-    }
-
-    const int numChan = audio_channel_count_from_out_mask(mask);
-    const bool hasFC = ((mask & AUDIO_CHANNEL_OUT_FRONT_CENTER) == AUDIO_CHANNEL_OUT_FRONT_CENTER);
-    const bool hasLFE =
-            ((mask & AUDIO_CHANNEL_OUT_LOW_FREQUENCY) == AUDIO_CHANNEL_OUT_LOW_FREQUENCY);
-    const bool hasBC = ((mask & AUDIO_CHANNEL_OUT_BACK_CENTER) == AUDIO_CHANNEL_OUT_BACK_CENTER);
-    // compute at what index each channel is: samples will be in the following order:
-    //   FL FR FC LFE BL BR BC SL SR
-    // when a channel is not present, its index is set to the same as the index of the preceding
-    // channel
-    const int indexFC  = hasFC    ? 2            : 1;        // front center
-    const int indexLFE = hasLFE   ? indexFC + 1  : indexFC;  // low frequency
-    const int indexBL  = hasBacks ? indexLFE + 1 : indexLFE; // back left
-    const int indexBR  = hasBacks ? indexBL + 1  : indexBL;  // back right
-    const int indexBC  = hasBC    ? indexBR + 1  : indexBR;  // back center
-    const int indexSL  = hasSides ? indexBC + 1  : indexBC;  // side left
-    const int indexSR  = hasSides ? indexSL + 1  : indexSL;  // side right
-
-    int32_t lt, rt, centersLfeContrib; // samples in Q19.12 format
-    // code is mostly duplicated between the two values of accumulate to avoid repeating the test
-    // for every sample
-    if (accumulate) {
-        while (numFrames) {
-            // compute contribution of FC, BC and LFE
-            centersLfeContrib = 0;
-            if (hasFC)  { centersLfeContrib += pSrc[indexFC]; }
-            if (hasLFE) { centersLfeContrib += pSrc[indexLFE]; }
-            if (hasBC)  { centersLfeContrib += pSrc[indexBC]; }
-            centersLfeContrib *= MINUS_3_DB_IN_Q19_12;
-            // always has FL/FR
-            lt = (pSrc[0] << 12);
-            rt = (pSrc[1] << 12);
-            // mix in sides and backs
-            if (hasSides) {
-                lt += pSrc[indexSL] << 12;
-                rt += pSrc[indexSR] << 12;
-            }
-            if (hasBacks) {
-                lt += pSrc[indexBL] << 12;
-                rt += pSrc[indexBR] << 12;
+        Downmix_mixFloat(pDownmixer, in, out, count, false);
+        if (accumulate) {
+            for (size_t i = 0; i < count * 2; i++) {
+                pDst[i] = clamp16(pDst[i] + clamp16_from_float(out[i]));
             }
-            lt += centersLfeContrib;
-            rt += centersLfeContrib;
-            // accumulate in destination
-            pDst[0] = clamp16(pDst[0] + (lt >> 13));
-            pDst[1] = clamp16(pDst[1] + (rt >> 13));
-            pSrc += numChan;
-            pDst += 2;
-            numFrames--;
-        }
-    } else {
-        while (numFrames) {
-            // compute contribution of FC, BC and LFE
-            centersLfeContrib = 0;
-            if (hasFC)  { centersLfeContrib += pSrc[indexFC]; }
-            if (hasLFE) { centersLfeContrib += pSrc[indexLFE]; }
-            if (hasBC)  { centersLfeContrib += pSrc[indexBC]; }
-            centersLfeContrib *= MINUS_3_DB_IN_Q19_12;
-            // always has FL/FR
-            lt = (pSrc[0] << 12);
-            rt = (pSrc[1] << 12);
-            // mix in sides and backs
-            if (hasSides) {
-                lt += pSrc[indexSL] << 12;
-                rt += pSrc[indexSR] << 12;
-            }
-            if (hasBacks) {
-                lt += pSrc[indexBL] << 12;
-                rt += pSrc[indexBR] << 12;
+        } else {
+            for (size_t i = 0; i < count * 2; i++) {
+                pDst[i] = clamp16_from_float(out[i]);
             }
-            lt += centersLfeContrib;
-            rt += centersLfeContrib;
-            // store in destination
-            pDst[0] = clamp16(lt >> 13); // differs from when accumulate is true above
-            pDst[1] = clamp16(rt >> 13); // differs from when accumulate is true above
-            pSrc += numChan;
-            pDst += 2;
-            numFrames--;
         }
+        pSrc += numSamples;
+        pDst += count * 2;
+        numFrames -= count;
     }
-    return true;
 }
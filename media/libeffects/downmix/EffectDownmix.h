@@ -27,6 +27,9 @@
 */
 
 #define DOWNMIX_OUTPUT_CHANNELS AUDIO_CHANNEL_OUT_STEREO
+#define DOWNMIX_OUTPUT_CHANNEL_COUNT 2
+// one matrix column per bit of a channel mask, a multiple of 4 for the NEON kernel
+#define DOWNMIX_MAX_INPUT_CHANNELS 32
 
 typedef enum {
     DOWNMIX_STATE_UNINITIALIZED,
@@ -40,6 +43,11 @@ typedef struct {
     downmix_type_t type;
     bool apply_volume_correction;
     uint8_t input_channel_count;
+    uint32_t input_channel_mask;
+    // gain of each input channel in each output channel, computed by Downmix_computeMatrix()
+    // from the input channel mask and the downmix type, unused columns are 0
+    float matrix[DOWNMIX_OUTPUT_CHANNEL_COUNT][DOWNMIX_MAX_INPUT_CHANNELS]
+            __attribute__((aligned(16)));
 } downmix_object_t;
 
 
@@ -49,17 +57,19 @@ typedef struct downmix_module_s {
     downmix_object_t context;
 } downmix_module_t;
 
-const uint32_t kSides = AUDIO_CHANNEL_OUT_SIDE_LEFT | AUDIO_CHANNEL_OUT_SIDE_RIGHT;
-const uint32_t kBacks = AUDIO_CHANNEL_OUT_BACK_LEFT | AUDIO_CHANNEL_OUT_BACK_RIGHT;
-const uint32_t kUnsupported =
-        AUDIO_CHANNEL_OUT_FRONT_LEFT_OF_CENTER | AUDIO_CHANNEL_OUT_FRONT_RIGHT_OF_CENTER |
-        AUDIO_CHANNEL_OUT_TOP_CENTER |
-        AUDIO_CHANNEL_OUT_TOP_FRONT_LEFT |
-        AUDIO_CHANNEL_OUT_TOP_FRONT_CENTER |
-        AUDIO_CHANNEL_OUT_TOP_FRONT_RIGHT |
-        AUDIO_CHANNEL_OUT_TOP_BACK_LEFT |
-        AUDIO_CHANNEL_OUT_TOP_BACK_CENTER |
-        AUDIO_CHANNEL_OUT_TOP_BACK_RIGHT;
+// channel positions folded to the left output, to the right output, and to both at -3dB
+const uint32_t kLeftChannels =
+        AUDIO_CHANNEL_OUT_FRONT_LEFT | AUDIO_CHANNEL_OUT_FRONT_LEFT_OF_CENTER |
+        AUDIO_CHANNEL_OUT_BACK_LEFT | AUDIO_CHANNEL_OUT_SIDE_LEFT |
+        AUDIO_CHANNEL_OUT_TOP_FRONT_LEFT | AUDIO_CHANNEL_OUT_TOP_BACK_LEFT;
+const uint32_t kRightChannels =
+        AUDIO_CHANNEL_OUT_FRONT_RIGHT | AUDIO_CHANNEL_OUT_FRONT_RIGHT_OF_CENTER |
+        AUDIO_CHANNEL_OUT_BACK_RIGHT | AUDIO_CHANNEL_OUT_SIDE_RIGHT |
+        AUDIO_CHANNEL_OUT_TOP_FRONT_RIGHT | AUDIO_CHANNEL_OUT_TOP_BACK_RIGHT;
+const uint32_t kCenterChannels =
+        AUDIO_CHANNEL_OUT_FRONT_CENTER | AUDIO_CHANNEL_OUT_LOW_FREQUENCY |
+        AUDIO_CHANNEL_OUT_BACK_CENTER | AUDIO_CHANNEL_OUT_TOP_CENTER |
+        AUDIO_CHANNEL_OUT_TOP_FRONT_CENTER | AUDIO_CHANNEL_OUT_TOP_BACK_CENTER;
 
 /*------------------------------------
  * Effect API
@@ -96,10 +106,10 @@ int Downmix_Reset(downmix_object_t *pDownmixer, bool init);
 int Downmix_setParameter(downmix_object_t *pDownmixer, int32_t param, uint32_t size, void *pValue);
 int Downmix_getParameter(downmix_object_t *pDownmixer, int32_t param, uint32_t *pSize, void *pValue);
 
-void Downmix_foldFromQuad(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate);
-void Downmix_foldFrom5Point1(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate);
-void Downmix_foldFrom7Point1(int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate);
-bool Downmix_foldGeneric(
-        uint32_t mask, int16_t *pSrc, int16_t*pDst, size_t numFrames, bool accumulate);
+void Downmix_computeMatrix(downmix_object_t *pDownmixer);
+void Downmix_mixFloat(const downmix_object_t *pDownmixer,
+        const float *pSrc, float *pDst, size_t numFrames, bool accumulate);
+void Downmix_mix16(const downmix_object_t *pDownmixer,
+        const int16_t *pSrc, int16_t *pDst, size_t numFrames, bool accumulate);
 
 #endif /*ANDROID_EFFECTDOWNMIX_H_*/
@@ -24,6 +24,7 @@
 
 #include <cutils/misc.h>
 #include <cutils/config_utils.h>
+#include <cutils/properties.h>
 #include <audio_effects/audio_effects_conf.h>
 
 static list_elem_t *gEffectList; // list of effect_entry_t: all currently created effects
@@ -37,6 +38,13 @@ static list_elem_t *gCurLib;    // current library in enumeration process
 static list_elem_t *gCurEffect; // current effect in enumeration process
 static uint32_t gCurEffectIdx;       // current effect index in enumeration process
 static lib_entry_t *gCachedLibrary;  // last library accessed by getLibrary()
+static list_elem_t *gEffectPool; // list of pool_entry_t: released effects, most recent first
+static uint32_t gEffectPoolSize;     // number of entries in gEffectPool
+static uint32_t gEffectPoolMax;      // max number of entries in gEffectPool, 0 disables the pool
+
+// Default number of released effect instances kept for reuse. Can be overridden
+// with property af.effects.pool.
+#define EFFECT_POOL_DEFAULT_SIZE 4
 
 static int gInitDone; // true is global initialization has been preformed
 static int gCanQueryEffect; // indicates that call to EffectQueryEffect() is valid, i.e. that the list of effects
@@ -69,6 +77,9 @@ int findSubEffect(const effect_uuid_t *uuid,
 static void dumpEffectDescriptor(effect_descriptor_t *desc, char *str, size_t len);
 static int stringToUuid(const char *str, effect_uuid_t *uuid);
 static int uuidToString(const effect_uuid_t *uuid, char *str, size_t maxLen);
+static effect_handle_t takePooledEffect(const effect_uuid_t *uuid, int32_t sessionId,
+               int32_t ioId, lib_entry_t *lib);
+static int poolEffect(effect_entry_t *fx);
 
 /////////////////////////////////////////////////
 //      Effect Control Interface functions
@@ -304,11 +315,16 @@ int EffectCreate(const effect_uuid_t *uuid, int32_t sessionId, int32_t ioId, eff
         }
     }
 
+    // reuse an instance released with the same parameters if any, otherwise
     // create effect in library
-    ret = l->desc->create_effect(uuid, sessionId, ioId, &itfe);
-    if (ret != 0) {
-        ALOGW("EffectCreate() library %s: could not create fx %s, error %d", l->name, d->name, ret);
-        goto exit;
+    itfe = takePooledEffect(uuid, sessionId, ioId, l);
+    if (itfe == NULL) {
+        ret = l->desc->create_effect(uuid, sessionId, ioId, &itfe);
+        if (ret != 0) {
+            ALOGW("EffectCreate() library %s: could not create fx %s, error %d",
+                    l->name, d->name, ret);
+            goto exit;
+        }
     }
 
     // add entry to effect list
@@ -322,6 +338,9 @@ int EffectCreate(const effect_uuid_t *uuid, int32_t sessionId, int32_t ioId, eff
         ALOGV("EffectCreate() gInterface");
     }
     fx->lib = l;
+    fx->uuid = *uuid;
+    fx->sessionId = sessionId;
+    fx->ioId = ioId;
 
     e = (list_elem_t *)malloc(sizeof(list_elem_t));
     e->object = fx;
@@ -371,10 +390,10 @@ int EffectRelease(effect_handle_t handle)
         goto exit;
     }
 
-    // release effect in library
+    // keep effect for reuse if possible, otherwise release it in library
     if (fx->lib == NULL) {
         ALOGW("EffectRelease() fx %p library already unloaded", handle);
-    } else {
+    } else if (poolEffect(fx) != 0) {
         pthread_mutex_lock(&fx->lib->lock);
         fx->lib->desc->release_effect(fx->subItfe);
         pthread_mutex_unlock(&fx->lib->lock);
@@ -448,6 +467,16 @@ int init() {
 
     pthread_mutex_init(&gLibLock, NULL);
 
+    gEffectPoolMax = EFFECT_POOL_DEFAULT_SIZE;
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("af.effects.pool", value, NULL) > 0) {
+        char *endptr;
+        unsigned long size = strtoul(value, &endptr, 0);
+        if (*endptr == '\0') {
+            gEffectPoolMax = size;
+        }
+    }
+
     if (access(AUDIO_EFFECT_VENDOR_CONFIG_FILE, R_OK) == 0) {
         loadEffectConfigFile(AUDIO_EFFECT_VENDOR_CONFIG_FILE);
     } else if (access(AUDIO_EFFECT_DEFAULT_CONFIG_FILE, R_OK) == 0) {
@@ -876,6 +905,99 @@ int findEffect(const effect_uuid_t *type,
     return ret;
 }
 
+// Returns an instance of the effect previously released with the same uuid, session
+// and io and removes it from gEffectPool, or NULL if there is none.
+// Must be called with gLibLock held.
+effect_handle_t takePooledEffect(const effect_uuid_t *uuid, int32_t sessionId,
+               int32_t ioId, lib_entry_t *lib)
+{
+    list_elem_t *e1 = gEffectPool;
+    list_elem_t *e2 = NULL;
+    pool_entry_t *p;
+    effect_handle_t itfe;
+
+    while (e1) {
+        p = (pool_entry_t *)e1->object;
+        if (p->lib == lib && p->sessionId == sessionId && p->ioId == ioId &&
+                memcmp(&p->uuid, uuid, sizeof(effect_uuid_t)) == 0) {
+            if (e2) {
+                e2->next = e1->next;
+            } else {
+                gEffectPool = e1->next;
+            }
+            itfe = p->subItfe;
+            free(p);
+            free(e1);
+            gEffectPoolSize--;
+            ALOGV("takePooledEffect() reusing sub itfe %p in library %s", itfe, lib->name);
+            return itfe;
+        }
+        e2 = e1;
+        e1 = e1->next;
+    }
+    return NULL;
+}
+
+// Resets the effect instance of fx and adds it at the head of gEffectPool, releasing
+// the oldest pooled instance if the pool is full.
+// Returns 0 if the instance was pooled, in which case it must not be released.
+// Must be called with gLibLock held.
+int poolEffect(effect_entry_t *fx)
+{
+    list_elem_t *e1;
+    list_elem_t *e2;
+    pool_entry_t *p;
+    uint32_t replySize = sizeof(int);
+    int reply;
+    int ret;
+
+    if (gEffectPoolMax == 0) {
+        return -ENOSYS;
+    }
+
+    pthread_mutex_lock(&fx->lib->lock);
+    (*fx->subItfe)->command(fx->subItfe, EFFECT_CMD_DISABLE, 0, NULL, &replySize, &reply);
+    ret = (*fx->subItfe)->command(fx->subItfe, EFFECT_CMD_RESET, 0, NULL, NULL, NULL);
+    pthread_mutex_unlock(&fx->lib->lock);
+    if (ret != 0) {
+        ALOGV("poolEffect() could not reset sub itfe %p, error %d", fx->subItfe, ret);
+        return ret;
+    }
+
+    p = (pool_entry_t *)malloc(sizeof(pool_entry_t));
+    p->uuid = fx->uuid;
+    p->sessionId = fx->sessionId;
+    p->ioId = fx->ioId;
+    p->subItfe = fx->subItfe;
+    p->lib = fx->lib;
+
+    e1 = (list_elem_t *)malloc(sizeof(list_elem_t));
+    e1->object = p;
+    e1->next = gEffectPool;
+    gEffectPool = e1;
+    gEffectPoolSize++;
+
+    // release the least recently pooled instance when the pool is full
+    if (gEffectPoolSize > gEffectPoolMax) {
+        e2 = NULL;
+        while (e1->next) {
+            e2 = e1;
+            e1 = e1->next;
+        }
+        e2->next = NULL;
+        p = (pool_entry_t *)e1->object;
+        pthread_mutex_lock(&p->lib->lock);
+        p->lib->desc->release_effect(p->subItfe);
+        pthread_mutex_unlock(&p->lib->lock);
+        free(p);
+        free(e1);
+        gEffectPoolSize--;
+    }
+
+    ALOGV("poolEffect() pooled sub itfe %p, %u in pool", fx->subItfe, gEffectPoolSize);
+    return 0;
+}
+
 void dumpEffectDescriptor(effect_descriptor_t *desc, char *str, size_t len) {
     char s[256];
 
@@ -54,8 +54,22 @@ typedef struct effect_entry_s {
     struct effect_interface_s *itfe;
     effect_handle_t subItfe;
     lib_entry_t *lib;
+    effect_uuid_t uuid;     // uuid, session and io the effect was created with,
+    int32_t sessionId;      // used to return it to gEffectPool on release
+    int32_t ioId;
 } effect_entry_t;
 
+// Released effect instance kept in gEffectPool after a reset, so that a
+// subsequent EffectCreate() with the same uuid, session and io can reuse it
+// instead of creating and initializing a new one in the library.
+typedef struct pool_entry_s {
+    effect_uuid_t uuid;
+    int32_t sessionId;
+    int32_t ioId;
+    effect_handle_t subItfe;
+    lib_entry_t *lib;
+} pool_entry_t;
+
 // Structure used to store the lib entry
 // and the descriptor of the sub effects.
 // The library entry is to be stored in case of
@@ -107,7 +107,8 @@ int LE_setConfig(LoudnessEnhancerContext *pContext, effect_config_t *pConfig)
     if (pConfig->inputCfg.channels != AUDIO_CHANNEL_OUT_STEREO) return -EINVAL;
     if (pConfig->outputCfg.accessMode != EFFECT_BUFFER_ACCESS_WRITE &&
             pConfig->outputCfg.accessMode != EFFECT_BUFFER_ACCESS_ACCUMULATE) return -EINVAL;
-    if (pConfig->inputCfg.format != AUDIO_FORMAT_PCM_16_BIT) return -EINVAL;
+    if (pConfig->inputCfg.format != AUDIO_FORMAT_PCM_16_BIT &&
+            pConfig->inputCfg.format != AUDIO_FORMAT_PCM_FLOAT) return -EINVAL;
 
     pContext->mConfig = *pConfig;
 
@@ -280,16 +281,45 @@ int LE_process(
     }
 
     //ALOGV("LE about to process %d samples", inBuffer->frameCount);
-    uint16_t inIdx;
+    // makeup gain is applied on the input of the compressor
     float inputAmp = pow(10, pContext->mTargetGainmB/2000.0f);
-    float leftSample, rightSample;
-    for (inIdx = 0 ; inIdx < inBuffer->frameCount ; inIdx++) {
-        // makeup gain is applied on the input of the compressor
-        leftSample  = inputAmp * (float)inBuffer->s16[2*inIdx];
-        rightSample = inputAmp * (float)inBuffer->s16[2*inIdx +1];
-        pContext->mCompressor->Compress(&leftSample, &rightSample);
-        inBuffer->s16[2*inIdx]    = (int16_t) leftSample;
-        inBuffer->s16[2*inIdx +1] = (int16_t) rightSample;
+    if (pContext->mConfig.inputCfg.format == AUDIO_FORMAT_PCM_FLOAT) {
+        // the compressor works on a 16 bit scale
+        static const float kScale = 1 << 15;
+        float *in = (float *)inBuffer->raw;
+        pContext->mCompressor->CompressStereo(in, inBuffer->frameCount,
+                inputAmp * kScale, 1.0f / kScale);
+        if (inBuffer->raw != outBuffer->raw) {
+            float *out = (float *)outBuffer->raw;
+            if (pContext->mConfig.outputCfg.accessMode == EFFECT_BUFFER_ACCESS_ACCUMULATE) {
+                for (size_t i = 0; i < outBuffer->frameCount*2; i++) {
+                    out[i] += in[i];
+                }
+            } else {
+                memcpy(out, in, outBuffer->frameCount * 2 * sizeof(float));
+            }
+        }
+        if (pContext->mState != LOUDNESS_ENHANCER_STATE_ACTIVE) {
+            return -ENODATA;
+        }
+        return 0;
+    }
+    // converted to float by blocks of kConvertFrames for the block compressor
+    static const size_t kConvertFrames = 256;
+    float samples[kConvertFrames * 2];
+    for (size_t frame = 0; frame < inBuffer->frameCount; frame += kConvertFrames) {
+        size_t count = inBuffer->frameCount - frame;
+        if (count > kConvertFrames) {
+            count = kConvertFrames;
+        }
+        int16_t *in = inBuffer->s16 + 2 * frame;
+        for (size_t i = 0; i < count * 2; i++) {
+            samples[i] = (float)in[i];
+        }
+        pContext->mCompressor->CompressStereo(samples, count, inputAmp, 1.0f);
+        for (size_t i = 0; i < count * 2; i++) {
+            in[i] = (int16_t) samples[i];
+        }
     }
 
     if (inBuffer->raw != outBuffer->raw) {
@@ -65,6 +65,31 @@ inline T ExpApproximationViaTaylorExpansionOrder5(T x) {
       0.008333333333333333217685101601546193705871701240539550781250f * x5;
 }
 
+// A fast approximation to exp(.) for values between -87 and 0, with a relative
+// error of about 1e-5 at worst: 2^round(t) is built from the exponent bits,
+// times a 5-th order Taylor expansion of 2^f for the remainder |f| <= 0.5.
+inline float fast_exp_nonpositive(float val) {
+  float t = val * 1.44269504088896338700465094007086008787155151367187500f;
+  if (t < -126.0f) {
+    t = -126.0f;
+  }
+  if (t > 0.0f) {
+    t = 0.0f;
+  }
+  // truncation of a non-positive value minus one half rounds to nearest
+  const int n = static_cast<int>(t - 0.5f);
+  const float f = t - n;
+  const float p = 1.0f + f * (0.693147180559945f + f * (0.240226506959101f +
+      f * (0.0555041086648216f + f * (0.00961812910762848f +
+      f * 0.00133335581464284f))));
+  union {
+    int i;
+    float value;
+  } scale;
+  scale.i = (n + 127) << 23;
+  return p * scale.value;
+}
+
 }  // namespace math
 }  // namespace le_fx
 
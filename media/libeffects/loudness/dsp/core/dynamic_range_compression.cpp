@@ -14,8 +14,17 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <cmath>
 
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#define LE_FX_DRC_NEON
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define LE_FX_DRC_SSE2
+#endif
+
 #include "common/core/math.h"
 #include "common/core/types.h"
 #include "dsp/core/basic.h"
@@ -28,6 +37,85 @@
 
 namespace le_fx {
 
+namespace {
+
+// Frames processed per pass by CompressStereo(), bounds its stack usage.
+const int kBlockFrames = 64;
+
+// ln(2), to turn the base 2 logarithm of the vector paths into math::fast_log()
+const float kLn2 = 0.693147180559945309417232121458176568075500134360255254f;
+
+#if defined(LE_FX_DRC_NEON)
+
+// Vector versions of math::fast_log() and math::fast_exp_nonpositive(), with
+// the same approximations so that every path gives the same result.
+inline float32x4_t FastLog(float32x4_t val) {
+  int32x4_t bits = vreinterpretq_s32_f32(val);
+  const int32x4_t exponent = vsubq_s32(
+      vandq_s32(vshrq_n_s32(bits, 23), vdupq_n_s32(255)), vdupq_n_s32(128));
+  bits = vorrq_s32(vandq_s32(bits, vdupq_n_s32(~(255 << 23))),
+                   vdupq_n_s32(127 << 23));
+  float32x4_t m = vreinterpretq_f32_s32(bits);
+  m = vsubq_f32(
+      vmulq_f32(vaddq_f32(vmulq_n_f32(m, -1.0f / 3), vdupq_n_f32(2.0f)), m),
+      vdupq_n_f32(2.0f / 3));
+  return vmulq_n_f32(vaddq_f32(m, vcvtq_f32_s32(exponent)), kLn2);
+}
+
+inline float32x4_t FastExpNonPositive(float32x4_t val) {
+  float32x4_t t = vmulq_n_f32(val, 1.44269504088896338700f);
+  t = vminq_f32(vmaxq_f32(t, vdupq_n_f32(-126.0f)), vdupq_n_f32(0.0f));
+  const int32x4_t n = vcvtq_s32_f32(vsubq_f32(t, vdupq_n_f32(0.5f)));
+  const float32x4_t f = vsubq_f32(t, vcvtq_f32_s32(n));
+  float32x4_t p = vdupq_n_f32(0.00133335581464284f);
+  p = vmlaq_f32(vdupq_n_f32(0.00961812910762848f), p, f);
+  p = vmlaq_f32(vdupq_n_f32(0.0555041086648216f), p, f);
+  p = vmlaq_f32(vdupq_n_f32(0.240226506959101f), p, f);
+  p = vmlaq_f32(vdupq_n_f32(0.693147180559945f), p, f);
+  p = vmlaq_f32(vdupq_n_f32(1.0f), p, f);
+  const int32x4_t scale =
+      vshlq_n_s32(vaddq_s32(n, vdupq_n_s32(127)), 23);
+  return vmulq_f32(p, vreinterpretq_f32_s32(scale));
+}
+
+#elif defined(LE_FX_DRC_SSE2)
+
+inline __m128 FastLog(__m128 val) {
+  __m128i bits = _mm_castps_si128(val);
+  const __m128i exponent = _mm_sub_epi32(
+      _mm_and_si128(_mm_srli_epi32(bits, 23), _mm_set1_epi32(255)),
+      _mm_set1_epi32(128));
+  bits = _mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(~(255 << 23))),
+                      _mm_set1_epi32(127 << 23));
+  __m128 m = _mm_castsi128_ps(bits);
+  m = _mm_sub_ps(
+      _mm_mul_ps(_mm_add_ps(_mm_mul_ps(m, _mm_set1_ps(-1.0f / 3)),
+                            _mm_set1_ps(2.0f)), m),
+      _mm_set1_ps(2.0f / 3));
+  return _mm_mul_ps(_mm_add_ps(m, _mm_cvtepi32_ps(exponent)),
+                    _mm_set1_ps(kLn2));
+}
+
+inline __m128 FastExpNonPositive(__m128 val) {
+  __m128 t = _mm_mul_ps(val, _mm_set1_ps(1.44269504088896338700f));
+  t = _mm_min_ps(_mm_max_ps(t, _mm_set1_ps(-126.0f)), _mm_setzero_ps());
+  const __m128i n = _mm_cvttps_epi32(_mm_sub_ps(t, _mm_set1_ps(0.5f)));
+  const __m128 f = _mm_sub_ps(t, _mm_cvtepi32_ps(n));
+  __m128 p = _mm_set1_ps(0.00133335581464284f);
+  p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.00961812910762848f));
+  p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.0555041086648216f));
+  p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.240226506959101f));
+  p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.693147180559945f));
+  p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f));
+  const __m128i scale =
+      _mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23);
+  return _mm_mul_ps(p, _mm_castsi128_ps(scale));
+}
+
+#endif
+
+}  // namespace
+
 // Definitions for static const class members declared in
 // dynamic_range_compression.h.
 const float AdaptiveDynamicRangeCompression::kMinAbsValue = 0.000001f;
@@ -137,5 +225,117 @@ void AdaptiveDynamicRangeCompression::Compress(float *x1, float *x2) {
   }
 }
 
-}  // namespace le_fx
+void AdaptiveDynamicRangeCompression::DetectStereo(
+    float *x, int num_frames, float input_gain, float *cv) const {
+  int i = 0;
+#if defined(LE_FX_DRC_NEON)
+  const float32x4_t min_abs = vdupq_n_f32(kMinLogAbsValue);
+  const float32x4_t knee = vdupq_n_f32(knee_threshold_);
+  for (; i + 4 <= num_frames; i += 4) {
+    float32x4x2_t lr = vld2q_f32(x + 2 * i);
+    lr.val[0] = vmulq_n_f32(lr.val[0], input_gain);
+    lr.val[1] = vmulq_n_f32(lr.val[1], input_gain);
+    vst2q_f32(x + 2 * i, lr);
+    const float32x4_t max_abs_x = vmaxq_f32(
+        vmaxq_f32(vabsq_f32(lr.val[0]), vabsq_f32(lr.val[1])), min_abs);
+    const float32x4_t overshoot = vsubq_f32(FastLog(max_abs_x), knee);
+    vst1q_f32(cv + i, vmulq_n_f32(vmaxq_f32(overshoot, vdupq_n_f32(0.0f)),
+                                  slope_));
+  }
+#elif defined(LE_FX_DRC_SSE2)
+  const __m128 gain = _mm_set1_ps(input_gain);
+  const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+  const __m128 min_abs = _mm_set1_ps(kMinLogAbsValue);
+  const __m128 knee = _mm_set1_ps(knee_threshold_);
+  for (; i + 4 <= num_frames; i += 4) {
+    const __m128 lr01 = _mm_mul_ps(_mm_loadu_ps(x + 2 * i), gain);
+    const __m128 lr23 = _mm_mul_ps(_mm_loadu_ps(x + 2 * i + 4), gain);
+    _mm_storeu_ps(x + 2 * i, lr01);
+    _mm_storeu_ps(x + 2 * i + 4, lr23);
+    const __m128 abs01 = _mm_and_ps(lr01, abs_mask);
+    const __m128 abs23 = _mm_and_ps(lr23, abs_mask);
+    // maximum of the two channels of each frame, then one lane per frame
+    const __m128 max01 = _mm_max_ps(
+        abs01, _mm_shuffle_ps(abs01, abs01, _MM_SHUFFLE(2, 3, 0, 1)));
+    const __m128 max23 = _mm_max_ps(
+        abs23, _mm_shuffle_ps(abs23, abs23, _MM_SHUFFLE(2, 3, 0, 1)));
+    const __m128 max_abs_x = _mm_max_ps(
+        _mm_shuffle_ps(max01, max23, _MM_SHUFFLE(2, 0, 2, 0)), min_abs);
+    const __m128 overshoot = _mm_sub_ps(FastLog(max_abs_x), knee);
+    _mm_storeu_ps(cv + i, _mm_mul_ps(_mm_max_ps(overshoot, _mm_setzero_ps()),
+                                     _mm_set1_ps(slope_)));
+  }
+#endif
+  for (; i < num_frames; ++i) {
+    x[2 * i] *= input_gain;
+    x[2 * i + 1] *= input_gain;
+    const float max_abs_x = std::max(std::fabs(x[2 * i]),
+      std::max(std::fabs(x[2 * i + 1]), kMinLogAbsValue));
+    const float overshoot = math::fast_log(max_abs_x) - knee_threshold_;
+    cv[i] = std::max(overshoot, 0.0f) * slope_;
+  }
+}
+
+void AdaptiveDynamicRangeCompression::CompressStereo(
+    float *x, int num_frames, float input_gain, float output_gain) {
+  float state[kBlockFrames];
+  while (num_frames > 0) {
+    const int n = std::min(num_frames, kBlockFrames);
+    DetectStereo(x, n, input_gain, state);
+    // The envelope is the only recursive part, the gain of each frame is then
+    // exp(state), instead of compressor_gain_ updated by the state increment.
+    float s = state_;
+    for (int i = 0; i < n; ++i) {
+      const float cv = state[i];
+      if (cv <= s) {
+        s = alpha_attack_ * s + (1.0f - alpha_attack_) * cv;
+      } else {
+        s = alpha_release_ * s + (1.0f - alpha_release_) * cv;
+      }
+      state[i] = s;
+    }
+    state_ = s;
+    int i = 0;
+#if defined(LE_FX_DRC_NEON)
+    const float32x4_t limit = vdupq_n_f32(kFixedPointLimit);
+    const float32x4_t minus_limit = vdupq_n_f32(-kFixedPointLimit);
+    for (; i + 4 <= n; i += 4) {
+      const float32x4_t gain = FastExpNonPositive(vld1q_f32(state + i));
+      float32x4x2_t lr = vld2q_f32(x + 2 * i);
+      lr.val[0] = vmulq_n_f32(vmaxq_f32(vminq_f32(
+          vmulq_f32(lr.val[0], gain), limit), minus_limit), output_gain);
+      lr.val[1] = vmulq_n_f32(vmaxq_f32(vminq_f32(
+          vmulq_f32(lr.val[1], gain), limit), minus_limit), output_gain);
+      vst2q_f32(x + 2 * i, lr);
+    }
+#elif defined(LE_FX_DRC_SSE2)
+    const __m128 limit = _mm_set1_ps(kFixedPointLimit);
+    const __m128 minus_limit = _mm_set1_ps(-kFixedPointLimit);
+    const __m128 out_gain = _mm_set1_ps(output_gain);
+    for (; i + 4 <= n; i += 4) {
+      const __m128 gain = FastExpNonPositive(_mm_loadu_ps(state + i));
+      const __m128 lr01 = _mm_mul_ps(_mm_loadu_ps(x + 2 * i),
+                                     _mm_unpacklo_ps(gain, gain));
+      const __m128 lr23 = _mm_mul_ps(_mm_loadu_ps(x + 2 * i + 4),
+                                     _mm_unpackhi_ps(gain, gain));
+      _mm_storeu_ps(x + 2 * i, _mm_mul_ps(_mm_max_ps(_mm_min_ps(
+          lr01, limit), minus_limit), out_gain));
+      _mm_storeu_ps(x + 2 * i + 4, _mm_mul_ps(_mm_max_ps(_mm_min_ps(
+          lr23, limit), minus_limit), out_gain));
+    }
+#endif
+    for (; i < n; ++i) {
+      const float gain = math::fast_exp_nonpositive(state[i]);
+      for (int c = 0; c < 2; ++c) {
+        const float y = x[2 * i + c] * gain;
+        x[2 * i + c] = std::max(std::min(y, kFixedPointLimit),
+                                -kFixedPointLimit) * output_gain;
+      }
+    }
+    x += 2 * n;
+    num_frames -= n;
+  }
+  compressor_gain_ = math::fast_exp_nonpositive(state_);
+}
 
+}  // namespace le_fx
@@ -58,6 +58,16 @@ class AdaptiveDynamicRangeCompression {
   // Stereo channel version of the compressor
   void Compress(float *x1, float *x2);
 
+  // Block version of the stereo compressor, on `num_frames` interleaved stereo
+  // frames processed in place. The input is multiplied by `input_gain` before
+  // compression, and the output, limited to the fixed-point range, by
+  // `output_gain`. The envelope detection and the gain computation are done on
+  // whole blocks, with NEON or SSE2 when available; only the envelope recursion
+  // runs frame by frame. The result matches Compress(float*, float*) within the
+  // accuracy of the log(.) and exp(.) approximations.
+  void CompressStereo(float *x, int num_frames, float input_gain,
+                      float output_gain);
+
   // This version is slower than Compress(.) but faster than CompressSlow(.)
   float CompressNormalSpeed(float x);
 
@@ -109,6 +119,10 @@ class AdaptiveDynamicRangeCompression {
   // threshold.
   sigmod::InterpolatorLinear<float> target_gain_to_knee_threshold_;
 
+  // Scales `num_frames` stereo frames of `x` by `input_gain` in place, and
+  // writes the control value of each frame, before smoothing, to `cv`.
+  void DetectStereo(float *x, int num_frames, float input_gain, float *cv) const;
+
   LE_FX_DISALLOW_COPY_AND_ASSIGN(AdaptiveDynamicRangeCompression);
 };
 
@@ -0,0 +1,36 @@
+# Build the unit tests and benchmark of the loudness enhancer compressor
+
+#
+# Block versus per frame compressor test and benchmark
+#
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils \
+	libstlport
+
+LOCAL_STATIC_LIBRARIES := \
+	libgtest \
+	libgtest_main
+
+LOCAL_C_INCLUDES := \
+	bionic \
+	bionic/libstdc++/include \
+	external/gtest/include \
+	external/stlport/stlport \
+	$(LOCAL_PATH)/..
+
+LOCAL_SRC_FILES := \
+	loudness_tests.cpp \
+	../dsp/core/dynamic_range_compression.cpp
+
+LOCAL_CFLAGS += -O2 -fno-strict-aliasing
+
+LOCAL_ARM_NEON := true
+
+LOCAL_MODULE := loudness_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "loudness_tests"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "common/core/math.h"
+#include "dsp/core/dynamic_range_compression.h"
+
+using le_fx::AdaptiveDynamicRangeCompression;
+
+static const float kSampleRate = 48000.0f;
+
+// Interleaved stereo on a 16 bit scale: a tone with bursts well above the knee,
+// so that both the attack and the release of the compressor are exercised.
+static void fillSignal(std::vector<float>& v)
+{
+    for (size_t i = 0; i < v.size() / 2; i++) {
+        const float level = (i / 4096) % 2 ? 32767.0f : 3000.0f;
+        const float noise = (float) rand() / RAND_MAX * 0.2f - 0.1f;
+        v[2 * i] = level * (sinf(2 * M_PI * 440 * i / kSampleRate) + noise);
+        v[2 * i + 1] = level * (sinf(2 * M_PI * 660 * i / kSampleRate) - noise);
+    }
+}
+
+static int64_t nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+TEST(le_fx, fast_exp_nonpositive)
+{
+    for (float x = -80.0f; x <= 0.0f; x += 0.01f) {
+        EXPECT_NEAR(1.0f, le_fx::math::fast_exp_nonpositive(x) / expf(x), 1e-5);
+    }
+}
+
+// The block compressor against the per frame one, processing the input in
+// chunks that do not align with the internal blocks or the vectors.
+TEST(le_fx, block_matches_per_frame)
+{
+    static const float kGain = 2.5f;
+    std::vector<float> in(2 * 48000);
+    fillSignal(in);
+
+    AdaptiveDynamicRangeCompression reference;
+    ASSERT_TRUE(reference.Initialize(kGain, kSampleRate));
+    std::vector<float> expected(in);
+    for (size_t i = 0; i < expected.size(); i += 2) {
+        expected[i] *= kGain;
+        expected[i + 1] *= kGain;
+        reference.Compress(&expected[i], &expected[i + 1]);
+    }
+
+    AdaptiveDynamicRangeCompression compressor;
+    ASSERT_TRUE(compressor.Initialize(kGain, kSampleRate));
+    std::vector<float> out(in);
+    static const size_t kChunks[] = { 1, 3, 64, 65, 191, 1024 };
+    size_t frame = 0;
+    for (size_t c = 0; frame < out.size() / 2; c++) {
+        size_t count = kChunks[c % (sizeof(kChunks) / sizeof(kChunks[0]))];
+        if (count > out.size() / 2 - frame) {
+            count = out.size() / 2 - frame;
+        }
+        compressor.CompressStereo(&out[2 * frame], count, kGain, 1.0f);
+        frame += count;
+    }
+
+    // the per frame compressor accumulates the error of its exp(.) increments
+    float maxDiff = 0.0f;
+    for (size_t i = 0; i < out.size(); i++) {
+        maxDiff = std::max(maxDiff, fabsf(out[i] - expected[i]));
+        ASSERT_LE(out[i], 32767.0f);
+        ASSERT_GE(out[i], -32767.0f);
+    }
+    printf("maximum difference %.3f on a 16 bit scale\n", maxDiff);
+    EXPECT_LT(maxDiff, 8.0f);
+}
+
+TEST(le_fx, output_gain)
+{
+    std::vector<float> in(2 * 1000);
+    fillSignal(in);
+    AdaptiveDynamicRangeCompression a, b;
+    ASSERT_TRUE(a.Initialize(3.0f, kSampleRate));
+    ASSERT_TRUE(b.Initialize(3.0f, kSampleRate));
+    std::vector<float> x(in), y(in);
+    a.CompressStereo(&x[0], x.size() / 2, 3.0f, 1.0f);
+    b.CompressStereo(&y[0], y.size() / 2, 3.0f, 1.0f / 32768);
+    for (size_t i = 0; i < x.size(); i++) {
+        EXPECT_FLOAT_EQ(x[i] / 32768, y[i]);
+    }
+}
+
+TEST(le_fx, benchmark)
+{
+    static const size_t kFrames = 256;
+    static const int kIterations = 2000;
+    std::vector<float> in(2 * kFrames);
+    fillSignal(in);
+    std::vector<float> x(in);
+
+    AdaptiveDynamicRangeCompression perFrame;
+    ASSERT_TRUE(perFrame.Initialize(2.0f, kSampleRate));
+    int64_t start = nowNs();
+    for (int n = 0; n < kIterations; n++) {
+        for (size_t i = 0; i < x.size(); i += 2) {
+            x[i] = in[i] * 2.0f;
+            x[i + 1] = in[i + 1] * 2.0f;
+            perFrame.Compress(&x[i], &x[i + 1]);
+        }
+    }
+    const double perFrameNs = (double) (nowNs() - start) / (kIterations * kFrames);
+
+    AdaptiveDynamicRangeCompression block;
+    ASSERT_TRUE(block.Initialize(2.0f, kSampleRate));
+    start = nowNs();
+    for (int n = 0; n < kIterations; n++) {
+        x = in;
+        block.CompressStereo(&x[0], kFrames, 2.0f, 1.0f);
+    }
+    const double blockNs = (double) (nowNs() - start) / (kIterations * kFrames);
+
+    printf("per frame %.2f ns/frame, block %.2f ns/frame\n", perFrameNs, blockNs);
+}
@@ -52,6 +52,7 @@ LOCAL_SRC_FILES:= \
     Common/src/BP_1I_D32F32Cll_TRC_WRA_02_Init.c \
     Common/src/BQ_2I_D32F32Cll_TRC_WRA_01_Init.c \
     Common/src/BQ_2I_D32F32C30_TRC_WRA_01.c \
+    Common/src/BQ_2I_D32F32C30_TRC_WRA_01_NEON.c \
     Common/src/BQ_2I_D16F32C15_TRC_WRA_01.c \
     Common/src/BQ_2I_D16F32C14_TRC_WRA_01.c \
     Common/src/BQ_2I_D16F32C13_TRC_WRA_01.c \
@@ -94,10 +95,13 @@ LOCAL_SRC_FILES:= \
     Common/src/LVC_Core_MixHard_1St_2i_D16C31_SAT.c \
     Common/src/LVC_Core_MixSoft_1St_2i_D16C31_WRA.c \
     Common/src/LVC_Core_MixInSoft_D16C31_SAT.c \
+    Common/src/LVC_Core_MixInSoft_D16C31_SAT_NEON.c \
     Common/src/LVC_Mixer_GetCurrent.c \
     Common/src/LVC_MixSoft_2St_D16C31_SAT.c \
     Common/src/LVC_Core_MixSoft_1St_D16C31_WRA.c \
+    Common/src/LVC_Core_MixSoft_1St_D16C31_WRA_NEON.c \
     Common/src/LVC_Core_MixHard_2St_D16C31_SAT.c \
+    Common/src/LVC_Core_MixHard_2St_D16C31_SAT_NEON.c \
     Common/src/LVC_MixInSoft_D16C31_SAT.c \
     Common/src/AGC_MIX_VOL_2St1Mon_D32_WRA.c \
     Common/src/LVM_Timer.c \
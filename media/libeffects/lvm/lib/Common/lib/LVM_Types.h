@@ -78,6 +78,13 @@ extern "C" {
 #define LVM_PERSISTENT_COEF     LVM_MEM_PARTITION2+LVM_MEM_PERSISTENT+LVM_MEM_INTERNAL
 #define LVM_SCRATCH             LVM_MEM_PARTITION3+LVM_MEM_SCRATCH+LVM_MEM_INTERNAL
 
+/* Processing primitives, 1 when the NEON implementations are used in place of the C ones */
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define LVM_NEON                1
+#else
+#define LVM_NEON                0
+#endif
+
 /****************************************************************************************/
 /*                                                                                      */
 /*  Basic types                                                                         */
@@ -37,7 +37,7 @@
  pBiquadState->pDelays[7] is y(n-2)R in Q0 format
 ***************************************************************************/
 
-void BQ_2I_D32F32C30_TRC_WRA_01 (           Biquad_Instance_t       *pInstance,
+void BQ_2I_D32F32C30_TRC_WRA_01_C (           Biquad_Instance_t       *pInstance,
                                             LVM_INT32                    *pDataIn,
                                             LVM_INT32                    *pDataOut,
                                             LVM_INT16                    NrSamples)
@@ -124,3 +124,21 @@ void BQ_2I_D32F32C30_TRC_WRA_01 (           Biquad_Instance_t       *pInstance,
 
     }
 
+/**********************************************************************************
+   FUNCTION BQ_2I_D32F32C30_TRC_WRA_01
+   Runs the NEON implementation where available, which is bit-exact with the C one
+***********************************************************************************/
+
+void BQ_2I_D32F32C30_TRC_WRA_01 (           Biquad_Instance_t       *pInstance,
+                                            LVM_INT32                    *pDataIn,
+                                            LVM_INT32                    *pDataOut,
+                                            LVM_INT16                    NrSamples)
+{
+#if LVM_NEON
+    BQ_2I_D32F32C30_TRC_WRA_01_NEON(pInstance, pDataIn, pDataOut, NrSamples);
+#else
+    BQ_2I_D32F32C30_TRC_WRA_01_C(pInstance, pDataIn, pDataOut, NrSamples);
+#endif
+}
+
+/**********************************************************************************/
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BIQUAD.h"
+#include "BQ_2I_D32F32Cll_TRC_WRA_01_Private.h"
+
+#if LVM_NEON
+
+#include <arm_neon.h>
+
+/**************************************************************************
+ NEON implementation of BQ_2I_D32F32C30_TRC_WRA_01, see the C version for
+ the coefficient and delay layout.
+
+ The left and right channels are processed in the two lanes of a vector.
+ Each product is computed on 64 bits and shifted by 30 before the sum, as
+ MUL32x32INTO32 does, so that the output is bit-exact with the C version.
+***************************************************************************/
+
+void BQ_2I_D32F32C30_TRC_WRA_01_NEON (      Biquad_Instance_t       *pInstance,
+                                            LVM_INT32                    *pDataIn,
+                                            LVM_INT32                    *pDataOut,
+                                            LVM_INT16                    NrSamples)
+    {
+        PFilter_State pBiquadState = (PFilter_State) pInstance;
+        const int32x2_t A2  = vdup_n_s32(pBiquadState->coefs[0]);
+        const int32x2_t A1  = vdup_n_s32(pBiquadState->coefs[1]);
+        const int32x2_t A0  = vdup_n_s32(pBiquadState->coefs[2]);
+        const int32x2_t mB2 = vdup_n_s32(pBiquadState->coefs[3]);
+        const int32x2_t mB1 = vdup_n_s32(pBiquadState->coefs[4]);
+        int32x2_t x1 = vld1_s32(&pBiquadState->pDelays[0]);     /* x(n-1)L, x(n-1)R */
+        int32x2_t x2 = vld1_s32(&pBiquadState->pDelays[2]);     /* x(n-2)L, x(n-2)R */
+        int32x2_t y1 = vld1_s32(&pBiquadState->pDelays[4]);     /* y(n-1)L, y(n-1)R */
+        int32x2_t y2 = vld1_s32(&pBiquadState->pDelays[6]);     /* y(n-2)L, y(n-2)R */
+        LVM_INT16 ii;
+
+        for (ii = NrSamples; ii != 0; ii--)
+        {
+            const int32x2_t xn = vld1_s32(pDataIn);
+            int32x2_t yn;
+
+            /* yn = (A2 * x(n-2)) >> 30 + (A1 * x(n-1)) >> 30 + (A0 * x(n)) >> 30
+                  + (-B2 * y(n-2)) >> 30 + (-B1 * y(n-1)) >> 30, wrapping on 32 bits */
+            yn = vmovn_s64(vshrq_n_s64(vmull_s32(A2, x2), 30));
+            yn = vadd_s32(yn, vmovn_s64(vshrq_n_s64(vmull_s32(A1, x1), 30)));
+            yn = vadd_s32(yn, vmovn_s64(vshrq_n_s64(vmull_s32(A0, xn), 30)));
+            yn = vadd_s32(yn, vmovn_s64(vshrq_n_s64(vmull_s32(mB2, y2), 30)));
+            yn = vadd_s32(yn, vmovn_s64(vshrq_n_s64(vmull_s32(mB1, y1), 30)));
+
+            x2 = x1;
+            x1 = xn;
+            y2 = y1;
+            y1 = yn;
+
+            vst1_s32(pDataOut, yn);
+            pDataIn += 2;
+            pDataOut += 2;
+        }
+
+        vst1_s32(&pBiquadState->pDelays[0], x1);
+        vst1_s32(&pBiquadState->pDelays[2], x2);
+        vst1_s32(&pBiquadState->pDelays[4], y1);
+        vst1_s32(&pBiquadState->pDelays[6], y2);
+    }
+
+#endif /* LVM_NEON */
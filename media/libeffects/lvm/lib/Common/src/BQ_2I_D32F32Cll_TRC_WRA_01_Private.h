@@ -29,4 +29,16 @@ typedef struct _Filter_State_
 
 typedef Filter_State * PFilter_State ;
 
+/* C and NEON implementations of BQ_2I_D32F32C30_TRC_WRA_01, the NEON one only exists when
+   LVM_NEON is set */
+void BQ_2I_D32F32C30_TRC_WRA_01_C (         Biquad_Instance_t       *pInstance,
+                                            LVM_INT32                    *pDataIn,
+                                            LVM_INT32                    *pDataOut,
+                                            LVM_INT16                    NrSamples);
+
+void BQ_2I_D32F32C30_TRC_WRA_01_NEON (      Biquad_Instance_t       *pInstance,
+                                            LVM_INT32                    *pDataIn,
+                                            LVM_INT32                    *pDataOut,
+                                            LVM_INT16                    NrSamples);
+
 #endif /* _BQ_2I_D32F32CLL_TRC_WRA_01_PRIVATE_H_*/
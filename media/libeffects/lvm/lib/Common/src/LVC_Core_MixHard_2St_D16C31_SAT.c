@@ -25,7 +25,7 @@
    FUNCTION LVCore_MIXHARD_2ST_D16C31_SAT
 ***********************************************************************************/
 
-void LVC_Core_MixHard_2St_D16C31_SAT( LVMixer3_st *ptrInstance1,
+void LVC_Core_MixHard_2St_D16C31_SAT_C( LVMixer3_st *ptrInstance1,
                                     LVMixer3_st         *ptrInstance2,
                                     const LVM_INT16     *src1,
                                     const LVM_INT16     *src2,
@@ -56,4 +56,25 @@ void LVC_Core_MixHard_2St_D16C31_SAT( LVMixer3_st *ptrInstance1,
 }
 
 
+/**********************************************************************************/
+
+/**********************************************************************************
+   FUNCTION LVC_Core_MixHard_2St_D16C31_SAT
+   Runs the NEON implementation where available, which is bit-exact with the C one
+***********************************************************************************/
+
+void LVC_Core_MixHard_2St_D16C31_SAT( LVMixer3_st *ptrInstance1,
+                                    LVMixer3_st         *ptrInstance2,
+                                    const LVM_INT16     *src1,
+                                    const LVM_INT16     *src2,
+                                          LVM_INT16     *dst,
+                                          LVM_INT16     n)
+{
+#if LVM_NEON
+    LVC_Core_MixHard_2St_D16C31_SAT_NEON(ptrInstance1, ptrInstance2, src1, src2, dst, n);
+#else
+    LVC_Core_MixHard_2St_D16C31_SAT_C(ptrInstance1, ptrInstance2, src1, src2, dst, n);
+#endif
+}
+
 /**********************************************************************************/
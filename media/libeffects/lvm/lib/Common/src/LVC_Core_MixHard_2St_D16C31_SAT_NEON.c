@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**********************************************************************************
+   INCLUDE FILES
+***********************************************************************************/
+
+#include "LVC_Mixer_Private.h"
+
+#if LVM_NEON
+
+#include <arm_neon.h>
+
+/**********************************************************************************
+   FUNCTION LVC_Core_MixHard_2St_D16C31_SAT_NEON
+
+   NEON implementation of LVC_Core_MixHard_2St_D16C31_SAT, 8 samples at a time.
+   Both Q15 products are summed on 32 bits and saturated to 16 bits, so the output
+   is bit-exact with the C version.
+***********************************************************************************/
+
+void LVC_Core_MixHard_2St_D16C31_SAT_NEON( LVMixer3_st *ptrInstance1,
+                                    LVMixer3_st         *ptrInstance2,
+                                    const LVM_INT16     *src1,
+                                    const LVM_INT16     *src2,
+                                          LVM_INT16     *dst,
+                                          LVM_INT16     n)
+{
+    LVM_INT32  Temp;
+    LVM_INT16 ii;
+    LVM_INT16 Current1Short;
+    LVM_INT16 Current2Short;
+    Mix_Private_st  *pInstance1=(Mix_Private_st *)(ptrInstance1->PrivateParams);
+    Mix_Private_st  *pInstance2=(Mix_Private_st *)(ptrInstance2->PrivateParams);
+    int16x4_t  Gain1;
+    int16x4_t  Gain2;
+
+    Current1Short = (LVM_INT16)(pInstance1->Current >> 16);
+    Current2Short = (LVM_INT16)(pInstance2->Current >> 16);
+    Gain1 = vdup_n_s16(Current1Short);
+    Gain2 = vdup_n_s16(Current2Short);
+
+    for (ii = (LVM_INT16)(n >> 3); ii != 0; ii--){
+        const int16x8_t in1 = vld1q_s16(src1);
+        const int16x8_t in2 = vld1q_s16(src2);
+        int32x4_t lo = vshrq_n_s32(vmull_s16(vget_low_s16(in1), Gain1), 15);
+        int32x4_t hi = vshrq_n_s32(vmull_s16(vget_high_s16(in1), Gain1), 15);
+        lo = vaddq_s32(lo, vshrq_n_s32(vmull_s16(vget_low_s16(in2), Gain2), 15));
+        hi = vaddq_s32(hi, vshrq_n_s32(vmull_s16(vget_high_s16(in2), Gain2), 15));
+        vst1q_s16(dst, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+        src1 += 8;
+        src2 += 8;
+        dst += 8;
+    }
+
+    for (ii = (LVM_INT16)(n & 7); ii != 0; ii--){
+        Temp = (((LVM_INT32)*(src1++) * (LVM_INT32)Current1Short)>>15) +
+               (((LVM_INT32)*(src2++) * (LVM_INT32)Current2Short)>>15);
+        if (Temp > 0x00007FFF)
+            *dst++ = 0x7FFF;
+        else if (Temp < -0x00008000)
+            *dst++ = - 0x8000;
+        else
+            *dst++ = (LVM_INT16)Temp;
+    }
+}
+
+#endif /* LVM_NEON */
+
+/**********************************************************************************/
@@ -26,7 +26,7 @@
    FUNCTION LVCore_MIXSOFT_1ST_D16C31_WRA
 ***********************************************************************************/
 
-void LVC_Core_MixInSoft_D16C31_SAT( LVMixer3_st *ptrInstance,
+void LVC_Core_MixInSoft_D16C31_SAT_C( LVMixer3_st *ptrInstance,
                                     const LVM_INT16     *src,
                                           LVM_INT16     *dst,
                                           LVM_INT16     n)
@@ -125,4 +125,23 @@ void LVC_Core_MixInSoft_D16C31_SAT( LVMixer3_st *ptrInstance,
 }
 
 
+/**********************************************************************************/
+
+/**********************************************************************************
+   FUNCTION LVC_Core_MixInSoft_D16C31_SAT
+   Runs the NEON implementation where available, which is bit-exact with the C one
+***********************************************************************************/
+
+void LVC_Core_MixInSoft_D16C31_SAT( LVMixer3_st *ptrInstance,
+                                    const LVM_INT16     *src,
+                                          LVM_INT16     *dst,
+                                          LVM_INT16     n)
+{
+#if LVM_NEON
+    LVC_Core_MixInSoft_D16C31_SAT_NEON(ptrInstance, src, dst, n);
+#else
+    LVC_Core_MixInSoft_D16C31_SAT_C(ptrInstance, src, dst, n);
+#endif
+}
+
 /**********************************************************************************/
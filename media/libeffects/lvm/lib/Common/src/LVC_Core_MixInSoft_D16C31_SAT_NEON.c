@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**********************************************************************************
+   INCLUDE FILES
+***********************************************************************************/
+
+#include "LVC_Mixer_Private.h"
+
+#if LVM_NEON
+
+#include <arm_neon.h>
+
+/**********************************************************************************
+   FUNCTION LVC_Core_MixInSoft_D16C31_SAT_NEON
+
+   NEON implementation of LVC_Core_MixInSoft_D16C31_SAT, with the gain stepping of
+   LVC_Core_MixSoft_1St_D16C31_WRA_NEON.  The Q15 products are accumulated on 32 bits
+   and saturated to 16 bits, so the output is bit-exact with the C version.
+***********************************************************************************/
+
+void LVC_Core_MixInSoft_D16C31_SAT_NEON( LVMixer3_st *ptrInstance,
+                                    const LVM_INT16     *src,
+                                          LVM_INT16     *dst,
+                                          LVM_INT16     n)
+{
+    LVM_INT16   OutLoop;
+    LVM_INT16   InLoop;
+    LVM_INT16   CurrentShort;
+    LVM_INT32   ii;
+    Mix_Private_st  *pInstance=(Mix_Private_st *)(ptrInstance->PrivateParams);
+    LVM_INT32   Delta=pInstance->Delta;
+    LVM_INT32   Current=pInstance->Current;
+    LVM_INT32   Target=pInstance->Target;
+    LVM_INT32   Temp;
+    LVM_INT16   Up;
+
+    InLoop = (LVM_INT16)(n >> 2); /* Process per 4 samples */
+    OutLoop = (LVM_INT16)(n - (InLoop << 2));
+
+    /* the direction of the ramp is decided once, as in the C version */
+    Up = (LVM_INT16)(Current < Target);
+
+    if (OutLoop){
+        CurrentShort = LVC_Core_MixSoft_Step(&Current, Delta, Target, Up);
+        for (ii = OutLoop; ii != 0; ii--){
+            Temp = ((LVM_INT32)*dst) + (((LVM_INT32)*(src++) * CurrentShort)>>15);      /* Q15 + Q15*Q15>>15 into Q15 */
+            if (Temp > 0x00007FFF)
+                *dst++ = 0x7FFF;
+            else if (Temp < -0x00008000)
+                *dst++ = - 0x8000;
+            else
+                *dst++ = (LVM_INT16)Temp;
+        }
+    }
+
+    for (ii = InLoop >> 1; ii != 0; ii--){
+        const LVM_INT16 Gain1 = LVC_Core_MixSoft_Step(&Current, Delta, Target, Up);
+        const LVM_INT16 Gain2 = LVC_Core_MixSoft_Step(&Current, Delta, Target, Up);
+        const int16x8_t in = vld1q_s16(src);
+        const int16x8_t out = vld1q_s16(dst);
+        int32x4_t lo = vshrq_n_s32(vmull_s16(vget_low_s16(in), vdup_n_s16(Gain1)), 15);
+        int32x4_t hi = vshrq_n_s32(vmull_s16(vget_high_s16(in), vdup_n_s16(Gain2)), 15);
+        lo = vaddq_s32(lo, vmovl_s16(vget_low_s16(out)));
+        hi = vaddq_s32(hi, vmovl_s16(vget_high_s16(out)));
+        vst1q_s16(dst, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+        src += 8;
+        dst += 8;
+    }
+
+    if (InLoop & 1){
+        int32x4_t acc;
+        CurrentShort = LVC_Core_MixSoft_Step(&Current, Delta, Target, Up);
+        acc = vshrq_n_s32(vmull_s16(vld1_s16(src), vdup_n_s16(CurrentShort)), 15);
+        acc = vaddq_s32(acc, vmovl_s16(vld1_s16(dst)));
+        vst1_s16(dst, vqmovn_s32(acc));
+    }
+
+    pInstance->Current=Current;
+}
+
+#endif /* LVM_NEON */
+
+/**********************************************************************************/
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**********************************************************************************
+   INCLUDE FILES
+***********************************************************************************/
+
+#include "LVC_Mixer_Private.h"
+#include "LVM_Macros.h"
+#include "ScalarArithmetic.h"
+
+#if LVM_NEON
+
+#include <arm_neon.h>
+
+/**********************************************************************************
+   FUNCTION LVC_Core_MixSoft_1St_D16C31_WRA_NEON
+
+   NEON implementation of LVC_Core_MixSoft_1St_D16C31_WRA.  The gain still steps
+   once per 4 samples, after the first n % 4 samples, and two steps are applied per
+   vector of 8 samples.  The Q15 products are narrowed by truncation, as the C
+   version casts them to 16 bits, so the output is bit-exact.
+***********************************************************************************/
+
+/* Steps *pCurrent towards Target as the 16 bit soft mixers do, upwards if Up is set, and
+   returns the new gain in Q15.  Also used by LVC_Core_MixInSoft_D16C31_SAT_NEON. */
+LVM_INT16 LVC_Core_MixSoft_Step(LVM_INT32 *pCurrent, LVM_INT32 Delta, LVM_INT32 Target,
+                                       LVM_INT16 Up)
+{
+    LVM_INT32   Current = *pCurrent;
+    LVM_INT32   Temp;
+
+    if (Up){
+        ADD2_SAT_32x32(Current,Delta,Temp);                                          /* Q31 + Q31 into Q31*/
+        Current=Temp;
+        if (Current > Target)
+            Current = Target;
+    }
+    else{
+        Current -= Delta;                                                            /* Q31 + Q31 into Q31*/
+        if (Current < Target)
+            Current = Target;
+    }
+    *pCurrent = Current;
+    return (LVM_INT16)(Current>>16);                                                 /* From Q31 to Q15*/
+}
+
+void LVC_Core_MixSoft_1St_D16C31_WRA_NEON( LVMixer3_st *ptrInstance,
+                                    const LVM_INT16     *src,
+                                          LVM_INT16     *dst,
+                                          LVM_INT16     n)
+{
+    LVM_INT16   OutLoop;
+    LVM_INT16   InLoop;
+    LVM_INT16   CurrentShort;
+    LVM_INT32   ii;
+    Mix_Private_st  *pInstance=(Mix_Private_st *)(ptrInstance->PrivateParams);
+    LVM_INT32   Delta=pInstance->Delta;
+    LVM_INT32   Current=pInstance->Current;
+    LVM_INT32   Target=pInstance->Target;
+    LVM_INT16   Up;
+
+    InLoop = (LVM_INT16)(n >> 2); /* Process per 4 samples */
+    OutLoop = (LVM_INT16)(n - (InLoop << 2));
+
+    /* the direction of the ramp is decided once, as in the C version */
+    Up = (LVM_INT16)(Current < Target);
+
+    if (OutLoop){
+        CurrentShort = LVC_Core_MixSoft_Step(&Current, Delta, Target, Up);
+        for (ii = OutLoop; ii != 0; ii--){
+            *(dst++) = (LVM_INT16)(((LVM_INT32)*(src++) * (LVM_INT32)CurrentShort)>>15);    /* Q15*Q15>>15 into Q15 */
+        }
+    }
+
+    for (ii = InLoop >> 1; ii != 0; ii--){
+        const LVM_INT16 Gain1 = LVC_Core_MixSoft_Step(&Current, Delta, Target, Up);
+        const LVM_INT16 Gain2 = LVC_Core_MixSoft_Step(&Current, Delta, Target, Up);
+        const int16x8_t in = vld1q_s16(src);
+        const int32x4_t lo = vmull_s16(vget_low_s16(in), vdup_n_s16(Gain1));
+        const int32x4_t hi = vmull_s16(vget_high_s16(in), vdup_n_s16(Gain2));
+        vst1q_s16(dst, vcombine_s16(vshrn_n_s32(lo, 15), vshrn_n_s32(hi, 15)));
+        src += 8;
+        dst += 8;
+    }
+
+    if (InLoop & 1){
+        CurrentShort = LVC_Core_MixSoft_Step(&Current, Delta, Target, Up);
+        vst1_s16(dst, vshrn_n_s32(vmull_s16(vld1_s16(src), vdup_n_s16(CurrentShort)), 15));
+    }
+
+    pInstance->Current=Current;
+}
+
+#endif /* LVM_NEON */
+
+/**********************************************************************************/
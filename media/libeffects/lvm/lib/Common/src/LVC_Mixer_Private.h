@@ -67,6 +67,44 @@ void LVC_Core_MixHard_2St_D16C31_SAT( LVMixer3_st *pInstance1,
                                           LVM_INT16     *dst,
                                           LVM_INT16     n);
 
+/* C and NEON implementations of the above, the NEON ones only exist when LVM_NEON is set */
+void LVC_Core_MixInSoft_D16C31_SAT_C( LVMixer3_st *pInstance,
+                                    const LVM_INT16     *src,
+                                          LVM_INT16     *dst,
+                                          LVM_INT16     n);
+
+void LVC_Core_MixSoft_1St_D16C31_WRA_C( LVMixer3_st *pInstance,
+                                    const LVM_INT16     *src,
+                                          LVM_INT16     *dst,
+                                          LVM_INT16     n);
+
+void LVC_Core_MixHard_2St_D16C31_SAT_C( LVMixer3_st *pInstance1,
+                                    LVMixer3_st         *pInstance2,
+                                    const LVM_INT16     *src1,
+                                    const LVM_INT16     *src2,
+                                          LVM_INT16     *dst,
+                                          LVM_INT16     n);
+
+LVM_INT16 LVC_Core_MixSoft_Step(LVM_INT32 *pCurrent, LVM_INT32 Delta, LVM_INT32 Target,
+                                 LVM_INT16 Up);
+
+void LVC_Core_MixInSoft_D16C31_SAT_NEON( LVMixer3_st *pInstance,
+                                    const LVM_INT16     *src,
+                                          LVM_INT16     *dst,
+                                          LVM_INT16     n);
+
+void LVC_Core_MixSoft_1St_D16C31_WRA_NEON( LVMixer3_st *pInstance,
+                                    const LVM_INT16     *src,
+                                          LVM_INT16     *dst,
+                                          LVM_INT16     n);
+
+void LVC_Core_MixHard_2St_D16C31_SAT_NEON( LVMixer3_st *pInstance1,
+                                    LVMixer3_st         *pInstance2,
+                                    const LVM_INT16     *src1,
+                                    const LVM_INT16     *src2,
+                                          LVM_INT16     *dst,
+                                          LVM_INT16     n);
+
 /**********************************************************************************/
 /* For applying different gains to Left and right chennals                        */
 /* ptrInstance1 applies to Left channel                                           */
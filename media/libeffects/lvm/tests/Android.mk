@@ -0,0 +1,33 @@
+# Build the unit tests for the LVM effect libraries
+
+#
+# NEON primitives bit-exactness test
+#
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libcutils \
+	libstlport
+
+LOCAL_STATIC_LIBRARIES := \
+	libmusicbundle \
+	libgtest \
+	libgtest_main
+
+LOCAL_C_INCLUDES := \
+	bionic \
+	bionic/libstdc++/include \
+	external/gtest/include \
+	external/stlport/stlport \
+	$(LOCAL_PATH)/../lib/Common/lib \
+	$(LOCAL_PATH)/../lib/Common/src
+
+LOCAL_SRC_FILES := \
+	lvm_primitives_tests.cpp
+
+LOCAL_MODULE := lvm_primitives_tests
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
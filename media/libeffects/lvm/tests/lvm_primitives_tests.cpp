@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "lvm_primitives_tests"
+
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <cutils/log.h>
+#include <gtest/gtest.h>
+
+extern "C" {
+#include "BIQUAD.h"
+#include "BQ_2I_D32F32Cll_TRC_WRA_01_Private.h"
+#include "LVC_Mixer_Private.h"
+}
+
+// The NEON implementations of the LVM primitives must produce the same output and state as
+// the C ones, for any input, gain ramp and block size.
+
+#if LVM_NEON
+
+// block sizes, including sizes that are not a multiple of the vector lengths
+static const LVM_INT16 kBlockSizes[] = { 1, 3, 4, 7, 8, 9, 16, 31, 64, 160, 257 };
+
+static const int kBlocks = 64;
+
+static LVM_INT32 random32()
+{
+    return (LVM_INT32) (((uint32_t) rand() << 16) ^ (uint32_t) rand());
+}
+
+static void randomFill(std::vector<LVM_INT16>& buffer)
+{
+    for (size_t i = 0; i < buffer.size(); i++) {
+        buffer[i] = (LVM_INT16) rand();
+    }
+}
+
+TEST(lvm_primitives, BQ_2I_D32F32C30_TRC_WRA_01)
+{
+    srand(42);
+    // a high pass and an arbitrary set of coefficients, both in Q30
+    static const LVM_INT32 kCoefs[][5] = {
+        { 1069900208, -2139800416, 1069900208, -1066002471, 2139638038 },
+        { 0x12345678, -0x23456789, 0x0ABCDEF0, -0x1FEDCBA9, 0x3FFFFFFF },
+    };
+    for (size_t c = 0; c < sizeof(kCoefs) / sizeof(kCoefs[0]); c++) {
+        for (size_t b = 0; b < sizeof(kBlockSizes) / sizeof(kBlockSizes[0]); b++) {
+            const LVM_INT16 n = kBlockSizes[b];
+            LVM_INT32 delaysC[8], delaysNeon[8];
+            Filter_State stateC, stateNeon;
+            for (int i = 0; i < 8; i++) {
+                delaysC[i] = delaysNeon[i] = random32() >> 8;
+            }
+            stateC.pDelays = delaysC;
+            stateNeon.pDelays = delaysNeon;
+            memcpy(stateC.coefs, kCoefs[c], sizeof(stateC.coefs));
+            memcpy(stateNeon.coefs, kCoefs[c], sizeof(stateNeon.coefs));
+
+            std::vector<LVM_INT32> in(2 * n), outC(2 * n), outNeon(2 * n);
+            for (int block = 0; block < kBlocks; block++) {
+                for (size_t i = 0; i < in.size(); i++) {
+                    // 16 bit samples shifted left as done by LVDBE_Process(), or full scale
+                    in[i] = (block & 1) ? random32() >> 2 : random32() >> 15;
+                }
+                BQ_2I_D32F32C30_TRC_WRA_01_C((Biquad_Instance_t *) &stateC,
+                        &in[0], &outC[0], n);
+                BQ_2I_D32F32C30_TRC_WRA_01_NEON((Biquad_Instance_t *) &stateNeon,
+                        &in[0], &outNeon[0], n);
+                ASSERT_EQ(0, memcmp(&outC[0], &outNeon[0], outC.size() * sizeof(outC[0])))
+                        << "coefs " << c << " block size " << n << " block " << block;
+                ASSERT_EQ(0, memcmp(delaysC, delaysNeon, sizeof(delaysC)));
+            }
+            // in place, as called by LVDBE_Process()
+            std::vector<LVM_INT32> inPlaceC(in), inPlaceNeon(in);
+            BQ_2I_D32F32C30_TRC_WRA_01_C((Biquad_Instance_t *) &stateC,
+                    &inPlaceC[0], &inPlaceC[0], n);
+            BQ_2I_D32F32C30_TRC_WRA_01_NEON((Biquad_Instance_t *) &stateNeon,
+                    &inPlaceNeon[0], &inPlaceNeon[0], n);
+            ASSERT_EQ(0, memcmp(&inPlaceC[0], &inPlaceNeon[0],
+                    inPlaceC.size() * sizeof(inPlaceC[0])));
+        }
+    }
+}
+
+// Sets the mixer gain ramp from current to target by steps of delta, all in Q31
+static void setRamp(LVMixer3_st *mixer, LVM_INT32 current, LVM_INT32 target, LVM_INT32 delta)
+{
+    memset(mixer, 0, sizeof(*mixer));
+    Mix_Private_st *params = (Mix_Private_st *) mixer->PrivateParams;
+    params->Current = current;
+    params->Target = target;
+    params->Delta = delta;
+}
+
+static LVM_INT32 current(LVMixer3_st *mixer)
+{
+    return ((Mix_Private_st *) mixer->PrivateParams)->Current;
+}
+
+// gain ramps: up, down, reaching the target within a block, and starting at the target
+static const LVM_INT32 kRamps[][3] = {
+    { 0, 0x7FFFFFFF, 0x00100000 },
+    { 0x7FFFFFFF, 0, 0x00100000 },
+    { 0x20000000, 0x21000000, 0x00400000 },
+    { 0x40000000, 0x3F000000, 0x00400000 },
+    { 0x7FFF0000, 0x7FFFFFFF, 0x7FFFFFFF },
+    { 0x30000000, 0x30000000, 0x00001000 },
+};
+
+TEST(lvm_primitives, LVC_Core_MixSoft_1St_D16C31_WRA)
+{
+    srand(43);
+    for (size_t r = 0; r < sizeof(kRamps) / sizeof(kRamps[0]); r++) {
+        for (size_t b = 0; b < sizeof(kBlockSizes) / sizeof(kBlockSizes[0]); b++) {
+            const LVM_INT16 n = kBlockSizes[b];
+            LVMixer3_st mixerC, mixerNeon;
+            setRamp(&mixerC, kRamps[r][0], kRamps[r][1], kRamps[r][2]);
+            setRamp(&mixerNeon, kRamps[r][0], kRamps[r][1], kRamps[r][2]);
+            std::vector<LVM_INT16> in(n), outC(n), outNeon(n);
+            for (int block = 0; block < kBlocks; block++) {
+                randomFill(in);
+                LVC_Core_MixSoft_1St_D16C31_WRA_C(&mixerC, &in[0], &outC[0], n);
+                LVC_Core_MixSoft_1St_D16C31_WRA_NEON(&mixerNeon, &in[0], &outNeon[0], n);
+                ASSERT_EQ(0, memcmp(&outC[0], &outNeon[0], n * sizeof(outC[0])))
+                        << "ramp " << r << " block size " << n << " block " << block;
+                ASSERT_EQ(current(&mixerC), current(&mixerNeon));
+            }
+        }
+    }
+}
+
+TEST(lvm_primitives, LVC_Core_MixInSoft_D16C31_SAT)
+{
+    srand(44);
+    for (size_t r = 0; r < sizeof(kRamps) / sizeof(kRamps[0]); r++) {
+        for (size_t b = 0; b < sizeof(kBlockSizes) / sizeof(kBlockSizes[0]); b++) {
+            const LVM_INT16 n = kBlockSizes[b];
+            LVMixer3_st mixerC, mixerNeon;
+            setRamp(&mixerC, kRamps[r][0], kRamps[r][1], kRamps[r][2]);
+            setRamp(&mixerNeon, kRamps[r][0], kRamps[r][1], kRamps[r][2]);
+            std::vector<LVM_INT16> in(n), outC(n), outNeon(n);
+            for (int block = 0; block < kBlocks; block++) {
+                randomFill(in);
+                // accumulates into the destination, which saturates with full scale signals
+                randomFill(outC);
+                outNeon = outC;
+                LVC_Core_MixInSoft_D16C31_SAT_C(&mixerC, &in[0], &outC[0], n);
+                LVC_Core_MixInSoft_D16C31_SAT_NEON(&mixerNeon, &in[0], &outNeon[0], n);
+                ASSERT_EQ(0, memcmp(&outC[0], &outNeon[0], n * sizeof(outC[0])))
+                        << "ramp " << r << " block size " << n << " block " << block;
+                ASSERT_EQ(current(&mixerC), current(&mixerNeon));
+            }
+        }
+    }
+}
+
+TEST(lvm_primitives, LVC_Core_MixHard_2St_D16C31_SAT)
+{
+    srand(45);
+    static const LVM_INT32 kGains[][2] = {
+        { 0x7FFFFFFF, 0x7FFFFFFF },
+        { 0x7FFFFFFF, 0 },
+        { 0x40000000, 0x20000000 },
+        { 0x12345678, 0x6789ABCD },
+    };
+    for (size_t g = 0; g < sizeof(kGains) / sizeof(kGains[0]); g++) {
+        for (size_t b = 0; b < sizeof(kBlockSizes) / sizeof(kBlockSizes[0]); b++) {
+            const LVM_INT16 n = kBlockSizes[b];
+            LVMixer3_st mixer1, mixer2;
+            setRamp(&mixer1, kGains[g][0], kGains[g][0], 0);
+            setRamp(&mixer2, kGains[g][1], kGains[g][1], 0);
+            std::vector<LVM_INT16> in1(n), in2(n), outC(n), outNeon(n);
+            for (int block = 0; block < kBlocks; block++) {
+                randomFill(in1);
+                randomFill(in2);
+                LVC_Core_MixHard_2St_D16C31_SAT_C(&mixer1, &mixer2, &in1[0], &in2[0],
+                        &outC[0], n);
+                LVC_Core_MixHard_2St_D16C31_SAT_NEON(&mixer1, &mixer2, &in1[0], &in2[0],
+                        &outNeon[0], n);
+                ASSERT_EQ(0, memcmp(&outC[0], &outNeon[0], n * sizeof(outC[0])))
+                        << "gains " << g << " block size " << n << " block " << block;
+            }
+        }
+    }
+}
+
+#else // LVM_NEON
+
+TEST(lvm_primitives, no_neon)
+{
+    ALOGI("no NEON implementation on this target, nothing to compare");
+}
+
+#endif // LVM_NEON
@@ -131,6 +131,8 @@ struct preproc_session_s {
     size_t revBufSize;                  // reverse channel input buffer size
     size_t framesRev;                   // number of frames in reverse channel input buffer
     SpeexResamplerState *revResampler;  // handle on reverse channel input speex resampler
+    int echoDelayMs;                    // echo delay last set with AEC_PARAM_ECHO_DELAY and
+                                        // applied before each ProcessStream(), or -1 if not set
 };
 
 #ifdef DUAL_MIC_TEST
@@ -487,6 +489,9 @@ int AecSetParameter (preproc_effect_t *effect, void *pParam, void *pValue)
     case AEC_PARAM_ECHO_DELAY:
     case AEC_PARAM_PROPERTIES:
         status = effect->session->apm->set_stream_delay_ms(value/1000);
+        // the engine forgets the delay after each frame: keep it so that a client aligning the
+        // reverse stream once does not have to set it again every 10 ms
+        effect->session->echoDelayMs = status == 0 ? value/1000 : -1;
         ALOGV("AecSetParameter() echo delay %d us, status %d", value, status);
         break;
     default:
@@ -817,6 +822,7 @@ extern "C" int Session_CreateEffect(preproc_session_t *session,
         session->revResampler = NULL;
         session->revBuf = NULL;
         session->revBufSize = 0;
+        session->echoDelayMs = -1;
     }
     status = Effect_Create(&session->effects[procId], session, interface);
     if (status < 0) {
@@ -1281,6 +1287,9 @@ int PreProcessingFx_Process(effect_handle_t     self,
         session->procFrame->_payloadDataLengthInSamples =
                 session->apmFrameCount * session->inChannelCount;
 
+        if (session->echoDelayMs >= 0) {
+            effect->session->apm->set_stream_delay_ms(session->echoDelayMs);
+        }
         effect->session->apm->ProcessStream(session->procFrame);
 
         if (session->outBufSize < session->framesOut + session->frameCount) {
@@ -11,13 +11,16 @@ LOCAL_CFLAGS+= -O2 -fvisibility=hidden -fno-strict-aliasing
 LOCAL_SHARED_LIBRARIES := \
 	libcutils \
 	liblog \
-	libdl
+	libdl \
+	libaudioutils
 
 LOCAL_MODULE_RELATIVE_PATH := soundfx
 LOCAL_MODULE:= libvisualizer
 
 LOCAL_C_INCLUDES := \
-	$(call include-path-for, audio-effects)
+	$(call include-path-for, audio-effects) \
+	$(call include-path-for, audio-utils) \
+	frameworks/av/include
 
 
 include $(BUILD_SHARED_LIBRARY)
@@ -25,6 +25,8 @@
 #include <time.h>
 #include <math.h>
 #include <audio_effects/effect_visualizer.h>
+#include <audio_utils/fixedfft.h>
+#include <media/VisualizerFrame.h>
 
 
 extern "C" {
@@ -77,6 +79,7 @@ struct VisualizerContext {
     uint8_t mState;
     uint32_t mLastCaptureIdx;
     uint32_t mLatency;
+    uint32_t mSequence; // number of buffers processed, see visualizer_frame_t
     struct timespec mBufferUpdateTime;
     uint8_t mCaptureBuf[CAPTURE_BUF_SIZE];
     // for measurements
@@ -204,6 +207,7 @@ int Visualizer_init(VisualizerContext *pContext)
 
     // visualization initialization
     pContext->mCaptureSize = VISUALIZER_CAPTURE_SIZE_MAX;
+    pContext->mSequence = 0;
     pContext->mScalingMode = VISUALIZER_SCALING_MODE_NORMALIZED;
 
     // measurement initialization
@@ -223,6 +227,203 @@ int Visualizer_init(VisualizerContext *pContext)
     return 0;
 }
 
+//----------------------------------------------------------------------------
+// Visualizer_getCapture()
+//----------------------------------------------------------------------------
+// Purpose: Copy the latest mCaptureSize samples of the capture buffer, or
+//  silence if the capture is idle.
+//
+// Inputs:
+//  pContext:   effect engine context
+//
+// Outputs:
+//  capture:    mCaptureSize 8 bit unsigned samples
+//
+//----------------------------------------------------------------------------
+
+void Visualizer_getCapture(VisualizerContext *pContext, uint8_t *capture)
+{
+    uint32_t captureSize = pContext->mCaptureSize;
+    if (pContext->mState == VISUALIZER_STATE_ACTIVE) {
+        const uint32_t deltaMs = Visualizer_getDeltaTimeMsFromUpdatedTime(pContext);
+
+        // if audio framework has stopped playing audio although the effect is still
+        // active we must clear the capture buffer to return silence
+        if ((pContext->mLastCaptureIdx == pContext->mCaptureIdx) &&
+                (pContext->mBufferUpdateTime.tv_sec != 0) &&
+                (deltaMs > MAX_STALL_TIME_MS)) {
+                ALOGV("capture going to idle");
+                pContext->mBufferUpdateTime.tv_sec = 0;
+                // let clients skipping unchanged frames display the silence
+                pContext->mSequence++;
+                memset(capture, 0x80, captureSize);
+        } else {
+            int32_t latencyMs = pContext->mLatency;
+            latencyMs -= deltaMs;
+            if (latencyMs < 0) {
+                latencyMs = 0;
+            }
+            const uint32_t deltaSmpl =
+                pContext->mConfig.inputCfg.samplingRate * latencyMs / 1000;
+            int32_t capturePoint = pContext->mCaptureIdx - captureSize - deltaSmpl;
+
+            if (capturePoint < 0) {
+                uint32_t size = -capturePoint;
+                if (size > captureSize) {
+                    size = captureSize;
+                }
+                memcpy(capture,
+                       pContext->mCaptureBuf + CAPTURE_BUF_SIZE + capturePoint,
+                       size);
+                capture += size;
+                captureSize -= size;
+                capturePoint = 0;
+            }
+            memcpy(capture,
+                   pContext->mCaptureBuf + capturePoint,
+                   captureSize);
+        }
+
+        pContext->mLastCaptureIdx = pContext->mCaptureIdx;
+    } else {
+        memset(capture, 0x80, captureSize);
+    }
+}
+
+//----------------------------------------------------------------------------
+// Visualizer_getMeasurements()
+//----------------------------------------------------------------------------
+// Purpose: Compute the peak and RMS over the measurement window.
+//
+// Inputs:
+//  pContext:   effect engine context
+//
+// Outputs:
+//  measurements:   peak and RMS in mB, at MEASUREMENT_IDX_PEAK and MEASUREMENT_IDX_RMS
+//
+//----------------------------------------------------------------------------
+
+void Visualizer_getMeasurements(VisualizerContext *pContext, int32_t *measurements)
+{
+    uint16_t peakU16 = 0;
+    float sumRmsSquared = 0.0f;
+    uint8_t nbValidMeasurements = 0;
+    // reset measurements if last measurement was too long ago (which implies stored
+    // measurements aren't relevant anymore and shouldn't bias the new one)
+    const int32_t delayMs = Visualizer_getDeltaTimeMsFromUpdatedTime(pContext);
+    if (delayMs > DISCARD_MEASUREMENTS_TIME_MS) {
+        ALOGV("Discarding measurements, last measurement is %" PRId32 "ms old", delayMs);
+        for (uint32_t i=0 ; i<pContext->mMeasurementWindowSizeInBuffers ; i++) {
+            pContext->mPastMeasurements[i].mIsValid = false;
+            pContext->mPastMeasurements[i].mPeakU16 = 0;
+            pContext->mPastMeasurements[i].mRmsSquared = 0;
+        }
+        pContext->mMeasurementBufferIdx = 0;
+    } else {
+        // only use actual measurements, otherwise the first RMS measure happening before
+        // MEASUREMENT_WINDOW_MAX_SIZE_IN_BUFFERS have been played will always be artificially
+        // low
+        for (uint32_t i=0 ; i < pContext->mMeasurementWindowSizeInBuffers ; i++) {
+            if (pContext->mPastMeasurements[i].mIsValid) {
+                if (pContext->mPastMeasurements[i].mPeakU16 > peakU16) {
+                    peakU16 = pContext->mPastMeasurements[i].mPeakU16;
+                }
+                sumRmsSquared += pContext->mPastMeasurements[i].mRmsSquared;
+                nbValidMeasurements++;
+            }
+        }
+    }
+    float rms = nbValidMeasurements == 0 ? 0.0f : sqrtf(sumRmsSquared / nbValidMeasurements);
+    // convert from I16 sample values to mB and write results
+    if (rms < 0.000016f) {
+        measurements[MEASUREMENT_IDX_RMS] = -9600; //-96dB
+    } else {
+        measurements[MEASUREMENT_IDX_RMS] = (int32_t) (2000 * log10(rms / 32767.0f));
+    }
+    if (peakU16 == 0) {
+        measurements[MEASUREMENT_IDX_PEAK] = -9600; //-96dB
+    } else {
+        measurements[MEASUREMENT_IDX_PEAK] = (int32_t) (2000 * log10(peakU16 / 32767.0f));
+    }
+    ALOGV("Visualizer_getMeasurements peak=%" PRIu16 " (%" PRId32 "mB), rms=%.1f (%" PRId32 "mB)",
+            peakU16, measurements[MEASUREMENT_IDX_PEAK],
+            rms, measurements[MEASUREMENT_IDX_RMS]);
+}
+
+//----------------------------------------------------------------------------
+// Visualizer_getFrame()
+//----------------------------------------------------------------------------
+// Purpose: Compute the spectrum of the latest capture decimated to a number of
+//  bands, and the measurements, so that clients get a frame ready for display
+//  in a single command instead of a capture and an FFT of their own.
+//
+// Inputs:
+//  pContext:   effect engine context
+//  bands:      number of bands, a power of 2 not larger than mCaptureSize / 2
+//
+// Outputs:
+//  frame:      frame for the latest capture
+//
+//----------------------------------------------------------------------------
+
+void Visualizer_getFrame(VisualizerContext *pContext, uint32_t bands, visualizer_frame_t *frame)
+{
+    const uint32_t captureSize = pContext->mCaptureSize;
+    uint8_t capture[captureSize];
+    int32_t workspace[captureSize >> 1];
+    int32_t nonzero = 0;
+
+    Visualizer_getCapture(pContext, capture);
+    for (uint32_t i = 0; i < captureSize; i += 2) {
+        workspace[i >> 1] =
+                ((capture[i] ^ 0x80) << 24) | ((capture[i + 1] ^ 0x80) << 8);
+        nonzero |= workspace[i >> 1];
+    }
+    if (nonzero) {
+        fixed_fft_real(captureSize >> 1, workspace);
+    }
+
+    // each band is the largest magnitude of its bins, converted to a log scale where 255 is
+    // the full scale of the 16 bit real and imaginary parts of the fixed point FFT
+    const uint32_t binsPerBand = (captureSize >> 1) / bands;
+    for (uint32_t band = 0; band < bands; band++) {
+        uint32_t maxSquared = 0;
+        for (uint32_t bin = band * binsPerBand; bin < (band + 1) * binsPerBand; bin++) {
+            int32_t re = workspace[bin] >> 16;
+            int32_t im = (int16_t)workspace[bin];
+            uint32_t squared = (uint32_t)(re * re) + (uint32_t)(im * im);
+            if (squared > maxSquared) {
+                maxSquared = squared;
+            }
+        }
+        int32_t level = VISUALIZER_FRAME_FLOOR_MB;
+        if (maxSquared != 0) {
+            level = (int32_t)(1000 * log10(maxSquared / (32768.0f * 32768.0f)));
+            if (level < VISUALIZER_FRAME_FLOOR_MB) {
+                level = VISUALIZER_FRAME_FLOOR_MB;
+            } else if (level > 0) {
+                level = 0;
+            }
+        }
+        frame->magnitudes[band] = (uint8_t)((level - VISUALIZER_FRAME_FLOOR_MB) * 255 /
+                -VISUALIZER_FRAME_FLOOR_MB);
+    }
+    memset(frame->magnitudes + bands, 0, VISUALIZER_FRAME_BANDS_MAX - bands);
+    frame->bands = bands;
+
+    if (pContext->mMeasurementMode & MEASUREMENT_MODE_PEAK_RMS) {
+        int32_t measurements[2];
+        Visualizer_getMeasurements(pContext, measurements);
+        frame->peakmB = measurements[MEASUREMENT_IDX_PEAK];
+        frame->rmsmB = measurements[MEASUREMENT_IDX_RMS];
+    } else {
+        frame->peakmB = VISUALIZER_FRAME_FLOOR_MB;
+        frame->rmsmB = VISUALIZER_FRAME_FLOOR_MB;
+    }
+    frame->sequence = pContext->mSequence;
+    frame->samplingRate = pContext->mConfig.inputCfg.samplingRate;
+}
+
 //
 //--- Effect Library Interface Implementation
 //
@@ -387,9 +588,10 @@ int Visualizer_process(
         buf[captIdx] = ((uint8_t)smp)^0x80;
     }
 
-    // XXX the following two should really be atomic, though it probably doesn't
+    // XXX the following should really be atomic, though it probably doesn't
     // matter much for visualization purposes
     pContext->mCaptureIdx = captIdx;
+    pContext->mSequence++;
     // update last buffer update time stamp
     if (clock_gettime(CLOCK_MONOTONIC, &pContext->mBufferUpdateTime) < 0) {
         pContext->mBufferUpdateTime.tv_sec = 0;
@@ -553,98 +755,29 @@ int Visualizer_command(effect_handle_t self, uint32_t cmdCode, uint32_t cmdSize,
                     *replySize, captureSize);
             return -EINVAL;
         }
-        if (pContext->mState == VISUALIZER_STATE_ACTIVE) {
-            const uint32_t deltaMs = Visualizer_getDeltaTimeMsFromUpdatedTime(pContext);
-
-            // if audio framework has stopped playing audio although the effect is still
-            // active we must clear the capture buffer to return silence
-            if ((pContext->mLastCaptureIdx == pContext->mCaptureIdx) &&
-                    (pContext->mBufferUpdateTime.tv_sec != 0) &&
-                    (deltaMs > MAX_STALL_TIME_MS)) {
-                    ALOGV("capture going to idle");
-                    pContext->mBufferUpdateTime.tv_sec = 0;
-                    memset(pReplyData, 0x80, captureSize);
-            } else {
-                int32_t latencyMs = pContext->mLatency;
-                latencyMs -= deltaMs;
-                if (latencyMs < 0) {
-                    latencyMs = 0;
-                }
-                const uint32_t deltaSmpl =
-                    pContext->mConfig.inputCfg.samplingRate * latencyMs / 1000;
-                int32_t capturePoint = pContext->mCaptureIdx - captureSize - deltaSmpl;
-
-                if (capturePoint < 0) {
-                    uint32_t size = -capturePoint;
-                    if (size > captureSize) {
-                        size = captureSize;
-                    }
-                    memcpy(pReplyData,
-                           pContext->mCaptureBuf + CAPTURE_BUF_SIZE + capturePoint,
-                           size);
-                    pReplyData = (char *)pReplyData + size;
-                    captureSize -= size;
-                    capturePoint = 0;
-                }
-                memcpy(pReplyData,
-                       pContext->mCaptureBuf + capturePoint,
-                       captureSize);
-            }
-
-            pContext->mLastCaptureIdx = pContext->mCaptureIdx;
-        } else {
-            memset(pReplyData, 0x80, captureSize);
-        }
-
+        Visualizer_getCapture(pContext, (uint8_t *)pReplyData);
         } break;
 
-    case VISUALIZER_CMD_MEASURE: {
-        uint16_t peakU16 = 0;
-        float sumRmsSquared = 0.0f;
-        uint8_t nbValidMeasurements = 0;
-        // reset measurements if last measurement was too long ago (which implies stored
-        // measurements aren't relevant anymore and shouldn't bias the new one)
-        const int32_t delayMs = Visualizer_getDeltaTimeMsFromUpdatedTime(pContext);
-        if (delayMs > DISCARD_MEASUREMENTS_TIME_MS) {
-            ALOGV("Discarding measurements, last measurement is %" PRId32 "ms old", delayMs);
-            for (uint32_t i=0 ; i<pContext->mMeasurementWindowSizeInBuffers ; i++) {
-                pContext->mPastMeasurements[i].mIsValid = false;
-                pContext->mPastMeasurements[i].mPeakU16 = 0;
-                pContext->mPastMeasurements[i].mRmsSquared = 0;
-            }
-            pContext->mMeasurementBufferIdx = 0;
-        } else {
-            // only use actual measurements, otherwise the first RMS measure happening before
-            // MEASUREMENT_WINDOW_MAX_SIZE_IN_BUFFERS have been played will always be artificially
-            // low
-            for (uint32_t i=0 ; i < pContext->mMeasurementWindowSizeInBuffers ; i++) {
-                if (pContext->mPastMeasurements[i].mIsValid) {
-                    if (pContext->mPastMeasurements[i].mPeakU16 > peakU16) {
-                        peakU16 = pContext->mPastMeasurements[i].mPeakU16;
-                    }
-                    sumRmsSquared += pContext->mPastMeasurements[i].mRmsSquared;
-                    nbValidMeasurements++;
-                }
-            }
-        }
-        float rms = nbValidMeasurements == 0 ? 0.0f : sqrtf(sumRmsSquared / nbValidMeasurements);
-        int32_t* pIntReplyData = (int32_t*)pReplyData;
-        // convert from I16 sample values to mB and write results
-        if (rms < 0.000016f) {
-            pIntReplyData[MEASUREMENT_IDX_RMS] = -9600; //-96dB
-        } else {
-            pIntReplyData[MEASUREMENT_IDX_RMS] = (int32_t) (2000 * log10(rms / 32767.0f));
+    case VISUALIZER_CMD_MEASURE:
+        if (pReplyData == NULL || *replySize < 2 * sizeof(int32_t)) {
+            return -EINVAL;
         }
-        if (peakU16 == 0) {
-            pIntReplyData[MEASUREMENT_IDX_PEAK] = -9600; //-96dB
-        } else {
-            pIntReplyData[MEASUREMENT_IDX_PEAK] = (int32_t) (2000 * log10(peakU16 / 32767.0f));
+        Visualizer_getMeasurements(pContext, (int32_t *)pReplyData);
+        break;
+
+    case VISUALIZER_CMD_CAPTURE_FRAME: {
+        if (pCmdData == NULL || cmdSize != sizeof(uint32_t) ||
+                pReplyData == NULL || *replySize != sizeof(visualizer_frame_t)) {
+            return -EINVAL;
         }
-        ALOGV("VISUALIZER_CMD_MEASURE peak=%" PRIu16 " (%" PRId32 "mB), rms=%.1f (%" PRId32 "mB)",
-                peakU16, pIntReplyData[MEASUREMENT_IDX_PEAK],
-                rms, pIntReplyData[MEASUREMENT_IDX_RMS]);
+        uint32_t bands = *(uint32_t *)pCmdData;
+        if (bands < VISUALIZER_FRAME_BANDS_MIN || bands > VISUALIZER_FRAME_BANDS_MAX ||
+                bands > pContext->mCaptureSize / 2 || (bands & (bands - 1)) != 0) {
+            ALOGV("VISUALIZER_CMD_CAPTURE_FRAME() invalid bands %" PRIu32, bands);
+            return -EINVAL;
         }
-        break;
+        Visualizer_getFrame(pContext, bands, (visualizer_frame_t *)pReplyData);
+        } break;
 
     default:
         ALOGW("Visualizer_command invalid command %" PRIu32, cmdCode);
@@ -70,6 +70,8 @@ LOCAL_SRC_FILES:= \
     MemoryLeakTrackUtil.cpp \
     SoundPool.cpp \
     SoundPoolThread.cpp \
+    SoundPoolCache.cpp \
+    SoundPoolMixer.cpp \
     StringArray.cpp
 
 LOCAL_SRC_FILES += ../libnbaio/roundup.c
@@ -148,8 +148,9 @@ status_t AudioRecord::set(
         }
         break;
     case TRANSFER_CALLBACK:
+    case TRANSFER_CALLBACK_SPLIT:
         if (cbf == NULL) {
-            ALOGE("Transfer type TRANSFER_CALLBACK but cbf == NULL");
+            ALOGE("Transfer type %d but cbf == NULL", transferType);
             return BAD_VALUE;
         }
         break;
@@ -192,8 +193,9 @@ status_t AudioRecord::set(
         ALOGE("Invalid format %#x", format);
         return BAD_VALUE;
     }
-    // Temporary restriction: AudioFlinger currently supports 16-bit PCM and compress formats only
-    if (format != AUDIO_FORMAT_PCM_16_BIT &&
+    // Temporary restriction: AudioFlinger currently supports 16-bit PCM, float and compress
+    // formats only
+    if (format != AUDIO_FORMAT_PCM_16_BIT && format != AUDIO_FORMAT_PCM_FLOAT &&
            !audio_is_compress_voip_format(format) &&
            !audio_is_compress_capture_format(format)) {
         ALOGE("Format %#x is not supported", format);
@@ -434,7 +436,7 @@ status_t AudioRecord::openRecord_l(size_t epoch)
     // Client can only express a preference for FAST.  Server will perform additional tests.
     if ((mFlags & AUDIO_INPUT_FLAG_FAST) && !(
             // use case: callback transfer mode
-            (mTransfer == TRANSFER_CALLBACK) &&
+            (mTransfer == TRANSFER_CALLBACK || mTransfer == TRANSFER_CALLBACK_SPLIT) &&
             // matching sample rate
             (mSampleRate == afSampleRate))) {
         ALOGW("AUDIO_INPUT_FLAG_FAST denied by client");
@@ -569,6 +571,7 @@ status_t AudioRecord::openRecord_l(size_t epoch)
     }
 
     // update proxy
+    mBuffers = buffers;
     mProxy = new AudioRecordClientProxy(cblk, buffers, mFrameCount, mFrameSize);
     mProxy->setEpoch(epoch);
     mProxy->setMinimum(mNotificationFramesAct);
@@ -868,7 +871,8 @@ nsecs_t AudioRecord::processAudioBuffer()
 
     // If > 0, poll periodically to recover from a stuck server.  A good value is 2.
     static const uint32_t kPoll = 0;
-    if (kPoll > 0 && mTransfer == TRANSFER_CALLBACK && kPoll * notificationFrames < minFrames) {
+    if (kPoll > 0 && (mTransfer == TRANSFER_CALLBACK || mTransfer == TRANSFER_CALLBACK_SPLIT) &&
+            kPoll * notificationFrames < minFrames) {
         minFrames = kPoll * notificationFrames;
     }
 
@@ -881,7 +885,7 @@ nsecs_t AudioRecord::processAudioBuffer()
     }
 
     // If not supplying data by EVENT_MORE_DATA, then we're done
-    if (mTransfer != TRANSFER_CALLBACK) {
+    if (mTransfer != TRANSFER_CALLBACK && mTransfer != TRANSFER_CALLBACK_SPLIT) {
         return ns;
     }
 
@@ -927,7 +931,26 @@ nsecs_t AudioRecord::processAudioBuffer()
         }
 
         size_t reqSize = audioBuffer.size;
-        mCbf(EVENT_MORE_DATA, mUserData, &audioBuffer);
+        size_t splitFrames = 0;
+        SplitBuffer splitBuffer;
+        if (mTransfer == TRANSFER_CALLBACK_SPLIT) {
+            // obtainBuffer() stopped short of both the request and the available data,
+            // so the data continues at the start of the buffer
+            if (nonContig > 0 && audioBuffer.frameCount < mRemainingFrames) {
+                splitFrames = mRemainingFrames - audioBuffer.frameCount;
+                if (splitFrames > nonContig) {
+                    splitFrames = nonContig;
+                }
+            }
+            splitBuffer.first = audioBuffer;
+            splitBuffer.second.frameCount = splitFrames;
+            splitBuffer.second.size = splitFrames * mFrameSize;
+            splitBuffer.second.raw = splitFrames > 0 ? mBuffers : NULL;
+            mCbf(EVENT_MORE_DATA, mUserData, &splitBuffer);
+            audioBuffer.size = splitBuffer.first.size;
+        } else {
+            mCbf(EVENT_MORE_DATA, mUserData, &audioBuffer);
+        }
         size_t readSize = audioBuffer.size;
 
         // Sanity check on returned size
@@ -936,6 +959,17 @@ nsecs_t AudioRecord::processAudioBuffer()
                     reqSize, ssize_t(readSize));
             return NS_NEVER;
         }
+        size_t splitSize = 0;
+        if (splitFrames > 0) {
+            splitSize = splitBuffer.second.size;
+            if (ssize_t(splitSize) < 0 || splitSize > splitFrames * mFrameSize ||
+                    (splitSize > 0 && readSize < reqSize)) {
+                ALOGE("EVENT_MORE_DATA requested %zu + %zu bytes but callback returned "
+                        "%zd + %zd bytes", reqSize, splitFrames * mFrameSize,
+                        ssize_t(readSize), ssize_t(splitSize));
+                return NS_NEVER;
+            }
+        }
 
         if (readSize == 0) {
             // The callback is done consuming buffers
@@ -956,6 +990,34 @@ nsecs_t AudioRecord::processAudioBuffer()
 
         releaseBuffer(&audioBuffer);
 
+        if (splitFrames > 0) {
+            nonContig -= splitFrames;
+            reqSize += splitFrames * mFrameSize;
+        }
+        if (splitSize > 0) {
+            // The second part is now at the read position: obtain it to release what the
+            // callback consumed. It cannot have been overwritten as it was not released.
+            Buffer wrapped;
+            wrapped.frameCount = splitFrames;
+            status_t err = obtainBuffer(&wrapped, &ClientProxy::kNonBlocking);
+            if (err != NO_ERROR || wrapped.raw != mBuffers) {
+                ALOGW("Lost wrapped buffer after EVENT_MORE_DATA, err %d", err);
+                wrapped.size = 0;
+                releaseBuffer(&wrapped);
+                return 0;
+            }
+            size_t wrappedFrames = splitSize / mFrameSize;
+            wrapped.size = splitSize;
+            releaseBuffer(&wrapped);
+            readSize += splitSize;
+            mRemainingFrames -= wrappedFrames;
+            if (misalignment >= wrappedFrames) {
+                misalignment -= wrappedFrames;
+            } else {
+                misalignment = 0;
+            }
+        }
+
         // FIXME here is where we would repeat EVENT_MORE_DATA again on same advanced buffer
         // if callback doesn't like to accept the full chunk
         if (readSize < reqSize) {
@@ -19,10 +19,12 @@
 
 #include <utils/Log.h>
 #include <binder/IServiceManager.h>
+#include <utils/KeyedVector.h>
 #include <media/AudioSystem.h>
 #include <media/IAudioFlinger.h>
 #include <media/IAudioPolicyService.h>
 #include <math.h>
+#include <stdatomic.h>
 
 #include <system/audio.h>
 
@@ -36,8 +38,66 @@ sp<IAudioFlinger> AudioSystem::gAudioFlinger;
 sp<AudioSystem::AudioFlingerClient> AudioSystem::gAudioFlingerClient;
 audio_error_callback AudioSystem::gAudioErrorCallback = NULL;
 
-// Cached values for output handles
-DefaultKeyedVector<audio_io_handle_t, AudioSystem::OutputDescriptor *> AudioSystem::gOutputs(NULL);
+// Cached values for output handles (sampling rate, framecount, channel count...)
+//
+// The output configuration is read by every AudioTrack::set(), so it is kept in an immutable
+// snapshot that queries read without gLock. AudioFlingerClient::ioConfigChanged() builds a new
+// snapshot under gLock and publishes it as a whole. A replaced snapshot is retired, and retired
+// snapshots are freed by the next update that finds no query in progress.
+struct OutputSnapshot {
+    KeyedVector<audio_io_handle_t, AudioSystem::OutputDescriptor> mOutputs;
+    OutputSnapshot *mNextRetired;
+};
+static atomic_uintptr_t gOutputSnapshot = ATOMIC_VAR_INIT(0);  // const OutputSnapshot *
+static atomic_int gOutputReaders = ATOMIC_VAR_INIT(0);         // queries in progress
+static OutputSnapshot *gRetiredSnapshots;                      // protected by gLock
+
+static bool getOutputDescriptor(audio_io_handle_t output, AudioSystem::OutputDescriptor *desc)
+{
+    // Sequentially consistent, so that an update either sees this query or has published
+    // its snapshot before the load below.
+    atomic_fetch_add(&gOutputReaders, 1);
+    const OutputSnapshot *snapshot = (const OutputSnapshot *) atomic_load(&gOutputSnapshot);
+    ssize_t index = snapshot != NULL ? snapshot->mOutputs.indexOfKey(output) : -1;
+    if (index >= 0) {
+        *desc = snapshot->mOutputs.valueAt(index);
+    }
+    atomic_fetch_sub_explicit(&gOutputReaders, 1, memory_order_release);
+    return index >= 0;
+}
+
+// Returns a copy of the current snapshot for modification, called with gLock held.
+static OutputSnapshot *copyOutputSnapshot_l()
+{
+    const OutputSnapshot *current =
+            (const OutputSnapshot *) atomic_load_explicit(&gOutputSnapshot, memory_order_relaxed);
+    OutputSnapshot *snapshot = new OutputSnapshot();
+    if (current != NULL) {
+        snapshot->mOutputs = current->mOutputs;
+    }
+    snapshot->mNextRetired = NULL;
+    return snapshot;
+}
+
+// Replaces the current snapshot, NULL clears the cache. Called with gLock held.
+static void publishOutputSnapshot_l(OutputSnapshot *snapshot)
+{
+    OutputSnapshot *previous =
+            (OutputSnapshot *) atomic_exchange(&gOutputSnapshot, (uintptr_t) snapshot);
+    if (previous != NULL) {
+        previous->mNextRetired = gRetiredSnapshots;
+        gRetiredSnapshots = previous;
+    }
+    // Queries starting from now on read the new snapshot: if none is in progress,
+    // no query can still be reading a retired one.
+    if (atomic_load(&gOutputReaders) == 0) {
+        while (gRetiredSnapshots != NULL) {
+            OutputSnapshot *next = gRetiredSnapshots->mNextRetired;
+            delete gRetiredSnapshots;
+            gRetiredSnapshots = next;
+        }
+    }
+}
 
 // Cached values for recording queries, all protected by gLock
 uint32_t AudioSystem::gPrevInSamplingRate;
@@ -261,20 +321,16 @@ status_t AudioSystem::getOutputSamplingRateForAttr(uint32_t* samplingRate,
 status_t AudioSystem::getSamplingRate(audio_io_handle_t output,
                                       uint32_t* samplingRate)
 {
-    OutputDescriptor *outputDesc;
+    OutputDescriptor outputDesc;
 
-    gLock.lock();
-    outputDesc = AudioSystem::gOutputs.valueFor(output);
-    if (outputDesc == NULL) {
-        ALOGV("getOutputSamplingRate() no output descriptor for output %d in gOutputs", output);
-        gLock.unlock();
+    if (!getOutputDescriptor(output, &outputDesc)) {
+        ALOGV("getOutputSamplingRate() no output descriptor for output %d in cache", output);
         const sp<IAudioFlinger>& af = AudioSystem::get_audio_flinger();
         if (af == 0) return PERMISSION_DENIED;
         *samplingRate = af->sampleRate(output);
     } else {
         ALOGV("getOutputSamplingRate() reading from output desc");
-        *samplingRate = outputDesc->samplingRate;
-        gLock.unlock();
+        *samplingRate = outputDesc.samplingRate;
     }
     if (*samplingRate == 0) {
         ALOGE("AudioSystem::getSamplingRate failed for output %d", output);
@@ -305,18 +361,14 @@ status_t AudioSystem::getOutputFrameCount(size_t* frameCount, audio_stream_type_
 status_t AudioSystem::getFrameCount(audio_io_handle_t output,
                                     size_t* frameCount)
 {
-    OutputDescriptor *outputDesc;
+    OutputDescriptor outputDesc;
 
-    gLock.lock();
-    outputDesc = AudioSystem::gOutputs.valueFor(output);
-    if (outputDesc == NULL) {
-        gLock.unlock();
+    if (!getOutputDescriptor(output, &outputDesc)) {
         const sp<IAudioFlinger>& af = AudioSystem::get_audio_flinger();
         if (af == 0) return PERMISSION_DENIED;
         *frameCount = af->frameCount(output);
     } else {
-        *frameCount = outputDesc->frameCount;
-        gLock.unlock();
+        *frameCount = outputDesc.frameCount;
     }
     if (*frameCount == 0) {
         ALOGE("AudioSystem::getFrameCount failed for output %d", output);
@@ -347,18 +399,14 @@ status_t AudioSystem::getOutputLatency(uint32_t* latency, audio_stream_type_t st
 status_t AudioSystem::getLatency(audio_io_handle_t output,
                                  uint32_t* latency)
 {
-    OutputDescriptor *outputDesc;
+    OutputDescriptor outputDesc;
 
-    gLock.lock();
-    outputDesc = AudioSystem::gOutputs.valueFor(output);
-    if (outputDesc == NULL) {
-        gLock.unlock();
+    if (!getOutputDescriptor(output, &outputDesc)) {
         const sp<IAudioFlinger>& af = AudioSystem::get_audio_flinger();
         if (af == 0) return PERMISSION_DENIED;
         *latency = af->latency(output);
     } else {
-        *latency = outputDesc->latency;
-        gLock.unlock();
+        *latency = outputDesc.latency;
     }
 
     ALOGV("getLatency() output %d, latency %d", output, *latency);
@@ -465,7 +513,7 @@ void AudioSystem::AudioFlingerClient::binderDied(const wp<IBinder>& who __unused
 
     AudioSystem::gAudioFlinger.clear();
     // clear output handles and stream to output map caches
-    AudioSystem::gOutputs.clear();
+    publishOutputSnapshot_l(NULL);
 
     if (gAudioErrorCallback) {
         gAudioErrorCallback(DEAD_OBJECT);
@@ -483,36 +531,40 @@ void AudioSystem::AudioFlingerClient::ioConfigChanged(int event, audio_io_handle
 
     Mutex::Autolock _l(AudioSystem::gLock);
 
+    OutputSnapshot *snapshot = copyOutputSnapshot_l();
+    bool changed = false;
+
     switch (event) {
     case STREAM_CONFIG_CHANGED:
         break;
     case OUTPUT_OPENED: {
-        if (gOutputs.indexOfKey(ioHandle) >= 0) {
+        if (snapshot->mOutputs.indexOfKey(ioHandle) >= 0) {
             ALOGV("ioConfigChanged() opening already existing output! %d", ioHandle);
             break;
         }
         if (param2 == NULL) break;
         desc = (const OutputDescriptor *)param2;
 
-        OutputDescriptor *outputDesc =  new OutputDescriptor(*desc);
-        gOutputs.add(ioHandle, outputDesc);
+        snapshot->mOutputs.add(ioHandle, *desc);
+        changed = true;
         ALOGV("ioConfigChanged() new output samplingRate %u, format %#x channel mask %#x frameCount %zu "
                 "latency %d",
-                outputDesc->samplingRate, outputDesc->format, outputDesc->channelMask,
-                outputDesc->frameCount, outputDesc->latency);
+                desc->samplingRate, desc->format, desc->channelMask,
+                desc->frameCount, desc->latency);
         } break;
     case OUTPUT_CLOSED: {
-        if (gOutputs.indexOfKey(ioHandle) < 0) {
+        if (snapshot->mOutputs.indexOfKey(ioHandle) < 0) {
             ALOGW("ioConfigChanged() closing unknown output! %d", ioHandle);
             break;
         }
         ALOGV("ioConfigChanged() output %d closed", ioHandle);
 
-        gOutputs.removeItem(ioHandle);
+        snapshot->mOutputs.removeItem(ioHandle);
+        changed = true;
         } break;
 
     case OUTPUT_CONFIG_CHANGED: {
-        int index = gOutputs.indexOfKey(ioHandle);
+        int index = snapshot->mOutputs.indexOfKey(ioHandle);
         if (index < 0) {
             ALOGW("ioConfigChanged() modifying unknown output! %d", ioHandle);
             break;
@@ -524,10 +576,8 @@ void AudioSystem::AudioFlingerClient::ioConfigChanged(int event, audio_io_handle
                 "frameCount %zu latency %d",
                 ioHandle, desc->samplingRate, desc->format,
                 desc->channelMask, desc->frameCount, desc->latency);
-        OutputDescriptor *outputDesc = gOutputs.valueAt(index);
-        delete outputDesc;
-        outputDesc =  new OutputDescriptor(*desc);
-        gOutputs.replaceValueFor(ioHandle, outputDesc);
+        snapshot->mOutputs.replaceValueAt(index, *desc);
+        changed = true;
     } break;
     case INPUT_OPENED:
     case INPUT_CLOSED:
@@ -535,6 +585,12 @@ void AudioSystem::AudioFlingerClient::ioConfigChanged(int event, audio_io_handle
         break;
 
     }
+
+    if (changed) {
+        publishOutputSnapshot_l(snapshot);
+    } else {
+        delete snapshot;
+    }
 }
 
 void AudioSystem::setErrorCallback(audio_error_callback cb)
@@ -858,7 +914,7 @@ void AudioSystem::clearAudioConfigCache()
 {
     Mutex::Autolock _l(gLock);
     ALOGV("clearAudioConfigCache()");
-    gOutputs.clear();
+    publishOutputSnapshot_l(NULL);
 }
 
 bool AudioSystem::isOffloadSupported(const audio_offload_info_t& info)
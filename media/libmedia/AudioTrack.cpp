@@ -121,7 +121,8 @@ AudioTrack::AudioTrack()
       mIsTimed(false),
       mPreviousPriority(ANDROID_PRIORITY_NORMAL),
       mPreviousSchedulingGroup(SP_DEFAULT),
-      mPausedPosition(0)
+      mPausedPosition(0),
+      mSpinBudgetUs(0)
 {
     mAttributes.content_type = AUDIO_CONTENT_TYPE_UNKNOWN;
     mAttributes.usage = AUDIO_USAGE_UNKNOWN;
@@ -150,7 +151,8 @@ AudioTrack::AudioTrack(
       mPreviousPriority(ANDROID_PRIORITY_NORMAL),
       mPreviousSchedulingGroup(SP_DEFAULT),
       mUseSmallBuf(false),
-      mPausedPosition(0)
+      mPausedPosition(0),
+      mSpinBudgetUs(0)
 #ifdef QCOM_DIRECTTRACK
       ,mAudioFlinger(NULL),
       mObserver(NULL)
@@ -184,7 +186,8 @@ AudioTrack::AudioTrack(
       mPreviousPriority(ANDROID_PRIORITY_NORMAL),
       mPreviousSchedulingGroup(SP_DEFAULT),
       mUseSmallBuf(false),
-      mPausedPosition(0)
+      mPausedPosition(0),
+      mSpinBudgetUs(0)
 #ifdef QCOM_DIRECTTRACK
       ,mAudioFlinger(NULL),
       mObserver(NULL)
@@ -1153,6 +1156,12 @@ audio_io_handle_t AudioTrack::getOutput() const
     return mOutput;
 }
 
+sp<IAudioTrack> AudioTrack::getIAudioTrack() const
+{
+    AutoMutex lock(mLock);
+    return mAudioTrack;
+}
+
 status_t AudioTrack::attachAuxEffect(int effectId)
 {
     AutoMutex lock(mLock);
@@ -1524,6 +1533,9 @@ status_t AudioTrack::createTrack_l()
     mProxy->setSendLevel(mSendLevel);
     mProxy->setSampleRate(mSampleRate);
     mProxy->setMinimum(mNotificationFramesAct);
+    if (mSharedBuffer == 0) {
+        mProxy->setSpinBudget(mSpinBudgetUs * 1000);
+    }
 
     mDeathNotifier = new DeathNotifier(this);
     mAudioTrack->asBinder()->linkToDeath(mDeathNotifier, this);
@@ -1851,7 +1863,8 @@ nsecs_t AudioTrack::processAudioBuffer()
 
     // Can only reference mCblk while locked
     int32_t flags = android_atomic_and(
-        ~(CBLK_UNDERRUN | CBLK_LOOP_CYCLE | CBLK_LOOP_FINAL | CBLK_BUFFER_END), &mCblk->mFlags);
+        ~(CBLK_UNDERRUN | CBLK_UNDERRUN_RISK | CBLK_LOOP_CYCLE | CBLK_LOOP_FINAL |
+                CBLK_BUFFER_END), &mCblk->mFlags);
 
     if (flags & CBLK_STREAM_FATAL_ERROR) {
         ALOGE("clbk sees STREAM_FATAL_ERROR.. close session");
@@ -1896,6 +1909,11 @@ nsecs_t AudioTrack::processAudioBuffer()
         }
     }
 
+    // The server predicts underruns only for streaming tracks; an underrun that already
+    // happened supersedes the warning.
+    bool underrunRisk = (flags & CBLK_UNDERRUN_RISK) && !newUnderrun && active;
+    uint32_t underrunRiskFrames = underrunRisk ? mProxy->getUnderrunRiskFrames() : 0;
+
     // Get current position of server
     size_t position = updateAndGetPosition_l();
 
@@ -1940,6 +1958,9 @@ nsecs_t AudioTrack::processAudioBuffer()
     if (newUnderrun) {
         mCbf(EVENT_UNDERRUN, mUserData, NULL);
     }
+    if (underrunRisk) {
+        mCbf(EVENT_UNDERRUN_RISK, mUserData, &underrunRiskFrames);
+    }
     // FIXME we will miss loops if loop cycle was signaled several times since last call
     //       to processAudioBuffer()
     if (flags & (CBLK_LOOP_CYCLE | CBLK_LOOP_FINAL)) {
@@ -2380,6 +2401,23 @@ bool AudioTrack::isOffloadedOrDirect() const
 }
 
 
+status_t AudioTrack::setObtainSpinBudget(uint32_t spinUs)
+{
+    AutoMutex lock(mLock);
+    if (mSharedBuffer != 0) {
+        return INVALID_OPERATION;
+    }
+    // limit so the budget in ns fits in 32 bits
+    if (spinUs > UINT32_MAX / 1000) {
+        spinUs = UINT32_MAX / 1000;
+    }
+    mSpinBudgetUs = spinUs;
+    if (mProxy != 0) {
+        mProxy->setSpinBudget(spinUs * 1000);
+    }
+    return NO_ERROR;
+}
+
 status_t AudioTrack::dump(int fd, const Vector<String16>& args __unused) const
 {
 
@@ -2398,6 +2436,12 @@ status_t AudioTrack::dump(int fd, const Vector<String16>& args __unused) const
     result.append(buffer);
     snprintf(buffer, 255, "  state(%d), latency (%d)\n", mState, mLatency);
     result.append(buffer);
+    if (mSpinBudgetUs > 0 && mProxy != 0) {
+        ClientProxy::SpinStats stats = mProxy->getSpinStats();
+        snprintf(buffer, 255, "  spin budget(%u us), spins(%u), hits(%u), futex waits(%u)\n",
+                mSpinBudgetUs, stats.mSpins, stats.mSpinHits, stats.mFutexWaits);
+        result.append(buffer);
+    }
     ::write(fd, result.string(), result.size());
     return NO_ERROR;
 }
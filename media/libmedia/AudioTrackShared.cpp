@@ -49,8 +49,10 @@ Proxy::Proxy(audio_track_cblk_t* cblk, void *buffers, size_t frameCount, size_t
 
 ClientProxy::ClientProxy(audio_track_cblk_t* cblk, void *buffers, size_t frameCount,
         size_t frameSize, bool isOut, bool clientInServer)
-    : Proxy(cblk, buffers, frameCount, frameSize, isOut, clientInServer), mEpoch(0)
+    : Proxy(cblk, buffers, frameCount, frameSize, isOut, clientInServer), mEpoch(0),
+      mSpinBudgetNs(0), mSpinNs(0)
 {
+    memset(&mSpinStats, 0, sizeof(mSpinStats));
 }
 
 const struct timespec ClientProxy::kForever = {INT_MAX /*tv_sec*/, 0 /*tv_nsec*/};
@@ -96,6 +98,7 @@ status_t ClientProxy::obtainBuffer(Buffer* buffer, const struct timespec *reques
     bool beforeIsValid = false;
     audio_track_cblk_t* cblk = mCblk;
     bool ignoreInitialPendingInterrupt = true;
+    bool spun = false;
     // check for shared memory corruption
     if (mIsShutdown) {
         status = NO_INIT;
@@ -218,8 +221,16 @@ status_t ClientProxy::obtainBuffer(Buffer* buffer, const struct timespec *reques
             ts = NULL;
             break;
         }
+        // Poll at most once per call; on time out the wake bit set by the poll is cleared below,
+        // which costs one extra pass through the loop before the futex wait.
+        if (mSpinNs > 0 && !spun) {
+            spun = true;
+            (void) spinUntilChanged(mIsOut ? front : rear);
+            continue;
+        }
         int32_t old = android_atomic_and(~CBLK_FUTEX_WAKE, &cblk->mFutex);
         if (!(old & CBLK_FUTEX_WAKE)) {
+            mSpinStats.mFutexWaits++;
             if (measure && !beforeIsValid) {
                 clock_gettime(CLOCK_MONOTONIC, &before);
                 beforeIsValid = true;
@@ -280,6 +291,56 @@ end:
     return status;
 }
 
+void ClientProxy::setSpinBudget(uint32_t spinNs)
+{
+    mSpinBudgetNs = spinNs;
+    mSpinNs = spinNs;
+}
+
+// Busy-wait until the index advanced by the server differs from the observed value, the track
+// is invalidated or interrupted, or the adaptive budget expires.  Returns true if the server
+// made progress.  Time spent here is not charged against the obtainBuffer() timeout.
+bool ClientProxy::spinUntilChanged(int32_t observed)
+{
+    audio_track_cblk_t* cblk = mCblk;
+    mSpinStats.mSpins++;
+    // While the wake bit is set the server does not issue a futex wake on releaseBuffer().
+    // The caller clears the bit again before actually waiting on the futex.
+    (void) android_atomic_or(CBLK_FUTEX_WAKE, &cblk->mFutex);
+    volatile int32_t *index = mIsOut ? &cblk->u.mStreaming.mFront : &cblk->u.mStreaming.mRear;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    bool changed = false;
+    for (uint32_t i = 1; ; ++i) {
+        if (android_atomic_acquire_load(index) != observed ||
+                (cblk->mFlags & (CBLK_INVALID | CBLK_INTERRUPT))) {
+            changed = true;
+            break;
+        }
+        // reading the clock is much more expensive than reading the control block
+        if ((i & 15) == 0) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            int64_t elapsedNs = (now.tv_sec - start.tv_sec) * 1000000000LL +
+                    (now.tv_nsec - start.tv_nsec);
+            if (elapsedNs >= mSpinNs) {
+                break;
+            }
+        }
+    }
+    if (changed) {
+        mSpinStats.mSpinHits++;
+        mSpinNs = mSpinNs > mSpinBudgetNs / 2 ? mSpinBudgetNs : mSpinNs * 2;
+    } else {
+        uint32_t floor = mSpinBudgetNs / kSpinFloorDivisor;
+        mSpinNs = mSpinNs / 2 > floor ? mSpinNs / 2 : floor;
+        if (mSpinNs == 0) {
+            mSpinNs = 1;
+        }
+    }
+    return changed;
+}
+
 void ClientProxy::releaseBuffer(Buffer* buffer)
 {
     LOG_ALWAYS_FATAL_IF(buffer == NULL);
@@ -718,6 +779,67 @@ void AudioTrackServerProxy::tallyUnderrunFrames(uint32_t frameCount)
     (void) android_atomic_or(CBLK_UNDERRUN, &cblk->mFlags);
 }
 
+void AudioTrackServerProxy::observeFramesReady(size_t framesReady, size_t desiredFrames)
+{
+    audio_track_cblk_t* cblk = mCblk;
+    uint32_t server = cblk->mServer;
+    // frames written by the client since the previous observation
+    ssize_t delivered = (ssize_t) framesReady - (ssize_t) mLastFill +
+            (ssize_t) (server - mLastServer);
+    mLastFill = framesReady;
+    mLastServer = server;
+    if (mFillObservations == 0 || delivered < 0) {
+        // first observation, or flush() discarded frames: restart learning
+        mFillObservations = 1;
+        mDeliveryMeanQ4 = 0;
+        mDeliveryDevQ4 = 0;
+        return;
+    }
+    int32_t deliveredQ4 = (int32_t) delivered << 4;
+    if (mFillObservations == 1) {
+        mDeliveryMeanQ4 = deliveredQ4;
+    } else {
+        int32_t errorQ4 = deliveredQ4 - mDeliveryMeanQ4;
+        mDeliveryMeanQ4 += errorQ4 >> kFillShift;
+        mDeliveryDevQ4 += ((errorQ4 < 0 ? -errorQ4 : errorQ4) - mDeliveryDevQ4) >> kFillShift;
+    }
+    if (mFillObservations < kFillWarmup) {
+        mFillObservations++;
+        return;
+    }
+
+    // Pessimistic estimate of what the client will deliver before the next cycle,
+    // and the resulting fill level once this cycle has consumed desiredFrames.
+    int32_t expected = (mDeliveryMeanQ4 - 2 * mDeliveryDevQ4) >> 4;
+    if (expected < 0) {
+        expected = 0;
+    }
+    ssize_t predicted = (ssize_t) framesReady - (ssize_t) desiredFrames + expected;
+    if (predicted >= (ssize_t) desiredFrames) {
+        if (mRiskSignaled && ++mSafeCycles >= kRiskRearm) {
+            mRiskSignaled = false;
+        }
+        return;
+    }
+    mSafeCycles = 0;
+    if (mRiskSignaled) {
+        return;
+    }
+    mRiskSignaled = true;
+    ssize_t recommended = 2 * (ssize_t) desiredFrames - expected;
+    if (recommended > (ssize_t) mFrameCount) {
+        recommended = mFrameCount;
+    } else if (recommended < (ssize_t) desiredFrames) {
+        recommended = desiredFrames;
+    }
+    ALOGV("underrun predicted: ready=%zu desired=%zu expected=%d recommended=%zd",
+            framesReady, desiredFrames, expected, recommended);
+    // the value is published before the flag, see AudioTrack::processAudioBuffer()
+    android_atomic_release_store((int32_t) recommended,
+            (volatile int32_t *) &cblk->u.mStreaming.mUnderrunRiskFrames);
+    (void) android_atomic_or(CBLK_UNDERRUN_RISK, &cblk->mFlags);
+}
+
 // ---------------------------------------------------------------------------
 
 StaticAudioTrackServerProxy::StaticAudioTrackServerProxy(audio_track_cblk_t* cblk, void *buffers,
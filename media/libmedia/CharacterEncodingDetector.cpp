@@ -63,8 +63,26 @@ status_t CharacterEncodingDetector::getTag(int index, const char **name, const c
     return OK;
 }
 
+static const uint64_t kOnes = 0x0101010101010101ull;
+static const uint64_t kHighBits = 0x8080808080808080ull;
+
+// Checks 8 characters at once, for none of them to have bit 7 set, to be
+// below 0x20 or to be 0x7f.
+static inline bool isPrintableAsciiWord(const char *value) {
+    uint64_t x;
+    memcpy(&x, value, sizeof(x));
+    uint64_t del = x ^ (kOnes * 0x7f);
+    return !((x | ((x - kOnes * 0x20) & ~x) | ((del - kOnes) & ~del)) & kHighBits);
+}
+
 static bool isPrintableAscii(const char *value, size_t len) {
-    for (size_t i = 0; i < len; i++) {
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        if (!isPrintableAsciiWord(&value[i])) {
+            return false;
+        }
+    }
+    for (; i < len; i++) {
         if ((value[i] & 0x80) || value[i] < 0x20 || value[i] == 0x7f) {
             return false;
         }
@@ -72,6 +90,71 @@ static bool isPrintableAscii(const char *value, size_t len) {
     return true;
 }
 
+// Whether the value is well formed UTF-8, without control characters. Values
+// that are, are taken to be UTF-8 without asking ICU, which could only tell
+// the same after running all its detectors on them.
+static bool isPrintableUtf8(const char *value, size_t len) {
+    const uint8_t *s = (const uint8_t *)value;
+    size_t i = 0;
+    while (i < len) {
+        if (i + 8 <= len && isPrintableAsciiWord(&value[i])) {
+            i += 8;
+            continue;
+        }
+
+        uint8_t c = s[i];
+        if (c < 0x80) {
+            if (c < 0x20 || c == 0x7f) {
+                return false;
+            }
+            i++;
+            continue;
+        }
+
+        size_t n;
+        uint32_t cp, min;
+        if ((c & 0xe0) == 0xc0) {
+            n = 1;
+            cp = c & 0x1f;
+            min = 0x80;
+        } else if ((c & 0xf0) == 0xe0) {
+            n = 2;
+            cp = c & 0x0f;
+            min = 0x800;
+        } else if ((c & 0xf8) == 0xf0) {
+            n = 3;
+            cp = c & 0x07;
+            min = 0x10000;
+        } else {
+            return false;
+        }
+        if (n >= len - i) {
+            return false;
+        }
+        for (size_t k = 1; k <= n; k++) {
+            if ((s[i + k] & 0xc0) != 0x80) {
+                return false;
+            }
+            cp = (cp << 6) | (s[i + k] & 0x3f);
+        }
+        // overlong forms, surrogates, code points past Unicode and C1 controls
+        if (cp < min || (cp >= 0xd800 && cp <= 0xdfff) || cp > 0x10ffff || cp <= 0x9f) {
+            return false;
+        }
+        i += n + 1;
+    }
+    return true;
+}
+
+static bool isCombinedTag(const char *name) {
+    return !strcmp(name, "artist") ||
+            !strcmp(name, "albumartist") ||
+            !strcmp(name, "composer") ||
+            !strcmp(name, "genre") ||
+            !strcmp(name, "album") ||
+            !strcmp(name, "title");
+}
+
 void CharacterEncodingDetector::detectAndConvert() {
 
     int size = mNames.size();
@@ -91,20 +174,19 @@ void CharacterEncodingDetector::detectAndConvert() {
         buf[0] = 0;
         int idx;
         bool allprintable = true;
+        bool allutf8 = true;
         for (int i = 0; i < size; i++) {
             const char *name = mNames.getEntry(i);
             const char *value = mValues.getEntry(i);
-            if (!isPrintableAscii(value, strlen(value)) && (
-                        !strcmp(name, "artist") ||
-                        !strcmp(name, "albumartist") ||
-                        !strcmp(name, "composer") ||
-                        !strcmp(name, "genre") ||
-                        !strcmp(name, "album") ||
-                        !strcmp(name, "title"))) {
+            size_t len = strlen(value);
+            if (isCombinedTag(name) && !isPrintableAscii(value, len)) {
                 strlcat(buf, value, sizeof(buf));
                 // separate tags by space so ICU's ngram detector can do its job
                 strlcat(buf, " ", sizeof(buf));
                 allprintable = false;
+                if (allutf8 && !isPrintableUtf8(value, len)) {
+                    allutf8 = false;
+                }
             }
         }
 
@@ -113,6 +195,8 @@ void CharacterEncodingDetector::detectAndConvert() {
             // since 'buf' is empty, ICU would return a UTF-8 matcher with low confidence, so
             // no need to even call it
             ALOGV("all tags are printable, assuming ascii (%zu)", strlen(buf));
+        } else if (allutf8) {
+            ALOGV("all tags are valid utf-8 (%zu)", strlen(buf));
         } else {
             ucsdet_setText(csd, buf, strlen(buf), &status);
             int32_t matches;
@@ -176,18 +260,16 @@ void CharacterEncodingDetector::detectAndConvert() {
             int32_t inputLength = strlen(s);
             const char *enc;
 
-            if (!allprintable && (!strcmp(name, "artist") ||
-                    !strcmp(name, "albumartist") ||
-                    !strcmp(name, "composer") ||
-                    !strcmp(name, "genre") ||
-                    !strcmp(name, "album") ||
-                    !strcmp(name, "title"))) {
+            if (!allprintable && isCombinedTag(name)) {
                 // use encoding determined from the combination of artist/album/title etc.
                 enc = combinedenc;
             } else {
                 if (isPrintableAscii(s, inputLength)) {
                     enc = "UTF-8";
                     ALOGV("@@@@ %s is ascii", mNames.getEntry(i));
+                } else if (isPrintableUtf8(s, inputLength)) {
+                    enc = "UTF-8";
+                    ALOGV("@@@@ %s is utf-8", mNames.getEntry(i));
                 } else {
                     ucsdet_setText(csd, s, inputLength, &status);
                     ucm = ucsdet_detect(csd, &status);
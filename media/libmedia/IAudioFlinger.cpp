@@ -82,6 +82,8 @@ enum {
     LIST_AUDIO_PATCHES,
     SET_AUDIO_PORT_CONFIG,
     GET_AUDIO_HW_SYNC,
+    SET_TRACK_PARAMETERS,
+    SHARE_STATIC_BUFFER,
 #ifdef QCOM_DIRECTTRACK
     CREATE_DIRECT_TRACK,
 #endif
@@ -942,6 +944,43 @@ public:
         }
         return (audio_hw_sync_t)reply.readInt32();
     }
+    virtual status_t setTrackParameters(const Vector<TrackParameter>& parameters)
+    {
+        if (parameters.size() > kMaxTrackParameters) {
+            return BAD_VALUE;
+        }
+        Parcel data, reply;
+        data.writeInterfaceToken(IAudioFlinger::getInterfaceDescriptor());
+        data.writeInt32(parameters.size());
+        for (size_t i = 0; i < parameters.size(); i++) {
+            const TrackParameter& parameter = parameters[i];
+            if (parameter.mTrack == 0) {
+                return BAD_VALUE;
+            }
+            data.writeStrongBinder(parameter.mTrack->asBinder());
+            data.writeInt32(parameter.mKey);
+            data.writeFloat(parameter.mValue);
+        }
+        status_t status = remote()->transact(SET_TRACK_PARAMETERS, data, &reply);
+        if (status != NO_ERROR) {
+            return status;
+        }
+        return (status_t)reply.readInt32();
+    }
+    virtual sp<IMemory> shareStaticBuffer(const sp<IMemory>& buffer)
+    {
+        if (buffer == 0) {
+            return 0;
+        }
+        Parcel data, reply;
+        data.writeInterfaceToken(IAudioFlinger::getInterfaceDescriptor());
+        data.writeStrongBinder(buffer->asBinder());
+        status_t status = remote()->transact(SHARE_STATIC_BUFFER, data, &reply);
+        if (status != NO_ERROR) {
+            return 0;
+        }
+        return interface_cast<IMemory>(reply.readStrongBinder());
+    }
 };
 
 IMPLEMENT_META_INTERFACE(AudioFlinger, "android.media.IAudioFlinger");
@@ -1429,6 +1468,32 @@ status_t BnAudioFlinger::onTransact(
             reply->writeInt32(getAudioHwSyncForSession((audio_session_t)data.readInt32()));
             return NO_ERROR;
         } break;
+        case SET_TRACK_PARAMETERS: {
+            CHECK_INTERFACE(IAudioFlinger, data, reply);
+            size_t count = (size_t)data.readInt32();
+            if (count > kMaxTrackParameters) {
+                reply->writeInt32(BAD_VALUE);
+                return NO_ERROR;
+            }
+            Vector<TrackParameter> parameters;
+            parameters.setCapacity(count);
+            for (size_t i = 0; i < count; i++) {
+                TrackParameter parameter;
+                parameter.mTrack = interface_cast<IAudioTrack>(data.readStrongBinder());
+                parameter.mKey = (TrackParameter::Key)data.readInt32();
+                parameter.mValue = data.readFloat();
+                parameters.add(parameter);
+            }
+            reply->writeInt32(setTrackParameters(parameters));
+            return NO_ERROR;
+        } break;
+        case SHARE_STATIC_BUFFER: {
+            CHECK_INTERFACE(IAudioFlinger, data, reply);
+            sp<IMemory> buffer = interface_cast<IMemory>(data.readStrongBinder());
+            sp<IMemory> shared = shareStaticBuffer(buffer);
+            reply->writeStrongBinder(shared != 0 ? shared->asBinder() : sp<IBinder>());
+            return NO_ERROR;
+        } break;
         default:
             return BBinder::onTransact(code, data, reply, flags);
     }
@@ -18,6 +18,7 @@
 #define LOG_TAG "ICrypto"
 #include <utils/Log.h>
 
+#include <binder/IMemory.h>
 #include <binder/Parcel.h>
 #include <media/ICrypto.h>
 #include <media/stagefright/MediaErrors.h>
@@ -33,6 +34,7 @@ enum {
     DESTROY_PLUGIN,
     REQUIRES_SECURE_COMPONENT,
     DECRYPT,
+    DECRYPT_SHARED,
 };
 
 struct BpCrypto : public BpInterface<ICrypto> {
@@ -149,6 +151,59 @@ struct BpCrypto : public BpInterface<ICrypto> {
         return result;
     }
 
+    virtual ssize_t decrypt(
+            bool secure,
+            const uint8_t key[16],
+            const uint8_t iv[16],
+            CryptoPlugin::Mode mode,
+            const sp<IMemory> &sharedBuffer, size_t offset,
+            const CryptoPlugin::SubSample *subSamples, size_t numSubSamples,
+            void *dstPtr,
+            AString *errorDetailMsg) {
+        Parcel data, reply;
+        data.writeInterfaceToken(ICrypto::getInterfaceDescriptor());
+        data.writeInt32(secure);
+        data.writeInt32(mode);
+
+        static const uint8_t kDummy[16] = { 0 };
+
+        if (key == NULL) {
+            key = kDummy;
+        }
+
+        if (iv == NULL) {
+            iv = kDummy;
+        }
+
+        data.write(key, 16);
+        data.write(iv, 16);
+
+        // the binder of the memory, not the data in it
+        data.writeStrongBinder(sharedBuffer->asBinder());
+        data.writeInt32(offset);
+
+        data.writeInt32(numSubSamples);
+        data.write(subSamples, sizeof(CryptoPlugin::SubSample) * numSubSamples);
+
+        if (secure) {
+            data.writeInt64(static_cast<uint64_t>(reinterpret_cast<uintptr_t>(dstPtr)));
+        }
+
+        remote()->transact(DECRYPT_SHARED, data, &reply);
+
+        ssize_t result = reply.readInt32();
+
+        if (result >= ERROR_DRM_VENDOR_MIN && result <= ERROR_DRM_VENDOR_MAX) {
+            errorDetailMsg->setTo(reply.readCString());
+        }
+
+        if (!secure && result >= 0) {
+            reply.read(dstPtr, result);
+        }
+
+        return result;
+    }
+
 private:
     DISALLOW_EVIL_CONSTRUCTORS(BpCrypto);
 };
@@ -222,6 +277,7 @@ status_t BnCrypto::onTransact(
         }
 
         case DECRYPT:
+        case DECRYPT_SHARED:
         {
             CHECK_INTERFACE(ICrypto, data, reply);
 
@@ -234,9 +290,23 @@ status_t BnCrypto::onTransact(
             uint8_t iv[16];
             data.read(iv, sizeof(iv));
 
-            size_t totalSize = data.readInt32();
-            void *srcData = malloc(totalSize);
-            data.read(srcData, totalSize);
+            size_t totalSize = 0;
+            void *srcData = NULL;
+            sp<IMemory> sharedBuffer;
+            size_t offset = 0;
+
+            if (code == DECRYPT_SHARED) {
+                sharedBuffer = interface_cast<IMemory>(data.readStrongBinder());
+                offset = data.readInt32();
+                if (sharedBuffer == NULL) {
+                    reply->writeInt32(BAD_VALUE);
+                    return OK;
+                }
+            } else {
+                totalSize = data.readInt32();
+                srcData = malloc(totalSize);
+                data.read(srcData, totalSize);
+            }
 
             int32_t numSubSamples = data.readInt32();
 
@@ -247,6 +317,13 @@ status_t BnCrypto::onTransact(
                     subSamples,
                     sizeof(CryptoPlugin::SubSample) * numSubSamples);
 
+            if (code == DECRYPT_SHARED) {
+                for (int32_t i = 0; i < numSubSamples; ++i) {
+                    totalSize += subSamples[i].mNumBytesOfEncryptedData;
+                    totalSize += subSamples[i].mNumBytesOfClearData;
+                }
+            }
+
             void *dstPtr;
             if (secure) {
                 dstPtr = reinterpret_cast<void *>(static_cast<uintptr_t>(data.readInt64()));
@@ -255,15 +332,28 @@ status_t BnCrypto::onTransact(
             }
 
             AString errorDetailMsg;
-            ssize_t result = decrypt(
-                    secure,
-                    key,
-                    iv,
-                    mode,
-                    srcData,
-                    subSamples, numSubSamples,
-                    dstPtr,
-                    &errorDetailMsg);
+            ssize_t result;
+            if (code == DECRYPT_SHARED) {
+                result = decrypt(
+                        secure,
+                        key,
+                        iv,
+                        mode,
+                        sharedBuffer, offset,
+                        subSamples, numSubSamples,
+                        dstPtr,
+                        &errorDetailMsg);
+            } else {
+                result = decrypt(
+                        secure,
+                        key,
+                        iv,
+                        mode,
+                        srcData,
+                        subSamples, numSubSamples,
+                        dstPtr,
+                        &errorDetailMsg);
+            }
 
             reply->writeInt32(result);
 
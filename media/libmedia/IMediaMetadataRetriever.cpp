@@ -68,6 +68,8 @@ enum {
     GET_FRAME_AT_TIME,
     EXTRACT_ALBUM_ART,
     EXTRACT_METADATA,
+    GET_THUMBNAIL_AT_TIME,
+    EXTRACT_METADATA_BATCH,
 };
 
 class BpMediaMetadataRetriever: public BpInterface<IMediaMetadataRetriever>
@@ -143,6 +145,28 @@ public:
         return interface_cast<IMemory>(reply.readStrongBinder());
     }
 
+    sp<IMemory> getThumbnailAtTime(
+            int64_t timeUs, int option, int32_t width, int32_t height)
+    {
+        ALOGV("getThumbnailAtTime: time(%" PRId64 " us) option(%d) size(%dx%d)",
+                timeUs, option, width, height);
+        Parcel data, reply;
+        data.writeInterfaceToken(IMediaMetadataRetriever::getInterfaceDescriptor());
+        data.writeInt64(timeUs);
+        data.writeInt32(option);
+        data.writeInt32(width);
+        data.writeInt32(height);
+#ifndef DISABLE_GROUP_SCHEDULE_HACK
+        sendSchedPolicy(data);
+#endif
+        remote()->transact(GET_THUMBNAIL_AT_TIME, data, &reply);
+        status_t ret = reply.readInt32();
+        if (ret != NO_ERROR) {
+            return NULL;
+        }
+        return interface_cast<IMemory>(reply.readStrongBinder());
+    }
+
     sp<IMemory> extractAlbumArt()
     {
         Parcel data, reply;
@@ -185,6 +209,50 @@ public:
         }
     }
 
+    status_t extractMetadataBatch(
+            const Vector<int> &fds, const Vector<int> &keyCodes,
+            Vector<KeyedVector<int, String8> > *values)
+    {
+        values->clear();
+        if (fds.size() > kMaxBatchSize || keyCodes.size() > kMaxBatchSize) {
+            return BAD_VALUE;
+        }
+
+        Parcel data, reply;
+        data.writeInterfaceToken(IMediaMetadataRetriever::getInterfaceDescriptor());
+#ifndef DISABLE_GROUP_SCHEDULE_HACK
+        sendSchedPolicy(data);
+#endif
+        data.writeInt32(fds.size());
+        for (size_t i = 0; i < fds.size(); ++i) {
+            data.writeFileDescriptor(fds[i]);
+        }
+        data.writeInt32(keyCodes.size());
+        for (size_t i = 0; i < keyCodes.size(); ++i) {
+            data.writeInt32(keyCodes[i]);
+        }
+        remote()->transact(EXTRACT_METADATA_BATCH, data, &reply);
+        status_t ret = reply.readInt32();
+        if (ret != NO_ERROR) {
+            return ret;
+        }
+
+        for (size_t i = 0; i < fds.size(); ++i) {
+            KeyedVector<int, String8> fileValues;
+            int32_t count = reply.readInt32();
+            if (count < 0 || (size_t)count > keyCodes.size()) {
+                values->clear();
+                return UNKNOWN_ERROR;
+            }
+            for (int32_t j = 0; j < count; ++j) {
+                int keyCode = reply.readInt32();
+                fileValues.add(keyCode, reply.readString8());
+            }
+            values->push(fileValues);
+        }
+        return NO_ERROR;
+    }
+
 private:
     KeyedVector<int, String8> mMetadata;
 };
@@ -252,6 +320,29 @@ status_t BnMediaMetadataRetriever::onTransact(
             }
 #ifndef DISABLE_GROUP_SCHEDULE_HACK
             restoreSchedPolicy();
+#endif
+            return NO_ERROR;
+        } break;
+        case GET_THUMBNAIL_AT_TIME: {
+            CHECK_INTERFACE(IMediaMetadataRetriever, data, reply);
+            int64_t timeUs = data.readInt64();
+            int option = data.readInt32();
+            int32_t width = data.readInt32();
+            int32_t height = data.readInt32();
+            ALOGV("getThumbnailAtTime: time(%" PRId64 " us) option(%d) size(%dx%d)",
+                    timeUs, option, width, height);
+#ifndef DISABLE_GROUP_SCHEDULE_HACK
+            setSchedPolicy(data);
+#endif
+            sp<IMemory> bitmap = getThumbnailAtTime(timeUs, option, width, height);
+            if (bitmap != 0) {  // Don't send NULL across the binder interface
+                reply->writeInt32(NO_ERROR);
+                reply->writeStrongBinder(bitmap->asBinder());
+            } else {
+                reply->writeInt32(UNKNOWN_ERROR);
+            }
+#ifndef DISABLE_GROUP_SCHEDULE_HACK
+            restoreSchedPolicy();
 #endif
             return NO_ERROR;
         } break;
@@ -287,6 +378,50 @@ status_t BnMediaMetadataRetriever::onTransact(
             }
 #ifndef DISABLE_GROUP_SCHEDULE_HACK
             restoreSchedPolicy();
+#endif
+            return NO_ERROR;
+        } break;
+        case EXTRACT_METADATA_BATCH: {
+            CHECK_INTERFACE(IMediaMetadataRetriever, data, reply);
+#ifndef DISABLE_GROUP_SCHEDULE_HACK
+            setSchedPolicy(data);
+#endif
+            // the fds are the parcel's, closed with it
+            status_t ret = NO_ERROR;
+            Vector<int> fds;
+            int32_t numFds = data.readInt32();
+            if (numFds < 0 || (size_t)numFds > kMaxBatchSize) {
+                ret = BAD_VALUE;
+            }
+            for (int32_t i = 0; ret == NO_ERROR && i < numFds; ++i) {
+                fds.push(data.readFileDescriptor());
+            }
+            Vector<int> keyCodes;
+            int32_t numKeyCodes = data.readInt32();
+            if (numKeyCodes < 0 || (size_t)numKeyCodes > kMaxBatchSize) {
+                ret = BAD_VALUE;
+            }
+            for (int32_t i = 0; ret == NO_ERROR && i < numKeyCodes; ++i) {
+                keyCodes.push(data.readInt32());
+            }
+
+            Vector<KeyedVector<int, String8> > values;
+            if (ret == NO_ERROR) {
+                ret = extractMetadataBatch(fds, keyCodes, &values);
+            }
+            reply->writeInt32(ret);
+            if (ret == NO_ERROR) {
+                for (size_t i = 0; i < values.size(); ++i) {
+                    const KeyedVector<int, String8> &fileValues = values[i];
+                    reply->writeInt32(fileValues.size());
+                    for (size_t j = 0; j < fileValues.size(); ++j) {
+                        reply->writeInt32(fileValues.keyAt(j));
+                        reply->writeString8(fileValues.valueAt(j));
+                    }
+                }
+            }
+#ifndef DISABLE_GROUP_SCHEDULE_HACK
+            restoreSchedPolicy();
 #endif
             return NO_ERROR;
         } break;
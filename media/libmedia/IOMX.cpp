@@ -963,16 +963,38 @@ public:
     virtual void onMessage(const omx_message &msg) {
         Parcel data, reply;
         data.writeInterfaceToken(IOMXObserver::getInterfaceDescriptor());
+        data.writeInt32(1);
         data.write(&msg, sizeof(msg));
 
         ALOGV("onMessage writing message %d, size %zu", msg.type, sizeof(msg));
 
         remote()->transact(OBSERVER_ON_MSG, data, &reply, IBinder::FLAG_ONEWAY);
     }
+
+    virtual void onMessages(const List<omx_message> &messages) {
+        Parcel data, reply;
+        data.writeInterfaceToken(IOMXObserver::getInterfaceDescriptor());
+        data.writeInt32(messages.size());
+        for (List<omx_message>::const_iterator it = messages.begin();
+                it != messages.end(); ++it) {
+            data.write(&*it, sizeof(*it));
+        }
+
+        ALOGV("onMessages writing %zu messages", messages.size());
+
+        remote()->transact(OBSERVER_ON_MSG, data, &reply, IBinder::FLAG_ONEWAY);
+    }
 };
 
 IMPLEMENT_META_INTERFACE(OMXObserver, "android.hardware.IOMXObserver");
 
+void IOMXObserver::onMessages(const List<omx_message> &messages) {
+    for (List<omx_message>::const_iterator it = messages.begin();
+            it != messages.end(); ++it) {
+        onMessage(*it);
+    }
+}
+
 status_t BnOMXObserver::onTransact(
     uint32_t code, const Parcel &data, Parcel *reply, uint32_t flags) {
     switch (code) {
@@ -980,13 +1002,33 @@ status_t BnOMXObserver::onTransact(
         {
             CHECK_OMX_INTERFACE(IOMXObserver, data, reply);
 
-            omx_message msg;
-            data.read(&msg, sizeof(msg));
+            int32_t count = data.readInt32();
+            if (count == 1) {
+                omx_message msg;
+                data.read(&msg, sizeof(msg));
+
+                ALOGV("onTransact reading message %d, size %zu", msg.type, sizeof(msg));
+
+                // XXX Could use readInplace maybe?
+                onMessage(msg);
+                return NO_ERROR;
+            }
+
+            if (count < 0 || (size_t)count > data.dataAvail() / sizeof(omx_message)) {
+                ALOGE("invalid OMX message count %d", count);
+                return BAD_VALUE;
+            }
+
+            List<omx_message> messages;
+            for (int32_t i = 0; i < count; ++i) {
+                omx_message msg;
+                data.read(&msg, sizeof(msg));
+                messages.push_back(msg);
+            }
 
-            ALOGV("onTransact reading message %d, size %zu", msg.type, sizeof(msg));
+            ALOGV("onTransact reading %d messages", count);
 
-            // XXX Could use readInplace maybe?
-            onMessage(msg);
+            onMessages(messages);
 
             return NO_ERROR;
         }
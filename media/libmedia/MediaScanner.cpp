@@ -17,17 +17,276 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "MediaScanner"
 #include <cutils/properties.h>
+#include <utils/KeyedVector.h>
 #include <utils/Log.h>
+#include <utils/Vector.h>
 
 #include <media/mediascanner.h>
 
 #include <sys/stat.h>
 #include <dirent.h>
+#include <stdlib.h>
+#include <unistd.h>
 
 namespace android {
 
+// Directories listed ahead and not yet reached by the scan, at most.
+static const size_t kMaxPrefetchedDirectories = 256;
+static const long kMaxPrefetchThreads = 4;
+
+struct MediaScanner::DirectoryEntry {
+    String8 mName;
+    int mType;
+    // whether stat() succeeded, for mModified and mSize
+    bool mStatted;
+    long long mModified;
+    long long mSize;
+};
+
+struct MediaScanner::DirectoryListing : public RefBase {
+    enum State {
+        PENDING,
+        LISTING,
+        LISTED,
+    };
+
+    DirectoryListing(const char *path)
+        : mPath(path),
+          mState(PENDING),
+          mError(0),
+          mHasNoMediaFile(false) {
+    }
+
+    // with a trailing '/'
+    String8 mPath;
+    State mState;
+    // errno if the directory could not be opened
+    int mError;
+    bool mHasNoMediaFile;
+    Vector<DirectoryEntry> mEntries;
+
+    void list();
+
+private:
+    DirectoryListing(const DirectoryListing &);
+    DirectoryListing &operator=(const DirectoryListing &);
+};
+
+void MediaScanner::DirectoryListing::list() {
+    String8 noMediaPath(mPath);
+    noMediaPath.append(".nomedia");
+    mHasNoMediaFile = access(noMediaPath.string(), F_OK) == 0;
+
+    DIR* dir = opendir(mPath.string());
+    if (!dir) {
+        mError = errno;
+        return;
+    }
+
+    struct dirent* entry;
+    while ((entry = readdir(dir))) {
+        const char* name = entry->d_name;
+
+        // ignore "." and ".."
+        if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) {
+            continue;
+        }
+
+        DirectoryEntry item;
+        item.mName = name;
+        item.mType = entry->d_type;
+        item.mStatted = false;
+        item.mModified = 0;
+        item.mSize = 0;
+
+        if (item.mType == DT_UNKNOWN || item.mType == DT_DIR || item.mType == DT_REG) {
+            String8 path(mPath);
+            path.append(name);
+
+            struct stat statbuf;
+            if (stat(path.string(), &statbuf) == 0) {
+                item.mStatted = true;
+                item.mModified = statbuf.st_mtime;
+                item.mSize = statbuf.st_size;
+
+                // If the type is unknown, stat() tells it instead.
+                // This is sometimes necessary when accessing NFS mounted
+                // filesystems, but could be needed in other cases well.
+                if (item.mType == DT_UNKNOWN) {
+                    if (S_ISREG(statbuf.st_mode)) {
+                        item.mType = DT_REG;
+                    } else if (S_ISDIR(statbuf.st_mode)) {
+                        item.mType = DT_DIR;
+                    }
+                }
+            } else if (item.mType == DT_UNKNOWN) {
+                ALOGD("stat() failed for %s: %s", path.string(), strerror(errno));
+            }
+        }
+
+        mEntries.push_back(item);
+    }
+    closedir(dir);
+}
+
+// The directories are listed in the order the scan walks the tree: those
+// of the directory the scan enters go to the front of the queue, ahead of
+// the siblings of that directory, which the scan reaches after them.
+struct MediaScanner::DirectoryPrefetcher {
+    DirectoryPrefetcher(size_t numThreads);
+    ~DirectoryPrefetcher();
+
+    void prefetch(const Vector<String8> &paths);
+
+    // The listing of path, waiting for it if it is being listed. NULL if
+    // no thread has picked it up, the scan then lists it itself.
+    sp<DirectoryListing> take(const char *path);
+
+private:
+    Mutex mLock;
+    Condition mQueueCondition;
+    Condition mListedCondition;
+    List<sp<DirectoryListing> > mQueue;
+    KeyedVector<String8, sp<DirectoryListing> > mListings;
+    Vector<pthread_t> mThreads;
+    bool mDone;
+
+    static void *ThreadWrapper(void *me);
+    void threadEntry();
+
+    DirectoryPrefetcher(const DirectoryPrefetcher &);
+    DirectoryPrefetcher &operator=(const DirectoryPrefetcher &);
+};
+
+MediaScanner::DirectoryPrefetcher::DirectoryPrefetcher(size_t numThreads)
+    : mDone(false) {
+    for (size_t i = 0; i < numThreads; ++i) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, ThreadWrapper, this) == 0) {
+            mThreads.push_back(thread);
+        }
+    }
+}
+
+MediaScanner::DirectoryPrefetcher::~DirectoryPrefetcher() {
+    {
+        Mutex::Autolock autoLock(mLock);
+        mDone = true;
+        mQueueCondition.broadcast();
+    }
+
+    for (size_t i = 0; i < mThreads.size(); ++i) {
+        void *dummy;
+        pthread_join(mThreads[i], &dummy);
+    }
+}
+
+void MediaScanner::DirectoryPrefetcher::prefetch(const Vector<String8> &paths) {
+    Mutex::Autolock autoLock(mLock);
+
+    // leaving out the last ones past the limit, the scan reaches them last
+    size_t count = paths.size();
+    if (mListings.size() + count > kMaxPrefetchedDirectories) {
+        count = mListings.size() < kMaxPrefetchedDirectories
+            ? kMaxPrefetchedDirectories - mListings.size() : 0;
+    }
+
+    // last to first, for the first one to end up at the front
+    for (size_t i = count; i > 0; --i) {
+        if (mListings.indexOfKey(paths[i - 1]) >= 0) {
+            continue;
+        }
+
+        sp<DirectoryListing> listing = new DirectoryListing(paths[i - 1].string());
+        mListings.add(paths[i - 1], listing);
+        mQueue.push_front(listing);
+    }
+
+    mQueueCondition.broadcast();
+}
+
+sp<MediaScanner::DirectoryListing> MediaScanner::DirectoryPrefetcher::take(
+        const char *path) {
+    Mutex::Autolock autoLock(mLock);
+
+    ssize_t index = mListings.indexOfKey(String8(path));
+    if (index < 0) {
+        return NULL;
+    }
+
+    sp<DirectoryListing> listing = mListings.valueAt(index);
+    mListings.removeItemsAt(index);
+
+    if (listing->mState == DirectoryListing::PENDING) {
+        for (List<sp<DirectoryListing> >::iterator it = mQueue.begin();
+                it != mQueue.end(); ++it) {
+            if (*it == listing) {
+                mQueue.erase(it);
+                break;
+            }
+        }
+        return NULL;
+    }
+
+    while (listing->mState != DirectoryListing::LISTED) {
+        mListedCondition.wait(mLock);
+    }
+    return listing;
+}
+
+// static
+void *MediaScanner::DirectoryPrefetcher::ThreadWrapper(void *me) {
+    static_cast<DirectoryPrefetcher *>(me)->threadEntry();
+    return NULL;
+}
+
+void MediaScanner::DirectoryPrefetcher::threadEntry() {
+    Mutex::Autolock autoLock(mLock);
+
+    for (;;) {
+        while (!mDone && mQueue.empty()) {
+            mQueueCondition.wait(mLock);
+        }
+        if (mDone) {
+            break;
+        }
+
+        sp<DirectoryListing> listing = *mQueue.begin();
+        mQueue.erase(mQueue.begin());
+        listing->mState = DirectoryListing::LISTING;
+
+        mLock.unlock();
+        listing->list();
+        mLock.lock();
+
+        listing->mState = DirectoryListing::LISTED;
+        mListedCondition.broadcast();
+    }
+}
+
+// A directory walk mostly waits on the storage, on FUSE emulated storage and
+// SD cards particularly: one thread per core, up to kMaxPrefetchThreads,
+// keeps a few listings in flight. media.scanner.threads overrides it, 0
+// listing every directory on the scanning thread as before.
+static size_t NumPrefetchThreads() {
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("media.scanner.threads", value, NULL)) {
+        long numThreads = strtol(value, NULL, 10);
+        if (numThreads < 0) {
+            return 0;
+        }
+        return numThreads > kMaxPrefetchThreads ? kMaxPrefetchThreads : numThreads;
+    }
+
+    long numCores = sysconf(_SC_NPROCESSORS_ONLN);
+    if (numCores <= 1) {
+        return 0;
+    }
+    return numCores > kMaxPrefetchThreads ? kMaxPrefetchThreads : numCores;
+}
+
 MediaScanner::MediaScanner()
-    : mLocale(NULL), mSkipList(NULL), mSkipIndex(NULL) {
+    : mLocale(NULL), mSkipList(NULL), mSkipIndex(NULL), mPrefetcher(NULL) {
     loadSkipList();
 }
 
@@ -99,14 +358,22 @@ MediaScanResult MediaScanner::processDirectory(
 
     client.setLocale(locale());
 
+    size_t numThreads = NumPrefetchThreads();
+    if (numThreads > 0) {
+        mPrefetcher = new DirectoryPrefetcher(numThreads);
+    }
+
     MediaScanResult result = doProcessDirectory(pathBuffer, pathRemaining, client, false);
 
+    delete mPrefetcher;
+    mPrefetcher = NULL;
+
     free(pathBuffer);
 
     return result;
 }
 
-bool MediaScanner::shouldSkipDirectory(char *path) {
+bool MediaScanner::shouldSkipDirectory(const char *path) {
     if (path && mSkipList && mSkipIndex) {
         int len = strlen(path);
         int idx = 0;
@@ -132,53 +399,65 @@ MediaScanResult MediaScanner::doProcessDirectory(
         char *path, int pathRemaining, MediaScannerClient &client, bool noMedia) {
     // place to copy file or directory name
     char* fileSpot = path + strlen(path);
-    struct dirent* entry;
 
     if (shouldSkipDirectory(path)) {
         ALOGD("Skipping: %s", path);
         return MEDIA_SCAN_RESULT_OK;
     }
 
-    // Treat all files as non-media in directories that contain a  ".nomedia" file
-    if (pathRemaining >= 8 /* strlen(".nomedia") */ ) {
-        strcpy(fileSpot, ".nomedia");
-        if (access(path, F_OK) == 0) {
-            ALOGV("found .nomedia, setting noMedia flag");
-            noMedia = true;
-        }
+    sp<DirectoryListing> listing;
+    if (mPrefetcher != NULL) {
+        listing = mPrefetcher->take(path);
+    }
+    if (listing == NULL) {
+        listing = new DirectoryListing(path);
+        listing->list();
+    }
 
-        // restore path
-        fileSpot[0] = 0;
+    // Treat all files as non-media in directories that contain a  ".nomedia" file
+    if (pathRemaining >= 8 /* strlen(".nomedia") */ && listing->mHasNoMediaFile) {
+        ALOGV("found .nomedia, setting noMedia flag");
+        noMedia = true;
     }
 
-    DIR* dir = opendir(path);
-    if (!dir) {
-        ALOGW("Error opening directory '%s', skipping: %s.", path, strerror(errno));
+    if (listing->mError != 0) {
+        ALOGW("Error opening directory '%s', skipping: %s.", path, strerror(listing->mError));
         return MEDIA_SCAN_RESULT_SKIPPED;
     }
 
-    MediaScanResult result = MEDIA_SCAN_RESULT_OK;
-    while ((entry = readdir(dir))) {
-        if (doProcessDirectoryEntry(path, pathRemaining, client, noMedia, entry, fileSpot)
+    if (mPrefetcher != NULL) {
+        Vector<String8> subdirectories;
+        for (size_t i = 0; i < listing->mEntries.size(); ++i) {
+            const DirectoryEntry &entry = listing->mEntries[i];
+            if (entry.mType != DT_DIR
+                    || (int)entry.mName.length() + 1 > pathRemaining) {
+                continue;
+            }
+
+            String8 subdirectory(path);
+            subdirectory.append(entry.mName);
+            subdirectory.append("/");
+            if (!shouldSkipDirectory(subdirectory.string())) {
+                subdirectories.push_back(subdirectory);
+            }
+        }
+        mPrefetcher->prefetch(subdirectories);
+    }
+
+    for (size_t i = 0; i < listing->mEntries.size(); ++i) {
+        if (doProcessDirectoryEntry(path, pathRemaining, client, noMedia,
+                    listing->mEntries[i], fileSpot)
                 == MEDIA_SCAN_RESULT_ERROR) {
-            result = MEDIA_SCAN_RESULT_ERROR;
-            break;
+            return MEDIA_SCAN_RESULT_ERROR;
         }
     }
-    closedir(dir);
-    return result;
+    return MEDIA_SCAN_RESULT_OK;
 }
 
 MediaScanResult MediaScanner::doProcessDirectoryEntry(
         char *path, int pathRemaining, MediaScannerClient &client, bool noMedia,
-        struct dirent* entry, char* fileSpot) {
-    struct stat statbuf;
-    const char* name = entry->d_name;
-
-    // ignore "." and ".."
-    if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) {
-        return MEDIA_SCAN_RESULT_SKIPPED;
-    }
+        const DirectoryEntry &entry, char* fileSpot) {
+    const char* name = entry.mName.string();
 
     int nameLength = strlen(name);
     if (nameLength + 1 > pathRemaining) {
@@ -187,21 +466,8 @@ MediaScanResult MediaScanner::doProcessDirectoryEntry(
     }
     strcpy(fileSpot, name);
 
-    int type = entry->d_type;
-    if (type == DT_UNKNOWN) {
-        // If the type is unknown, stat() the file instead.
-        // This is sometimes necessary when accessing NFS mounted filesystems, but
-        // could be needed in other cases well.
-        if (stat(path, &statbuf) == 0) {
-            if (S_ISREG(statbuf.st_mode)) {
-                type = DT_REG;
-            } else if (S_ISDIR(statbuf.st_mode)) {
-                type = DT_DIR;
-            }
-        } else {
-            ALOGD("stat() failed for %s: %s", path, strerror(errno) );
-        }
-    }
+    // DT_UNKNOWN resolved by the stat() of DirectoryListing::list()
+    int type = entry.mType;
     if (type == DT_DIR) {
         bool childNoMedia = noMedia;
         // set noMedia flag on directories with a name that starts with '.'
@@ -210,8 +476,8 @@ MediaScanResult MediaScanner::doProcessDirectoryEntry(
             childNoMedia = true;
 
         // report the directory to the client
-        if (stat(path, &statbuf) == 0) {
-            status_t status = client.scanFile(path, statbuf.st_mtime, 0,
+        if (entry.mStatted) {
+            status_t status = client.scanFile(path, entry.mModified, 0,
                     true /*isDirectory*/, childNoMedia);
             if (status) {
                 return MEDIA_SCAN_RESULT_ERROR;
@@ -226,8 +492,7 @@ MediaScanResult MediaScanner::doProcessDirectoryEntry(
             return MEDIA_SCAN_RESULT_ERROR;
         }
     } else if (type == DT_REG) {
-        stat(path, &statbuf);
-        status_t status = client.scanFile(path, statbuf.st_mtime, statbuf.st_size,
+        status_t status = client.scanFile(path, entry.mModified, entry.mSize,
                 false /*isDirectory*/, noMedia);
         if (status) {
             return MEDIA_SCAN_RESULT_ERROR;
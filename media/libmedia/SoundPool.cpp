@@ -18,16 +18,23 @@
 #define LOG_TAG "SoundPool"
 
 #include <inttypes.h>
+#include <stdlib.h>
+#include <sys/stat.h>
 
 #include <utils/Log.h>
+#include <cutils/properties.h>
 
 #define USE_SHARED_MEM_BUFFER
 
+#include <media/AudioSystem.h>
 #include <media/AudioTrack.h>
+#include <media/IAudioFlinger.h>
 #include <media/IMediaHTTPService.h>
 #include <media/mediaplayer.h>
 #include <media/SoundPool.h>
 #include "SoundPoolThread.h"
+#include "SoundPoolCache.h"
+#include "SoundPoolMixer.h"
 #include <media/AudioPolicyHelper.h>
 
 namespace android
@@ -38,6 +45,7 @@ uint32_t kMaxSampleRate = 48000;
 uint32_t kDefaultSampleRate = 44100;
 uint32_t kDefaultFrameCount = 1200;
 size_t kDefaultHeapSize = 1024 * 1024; // 1MB
+size_t kDefaultDecodeThreadCount = 2;
 
 
 SoundPool::SoundPool(int maxChannels, const audio_attributes_t* pAttributes)
@@ -57,6 +65,8 @@ SoundPool::SoundPool(int maxChannels, const audio_attributes_t* pAttributes)
 
     mQuit = false;
     mDecodeThread = 0;
+    mCache = 0;
+    mMixer = 0;
     memcpy(&mAttributes, pAttributes, sizeof(audio_attributes_t));
     mAllocated = 0;
     mNextSampleID = 0;
@@ -71,6 +81,15 @@ SoundPool::SoundPool(int maxChannels, const audio_attributes_t* pAttributes)
         mChannels.push_back(&mChannelPool[i]);
     }
 
+    // optionally mix all channels into one track rather than one track per channel
+    char value[PROPERTY_VALUE_MAX];
+    char *endptr;
+    if (property_get("media.soundpool.mixer", value, NULL) > 0 &&
+            strtoul(value, &endptr, 0) != 0 && *endptr == '\0') {
+        ALOGV("mixing %d channels client side", mMaxChannels);
+        mMixer = new SoundPoolMixer(this, mChannelPool, mMaxChannels);
+    }
+
     // start decode thread
     startThreads();
 }
@@ -86,12 +105,15 @@ SoundPool::~SoundPool()
     mChannels.clear();
     if (mChannelPool)
         delete [] mChannelPool;
+    // after the channels, which stop their voices when destroyed
+    delete mMixer;
     // clean up samples
     ALOGV("clear samples");
     mSamples.clear();
 
     if (mDecodeThread)
         delete mDecodeThread;
+    delete mCache;
 }
 
 void SoundPool::addToRestartList(SoundChannel* channel)
@@ -178,11 +200,39 @@ void SoundPool::quit()
 bool SoundPool::startThreads()
 {
     createThreadEtc(beginThread, this, "SoundPool");
-    if (mDecodeThread == NULL)
-        mDecodeThread = new SoundPoolThread(this);
+    if (mDecodeThread == NULL) {
+        // decoding happens in mediaserver, so a few threads hide most of the IPC
+        // and disk latency of loading many samples
+        size_t threadCount = kDefaultDecodeThreadCount;
+        char value[PROPERTY_VALUE_MAX];
+        if (property_get("media.soundpool.decoders", value, NULL) > 0) {
+            char *endptr;
+            unsigned long count = strtoul(value, &endptr, 0);
+            if (*endptr == '\0' && count > 0) {
+                threadCount = count;
+            }
+        }
+        mDecodeThread = new SoundPoolThread(this, threadCount);
+    }
     return mDecodeThread != NULL;
 }
 
+status_t SoundPool::setCacheDirectory(const char* directory)
+{
+    ALOGV("setCacheDirectory: %s", directory);
+    Mutex::Autolock lock(&mLock);
+    // decoder threads read mCache without the lock
+    if (mCache != NULL || mNextSampleID != 0) {
+        return INVALID_OPERATION;
+    }
+    struct stat st;
+    if (directory == NULL || stat(directory, &st) != 0 || !S_ISDIR(st.st_mode)) {
+        return BAD_VALUE;
+    }
+    mCache = new SoundPoolCache(directory);
+    return NO_ERROR;
+}
+
 SoundChannel* SoundPool::findChannel(int channelID)
 {
     for (int i = 0; i < mMaxChannels; ++i) {
@@ -491,12 +541,32 @@ Sample::~Sample()
     free(mUrl);
 }
 
-status_t Sample::doLoad()
+status_t Sample::doLoad(const SoundPoolCache* cache)
 {
     uint32_t sampleRate;
     int numChannels;
     audio_format_t format;
     status_t status;
+    String8 key;
+    bool cacheable = false;
+
+    if (cache != NULL) {
+        // the key is taken before the descriptor is closed
+        cacheable = mUrl ? SoundPoolCache::makeKey(mUrl, &key)
+                : SoundPoolCache::makeKey(mFd, mOffset, mLength, &key);
+        if (cacheable && cache->lookup(key, &mHeap, &mSize, &sampleRate, &numChannels,
+                &format) == NO_ERROR) {
+            ALOGV("Sample %d loaded from cache", mSampleID);
+            if (mFd >= 0) {
+                ::close(mFd);
+                mFd = -1;
+            }
+            // an entry is only stored once it passed the checks below
+            cacheable = false;
+            goto loaded;
+        }
+    }
+
     mHeap = new MemoryHeapBase(kDefaultHeapSize);
 
     ALOGV("Start decode");
@@ -520,6 +590,7 @@ status_t Sample::doLoad()
         ALOGE("Unable to load sample: %s", mUrl);
         goto error;
     }
+loaded:
     ALOGV("pointer = %p, size = %zu, sampleRate = %u, numChannels = %d",
           mHeap->getBase(), mSize, sampleRate, numChannels);
 
@@ -535,7 +606,12 @@ status_t Sample::doLoad()
         goto error;
     }
 
+    if (cacheable) {
+        cache->store(key, mHeap, mSize, sampleRate, numChannels, format);
+    }
+
     mData = new MemoryBase(mHeap, 0, mSize);
+    shareData();
     mSampleRate = sampleRate;
     mNumChannels = numChannels;
     mFormat = format;
@@ -547,12 +623,34 @@ error:
     return status;
 }
 
+// Plays the copy AudioFlinger shares with the other processes which loaded the same sound, such
+// as the UI sound effects, instead of a decoded copy per process.
+void Sample::shareData()
+{
+    const sp<IAudioFlinger>& af = AudioSystem::get_audio_flinger();
+    if (af == 0) {
+        return;
+    }
+    sp<IMemory> shared = af->shareStaticBuffer(mData);
+    if (shared == 0) {
+        return;
+    }
+    ALOGV("Sample %d shared, %zu bytes", mSampleID, mSize);
+    mData = shared;
+    // only the cache, if this sample is in it, still holds the decoded copy
+    mHeap.clear();
+}
 
 void SoundChannel::init(SoundPool* soundPool)
 {
     mSoundPool = soundPool;
 }
 
+SoundPoolMixer* SoundChannel::mixer()
+{
+    return mSoundPool->mMixer;
+}
+
 // call with sound pool lock held
 void SoundChannel::play(const sp<Sample>& sample, int nextChannelID, float leftVolume,
         float rightVolume, int priority, int loop, float rate)
@@ -577,6 +675,25 @@ void SoundChannel::play(const sp<Sample>& sample, int nextChannelID, float leftV
             return;
         }
 
+        if (mixer() != NULL) {
+            if (mixer()->start(this, sample, leftVolume, rightVolume, loop, rate) != NO_ERROR) {
+                ALOGE("Error starting mixer voice");
+                return;
+            }
+            mPos = 0;
+            mSample = sample;
+            mChannelID = nextChannelID;
+            mPriority = priority;
+            mLoop = loop;
+            mLeftVolume = leftVolume;
+            mRightVolume = rightVolume;
+            mNumChannels = sample->numChannels();
+            mRate = rate;
+            clearNextEvent();
+            mState = PLAYING;
+            return;
+        }
+
         // initialize track
         size_t afFrameCount;
         uint32_t afSampleRate;
@@ -776,7 +893,11 @@ bool SoundChannel::doStop_l()
     if (mState != IDLE) {
         setVolume_l(0, 0);
         ALOGV("stop");
-        mAudioTrack->stop();
+        if (mixer() != NULL) {
+            mixer()->stop(this);
+        } else {
+            mAudioTrack->stop();
+        }
         mSample.clear();
         mState = IDLE;
         mPriority = IDLE_PRIORITY;
@@ -814,7 +935,11 @@ void SoundChannel::pause()
     if (mState == PLAYING) {
         ALOGV("pause track");
         mState = PAUSED;
-        mAudioTrack->pause();
+        if (mixer() != NULL) {
+            mixer()->pause(this);
+        } else {
+            mAudioTrack->pause();
+        }
     }
 }
 
@@ -825,7 +950,11 @@ void SoundChannel::autoPause()
         ALOGV("pause track");
         mState = PAUSED;
         mAutoPaused = true;
-        mAudioTrack->pause();
+        if (mixer() != NULL) {
+            mixer()->pause(this);
+        } else {
+            mAudioTrack->pause();
+        }
     }
 }
 
@@ -836,7 +965,11 @@ void SoundChannel::resume()
         ALOGV("resume track");
         mState = PLAYING;
         mAutoPaused = false;
-        mAudioTrack->start();
+        if (mixer() != NULL) {
+            mixer()->resume(this);
+        } else {
+            mAudioTrack->start();
+        }
     }
 }
 
@@ -847,14 +980,21 @@ void SoundChannel::autoResume()
         ALOGV("resume track");
         mState = PLAYING;
         mAutoPaused = false;
-        mAudioTrack->start();
+        if (mixer() != NULL) {
+            mixer()->resume(this);
+        } else {
+            mAudioTrack->start();
+        }
     }
 }
 
 void SoundChannel::setRate(float rate)
 {
     Mutex::Autolock lock(&mLock);
-    if (mAudioTrack != NULL && mSample != 0) {
+    if (mixer() != NULL) {
+        mixer()->setRate(this, rate);
+        mRate = rate;
+    } else if (mAudioTrack != NULL && mSample != 0) {
         uint32_t sampleRate = uint32_t(float(mSample->sampleRate()) * rate + 0.5);
         mAudioTrack->setSampleRate(sampleRate);
         mRate = rate;
@@ -866,7 +1006,9 @@ void SoundChannel::setVolume_l(float leftVolume, float rightVolume)
 {
     mLeftVolume = leftVolume;
     mRightVolume = rightVolume;
-    if (mAudioTrack != NULL)
+    if (mixer() != NULL)
+        mixer()->setVolume(this, leftVolume, rightVolume);
+    else if (mAudioTrack != NULL)
         mAudioTrack->setVolume(leftVolume, rightVolume);
 }
 
@@ -879,7 +1021,10 @@ void SoundChannel::setVolume(float leftVolume, float rightVolume)
 void SoundChannel::setLoop(int loop)
 {
     Mutex::Autolock lock(&mLock);
-    if (mAudioTrack != NULL && mSample != 0) {
+    if (mixer() != NULL) {
+        mixer()->setLoop(this, loop);
+        mLoop = loop;
+    } else if (mAudioTrack != NULL && mSample != 0) {
         uint32_t loopEnd = mSample->size()/mNumChannels/
             ((mSample->format() == AUDIO_FORMAT_PCM_16_BIT) ? sizeof(int16_t) : sizeof(uint8_t));
         mAudioTrack->setLoop(0, loopEnd, loop);
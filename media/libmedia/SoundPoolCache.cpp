@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "SoundPoolCache"
+#include <utils/Log.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "SoundPoolCache.h"
+
+namespace android {
+
+static const uint32_t kCacheMagic = 0x53504331; // 'SPC1'
+static const uint32_t kCacheVersion = 1;
+// offset of the PCM in an entry, a multiple of the page size so that it can be mapped
+static const size_t kCacheDataOffset = 4096;
+// cap on an entry, the size of the heap samples are decoded in
+static const size_t kCacheMaxSize = 1024 * 1024;
+
+struct CacheHeader {
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    sampleRate;
+    uint32_t    numChannels;
+    uint32_t    format;
+    uint32_t    keyLength;
+    uint64_t    size;
+    // followed by the key, not NUL terminated
+};
+
+SoundPoolCache::SoundPoolCache(const char* directory) :
+    mDirectory(directory)
+{
+}
+
+bool SoundPoolCache::makeKey(const char* url, String8* key)
+{
+    // only local files have a modification time
+    if (url == NULL || url[0] != '/') {
+        return false;
+    }
+    struct stat st;
+    if (stat(url, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    key->setTo(String8::format("%s:%" PRId64 ":%" PRId64,
+            url, (int64_t)st.st_size, (int64_t)st.st_mtime));
+    return true;
+}
+
+bool SoundPoolCache::makeKey(int fd, int64_t offset, int64_t length, String8* key)
+{
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    key->setTo(String8::format("fd:%" PRIu64 ":%" PRIu64 ":%" PRId64 ":%" PRId64 ":%" PRId64
+            ":%" PRId64, (uint64_t)st.st_dev, (uint64_t)st.st_ino, (int64_t)st.st_size,
+            (int64_t)st.st_mtime, offset, length));
+    return true;
+}
+
+String8 SoundPoolCache::entryPath(const String8& key) const
+{
+    // 64-bit FNV-1a, collisions are caught by comparing the key stored in the entry
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < key.length(); i++) {
+        hash ^= (uint8_t)key.string()[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return String8::format("%s/%016" PRIx64 ".pcm", mDirectory.string(), hash);
+}
+
+static bool readFully(int fd, void* buffer, size_t size)
+{
+    uint8_t* p = (uint8_t*)buffer;
+    while (size > 0) {
+        ssize_t ret = read(fd, p, size);
+        if (ret <= 0) {
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += ret;
+        size -= ret;
+    }
+    return true;
+}
+
+static bool writeFully(int fd, const void* buffer, size_t size)
+{
+    const uint8_t* p = (const uint8_t*)buffer;
+    while (size > 0) {
+        ssize_t ret = write(fd, p, size);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        p += ret;
+        size -= ret;
+    }
+    return true;
+}
+
+status_t SoundPoolCache::lookup(const String8& key, sp<MemoryHeapBase>* heap, size_t* size,
+        uint32_t* sampleRate, int* numChannels, audio_format_t* format) const
+{
+    String8 path = entryPath(key);
+    int fd = open(path.string(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return NAME_NOT_FOUND;
+    }
+
+    status_t status = BAD_VALUE;
+    CacheHeader header;
+    struct stat st;
+    char stored[kCacheDataOffset];
+    if (!readFully(fd, &header, sizeof(header)) ||
+            header.magic != kCacheMagic || header.version != kCacheVersion ||
+            header.keyLength != key.length() ||
+            header.keyLength > kCacheDataOffset - sizeof(header) ||
+            header.size == 0 || header.size > kCacheMaxSize ||
+            fstat(fd, &st) != 0 ||
+            (uint64_t)st.st_size < kCacheDataOffset + header.size ||
+            !readFully(fd, stored, header.keyLength) ||
+            memcmp(stored, key.string(), header.keyLength) != 0) {
+        ALOGW("lookup: ignoring stale or invalid entry %s", path.string());
+        goto exit;
+    }
+
+    // the heap duplicates the descriptor
+    *heap = new MemoryHeapBase(fd, header.size, MemoryHeapBase::READ_ONLY, kCacheDataOffset);
+    if ((*heap)->getHeapID() < 0 || (*heap)->getBase() == MAP_FAILED) {
+        ALOGE("lookup: cannot map %s", path.string());
+        heap->clear();
+        status = NO_MEMORY;
+        goto exit;
+    }
+    *size = header.size;
+    *sampleRate = header.sampleRate;
+    *numChannels = header.numChannels;
+    *format = (audio_format_t)header.format;
+    ALOGV("lookup: hit %s, size %zu", path.string(), *size);
+    status = NO_ERROR;
+
+exit:
+    close(fd);
+    return status;
+}
+
+void SoundPoolCache::store(const String8& key, const sp<MemoryHeapBase>& heap, size_t size,
+        uint32_t sampleRate, int numChannels, audio_format_t format) const
+{
+    if (size == 0 || size > kCacheMaxSize || key.length() > kCacheDataOffset - sizeof(CacheHeader)) {
+        return;
+    }
+    String8 path = entryPath(key);
+    String8 temp = path + ".XXXXXX";
+    char* name = temp.lockBuffer(temp.length());
+    int fd = mkstemp(name);
+    temp.unlockBuffer();
+    if (fd < 0) {
+        ALOGW("store: cannot create entry in %s: %s", mDirectory.string(), strerror(errno));
+        return;
+    }
+
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = kCacheMagic;
+    header.version = kCacheVersion;
+    header.sampleRate = sampleRate;
+    header.numChannels = numChannels;
+    header.format = format;
+    header.keyLength = key.length();
+    header.size = size;
+    bool written = writeFully(fd, &header, sizeof(header)) &&
+            writeFully(fd, key.string(), key.length()) &&
+            lseek(fd, kCacheDataOffset, SEEK_SET) == (off_t)kCacheDataOffset &&
+            writeFully(fd, heap->getBase(), size);
+    if (close(fd) != 0) {
+        written = false;
+    }
+    if (!written || rename(temp.string(), path.string()) != 0) {
+        ALOGW("store: cannot write %s: %s", path.string(), strerror(errno));
+        unlink(temp.string());
+        return;
+    }
+    ALOGV("store: %s, size %zu", path.string(), size);
+}
+
+} // end namespace android
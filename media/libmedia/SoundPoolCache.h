@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SOUNDPOOLCACHE_H_
+#define SOUNDPOOLCACHE_H_
+
+#include <utils/String8.h>
+#include <binder/MemoryHeapBase.h>
+#include <system/audio.h>
+
+namespace android {
+
+/*
+ * On-disk cache of decoded samples.
+ *
+ * Each entry is a file holding a header and the decoded PCM at a page aligned
+ * offset, so that a hit is mapped read-only into a MemoryHeapBase and shared as is
+ * with AudioFlinger instead of being decoded again. Entries are keyed by the source
+ * path, or device and inode for a file descriptor, and its modification time, so
+ * that an edited source misses. Entries are written to a temporary file and renamed,
+ * so concurrent decoders and processes never see a partial entry.
+ *
+ * The cache does not evict: the directory is expected to be one the system trims,
+ * such as the application cache directory. All methods are thread safe.
+ */
+class SoundPoolCache {
+public:
+    SoundPoolCache(const char* directory);
+
+    // Returns the key of a source, or false if the source cannot be cached.
+    static bool makeKey(const char* url, String8* key);
+    static bool makeKey(int fd, int64_t offset, int64_t length, String8* key);
+
+    // Maps the entry of key, returns NO_ERROR on a hit.
+    status_t lookup(const String8& key, sp<MemoryHeapBase>* heap, size_t* size,
+            uint32_t* sampleRate, int* numChannels, audio_format_t* format) const;
+
+    // Stores the first size bytes of heap as the entry of key.
+    void store(const String8& key, const sp<MemoryHeapBase>& heap, size_t size,
+            uint32_t sampleRate, int numChannels, audio_format_t format) const;
+
+private:
+    String8 entryPath(const String8& key) const;
+
+    const String8 mDirectory;
+};
+
+} // end namespace android
+
+#endif /*SOUNDPOOLCACHE_H_*/
@@ -0,0 +1,365 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "SoundPoolMixer"
+#include <utils/Log.h>
+
+#include <string.h>
+
+#include <audio_utils/primitives.h>
+#include <media/AudioSystem.h>
+#include <media/AudioPolicyHelper.h>
+
+#include "SoundPoolMixer.h"
+
+#if defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+namespace android {
+
+static const uint64_t kUnityStep = 1ULL << 32;
+static const uint32_t kDefaultMixerSampleRate = 44100;
+
+SoundPoolMixer::SoundPoolMixer(SoundPool* soundPool, SoundChannel* channels, int channelCount) :
+    mSoundPool(soundPool), mChannels(channels), mChannelCount(channelCount),
+    mSampleRate(0), mStarted(false)
+{
+    mVoices = new Voice[mChannelCount];
+}
+
+SoundPoolMixer::~SoundPoolMixer()
+{
+    ALOGV("SoundPoolMixer destructor");
+    // do not hold mLock: clearing the track waits for the callback thread to exit
+    if (mAudioTrack != 0) {
+        mAudioTrack->stop();
+        mAudioTrack.clear();
+    }
+    delete [] mVoices;
+}
+
+status_t SoundPoolMixer::createTrack()
+{
+    audio_stream_type_t streamType = audio_attributes_to_stream_type(mSoundPool->attributes());
+    if (AudioSystem::getOutputSamplingRate(&mSampleRate, streamType) != NO_ERROR) {
+        mSampleRate = kDefaultMixerSampleRate;
+    }
+    // the fast flag is only a request, AudioFlinger falls back to a normal track
+    // when no fast track is available
+    sp<AudioTrack> track = new AudioTrack(streamType, mSampleRate, AUDIO_FORMAT_PCM_16_BIT,
+            AUDIO_CHANNEL_OUT_STEREO, 0 /*frameCount*/, AUDIO_OUTPUT_FLAG_FAST, callback, this);
+    status_t status = track->initCheck();
+    if (status != NO_ERROR) {
+        ALOGE("Error creating mixer AudioTrack: %d", status);
+        return status;
+    }
+    ALOGV("mixer track %p, sample rate %u, frame count %zu",
+            track.get(), mSampleRate, track->frameCount());
+    mAudioTrack = track;
+    mStarted = false;
+    return NO_ERROR;
+}
+
+uint64_t SoundPoolMixer::stepFor(const sp<Sample>& sample, float rate) const
+{
+    double step = (double)sample->sampleRate() * rate / mSampleRate;
+    if (step <= 0.) {
+        step = 1.;
+    }
+    return (uint64_t)(step * kUnityStep + 0.5);
+}
+
+SoundPoolMixer::Voice* SoundPoolMixer::voiceFor(SoundChannel* channel)
+{
+    int index = channel - mChannels;
+    LOG_ALWAYS_FATAL_IF(index < 0 || index >= mChannelCount, "channel %p not in pool", channel);
+    return &mVoices[index];
+}
+
+status_t SoundPoolMixer::start(SoundChannel* channel, const sp<Sample>& sample,
+        float leftVolume, float rightVolume, int loop, float rate)
+{
+    if (sample->format() != AUDIO_FORMAT_PCM_16_BIT && sample->format() != AUDIO_FORMAT_PCM_8_BIT) {
+        ALOGE("Sample format %#x not supported by the mixer", sample->format());
+        return BAD_VALUE;
+    }
+    if (mAudioTrack == 0) {
+        status_t status = createTrack();
+        if (status != NO_ERROR) {
+            return status;
+        }
+    }
+    size_t frameSize = sample->numChannels() *
+            (sample->format() == AUDIO_FORMAT_PCM_16_BIT ? sizeof(int16_t) : sizeof(uint8_t));
+    {
+        Mutex::Autolock lock(&mLock);
+        Voice* voice = voiceFor(channel);
+        voice->mSample = sample;
+        voice->mFrames = sample->size() / frameSize;
+        voice->mPosition = 0;
+        voice->mStep = stepFor(sample, rate);
+        voice->mLeftVolume = leftVolume;
+        voice->mRightVolume = rightVolume;
+        voice->mLoop = loop;
+        voice->mPaused = false;
+        voice->mActive = voice->mFrames != 0;
+    }
+    updateTrack();
+    return NO_ERROR;
+}
+
+void SoundPoolMixer::stop(SoundChannel* channel)
+{
+    sp<Sample> sample;
+    {
+        Mutex::Autolock lock(&mLock);
+        Voice* voice = voiceFor(channel);
+        voice->mActive = false;
+        // released outside the lock, it may be the last reference
+        sample = voice->mSample;
+        voice->mSample.clear();
+    }
+    updateTrack();
+}
+
+void SoundPoolMixer::pause(SoundChannel* channel)
+{
+    {
+        Mutex::Autolock lock(&mLock);
+        voiceFor(channel)->mPaused = true;
+    }
+    updateTrack();
+}
+
+void SoundPoolMixer::resume(SoundChannel* channel)
+{
+    {
+        Mutex::Autolock lock(&mLock);
+        voiceFor(channel)->mPaused = false;
+    }
+    updateTrack();
+}
+
+void SoundPoolMixer::setVolume(SoundChannel* channel, float leftVolume, float rightVolume)
+{
+    Mutex::Autolock lock(&mLock);
+    Voice* voice = voiceFor(channel);
+    voice->mLeftVolume = leftVolume;
+    voice->mRightVolume = rightVolume;
+}
+
+void SoundPoolMixer::setRate(SoundChannel* channel, float rate)
+{
+    Mutex::Autolock lock(&mLock);
+    Voice* voice = voiceFor(channel);
+    if (voice->mSample != 0) {
+        voice->mStep = stepFor(voice->mSample, rate);
+    }
+}
+
+void SoundPoolMixer::setLoop(SoundChannel* channel, int loop)
+{
+    Mutex::Autolock lock(&mLock);
+    voiceFor(channel)->mLoop = loop;
+}
+
+void SoundPoolMixer::updateTrack()
+{
+    if (mAudioTrack == 0) {
+        return;
+    }
+    bool playing = false;
+    {
+        Mutex::Autolock lock(&mLock);
+        for (int i = 0; i < mChannelCount; i++) {
+            if (mVoices[i].mActive && !mVoices[i].mPaused) {
+                playing = true;
+                break;
+            }
+        }
+    }
+    // the sound pool lock serializes the calls, so mStarted needs no lock
+    if (playing && !mStarted) {
+        ALOGV("start mixer track");
+        mAudioTrack->start();
+        mStarted = true;
+    } else if (!playing && mStarted) {
+        ALOGV("pause mixer track");
+        mAudioTrack->pause();
+        mStarted = false;
+    }
+}
+
+void SoundPoolMixer::callback(int event, void* user, void *info)
+{
+    SoundPoolMixer* mixer = static_cast<SoundPoolMixer*>(user);
+    if (event == AudioTrack::EVENT_MORE_DATA) {
+        AudioTrack::Buffer* b = static_cast<AudioTrack::Buffer *>(info);
+        mixer->process(b->i16, b->frameCount);
+    } else if (event == AudioTrack::EVENT_UNDERRUN) {
+        ALOGV("mixer track underrun");
+    }
+}
+
+void SoundPoolMixer::process(int16_t* out, size_t frameCount)
+{
+    float mix[kMixFrames * 2];
+    // a pool has at most 32 channels
+    uint32_t ended = 0;
+
+    {
+        Mutex::Autolock lock(&mLock);
+        while (frameCount > 0) {
+            size_t count = frameCount < kMixFrames ? frameCount : kMixFrames;
+            memset(mix, 0, count * 2 * sizeof(float));
+            for (int i = 0; i < mChannelCount; i++) {
+                Voice* voice = &mVoices[i];
+                if (!voice->mActive || voice->mPaused) {
+                    continue;
+                }
+                if (!mixVoice(voice, mix, count)) {
+                    ALOGV("voice %d ended", i);
+                    voice->mActive = false;
+                    ended |= 1u << i;
+                }
+            }
+            memcpy_to_i16_from_float(out, mix, count * 2);
+            out += count * 2;
+            frameCount -= count;
+        }
+    }
+
+    // the channels are stopped by the sound pool thread, like when their own
+    // track reaches the end of its buffer
+    for (int i = 0; ended != 0; i++, ended >>= 1) {
+        if (ended & 1) {
+            mSoundPool->addToStopList(&mChannels[i]);
+        }
+    }
+}
+
+// Mixes count frames of 16-bit input at unity rate, the common case.
+static inline void mixUnity16(const int16_t* in, int channels, float leftVolume,
+        float rightVolume, float* out, size_t count)
+{
+    const float scale = 1.0f / 32768.0f;
+    leftVolume *= scale;
+    rightVolume *= scale;
+    size_t i = 0;
+#if defined(__ARM_NEON__)
+    const float volumes[4] = { leftVolume, rightVolume, leftVolume, rightVolume };
+    const float32x4_t vol = vld1q_f32(volumes);
+    if (channels == 2) {
+        for (; i + 4 <= count; i += 4) {
+            int16x8_t s = vld1q_s16(in + 2 * i);
+            float32x4_t lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(s)));
+            float32x4_t hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(s)));
+            vst1q_f32(out + 2 * i, vmlaq_f32(vld1q_f32(out + 2 * i), lo, vol));
+            vst1q_f32(out + 2 * i + 4, vmlaq_f32(vld1q_f32(out + 2 * i + 4), hi, vol));
+        }
+    } else {
+        for (; i + 4 <= count; i += 4) {
+            float32x4_t m = vcvtq_f32_s32(vmovl_s16(vld1_s16(in + i)));
+            // duplicate each mono sample to left and right
+            float32x4x2_t d = vzipq_f32(m, m);
+            vst1q_f32(out + 2 * i, vmlaq_f32(vld1q_f32(out + 2 * i), d.val[0], vol));
+            vst1q_f32(out + 2 * i + 4, vmlaq_f32(vld1q_f32(out + 2 * i + 4), d.val[1], vol));
+        }
+    }
+#endif
+    if (channels == 2) {
+        for (; i < count; i++) {
+            out[2 * i] += in[2 * i] * leftVolume;
+            out[2 * i + 1] += in[2 * i + 1] * rightVolume;
+        }
+    } else {
+        for (; i < count; i++) {
+            out[2 * i] += in[i] * leftVolume;
+            out[2 * i + 1] += in[i] * rightVolume;
+        }
+    }
+}
+
+// Returns sample c of frame i normalized to [-1.0, 1.0).
+static inline float readSample(const uint8_t* data, bool is16Bit, int channels, uint32_t i,
+        int c)
+{
+    if (is16Bit) {
+        return ((const int16_t*)data)[i * channels + c] * (1.0f / 32768.0f);
+    }
+    return ((int)data[i * channels + c] - 128) * (1.0f / 128.0f);
+}
+
+bool SoundPoolMixer::mixVoice(Voice* voice, float* out, size_t count)
+{
+    const sp<Sample>& sample = voice->mSample;
+    const uint8_t* data = sample->data();
+    const bool is16Bit = sample->format() == AUDIO_FORMAT_PCM_16_BIT;
+    const int channels = sample->numChannels();
+    const uint32_t frames = voice->mFrames;
+
+    while (count > 0) {
+        uint32_t index = voice->mPosition >> 32;
+        if (index >= frames) {
+            if (voice->mLoop == 0) {
+                return false;
+            }
+            voice->mPosition -= (uint64_t)frames << 32;
+            if (voice->mLoop > 0) {
+                voice->mLoop--;
+            }
+            continue;
+        }
+        if (voice->mStep == kUnityStep && is16Bit && (uint32_t)voice->mPosition == 0) {
+            size_t run = frames - index;
+            if (run > count) {
+                run = count;
+            }
+            mixUnity16((const int16_t*)data + index * channels, channels,
+                    voice->mLeftVolume, voice->mRightVolume, out, run);
+            voice->mPosition += (uint64_t)run << 32;
+            out += run * 2;
+            count -= run;
+            continue;
+        }
+
+        // linear interpolation, wrapping to the start when looping
+        uint32_t next = index + 1;
+        if (next >= frames) {
+            next = voice->mLoop != 0 ? 0 : index;
+        }
+        float frac = (uint32_t)voice->mPosition * (1.0f / 4294967296.0f);
+        float left0 = readSample(data, is16Bit, channels, index, 0);
+        float left1 = readSample(data, is16Bit, channels, next, 0);
+        float left = left0 + (left1 - left0) * frac;
+        float right = left;
+        if (channels == 2) {
+            float right0 = readSample(data, is16Bit, channels, index, 1);
+            float right1 = readSample(data, is16Bit, channels, next, 1);
+            right = right0 + (right1 - right0) * frac;
+        }
+        out[0] += left * voice->mLeftVolume;
+        out[1] += right * voice->mRightVolume;
+        out += 2;
+        count--;
+        voice->mPosition += voice->mStep;
+    }
+    return true;
+}
+
+} // end namespace android
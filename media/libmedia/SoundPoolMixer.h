@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SOUNDPOOLMIXER_H_
+#define SOUNDPOOLMIXER_H_
+
+#include <utils/threads.h>
+#include <media/AudioTrack.h>
+
+#include <media/SoundPool.h>
+
+namespace android {
+
+/*
+ * Mixes the channels of a SoundPool client side into a single stereo AudioTrack,
+ * instead of one AudioTrack per channel, so that a pool only takes one track, and
+ * one fast track slot, in AudioFlinger. Each channel has a voice that plays its
+ * sample with linear interpolation at the requested rate, and its own volume and
+ * loop count.
+ *
+ * The control methods are called with the sound pool lock held, the mix runs on
+ * the AudioTrack callback thread.
+ */
+class SoundPoolMixer {
+public:
+    SoundPoolMixer(SoundPool* soundPool, SoundChannel* channels, int channelCount);
+    ~SoundPoolMixer();
+
+    status_t start(SoundChannel* channel, const sp<Sample>& sample, float leftVolume,
+            float rightVolume, int loop, float rate);
+    void stop(SoundChannel* channel);
+    void pause(SoundChannel* channel);
+    void resume(SoundChannel* channel);
+    void setVolume(SoundChannel* channel, float leftVolume, float rightVolume);
+    void setRate(SoundChannel* channel, float rate);
+    void setLoop(SoundChannel* channel, int loop);
+
+private:
+    // frames mixed per pass, bounds the stack used by the mix buffer
+    static const size_t kMixFrames = 256;
+
+    struct Voice {
+        Voice() : mActive(false), mPaused(false), mFrames(0), mPosition(0), mStep(0),
+                mLeftVolume(0), mRightVolume(0), mLoop(0) {}
+        sp<Sample>  mSample;
+        bool        mActive;
+        bool        mPaused;
+        uint32_t    mFrames;        // frames in the sample
+        uint64_t    mPosition;      // read position in frames, Q32.32
+        uint64_t    mStep;          // position increment per output frame, Q32.32
+        float       mLeftVolume;
+        float       mRightVolume;
+        int         mLoop;          // remaining loops, -1 for ever
+    };
+
+    static void callback(int event, void* user, void *info);
+    void process(int16_t* out, size_t frameCount);
+    // mixes count frames of voice into the stereo float buffer out, returns false
+    // when the voice ended
+    static bool mixVoice(Voice* voice, float* out, size_t count);
+    uint64_t stepFor(const sp<Sample>& sample, float rate) const;
+    Voice* voiceFor(SoundChannel* channel);
+    status_t createTrack();
+    // starts the track when a voice plays and pauses it when none does
+    void updateTrack();
+
+    SoundPool*          mSoundPool;
+    SoundChannel*       mChannels;
+    int                 mChannelCount;
+    Mutex               mLock;          // protects mVoices against the mix
+    Voice*              mVoices;
+    sp<AudioTrack>      mAudioTrack;
+    uint32_t            mSampleRate;
+    bool                mStarted;
+};
+
+} // end namespace android
+
+#endif /*SOUNDPOOLMIXER_H_*/
@@ -24,14 +24,14 @@ namespace android {
 
 void SoundPoolThread::write(SoundPoolMsg msg) {
     Mutex::Autolock lock(&mLock);
-    while (mMsgQueue.size() >= maxMessages) {
+    while (mRunning && mMsgQueue.size() >= maxMessages) {
         mCondition.wait(mLock);
     }
 
     // if thread is quitting, don't add to queue
     if (mRunning) {
         mMsgQueue.push(msg);
-        mCondition.signal();
+        mCondition.broadcast();
     }
 }
 
@@ -42,7 +42,8 @@ const SoundPoolMsg SoundPoolThread::read() {
     }
     SoundPoolMsg msg = mMsgQueue[0];
     mMsgQueue.removeAt(0);
-    mCondition.signal();
+    // writers, readers and quit() share the condition
+    mCondition.broadcast();
     return msg;
 }
 
@@ -51,20 +52,36 @@ void SoundPoolThread::quit() {
     if (mRunning) {
         mRunning = false;
         mMsgQueue.clear();
-        mMsgQueue.push(SoundPoolMsg(SoundPoolMsg::KILL, 0));
-        mCondition.signal();
+        // one message per thread, each thread consumes one and exits
+        for (size_t i = 0; i < mThreadCount; i++) {
+            mMsgQueue.push(SoundPoolMsg(SoundPoolMsg::KILL, 0));
+        }
+        mCondition.broadcast();
+    }
+    while (mThreadCount > 0) {
         mCondition.wait(mLock);
     }
     ALOGV("return from quit");
 }
 
-SoundPoolThread::SoundPoolThread(SoundPool* soundPool) :
-    mSoundPool(soundPool)
+SoundPoolThread::SoundPoolThread(SoundPool* soundPool, size_t threadCount) :
+    mSoundPool(soundPool), mRunning(false), mThreadCount(0)
 {
-    mMsgQueue.setCapacity(maxMessages);
-    if (createThreadEtc(beginThread, this, "SoundPoolThread")) {
-        mRunning = true;
+    if (threadCount < 1) {
+        threadCount = 1;
+    } else if (threadCount > maxThreads) {
+        threadCount = maxThreads;
     }
+    mMsgQueue.setCapacity(maxMessages + maxThreads);
+    Mutex::Autolock lock(&mLock);
+    for (size_t i = 0; i < threadCount; i++) {
+        if (!createThreadEtc(beginThread, this, "SoundPoolThread")) {
+            break;
+        }
+        mThreadCount++;
+    }
+    mRunning = mThreadCount > 0;
+    ALOGV("started %zu decoder threads", mThreadCount);
 }
 
 SoundPoolThread::~SoundPoolThread()
@@ -75,7 +92,15 @@ SoundPoolThread::~SoundPoolThread()
 int SoundPoolThread::beginThread(void* arg) {
     ALOGV("beginThread");
     SoundPoolThread* soundPoolThread = (SoundPoolThread*)arg;
-    return soundPoolThread->run();
+    int ret = soundPoolThread->run();
+    soundPoolThread->exitThread();
+    return ret;
+}
+
+void SoundPoolThread::exitThread() {
+    Mutex::Autolock lock(&mLock);
+    mThreadCount--;
+    mCondition.broadcast();
 }
 
 int SoundPoolThread::run() {
@@ -106,7 +131,7 @@ void SoundPoolThread::doLoadSample(int sampleID) {
     sp <Sample> sample = mSoundPool->findSample(sampleID);
     status_t status = -1;
     if (sample != 0) {
-        status = sample->doLoad();
+        status = sample->doLoad(mSoundPool->mCache);
     }
     mSoundPool->notify(SoundPoolEvent(SoundPoolEvent::SAMPLE_LOADED, sampleID, status));
 }
@@ -36,11 +36,12 @@ public:
 };
 
 /*
- * This class handles background requests from the SoundPool
+ * This class handles background requests from the SoundPool on a pool of
+ * decoder threads sharing one message queue, so that samples load in parallel
  */
 class SoundPoolThread {
 public:
-    SoundPoolThread(SoundPool* SoundPool);
+    SoundPoolThread(SoundPool* SoundPool, size_t threadCount = 1);
     ~SoundPoolThread();
     void loadSample(int sampleID);
     void quit();
@@ -48,9 +49,11 @@ public:
 
 private:
     static const size_t maxMessages = 5;
+    static const size_t maxThreads = 4;
 
     static int beginThread(void* arg);
     int run();
+    void exitThread();
     void doLoadSample(int sampleID);
     const SoundPoolMsg read();
 
@@ -59,6 +62,7 @@ private:
     Vector<SoundPoolMsg>    mMsgQueue;
     SoundPool*              mSoundPool;
     bool                    mRunning;
+    size_t                  mThreadCount;   // threads that have not exited run()
 };
 
 } // end namespace android
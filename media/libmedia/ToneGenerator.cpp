@@ -17,9 +17,13 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "ToneGenerator"
 
+#include <limits.h>
 #include <math.h>
+#include <unistd.h>
 #include <utils/Log.h>
 #include <cutils/properties.h>
+#include <binder/MemoryBase.h>
+#include <binder/MemoryHeapBase.h>
 #include "media/ToneGenerator.h"
 
 
@@ -815,6 +819,8 @@ ToneGenerator::ToneGenerator(audio_stream_type_t streamType, float volume, bool
     ALOGV("ToneGenerator constructor: streamType=%d, volume=%f", streamType, volume);
 
     mState = TONE_IDLE;
+    mStaticMode = false;
+    mStaticPlaying = false;
 
     if (AudioSystem::getOutputSamplingRate(&mSamplingRate, streamType) != NO_ERROR) {
         ALOGE("Unable to marshal AudioFlinger");
@@ -845,6 +851,9 @@ ToneGenerator::ToneGenerator(audio_stream_type_t streamType, float volume, bool
         mRegion = CEPT;
     }
 
+    property_get("media.tonegen.static", value, "0");
+    mStaticMode = atoi(value) != 0;
+
     if (initAudioTrack()) {
         ALOGV("ToneGenerator INIT OK, time: %d", (unsigned int)(systemTime()/1000000));
     } else {
@@ -877,6 +886,7 @@ ToneGenerator::~ToneGenerator() {
         ALOGV("Delete Track: %p", mpAudioTrack.get());
         mpAudioTrack.clear();
     }
+    mpStaticTrack.clear();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -923,6 +933,10 @@ bool ToneGenerator::startTone(tone_type toneType, int durationMs) {
 
     mDurationMs = durationMs;
 
+    if (mStaticPlaying) {
+        stopStaticTone_l();
+    }
+
     if (mState == TONE_STOPPED) {
         ALOGV("Start waiting for previous tone to stop");
         lStatus = mWaitCbkCond.waitRelative(mLock, seconds(3));
@@ -934,6 +948,13 @@ bool ToneGenerator::startTone(tone_type toneType, int durationMs) {
         }
     }
 
+    // In static mode, play the tone from a rendered buffer if it can be, otherwise stream it
+    if (mState == TONE_INIT && mStaticMode && startStaticTone_l()) {
+        mLock.unlock();
+        ALOGV("Static tone started, time %d", (unsigned int)(systemTime()/1000000));
+        return true;
+    }
+
     if (mState == TONE_INIT) {
         if (prepareWave()) {
             ALOGV("Immediate start, time %d", (unsigned int)(systemTime()/1000000));
@@ -997,6 +1018,9 @@ void ToneGenerator::stopTone() {
     ALOGV("stopTone");
 
     mLock.lock();
+    if (mStaticPlaying) {
+        stopStaticTone_l();
+    }
     if (mState != TONE_IDLE && mState != TONE_INIT) {
         if (mState == TONE_PLAYING || mState == TONE_STARTING || mState == TONE_RESTARTING) {
             struct timespec stopTime;
@@ -1509,10 +1533,374 @@ ToneGenerator::tone_type ToneGenerator::getToneForRegion(tone_type toneType) {
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+//
+//    Method:        ToneGenerator::startStaticTone_l()
+//
+//    Description:    Starts the tone described by mpNewToneDesc and mDurationMs in static mode,
+//      rendering it if it was not rendered yet. Must be called with mLock held and the
+//      streaming AudioTrack idle (TONE_INIT state).
+//
+//    Input:
+//        none
+//
+//    Output:
+//        returned value:   true if the tone was started, false if it must be streamed
+//
+////////////////////////////////////////////////////////////////////////////////
+bool ToneGenerator::startStaticTone_l() {
+#ifdef QCOM_HARDWARE
+    // played on a direct output, which does not support static tracks
+    if (mStreamType == AUDIO_STREAM_INCALL_MUSIC) {
+        return false;
+    }
+#endif
+    if (!prepareWave()) {
+        return false;
+    }
+
+    // Reuse the rendered tone if any, the most recently used tone is kept last
+    StaticTone lTone;
+    size_t lIdx;
+    for (lIdx = 0; lIdx < mStaticTones.size(); lIdx++) {
+        if (mStaticTones[lIdx].mpToneDesc == mpToneDesc &&
+                mStaticTones[lIdx].mDurationMs == mDurationMs) {
+            break;
+        }
+    }
+    if (lIdx < mStaticTones.size()) {
+        lTone = mStaticTones[lIdx];
+        mStaticTones.removeAt(lIdx);
+    } else {
+        if (!renderStaticTone(&lTone)) {
+            return false;
+        }
+        if (mStaticTones.size() >= TONEGEN_MAX_STATIC_TONES) {
+            mStaticTones.removeAt(0);
+        }
+    }
+    mStaticTones.push(lTone);
+
+    if (mpStaticTrack == 0 || mStaticTrackBuffer != lTone.mBuffer) {
+        mpStaticTrack.clear();
+        mStaticTrackBuffer.clear();
+        // Not a fast track: the normal mixer ramps volume changes, which stopStaticTone_l()
+        // relies on to stop without a click.
+        sp<AudioTrack> lpTrack = new AudioTrack();
+        lpTrack->set(mStreamType,
+                     mSamplingRate,
+                     AUDIO_FORMAT_PCM_16_BIT,
+                     AUDIO_CHANNEL_OUT_MONO,
+                     0,    // frameCount
+                     AUDIO_OUTPUT_FLAG_NONE,
+                     NULL, // callback
+                     NULL, // user
+                     0,    // notificationFrames
+                     lTone.mBuffer,
+                     mThreadCanCallJava,
+                     mpAudioTrack->getSessionId(),
+                     AudioTrack::TRANSFER_SHARED);
+        if (lpTrack->initCheck() != NO_ERROR) {
+            ALOGE("Static AudioTrack->initCheck failed");
+            return false;
+        }
+        mpStaticTrack = lpTrack;
+        mStaticTrackBuffer = lTone.mBuffer;
+        ALOGV("Create static track: %p, %u frames", mpStaticTrack.get(), lTone.mFrameCount);
+    } else {
+        // a tone that played to its end leaves the track active
+        mpStaticTrack->stop();
+        mpStaticTrack->reload();
+    }
+
+    mpStaticTrack->setVolume(mVolume);
+    if (lTone.mLoopCount != 0) {
+        mpStaticTrack->setLoop(0, lTone.mFrameCount, lTone.mLoopCount);
+    }
+    if (mpStaticTrack->start() != NO_ERROR) {
+        ALOGW("Static track start failed");
+        return false;
+    }
+    mStaticPlaying = true;
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//    Method:        ToneGenerator::stopStaticTone_l()
+//
+//    Description:    Stops the tone played in static mode. Must be called with mLock held.
+//
+//    Input:
+//        none
+//
+//    Output:
+//        none
+//
+////////////////////////////////////////////////////////////////////////////////
+void ToneGenerator::stopStaticTone_l() {
+    mStaticPlaying = false;
+
+    // The tone playing is the most recently used one. If it has not played to its end, mute the
+    // track first and let the mixer ramp the volume down over one block.
+    const StaticTone& lTone = mStaticTones.top();
+    uint32_t lPosition;
+    if (lTone.mLoopCount != 0 || mpStaticTrack->getPosition(&lPosition) != NO_ERROR ||
+            lPosition < lTone.mFrameCount) {
+        mpStaticTrack->setVolume(0);
+        usleep((mProcessSize * 1000000LL) / mSamplingRate);
+    }
+    mpStaticTrack->stop();
+    ALOGV("Static tone stopped, time %d", (unsigned int)(systemTime()/1000000));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//    Method:        ToneGenerator::renderStaticTone()
+//
+//    Description:    Renders the tone prepared by prepareWave() into shared memory. A tone
+//      limited in duration, by definition or by mDurationMs, is rendered entirely. A tone
+//      whose sequence repeats from its first segment, or that is a continuous multi-tone, is
+//      rendered for one sequence or a whole number of wave periods, and looped by the track.
+//
+//    Input:
+//        pTone:        rendered tone
+//
+//    Output:
+//        returned value:   true if the tone was rendered, false if it cannot be
+//
+////////////////////////////////////////////////////////////////////////////////
+bool ToneGenerator::renderStaticTone(StaticTone *pTone) {
+    // minimum loop length accepted by AudioTrack::setLoop()
+    static const unsigned int kMinLoopFrames = 16;
+    const uint64_t lMaxFrames = ((uint64_t)TONEGEN_MAX_STATIC_MS * mSamplingRate) / 1000;
+    const ToneDescriptor *lpToneDesc = mpToneDesc;
+    bool lContinuous = lpToneDesc->segments[0].duration == TONEGEN_INF;
+    uint64_t lFrames;
+    int lLoopCount = 0;
+
+    if (lContinuous) {
+        if (mMaxSmp != TONEGEN_INF) {
+            lFrames = mMaxSmp;
+        } else {
+            // The shortest loop holding a whole number of periods of every wave is the sampling
+            // rate divided by the greatest common divisor of the sampling rate and frequencies.
+            unsigned int lDivisor = mSamplingRate;
+            unsigned int lFreqIdx = 0;
+            unsigned int lFrequency = lpToneDesc->segments[0].waveFreq[lFreqIdx];
+            while (lFrequency != 0) {
+                unsigned int a = lDivisor;
+                unsigned int b = lFrequency;
+                while (b != 0) {
+                    unsigned int r = a % b;
+                    a = b;
+                    b = r;
+                }
+                lDivisor = a;
+                lFrequency = lpToneDesc->segments[0].waveFreq[++lFreqIdx];
+            }
+            const unsigned int lPeriod = mSamplingRate / lDivisor;
+            lFrames = lPeriod;
+            while (lFrames < kMinLoopFrames) {
+                lFrames += lPeriod;
+            }
+            lLoopCount = -1;
+        }
+    } else {
+        uint64_t lFirstSmp = sequenceSmp(0);
+        uint64_t lRepeatSmp = sequenceSmp(lpToneDesc->repeatSegment);
+        // a segment of infinite duration after the first cannot be rendered
+        if (lFirstSmp == 0 || (lpToneDesc->repeatCnt != 0 && lRepeatSmp == 0)) {
+            return false;
+        }
+        uint64_t lTotalSmp = ~(uint64_t)0;
+        if (lpToneDesc->repeatCnt != TONEGEN_INF) {
+            lTotalSmp = lFirstSmp + lpToneDesc->repeatCnt * lRepeatSmp;
+        }
+        if (mMaxSmp != TONEGEN_INF) {
+            lFrames = lTotalSmp < mMaxSmp ? lTotalSmp : mMaxSmp;
+        } else if (lpToneDesc->repeatSegment == 0 && lpToneDesc->repeatCnt != 0 &&
+                lFirstSmp >= kMinLoopFrames &&
+                (lpToneDesc->repeatCnt == TONEGEN_INF || lpToneDesc->repeatCnt <= INT_MAX)) {
+            // AudioTrack loops can only start at the beginning of the buffer: setting a loop
+            // moves the position to its start
+            lFrames = lFirstSmp;
+            lLoopCount = lpToneDesc->repeatCnt == TONEGEN_INF ? -1 : (int)lpToneDesc->repeatCnt;
+        } else {
+            lFrames = lTotalSmp;
+        }
+    }
+    if (lFrames == 0 || lFrames > lMaxFrames) {
+        ALOGV("renderStaticTone: cannot render %llu frames", (unsigned long long)lFrames);
+        return false;
+    }
+
+    sp<MemoryHeapBase> lHeap = new MemoryHeapBase(lFrames * sizeof(short), 0, "ToneGenerator");
+    if (lHeap->getHeapID() < 0) {
+        ALOGE("renderStaticTone: cannot allocate %llu frames", (unsigned long long)lFrames);
+        return false;
+    }
+    short *lpOut = static_cast<short *>(lHeap->getBase());
+    // WaveGenerator accumulates into the buffer
+    memset(lpOut, 0, lFrames * sizeof(short));
+
+    if (lContinuous) {
+        if (lpToneDesc->segments[0].waveFreq[0] != 0) {
+            renderSegment(lpOut, 0, lFrames, lLoopCount == 0);
+        }
+    } else {
+        // same sequencing as audioCallback()
+        unsigned int lPos = 0;
+        unsigned int lSegmentIdx = 0;
+        unsigned int lCount = 0;
+        unsigned short lLoopCounter = 0;
+        while (lPos < lFrames) {
+            if (lpToneDesc->segments[lSegmentIdx].duration == 0) {
+                if (++lCount > lpToneDesc->repeatCnt) {
+                    break;
+                }
+                lSegmentIdx = lpToneDesc->repeatSegment;
+                continue;
+            }
+            unsigned int lSmp = segmentSmp(lSegmentIdx);
+            if (lSmp > lFrames - lPos) {
+                lSmp = lFrames - lPos;
+            }
+            if (lpToneDesc->segments[lSegmentIdx].waveFreq[0] != 0) {
+                renderSegment(lpOut + lPos, lSegmentIdx, lSmp, true);
+            }
+            lPos += lSmp;
+            lSegmentIdx = nextSegment(lSegmentIdx, &lLoopCounter);
+        }
+        lFrames = lPos;
+    }
+
+    pTone->mpToneDesc = lpToneDesc;
+    pTone->mDurationMs = mDurationMs;
+    pTone->mBuffer = new MemoryBase(lHeap, 0, lFrames * sizeof(short));
+    pTone->mFrameCount = lFrames;
+    pTone->mLoopCount = lLoopCount;
+    ALOGV("renderStaticTone: %u frames, loop count %d", pTone->mFrameCount, lLoopCount);
+    return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//    Method:        ToneGenerator::segmentSmp()
+//
+//    Description:    Duration of a tone segment in samples, as counted by audioCallback().
+//
+//    Input:
+//        segmentIdx        tone segment index
+//
+//    Output:
+//        returned value:    number of samples
+//
+////////////////////////////////////////////////////////////////////////////////
+unsigned int ToneGenerator::segmentSmp(unsigned int segmentIdx) const {
+    return ((uint64_t)mpToneDesc->segments[segmentIdx].duration * mSamplingRate) / 1000;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//    Method:        ToneGenerator::sequenceSmp()
+//
+//    Description:    Duration in samples of the tone sequence played from a segment to the last
+//      one, segment loops included.
+//
+//    Input:
+//        segmentIdx        first tone segment index
+//
+//    Output:
+//        returned value:    number of samples, 0 if a segment has an infinite duration
+//
+////////////////////////////////////////////////////////////////////////////////
+uint64_t ToneGenerator::sequenceSmp(unsigned int segmentIdx) const {
+    uint64_t lSmp = 0;
+    unsigned short lLoopCounter = 0;
+
+    while (mpToneDesc->segments[segmentIdx].duration != 0) {
+        if (mpToneDesc->segments[segmentIdx].duration == TONEGEN_INF) {
+            return 0;
+        }
+        lSmp += segmentSmp(segmentIdx);
+        segmentIdx = nextSegment(segmentIdx, &lLoopCounter);
+    }
+    return lSmp;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//    Method:        ToneGenerator::nextSegment()
+//
+//    Description:    Index of the segment following a tone segment, taking segment loops into
+//      account as audioCallback() does.
+//
+//    Input:
+//        segmentIdx        tone segment index
+//        pLoopCounter      current loop count, updated
+//
+//    Output:
+//        returned value:    next tone segment index
+//
+////////////////////////////////////////////////////////////////////////////////
+unsigned int ToneGenerator::nextSegment(unsigned int segmentIdx,
+        unsigned short *pLoopCounter) const {
+    const ToneSegment& lSegment = mpToneDesc->segments[segmentIdx];
+
+    if (lSegment.loopCnt) {
+        if (*pLoopCounter < lSegment.loopCnt) {
+            ++*pLoopCounter;
+            return lSegment.loopIndx;
+        }
+        *pLoopCounter = 0;
+    }
+    return segmentIdx + 1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//    Method:        ToneGenerator::renderSegment()
+//
+//    Description:    Renders a tone ON segment: all the waves start from phase 0 and, if
+//      requested, ramp down over the last block as audioCallback() does at the segment end.
+//
+//    Input:
+//        outBuffer:      Output buffer where to accumulate samples.
+//        segmentIdx:     tone segment index
+//        count:          number of samples to produce.
+//        rampDown:       whether to ramp down at the end
+//
+//    Output:
+//        none
+//
+////////////////////////////////////////////////////////////////////////////////
+void ToneGenerator::renderSegment(short *outBuffer, unsigned int segmentIdx,
+        unsigned int count, bool rampDown) {
+    unsigned int lRampSmp = rampDown ? mProcessSize : 0;
+    if (lRampSmp > count) {
+        lRampSmp = count;
+    }
+    unsigned int lFreqIdx = 0;
+    unsigned short lFrequency = mpToneDesc->segments[segmentIdx].waveFreq[lFreqIdx];
+
+    while (lFrequency != 0) {
+        WaveGenerator *lpWaveGen = mWaveGens.valueFor(lFrequency);
+        lpWaveGen->getSamples(outBuffer, count - lRampSmp, WaveGenerator::WAVEGEN_START);
+        lpWaveGen->getSamples(outBuffer + count - lRampSmp, lRampSmp,
+                WaveGenerator::WAVEGEN_STOP);
+        lFrequency = mpToneDesc->segments[segmentIdx].waveFreq[++lFreqIdx];
+    }
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 //                WaveGenerator::WaveGenerator class    Implementation
 ////////////////////////////////////////////////////////////////////////////////
 
+short ToneGenerator::WaveGenerator::sSineTable[(1 << SINE_TABLE_BITS) + 1];
+pthread_once_t ToneGenerator::WaveGenerator::sSineTableOnce = PTHREAD_ONCE_INIT;
+
 //---------------------------------- public methods ----------------------------
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1532,27 +1920,19 @@ ToneGenerator::tone_type ToneGenerator::getToneForRegion(tone_type toneType) {
 ////////////////////////////////////////////////////////////////////////////////
 ToneGenerator::WaveGenerator::WaveGenerator(unsigned short samplingRate,
         unsigned short frequency, float volume) {
-    double d0;
-    double F_div_Fs;  // frequency / samplingRate
+    pthread_once(&sSineTableOnce, initSineTable);
 
-    F_div_Fs = frequency / (double)samplingRate;
-    d0 = - (float)GEN_AMP * sin(2 * M_PI * F_div_Fs);
-    mS2_0 = (short)d0;
-    mS1 = 0;
-    mS2 = mS2_0;
+    // phase increment per sample, a full turn being 2^32
+    mPhaseInc = (uint32_t)((frequency * 4294967296.0) / samplingRate + 0.5);
+    mPhase = 0;
 
-    mAmplitude_Q15 = (short)(32767. * 32767. * volume / GEN_AMP);
+    mAmplitude_Q15 = (short)(32767. * volume);
     // take some margin for amplitude fluctuation
     if (mAmplitude_Q15 > 32500)
         mAmplitude_Q15 = 32500;
 
-    d0 = 32768.0 * cos(2 * M_PI * F_div_Fs);  // Q14*2*cos()
-    if (d0 > 32767)
-        d0 = 32767;
-    mA1_Q14 = (short) d0;
-
-    ALOGV("WaveGenerator init, mA1_Q14: %d, mS2_0: %d, mAmplitude_Q15: %d",
-            mA1_Q14, mS2_0, mAmplitude_Q15);
+    ALOGV("WaveGenerator init, mPhaseInc: %u, mAmplitude_Q15: %d",
+            mPhaseInc, mAmplitude_Q15);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1589,19 +1969,18 @@ ToneGenerator::WaveGenerator::~WaveGenerator() {
 ////////////////////////////////////////////////////////////////////////////////
 void ToneGenerator::WaveGenerator::getSamples(short *outBuffer,
         unsigned int count, unsigned int command) {
-    long lS1, lS2;
-    long lA1, lAmplitude;
+    uint32_t lPhase;
+    uint32_t lPhaseInc;
+    long lAmplitude;
     long Sample;  // current sample
 
     // init local
     if (command == WAVEGEN_START) {
-        lS1 = (long)0;
-        lS2 = (long)mS2_0;
+        lPhase = 0;
     } else {
-        lS1 = (long)mS1;
-        lS2 = (long)mS2;
+        lPhase = mPhase;
     }
-    lA1 = (long)mA1_Q14;
+    lPhaseInc = mPhaseInc;
     lAmplitude = (long)mAmplitude_Q15;
 
     if (command == WAVEGEN_STOP) {
@@ -1612,29 +1991,65 @@ void ToneGenerator::WaveGenerator::getSamples(short *outBuffer,
         long dec = lAmplitude/count;
         // loop generation
         while (count--) {
-            Sample = ((lA1 * lS1) >> S_Q14) - lS2;
-            // shift delay
-            lS2 = lS1;
-            lS1 = Sample;
-            Sample = ((lAmplitude>>16) * Sample) >> S_Q15;
+            lPhase += lPhaseInc;
+            Sample = ((lAmplitude>>16) * sine(lPhase)) >> S_Q15;
             *(outBuffer++) += (short)Sample;  // put result in buffer
             lAmplitude -= dec;
         }
     } else {
         // loop generation
         while (count--) {
-            Sample = ((lA1 * lS1) >> S_Q14) - lS2;
-            // shift delay
-            lS2 = lS1;
-            lS1 = Sample;
-            Sample = (lAmplitude * Sample) >> S_Q15;
+            lPhase += lPhaseInc;
+            Sample = (lAmplitude * sine(lPhase)) >> S_Q15;
             *(outBuffer++) += (short)Sample;  // put result in buffer
         }
     }
 
     // save status
-    mS1 = (short)lS1;
-    mS2 = (short)lS2;
+    mPhase = lPhase;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//    Method:        WaveGenerator::initSineTable()
+//
+//    Description:    Fills the sine table shared by all wave generators, once per process.
+//
+//    Input:
+//        none
+//
+//    Output:
+//        none
+//
+////////////////////////////////////////////////////////////////////////////////
+void ToneGenerator::WaveGenerator::initSineTable() {
+    const unsigned int lSize = 1 << SINE_TABLE_BITS;
+
+    // one extra entry so that interpolation never wraps
+    for (unsigned int i = 0; i <= lSize; i++) {
+        sSineTable[i] = (short)lrint(32767. * sin(2 * M_PI * i / lSize));
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+//    Method:        WaveGenerator::sine()
+//
+//    Description:    Sine of a phase, linearly interpolated in the sine table.
+//
+//    Input:
+//        phase:          phase, a full turn being 2^32
+//
+//    Output:
+//        returned value:   sine, Q15
+//
+////////////////////////////////////////////////////////////////////////////////
+inline long ToneGenerator::WaveGenerator::sine(uint32_t phase) {
+    unsigned int lIdx = phase >> SINE_FRAC_BITS;
+    long lFrac = (phase >> (SINE_FRAC_BITS - S_Q15)) & ((1 << S_Q15) - 1);
+    long lS0 = sSineTable[lIdx];
+
+    return lS0 + (((sSineTable[lIdx + 1] - lS0) * lFrac) >> S_Q15);
 }
 
 }  // end namespace android
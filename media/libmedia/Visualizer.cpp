@@ -45,7 +45,12 @@ Visualizer::Visualizer (int32_t priority,
         mScalingMode(VISUALIZER_SCALING_MODE_NORMALIZED),
         mMeasurementMode(MEASUREMENT_MODE_NONE),
         mCaptureCallBack(NULL),
-        mCaptureCbkUser(NULL)
+        mCaptureCbkUser(NULL),
+        mFrameCallBack(NULL),
+        mFrameCbkUser(NULL),
+        mFrameBands(0),
+        mFrameDelivered(false),
+        mLastFrameSequence(0)
 {
     initCaptureSize();
 }
@@ -58,6 +63,7 @@ Visualizer::~Visualizer()
         mCaptureThread.clear();
     }
     mCaptureCallBack = NULL;
+    mFrameCallBack = NULL;
     mCaptureFlags = 0;
 }
 
@@ -126,6 +132,7 @@ status_t Visualizer::setCaptureCallBack(capture_cbk_t cbk, void* user, uint32_t
     mCaptureCbkUser = user;
     mCaptureFlags = flags;
     mCaptureRate = rate;
+    mFrameCallBack = NULL;
 
     if (t != 0) {
         t->mLock.unlock();
@@ -139,6 +146,46 @@ status_t Visualizer::setCaptureCallBack(capture_cbk_t cbk, void* user, uint32_t
     return NO_ERROR;
 }
 
+status_t Visualizer::setFrameCallBack(frame_cbk_t cbk, void* user, uint32_t bands,
+        uint32_t flags, uint32_t rate)
+{
+    if (rate > CAPTURE_RATE_MAX) {
+        return BAD_VALUE;
+    }
+    if (cbk != NULL && (bands < VISUALIZER_FRAME_BANDS_MIN ||
+            bands > VISUALIZER_FRAME_BANDS_MAX || popcount(bands) != 1)) {
+        return BAD_VALUE;
+    }
+    Mutex::Autolock _l(mCaptureLock);
+
+    if (mEnabled) {
+        return INVALID_OPERATION;
+    }
+
+    sp<CaptureThread> t = mCaptureThread;
+    if (t != 0) {
+        t->mLock.lock();
+    }
+    mCaptureThread.clear();
+    mCaptureCallBack = NULL;
+    mCaptureFlags = flags & CAPTURE_CALL_JAVA;
+    mCaptureRate = rate;
+    mFrameCallBack = cbk;
+    mFrameCbkUser = user;
+    mFrameBands = bands;
+    mFrameDelivered = false;
+
+    if (t != 0) {
+        t->mLock.unlock();
+    }
+
+    if (cbk != NULL) {
+        mCaptureThread = new CaptureThread(*this, rate, ((flags & CAPTURE_CALL_JAVA) != 0));
+    }
+    ALOGV("setFrameCallBack() rate: %d thread %p bands %u", rate, mCaptureThread.get(), bands);
+    return NO_ERROR;
+}
+
 status_t Visualizer::setCaptureSize(uint32_t size)
 {
     if (size > VISUALIZER_CAPTURE_SIZE_MAX ||
@@ -315,6 +362,38 @@ status_t Visualizer::getFft(uint8_t *fft)
     return status;
 }
 
+status_t Visualizer::getFrame(uint32_t bands, visualizer_frame_t *frame)
+{
+    if (frame == NULL || bands < VISUALIZER_FRAME_BANDS_MIN ||
+            bands > VISUALIZER_FRAME_BANDS_MAX || popcount(bands) != 1) {
+        return BAD_VALUE;
+    }
+    if (mCaptureSize == 0) {
+        return NO_INIT;
+    }
+    if (bands > mCaptureSize / 2) {
+        return BAD_VALUE;
+    }
+
+    status_t status = NO_ERROR;
+    if (mEnabled) {
+        uint32_t replySize = sizeof(visualizer_frame_t);
+        status = command(VISUALIZER_CMD_CAPTURE_FRAME, sizeof(uint32_t), &bands,
+                &replySize, frame);
+        ALOGV("getFrame() command returned %d", status);
+        if ((status == NO_ERROR) && (replySize == 0)) {
+            status = NOT_ENOUGH_DATA;
+        }
+    } else {
+        ALOGV("getFrame() disabled");
+        memset(frame, 0, sizeof(visualizer_frame_t));
+        frame->peakmB = VISUALIZER_FRAME_FLOOR_MB;
+        frame->rmsmB = VISUALIZER_FRAME_FLOOR_MB;
+        frame->bands = bands;
+    }
+    return status;
+}
+
 status_t Visualizer::doFft(uint8_t *fft, uint8_t *waveform)
 {
     int32_t workspace[mCaptureSize >> 1];
@@ -346,6 +425,20 @@ status_t Visualizer::doFft(uint8_t *fft, uint8_t *waveform)
 void Visualizer::periodicCapture()
 {
     Mutex::Autolock _l(mCaptureLock);
+    if (mFrameCallBack != NULL) {
+        visualizer_frame_t frame;
+        if (getFrame(mFrameBands, &frame) != NO_ERROR) {
+            return;
+        }
+        // nothing new to display if no audio was processed since the last frame
+        if (mFrameDelivered && frame.sequence == mLastFrameSequence) {
+            return;
+        }
+        mFrameDelivered = true;
+        mLastFrameSequence = frame.sequence;
+        mFrameCallBack(mFrameCbkUser, &frame);
+        return;
+    }
     ALOGV("periodicCapture() %p mCaptureCallBack %p mCaptureFlags 0x%08x",
             this, mCaptureCallBack, mCaptureFlags);
     if (mCaptureCallBack != NULL &&
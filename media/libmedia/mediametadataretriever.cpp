@@ -140,6 +140,19 @@ sp<IMemory> MediaMetadataRetriever::getFrameAtTime(int64_t timeUs, int option)
     return mRetriever->getFrameAtTime(timeUs, option);
 }
 
+sp<IMemory> MediaMetadataRetriever::getThumbnailAtTime(
+        int64_t timeUs, int option, int32_t width, int32_t height)
+{
+    ALOGV("getThumbnailAtTime: time(%" PRId64 " us) option(%d) size(%dx%d)",
+            timeUs, option, width, height);
+    Mutex::Autolock _l(mLock);
+    if (mRetriever == 0) {
+        ALOGE("retriever is not initialized");
+        return NULL;
+    }
+    return mRetriever->getThumbnailAtTime(timeUs, option, width, height);
+}
+
 const char* MediaMetadataRetriever::extractMetadata(int keyCode)
 {
     ALOGV("extractMetadata(%d)", keyCode);
@@ -151,6 +164,42 @@ const char* MediaMetadataRetriever::extractMetadata(int keyCode)
     return mRetriever->extractMetadata(keyCode);
 }
 
+status_t MediaMetadataRetriever::extractMetadataBatch(
+        const Vector<int> &fds, const Vector<int> &keyCodes,
+        Vector<KeyedVector<int, String8> > *values)
+{
+    ALOGV("extractMetadataBatch(%zu files)", fds.size());
+    Mutex::Autolock _l(mLock);
+    values->clear();
+    if (mRetriever == 0) {
+        ALOGE("retriever is not initialized");
+        return INVALID_OPERATION;
+    }
+    if (keyCodes.size() > IMediaMetadataRetriever::kMaxBatchSize) {
+        return BAD_VALUE;
+    }
+
+    for (size_t i = 0; i < fds.size();
+            i += IMediaMetadataRetriever::kMaxBatchSize) {
+        Vector<int> batchFds;
+        for (size_t j = i;
+                j < fds.size() && j < i + IMediaMetadataRetriever::kMaxBatchSize;
+                ++j) {
+            batchFds.push(fds[j]);
+        }
+
+        Vector<KeyedVector<int, String8> > batchValues;
+        status_t err = mRetriever->extractMetadataBatch(
+                batchFds, keyCodes, &batchValues);
+        if (err != NO_ERROR) {
+            values->clear();
+            return err;
+        }
+        values->appendVector(batchValues);
+    }
+    return NO_ERROR;
+}
+
 sp<IMemory> MediaMetadataRetriever::extractAlbumArt()
 {
     ALOGV("extractAlbumArt");
@@ -22,6 +22,7 @@
 
 #include "Crypto.h"
 
+#include <binder/IMemory.h>
 #include <media/hardware/CryptoAPI.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/AString.h>
@@ -257,4 +258,37 @@ ssize_t Crypto::decrypt(
             errorDetailMsg);
 }
 
+ssize_t Crypto::decrypt(
+        bool secure,
+        const uint8_t key[16],
+        const uint8_t iv[16],
+        CryptoPlugin::Mode mode,
+        const sp<IMemory> &sharedBuffer, size_t offset,
+        const CryptoPlugin::SubSample *subSamples, size_t numSubSamples,
+        void *dstPtr,
+        AString *errorDetailMsg) {
+    if (sharedBuffer == NULL || sharedBuffer->pointer() == NULL) {
+        return -EINVAL;
+    }
+
+    size_t totalSize = 0;
+    for (size_t i = 0; i < numSubSamples; ++i) {
+        totalSize += subSamples[i].mNumBytesOfEncryptedData;
+        totalSize += subSamples[i].mNumBytesOfClearData;
+    }
+
+    // the client says where the data is, it must not point us elsewhere
+    size_t size = sharedBuffer->size();
+    if (offset > size || totalSize > size - offset) {
+        ALOGE("%zu bytes at %zu past the %zu of the shared buffer",
+                totalSize, offset, size);
+        return -EINVAL;
+    }
+
+    return decrypt(
+            secure, key, iv, mode,
+            static_cast<const uint8_t *>(sharedBuffer->pointer()) + offset,
+            subSamples, numSubSamples, dstPtr, errorDetailMsg);
+}
+
 }  // namespace android
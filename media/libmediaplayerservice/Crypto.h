@@ -55,6 +55,16 @@ struct Crypto : public BnCrypto {
             void *dstPtr,
             AString *errorDetailMsg);
 
+    virtual ssize_t decrypt(
+            bool secure,
+            const uint8_t key[16],
+            const uint8_t iv[16],
+            CryptoPlugin::Mode mode,
+            const sp<IMemory> &sharedBuffer, size_t offset,
+            const CryptoPlugin::SubSample *subSamples, size_t numSubSamples,
+            void *dstPtr,
+            AString *errorDetailMsg);
+
 private:
     mutable Mutex mLock;
 
@@ -37,6 +37,12 @@ namespace android {
 Mutex MediaPlayerFactory::sLock;
 MediaPlayerFactory::tFactoryMap MediaPlayerFactory::sFactoryMap;
 bool MediaPlayerFactory::sInitComplete = false;
+Vector<MediaPlayerFactory::SniffResult> MediaPlayerFactory::sSniffResults;
+
+// Long enough for a playlist to come back to a file, short enough for a
+// change of the default player to be picked up soon.
+static const size_t kMaxSniffResults = 16;
+static const nsecs_t kSniffResultLifetimeNs = seconds_to_nanoseconds(60);
 
 status_t MediaPlayerFactory::registerFactory_l(IFactory* factory,
                                                player_type type) {
@@ -58,6 +64,7 @@ status_t MediaPlayerFactory::registerFactory_l(IFactory* factory,
         return UNKNOWN_ERROR;
     }
 
+    sSniffResults.clear();
     return OK;
 }
 
@@ -86,6 +93,7 @@ status_t MediaPlayerFactory::registerFactory(IFactory* factory,
 void MediaPlayerFactory::unregisterFactory(player_type type) {
     Mutex::Autolock lock_(&sLock);
     sFactoryMap.removeItem(type);
+    sSniffResults.clear();
 }
 
 #define GET_PLAYER_TYPE_IMPL(a...)                      \
@@ -121,6 +129,33 @@ player_type MediaPlayerFactory::getPlayerType(const sp<IMediaPlayer>& client,
                                               int fd,
                                               int64_t offset,
                                               int64_t length) {
+    // Only regular files keep their content for as long as their identity.
+    struct stat sb;
+    bool cacheable = fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode);
+
+    if (cacheable) {
+        Mutex::Autolock lock_(&sLock);
+        ssize_t index = findSniffResult_l(sb, offset, length);
+        if (index >= 0) {
+            ALOGV("getPlayerType(): player %d from an earlier sniff",
+                  sSniffResults[index].mType);
+            return sSniffResults[index].mType;
+        }
+    }
+
+    player_type type = scorePlayerTypes(client, fd, offset, length);
+
+    if (cacheable) {
+        Mutex::Autolock lock_(&sLock);
+        addSniffResult_l(sb, offset, length, type);
+    }
+    return type;
+}
+
+player_type MediaPlayerFactory::scorePlayerTypes(const sp<IMediaPlayer>& client,
+                                                 int fd,
+                                                 int64_t offset,
+                                                 int64_t length) {
     GET_PLAYER_TYPE_IMPL(client, fd, offset, length);
 }
 
@@ -131,6 +166,52 @@ player_type MediaPlayerFactory::getPlayerType(const sp<IMediaPlayer>& client,
 
 #undef GET_PLAYER_TYPE_IMPL
 
+ssize_t MediaPlayerFactory::findSniffResult_l(const struct stat& sb,
+                                              int64_t offset,
+                                              int64_t length) {
+    nsecs_t nowNs = systemTime();
+
+    // from the newest, so that removing one never moves those still to look at
+    for (size_t i = sSniffResults.size(); i-- > 0;) {
+        const SniffResult& result = sSniffResults[i];
+        if (nowNs - result.mTimeNs > kSniffResultLifetimeNs) {
+            sSniffResults.removeAt(i);
+            continue;
+        }
+        if (result.mDev == sb.st_dev && result.mIno == sb.st_ino
+                && result.mFileSize == sb.st_size
+                && result.mModTime == sb.st_mtime
+                && result.mOffset == offset && result.mLength == length) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void MediaPlayerFactory::addSniffResult_l(const struct stat& sb,
+                                          int64_t offset,
+                                          int64_t length,
+                                          player_type type) {
+    if (findSniffResult_l(sb, offset, length) >= 0) {
+        return;
+    }
+    if (sSniffResults.size() >= kMaxSniffResults) {
+        // the oldest goes
+        sSniffResults.removeAt(0);
+    }
+
+    SniffResult result;
+    result.mDev = sb.st_dev;
+    result.mIno = sb.st_ino;
+    result.mFileSize = sb.st_size;
+    result.mModTime = sb.st_mtime;
+    result.mOffset = offset;
+    result.mLength = length;
+    result.mType = type;
+    result.mTimeNs = systemTime();
+    sSniffResults.push(result);
+}
+
 sp<MediaPlayerBase> MediaPlayerFactory::createPlayer(
         player_type playerType,
         void* cookie,
@@ -20,6 +20,10 @@
 
 #include <media/MediaPlayerInterface.h>
 #include <media/stagefright/foundation/ABase.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+#include <sys/stat.h>
 
 namespace android {
 
@@ -67,14 +71,41 @@ class MediaPlayerFactory {
   private:
     typedef KeyedVector<player_type, IFactory*> tFactoryMap;
 
+    // The player picked for a file, for the sniffing not to be done again
+    // as a playlist reopens it.  A file is known by its inode, size and
+    // modification time, and the range of it that is played.
+    struct SniffResult {
+        dev_t       mDev;
+        ino_t       mIno;
+        off_t       mFileSize;
+        time_t      mModTime;
+        int64_t     mOffset;
+        int64_t     mLength;
+        player_type mType;
+        nsecs_t     mTimeNs;
+    };
+
     MediaPlayerFactory() { }
 
     static status_t registerFactory_l(IFactory* factory,
                                       player_type type);
 
+    static player_type scorePlayerTypes(const sp<IMediaPlayer>& client,
+                                        int fd,
+                                        int64_t offset,
+                                        int64_t length);
+    static ssize_t findSniffResult_l(const struct stat& sb,
+                                     int64_t offset,
+                                     int64_t length);
+    static void addSniffResult_l(const struct stat& sb,
+                                 int64_t offset,
+                                 int64_t length,
+                                 player_type type);
+
     static Mutex       sLock;
     static tFactoryMap sFactoryMap;
     static bool        sInitComplete;
+    static Vector<SniffResult> sSniffResults;
 
     DISALLOW_EVIL_CONSTRUCTORS(MediaPlayerFactory);
 };
@@ -23,6 +23,7 @@
 #include <sys/stat.h>
 #include <dirent.h>
 #include <unistd.h>
+#include <pthread.h>
 
 #include <string.h>
 #include <cutils/atomic.h>
@@ -42,6 +43,10 @@
 
 namespace android {
 
+// The files of a batch are extracted on this many threads at most, the binder
+// thread included, for a gallery's batches not to take all of the cores.
+static const size_t kMaxBatchThreads = 4;
+
 MetadataRetrieverClient::MetadataRetrieverClient(pid_t pid)
 {
     ALOGV("MetadataRetrieverClient constructor pid(%d)", pid);
@@ -187,7 +192,26 @@ sp<IMemory> MetadataRetrieverClient::getFrameAtTime(int64_t timeUs, int option)
         ALOGE("retriever is not initialized");
         return NULL;
     }
-    VideoFrame *frame = mRetriever->getFrameAtTime(timeUs, option);
+    return copyFrame_l(mRetriever->getFrameAtTime(timeUs, option));
+}
+
+sp<IMemory> MetadataRetrieverClient::getThumbnailAtTime(
+        int64_t timeUs, int option, int32_t width, int32_t height)
+{
+    ALOGV("getThumbnailAtTime: time(%lld us) option(%d) size(%dx%d)",
+            timeUs, option, width, height);
+    Mutex::Autolock lock(mLock);
+    mThumbnail.clear();
+    if (mRetriever == NULL) {
+        ALOGE("retriever is not initialized");
+        return NULL;
+    }
+    return copyFrame_l(
+            mRetriever->getThumbnailAtTime(timeUs, option, width, height));
+}
+
+sp<IMemory> MetadataRetrieverClient::copyFrame_l(VideoFrame *frame)
+{
     if (frame == NULL) {
         ALOGE("failed to capture a video frame");
         return NULL;
@@ -263,4 +287,100 @@ const char* MetadataRetrieverClient::extractMetadata(int keyCode)
     return mRetriever->extractMetadata(keyCode);
 }
 
+struct MetadataBatch {
+    const Vector<int> *mFds;
+    const Vector<int> *mKeyCodes;
+    KeyedVector<int, String8> *mValues;
+
+    Mutex mLock;
+    // of the file to extract next
+    size_t mNext;
+};
+
+static void extractFileMetadata(
+        int fd, const Vector<int> &keyCodes, KeyedVector<int, String8> *values)
+{
+    struct stat sb;
+    if (fstat(fd, &sb) != 0 || sb.st_size <= 0) {
+        ALOGV("skipping fd %d, not a file or empty", fd);
+        return;
+    }
+
+    player_type playerType =
+        MediaPlayerFactory::getPlayerType(NULL /* client */, fd, 0, sb.st_size);
+    sp<MediaMetadataRetrieverBase> p = createRetriever(playerType);
+    if (p == NULL || p->setDataSource(fd, 0, sb.st_size) != NO_ERROR) {
+        return;
+    }
+
+    for (size_t i = 0; i < keyCodes.size(); ++i) {
+        const char *value = p->extractMetadata(keyCodes[i]);
+        if (value != NULL) {
+            values->add(keyCodes[i], String8(value));
+        }
+    }
+}
+
+static void *batchThread(void *me)
+{
+    MetadataBatch *batch = static_cast<MetadataBatch *>(me);
+    for (;;) {
+        size_t i;
+        {
+            Mutex::Autolock autoLock(batch->mLock);
+            if (batch->mNext == batch->mFds->size()) {
+                break;
+            }
+            i = batch->mNext++;
+        }
+        extractFileMetadata(
+                batch->mFds->itemAt(i), *batch->mKeyCodes, &batch->mValues[i]);
+    }
+    return NULL;
+}
+
+// Unlike a retriever per file, none of the files cost a binder object, and
+// they are extracted in parallel.
+status_t MetadataRetrieverClient::extractMetadataBatch(
+        const Vector<int> &fds, const Vector<int> &keyCodes,
+        Vector<KeyedVector<int, String8> > *values)
+{
+    ALOGV("extractMetadataBatch: %zu files, %zu keys", fds.size(), keyCodes.size());
+    values->clear();
+    values->insertAt(KeyedVector<int, String8>(), 0, fds.size());
+
+    MetadataBatch batch;
+    batch.mFds = &fds;
+    batch.mKeyCodes = &keyCodes;
+    batch.mValues = values->editArray();
+    batch.mNext = 0;
+
+    size_t numThreads = fds.size() < kMaxBatchThreads ? fds.size() : kMaxBatchThreads;
+    pthread_t threads[kMaxBatchThreads];
+    size_t numStarted = 0;
+    for (size_t i = 1; i < numThreads; ++i) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+        int res = pthread_create(&threads[numStarted], &attr, batchThread, &batch);
+        pthread_attr_destroy(&attr);
+
+        if (res != 0) {
+            // the threads started have the rest
+            ALOGW("could not start a metadata batch thread (%d)", res);
+            break;
+        }
+        ++numStarted;
+    }
+
+    batchThread(&batch);
+
+    for (size_t i = 0; i < numStarted; ++i) {
+        void *dummy;
+        pthread_join(threads[i], &dummy);
+    }
+
+    return NO_ERROR;
+}
+
 }; // namespace android
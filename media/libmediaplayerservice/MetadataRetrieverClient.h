@@ -50,8 +50,13 @@ public:
 
     virtual status_t                setDataSource(int fd, int64_t offset, int64_t length);
     virtual sp<IMemory>             getFrameAtTime(int64_t timeUs, int option);
+    virtual sp<IMemory>             getThumbnailAtTime(
+            int64_t timeUs, int option, int32_t width, int32_t height);
     virtual sp<IMemory>             extractAlbumArt();
     virtual const char*             extractMetadata(int keyCode);
+    virtual status_t                extractMetadataBatch(
+            const Vector<int> &fds, const Vector<int> &keyCodes,
+            Vector<KeyedVector<int, String8> > *values);
 
     virtual status_t                dump(int fd, const Vector<String16>& args) const;
 
@@ -61,6 +66,9 @@ private:
     explicit MetadataRetrieverClient(pid_t pid);
     virtual ~MetadataRetrieverClient();
 
+    // Copies frame to mThumbnail and deletes it.
+    sp<IMemory>                     copyFrame_l(VideoFrame *frame);
+
     mutable Mutex                          mLock;
     sp<MediaMetadataRetrieverBase>         mRetriever;
     pid_t                                  mPid;
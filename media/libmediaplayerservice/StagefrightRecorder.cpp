@@ -51,6 +51,7 @@
 #include <utils/Errors.h>
 #include <sys/types.h>
 #include <ctype.h>
+#include <pthread.h>
 #include <unistd.h>
 
 #include "ExtendedUtils.h"
@@ -88,7 +89,10 @@ StagefrightRecorder::StagefrightRecorder()
       mVideoSource(VIDEO_SOURCE_LIST_END),
       mCaptureTimeLapse(false),
       mStarted(false),
-      mRecPaused(false) {
+      mRecPaused(false),
+      mAudioEncoderStatus(OK),
+      mAudioEncoderSetupUs(0),
+      mAudioEncoderCallingIdentity(0) {
 
     ALOGV("Constructor");
     reset();
@@ -516,6 +520,24 @@ status_t StagefrightRecorder::setParam64BitFileOffset(bool use64Bit) {
     return OK;
 }
 
+// If durationUs == 0, the file is written with a single movie box at the end
+// If durationUs >  0, a movie fragment is written about every durationUs
+status_t StagefrightRecorder::setParamMovieFragmentDuration(int64_t durationUs) {
+    ALOGV("setParamMovieFragmentDuration: %" PRId64 " us", durationUs);
+    if (durationUs != 0 && durationUs < 500000LL) {         // 500 ms
+        // Every fragment carries its own sample tables, too small a
+        // fragment spends a significant portion of the file on them
+        ALOGE("Movie fragment duration is too small: %" PRId64 " us", durationUs);
+        return BAD_VALUE;
+    } else if (durationUs > 10000000LL) {                   // 10 seconds
+        // A fragment is held in memory until it is written out
+        ALOGE("Movie fragment duration is too large: %" PRId64 " us", durationUs);
+        return BAD_VALUE;
+    }
+    mMovieFragmentDurationUs = durationUs;
+    return OK;
+}
+
 status_t StagefrightRecorder::setParamVideoCameraId(int32_t cameraId) {
     ALOGV("setParamVideoCameraId: %d", cameraId);
     if (cameraId < 0) {
@@ -665,6 +687,11 @@ status_t StagefrightRecorder::setParameter(
         if (safe_strtoi32(value.string(), &use64BitOffset)) {
             return setParam64BitFileOffset(use64BitOffset != 0);
         }
+    } else if (key == "param-movie-fragment-duration-us") {
+        int64_t durationUs;
+        if (safe_strtoi64(value.string(), &durationUs)) {
+            return setParamMovieFragmentDuration(durationUs);
+        }
     } else if (key == "param-geotag-longitude") {
         int64_t longitudex10000;
         if (safe_strtoi64(value.string(), &longitudex10000)) {
@@ -1616,6 +1643,7 @@ status_t StagefrightRecorder::setupCameraSource(
 
     mIsMetaDataStoredInVideoBuffers =
         (*cameraSource)->isMetaDataStoredInVideoBuffers();
+    mCameraSource = *cameraSource;
 
     return OK;
 }
@@ -1754,6 +1782,17 @@ status_t StagefrightRecorder::setupVideoEncoder(
 }
 
 status_t StagefrightRecorder::setupAudioEncoder(const sp<MediaWriter>& writer) {
+    sp<MediaSource> audioEncoder;
+    status_t status = createAudioEncoder(&audioEncoder);
+    if (status != OK) {
+        return status;
+    }
+
+    writer->addSource(audioEncoder);
+    return OK;
+}
+
+status_t StagefrightRecorder::createAudioEncoder(sp<MediaSource> *audioEncoder) {
     ExtendedStats::AutoProfile autoProfile(
             STATS_PROFILE_SET_ENCODER(false /* isVideo */), mRecorderExtendedStats);
     status_t status = BAD_VALUE;
@@ -1779,15 +1818,28 @@ status_t StagefrightRecorder::setupAudioEncoder(const sp<MediaWriter>& writer) {
             return UNKNOWN_ERROR;
     }
 
-    sp<MediaSource> audioEncoder = createAudioSource();
-    if (audioEncoder == NULL) {
+    *audioEncoder = createAudioSource();
+    if (*audioEncoder == NULL) {
         return UNKNOWN_ERROR;
     }
-
-    writer->addSource(audioEncoder);
     return OK;
 }
 
+// static
+void *StagefrightRecorder::AudioEncoderThread(void *me) {
+    StagefrightRecorder *recorder = static_cast<StagefrightRecorder *>(me);
+
+    // for the audio record to be that of the app, as it is when set up on
+    // the binder thread
+    IPCThreadState::self()->restoreCallingIdentity(recorder->mAudioEncoderCallingIdentity);
+
+    int64_t startUs = systemTime() / 1000;
+    recorder->mAudioEncoderStatus =
+        recorder->createAudioEncoder(&recorder->mAudioEncoderPending);
+    recorder->mAudioEncoderSetupUs = systemTime() / 1000 - startUs;
+    return NULL;
+}
+
 status_t StagefrightRecorder::setupMPEG4orWEBMRecording() {
     mWriter.clear();
     mTotalBitRate = 0;
@@ -1800,17 +1852,55 @@ status_t StagefrightRecorder::setupMPEG4orWEBMRecording() {
         writer = new MPEG4Writer(mOutputFd);
     }
 
+    // TODO Audio source is currently unsupported for webm output; vorbis encoder needed.
+    bool hasAudio = mOutputFormat != OUTPUT_FORMAT_WEBM
+            && !mCaptureTimeLapse && (mAudioSource != AUDIO_SOURCE_CNT);
+
+    // The audio source and encoder do not depend on the camera or the video
+    // encoder, and take about as long to allocate. Set them up on a thread
+    // of their own meanwhile.
+    int64_t setupStartUs = systemTime() / 1000;
+    pthread_t audioThread;
+    bool audioThreadStarted = false;
+    mAudioEncoderSetupUs = 0;
+    if (hasAudio && mVideoSource < VIDEO_SOURCE_LIST_END) {
+        IPCThreadState *ipc = IPCThreadState::self();
+        mAudioEncoderCallingIdentity =
+            ((int64_t)ipc->getCallingUid() << 32) | (uint32_t)ipc->getCallingPid();
+
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+        audioThreadStarted =
+            pthread_create(&audioThread, &attr, AudioEncoderThread, this) == 0;
+        pthread_attr_destroy(&attr);
+        if (!audioThreadStarted) {
+            ALOGW("could not start the audio encoder set up thread");
+        }
+    }
+
+    int64_t videoSetupUs = 0;
     if (mVideoSource < VIDEO_SOURCE_LIST_END) {
         setDefaultVideoEncoderIfNecessary();
 
         sp<MediaSource> mediaSource;
         err = setupMediaSource(&mediaSource);
-        if (err != OK) {
-            return err;
-        }
 
         sp<MediaSource> encoder;
-        err = setupVideoEncoder(mediaSource, &encoder);
+        if (err == OK) {
+            err = setupVideoEncoder(mediaSource, &encoder);
+        }
+        videoSetupUs = systemTime() / 1000 - setupStartUs;
+
+        if (audioThreadStarted) {
+            void *dummy;
+            pthread_join(audioThread, &dummy);
+            if (err != OK && mAudioEncoderPending != NULL) {
+                mAudioEncoderPending.clear();
+                mAudioEncoderOMX.clear();
+                mAudioSourceNode.clear();
+            }
+        }
         if (err != OK) {
             return err;
         }
@@ -1823,9 +1913,18 @@ status_t StagefrightRecorder::setupMPEG4orWEBMRecording() {
         // Audio source is added at the end if it exists.
         // This help make sure that the "recoding" sound is suppressed for
         // camcorder applications in the recorded files.
-        // TODO Audio source is currently unsupported for webm output; vorbis encoder needed.
-        if (!mCaptureTimeLapse && (mAudioSource != AUDIO_SOURCE_CNT)) {
-            err = setupAudioEncoder(writer);
+        if (hasAudio) {
+            if (audioThreadStarted) {
+                err = mAudioEncoderStatus;
+                if (err == OK) {
+                    writer->addSource(mAudioEncoderPending);
+                }
+                mAudioEncoderPending.clear();
+            } else {
+                int64_t startUs = systemTime() / 1000;
+                err = setupAudioEncoder(writer);
+                mAudioEncoderSetupUs = systemTime() / 1000 - startUs;
+            }
             if (err != OK) return err;
             mTotalBitRate += mAudioBitRate;
         }
@@ -1858,6 +1957,10 @@ status_t StagefrightRecorder::setupMPEG4orWEBMRecording() {
 
     writer->setListener(mListener);
     mWriter = writer;
+
+    ALOGI("recorder set up in %" PRId64 " us: video %" PRId64 " us, audio %" PRId64 " us%s",
+            systemTime() / 1000 - setupStartUs, videoSetupUs, mAudioEncoderSetupUs,
+            audioThreadStarted ? " (in parallel)" : "");
     return OK;
 }
 
@@ -1871,6 +1974,9 @@ void StagefrightRecorder::setupMPEG4orWEBMMetaData(sp<MetaData> *meta) {
     }
     if (mOutputFormat != OUTPUT_FORMAT_WEBM) {
         (*meta)->setInt32(kKey64BitFileOffset, mUse64BitFileOffset);
+        if (mMovieFragmentDurationUs > 0) {
+            (*meta)->setInt64(kKeyMovieFragmentDurationUs, mMovieFragmentDurationUs);
+        }
         if (mTrackEveryTimeDurationUs > 0) {
             (*meta)->setInt64(kKeyTrackTimeStatus, mTrackEveryTimeDurationUs);
         }
@@ -2010,6 +2116,7 @@ status_t StagefrightRecorder::reset() {
     mIFramesIntervalSec = 1;
     mAudioSourceNode = 0;
     mUse64BitFileOffset = false;
+    mMovieFragmentDurationUs = 0;
     mMovieTimeScale  = -1;
     mAudioTimeScale  = -1;
     mVideoTimeScale  = -1;
@@ -2023,6 +2130,7 @@ status_t StagefrightRecorder::reset() {
     mCaptureTimeLapse = false;
     mTimeBetweenTimeLapseFrameCaptureUs = -1;
     mCameraSourceTimeLapse = NULL;
+    mCameraSource = NULL;
     mIsMetaDataStoredInVideoBuffers = false;
     mEncoderProfiles = MediaProfiles::getInstance();
     mRotationDegrees = 0;
@@ -2077,6 +2185,8 @@ status_t StagefrightRecorder::dump(
     result.append(buffer);
     snprintf(buffer, SIZE, "     Interleave duration (us): %d\n", mInterleaveDurationUs);
     result.append(buffer);
+    snprintf(buffer, SIZE, "     Movie fragment duration (us): %" PRId64 "\n", mMovieFragmentDurationUs);
+    result.append(buffer);
     snprintf(buffer, SIZE, "     Progress notification: %" PRId64 " us\n", mTrackEveryTimeDurationUs);
     result.append(buffer);
     snprintf(buffer, SIZE, "   Audio\n");
@@ -2116,6 +2226,9 @@ status_t StagefrightRecorder::dump(
     snprintf(buffer, SIZE, "     Bit rate (bps): %d\n", mVideoBitRate);
     result.append(buffer);
     ::write(fd, result.string(), result.size());
+    if (mCameraSource != 0) {
+        mCameraSource->dump(fd, args);
+    }
     return OK;
 }
 
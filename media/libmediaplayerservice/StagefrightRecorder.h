@@ -108,6 +108,7 @@ private:
     int32_t mAudioChannels;
     int32_t mSampleRate;
     int32_t mInterleaveDurationUs;
+    int64_t mMovieFragmentDurationUs;
     int32_t mIFramesIntervalSec;
     int32_t mCameraId;
     int32_t mVideoEncoderProfile;
@@ -127,6 +128,7 @@ private:
     bool mCaptureTimeLapse;
     int64_t mTimeBetweenTimeLapseFrameCaptureUs;
     sp<CameraSourceTimeLapse> mCameraSourceTimeLapse;
+    sp<CameraSource> mCameraSource;
 
 
     String8 mParams;
@@ -145,6 +147,14 @@ private:
 
     sp<RecorderExtendedStats> mRecorderExtendedStats;
 
+    // set up on AudioEncoderThread while the video encoder is
+    sp<MediaSource> mAudioEncoderPending;
+    status_t mAudioEncoderStatus;
+    int64_t mAudioEncoderSetupUs;
+    int64_t mAudioEncoderCallingIdentity;
+
+    static void *AudioEncoderThread(void *me);
+
     status_t prepareInternal();
     status_t setupMPEG4orWEBMRecording();
     void setupMPEG4orWEBMMetaData(sp<MetaData> *meta);
@@ -163,6 +173,7 @@ private:
     status_t setupMediaSource(sp<MediaSource> *mediaSource);
     status_t setupCameraSource(sp<CameraSource> *cameraSource);
     status_t setupAudioEncoder(const sp<MediaWriter>& writer);
+    status_t createAudioEncoder(sp<MediaSource> *audioEncoder);
     status_t setupVideoEncoder(sp<MediaSource> cameraSource, sp<MediaSource> *source);
 
     // Encoding parameter handling utilities
@@ -183,6 +194,7 @@ private:
     status_t setParamTrackTimeStatus(int64_t timeDurationUs);
     status_t setParamInterleaveDuration(int32_t durationUs);
     status_t setParam64BitFileOffset(bool use64BitFileOffset);
+    status_t setParamMovieFragmentDuration(int64_t durationUs);
     status_t setParamMaxFileDurationUs(int64_t timeUs);
     status_t setParamMaxFileSizeBytes(int64_t bytes);
     status_t setParamMovieTimeScale(int32_t timeScale);
@@ -328,7 +328,8 @@ VideoFrameScheduler::VideoFrameScheduler()
       mVsyncPeriod(0),
       mVsyncRefreshAt(0),
       mLastVsyncTime(-1),
-      mTimeCorrection(0) {
+      mTimeCorrection(0),
+      mVideoPeriod(-1) {
 }
 
 void VideoFrameScheduler::updateVsync() {
@@ -364,6 +365,7 @@ void VideoFrameScheduler::init(float videoFps) {
 
     mLastVsyncTime = -1;
     mTimeCorrection = 0;
+    mVideoPeriod = videoFps > 0.f ? (nsecs_t)(1e9 / videoFps + 0.5) : -1;
 
     mPll.reset(videoFps);
 }
@@ -382,6 +384,10 @@ nsecs_t VideoFrameScheduler::getVsyncPeriod() {
     return kDefaultVsyncPeriod;
 }
 
+nsecs_t VideoFrameScheduler::getVideoPeriod() const {
+    return mVideoPeriod;
+}
+
 nsecs_t VideoFrameScheduler::schedule(nsecs_t renderTime) {
     nsecs_t origRenderTime = renderTime;
 
@@ -407,6 +413,7 @@ nsecs_t VideoFrameScheduler::schedule(nsecs_t renderTime) {
     renderTime -= mVsyncPeriod / 2;
 
     const nsecs_t videoPeriod = mPll.addSample(origRenderTime);
+    mVideoPeriod = videoPeriod > 0 ? videoPeriod : -1;
     if (videoPeriod > 0) {
         // Smooth out rendering
         size_t N = 12;
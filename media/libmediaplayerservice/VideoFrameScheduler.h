@@ -39,6 +39,10 @@ struct VideoFrameScheduler : public RefBase {
     // returns the vsync period for the main display
     nsecs_t getVsyncPeriod();
 
+    // returns the period of the frames scheduled so far, -1 until the PLL has
+    // an estimate
+    nsecs_t getVideoPeriod() const;
+
     void release();
 
     static const size_t kHistorySize = 8;
@@ -85,6 +89,7 @@ private:
 
     nsecs_t mLastVsyncTime;    // estimated vsync time for last frame
     nsecs_t mTimeCorrection;   // running adjustment
+    nsecs_t mVideoPeriod;      // PLL estimate as of the last frame
 
     PLL mPll;                  // PLL for video frame rate based on render time
 
@@ -24,6 +24,7 @@
 #include <media/IMediaHTTPService.h>
 #include <media/stagefright/foundation/ABuffer.h>
 #include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
 #include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/DataSource.h>
 #include <media/stagefright/FileSource.h>
@@ -41,8 +42,29 @@
 #include "../../libstagefright/include/FLACDecoder.h"
 #endif
 
+#include <cutils/properties.h>
+
+#include <stdlib.h>
+
 namespace android {
 
+// How far ahead of the decoders the audio and video readers read, further
+// from the network for a slow read there to be ridden out.
+static const int64_t kLocalLookaheadUs = 1000000ll;
+static const int64_t kNetworkLookaheadUs = 5000000ll;
+
+static int64_t getLookaheadUs(const char *property, int64_t defaultUs) {
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get(property, value, NULL)) {
+        char *end;
+        long ms = strtol(value, &end, 10);
+        if (end > value && *end == '\0' && ms >= 0) {
+            return ms * 1000ll;
+        }
+    }
+    return defaultUs;
+}
+
 NuPlayer::GenericSource::GenericSource(
         const sp<AMessage> &notify,
         bool uidValid,
@@ -59,7 +81,8 @@ NuPlayer::GenericSource::GenericSource(
       mMetaDataSize(-1ll),
       mBitrate(-1ll),
       mPollBufferingGeneration(0),
-      mPendingReadBufferTypes(0) {
+      mPendingReadBufferTypes(0),
+      mLookaheadUs(0ll) {
     resetDataSource();
     DataSource::RegisterDefaultSniffers();
 }
@@ -240,6 +263,10 @@ status_t NuPlayer::GenericSource::initFromDataSource() {
 
     mBitrate = totalBitrate;
 
+    if (mCachedSource != NULL && mBitrate > 0) {
+        mCachedSource->setStreamBitrate(mBitrate);
+    }
+
     return OK;
 }
 
@@ -274,6 +301,9 @@ status_t NuPlayer::GenericSource::setBuffers(
 }
 
 NuPlayer::GenericSource::~GenericSource() {
+    stopReader(&mAudioTrack, "audio");
+    stopReader(&mVideoTrack, "video");
+
     if (mLooper != NULL) {
         mLooper->unregisterHandler(id());
         mLooper->stop();
@@ -358,6 +388,20 @@ void NuPlayer::GenericSource::onPrepareAsync() {
         return;
     }
 
+    // With a lookahead of 0 the source looper reads the tracks, as it does
+    // those of Widevine.
+    if (mHttpSource != NULL || mCachedSource != NULL) {
+        mLookaheadUs = getLookaheadUs(
+                "media.nuplayer.network-lookahead-ms", kNetworkLookaheadUs);
+    } else {
+        mLookaheadUs = getLookaheadUs(
+                "media.nuplayer.local-lookahead-ms", kLocalLookaheadUs);
+    }
+    if (!mIsWidevine && mLookaheadUs > 0) {
+        startReader(&mAudioTrack, "generic audio");
+        startReader(&mVideoTrack, "generic video");
+    }
+
     if (mVideoTrack.mSource != NULL) {
         sp<MetaData> meta = doGetFormatMeta(false /* audio */);
         sp<AMessage> msg = new AMessage;
@@ -628,49 +672,7 @@ void NuPlayer::GenericSource::onMessageReceived(const sp<AMessage> &msg) {
 
       case kWhatChangeAVSource:
       {
-          int32_t trackIndex;
-          CHECK(msg->findInt32("trackIndex", &trackIndex));
-          const sp<MediaSource> source = mSources.itemAt(trackIndex);
-
-          Track* track;
-          const char *mime;
-          media_track_type trackType, counterpartType;
-          sp<MetaData> meta = source->getFormat();
-          meta->findCString(kKeyMIMEType, &mime);
-          if (!strncasecmp(mime, "audio/", 6)) {
-              track = &mAudioTrack;
-              trackType = MEDIA_TRACK_TYPE_AUDIO;
-              counterpartType = MEDIA_TRACK_TYPE_VIDEO;;
-          } else {
-              CHECK(!strncasecmp(mime, "video/", 6));
-              track = &mVideoTrack;
-              trackType = MEDIA_TRACK_TYPE_VIDEO;
-              counterpartType = MEDIA_TRACK_TYPE_AUDIO;;
-          }
-
-
-          if (track->mSource != NULL) {
-              track->mSource->stop();
-          }
-          track->mSource = source;
-          track->mSource->start();
-          track->mIndex = trackIndex;
-
-          status_t avail;
-          if (!track->mPackets->hasBufferAvailable(&avail)) {
-              // sync from other source
-              TRESPASS();
-              break;
-          }
-
-          int64_t timeUs, actualTimeUs;
-          const bool formatChange = true;
-          sp<AMessage> latestMeta = track->mPackets->getLatestEnqueuedMeta();
-          CHECK(latestMeta != NULL && latestMeta->findInt64("timeUs", &timeUs));
-          readBuffer(trackType, timeUs, &actualTimeUs, formatChange);
-          readBuffer(counterpartType, -1, NULL, formatChange);
-          ALOGV("timeUs %lld actualTimeUs %lld", timeUs, actualTimeUs);
-
+          onChangeAVSource(msg);
           break;
       }
       case kWhatPollBuffering:
@@ -733,6 +735,121 @@ void NuPlayer::GenericSource::onMessageReceived(const sp<AMessage> &msg) {
     }
 }
 
+void NuPlayer::GenericSource::startReader(Track *track, const char *name) {
+    if (track->mSource == NULL) {
+        return;
+    }
+
+    track->mNumReads = 0;
+    track->mTotalReadTimeUs = 0ll;
+    track->mMaxReadTimeUs = 0ll;
+    track->mNumUnderruns = 0;
+    track->mUnderrun = true;
+    track->mNumBufferedSamples = 0;
+    track->mTotalBufferedUs = 0ll;
+
+    track->mReaderLooper = new ALooper;
+    track->mReaderLooper->setName(name);
+    track->mReaderLooper->start();
+
+    track->mReader = new AHandlerReflector<GenericSource>(this);
+    track->mReaderLooper->registerHandler(track->mReader);
+}
+
+void NuPlayer::GenericSource::stopReader(Track *track, const char *name) {
+    if (track->mReaderLooper == NULL) {
+        return;
+    }
+
+    track->mReaderLooper->unregisterHandler(track->mReader->id());
+    track->mReaderLooper->stop();
+
+    if (track->mNumReads > 0) {
+        ALOGI("%s: %zu reads, %.2f ms on average, %.2f ms at most, "
+                "%zu underruns, %.2f s buffered on average",
+                name, track->mNumReads,
+                track->mTotalReadTimeUs / 1E3 / track->mNumReads,
+                track->mMaxReadTimeUs / 1E3,
+                track->mNumUnderruns,
+                track->mNumBufferedSamples > 0
+                    ? track->mTotalBufferedUs / 1E6 / track->mNumBufferedSamples
+                    : 0.0);
+    }
+}
+
+NuPlayer::GenericSource::Track *NuPlayer::GenericSource::getReadAheadTrack(
+        media_track_type trackType) {
+    Track *track = NULL;
+    if (trackType == MEDIA_TRACK_TYPE_AUDIO) {
+        track = &mAudioTrack;
+    } else if (trackType == MEDIA_TRACK_TYPE_VIDEO) {
+        track = &mVideoTrack;
+    }
+    return (track != NULL && track->mReader != NULL) ? track : NULL;
+}
+
+void NuPlayer::GenericSource::onChangeAVSource(sp<AMessage> msg) {
+    int32_t trackIndex;
+    CHECK(msg->findInt32("trackIndex", &trackIndex));
+    const sp<MediaSource> source = mSources.itemAt(trackIndex);
+
+    Track* track;
+    const char *mime;
+    media_track_type trackType, counterpartType;
+    sp<MetaData> meta = source->getFormat();
+    meta->findCString(kKeyMIMEType, &mime);
+    if (!strncasecmp(mime, "audio/", 6)) {
+        track = &mAudioTrack;
+        trackType = MEDIA_TRACK_TYPE_AUDIO;
+        counterpartType = MEDIA_TRACK_TYPE_VIDEO;;
+    } else {
+        CHECK(!strncasecmp(mime, "video/", 6));
+        track = &mVideoTrack;
+        trackType = MEDIA_TRACK_TYPE_VIDEO;
+        counterpartType = MEDIA_TRACK_TYPE_AUDIO;;
+    }
+
+    const bool formatChange = true;
+    uint32_t replyID;
+    bool onReader = msg->senderAwaitsResponse(&replyID);
+    if (track->mReader != NULL && !onReader) {
+        // The reader changes the source, for it not to be read meanwhile.
+        sp<AMessage> readerMsg =
+            new AMessage(kWhatChangeAVSource, track->mReader->id());
+        readerMsg->setInt32("trackIndex", trackIndex);
+
+        sp<AMessage> response;
+        (void)readerMsg->postAndAwaitResponse(&response);
+    } else {
+        if (track->mSource != NULL) {
+            track->mSource->stop();
+        }
+        track->mSource = source;
+        track->mSource->start();
+        track->mIndex = trackIndex;
+
+        status_t avail;
+        if (!track->mPackets->hasBufferAvailable(&avail)) {
+            // sync from other source
+            TRESPASS();
+            return;
+        }
+
+        int64_t timeUs, actualTimeUs;
+        sp<AMessage> latestMeta = track->mPackets->getLatestEnqueuedMeta();
+        CHECK(latestMeta != NULL && latestMeta->findInt64("timeUs", &timeUs));
+        readBuffer(trackType, timeUs, &actualTimeUs, formatChange);
+        ALOGV("timeUs %lld actualTimeUs %lld", timeUs, actualTimeUs);
+
+        if (onReader) {
+            (new AMessage)->postReply(replyID);
+            return;
+        }
+    }
+
+    readBufferAndWait(counterpartType, -1, NULL, formatChange);
+}
+
 void NuPlayer::GenericSource::fetchTextData(
         uint32_t sendWhat,
         media_track_type type,
@@ -854,12 +971,29 @@ status_t NuPlayer::GenericSource::dequeueAccessUnit(
 
     status_t finalResult;
     if (!track->mPackets->hasBufferAvailable(&finalResult)) {
+        if (finalResult == OK && track->mReader != NULL
+                && mStarted && !track->mUnderrun) {
+            track->mUnderrun = true;
+            ++track->mNumUnderruns;
+        }
         return (finalResult == OK ? -EWOULDBLOCK : finalResult);
     }
 
     status_t result = track->mPackets->dequeueAccessUnit(accessUnit);
 
-    if (!track->mPackets->hasBufferAvailable(&finalResult)) {
+    if (track->mReader != NULL) {
+        // The reader fills the track up to the lookahead again once it is
+        // half empty, for it not to wake up for every access unit.
+        int64_t bufferedUs = track->mPackets->getBufferedDurationUs(&finalResult);
+        if (result == OK) {
+            track->mUnderrun = false;
+            ++track->mNumBufferedSamples;
+            track->mTotalBufferedUs += bufferedUs;
+        }
+        if (finalResult == OK && bufferedUs < mLookaheadUs / 2) {
+            postReadBuffer(audio? MEDIA_TRACK_TYPE_AUDIO : MEDIA_TRACK_TYPE_VIDEO);
+        }
+    } else if (!track->mPackets->hasBufferAvailable(&finalResult)) {
         postReadBuffer(audio? MEDIA_TRACK_TYPE_AUDIO : MEDIA_TRACK_TYPE_VIDEO);
     }
 
@@ -1141,13 +1275,15 @@ status_t NuPlayer::GenericSource::doSeek(int64_t seekTimeUs) {
     }
     if (mVideoTrack.mSource != NULL) {
         int64_t actualTimeUs;
-        readBuffer(MEDIA_TRACK_TYPE_VIDEO, seekTimeUs, &actualTimeUs);
+        readBufferAndWait(MEDIA_TRACK_TYPE_VIDEO, seekTimeUs, &actualTimeUs);
 
         seekTimeUs = actualTimeUs;
+        mVideoTrack.mUnderrun = true;
     }
 
     if (mAudioTrack.mSource != NULL) {
-        readBuffer(MEDIA_TRACK_TYPE_AUDIO, seekTimeUs);
+        readBufferAndWait(MEDIA_TRACK_TYPE_AUDIO, seekTimeUs);
+        mAudioTrack.mUnderrun = true;
     }
 
     setDrmPlaybackStatusIfNeeded(Playback::START, seekTimeUs / 1000);
@@ -1228,7 +1364,9 @@ void NuPlayer::GenericSource::postReadBuffer(media_track_type trackType) {
 
     if ((mPendingReadBufferTypes & (1 << trackType)) == 0) {
         mPendingReadBufferTypes |= (1 << trackType);
-        sp<AMessage> msg = new AMessage(kWhatReadBuffer, id());
+        Track *track = getReadAheadTrack(trackType);
+        sp<AMessage> msg = new AMessage(
+                kWhatReadBuffer, track != NULL ? track->mReader->id() : id());
         msg->setInt32("trackType", trackType);
         msg->post();
     }
@@ -1238,6 +1376,24 @@ void NuPlayer::GenericSource::onReadBuffer(sp<AMessage> msg) {
     int32_t tmpType;
     CHECK(msg->findInt32("trackType", &tmpType));
     media_track_type trackType = (media_track_type)tmpType;
+
+    uint32_t replyID;
+    if (msg->senderAwaitsResponse(&replyID)) {
+        // from readBufferAndWait
+        int64_t seekTimeUs;
+        int32_t formatChange;
+        CHECK(msg->findInt64("seekTimeUs", &seekTimeUs));
+        CHECK(msg->findInt32("formatChange", &formatChange));
+
+        int64_t actualTimeUs;
+        readBuffer(trackType, seekTimeUs, &actualTimeUs, formatChange);
+
+        sp<AMessage> response = new AMessage;
+        response->setInt64("actualTimeUs", actualTimeUs);
+        response->postReply(replyID);
+        return;
+    }
+
     {
         // only protect the variable change, as readBuffer may
         // take considerable time.  This may result in one extra
@@ -1246,6 +1402,40 @@ void NuPlayer::GenericSource::onReadBuffer(sp<AMessage> msg) {
         mPendingReadBufferTypes &= ~(1 << trackType);
     }
     readBuffer(trackType);
+
+    // Read on, a few buffers at a time for a seek not to wait long behind
+    // the reads, until the lookahead is buffered.
+    Track *track = getReadAheadTrack(trackType);
+    if (track != NULL && !mStopRead) {
+        status_t finalResult;
+        int64_t bufferedUs = track->mPackets->getBufferedDurationUs(&finalResult);
+        if (finalResult == OK && bufferedUs < mLookaheadUs) {
+            postReadBuffer(trackType);
+        }
+    }
+}
+
+void NuPlayer::GenericSource::readBufferAndWait(
+        media_track_type trackType, int64_t seekTimeUs, int64_t *actualTimeUs, bool formatChange) {
+    Track *track = getReadAheadTrack(trackType);
+    if (track == NULL) {
+        readBuffer(trackType, seekTimeUs, actualTimeUs, formatChange);
+        return;
+    }
+
+    sp<AMessage> msg = new AMessage(kWhatReadBuffer, track->mReader->id());
+    msg->setInt32("trackType", trackType);
+    msg->setInt64("seekTimeUs", seekTimeUs);
+    msg->setInt32("formatChange", formatChange);
+
+    int64_t timeUs = seekTimeUs;
+    sp<AMessage> response;
+    if (msg->postAndAwaitResponse(&response) == OK && response != NULL) {
+        CHECK(response->findInt64("actualTimeUs", &timeUs));
+    }
+    if (actualTimeUs) {
+        *actualTimeUs = timeUs;
+    }
 }
 
 void NuPlayer::GenericSource::readBuffer(
@@ -1304,8 +1494,18 @@ void NuPlayer::GenericSource::readBuffer(
 
     for (size_t numBuffers = 0; numBuffers < maxBuffers; ) {
         MediaBuffer *mbuf;
+        int64_t startUs = ALooper::GetNowUs();
         status_t err = track->mSource->read(&mbuf, &options);
 
+        if (track->mReader != NULL) {
+            int64_t readTimeUs = ALooper::GetNowUs() - startUs;
+            ++track->mNumReads;
+            track->mTotalReadTimeUs += readTimeUs;
+            if (readTimeUs > track->mMaxReadTimeUs) {
+                track->mMaxReadTimeUs = readTimeUs;
+            }
+        }
+
         options.clearSeekTo();
 
         if (err == OK) {
@@ -24,6 +24,7 @@
 #include "ATSParser.h"
 
 #include <media/mediaplayer.h>
+#include <media/stagefright/foundation/AHandlerReflector.h>
 
 namespace android {
 
@@ -80,6 +81,8 @@ protected:
     virtual sp<MetaData> getFormatMeta(bool audio);
 
 private:
+    friend struct AHandlerReflector<GenericSource>;
+
     enum {
         kWhatPrepareAsync,
         kWhatFetchSubtitleData,
@@ -102,6 +105,22 @@ private:
         size_t mIndex;
         sp<MediaSource> mSource;
         sp<AnotherPacketSource> mPackets;
+
+        // Reads the track ahead of the decoder, up to mLookaheadUs, on a
+        // looper of its own for a slow read of one track not to hold up the
+        // other. NULL if the source looper reads it, as it does subtitles
+        // and Widevine.
+        sp<ALooper> mReaderLooper;
+        sp<AHandlerReflector<GenericSource> > mReader;
+
+        // buffer level metrics, logged once done
+        size_t mNumReads;
+        int64_t mTotalReadTimeUs;
+        int64_t mMaxReadTimeUs;
+        size_t mNumUnderruns;
+        bool mUnderrun;
+        size_t mNumBufferedSamples;
+        int64_t mTotalBufferedUs;
     };
 
     Track mAudioTrack;
@@ -141,6 +160,7 @@ private:
     int32_t mPollBufferingGeneration;
     uint32_t mPendingReadBufferTypes;
     mutable Mutex mReadBufferLock;
+    int64_t mLookaheadUs;
 
     sp<ALooper> mLooper;
 
@@ -182,12 +202,23 @@ private:
             media_track_type trackType,
             int64_t *actualTimeUs = NULL);
 
+    void startReader(Track *track, const char *name);
+    void stopReader(Track *track, const char *name);
+    Track *getReadAheadTrack(media_track_type trackType);
+
+    void onChangeAVSource(sp<AMessage> msg);
+
     void postReadBuffer(media_track_type trackType);
     void onReadBuffer(sp<AMessage> msg);
     void readBuffer(
             media_track_type trackType,
             int64_t seekTimeUs = -1ll, int64_t *actualTimeUs = NULL, bool formatChange = false);
 
+    // readBuffer, on the track's reader if it has one, waiting for it.
+    void readBufferAndWait(
+            media_track_type trackType,
+            int64_t seekTimeUs = -1ll, int64_t *actualTimeUs = NULL, bool formatChange = false);
+
     void schedulePollBuffering();
     void cancelPollBuffering();
     void onPollBuffering();
@@ -48,14 +48,25 @@
 #include "ESDS.h"
 #include <media/stagefright/Utils.h>
 
+#include <cutils/properties.h>
+
 namespace android {
 
 static int64_t kLowWaterMarkUs = 2000000ll;  // 2secs
 static int64_t kHighWaterMarkUs = 5000000ll;  // 5secs
 
-// TODO optimize buffer size for power consumption
-// The offload read buffer size is 32 KB but 24 KB uses less power.
+// Seeks closer together than this are a scrub, which ends this long after
+// the last one.
+static const int64_t kScrubIntervalUs = 250000ll;
+
+// The offload read buffer size is 32 KB but 24 KB uses less power, which is
+// 1.5 s of a 128 kbps stream. Streams of a known bitrate get buffers holding
+// as long of them, for a low bitrate not to wait long for a buffer to fill
+// nor a high one to wake the renderer up often, see getAggregateBufferSize.
 const size_t NuPlayer::kAggregateBufferSizeBytes = 24 * 1024;
+static const int64_t kAggregateDurationUs = 1500000ll;
+static const size_t kMinAggregateBufferSizeBytes = 8 * 1024;
+static const size_t kMaxAggregateBufferSizeBytes = 64 * 1024;
 
 struct NuPlayer::Action : public RefBase {
     Action() {}
@@ -67,18 +78,27 @@ private:
 };
 
 struct NuPlayer::SeekAction : public Action {
-    SeekAction(int64_t seekTimeUs, bool needNotify)
+    SeekAction(int64_t seekTimeUs, bool needNotify, bool exact)
         : mSeekTimeUs(seekTimeUs),
-          mNeedNotify(needNotify) {
+          mNeedNotify(needNotify),
+          mExact(exact) {
+    }
+
+    // to a seek requested before this one was done, notified once for both
+    void update(int64_t seekTimeUs, bool needNotify, bool exact) {
+        mSeekTimeUs = seekTimeUs;
+        mNeedNotify = mNeedNotify || needNotify;
+        mExact = exact;
     }
 
     virtual void execute(NuPlayer *player) {
-        player->performSeek(mSeekTimeUs, mNeedNotify);
+        player->performSeek(mSeekTimeUs, mNeedNotify, mExact);
     }
 
 private:
     int64_t mSeekTimeUs;
     bool mNeedNotify;
+    bool mExact;
 
     DISALLOW_EVIL_CONSTRUCTORS(SeekAction);
 };
@@ -167,6 +187,7 @@ NuPlayer::NuPlayer()
       mPollDurationGeneration(0),
       mTimedTextGeneration(0),
       mTimeDiscontinuityPending(false),
+      mAggregateBufferSizeBytes(kAggregateBufferSizeBytes),
       mFlushingAudio(NONE),
       mFlushingVideo(NONE),
       mSkipRenderingAudioUntilMediaTimeUs(-1ll),
@@ -176,9 +197,25 @@ NuPlayer::NuPlayer()
       mVideoScalingMode(NATIVE_WINDOW_SCALING_MODE_SCALE_TO_WINDOW),
       mStarted(false),
       mBuffering(false),
-      mPlaying(false) {
+      mPlaying(false),
+      mScrubMode(true),
+      mScrubbing(false),
+      mScrubFrameRendered(false),
+      mLastSeekRequestUs(-1ll),
+      mScrubSeekTimeUs(-1ll),
+      mScrubGeneration(0),
+      mExactSeekAudioTimeUs(-1ll),
+      mExactSeekVideoTimeUs(-1ll),
+      mFastStart(false),
+      mPrerolled(false) {
 
     clearFlushComplete();
+
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("media.nuplayer.scrub", value, NULL)
+            && (!strcmp(value, "0") || !strcasecmp(value, "false"))) {
+        mScrubMode = false;
+    }
     mPlayerExtendedStats = (PlayerExtendedStats *)ExtendedStats::Create(
             ExtendedStats::PLAYER, "NuPlayer", gettid());
 }
@@ -413,6 +450,10 @@ void NuPlayer::onMessageReceived(const sp<AMessage> &msg) {
 
         case kWhatPrepare:
         {
+            char value[PROPERTY_VALUE_MAX];
+            mFastStart = property_get("media.nuplayer.fast-start", value, NULL)
+                    && (!strcmp(value, "1") || !strcasecmp(value, "true"));
+
             mSource->prepareAsync();
             break;
         }
@@ -453,6 +494,31 @@ void NuPlayer::onMessageReceived(const sp<AMessage> &msg) {
             break;
         }
 
+        case kWhatGetCodecMetrics:
+        {
+            uint32_t replyID;
+            CHECK(msg->senderAwaitsResponse(&replyID));
+
+            int32_t audio;
+            CHECK(msg->findInt32("audio", &audio));
+
+            sp<AMessage> response = new AMessage;
+            response->setObject("decoder", getDecoder(audio));
+            response->postReply(replyID);
+            break;
+        }
+
+        case kWhatGetRenderer:
+        {
+            uint32_t replyID;
+            CHECK(msg->senderAwaitsResponse(&replyID));
+
+            sp<AMessage> response = new AMessage;
+            response->setObject("renderer", mRenderer);
+            response->postReply(replyID);
+            break;
+        }
+
         case kWhatGetSelectedTrack:
         {
             status_t err = INVALID_OPERATION;
@@ -572,7 +638,8 @@ void NuPlayer::onMessageReceived(const sp<AMessage> &msg) {
                     int64_t currentPositionUs = 0;
                     if (getCurrentPosition(&currentPositionUs) == OK) {
                         mDeferredActions.push_back(
-                                new SeekAction(currentPositionUs, false /* needNotify */));
+                                new SeekAction(currentPositionUs,
+                                        false /* needNotify */, false /* exact */));
                     }
                 }
 
@@ -601,75 +668,15 @@ void NuPlayer::onMessageReceived(const sp<AMessage> &msg) {
         {
             ALOGV("kWhatStart");
 
-            mVideoIsAVC = false;
-            mOffloadAudio = false;
-            mAudioEOS = false;
-            mVideoEOS = false;
-            mSkipRenderingAudioUntilMediaTimeUs = -1;
-            mSkipRenderingVideoUntilMediaTimeUs = -1;
-            mNumFramesTotal = 0;
-            mNumFramesDropped = 0;
-            mStarted = true;
-
-            /* instantiate decoders now for secure playback */
-            if (mSourceFlags & Source::FLAG_SECURE) {
-                if (mNativeWindow != NULL) {
-                    instantiateDecoder(false, &mVideoDecoder);
-                }
-
-                if (mAudioSink != NULL) {
-                    instantiateDecoder(true, &mAudioDecoder);
-                }
-            }
-
-            mSource->start();
-
-            uint32_t flags = 0;
-
-            if (mSource->isRealTime()) {
-                flags |= Renderer::FLAG_REAL_TIME;
-            }
-
-            sp<MetaData> audioMeta = mSource->getFormatMeta(true /* audio */);
-            audio_stream_type_t streamType = AUDIO_STREAM_MUSIC;
-            if (mAudioSink != NULL) {
-                streamType = mAudioSink->getAudioStreamType();
-            }
-
-            sp<AMessage> videoFormat = mSource->getFormat(false /* audio */);
-            sp<MetaData> vMeta = new MetaData;
-            convertMessageToMetaData(videoFormat, vMeta);
-
-            mOffloadAudio =
-                canOffloadStream(audioMeta, (videoFormat != NULL), vMeta,
-                                 mIsStreaming /* is_streaming */, streamType);
-            if (mOffloadAudio) {
-                flags |= Renderer::FLAG_OFFLOAD_AUDIO;
-            }
-
-            sp<AMessage> notify = new AMessage(kWhatRendererNotify, id());
-            ++mRendererGeneration;
-            notify->setInt32("generation", mRendererGeneration);
-            if (mPlayerExtendedStats != NULL) {
-                notify->setObject(MEDIA_EXTENDED_STATS, mPlayerExtendedStats);
-            }
-            mRenderer = new Renderer(mAudioSink, notify, flags);
-
-            mRendererLooper = new ALooper;
-            mRendererLooper->setName("NuPlayerRenderer");
-            mRendererLooper->start(false, false, ANDROID_PRIORITY_AUDIO);
-            mRendererLooper->registerHandler(mRenderer);
-
-            sp<MetaData> meta = getFileMeta();
-            int32_t rate;
-            if (meta != NULL
-                    && meta->findInt32(kKeyFrameRate, &rate) && rate > 0) {
-                mRenderer->setVideoFrameRate(rate);
-                PLAYER_STATS(setFrameRate, rate);
+            if (mPrerolled) {
+                // decoders are up and the first frame is out already
+                mPrerolled = false;
+                mRenderer->resume();
+                mPlaying = true;
+                break;
             }
 
-            postScanSources();
-            mPlaying = true;
+            onStart();
             break;
         }
 
@@ -959,7 +966,7 @@ void NuPlayer::onMessageReceived(const sp<AMessage> &msg) {
                     mRenderer->flush(false /* audio */);
                 }
 
-                performSeek(positionUs, false /* needNotify */);
+                performSeek(positionUs, false /* needNotify */, false /* exact */);
                 if (reason == Renderer::kDueToError) {
                     mRenderer->signalDisableOffloadAudio();
                     mOffloadAudio = false;
@@ -999,13 +1006,57 @@ void NuPlayer::onMessageReceived(const sp<AMessage> &msg) {
             ALOGV("kWhatSeek seekTimeUs=%lld us, needNotify=%d",
                     seekTimeUs, needNotify);
 
-            mDeferredActions.push_back(
-                    new SimpleAction(&NuPlayer::performDecoderFlush));
+            // While scrubbing each seek lands on a sync frame, which alone
+            // is decoded, and the last one is followed by an exact seek to
+            // where it was asked to, once the seeks stop.
+            int64_t nowUs = ALooper::GetNowUs();
+            if (mScrubMode && mLastSeekRequestUs >= 0
+                    && nowUs - mLastSeekRequestUs < kScrubIntervalUs) {
+                if (!mScrubbing) {
+                    ALOGV("scrubbing");
+                }
+                mScrubbing = true;
+            }
+            mLastSeekRequestUs = nowUs;
 
-            mDeferredActions.push_back(
-                    new SeekAction(seekTimeUs, needNotify));
+            if (mScrubbing) {
+                mScrubSeekTimeUs = seekTimeUs;
 
-            processDeferredActions();
+                sp<AMessage> scrubMsg = new AMessage(kWhatScrubDone, id());
+                scrubMsg->setInt32("generation", ++mScrubGeneration);
+                scrubMsg->post(kScrubIntervalUs);
+            }
+
+            if (mPendingSeek != NULL) {
+                // The decoders are still flushing for a seek that is yet to
+                // be done, which can as well be done to here instead.
+                ALOGV("coalescing the seek with the one pending");
+                mPendingSeek->update(seekTimeUs, needNotify, false /* exact */);
+                break;
+            }
+
+            queueSeek(seekTimeUs, needNotify, false /* exact */);
+            break;
+        }
+
+        case kWhatScrubDone:
+        {
+            int32_t generation;
+            CHECK(msg->findInt32("generation", &generation));
+            if (generation != mScrubGeneration || !mScrubbing) {
+                break;
+            }
+
+            ALOGV("done scrubbing at %lld us", mScrubSeekTimeUs);
+            mScrubbing = false;
+
+            // the client was notified of the scrub's seeks already
+            if (mPendingSeek != NULL) {
+                mPendingSeek->update(
+                        mScrubSeekTimeUs, false /* needNotify */, true /* exact */);
+            } else {
+                queueSeek(mScrubSeekTimeUs, false /* needNotify */, true /* exact */);
+            }
             break;
         }
 
@@ -1146,6 +1197,100 @@ void NuPlayer::finishFlushIfPossible() {
     processDeferredActions();
 }
 
+void NuPlayer::onStart() {
+    mVideoIsAVC = false;
+    mOffloadAudio = false;
+    mAudioEOS = false;
+    mVideoEOS = false;
+    mSkipRenderingAudioUntilMediaTimeUs = -1;
+    mSkipRenderingVideoUntilMediaTimeUs = -1;
+    mNumFramesTotal = 0;
+    mNumFramesDropped = 0;
+    mStarted = true;
+
+    /* instantiate decoders now for secure playback */
+    if (mSourceFlags & Source::FLAG_SECURE) {
+        if (mNativeWindow != NULL) {
+            instantiateDecoder(false, &mVideoDecoder);
+        }
+
+        if (mAudioSink != NULL) {
+            instantiateDecoder(true, &mAudioDecoder);
+        }
+    }
+
+    mSource->start();
+
+    uint32_t flags = 0;
+
+    if (mSource->isRealTime()) {
+        flags |= Renderer::FLAG_REAL_TIME;
+    }
+
+    sp<MetaData> audioMeta = mSource->getFormatMeta(true /* audio */);
+    audio_stream_type_t streamType = AUDIO_STREAM_MUSIC;
+    if (mAudioSink != NULL) {
+        streamType = mAudioSink->getAudioStreamType();
+    }
+
+    sp<AMessage> videoFormat = mSource->getFormat(false /* audio */);
+    sp<MetaData> vMeta = new MetaData;
+    convertMessageToMetaData(videoFormat, vMeta);
+
+    mOffloadAudio =
+        canOffloadStream(audioMeta, (videoFormat != NULL), vMeta,
+                         mIsStreaming /* is_streaming */, streamType);
+    if (mOffloadAudio) {
+        flags |= Renderer::FLAG_OFFLOAD_AUDIO;
+    }
+
+    sp<AMessage> notify = new AMessage(kWhatRendererNotify, id());
+    ++mRendererGeneration;
+    notify->setInt32("generation", mRendererGeneration);
+    if (mPlayerExtendedStats != NULL) {
+        notify->setObject(MEDIA_EXTENDED_STATS, mPlayerExtendedStats);
+    }
+    mRenderer = new Renderer(mAudioSink, notify, flags);
+
+    mRendererLooper = new ALooper;
+    mRendererLooper->setName("NuPlayerRenderer");
+    mRendererLooper->start(false, false, ANDROID_PRIORITY_AUDIO);
+    mRendererLooper->registerHandler(mRenderer);
+
+    sp<MetaData> meta = getFileMeta();
+    int32_t rate;
+    if (meta != NULL
+            && meta->findInt32(kKeyFrameRate, &rate) && rate > 0) {
+        mRenderer->setVideoFrameRate(rate);
+        PLAYER_STATS(setFrameRate, rate);
+    }
+
+    postScanSources();
+    mPlaying = true;
+}
+
+// Starts as onStart does, the renderer paused, for the decoders to be
+// allocated and configured while the client is yet to call start, as soon as
+// the source has the formats for them, and the first video frame to be
+// decoded and posted to the surface, the way it is after a seek while paused.
+// The source is only started for this where that costs nothing while paused:
+// not for a live one, played in real time or not to be paused, nor a secure
+// one, set up at start.
+void NuPlayer::preroll() {
+    if (mSource->isRealTime()
+            || !(mSourceFlags & Source::FLAG_CAN_PAUSE)
+            || (mSourceFlags & Source::FLAG_SECURE)) {
+        return;
+    }
+
+    ALOGV("prerolling");
+
+    onStart();
+    mRenderer->pause();
+    mPlaying = false;
+    mPrerolled = true;
+}
+
 void NuPlayer::postScanSources() {
     if (mScanSourcesPending) {
         return;
@@ -1221,6 +1366,8 @@ status_t NuPlayer::instantiateDecoder(bool audio, sp<Decoder> *decoder) {
         notify->setInt32("generation", mAudioDecoderGeneration);
 
         if (mOffloadAudio) {
+            mAggregateBufferSizeBytes = getAggregateBufferSize(format);
+            format->setInt32("aggregate-buffer-size", mAggregateBufferSizeBytes);
             *decoder = new DecoderPassThrough(notify);
         } else {
             *decoder = new Decoder(notify);
@@ -1285,6 +1432,11 @@ status_t NuPlayer::feedDecoderInputData(bool audio, const sp<AMessage> &msg) {
     bool doBufferAggregation = (audio && mOffloadAudio);
     bool needMoreData = false;
 
+    if (!audio && mScrubbing && mScrubFrameRendered) {
+        // nothing more to decode until the next seek of the scrub
+        return -EWOULDBLOCK;
+    }
+
     bool dropAccessUnit;
     do {
         status_t err;
@@ -1330,7 +1482,18 @@ status_t NuPlayer::feedDecoderInputData(bool audio, const sp<AMessage> &msg) {
                     mSkipRenderingVideoUntilMediaTimeUs = -1;
                 }
 
-                if (timeChange) {
+                int64_t &exactSeekTimeUs =
+                    audio ? mExactSeekAudioTimeUs : mExactSeekVideoTimeUs;
+                if (timeChange && exactSeekTimeUs >= 0) {
+                    ALOGV("rendering %s from %lld us on",
+                            audio ? "audio" : "video", exactSeekTimeUs);
+                    if (audio) {
+                        mSkipRenderingAudioUntilMediaTimeUs = exactSeekTimeUs;
+                    } else {
+                        mSkipRenderingVideoUntilMediaTimeUs = exactSeekTimeUs;
+                    }
+                    exactSeekTimeUs = -1;
+                } else if (timeChange) {
                     sp<AMessage> extra;
                     if (accessUnit->meta()->findMessage("extra", &extra)
                             && extra != NULL) {
@@ -1408,7 +1571,8 @@ status_t NuPlayer::feedDecoderInputData(bool audio, const sp<AMessage> &msg) {
         dropAccessUnit = false;
         if (!audio
                 && !(mSourceFlags & Source::FLAG_SECURE)
-                && mRenderer->getVideoLateByUs() > 100000ll
+                && (mRenderer->getVideoLateByUs() > 100000ll
+                    || isVideoAccessUnitLate(accessUnit))
                 && mVideoIsAVC
                 && !IsAVCReferenceFrame(accessUnit)) {
             dropAccessUnit = true;
@@ -1419,9 +1583,9 @@ status_t NuPlayer::feedDecoderInputData(bool audio, const sp<AMessage> &msg) {
         needMoreData = false;
         if (doBufferAggregation && (mAggregateBuffer == NULL)
                 // Don't bother if only room for a few small buffers.
-                && (smallSize < (kAggregateBufferSizeBytes / 3))) {
+                && (smallSize < (mAggregateBufferSizeBytes / 3))) {
             // Create a larger buffer for combining smaller buffers from the extractor.
-            mAggregateBuffer = new ABuffer(kAggregateBufferSizeBytes);
+            mAggregateBuffer = new ABuffer(mAggregateBufferSizeBytes);
             mAggregateBuffer->setRange(0, 0); // start empty
         }
 
@@ -1488,6 +1652,31 @@ status_t NuPlayer::feedDecoderInputData(bool audio, const sp<AMessage> &msg) {
     return OK;
 }
 
+size_t NuPlayer::getAggregateBufferSize(const sp<AMessage> &format) const {
+    int32_t bitrate;
+    if (!format->findInt32("bitrate", &bitrate) || bitrate <= 0) {
+        return kAggregateBufferSizeBytes;
+    }
+
+    // No larger than the sink's buffer, filled from them when it runs low.
+    size_t maxSize = kMaxAggregateBufferSizeBytes;
+    ssize_t sinkSize = mAudioSink != NULL ? mAudioSink->bufferSize() : -1;
+    if (sinkSize > 0 && (size_t)sinkSize < maxSize) {
+        maxSize = sinkSize;
+    }
+
+    size_t size = (size_t)((int64_t)bitrate * kAggregateDurationUs / 8000000ll);
+    if (size < kMinAggregateBufferSizeBytes) {
+        size = kMinAggregateBufferSizeBytes;
+    }
+    if (size > maxSize) {
+        size = maxSize;
+    }
+
+    ALOGV("aggregating %d bps in buffers of %zu bytes", bitrate, size);
+    return size;
+}
+
 void NuPlayer::renderBuffer(bool audio, const sp<AMessage> &msg) {
     // ALOGV("renderBuffer %s", audio ? "audio" : "video");
 
@@ -1533,6 +1722,10 @@ void NuPlayer::renderBuffer(bool audio, const sp<AMessage> &msg) {
         skipUntilMediaTimeUs = -1;
     }
 
+    if (!audio && mScrubbing) {
+        mScrubFrameRendered = true;
+    }
+
     if (!audio && mCCDecoder->isSelected()) {
         mCCDecoder->display(mediaTimeUs);
     }
@@ -1762,6 +1955,58 @@ void NuPlayer::getStats(int64_t *numFramesTotal, int64_t *numFramesDropped) {
     *numFramesDropped = mNumFramesDropped;
 }
 
+bool NuPlayer::isVideoAccessUnitLate(const sp<ABuffer> &accessUnit) {
+    int64_t timeUs;
+    int64_t positionUs;
+    if (mSource->isRealTime()
+            || !accessUnit->meta()->findInt64("timeUs", &timeUs)
+            || mRenderer->getCurrentPosition(&positionUs) != OK) {
+        return false;
+    }
+
+    // The renderer would drop it once decoded, as more than 40 ms late.
+    return timeUs + 40000ll < positionUs;
+}
+
+status_t NuPlayer::getCodecMetrics(bool audio, sp<AMessage> *metrics) const {
+    sp<AMessage> msg = new AMessage(kWhatGetCodecMetrics, id());
+    msg->setInt32("audio", audio);
+
+    sp<AMessage> response;
+    status_t err = msg->postAndAwaitResponse(&response);
+    if (err != OK) {
+        return err;
+    }
+
+    sp<RefBase> obj;
+    CHECK(response->findObject("decoder", &obj));
+    if (obj == NULL) {
+        return INVALID_OPERATION;
+    }
+
+    // ask the decoder on this thread, not on ours
+    return static_cast<Decoder *>(obj.get())->getCodecMetrics(metrics);
+}
+
+status_t NuPlayer::getAudioRenderStats(sp<AMessage> *stats) const {
+    sp<AMessage> msg = new AMessage(kWhatGetRenderer, id());
+
+    sp<AMessage> response;
+    status_t err = msg->postAndAwaitResponse(&response);
+    if (err != OK) {
+        return err;
+    }
+
+    sp<RefBase> obj;
+    CHECK(response->findObject("renderer", &obj));
+    if (obj == NULL) {
+        return INVALID_OPERATION;
+    }
+
+    static_cast<Renderer *>(obj.get())->getAudioStats(stats);
+    return OK;
+}
+
 sp<MetaData> NuPlayer::getFileMeta() {
     return mSource->getFileFormatMeta();
 }
@@ -1799,11 +2044,31 @@ void NuPlayer::processDeferredActions() {
     }
 }
 
-void NuPlayer::performSeek(int64_t seekTimeUs, bool needNotify) {
-    ALOGV("performSeek seekTimeUs=%lld us (%.2f secs), needNotify(%d)",
+void NuPlayer::queueSeek(int64_t seekTimeUs, bool needNotify, bool exact) {
+    mDeferredActions.push_back(
+            new SimpleAction(&NuPlayer::performDecoderFlush));
+
+    mPendingSeek = new SeekAction(seekTimeUs, needNotify, exact);
+    mDeferredActions.push_back(mPendingSeek);
+
+    processDeferredActions();
+}
+
+void NuPlayer::performSeek(int64_t seekTimeUs, bool needNotify, bool exact) {
+    ALOGV("performSeek seekTimeUs=%lld us (%.2f secs), needNotify(%d), exact(%d)",
           seekTimeUs,
           seekTimeUs / 1E6,
-          needNotify);
+          needNotify,
+          exact);
+
+    mPendingSeek.clear();
+    mScrubFrameRendered = false;
+
+    // The source seeks to the sync frame before seekTimeUs, and the audio to
+    // that frame. For an exact seek both are decoded from there on, but
+    // rendered from seekTimeUs on only.
+    mExactSeekAudioTimeUs = exact ? seekTimeUs : -1ll;
+    mExactSeekVideoTimeUs = exact ? seekTimeUs : -1ll;
 
     if (mSource == NULL) {
         // This happens when reset occurs right before the loop mode
@@ -1878,6 +2143,11 @@ void NuPlayer::performReset() {
     ++mScanSourcesGeneration;
     mScanSourcesPending = false;
 
+    ++mScrubGeneration;
+    mScrubbing = false;
+    mLastSeekRequestUs = -1ll;
+    mPendingSeek.clear();
+
     if (mRendererLooper != NULL) {
         if (mRenderer != NULL) {
             mRendererLooper->unregisterHandler(mRenderer->id());
@@ -1904,6 +2174,7 @@ void NuPlayer::performReset() {
     mStarted = false;
     mBuffering = false;
     mPlaying = false;
+    mPrerolled = false;
     PLAYER_STATS(notifyEOS);
     PLAYER_STATS(dump);
     PLAYER_STATS(reset);
@@ -1966,6 +2237,9 @@ void NuPlayer::onSourceNotify(const sp<AMessage> &msg) {
                 driver->notifyPrepareCompleted(err);
             }
 
+            if (err == OK && mFastStart) {
+                preroll();
+            }
             break;
         }
 
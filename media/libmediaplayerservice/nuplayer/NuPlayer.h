@@ -77,6 +77,8 @@ struct NuPlayer : public AHandler {
     status_t selectTrack(size_t trackIndex, bool select);
     status_t getCurrentPosition(int64_t *mediaUs);
     void getStats(int64_t *mNumFramesTotal, int64_t *mNumFramesDropped);
+    status_t getCodecMetrics(bool audio, sp<AMessage> *metrics) const;
+    status_t getAudioRenderStats(sp<AMessage> *stats) const;
 
     sp<MetaData> getFileMeta();
 
@@ -130,6 +132,9 @@ private:
         kWhatGetTrackInfo               = 'gTrI',
         kWhatGetSelectedTrack           = 'gSel',
         kWhatSelectTrack                = 'selT',
+        kWhatGetCodecMetrics            = 'gMet',
+        kWhatGetRenderer                = 'gRen',
+        kWhatScrubDone                  = 'scrD',
     };
     sp<PlayerExtendedStats> mPlayerExtendedStats;
 
@@ -184,6 +189,7 @@ private:
     sp<ABuffer> mPendingAudioAccessUnit;
     status_t    mPendingAudioErr;
     sp<ABuffer> mAggregateBuffer;
+    size_t mAggregateBufferSizeBytes;
 
     FlushStatus mFlushingAudio;
     FlushStatus mFlushingVideo;
@@ -199,6 +205,27 @@ private:
     bool mBuffering;
     bool mPlaying;
 
+    // The seek yet to be done once the decoders are flushed, see kWhatSeek.
+    sp<SeekAction> mPendingSeek;
+
+    // Seeks coming in less than kScrubIntervalUs apart are a scrub, in
+    // which only the frame each one lands on is decoded, see kWhatSeek.
+    bool mScrubMode;
+    bool mScrubbing;
+    bool mScrubFrameRendered;
+    int64_t mLastSeekRequestUs;
+    int64_t mScrubSeekTimeUs;
+    int32_t mScrubGeneration;
+
+    // what the next time discontinuity of each stream is rendered from on,
+    // -1 but after an exact seek
+    int64_t mExactSeekAudioTimeUs;
+    int64_t mExactSeekVideoTimeUs;
+
+    // media.nuplayer.fast-start, see preroll()
+    bool mFastStart;
+    bool mPrerolled;
+
     inline const sp<Decoder> &getDecoder(bool audio) {
         return audio ? mAudioDecoder : mVideoDecoder;
     }
@@ -220,6 +247,7 @@ private:
             const sp<AMessage> &outputFormat = NULL);
 
     status_t feedDecoderInputData(bool audio, const sp<AMessage> &msg);
+    size_t getAggregateBufferSize(const sp<AMessage> &format) const;
     void renderBuffer(bool audio, const sp<AMessage> &msg);
 
     void notifyListener(int msg, int ext1, int ext2, const Parcel *in = NULL);
@@ -233,6 +261,9 @@ private:
             bool audio, bool needShutdown, const sp<AMessage> &newFormat = NULL);
     void updateDecoderFormatWithoutFlush(bool audio, const sp<AMessage> &format);
 
+    void onStart();
+    void preroll();
+
     void postScanSources();
 
     void schedulePollDuration();
@@ -240,7 +271,13 @@ private:
 
     void processDeferredActions();
 
-    void performSeek(int64_t seekTimeUs, bool needNotify);
+    // whether a video access unit is already too late to render, for it to
+    // be dropped before it is decoded
+    bool isVideoAccessUnitLate(const sp<ABuffer> &accessUnit);
+
+    void queueSeek(int64_t seekTimeUs, bool needNotify, bool exact);
+
+    void performSeek(int64_t seekTimeUs, bool needNotify, bool exact);
     void performDecoderFlush();
     void performDecoderShutdown(bool audio, bool video);
     void performReset();
@@ -254,6 +254,17 @@ status_t NuPlayer::Decoder::getInputBuffers(Vector<sp<ABuffer> > *buffers) const
     return PostAndAwaitResponse(msg, &response);
 }
 
+status_t NuPlayer::Decoder::getCodecMetrics(sp<AMessage> *metrics) const {
+    sp<AMessage> msg = new AMessage(kWhatGetCodecMetrics, id());
+
+    sp<AMessage> response;
+    status_t err = PostAndAwaitResponse(msg, &response);
+    if (err == OK) {
+        CHECK(response->findMessage("metrics", metrics));
+    }
+    return err;
+}
+
 void NuPlayer::Decoder::handleError(int32_t err)
 {
     // We cannot immediately release the codec due to buffers still outstanding
@@ -644,6 +655,26 @@ void NuPlayer::Decoder::onMessageReceived(const sp<AMessage> &msg) {
             break;
         }
 
+        case kWhatGetCodecMetrics:
+        {
+            uint32_t replyID;
+            CHECK(msg->senderAwaitsResponse(&replyID));
+
+            sp<AMessage> metrics;
+            status_t err = INVALID_OPERATION;
+            if (mCodec != NULL) {
+                err = mCodec->getMetrics(&metrics);
+            }
+
+            sp<AMessage> response = new AMessage;
+            response->setInt32("err", err);
+            if (err == OK) {
+                response->setMessage("metrics", metrics);
+            }
+            response->postReply(replyID);
+            break;
+        }
+
         case kWhatCodecNotify:
         {
             if (!isStaleReply(msg)) {
@@ -36,6 +36,7 @@ struct NuPlayer::Decoder : public AHandler {
     virtual void init();
 
     status_t getInputBuffers(Vector<sp<ABuffer> > *dstBuffers) const;
+    virtual status_t getCodecMetrics(sp<AMessage> *metrics) const;
     virtual void signalFlush(const sp<AMessage> &format = NULL);
     virtual void signalUpdateFormat(const sp<AMessage> &format);
     virtual void signalResume();
@@ -69,6 +70,7 @@ private:
         kWhatFlush              = 'flus',
         kWhatShutdown           = 'shuD',
         kWhatUpdateFormat       = 'uFmt',
+        kWhatGetCodecMetrics    = 'gMet',
     };
 
     sp<AMessage> mNotify;
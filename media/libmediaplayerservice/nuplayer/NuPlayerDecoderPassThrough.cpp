@@ -31,9 +31,6 @@
 namespace android {
 
 static const size_t kMaxCachedBytes = 200000;
-// The buffers will contain a bit less than kAggregateBufferSizeBytes.
-// So we can start off with just enough buffers to keep the cache full.
-static const size_t kMaxPendingBuffers = 1 + (kMaxCachedBytes / NuPlayer::kAggregateBufferSizeBytes);
 
 NuPlayer::DecoderPassThrough::DecoderPassThrough(
         const sp<AMessage> &notify)
@@ -44,6 +41,7 @@ NuPlayer::DecoderPassThrough::DecoderPassThrough(
       mPendingBuffersToFill(0),
       mPendingBuffersToDrain(0),
       mCachedBytes(0),
+      mMaxPendingBuffers(1 + kMaxCachedBytes / NuPlayer::kAggregateBufferSizeBytes),
       mComponentName("pass through decoder") {
     mDecoderLooper = new ALooper;
     mDecoderLooper->setName("NuPlayerDecoderPassThrough");
@@ -80,6 +78,11 @@ bool NuPlayer::DecoderPassThrough::supportsSeamlessFormatChange(
     return true;
 }
 
+status_t NuPlayer::DecoderPassThrough::getCodecMetrics(
+        sp<AMessage> * /* metrics */) const {
+    return INVALID_OPERATION;
+}
+
 void NuPlayer::DecoderPassThrough::onConfigure(const sp<AMessage> &format) {
     ALOGV("[%s] onConfigure", mComponentName.c_str());
     mCachedBytes = 0;
@@ -88,6 +91,16 @@ void NuPlayer::DecoderPassThrough::onConfigure(const sp<AMessage> &format) {
     mReachedEOS = false;
     ++mBufferGeneration;
 
+    // The buffers will contain a bit less than the size NuPlayer aggregates
+    // them to. So we can start off with just enough buffers to keep the
+    // cache full.
+    int32_t aggregateSize;
+    if (!format->findInt32("aggregate-buffer-size", &aggregateSize)
+            || aggregateSize <= 0) {
+        aggregateSize = NuPlayer::kAggregateBufferSizeBytes;
+    }
+    mMaxPendingBuffers = 1 + kMaxCachedBytes / aggregateSize;
+
     requestMaxBuffers();
 
     sp<AMessage> notify = mNotify->dup();
@@ -183,7 +196,7 @@ void NuPlayer::DecoderPassThrough::onFlush() {
 }
 
 void NuPlayer::DecoderPassThrough::requestMaxBuffers() {
-    for (size_t i = 0; i < kMaxPendingBuffers; i++) {
+    for (size_t i = 0; i < mMaxPendingBuffers; i++) {
         if (!requestABuffer()) {
             break;
         }
@@ -36,6 +36,9 @@ struct NuPlayer::DecoderPassThrough : public Decoder {
 
     bool supportsSeamlessFormatChange(const sp<AMessage> &to) const;
 
+    // there is no codec to measure
+    virtual status_t getCodecMetrics(sp<AMessage> *metrics) const;
+
 protected:
 
     virtual ~DecoderPassThrough();
@@ -75,6 +78,7 @@ private:
     size_t  mPendingBuffersToFill;
     size_t  mPendingBuffersToDrain;
     size_t  mCachedBytes;
+    size_t  mMaxPendingBuffers;
     AString mComponentName;
 
     DISALLOW_EVIL_CONSTRUCTORS(DecoderPassThrough);
@@ -26,6 +26,7 @@
 
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/foundation/AUtils.h>
 #include <media/stagefright/MetaData.h>
 #include <media/stagefright/Utils.h>
@@ -613,6 +614,17 @@ void NuPlayerDriver::notifySeekComplete_l() {
     notifyListener_l(wasSeeking ? MEDIA_SEEK_COMPLETE : MEDIA_PREPARED);
 }
 
+static void dumpInt64Entries(FILE *out, const sp<AMessage> &msg) {
+    for (size_t i = 0; i < msg->countEntries(); ++i) {
+        AMessage::Type type;
+        const char *name = msg->getEntryNameAt(i, &type);
+        int64_t value;
+        if (msg->findInt64(name, &value)) {
+            fprintf(out, "   %s(%" PRId64 ")\n", name, value);
+        }
+    }
+}
+
 status_t NuPlayerDriver::dump(
         int fd, const Vector<String16> & /* args */) const {
     int64_t numFramesTotal;
@@ -629,6 +641,29 @@ status_t NuPlayerDriver::dump(
                  numFramesTotal == 0
                     ? 0.0 : (double)numFramesDropped / numFramesTotal);
 
+    for (int audio = 0; audio < 2; ++audio) {
+        sp<AMessage> metrics;
+        if (mPlayer->getCodecMetrics(audio, &metrics) != OK) {
+            continue;
+        }
+
+        fprintf(out, "  %s codec\n", audio ? "audio" : "video");
+        dumpInt64Entries(out, metrics);
+    }
+
+    sp<AMessage> stats;
+    if (mPlayer->getAudioRenderStats(&stats) == OK) {
+        fprintf(out, "  audio renderer\n");
+        dumpInt64Entries(out, stats);
+
+        int64_t numWrites, numBytesWritten;
+        if (stats->findInt64("audio-writes", &numWrites) && numWrites > 0
+                && stats->findInt64("audio-bytes-written", &numBytesWritten)) {
+            fprintf(out, "   avg-audio-write-bytes(%" PRId64 ")\n",
+                    numBytesWritten / numWrites);
+        }
+    }
+
     fclose(out);
     out = NULL;
 
@@ -34,6 +34,7 @@
 #include <VideoFrameScheduler.h>
 
 #include <inttypes.h>
+#include <stdlib.h>
 
 #ifdef ENABLE_AV_ENHANCEMENTS
 #include "ExtendedUtils.h"
@@ -50,12 +51,23 @@ const int64_t NuPlayer::Renderer::kMinPositionUpdateDelayUs = 100000ll;
 
 static bool sFrameAccurateAVsync = false;
 
+// Video frames are released to the surface up to this many frame periods
+// before their display refresh, stamped with it, for SurfaceFlinger to
+// present them on time however late the renderer wakes up.
+static int32_t sVideoFramesAhead = 2;
+
+// however many frames that is
+static const int64_t kMaxVideoReleaseLeadUs = 100000ll;
+
 static void readProperties() {
     char value[PROPERTY_VALUE_MAX];
     if (property_get("persist.sys.media.avsync", value, NULL)) {
         sFrameAccurateAVsync =
             !strcmp("1", value) || !strcasecmp("true", value);
     }
+    if (property_get("media.nuplayer.video-frames-ahead", value, NULL)) {
+        sVideoFramesAhead = atoi(value);
+    }
 }
 
 NuPlayer::Renderer::Renderer(
@@ -91,7 +103,12 @@ NuPlayer::Renderer::Renderer(
       mAudioOffloadTornDown(false),
       mCurrentOffloadInfo(AUDIO_INFO_INITIALIZER),
       mTotalBuffersQueued(0),
-      mLastAudioBufferDrained(0) {
+      mLastAudioBufferDrained(0),
+      mNumAudioWrites(0),
+      mNumAudioBytesWritten(0),
+      mNumAudioBuffersWritten(0),
+      mMaxAudioWriteBytes(0),
+      mNumAudioUnderruns(0) {
 
     readProperties();
     notify->findObject(MEDIA_EXTENDED_STATS, (sp<RefBase>*)&mPlayerExtendedStats);
@@ -292,6 +309,15 @@ void NuPlayer::Renderer::closeAudioSink() {
     msg->postAndAwaitResponse(&response);
 }
 
+void NuPlayer::Renderer::getAudioStats(sp<AMessage> *stats) {
+    sp<AMessage> msg = new AMessage(kWhatGetAudioStats, id());
+
+    sp<AMessage> response;
+    msg->postAndAwaitResponse(&response);
+
+    CHECK(response->findMessage("stats", stats));
+}
+
 void NuPlayer::Renderer::onMessageReceived(const sp<AMessage> &msg) {
     switch (msg->what()) {
         case kWhatOpenAudioSink:
@@ -332,6 +358,24 @@ void NuPlayer::Renderer::onMessageReceived(const sp<AMessage> &msg) {
             break;
         }
 
+        case kWhatGetAudioStats:
+        {
+            uint32_t replyID;
+            CHECK(msg->senderAwaitsResponse(&replyID));
+
+            sp<AMessage> stats = new AMessage;
+            stats->setInt64("audio-writes", mNumAudioWrites);
+            stats->setInt64("audio-bytes-written", mNumAudioBytesWritten);
+            stats->setInt64("audio-buffers-written", mNumAudioBuffersWritten);
+            stats->setInt64("max-audio-write-bytes", mMaxAudioWriteBytes);
+            stats->setInt64("audio-underruns", mNumAudioUnderruns);
+
+            sp<AMessage> response = new AMessage;
+            response->setMessage("stats", stats);
+            response->postReply(replyID);
+            break;
+        }
+
         case kWhatStopAudioSink:
         {
             mAudioSink->stop();
@@ -382,7 +426,11 @@ void NuPlayer::Renderer::onMessageReceived(const sp<AMessage> &msg) {
 
             mDrainVideoQueuePending = false;
 
-            onDrainVideoQueue();
+            int64_t scheduledTimeUs;
+            if (!msg->findInt64("scheduledTimeUs", &scheduledTimeUs)) {
+                scheduledTimeUs = -1;
+            }
+            onDrainVideoQueue(scheduledTimeUs);
 
             postDrainVideoQueue();
             break;
@@ -634,14 +682,12 @@ bool NuPlayer::Renderer::onDrainAudioQueue() {
     ssize_t numFramesAvailableToWrite =
         mAudioSink->frameCount() - (mNumFramesWritten - numFramesPlayed);
 
-#if 0
-    if (numFramesAvailableToWrite == mAudioSink->frameCount()) {
-        ALOGI("audio sink underrun");
-    } else {
-        ALOGV("audio queue has %d frames left to play",
-             mAudioSink->frameCount() - numFramesAvailableToWrite);
+    // The sink played out everything written while more was queued.
+    if (mNumFramesWritten > 0 && numFramesPlayed == mNumFramesWritten
+            && !mAudioQueue.empty()) {
+        ALOGV("audio sink underrun");
+        ++mNumAudioUnderruns;
     }
-#endif
 
     size_t numBytesAvailableToWrite =
         numFramesAvailableToWrite * mAudioSink->frameSize();
@@ -649,10 +695,10 @@ bool NuPlayer::Renderer::onDrainAudioQueue() {
     while (numBytesAvailableToWrite > 0 && !mAudioQueue.empty()) {
         QueueEntry *entry = &*mAudioQueue.begin();
 
-        mLastAudioBufferDrained = entry->mBufferOrdinal;
-
         if (entry->mBuffer == NULL) {
             // EOS
+            mLastAudioBufferDrained = entry->mBufferOrdinal;
+
             int64_t postEOSDelayUs = 0;
             if (mAudioSink->needsTrailingPadding()) {
                 postEOSDelayUs = getPendingAudioPlayoutDurationUs(ALooper::GetNowUs());
@@ -664,35 +710,63 @@ bool NuPlayer::Renderer::onDrainAudioQueue() {
             return false;
         }
 
-        if (entry->mOffset == 0) {
-            int64_t mediaTimeUs;
-            CHECK(entry->mBuffer->meta()->findInt64("timeUs", &mediaTimeUs));
-            ALOGV("rendering audio at media time %.2f secs", mediaTimeUs / 1E6);
-            onNewAudioMediaTime(mediaTimeUs);
-        }
-
-        size_t copy = entry->mBuffer->size() - entry->mOffset;
-        if (copy > numBytesAvailableToWrite) {
-            copy = numBytesAvailableToWrite;
-        }
+        const uint8_t *data;
+        size_t copy = coalesceAudioQueue(numBytesAvailableToWrite, &data);
 
-        ssize_t written = mAudioSink->write(entry->mBuffer->data() + entry->mOffset, copy);
+        ssize_t written = mAudioSink->write(data, copy);
         if (written < 0) {
             // An error in AudioSink write is fatal here.
             LOG_ALWAYS_FATAL("AudioSink write error(%zd) when writing %zu bytes", written, copy);
         }
 
-        entry->mOffset += written;
-        if (entry->mOffset == entry->mBuffer->size()) {
-            entry->mNotifyConsumed->post();
-            mAudioQueue.erase(mAudioQueue.begin());
+        ++mNumAudioWrites;
+        mNumAudioBytesWritten += written;
+        if (written > mMaxAudioWriteBytes) {
+            mMaxAudioWriteBytes = written;
+        }
 
+        // The entries written are consumed in order, each one anchoring the
+        // media time at its first frame as if it had been written alone.
+        uint32_t numFramesWritten = mNumFramesWritten;
+        size_t consumed = 0;
+        while (!mAudioQueue.empty()) {
+            entry = &*mAudioQueue.begin();
+            if (entry->mBuffer == NULL) {
+                break;
+            }
+
+            size_t n = entry->mBuffer->size() - entry->mOffset;
+            if (n > (size_t)written - consumed) {
+                n = (size_t)written - consumed;
+                if (n == 0) {
+                    break;
+                }
+            }
+
+            mLastAudioBufferDrained = entry->mBufferOrdinal;
+
+            mNumFramesWritten = numFramesWritten + consumed / mAudioSink->frameSize();
+            if (entry->mOffset == 0) {
+                int64_t mediaTimeUs;
+                CHECK(entry->mBuffer->meta()->findInt64("timeUs", &mediaTimeUs));
+                ALOGV("rendering audio at media time %.2f secs", mediaTimeUs / 1E6);
+                onNewAudioMediaTime(mediaTimeUs);
+            }
+
+            entry->mOffset += n;
+            consumed += n;
+
+            if (entry->mOffset == entry->mBuffer->size()) {
+                entry->mNotifyConsumed->post();
+                mAudioQueue.erase(mAudioQueue.begin());
+                ++mNumAudioBuffersWritten;
+            }
             entry = NULL;
         }
 
         numBytesAvailableToWrite -= written;
         size_t copiedFrames = written / mAudioSink->frameSize();
-        mNumFramesWritten += copiedFrames;
+        mNumFramesWritten = numFramesWritten + copiedFrames;
 
         notifyIfMediaRenderingStarted();
 
@@ -725,6 +799,52 @@ bool NuPlayer::Renderer::onDrainAudioQueue() {
     return !mAudioQueue.empty();
 }
 
+size_t NuPlayer::Renderer::coalesceAudioQueue(
+        size_t maxBytes, const uint8_t **data) {
+    List<QueueEntry>::iterator it = mAudioQueue.begin();
+    size_t size = it->mBuffer->size() - it->mOffset;
+
+    List<QueueEntry>::iterator next = it;
+    ++next;
+    if (size >= maxBytes || next == mAudioQueue.end() || next->mBuffer == NULL) {
+        // written from the entry itself
+        *data = it->mBuffer->data() + it->mOffset;
+        return size < maxBytes ? size : maxBytes;
+    }
+
+    if (mAudioWriteBuffer == NULL || mAudioWriteBuffer->capacity() < maxBytes) {
+        mAudioWriteBuffer = new ABuffer(maxBytes);
+    }
+
+    size = 0;
+    for (; it != mAudioQueue.end() && it->mBuffer != NULL && size < maxBytes; ++it) {
+        size_t copy = it->mBuffer->size() - it->mOffset;
+        if (copy > maxBytes - size) {
+            copy = maxBytes - size;
+        }
+        memcpy(mAudioWriteBuffer->data() + size, it->mBuffer->data() + it->mOffset, copy);
+        size += copy;
+    }
+
+    *data = mAudioWriteBuffer->data();
+    return size;
+}
+
+int64_t NuPlayer::Renderer::getAudioDrainDelayUs() {
+    uint32_t numFramesPlayed;
+    if (offloadingAudio() || mAudioSink->getPosition(&numFramesPlayed) != OK) {
+        return 0;
+    }
+
+    uint32_t numFramesPendingPlayout = mNumFramesWritten - numFramesPlayed;
+    if (numFramesPendingPlayout > mAudioSink->frameCount()) {
+        return 0;
+    }
+
+    // as after a drain, half the time the sink has data to play back for
+    return mAudioSink->msecsPerFrame() * numFramesPendingPlayout * 1000ll / 2;
+}
+
 int64_t NuPlayer::Renderer::getPendingAudioPlayoutDurationUs(int64_t nowUs) {
     int64_t writtenAudioDurationUs =
         mNumFramesWritten * 1000LL * mAudioSink->msecsPerFrame();
@@ -818,6 +938,7 @@ void NuPlayer::Renderer::postDrainVideoQueue() {
     }
 
     realTimeUs = mVideoScheduler->schedule(realTimeUs * 1000) / 1000;
+    msg->setInt64("scheduledTimeUs", realTimeUs);
     int64_t twoVsyncsUs = 2 * (mVideoScheduler->getVsyncPeriod() / 1000);
 
     delayUs = realTimeUs - nowUs;
@@ -829,12 +950,25 @@ void NuPlayer::Renderer::postDrainVideoQueue() {
     if (!sFrameAccurateAVsync) {
         twoVsyncsUs >>= 4;
     }
-    msg->post(delayUs > twoVsyncsUs ? delayUs - twoVsyncsUs : 0);
+
+    // or a few frames ahead, once the frame rate is known
+    int64_t leadUs = twoVsyncsUs;
+    int64_t videoPeriodUs = mVideoScheduler->getVideoPeriod() / 1000;
+    if (sVideoFramesAhead > 0 && videoPeriodUs > 0) {
+        int64_t framesAheadUs = sVideoFramesAhead * videoPeriodUs;
+        if (framesAheadUs > kMaxVideoReleaseLeadUs) {
+            framesAheadUs = kMaxVideoReleaseLeadUs;
+        }
+        if (framesAheadUs > leadUs) {
+            leadUs = framesAheadUs;
+        }
+    }
+    msg->post(delayUs > leadUs ? delayUs - leadUs : 0);
 
     mDrainVideoQueuePending = true;
 }
 
-void NuPlayer::Renderer::onDrainVideoQueue() {
+void NuPlayer::Renderer::onDrainVideoQueue(int64_t scheduledTimeUs) {
     if (mVideoQueue.empty()) {
         return;
     }
@@ -891,7 +1025,15 @@ void NuPlayer::Renderer::onDrainVideoQueue() {
         }
     }
 
-    entry->mNotifyConsumed->setInt64("timestampNs", realTimeUs * 1000ll);
+    // The refresh the scheduler picked, unless the frame is being released
+    // later than that or the anchor moved since.
+    int64_t timestampUs = realTimeUs;
+    if (scheduledTimeUs >= 0 && !mPaused && scheduledTimeUs > nowUs
+            && llabs(scheduledTimeUs - realTimeUs) < kMaxVideoReleaseLeadUs / 2) {
+        timestampUs = scheduledTimeUs;
+    }
+
+    entry->mNotifyConsumed->setInt64("timestampNs", timestampUs * 1000ll);
     entry->mNotifyConsumed->setInt32("render", !tooLate);
     entry->mNotifyConsumed->post();
     mVideoQueue.erase(mVideoQueue.begin());
@@ -965,7 +1107,9 @@ void NuPlayer::Renderer::onQueueBuffer(const sp<AMessage> &msg) {
     if (audio) {
         Mutex::Autolock autoLock(mLock);
         mAudioQueue.push_back(entry);
-        postDrainAudioQueue_l();
+        // Leave it queued while the sink has data to play, for the buffers
+        // decoded until then to be written together.
+        postDrainAudioQueue_l(getAudioDrainDelayUs());
     } else {
         mVideoQueue.push_back(entry);
         postDrainVideoQueue();
@@ -80,6 +80,11 @@ struct NuPlayer::Renderer : public AHandler {
             uint32_t flags);
     void closeAudioSink();
 
+    // How the audio was written to the sink so far, offloaded audio aside:
+    // "audio-writes", "audio-bytes-written", "audio-buffers-written",
+    // "max-audio-write-bytes" and "audio-underruns", all int64.
+    void getAudioStats(sp<AMessage> *stats);
+
     enum {
         kWhatEOS                 = 'eos ',
         kWhatFlushComplete       = 'fluC',
@@ -117,6 +122,7 @@ private:
         kWhatDisableOffloadAudio = 'noOA',
         kWhatEnableOffloadAudio  = 'enOA',
         kWhatSetVideoFrameRate   = 'sVFR',
+        kWhatGetAudioStats       = 'gASt',
     };
 
     struct QueueEntry {
@@ -181,10 +187,21 @@ private:
     int32_t mTotalBuffersQueued;
     int32_t mLastAudioBufferDrained;
 
+    // the queued buffers copied together, for a single write to the sink
+    sp<ABuffer> mAudioWriteBuffer;
+
+    int64_t mNumAudioWrites;
+    int64_t mNumAudioBytesWritten;
+    int64_t mNumAudioBuffersWritten;
+    int64_t mMaxAudioWriteBytes;
+    int64_t mNumAudioUnderruns;
+
 
     size_t fillAudioBuffer(void *buffer, size_t size);
 
     bool onDrainAudioQueue();
+    size_t coalesceAudioQueue(size_t maxBytes, const uint8_t **data);
+    int64_t getAudioDrainDelayUs();
     int64_t getPendingAudioPlayoutDurationUs(int64_t nowUs);
     int64_t getPlayedOutAudioDurationUs(int64_t nowUs);
     void postDrainAudioQueue_l(int64_t delayUs = 0);
@@ -192,7 +209,9 @@ private:
     void onNewAudioMediaTime(int64_t mediaTimeUs);
     int64_t getRealTimeUs(int64_t mediaTimeUs, int64_t nowUs);
 
-    void onDrainVideoQueue();
+    // scheduledTimeUs is the vsync-aligned render time the drain was posted
+    // for, -1 if none.
+    void onDrainVideoQueue(int64_t scheduledTimeUs);
     void postDrainVideoQueue();
 
     void prepareForMediaRenderingStart();
@@ -24,6 +24,7 @@
 #include "MyHandler.h"
 #include "SDPLoader.h"
 
+#include <cutils/properties.h>
 #include <media/IMediaHTTPService.h>
 #include <media/stagefright/MediaDefs.h>
 #include <media/stagefright/MetaData.h>
@@ -32,6 +33,19 @@ namespace android {
 
 const int64_t kNearEOSTimeoutUs = 2000000ll; // 2 secs
 
+// We're going to buffer at least 2 secs worth data on all tracks before
+// starting playback (both at startup and after a seek).
+static const int64_t kMinDurationUs = 2000000ll;
+
+// In low-latency mode, playback starts as soon as every track has data, and
+// every rebuffer adds a step to the buffer, up to the max, while a step is
+// taken back after a period without any.
+static const int64_t kLowLatencyBufferStepUs = 40000ll;
+static const int64_t kLowLatencyMaxBufferUs = 200000ll;
+static const int64_t kLowLatencyStablePeriodUs = 30000000ll;
+
+static const int64_t kLatencyLogIntervalUs = 10000000ll;
+
 NuPlayer::RTSPSource::RTSPSource(
         const sp<AMessage> &notify,
         const sp<IMediaHTTPService> &httpService,
@@ -51,6 +65,15 @@ NuPlayer::RTSPSource::RTSPSource(
       mFinalResult(OK),
       mDisconnectReplyID(0),
       mBuffering(true),
+      mMinBufferUs(kMinDurationUs),
+      mBufferChangedUs(-1ll),
+      mNumRebuffers(0),
+      mRebufferStartUs(-1ll),
+      mRebufferDurationUs(0ll),
+      mNumBufferedSamples(0),
+      mTotalBufferedUs(0ll),
+      mMaxBufferedUs(0ll),
+      mLatencyLoggedUs(-1ll),
       mSeekGeneration(0),
       mEOSTimeoutAudio(0),
       mEOSTimeoutVideo(0) {
@@ -65,6 +88,24 @@ NuPlayer::RTSPSource::RTSPSource(
 
             mExtraHeaders.removeItemsAt(index);
         }
+
+        index = mExtraHeaders.indexOfKey(String8("x-rtsp-low-latency"));
+
+        if (index >= 0) {
+            mFlags |= kFlagLowLatency;
+
+            mExtraHeaders.removeItemsAt(index);
+        }
+    }
+
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("rtsp.low-latency", value, NULL)
+            && (!strcmp(value, "1") || !strcasecmp(value, "true"))) {
+        mFlags |= kFlagLowLatency;
+    }
+
+    if (mFlags & kFlagLowLatency) {
+        mMinBufferUs = 0ll;
     }
 }
 
@@ -100,7 +141,9 @@ void NuPlayer::RTSPSource::prepareAsync() {
         mSDPLoader->load(
                 mURL.c_str(), mExtraHeaders.isEmpty() ? NULL : &mExtraHeaders);
     } else {
-        mHandler = new MyHandler(mURL.c_str(), notify, mUIDValid, mUID);
+        mHandler = new MyHandler(
+                mURL.c_str(), notify, mUIDValid, mUID,
+                (mFlags & kFlagLowLatency) != 0);
         mLooper->registerHandler(mHandler);
 
         mHandler->connect();
@@ -160,11 +203,6 @@ sp<MetaData> NuPlayer::RTSPSource::getFormatMeta(bool audio) {
 }
 
 bool NuPlayer::RTSPSource::haveSufficientDataOnAllTracks() {
-    // We're going to buffer at least 2 secs worth data on all tracks before
-    // starting playback (both at startup and after a seek).
-
-    static const int64_t kMinDurationUs = 2000000ll;
-
     int64_t mediaDurationUs = 0;
     getDuration(&mediaDurationUs);
     if ((mAudioTrack != NULL && mAudioTrack->isFinished(mediaDurationUs))
@@ -174,9 +212,18 @@ bool NuPlayer::RTSPSource::haveSufficientDataOnAllTracks() {
 
     status_t err;
     int64_t durationUs;
+    if ((mFlags & kFlagLowLatency)
+            && ((mAudioTrack != NULL && !mAudioTrack->hasBufferAvailable(&err)
+                    && err == OK)
+                || (mVideoTrack != NULL && !mVideoTrack->hasBufferAvailable(&err)
+                    && err == OK))) {
+        ALOGV("not all tracks have data yet.");
+        return false;
+    }
+
     if (mAudioTrack != NULL
             && (durationUs = mAudioTrack->getBufferedDurationUs(&err))
-                    < kMinDurationUs
+                    < mMinBufferUs
             && err == OK) {
         ALOGV("audio track doesn't have enough data yet. (%.2f secs buffered)",
               durationUs / 1E6);
@@ -185,7 +232,7 @@ bool NuPlayer::RTSPSource::haveSufficientDataOnAllTracks() {
 
     if (mVideoTrack != NULL
             && (durationUs = mVideoTrack->getBufferedDurationUs(&err))
-                    < kMinDurationUs
+                    < mMinBufferUs
             && err == OK) {
         ALOGV("video track doesn't have enough data yet. (%.2f secs buffered)",
               durationUs / 1E6);
@@ -204,6 +251,11 @@ status_t NuPlayer::RTSPSource::dequeueAccessUnit(
 
         mBuffering = false;
 
+        if (mRebufferStartUs >= 0) {
+            mRebufferDurationUs += ALooper::GetNowUs() - mRebufferStartUs;
+            mRebufferStartUs = -1ll;
+        }
+
         sp<AMessage> notify = dupNotify();
         notify->setInt32("what", kWhatBufferingEnd);
         notify->post();
@@ -249,6 +301,7 @@ status_t NuPlayer::RTSPSource::dequeueAccessUnit(
                 // We should not enter buffering mode
                 // if any of the sources already have detected EOS.
                 mBuffering = true;
+                onRebuffer();
 
                 sp<AMessage> notify = dupNotify();
                 notify->setInt32("what", kWhatBufferingStart);
@@ -262,9 +315,83 @@ status_t NuPlayer::RTSPSource::dequeueAccessUnit(
 
     setEOSTimeout(audio, 0);
 
+    if (mFlags & kFlagLowLatency) {
+        updateLatencyStats(source);
+    }
+
     return source->dequeueAccessUnit(accessUnit);
 }
 
+void NuPlayer::RTSPSource::onRebuffer() {
+    int64_t nowUs = ALooper::GetNowUs();
+
+    ++mNumRebuffers;
+    mRebufferStartUs = nowUs;
+
+    if ((mFlags & kFlagLowLatency) && mMinBufferUs < kLowLatencyMaxBufferUs) {
+        mMinBufferUs += kLowLatencyBufferStepUs;
+        mBufferChangedUs = nowUs;
+        ALOGI("rebuffering, buffer now %lld ms", (long long)mMinBufferUs / 1000);
+    }
+}
+
+// What the source adds to the latency is the media queued in it: sampled as
+// every access unit goes out, logged every kLatencyLogIntervalUs and when
+// the session disconnects.
+void NuPlayer::RTSPSource::updateLatencyStats(
+        const sp<AnotherPacketSource> &source) {
+    int64_t nowUs = ALooper::GetNowUs();
+
+    if (mBufferChangedUs < 0) {
+        mBufferChangedUs = nowUs;
+    } else if (mMinBufferUs > 0
+            && nowUs - mBufferChangedUs >= kLowLatencyStablePeriodUs) {
+        mMinBufferUs -= kLowLatencyBufferStepUs;
+        mBufferChangedUs = nowUs;
+        ALOGV("no rebuffer for a while, buffer now %lld ms",
+              (long long)mMinBufferUs / 1000);
+    }
+
+    status_t err;
+    int64_t bufferedUs = source->getBufferedDurationUs(&err);
+    ++mNumBufferedSamples;
+    mTotalBufferedUs += bufferedUs;
+    if (bufferedUs > mMaxBufferedUs) {
+        mMaxBufferedUs = bufferedUs;
+    }
+
+    if (mLatencyLoggedUs < 0) {
+        mLatencyLoggedUs = nowUs;
+    } else if (nowUs - mLatencyLoggedUs >= kLatencyLogIntervalUs) {
+        logLatencyStats(false /* summary */);
+        mLatencyLoggedUs = nowUs;
+    }
+}
+
+void NuPlayer::RTSPSource::logLatencyStats(bool summary) {
+    if (mNumBufferedSamples == 0) {
+        return;
+    }
+
+    int64_t rebufferDurationUs = mRebufferDurationUs;
+    if (mRebufferStartUs >= 0) {
+        rebufferDurationUs += ALooper::GetNowUs() - mRebufferStartUs;
+    }
+
+    if (summary) {
+        ALOGI("buffered %.2f ms on average, %.2f ms at most, "
+              "%zu rebuffers for %.2f s",
+              mTotalBufferedUs / 1E3 / mNumBufferedSamples,
+              mMaxBufferedUs / 1E3, mNumRebuffers, rebufferDurationUs / 1E6);
+    } else {
+        ALOGV("buffered %.2f ms on average, %.2f ms at most, "
+              "%zu rebuffers for %.2f s, buffer %lld ms",
+              mTotalBufferedUs / 1E3 / mNumBufferedSamples,
+              mMaxBufferedUs / 1E3, mNumRebuffers, rebufferDurationUs / 1E6,
+              (long long)mMinBufferUs / 1000);
+    }
+}
+
 sp<AnotherPacketSource> NuPlayer::RTSPSource::getSource(bool audio) {
     if (mTSParser != NULL) {
         sp<MediaSource> source = mTSParser->getSource(
@@ -639,7 +766,9 @@ void NuPlayer::RTSPSource::onSDPLoaded(const sp<AMessage> &msg) {
         } else {
             sp<AMessage> notify = new AMessage(kWhatNotify, id());
 
-            mHandler = new MyHandler(rtspUri.c_str(), notify, mUIDValid, mUID);
+            mHandler = new MyHandler(
+                    rtspUri.c_str(), notify, mUIDValid, mUID,
+                    (mFlags & kFlagLowLatency) != 0);
             mLooper->registerHandler(mHandler);
 
             mHandler->loadSDP(desc);
@@ -671,6 +800,10 @@ void NuPlayer::RTSPSource::onDisconnected(const sp<AMessage> &msg) {
     CHECK(msg->findInt32("result", &err));
     CHECK_NE(err, (status_t)OK);
 
+    if (mFlags & kFlagLowLatency) {
+        logLatencyStats(true /* summary */);
+    }
+
     mLooper->unregisterHandler(mHandler->id());
     mHandler.clear();
 
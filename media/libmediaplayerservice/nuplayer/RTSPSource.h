@@ -78,6 +78,10 @@ private:
     enum Flags {
         // Don't log any URLs.
         kFlagIncognito = 1,
+
+        // Live viewing: play on the first IDR without waiting for sender
+        // reports, on a buffer kept as small as the network allows.
+        kFlagLowLatency = 2,
     };
 
     struct TrackInfo {
@@ -101,6 +105,20 @@ private:
     uint32_t mDisconnectReplyID;
     bool mBuffering;
 
+    // media buffered before playback starts or resumes, and what the
+    // low-latency mode varies it on
+    int64_t mMinBufferUs;
+    int64_t mBufferChangedUs;
+    size_t mNumRebuffers;
+    int64_t mRebufferStartUs;
+    int64_t mRebufferDurationUs;
+
+    // low-latency mode: media queued in the sources as access units go out
+    size_t mNumBufferedSamples;
+    int64_t mTotalBufferedUs;
+    int64_t mMaxBufferedUs;
+    int64_t mLatencyLoggedUs;
+
     sp<ALooper> mLooper;
     sp<MyHandler> mHandler;
     sp<SDPLoader> mSDPLoader;
@@ -127,6 +145,10 @@ private:
 
     bool haveSufficientDataOnAllTracks();
 
+    void onRebuffer();
+    void updateLatencyStats(const sp<AnotherPacketSource> &source);
+    void logLatencyStats(bool summary);
+
     void setEOSTimeout(bool audio, int64_t timeout);
 
     DISALLOW_EVIL_CONSTRUCTORS(RTSPSource);
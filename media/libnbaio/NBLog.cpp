@@ -18,6 +18,7 @@
 //#define LOG_NDEBUG 0
 
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
@@ -47,6 +48,95 @@ int NBLog::Entry::readAt(size_t offset) const
 
 // ---------------------------------------------------------------------------
 
+/*static*/
+const char *NBLog::scanFormat(const char *fmt, const char **spec, int *arg)
+{
+    const char *p = strchr(fmt, '%');
+    if (p == NULL) {
+        return NULL;
+    }
+    *spec = p++;
+    if (*p == '%') {
+        *arg = FORMAT_ARG_NONE;
+        return p + 1;
+    }
+    // flags, width and precision; '*' would consume an additional argument
+    while (*p != '\0' && strchr("-+ #0123456789.", *p) != NULL) {
+        ++p;
+    }
+    int length = FORMAT_ARG_INT;
+    switch (*p) {
+    case 'h':
+        p += p[1] == 'h' ? 2 : 1;
+        break;
+    case 'l':
+        if (p[1] == 'l') {
+            length = FORMAT_ARG_LONG_LONG;
+            p += 2;
+        } else {
+            length = FORMAT_ARG_LONG;
+            p++;
+        }
+        break;
+    case 'z':
+        length = FORMAT_ARG_SIZE;
+        p++;
+        break;
+    case 'j':
+        length = FORMAT_ARG_INTMAX;
+        p++;
+        break;
+    case 't':
+        length = FORMAT_ARG_PTRDIFF;
+        p++;
+        break;
+    default:
+        break;
+    }
+    switch (*p) {
+    case 'd':
+    case 'i':
+        *arg = length;
+        break;
+    case 'o':
+    case 'u':
+    case 'x':
+    case 'X':
+        *arg = length | FORMAT_ARG_UNSIGNED;
+        break;
+    case 'c':
+        *arg = length == FORMAT_ARG_INT ? FORMAT_ARG_INT | FORMAT_ARG_UNSIGNED : FORMAT_ARG_INVALID;
+        break;
+    case 'e':
+    case 'E':
+    case 'f':
+    case 'F':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        // "l" has no effect on a double, and "L" for long double is not supported
+        *arg = length == FORMAT_ARG_INT || length == FORMAT_ARG_LONG ?
+                FORMAT_ARG_DOUBLE : FORMAT_ARG_INVALID;
+        break;
+    case 's':
+        *arg = length == FORMAT_ARG_INT && p[-1] != 'h' ? FORMAT_ARG_STRING : FORMAT_ARG_INVALID;
+        break;
+    case 'p':
+        *arg = length == FORMAT_ARG_INT && p[-1] != 'h' ? FORMAT_ARG_POINTER : FORMAT_ARG_INVALID;
+        break;
+    case '\0':
+        *arg = FORMAT_ARG_INVALID;
+        return p;
+    default:
+        *arg = FORMAT_ARG_INVALID;
+        break;
+    }
+    return p + 1;
+}
+
+// ---------------------------------------------------------------------------
+
 #if 0   // FIXME see note in NBLog.h
 NBLog::Timeline::Timeline(size_t size, void *shared)
     : mSize(roundup(size)), mOwn(shared == NULL),
@@ -73,19 +163,28 @@ size_t NBLog::Timeline::sharedSize(size_t size)
 // ---------------------------------------------------------------------------
 
 NBLog::Writer::Writer()
-    : mSize(0), mShared(NULL), mRear(0), mEnabled(false)
+    : mSize(0), mShared(NULL), mRear(0), mEnabled(false), mFormatCount(0), mSharedFormatCount(0)
 {
 }
 
 NBLog::Writer::Writer(size_t size, void *shared)
-    : mSize(roundup(size)), mShared((Shared *) shared), mRear(0), mEnabled(mShared != NULL)
+    : mSize(roundup(size)), mShared((Shared *) shared), mRear(0), mEnabled(mShared != NULL),
+      mFormatCount(0), mSharedFormatCount(0)
 {
+    // the shared memory may have been used by a previous writer
+    if (mShared != NULL) {
+        android_atomic_release_store(0, &mShared->mFormatCount);
+    }
 }
 
 NBLog::Writer::Writer(size_t size, const sp<IMemory>& iMemory)
     : mSize(roundup(size)), mShared(iMemory != 0 ? (Shared *) iMemory->pointer() : NULL),
-      mIMemory(iMemory), mRear(0), mEnabled(mShared != NULL)
+      mIMemory(iMemory), mRear(0), mEnabled(mShared != NULL),
+      mFormatCount(0), mSharedFormatCount(0)
 {
+    if (mShared != NULL) {
+        android_atomic_release_store(0, &mShared->mFormatCount);
+    }
 }
 
 void NBLog::Writer::log(const char *string)
@@ -116,6 +215,9 @@ void NBLog::Writer::logvf(const char *fmt, va_list ap)
     if (!mEnabled) {
         return;
     }
+    if (logFormat(fmt, ap)) {
+        return;
+    }
     char buffer[256];
     int length = vsnprintf(buffer, sizeof(buffer), fmt, ap);
     if (length >= (int) sizeof(buffer)) {
@@ -128,6 +230,111 @@ void NBLog::Writer::logvf(const char *fmt, va_list ap)
     }
 }
 
+const NBLog::Writer::Format *NBLog::Writer::findFormat(const char *fmt)
+{
+    // format strings are normally literals, so comparing addresses is sufficient
+    for (size_t i = 0; i < mFormatCount; ++i) {
+        if (mFormats[i].mFmt == fmt) {
+            return &mFormats[i];
+        }
+    }
+    if (mFormatCount >= kMaxCachedFormats) {
+        return NULL;
+    }
+    // first use of this format string: check whether it can be deferred
+    Format *format = &mFormats[mFormatCount++];
+    format->mFmt = fmt;
+    format->mIndex = -1;
+    format->mArgCount = 0;
+    format->mFixedLength = 1;   // the index
+    size_t fmtLength = strlen(fmt);
+    if (fmtLength >= kMaxFormatLength || (size_t) mSharedFormatCount >= kMaxFormats) {
+        return format;
+    }
+    const char *spec;
+    int arg;
+    for (const char *p = fmt; (p = scanFormat(p, &spec, &arg)) != NULL; ) {
+        if (arg == FORMAT_ARG_NONE) {
+            continue;
+        }
+        if (arg == FORMAT_ARG_INVALID || format->mArgCount >= kMaxFormatArgs) {
+            return format;
+        }
+        format->mArgs[format->mArgCount++] = arg;
+        // a string needs at least its length byte
+        format->mFixedLength += arg == FORMAT_ARG_STRING ? 1 : 8;
+    }
+    // kMaxFormatArgs * 8 + 1 always fits in an entry
+    // publish the format string before any entry that refers to it
+    memcpy(mShared->mFormats[mSharedFormatCount], fmt, fmtLength + 1);
+    format->mIndex = mSharedFormatCount;
+    android_atomic_release_store(++mSharedFormatCount, &mShared->mFormatCount);
+    return format;
+}
+
+bool NBLog::Writer::logFormat(const char *fmt, va_list ap)
+{
+    const Format *format = findFormat(fmt);
+    if (format == NULL || format->mIndex < 0) {
+        return false;
+    }
+    uint8_t buffer[255];
+    size_t length = 0;
+    buffer[length++] = format->mIndex;
+    size_t fixed = format->mFixedLength - 1;   // still to be packed, excluding strings
+    for (size_t i = 0; i < format->mArgCount; ++i) {
+        int arg = format->mArgs[i];
+        bool isUnsigned = arg & FORMAT_ARG_UNSIGNED;
+        int64_t value;
+        switch (arg & ~FORMAT_ARG_UNSIGNED) {
+        case FORMAT_ARG_INT:
+            value = isUnsigned ? (int64_t) va_arg(ap, unsigned) : va_arg(ap, int);
+            break;
+        case FORMAT_ARG_LONG:
+            value = isUnsigned ? (int64_t) va_arg(ap, unsigned long) : va_arg(ap, long);
+            break;
+        case FORMAT_ARG_LONG_LONG:
+            value = va_arg(ap, long long);
+            break;
+        case FORMAT_ARG_SIZE:
+            value = isUnsigned ? (int64_t) va_arg(ap, size_t) : va_arg(ap, ssize_t);
+            break;
+        case FORMAT_ARG_INTMAX:
+            value = va_arg(ap, intmax_t);
+            break;
+        case FORMAT_ARG_PTRDIFF:
+            value = va_arg(ap, ptrdiff_t);
+            break;
+        case FORMAT_ARG_POINTER:
+            value = (int64_t) (uintptr_t) va_arg(ap, void *);
+            break;
+        case FORMAT_ARG_DOUBLE: {
+            double d = va_arg(ap, double);
+            memcpy(&value, &d, sizeof(value));
+            } break;
+        case FORMAT_ARG_STRING: {
+            const char *string = va_arg(ap, const char *);
+            if (string == NULL) {
+                string = "(null)";
+            }
+            fixed--;
+            size_t stringLength = strnlen(string, sizeof(buffer) - 1 - length - fixed);
+            buffer[length++] = stringLength;
+            memcpy(&buffer[length], string, stringLength);
+            length += stringLength;
+            } continue;
+        default:
+            LOG_ALWAYS_FATAL("logFormat() arg=%d", arg);
+            break;
+        }
+        memcpy(&buffer[length], &value, sizeof(value));
+        length += sizeof(value);
+        fixed -= sizeof(value);
+    }
+    log(EVENT_FORMAT, buffer, length);
+    return true;
+}
+
 void NBLog::Writer::logTimestamp()
 {
     if (!mEnabled) {
@@ -158,6 +365,7 @@ void NBLog::Writer::log(Event event, const void *data, size_t length)
     switch (event) {
     case EVENT_STRING:
     case EVENT_TIMESTAMP:
+    case EVENT_FORMAT:
         break;
     case EVENT_RESERVED:
     default:
@@ -273,17 +481,32 @@ bool NBLog::LockedWriter::setEnabled(bool enabled)
 // ---------------------------------------------------------------------------
 
 NBLog::Reader::Reader(size_t size, const void *shared)
-    : mSize(roundup(size)), mShared((const Shared *) shared), mFront(0)
+    : mSize(roundup(size)), mShared((const Shared *) shared), mFront(0),
+      mFd(-1), mIndent(0), mLines(NULL), mTimestampNs(0)
 {
 }
 
 NBLog::Reader::Reader(size_t size, const sp<IMemory>& iMemory)
     : mSize(roundup(size)), mShared(iMemory != 0 ? (const Shared *) iMemory->pointer() : NULL),
-      mIMemory(iMemory), mFront(0)
+      mIMemory(iMemory), mFront(0), mFd(-1), mIndent(0), mLines(NULL), mTimestampNs(0)
 {
 }
 
 void NBLog::Reader::dump(int fd, size_t indent)
+{
+    mFd = fd;
+    mIndent = indent;
+    format();
+}
+
+void NBLog::Reader::read(Vector<Line>& lines)
+{
+    mLines = &lines;
+    format();
+    mLines = NULL;
+}
+
+void NBLog::Reader::format()
 {
     int32_t rear = android_atomic_acquire_load(&mShared->mRear);
     size_t avail = rear - mFront;
@@ -338,8 +561,6 @@ void NBLog::Reader::dump(int fd, size_t indent)
         }
         i -= length + 3;
     }
-    mFd = fd;
-    mIndent = indent;
     String8 timestamp, body;
     lost += i;
     if (lost > 0) {
@@ -366,6 +587,9 @@ void NBLog::Reader::dump(int fd, size_t indent)
         case EVENT_STRING:
             body.appendFormat("%.*s", (int) length, (const char *) data);
             break;
+        case EVENT_FORMAT:
+            appendFormat(body, (const uint8_t *) data, length);
+            break;
         case EVENT_TIMESTAMP: {
             // already checked that length == sizeof(struct timespec);
             memcpy(&ts, data, sizeof(struct timespec));
@@ -403,7 +627,9 @@ void NBLog::Reader::dump(int fd, size_t indent)
                 deferredTimestamp = false;
             }
             timestamp.clear();
+            mTimestampNs = ts.tv_sec * 1000000000LL + ts.tv_nsec;
             if (n >= kSquashTimestamp) {
+                mTimestampNs += deltaTotal;
                 timestamp.appendFormat("[%d.%03d to .%.03d by .%.03d to .%.03d]",
                         (int) ts.tv_sec, (int) (ts.tv_nsec / 1000000),
                         (int) ((ts.tv_nsec + deltaTotal) / 1000000),
@@ -437,7 +663,15 @@ void NBLog::Reader::dump(int fd, size_t indent)
 
 void NBLog::Reader::dumpLine(const String8& timestamp, String8& body)
 {
-    if (mFd >= 0) {
+    if (mLines != NULL) {
+        // a timestamp alone is not worth a line of its own
+        if (!body.isEmpty()) {
+            Line line;
+            line.mTimestampNs = mTimestampNs;
+            line.mBody = body;
+            mLines->add(line);
+        }
+    } else if (mFd >= 0) {
         dprintf(mFd, "%.*s%s %s\n", mIndent, "", timestamp.string(), body.string());
     } else {
         ALOGI("%.*s%s %s", mIndent, "", timestamp.string(), body.string());
@@ -445,6 +679,92 @@ void NBLog::Reader::dumpLine(const String8& timestamp, String8& body)
     body.clear();
 }
 
+void NBLog::Reader::appendFormat(String8& body, const uint8_t *data, size_t length)
+{
+    int32_t formatCount = android_atomic_acquire_load(&mShared->mFormatCount);
+    if (length < 1 || data[0] >= formatCount || formatCount > (int32_t) kMaxFormats) {
+        body.append("warning: unknown format");
+        return;
+    }
+    // the format strings are append-only, but copy in case the memory is corrupt
+    char fmt[kMaxFormatLength];
+    memcpy(fmt, mShared->mFormats[data[0]], sizeof(fmt));
+    fmt[sizeof(fmt) - 1] = '\0';
+    size_t offset = 1;
+    const char *p = fmt;
+    const char *spec;
+    int arg;
+    const char *next;
+    while ((next = scanFormat(p, &spec, &arg)) != NULL) {
+        body.append(p, spec - p);
+        p = next;
+        if (arg == FORMAT_ARG_NONE) {
+            body.append("%");
+            continue;
+        }
+        if (arg == FORMAT_ARG_INVALID) {
+            body.append("warning: corrupt format");
+            return;
+        }
+        // the conversion without its length modifier, which is replaced according to the
+        // packed size of the argument
+        char conversion[kMaxFormatLength + 4];
+        size_t specLength = next - spec - 1;
+        while (specLength > 1 && strchr("hljzt", spec[specLength - 1]) != NULL) {
+            --specLength;
+        }
+        memcpy(conversion, spec, specLength);
+        if (arg == FORMAT_ARG_STRING) {
+            if (offset >= length || offset + 1 + data[offset] > length) {
+                body.append("warning: corrupt event");
+                return;
+            }
+            char string[256];
+            size_t stringLength = data[offset++];
+            memcpy(string, &data[offset], stringLength);
+            string[stringLength] = '\0';
+            offset += stringLength;
+            conversion[specLength] = 's';
+            conversion[specLength + 1] = '\0';
+            body.appendFormat(conversion, string);
+            continue;
+        }
+        int64_t value;
+        if (offset + sizeof(value) > length) {
+            body.append("warning: corrupt event");
+            return;
+        }
+        memcpy(&value, &data[offset], sizeof(value));
+        offset += sizeof(value);
+        switch (arg & ~FORMAT_ARG_UNSIGNED) {
+        case FORMAT_ARG_INT:
+            // keep "h" and "hh", which apply to an int
+            memcpy(conversion, spec, next - spec);
+            conversion[next - spec] = '\0';
+            body.appendFormat(conversion, (int) value);
+            break;
+        case FORMAT_ARG_DOUBLE: {
+            double d;
+            memcpy(&d, &value, sizeof(d));
+            conversion[specLength] = next[-1];
+            conversion[specLength + 1] = '\0';
+            body.appendFormat(conversion, d);
+            } break;
+        case FORMAT_ARG_POINTER:
+            body.appendFormat("%#llx", (unsigned long long) value);
+            break;
+        default:
+            conversion[specLength] = 'l';
+            conversion[specLength + 1] = 'l';
+            conversion[specLength + 2] = next[-1];
+            conversion[specLength + 3] = '\0';
+            body.appendFormat(conversion, (long long) value);
+            break;
+        }
+    }
+    body.append(p);
+}
+
 bool NBLog::Reader::isIMemory(const sp<IMemory>& iMemory) const
 {
     return iMemory != 0 && mIMemory != 0 && iMemory->pointer() == mIMemory->pointer();
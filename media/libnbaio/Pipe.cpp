@@ -17,6 +17,7 @@
 #define LOG_TAG "Pipe"
 //#define LOG_NDEBUG 0
 
+#include <string.h>
 #include <cutils/atomic.h>
 #include <cutils/compiler.h>
 #include <utils/Log.h>
@@ -33,6 +34,7 @@ Pipe::Pipe(size_t maxFrames, const NBAIO_Format& format, void *buffer) :
         mReaders(0),
         mFreeBufferInDestructor(buffer == NULL)
 {
+    memset(mReaderSlots, 0, sizeof(mReaderSlots));
 }
 
 Pipe::~Pipe()
@@ -70,4 +72,23 @@ ssize_t Pipe::write(const void *buffer, size_t count)
     return written;
 }
 
+size_t Pipe::getReaderStats(ReaderStats stats[], size_t maxStats) const
+{
+    int32_t rear = android_atomic_acquire_load(&mRear);
+    size_t count = 0;
+    for (size_t i = 0; i < kMaxReaderStats && count < maxStats; ++i) {
+        const ReaderSlot *slot = &mReaderSlots[i];
+        if (android_atomic_acquire_load(&slot->mInUse) == 0) {
+            continue;
+        }
+        ReaderStats *s = &stats[count++];
+        s->mLag = (size_t) (rear - android_atomic_acquire_load(&slot->mFront));
+        s->mMaxLag = slot->mMaxLag;
+        s->mOverruns = slot->mOverruns;
+        s->mFramesOverrun = slot->mFramesOverrun;
+        s->mLowestLatency = slot->mLowestLatency != 0;
+    }
+    return count;
+}
+
 }   // namespace android
@@ -17,25 +17,47 @@
 #define LOG_TAG "PipeReader"
 //#define LOG_NDEBUG 0
 
+#include <cutils/atomic.h>
 #include <cutils/compiler.h>
 #include <utils/Log.h>
 #include <media/nbaio/PipeReader.h>
 
 namespace android {
 
-PipeReader::PipeReader(Pipe& pipe) :
+PipeReader::PipeReader(Pipe& pipe, OverrunPolicy policy) :
         NBAIO_Source(pipe.mFormat),
         mPipe(pipe),
+        mPolicy(policy),
         // any data already in the pipe is not visible to this PipeReader
         mFront(android_atomic_acquire_load(&pipe.mRear)),
         mFramesOverrun(0),
-        mOverruns(0)
+        mOverruns(0),
+        mSlot(NULL),
+        mMaxLag(0)
 {
     android_atomic_inc(&pipe.mReaders);
+    for (size_t i = 0; i < Pipe::kMaxReaderStats; ++i) {
+        Pipe::ReaderSlot *slot = &pipe.mReaderSlots[i];
+        if (android_atomic_cmpxchg(0, 1, &slot->mInUse) == 0) {
+            slot->mFront = mFront;
+            slot->mMaxLag = 0;
+            slot->mOverruns = 0;
+            slot->mFramesOverrun = 0;
+            slot->mLowestLatency = policy == OVERRUN_LOWEST_LATENCY;
+            mSlot = slot;
+            break;
+        }
+    }
+    if (mSlot == NULL) {
+        ALOGW("more than %zu readers, statistics unavailable", Pipe::kMaxReaderStats);
+    }
 }
 
 PipeReader::~PipeReader()
 {
+    if (mSlot != NULL) {
+        android_atomic_release_store(0, &mSlot->mInUse);
+    }
     int32_t readers = android_atomic_dec(&mPipe.mReaders);
     ALOG_ASSERT(readers > 0);
 }
@@ -49,13 +71,29 @@ ssize_t PipeReader::availableToRead()
     // read() is not multi-thread safe w.r.t. itself, so no mutex or atomic op needed to read mFront
     size_t avail = rear - mFront;
     if (CC_UNLIKELY(avail > mPipe.mMaxFrames)) {
-        // Discard 1/16 of the most recent data in pipe to avoid another overrun immediately
         int32_t oldFront = mFront;
-        mFront = rear - mPipe.mMaxFrames + (mPipe.mMaxFrames >> 4);
+        if (mPolicy == OVERRUN_LOWEST_LATENCY) {
+            // Keep only the most recent 1/16 of the pipe
+            mFront = rear - (mPipe.mMaxFrames >> 4);
+        } else {
+            // Discard 1/16 of the most recent data in pipe to avoid another overrun immediately
+            mFront = rear - mPipe.mMaxFrames + (mPipe.mMaxFrames >> 4);
+        }
         mFramesOverrun += (size_t) (mFront - oldFront);
         ++mOverruns;
+        if (mSlot != NULL) {
+            mSlot->mOverruns = mOverruns;
+            mSlot->mFramesOverrun = mFramesOverrun;
+            android_atomic_release_store(mFront, &mSlot->mFront);
+        }
         return OVERRUN;
     }
+    if (CC_UNLIKELY((int32_t) avail > mMaxLag)) {
+        mMaxLag = avail;
+        if (mSlot != NULL) {
+            mSlot->mMaxLag = mMaxLag;
+        }
+    }
     return avail;
 }
 
@@ -89,6 +127,9 @@ ssize_t PipeReader::read(void *buffer, size_t count, int64_t readPTS __unused)
     }
     mFront += red;
     mFramesRead += red;
+    if (mSlot != NULL) {
+        android_atomic_release_store(mFront, &mSlot->mFront);
+    }
     return red;
 }
 
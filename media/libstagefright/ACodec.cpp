@@ -1571,10 +1571,17 @@ status_t ACodec::configureCodec(
                     isADTS != 0, sbrMode, maxOutputChannelCount, drc,
                     pcmLimiterEnable);
         }
-    } else if (!strcasecmp(mime, MEDIA_MIMETYPE_AUDIO_AMR_NB)) {
-        err = setupAMRCodec(encoder, false /* isWAMR */, bitRate);
-    } else if (!strcasecmp(mime, MEDIA_MIMETYPE_AUDIO_AMR_WB)) {
-        err = setupAMRCodec(encoder, true /* isWAMR */, bitRate);
+    } else if (!strcasecmp(mime, MEDIA_MIMETYPE_AUDIO_AMR_NB)
+            || !strcasecmp(mime, MEDIA_MIMETYPE_AUDIO_AMR_WB)) {
+        bool isWAMR = !strcasecmp(mime, MEDIA_MIMETYPE_AUDIO_AMR_WB);
+        err = setupAMRCodec(encoder, isWAMR, bitRate);
+
+        int32_t framesPerBuffer;
+        if (err == OK && encoder
+                && msg->findInt32("frames-per-buffer", &framesPerBuffer)
+                && framesPerBuffer > 1) {
+            err = setupFramesPerBuffer(framesPerBuffer);
+        }
     } else if (!strcasecmp(mime, MEDIA_MIMETYPE_AUDIO_G711_ALAW)
             || !strcasecmp(mime, MEDIA_MIMETYPE_AUDIO_G711_MLAW)) {
         // These are PCM-like formats with a fixed sample rate but
@@ -1983,6 +1990,29 @@ static OMX_AUDIO_AMRBANDMODETYPE pickModeFromBitRate(
     }
 }
 
+// Several encoded frames per output buffer, in order, for fewer buffers on
+// a call. Encoders that can't leave it at one frame per buffer.
+status_t ACodec::setupFramesPerBuffer(int32_t framesPerBuffer) {
+    OMX_INDEXTYPE index;
+    status_t err = mOMX->getExtensionIndex(
+            mNode, "OMX.google.android.index.framesPerBuffer", &index);
+
+    if (err == OK) {
+        OMX_PARAM_U32TYPE params;
+        InitOMXParams(&params);
+        params.nPortIndex = kPortIndexOutput;
+        params.nU32 = framesPerBuffer;
+
+        err = mOMX->setParameter(mNode, index, &params, sizeof(params));
+    }
+
+    if (err != OK) {
+        ALOGW("[%s] does not pack %d frames per buffer (err %d)",
+              mComponentName.c_str(), framesPerBuffer, err);
+    }
+    return OK;
+}
+
 status_t ACodec::setupAMRCodec(bool encoder, bool isWAMR, int32_t bitrate) {
     OMX_AUDIO_PARAM_AMRTYPE def;
     InitOMXParams(&def);
@@ -2850,6 +2880,13 @@ status_t ACodec::setupAVCEncoderParameters(const sp<AMessage> &msg) {
     ExtendedUtils::setBFrames(h264type, iFrameInterval,
             frameRate, mComponentName.c_str());
 
+    // a slice every so many macroblocks, for the frame to be sent out as it
+    // is encoded by the encoders that output partial frames
+    int32_t sliceMBs;
+    if (msg->findInt32("slice-mbs", &sliceMBs) && sliceMBs > 0) {
+        h264type.nSliceHeaderSpacing = sliceMBs;
+    }
+
     if (h264type.nBFrames != 0) {
         h264type.nAllowedPictureTypes |= OMX_VIDEO_PictureTypeB;
     }
@@ -4187,14 +4224,23 @@ void ACodec::BaseState::postFillThisBuffer(BufferInfo *info) {
 
     CHECK_EQ((int)info->mStatus, (int)BufferInfo::OWNED_BY_US);
 
-    sp<AMessage> notify = mCodec->mNotify->dup();
+    if (info->mNotifyMsg == NULL) {
+        info->mNotifyMsg = mCodec->mNotify->dup();
+        info->mReplyMsg = new AMessage(kWhatInputBufferFilled, mCodec->id());
+    }
+
+    // The client is done with both messages by the time the buffer is
+    // back; every item of the notification is set again below, the reply
+    // starts out empty.
+    sp<AMessage> notify = info->mNotifyMsg;
     notify->setInt32("what", CodecBase::kWhatFillThisBuffer);
     notify->setInt32("buffer-id", info->mBufferID);
 
     info->mData->meta()->clear();
     notify->setBuffer("buffer", info->mData);
 
-    sp<AMessage> reply = new AMessage(kWhatInputBufferFilled, mCodec->id());
+    sp<AMessage> reply = info->mReplyMsg;
+    reply->clear();
     reply->setInt32("buffer-id", info->mBufferID);
 
     notify->setMessage("reply", reply);
@@ -4458,8 +4504,15 @@ bool ACodec::BaseState::onOMXFillBufferDone(
                 break;
             }
 
-            sp<AMessage> reply =
-                new AMessage(kWhatOutputBufferDrained, mCodec->id());
+            if (info->mNotifyMsg == NULL) {
+                info->mNotifyMsg = mCodec->mNotify->dup();
+                info->mReplyMsg =
+                    new AMessage(kWhatOutputBufferDrained, mCodec->id());
+            }
+
+            // See postFillThisBuffer() on reusing the messages.
+            sp<AMessage> reply = info->mReplyMsg;
+            reply->clear();
 
             if (!mCodec->mSentFormat && rangeLength > 0) {
                 mCodec->sendFormatChange(reply);
@@ -4488,7 +4541,7 @@ bool ACodec::BaseState::onOMXFillBufferDone(
             info->mData->meta()->setInt64("timeUs", timeUs);
             info->mData->meta()->setObject("graphic-buffer", info->mGraphicBuffer);
 
-            sp<AMessage> notify = mCodec->mNotify->dup();
+            sp<AMessage> notify = info->mNotifyMsg;
             notify->setInt32("what", CodecBase::kWhatDrainThisBuffer);
             notify->setInt32("buffer-id", info->mBufferID);
             notify->setBuffer("buffer", info->mData);
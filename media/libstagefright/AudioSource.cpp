@@ -49,7 +49,10 @@ AudioSource::AudioSource(
       mMime(MEDIA_MIMETYPE_AUDIO_RAW),
       mMaxBufferSize(kMaxBufferSize),
       mNumClientOwnedBuffers(0),
-      mRecPaused(false) {
+      mRecPaused(false),
+      mBatchBuffer(NULL),
+      mBatchTimeUs(0),
+      mBatchBytes(0) {
     ALOGV("sampleRate: %d, channelCount: %d", sampleRate, channelCount);
     CHECK(channelCount == 1 || channelCount == 2 || channelCount == 6);
 
@@ -69,9 +72,6 @@ AudioSource::AudioSource(
             bufCount++;
         }
 
-        mTempBuf.size = 0;
-        mTempBuf.frameCount = 0;
-        mTempBuf.i16 = (short*)NULL;
         mPrevPosition = 0;
         mAudioSessionId = -1;
         mAllocBytes = 0;
@@ -116,15 +116,11 @@ AudioSource::AudioSource(
                     buffDuration = AUDIO_RECORD_DEFAULT_BUFFER_DURATION;
 
                 /* set to update position after frames worth of buffduration
-                   time for 16 bits */
+                   time for 16 bits, read straight into the buffers queued
+                   for the encoder */
                 mAllocBytes = ((sizeof(uint8_t) * frameCount * 2 * channelCount));
                 ALOGI("AudioSource in TRANSFER_SYNC with duration %d ms",
                                                               buffDuration);
-                mTempBuf.i16 = (short*) malloc(mAllocBytes);
-                if (mTempBuf.i16 == NULL) {
-                    mAllocBytes = 0;
-                    mInitCheck = NO_MEMORY;
-                }
                 mTransferMode = AudioRecord::TRANSFER_SYNC;
                 mRecord->setPositionUpdatePeriod((sampleRate * buffDuration)/1000);
             }
@@ -139,6 +135,20 @@ AudioSource::AudioSource(
                         frameCount /*notificationFrames*/);
             ALOGI("AudioSource in TRANSFER_CALLBACK");
             mTransferMode = AudioRecord::TRANSFER_CALLBACK;
+
+            // Callbacks bring 20ms or so of audio each, put several of them
+            // in a buffer if asked to for the encoder to get fewer, larger
+            // ones.
+            char propValue[PROPERTY_VALUE_MAX];
+            if (property_get("audio.record.batch.duration", propValue, NULL)) {
+                int64_t batchFrames = (int64_t)atoi(propValue) * sampleRate / 1000;
+                const size_t frameSize = sizeof(int16_t) * channelCount;
+                if (batchFrames > 0) {
+                    mBatchBytes = batchFrames * frameSize < (size_t)mMaxBufferSize
+                            ? batchFrames * frameSize : mMaxBufferSize / frameSize * frameSize;
+                    ALOGI("AudioSource batching %zu bytes", mBatchBytes);
+                }
+            }
         }
 
         mInitCheck = mRecord->initCheck();
@@ -165,7 +175,10 @@ AudioSource::AudioSource( audio_source_t inputSource, const sp<MetaData>& meta )
       mNumClientOwnedBuffers(0),
       mFormat(AUDIO_FORMAT_PCM_16_BIT),
       mMime(MEDIA_MIMETYPE_AUDIO_RAW),
-      mRecPaused(false) {
+      mRecPaused(false),
+      mBatchBuffer(NULL),
+      mBatchTimeUs(0),
+      mBatchBytes(0) {
 
     const char * mime;
     ALOGV("AudioSource CTOR compress offload capture: inputSource: %d", inputSource);
@@ -193,9 +206,6 @@ AudioSource::AudioSource( audio_source_t inputSource, const sp<MetaData>& meta )
                 AudioRecordCallbackFunction,
                 this);
     mInitCheck = mRecord->initCheck();
-    mTempBuf.size = 0;
-    mTempBuf.frameCount = 0;
-    mTempBuf.i16 = (short*)NULL;
     mPrevPosition = 0;
     mAudioSessionId = -1;
     mAllocBytes = 0;
@@ -208,11 +218,9 @@ AudioSource::~AudioSource() {
         reset();
     }
 
-    if (mTransferMode == AudioRecord::TRANSFER_SYNC) {
-        if(mTempBuf.i16) {
-            free(mTempBuf.i16);
-            mTempBuf.i16 = (short*)NULL;
-        }
+    while (!mFreeBuffers.empty()) {
+        (*mFreeBuffers.begin())->release();
+        mFreeBuffers.erase(mFreeBuffers.begin());
     }
 }
 
@@ -243,6 +251,10 @@ status_t AudioSource::start(MetaData *params) {
     if (params && params->findInt64(kKeyTime, &startTimeUs)) {
         mStartTimeUs = startTimeUs;
     }
+    for (size_t i = mFreeBuffers.size(); i < kNumPreallocatedBuffers; ++i) {
+        mFreeBuffers.push_back(new MediaBuffer(mMaxBufferSize));
+    }
+
     status_t err = mRecord->start();
     if (err == OK) {
         mStarted = true;
@@ -265,11 +277,30 @@ void AudioSource::releaseQueuedFrames_l() {
     List<MediaBuffer *>::iterator it;
     while (!mBuffersReceived.empty()) {
         it = mBuffersReceived.begin();
-        (*it)->release();
+        recycleBuffer_l(*it);
         mBuffersReceived.erase(it);
     }
 }
 
+MediaBuffer *AudioSource::acquireBuffer_l() {
+    MediaBuffer *buffer;
+    if (mFreeBuffers.empty()) {
+        // the encoder is behind, the pool grows for good
+        ALOGV("allocating a buffer");
+        buffer = new MediaBuffer(mMaxBufferSize);
+    } else {
+        buffer = *mFreeBuffers.begin();
+        mFreeBuffers.erase(mFreeBuffers.begin());
+        buffer->reset();
+    }
+    buffer->set_range(0, 0);
+    return buffer;
+}
+
+void AudioSource::recycleBuffer_l(MediaBuffer *buffer) {
+    mFreeBuffers.push_back(buffer);
+}
+
 void AudioSource::waitOutstandingEncodingFrames_l() {
     ALOGV("waitOutstandingEncodingFrames_l: %" PRId64, mNumClientOwnedBuffers);
     while (mNumClientOwnedBuffers > 0) {
@@ -293,14 +324,16 @@ status_t AudioSource::reset() {
     mRecord->stop();
     waitOutstandingEncodingFrames_l();
     releaseQueuedFrames_l();
+    if (mBatchBuffer != NULL) {
+        recycleBuffer_l(mBatchBuffer);
+        mBatchBuffer = NULL;
+    }
 
     if (mTransferMode == AudioRecord::TRANSFER_SYNC) {
         if(mAudioSessionId != -1)
             AudioSystem::releaseAudioSessionId(mAudioSessionId, -1);
 
         mAudioSessionId = -1;
-        mTempBuf.size = 0;
-        mTempBuf.frameCount = 0;
     }
     return OK;
 }
@@ -408,18 +441,25 @@ void AudioSource::signalBufferReturned(MediaBuffer *buffer) {
     Mutex::Autolock autoLock(mLock);
     --mNumClientOwnedBuffers;
     buffer->setObserver(0);
-    buffer->release();
+    recycleBuffer_l(buffer);
     mFrameEncodingCompletionCondition.signal();
     return;
 }
 
 status_t AudioSource::dataCallback(const AudioRecord::Buffer& audioBuffer) {
+    return onAudioData(audioBuffer.i16, audioBuffer.size, NULL);
+}
+
+status_t AudioSource::onAudioData(const void *data, size_t size, MediaBuffer *filled) {
     int64_t timeUs = systemTime() / 1000ll;
 
     ALOGV("dataCallbackTimestamp: %" PRId64 " us", timeUs);
     Mutex::Autolock autoLock(mLock);
     if (!mStarted) {
         ALOGW("Spurious callback from AudioRecord. Drop the audio data.");
+        if (filled != NULL) {
+            recycleBuffer_l(filled);
+        }
         return OK;
     }
 
@@ -427,6 +467,9 @@ status_t AudioSource::dataCallback(const AudioRecord::Buffer& audioBuffer) {
     if (mNumFramesReceived == 0 && timeUs < mStartTimeUs) {
         (void) mRecord->getInputFramesLost();
         ALOGV("Drop audio data at %" PRId64 "/%" PRId64 " us", timeUs, mStartTimeUs);
+        if (filled != NULL) {
+            recycleBuffer_l(filled);
+        }
         return OK;
     }
 
@@ -452,41 +495,71 @@ status_t AudioSource::dataCallback(const AudioRecord::Buffer& audioBuffer) {
 
     CHECK_EQ(numLostBytes & 1, 0u);
     if ( mFormat == AUDIO_FORMAT_PCM_16_BIT )
-        CHECK_EQ(audioBuffer.size & 1, 0u);
+        CHECK_EQ(size & 1, 0u);
     if (numLostBytes > 0) {
         // Loss of audio frames should happen rarely; thus the LOGW should
         // not cause a logging spam
         ALOGW("Lost audio record data: %zu bytes", numLostBytes);
     }
 
-    while (numLostBytes > 0) {
-        size_t bufferSize = numLostBytes;
-        if (numLostBytes > kMaxBufferSize) {
-            numLostBytes -= kMaxBufferSize;
-            bufferSize = kMaxBufferSize;
-        } else {
-            numLostBytes = 0;
-        }
-        MediaBuffer *lostAudioBuffer = new MediaBuffer(bufferSize);
-        memset(lostAudioBuffer->data(), 0, bufferSize);
-        lostAudioBuffer->set_range(0, bufferSize);
-        queueInputBuffer_l(lostAudioBuffer, timeUs);
+    if (numLostBytes > 0) {
+        appendInput_l(NULL, numLostBytes, timeUs);
     }
 
-    if (audioBuffer.size == 0) {
+    if (size == 0) {
         ALOGW("Nothing is available from AudioRecord callback buffer");
+        if (filled != NULL) {
+            recycleBuffer_l(filled);
+        }
         return OK;
     }
 
-    const size_t bufferSize = audioBuffer.size;
-    MediaBuffer *buffer = new MediaBuffer(bufferSize);
-    memcpy((uint8_t *) buffer->data(),
-            audioBuffer.i16, audioBuffer.size);
-    buffer->set_range(0, bufferSize);
-    queueInputBuffer_l(buffer, timeUs);
+    if (filled != NULL) {
+        // read in place, in a buffer of its own
+        if (mBatchBuffer != NULL) {
+            queueInputBuffer_l(mBatchBuffer, mBatchTimeUs);
+            mBatchBuffer = NULL;
+        }
+        filled->set_range(0, size);
+        queueInputBuffer_l(filled, timeUs);
+    } else {
+        appendInput_l(data, size, timeUs);
+    }
     return OK;
 }
 
+// Copies the data, or silence if it is NULL, at the end of the buffer being
+// filled and queues that buffer once it holds mBatchBytes. Without batching
+// the data is queued right away, split in buffers of mMaxBufferSize.
+void AudioSource::appendInput_l(const void *data, size_t size, int64_t timeUs) {
+    const uint8_t *src = (const uint8_t *)data;
+    while (size > 0) {
+        if (mBatchBuffer == NULL) {
+            mBatchBuffer = acquireBuffer_l();
+            mBatchTimeUs = timeUs;
+        }
+
+        size_t offset = mBatchBuffer->range_length();
+        size_t copy = mBatchBuffer->size() - offset;
+        if (copy > size) {
+            copy = size;
+        }
+        if (src != NULL) {
+            memcpy((uint8_t *)mBatchBuffer->data() + offset, src, copy);
+            src += copy;
+        } else {
+            memset((uint8_t *)mBatchBuffer->data() + offset, 0, copy);
+        }
+        mBatchBuffer->set_range(0, offset + copy);
+        size -= copy;
+
+        if (mBatchBuffer->range_length() >= mBatchBytes) {
+            queueInputBuffer_l(mBatchBuffer, mBatchTimeUs);
+            mBatchBuffer = NULL;
+        }
+    }
+}
+
 void AudioSource::onEvent(int event, void* info) {
 
     switch (event) {
@@ -506,21 +579,27 @@ void AudioSource::onEvent(int event, void* info) {
                 framestoRead = (mAllocBytes / (2 * mRecord->channelCount()));
             }
 
-            if(mTempBuf.i16 && framestoRead > 0) {
-                //read only if you have valid data
-                size_t bytesRead = mRecord->read(mTempBuf.i16, framestoRead);
+            if(mAllocBytes > 0 && framestoRead > 0) {
+                //read only if you have valid data, straight into the
+                //buffer to be queued
+                MediaBuffer *buffer;
+                {
+                    Mutex::Autolock autoLock(mLock);
+                    buffer = acquireBuffer_l();
+                }
+                ssize_t bytesRead = mRecord->read(buffer->data(), bytestoRead);
                 size_t framesRead = 0;
                 ALOGV("event_new_pos, new pos %d, frames to read %d\n", \
                         position, framestoRead);
-                ALOGV("bytes read = %d \n", bytesRead);
+                ALOGV("bytes read = %zd \n", bytesRead);
                 if(bytesRead > 0){
                     framesRead = (bytesRead / (2 * mRecord->channelCount()));
                     mPrevPosition += framesRead;
-                    mTempBuf.size = bytesRead;
-                    mTempBuf.frameCount = framesRead;
-                    dataCallback(mTempBuf);
+                    onAudioData(NULL, bytesRead, buffer);
                 } else {
                     ALOGE("EVENT_NEW_POS did not return any data");
+                    Mutex::Autolock autoLock(mLock);
+                    recycleBuffer_l(buffer);
                 }
             } else {
                 ALOGE("Init error");
@@ -543,7 +622,7 @@ void AudioSource::queueInputBuffer_l(MediaBuffer *buffer, int64_t timeUs) {
         if (!mBuffersReceived.empty()) {
             releaseQueuedFrames_l();
         }
-        buffer->release();
+        recycleBuffer_l(buffer);
         return;
     }
 
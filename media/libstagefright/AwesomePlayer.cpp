@@ -95,6 +95,11 @@ int AwesomePlayer::mTunnelAliveAP = 0;
 // is destroyed to allow the audio DSP to power down.
 static int64_t kOffloadPauseMaxUs = 60000000ll;
 
+// How late the buffering and video lag polls, and the audio EOS check, may
+// fire for the event queue to run them on the wakeup of a video event, or of
+// each other, rather than wake up for them alone.
+static const int64_t kPollSlackUs = 100000ll;
+static const int64_t kAudioStatusSlackUs = 20000ll;
 
 struct AwesomeEvent : public TimedEventQueue::Event {
     AwesomeEvent(
@@ -533,6 +538,10 @@ status_t AwesomePlayer::setDataSource_l(const sp<MediaExtractor> &extractor) {
 
     ALOGV("mBitrate = %lld bits/sec", mBitrate);
 
+    if (mCachedSource != NULL && mBitrate > 0) {
+        mCachedSource->setStreamBitrate(mBitrate);
+    }
+
     {
         Mutex::Autolock autoLock(mStatsLock);
         mStats.mBitrate = mBitrate;
@@ -944,6 +953,12 @@ void AwesomePlayer::onBufferingUpdate() {
         ALOGV("cachedDurationUs = %.2f secs, eos=%d",
              cachedDurationUs / 1E6, eos);
 
+        int64_t underrunTimeUs;
+        if (mCachedSource != NULL
+                && mCachedSource->getEstimatedUnderrunTimeUs(&underrunTimeUs) == OK) {
+            ALOGV("cache expected to run dry in %.2f secs", underrunTimeUs / 1E6);
+        }
+
         if ((mFlags & PLAYING) && !eos
                 && (cachedDurationUs < kLowWaterMarkUs)) {
             modifyFlags(CACHE_UNDERRUN, SET);
@@ -2639,7 +2654,7 @@ void AwesomePlayer::postBufferingEvent_l() {
         return;
     }
     mBufferingEventPending = true;
-    mQueue.postEventWithDelay(mBufferingEvent, 1000000ll);
+    mQueue.postEventWithDelay(mBufferingEvent, 1000000ll, kPollSlackUs);
 }
 
 void AwesomePlayer::postVideoLagEvent_l() {
@@ -2647,7 +2662,7 @@ void AwesomePlayer::postVideoLagEvent_l() {
         return;
     }
     mVideoLagEventPending = true;
-    mQueue.postEventWithDelay(mVideoLagEvent, 1000000ll);
+    mQueue.postEventWithDelay(mVideoLagEvent, 1000000ll, kPollSlackUs);
 }
 
 void AwesomePlayer::postCheckAudioStatusEvent(int64_t delayUs) {
@@ -2660,7 +2675,9 @@ void AwesomePlayer::postCheckAudioStatusEvent(int64_t delayUs) {
     if (mFlags & (LOOPING | AUTO_LOOPING)) {
         delayUs = 0;
     }
-    mQueue.postEventWithDelay(mCheckAudioStatusEvent, delayUs);
+    mQueue.postEventWithDelay(
+            mCheckAudioStatusEvent, delayUs,
+            delayUs > 0 ? kAudioStatusSlackUs : 0);
 }
 
 void AwesomePlayer::postAudioTearDownEvent(int64_t delayUs) {
@@ -0,0 +1,344 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "BlockFileWriter"
+#include <utils/Log.h>
+
+#include "include/BlockFileWriter.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <unistd.h>
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/MediaErrors.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+static int64_t nowUs() {
+    return systemTime(SYSTEM_TIME_MONOTONIC) / 1000ll;
+}
+
+BlockFileWriter::BlockFileWriter(
+        int fd, off64_t offset, size_t blockSize, size_t numBlocks,
+        int64_t syncIntervalBytes)
+    : mFd(fd),
+      mBlockSize(blockSize),
+      mSyncIntervalBytes(syncIntervalBytes),
+      mInitCheck(NO_INIT),
+      mFilling(NULL),
+      mNextOffset(offset),
+      mWriting(false),
+      mDone(false),
+      mError(OK),
+      mBytesWritten(0),
+      mNumWrites(0),
+      mTotalWriteTimeUs(0),
+      mMaxWriteTimeUs(0),
+      mNumStalls(0),
+      mTotalStallTimeUs(0) {
+    CHECK_GE(numBlocks, 2u);
+
+    for (size_t i = 0; i < numBlocks; ++i) {
+        void *data;
+        // Page aligned, the kernel can then hand whole pages to the device.
+        if (posix_memalign(&data, 4096, mBlockSize) != 0) {
+            mInitCheck = NO_MEMORY;
+            return;
+        }
+
+        Block *block = new Block;
+        block->mData = (uint8_t *)data;
+        block->mOffset = 0;
+        block->mSize = 0;
+        block->mCapacity = 0;
+        mFreeBlocks.push_back(block);
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+
+    if (pthread_create(&mThread, &attr, ThreadWrapper, this) == 0) {
+        mInitCheck = OK;
+    }
+    pthread_attr_destroy(&attr);
+}
+
+BlockFileWriter::~BlockFileWriter() {
+    if (mInitCheck == OK) {
+        flush();
+
+        {
+            Mutex::Autolock autoLock(mLock);
+            mDone = true;
+            mBlockQueuedCondition.signal();
+        }
+
+        void *dummy;
+        pthread_join(mThread, &dummy);
+
+        ALOGD("%" PRId64 " bytes in %" PRId64 " writes, %" PRId64
+              " us max per write, %" PRId64 " stalls",
+              mBytesWritten, mNumWrites, mMaxWriteTimeUs, mNumStalls);
+    }
+
+    while (!mFreeBlocks.empty()) {
+        Block *block = *mFreeBlocks.begin();
+        mFreeBlocks.erase(mFreeBlocks.begin());
+
+        free(block->mData);
+        delete block;
+    }
+}
+
+status_t BlockFileWriter::initCheck() const {
+    return mInitCheck;
+}
+
+void BlockFileWriter::startFilling_l() {
+    if (mFreeBlocks.empty()) {
+        // All blocks are waiting to be written, the device can't keep up.
+        int64_t startUs = nowUs();
+        while (mFreeBlocks.empty()) {
+            mBlockWrittenCondition.wait(mLock);
+        }
+        ++mNumStalls;
+        mTotalStallTimeUs += nowUs() - startUs;
+    }
+
+    mFilling = *mFreeBlocks.begin();
+    mFreeBlocks.erase(mFreeBlocks.begin());
+
+    // End the block on a block boundary of the file.
+    mFilling->mOffset = mNextOffset;
+    mFilling->mSize = 0;
+    mFilling->mCapacity = mBlockSize - (mNextOffset % mBlockSize);
+}
+
+void BlockFileWriter::queueFilling_l() {
+    if (mFilling == NULL) {
+        return;
+    }
+
+    if (mFilling->mSize > 0) {
+        mFullBlocks.push_back(mFilling);
+        mBlockQueuedCondition.signal();
+    } else {
+        mFreeBlocks.push_back(mFilling);
+    }
+
+    mFilling = NULL;
+}
+
+void BlockFileWriter::waitForWrites_l() {
+    while (!mFullBlocks.empty() || mWriting) {
+        mBlockWrittenCondition.wait(mLock);
+    }
+}
+
+void BlockFileWriter::append(const void *data, size_t size) {
+    Mutex::Autolock autoLock(mLock);
+
+    const uint8_t *ptr = (const uint8_t *)data;
+    while (size > 0) {
+        if (mFilling == NULL) {
+            startFilling_l();
+        }
+
+        size_t n = mFilling->mCapacity - mFilling->mSize;
+        if (n > size) {
+            n = size;
+        }
+
+        memcpy(mFilling->mData + mFilling->mSize, ptr, n);
+        mFilling->mSize += n;
+        mNextOffset += n;
+        ptr += n;
+        size -= n;
+
+        if (mFilling->mSize == mFilling->mCapacity) {
+            queueFilling_l();
+        }
+    }
+}
+
+void BlockFileWriter::seekTo(off64_t offset) {
+    Mutex::Autolock autoLock(mLock);
+
+    if (offset == mNextOffset) {
+        return;
+    }
+
+    queueFilling_l();
+    mNextOffset = offset;
+}
+
+void BlockFileWriter::writeAt(off64_t offset, const void *data, size_t size) {
+    Mutex::Autolock autoLock(mLock);
+
+    if (mFilling != NULL
+            && offset >= mFilling->mOffset
+            && offset + (off64_t)size <= mFilling->mOffset + (off64_t)mFilling->mSize) {
+        memcpy(mFilling->mData + (offset - mFilling->mOffset), data, size);
+        return;
+    }
+
+    if (mFilling != NULL
+            && offset < mFilling->mOffset + (off64_t)mFilling->mSize
+            && offset + (off64_t)size > mFilling->mOffset) {
+        // Partly buffered, write that part first.
+        queueFilling_l();
+    }
+
+    // The data to overwrite must be in the file before it is overwritten.
+    waitForWrites_l();
+
+    const uint8_t *ptr = (const uint8_t *)data;
+    while (size > 0) {
+        ssize_t n = pwrite64(mFd, ptr, size, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            ALOGE("failed to write %zu bytes at %" PRId64 " (%s)",
+                  size, offset, strerror(errno));
+            if (mError == OK) {
+                mError = ERROR_IO;
+            }
+            return;
+        }
+
+        ptr += n;
+        offset += n;
+        size -= n;
+    }
+}
+
+status_t BlockFileWriter::flush() {
+    Mutex::Autolock autoLock(mLock);
+
+    queueFilling_l();
+    waitForWrites_l();
+
+    return mError;
+}
+
+void BlockFileWriter::dump(String8 *result) const {
+    Mutex::Autolock autoLock(mLock);
+
+    const size_t SIZE = 256;
+    char buffer[SIZE];
+    snprintf(buffer, SIZE,
+            "     written: %" PRId64 " bytes in %" PRId64 " writes\n",
+            mBytesWritten, mNumWrites);
+    result->append(buffer);
+    snprintf(buffer, SIZE,
+            "     write time: %" PRId64 " us avg, %" PRId64 " us max\n",
+            mNumWrites > 0 ? mTotalWriteTimeUs / mNumWrites : 0, mMaxWriteTimeUs);
+    result->append(buffer);
+    snprintf(buffer, SIZE,
+            "     stalls: %" PRId64 ", %" PRId64 " us waiting\n",
+            mNumStalls, mTotalStallTimeUs);
+    result->append(buffer);
+}
+
+// static
+void *BlockFileWriter::ThreadWrapper(void *me) {
+    static_cast<BlockFileWriter *>(me)->threadFunc();
+    return NULL;
+}
+
+void BlockFileWriter::threadFunc() {
+    prctl(PR_SET_NAME, (unsigned long)"BlockFileWriter", 0, 0, 0);
+
+    int64_t bytesSinceSync = 0;
+
+    Mutex::Autolock autoLock(mLock);
+    for (;;) {
+        while (mFullBlocks.empty() && !mDone) {
+            mBlockQueuedCondition.wait(mLock);
+        }
+
+        if (mFullBlocks.empty()) {
+            break;
+        }
+
+        Block *block = *mFullBlocks.begin();
+        mFullBlocks.erase(mFullBlocks.begin());
+        mWriting = true;
+
+        mLock.unlock();
+
+        int64_t startUs = nowUs();
+        status_t err = writeBlock(block);
+
+        bytesSinceSync += block->mSize;
+        if (err == OK && mSyncIntervalBytes > 0
+                && bytesSinceSync >= mSyncIntervalBytes) {
+            fdatasync(mFd);
+            bytesSinceSync = 0;
+        }
+
+        int64_t writeTimeUs = nowUs() - startUs;
+
+        mLock.lock();
+
+        if (err != OK && mError == OK) {
+            mError = err;
+        }
+
+        mBytesWritten += block->mSize;
+        ++mNumWrites;
+        mTotalWriteTimeUs += writeTimeUs;
+        if (writeTimeUs > mMaxWriteTimeUs) {
+            mMaxWriteTimeUs = writeTimeUs;
+        }
+
+        mFreeBlocks.push_back(block);
+        mWriting = false;
+        mBlockWrittenCondition.broadcast();
+    }
+}
+
+status_t BlockFileWriter::writeBlock(const Block *block) {
+    const uint8_t *ptr = block->mData;
+    size_t size = block->mSize;
+    off64_t offset = block->mOffset;
+
+    while (size > 0) {
+        ssize_t n = pwrite64(mFd, ptr, size, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n <= 0) {
+            ALOGE("failed to write %zu bytes at %" PRId64 " (%s)",
+                  size, offset, strerror(errno));
+            return ERROR_IO;
+        }
+
+        ptr += n;
+        offset += n;
+        size -= n;
+    }
+
+    return OK;
+}
+
+}  // namespace android
@@ -15,6 +15,7 @@
  */
 
 #include <inttypes.h>
+#include <math.h>
 
 //#define LOG_NDEBUG 0
 #define LOG_TAG "CameraSource"
@@ -188,7 +189,12 @@ CameraSource::CameraSource(
       mTimeBetweenFrameCaptureUs(0),
       mFirstFrameTimeUs(0),
       mNumFramesDropped(0),
+      mNumFramesSkipped(0),
       mNumGlitches(0),
+      mNumFrameIntervals(0),
+      mFrameIntervalSumUs(0),
+      mFrameIntervalSquaresUs(0),
+      mMaxFrameIntervalUs(0),
       mGlitchDurationThresholdUs(200000),
       mCollectStats(false),
       mRecPause(false),
@@ -901,6 +907,7 @@ void CameraSource::dataCallbackTimestamp(int64_t timestampUs,
     if (!mStarted || (mNumFramesReceived == 0 && timestampUs < mStartTimeUs)) {
         ALOGV("Drop frame at %" PRId64 "/%" PRId64 " us", timestampUs, mStartTimeUs);
         releaseOneRecordingFrame(data);
+        ++mNumFramesSkipped;
         return;
     }
 
@@ -911,6 +918,7 @@ void CameraSource::dataCallbackTimestamp(int64_t timestampUs,
         }
         ALOGV("release One Video Frame for Pause : %lld us", timestampUs);
         releaseOneRecordingFrame(data);
+        ++mNumFramesSkipped;
         mPauseEndTimeUs = timestampUs;
         return;
     }
@@ -928,9 +936,19 @@ void CameraSource::dataCallbackTimestamp(int64_t timestampUs,
     // by the subclass CameraSourceTimeLapse.
     if (skipCurrentFrame(timestampUs)) {
         releaseOneRecordingFrame(data);
+        ++mNumFramesSkipped;
         return;
     }
 
+    if (mNumFramesReceived > 0) {
+        int64_t intervalUs = timestampUs - mLastFrameTimestampUs;
+        ++mNumFrameIntervals;
+        mFrameIntervalSumUs += intervalUs;
+        mFrameIntervalSquaresUs += (double)intervalUs * intervalUs;
+        if (intervalUs > mMaxFrameIntervalUs) {
+            mMaxFrameIntervalUs = intervalUs;
+        }
+    }
     mLastFrameTimestampUs = timestampUs;
     if (mNumFramesReceived == 0) {
         RECORDER_STATS(profileStop, STATS_PROFILE_CAMERA_SOURCE_START_LATENCY);
@@ -942,6 +960,7 @@ void CameraSource::dataCallbackTimestamp(int64_t timestampUs,
                 // Frame was captured before recording was started
                 // Drop it without updating the statistical data.
                 releaseOneRecordingFrame(data);
+                ++mNumFramesSkipped;
                 return;
             }
             mStartTimeUs = timestampUs - mStartTimeUs;
@@ -958,6 +977,40 @@ void CameraSource::dataCallbackTimestamp(int64_t timestampUs,
     mFrameAvailableCondition.signal();
 }
 
+status_t CameraSource::dump(int fd, const Vector<String16>& /* args */) {
+    const size_t SIZE = 256;
+    char buffer[SIZE];
+    String8 result;
+    Mutex::Autolock autoLock(mLock);
+    snprintf(buffer, SIZE, "   CameraSource %p\n", this);
+    result.append(buffer);
+    snprintf(buffer, SIZE, "     Meta data in video buffers: %s\n",
+            mIsMetaDataStoredInVideoBuffers ? "true" : "false");
+    result.append(buffer);
+    snprintf(buffer, SIZE, "     Frames received/encoded/dropped: %d/%d/%d\n",
+            mNumFramesReceived, mNumFramesEncoded, mNumFramesDropped);
+    result.append(buffer);
+    snprintf(buffer, SIZE, "     Frames skipped (not started, paused, time lapse): %d\n",
+            mNumFramesSkipped);
+    result.append(buffer);
+    snprintf(buffer, SIZE, "     Frames queued/being encoded: %zu/%zu\n",
+            mFramesReceived.size(), mFramesBeingEncoded.size());
+    result.append(buffer);
+    if (mNumFrameIntervals > 0) {
+        double meanUs = (double)mFrameIntervalSumUs / mNumFrameIntervals;
+        double variance = mFrameIntervalSquaresUs / mNumFrameIntervals - meanUs * meanUs;
+        snprintf(buffer, SIZE,
+                "     Frame interval (us): mean %.0f, jitter %.0f, max %" PRId64 "\n",
+                meanUs, variance > 0 ? sqrt(variance) : 0.0, mMaxFrameIntervalUs);
+        result.append(buffer);
+    }
+    snprintf(buffer, SIZE, "     Glitches (> %" PRId64 " us): %d\n",
+            mGlitchDurationThresholdUs, mNumGlitches);
+    result.append(buffer);
+    ::write(fd, result.string(), result.size());
+    return OK;
+}
+
 bool CameraSource::isMetaDataStoredInVideoBuffers() const {
     ALOGV("isMetaDataStoredInVideoBuffers");
     return mIsMetaDataStoredInVideoBuffers;
@@ -92,6 +92,10 @@ CameraSourceTimeLapse::CameraSourceTimeLapse(
         mInitCheck = NO_INIT;
     }
 
+    if (OK == mInitCheck) {
+        trySettingCaptureFrameRate();
+    }
+
     // Initialize quick stop variables.
     mQuickStop = false;
     mForceRead = false;
@@ -166,6 +170,46 @@ bool CameraSourceTimeLapse::trySettingVideoSize(
     return isSuccessful;
 }
 
+void CameraSourceTimeLapse::trySettingCaptureFrameRate() {
+    ALOGV("trySettingCaptureFrameRate");
+    int64_t token = IPCThreadState::self()->clearCallingIdentity();
+    CameraParameters params(mCamera->getParameters());
+
+    // All but one frame per mTimeBetweenFrameCaptureUs are skipped, so
+    // ask for the supported range of the lowest maximum rate that still
+    // brings one, in frames per 1000 seconds as the camera has them.
+    int currentMinFps, currentMaxFps;
+    params.getPreviewFpsRange(&currentMinFps, &currentMaxFps);
+    int bestMinFps = currentMinFps;
+    int bestMaxFps = currentMaxFps;
+    const char *ranges = params.get(CameraParameters::KEY_SUPPORTED_PREVIEW_FPS_RANGE);
+    while (ranges != NULL && (ranges = strchr(ranges, '(')) != NULL) {
+        int minFps, maxFps;
+        if (sscanf(ranges, "(%d,%d)", &minFps, &maxFps) == 2
+                && maxFps > 0 && minFps <= maxFps
+                && (int64_t)maxFps * mTimeBetweenFrameCaptureUs >= 1000000000ll
+                && (maxFps < bestMaxFps || (maxFps == bestMaxFps && minFps < bestMinFps))) {
+            bestMinFps = minFps;
+            bestMaxFps = maxFps;
+        }
+        ++ranges;
+    }
+
+    if (bestMinFps != currentMinFps || bestMaxFps != currentMaxFps) {
+        char range[32];
+        snprintf(range, sizeof(range), "%d,%d", bestMinFps, bestMaxFps);
+        params.set(CameraParameters::KEY_PREVIEW_FPS_RANGE, range);
+        if (mCamera->setParameters(params.flatten()) == OK) {
+            ALOGI("time lapse capture at %d-%d fps/1000, was %d-%d",
+                    bestMinFps, bestMaxFps, currentMinFps, currentMaxFps);
+        } else {
+            ALOGW("Failed to set preview fps range to %s", range);
+        }
+    }
+
+    IPCThreadState::self()->restoreCallingIdentity(token);
+}
+
 void CameraSourceTimeLapse::signalBufferReturned(MediaBuffer* buffer) {
     ALOGV("signalBufferReturned");
     Mutex::Autolock autoLock(mQuickStopLock);
@@ -30,6 +30,7 @@
 #define LOG_TAG "ExtendedStats"
 #include <ctype.h>
 #include <inttypes.h>
+#include <string.h>
 #include <media/stagefright/ExtendedStats.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <sys/types.h>
@@ -218,16 +219,22 @@ sp<ExtendedStats::LogEntry> ExtendedStats::getLogEntry(const char *key,
     if (!key)
         return NULL;
 
+    if (mLastEntry != NULL && !strcmp(mLastKey.c_str(), key)) {
+        return mLastEntry;
+    }
+
     ssize_t idx = mLogEntry.indexOfKey(key);
 
     /* if this entry doesn't exist, add it in the log and return it */
     if (idx < 0) {
         sp<LogEntry> logEntry = createLogEntry(type, mWindowSize);
         mLogEntry.add(key, logEntry);
-        return logEntry;
+        mLastEntry = logEntry;
     } else {
-        return mLogEntry.valueAt(idx);
+        mLastEntry = mLogEntry.valueAt(idx);
     }
+    mLastKey.setTo(key);
+    return mLastEntry;
 }
 
 void ExtendedStats::log(LogType type, const char* key, statsDataType value, bool condition) {
@@ -271,6 +278,8 @@ void ExtendedStats::reset(const char* key) {
 void ExtendedStats::clear() {
     Mutex::Autolock lock(mLock);
     mLogEntry.clear();
+    mLastKey.clear();
+    mLastEntry.clear();
     mTid = -1;
     mWindowSize = kMaxWindowSize;
     mName = "";
@@ -380,6 +389,11 @@ MediaExtendedStats::~MediaExtendedStats() {
 
 /***************************** PlayerExtendedStats ************************/
 
+// 60, 30, 20 and 15 fps, then stutters and stalls
+const int64_t PlayerExtendedStats::kRenderIntervalBoundsUs[kNumRenderIntervalBuckets - 1] = {
+    17000ll, 34000ll, 50000ll, 67000ll, 100000ll, 200000ll, 500000ll,
+};
+
 PlayerExtendedStats::PlayerExtendedStats(const char* name, pid_t tid) :
     MediaExtendedStats(name, tid) {
 
@@ -406,6 +420,9 @@ void PlayerExtendedStats::reset() {
 
     mFramesRendered = 0;
 
+    mLastRenderTimeUs = 0;
+    memset(mRenderIntervals, 0, sizeof(mRenderIntervals));
+
     mPlaying = false;
     mPaused = false;
     mEOS = false;
@@ -427,9 +444,24 @@ void PlayerExtendedStats::logFrameRendered() {
     resetConsecutiveFramesDropped();
 
     mFramesRendered++;
+
+    // a fixed set of buckets, for this to cost no more than the clock read
+    int64_t nowUs = ExtendedStats::getSystemTime();
+    if (mLastRenderTimeUs > 0) {
+        int64_t intervalUs = nowUs - mLastRenderTimeUs;
+        int32_t i = 0;
+        while (i < kNumRenderIntervalBuckets - 1 && intervalUs > kRenderIntervalBoundsUs[i]) {
+            ++i;
+        }
+        mRenderIntervals[i]++;
+    }
+    mLastRenderTimeUs = nowUs;
 }
 
 void PlayerExtendedStats::notifyPlaying(bool isNowPlaying) {
+    // the gap over a pause or seek isn't one between frames
+    mLastRenderTimeUs = 0;
+
     if (isNowPlaying) {
         mStartPlayingTime = ExtendedStats::getSystemTime();
         mPaused = false;
@@ -506,6 +538,15 @@ void PlayerExtendedStats::dump() {
 
     ALOGI("Average FPS: %0.2f", mTotalPlayingTime == 0 ? 0 : mFramesRendered /(mTotalPlayingTime / 1E6));
 
+    ALOGI("Intervals between rendered frames:");
+    for (int32_t i = 0; i < kNumRenderIntervalBuckets - 1; ++i) {
+        ALOGI("\t\t<= %" PRId64 " ms: %" PRId64 "",
+                kRenderIntervalBoundsUs[i] / 1000, mRenderIntervals[i]);
+    }
+    ALOGI("\t\t> %" PRId64 " ms: %" PRId64 "",
+            kRenderIntervalBoundsUs[kNumRenderIntervalBuckets - 2] / 1000,
+            mRenderIntervals[kNumRenderIntervalBuckets - 1]);
+
     mProfileTimes->dump(STATS_BITRATE);
 
     ALOGI("EOS(%d)", mEOS ? 1 : 0);
@@ -14,21 +14,54 @@
  * limitations under the License.
  */
 
+//#define LOG_NDEBUG 0
+#define LOG_TAG "FileSource"
+#include <utils/Log.h>
+
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/FileSource.h>
+#include <cutils/properties.h>
 #include <sys/types.h>
 #include <unistd.h>
 #include <sys/types.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 
 namespace android {
 
+// Mapping a file takes as much address space as the file is large, which
+// 32-bit processes can't spare for big videos.
+static const int64_t kMaxMapSize =
+    (sizeof(void *) > 4) ? (1ll << 40) : (256ll << 20);
+
+// Reads this close to where the last one ended count as reading on, even if
+// the tracks of the file are read in turn.
+static const off64_t kMaxLocalReadDistance = 1024 * 1024;
+
+// After this many reads in a row that move on through the file, the kernel
+// is told to read ahead more aggressively.
+static const size_t kNumLocalReadsForSequential = 16;
+
+// How much to prefetch after a jump, until the kernel's own readahead has
+// picked up again.
+static const off64_t kReadAheadAfterSeek = 256 * 1024;
+
+// Every DRM read is a binder transaction to the drmserver, which decrypts
+// this much at a time for the small reads of the extractors to follow.
+static const size_t kDrmCacheSize = 64 * 1024;
+
 FileSource::FileSource(const char *filename)
     : mFd(-1),
       mUri(filename),
       mOffset(0),
       mLength(-1),
+      mMapAddress(MAP_FAILED),
+      mMapSize(0),
+      mMappedData(NULL),
+      mAccessHint(kAccessNormal),
+      mLastReadEnd(0),
+      mNumLocalReads(0),
       mDecryptHandle(NULL),
       mDrmManagerClient(NULL),
       mDrmBufOffset(0),
@@ -39,6 +72,7 @@ FileSource::FileSource(const char *filename)
 
     if (mFd >= 0) {
         mLength = lseek64(mFd, 0, SEEK_END);
+        mapFile();
     } else {
         ALOGE("Failed to open file '%s'. (%s)", filename, strerror(errno));
     }
@@ -48,6 +82,12 @@ FileSource::FileSource(int fd, int64_t offset, int64_t length)
     : mFd(fd),
       mOffset(offset),
       mLength(length),
+      mMapAddress(MAP_FAILED),
+      mMapSize(0),
+      mMappedData(NULL),
+      mAccessHint(kAccessNormal),
+      mLastReadEnd(0),
+      mNumLocalReads(0),
       mDecryptHandle(NULL),
       mDrmManagerClient(NULL),
       mDrmBufOffset(0),
@@ -56,9 +96,16 @@ FileSource::FileSource(int fd, int64_t offset, int64_t length)
     CHECK(offset >= 0);
     CHECK(length >= 0);
     fetchUriFromFd(fd);
+    mapFile();
 }
 
 FileSource::~FileSource() {
+    if (mMapAddress != MAP_FAILED) {
+        munmap(mMapAddress, mMapSize);
+        mMapAddress = MAP_FAILED;
+        mMappedData = NULL;
+    }
+
     if (mFd >= 0) {
         close(mFd);
         mFd = -1;
@@ -86,13 +133,38 @@ status_t FileSource::initCheck() const {
     return mFd >= 0 ? OK : NO_INIT;
 }
 
+void FileSource::mapFile() {
+    char value[PROPERTY_VALUE_MAX];
+    if (!property_get("media.stagefright.mmap-files", value, NULL)
+            || (strcmp(value, "1") && strcasecmp(value, "true"))) {
+        return;
+    }
+
+    if (mLength <= 0 || mLength > kMaxMapSize) {
+        return;
+    }
+
+    // The mapping has to start on a page boundary.
+    off64_t pageSize = sysconf(_SC_PAGESIZE);
+    off64_t mapOffset = mOffset - (mOffset % pageSize);
+
+    mMapSize = mLength + (mOffset - mapOffset);
+    mMapAddress = mmap64(NULL, mMapSize, PROT_READ, MAP_SHARED, mFd, mapOffset);
+
+    if (mMapAddress == MAP_FAILED) {
+        ALOGV("failed to map '%s' (%s)", mUri.string(), strerror(errno));
+        mMapSize = 0;
+        return;
+    }
+
+    mMappedData = (const uint8_t *)mMapAddress + (mOffset - mapOffset);
+}
+
 ssize_t FileSource::readAt(off64_t offset, void *data, size_t size) {
     if (mFd < 0) {
         return NO_INIT;
     }
 
-    Mutex::Autolock autoLock(mLock);
-
     if (mLength >= 0) {
         if (offset >= mLength) {
             return 0;  // read beyond EOF.
@@ -105,21 +177,48 @@ ssize_t FileSource::readAt(off64_t offset, void *data, size_t size) {
 
     if (mDecryptHandle != NULL && DecryptApiType::CONTAINER_BASED
             == mDecryptHandle->decryptApiType) {
+        Mutex::Autolock autoLock(mLock);
         return readAtDRM(offset, data, size);
-   } else {
-        off64_t result = lseek64(mFd, offset + mOffset, SEEK_SET);
-        if (result == -1) {
-            ALOGE("seek to %lld failed", offset + mOffset);
-            return UNKNOWN_ERROR;
-        }
+    }
 
-        return ::read(mFd, data, size);
+    if (mMappedData != NULL) {
+        memcpy(data, mMappedData + offset, size);
+        return size;
     }
+
+    updateAccessHint(offset, size);
+
+    return pread64(mFd, data, size, offset + mOffset);
 }
 
-status_t FileSource::getSize(off64_t *size) {
+void FileSource::updateAccessHint(off64_t offset, size_t size) {
     Mutex::Autolock autoLock(mLock);
 
+    off64_t distance = offset - mLastReadEnd;
+    mLastReadEnd = offset + size;
+
+    if (distance >= -kMaxLocalReadDistance && distance <= kMaxLocalReadDistance) {
+        if (++mNumLocalReads == kNumLocalReadsForSequential
+                && mAccessHint != kAccessSequential) {
+            ALOGV("reading '%s' sequentially", mUri.string());
+            posix_fadvise64(mFd, mOffset, mLength, POSIX_FADV_SEQUENTIAL);
+            mAccessHint = kAccessSequential;
+        }
+        return;
+    }
+
+    // A seek, what was read ahead so far is of no use anymore.
+    mNumLocalReads = 0;
+    if (mAccessHint != kAccessNormal) {
+        posix_fadvise64(mFd, mOffset, mLength, POSIX_FADV_NORMAL);
+        mAccessHint = kAccessNormal;
+    }
+
+    posix_fadvise64(
+            mFd, mLastReadEnd + mOffset, kReadAheadAfterSeek, POSIX_FADV_WILLNEED);
+}
+
+status_t FileSource::getSize(off64_t *size) {
     if (mFd < 0) {
         return NO_INIT;
     }
@@ -129,6 +228,15 @@ status_t FileSource::getSize(off64_t *size) {
     return OK;
 }
 
+const void *FileSource::getMappedRange(off64_t offset, size_t size) {
+    if (mMappedData == NULL || mDecryptHandle != NULL
+            || offset < 0 || offset + (off64_t)size > mLength) {
+        return NULL;
+    }
+
+    return mMappedData + offset;
+}
+
 sp<DecryptHandle> FileSource::DrmInitialization(const char *mime) {
     if (mDrmManagerClient == NULL) {
         mDrmManagerClient = new DrmManagerClient();
@@ -158,33 +266,54 @@ void FileSource::getDrmInfo(sp<DecryptHandle> &handle, DrmManagerClient **client
 }
 
 ssize_t FileSource::readAtDRM(off64_t offset, void *data, size_t size) {
-    size_t DRM_CACHE_SIZE = 1024;
     if (mDrmBuf == NULL) {
-        mDrmBuf = new unsigned char[DRM_CACHE_SIZE];
+        mDrmBuf = new unsigned char[kDrmCacheSize];
     }
 
-    if (mDrmBuf != NULL && mDrmBufSize > 0 && (offset + mOffset) >= mDrmBufOffset
-            && (offset + mOffset + size) <= (mDrmBufOffset + mDrmBufSize)) {
-        /* Use buffered data */
-        memcpy(data, (void*)(mDrmBuf+(offset+mOffset-mDrmBufOffset)), size);
-        return size;
-    } else if (size <= DRM_CACHE_SIZE) {
-        /* Buffer new data */
-        mDrmBufOffset =  offset + mOffset;
-        mDrmBufSize = mDrmManagerClient->pread(mDecryptHandle, mDrmBuf,
-                DRM_CACHE_SIZE, offset + mOffset);
-        if (mDrmBufSize > 0) {
-            int64_t dataRead = 0;
-            dataRead = size > mDrmBufSize ? mDrmBufSize : size;
-            memcpy(data, (void*)mDrmBuf, dataRead);
-            return dataRead;
-        } else {
-            return mDrmBufSize;
+    off64_t position = offset + mOffset;
+    size_t copied = 0;
+
+    // The start of the read may be what the last one left in the buffer,
+    // extractors reading on where they stopped.
+    if (mDrmBufSize > 0 && position >= mDrmBufOffset
+            && position < mDrmBufOffset + (off64_t)mDrmBufSize) {
+        copied = mDrmBufOffset + mDrmBufSize - position;
+        if (copied > size) {
+            copied = size;
         }
-    } else {
+        memcpy(data, mDrmBuf + (position - mDrmBufOffset), copied);
+        if (copied == size) {
+            return size;
+        }
+        position += copied;
+        size -= copied;
+        data = (uint8_t *)data + copied;
+    }
+
+    if (size > kDrmCacheSize) {
         /* Too big chunk to cache. Call DRM directly */
-        return mDrmManagerClient->pread(mDecryptHandle, data, size, offset + mOffset);
+        ssize_t n = mDrmManagerClient->pread(mDecryptHandle, data, size, position);
+        if (n < 0) {
+            return copied > 0 ? (ssize_t)copied : n;
+        }
+        return copied + n;
+    }
+
+    /* Buffer new data */
+    mDrmBufOffset = position;
+    ssize_t n = mDrmManagerClient->pread(
+            mDecryptHandle, mDrmBuf, kDrmCacheSize, position);
+    if (n <= 0) {
+        mDrmBufSize = 0;
+        return copied > 0 ? (ssize_t)copied : n;
+    }
+    mDrmBufSize = n;
+
+    if (size > (size_t)n) {
+        size = n;
     }
+    memcpy(data, mDrmBuf, size);
+    return copied + size;
 }
 
 void FileSource::fetchUriFromFd(int fd) {
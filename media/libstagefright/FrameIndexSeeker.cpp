@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "FrameIndexSeeker"
+
+#include <inttypes.h>
+#include <sys/prctl.h>
+
+#include <utils/Log.h>
+
+#include "include/FrameIndexSeeker.h"
+
+#include "include/avc_utils.h"
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/DataSource.h>
+#include <media/stagefright/Utils.h>
+
+namespace android {
+
+// The same as in MP3Extractor, what must match from frame to frame.
+static const uint32_t kMask = 0xfffe0c00;
+
+// static
+sp<FrameIndexSeeker> FrameIndexSeeker::CreateFromSource(
+        const sp<DataSource> &source, off64_t first_frame_pos,
+        uint32_t fixed_header) {
+    if (source->flags()
+            & (DataSource::kWantsPrefetching
+                | DataSource::kIsCachingDataSource
+                | DataSource::kIsHTTPBasedSource)) {
+        return NULL;
+    }
+
+    off64_t size;
+    if (source->getSize(&size) != OK) {
+        return NULL;
+    }
+
+    size_t frameSize;
+    int sampleRate, numSamples;
+    if (!GetMPEGAudioFrameSize(
+                fixed_header, &frameSize, &sampleRate, NULL, NULL,
+                &numSamples)) {
+        return NULL;
+    }
+
+    sp<FrameIndexSeeker> seeker = new FrameIndexSeeker(
+            source, first_frame_pos, fixed_header, sampleRate, numSamples);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+
+    pthread_create(&seeker->mThread, &attr, ThreadWrapper, seeker.get());
+    pthread_attr_destroy(&attr);
+
+    return seeker;
+}
+
+FrameIndexSeeker::FrameIndexSeeker(
+        const sp<DataSource> &source, off64_t first_frame_pos,
+        uint32_t fixed_header, int sample_rate, int samples_per_frame)
+    : mDataSource(source),
+      mFirstFramePos(first_frame_pos),
+      mFixedHeader(fixed_header),
+      mSampleRate(sample_rate),
+      mSamplesPerFrame(samples_per_frame),
+      mStopping(false),
+      mDone(false),
+      mNumFrames(0) {
+}
+
+FrameIndexSeeker::~FrameIndexSeeker() {
+    {
+        Mutex::Autolock autoLock(mLock);
+        mStopping = true;
+    }
+
+    void *dummy;
+    pthread_join(mThread, &dummy);
+}
+
+// static
+void *FrameIndexSeeker::ThreadWrapper(void *me) {
+    prctl(PR_SET_NAME, (unsigned long)"MP3FrameIndex", 0, 0, 0);
+    androidSetThreadPriority(0, ANDROID_PRIORITY_BACKGROUND);
+
+    static_cast<FrameIndexSeeker *>(me)->buildIndex();
+
+    return NULL;
+}
+
+void FrameIndexSeeker::buildIndex() {
+    static const size_t kBufferSize = 64 * 1024;
+    uint8_t *buffer = new uint8_t[kBufferSize];
+    off64_t bufferPos = mFirstFramePos;
+    size_t bufferSize = 0;
+
+    off64_t pos = mFirstFramePos;
+    int64_t numFrames = 0;
+    for (;;) {
+        if (pos < bufferPos || pos + 4 > bufferPos + (off64_t)bufferSize) {
+            {
+                Mutex::Autolock autoLock(mLock);
+                if (mStopping) {
+                    break;
+                }
+            }
+
+            ssize_t n = mDataSource->readAt(pos, buffer, kBufferSize);
+            if (n < 4) {
+                break;
+            }
+            bufferPos = pos;
+            bufferSize = n;
+        }
+
+        const uint8_t *ptr = buffer + (pos - bufferPos);
+        uint32_t header = U32_AT(ptr);
+
+        size_t frameSize;
+        if ((header & kMask) != (mFixedHeader & kMask)
+                || !GetMPEGAudioFrameSize(header, &frameSize)) {
+            // Lost sync, every header starts with an 0xff.
+            size_t remaining = bufferSize - (pos - bufferPos);
+            const uint8_t *next =
+                (const uint8_t *)memchr(ptr + 1, 0xff, remaining - 4);
+            pos += (next != NULL) ? next - ptr : remaining - 3;
+            continue;
+        }
+
+        if ((numFrames % kFramesPerEntry) == 0) {
+            Mutex::Autolock autoLock(mLock);
+            mOffsets.push(pos);
+        }
+
+        ++numFrames;
+        pos += frameSize;
+    }
+
+    delete[] buffer;
+    buffer = NULL;
+
+    Mutex::Autolock autoLock(mLock);
+    if (!mStopping) {
+        ALOGV("indexed %" PRId64 " frames in %zu entries",
+             numFrames, mOffsets.size());
+
+        mNumFrames = numFrames;
+        mDone = true;
+    }
+}
+
+int64_t FrameIndexSeeker::framesToUs(int64_t numFrames) const {
+    return numFrames * mSamplesPerFrame * 1000000ll / mSampleRate;
+}
+
+bool FrameIndexSeeker::getDuration(int64_t *durationUs) {
+    Mutex::Autolock autoLock(mLock);
+    if (!mDone) {
+        return false;
+    }
+
+    *durationUs = framesToUs(mNumFrames);
+
+    return true;
+}
+
+bool FrameIndexSeeker::getOffsetForTime(int64_t *timeUs, off64_t *pos) {
+    int64_t frame = *timeUs * mSampleRate / (mSamplesPerFrame * 1000000ll);
+    if (frame < 0) {
+        frame = 0;
+    }
+
+    int64_t numFrames;
+    {
+        Mutex::Autolock autoLock(mLock);
+        if (mOffsets.isEmpty()) {
+            return false;
+        }
+
+        if (mDone) {
+            if (frame >= mNumFrames) {
+                frame = mNumFrames > 0 ? mNumFrames - 1 : 0;
+            }
+        } else if (frame / kFramesPerEntry >= (int64_t)mOffsets.size()) {
+            return false;
+        }
+
+        size_t entry = frame / kFramesPerEntry;
+        *pos = mOffsets.itemAt(entry);
+        numFrames = (int64_t)entry * kFramesPerEntry;
+    }
+
+    // Walk the headers up to the frame itself.
+    while (numFrames < frame) {
+        uint8_t tmp[4];
+        if (mDataSource->readAt(*pos, tmp, 4) < 4) {
+            break;
+        }
+
+        uint32_t header = U32_AT(tmp);
+        size_t frameSize;
+        if ((header & kMask) != (mFixedHeader & kMask)
+                || !GetMPEGAudioFrameSize(header, &frameSize)) {
+            // Junk the index skipped over, settle for the last frame.
+            break;
+        }
+
+        *pos += frameSize;
+        ++numFrames;
+    }
+
+    ALOGV("getOffsetForTime %" PRId64 " us => frame %" PRId64 " at 0x%016llx",
+         *timeUs, numFrames, *pos);
+
+    *timeUs = framesToUs(numFrames);
+
+    return true;
+}
+
+}  // namespace android
@@ -21,6 +21,7 @@
 #include "include/MP3Extractor.h"
 
 #include "include/avc_utils.h"
+#include "include/FrameIndexSeeker.h"
 #include "include/ID3.h"
 #include "include/VBRISeeker.h"
 #include "include/XINGSeeker.h"
@@ -135,6 +136,17 @@ static bool Resync(
             }
         }
 
+        if (tmp[0] != 0xff) {
+            // Every header starts with an 0xff, skip to the next one.
+            const uint8_t *next =
+                (const uint8_t *)memchr(tmp + 1, 0xff, remainingBytes - 4);
+            ssize_t skip = (next != NULL) ? next - tmp : remainingBytes - 3;
+            pos += skip;
+            tmp += skip;
+            remainingBytes -= skip;
+            continue;
+        }
+
         uint32_t header = U32_AT(tmp);
 
         if (match_header != 0 && (header & kMask) != (match_header & kMask)) {
@@ -393,6 +405,13 @@ sp<MediaSource> MP3Extractor::getTrack(size_t index) {
         return NULL;
     }
 
+    if (mSeeker == NULL) {
+        // Only index the frames once the track is actually to be played,
+        // not just scanned for its metadata.
+        mSeeker = FrameIndexSeeker::CreateFromSource(
+                mDataSource, mFirstFramePos, mFixedHeader);
+    }
+
     return new MP3Source(
             mMeta, mDataSource, mFirstFramePos, mFixedHeader,
             mSeeker);
@@ -31,6 +31,7 @@
 #include <arpa/inet.h>
 
 #include "include/ESDS.h"
+#include "include/TSPacketUtils.h"
 
 namespace android {
 
@@ -511,7 +512,8 @@ MPEG2TSWriter::MPEG2TSWriter(
 void MPEG2TSWriter::init() {
     CHECK(mFile != NULL || mWriteFunc != NULL);
 
-    initCrcTable();
+    mPacketBuffer = new ABuffer(64 * kTSPacketSize);
+    mPacketBuffer->setRange(0, 0);
 
     mLooper = new ALooper;
     mLooper->setName("MPEG2TSWriter");
@@ -740,19 +742,17 @@ void MPEG2TSWriter::writeProgramAssociationTable() {
         0x00, 0x00, 0x00, 0x00   // b???? ???? ???? ???? ???? ???? ???? ????
     };
 
-    sp<ABuffer> buffer = new ABuffer(188);
-    memset(buffer->data(), 0xff, buffer->size());
-    memcpy(buffer->data(), kData, sizeof(kData));
+    uint8_t *packet = appendPackets(1);
+    memset(packet, 0xff, kTSPacketSize);
+    memcpy(packet, kData, sizeof(kData));
 
     if (++mPATContinuityCounter == 16) {
         mPATContinuityCounter = 0;
     }
-    buffer->data()[3] |= mPATContinuityCounter;
+    packet[3] |= mPATContinuityCounter;
 
-    uint32_t crc = htonl(crc32(&buffer->data()[5], 12));
-    memcpy(&buffer->data()[17], &crc, sizeof(crc));
-
-    CHECK_EQ(internalWrite(buffer->data(), buffer->size()), buffer->size());
+    uint32_t crc = htonl(TSSectionCRC32(&packet[5], 12));
+    memcpy(&packet[17], &crc, sizeof(crc));
 }
 
 void MPEG2TSWriter::writeProgramMap() {
@@ -797,24 +797,24 @@ void MPEG2TSWriter::writeProgramMap() {
         0xe0, 0x00, 0xf0, 0x00   // b111? ???? ???? ???? 1111 0000 0000 0000
     };
 
-    sp<ABuffer> buffer = new ABuffer(188);
-    memset(buffer->data(), 0xff, buffer->size());
-    memcpy(buffer->data(), kData, sizeof(kData));
+    uint8_t *packet = appendPackets(1);
+    memset(packet, 0xff, kTSPacketSize);
+    memcpy(packet, kData, sizeof(kData));
 
     if (++mPMTContinuityCounter == 16) {
         mPMTContinuityCounter = 0;
     }
-    buffer->data()[3] |= mPMTContinuityCounter;
+    packet[3] |= mPMTContinuityCounter;
 
     size_t section_length = 5 * mSources.size() + 4 + 9;
-    buffer->data()[6] |= section_length >> 8;
-    buffer->data()[7] = section_length & 0xff;
+    packet[6] |= section_length >> 8;
+    packet[7] = section_length & 0xff;
 
     static const unsigned kPCR_PID = 0x1e1;
-    buffer->data()[13] |= (kPCR_PID >> 8) & 0x1f;
-    buffer->data()[14] = kPCR_PID & 0xff;
+    packet[13] |= (kPCR_PID >> 8) & 0x1f;
+    packet[14] = kPCR_PID & 0xff;
 
-    uint8_t *ptr = &buffer->data()[sizeof(kData)];
+    uint8_t *ptr = &packet[sizeof(kData)];
     for (size_t i = 0; i < mSources.size(); ++i) {
         *ptr++ = mSources.editItemAt(i)->streamType();
 
@@ -825,10 +825,8 @@ void MPEG2TSWriter::writeProgramMap() {
         *ptr++ = 0x00;
     }
 
-    uint32_t crc = htonl(crc32(&buffer->data()[5], 12+mSources.size()*5));
-    memcpy(&buffer->data()[17+mSources.size()*5], &crc, sizeof(crc));
-
-    CHECK_EQ(internalWrite(buffer->data(), buffer->size()), buffer->size());
+    uint32_t crc = htonl(TSSectionCRC32(&packet[5], 12+mSources.size()*5));
+    memcpy(&packet[17+mSources.size()*5], &crc, sizeof(crc));
 }
 
 void MPEG2TSWriter::writeAccessUnit(
@@ -868,14 +866,8 @@ void MPEG2TSWriter::writeAccessUnit(
     // reserved = b1
     // the first fragment of "buffer" follows
 
-    sp<ABuffer> buffer = new ABuffer(188);
-    memset(buffer->data(), 0xff, buffer->size());
-
     const unsigned PID = 0x1e0 + sourceIndex + 1;
 
-    const unsigned continuity_counter =
-        mSources.editItemAt(sourceIndex)->incrementContinuityCounter();
-
     // XXX if there are multiple streams of a kind (more than 1 audio or
     // more than 1 video) they need distinct stream_ids.
     const unsigned stream_id =
@@ -887,7 +879,6 @@ void MPEG2TSWriter::writeAccessUnit(
     uint32_t PTS = (timeUs * 9ll) / 100ll;
 
     size_t PES_packet_length = accessUnit->size() + 8;
-    bool padding = (accessUnit->size() < (188 - 18));
 
     if (PES_packet_length >= 65536) {
         // This really should only happen for video.
@@ -897,19 +888,24 @@ void MPEG2TSWriter::writeAccessUnit(
         PES_packet_length = 0;
     }
 
-    uint8_t *ptr = buffer->data();
-    *ptr++ = 0x47;
-    *ptr++ = 0x40 | (PID >> 8);
-    *ptr++ = PID & 0xff;
-    *ptr++ = (padding ? 0x30 : 0x10) | continuity_counter;
-    if (padding) {
-        int paddingSize = 188 - accessUnit->size() - 18;
-        *ptr++ = paddingSize - 1;
-        if (paddingSize >= 2) {
-            *ptr++ = 0x00;
-            ptr += paddingSize - 2;
-        }
+    // The first packet carries the PES header and as much of the access
+    // unit as fits after it, the rest follows in as many packets as it
+    // takes. All of them are laid out in mPacketBuffer and written at once.
+    static const size_t kPESHeaderSize = 14;
+
+    size_t copy = accessUnit->size();
+    if (copy > kTSMaxPayloadSize - kPESHeaderSize) {
+        copy = kTSMaxPayloadSize - kPESHeaderSize;
     }
+
+    uint8_t *packet = appendPackets(
+            1 + NumTSContinuationPackets(accessUnit->size() - copy));
+
+    uint8_t *ptr = WriteTSPacketHeader(
+            packet, PID, true /* payloadUnitStart */,
+            mSources.editItemAt(sourceIndex)->incrementContinuityCounter(),
+            kTSMaxPayloadSize - kPESHeaderSize - copy);
+
     *ptr++ = 0x00;
     *ptr++ = 0x00;
     *ptr++ = 0x01;
@@ -925,19 +921,11 @@ void MPEG2TSWriter::writeAccessUnit(
     *ptr++ = (PTS >> 7) & 0xff;
     *ptr++ = ((PTS & 0x7f) << 1) | 1;
 
-    size_t sizeLeft = buffer->data() + buffer->size() - ptr;
-    size_t copy = accessUnit->size();
-    if (copy > sizeLeft) {
-        copy = sizeLeft;
-    }
-
     memcpy(ptr, accessUnit->data(), copy);
-
-    CHECK_EQ(internalWrite(buffer->data(), buffer->size()), buffer->size());
+    packet += kTSPacketSize;
 
     size_t offset = copy;
     while (offset < accessUnit->size()) {
-        bool lastAccessUnit = ((accessUnit->size() - offset) < 184);
         // for subsequent fragments of "buffer":
         // 0x47
         // transport_error_indicator = b0
@@ -947,42 +935,26 @@ void MPEG2TSWriter::writeAccessUnit(
         // transport_scrambling_control = b00
         // adaptation_field_control = b??
         // continuity_counter = b????
-        // the fragment of "buffer" follows.
-
-        memset(buffer->data(), 0xff, buffer->size());
-
-        const unsigned continuity_counter =
-            mSources.editItemAt(sourceIndex)->incrementContinuityCounter();
-
-        ptr = buffer->data();
-        *ptr++ = 0x47;
-        *ptr++ = 0x00 | (PID >> 8);
-        *ptr++ = PID & 0xff;
-        *ptr++ = (lastAccessUnit ? 0x30 : 0x10) | continuity_counter;
-
-        if (lastAccessUnit) {
-            // Pad packet using an adaptation field
-            // Adaptation header all to 0 execpt size
-            uint8_t paddingSize = (uint8_t)184 - (accessUnit->size() - offset);
-            *ptr++ = paddingSize - 1;
-            if (paddingSize >= 2) {
-                *ptr++ = 0x00;
-                ptr += paddingSize - 2;
-            }
-        }
+        // the fragment of "buffer" follows, padded using an adaptation
+        // field if it is the last one and does not fill the packet.
 
-        size_t sizeLeft = buffer->data() + buffer->size() - ptr;
         size_t copy = accessUnit->size() - offset;
-        if (copy > sizeLeft) {
-            copy = sizeLeft;
+        if (copy > kTSMaxPayloadSize) {
+            copy = kTSMaxPayloadSize;
         }
 
-        memcpy(ptr, accessUnit->data() + offset, copy);
-        CHECK_EQ(internalWrite(buffer->data(), buffer->size()),
-                 buffer->size());
+        WriteTSPacket(
+                packet, PID, false /* payloadUnitStart */,
+                mSources.editItemAt(sourceIndex)->incrementContinuityCounter(),
+                accessUnit->data() + offset, copy);
+        packet += kTSPacketSize;
 
         offset += copy;
     }
+
+    CHECK(packet == mPacketBuffer->data() + mPacketBuffer->size());
+
+    flushPackets();
 }
 
 void MPEG2TSWriter::writeTS() {
@@ -994,31 +966,35 @@ void MPEG2TSWriter::writeTS() {
     }
 }
 
-void MPEG2TSWriter::initCrcTable() {
-    uint32_t poly = 0x04C11DB7;
+// Returns room for numPackets more packets at the end of mPacketBuffer,
+// which holds the packets of the current access unit (and the PAT and PMT
+// preceding it, if any) until flushPackets().
+uint8_t *MPEG2TSWriter::appendPackets(size_t numPackets) {
+    size_t size = mPacketBuffer->size();
+    size_t needed = size + numPackets * kTSPacketSize;
 
-    for (int i = 0; i < 256; i++) {
-        uint32_t crc = i << 24;
-        for (int j = 0; j < 8; j++) {
-            crc = (crc << 1) ^ ((crc & 0x80000000) ? (poly) : 0);
+    if (needed > mPacketBuffer->capacity()) {
+        size_t capacity = mPacketBuffer->capacity() * 2;
+        while (capacity < needed) {
+            capacity *= 2;
         }
-        mCrcTable[i] = crc;
+
+        sp<ABuffer> buffer = new ABuffer(capacity);
+        memcpy(buffer->data(), mPacketBuffer->data(), size);
+        mPacketBuffer = buffer;
     }
-}
 
-/**
- * Compute CRC32 checksum for buffer starting at offset start and for length
- * bytes.
- */
-uint32_t MPEG2TSWriter::crc32(const uint8_t *p_start, size_t length) {
-    uint32_t crc = 0xFFFFFFFF;
-    const uint8_t *p;
+    mPacketBuffer->setRange(0, needed);
 
-    for (p = p_start; p < p_start + length; p++) {
-        crc = (crc << 8) ^ mCrcTable[((crc >> 24) ^ *p) & 0xFF];
-    }
+    return mPacketBuffer->data() + size;
+}
+
+void MPEG2TSWriter::flushPackets() {
+    CHECK_EQ(internalWrite(mPacketBuffer->data(), mPacketBuffer->size()),
+             (ssize_t)mPacketBuffer->size());
 
-    return crc;
+    mNumTSPacketsWritten += mPacketBuffer->size() / kTSPacketSize;
+    mPacketBuffer->setRange(0, 0);
 }
 
 ssize_t MPEG2TSWriter::internalWrite(const void *data, size_t size) {
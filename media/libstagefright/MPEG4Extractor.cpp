@@ -49,6 +49,8 @@
 
 namespace android {
 
+struct MPEG4DataSource;
+
 class MPEG4Source : public MediaSource {
 public:
     // Caller retains ownership of both "dataSource" and "sampleTable".
@@ -90,6 +92,21 @@ private:
     off64_t mNextMoofOffset;
     uint32_t mCurrentTime;
     int32_t mLastParsedTrackId;
+
+    // Holds the moof box being parsed, wraps the data source of the track
+    // when it is fragmented.
+    sp<MPEG4DataSource> mFragmentSource;
+
+    // The fragments parsed so far in file order, without a sidx box this is
+    // what seeking goes by.
+    struct FragmentInfo {
+        off64_t mMoofOffset;
+        uint32_t mTime;
+        uint32_t mDuration;
+    };
+    Vector<FragmentInfo> mFragments;
+    // The moof following the last entry of mFragments, if any.
+    off64_t mNextUnindexedMoofOffset;
     int32_t mTrackId;
 
     int32_t mCryptoMode;    // passed in from extractor
@@ -119,8 +136,18 @@ private:
 
     uint8_t *mSrcBuffer;
 
+    // Samples of chunks up to kMaxCachedChunkSize are read a chunk at a
+    // time into mChunkCache, see readSampleData().
+    bool mCoalesceReads;
+    uint8_t *mChunkCache;
+    off64_t mChunkCacheOffset;
+    size_t mChunkCacheSize;
+
     size_t parseNALSize(const uint8_t *data) const;
+    ssize_t readSampleData(
+            uint32_t sampleIndex, off64_t offset, void *data, size_t size);
     status_t parseChunk(off64_t *offset);
+    status_t loadFragment(off64_t moofOffset, uint32_t time);
     status_t parseTrackFragmentHeader(off64_t offset, off64_t size);
     status_t parseTrackFragmentRun(off64_t offset, off64_t size);
     status_t parseSampleAuxiliaryInformationSizes(off64_t offset, off64_t size);
@@ -163,6 +190,16 @@ private:
     MPEG4Source &operator=(const MPEG4Source &);
 };
 
+// Movie boxes up to this size are read into memory in one go from network
+// sources, larger ones only have their sample tables cached.
+static const uint64_t kMaxCachedMoovSize = 32 * 1024 * 1024;
+
+// Same for the moof box of a fragment.
+static const uint64_t kMaxCachedMoofSize = 1024 * 1024;
+
+// Larger chunks, mostly those of video, are read a sample at a time.
+static const size_t kMaxCachedChunkSize = 256 * 1024;
+
 // This custom data source wraps an existing one and satisfies requests
 // falling entirely within a cached range from the cache while forwarding
 // all remaining requests to the wrapped datasource.
@@ -189,7 +226,8 @@ private:
     sp<DataSource> mSource;
     off64_t mCachedOffset;
     size_t mCachedSize;
-    uint8_t *mCache;
+    const uint8_t *mCache;
+    bool mCacheMapped;
 
     void clearCache();
 
@@ -201,7 +239,8 @@ MPEG4DataSource::MPEG4DataSource(const sp<DataSource> &source)
     : mSource(source),
       mCachedOffset(0),
       mCachedSize(0),
-      mCache(NULL) {
+      mCache(NULL),
+      mCacheMapped(false) {
 }
 
 MPEG4DataSource::~MPEG4DataSource() {
@@ -209,10 +248,11 @@ MPEG4DataSource::~MPEG4DataSource() {
 }
 
 void MPEG4DataSource::clearCache() {
-    if (mCache) {
-        free(mCache);
-        mCache = NULL;
+    if (mCache && !mCacheMapped) {
+        free((void *)mCache);
     }
+    mCache = NULL;
+    mCacheMapped = false;
 
     mCachedOffset = 0;
     mCachedSize = 0;
@@ -247,16 +287,27 @@ status_t MPEG4DataSource::setCachedRange(off64_t offset, size_t size) {
 
     clearCache();
 
-    mCache = (uint8_t *)malloc(size);
+    mCachedOffset = offset;
+    mCachedSize = size;
+
+    mCache = (const uint8_t *)mSource->getMappedRange(offset, size);
+    if (mCache != NULL) {
+        // Already in memory, no need for a copy.
+        mCacheMapped = true;
+        return OK;
+    }
 
-    if (mCache == NULL) {
+    uint8_t *cache = (uint8_t *)malloc(size);
+
+    if (cache == NULL) {
+        mCachedOffset = 0;
+        mCachedSize = 0;
         return -ENOMEM;
     }
 
-    mCachedOffset = offset;
-    mCachedSize = size;
+    mCache = cache;
 
-    ssize_t err = mSource->readAt(mCachedOffset, mCache, mCachedSize);
+    ssize_t err = mSource->readAt(mCachedOffset, cache, mCachedSize);
 
     if (err < (ssize_t)size) {
         clearCache();
@@ -392,11 +443,13 @@ MPEG4Extractor::MPEG4Extractor(const sp<DataSource> &source)
       mInitCheck(NO_INIT),
       mHasVideo(false),
       mHeaderTimescale(0),
+      mMoovCached(false),
       mFirstTrack(NULL),
       mLastTrack(NULL),
       mFileMetaData(new MetaData),
       mFirstSINF(NULL),
-      mIsDrm(false) {
+      mIsDrm(false),
+      mMetaDataOnly(false) {
 }
 
 MPEG4Extractor::~MPEG4Extractor() {
@@ -429,6 +482,13 @@ uint32_t MPEG4Extractor::flags() const {
                     (CAN_SEEK_BACKWARD | CAN_SEEK_FORWARD | CAN_SEEK) : 0);
 }
 
+void MPEG4Extractor::setMetaDataOnly() {
+    // too late once the tracks have been parsed in full
+    if (mInitCheck == NO_INIT) {
+        mMetaDataOnly = true;
+    }
+}
+
 sp<MetaData> MPEG4Extractor::getMetaData() {
     status_t err;
     if ((err = readMetaData()) != OK) {
@@ -477,7 +537,7 @@ sp<MetaData> MPEG4Extractor::getTrackMetaData(
         return NULL;
     }
 
-    if ((flags & kIncludeExtensiveMetaData)
+    if ((flags & kIncludeExtensiveMetaData) && !mMetaDataOnly
             && !track->includes_expensive_metadata) {
         track->includes_expensive_metadata = true;
 
@@ -900,12 +960,32 @@ status_t MPEG4Extractor::parseChunk(off64_t *offset, int depth) {
         case FOURCC('s', 'c', 'h', 'i'):
         case FOURCC('e', 'd', 't', 's'):
         {
+            if (chunk_type == FOURCC('m', 'o', 'o', 'v')
+                    && chunk_size <= kMaxCachedMoovSize
+                    && (mDataSource->flags()
+                        & (DataSource::kWantsPrefetching
+                            | DataSource::kIsCachingDataSource))) {
+                // Fetch the whole movie box in one read rather than in the
+                // many small reads of its child boxes, this also covers the
+                // sample tables of all tracks.
+                ALOGV("movie chunk is %" PRIu64 " bytes long.", chunk_size);
+
+                sp<MPEG4DataSource> cachedSource =
+                    new MPEG4DataSource(mDataSource);
+
+                if (cachedSource->setCachedRange(*offset, chunk_size) == OK) {
+                    mDataSource = cachedSource;
+                    mMoovCached = true;
+                }
+            }
+
             if (chunk_type == FOURCC('s', 't', 'b', 'l')) {
                 ALOGV("sampleTable chunk is %" PRIu64 " bytes long.", chunk_size);
 
-                if (mDataSource->flags()
-                        & (DataSource::kWantsPrefetching
-                            | DataSource::kIsCachingDataSource)) {
+                if (!mMoovCached
+                        && (mDataSource->flags()
+                            & (DataSource::kWantsPrefetching
+                                | DataSource::kIsCachingDataSource))) {
                     sp<MPEG4DataSource> cachedSource =
                         new MPEG4DataSource(mDataSource);
 
@@ -1457,6 +1537,11 @@ status_t MPEG4Extractor::parseChunk(off64_t *offset, int depth) {
 
         case FOURCC('s', 't', 's', 'c'):
         {
+            if (mMetaDataOnly) {
+                *offset += chunk_size;
+                break;
+            }
+
             status_t err =
                 mLastTrack->sampleTable->setSampleToChunkParams(
                         data_offset, chunk_data_size);
@@ -1483,6 +1568,13 @@ status_t MPEG4Extractor::parseChunk(off64_t *offset, int depth) {
                 return err;
             }
 
+            if (mMetaDataOnly) {
+                // The max input size takes reading every sample size, and
+                // neither it nor the frame rate matter without samples to
+                // read.
+                break;
+            }
+
             size_t max_size;
             err = mLastTrack->sampleTable->getMaxSampleSize(&max_size);
 
@@ -1543,6 +1635,9 @@ status_t MPEG4Extractor::parseChunk(off64_t *offset, int depth) {
         case FOURCC('s', 't', 't', 's'):
         {
             *offset += chunk_size;
+            if (mMetaDataOnly) {
+                break;
+            }
 
             status_t err =
                 mLastTrack->sampleTable->setTimeToSampleParams(
@@ -1558,6 +1653,9 @@ status_t MPEG4Extractor::parseChunk(off64_t *offset, int depth) {
         case FOURCC('c', 't', 't', 's'):
         {
             *offset += chunk_size;
+            if (mMetaDataOnly) {
+                break;
+            }
 
             status_t err =
                 mLastTrack->sampleTable->setCompositionTimeToSampleParams(
@@ -1573,6 +1671,9 @@ status_t MPEG4Extractor::parseChunk(off64_t *offset, int depth) {
         case FOURCC('s', 't', 's', 's'):
         {
             *offset += chunk_size;
+            if (mMetaDataOnly) {
+                break;
+            }
             // Ignore stss block for audio even if its present
             // All audio sample are sync samples itself,
             // self decodeable and playable.
@@ -2649,7 +2750,7 @@ sp<MediaSource> MPEG4Extractor::getTrack(size_t index) {
         --index;
     }
 
-    if (track == NULL) {
+    if (track == NULL || mMetaDataOnly) {
         return NULL;
     }
 
@@ -2673,7 +2774,6 @@ sp<MediaSource> MPEG4Extractor::getTrack(size_t index) {
             mSidxEntries, trex, mMoofOffset);
 }
 
-// static
 status_t MPEG4Extractor::verifyTrack(Track *track) {
     const char *mime;
     CHECK(track->meta->findCString(kKeyMIMEType, &mime));
@@ -2699,7 +2799,8 @@ status_t MPEG4Extractor::verifyTrack(Track *track) {
         }
     }
 
-    if (track->sampleTable == NULL || !track->sampleTable->isValid()) {
+    if (track->sampleTable == NULL
+            || (!mMetaDataOnly && !track->sampleTable->isValid())) {
         // Make sure we have all the metadata we need.
         ALOGE("stbl atom missing/invalid.");
         return ERROR_MALFORMED;
@@ -3041,7 +3142,9 @@ MPEG4Source::MPEG4Source(
       mTrex(trex),
       mFirstMoofOffset(firstMoofOffset),
       mCurrentMoofOffset(firstMoofOffset),
+      mNextMoofOffset(0),
       mCurrentTime(0),
+      mNextUnindexedMoofOffset(0),
       mCurrentSampleInfoAllocSize(0),
       mCurrentSampleInfoSizes(NULL),
       mCurrentSampleInfoOffsetsAllocSize(0),
@@ -3053,7 +3156,11 @@ MPEG4Source::MPEG4Source(
       mGroup(NULL),
       mBuffer(NULL),
       mWantsNALFragments(false),
-      mSrcBuffer(NULL) {
+      mSrcBuffer(NULL),
+      mCoalesceReads(false),
+      mChunkCache(NULL),
+      mChunkCacheOffset(0),
+      mChunkCacheSize(0) {
 
     memset(&mTrackFragmentHeaderInfo, 0, sizeof(mTrackFragmentHeaderInfo));
 
@@ -3106,8 +3213,10 @@ MPEG4Source::MPEG4Source(
     CHECK(format->findInt32(kKeyTrackID, &mTrackId));
 
     if (mFirstMoofOffset != 0) {
-        off64_t offset = mFirstMoofOffset;
-        parseChunk(&offset);
+        mFragmentSource = new MPEG4DataSource(mDataSource);
+        mDataSource = mFragmentSource;
+
+        loadFragment(mFirstMoofOffset, 0);
     }
 }
 
@@ -3145,6 +3254,10 @@ status_t MPEG4Source::start(MetaData *params) {
         return ERROR_MALFORMED;
     }
 
+    // DRM sources decrypt what is read, leave them the sample boundaries.
+    int32_t drm = 0;
+    mCoalesceReads = !(mFormat->findInt32(kKeyIsDRM, &drm) && drm != 0);
+
     mStarted = true;
 
     return OK;
@@ -3163,6 +3276,11 @@ status_t MPEG4Source::stop() {
     delete[] mSrcBuffer;
     mSrcBuffer = NULL;
 
+    delete[] mChunkCache;
+    mChunkCache = NULL;
+    mChunkCacheOffset = 0;
+    mChunkCacheSize = 0;
+
     delete mGroup;
     mGroup = NULL;
 
@@ -3288,6 +3406,46 @@ status_t MPEG4Source::parseChunk(off64_t *offset) {
     return OK;
 }
 
+status_t MPEG4Source::loadFragment(off64_t moofOffset, uint32_t time) {
+    // Read the moof box in one go, its boxes are parsed a few bytes at a
+    // time. The samples in the mdat are read through to the source.
+    uint32_t hdr[2];
+    if (mDataSource->readAt(moofOffset, hdr, 8) == 8) {
+        uint64_t moofSize = ntohl(hdr[0]);
+        if (moofSize >= 8 && moofSize <= kMaxCachedMoofSize) {
+            mFragmentSource->setCachedRange(moofOffset, moofSize);
+        }
+    }
+
+    mCurrentMoofOffset = moofOffset;
+    mNextMoofOffset = moofOffset;
+    mCurrentSamples.clear();
+    mCurrentSampleIndex = 0;
+    mCurrentTime = time;
+
+    off64_t offset = moofOffset;
+    status_t err = parseChunk(&offset);
+
+    // With a sidx box seeks skip fragments, the index would have holes.
+    if (mSegments.isEmpty()
+            && (mFragments.isEmpty()
+                || moofOffset > mFragments.itemAt(mFragments.size() - 1).mMoofOffset)) {
+        FragmentInfo info;
+        info.mMoofOffset = moofOffset;
+        info.mTime = time;
+        info.mDuration = 0;
+        for (size_t i = 0; i < mCurrentSamples.size(); ++i) {
+            info.mDuration += mCurrentSamples[i].duration;
+        }
+        mFragments.push(info);
+
+        mNextUnindexedMoofOffset =
+            mNextMoofOffset > moofOffset ? mNextMoofOffset : 0;
+    }
+
+    return err;
+}
+
 status_t MPEG4Source::parseSampleAuxiliaryInformationSizes(
         off64_t offset, off64_t /* size */) {
     ALOGV("parseSampleAuxiliaryInformationSizes");
@@ -3856,8 +4014,8 @@ status_t MPEG4Source::read(
 
     if ((!mIsAVC && !mIsHEVC) || mWantsNALFragments) {
         if (newBuffer) {
-            ssize_t num_bytes_read =
-                mDataSource->readAt(offset, (uint8_t *)mBuffer->data(), size);
+            ssize_t num_bytes_read = readSampleData(
+                    mCurrentSampleIndex, offset, (uint8_t *)mBuffer->data(), size);
 
             if (num_bytes_read < (ssize_t)size) {
                 mBuffer->release();
@@ -3938,7 +4096,8 @@ status_t MPEG4Source::read(
             num_bytes_read =
                 mDataSource->readAt(offset, (uint8_t*)mBuffer->data(), size);
         } else {
-            num_bytes_read = mDataSource->readAt(offset, mSrcBuffer, size);
+            num_bytes_read = readSampleData(
+                    mCurrentSampleIndex, offset, mSrcBuffer, size);
         }
 
         if (num_bytes_read < (ssize_t)size) {
@@ -4016,6 +4175,46 @@ status_t MPEG4Source::read(
     }
 }
 
+ssize_t MPEG4Source::readSampleData(
+        uint32_t sampleIndex, off64_t offset, void *data, size_t size) {
+    if (offset >= mChunkCacheOffset
+            && offset + size <= mChunkCacheOffset + mChunkCacheSize) {
+        memcpy(data, &mChunkCache[offset - mChunkCacheOffset], size);
+        return size;
+    }
+
+    off64_t chunkOffset;
+    size_t chunkSize;
+    if (mCoalesceReads
+            && mSampleTable->getChunkRangeForSample(
+                    sampleIndex, &chunkOffset, &chunkSize) == OK
+            && chunkSize <= kMaxCachedChunkSize
+            && offset >= chunkOffset
+            && offset + size < chunkOffset + chunkSize) {
+        if (mChunkCache == NULL) {
+            mChunkCache = new (std::nothrow) uint8_t[kMaxCachedChunkSize];
+        }
+
+        if (mChunkCache != NULL) {
+            // Samples are mostly read in order, keep the rest of the chunk
+            // from this sample on.
+            size_t cacheSize = chunkOffset + chunkSize - offset;
+            ssize_t n = mDataSource->readAt(offset, mChunkCache, cacheSize);
+            if (n >= (ssize_t)size) {
+                mChunkCacheOffset = offset;
+                mChunkCacheSize = n;
+
+                memcpy(data, mChunkCache, size);
+                return size;
+            }
+
+            mChunkCacheSize = 0;
+        }
+    }
+
+    return mDataSource->readAt(offset, data, size);
+}
+
 status_t MPEG4Source::fragmentedRead(
         MediaBuffer **out, const ReadOptions *options) {
 
@@ -4052,19 +4251,46 @@ status_t MPEG4Source::fragmentedRead(
                 totalTime += se->mDurationUs;
                 totalOffset += se->mSize;
             }
-            mCurrentMoofOffset = totalOffset;
-            mCurrentSamples.clear();
-            mCurrentSampleIndex = 0;
-            parseChunk(&totalOffset);
-            mCurrentTime = totalTime * mTimescale / 1000000ll;
+            loadFragment(totalOffset, totalTime * mTimescale / 1000000ll);
         } else {
-            // without sidx boxes, we can only seek to 0
-            mCurrentMoofOffset = mFirstMoofOffset;
-            mCurrentSamples.clear();
-            mCurrentSampleIndex = 0;
-            off64_t tmp = mCurrentMoofOffset;
-            parseChunk(&tmp);
-            mCurrentTime = 0;
+            // without sidx boxes, go by the fragments seen so far and parse
+            // ahead until one covers the requested time
+            uint32_t seekTime = seekTimeUs * mTimescale / 1000000ll;
+            while (mNextUnindexedMoofOffset > 0) {
+                const FragmentInfo &last = mFragments.itemAt(mFragments.size() - 1);
+                uint32_t endTime = last.mTime + last.mDuration;
+                if (endTime > seekTime) {
+                    break;
+                }
+                loadFragment(mNextUnindexedMoofOffset, endTime);
+            }
+
+            // The last fragment starting at or before seekTime.
+            size_t left = 0;
+            size_t right = mFragments.size();
+            while (left < right) {
+                size_t center = left + (right - left) / 2;
+                if (mFragments.itemAt(center).mTime <= seekTime) {
+                    left = center + 1;
+                } else {
+                    right = center;
+                }
+            }
+            size_t index = left > 0 ? left - 1 : 0;
+
+            const FragmentInfo &fragment = mFragments.itemAt(index);
+            if (index + 1 < mFragments.size()
+                    && ((mode == ReadOptions::SEEK_NEXT_SYNC && seekTime > fragment.mTime)
+                        || (mode == ReadOptions::SEEK_CLOSEST_SYNC
+                            && seekTime - fragment.mTime
+                                > fragment.mTime + fragment.mDuration - seekTime))) {
+                // requested next sync, or closest sync and it was closer to
+                // the start of the next fragment
+                ++index;
+            }
+
+            FragmentInfo target = mFragments.itemAt(index);
+            loadFragment(target.mMoofOffset, target.mTime);
         }
 
         if (mBuffer != NULL) {
@@ -4088,11 +4314,7 @@ status_t MPEG4Source::fragmentedRead(
             if (mNextMoofOffset <= mCurrentMoofOffset) {
                 return ERROR_END_OF_STREAM;
             }
-            off64_t nextMoof = mNextMoofOffset;
-            mCurrentMoofOffset = nextMoof;
-            mCurrentSamples.clear();
-            mCurrentSampleIndex = 0;
-            parseChunk(&nextMoof);
+            loadFragment(mNextMoofOffset, mCurrentTime);
             if (mCurrentSampleIndex >= mCurrentSamples.size()) {
                 return ERROR_END_OF_STREAM;
             }
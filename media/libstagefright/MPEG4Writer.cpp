@@ -39,6 +39,7 @@
 #include <media/mediarecorder.h>
 #include <cutils/properties.h>
 
+#include "include/BlockFileWriter.h"
 #include "include/ESDS.h"
 #include "include/ExtendedUtils.h"
 
@@ -58,6 +59,11 @@ static const uint8_t kNalUnitTypeSeqParamSet = 0x07;
 static const uint8_t kNalUnitTypePicParamSet = 0x08;
 static const int64_t kInitialDelayTimeUs     = 700000LL;
 
+// The file is written in blocks of this size, with this many of them in
+// flight before the tracks stall.
+static const size_t kFileWriterBlockSize = 1024 * 1024;
+static const size_t kFileWriterNumBlocks = 4;
+
 class MPEG4Writer::Track {
 public:
     Track(MPEG4Writer *owner, const sp<MediaSource> &source, size_t trackId);
@@ -79,6 +85,8 @@ public:
     bool isHEVC() const { return mIsHEVC; }
     void addChunkOffset(off64_t offset);
     int32_t getTrackId() const { return mTrackId; }
+    void writeTrexBox();
+    void writeTrafBox(const Chunk &chunk, off64_t *dataOffsetPos);
     status_t dump(int fd, const Vector<String16>& args) const;
 
 private:
@@ -246,6 +254,16 @@ private:
     int64_t mMinCttsOffsetTimeUs;
     int64_t mMaxCttsOffsetTimeUs;
 
+    // The movie fragment being gathered, its sample data is in mChunkSamples.
+    // None of the sample tables above are used for a fragmented file.
+    Vector<FragmentSample> mFragmentSamples;
+    int64_t mFragmentStartTimeUs;         // Decoding time of the 1st sample
+    int64_t mFragmentBaseDecodeTimeTicks;
+    int64_t mLastDecodingTimeUs;
+    int64_t mLastDecodingTimeTicks;
+    uint32_t mNumFragmentedSamples;
+    uint32_t mNumFragmentedSyncSamples;
+
     // Sequence parameter set or picture parameter set
     struct AVCParamSet {
         AVCParamSet(uint16_t length, const uint8_t *data)
@@ -305,6 +323,11 @@ private:
     int32_t mHFRRatio;
 
     void updateTrackSizeEstimate();
+    uint32_t getSampleCount() const;
+    uint32_t getSyncSampleCount() const;
+    status_t addFragmentSample(
+            MediaBuffer *sample, const sp<MetaData> &meta, size_t sampleSize, bool isSync);
+    void bufferFragment();
     void addOneStscTableEntry(size_t chunkId, size_t sampleId);
     void addOneStssTableEntry(size_t sampleId);
 
@@ -346,6 +369,7 @@ private:
 
 MPEG4Writer::MPEG4Writer(const char *filename)
     : mFd(-1),
+      mFileWriter(NULL),
       mInitCheck(NO_INIT),
       mIsRealTimeRecording(true),
       mUse4ByteNalLength(true),
@@ -358,6 +382,9 @@ MPEG4Writer::MPEG4Writer(const char *filename)
       mMdatOffset(0),
       mEstimatedMoovBoxSize(0),
       mInterleaveDurationUs(1000000),
+      mFragmentDurationUs(0),
+      mMoovWritten(false),
+      mFragmentSequenceNumber(0),
       mLatitudex10000(0),
       mLongitudex10000(0),
       mAreGeoTagsAvailable(false),
@@ -374,6 +401,7 @@ MPEG4Writer::MPEG4Writer(const char *filename)
 
 MPEG4Writer::MPEG4Writer(int fd)
     : mFd(dup(fd)),
+      mFileWriter(NULL),
       mInitCheck(mFd < 0? NO_INIT: OK),
       mIsRealTimeRecording(true),
       mUse4ByteNalLength(true),
@@ -386,6 +414,9 @@ MPEG4Writer::MPEG4Writer(int fd)
       mMdatOffset(0),
       mEstimatedMoovBoxSize(0),
       mInterleaveDurationUs(1000000),
+      mFragmentDurationUs(0),
+      mMoovWritten(false),
+      mFragmentSequenceNumber(0),
       mLatitudex10000(0),
       mLongitudex10000(0),
       mAreGeoTagsAvailable(false),
@@ -416,6 +447,9 @@ status_t MPEG4Writer::dump(
     result.append(buffer);
     snprintf(buffer, SIZE, "     mStarted: %s\n", mStarted? "true": "false");
     result.append(buffer);
+    if (mFileWriter != NULL) {
+        mFileWriter->dump(&result);
+    }
     ::write(fd, result.string(), result.size());
     for (List<Track *>::iterator it = mTracks.begin();
          it != mTracks.end(); ++it) {
@@ -434,7 +468,7 @@ status_t MPEG4Writer::Track::dump(
     snprintf(buffer, SIZE, "       reached EOS: %s\n",
             mReachedEOS? "true": "false");
     result.append(buffer);
-    snprintf(buffer, SIZE, "       frames encoded : %d\n", mStszTableEntries->count());
+    snprintf(buffer, SIZE, "       frames encoded : %d\n", getSampleCount());
     result.append(buffer);
     snprintf(buffer, SIZE, "       duration encoded : %" PRId64 " us\n", mTrackDurationUs);
     result.append(buffer);
@@ -649,6 +683,16 @@ status_t MPEG4Writer::start(MetaData *param) {
 
     mStartTimestampUs = -1;
 
+    int64_t fragmentDurationUs;
+    if (param &&
+        param->findInt64(kKeyMovieFragmentDurationUs, &fragmentDurationUs) &&
+        fragmentDurationUs > 0) {
+        mFragmentDurationUs = fragmentDurationUs;
+        ALOGI("movie fragment duration: %" PRId64 " us", mFragmentDurationUs);
+    }
+    mMoovWritten = false;
+    mFragmentSequenceNumber = 0;
+
     if (!param ||
         !param->findInt32(kKeyTimeScale, &mTimeScale)) {
         mTimeScale = 1000;
@@ -661,10 +705,13 @@ status_t MPEG4Writer::start(MetaData *param) {
      * is to meet the file size limit requirement, rather than
      * to make the file streamable. mStreamableFile does not tell
      * whether the actual recorded file is streamable or not.
+     * A fragmented file writes its moov box ahead of the first
+     * fragment and never needs the reserved space.
      */
     mStreamableFile =
         (mMaxFileSizeLimitBytes != 0 &&
-         mMaxFileSizeLimitBytes >= kMinStreamableFileSizeInBytes);
+         mMaxFileSizeLimitBytes >= kMinStreamableFileSizeInBytes &&
+         !isFragmented());
 
     /*
      * mWriteMoovBoxToMemory is true if the amount of data in moov box is
@@ -706,6 +753,23 @@ status_t MPEG4Writer::start(MetaData *param) {
     mMoovBoxBuffer = NULL;
     mMoovBoxBufferOffset = 0;
 
+    // Samples and boxes go to the file through large blocks written on
+    // a thread of their own, a slow write then doesn't hold up the tracks.
+    char value[PROPERTY_VALUE_MAX];
+    int64_t syncIntervalBytes = 0;
+    if (property_get("media.stagefright.mp4-sync-kb", value, NULL)) {
+        syncIntervalBytes = atoll(value) * 1024;
+    }
+    mFileWriter = new BlockFileWriter(
+            mFd, mOffset, kFileWriterBlockSize, kFileWriterNumBlocks,
+            syncIntervalBytes);
+    if (mFileWriter->initCheck() != OK) {
+        ALOGE("failed to set up the file writer");
+        delete mFileWriter;
+        mFileWriter = NULL;
+        return NO_MEMORY;
+    }
+
     writeFtypBox(param);
 
     mFreeBoxOffset = mOffset;
@@ -720,7 +784,7 @@ status_t MPEG4Writer::start(MetaData *param) {
     CHECK_GE(mEstimatedMoovBoxSize, 8);
     if (mStreamableFile) {
         // Reserve a 'free' box only for streamable file
-        lseek64(mFd, mFreeBoxOffset, SEEK_SET);
+        mFileWriter->seekTo(mFreeBoxOffset);
         writeInt32(mEstimatedMoovBoxSize);
         write("free", 4);
         mMdatOffset = mFreeBoxOffset + mEstimatedMoovBoxSize;
@@ -729,11 +793,14 @@ status_t MPEG4Writer::start(MetaData *param) {
     }
 
     mOffset = mMdatOffset;
-    lseek64(mFd, mMdatOffset, SEEK_SET);
-    if (mUse32BitOffset) {
-        write("????mdat", 8);
-    } else {
-        write("\x00\x00\x00\x01mdat????????", 16);
+    mFileWriter->seekTo(mMdatOffset);
+    if (!isFragmented()) {
+        // A fragmented file has an mdat box per fragment instead
+        if (mUse32BitOffset) {
+            write("????mdat", 8);
+        } else {
+            write("\x00\x00\x00\x01mdat????????", 16);
+        }
     }
 
     status_t err = startWriterThread();
@@ -842,6 +909,12 @@ void MPEG4Writer::writeCompositionMatrix(int degrees) {
 }
 
 void MPEG4Writer::release() {
+    if (mFileWriter != NULL) {
+        mFileWriter->flush();
+        delete mFileWriter;
+        mFileWriter = NULL;
+    }
+
     close(mFd);
     mFd = -1;
     mInitCheck = NO_INIT;
@@ -894,18 +967,26 @@ status_t MPEG4Writer::reset() {
         return err;
     }
 
+    // Every fragment is complete on its own, the writer thread has already
+    // written out the last of them.
+    if (isFragmented()) {
+        if (!mMoovWritten) {
+            ALOGW("No movie fragment was written");
+        }
+        CHECK(mBoxes.empty());
+        release();
+        return err;
+    }
+
     // Fix up the size of the 'mdat' chunk.
     if (mUse32BitOffset) {
-        lseek64(mFd, mMdatOffset, SEEK_SET);
         uint32_t size = htonl(static_cast<uint32_t>(mOffset - mMdatOffset));
-        ::write(mFd, &size, 4);
+        mFileWriter->writeAt(mMdatOffset, &size, 4);
     } else {
-        lseek64(mFd, mMdatOffset + 8, SEEK_SET);
         uint64_t size = mOffset - mMdatOffset;
         size = hton64(size);
-        ::write(mFd, &size, 8);
+        mFileWriter->writeAt(mMdatOffset + 8, &size, 8);
     }
-    lseek64(mFd, mOffset, SEEK_SET);
 
     // Construct moov box now
     mMoovBoxBufferOffset = 0;
@@ -929,12 +1010,12 @@ status_t MPEG4Writer::reset() {
         CHECK_LE(mMoovBoxBufferOffset + 8, mEstimatedMoovBoxSize);
 
         // Moov box
-        lseek64(mFd, mFreeBoxOffset, SEEK_SET);
+        mFileWriter->seekTo(mFreeBoxOffset);
         mOffset = mFreeBoxOffset;
         write(mMoovBoxBuffer, 1, mMoovBoxBufferOffset);
 
         // Free box
-        lseek64(mFd, mOffset, SEEK_SET);
+        mFileWriter->seekTo(mOffset);
         writeInt32(mEstimatedMoovBoxSize - mMoovBoxBufferOffset);
         write("free", 4);
     } else {
@@ -999,9 +1080,21 @@ void MPEG4Writer::writeMoovBox(int64_t durationUs) {
         it != mTracks.end(); ++it, ++id) {
         (*it)->writeTrackHeader(mUse32BitOffset);
     }
+    if (isFragmented()) {
+        writeMvexBox();
+    }
     endBox();  // moov
 }
 
+void MPEG4Writer::writeMvexBox() {
+    beginBox("mvex");
+    for (List<Track *>::iterator it = mTracks.begin();
+        it != mTracks.end(); ++it) {
+        (*it)->writeTrexBox();
+    }
+    endBox();  // mvex
+}
+
 void MPEG4Writer::writeFtypBox(MetaData *param) {
     beginBox("ftyp");
 
@@ -1071,7 +1164,7 @@ void MPEG4Writer::unlock() {
 off64_t MPEG4Writer::addSample_l(MediaBuffer *buffer) {
     off64_t old_offset = mOffset;
 
-    ::write(mFd,
+    mFileWriter->append(
           (const uint8_t *)buffer->data() + buffer->range_offset(),
           buffer->range_length());
 
@@ -1100,16 +1193,14 @@ off64_t MPEG4Writer::addLengthPrefixedSample_l(MediaBuffer *buffer) {
     size_t length = buffer->range_length();
 
     if (mUse4ByteNalLength) {
-        uint8_t x = length >> 24;
-        ::write(mFd, &x, 1);
-        x = (length >> 16) & 0xff;
-        ::write(mFd, &x, 1);
-        x = (length >> 8) & 0xff;
-        ::write(mFd, &x, 1);
-        x = length & 0xff;
-        ::write(mFd, &x, 1);
-
-        ::write(mFd,
+        uint8_t x[4];
+        x[0] = length >> 24;
+        x[1] = (length >> 16) & 0xff;
+        x[2] = (length >> 8) & 0xff;
+        x[3] = length & 0xff;
+        mFileWriter->append(x, 4);
+
+        mFileWriter->append(
               (const uint8_t *)buffer->data() + buffer->range_offset(),
               length);
 
@@ -1117,11 +1208,12 @@ off64_t MPEG4Writer::addLengthPrefixedSample_l(MediaBuffer *buffer) {
     } else {
         CHECK_LT(length, 65536);
 
-        uint8_t x = length >> 8;
-        ::write(mFd, &x, 1);
-        x = length & 0xff;
-        ::write(mFd, &x, 1);
-        ::write(mFd, (const uint8_t *)buffer->data() + buffer->range_offset(), length);
+        uint8_t x[2];
+        x[0] = length >> 8;
+        x[1] = length & 0xff;
+        mFileWriter->append(x, 2);
+        mFileWriter->append(
+                (const uint8_t *)buffer->data() + buffer->range_offset(), length);
         mOffset += length + 2;
     }
 
@@ -1147,9 +1239,9 @@ size_t MPEG4Writer::write(
                  it != mBoxes.end(); ++it) {
                 (*it) += mOffset;
             }
-            lseek64(mFd, mOffset, SEEK_SET);
-            ::write(mFd, mMoovBoxBuffer, mMoovBoxBufferOffset);
-            ::write(mFd, ptr, bytes);
+            mFileWriter->seekTo(mOffset);
+            mFileWriter->append(mMoovBoxBuffer, mMoovBoxBufferOffset);
+            mFileWriter->append(ptr, bytes);
             mOffset += (bytes + mMoovBoxBufferOffset);
 
             // All subsequent moov box content will be written
@@ -1160,7 +1252,7 @@ size_t MPEG4Writer::write(
             mMoovBoxBufferOffset += bytes;
         }
     } else {
-        ::write(mFd, ptr, size * nmemb);
+        mFileWriter->append(ptr, bytes);
         mOffset += bytes;
     }
     return bytes;
@@ -1186,10 +1278,8 @@ void MPEG4Writer::endBox() {
        int32_t x = htonl(mMoovBoxBufferOffset - offset);
        memcpy(mMoovBoxBuffer + offset, &x, 4);
     } else {
-        lseek64(mFd, offset, SEEK_SET);
-        writeInt32(mOffset - offset);
-        mOffset -= 4;
-        lseek64(mFd, mOffset, SEEK_SET);
+        int32_t x = htonl(mOffset - offset);
+        mFileWriter->writeAt(offset, &x, 4);
     }
 }
 
@@ -1393,6 +1483,12 @@ MPEG4Writer::Track::Track(
       mStssTableEntries(new ListTableEntries<uint32_t>(1000, 1)),
       mSttsTableEntries(new ListTableEntries<uint32_t>(1000, 2)),
       mCttsTableEntries(new ListTableEntries<uint32_t>(1000, 2)),
+      mFragmentStartTimeUs(0),
+      mFragmentBaseDecodeTimeTicks(0),
+      mLastDecodingTimeUs(0),
+      mLastDecodingTimeTicks(0),
+      mNumFragmentedSamples(0),
+      mNumFragmentedSyncSamples(0),
       mCodecSpecificData(NULL),
       mCodecSpecificDataSize(0),
       mGotAllCodecSpecificData(false),
@@ -1612,6 +1708,11 @@ void MPEG4Writer::writeChunkToFile(Chunk* chunk) {
     ALOGV("writeChunkToFile: %" PRId64 " from %s track",
         chunk->mTimeStampUs, chunk->mTrack->isAudio()? "audio": "video");
 
+    if (isFragmented()) {
+        writeFragmentToFile(chunk);
+        return;
+    }
+
     int32_t isFirstSample = true;
     while (!chunk->mSamples.empty()) {
         List<MediaBuffer *>::iterator it = chunk->mSamples.begin();
@@ -1632,6 +1733,54 @@ void MPEG4Writer::writeChunkToFile(Chunk* chunk) {
     chunk->mSamples.clear();
 }
 
+void MPEG4Writer::writeFragmentToFile(Chunk* chunk) {
+    if (!mMoovWritten) {
+        // The durations are only known from the fragments
+        writeMoovBox(0);
+        mMoovWritten = true;
+    }
+
+    off64_t moofOffset = mOffset;
+    off64_t dataOffsetPos;
+    beginBox("moof");
+    beginBox("mfhd");
+    writeInt32(0);                          // version=0, flags=0
+    writeInt32(++mFragmentSequenceNumber);  // sequence number
+    endBox();  // mfhd
+    chunk->mTrack->writeTrafBox(*chunk, &dataOffsetPos);
+    endBox();  // moof
+
+    // The samples start right after the 8-byte mdat header
+    int32_t dataOffset = htonl(static_cast<int32_t>(mOffset + 8 - moofOffset));
+    mFileWriter->writeAt(dataOffsetPos, &dataOffset, 4);
+
+    beginBox("mdat");
+    while (!chunk->mSamples.empty()) {
+        List<MediaBuffer *>::iterator it = chunk->mSamples.begin();
+
+        if (chunk->mTrack->isAvc() || chunk->mTrack->isHEVC()) {
+            addLengthPrefixedSample_l(*it);
+        } else {
+            addSample_l(*it);
+        }
+
+        (*it)->release();
+        (*it) = NULL;
+        chunk->mSamples.erase(it);
+    }
+    endBox();  // mdat
+}
+
+bool MPEG4Writer::allTracksBuffered_l() {
+    for (List<ChunkInfo>::iterator it = mChunkInfos.begin();
+         it != mChunkInfos.end(); ++it) {
+        if (it->mChunks.empty() && !it->mTrack->reachedEOS()) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void MPEG4Writer::writeAllChunks() {
     ALOGV("writeAllChunks");
     size_t outstandingChunks = 0;
@@ -1650,6 +1799,12 @@ void MPEG4Writer::writeAllChunks() {
 bool MPEG4Writer::findChunkToWrite(Chunk *chunk) {
     ALOGV("findChunkToWrite");
 
+    // The moov box of a fragmented file needs the codec specific data of
+    // every track, hold the first fragment back until all of them have it.
+    if (isFragmented() && !mMoovWritten && !mDone && !allTracksBuffered_l()) {
+        return false;
+    }
+
     int64_t minTimestampUs = 0x7FFFFFFFFFFFFFFFLL;
     Track *track = NULL;
     for (List<ChunkInfo>::iterator it = mChunkInfos.begin();
@@ -1847,7 +2002,7 @@ status_t MPEG4Writer::Track::stop() {
     pthread_join(mThread, &dummy);
     status_t err = static_cast<status_t>(reinterpret_cast<uintptr_t>(dummy));
 
-    if (mOwner->exceedsFileSizeLimit() && mStszTableEntries->count() == 0) {
+    if (mOwner->exceedsFileSizeLimit() && getSampleCount() == 0) {
         ALOGE(" Filesize limit exceeded and zero samples written ");
         return ERROR_END_OF_STREAM;
     }
@@ -2269,6 +2424,15 @@ status_t MPEG4Writer::Track::threadEntry() {
         meta_data->findInt32(kKeyIsSyncFrame, &isSync);
         CHECK(meta_data->findInt64(kKeyTime, &timestampUs));
 
+        if (mOwner->isFragmented()) {
+            err = addFragmentSample(copy, meta_data, sampleSize, isSync != 0);
+            if (err != OK) {
+                copy->release();
+                return err;
+            }
+            continue;
+        }
+
 ////////////////////////////////////////////////////////////////////////////////
         if (mStszTableEntries->count() == 0) {
             mFirstSampleTimeRealUs = systemTime() / 1000;
@@ -2478,6 +2642,32 @@ status_t MPEG4Writer::Track::threadEntry() {
 
     mOwner->trackProgressStatus(mTrackId, -1, err);
 
+    if (mOwner->isFragmented()) {
+        // We don't know how long the last sample lasts either, repeat the
+        // duration of the one before it.
+        if (!mFragmentSamples.isEmpty()) {
+            int64_t durationTicks = 0;
+            if (mFragmentSamples.size() > 1) {
+                durationTicks =
+                    mFragmentSamples[mFragmentSamples.size() - 2].mDurationTicks;
+            }
+            mFragmentSamples.editTop().mDurationTicks = durationTicks;
+            mTrackDurationUs = mLastDecodingTimeUs +
+                (durationTicks * 1000000LL + (mTimeScale / 2)) / mTimeScale;
+            bufferFragment();
+        }
+        mReachedEOS = true;
+
+        sendTrackSummary(hasMultipleTracks);
+
+        ALOGI("Received total/0-length (%d/%d) buffers and encoded %d frames in fragments. - %s",
+                count, nZeroLengthFrames, mNumFragmentedSamples, trackName);
+        if (err == ERROR_END_OF_STREAM) {
+            return OK;
+        }
+        return err;
+    }
+
     // Last chunk
     if (!hasMultipleTracks) {
         addOneStscTableEntry(1, mStszTableEntries->count());
@@ -2531,12 +2721,12 @@ status_t MPEG4Writer::Track::threadEntry() {
 }
 
 bool MPEG4Writer::Track::isTrackMalFormed() const {
-    if (mStszTableEntries->count() == 0) {                      // no samples written
+    if (getSampleCount() == 0) {                      // no samples written
         ALOGE("The number of recorded samples is 0");
         return true;
     }
 
-    if (!mIsAudio && mStssTableEntries->count() == 0) {  // no sync frames for video
+    if (!mIsAudio && getSyncSampleCount() == 0) {  // no sync frames for video
         ALOGE("There are no sync frames for video track");
         return true;
     }
@@ -2567,7 +2757,7 @@ void MPEG4Writer::Track::sendTrackSummary(bool hasMultipleTracks) {
 
     mOwner->notify(MEDIA_RECORDER_TRACK_EVENT_INFO,
                     trackNum | MEDIA_RECORDER_TRACK_INFO_ENCODED_FRAMES,
-                    mStszTableEntries->count());
+                    getSampleCount());
 
     {
         // The system delay time excluding the requested initial delay that
@@ -2661,6 +2851,120 @@ bool MPEG4Writer::useNalLengthFour() {
     return mUse4ByteNalLength;
 }
 
+uint32_t MPEG4Writer::Track::getSampleCount() const {
+    if (mOwner->isFragmented()) {
+        return mNumFragmentedSamples;
+    }
+    return mStszTableEntries->count();
+}
+
+uint32_t MPEG4Writer::Track::getSyncSampleCount() const {
+    if (mOwner->isFragmented()) {
+        return mNumFragmentedSyncSamples;
+    }
+    return mStssTableEntries->count();
+}
+
+status_t MPEG4Writer::Track::addFragmentSample(
+        MediaBuffer *sample, const sp<MetaData> &meta, size_t sampleSize, bool isSync) {
+    const char *trackName = mIsAudio ? "Audio" : "Video";
+    int64_t timestampUs;
+    CHECK(meta->findInt64(kKeyTime, &timestampUs));
+    int64_t decodingTimeUs = timestampUs;
+    if (!mIsAudio) {
+        CHECK(meta->findInt64(kKeyDecodingTime, &decodingTimeUs));
+    }
+
+    if (mNumFragmentedSamples == 0) {
+        mFirstSampleTimeRealUs = systemTime() / 1000;
+        mStartTimestampUs = timestampUs;
+        mOwner->setStartTimestampUs(mStartTimestampUs);
+    }
+
+    timestampUs -= mStartTimestampUs;
+    decodingTimeUs -= mStartTimestampUs;
+    if (WARN_UNLESS(decodingTimeUs >= 0ll, "for %s track", trackName)) {
+        return ERROR_MALFORMED;
+    }
+    if (WARN_UNLESS(kMaxCttsOffsetTimeUs >= decodingTimeUs - timestampUs,
+            "for %s track", trackName)) {
+        return ERROR_MALFORMED;
+    }
+
+    if (mOwner->isRealTimeRecording() && mIsAudio) {
+        updateDriftTime(meta);
+    }
+
+    int64_t decodingTimeTicks = (decodingTimeUs * mTimeScale + 500000LL) / 1000000LL;
+    if (decodingTimeTicks < mLastDecodingTimeTicks) {
+        ALOGE("decodingTimeUs %" PRId64 " < lastDecodingTimeUs %" PRId64 " for %s track",
+            decodingTimeUs, mLastDecodingTimeUs, trackName);
+        return UNKNOWN_ERROR;
+    }
+
+    if (!mFragmentSamples.isEmpty()) {
+        mFragmentSamples.editTop().mDurationTicks = decodingTimeTicks - mLastDecodingTimeTicks;
+
+        // A video fragment starts with a sync frame so that playback can
+        // begin at any of them, unless the sync frames are too far apart.
+        int64_t fragmentDurationUs = decodingTimeUs - mFragmentStartTimeUs;
+        if ((fragmentDurationUs >= mOwner->fragmentDuration() && (mIsAudio || isSync)) ||
+            fragmentDurationUs >= 4 * mOwner->fragmentDuration()) {
+            bufferFragment();
+        }
+    }
+
+    if (mFragmentSamples.isEmpty()) {
+        mFragmentStartTimeUs = decodingTimeUs;
+        mFragmentBaseDecodeTimeTicks = decodingTimeTicks;
+    }
+
+    FragmentSample info;
+    info.mSize = sampleSize;
+    info.mDurationTicks = 0;  // Set when the next sample arrives
+    int64_t cttsOffsetTicks =
+        ((timestampUs - decodingTimeUs) * mTimeScale + 500000LL) / 1000000LL;
+    info.mCttsOffsetTicks = cttsOffsetTicks > 0 ? cttsOffsetTicks : 0;
+    info.mIsSync = mIsAudio || isSync;
+    mFragmentSamples.push(info);
+    mChunkSamples.push_back(sample);
+
+    ++mNumFragmentedSamples;
+    if (info.mIsSync) {
+        ++mNumFragmentedSyncSamples;
+    }
+    mLastDecodingTimeUs = decodingTimeUs;
+    mLastDecodingTimeTicks = decodingTimeTicks;
+    if (timestampUs > mTrackDurationUs) {
+        mTrackDurationUs = timestampUs;
+    }
+
+    if (mTrackingProgressStatus) {
+        if (mPreviousTrackTimeUs <= 0) {
+            mPreviousTrackTimeUs = mStartTimestampUs;
+        }
+        trackProgressStatus(timestampUs);
+    }
+    return OK;
+}
+
+void MPEG4Writer::Track::bufferFragment() {
+    ALOGV("bufferFragment: %zu samples", mFragmentSamples.size());
+
+    Chunk chunk(this, mFragmentStartTimeUs, mChunkSamples);
+    chunk.mFragmentSamples = mFragmentSamples;
+    chunk.mBaseDecodeTimeTicks = mFragmentBaseDecodeTimeTicks;
+
+    int64_t chunkDurationUs = mLastDecodingTimeUs - mFragmentStartTimeUs;
+    if (chunkDurationUs > mMaxChunkDurationUs) {
+        mMaxChunkDurationUs = chunkDurationUs;
+    }
+
+    mOwner->bufferChunk(chunk);
+    mChunkSamples.clear();
+    mFragmentSamples.clear();
+}
+
 void MPEG4Writer::Track::bufferChunk(int64_t timestampUs) {
     ALOGV("bufferChunk");
 
@@ -2739,10 +3043,19 @@ void MPEG4Writer::Track::writeStblBox(bool use32BitOffset) {
         writeVideoFourCCBox();
     }
     mOwner->endBox();  // stsd
-    writeSttsBox();
-    writeCttsBox();
-    if (!mIsAudio) {
-        writeStssBox();
+    if (mOwner->isFragmented()) {
+        // The samples are described by the movie fragments, the
+        // mandatory tables stay empty.
+        mOwner->beginBox("stts");
+        mOwner->writeInt32(0);  // version=0, flags=0
+        mOwner->writeInt32(0);  // entry count
+        mOwner->endBox();  // stts
+    } else {
+        writeSttsBox();
+        writeCttsBox();
+        if (!mIsAudio) {
+            writeStssBox();
+        }
     }
     writeStszBox();
     writeStscBox();
@@ -2750,6 +3063,69 @@ void MPEG4Writer::Track::writeStblBox(bool use32BitOffset) {
     mOwner->endBox();  // stbl
 }
 
+void MPEG4Writer::Track::writeTrexBox() {
+    if (mMdatSizeBytes == 0) {
+        // There is no trak box for it either
+        return;
+    }
+
+    mOwner->beginBox("trex");
+    mOwner->writeInt32(0);             // version=0, flags=0
+    mOwner->writeInt32(mTrackId);
+    mOwner->writeInt32(1);             // default sample description index
+    mOwner->writeInt32(0);             // default sample duration
+    mOwner->writeInt32(0);             // default sample size
+    mOwner->writeInt32(0);             // default sample flags
+    mOwner->endBox();  // trex
+}
+
+void MPEG4Writer::Track::writeTrafBox(const Chunk &chunk, off64_t *dataOffsetPos) {
+    const Vector<FragmentSample> &samples = chunk.mFragmentSamples;
+    CHECK_EQ(samples.size(), chunk.mSamples.size());
+
+    // Fragment times are relative to the earliest track, as the edit of
+    // the first stts entry does for a regular file. The movie start time
+    // is settled by now, all tracks have their first samples.
+    int64_t startTimeOffsetUs = mStartTimestampUs - mOwner->mStartTimestampUs;
+    int64_t baseDecodeTimeTicks = chunk.mBaseDecodeTimeTicks +
+        (startTimeOffsetUs * mTimeScale + 500000LL) / 1000000LL;
+
+    // data offset, sample duration, sample size and sample flags present
+    uint32_t trunFlags = 0x000001 | 0x000100 | 0x000200 | 0x000400;
+    if (!mIsAudio) {
+        trunFlags |= 0x000800;         // sample composition time offset present
+    }
+
+    mOwner->beginBox("traf");
+    mOwner->beginBox("tfhd");
+    mOwner->writeInt32(0x020000);      // version=0, flags=default-base-is-moof
+    mOwner->writeInt32(mTrackId);
+    mOwner->endBox();  // tfhd
+
+    mOwner->beginBox("tfdt");
+    mOwner->writeInt32(0x01000000);    // version=1, flags=0
+    mOwner->writeInt64(baseDecodeTimeTicks);
+    mOwner->endBox();  // tfdt
+
+    mOwner->beginBox("trun");
+    mOwner->writeInt32(trunFlags);     // version=0
+    mOwner->writeInt32(samples.size());
+    *dataOffsetPos = mOwner->mOffset;
+    mOwner->writeInt32(0);             // data offset, set once moof is complete
+    for (size_t i = 0; i < samples.size(); ++i) {
+        const FragmentSample &sample = samples[i];
+        mOwner->writeInt32(sample.mDurationTicks);
+        mOwner->writeInt32(sample.mSize);
+        // A sync sample does not depend on others, others are non sync
+        mOwner->writeInt32(sample.mIsSync ? 0x02000000 : 0x01010000);
+        if (!mIsAudio) {
+            mOwner->writeInt32(sample.mCttsOffsetTicks);
+        }
+    }
+    mOwner->endBox();  // trun
+    mOwner->endBox();  // traf
+}
+
 void MPEG4Writer::Track::writeVideoFourCCBox() {
     const char *mime;
     bool success = mMeta->findCString(kKeyMIMEType, &mime);
@@ -2943,7 +3319,8 @@ void MPEG4Writer::Track::writeTkhdBox(uint32_t now) {
     mOwner->writeInt32(now);           // modification time
     mOwner->writeInt32(mTrackId);      // track id starts with 1
     mOwner->writeInt32(0);             // reserved
-    int64_t trakDurationUs = getDurationUs();
+    // The duration of a fragmented track is the sum of its fragments
+    int64_t trakDurationUs = mOwner->isFragmented() ? 0 : getDurationUs();
     int32_t mvhdTimeScale = mOwner->getTimeScale();
     int32_t tkhdDuration =
         (trakDurationUs * mvhdTimeScale + 5E5) / 1E6;
@@ -3004,7 +3381,7 @@ void MPEG4Writer::Track::writeHdlrBox() {
 }
 
 void MPEG4Writer::Track::writeMdhdBox(uint32_t now) {
-    int64_t trakDurationUs = getDurationUs();
+    int64_t trakDurationUs = mOwner->isFragmented() ? 0 : getDurationUs();
     mOwner->beginBox("mdhd");
     mOwner->writeInt32(0);             // version=0, flags=0
     mOwner->writeInt32(now);           // creation time
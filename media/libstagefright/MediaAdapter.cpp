@@ -24,22 +24,32 @@
 
 namespace android {
 
-MediaAdapter::MediaAdapter(const sp<MetaData> &meta)
-    : mCurrentMediaBuffer(NULL),
+// How long stop() waits for the reader to make progress draining the queue.
+static const nsecs_t kDrainTimeoutNs = 3000000000ll;
+
+MediaAdapter::MediaAdapter(const sp<MetaData> &meta, size_t maxQueuedBuffers)
+    : mNumPendingBuffers(0),
+      mMaxQueuedBuffers(maxQueuedBuffers),
       mStarted(false),
+      mStopping(false),
       mOutputFormat(meta) {
 }
 
 MediaAdapter::~MediaAdapter() {
     Mutex::Autolock autoLock(mAdapterLock);
     mOutputFormat.clear();
-    CHECK(mCurrentMediaBuffer == NULL);
+    CHECK(mQueuedBuffers.empty());
+    for (size_t i = 0; i < mFreeBuffers.size(); ++i) {
+        mFreeBuffers[i]->release();
+    }
+    mFreeBuffers.clear();
 }
 
 status_t MediaAdapter::start(MetaData * /* params */) {
     Mutex::Autolock autoLock(mAdapterLock);
     if (!mStarted) {
         mStarted = true;
+        mStopping = false;
     }
     return OK;
 }
@@ -47,15 +57,28 @@ status_t MediaAdapter::start(MetaData * /* params */) {
 status_t MediaAdapter::stop() {
     Mutex::Autolock autoLock(mAdapterLock);
     if (mStarted) {
+        if (mMaxQueuedBuffers > 0) {
+            // Let read() hand out what is queued, then report the end of
+            // stream; give up if the reader stopped reading.
+            mStopping = true;
+            mBufferReadCond.signal();
+            while (!mQueuedBuffers.empty()) {
+                if (mBufferReturnedCond.waitRelative(
+                        mAdapterLock, kDrainTimeoutNs) == TIMED_OUT) {
+                    ALOGW("dropping %zu buffers the reader did not drain",
+                            mQueuedBuffers.size());
+                    break;
+                }
+            }
+        }
         mStarted = false;
         // If stop() happens immediately after a pushBuffer(), we should
-        // clean up the mCurrentMediaBuffer
-        if (mCurrentMediaBuffer != NULL) {
-            mCurrentMediaBuffer->release();
-            mCurrentMediaBuffer = NULL;
-        }
-        // While read() is still waiting, we should signal it to finish.
+        // clean up the buffers not read yet.
+        flushQueuedBuffers_l();
+        // While read() is still waiting, we should signal it to finish,
+        // and so should pushBuffer().
         mBufferReadCond.signal();
+        mBufferReturnedCond.broadcast();
     }
     return OK;
 }
@@ -65,13 +88,64 @@ sp<MetaData> MediaAdapter::getFormat() {
     return mOutputFormat;
 }
 
+// Takes back a buffer holding no reference and no observer, keeping it
+// for acquireBuffer() if queueing.
+void MediaAdapter::recycleBuffer_l(MediaBuffer *buffer) {
+    if (mMaxQueuedBuffers > 0 && mFreeBuffers.size() < mMaxQueuedBuffers) {
+        mFreeBuffers.push(buffer);
+    } else {
+        buffer->release();
+    }
+}
+
+void MediaAdapter::flushQueuedBuffers_l() {
+    while (!mQueuedBuffers.empty()) {
+        MediaBuffer *buffer = *mQueuedBuffers.begin();
+        mQueuedBuffers.erase(mQueuedBuffers.begin());
+        // drop the reference taken for pushBuffer() without a callback
+        buffer->setObserver(this);
+        buffer->claim();
+        buffer->setObserver(0);
+        recycleBuffer_l(buffer);
+        --mNumPendingBuffers;
+    }
+}
+
 void MediaAdapter::signalBufferReturned(MediaBuffer *buffer) {
     Mutex::Autolock autoLock(mAdapterLock);
     CHECK(buffer != NULL);
     buffer->setObserver(0);
-    buffer->release();
+    recycleBuffer_l(buffer);
     ALOGV("buffer returned %p", buffer);
-    mBufferReturnedCond.signal();
+    CHECK_GT(mNumPendingBuffers, 0u);
+    --mNumPendingBuffers;
+    mBufferReturnedCond.broadcast();
+}
+
+MediaBuffer *MediaAdapter::acquireBuffer(size_t size) {
+    CHECK_GT(mMaxQueuedBuffers, 0u);
+
+    MediaBuffer *buffer = NULL;
+    {
+        Mutex::Autolock autoLock(mAdapterLock);
+        while (!mFreeBuffers.isEmpty() && buffer == NULL) {
+            buffer = mFreeBuffers.top();
+            mFreeBuffers.pop();
+            if (buffer->size() < size) {
+                buffer->release();
+                buffer = NULL;
+            }
+        }
+    }
+
+    if (buffer == NULL) {
+        buffer = new MediaBuffer(size);
+    } else {
+        buffer->meta_data()->clear();
+    }
+    buffer->set_range(0, size);
+    buffer->add_ref(); // Released by the reader, see signalBufferReturned().
+    return buffer;
 }
 
 status_t MediaAdapter::read(
@@ -82,22 +156,22 @@ status_t MediaAdapter::read(
         return ERROR_END_OF_STREAM;
     }
 
-    while (mCurrentMediaBuffer == NULL && mStarted) {
+    while (mQueuedBuffers.empty() && mStarted && !mStopping) {
         ALOGV("waiting @ read()");
         mBufferReadCond.wait(mAdapterLock);
     }
 
-    if (!mStarted) {
+    if (mQueuedBuffers.empty()) {
         ALOGV("read interrupted after stop");
-        CHECK(mCurrentMediaBuffer == NULL);
         return ERROR_END_OF_STREAM;
     }
 
-    CHECK(mCurrentMediaBuffer != NULL);
-
-    *buffer = mCurrentMediaBuffer;
-    mCurrentMediaBuffer = NULL;
+    *buffer = *mQueuedBuffers.begin();
+    mQueuedBuffers.erase(mQueuedBuffers.begin());
     (*buffer)->setObserver(this);
+    if (mStopping) {
+        mBufferReturnedCond.broadcast();
+    }
 
     return OK;
 }
@@ -109,18 +183,34 @@ status_t MediaAdapter::pushBuffer(MediaBuffer *buffer) {
     }
 
     Mutex::Autolock autoLock(mAdapterLock);
-    if (!mStarted) {
-        ALOGE("pushBuffer called before start");
+    while (mStarted && !mStopping && mMaxQueuedBuffers > 0
+            && mNumPendingBuffers >= mMaxQueuedBuffers) {
+        mBufferReturnedCond.wait(mAdapterLock);
+    }
+
+    if (!mStarted || mStopping) {
+        ALOGE("pushBuffer called while not started");
+        if (mMaxQueuedBuffers > 0) {
+            // the buffer is ours either way
+            buffer->setObserver(this);
+            buffer->claim();
+            buffer->setObserver(0);
+            recycleBuffer_l(buffer);
+        }
         return INVALID_OPERATION;
     }
-    mCurrentMediaBuffer = buffer;
+    mQueuedBuffers.push_back(buffer);
+    ++mNumPendingBuffers;
     mBufferReadCond.signal();
 
-    ALOGV("wait for the buffer returned @ pushBuffer! %p", buffer);
-    mBufferReturnedCond.wait(mAdapterLock);
+    if (mMaxQueuedBuffers == 0) {
+        ALOGV("wait for the buffer returned @ pushBuffer! %p", buffer);
+        while (mStarted && mNumPendingBuffers > 0) {
+            mBufferReturnedCond.wait(mAdapterLock);
+        }
+    }
 
     return OK;
 }
 
 }  // namespace android
-
@@ -18,6 +18,7 @@
 #include <utils/Log.h>
 
 #include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/MediaBuffer.h>
 #include <media/stagefright/MediaBufferGroup.h>
 
@@ -25,7 +26,10 @@ namespace android {
 
 MediaBufferGroup::MediaBufferGroup()
     : mFirstBuffer(NULL),
-      mLastBuffer(NULL) {
+      mLastBuffer(NULL),
+      mNumBuffers(0),
+      mMaxBuffers(0),
+      mGrowthBufferSize(0) {
 }
 
 MediaBufferGroup::~MediaBufferGroup() {
@@ -44,6 +48,10 @@ MediaBufferGroup::~MediaBufferGroup() {
 void MediaBufferGroup::add_buffer(MediaBuffer *buffer) {
     Mutex::Autolock autoLock(mLock);
 
+    addBufferLocked(buffer);
+}
+
+void MediaBufferGroup::addBufferLocked(MediaBuffer *buffer) {
     buffer->setObserver(this);
 
     if (mLastBuffer) {
@@ -53,6 +61,38 @@ void MediaBufferGroup::add_buffer(MediaBuffer *buffer) {
     }
 
     mLastBuffer = buffer;
+    ++mNumBuffers;
+
+    if (buffer->refcount() == 0) {
+        mFreeBuffers.push(buffer);
+    }
+}
+
+void MediaBufferGroup::setGrowthLimit(size_t maxBuffers, size_t bufferSize) {
+    Mutex::Autolock autoLock(mLock);
+
+    mMaxBuffers = maxBuffers;
+    mGrowthBufferSize = bufferSize;
+}
+
+MediaBuffer *MediaBufferGroup::takeFreeBufferLocked() {
+    if (mFreeBuffers.isEmpty()) {
+        if (mNumBuffers >= mMaxBuffers) {
+            return NULL;
+        }
+
+        ALOGV("growing group %p to %zu buffers", this, mNumBuffers + 1);
+        addBufferLocked(new MediaBuffer(mGrowthBufferSize));
+    }
+
+    MediaBuffer *buffer = mFreeBuffers.top();
+    mFreeBuffers.pop();
+
+    CHECK_EQ(buffer->refcount(), 0);
+    buffer->add_ref();
+    buffer->reset();
+
+    return buffer;
 }
 
 #ifdef ADD_LEGACY_ACQUIRE_BUFFER_SYMBOL
@@ -67,15 +107,10 @@ status_t MediaBufferGroup::acquire_buffer(
     Mutex::Autolock autoLock(mLock);
 
     for (;;) {
-        for (MediaBuffer *buffer = mFirstBuffer;
-             buffer != NULL; buffer = buffer->nextBuffer()) {
-            if (buffer->refcount() == 0) {
-                buffer->add_ref();
-                buffer->reset();
-
-                *out = buffer;
-                goto exit;
-            }
+        MediaBuffer *buffer = takeFreeBufferLocked();
+        if (buffer != NULL) {
+            *out = buffer;
+            return OK;
         }
 
         if (nonBlocking) {
@@ -86,13 +121,41 @@ status_t MediaBufferGroup::acquire_buffer(
         // All buffers are in use. Block until one of them is returned to us.
         mCondition.wait(mLock);
     }
+}
+
+void MediaBufferGroup::acquire_buffer_async(const sp<AMessage> &notify) {
+    Mutex::Autolock autoLock(mLock);
+
+    MediaBuffer *buffer = NULL;
+    if (mPendingNotifies.empty()) {
+        buffer = takeFreeBufferLocked();
+    }
 
-exit:
-    return OK;
+    if (buffer == NULL) {
+        mPendingNotifies.push_back(notify);
+        return;
+    }
+
+    sp<AMessage> msg = notify->dup();
+    msg->setPointer("buffer", buffer);
+    msg->post();
 }
 
-void MediaBufferGroup::signalBufferReturned(MediaBuffer *) {
+void MediaBufferGroup::signalBufferReturned(MediaBuffer *buffer) {
     Mutex::Autolock autoLock(mLock);
+
+    mFreeBuffers.push(buffer);
+
+    if (!mPendingNotifies.empty()) {
+        // asynchronous requests are served first, in order
+        sp<AMessage> msg = (*mPendingNotifies.begin())->dup();
+        mPendingNotifies.erase(mPendingNotifies.begin());
+
+        msg->setPointer("buffer", takeFreeBufferLocked());
+        msg->post();
+        return;
+    }
+
     mCondition.signal();
 }
 
@@ -22,11 +22,13 @@
 #include "include/SoftwareRenderer.h"
 
 #include <binder/IBatteryStats.h>
+#include <binder/MemoryDealer.h>
 #include <binder/IServiceManager.h>
 #include <gui/Surface.h>
 #include <media/ICrypto.h>
 #include <media/stagefright/foundation/ABuffer.h>
 #include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
 #include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/foundation/AString.h>
 #include <media/stagefright/foundation/hexdump.h>
@@ -535,6 +537,20 @@ status_t MediaCodec::getName(AString *name) const {
     return OK;
 }
 
+status_t MediaCodec::getMetrics(sp<AMessage> *metrics) const {
+    sp<AMessage> msg = new AMessage(kWhatGetMetrics, id());
+
+    sp<AMessage> response;
+    status_t err;
+    if ((err = PostAndAwaitResponse(msg, &response)) != OK) {
+        return err;
+    }
+
+    CHECK(response->findMessage("metrics", metrics));
+
+    return OK;
+}
+
 status_t MediaCodec::getInputBuffers(Vector<sp<ABuffer> > *buffers) const {
     sp<AMessage> msg = new AMessage(kWhatGetBuffers, id());
     msg->setInt32("portIndex", kPortIndexInput);
@@ -712,6 +728,11 @@ bool MediaCodec::handleDequeueOutputBuffer(uint32_t replyID, bool newRequest) {
         if (omxFlags & OMX_BUFFERFLAG_EOS) {
             flags |= BUFFER_FLAG_EOS;
         }
+        if ((mFlags & kFlagOutputPartialFrames)
+                && !(omxFlags & (OMX_BUFFERFLAG_ENDOFFRAME
+                        | OMX_BUFFERFLAG_CODECCONFIG | OMX_BUFFERFLAG_EOS))) {
+            flags |= BUFFER_FLAG_PARTIAL_FRAME;
+        }
         if (omxFlags & OMX_BUFFERFLAG_EXTRADATA) {
             flags |= BUFFER_FLAG_EXTRADATA;
         }
@@ -959,15 +980,33 @@ void MediaCodec::onMessageReceived(const sp<AMessage> &msg) {
 
                     size_t numBuffers = portDesc->countBuffers();
 
+                    if (portIndex == kPortIndexInput && mCrypto != NULL) {
+                        // the dealer rounds each allocation up to 32 bytes
+                        size_t totalSize = 0;
+                        for (size_t i = 0; i < numBuffers; ++i) {
+                            totalSize += (portDesc->bufferAt(i)->capacity() + 31) & ~31;
+                        }
+                        mDealer = new MemoryDealer(totalSize, "MediaCodec");
+                    }
+
                     for (size_t i = 0; i < numBuffers; ++i) {
                         BufferInfo info;
                         info.mBufferID = portDesc->bufferIDAt(i);
                         info.mOwnedByClient = false;
+                        info.mAvailableTimeUs = 0;
+                        info.mDequeuedTimeUs = 0;
                         info.mData = portDesc->bufferAt(i);
 
                         if (portIndex == kPortIndexInput && mCrypto != NULL) {
-                            info.mEncryptedData =
-                                new ABuffer(info.mData->capacity());
+                            sp<IMemory> mem = mDealer->allocate(info.mData->capacity());
+                            if (mem != NULL && mem->pointer() != NULL) {
+                                info.mSharedEncryptedBuffer = mem;
+                                info.mEncryptedData =
+                                    new ABuffer(mem->pointer(), info.mData->capacity());
+                            } else {
+                                info.mEncryptedData =
+                                    new ABuffer(info.mData->capacity());
+                            }
                         }
 
                         buffers->push_back(info);
@@ -1089,6 +1128,13 @@ void MediaCodec::onMessageReceived(const sp<AMessage> &msg) {
 
                     buffer->meta()->setInt32("omxFlags", omxFlags);
 
+                    int64_t timeUs;
+                    if (!(omxFlags & OMX_BUFFERFLAG_CODECCONFIG)
+                            && buffer->meta()->findInt64("timeUs", &timeUs)) {
+                        onFrameDecoded(
+                                timeUs, omxFlags & OMX_BUFFERFLAG_SYNCFRAME);
+                    }
+
                     if (mFlags & kFlagGatherCodecSpecificData) {
                         // This is the very first output buffer after a
                         // format change was signalled, it'll either contain
@@ -1291,6 +1337,12 @@ void MediaCodec::onMessageReceived(const sp<AMessage> &msg) {
             if (flags & CONFIGURE_FLAG_ENCODE) {
                 format->setInt32("encoder", true);
                 mFlags |= kFlagIsEncoder;
+
+                int32_t partialFrames;
+                if (format->findInt32("output-partial-frames", &partialFrames)
+                        && partialFrames) {
+                    mFlags |= kFlagOutputPartialFrames;
+                }
             }
 
             extractCSD(format);
@@ -1669,6 +1721,25 @@ void MediaCodec::onMessageReceived(const sp<AMessage> &msg) {
             break;
         }
 
+        case kWhatGetMetrics:
+        {
+            uint32_t replyID;
+            CHECK(msg->senderAwaitsResponse(&replyID));
+
+            sp<AMessage> metrics = new AMessage;
+            mInputWait.addTo(metrics, "input-wait");
+            mInputHold.addTo(metrics, "input-hold");
+            mSyncFrameLatency.addTo(metrics, "sync-frame-latency");
+            mFrameLatency.addTo(metrics, "frame-latency");
+            mOutputWait.addTo(metrics, "output-wait");
+            mOutputHold.addTo(metrics, "output-hold");
+
+            sp<AMessage> response = new AMessage;
+            response->setMessage("metrics", metrics);
+            response->postReply(replyID);
+            break;
+        }
+
         case kWhatSetParameters:
         {
             uint32_t replyID;
@@ -1754,6 +1825,7 @@ void MediaCodec::setState(State newState) {
         mSoftRenderer = NULL;
 
         mCrypto.clear();
+        mDealer.clear();
         setNativeWindow(NULL);
 
         mInputFormat.clear();
@@ -1762,6 +1834,7 @@ void MediaCodec::setState(State newState) {
         mFlags &= ~kFlagOutputBuffersChanged;
         mFlags &= ~kFlagStickyError;
         mFlags &= ~kFlagIsEncoder;
+        mFlags &= ~kFlagOutputPartialFrames;
         mFlags &= ~kFlagGatherCodecSpecificData;
         mFlags &= ~kFlagIsAsync;
         mStickyError = OK;
@@ -1815,6 +1888,10 @@ void MediaCodec::returnBuffersToCodecOnPort(int32_t portIndex) {
     }
 
     mAvailPortBuffers[portIndex].clear();
+
+    if (portIndex == kPortIndexInput) {
+        mPendingFrames.clear();
+    }
 }
 
 size_t MediaCodec::updateBuffers(
@@ -1835,6 +1912,7 @@ size_t MediaCodec::updateBuffers(
 
             info->mFormat =
                 (portIndex == kPortIndexInput) ? mInputFormat : mOutputFormat;
+            info->mAvailableTimeUs = ALooper::GetNowUs();
             mAvailPortBuffers[portIndex].push_back(i);
 
             return i;
@@ -1933,16 +2011,31 @@ status_t MediaCodec::onQueueInputBuffer(const sp<AMessage> &msg) {
         AString *errorDetailMsg;
         CHECK(msg->findPointer("errorDetailMsg", (void **)&errorDetailMsg));
 
-        ssize_t result = mCrypto->decrypt(
-                (mFlags & kFlagIsSecure) != 0,
-                key,
-                iv,
-                mode,
-                info->mEncryptedData->base() + offset,
-                subSamples,
-                numSubSamples,
-                info->mData->base(),
-                errorDetailMsg);
+        ssize_t result;
+        if (info->mSharedEncryptedBuffer != NULL) {
+            result = mCrypto->decrypt(
+                    (mFlags & kFlagIsSecure) != 0,
+                    key,
+                    iv,
+                    mode,
+                    info->mSharedEncryptedBuffer,
+                    offset,
+                    subSamples,
+                    numSubSamples,
+                    info->mData->base(),
+                    errorDetailMsg);
+        } else {
+            result = mCrypto->decrypt(
+                    (mFlags & kFlagIsSecure) != 0,
+                    key,
+                    iv,
+                    mode,
+                    info->mEncryptedData->base() + offset,
+                    subSamples,
+                    numSubSamples,
+                    info->mData->base(),
+                    errorDetailMsg);
+        }
 
         if (result < 0) {
             return result;
@@ -1961,6 +2054,12 @@ status_t MediaCodec::onQueueInputBuffer(const sp<AMessage> &msg) {
 
     info->mNotify = NULL;
 
+    int64_t nowUs = ALooper::GetNowUs();
+    mInputHold.add(nowUs - info->mDequeuedTimeUs);
+    if (!(flags & BUFFER_FLAG_CODECCONFIG) && info->mData->size() > 0) {
+        onFrameQueued(timeUs, flags & BUFFER_FLAG_SYNCFRAME);
+    }
+
     return OK;
 }
 
@@ -2022,6 +2121,8 @@ status_t MediaCodec::onReleaseOutputBuffer(const sp<AMessage> &msg) {
     info->mNotify->post();
     info->mNotify = NULL;
 
+    mOutputHold.add(ALooper::GetNowUs() - info->mDequeuedTimeUs);
+
     return OK;
 }
 
@@ -2039,6 +2140,12 @@ ssize_t MediaCodec::dequeuePortBuffer(int32_t portIndex) {
 
     BufferInfo *info = &mPortBuffers[portIndex].editItemAt(index);
     CHECK(!info->mOwnedByClient);
+
+    info->mDequeuedTimeUs = ALooper::GetNowUs();
+    LatencyHistogram *wait =
+        (portIndex == kPortIndexInput) ? &mInputWait : &mOutputWait;
+    wait->add(info->mDequeuedTimeUs - info->mAvailableTimeUs);
+
     {
         Mutex::Autolock al(mBufferLock);
         info->mOwnedByClient = true;
@@ -2131,6 +2238,11 @@ void MediaCodec::onOutputBufferAvailable() {
         if (omxFlags & OMX_BUFFERFLAG_EOS) {
             flags |= BUFFER_FLAG_EOS;
         }
+        if ((mFlags & kFlagOutputPartialFrames)
+                && !(omxFlags & (OMX_BUFFERFLAG_ENDOFFRAME
+                        | OMX_BUFFERFLAG_CODECCONFIG | OMX_BUFFERFLAG_EOS))) {
+            flags |= BUFFER_FLAG_PARTIAL_FRAME;
+        }
 
         msg->setInt32("flags", flags);
 
@@ -2276,4 +2388,92 @@ void MediaCodec::updateBatteryStat() {
     }
 }
 
+void MediaCodec::onFrameQueued(int64_t timeUs, bool isSync) {
+    if (mPendingFrames.size() >= kMaxPendingFrames) {
+        mPendingFrames.removeItemsAt(0);
+    }
+
+    PendingFrame frame;
+    frame.mQueuedTimeUs = ALooper::GetNowUs();
+    frame.mIsSync = isSync;
+    mPendingFrames.add(timeUs, frame);
+}
+
+void MediaCodec::onFrameDecoded(int64_t timeUs, bool isSync) {
+    ssize_t index = mPendingFrames.indexOfKey(timeUs);
+    if (index < 0) {
+        return;
+    }
+
+    // Decoders learn the frame type from the client, encoders decide it.
+    const PendingFrame &frame = mPendingFrames.valueAt(index);
+    LatencyHistogram *latency = (frame.mIsSync || isSync)
+            ? &mSyncFrameLatency : &mFrameLatency;
+    latency->add(ALooper::GetNowUs() - frame.mQueuedTimeUs);
+
+    mPendingFrames.removeItemsAt(index);
+}
+
+MediaCodec::LatencyHistogram::LatencyHistogram()
+    : mCount(0),
+      mSumUs(0),
+      mMaxUs(0) {
+    memset(mBuckets, 0, sizeof(mBuckets));
+}
+
+void MediaCodec::LatencyHistogram::add(int64_t latencyUs) {
+    if (latencyUs < 0) {
+        latencyUs = 0;
+    }
+
+    // bucket i holds [2^i, 2^(i+1)) us, bucket 0 holds [0, 2) us
+    size_t bucket = latencyUs < 2 ? 0 : 63 - __builtin_clzll(latencyUs);
+    if (bucket >= kNumBuckets) {
+        bucket = kNumBuckets - 1;
+    }
+
+    ++mBuckets[bucket];
+    ++mCount;
+    mSumUs += latencyUs;
+    if (latencyUs > mMaxUs) {
+        mMaxUs = latencyUs;
+    }
+}
+
+int64_t MediaCodec::LatencyHistogram::percentileUs(int percent) const {
+    if (mCount == 0) {
+        return 0;
+    }
+
+    int64_t rank = (mCount * percent + 99) / 100;
+    if (rank < 1) {
+        rank = 1;
+    }
+
+    // interpolate within the bucket the rank falls into
+    int64_t below = 0;
+    for (size_t i = 0; i < kNumBuckets; ++i) {
+        if (below + mBuckets[i] >= rank) {
+            int64_t lowUs = (i == 0) ? 0 : 1ll << i;
+            int64_t highUs = (i == kNumBuckets - 1) ? mMaxUs : 2ll << i;
+            int64_t us = lowUs + (highUs - lowUs) * (rank - below) / mBuckets[i];
+            return us < mMaxUs ? us : mMaxUs;
+        }
+        below += mBuckets[i];
+    }
+
+    return mMaxUs;
+}
+
+void MediaCodec::LatencyHistogram::addTo(
+        const sp<AMessage> &metrics, const char *name) const {
+    metrics->setInt64(StringPrintf("%s-count", name).c_str(), mCount);
+    metrics->setInt64(StringPrintf("%s-mean-us", name).c_str(),
+            mCount == 0 ? 0 : mSumUs / mCount);
+    metrics->setInt64(StringPrintf("%s-p50-us", name).c_str(), percentileUs(50));
+    metrics->setInt64(StringPrintf("%s-p90-us", name).c_str(), percentileUs(90));
+    metrics->setInt64(StringPrintf("%s-p99-us", name).c_str(), percentileUs(99));
+    metrics->setInt64(StringPrintf("%s-max-us", name).c_str(), mMaxUs);
+}
+
 }  // namespace android
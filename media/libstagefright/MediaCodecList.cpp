@@ -36,8 +36,38 @@
 
 #include <libexpat/expat.h>
 
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 namespace android {
 
+// The parsed list, so that startup does not have to parse the xml and query
+// every component again. Only mediaserver can write it.
+static const char *kCacheFile = "/data/misc/media/media_codecs.cache";
+static const int32_t kCacheVersion = 1;
+static const size_t kMaxCacheSize = 1024 * 1024;
+
+// FNV-1a, to tell a cache that was cut short or damaged
+static uint32_t CacheChecksum(const uint8_t *data, size_t size) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static bool GetFileStamp(const char *path, int64_t *mtime, int64_t *size) {
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return false;
+    }
+    *mtime = st.st_mtime;
+    *size = st.st_size;
+    return true;
+}
+
 static Mutex sInitMutex;
 
 static MediaCodecList *gCodecList = NULL;
@@ -85,7 +115,154 @@ sp<IMediaCodecList> MediaCodecList::getInstance() {
 
 MediaCodecList::MediaCodecList()
     : mInitCheck(NO_INIT) {
-    parseTopLevelXMLFile("/etc/media_codecs.xml");
+    if (readCache(kCacheFile)) {
+        mInitCheck = OK;
+    } else {
+        parseTopLevelXMLFile("/etc/media_codecs.xml");
+        if (mInitCheck == OK) {
+            writeCache(kCacheFile);
+        }
+    }
+    buildTypeIndex();
+}
+
+bool MediaCodecList::readCache(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    // a checksum and the parcel it covers
+    struct stat st;
+    uint8_t *data = NULL;
+    size_t size = 0;
+    uint32_t header[2];
+    if (fstat(fd, &st) == 0
+            && st.st_size > (off_t)sizeof(header)
+            && st.st_size <= (off_t)kMaxCacheSize
+            && read(fd, header, sizeof(header)) == (ssize_t)sizeof(header)) {
+        size = st.st_size - sizeof(header);
+        data = new uint8_t[size];
+        if (read(fd, data, size) != (ssize_t)size
+                || header[0] != size
+                || header[1] != CacheChecksum(data, size)) {
+            delete[] data;
+            data = NULL;
+        }
+    }
+    close(fd);
+
+    if (data == NULL) {
+        ALOGW("ignoring malformed %s", path);
+        return false;
+    }
+
+    Parcel parcel;
+    parcel.setData(data, size);
+    delete[] data;
+
+    char fingerprint[PROPERTY_VALUE_MAX];
+    property_get("ro.build.fingerprint", fingerprint, "");
+    const char *cachedFingerprint;
+    if (parcel.readInt32() != kCacheVersion
+            || (cachedFingerprint = parcel.readCString()) == NULL
+            || strcmp(cachedFingerprint, fingerprint)) {
+        return false;
+    }
+
+    size_t numFiles = parcel.readInt32();
+    for (size_t i = 0; i < numFiles; ++i) {
+        AString file = AString::FromParcel(parcel);
+        int64_t mtime = parcel.readInt64();
+        int64_t fileSize = parcel.readInt64();
+
+        int64_t currentMtime, currentSize;
+        if (!GetFileStamp(file.c_str(), &currentMtime, &currentSize)
+                || currentMtime != mtime || currentSize != fileSize) {
+            ALOGV("%s changed, not using %s", file.c_str(), path);
+            return false;
+        }
+    }
+
+    size_t numCodecs = parcel.readInt32();
+    if (numCodecs == 0 || numCodecs > parcel.dataAvail()) {
+        return false;
+    }
+    for (size_t i = 0; i < numCodecs; ++i) {
+        mCodecInfos.push_back(MediaCodecInfo::FromParcel(parcel));
+    }
+
+    ALOGV("read %zu codecs from %s", numCodecs, path);
+    return true;
+}
+
+void MediaCodecList::writeCache(const char *path) const {
+    Parcel parcel;
+    parcel.writeInt32(kCacheVersion);
+
+    char fingerprint[PROPERTY_VALUE_MAX];
+    property_get("ro.build.fingerprint", fingerprint, "");
+    parcel.writeCString(fingerprint);
+
+    parcel.writeInt32(mParsedFiles.size());
+    for (size_t i = 0; i < mParsedFiles.size(); ++i) {
+        int64_t mtime, size;
+        if (!GetFileStamp(mParsedFiles[i].c_str(), &mtime, &size)) {
+            return;
+        }
+        mParsedFiles[i].writeToParcel(&parcel);
+        parcel.writeInt64(mtime);
+        parcel.writeInt64(size);
+    }
+
+    parcel.writeInt32(mCodecInfos.size());
+    for (size_t i = 0; i < mCodecInfos.size(); ++i) {
+        mCodecInfos[i]->writeToParcel(&parcel);
+    }
+
+    if (parcel.dataSize() > kMaxCacheSize) {
+        return;
+    }
+
+    // readers only ever see a complete file
+    AString tmpPath = path;
+    tmpPath.append(".tmp");
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        ALOGV("cannot write %s (%s)", tmpPath.c_str(), strerror(errno));
+        return;
+    }
+
+    uint32_t header[2] = {
+        (uint32_t)parcel.dataSize(),
+        CacheChecksum(parcel.data(), parcel.dataSize()),
+    };
+    bool written = write(fd, header, sizeof(header)) == (ssize_t)sizeof(header)
+            && write(fd, parcel.data(), parcel.dataSize())
+                    == (ssize_t)parcel.dataSize();
+    close(fd);
+
+    if (!written || rename(tmpPath.c_str(), path) != 0) {
+        ALOGW("failed to write %s", path);
+        unlink(tmpPath.c_str());
+    }
+}
+
+void MediaCodecList::buildTypeIndex() {
+    mTypeIndex.clear();
+    for (size_t i = 0; i < mCodecInfos.size(); ++i) {
+        const MediaCodecInfo &info = *mCodecInfos.itemAt(i).get();
+        for (size_t j = 0; j < info.mCaps.size(); ++j) {
+            AString type = info.mCaps.keyAt(j);
+            type.tolower();
+
+            ssize_t index = mTypeIndex.indexOfKey(type);
+            if (index < 0) {
+                index = mTypeIndex.add(type, Vector<size_t>());
+            }
+            mTypeIndex.editValueAt(index).push_back(i);
+        }
+    }
 }
 
 void MediaCodecList::parseTopLevelXMLFile(const char *codecs_xml) {
@@ -200,6 +377,8 @@ void MediaCodecList::parseXMLFile(const char *path) {
         return;
     }
 
+    mParsedFiles.push_back(AString(path));
+
     XML_Parser parser = ::XML_ParserCreate(NULL);
     CHECK(parser != NULL);
 
@@ -596,9 +775,20 @@ ssize_t MediaCodecList::findCodecByType(
         "feature-tunneled-playback",
     };
 
-    size_t numCodecs = mCodecInfos.size();
-    for (; startIndex < numCodecs; ++startIndex) {
-        const MediaCodecInfo &info = *mCodecInfos.itemAt(startIndex).get();
+    AString key = type;
+    key.tolower();
+    ssize_t typeIndex = mTypeIndex.indexOfKey(key);
+    if (typeIndex < 0) {
+        return -ENOENT;
+    }
+
+    const Vector<size_t> &codecs = mTypeIndex.valueAt(typeIndex);
+    for (size_t i = 0; i < codecs.size(); ++i) {
+        size_t index = codecs[i];
+        if (index < startIndex) {
+            continue;
+        }
+        const MediaCodecInfo &info = *mCodecInfos.itemAt(index).get();
 
         if (info.isEncoder() != encoder) {
             continue;
@@ -620,7 +810,7 @@ ssize_t MediaCodecList::findCodecByType(
         }
 
         if (!isAdvanced) {
-            return startIndex;
+            return index;
         }
     }
 
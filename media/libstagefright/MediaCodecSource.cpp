@@ -334,6 +334,17 @@ status_t MediaCodecSource::read(
 }
 
 void MediaCodecSource::signalBufferReturned(MediaBuffer *buffer) {
+    {
+        Mutex::Autolock autoLock(mHeldOutputBufferLock);
+        ssize_t i = mHeldOutputBuffers.indexOfKey(buffer);
+        if (i >= 0) {
+            // The encoder may only get the buffer back on the looper
+            sp<AMessage> msg = new AMessage(kWhatReleaseOutputBuffer, mReflector->id());
+            msg->setSize("index", mHeldOutputBuffers.valueAt(i));
+            msg->post();
+            mHeldOutputBuffers.removeItemsAt(i);
+        }
+    }
     buffer->setObserver(0);
     buffer->release();
 }
@@ -353,7 +364,10 @@ MediaCodecSource::MediaCodecSource(
       mDoMoreWorkPending(false),
       mFirstSampleTimeUs(-1ll),
       mEncoderReachedEOS(false),
-      mErrorCode(OK) {
+      mErrorCode(OK),
+      mNumOutputBuffersHeld(0),
+      mNumEncoderOutputBuffers(0),
+      mReleaseEncoderPending(false) {
     CHECK(mLooper != NULL);
 
     AString mime;
@@ -404,6 +418,8 @@ MediaCodecSource::MediaCodecSource(
 }
 
 MediaCodecSource::~MediaCodecSource() {
+    // Whoever read the buffers is done with them by now
+    mNumOutputBuffersHeld = 0;
     releaseEncoder();
 
     mCodecLooper->stop();
@@ -512,9 +528,6 @@ void MediaCodecSource::releaseEncoder() {
         return;
     }
 
-    mEncoder->release();
-    mEncoder.clear();
-
     while (!mInputBufferQueue.empty()) {
         MediaBuffer *mbuf = *mInputBufferQueue.begin();
         mInputBufferQueue.erase(mInputBufferQueue.begin());
@@ -522,6 +535,29 @@ void MediaCodecSource::releaseEncoder() {
             mbuf->release();
         }
     }
+
+    if (mNumOutputBuffersHeld > 0) {
+        // The encoder owns the memory of the buffers still out there
+        ALOGV("encoder (%s) release deferred, %zu output buffers held",
+                mIsVideo ? "video" : "audio", mNumOutputBuffersHeld);
+        mReleaseEncoderPending = true;
+        return;
+    }
+    mReleaseEncoderPending = false;
+
+    mEncoder->release();
+    mEncoder.clear();
+}
+
+void MediaCodecSource::onReleaseOutputBuffer(size_t index) {
+    CHECK_GT(mNumOutputBuffersHeld, 0u);
+    --mNumOutputBuffersHeld;
+    if (mEncoder != NULL) {
+        mEncoder->releaseOutputBuffer(index);
+    }
+    if (mReleaseEncoderPending && mNumOutputBuffersHeld == 0) {
+        releaseEncoder();
+    }
 }
 
 status_t MediaCodecSource::postSynchronouslyAndReturnError(
@@ -719,7 +755,7 @@ void MediaCodecSource::onMessageReceived(const sp<AMessage> &msg) {
             signalEOS();
         }
 
-        if (mEncoder == NULL) {
+        if (mEncoder == NULL || mReleaseEncoderPending) {
             ALOGV("got msg '%s' after encoder shutdown.",
                   msg->debugString().c_str());
 
@@ -764,7 +800,8 @@ void MediaCodecSource::onMessageReceived(const sp<AMessage> &msg) {
             CHECK(msg->findInt64("timeUs", &timeUs));
             CHECK(msg->findInt32("flags", &flags));
 
-            if (flags & MediaCodec::BUFFER_FLAG_EOS) {
+            if ((flags & MediaCodec::BUFFER_FLAG_EOS) || mReleaseEncoderPending) {
+                // Nobody reads the output of an encoder about to be released
                 mEncoder->releaseOutputBuffer(index);
                 signalEOS();
                 break;
@@ -777,8 +814,25 @@ void MediaCodecSource::onMessageReceived(const sp<AMessage> &msg) {
                     break;
             }
 
-            MediaBuffer *mbuf = new MediaBuffer(outbuf->size());
-            memcpy(mbuf->data(), outbuf->data(), outbuf->size());
+            if ((size_t)index >= mNumEncoderOutputBuffers) {
+                mNumEncoderOutputBuffers = index + 1;
+            }
+
+            // Hand the encoder's buffer itself to the reader, as long as the
+            // encoder keeps at least half of its output buffers to work with.
+            // Past that, or for codec config data which the reader keeps for
+            // the whole session, fall back to a copy.
+            bool holdBuffer = !(flags & MediaCodec::BUFFER_FLAG_CODECCONFIG) &&
+                    (mNumOutputBuffersHeld + 1) * 2 <= mNumEncoderOutputBuffers;
+            MediaBuffer *mbuf;
+            if (holdBuffer) {
+                mbuf = new MediaBuffer(outbuf);
+            } else {
+                mbuf = new MediaBuffer(outbuf->size());
+                memcpy(mbuf->data(), outbuf->data(), outbuf->size());
+            }
+            // Either way the buffer is ours, the reader need not copy it again
+            mbuf->meta_data()->setInt32(kKeyCanDeferRelease, true);
 
             if (!(flags & MediaCodec::BUFFER_FLAG_CODECCONFIG)) {
                 if (mIsVideo) {
@@ -822,13 +876,21 @@ void MediaCodecSource::onMessageReceived(const sp<AMessage> &msg) {
             mbuf->setObserver(this);
             mbuf->add_ref();
 
+            if (holdBuffer) {
+                Mutex::Autolock autoLock(mHeldOutputBufferLock);
+                mHeldOutputBuffers.add(mbuf, index);
+                ++mNumOutputBuffersHeld;
+            }
+
             {
                 Mutex::Autolock autoLock(mOutputBufferLock);
                 mOutputBufferQueue.push_back(mbuf);
                 mOutputBufferCond.signal();
             }
 
-            mEncoder->releaseOutputBuffer(index);
+            if (!holdBuffer) {
+                mEncoder->releaseOutputBuffer(index);
+            }
         } else if (cbID == MediaCodec::CB_ERROR) {
             status_t err;
             CHECK(msg->findInt32("err", &err));
@@ -895,6 +957,13 @@ void MediaCodecSource::onMessageReceived(const sp<AMessage> &msg) {
         }
         break;
     }
+    case kWhatReleaseOutputBuffer:
+    {
+        size_t index;
+        CHECK(msg->findSize("index", &index));
+        onReleaseOutputBuffer(index);
+        break;
+    }
     default:
         TRESPASS();
     }
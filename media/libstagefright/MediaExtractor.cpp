@@ -55,7 +55,7 @@ uint32_t MediaExtractor::flags() const {
 
 // static
 sp<MediaExtractor> MediaExtractor::Create(
-        const sp<DataSource> &source, const char *mime) {
+        const sp<DataSource> &source, const char *mime, uint32_t createFlags) {
     sp<AMessage> meta;
 
     bool secondPass = false;
@@ -141,6 +141,9 @@ retry:
        } else {
            ret->setDrmFlag(false);
        }
+       if (createFlags & kMetaDataOnly) {
+           ret->setMetaDataOnly();
+       }
     }
 
 #ifdef QCOM_HARDWARE
@@ -19,6 +19,7 @@
 
 #include "webm/WebmWriter.h"
 
+#include <cutils/properties.h>
 #include <utils/Log.h>
 
 #include <media/stagefright/MediaMuxer.h>
@@ -38,8 +39,23 @@
 
 namespace android {
 
+// Samples of a track queued for the writer before writeSampleData() blocks.
+static const size_t kDefaultMaxQueuedSamples = 8;
+
+static size_t getMaxQueuedSamples() {
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("media.stagefright.muxer-queue", value, NULL)) {
+        int queued = atoi(value);
+        if (queued >= 0) {
+            return queued;
+        }
+    }
+    return kDefaultMaxQueuedSamples;
+}
+
 MediaMuxer::MediaMuxer(const char *path, OutputFormat format)
     : mFormat(format),
+      mMaxQueuedSamples(getMaxQueuedSamples()),
       mState(UNINITIALIZED) {
     if (format == OUTPUT_FORMAT_MPEG_4) {
         mWriter = new MPEG4Writer(path);
@@ -55,6 +71,7 @@ MediaMuxer::MediaMuxer(const char *path, OutputFormat format)
 
 MediaMuxer::MediaMuxer(int fd, OutputFormat format)
     : mFormat(format),
+      mMaxQueuedSamples(getMaxQueuedSamples()),
       mState(UNINITIALIZED) {
     if (format == OUTPUT_FORMAT_MPEG_4) {
         mWriter = new MPEG4Writer(fd);
@@ -93,7 +110,7 @@ ssize_t MediaMuxer::addTrack(const sp<AMessage> &format) {
     sp<MetaData> trackMeta = new MetaData;
     convertMessageToMetaData(format, trackMeta);
 
-    sp<MediaAdapter> newTrack = new MediaAdapter(trackMeta);
+    sp<MediaAdapter> newTrack = new MediaAdapter(trackMeta, mMaxQueuedSamples);
     status_t result = mWriter->addSource(newTrack);
     if (result == OK) {
         return mTrackList.add(newTrack);
@@ -132,6 +149,24 @@ status_t MediaMuxer::setLocation(int latitude, int longitude) {
     return static_cast<MPEG4Writer*>(mWriter.get())->setGeoData(latitude, longitude);
 }
 
+status_t MediaMuxer::setInterleaveWindow(int64_t windowUs) {
+    Mutex::Autolock autoLock(mMuxerLock);
+    if (mState != INITIALIZED) {
+        ALOGE("setInterleaveWindow() must be called before start().");
+        return INVALID_OPERATION;
+    }
+    if (mFormat != OUTPUT_FORMAT_MPEG_4) {
+        ALOGE("setInterleaveWindow() is only supported for .mp4 output.");
+        return INVALID_OPERATION;
+    }
+    if (windowUs < 0 || windowUs > 0xffffffffll) {
+        ALOGE("setInterleaveWindow() get invalid window %lld us", (long long)windowUs);
+        return -EINVAL;
+    }
+
+    return static_cast<MPEG4Writer*>(mWriter.get())->setInterleaveDuration(windowUs);
+}
+
 status_t MediaMuxer::start() {
     Mutex::Autolock autoLock(mMuxerLock);
     if (mState == INITIALIZED) {
@@ -163,27 +198,40 @@ status_t MediaMuxer::stop() {
 
 status_t MediaMuxer::writeSampleData(const sp<ABuffer> &buffer, size_t trackIndex,
                                      int64_t timeUs, uint32_t flags) {
-    Mutex::Autolock autoLock(mMuxerLock);
+    sp<MediaAdapter> currentTrack;
+    {
+        Mutex::Autolock autoLock(mMuxerLock);
 
-    if (buffer.get() == NULL) {
-        ALOGE("WriteSampleData() get an NULL buffer.");
-        return -EINVAL;
-    }
+        if (buffer.get() == NULL) {
+            ALOGE("WriteSampleData() get an NULL buffer.");
+            return -EINVAL;
+        }
 
-    if (mState != STARTED) {
-        ALOGE("WriteSampleData() is called in invalid state %d", mState);
-        return INVALID_OPERATION;
-    }
+        if (mState != STARTED) {
+            ALOGE("WriteSampleData() is called in invalid state %d", mState);
+            return INVALID_OPERATION;
+        }
 
-    if (trackIndex >= mTrackList.size()) {
-        ALOGE("WriteSampleData() get an invalid index %zu", trackIndex);
-        return -EINVAL;
+        if (trackIndex >= mTrackList.size()) {
+            ALOGE("WriteSampleData() get an invalid index %zu", trackIndex);
+            return -EINVAL;
+        }
+
+        currentTrack = mTrackList[trackIndex];
     }
 
-    MediaBuffer* mediaBuffer = new MediaBuffer(buffer);
+    // Not holding mMuxerLock from here on, a full queue only holds up the
+    // caller of this track.
+    MediaBuffer* mediaBuffer;
+    if (mMaxQueuedSamples > 0) {
+        mediaBuffer = currentTrack->acquireBuffer(buffer->size());
+        memcpy(mediaBuffer->data(), buffer->data(), buffer->size());
+    } else {
+        mediaBuffer = new MediaBuffer(buffer);
 
-    mediaBuffer->add_ref(); // Released in MediaAdapter::signalBufferReturned().
-    mediaBuffer->set_range(buffer->offset(), buffer->size());
+        mediaBuffer->add_ref(); // Released in MediaAdapter::signalBufferReturned().
+        mediaBuffer->set_range(buffer->offset(), buffer->size());
+    }
 
     sp<MetaData> sampleMetaData = mediaBuffer->meta_data();
     sampleMetaData->setInt64(kKeyTime, timeUs);
@@ -194,8 +242,8 @@ status_t MediaMuxer::writeSampleData(const sp<ABuffer> &buffer, size_t trackInde
         sampleMetaData->setInt32(kKeyIsSyncFrame, true);
     }
 
-    sp<MediaAdapter> currentTrack = mTrackList[trackIndex];
-    // This pushBuffer will wait until the mediaBuffer is consumed.
+    // This pushBuffer will wait until the mediaBuffer is consumed, or only
+    // for room in the track's queue.
     return currentTrack->pushBuffer(mediaBuffer);
 }
 
@@ -29,23 +29,58 @@
 
 namespace android {
 
-MetaData::MetaData() {
+MetaData::MetaData()
+    : mFixedItemsSet(0) {
 }
 
 MetaData::MetaData(const MetaData &from)
     : RefBase(),
+      mFixedItemsSet(from.mFixedItemsSet),
       mItems(from.mItems) {
+    for (size_t i = 0; i < kNumFixedItems; ++i) {
+        if (mFixedItemsSet & (1u << i)) {
+            mFixedItems[i] = from.mFixedItems[i];
+        }
+    }
 }
 
 MetaData::~MetaData() {
     clear();
 }
 
+// static
+ssize_t MetaData::FixedItemIndex(uint32_t key) {
+    switch (key) {
+        case kKeyTime:          return 0;
+        case kKeyIsSyncFrame:   return 1;
+        case kKeyDuration:      return 2;
+        case kKeyDecodingTime:  return 3;
+        default:                return -1;
+    }
+}
+
 void MetaData::clear() {
+    for (size_t i = 0; i < kNumFixedItems; ++i) {
+        mFixedItems[i].clear();
+    }
+    mFixedItemsSet = 0;
+
     mItems.clear();
 }
 
 bool MetaData::remove(uint32_t key) {
+    ssize_t fixed = FixedItemIndex(key);
+    if (fixed >= 0) {
+        if (!(mFixedItemsSet & (1u << fixed))) {
+            return false;
+        }
+
+        mFixedItems[fixed].clear();
+        mFixedItemsSet &= ~(1u << fixed);
+
+        return true;
+    }
+
     ssize_t i = mItems.indexOfKey(key);
 
     if (i < 0) {
@@ -190,6 +225,16 @@ bool MetaData::findRect(
 
 bool MetaData::setData(
         uint32_t key, uint32_t type, const void *data, size_t size) {
+    ssize_t fixed = FixedItemIndex(key);
+    if (fixed >= 0) {
+        bool overwrote_existing = (mFixedItemsSet & (1u << fixed)) != 0;
+
+        mFixedItems[fixed].setData(type, data, size);
+        mFixedItemsSet |= 1u << fixed;
+
+        return overwrote_existing;
+    }
+
     bool overwrote_existing = true;
 
     ssize_t i = mItems.indexOfKey(key);
@@ -209,6 +254,17 @@ bool MetaData::setData(
 
 bool MetaData::findData(uint32_t key, uint32_t *type,
                         const void **data, size_t *size) const {
+    ssize_t fixed = FixedItemIndex(key);
+    if (fixed >= 0) {
+        if (!(mFixedItemsSet & (1u << fixed))) {
+            return false;
+        }
+
+        mFixedItems[fixed].getData(type, data, size);
+
+        return true;
+    }
+
     ssize_t i = mItems.indexOfKey(key);
 
     if (i < 0) {
@@ -223,6 +279,11 @@ bool MetaData::findData(uint32_t key, uint32_t *type,
 }
 
 bool MetaData::hasData(uint32_t key) const {
+    ssize_t fixed = FixedItemIndex(key);
+    if (fixed >= 0) {
+        return (mFixedItemsSet & (1u << fixed)) != 0;
+    }
+
     ssize_t i = mItems.indexOfKey(key);
 
     if (i < 0) {
@@ -355,6 +416,17 @@ static void MakeFourCCString(uint32_t x, char *s) {
 }
 
 void MetaData::dumpToLog() const {
+    static const uint32_t kFixedKeys[kNumFixedItems] = {
+        kKeyTime, kKeyIsSyncFrame, kKeyDuration, kKeyDecodingTime,
+    };
+    for (size_t i = 0; i < kNumFixedItems; ++i) {
+        if (mFixedItemsSet & (1u << i)) {
+            char cc[5];
+            MakeFourCCString(kFixedKeys[i], cc);
+            ALOGI("%s: %s", cc, mFixedItems[i].asString().string());
+        }
+    }
+
     for (int i = mItems.size(); --i >= 0;) {
         int32_t key = mItems.keyAt(i);
         char cc[5];
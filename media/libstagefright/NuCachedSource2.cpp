@@ -45,6 +45,16 @@ struct PageCache {
     void appendPage(Page *page);
     size_t releaseFromStart(size_t maxBytes);
 
+    // Releases whole pages from the end until at least minBytes are gone.
+    size_t releaseFromEnd(size_t minBytes);
+
+    // Hands the memory of released pages back.
+    void freeReleasedPages();
+
+    // The last page if it isn't full yet, NULL otherwise.
+    Page *lastPageWithRoom();
+    void appendToLastPage(size_t size);
+
     size_t totalSize() const {
         return mTotalSize;
     }
@@ -136,6 +146,46 @@ size_t PageCache::releaseFromStart(size_t maxBytes) {
     return bytesReleased;
 }
 
+size_t PageCache::releaseFromEnd(size_t minBytes) {
+    size_t bytesReleased = 0;
+
+    while (bytesReleased < minBytes && !mActivePages.empty()) {
+        List<Page *>::iterator it = --mActivePages.end();
+
+        Page *page = *it;
+        mActivePages.erase(it);
+
+        bytesReleased += page->mSize;
+
+        releasePage(page);
+    }
+
+    mTotalSize -= bytesReleased;
+    return bytesReleased;
+}
+
+PageCache::Page *PageCache::lastPageWithRoom() {
+    if (mActivePages.empty()) {
+        return NULL;
+    }
+
+    Page *page = *--mActivePages.end();
+    return page->mSize < mPageSize ? page : NULL;
+}
+
+void PageCache::appendToLastPage(size_t size) {
+    Page *page = *--mActivePages.end();
+    CHECK_LE(page->mSize + size, mPageSize);
+
+    page->mSize += size;
+    mTotalSize += size;
+}
+
+void PageCache::freeReleasedPages() {
+    freePages(&mFreePages);
+    mFreePages.clear();
+}
+
 void PageCache::copy(size_t from, void *data, size_t size) {
     ALOGV("copy from %zu size %zu", from, size);
 
@@ -188,6 +238,9 @@ NuCachedSource2::NuCachedSource2(
       mLooper(new ALooper),
       mCache(new PageCache(kPageSize)),
       mCacheOffset(0),
+      mInactiveBytes(0),
+      mNumReads(0),
+      mNumCacheHits(0),
       mFinalStatus(OK),
       mLastAccessPos(0),
       mFetching(true),
@@ -198,6 +251,11 @@ NuCachedSource2::NuCachedSource2(
       mLowwaterThresholdBytes(kDefaultLowWaterThreshold),
       mKeepAliveIntervalUs(kDefaultKeepAliveIntervalUs),
       mDisconnectAtHighwatermark(disconnectAtHighwatermark),
+      mAdaptCacheParams(true),
+      mStreamBitrate(-1),
+      mBandwidthKbps(-1),
+      mLastAdaptTimeUs(-1),
+      mFetchSize(kPageSize),
       mSuspended(false) {
     // We are NOT going to support disconnect-at-highwatermark indefinitely
     // and we are not guaranteeing support for client-specified cache
@@ -236,6 +294,12 @@ NuCachedSource2::~NuCachedSource2() {
 
     delete mCache;
     mCache = NULL;
+
+    for (List<CachedRange>::iterator it = mInactiveRanges.begin();
+            it != mInactiveRanges.end(); ++it) {
+        delete (*it).mCache;
+    }
+    mInactiveRanges.clear();
 }
 
 status_t NuCachedSource2::getEstimatedBandwidthKbps(int32_t *kbps) {
@@ -275,6 +339,118 @@ status_t NuCachedSource2::setCacheStatCollectFreq(int32_t freqMs) {
     return ERROR_UNSUPPORTED;
 }
 
+status_t NuCachedSource2::getCacheHitRate(int32_t *percent) {
+    Mutex::Autolock autoLock(mLock);
+
+    if (mNumReads == 0) {
+        return NOT_ENOUGH_DATA;
+    }
+
+    *percent = (int32_t)(100ll * mNumCacheHits / mNumReads);
+
+    return OK;
+}
+
+void NuCachedSource2::setStreamBitrate(int64_t bitrate) {
+    Mutex::Autolock autoLock(mLock);
+    mStreamBitrate = bitrate;
+}
+
+status_t NuCachedSource2::getEstimatedUnderrunTimeUs(int64_t *timeUs) {
+    Mutex::Autolock autoLock(mLock);
+
+    if (mStreamBitrate <= 0 || mBandwidthKbps <= 0) {
+        return NOT_ENOUGH_DATA;
+    }
+
+    status_t finalStatus;
+    size_t remaining = approxDataRemaining_l(&finalStatus);
+
+    int64_t drainBitrate = mStreamBitrate;
+    if (finalStatus == OK) {
+        drainBitrate -= mBandwidthKbps * 1000ll;
+    }
+
+    if (drainBitrate <= 0) {
+        *timeUs = -1;
+    } else {
+        *timeUs = remaining * 8000000ll / drainBitrate;
+    }
+
+    return OK;
+}
+
+// Sizes the fetches and watermarks to what the network and the stream need:
+// the closer the bandwidth is to the bitrate, the more is buffered to ride
+// out a drop, the faster the network, the less is downloaded in vain.
+void NuCachedSource2::adaptCacheParams() {
+    int64_t nowUs = ALooper::GetNowUs();
+    if (mLastAdaptTimeUs >= 0 && nowUs < mLastAdaptTimeUs + kAdaptIntervalUs) {
+        return;
+    }
+    mLastAdaptTimeUs = nowUs;
+
+    int32_t kbps;
+    if (getEstimatedBandwidthKbps(&kbps) != OK || kbps <= 0) {
+        return;
+    }
+
+    Mutex::Autolock autoLock(mLock);
+    mBandwidthKbps = kbps;
+
+    // About a tenth of a second's worth.
+    size_t fetchSize = kbps * 1000ll / 8 / 10;
+    if (fetchSize < kMinFetchSize) {
+        fetchSize = kMinFetchSize;
+    } else if (fetchSize > kPageSize) {
+        fetchSize = kPageSize;
+    }
+    mFetchSize = fetchSize;
+
+    if (!mAdaptCacheParams || mStreamBitrate <= 0) {
+        return;
+    }
+
+    int64_t bandwidthPercent = kbps * 1000ll * 100 / mStreamBitrate;
+    int64_t lowwaterSecs;
+    if (bandwidthPercent >= 300) {
+        lowwaterSecs = 5;
+    } else if (bandwidthPercent >= 150) {
+        lowwaterSecs = 10;
+    } else {
+        lowwaterSecs = 20;
+    }
+
+    int64_t lowwater = mStreamBitrate / 8 * lowwaterSecs;
+    if (lowwater < kMinLowWaterThreshold) {
+        lowwater = kMinLowWaterThreshold;
+    } else if (lowwater > kDefaultLowWaterThreshold) {
+        lowwater = kDefaultLowWaterThreshold;
+    }
+
+    int64_t highwater = lowwater * 4;
+    if (highwater > kDefaultHighWaterThreshold) {
+        highwater = kDefaultHighWaterThreshold;
+    }
+
+    // Leave the watermarks alone unless they're off by more than a quarter,
+    // bandwidth estimates jitter.
+    int64_t lowDelta = lowwater - (int64_t)mLowwaterThresholdBytes;
+    int64_t highDelta = highwater - (int64_t)mHighwaterThresholdBytes;
+    if ((lowDelta < 0 ? -lowDelta : lowDelta) * 4 <= (int64_t)mLowwaterThresholdBytes
+            && (highDelta < 0 ? -highDelta : highDelta) * 4
+                <= (int64_t)mHighwaterThresholdBytes) {
+        return;
+    }
+
+    ALOGV("%d kbps for a %" PRId64 " bps stream, lowwater = %" PRId64
+         " bytes, highwater = %" PRId64 " bytes",
+         kbps, mStreamBitrate, lowwater, highwater);
+
+    mLowwaterThresholdBytes = lowwater;
+    mHighwaterThresholdBytes = highwater;
+}
+
 status_t NuCachedSource2::initCheck() const {
     return mSource->initCheck();
 }
@@ -347,10 +523,26 @@ void NuCachedSource2::fetchInternal() {
         }
     }
 
-    PageCache::Page *page = mCache->acquirePage();
+    size_t fetchSize;
+    {
+        Mutex::Autolock autoLock(mLock);
+        fetchSize = mFetchSize;
+    }
+
+    // Fill up the last page first if the fetches are smaller.
+    PageCache::Page *page = mCache->lastPageWithRoom();
+    bool partialPage = (page != NULL);
+    if (!partialPage) {
+        page = mCache->acquirePage();
+    }
+
+    if (fetchSize > kPageSize - page->mSize) {
+        fetchSize = kPageSize - page->mSize;
+    }
 
     ssize_t n = mSource->readAt(
-            mCacheOffset + mCache->totalSize(), page->mData, kPageSize);
+            mCacheOffset + mCache->totalSize(),
+            (uint8_t *)page->mData + page->mSize, fetchSize);
 
     Mutex::Autolock autoLock(mLock);
 
@@ -360,7 +552,9 @@ void NuCachedSource2::fetchInternal() {
         mNumRetriesLeft = 0;
         mFinalStatus = ERROR_END_OF_STREAM;
 
-        mCache->releasePage(page);
+        if (!partialPage) {
+            mCache->releasePage(page);
+        }
     } else if (n < 0) {
         mFinalStatus = n;
         if (n == ERROR_UNSUPPORTED || n == -EPIPE) {
@@ -370,7 +564,9 @@ void NuCachedSource2::fetchInternal() {
         }
 
         ALOGE("source returned error %zd, %d retries left", n, mNumRetriesLeft);
-        mCache->releasePage(page);
+        if (!partialPage) {
+            mCache->releasePage(page);
+        }
     } else {
         if (mFinalStatus != OK) {
             ALOGI("retrying a previously failed read succeeded.");
@@ -378,8 +574,12 @@ void NuCachedSource2::fetchInternal() {
         mNumRetriesLeft = kMaxNumRetries;
         mFinalStatus = OK;
 
-        page->mSize = n;
-        mCache->appendPage(page);
+        if (partialPage) {
+            mCache->appendToLastPage(n);
+        } else {
+            page->mSize = n;
+            mCache->appendPage(page);
+        }
     }
 }
 
@@ -402,6 +602,8 @@ void NuCachedSource2::onFetch() {
             ALOGI("Keep alive");
         }
 
+        adaptCacheParams();
+
         fetchInternal();
 
         mLastFetchTimeUs = ALooper::GetNowUs();
@@ -508,6 +710,28 @@ void NuCachedSource2::restartPrefetcherIfNecessary_l(
 }
 
 ssize_t NuCachedSource2::readAt(off64_t offset, void *data, size_t size) {
+    if (size > kMaxReadSize) {
+        size_t total = 0;
+        while (total < size) {
+            size_t n = size - total;
+            if (n > kMaxReadSize) {
+                n = kMaxReadSize;
+            }
+
+            ssize_t result = readAt(offset + total, (uint8_t *)data + total, n);
+            if (result < 0) {
+                return result;
+            }
+
+            total += result;
+            if ((size_t)result < n) {
+                break;
+            }
+        }
+
+        return total;
+    }
+
     Mutex::Autolock autoSerializer(mSerializer);
 
     ALOGV("readAt offset %lld, size %zu", offset, size);
@@ -517,6 +741,8 @@ ssize_t NuCachedSource2::readAt(off64_t offset, void *data, size_t size) {
         return ERROR_END_OF_STREAM;
     }
 
+    ++mNumReads;
+
     // If the request can be completely satisfied from the cache, do so.
 
     if (offset >= mCacheOffset
@@ -526,6 +752,12 @@ ssize_t NuCachedSource2::readAt(off64_t offset, void *data, size_t size) {
 
         mLastAccessPos = offset + size;
 
+        ++mNumCacheHits;
+        return size;
+    }
+
+    if (readFromInactiveRanges_l(offset, data, size)) {
+        ++mNumCacheHits;
         return size;
     }
 
@@ -590,7 +822,15 @@ ssize_t NuCachedSource2::readInternal(off64_t offset, void *data, size_t size) {
 
     Mutex::Autolock autoLock(mLock);
 
-    if (!mFetching) {
+    if ((offset < mCacheOffset
+            || offset >= (off64_t)(mCacheOffset + mCache->totalSize()))
+            && switchToInactiveRange_l(offset)) {
+        ALOGV("resuming range at offset %lld", mCacheOffset);
+    }
+
+    if (!mFetching
+            && offset >= mCacheOffset
+            && offset < (off64_t)(mCacheOffset + mCache->totalSize())) {
         mLastAccessPos = offset;
         restartPrefetcherIfNecessary_l(
                 false, // ignoreLowWaterThreshold
@@ -640,19 +880,21 @@ ssize_t NuCachedSource2::readInternal(off64_t offset, void *data, size_t size) {
 }
 
 status_t NuCachedSource2::seekInternal_l(off64_t offset) {
-    mLastAccessPos = offset;
-
     if (offset >= mCacheOffset
             && offset <= (off64_t)(mCacheOffset + mCache->totalSize())) {
+        mLastAccessPos = offset;
+        restartPrefetcherIfNecessary_l(
+                false, // ignoreLowWaterThreshold
+                true); // force
         return OK;
     }
 
     ALOGI("new range: offset= %lld", offset);
 
-    mCacheOffset = offset;
+    retireActiveRange_l();
 
-    size_t totalSize = mCache->totalSize();
-    CHECK_EQ(mCache->releaseFromStart(totalSize), totalSize);
+    mCacheOffset = offset;
+    mLastAccessPos = offset;
 
     mNumRetriesLeft = kMaxNumRetries;
     mFetching = true;
@@ -660,6 +902,98 @@ status_t NuCachedSource2::seekInternal_l(off64_t offset) {
     return OK;
 }
 
+bool NuCachedSource2::readFromInactiveRanges_l(
+        off64_t offset, void *data, size_t size) {
+    for (List<CachedRange>::iterator it = mInactiveRanges.begin();
+            it != mInactiveRanges.end(); ++it) {
+        const CachedRange &range = *it;
+        if (offset >= range.mOffset
+                && offset + size <= range.mOffset + range.mCache->totalSize()) {
+            range.mCache->copy(offset - range.mOffset, data, size);
+
+            if (it != mInactiveRanges.begin()) {
+                CachedRange used = range;
+                mInactiveRanges.erase(it);
+                mInactiveRanges.push_front(used);
+            }
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool NuCachedSource2::switchToInactiveRange_l(off64_t offset) {
+    for (List<CachedRange>::iterator it = mInactiveRanges.begin();
+            it != mInactiveRanges.end(); ++it) {
+        CachedRange range = *it;
+        if (offset >= range.mOffset
+                && offset < (off64_t)(range.mOffset + range.mCache->totalSize())) {
+            mInactiveRanges.erase(it);
+            mInactiveBytes -= range.mCache->totalSize();
+
+            retireActiveRange_l();
+
+            delete mCache;
+            mCache = range.mCache;
+            mCacheOffset = range.mOffset;
+            mLastAccessPos = offset;
+
+            // Pick up prefetching where this range was left.
+            mNumRetriesLeft = kMaxNumRetries;
+            mFetching = true;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Moves the data of the active range not read yet to the inactive ones, and
+// leaves an empty active range behind.
+void NuCachedSource2::retireActiveRange_l() {
+    static const size_t kGrayArea = 1024 * 1024;
+
+    if (mLastAccessPos > (off64_t)(mCacheOffset + kGrayArea)) {
+        mCacheOffset += mCache->releaseFromStart(
+                mLastAccessPos - mCacheOffset - kGrayArea);
+    }
+
+    size_t totalSize = mCache->totalSize();
+    if (totalSize > kMaxInactiveBytes) {
+        mCache->releaseFromEnd(totalSize - kMaxInactiveBytes);
+        totalSize = mCache->totalSize();
+    }
+
+    if (totalSize == 0) {
+        return;
+    }
+
+    mCache->freeReleasedPages();
+
+    CachedRange range;
+    range.mOffset = mCacheOffset;
+    range.mCache = mCache;
+    mInactiveRanges.push_front(range);
+    mInactiveBytes += totalSize;
+
+    mCache = new PageCache(kPageSize);
+
+    while (mInactiveBytes > kMaxInactiveBytes
+            || mInactiveRanges.size() > kMaxNumInactiveRanges) {
+        List<CachedRange>::iterator it = --mInactiveRanges.end();
+
+        ALOGV("dropping range at offset %lld, %zu bytes",
+             (*it).mOffset, (*it).mCache->totalSize());
+
+        mInactiveBytes -= (*it).mCache->totalSize();
+        delete (*it).mCache;
+        mInactiveRanges.erase(it);
+    }
+}
+
 void NuCachedSource2::resumeFetchingIfNecessary() {
     Mutex::Autolock autoLock(mLock);
 
@@ -706,6 +1040,8 @@ void NuCachedSource2::updateCacheParamsFromString(const char *s) {
         return;
     }
 
+    mAdaptCacheParams = false;
+
     if (lowwaterMarkKb >= 0) {
         mLowwaterThresholdBytes = lowwaterMarkKb * 1024;
     } else {
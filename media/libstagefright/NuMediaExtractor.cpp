@@ -40,8 +40,164 @@
 #include <media/stagefright/MetaData.h>
 #include <media/stagefright/Utils.h>
 
+#include <utils/List.h>
+
 namespace android {
 
+// Reads the samples of one track on a thread of its own, a few of them ahead
+// of the client, so that the client doesn't wait on the I/O of the next
+// sample as it advances. The samples are copied out of the source's buffers
+// as they are read, the extractors handing out samples from a group of one
+// buffer or so that a queue of them would exhaust.
+struct NuMediaExtractor::SamplePrefetcher : public Thread {
+    SamplePrefetcher(const sp<MediaSource> &source)
+        : Thread(false),
+          mSource(source),
+          mQueuedBytes(0),
+          mFinalResult(OK),
+          mSeekTimeUs(-1ll),
+          mSeekMode(MediaSource::ReadOptions::SEEK_CLOSEST_SYNC),
+          mGeneration(0) {
+    }
+
+    // Takes the next sample, waiting for it to be read if it hasn't been
+    // yet. A seekTimeUs >= 0 drops what was read ahead and has the reads go
+    // on from there.
+    status_t read(MediaBuffer **buffer, sp<MetaData> *meta,
+            int64_t seekTimeUs, MediaSource::ReadOptions::SeekMode mode) {
+        Mutex::Autolock autoLock(mLock);
+
+        if (seekTimeUs >= 0ll) {
+            flush_l();
+            mFinalResult = OK;
+            mSeekTimeUs = seekTimeUs;
+            mSeekMode = mode;
+            ++mGeneration;
+            mCondition.broadcast();
+        }
+
+        while (mQueue.empty() && (mFinalResult == OK || mSeekTimeUs >= 0ll)) {
+            mCondition.wait(mLock);
+        }
+
+        if (mQueue.empty()) {
+            return mFinalResult;
+        }
+
+        List<Sample>::iterator it = mQueue.begin();
+        *buffer = it->mBuffer;
+        *meta = it->mMeta;
+        mQueuedBytes -= it->mBuffer->range_length();
+        mQueue.erase(it);
+
+        mCondition.broadcast();
+        return OK;
+    }
+
+    // Waits for a read in progress to return, the source may be stopped
+    // after this.
+    void stop() {
+        {
+            Mutex::Autolock autoLock(mLock);
+            requestExit();
+            mCondition.broadcast();
+        }
+        requestExitAndWait();
+
+        Mutex::Autolock autoLock(mLock);
+        flush_l();
+    }
+
+private:
+    // Enough to ride out a slow read or two, without holding seconds of a
+    // high bitrate video.
+    static const size_t kMaxQueuedSamples = 16;
+    static const size_t kMaxQueuedBytes = 4 * 1024 * 1024;
+
+    struct Sample {
+        MediaBuffer *mBuffer;
+        sp<MetaData> mMeta;
+    };
+
+    sp<MediaSource> mSource;
+
+    Mutex mLock;
+    Condition mCondition;
+    List<Sample> mQueue;
+    size_t mQueuedBytes;
+    status_t mFinalResult;
+    int64_t mSeekTimeUs;
+    MediaSource::ReadOptions::SeekMode mSeekMode;
+
+    // bumped by each seek, for what was being read before it to be dropped
+    int32_t mGeneration;
+
+    virtual bool threadLoop() {
+        MediaSource::ReadOptions options;
+        int32_t generation;
+        {
+            Mutex::Autolock autoLock(mLock);
+            while (!exitPending() && mSeekTimeUs < 0ll
+                    && (mFinalResult != OK
+                        || mQueue.size() >= kMaxQueuedSamples
+                        || mQueuedBytes >= kMaxQueuedBytes)) {
+                mCondition.wait(mLock);
+            }
+            if (exitPending()) {
+                return false;
+            }
+            if (mSeekTimeUs >= 0ll) {
+                options.setSeekTo(mSeekTimeUs, mSeekMode);
+                mSeekTimeUs = -1ll;
+            }
+            generation = mGeneration;
+        }
+
+        MediaBuffer *buffer;
+        status_t err = mSource->read(&buffer, &options);
+
+        Sample sample;
+        sample.mBuffer = NULL;
+        if (err == OK) {
+            // the buffer's meta data is cleared as it goes back to its group
+            sample.mBuffer = new MediaBuffer(buffer->range_length());
+            memcpy(sample.mBuffer->data(),
+                   (const uint8_t *)buffer->data() + buffer->range_offset(),
+                   buffer->range_length());
+            sample.mMeta = new MetaData(*buffer->meta_data());
+            buffer->release();
+        }
+
+        Mutex::Autolock autoLock(mLock);
+        if (generation != mGeneration) {
+            // a seek came in while reading
+            if (sample.mBuffer != NULL) {
+                sample.mBuffer->release();
+            }
+            return true;
+        }
+
+        if (err != OK) {
+            mFinalResult = err;
+        } else {
+            mQueue.push_back(sample);
+            mQueuedBytes += sample.mBuffer->range_length();
+        }
+        mCondition.broadcast();
+        return true;
+    }
+
+    void flush_l() {
+        for (List<Sample>::iterator it = mQueue.begin(); it != mQueue.end(); ++it) {
+            it->mBuffer->release();
+        }
+        mQueue.clear();
+        mQueuedBytes = 0;
+    }
+
+    DISALLOW_EVIL_CONSTRUCTORS(SamplePrefetcher);
+};
+
 NuMediaExtractor::NuMediaExtractor()
     : mIsWidevineExtractor(false),
       mTotalBitrate(-1ll),
@@ -54,6 +210,10 @@ NuMediaExtractor::~NuMediaExtractor() {
     for (size_t i = 0; i < mSelectedTracks.size(); ++i) {
         TrackInfo *info = &mSelectedTracks.editItemAt(i);
 
+        if (info->mPrefetcher != NULL) {
+            info->mPrefetcher->stop();
+            info->mPrefetcher.clear();
+        }
         CHECK_EQ((status_t)OK, info->mSource->stop());
     }
 
@@ -302,11 +462,18 @@ status_t NuMediaExtractor::selectTrack(size_t index) {
     info->mSample = NULL;
     info->mSampleTimeUs = -1ll;
     info->mTrackFlags = 0;
+    info->mPrefetcher = NULL;
 
     if (!strcasecmp(mime, MEDIA_MIMETYPE_AUDIO_VORBIS)) {
         info->mTrackFlags |= kIsVorbis;
     }
 
+    // The widevine extractor does its own buffering.
+    if (!mIsWidevineExtractor && info->mSource != NULL) {
+        info->mPrefetcher = new SamplePrefetcher(info->mSource);
+        info->mPrefetcher->run("NuMediaExtractor prefetch");
+    }
+
     return OK;
 }
 
@@ -337,13 +504,12 @@ status_t NuMediaExtractor::unselectTrack(size_t index) {
 
     TrackInfo *info = &mSelectedTracks.editItemAt(i);
 
-    if (info->mSample != NULL) {
-        info->mSample->release();
-        info->mSample = NULL;
+    releaseSample(info);
 
-        info->mSampleTimeUs = -1ll;
+    if (info->mPrefetcher != NULL) {
+        info->mPrefetcher->stop();
+        info->mPrefetcher.clear();
     }
-
     CHECK_EQ((status_t)OK, info->mSource->stop());
 
     mSelectedTracks.removeAt(i);
@@ -353,14 +519,18 @@ status_t NuMediaExtractor::unselectTrack(size_t index) {
 
 void NuMediaExtractor::releaseTrackSamples() {
     for (size_t i = 0; i < mSelectedTracks.size(); ++i) {
-        TrackInfo *info = &mSelectedTracks.editItemAt(i);
+        releaseSample(&mSelectedTracks.editItemAt(i));
+    }
+}
 
-        if (info->mSample != NULL) {
-            info->mSample->release();
-            info->mSample = NULL;
+// static
+void NuMediaExtractor::releaseSample(TrackInfo *info) {
+    if (info->mSample != NULL) {
+        info->mSample->release();
+        info->mSample = NULL;
+        info->mSampleMeta.clear();
 
-            info->mSampleTimeUs = -1ll;
-        }
+        info->mSampleTimeUs = -1ll;
     }
 }
 
@@ -375,21 +545,26 @@ ssize_t NuMediaExtractor::fetchTrackSamples(
         if (seekTimeUs >= 0ll) {
             info->mFinalResult = OK;
 
-            if (info->mSample != NULL) {
-                info->mSample->release();
-                info->mSample = NULL;
-                info->mSampleTimeUs = -1ll;
-            }
+            releaseSample(info);
         } else if (info->mFinalResult != OK) {
             continue;
         }
 
         if (info->mSample == NULL) {
-            MediaSource::ReadOptions options;
-            if (seekTimeUs >= 0ll) {
-                options.setSeekTo(seekTimeUs, mode);
+            status_t err;
+            if (info->mPrefetcher != NULL) {
+                err = info->mPrefetcher->read(
+                        &info->mSample, &info->mSampleMeta, seekTimeUs, mode);
+            } else {
+                MediaSource::ReadOptions options;
+                if (seekTimeUs >= 0ll) {
+                    options.setSeekTo(seekTimeUs, mode);
+                }
+                err = info->mSource->read(&info->mSample, &options);
+                if (err == OK) {
+                    info->mSampleMeta = info->mSample->meta_data();
+                }
             }
-            status_t err = info->mSource->read(&info->mSample, &options);
 
             if (err != OK) {
                 CHECK(info->mSample == NULL);
@@ -405,7 +580,7 @@ ssize_t NuMediaExtractor::fetchTrackSamples(
                 continue;
             } else {
                 CHECK(info->mSample != NULL);
-                CHECK(info->mSample->meta_data()->findInt64(
+                CHECK(info->mSampleMeta->findInt64(
                             kKeyTime, &info->mSampleTimeUs));
             }
         }
@@ -443,9 +618,7 @@ status_t NuMediaExtractor::advance() {
 
     TrackInfo *info = &mSelectedTracks.editItemAt(minIndex);
 
-    info->mSample->release();
-    info->mSample = NULL;
-    info->mSampleTimeUs = -1ll;
+    releaseSample(info);
 
     return OK;
 }
@@ -481,7 +654,7 @@ status_t NuMediaExtractor::readSampleData(const sp<ABuffer> &buffer) {
 
     if (info->mTrackFlags & kIsVorbis) {
         int32_t numPageSamples;
-        if (!info->mSample->meta_data()->findInt32(
+        if (!info->mSampleMeta->findInt32(
                     kKeyValidSamples, &numPageSamples)) {
             numPageSamples = -1;
         }
@@ -538,7 +711,7 @@ status_t NuMediaExtractor::getSampleMeta(sp<MetaData> *sampleMeta) {
     }
 
     TrackInfo *info = &mSelectedTracks.editItemAt(minIndex);
-    *sampleMeta = info->mSample->meta_data();
+    *sampleMeta = info->mSampleMeta;
 
     return OK;
 }
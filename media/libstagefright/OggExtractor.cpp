@@ -113,6 +113,12 @@ private:
     sp<MetaData> mMeta;
     sp<MetaData> mFileMeta;
 
+    // Set if seeking anywhere in the source is cheap, seeking by time then
+    // bisects the file on the granule positions of its pages.
+    off64_t mFileSize;
+
+    // The pages looked at while seeking, in file order. Later seeks start
+    // bisecting from the closest ones.
     Vector<TOCEntry> mTableOfContents;
 
     ssize_t readPage(off64_t offset, Page *page);
@@ -125,7 +131,10 @@ private:
 
     status_t findPrevGranulePosition(off64_t pageOffset, uint64_t *granulePos);
 
-    void buildTableOfContents();
+    status_t findPageAtTime(int64_t timeUs, off64_t *pageOffset);
+    ssize_t readPageWithGranulePosition(
+            off64_t offset, off64_t stopOffset, off64_t *pageOffset, Page *page);
+    void addTOCEntry(off64_t pageOffset, uint64_t granulePosition);
 
     MyVorbisExtractor(const MyVorbisExtractor &);
     MyVorbisExtractor &operator=(const MyVorbisExtractor &);
@@ -212,7 +221,8 @@ MyVorbisExtractor::MyVorbisExtractor(const sp<DataSource> &source)
       mFirstPacketInPage(true),
       mCurrentPageSamples(0),
       mNextLaceIndex(0),
-      mFirstDataOffset(-1) {
+      mFirstDataOffset(-1),
+      mFileSize(-1) {
     mCurrentPage.mNumSegments = 0;
 
     vorbis_info_init(&mVi);
@@ -233,8 +243,8 @@ status_t MyVorbisExtractor::findNextPage(
     *pageOffset = startOffset;
 
     for (;;) {
-        char signature[4];
-        ssize_t n = mSource->readAt(*pageOffset, &signature, 4);
+        uint8_t buffer[4096];
+        ssize_t n = mSource->readAt(*pageOffset, buffer, sizeof(buffer));
 
         if (n < 4) {
             *pageOffset = 0;
@@ -242,16 +252,26 @@ status_t MyVorbisExtractor::findNextPage(
             return (n < 0) ? n : (status_t)ERROR_END_OF_STREAM;
         }
 
-        if (!memcmp(signature, "OggS", 4)) {
-            if (*pageOffset > startOffset) {
-                ALOGV("skipped %lld bytes of junk to reach next frame",
-                     *pageOffset - startOffset);
+        // memchr() is vectorized, only look closer where there is an 'O'.
+        const uint8_t *ptr = buffer;
+        const uint8_t *end = buffer + n - 3;
+        while (ptr < end
+                && (ptr = (const uint8_t *)memchr(ptr, 'O', end - ptr)) != NULL) {
+            if (!memcmp(ptr, "OggS", 4)) {
+                *pageOffset += ptr - buffer;
+
+                if (*pageOffset > startOffset) {
+                    ALOGV("skipped %lld bytes of junk to reach next frame",
+                         *pageOffset - startOffset);
+                }
+
+                return OK;
             }
 
-            return OK;
+            ++ptr;
         }
 
-        ++*pageOffset;
+        *pageOffset += n - 3;
     }
 }
 
@@ -310,7 +330,7 @@ status_t MyVorbisExtractor::findPrevGranulePosition(
 }
 
 status_t MyVorbisExtractor::seekToTime(int64_t timeUs) {
-    if (mTableOfContents.isEmpty()) {
+    if (mFileSize < 0) {
         // Perform approximate seeking based on avg. bitrate.
 
         off64_t pos = timeUs * approxBitrate() / 8000000ll;
@@ -319,33 +339,163 @@ status_t MyVorbisExtractor::seekToTime(int64_t timeUs) {
         return seekToOffset(pos);
     }
 
+    off64_t pageOffset;
+    status_t err = findPageAtTime(timeUs, &pageOffset);
+    if (err != OK) {
+        return err;
+    }
+
+    ALOGV("seeking to page at offset %lld", pageOffset);
+
+    return seekToOffset(pageOffset);
+}
+
+// Reads the pages from offset on up to the first one some packet ends on,
+// those without carry a granule position of -1. Junk that merely looks like
+// the start of a page is skipped.
+ssize_t MyVorbisExtractor::readPageWithGranulePosition(
+        off64_t offset, off64_t stopOffset, off64_t *pageOffset, Page *page) {
+    status_t err = findNextPage(offset, pageOffset);
+    if (err != OK) {
+        return err;
+    }
+
+    while (*pageOffset < stopOffset) {
+        ssize_t pageSize = readPage(*pageOffset, page);
+        if (pageSize == ERROR_MALFORMED || pageSize == ERROR_UNSUPPORTED) {
+            // "OggS" in the middle of some packet, keep looking.
+            err = findNextPage(*pageOffset + 1, pageOffset);
+            if (err != OK) {
+                return err;
+            }
+            continue;
+        } else if (pageSize <= 0) {
+            return pageSize < 0 ? pageSize : (ssize_t)ERROR_MALFORMED;
+        }
+
+        if (page->mGranulePosition != (uint64_t)-1) {
+            return pageSize;
+        }
+
+        *pageOffset += pageSize;
+    }
+
+    return ERROR_END_OF_STREAM;
+}
+
+// Finds the first page where the stream reaches timeUs. The range of the
+// file it can be in is bisected on the granule positions of the pages until
+// it is small enough to read through.
+status_t MyVorbisExtractor::findPageAtTime(int64_t timeUs, off64_t *pageOffset) {
+    static const off64_t kScanSize = 64 * 1024;
+
+    // Where the page is at the latest, if known.
+    off64_t found = -1;
+    // The last page before timeUs seen.
+    off64_t before = -1;
+
+    off64_t low = mFirstDataOffset;
+    off64_t high = mFileSize;
+
     size_t left = 0;
     size_t right_plus_one = mTableOfContents.size();
     while (left < right_plus_one) {
         size_t center = left + (right_plus_one - left) / 2;
+        if (mTableOfContents.itemAt(center).mTimeUs < timeUs) {
+            left = center + 1;
+        } else {
+            right_plus_one = center;
+        }
+    }
 
-        const TOCEntry &entry = mTableOfContents.itemAt(center);
+    if (left > 0) {
+        before = mTableOfContents.itemAt(left - 1).mPageOffset;
+        low = before + 1;
+    }
+    if (left < mTableOfContents.size()) {
+        found = mTableOfContents.itemAt(left).mPageOffset;
+        high = found;
+    }
 
-        if (timeUs < entry.mTimeUs) {
-            right_plus_one = center;
-        } else if (timeUs > entry.mTimeUs) {
-            left = center + 1;
+    while (high - low > kScanSize) {
+        off64_t mid = low + (high - low) / 2;
+
+        off64_t offset;
+        Page page;
+        if (readPageWithGranulePosition(mid, high, &offset, &page) <= 0) {
+            // Nothing ends between mid and high.
+            high = mid;
+            continue;
+        }
+
+        addTOCEntry(offset, page.mGranulePosition);
+
+        if ((int64_t)(page.mGranulePosition * 1000000ll / mVi.rate) < timeUs) {
+            before = offset;
+            low = offset + 1;
         } else {
-            left = center;
+            found = offset;
+            high = mid;
+        }
+    }
+
+    off64_t offset = low;
+    for (;;) {
+        Page page;
+        ssize_t pageSize = readPageWithGranulePosition(
+                offset, found >= 0 ? found : mFileSize, &offset, &page);
+        if (pageSize <= 0) {
             break;
         }
+
+        if ((int64_t)(page.mGranulePosition * 1000000ll / mVi.rate) >= timeUs) {
+            addTOCEntry(offset, page.mGranulePosition);
+            found = offset;
+            break;
+        }
+
+        before = offset;
+        offset += pageSize;
     }
 
-    if (left == mTableOfContents.size()) {
-        --left;
+    if (found >= 0) {
+        *pageOffset = found;
+    } else if (before >= 0) {
+        // Past the end, settle for the last page.
+        *pageOffset = before;
+    } else {
+        *pageOffset = mFirstDataOffset;
     }
 
-    const TOCEntry &entry = mTableOfContents.itemAt(left);
+    return OK;
+}
+
+void MyVorbisExtractor::addTOCEntry(off64_t pageOffset, uint64_t granulePosition) {
+    // Limit the maximum amount of RAM we spend on the table of contents.
+    static const size_t kMaxTOCSize = 8192;
+    static const size_t kMaxNumTOCEntries = kMaxTOCSize / sizeof(TOCEntry);
+
+    size_t left = 0;
+    size_t right_plus_one = mTableOfContents.size();
+    while (left < right_plus_one) {
+        size_t center = left + (right_plus_one - left) / 2;
+        if (mTableOfContents.itemAt(center).mPageOffset < pageOffset) {
+            left = center + 1;
+        } else {
+            right_plus_one = center;
+        }
+    }
 
-    ALOGV("seeking to entry %zu / %zu at offset %lld",
-         left, mTableOfContents.size(), entry.mPageOffset);
+    if ((left < mTableOfContents.size()
+                && mTableOfContents.itemAt(left).mPageOffset == pageOffset)
+            || mTableOfContents.size() >= kMaxNumTOCEntries) {
+        return;
+    }
 
-    return seekToOffset(entry.mPageOffset);
+    TOCEntry entry;
+    entry.mPageOffset = pageOffset;
+    entry.mTimeUs = granulePosition * 1000000ll / mVi.rate;
+    mTableOfContents.insertAt(entry, left);
 }
 
 status_t MyVorbisExtractor::seekToOffset(off64_t offset) {
@@ -641,51 +791,12 @@ status_t MyVorbisExtractor::init() {
 
         mMeta->setInt64(kKeyDuration, durationUs);
 
-        buildTableOfContents();
+        mFileSize = size;
     }
 
     return OK;
 }
 
-void MyVorbisExtractor::buildTableOfContents() {
-    off64_t offset = mFirstDataOffset;
-    Page page;
-    ssize_t pageSize;
-    while ((pageSize = readPage(offset, &page)) > 0) {
-        mTableOfContents.push();
-
-        TOCEntry &entry =
-            mTableOfContents.editItemAt(mTableOfContents.size() - 1);
-
-        entry.mPageOffset = offset;
-        entry.mTimeUs = page.mGranulePosition * 1000000ll / mVi.rate;
-
-        offset += (size_t)pageSize;
-    }
-
-    // Limit the maximum amount of RAM we spend on the table of contents,
-    // if necessary thin out the table evenly to trim it down to maximum
-    // size.
-
-    static const size_t kMaxTOCSize = 8192;
-    static const size_t kMaxNumTOCEntries = kMaxTOCSize / sizeof(TOCEntry);
-
-    size_t numerator = mTableOfContents.size();
-
-    if (numerator > kMaxNumTOCEntries) {
-        size_t denom = numerator - kMaxNumTOCEntries;
-
-        size_t accum = 0;
-        for (ssize_t i = mTableOfContents.size() - 1; i >= 0; --i) {
-            accum += denom;
-            if (accum >= numerator) {
-                mTableOfContents.removeAt(i);
-                accum -= numerator;
-            }
-        }
-    }
-}
-
 status_t MyVorbisExtractor::verifyHeader(
         MediaBuffer *buffer, uint8_t type) {
     const uint8_t *data =
@@ -97,21 +97,13 @@ status_t SampleIterator::seekTo(uint32_t sampleIndex) {
             return err;
         }
 
-        mCurrentChunkSampleSizes.clear();
-
         uint32_t firstChunkSampleIndex =
             mFirstChunkSampleIndex
                 + mSamplesPerChunk * (mCurrentChunkIndex - mFirstChunk);
 
-        for (uint32_t i = 0; i < mSamplesPerChunk; ++i) {
-            size_t sampleSize;
-            if ((err = getSampleSizeDirect(
-                            firstChunkSampleIndex + i, &sampleSize)) != OK) {
-                ALOGE("getSampleSizeDirect return error");
-                return err;
-            }
-
-            mCurrentChunkSampleSizes.push(sampleSize);
+        if ((err = readChunkSampleSizes(firstChunkSampleIndex)) != OK) {
+            ALOGE("readChunkSampleSizes return error");
+            return err;
         }
     }
 
@@ -130,6 +122,20 @@ status_t SampleIterator::seekTo(uint32_t sampleIndex) {
         mTTSSampleTime = 0;
         mTTSCount = 0;
         mTTSDuration = 0;
+
+        // Once seeking by time has indexed the samples, start over from
+        // the region of the sample rather than from the first sample.
+        if (mTable->mSampleRegions != NULL
+                && sampleIndex < mTable->mNumTimedSamples) {
+            const SampleTable::SampleRegion &region =
+                mTable->mSampleRegions[sampleIndex / SampleTable::kSamplesPerRegion];
+
+            mTimeToSampleIndex = region.mTTSEntry + 1;
+            mTTSSampleIndex = region.mTTSSampleIndex;
+            mTTSSampleTime = region.mTTSSampleTime;
+            mTTSCount = mTable->mTimeToSample[2 * region.mTTSEntry];
+            mTTSDuration = mTable->mTimeToSample[2 * region.mTTSEntry + 1];
+        }
     }
 
     status_t err;
@@ -286,6 +292,87 @@ status_t SampleIterator::getSampleSizeDirect(
     return OK;
 }
 
+status_t SampleIterator::readChunkSampleSizes(uint32_t firstSampleIndex) {
+    mCurrentChunkSampleSizes.clear();
+    mCurrentChunkSize = 0;
+
+    if (firstSampleIndex >= mTable->mNumSampleSizes) {
+        return ERROR_OUT_OF_RANGE;
+    }
+
+    // The last chunk may claim more samples than there are.
+    uint32_t numSamples = mSamplesPerChunk;
+    if (numSamples > mTable->mNumSampleSizes - firstSampleIndex) {
+        numSamples = mTable->mNumSampleSizes - firstSampleIndex;
+    }
+
+    if (mTable->mDefaultSampleSize > 0) {
+        mCurrentChunkSampleSizes.insertAt(
+                mTable->mDefaultSampleSize, 0, numSamples);
+        mCurrentChunkSize = (size_t)mTable->mDefaultSampleSize * numSamples;
+        return OK;
+    }
+
+    // Read the sizes of as many samples as fit in the buffer at a time,
+    // rather than one readAt() per sample.
+    static const size_t kBufferSize = 512;
+    uint8_t buffer[kBufferSize];
+
+    const uint32_t fieldSize = mTable->mSampleSizeFieldSize;
+    CHECK(fieldSize == 32 || fieldSize == 16 || fieldSize == 8 || fieldSize == 4);
+
+    // One less than fits, a 4 bit field may start in the middle of a byte.
+    const uint32_t maxSamplesPerRead = kBufferSize * 8 / fieldSize - 1;
+
+    uint32_t sampleIndex = firstSampleIndex;
+    while (numSamples > 0) {
+        uint32_t n = numSamples < maxSamplesPerRead ? numSamples : maxSamplesPerRead;
+
+        off64_t startByte = (off64_t)sampleIndex * fieldSize / 8;
+        off64_t stopByte = ((off64_t)(sampleIndex + n) * fieldSize + 7) / 8;
+        ssize_t size = stopByte - startByte;
+
+        if (mTable->mDataSource->readAt(
+                    mTable->mSampleSizeOffset + 12 + startByte,
+                    buffer, size) < size) {
+            return ERROR_IO;
+        }
+
+        for (uint32_t i = 0; i < n; ++i) {
+            size_t sampleSize;
+            switch (fieldSize) {
+                case 32:
+                    sampleSize = U32_AT(&buffer[4 * i]);
+                    break;
+
+                case 16:
+                    sampleSize = U16_AT(&buffer[2 * i]);
+                    break;
+
+                case 8:
+                    sampleSize = buffer[i];
+                    break;
+
+                default:
+                {
+                    uint32_t index = sampleIndex + i;
+                    uint8_t x = buffer[index / 2 - startByte];
+                    sampleSize = (index & 1) ? x & 0x0f : x >> 4;
+                    break;
+                }
+            }
+
+            mCurrentChunkSampleSizes.push(sampleSize);
+            mCurrentChunkSize += sampleSize;
+        }
+
+        sampleIndex += n;
+        numSamples -= n;
+    }
+
+    return OK;
+}
+
 status_t SampleIterator::findSampleTimeAndDuration(
         uint32_t sampleIndex, uint32_t *time, uint32_t *duration) {
     if (sampleIndex >= mTable->mNumSampleSizes) {
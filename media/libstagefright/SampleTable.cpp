@@ -42,6 +42,7 @@ const uint32_t SampleTable::kSampleSizeTypeCompact = FOURCC('s', 't', 'z', '2');
 
 struct SampleTable::CompositionDeltaLookup {
     CompositionDeltaLookup();
+    ~CompositionDeltaLookup();
 
     void setEntries(
             const uint32_t *deltaEntries, size_t numDeltaEntries);
@@ -54,6 +55,9 @@ private:
     const uint32_t *mDeltaEntries;
     size_t mNumDeltaEntries;
 
+    // Index of the first sample of each entry.
+    uint32_t *mEntrySampleIndices;
+
     size_t mCurrentDeltaEntry;
     size_t mCurrentEntrySampleIndex;
 
@@ -63,10 +67,16 @@ private:
 SampleTable::CompositionDeltaLookup::CompositionDeltaLookup()
     : mDeltaEntries(NULL),
       mNumDeltaEntries(0),
+      mEntrySampleIndices(NULL),
       mCurrentDeltaEntry(0),
       mCurrentEntrySampleIndex(0) {
 }
 
+SampleTable::CompositionDeltaLookup::~CompositionDeltaLookup() {
+    delete[] mEntrySampleIndices;
+    mEntrySampleIndices = NULL;
+}
+
 void SampleTable::CompositionDeltaLookup::setEntries(
         const uint32_t *deltaEntries, size_t numDeltaEntries) {
     Mutex::Autolock autolock(mLock);
@@ -75,6 +85,15 @@ void SampleTable::CompositionDeltaLookup::setEntries(
     mNumDeltaEntries = numDeltaEntries;
     mCurrentDeltaEntry = 0;
     mCurrentEntrySampleIndex = 0;
+
+    delete[] mEntrySampleIndices;
+    mEntrySampleIndices = new uint32_t[numDeltaEntries];
+
+    uint32_t sampleIndex = 0;
+    for (size_t i = 0; i < numDeltaEntries; ++i) {
+        mEntrySampleIndices[i] = sampleIndex;
+        sampleIndex += deltaEntries[2 * i];
+    }
 }
 
 uint32_t SampleTable::CompositionDeltaLookup::getCompositionTimeOffset(
@@ -85,14 +104,16 @@ uint32_t SampleTable::CompositionDeltaLookup::getCompositionTimeOffset(
         return 0;
     }
 
-    if (sampleIndex < mCurrentEntrySampleIndex) {
-        mCurrentDeltaEntry = 0;
-        mCurrentEntrySampleIndex = 0;
-    }
+    // Samples are mostly looked up in order, try the current and the
+    // next entry first.
+    for (size_t i = 0; i < 2; ++i) {
+        if (mCurrentDeltaEntry >= mNumDeltaEntries
+                || sampleIndex < mCurrentEntrySampleIndex) {
+            break;
+        }
 
-    while (mCurrentDeltaEntry < mNumDeltaEntries) {
         uint32_t sampleCount = mDeltaEntries[2 * mCurrentDeltaEntry];
-        if (sampleIndex < mCurrentEntrySampleIndex + sampleCount) {
+        if (sampleIndex - mCurrentEntrySampleIndex < sampleCount) {
             return mDeltaEntries[2 * mCurrentDeltaEntry + 1];
         }
 
@@ -100,7 +121,32 @@ uint32_t SampleTable::CompositionDeltaLookup::getCompositionTimeOffset(
         ++mCurrentDeltaEntry;
     }
 
-    return 0;
+    // Find the last entry starting at or before sampleIndex.
+    size_t left = 0;
+    size_t right = mNumDeltaEntries;
+    while (left < right) {
+        size_t center = left + (right - left) / 2;
+        if (mEntrySampleIndices[center] <= sampleIndex) {
+            left = center + 1;
+        } else {
+            right = center;
+        }
+    }
+
+    if (left == 0) {
+        return 0;
+    }
+
+    size_t entry = left - 1;
+    if (sampleIndex - mEntrySampleIndices[entry] >= mDeltaEntries[2 * entry]) {
+        // Past the last entry.
+        return 0;
+    }
+
+    mCurrentDeltaEntry = entry;
+    mCurrentEntrySampleIndex = mEntrySampleIndices[entry];
+
+    return mDeltaEntries[2 * entry + 1];
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -118,7 +164,11 @@ SampleTable::SampleTable(const sp<DataSource> &source)
       mNumSampleSizes(0),
       mTimeToSampleCount(0),
       mTimeToSample(NULL),
-      mSampleTimeEntries(NULL),
+      mNumTimedSamples(0),
+      mNumSampleRegions(0),
+      mSampleRegions(NULL),
+      mRegionMaxBefore(NULL),
+      mRegionMinAfter(NULL),
       mCompositionTimeDeltaEntries(NULL),
       mNumCompositionTimeDeltaEntries(0),
       mCompositionDeltaLookup(new CompositionDeltaLookup),
@@ -143,8 +193,14 @@ SampleTable::~SampleTable() {
     delete[] mCompositionTimeDeltaEntries;
     mCompositionTimeDeltaEntries = NULL;
 
-    delete[] mSampleTimeEntries;
-    mSampleTimeEntries = NULL;
+    delete[] mSampleRegions;
+    mSampleRegions = NULL;
+
+    delete[] mRegionMaxBefore;
+    mRegionMaxBefore = NULL;
+
+    delete[] mRegionMinAfter;
+    mRegionMinAfter = NULL;
 
     delete[] mTimeToSample;
     mTimeToSample = NULL;
@@ -478,91 +534,184 @@ uint32_t abs_difference(uint32_t time1, uint32_t time2) {
     return time1 > time2 ? time1 - time2 : time2 - time1;
 }
 
-// static
-int SampleTable::CompareIncreasingTime(const void *_a, const void *_b) {
-    const SampleTimeEntry *a = (const SampleTimeEntry *)_a;
-    const SampleTimeEntry *b = (const SampleTimeEntry *)_b;
-
-    if (a->mCompositionTime < b->mCompositionTime) {
-        return -1;
-    } else if (a->mCompositionTime > b->mCompositionTime) {
-        return 1;
-    }
-
-    return 0;
-}
-
-void SampleTable::buildSampleEntriesTable() {
-    Mutex::Autolock autoLock(mLock);
-
-    if (mSampleTimeEntries != NULL) {
+void SampleTable::buildSampleRegions_l() {
+    if (mSampleRegions != NULL) {
         return;
     }
 
-    mSampleTimeEntries = new SampleTimeEntry[mNumSampleSizes];
-
-    uint32_t sampleIndex = 0;
-    uint32_t sampleTime = 0;
-
+    // Technically every sample should be covered by the time to sample
+    // table if the file is well-formed, but you know... there's (gasp)
+    // malformed content out there.
+    uint64_t numTimedSamples = 0;
     for (uint32_t i = 0; i < mTimeToSampleCount; ++i) {
-        uint32_t n = mTimeToSample[2 * i];
-        uint32_t delta = mTimeToSample[2 * i + 1];
-
-        for (uint32_t j = 0; j < n; ++j) {
-            if (sampleIndex < mNumSampleSizes) {
-                // Technically this should always be the case if the file
-                // is well-formed, but you know... there's (gasp) malformed
-                // content out there.
+        numTimedSamples += mTimeToSample[2 * i];
+    }
+    if (numTimedSamples > mNumSampleSizes) {
+        numTimedSamples = mNumSampleSizes;
+    }
 
-                mSampleTimeEntries[sampleIndex].mSampleIndex = sampleIndex;
+    mNumTimedSamples = numTimedSamples;
+    mNumSampleRegions =
+        (mNumTimedSamples + kSamplesPerRegion - 1) / kSamplesPerRegion;
+    mSampleRegions = new SampleRegion[mNumSampleRegions];
+    mRegionMaxBefore = new uint32_t[mNumSampleRegions];
+    mRegionMinAfter = new uint32_t[mNumSampleRegions];
 
-                uint32_t compTimeDelta =
-                    mCompositionDeltaLookup->getCompositionTimeOffset(
-                            sampleIndex);
+    uint32_t entry = 0;
+    uint32_t entrySampleIndex = 0;
+    uint32_t entrySampleTime = 0;
 
-                mSampleTimeEntries[sampleIndex].mCompositionTime =
-                    sampleTime + compTimeDelta;
-            }
+    for (uint32_t sampleIndex = 0; sampleIndex < mNumTimedSamples; ++sampleIndex) {
+        while (sampleIndex - entrySampleIndex >= mTimeToSample[2 * entry]) {
+            entrySampleIndex += mTimeToSample[2 * entry];
+            entrySampleTime += mTimeToSample[2 * entry] * mTimeToSample[2 * entry + 1];
+            ++entry;
+        }
 
-            ++sampleIndex;
-            sampleTime += delta;
+        uint32_t compositionTime = entrySampleTime
+            + mTimeToSample[2 * entry + 1] * (sampleIndex - entrySampleIndex)
+            + mCompositionDeltaLookup->getCompositionTimeOffset(sampleIndex);
+
+        SampleRegion *region = &mSampleRegions[sampleIndex / kSamplesPerRegion];
+        if (sampleIndex % kSamplesPerRegion == 0) {
+            region->mMinTime = region->mMaxTime = compositionTime;
+            region->mMinTimeSample = region->mMaxTimeSample = sampleIndex;
+            region->mTTSEntry = entry;
+            region->mTTSSampleIndex = entrySampleIndex;
+            region->mTTSSampleTime = entrySampleTime;
+        } else if (compositionTime < region->mMinTime) {
+            region->mMinTime = compositionTime;
+            region->mMinTimeSample = sampleIndex;
+        } else if (compositionTime > region->mMaxTime) {
+            region->mMaxTime = compositionTime;
+            region->mMaxTimeSample = sampleIndex;
         }
     }
 
-    qsort(mSampleTimeEntries, mNumSampleSizes, sizeof(SampleTimeEntry),
-          CompareIncreasingTime);
+    for (uint32_t i = 0; i < mNumSampleRegions; ++i) {
+        mRegionMaxBefore[i] = (i > 0
+                && mSampleRegions[mRegionMaxBefore[i - 1]].mMaxTime
+                    >= mSampleRegions[i].mMaxTime)
+            ? mRegionMaxBefore[i - 1] : i;
+    }
+
+    for (uint32_t i = mNumSampleRegions; i-- > 0;) {
+        mRegionMinAfter[i] = (i + 1 < mNumSampleRegions
+                && mSampleRegions[mRegionMinAfter[i + 1]].mMinTime
+                    <= mSampleRegions[i].mMinTime)
+            ? mRegionMinAfter[i + 1] : i;
+    }
 }
 
 status_t SampleTable::findSampleAtTime(
         uint64_t req_time, uint64_t scale_num, uint64_t scale_den,
         uint32_t *sample_index, uint32_t flags) {
-    buildSampleEntriesTable();
+    Mutex::Autolock autoLock(mLock);
+
+    buildSampleRegions_l();
+
+    if (mNumSampleRegions == 0) {
+        return ERROR_OUT_OF_RANGE;
+    }
 
+    // All samples of the regions before firstRegion are earlier than
+    // req_time, all samples of the regions from endRegion on are later.
     uint32_t left = 0;
-    uint32_t right_plus_one = mNumSampleSizes;
+    uint32_t right_plus_one = mNumSampleRegions;
     while (left < right_plus_one) {
         uint32_t center = left + (right_plus_one - left) / 2;
-        uint64_t centerTime =
-            getSampleTime(center, scale_num, scale_den);
-
-        if (req_time < centerTime) {
+        const SampleRegion &region = mSampleRegions[mRegionMaxBefore[center]];
+        if (getScaledTime(region.mMaxTime, scale_num, scale_den) < req_time) {
+            left = center + 1;
+        } else {
             right_plus_one = center;
-        } else if (req_time > centerTime) {
+        }
+    }
+    uint32_t firstRegion = left;
+
+    right_plus_one = mNumSampleRegions;
+    while (left < right_plus_one) {
+        uint32_t center = left + (right_plus_one - left) / 2;
+        const SampleRegion &region = mSampleRegions[mRegionMinAfter[center]];
+        if (getScaledTime(region.mMinTime, scale_num, scale_den) <= req_time) {
             left = center + 1;
         } else {
-            *sample_index = mSampleTimeEntries[center].mSampleIndex;
-            return OK;
+            right_plus_one = center;
         }
     }
+    uint32_t endRegion = left;
+
+    // The latest sample before and the earliest sample after req_time.
+    bool foundBefore = false;
+    uint32_t beforeSample = 0;
+    uint32_t beforeTime = 0;
+    bool foundAfter = false;
+    uint32_t afterSample = 0;
+    uint32_t afterTime = 0;
+
+    if (firstRegion > 0) {
+        const SampleRegion &region =
+            mSampleRegions[mRegionMaxBefore[firstRegion - 1]];
+        foundBefore = true;
+        beforeSample = region.mMaxTimeSample;
+        beforeTime = region.mMaxTime;
+    }
+
+    if (endRegion < mNumSampleRegions) {
+        const SampleRegion &region = mSampleRegions[mRegionMinAfter[endRegion]];
+        foundAfter = true;
+        afterSample = region.mMinTimeSample;
+        afterTime = region.mMinTime;
+    }
+
+    for (uint32_t i = firstRegion; i < endRegion; ++i) {
+        const SampleRegion &region = mSampleRegions[i];
+        uint32_t entry = region.mTTSEntry;
+        uint32_t entrySampleIndex = region.mTTSSampleIndex;
+        uint32_t entrySampleTime = region.mTTSSampleTime;
+
+        uint32_t sampleIndex = i * kSamplesPerRegion;
+        uint32_t stopSampleIndex = sampleIndex + kSamplesPerRegion;
+        if (stopSampleIndex > mNumTimedSamples) {
+            stopSampleIndex = mNumTimedSamples;
+        }
 
-    uint32_t closestIndex = left;
+        for (; sampleIndex < stopSampleIndex; ++sampleIndex) {
+            while (sampleIndex - entrySampleIndex >= mTimeToSample[2 * entry]) {
+                entrySampleIndex += mTimeToSample[2 * entry];
+                entrySampleTime +=
+                    mTimeToSample[2 * entry] * mTimeToSample[2 * entry + 1];
+                ++entry;
+            }
+
+            uint32_t compositionTime = entrySampleTime
+                + mTimeToSample[2 * entry + 1] * (sampleIndex - entrySampleIndex)
+                + mCompositionDeltaLookup->getCompositionTimeOffset(sampleIndex);
+
+            uint64_t time = getScaledTime(compositionTime, scale_num, scale_den);
+            if (time == req_time) {
+                *sample_index = sampleIndex;
+                return OK;
+            } else if (time < req_time) {
+                if (!foundBefore || compositionTime > beforeTime) {
+                    foundBefore = true;
+                    beforeSample = sampleIndex;
+                    beforeTime = compositionTime;
+                }
+            } else if (!foundAfter || compositionTime < afterTime) {
+                foundAfter = true;
+                afterSample = sampleIndex;
+                afterTime = compositionTime;
+            }
+        }
+    }
 
-    if (closestIndex == mNumSampleSizes) {
+    if (!foundAfter) {
         if (flags == kFlagAfter) {
             return ERROR_OUT_OF_RANGE;
         }
         flags = kFlagBefore;
-    } else if (closestIndex == 0) {
+    } else if (!foundBefore) {
         if (flags == kFlagBefore) {
             // normally we should return out of range, but that is
             // treated as end-of-stream.  instead return first sample
@@ -575,13 +724,13 @@ status_t SampleTable::findSampleAtTime(
     switch (flags) {
         case kFlagBefore:
         {
-            --closestIndex;
+            *sample_index = beforeSample;
             break;
         }
 
         case kFlagAfter:
         {
-            // nothing to do
+            *sample_index = afterSample;
             break;
         }
 
@@ -590,16 +739,17 @@ status_t SampleTable::findSampleAtTime(
             CHECK(flags == kFlagClosest);
             // pick closest based on timestamp. use abs_difference for safety
             if (abs_difference(
-                    getSampleTime(closestIndex, scale_num, scale_den), req_time) >
+                    getScaledTime(afterTime, scale_num, scale_den), req_time) >
                 abs_difference(
-                    req_time, getSampleTime(closestIndex - 1, scale_num, scale_den))) {
-                --closestIndex;
+                    req_time, getScaledTime(beforeTime, scale_num, scale_den))) {
+                *sample_index = beforeSample;
+            } else {
+                *sample_index = afterSample;
             }
             break;
         }
     }
 
-    *sample_index = mSampleTimeEntries[closestIndex].mSampleIndex;
     return OK;
 }
 
@@ -807,6 +957,21 @@ status_t SampleTable::getMetaDataForSample(
     return OK;
 }
 
+status_t SampleTable::getChunkRangeForSample(
+        uint32_t sampleIndex, off64_t *offset, size_t *size) {
+    Mutex::Autolock autoLock(mLock);
+
+    status_t err;
+    if ((err = mSampleIterator->seekTo(sampleIndex)) != OK) {
+        return err;
+    }
+
+    *offset = mSampleIterator->getCurrentChunkOffset();
+    *size = mSampleIterator->getCurrentChunkSize();
+
+    return OK;
+}
+
 uint32_t SampleTable::getCompositionTimeOffset(uint32_t sampleIndex) {
     return mCompositionDeltaLookup->getCompositionTimeOffset(sampleIndex);
 }
@@ -20,10 +20,14 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
 
 #include <media/stagefright/StagefrightMediaScanner.h>
 
+#include <cutils/properties.h>
 #include <media/IMediaHTTPService.h>
 #include <media/mediametadataretriever.h>
 #include <private/media/VideoFrame.h>
@@ -33,9 +37,44 @@
 
 namespace android {
 
-StagefrightMediaScanner::StagefrightMediaScanner() {}
+#define PROP_METADATA_CACHE "media.scanner.metadata-cache"
 
-StagefrightMediaScanner::~StagefrightMediaScanner() {}
+static const uint32_t kCacheMagic = 0x534d5343;  // 'SMSC'
+static const uint32_t kCacheVersion = 1;
+
+// Files left out of the cache past this, those not seen during the scan
+// first.
+static const size_t kMaxCachedFiles = 100000;
+static const uint32_t kMaxCachedStringLength = 65536;
+
+StagefrightMediaScanner::StagefrightMediaScanner()
+    : mCacheLoaded(false),
+      mNumCacheHits(0) {
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get(PROP_METADATA_CACHE, value, NULL) && value[0] != '\0') {
+        mCachePath = value;
+    }
+}
+
+StagefrightMediaScanner::~StagefrightMediaScanner() {
+    if (mNumCacheHits > 0 || !mAddedFiles.isEmpty()) {
+        ALOGI("metadata cache: %zu files reported from it, %zu extracted",
+                mNumCacheHits, mAddedFiles.size());
+    }
+    if (!mAddedFiles.isEmpty()) {
+        saveCache();
+    }
+}
+
+void StagefrightMediaScanner::setMetadataCachePath(const char *path) {
+    if (!mAddedFiles.isEmpty()) {
+        saveCache();
+    }
+    mCachePath = path != NULL ? path : "";
+    mCacheLoaded = false;
+    mCache.clear();
+    mAddedFiles.clear();
+}
 
 static bool FileHasAcceptableExtension(const char *extension) {
     static const char *kValidExtensions[] = {
@@ -62,7 +101,7 @@ static bool FileHasAcceptableExtension(const char *extension) {
 }
 
 static MediaScanResult HandleMIDI(
-        const char *filename, MediaScannerClient *client) {
+        const char *filename, AString *duration) {
     // get the library configuration and do sanity check
     const S_EAS_LIB_CONFIG* pLibConfig = EAS_Config();
     if ((pLibConfig == NULL) || (LIB_VERSION != pLibConfig->libVersion)) {
@@ -102,10 +141,7 @@ static MediaScanResult HandleMIDI(
 
     char buffer[20];
     sprintf(buffer, "%ld", temp);
-    status_t status = client->addStringTag("duration", buffer);
-    if (status != OK) {
-        return MEDIA_SCAN_RESULT_ERROR;
-    }
+    *duration = buffer;
     return MEDIA_SCAN_RESULT_OK;
 }
 
@@ -134,6 +170,39 @@ MediaScanResult StagefrightMediaScanner::processFileInternal(
         return MEDIA_SCAN_RESULT_SKIPPED;
     }
 
+    struct stat statbuf;
+    bool cacheable = !mCachePath.empty() && stat(path, &statbuf) == 0;
+
+    Vector<CachedTag> tags;
+    if (!cacheable
+            || !lookUpCache(path, statbuf.st_size, statbuf.st_mtime, &tags)) {
+        MediaScanResult result = extractMetadata(path, extension, &tags);
+        if (result != MEDIA_SCAN_RESULT_OK) {
+            return result;
+        }
+        if (cacheable) {
+            addToCache(path, statbuf.st_size, statbuf.st_mtime, tags);
+        }
+    }
+
+    for (size_t i = 0; i < tags.size(); ++i) {
+        status_t status;
+        if (tags[i].mName.empty()) {
+            status = client.setMimeType(tags[i].mValue.c_str());
+        } else {
+            status = client.addStringTag(
+                    tags[i].mName.c_str(), tags[i].mValue.c_str());
+        }
+        if (status != OK) {
+            return MEDIA_SCAN_RESULT_ERROR;
+        }
+    }
+
+    return MEDIA_SCAN_RESULT_OK;
+}
+
+MediaScanResult StagefrightMediaScanner::extractMetadata(
+        const char *path, const char *extension, Vector<CachedTag> *tags) {
     if (!strcasecmp(extension, ".mid")
             || !strcasecmp(extension, ".smf")
             || !strcasecmp(extension, ".imy")
@@ -143,7 +212,13 @@ MediaScanResult StagefrightMediaScanner::processFileInternal(
             || !strcasecmp(extension, ".rtx")
             || !strcasecmp(extension, ".ota")
             || !strcasecmp(extension, ".mxmf")) {
-        return HandleMIDI(path, &client);
+        CachedTag tag;
+        tag.mName = "duration";
+        MediaScanResult result = HandleMIDI(path, &tag.mValue);
+        if (result == MEDIA_SCAN_RESULT_OK) {
+            tags->push_back(tag);
+        }
+        return result;
     }
 
     sp<MediaMetadataRetriever> mRetriever(new MediaMetadataRetriever);
@@ -165,10 +240,9 @@ MediaScanResult StagefrightMediaScanner::processFileInternal(
     const char *value;
     if ((value = mRetriever->extractMetadata(
                     METADATA_KEY_MIMETYPE)) != NULL) {
-        status = client.setMimeType(value);
-        if (status) {
-            return MEDIA_SCAN_RESULT_ERROR;
-        }
+        CachedTag tag;
+        tag.mValue = value;
+        tags->push_back(tag);
     }
 
     struct KeyMap {
@@ -197,16 +271,252 @@ MediaScanResult StagefrightMediaScanner::processFileInternal(
     for (size_t i = 0; i < kNumEntries; ++i) {
         const char *value;
         if ((value = mRetriever->extractMetadata(kKeyMap[i].key)) != NULL) {
-            status = client.addStringTag(kKeyMap[i].tag, value);
-            if (status != OK) {
-                return MEDIA_SCAN_RESULT_ERROR;
-            }
+            CachedTag tag;
+            tag.mName = kKeyMap[i].tag;
+            tag.mValue = value;
+            tags->push_back(tag);
         }
     }
 
     return MEDIA_SCAN_RESULT_OK;
 }
 
+bool StagefrightMediaScanner::lookUpCache(
+        const char *path, int64_t size, int64_t modified,
+        Vector<CachedTag> *tags) {
+    if (!mCacheLoaded) {
+        loadCache();
+    }
+
+    ssize_t index = mCache.indexOfKey(AString(path));
+    if (index < 0) {
+        return false;
+    }
+
+    CachedFile &file = mCache.editValueAt(index);
+    if (file.mSize != size || file.mModified != modified) {
+        ALOGV("'%s' changed since it was cached", path);
+        return false;
+    }
+
+    file.mUsed = true;
+    *tags = file.mTags;
+    ++mNumCacheHits;
+    return true;
+}
+
+void StagefrightMediaScanner::addToCache(
+        const char *path, int64_t size, int64_t modified,
+        const Vector<CachedTag> &tags) {
+    if (strlen(path) > kMaxCachedStringLength) {
+        return;
+    }
+    for (size_t i = 0; i < tags.size(); ++i) {
+        if (tags[i].mName.size() > kMaxCachedStringLength
+                || tags[i].mValue.size() > kMaxCachedStringLength) {
+            return;
+        }
+    }
+
+    CachedFile file;
+    file.mPath = path;
+    file.mSize = size;
+    file.mModified = modified;
+    file.mUsed = true;
+    file.mOrder = mAddedFiles.size();
+    file.mTags = tags;
+    mAddedFiles.push_back(file);
+}
+
+// The cache file is host endian, it isn't meant to leave the device:
+// the magic and version, the number of files and then, for every file,
+// its path, size, modification time, number of tags and tags. Strings are
+// a 32 bit length followed by as many bytes.
+
+static bool ReadUInt32(FILE *fp, uint32_t *x) {
+    return fread(x, sizeof(*x), 1, fp) == 1;
+}
+
+static bool ReadInt64(FILE *fp, int64_t *x) {
+    return fread(x, sizeof(*x), 1, fp) == 1;
+}
+
+static bool ReadString(FILE *fp, AString *s) {
+    uint32_t length;
+    if (!ReadUInt32(fp, &length) || length > kMaxCachedStringLength) {
+        return false;
+    }
+    if (length == 0) {
+        s->clear();
+        return true;
+    }
+    char *buffer = (char *)malloc(length);
+    if (buffer == NULL) {
+        return false;
+    }
+    bool ok = fread(buffer, length, 1, fp) == 1;
+    if (ok) {
+        s->setTo(buffer, length);
+    }
+    free(buffer);
+    return ok;
+}
+
+static bool WriteUInt32(FILE *fp, uint32_t x) {
+    return fwrite(&x, sizeof(x), 1, fp) == 1;
+}
+
+static bool WriteInt64(FILE *fp, int64_t x) {
+    return fwrite(&x, sizeof(x), 1, fp) == 1;
+}
+
+static bool WriteString(FILE *fp, const AString &s) {
+    return WriteUInt32(fp, s.size())
+        && (s.size() == 0 || fwrite(s.c_str(), s.size(), 1, fp) == 1);
+}
+
+void StagefrightMediaScanner::loadCache() {
+    mCacheLoaded = true;
+    mCache.clear();
+
+    FILE *fp = fopen(mCachePath.c_str(), "rb");
+    if (fp == NULL) {
+        ALOGV("no metadata cache at '%s'", mCachePath.c_str());
+        return;
+    }
+
+    uint32_t magic, version, numFiles;
+    bool ok = ReadUInt32(fp, &magic) && magic == kCacheMagic
+        && ReadUInt32(fp, &version) && version == kCacheVersion
+        && ReadUInt32(fp, &numFiles) && numFiles <= kMaxCachedFiles;
+
+    for (uint32_t i = 0; ok && i < numFiles; ++i) {
+        CachedFile file;
+        uint32_t numTags;
+        ok = ReadString(fp, &file.mPath)
+            && ReadInt64(fp, &file.mSize)
+            && ReadInt64(fp, &file.mModified)
+            && ReadUInt32(fp, &numTags);
+
+        for (uint32_t j = 0; ok && j < numTags; ++j) {
+            CachedTag tag;
+            ok = ReadString(fp, &tag.mName) && ReadString(fp, &tag.mValue);
+            file.mTags.push_back(tag);
+        }
+
+        file.mUsed = false;
+        file.mOrder = 0;
+
+        // written in path order, added at the end
+        if (ok) {
+            mCache.add(file.mPath, file);
+        }
+    }
+    fclose(fp);
+
+    if (!ok) {
+        ALOGW("discarding the corrupt metadata cache at '%s'", mCachePath.c_str());
+        mCache.clear();
+    }
+}
+
+// static
+int StagefrightMediaScanner::CompareCachedFiles(
+        const CachedFile *fileA, const CachedFile *fileB) {
+    int result = fileA->mPath.compare(fileB->mPath);
+    if (result != 0) {
+        return result;
+    }
+    return fileA->mOrder < fileB->mOrder ? -1 : fileA->mOrder > fileB->mOrder;
+}
+
+void StagefrightMediaScanner::saveCache() {
+    if (!mCacheLoaded) {
+        loadCache();
+    }
+
+    mAddedFiles.sort(CompareCachedFiles);
+
+    // The last extraction of a path, and the loaded files not extracted
+    // again, in path order.
+    Vector<CachedFile> files;
+    size_t i = 0, j = 0;
+    while (i < mCache.size() || j < mAddedFiles.size()) {
+        if (j < mAddedFiles.size()
+                && (i == mCache.size()
+                    || !(mCache.keyAt(i) < mAddedFiles[j].mPath))) {
+            while (j + 1 < mAddedFiles.size()
+                    && mAddedFiles[j + 1].mPath == mAddedFiles[j].mPath) {
+                ++j;
+            }
+            if (i < mCache.size() && mCache.keyAt(i) == mAddedFiles[j].mPath) {
+                ++i;
+            }
+            files.push_back(mAddedFiles[j++]);
+        } else {
+            files.push_back(mCache.valueAt(i++));
+        }
+    }
+
+    size_t numUnused = 0;
+    for (size_t k = 0; k < files.size(); ++k) {
+        if (!files[k].mUsed) {
+            ++numUnused;
+        }
+    }
+    size_t numToDrop = files.size() > kMaxCachedFiles
+        ? files.size() - kMaxCachedFiles : 0;
+    size_t numUnusedToDrop = numToDrop < numUnused ? numToDrop : numUnused;
+    size_t numUsedToDrop = numToDrop - numUnusedToDrop;
+
+    AString tmpPath = mCachePath;
+    tmpPath.append(".tmp");
+
+    FILE *fp = fopen(tmpPath.c_str(), "wb");
+    if (fp == NULL) {
+        ALOGW("failed to write the metadata cache to '%s': %s",
+                tmpPath.c_str(), strerror(errno));
+        return;
+    }
+
+    bool ok = WriteUInt32(fp, kCacheMagic)
+        && WriteUInt32(fp, kCacheVersion)
+        && WriteUInt32(fp, files.size() - numToDrop);
+
+    for (size_t k = 0; ok && k < files.size(); ++k) {
+        const CachedFile &file = files[k];
+        if (!file.mUsed && numUnusedToDrop > 0) {
+            --numUnusedToDrop;
+            continue;
+        } else if (file.mUsed && numUsedToDrop > 0) {
+            --numUsedToDrop;
+            continue;
+        }
+
+        ok = WriteString(fp, file.mPath)
+            && WriteInt64(fp, file.mSize)
+            && WriteInt64(fp, file.mModified)
+            && WriteUInt32(fp, file.mTags.size());
+
+        for (size_t t = 0; ok && t < file.mTags.size(); ++t) {
+            ok = WriteString(fp, file.mTags[t].mName)
+                && WriteString(fp, file.mTags[t].mValue);
+        }
+    }
+
+    if (fclose(fp) != 0) {
+        ok = false;
+    }
+
+    if (!ok || rename(tmpPath.c_str(), mCachePath.c_str()) != 0) {
+        ALOGW("failed to write the metadata cache to '%s'", mCachePath.c_str());
+        unlink(tmpPath.c_str());
+        return;
+    }
+
+    mAddedFiles.clear();
+}
+
 MediaAlbumArt *StagefrightMediaScanner::extractAlbumArt(int fd) {
     ALOGV("extractAlbumArt %d", fd);
 
@@ -39,7 +39,8 @@
 namespace android {
 
 StagefrightMetadataRetriever::StagefrightMetadataRetriever()
-    : mParsedMetaData(false),
+    : mMetaDataOnly(false),
+      mParsedMetaData(false),
       mAlbumArt(NULL) {
     ALOGV("StagefrightMetadataRetriever()");
 
@@ -74,7 +75,9 @@ status_t StagefrightMetadataRetriever::setDataSource(
         return UNKNOWN_ERROR;
     }
 
-    mExtractor = MediaExtractor::Create(mSource);
+    mExtractor = MediaExtractor::Create(
+            mSource, NULL /* mime */, MediaExtractor::kMetaDataOnly);
+    mMetaDataOnly = true;
 
     if (mExtractor == NULL) {
         ALOGE("Unable to instantiate an extractor for '%s'.", uri);
@@ -111,7 +114,9 @@ status_t StagefrightMetadataRetriever::setDataSource(
         return err;
     }
 
-    mExtractor = MediaExtractor::Create(mSource);
+    mExtractor = MediaExtractor::Create(
+            mSource, NULL /* mime */, MediaExtractor::kMetaDataOnly);
+    mMetaDataOnly = true;
 
     if (mExtractor == NULL) {
         mSource.clear();
@@ -153,7 +158,9 @@ static VideoFrame *extractVideoFrameWithCodecFlags(
         const sp<MediaSource> &source,
         uint32_t flags,
         int64_t frameTimeUs,
-        int seekMode) {
+        int seekMode,
+        int32_t targetWidth,
+        int32_t targetHeight) {
 
     sp<MetaData> format = source->getFormat();
 
@@ -278,9 +285,36 @@ static VideoFrame *extractVideoFrameWithCodecFlags(
         rotationAngle = 0;  // By default, no rotation
     }
 
+    int32_t srcFormat;
+    CHECK(meta->findInt32(kKeyColorFormat, &srcFormat));
+
+    ColorConverter converter(
+            (OMX_COLOR_FORMATTYPE)srcFormat, OMX_COLOR_Format16bitRGB565);
+
+    // Downscaled while converted, by the largest factor that leaves the frame
+    // at least the size asked for once rotated, rather than converting all of
+    // it for the caller to scale it down.
+    int32_t scale = 1;
+    if (targetWidth > 0 && targetHeight > 0 && converter.canDownscale()) {
+        if (rotationAngle == 90 || rotationAngle == 270) {
+            int32_t tmp = targetWidth;
+            targetWidth = targetHeight;
+            targetHeight = tmp;
+        }
+
+        int32_t scaleX = (crop_right - crop_left + 1) / targetWidth;
+        int32_t scaleY = (crop_bottom - crop_top + 1) / targetHeight;
+        scale = scaleX < scaleY ? scaleX : scaleY;
+        if (scale < 1) {
+            scale = 1;
+        }
+        ALOGV("downscaling %dx%d by %d", crop_right - crop_left + 1,
+                crop_bottom - crop_top + 1, scale);
+    }
+
     VideoFrame *frame = new VideoFrame;
-    frame->mWidth = crop_right - crop_left + 1;
-    frame->mHeight = crop_bottom - crop_top + 1;
+    frame->mWidth = (crop_right - crop_left + 1) / scale;
+    frame->mHeight = (crop_bottom - crop_top + 1) / scale;
     frame->mDisplayWidth = frame->mWidth;
     frame->mDisplayHeight = frame->mHeight;
     frame->mSize = frame->mWidth * frame->mHeight * 2;
@@ -289,23 +323,20 @@ static VideoFrame *extractVideoFrameWithCodecFlags(
 
     int32_t displayWidth, displayHeight;
     if (meta->findInt32(kKeyDisplayWidth, &displayWidth)) {
-        frame->mDisplayWidth = displayWidth;
+        frame->mDisplayWidth = displayWidth / scale;
     }
     if (meta->findInt32(kKeyDisplayHeight, &displayHeight)) {
-        frame->mDisplayHeight = displayHeight;
+        frame->mDisplayHeight = displayHeight / scale;
     }
 
-    int32_t srcFormat;
-    CHECK(meta->findInt32(kKeyColorFormat, &srcFormat));
-
-    ColorConverter converter(
-            (OMX_COLOR_FORMATTYPE)srcFormat, OMX_COLOR_Format16bitRGB565);
-
     if (converter.isValid()) {
+        // less the odd pixels of the crop that make no whole block
         err = converter.convert(
                 (const uint8_t *)buffer->data() + buffer->range_offset(),
                 width, height,
-                crop_left, crop_top, crop_right, crop_bottom,
+                crop_left, crop_top,
+                crop_left + frame->mWidth * scale - 1,
+                crop_top + frame->mHeight * scale - 1,
                 frame->mData,
                 frame->mWidth,
                 frame->mHeight,
@@ -338,11 +369,36 @@ VideoFrame *StagefrightMetadataRetriever::getFrameAtTime(
 
     ALOGV("getFrameAtTime: %" PRId64 " us option: %d", timeUs, option);
 
+    return extractFrame(timeUs, option, 0, 0);
+}
+
+VideoFrame *StagefrightMetadataRetriever::getThumbnailAtTime(
+        int64_t timeUs, int option, int32_t width, int32_t height) {
+
+    ALOGV("getThumbnailAtTime: %" PRId64 " us option: %d size: %dx%d",
+            timeUs, option, width, height);
+
+    return extractFrame(timeUs, option, width, height);
+}
+
+VideoFrame *StagefrightMetadataRetriever::extractFrame(
+        int64_t timeUs, int option, int32_t width, int32_t height) {
     if (mExtractor.get() == NULL) {
         ALOGV("no extractor.");
         return NULL;
     }
 
+    if (mMetaDataOnly) {
+        // for the sample tables left out for metadata
+        sp<MediaExtractor> extractor = MediaExtractor::Create(mSource);
+        if (extractor == NULL) {
+            ALOGV("unable to instantiate a full extractor.");
+            return NULL;
+        }
+        mExtractor = extractor;
+        mMetaDataOnly = false;
+    }
+
     sp<MetaData> fileMeta = mExtractor->getMetaData();
 
     if (fileMeta == NULL) {
@@ -399,14 +455,14 @@ VideoFrame *StagefrightMetadataRetriever::getFrameAtTime(
     VideoFrame *frame =
         extractVideoFrameWithCodecFlags(
                 &mClient, trackMeta, source, OMXCodec::kSoftwareCodecsOnly,
-                timeUs, option);
+                timeUs, option, width, height);
 
     if (frame == NULL) {
         ALOGV("Software decoder failed to extract thumbnail, "
              "trying hardware decoder.");
 
         frame = extractVideoFrameWithCodecFlags(&mClient, trackMeta, source, 0,
-                        timeUs, option);
+                        timeUs, option, width, height);
     }
 
     return frame;
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "TSPacketUtils"
+#include <utils/Log.h>
+
+#include "include/TSPacketUtils.h"
+
+#include <media/stagefright/foundation/ADebug.h>
+
+#include <pthread.h>
+#include <string.h>
+
+namespace android {
+
+uint8_t *WriteTSPacketHeader(
+        uint8_t *packet, unsigned PID, bool payloadUnitStart,
+        unsigned continuityCounter, size_t numPaddingBytes) {
+    CHECK_LE(numPaddingBytes, (size_t)kTSMaxPayloadSize);
+
+    uint8_t *ptr = packet;
+    *ptr++ = 0x47;
+    *ptr++ = (payloadUnitStart ? 0x40 : 0x00) | ((PID >> 8) & 0x1f);
+    *ptr++ = PID & 0xff;
+    *ptr++ = (numPaddingBytes > 0 ? 0x30 : 0x10) | (continuityCounter & 0x0f);
+
+    if (numPaddingBytes > 0) {
+        // adaptation_field_length, then no flags and stuffing bytes
+        *ptr++ = numPaddingBytes - 1;
+        if (numPaddingBytes >= 2) {
+            *ptr++ = 0x00;
+            memset(ptr, 0xff, numPaddingBytes - 2);
+            ptr += numPaddingBytes - 2;
+        }
+    }
+
+    return ptr;
+}
+
+void WriteTSPacket(
+        uint8_t *packet, unsigned PID, bool payloadUnitStart,
+        unsigned continuityCounter, const uint8_t *payload, size_t size) {
+    CHECK_LE(size, (size_t)kTSMaxPayloadSize);
+
+    uint8_t *ptr = WriteTSPacketHeader(
+            packet, PID, payloadUnitStart, continuityCounter,
+            kTSMaxPayloadSize - size);
+    memcpy(ptr, payload, size);
+}
+
+size_t NumTSContinuationPackets(size_t size) {
+    return (size + kTSMaxPayloadSize - 1) / kTSMaxPayloadSize;
+}
+
+// The section CRC is the MSB-first CRC32 with polynomial 0x04C11DB7 and no
+// final inversion; it is computed four bytes at a time ("slice-by-4"),
+// kCRCTable[k] advancing the CRC past a byte followed by k zero bytes.
+static uint32_t kCRCTable[4][256];
+static pthread_once_t kCRCTableOnce = PTHREAD_ONCE_INIT;
+
+static void InitCRCTable() {
+    static const uint32_t kPoly = 0x04C11DB7;
+
+    for (int i = 0; i < 256; ++i) {
+        uint32_t crc = i << 24;
+        for (int j = 0; j < 8; ++j) {
+            crc = (crc << 1) ^ ((crc & 0x80000000) ? kPoly : 0);
+        }
+        kCRCTable[0][i] = crc;
+    }
+
+    for (int i = 0; i < 256; ++i) {
+        for (int k = 1; k < 4; ++k) {
+            uint32_t crc = kCRCTable[k - 1][i];
+            kCRCTable[k][i] = (crc << 8) ^ kCRCTable[0][crc >> 24];
+        }
+    }
+}
+
+uint32_t TSSectionCRC32(const uint8_t *data, size_t size) {
+    pthread_once(&kCRCTableOnce, InitCRCTable);
+
+    uint32_t crc = 0xffffffff;
+    const uint8_t *p = data;
+    const uint8_t *end = data + size;
+
+    while (end - p >= 4) {
+        crc ^= (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+        crc = kCRCTable[3][crc >> 24]
+            ^ kCRCTable[2][(crc >> 16) & 0xff]
+            ^ kCRCTable[1][(crc >> 8) & 0xff]
+            ^ kCRCTable[0][crc & 0xff];
+        p += 4;
+    }
+
+    while (p < end) {
+        crc = (crc << 8) ^ kCRCTable[0][((crc >> 24) ^ *p++) & 0xff];
+    }
+
+    return crc;
+}
+
+}  // namespace android
@@ -42,7 +42,8 @@ namespace android {
 static int64_t kWakelockMinDelay = 100000ll;  // 100ms
 
 TimedEventQueue::TimedEventQueue()
-    : mNextEventID(1),
+    : mNextSeq(0),
+      mNextEventID(1),
       mRunning(false),
       mStopped(false),
       mDeathRecipient(new PMDeathRecipient(this)),
@@ -109,42 +110,124 @@ TimedEventQueue::event_id TimedEventQueue::postEventToBack(
 }
 
 TimedEventQueue::event_id TimedEventQueue::postEventWithDelay(
-        const sp<Event> &event, int64_t delay_us) {
+        const sp<Event> &event, int64_t delay_us, int64_t slack_us) {
     CHECK(delay_us >= 0);
-    return postTimedEvent(event, ALooper::GetNowUs() + delay_us);
+    return postTimedEvent(event, ALooper::GetNowUs() + delay_us, slack_us);
 }
 
 TimedEventQueue::event_id TimedEventQueue::postTimedEvent(
-        const sp<Event> &event, int64_t realtime_us) {
+        const sp<Event> &event, int64_t realtime_us, int64_t slack_us) {
+    CHECK(slack_us >= 0);
+
     Mutex::Autolock autoLock(mLock);
 
     event->setEventID(mNextEventID++);
 
-    List<QueueItem>::iterator it = mQueue.begin();
-    while (it != mQueue.end() && realtime_us >= (*it).realtime_us) {
-        ++it;
-    }
-
     QueueItem item;
     item.event = event;
     item.realtime_us = realtime_us;
-    item.has_wakelock = false;
-
-    if (it == mQueue.begin()) {
-        mQueueHeadChangedCondition.signal();
+    item.deadline_us = realtime_us;
+    if (slack_us > 0 && realtime_us >= 0) {
+        item.deadline_us = (realtime_us > INT64_MAX - 1 - slack_us)
+            ? INT64_MAX - 1 : realtime_us + slack_us;
     }
+    item.seq = mNextSeq++;
+    item.has_wakelock = false;
 
     if (realtime_us > ALooper::GetNowUs() + kWakelockMinDelay) {
         acquireWakeLock_l();
         item.has_wakelock = true;
     }
-    mQueue.insert(it, item);
+
+    mQueue.push_back(item);
+    siftUp_l(mQueue.size() - 1);
+
+    if (mQueue[0].event == event) {
+        mQueueHeadChangedCondition.signal();
+    }
 
     mQueueNotEmptyCondition.signal();
 
     return event->eventID();
 }
 
+// static
+bool TimedEventQueue::Before(const QueueItem &a, const QueueItem &b) {
+    if (a.deadline_us != b.deadline_us) {
+        return a.deadline_us < b.deadline_us;
+    }
+    return (int32_t)(a.seq - b.seq) < 0;
+}
+
+void TimedEventQueue::siftUp_l(size_t index) {
+    while (index > 0) {
+        size_t parent = (index - 1) / 2;
+        if (!Before(mQueue[index], mQueue[parent])) {
+            break;
+        }
+        QueueItem tmp = mQueue[index];
+        mQueue.editItemAt(index) = mQueue[parent];
+        mQueue.editItemAt(parent) = tmp;
+        index = parent;
+    }
+}
+
+void TimedEventQueue::siftDown_l(size_t index) {
+    size_t size = mQueue.size();
+    for (;;) {
+        size_t smallest = index;
+        size_t left = 2 * index + 1;
+        size_t right = left + 1;
+        if (left < size && Before(mQueue[left], mQueue[smallest])) {
+            smallest = left;
+        }
+        if (right < size && Before(mQueue[right], mQueue[smallest])) {
+            smallest = right;
+        }
+        if (smallest == index) {
+            break;
+        }
+        QueueItem tmp = mQueue[index];
+        mQueue.editItemAt(index) = mQueue[smallest];
+        mQueue.editItemAt(smallest) = tmp;
+        index = smallest;
+    }
+}
+
+void TimedEventQueue::removeAt_l(size_t index) {
+    size_t last = mQueue.size() - 1;
+    if (index != last) {
+        mQueue.editItemAt(index) = mQueue[last];
+    }
+    mQueue.removeAt(last);
+    if (index < mQueue.size()) {
+        siftDown_l(index);
+        siftUp_l(index);
+    }
+}
+
+ssize_t TimedEventQueue::findDueEvent_l(int64_t now_us) const {
+    if (mQueue.empty()) {
+        return -1;
+    }
+
+    int64_t when_us = mQueue[0].deadline_us;
+    if (when_us < 0 || when_us == INT64_MAX || when_us <= now_us) {
+        return 0;
+    }
+
+    // Awake anyway: fire the events whose slack window this falls in now
+    // rather than wake up again for them.
+    ssize_t due = -1;
+    for (size_t i = 1; i < mQueue.size(); ++i) {
+        if (mQueue[i].realtime_us <= now_us
+                && (due < 0 || Before(mQueue[i], mQueue[due]))) {
+            due = i;
+        }
+    }
+    return due;
+}
+
 static bool MatchesEventID(
         void *cookie, const sp<TimedEventQueue::Event> &event) {
     TimedEventQueue::event_id *id =
@@ -178,26 +261,35 @@ void TimedEventQueue::cancelEvents(
         bool stopAfterFirstMatch) {
     Mutex::Autolock autoLock(mLock);
 
-    List<QueueItem>::iterator it = mQueue.begin();
-    while (it != mQueue.end()) {
-        if (!(*predicate)(cookie, (*it).event)) {
-            ++it;
-            continue;
+    // in heap order, which removing events reshuffles
+    Vector<sp<Event> > matches;
+    for (size_t i = 0; i < mQueue.size(); ++i) {
+        if ((*predicate)(cookie, mQueue[i].event)) {
+            matches.push_back(mQueue[i].event);
+            if (stopAfterFirstMatch) {
+                break;
+            }
         }
+    }
 
-        if (it == mQueue.begin()) {
-            mQueueHeadChangedCondition.signal();
-        }
+    for (size_t i = 0; i < matches.size(); ++i) {
+        for (size_t j = 0; j < mQueue.size(); ++j) {
+            if (mQueue[j].event != matches[i]) {
+                continue;
+            }
+
+            if (j == 0) {
+                mQueueHeadChangedCondition.signal();
+            }
 
-        ALOGV("cancelling event %d", (*it).event->eventID());
+            ALOGV("cancelling event %d", mQueue[j].event->eventID());
 
-        (*it).event->setEventID(0);
-        if ((*it).has_wakelock) {
-            releaseWakeLock_l();
-        }
-        it = mQueue.erase(it);
-        if (stopAfterFirstMatch) {
-            return;
+            mQueue[j].event->setEventID(0);
+            if (mQueue[j].has_wakelock) {
+                releaseWakeLock_l();
+            }
+            removeAt_l(j);
+            break;
         }
     }
 }
@@ -239,25 +331,19 @@ void TimedEventQueue::threadEntry() {
                     break;
                 }
 
-                List<QueueItem>::iterator it = mQueue.begin();
-                eventID = (*it).event->eventID();
-
                 now_us = ALooper::GetNowUs();
-                int64_t when_us = (*it).realtime_us;
-
-                int64_t delay_us;
-                if (when_us < 0 || when_us == INT64_MAX) {
-                    delay_us = 0;
-                } else {
-                    delay_us = when_us - now_us;
-                }
-
-                if (delay_us <= 0) {
+                ssize_t index = findDueEvent_l(now_us);
+                if (index >= 0) {
+                    eventID = mQueue[index].event->eventID();
                     break;
                 }
 
+                // Up to the earliest deadline: an event posted with a slack
+                // is left for another event to wake the queue up in its
+                // window, if one does.
+                int64_t delay_us = mQueue[0].deadline_us - now_us;
+
                 static int64_t kMaxTimeoutUs = 10000000ll;  // 10 secs
-                bool timeoutCapped = false;
                 if (delay_us > kMaxTimeoutUs) {
                     ALOGW("delay_us exceeds max timeout: %" PRId64 " us", delay_us);
 
@@ -266,18 +352,10 @@ void TimedEventQueue::threadEntry() {
                     // 10 secs at a time. This will also avoid overflow
                     // when converting from us to ns.
                     delay_us = kMaxTimeoutUs;
-                    timeoutCapped = true;
                 }
 
-                status_t err = mQueueHeadChangedCondition.waitRelative(
+                mQueueHeadChangedCondition.waitRelative(
                         mLock, delay_us * 1000ll);
-
-                if (!timeoutCapped && err == -ETIMEDOUT) {
-                    // We finally hit the time this event is supposed to
-                    // trigger.
-                    now_us = ALooper::GetNowUs();
-                    break;
-                }
             }
 
             // The event w/ this id may have been cancelled while we're
@@ -301,13 +379,12 @@ void TimedEventQueue::threadEntry() {
 
 sp<TimedEventQueue::Event> TimedEventQueue::removeEventFromQueue_l(
         event_id id, bool *wakeLocked) {
-    for (List<QueueItem>::iterator it = mQueue.begin();
-         it != mQueue.end(); ++it) {
-        if ((*it).event->eventID() == id) {
-            sp<Event> event = (*it).event;
+    for (size_t i = 0; i < mQueue.size(); ++i) {
+        if (mQueue[i].event->eventID() == id) {
+            sp<Event> event = mQueue[i].event;
             event->setEventID(0);
-            *wakeLocked = (*it).has_wakelock;
-            mQueue.erase(it);
+            *wakeLocked = mQueue[i].has_wakelock;
+            removeAt_l(i);
             return event;
         }
     }
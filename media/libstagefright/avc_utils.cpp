@@ -252,9 +252,10 @@ status_t getNextNALUnit(
     size_t startOffset = offset;
 
     for (;;) {
-        while (offset < size && data[offset] != 0x01) {
-            ++offset;
-        }
+        // memchr() is vectorized, most bytes are not 0x01
+        const uint8_t *next =
+            (const uint8_t *)memchr(&data[offset], 0x01, size - offset);
+        offset = (next != NULL) ? next - data : size;
 
         if (offset == size) {
             if (startCodeFollows) {
@@ -43,6 +43,8 @@
 #define PROP_DRC_OVERRIDE_BOOST      "aac_drc_boost"
 #define PROP_DRC_OVERRIDE_HEAVY      "aac_drc_heavy"
 #define PROP_DRC_OVERRIDE_ENC_LEVEL "aac_drc_enc_target_level"
+// the number of frames to collect in each output buffer, see mNumBatchFrames
+#define PROP_BATCH_OUTPUT_FRAMES     "media.aac_batch_output_frames"
 
 namespace android {
 
@@ -68,6 +70,7 @@ SoftAAC2::SoftAAC2(
       mOutputBufferCount(0),
       mSignalledError(false),
       mLastInHeader(NULL),
+      mNumBatchFrames(1),
       mOutputPortSettingsChange(NONE) {
     initPorts();
     CHECK_EQ(initDecoder(), (status_t)OK);
@@ -145,6 +148,13 @@ status_t SoftAAC2::initDecoder() {
 
     //aacDecoder_SetParam(mAACDecoder, AAC_PCM_LIMITER_ENABLE, 0);
 
+    // fewer, fuller output buffers cost fewer OMX round trips, at the price of latency
+    char batchValue[PROPERTY_VALUE_MAX];
+    if (property_get(PROP_BATCH_OUTPUT_FRAMES, batchValue, NULL) && atoi(batchValue) > 1) {
+        mNumBatchFrames = atoi(batchValue);
+        ALOGV("collecting %d frames per output buffer", mNumBatchFrames);
+    }
+
     //init DRC wrapper
     mDrcWrap.setDecoderHandle(mAACDecoder);
     mDrcWrap.submitStreamData(mStreamInfo);
@@ -824,9 +834,21 @@ void SoftAAC2::onQueueFilled(OMX_U32 /* portIndex */) {
             }
         }
 
+        // When batching, wait until the frames for a full output buffer are decoded, or for
+        // the last ones at the end of the input.
+        int32_t frameSamples = mStreamInfo->frameSize * mStreamInfo->numChannels;
+        int32_t batchFrames = 1;
+        if (mNumBatchFrames > 1 && !mEndOfInput && frameSamples > 0) {
+            int32_t maxFrames = editPortInfo(1)->mDef.nBufferSize / sizeof(int16_t)
+                    / frameSamples;
+            batchFrames = mNumBatchFrames < maxFrames ? mNumBatchFrames : maxFrames;
+            if (batchFrames < 1) {
+                batchFrames = 1;
+            }
+        }
+
         while (!outQueue.empty()
-                && outputDelayRingBufferSamplesAvailable()
-                        >= mStreamInfo->frameSize * mStreamInfo->numChannels) {
+                && outputDelayRingBufferSamplesAvailable() >= frameSamples * batchFrames) {
             BufferInfo *outInfo = *outQueue.begin();
             OMX_BUFFERHEADERTYPE *outHeader = outInfo->mHeader;
 
@@ -887,6 +909,10 @@ void SoftAAC2::onQueueFilled(OMX_U32 /* portIndex */) {
                             ALOGV("moved to next time/size: %lld/%d",
                                     *nextTimeStamp, *currentBufLeft);
                         }
+                        // when batching, go on with the frames of the next input buffer
+                        if (mNumBatchFrames > 1 && !mBufferTimestamps.isEmpty()) {
+                            continue;
+                        }
                         // try to limit output buffer size to match input buffers
                         // (e.g when an input buffer contained 4 "sub" frames, output
                         // at most 4 decoded units in the corresponding output buffer)
@@ -65,6 +65,10 @@ private:
 
     CDrcPresModeWrapper mDrcWrap;
 
+    // Number of frames an output buffer collects before it is returned, 1 returns each
+    // input buffer's frames as soon as they are decoded
+    int32_t mNumBatchFrames;
+
     enum {
         NONE,
         AWAITING_DISABLED,
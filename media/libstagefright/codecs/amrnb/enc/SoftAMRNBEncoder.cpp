@@ -50,6 +50,8 @@ SoftAMRNBEncoder::SoftAMRNBEncoder(
       mMode(MR475),
       mInputSize(0),
       mInputTimeUs(-1ll),
+      mFramesPerBuffer(1),
+      mNumOutputFrames(0),
       mSawInputEOS(false),
       mSignalledError(false) {
     initPorts();
@@ -114,7 +116,9 @@ status_t SoftAMRNBEncoder::initEncoder() {
 
 OMX_ERRORTYPE SoftAMRNBEncoder::internalGetParameter(
         OMX_INDEXTYPE index, OMX_PTR params) {
-    switch (index) {
+    const int32_t indexFull = index;
+
+    switch (indexFull) {
         case OMX_IndexParamAudioPortFormat:
         {
             OMX_AUDIO_PARAM_PORTFORMATTYPE *formatParams =
@@ -175,6 +179,19 @@ OMX_ERRORTYPE SoftAMRNBEncoder::internalGetParameter(
             return OMX_ErrorNone;
         }
 
+        case kFramesPerBufferExtensionIndex:
+        {
+            OMX_PARAM_U32TYPE *framesParams = (OMX_PARAM_U32TYPE *)params;
+
+            if (framesParams->nPortIndex != 1) {
+                return OMX_ErrorUndefined;
+            }
+
+            framesParams->nU32 = mFramesPerBuffer;
+
+            return OMX_ErrorNone;
+        }
+
         default:
             return SimpleSoftOMXComponent::internalGetParameter(index, params);
     }
@@ -182,7 +199,9 @@ OMX_ERRORTYPE SoftAMRNBEncoder::internalGetParameter(
 
 OMX_ERRORTYPE SoftAMRNBEncoder::internalSetParameter(
         OMX_INDEXTYPE index, const OMX_PTR params) {
-    switch (index) {
+    const int32_t indexFull = index;
+
+    switch (indexFull) {
         case OMX_IndexParamStandardComponentRole:
         {
             const OMX_PARAM_COMPONENTROLETYPE *roleParams =
@@ -265,11 +284,43 @@ OMX_ERRORTYPE SoftAMRNBEncoder::internalSetParameter(
         }
 
 
+        case kFramesPerBufferExtensionIndex:
+        {
+            const OMX_PARAM_U32TYPE *framesParams =
+                (const OMX_PARAM_U32TYPE *)params;
+
+            if (framesParams->nPortIndex != 1
+                    || framesParams->nU32 < 1
+                    || framesParams->nU32 > kMaxFramesPerBuffer) {
+                return OMX_ErrorUndefined;
+            }
+
+            mFramesPerBuffer = framesParams->nU32;
+
+            return OMX_ErrorNone;
+        }
+
         default:
             return SimpleSoftOMXComponent::internalSetParameter(index, params);
     }
 }
 
+OMX_ERRORTYPE SoftAMRNBEncoder::getExtensionIndex(
+        const char *name, OMX_INDEXTYPE *index) {
+    if (!strcmp(name, "OMX.google.android.index.framesPerBuffer")) {
+        *(int32_t *)index = kFramesPerBufferExtensionIndex;
+        return OMX_ErrorNone;
+    }
+    return SimpleSoftOMXComponent::getExtensionIndex(name, index);
+}
+
+void SoftAMRNBEncoder::onPortFlushCompleted(OMX_U32 portIndex) {
+    if (portIndex == 1) {
+        // the frames of a buffer given back by the flush are dropped with it
+        mNumOutputFrames = 0;
+    }
+}
+
 void SoftAMRNBEncoder::onQueueFilled(OMX_U32 /* portIndex */) {
     if (mSignalledError) {
         return;
@@ -352,8 +403,15 @@ void SoftAMRNBEncoder::onQueueFilled(OMX_U32 /* portIndex */) {
         BufferInfo *outInfo = *outQueue.begin();
         OMX_BUFFERHEADERTYPE *outHeader = outInfo->mHeader;
 
-        uint8_t *outPtr = outHeader->pBuffer + outHeader->nOffset;
-        size_t outAvailable = outHeader->nAllocLen - outHeader->nOffset;
+        if (mNumOutputFrames == 0) {
+            outHeader->nFilledLen = 0;
+            outHeader->nTimeStamp = mInputTimeUs;
+        }
+
+        uint8_t *outPtr =
+            outHeader->pBuffer + outHeader->nOffset + outHeader->nFilledLen;
+        size_t outAvailable =
+            outHeader->nAllocLen - outHeader->nOffset - outHeader->nFilledLen;
 
         Frame_Type_3GPP frameType;
         int res = AMREncode(
@@ -366,7 +424,18 @@ void SoftAMRNBEncoder::onQueueFilled(OMX_U32 /* portIndex */) {
         // Convert header byte from WMF to IETF format.
         outPtr[0] = ((outPtr[0] << 3) | 4) & 0x7c;
 
-        outHeader->nFilledLen = res;
+        outHeader->nFilledLen += res;
+        mInputSize = 0;
+
+        // Frames are added until the buffer has mFramesPerBuffer of them or
+        // no room for one more.
+        if (++mNumOutputFrames < mFramesPerBuffer && !mSawInputEOS
+                && outHeader->nOffset + outHeader->nFilledLen
+                        + kMaxBytesPerFrame <= outHeader->nAllocLen) {
+            continue;
+        }
+        mNumOutputFrames = 0;
+
         outHeader->nFlags = OMX_BUFFERFLAG_ENDOFFRAME;
 
         if (mSawInputEOS) {
@@ -375,8 +444,6 @@ void SoftAMRNBEncoder::onQueueFilled(OMX_U32 /* portIndex */) {
             outHeader->nFlags = OMX_BUFFERFLAG_EOS;
         }
 
-        outHeader->nTimeStamp = mInputTimeUs;
-
 #if 0
         ALOGI("sending %d bytes of data (time = %lld us, flags = 0x%08lx)",
               nOutputBytes, mInputTimeUs, outHeader->nFlags);
@@ -390,8 +457,6 @@ void SoftAMRNBEncoder::onQueueFilled(OMX_U32 /* portIndex */) {
 
         outHeader = NULL;
         outInfo = NULL;
-
-        mInputSize = 0;
     }
 }
 
@@ -51,6 +51,8 @@ SoftAMRWBEncoder::SoftAMRWBEncoder(
       mMode(VOAMRWB_MD66),
       mInputSize(0),
       mInputTimeUs(-1ll),
+      mFramesPerBuffer(1),
+      mNumOutputFrames(0),
       mSawInputEOS(false),
       mSignalledError(false) {
     initPorts();
@@ -149,7 +151,9 @@ status_t SoftAMRWBEncoder::initEncoder() {
 
 OMX_ERRORTYPE SoftAMRWBEncoder::internalGetParameter(
         OMX_INDEXTYPE index, OMX_PTR params) {
-    switch (index) {
+    const int32_t indexFull = index;
+
+    switch (indexFull) {
         case OMX_IndexParamAudioPortFormat:
         {
             OMX_AUDIO_PARAM_PORTFORMATTYPE *formatParams =
@@ -213,6 +217,19 @@ OMX_ERRORTYPE SoftAMRWBEncoder::internalGetParameter(
             return OMX_ErrorNone;
         }
 
+        case kFramesPerBufferExtensionIndex:
+        {
+            OMX_PARAM_U32TYPE *framesParams = (OMX_PARAM_U32TYPE *)params;
+
+            if (framesParams->nPortIndex != 1) {
+                return OMX_ErrorUndefined;
+            }
+
+            framesParams->nU32 = mFramesPerBuffer;
+
+            return OMX_ErrorNone;
+        }
+
         default:
             return SimpleSoftOMXComponent::internalGetParameter(index, params);
     }
@@ -220,7 +237,9 @@ OMX_ERRORTYPE SoftAMRWBEncoder::internalGetParameter(
 
 OMX_ERRORTYPE SoftAMRWBEncoder::internalSetParameter(
         OMX_INDEXTYPE index, const OMX_PTR params) {
-    switch (index) {
+    const int32_t indexFull = index;
+
+    switch (indexFull) {
         case OMX_IndexParamStandardComponentRole:
         {
             const OMX_PARAM_COMPONENTROLETYPE *roleParams =
@@ -312,11 +331,43 @@ OMX_ERRORTYPE SoftAMRWBEncoder::internalSetParameter(
         }
 
 
+        case kFramesPerBufferExtensionIndex:
+        {
+            const OMX_PARAM_U32TYPE *framesParams =
+                (const OMX_PARAM_U32TYPE *)params;
+
+            if (framesParams->nPortIndex != 1
+                    || framesParams->nU32 < 1
+                    || framesParams->nU32 > kMaxFramesPerBuffer) {
+                return OMX_ErrorUndefined;
+            }
+
+            mFramesPerBuffer = framesParams->nU32;
+
+            return OMX_ErrorNone;
+        }
+
         default:
             return SimpleSoftOMXComponent::internalSetParameter(index, params);
     }
 }
 
+OMX_ERRORTYPE SoftAMRWBEncoder::getExtensionIndex(
+        const char *name, OMX_INDEXTYPE *index) {
+    if (!strcmp(name, "OMX.google.android.index.framesPerBuffer")) {
+        *(int32_t *)index = kFramesPerBufferExtensionIndex;
+        return OMX_ErrorNone;
+    }
+    return SimpleSoftOMXComponent::getExtensionIndex(name, index);
+}
+
+void SoftAMRWBEncoder::onPortFlushCompleted(OMX_U32 portIndex) {
+    if (portIndex == 1) {
+        // the frames of a buffer given back by the flush are dropped with it
+        mNumOutputFrames = 0;
+    }
+}
+
 void SoftAMRWBEncoder::onQueueFilled(OMX_U32 /* portIndex */) {
     if (mSignalledError) {
         return;
@@ -399,8 +450,15 @@ void SoftAMRWBEncoder::onQueueFilled(OMX_U32 /* portIndex */) {
         BufferInfo *outInfo = *outQueue.begin();
         OMX_BUFFERHEADERTYPE *outHeader = outInfo->mHeader;
 
-        uint8_t *outPtr = outHeader->pBuffer + outHeader->nOffset;
-        size_t outAvailable = outHeader->nAllocLen - outHeader->nOffset;
+        if (mNumOutputFrames == 0) {
+            outHeader->nFilledLen = 0;
+            outHeader->nTimeStamp = mInputTimeUs;
+        }
+
+        uint8_t *outPtr =
+            outHeader->pBuffer + outHeader->nOffset + outHeader->nFilledLen;
+        size_t outAvailable =
+            outHeader->nAllocLen - outHeader->nOffset - outHeader->nFilledLen;
 
         VO_CODECBUFFER inputData;
         memset(&inputData, 0, sizeof(inputData));
@@ -421,7 +479,18 @@ void SoftAMRWBEncoder::onQueueFilled(OMX_U32 /* portIndex */) {
                 mEncoderHandle, &outputData, &outputInfo);
         CHECK(ret == VO_ERR_NONE || ret == VO_ERR_INPUT_BUFFER_SMALL);
 
-        outHeader->nFilledLen = outputData.Length;
+        outHeader->nFilledLen += outputData.Length;
+        mInputSize = 0;
+
+        // Frames are added until the buffer has mFramesPerBuffer of them or
+        // no room for one more.
+        if (++mNumOutputFrames < mFramesPerBuffer && !mSawInputEOS
+                && outHeader->nOffset + outHeader->nFilledLen
+                        + kMaxBytesPerFrame <= outHeader->nAllocLen) {
+            continue;
+        }
+        mNumOutputFrames = 0;
+
         outHeader->nFlags = OMX_BUFFERFLAG_ENDOFFRAME;
 
         if (mSawInputEOS) {
@@ -430,8 +499,6 @@ void SoftAMRWBEncoder::onQueueFilled(OMX_U32 /* portIndex */) {
             outHeader->nFlags = OMX_BUFFERFLAG_EOS;
         }
 
-        outHeader->nTimeStamp = mInputTimeUs;
-
 #if 0
         ALOGI("sending %ld bytes of data (time = %lld us, flags = 0x%08lx)",
               outHeader->nFilledLen, mInputTimeUs, outHeader->nFlags);
@@ -445,8 +512,6 @@ void SoftAMRWBEncoder::onQueueFilled(OMX_U32 /* portIndex */) {
 
         outHeader = NULL;
         outInfo = NULL;
-
-        mInputSize = 0;
     }
 }
 
@@ -43,11 +43,17 @@ protected:
     virtual OMX_ERRORTYPE internalSetParameter(
             OMX_INDEXTYPE index, const OMX_PTR params);
 
+    virtual OMX_ERRORTYPE getExtensionIndex(
+            const char *name, OMX_INDEXTYPE *index);
+
     virtual void onQueueFilled(OMX_U32 portIndex);
+    virtual void onPortFlushCompleted(OMX_U32 portIndex);
 
 private:
     enum {
         kNumBuffers             = 4,
+        kMaxFramesPerBuffer     = 16,
+        kMaxBytesPerFrame       = 61,   // 23.85 kbps, with the header byte
         kNumSamplesPerFrame     = 320,
     };
 
@@ -62,6 +68,12 @@ private:
     int16_t mInputFrame[kNumSamplesPerFrame];
     int64_t mInputTimeUs;
 
+    // Encoded frames packed in an output buffer, one unless set through
+    // "OMX.google.android.index.framesPerBuffer", for fewer buffers to go
+    // back and forth on a call.
+    OMX_U32 mFramesPerBuffer;
+    OMX_U32 mNumOutputFrames;
+
     bool mSawInputEOS;
     bool mSignalledError;
 
@@ -32,6 +32,13 @@ LOCAL_CFLAGS := \
 
 LOCAL_CFLAGS += -Werror -fno-strict-aliasing
 
+# the SAD kernels in src/sad_inline.h and src/sad_halfpel.cpp have NEON paths
+ifeq ($(TARGET_ARCH),arm)
+  ifeq ($(ARCH_ARM_HAVE_NEON),true)
+    LOCAL_ARM_NEON := true
+  endif
+endif
+
 include $(BUILD_STATIC_LIBRARY)
 
 ################################################################################
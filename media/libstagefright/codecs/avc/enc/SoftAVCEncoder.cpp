@@ -34,6 +34,8 @@
 
 #include "SoftAVCEncoder.h"
 
+#include <unistd.h>
+
 #if LOG_NDEBUG
 #define UNUSED_UNLESS_VERBOSE(x) (void)(x)
 #else
@@ -158,6 +160,7 @@ SoftAVCEncoder::SoftAVCEncoder(
       mIDRFrameRefreshIntervalInSec(1),
       mAVCEncProfile(AVC_BASELINE),
       mAVCEncLevel(AVC_LEVEL2),
+      mSliceHeaderSpacing(0),
       mNumInputFrames(-1),
       mPrevTimestampUs(-1),
       mStarted(false),
@@ -265,6 +268,13 @@ OMX_ERRORTYPE SoftAVCEncoder::initEncParams() {
     }
     mEncParams->slice_group = mSliceGroup;
 
+    // Slices are whole MB rows, their motion search runs on one thread per core
+    if (mSliceHeaderSpacing > 0) {
+        int32_t mbWidth = (mVideoWidth + 15) >> 4;
+        mEncParams->num_slice_mb_rows = (mSliceHeaderSpacing + mbWidth - 1) / mbWidth;
+        mEncParams->num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
     // Set IDR frame refresh interval
     if (mIDRFrameRefreshIntervalInSec < 0) {
         mEncParams->idr_period = -1;
@@ -484,6 +494,7 @@ OMX_ERRORTYPE SoftAVCEncoder::internalGetParameter(
             avcParams->bDirect8x8Inference = OMX_FALSE;
             avcParams->bDirectSpatialTemporal = OMX_FALSE;
             avcParams->nCabacInitIdc = 0;
+            avcParams->nSliceHeaderSpacing = mSliceHeaderSpacing;
             return OMX_ErrorNone;
         }
 
@@ -666,6 +677,9 @@ OMX_ERRORTYPE SoftAVCEncoder::internalSetParameter(
                 return OMX_ErrorUndefined;
             }
 
+            // rounded up to whole MB rows when the encoder is initialized
+            mSliceHeaderSpacing = avcType->nSliceHeaderSpacing;
+
             return OMX_ErrorNone;
         }
 
@@ -851,19 +865,24 @@ void SoftAVCEncoder::onQueueFilled(OMX_U32 /* portIndex */) {
 
         // Encode an input video frame
         CHECK(encoderStatus == AVCENC_SUCCESS || encoderStatus == AVCENC_NEW_IDR);
-        dataLength = outHeader->nAllocLen;  // Reset the output buffer length
         if (inHeader->nFilledLen > 0) {
-            if (outHeader->nAllocLen >= 4) {
-                memcpy(outPtr, "\x00\x00\x00\x01", 4);
-                outPtr += 4;
-                dataLength -= 4;
-            }
-            encoderStatus = PVAVCEncodeNAL(mHandle, outPtr, &dataLength, &type);
-            dataLength = outPtr + dataLength - outHeader->pBuffer;
-            if (encoderStatus == AVCENC_SUCCESS) {
-                CHECK(NULL == PVAVCEncGetOverrunBuffer(mHandle));
-            } else if (encoderStatus == AVCENC_PICTURE_READY) {
-                CHECK(NULL == PVAVCEncGetOverrunBuffer(mHandle));
+            // Every slice of the picture is a NAL unit of its own, they all
+            // go into the output buffer behind start codes.
+            uint8_t *outEnd = (uint8_t *) outHeader->pBuffer + outHeader->nAllocLen;
+            do {
+                if (outEnd - outPtr >= 4) {
+                    memcpy(outPtr, "\x00\x00\x00\x01", 4);
+                    outPtr += 4;
+                }
+                dataLength = outEnd - outPtr;
+                encoderStatus = PVAVCEncodeNAL(mHandle, outPtr, &dataLength, &type);
+                if (encoderStatus == AVCENC_SUCCESS || encoderStatus == AVCENC_PICTURE_READY) {
+                    CHECK(NULL == PVAVCEncGetOverrunBuffer(mHandle));
+                    outPtr += dataLength;
+                }
+            } while (encoderStatus == AVCENC_SUCCESS);
+            dataLength = outPtr - outHeader->pBuffer;
+            if (encoderStatus == AVCENC_PICTURE_READY) {
                 if (mIsIDRFrame) {
                     outHeader->nFlags |= OMX_BUFFERFLAG_SYNCFRAME;
                     mIsIDRFrame = false;
@@ -77,6 +77,7 @@ private:
     int32_t  mIDRFrameRefreshIntervalInSec;
     AVCProfile mAVCEncProfile;
     AVCLevel   mAVCEncLevel;
+    int32_t  mSliceHeaderSpacing;  // in MBs, 0 for one slice per picture
 
     int64_t  mNumInputFrames;
     int64_t  mPrevTimestampUs;
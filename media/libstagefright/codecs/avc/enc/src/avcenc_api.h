@@ -124,6 +124,11 @@ typedef struct tagAVCEncParam
     /* fmo_type == 6 */
     uint *slice_group; /* array of size MBWidth*MBHeight */
 
+    int num_slice_mb_rows; /* number of MB rows per slice, 0 for one slice per slice group.
+                            Only supported with num_slice_group == 1 */
+    int num_threads;    /* number of threads used to search the slices of a picture in parallel,
+                        0 or 1 to search on the calling thread only */
+
     AVCFlag db_filter;  /* enable deblocking loop filter */
     int disable_db_idc;  /* 0: filter everywhere, 1: no filter, 2: no filter across slice boundary */
     int alpha_offset;   /* alpha offset range -6,...,6 */
@@ -351,6 +351,22 @@ typedef struct tagPadInfo
 } AVCPadInfo;
 
 
+/**
+This structure holds the motion estimation bounds and results of one slice of the picture.
+Slices are searched independently so that they can be searched in parallel.
+*/
+typedef struct tagMESlice
+{
+    int firstRow;       /* first MB row of the slice */
+    int lastRow;        /* last MB row of the slice */
+    int hp_guess;       /* half-pel search hint carried from MB to MB */
+    int numIntraSearch; /* number of MBs to be intra searched */
+    int totalSAD;       /* sum of the MAD of the searched MBs */
+} AVCMESlice;
+
+/* private to motion_est.cpp */
+typedef struct tagMEThreadPool AVCMEThreadPool;
+
 #ifdef HTFM
 typedef struct tagHTFM_Stat
 {
@@ -441,6 +457,15 @@ typedef struct tagEncObject
     /* encoding complexity control */
     uint fullsearch_enable; /* flag to enable full-pel full-search */
 
+    /* multiple slices per picture */
+    int numSliceMbRows;     /* MB rows per slice, 0 for one slice per slice group */
+    int numMEThreads;       /* number of threads for motion estimation */
+    AVCMESlice *meSlice;    /* array of motion estimation slices */
+    int numMESlices;        /* number of motion estimation slices */
+    int meTopRow;           /* first MB row of the slice being searched */
+    int meBottomRow;        /* last MB row of the slice being searched */
+    AVCMEThreadPool *meThreadPool; /* NULL when all slices are searched on the calling thread */
+
     /* misc.*/
     bool outOfBandParamSet; /* flag to enable out-of-band param set */
 
@@ -55,6 +55,15 @@ AVCEnc_Status  SetEncodeParam(AVCHandle* avcHandle, AVCEncParams* encParam,
 
     encvid->fullsearch_enable = encParam->fullsearch;
 
+    /* multiple slices per picture are not supported together with FMO */
+    if (encParam->num_slice_mb_rows < 0 || (encParam->num_slice_mb_rows > 0 &&
+            (extP ? extP->num_slice_groups_minus1 > 0 : encParam->num_slice_group > 1)))
+    {
+        return AVCENC_INVALID_NUM_SLICEGROUP;
+    }
+    encvid->numSliceMbRows = encParam->num_slice_mb_rows;
+    encvid->numMEThreads = encParam->num_threads;
+
     encvid->outOfBandParamSet = ((encParam->out_of_band_param_set == AVC_ON) ? TRUE : FALSE);
 
     /* parameters derived from the the encParam that are used in SPS */
@@ -17,6 +17,8 @@
  */
 #include "avcenc_lib.h"
 
+#include <pthread.h>
+
 #define MIN_GOP     1   /* minimum size of GOP, 1/23/01, need to be tested */
 
 #define DEFAULT_REF_IDX     0  /* always from the first frame in the reflist */
@@ -64,6 +66,40 @@ uint32 num_cand = 0;
 #define FIXED_SUBMB_MODE    AVC_4x4
 /*************************************************************************/
 
+#define MAX_ME_THREADS  8   /* including the calling thread */
+
+typedef struct tagMEWorker
+{
+    AVCMEThreadPool *pool;
+    pthread_t       thread;     /* unused for the calling thread */
+    AVCEncObject    enc;        /* private copy of the encoder state while searching a slice */
+    AVCCommonObj    common;
+} AVCMEWorker;
+
+/* Searches the slices of one motion estimation pass in parallel. The calling
+   thread takes part as worker[0], the others run METhreadLoop. */
+struct tagMEThreadPool
+{
+    AVCEncObject    *encvid;
+    AVCMEWorker     *worker;
+    int             numWorkers;
+    pthread_mutex_t lock;
+    pthread_cond_t  workCond;   /* a pass has been posted, or quit */
+    pthread_cond_t  doneCond;   /* all slices of the pass are searched */
+    uint            generation; /* incremented for every pass */
+    int             nextSlice;
+    int             numSlicesDone;
+    int             pass;
+    int             incr_i;
+    int             type_pred;
+    bool            quit;
+};
+
+static void AVCMotionEstimationSlice(AVCEncObject *encvid, AVCMESlice *slice, int pass,
+                                     int incr_i, int type_pred);
+static AVCEnc_Status InitMESlices(AVCHandle *avcHandle);
+static void CleanMESlices(AVCHandle *avcHandle);
+
 /* Initialize arrays necessary for motion search */
 AVCEnc_Status InitMotionSearchModule(AVCHandle *avcHandle)
 {
@@ -166,7 +202,7 @@ AVCEnc_Status InitMotionSearchModule(AVCHandle *avcHandle)
     encvid->bilin_base[8][3] = subpel_pred + V2Q_H2Q * SUBPEL_PRED_BLK_SIZE;
 
 
-    return AVCENC_SUCCESS;
+    return InitMESlices(avcHandle);
 }
 
 /* Clean-up memory */
@@ -180,6 +216,232 @@ void CleanMotionSearchModule(AVCHandle *avcHandle)
         encvid->mvbits = NULL;
     }
 
+    CleanMESlices(avcHandle);
+
+    return ;
+}
+
+/* Makes worker->enc a copy of the encoder with its own scratch memory. */
+static void MESetupWorker(AVCMEWorker *worker)
+{
+    AVCEncObject *encvid = worker->pool->encvid;
+    AVCEncObject *enc = &worker->enc;
+    uint8 *base = (uint8*) encvid->subpel_pred;
+    uint8 *copy = (uint8*) enc->subpel_pred;
+    int i, j;
+
+    memcpy(enc, encvid, sizeof(AVCEncObject));
+    memcpy(&worker->common, encvid->common, sizeof(AVCCommonObj));
+    enc->common = &worker->common;
+
+    /* the sub-pel candidates point into subpel_pred */
+    for (i = 0; i < 9; i++)
+    {
+        enc->hpel_cand[i] = copy + (encvid->hpel_cand[i] - base);
+        for (j = 0; j < 4; j++)
+        {
+            enc->bilin_base[i][j] = copy + (encvid->bilin_base[i][j] - base);
+        }
+    }
+
+    return ;
+}
+
+/* Searches slices of the current pass until none is left, called with pool->lock held. */
+static void MERunSlices(AVCMEWorker *worker)
+{
+    AVCMEThreadPool *pool = worker->pool;
+    AVCEncObject *encvid = pool->encvid;
+    int pass = pool->pass;
+    int incr_i = pool->incr_i;
+    int type_pred = pool->type_pred;
+    int i;
+
+    while (pool->nextSlice < encvid->numMESlices)
+    {
+        i = pool->nextSlice++;
+        pthread_mutex_unlock(&pool->lock);
+
+        MESetupWorker(worker);
+        AVCMotionEstimationSlice(&worker->enc, encvid->meSlice + i, pass, incr_i, type_pred);
+
+        pthread_mutex_lock(&pool->lock);
+        if (++pool->numSlicesDone == encvid->numMESlices)
+        {
+            pthread_cond_signal(&pool->doneCond);
+        }
+    }
+
+    return ;
+}
+
+static void *METhreadLoop(void *arg)
+{
+    AVCMEWorker *worker = (AVCMEWorker*) arg;
+    AVCMEThreadPool *pool = worker->pool;
+    uint generation = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    while (1)
+    {
+        while (!pool->quit && pool->generation == generation)
+        {
+            pthread_cond_wait(&pool->workCond, &pool->lock);
+        }
+        if (pool->quit)
+        {
+            break;
+        }
+        generation = pool->generation;
+        MERunSlices(worker);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+/* Splits the picture into slices of numSliceMbRows and starts the threads to
+   search them, if more than one was asked for. */
+static AVCEnc_Status InitMESlices(AVCHandle *avcHandle)
+{
+    AVCEncObject *encvid = (AVCEncObject*) avcHandle->AVCObject;
+    AVCCommonObj *video = encvid->common;
+    void *userData = avcHandle->userData;
+    AVCMEThreadPool *pool;
+    int mbheight = video->FrameHeightInMbs;
+    int rows = encvid->numSliceMbRows ? encvid->numSliceMbRows : mbheight;
+    int numThreads, i;
+
+    encvid->numMESlices = (mbheight + rows - 1) / rows;
+    encvid->meSlice = (AVCMESlice*) avcHandle->CBAVC_Malloc(userData,
+                      sizeof(AVCMESlice) * encvid->numMESlices, DEFAULT_ATTR);
+    if (encvid->meSlice == NULL)
+    {
+        return AVCENC_MEMORY_FAIL;
+    }
+
+    for (i = 0; i < encvid->numMESlices; i++)
+    {
+        encvid->meSlice[i].firstRow = i * rows;
+        encvid->meSlice[i].lastRow = AVC_MIN((i + 1) * rows, mbheight) - 1;
+    }
+
+    numThreads = AVC_MIN(encvid->numMEThreads, AVC_MIN(encvid->numMESlices, MAX_ME_THREADS));
+#ifdef HTFM
+    numThreads = 1; /* the HTFM statistics are shared */
+#endif
+    encvid->meThreadPool = NULL;
+    if (numThreads <= 1)
+    {
+        return AVCENC_SUCCESS;
+    }
+
+    pool = (AVCMEThreadPool*) avcHandle->CBAVC_Malloc(userData, sizeof(AVCMEThreadPool), DEFAULT_ATTR);
+    if (pool == NULL)
+    {
+        return AVCENC_MEMORY_FAIL;
+    }
+    pool->worker = (AVCMEWorker*) avcHandle->CBAVC_Malloc(userData,
+                   sizeof(AVCMEWorker) * numThreads, DEFAULT_ATTR);
+    if (pool->worker == NULL)
+    {
+        avcHandle->CBAVC_Free(userData, pool);
+        return AVCENC_MEMORY_FAIL;
+    }
+
+    pool->encvid = encvid;
+    pool->generation = 0;
+    pool->nextSlice = pool->numSlicesDone = encvid->numMESlices;
+    pool->quit = false;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->workCond, NULL);
+    pthread_cond_init(&pool->doneCond, NULL);
+
+    pool->worker[0].pool = pool;
+    pool->numWorkers = 1;
+    for (i = 1; i < numThreads; i++)
+    {
+        pool->worker[i].pool = pool;
+        if (pthread_create(&pool->worker[i].thread, NULL, METhreadLoop, pool->worker + i) != 0)
+        {
+            break; /* search with the threads we have */
+        }
+        pool->numWorkers++;
+    }
+
+    encvid->meThreadPool = pool;
+
+    return AVCENC_SUCCESS;
+}
+
+static void CleanMESlices(AVCHandle *avcHandle)
+{
+    AVCEncObject *encvid = (AVCEncObject*) avcHandle->AVCObject;
+    AVCMEThreadPool *pool = encvid->meThreadPool;
+    int i;
+
+    if (pool)
+    {
+        pthread_mutex_lock(&pool->lock);
+        pool->quit = true;
+        pthread_cond_broadcast(&pool->workCond);
+        pthread_mutex_unlock(&pool->lock);
+
+        for (i = 1; i < pool->numWorkers; i++)
+        {
+            pthread_join(pool->worker[i].thread, NULL);
+        }
+
+        pthread_cond_destroy(&pool->doneCond);
+        pthread_cond_destroy(&pool->workCond);
+        pthread_mutex_destroy(&pool->lock);
+
+        avcHandle->CBAVC_Free(avcHandle->userData, pool->worker);
+        avcHandle->CBAVC_Free(avcHandle->userData, pool);
+        encvid->meThreadPool = NULL;
+    }
+
+    if (encvid->meSlice)
+    {
+        avcHandle->CBAVC_Free(avcHandle->userData, encvid->meSlice);
+        encvid->meSlice = NULL;
+    }
+
+    return ;
+}
+
+/* Runs one pass of the motion search over all slices and waits for it to finish. */
+static void AVCSearchSlices(AVCEncObject *encvid, int pass, int incr_i, int type_pred)
+{
+    AVCMEThreadPool *pool = encvid->meThreadPool;
+    int i;
+
+    if (pool == NULL)
+    {
+        for (i = 0; i < encvid->numMESlices; i++)
+        {
+            AVCMotionEstimationSlice(encvid, encvid->meSlice + i, pass, incr_i, type_pred);
+        }
+        return ;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->pass = pass;
+    pool->incr_i = incr_i;
+    pool->type_pred = type_pred;
+    pool->nextSlice = 0;
+    pool->numSlicesDone = 0;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->workCond);
+
+    MERunSlices(pool->worker);
+
+    while (pool->numSlicesDone < encvid->numMESlices)
+    {
+        pthread_cond_wait(&pool->doneCond, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
     return ;
 }
 
@@ -238,39 +500,25 @@ void AVCMotionEstimation(AVCEncObject *encvid)
 {
     AVCCommonObj *video = encvid->common;
     int slice_type = video->slice_type;
-    AVCFrameIO *currInput = encvid->currInput;
     AVCPictureData *refPic = video->RefPicList0[0];
-    int i, j, k;
-    int mbwidth = video->PicWidthInMbs;
-    int mbheight = video->PicHeightInMbs;
+    int i;
     int totalMB = video->PicSizeInMbs;
-    int pitch = currInput->pitch;
-    AVCMacroblock *currMB, *mblock = video->mblock;
-    AVCMV *mot_mb_16x16, *mot16x16 = encvid->mot16x16;
-    // AVCMV *mot_mb_16x8, *mot_mb_8x16, *mot_mb_8x8, etc;
+    AVCMacroblock *mblock = video->mblock;
     AVCRateControl *rateCtrl = encvid->rateCtrl;
     uint8 *intraSearch = encvid->intraSearch;
-    uint FS_en = encvid->fullsearch_enable;
+    AVCMESlice *slice;
 
-    int NumIntraSearch, start_i, numLoop, incr_i;
-    int mbnum, offset;
-    uint8 *cur, *best_cand[5];
+    int NumIntraSearch, numLoop, incr_i, pass;
     int totalSAD = 0;   /* average SAD for rate control */
     int type_pred;
-    int abe_cost;
 
 #ifdef HTFM
     /***** HYPOTHESIS TESTING ********/  /* 2/28/01 */
     int collect = 0;
-    HTFM_Stat htfm_stat;
     double newvar[16];
     double exp_lamda[15];
     /*********************************/
 #endif
-    int hp_guess = 0;
-    uint32 mv_uint32;
-
-    offset = 0;
 
     if (slice_type == AVC_I_SLICE)
     {
@@ -309,7 +557,7 @@ void AVCMotionEstimation(AVCEncObject *encvid)
     encvid->sad_extra_info = NULL;
 #ifdef HTFM
     /***** HYPOTHESIS TESTING ********/
-    InitHTFM(video, &htfm_stat, newvar, &collect);
+    InitHTFM(video, &encvid->htfm_stat, newvar, &collect);
     /*********************************/
 #endif
 
@@ -319,111 +567,38 @@ void AVCMotionEstimation(AVCEncObject *encvid)
     {
         incr_i = 2;
         numLoop = 2;
-        start_i = 1;
         type_pred = 0; /* for initial candidate selection */
     }
     else
     {
         incr_i = 1;
         numLoop = 1;
-        start_i = 0;
         type_pred = 2;
     }
 
+    for (i = 0; i < encvid->numMESlices; i++)
+    {
+        slice = encvid->meSlice + i;
+        slice->hp_guess = 0;
+        slice->numIntraSearch = 0;
+        slice->totalSAD = 0;
+    }
+
     /* First pass, loop thru half the macroblock */
     /* determine scene change */
     /* Second pass, for the rest of macroblocks */
-    NumIntraSearch = 0; // to be intra searched in the encoding loop.
-    while (numLoop--)
+    /* Slices do not look at each other's MVs, each pass can search them in parallel */
+    for (pass = 0; numLoop--; pass++)
     {
-        for (j = 0; j < mbheight; j++)
-        {
-            if (incr_i > 1)
-                start_i = (start_i == 0 ? 1 : 0) ; /* toggle 0 and 1 */
-
-            offset = pitch * (j << 4) + (start_i << 4);
-
-            mbnum = j * mbwidth + start_i;
-
-            for (i = start_i; i < mbwidth; i += incr_i)
-            {
-                video->mbNum = mbnum;
-                video->currMB = currMB = mblock + mbnum;
-                mot_mb_16x16 = mot16x16 + mbnum;
-
-                cur = currInput->YCbCr[0] + offset;
-
-                if (currMB->mb_intra == 0) /* for INTER mode */
-                {
-#if defined(HTFM)
-                    HTFMPrepareCurMB_AVC(encvid, &htfm_stat, cur, pitch);
-#else
-                    AVCPrepareCurMB(encvid, cur, pitch);
-#endif
-                    /************************************************************/
-                    /******** full-pel 1MV search **********************/
-
-                    AVCMBMotionSearch(encvid, cur, best_cand, i << 4, j << 4, type_pred,
-                                      FS_en, &hp_guess);
-
-                    abe_cost = encvid->min_cost[mbnum] = mot_mb_16x16->sad;
-
-                    /* set mbMode and MVs */
-                    currMB->mbMode = AVC_P16;
-                    currMB->MBPartPredMode[0][0] = AVC_Pred_L0;
-                    mv_uint32 = ((mot_mb_16x16->y) << 16) | ((mot_mb_16x16->x) & 0xffff);
-                    for (k = 0; k < 32; k += 2)
-                    {
-                        currMB->mvL0[k>>1] = mv_uint32;
-                    }
-
-                    /* make a decision whether it should be tested for intra or not */
-                    if (i != mbwidth - 1 && j != mbheight - 1 && i != 0 && j != 0)
-                    {
-                        if (false == IntraDecisionABE(&abe_cost, cur, pitch, true))
-                        {
-                            intraSearch[mbnum] = 0;
-                        }
-                        else
-                        {
-                            NumIntraSearch++;
-                            rateCtrl->MADofMB[mbnum] = abe_cost;
-                        }
-                    }
-                    else // boundary MBs, always do intra search
-                    {
-                        NumIntraSearch++;
-                    }
+        AVCSearchSlices(encvid, pass, incr_i, type_pred);
 
-                    totalSAD += (int) rateCtrl->MADofMB[mbnum];//mot_mb_16x16->sad;
-                }
-                else    /* INTRA update, use for prediction */
-                {
-                    mot_mb_16x16[0].x = mot_mb_16x16[0].y = 0;
-
-                    /* reset all other MVs to zero */
-                    /* mot_mb_16x8, mot_mb_8x16, mot_mb_8x8, etc. */
-                    abe_cost = encvid->min_cost[mbnum] = 0x7FFFFFFF;  /* max value for int */
-
-                    if (i != mbwidth - 1 && j != mbheight - 1 && i != 0 && j != 0)
-                    {
-                        IntraDecisionABE(&abe_cost, cur, pitch, false);
-
-                        rateCtrl->MADofMB[mbnum] = abe_cost;
-                        totalSAD += abe_cost;
-                    }
-
-                    NumIntraSearch++ ;
-                    /* cannot do I16 prediction here because it needs full decoding. */
-                    // intraSearch[mbnum] = 1;
-
-                }
-
-                mbnum += incr_i;
-                offset += (incr_i << 4);
-
-            } /* for i */
-        } /* for j */
+        NumIntraSearch = 0; // to be intra searched in the encoding loop.
+        totalSAD = 0;
+        for (i = 0; i < encvid->numMESlices; i++)
+        {
+            NumIntraSearch += encvid->meSlice[i].numIntraSearch;
+            totalSAD += encvid->meSlice[i].totalSAD;
+        }
 
         /* since we cannot do intra/inter decision here, the SCD has to be
         based on other criteria such as motion vectors coherency or the SAD */
@@ -453,7 +628,6 @@ void AVCMotionEstimation(AVCEncObject *encvid)
             }
         }
         /******** no scene change, continue motion search **********************/
-        start_i = 0;
         type_pred++; /* second pass */
     }
 
@@ -464,7 +638,7 @@ void AVCMotionEstimation(AVCEncObject *encvid)
     if (collect)
     {
         collect = 0;
-        UpdateHTFM(encvid, newvar, exp_lamda, &htfm_stat);
+        UpdateHTFM(encvid, newvar, exp_lamda, &encvid->htfm_stat);
     }
     /*********************************/
 #endif
@@ -472,6 +646,125 @@ void AVCMotionEstimation(AVCEncObject *encvid)
     return ;
 }
 
+/* Motion search of the MBs of one slice for one pass. With incr_i == 2 the
+   pass searches every other MB in a checkerboard, starting from the MB at
+   (0, 0) in pass 0 and from the one at (1, 0) in pass 1. */
+static void AVCMotionEstimationSlice(AVCEncObject *encvid, AVCMESlice *slice, int pass,
+                                     int incr_i, int type_pred)
+{
+    AVCCommonObj *video = encvid->common;
+    AVCFrameIO *currInput = encvid->currInput;
+    int i, j, k;
+    int mbwidth = video->PicWidthInMbs;
+    int mbheight = video->PicHeightInMbs;
+    int pitch = currInput->pitch;
+    AVCMacroblock *currMB, *mblock = video->mblock;
+    AVCMV *mot_mb_16x16, *mot16x16 = encvid->mot16x16;
+    AVCRateControl *rateCtrl = encvid->rateCtrl;
+    uint8 *intraSearch = encvid->intraSearch;
+    uint FS_en = encvid->fullsearch_enable;
+
+    int start_i;
+    int mbnum, offset;
+    uint8 *cur, *best_cand[5];
+    int abe_cost;
+    uint32 mv_uint32;
+
+    /* the candidate selection treats the slice edges as picture edges */
+    encvid->meTopRow = slice->firstRow;
+    encvid->meBottomRow = slice->lastRow;
+
+    for (j = slice->firstRow; j <= slice->lastRow; j++)
+    {
+        start_i = (incr_i > 1) ? ((j + pass) & 1) : 0;
+
+        offset = pitch * (j << 4) + (start_i << 4);
+
+        mbnum = j * mbwidth + start_i;
+
+        for (i = start_i; i < mbwidth; i += incr_i)
+        {
+            video->mbNum = mbnum;
+            video->currMB = currMB = mblock + mbnum;
+            mot_mb_16x16 = mot16x16 + mbnum;
+
+            cur = currInput->YCbCr[0] + offset;
+
+            if (currMB->mb_intra == 0) /* for INTER mode */
+            {
+#if defined(HTFM)
+                HTFMPrepareCurMB_AVC(encvid, &encvid->htfm_stat, cur, pitch);
+#else
+                AVCPrepareCurMB(encvid, cur, pitch);
+#endif
+                /************************************************************/
+                /******** full-pel 1MV search **********************/
+
+                AVCMBMotionSearch(encvid, cur, best_cand, i << 4, j << 4, type_pred,
+                                  FS_en, &slice->hp_guess);
+
+                abe_cost = encvid->min_cost[mbnum] = mot_mb_16x16->sad;
+
+                /* set mbMode and MVs */
+                currMB->mbMode = AVC_P16;
+                currMB->MBPartPredMode[0][0] = AVC_Pred_L0;
+                mv_uint32 = ((mot_mb_16x16->y) << 16) | ((mot_mb_16x16->x) & 0xffff);
+                for (k = 0; k < 32; k += 2)
+                {
+                    currMB->mvL0[k>>1] = mv_uint32;
+                }
+
+                /* make a decision whether it should be tested for intra or not */
+                if (i != mbwidth - 1 && j != mbheight - 1 && i != 0 && j != 0)
+                {
+                    if (false == IntraDecisionABE(&abe_cost, cur, pitch, true))
+                    {
+                        intraSearch[mbnum] = 0;
+                    }
+                    else
+                    {
+                        slice->numIntraSearch++;
+                        rateCtrl->MADofMB[mbnum] = abe_cost;
+                    }
+                }
+                else // boundary MBs, always do intra search
+                {
+                    slice->numIntraSearch++;
+                }
+
+                slice->totalSAD += (int) rateCtrl->MADofMB[mbnum];//mot_mb_16x16->sad;
+            }
+            else    /* INTRA update, use for prediction */
+            {
+                mot_mb_16x16[0].x = mot_mb_16x16[0].y = 0;
+
+                /* reset all other MVs to zero */
+                /* mot_mb_16x8, mot_mb_8x16, mot_mb_8x8, etc. */
+                abe_cost = encvid->min_cost[mbnum] = 0x7FFFFFFF;  /* max value for int */
+
+                if (i != mbwidth - 1 && j != mbheight - 1 && i != 0 && j != 0)
+                {
+                    IntraDecisionABE(&abe_cost, cur, pitch, false);
+
+                    rateCtrl->MADofMB[mbnum] = abe_cost;
+                    slice->totalSAD += abe_cost;
+                }
+
+                slice->numIntraSearch++ ;
+                /* cannot do I16 prediction here because it needs full decoding. */
+                // intraSearch[mbnum] = 1;
+
+            }
+
+            mbnum += incr_i;
+            offset += (incr_i << 4);
+
+        } /* for i */
+    } /* for j */
+
+    return ;
+}
+
 /*=====================================================================
     Function:   PaddingEdge
     Date:       09/16/2000
@@ -1362,6 +1655,9 @@ void AVCCandidateSelection(int *mvx, int *mvy, int *num_can, int imb, int jmb,
     int mbnum = video->mbNum;
     int mbwidth = video->PicWidthInMbs;
     int mbheight = video->PicHeightInMbs;
+    /* MVs above or below the slice may not be searched yet */
+    int top_row = encvid->meTopRow;
+    int bottom_row = encvid->meBottomRow;
     int i, j, same, num1;
 
     /* this part is for predicted MV */
@@ -1391,26 +1687,26 @@ void AVCCandidateSelection(int *mvx, int *mvy, int *num_can, int imb, int jmb,
                 mvy[(*num_can)++] = (pmot->y) >> 2;
             }
 
-            if (jmb < mbheight - 1)  /*bottom neighbor previous frame */
+            if (jmb < bottom_row)  /*bottom neighbor previous frame */
             {
                 pmot = &mot16x16[mbnum+mbwidth];
                 mvx[(*num_can)] = (pmot->x) >> 2;
                 mvy[(*num_can)++] = (pmot->y) >> 2;
             }
-            else if (jmb > 0)   /*upper neighbor previous frame */
+            else if (jmb > top_row)   /*upper neighbor previous frame */
             {
                 pmot = &mot16x16[mbnum-mbwidth];
                 mvx[(*num_can)] = (pmot->x) >> 2;
                 mvy[(*num_can)++] = (pmot->y) >> 2;
             }
 
-            if (imb > 0 && jmb > 0)  /* upper-left neighbor current frame*/
+            if (imb > 0 && jmb > top_row)  /* upper-left neighbor current frame*/
             {
                 pmot = &mot16x16[mbnum-mbwidth-1];
                 mvx[(*num_can)] = (pmot->x) >> 2;
                 mvy[(*num_can)++] = (pmot->y) >> 2;
             }
-            if (jmb > 0 && imb < mbheight - 1)  /* upper right neighbor current frame*/
+            if (jmb > top_row && imb < mbheight - 1)  /* upper right neighbor current frame*/
             {
                 pmot = &mot16x16[mbnum-mbwidth+1];
                 mvx[(*num_can)] = (pmot->x) >> 2;
@@ -1430,7 +1726,7 @@ void AVCCandidateSelection(int *mvx, int *mvy, int *num_can, int imb, int jmb,
                 mvx[(*num_can)] = (pmot->x) >> 2;
                 mvy[(*num_can)++] = (pmot->y) >> 2;
             }
-            if (jmb > 0)  /*upper neighbor current frame */
+            if (jmb > top_row)  /*upper neighbor current frame */
             {
                 pmot = &mot16x16[mbnum-mbwidth];
                 mvx[(*num_can)] = (pmot->x) >> 2;
@@ -1442,7 +1738,7 @@ void AVCCandidateSelection(int *mvx, int *mvy, int *num_can, int imb, int jmb,
                 mvx[(*num_can)] = (pmot->x) >> 2;
                 mvy[(*num_can)++] = (pmot->y) >> 2;
             }
-            if (jmb < mbheight - 1)  /*bottom neighbor previous frame */
+            if (jmb < bottom_row)  /*bottom neighbor previous frame */
             {
                 pmot = &mot16x16[mbnum+mbwidth];
                 mvx[(*num_can)] = (pmot->x) >> 2;
@@ -1459,7 +1755,7 @@ void AVCCandidateSelection(int *mvx, int *mvy, int *num_can, int imb, int jmb,
             pmvA_y = pmot->y;
         }
 
-        if (jmb > 0) /* get MV from top (B) neighbor either on current or previous frame */
+        if (jmb > top_row) /* get MV from top (B) neighbor either on current or previous frame */
         {
             availB = 1;
             pmot = &mot16x16[mbnum-mbwidth];
@@ -1491,13 +1787,13 @@ void AVCCandidateSelection(int *mvx, int *mvy, int *num_can, int imb, int jmb,
                 mvx[(*num_can)] = (pmot->x) >> 2;
                 mvy[(*num_can)++] = (pmot->y) >> 2;
             }
-            if (imb > 0 && jmb > 0)  /* upper-left neighbor */
+            if (imb > 0 && jmb > top_row)  /* upper-left neighbor */
             {
                 pmot = &mot16x16[mbnum-mbwidth-1];
                 mvx[(*num_can)] = (pmot->x) >> 2;
                 mvy[(*num_can)++] = (pmot->y) >> 2;
             }
-            if (jmb > 0 && imb < mbheight - 1)  /* upper right neighbor */
+            if (jmb > top_row && imb < mbheight - 1)  /* upper right neighbor */
             {
                 pmot = &mot16x16[mbnum-mbwidth+1];
                 mvx[(*num_can)] = (pmot->x) >> 2;
@@ -1513,7 +1809,7 @@ void AVCCandidateSelection(int *mvx, int *mvy, int *num_can, int imb, int jmb,
                 pmvA_y = pmot->y;
             }
 
-            if (jmb > 0 && imb > 0) /* get MV from top-left (B) neighbor of current frame */
+            if (jmb > top_row && imb > 0) /* get MV from top-left (B) neighbor of current frame */
             {
                 availB = 1;
                 pmot = &mot16x16[mbnum-mbwidth-1];
@@ -1521,7 +1817,7 @@ void AVCCandidateSelection(int *mvx, int *mvy, int *num_can, int imb, int jmb,
                 pmvB_y = pmot->y;
             }
 
-            if (jmb > 0 && imb < mbwidth - 1)
+            if (jmb > top_row && imb < mbwidth - 1)
             {
                 availC = 1;
                 pmot = &mot16x16[mbnum-mbwidth+1];
@@ -1541,7 +1837,7 @@ void AVCCandidateSelection(int *mvx, int *mvy, int *num_can, int imb, int jmb,
                     mvx[(*num_can)] = (pmot->x) >> 2;
                     mvy[(*num_can)++] = (pmot->y) >> 2;
                 }
-                if (jmb > 0)  /*upper neighbor current frame */
+                if (jmb > top_row)  /*upper neighbor current frame */
                 {
                     pmot = &mot16x16[mbnum-mbwidth];
                     mvx[(*num_can)] = (pmot->x) >> 2;
@@ -1553,7 +1849,7 @@ void AVCCandidateSelection(int *mvx, int *mvy, int *num_can, int imb, int jmb,
                     mvx[(*num_can)] = (pmot->x) >> 2;
                     mvy[(*num_can)++] = (pmot->y) >> 2;
                 }
-                if (jmb < mbheight - 1)  /*bottom neighbor current frame */
+                if (jmb < bottom_row)  /*bottom neighbor current frame */
                 {
                     pmot = &mot16x16[mbnum+mbwidth];
                     mvx[(*num_can)] = (pmot->x) >> 2;
@@ -1569,7 +1865,7 @@ void AVCCandidateSelection(int *mvx, int *mvy, int *num_can, int imb, int jmb,
                     mvx[(*num_can)] = (pmot->x) >> 2;
                     mvy[(*num_can)++] = (pmot->y) >> 2;
 
-                    if (jmb > 0)  /*upper-left neighbor current frame */
+                    if (jmb > top_row)  /*upper-left neighbor current frame */
                     {
                         pmot = &mot16x16[mbnum-mbwidth-1];
                         mvx[(*num_can)] = (pmot->x) >> 2;
@@ -1577,7 +1873,7 @@ void AVCCandidateSelection(int *mvx, int *mvy, int *num_can, int imb, int jmb,
                     }
 
                 }
-                if (jmb > 0)  /*upper neighbor current frame */
+                if (jmb > top_row)  /*upper neighbor current frame */
                 {
                     pmot = &mot16x16[mbnum-mbwidth];
                     mvx[(*num_can)] = (pmot->x) >> 2;
@@ -1601,7 +1897,7 @@ void AVCCandidateSelection(int *mvx, int *mvy, int *num_can, int imb, int jmb,
                 pmvA_y = pmot->y;
             }
 
-            if (jmb > 0) /* get MV from top (B) neighbor either on current or previous frame */
+            if (jmb > top_row) /* get MV from top (B) neighbor either on current or previous frame */
             {
                 availB = 1;
                 pmot = &mot16x16[mbnum-mbwidth];
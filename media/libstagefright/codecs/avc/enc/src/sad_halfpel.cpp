@@ -84,14 +84,32 @@ int AVCSAD_MB_HalfPel_Cxhyh(uint8 *ref, uint8 *blk, int dmin_rx, void *extra_inf
     p4 = ref + rx + 1;
     kk  = blk;
 
+#ifdef AVCENC_NEON
+    uint16x8_t acc = vdupq_n_u16(0);
+    (void)(j);
+    (void)(temp);
+#endif
+
     for (i = 0; i < 16; i++)
     {
+#ifdef AVCENC_NEON
+        uint8x16_t a = vld1q_u8(p1), b = vld1q_u8(p2);
+        uint8x16_t c = vld1q_u8(p3), d = vld1q_u8(p4);
+        uint16x8_t lo = vaddq_u16(vaddl_u8(vget_low_u8(a), vget_low_u8(b)),
+                                  vaddl_u8(vget_low_u8(c), vget_low_u8(d)));
+        uint16x8_t hi = vaddq_u16(vaddl_u8(vget_high_u8(a), vget_high_u8(b)),
+                                  vaddl_u8(vget_high_u8(c), vget_high_u8(d)));
+        /* the rounding narrow is (sum + 2) >> 2 */
+        sad = NEON_ROW_SAD(&acc, vcombine_u8(vrshrn_n_u16(lo, 2), vrshrn_n_u16(hi, 2)), kk);
+        kk += 16;
+#else
         for (j = 0; j < 16; j++)
         {
 
             temp = ((p1[j] + p2[j] + p3[j] + p4[j] + 2) >> 2) - *kk++;
             sad += AVC_ABS(temp);
         }
+#endif
 
         NUM_SAD_HP_MB();
 
@@ -123,14 +141,25 @@ int AVCSAD_MB_HalfPel_Cyh(uint8 *ref, uint8 *blk, int dmin_rx, void *extra_info)
     p2 = ref + rx; /* either left/right or top/bottom pixel */
     kk  = blk;
 
+#ifdef AVCENC_NEON
+    uint16x8_t acc = vdupq_n_u16(0);
+    (void)(j);
+    (void)(temp);
+#endif
+
     for (i = 0; i < 16; i++)
     {
+#ifdef AVCENC_NEON
+        sad = NEON_ROW_SAD(&acc, vrhaddq_u8(vld1q_u8(p1), vld1q_u8(p2)), kk);
+        kk += 16;
+#else
         for (j = 0; j < 16; j++)
         {
 
             temp = ((p1[j] + p2[j] + 1) >> 1) - *kk++;
             sad += AVC_ABS(temp);
         }
+#endif
 
         NUM_SAD_HP_MB();
 
@@ -157,14 +186,25 @@ int AVCSAD_MB_HalfPel_Cxh(uint8 *ref, uint8 *blk, int dmin_rx, void *extra_info)
     p1 = ref;
     kk  = blk;
 
+#ifdef AVCENC_NEON
+    uint16x8_t acc = vdupq_n_u16(0);
+    (void)(j);
+    (void)(temp);
+#endif
+
     for (i = 0; i < 16; i++)
     {
+#ifdef AVCENC_NEON
+        sad = NEON_ROW_SAD(&acc, vrhaddq_u8(vld1q_u8(p1), vld1q_u8(p1 + 1)), kk);
+        kk += 16;
+#else
         for (j = 0; j < 16; j++)
         {
 
             temp = ((p1[j] + p1[j+1] + 1) >> 1) - *kk++;
             sad += AVC_ABS(temp);
         }
+#endif
 
         NUM_SAD_HP_MB();
 
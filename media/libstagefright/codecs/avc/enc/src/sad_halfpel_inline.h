@@ -19,6 +19,13 @@
 #ifndef _SAD_HALFPEL_INLINE_H_
 #define _SAD_HALFPEL_INLINE_H_
 
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#ifndef AVCENC_NEON
+#define AVCENC_NEON
+#endif
+#include <arm_neon.h>
+#endif
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -46,6 +53,22 @@ extern "C"
         return sad;
     }
 
+#ifdef AVCENC_NEON
+    /* Accumulates the SAD of one 16 pixel row of interpolated ref against
+     * blk and returns the running total. */
+    __inline int32 NEON_ROW_SAD(uint16x8_t *acc, uint8x16_t pred, uint8 *blk)
+    {
+        uint8x16_t b = vld1q_u8(blk);
+        uint64x2_t sum;
+
+        *acc = vabal_u8(*acc, vget_low_u8(pred), vget_low_u8(b));
+        *acc = vabal_u8(*acc, vget_high_u8(pred), vget_high_u8(b));
+
+        sum = vpaddlq_u32(vpaddlq_u16(*acc));
+        return (int32)(vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1));
+    }
+#endif
+
 #elif defined(__CC_ARM)  /* only work with arm v5 */
 
     __inline int32 INTERP1_SUB_SAD(int32 sad, int32 tmp, int32 tmp2)
@@ -18,6 +18,11 @@
 #ifndef _SAD_INLINE_H_
 #define _SAD_INLINE_H_
 
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define AVCENC_NEON
+#include <arm_neon.h>
+#endif
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -75,7 +80,37 @@ extern "C"
 #define SHIFT 8
 #include "sad_mb_offset.h"
 
+#ifdef AVCENC_NEON
+    /* NEON loads do not need ref to be word aligned, so there is no
+     * offset dispatch. The sum is reduced after every row to keep the
+     * early exit, and the returned value, identical to the C code. */
+    __inline int32 simd_sad_mb(uint8 *ref, uint8 *blk, int dmin, int lx)
+    {
+        uint16x8_t acc = vdupq_n_u16(0);
+        uint64x2_t sum;
+        uint8x16_t r, b;
+        int32 sad = 0;
+        int i;
 
+        for (i = 0; i < 16; i++)
+        {
+            r = vld1q_u8(ref);
+            b = vld1q_u8(blk);
+            acc = vabal_u8(acc, vget_low_u8(r), vget_low_u8(b));
+            acc = vabal_u8(acc, vget_high_u8(r), vget_high_u8(b));
+
+            sum = vpaddlq_u32(vpaddlq_u16(acc));
+            sad = (int32)(vgetq_lane_u64(sum, 0) + vgetq_lane_u64(sum, 1));
+            if (sad > dmin)
+                break;
+
+            ref += lx;
+            blk += 16;
+        }
+
+        return sad;
+    }
+#else
     __inline int32 simd_sad_mb(uint8 *ref, uint8 *blk, int dmin, int lx)
     {
         int32 x4, x5, x6, x8, x9, x10, x11, x12, x14;
@@ -168,6 +203,7 @@ SadMBOffset1:
         return sad_mb_offset1(ref, blk, lx, dmin);
 
     }
+#endif /* AVCENC_NEON */
 
 #elif defined(__CC_ARM)  /* only work with arm v5 */
 
@@ -130,6 +130,15 @@ AVCEnc_Status AVCEncodeSlice(AVCEncObject *encvid)
                 break;
             }
         }
+
+        if (encvid->numSliceMbRows &&
+                CurrMbAddr % (encvid->numSliceMbRows * video->PicWidthInMbs) == 0)
+        {
+            /* end of slice, the next slice starts at CurrMbAddr */
+            video->mbNum = CurrMbAddr;
+            status = AVCENC_SUCCESS;
+            break;
+        }
     }
 
     if (video->mb_skip_run > 0)
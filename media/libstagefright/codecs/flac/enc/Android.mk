@@ -1,6 +1,23 @@
 LOCAL_PATH:= $(call my-dir)
 include $(CLEAR_VARS)
 
+LOCAL_SRC_FILES := \
+        ParallelFlacEncoder.cpp
+
+LOCAL_C_INCLUDES := \
+        frameworks/av/media/libstagefright/include \
+        external/flac/include
+
+LOCAL_CFLAGS += -Werror
+
+LOCAL_MODULE := libstagefright_flacenc
+
+include $(BUILD_STATIC_LIBRARY)
+
+################################################################################
+
+include $(CLEAR_VARS)
+
 LOCAL_SRC_FILES := \
         SoftFlacEncoder.cpp
 
@@ -12,9 +29,11 @@ LOCAL_C_INCLUDES := \
 LOCAL_CFLAGS += -Werror
 
 LOCAL_SHARED_LIBRARIES := \
-        libstagefright libstagefright_omx libstagefright_foundation libutils liblog
+        libstagefright libstagefright_omx libstagefright_foundation libutils liblog \
+        libcutils
 
 LOCAL_STATIC_LIBRARIES := \
+        libstagefright_flacenc \
         libFLAC \
 
 LOCAL_MODULE := libstagefright_soft_flacenc
@@ -0,0 +1,458 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "ParallelFlacEncoder"
+#include <utils/Log.h>
+
+#include "ParallelFlacEncoder.h"
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AMessage.h>
+
+#include <string.h>
+
+namespace android {
+
+// Frames per run: enough to make up for handing a run over to a thread and
+// initializing its encoder, few enough not to delay the output much.
+static const size_t kFramesPerRun = 8;
+
+ParallelFlacEncoder::ParallelFlacEncoder(size_t numThreads)
+    : mInitCheck(NO_INIT),
+      mNumChannels(1),
+      mSampleRate(44100),
+      mBlockSize(0),
+      mFramesPerRun(kFramesPerRun),
+      mNextFrameNumber(0),
+      mFilling(NULL),
+      mNumBusyRuns(0),
+      mDone(false) {
+    CHECK_GE(numThreads, 1u);
+
+    // CRC-16 of the frame footer, polynomial x^16 + x^15 + x^2 + 1
+    for (unsigned i = 0; i < 256; ++i) {
+        uint16_t crc = i << 8;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x8005 : crc << 1;
+        }
+        mCrc16Table[i] = crc;
+    }
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+
+    for (size_t i = 0; i < numThreads; ++i) {
+        Worker *worker = new Worker;
+        worker->mOwner = this;
+        worker->mRun = NULL;
+        worker->mEncoder = FLAC__stream_encoder_new();
+        if (worker->mEncoder == NULL) {
+            delete worker;
+            break;
+        }
+        if (pthread_create(&worker->mThread, &attr, ThreadWrapper, worker) != 0) {
+            FLAC__stream_encoder_delete(worker->mEncoder);
+            delete worker;
+            break;
+        }
+        mWorkers.push(worker);
+    }
+    pthread_attr_destroy(&attr);
+
+    if (mWorkers.size() == numThreads) {
+        mInitCheck = OK;
+    }
+}
+
+ParallelFlacEncoder::~ParallelFlacEncoder() {
+    clearRuns();
+
+    {
+        Mutex::Autolock autoLock(mLock);
+        mDone = true;
+        mRunQueuedCondition.broadcast();
+    }
+
+    for (size_t i = 0; i < mWorkers.size(); ++i) {
+        Worker *worker = mWorkers[i];
+
+        void *dummy;
+        pthread_join(worker->mThread, &dummy);
+
+        FLAC__stream_encoder_delete(worker->mEncoder);
+        delete worker;
+    }
+}
+
+status_t ParallelFlacEncoder::initCheck() const {
+    return mInitCheck;
+}
+
+status_t ParallelFlacEncoder::configure(
+        unsigned numChannels, unsigned sampleRate, unsigned compressionLevel) {
+    if (mInitCheck != OK) {
+        return mInitCheck;
+    }
+
+    clearRuns();
+
+    // No run is being encoded, the encoders are all uninitialized.
+    FLAC__bool ok = true;
+    for (size_t i = 0; i < mWorkers.size(); ++i) {
+        FLAC__StreamEncoder *encoder = mWorkers[i]->mEncoder;
+        ok = ok && FLAC__stream_encoder_set_channels(encoder, numChannels);
+        ok = ok && FLAC__stream_encoder_set_sample_rate(encoder, sampleRate);
+        ok = ok && FLAC__stream_encoder_set_bits_per_sample(encoder, 16);
+        ok = ok && FLAC__stream_encoder_set_compression_level(encoder, compressionLevel);
+        ok = ok && FLAC__stream_encoder_set_verify(encoder, false);
+    }
+    if (!ok) {
+        ALOGE("unable to configure the encoders");
+        return UNKNOWN_ERROR;
+    }
+
+    mNumChannels = numChannels;
+    mSampleRate = sampleRate;
+    mBlockSize = FLAC__stream_encoder_get_blocksize(mWorkers[0]->mEncoder);
+    mNextFrameNumber = 0;
+
+    ALOGV("%zu threads, %u samples per frame, %zu frames per run",
+            mWorkers.size(), mBlockSize, mFramesPerRun);
+
+    return OK;
+}
+
+unsigned ParallelFlacEncoder::blockSize() const {
+    return mBlockSize;
+}
+
+void ParallelFlacEncoder::queueSamples(
+        const int16_t *pcm, size_t numFrames, int64_t timeUs) {
+    const size_t capacity = mBlockSize * mFramesPerRun;
+
+    size_t offset = 0;
+    while (offset < numFrames) {
+        if (mFilling == NULL) {
+            mFilling = new Run;
+            mFilling->mPcm = new FLAC__int32[capacity * mNumChannels];
+            mFilling->mNumFrames = 0;
+            mFilling->mTimeUs = timeUs + offset * 1000000ll / mSampleRate;
+            mFilling->mFirstFrameNumber = mNextFrameNumber;
+            mFilling->mDone = false;
+            mFilling->mError = OK;
+            mNextFrameNumber += mFramesPerRun;
+        }
+
+        size_t n = numFrames - offset;
+        if (n > capacity - mFilling->mNumFrames) {
+            n = capacity - mFilling->mNumFrames;
+        }
+
+        const int16_t *in = pcm + offset * mNumChannels;
+        FLAC__int32 *out = mFilling->mPcm + mFilling->mNumFrames * mNumChannels;
+        for (size_t i = 0; i < n * mNumChannels; ++i) {
+            out[i] = in[i];
+        }
+        mFilling->mNumFrames += n;
+        offset += n;
+
+        if (mFilling->mNumFrames == capacity) {
+            queueFilling();
+        }
+    }
+}
+
+void ParallelFlacEncoder::flush() {
+    queueFilling();
+}
+
+void ParallelFlacEncoder::queueFilling() {
+    if (mFilling == NULL) {
+        return;
+    }
+
+    Mutex::Autolock autoLock(mLock);
+
+    // Runs that would only wait for a thread are not worth the memory.
+    while (mNumBusyRuns >= 2 * mWorkers.size()) {
+        mRunDoneCondition.wait(mLock);
+    }
+
+    mQueuedRuns.push_back(mFilling);
+    mRuns.push_back(mFilling);
+    ++mNumBusyRuns;
+    mFilling = NULL;
+
+    mRunQueuedCondition.signal();
+}
+
+status_t ParallelFlacEncoder::dequeueFrame(bool wait, sp<ABuffer> *frame) {
+    frame->clear();
+
+    Mutex::Autolock autoLock(mLock);
+
+    for (;;) {
+        if (mRuns.empty()) {
+            return WOULD_BLOCK;
+        }
+
+        Run *run = *mRuns.begin();
+        if (!run->mDone) {
+            if (!wait) {
+                return WOULD_BLOCK;
+            }
+            mRunDoneCondition.wait(mLock);
+            continue;
+        }
+
+        if (run->mError != OK) {
+            return run->mError;
+        }
+
+        if (!run->mFrames.empty()) {
+            *frame = *run->mFrames.begin();
+            run->mFrames.erase(run->mFrames.begin());
+            return OK;
+        }
+
+        mRuns.erase(mRuns.begin());
+        freeRun(run);
+    }
+}
+
+void ParallelFlacEncoder::clearRuns() {
+    Mutex::Autolock autoLock(mLock);
+
+    while (!mQueuedRuns.empty()) {
+        Run *run = *mQueuedRuns.begin();
+        mQueuedRuns.erase(mQueuedRuns.begin());
+
+        for (List<Run *>::iterator it = mRuns.begin(); it != mRuns.end(); ++it) {
+            if (*it == run) {
+                mRuns.erase(it);
+                break;
+            }
+        }
+        freeRun(run);
+        --mNumBusyRuns;
+    }
+
+    while (mNumBusyRuns > 0) {
+        mRunDoneCondition.wait(mLock);
+    }
+
+    while (!mRuns.empty()) {
+        freeRun(*mRuns.begin());
+        mRuns.erase(mRuns.begin());
+    }
+
+    if (mFilling != NULL) {
+        freeRun(mFilling);
+        mFilling = NULL;
+    }
+}
+
+// static
+void ParallelFlacEncoder::freeRun(Run *run) {
+    delete[] run->mPcm;
+    delete run;
+}
+
+// static
+void *ParallelFlacEncoder::ThreadWrapper(void *me) {
+    Worker *worker = static_cast<Worker *>(me);
+    worker->mOwner->threadFunc(worker);
+    return NULL;
+}
+
+void ParallelFlacEncoder::threadFunc(Worker *worker) {
+    Mutex::Autolock autoLock(mLock);
+
+    for (;;) {
+        while (mQueuedRuns.empty() && !mDone) {
+            mRunQueuedCondition.wait(mLock);
+        }
+        if (mDone) {
+            break;
+        }
+
+        Run *run = *mQueuedRuns.begin();
+        mQueuedRuns.erase(mQueuedRuns.begin());
+
+        mLock.unlock();
+        status_t err = encodeRun(worker, run);
+        mLock.lock();
+
+        run->mError = err;
+        run->mDone = true;
+        --mNumBusyRuns;
+        mRunDoneCondition.broadcast();
+    }
+}
+
+status_t ParallelFlacEncoder::encodeRun(Worker *worker, Run *run) {
+    worker->mRun = run;
+
+    if (FLAC__stream_encoder_init_stream(
+                worker->mEncoder,
+                WriteCallback,
+                NULL /* seek_callback */,
+                NULL /* tell_callback */,
+                NULL /* metadata_callback */,
+                worker) != FLAC__STREAM_ENCODER_INIT_STATUS_OK) {
+        ALOGE("unable to initialize the encoder");
+        return UNKNOWN_ERROR;
+    }
+
+    FLAC__bool ok = FLAC__stream_encoder_process_interleaved(
+            worker->mEncoder, run->mPcm, run->mNumFrames);
+
+    // Encodes the last, short, frame if any and leaves the encoder ready to be
+    // initialized again.
+    ok = FLAC__stream_encoder_finish(worker->mEncoder) && ok;
+
+    delete[] run->mPcm;
+    run->mPcm = NULL;
+    worker->mRun = NULL;
+
+    if (!ok) {
+        ALOGE("error encoding frame %llu and on",
+                (unsigned long long)run->mFirstFrameNumber);
+        return UNKNOWN_ERROR;
+    }
+    return OK;
+}
+
+// static
+FLAC__StreamEncoderWriteStatus ParallelFlacEncoder::WriteCallback(
+        const FLAC__StreamEncoder * /* encoder */, const FLAC__byte buffer[],
+        size_t bytes, unsigned samples, unsigned current_frame, void *client_data) {
+    if (samples == 0) {
+        // the stream header, written again by each run
+        return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+    }
+
+    Worker *worker = static_cast<Worker *>(client_data);
+    ParallelFlacEncoder *me = worker->mOwner;
+    Run *run = worker->mRun;
+
+    sp<ABuffer> frame = me->renumberFrame(
+            buffer, bytes, run->mFirstFrameNumber + current_frame);
+    if (frame == NULL) {
+        ALOGE("unexpected frame header");
+        return FLAC__STREAM_ENCODER_WRITE_STATUS_FATAL_ERROR;
+    }
+
+    frame->meta()->setInt64(
+            "timeUs",
+            run->mTimeUs + (int64_t)current_frame * me->mBlockSize * 1000000ll / me->mSampleRate);
+    run->mFrames.push_back(frame);
+
+    return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+}
+
+// Rewrites the frame number of a fixed block size frame, and the CRCs of the
+// header and of the frame that cover it.
+sp<ABuffer> ParallelFlacEncoder::renumberFrame(
+        const uint8_t *data, size_t size, uint64_t frameNumber) const {
+    // sync code and fixed block size, block size and sample rate, channels and
+    // sample size, then the coded frame number
+    if (size < 8 || data[0] != 0xff || data[1] != 0xf8) {
+        return NULL;
+    }
+
+    size_t numberSize = 1;
+    if (data[4] & 0x80) {
+        while (numberSize < 7 && (data[4] & (0x80 >> numberSize))) {
+            ++numberSize;
+        }
+        if (numberSize == 1) {
+            return NULL;
+        }
+    }
+
+    // block size and sample rate not given by their code
+    size_t extraSize = 0;
+    unsigned blockSizeCode = data[2] >> 4;
+    unsigned sampleRateCode = data[2] & 0x0f;
+    if (blockSizeCode == 6) {
+        extraSize += 1;
+    } else if (blockSizeCode == 7) {
+        extraSize += 2;
+    }
+    if (sampleRateCode == 12) {
+        extraSize += 1;
+    } else if (sampleRateCode == 13 || sampleRateCode == 14) {
+        extraSize += 2;
+    }
+
+    size_t oldHeaderSize = 4 + numberSize + extraSize;
+    if (oldHeaderSize + 1 + 2 > size) {
+        return NULL;
+    }
+
+    // coded as UTF-8, extended to 36 bits
+    uint8_t number[7];
+    size_t newNumberSize;
+    if (frameNumber < 0x80) {
+        number[0] = frameNumber;
+        newNumberSize = 1;
+    } else {
+        newNumberSize = 2;
+        while (newNumberSize < 7 && (frameNumber >> (5 * newNumberSize + 1)) != 0) {
+            ++newNumberSize;
+        }
+        for (size_t i = newNumberSize - 1; i > 0; --i) {
+            number[i] = 0x80 | (frameNumber & 0x3f);
+            frameNumber >>= 6;
+        }
+        number[0] = ((0xff00 >> newNumberSize) & 0xff) | frameNumber;
+    }
+
+    size_t newSize = size - numberSize + newNumberSize;
+    sp<ABuffer> frame = new ABuffer(newSize);
+    uint8_t *out = frame->data();
+
+    memcpy(out, data, 4);
+    memcpy(out + 4, number, newNumberSize);
+    memcpy(out + 4 + newNumberSize, data + 4 + numberSize, extraSize);
+    size_t newHeaderSize = 4 + newNumberSize + extraSize;
+
+    // CRC-8 of the header, polynomial x^8 + x^2 + x + 1
+    uint8_t crc8 = 0;
+    for (size_t i = 0; i < newHeaderSize; ++i) {
+        crc8 ^= out[i];
+        for (int bit = 0; bit < 8; ++bit) {
+            crc8 = (crc8 & 0x80) ? (crc8 << 1) ^ 0x07 : crc8 << 1;
+        }
+    }
+    out[newHeaderSize] = crc8;
+
+    memcpy(out + newHeaderSize + 1, data + oldHeaderSize + 1, size - oldHeaderSize - 1 - 2);
+
+    uint16_t crc16 = 0;
+    for (size_t i = 0; i < newSize - 2; ++i) {
+        crc16 = (crc16 << 8) ^ mCrc16Table[(crc16 >> 8) ^ out[i]];
+    }
+    out[newSize - 2] = crc16 >> 8;
+    out[newSize - 1] = crc16 & 0xff;
+
+    return frame;
+}
+
+}  // namespace android
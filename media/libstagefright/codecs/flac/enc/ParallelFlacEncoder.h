@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PARALLEL_FLAC_ENCODER_H_
+
+#define PARALLEL_FLAC_ENCODER_H_
+
+#include <pthread.h>
+
+#include <media/stagefright/foundation/ABase.h>
+#include <media/stagefright/foundation/ABuffer.h>
+#include <utils/Errors.h>
+#include <utils/List.h>
+#include <utils/threads.h>
+#include <utils/Vector.h>
+
+#include "FLAC/stream_encoder.h"
+
+namespace android {
+
+// Encodes 16-bit PCM into FLAC frames on several threads. FLAC frames do not
+// depend on each other, so runs of whole frames are each handed to a libFLAC
+// stream encoder of their own, and the frames they produce are renumbered as
+// they are returned, in order. Except with the loose mid-side stereo of
+// compression levels 1 and 4, which looks across frames, the frames are the
+// same as those of a single encoder.
+// Not thread-safe, the caller serializes its calls.
+struct ParallelFlacEncoder {
+    ParallelFlacEncoder(size_t numThreads);
+
+    ~ParallelFlacEncoder();
+
+    status_t initCheck() const;
+
+    // Drops whatever is being encoded.
+    status_t configure(
+            unsigned numChannels, unsigned sampleRate, unsigned compressionLevel);
+
+    // Samples per channel of each frame but the last.
+    unsigned blockSize() const;
+
+    // Copies interleaved samples, the first one to be played at timeUs. Waits while
+    // all threads are busy and as many runs are queued behind them.
+    void queueSamples(const int16_t *pcm, size_t numFrames, int64_t timeUs);
+
+    // Encodes the samples queued so far, the last frame being short, at end of stream.
+    void flush();
+
+    // The next frame, its "timeUs" in meta(). WOULD_BLOCK if the next frame is not
+    // encoded yet or, with wait, once all frames have been returned.
+    status_t dequeueFrame(bool wait, sp<ABuffer> *frame);
+
+private:
+    struct Run {
+        FLAC__int32 *mPcm;
+        size_t mNumFrames;
+        int64_t mTimeUs;
+        uint64_t mFirstFrameNumber;
+        bool mDone;
+        status_t mError;
+        List<sp<ABuffer> > mFrames;
+    };
+
+    struct Worker {
+        ParallelFlacEncoder *mOwner;
+        FLAC__StreamEncoder *mEncoder;
+        pthread_t mThread;
+        Run *mRun;
+    };
+
+    status_t mInitCheck;
+    Vector<Worker *> mWorkers;
+
+    unsigned mNumChannels;
+    unsigned mSampleRate;
+    unsigned mBlockSize;
+    size_t mFramesPerRun;
+    uint64_t mNextFrameNumber;
+
+    uint16_t mCrc16Table[256];
+
+    Mutex mLock;
+    Condition mRunQueuedCondition;
+    Condition mRunDoneCondition;
+
+    List<Run *> mQueuedRuns;   // waiting for a worker
+    List<Run *> mRuns;         // in order, until their frames are dequeued
+    Run *mFilling;
+    size_t mNumBusyRuns;
+    bool mDone;
+
+    void queueFilling();
+    void clearRuns();
+    static void freeRun(Run *run);
+
+    static void *ThreadWrapper(void *me);
+    void threadFunc(Worker *worker);
+    status_t encodeRun(Worker *worker, Run *run);
+
+    static FLAC__StreamEncoderWriteStatus WriteCallback(
+            const FLAC__StreamEncoder *encoder, const FLAC__byte buffer[],
+            size_t bytes, unsigned samples, unsigned current_frame, void *client_data);
+
+    sp<ABuffer> renumberFrame(
+            const uint8_t *data, size_t size, uint64_t frameNumber) const;
+
+    DISALLOW_EVIL_CONSTRUCTORS(ParallelFlacEncoder);
+};
+
+}  // namespace android
+
+#endif  // PARALLEL_FLAC_ENCODER_H_
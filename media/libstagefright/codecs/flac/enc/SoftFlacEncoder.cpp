@@ -20,13 +20,18 @@
 
 #include "SoftFlacEncoder.h"
 
+#include <cutils/properties.h>
 #include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/MediaDefs.h>
 
 #define FLAC_COMPRESSION_LEVEL_MIN     0
 #define FLAC_COMPRESSION_LEVEL_DEFAULT 5
 #define FLAC_COMPRESSION_LEVEL_MAX     8
 
+#define PROP_NUM_THREADS "media.flacenc.num_threads"
+#define MAX_NUM_THREADS  8
+
 #if LOG_NDEBUG
 #define UNUSED_UNLESS_VERBOSE(x) (void)(x)
 #else
@@ -57,6 +62,9 @@ SoftFlacEncoder::SoftFlacEncoder(
       mEncoderWriteData(false),
       mEncoderReturnedEncodedData(false),
       mEncoderReturnedNbBytes(0),
+      mParallelEncoder(NULL),
+      mSawInputEOS(false),
+      mSignalledOutputEOS(false),
       mInputBufferPcm32(NULL)
 #ifdef WRITE_FLAC_HEADER_IN_FIRST_BUFFER
       , mHeaderOffset(0)
@@ -79,10 +87,26 @@ SoftFlacEncoder::SoftFlacEncoder(
             mSignalledError = true;
         }
     }
+
+    char value[PROPERTY_VALUE_MAX];
+    if (!mSignalledError && property_get(PROP_NUM_THREADS, value, NULL) && atoi(value) > 1) {
+        size_t numThreads = atoi(value);
+        if (numThreads > MAX_NUM_THREADS) {
+            numThreads = MAX_NUM_THREADS;
+        }
+        mParallelEncoder = new ParallelFlacEncoder(numThreads);
+        if (mParallelEncoder->initCheck() != OK) {
+            ALOGW("unable to start %zu encoder threads, encoding on one", numThreads);
+            delete mParallelEncoder;
+            mParallelEncoder = NULL;
+        }
+    }
 }
 
 SoftFlacEncoder::~SoftFlacEncoder() {
     ALOGV("SoftFlacEncoder::~SoftFlacEncoder()");
+    delete mParallelEncoder;
+    mParallelEncoder = NULL;
     if (mFlacStreamEncoder != NULL) {
         FLAC__stream_encoder_delete(mFlacStreamEncoder);
         mFlacStreamEncoder = NULL;
@@ -270,6 +294,11 @@ void SoftFlacEncoder::onQueueFilled(OMX_U32 portIndex) {
         return;
     }
 
+    if (mParallelEncoder != NULL) {
+        onQueueFilledParallel();
+        return;
+    }
+
     List<BufferInfo *> &inQueue = getPortQueue(0);
     List<BufferInfo *> &outQueue = getPortQueue(1);
 
@@ -349,6 +378,80 @@ void SoftFlacEncoder::onQueueFilled(OMX_U32 portIndex) {
     }
 }
 
+void SoftFlacEncoder::onQueueFilledParallel() {
+    List<BufferInfo *> &inQueue = getPortQueue(0);
+    List<BufferInfo *> &outQueue = getPortQueue(1);
+
+    // Input buffers are returned as soon as they are copied, the encoder only
+    // waits for its threads once they all have runs queued behind them.
+    while (!mSawInputEOS && !inQueue.empty()) {
+        BufferInfo *inInfo = *inQueue.begin();
+        OMX_BUFFERHEADERTYPE *inHeader = inInfo->mHeader;
+
+        if (inHeader->nFilledLen > kMaxInputBufferSize) {
+            ALOGE("input buffer too large (%d).", inHeader->nFilledLen);
+            mSignalledError = true;
+            notify(OMX_EventError, OMX_ErrorUndefined, 0, NULL);
+            return;
+        }
+
+        mParallelEncoder->queueSamples(
+                reinterpret_cast<const int16_t *>(inHeader->pBuffer + inHeader->nOffset),
+                inHeader->nFilledLen / (2 * mNumChannels),
+                inHeader->nTimeStamp);
+
+        if (inHeader->nFlags & OMX_BUFFERFLAG_EOS) {
+            mParallelEncoder->flush();
+            mSawInputEOS = true;
+        }
+
+        inQueue.erase(inQueue.begin());
+        inInfo->mOwnedByUs = false;
+        notifyEmptyBufferDone(inHeader);
+    }
+
+    // One frame per output buffer. Past EOS the frames still being encoded are
+    // waited for.
+    while (!mSignalledOutputEOS && !outQueue.empty()) {
+        sp<ABuffer> frame;
+        status_t err = mParallelEncoder->dequeueFrame(mSawInputEOS, &frame);
+        if (err == WOULD_BLOCK && !mSawInputEOS) {
+            break;
+        } else if (err != OK && err != WOULD_BLOCK) {
+            ALOGE(" error encountered during encoding");
+            mSignalledError = true;
+            notify(OMX_EventError, OMX_ErrorUndefined, 0, NULL);
+            return;
+        }
+
+        BufferInfo *outInfo = *outQueue.begin();
+        OMX_BUFFERHEADERTYPE *outHeader = outInfo->mHeader;
+        outHeader->nOffset = 0;
+        outHeader->nFilledLen = 0;
+
+        if (frame == NULL) {
+            outHeader->nFlags = OMX_BUFFERFLAG_EOS;
+            mSignalledOutputEOS = true;
+        } else {
+            if (frame->size() > outHeader->nAllocLen) {
+                ALOGE(" not enough space left to write encoded data, dropping %zu bytes",
+                        frame->size());
+                continue;
+            }
+            int64_t timeUs;
+            CHECK(frame->meta()->findInt64("timeUs", &timeUs));
+            memcpy(outHeader->pBuffer, frame->data(), frame->size());
+            outHeader->nFilledLen = frame->size();
+            outHeader->nTimeStamp = timeUs;
+            outHeader->nFlags = 0;
+        }
+
+        outQueue.erase(outQueue.begin());
+        outInfo->mOwnedByUs = false;
+        notifyFillBufferDone(outHeader);
+    }
+}
+
 FLAC__StreamEncoderWriteStatus SoftFlacEncoder::onEncodedFlacAvailable(
             const FLAC__byte buffer[],
             size_t bytes, unsigned samples,
@@ -420,6 +523,17 @@ OMX_ERRORTYPE SoftFlacEncoder::configureEncoder() {
         return OMX_ErrorInvalidState;
     }
 
+    if (mParallelEncoder != NULL) {
+        mSawInputEOS = false;
+        mSignalledOutputEOS = false;
+        if (mParallelEncoder->configure(
+                mNumChannels, mSampleRate, (unsigned)mCompressionLevel) != OK) {
+            ALOGE("unknown error when configuring encoder");
+            return OMX_ErrorUndefined;
+        }
+        return OMX_ErrorNone;
+    }
+
     FLAC__bool ok = true;
     FLAC__StreamEncoderInitStatus initStatus = FLAC__STREAM_ENCODER_INIT_STATUS_OK;
     ok = ok && FLAC__stream_encoder_set_channels(mFlacStreamEncoder, mNumChannels);
@@ -22,6 +22,8 @@
 
 #include "FLAC/stream_encoder.h"
 
+#include "ParallelFlacEncoder.h"
+
 // use this symbol to have the first output buffer start with FLAC frame header so a dump of
 // all the output buffers can be opened as a .flac file
 //#define WRITE_FLAC_HEADER_IN_FIRST_BUFFER
@@ -70,8 +72,16 @@ private:
 
     FLAC__StreamEncoder* mFlacStreamEncoder;
 
+    // set with media.flacenc.num_threads > 1, runs of frames are then encoded
+    // on that many threads rather than in onQueueFilled()
+    ParallelFlacEncoder *mParallelEncoder;
+    bool mSawInputEOS;
+    bool mSignalledOutputEOS;
+
     void initPorts();
 
+    void onQueueFilledParallel();
+
     OMX_ERRORTYPE configureEncoder();
 
     // FLAC encoder callbacks
@@ -17,6 +17,7 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "SoftHEVC"
 #include <utils/Log.h>
+#include <cutils/properties.h>
 
 #include "ihevc_typedefs.h"
 #include "iv.h"
@@ -35,6 +36,9 @@ namespace android {
 #define codingType                      OMX_VIDEO_CodingHEVC
 #define CODEC_MIME_TYPE                 MEDIA_MIMETYPE_VIDEO_HEVC
 
+/** Overrides the number of cores given to the codec when set to a positive value */
+#define PROP_NUM_CORES                  "media.hevcdec.num_cores"
+
 /** Function and structure definitions to keep code similar for each codec */
 #define ivdec_api_function              ihevcd_cxa_api_function
 #define ivdext_init_ip_t                ihevcd_cxa_init_ip_t
@@ -75,6 +79,8 @@ SoftHEVC::SoftHEVC(
       mNewWidth(mWidth),
       mNewHeight(mHeight),
       mChangingResolution(false) {
+    // the codec writes NV12 itself, see setDecodeArgs()
+    mSupportsSemiPlanarOutput = true;
     initPorts(kNumBuffers, INPUT_BUF_SIZE, kNumBuffers,
             CODEC_MIME_TYPE);
     CHECK_EQ(initDecoder(), (status_t)OK);
@@ -98,6 +104,19 @@ static size_t GetCPUCoreCount() {
     return (size_t)cpuCoreCount;
 }
 
+// The codec splits each picture across its cores by CTB rows, so small pictures
+// do not keep more than one core busy: use one core per PIXELS_PER_CORE of
+// picture, at most one per online CPU.
+static size_t GetNumCores(size_t pictureSize) {
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get(PROP_NUM_CORES, value, NULL) && atoi(value) > 0) {
+        ALOGD("Number of cores overridden to %d", atoi(value));
+        return atoi(value);
+    }
+    size_t numCores = (pictureSize + PIXELS_PER_CORE - 1) / PIXELS_PER_CORE;
+    return MIN(numCores, GetCPUCoreCount());
+}
+
 void SoftHEVC::logVersion() {
     ivd_ctl_getversioninfo_ip_t s_ctl_ip;
     ivd_ctl_getversioninfo_op_t s_ctl_op;
@@ -243,8 +262,6 @@ status_t SoftHEVC::initDecoder() {
     UWORD32 u4_share_disp_buf;
     WORD32 i4_level;
 
-    mNumCores = GetCPUCoreCount();
-
     /* Initialize number of ref and reorder modes (for HEVC) */
     u4_num_reorder_frames = 16;
     u4_num_ref_frames = 16;
@@ -254,6 +271,8 @@ status_t SoftHEVC::initDecoder() {
     uint32_t displayHeight = outputBufferHeight();
     uint32_t displaySizeY = displayStride * displayHeight;
 
+    mNumCores = GetNumCores(displaySizeY);
+
     if (displaySizeY > (1920 * 1088)) {
         i4_level = 50;
     } else if (displaySizeY > (1280 * 720)) {
@@ -466,8 +485,14 @@ void SoftHEVC::onReset() {
 OMX_ERRORTYPE SoftHEVC::internalSetParameter(OMX_INDEXTYPE index, const OMX_PTR params) {
     const uint32_t oldWidth = mWidth;
     const uint32_t oldHeight = mHeight;
+    const OMX_COLOR_FORMATTYPE oldColorFormat = mOutputColorFormat;
     OMX_ERRORTYPE ret = SoftVideoDecoderOMXComponent::internalSetParameter(index, params);
-    if (mWidth != oldWidth || mHeight != oldHeight) {
+    if (mOutputColorFormat != oldColorFormat) {
+        mOmxColorFormat = mOutputColorFormat;
+        mIvColorFormat = (mOutputColorFormat == OMX_COLOR_FormatYUV420SemiPlanar)
+                ? IV_YUV_420SP_UV : IV_YUV_420P;
+    }
+    if (mWidth != oldWidth || mHeight != oldHeight || mOutputColorFormat != oldColorFormat) {
         reInitDecoder();
     }
     return ret;
@@ -506,6 +531,16 @@ void SoftHEVC::setDecodeArgs(ivd_video_decode_ip_t *ps_dec_ip,
         pBuf = mFlushOutBuffer;
     }
 
+    if (mIvColorFormat == IV_YUV_420SP_UV) {
+        ps_dec_ip->s_out_buffer.u4_min_out_buf_size[0] = sizeY;
+        ps_dec_ip->s_out_buffer.u4_min_out_buf_size[1] = sizeY / 2;
+
+        ps_dec_ip->s_out_buffer.pu1_bufs[0] = pBuf;
+        ps_dec_ip->s_out_buffer.pu1_bufs[1] = pBuf + sizeY;
+        ps_dec_ip->s_out_buffer.u4_num_bufs = 2;
+        return;
+    }
+
     sizeUV = sizeY / 4;
     ps_dec_ip->s_out_buffer.u4_min_out_buf_size[0] = sizeY;
     ps_dec_ip->s_out_buffer.u4_min_out_buf_size[1] = sizeUV;
@@ -32,6 +32,9 @@ namespace android {
 /** Maximum number of cores supported by the codec */
 #define CODEC_MAX_NUM_CORES 4
 
+/** Picture size that keeps one core of the codec busy */
+#define PIXELS_PER_CORE     (640 * 480)
+
 #define CODEC_MAX_WIDTH     1920
 
 #define CODEC_MAX_HEIGHT    1088
@@ -73,7 +76,8 @@ private:
     iv_mem_rec_t *mMemRecords;   // Memory records requested by the codec
     size_t mNumMemRecords;       // Number of memory records requested by the codec
 
-    size_t mNumCores;            // Number of cores to be uesd by the codec
+    size_t mNumCores;            // Number of cores to be used by the codec, set for the
+                                 // picture size on each init
 
     struct timeval mTimeStart;   // Time at the start of decode()
     struct timeval mTimeEnd;     // Time at the end of decode()
@@ -35,6 +35,13 @@ LOCAL_C_INCLUDES := \
 
 LOCAL_CFLAGS += -Werror
 
+# the 8x8 DCT, IDCT and H.263 quantization in src/ have NEON paths
+ifeq ($(TARGET_ARCH),arm)
+  ifeq ($(ARCH_ARM_HAVE_NEON),true)
+    LOCAL_ARM_NEON := true
+  endif
+endif
+
 include $(BUILD_STATIC_LIBRARY)
 
 ################################################################################
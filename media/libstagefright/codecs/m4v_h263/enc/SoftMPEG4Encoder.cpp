@@ -17,6 +17,7 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "SoftMPEG4Encoder"
 #include <utils/Log.h>
+#include <utils/Timers.h>
 
 #include "mp4enc_api.h"
 #include "OMX_Video.h"
@@ -64,6 +65,9 @@ SoftMPEG4Encoder::SoftMPEG4Encoder(
       mStarted(false),
       mSawInputEOS(false),
       mSignalledError(false),
+      mConvertTimeNs(0),
+      mEncodeTimeNs(0),
+      mNumTimedFrames(0),
       mHandle(new tagvideoEncControls),
       mEncParams(new tagvideoEncOptions),
       mInputFrameData(NULL) {
@@ -175,6 +179,9 @@ OMX_ERRORTYPE SoftMPEG4Encoder::initEncoder() {
     }
 
     mNumInputFrames = -1;  // 1st buffer for codec specific data
+    mConvertTimeNs = 0;
+    mEncodeTimeNs = 0;
+    mNumTimedFrames = 0;
     mStarted = true;
 
     return OMX_ErrorNone;
@@ -185,6 +192,13 @@ OMX_ERRORTYPE SoftMPEG4Encoder::releaseEncoder() {
         return OMX_ErrorNone;
     }
 
+    if (mNumTimedFrames > 0) {
+        ALOGV("%" PRId64 " frames, %" PRId64 " us/frame converting input, "
+                "%" PRId64 " us/frame encoding",
+                mNumTimedFrames, mConvertTimeNs / 1000 / mNumTimedFrames,
+                mEncodeTimeNs / 1000 / mNumTimedFrames);
+    }
+
     PVCleanUpVideoEncoder(mHandle);
 
     free(mInputFrameData);
@@ -658,6 +672,7 @@ void SoftMPEG4Encoder::onQueueFilled(OMX_U32 /* portIndex */) {
         }
 
         if (inHeader->nFilledLen > 0) {
+            nsecs_t convertStart = systemTime();
             const uint8_t *inputData = NULL;
             if (mStoreMetaDataInBuffers) {
                 if (inHeader->nFilledLen != 8) {
@@ -688,6 +703,8 @@ void SoftMPEG4Encoder::onQueueFilled(OMX_U32 /* portIndex */) {
             }
 
             CHECK(inputData != NULL);
+            nsecs_t encodeStart = systemTime();
+            mConvertTimeNs += encodeStart - convertStart;
 
             VideoEncFrameIO vin, vout;
             memset(&vin, 0, sizeof(vin));
@@ -710,6 +727,8 @@ void SoftMPEG4Encoder::onQueueFilled(OMX_U32 /* portIndex */) {
                 mSignalledError = true;
                 notify(OMX_EventError, OMX_ErrorUndefined, 0, 0);
             }
+            mEncodeTimeNs += systemTime() - encodeStart;
+            ++mNumTimedFrames;
             CHECK(NULL == PVGetOverrunBuffer(mHandle));
             if (hintTrack.CodeType == 0) {  // I-frame serves as sync frame
                 outHeader->nFlags |= OMX_BUFFERFLAG_SYNCFRAME;
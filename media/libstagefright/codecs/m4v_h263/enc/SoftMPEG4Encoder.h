@@ -71,6 +71,12 @@ private:
     bool     mSawInputEOS;
     bool     mSignalledError;
 
+    // time spent getting the input into planar YUV, and in PVEncodeVideoFrame(),
+    // logged on release
+    nsecs_t  mConvertTimeNs;
+    nsecs_t  mEncodeTimeNs;
+    int64_t  mNumTimedFrames;
+
     tagvideoEncControls   *mHandle;
     tagvideoEncOptions    *mEncParams;
     uint8_t               *mInputFrameData;
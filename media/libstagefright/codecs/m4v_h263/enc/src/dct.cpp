@@ -17,6 +17,7 @@
  */
 #include "mp4enc_lib.h"
 #include "mp4lib_int.h"
+#include "dct.h"
 #include "dct_inline.h"
 
 #define FDCT_SHIFT 10
@@ -1277,7 +1278,217 @@ extern "C"
         return ;
     }
 
+#ifdef M4VENC_NEON
+    /**************************************************************************/
+    /*  NEON versions of BlockDCT_AANwSub and BlockDCT_AANIntra, bit-exact with
+        the C versions above. The row pass fits in 16 bits (the input is at most
+        9 bits) and runs on a transposed block, 8 rows at a time. The column pass
+        reads back arbitrary Short values and is done in 32 bits like the C,
+        4 columns at a time.                                                  */
+    /**************************************************************************/
+
+    /* (a * c + round) >> FDCT_SHIFT, with the sum kept in 32 bits */
+    static inline int16x8_t MulShift_NEON(int16x8_t a, int16_t c)
+    {
+        int32x4_t round = vdupq_n_s32(1 << (FDCT_SHIFT - 1));
+        int32x4_t lo = vmlal_n_s16(round, vget_low_s16(a), c);
+        int32x4_t hi = vmlal_n_s16(round, vget_high_s16(a), c);
+
+        return vcombine_s16(vshrn_n_s32(lo, FDCT_SHIFT), vshrn_n_s32(hi, FDCT_SHIFT));
+    }
+
+    /* ROTATE k4,k6,392,946, FDCT_SHIFT */
+    static inline void Rotate_NEON(int16x8_t *k4, int16x8_t *k6)
+    {
+        int32x4_t round = vdupq_n_s32(1 << (FDCT_SHIFT - 1));
+        int16x8_t k0 = vsubq_s16(*k4, *k6);
+        int32x4_t lo = vmlal_n_s16(round, vget_low_s16(k0), 392);
+        int32x4_t hi = vmlal_n_s16(round, vget_high_s16(k0), 392);
+        int32x4_t lo4 = vmlal_n_s16(lo, vget_low_s16(*k4), 554);
+        int32x4_t hi4 = vmlal_n_s16(hi, vget_high_s16(*k4), 554);
+        int32x4_t lo6 = vmlal_n_s16(lo, vget_low_s16(*k6), 1338);
+        int32x4_t hi6 = vmlal_n_s16(hi, vget_high_s16(*k6), 1338);
+
+        *k4 = vcombine_s16(vshrn_n_s32(lo4, FDCT_SHIFT), vshrn_n_s32(hi4, FDCT_SHIFT));
+        *k6 = vcombine_s16(vshrn_n_s32(lo6, FDCT_SHIFT), vshrn_n_s32(hi6, FDCT_SHIFT));
+    }
+
+    /* row pass, k[] holds one input column per vector and gets one output column */
+    static inline void FDCTRow_NEON(int16x8_t k[8])
+    {
+        int16x8_t k0, k1, k2, k3, k4, k5, k6, k7;
+
+        /* fdct_1 */
+        k0 = vaddq_s16(k[0], k[7]);
+        k7 = vsubq_s16(k[0], k[7]);
+        k1 = vaddq_s16(k[1], k[6]);
+        k6 = vsubq_s16(k[1], k[6]);
+        k2 = vaddq_s16(k[2], k[5]);
+        k5 = vsubq_s16(k[2], k[5]);
+        k3 = vaddq_s16(k[3], k[4]);
+        k4 = vsubq_s16(k[3], k[4]);
+
+        k[3] = vsubq_s16(k0, k3);
+        k0 = vaddq_s16(k0, k3);
+        k3 = k[3];
+        k[2] = vsubq_s16(k1, k2);
+        k1 = vaddq_s16(k1, k2);
+        k2 = k[2];
+
+        k[0] = vaddq_s16(k0, k1);
+        k[4] = vsubq_s16(k0, k1);
+        /* fdct_2 */
+        k4 = vaddq_s16(k4, k5);
+        k5 = vaddq_s16(k5, k6);
+        k6 = vaddq_s16(k6, k7);
+        k2 = vaddq_s16(k2, k3);
+        k5 = MulShift_NEON(k5, 724);
+        k2 = MulShift_NEON(k2, 724);
+        k2 = vaddq_s16(k2, k3);
+        k3 = vsubq_s16(vshlq_n_s16(k3, 1), k2);
+        k[2] = k2;
+        k[6] = vshlq_n_s16(k3, 1);
+        /* fdct_3 */
+        Rotate_NEON(&k4, &k6);
+        k5 = vaddq_s16(k5, k7);
+        k7 = vsubq_s16(vshlq_n_s16(k7, 1), k5);
+        k4 = vaddq_s16(k4, k7);
+        k7 = vsubq_s16(vshlq_n_s16(k7, 1), k4);
+        k5 = vaddq_s16(k5, k6);
+        k6 = vsubq_s16(k5, vshlq_n_s16(k6, 1));
+        k[5] = vshlq_n_s16(k4, 1);
+        k[1] = k5;
+        k[7] = vshlq_n_s16(k6, 2);
+        k[3] = k7;
+    }
+
+    /* column pass on 4 columns, same operations as FDCTRow_NEON in 32 bits */
+    static inline void FDCTCol_NEON(int32x4_t k[8])
+    {
+        int32x4_t k0, k1, k2, k3, k4, k5, k6, k7;
+        int32x4_t round = vdupq_n_s32(1 << (FDCT_SHIFT - 1));
+
+        /* fdct_1 */
+        k0 = vaddq_s32(k[0], k[7]);
+        k7 = vsubq_s32(k[0], k[7]);
+        k1 = vaddq_s32(k[1], k[6]);
+        k6 = vsubq_s32(k[1], k[6]);
+        k2 = vaddq_s32(k[2], k[5]);
+        k5 = vsubq_s32(k[2], k[5]);
+        k3 = vaddq_s32(k[3], k[4]);
+        k4 = vsubq_s32(k[3], k[4]);
+
+        k[3] = vsubq_s32(k0, k3);
+        k0 = vaddq_s32(k0, k3);
+        k3 = k[3];
+        k[2] = vsubq_s32(k1, k2);
+        k1 = vaddq_s32(k1, k2);
+        k2 = k[2];
+
+        k[0] = vaddq_s32(k0, k1);
+        k[4] = vsubq_s32(k0, k1);
+        /* fdct_2 */
+        k4 = vaddq_s32(k4, k5);
+        k5 = vaddq_s32(k5, k6);
+        k6 = vaddq_s32(k6, k7);
+        k2 = vaddq_s32(k2, k3);
+        k5 = vshrq_n_s32(vmlaq_n_s32(round, k5, 724), FDCT_SHIFT);
+        k2 = vshrq_n_s32(vmlaq_n_s32(round, k2, 724), FDCT_SHIFT);
+        k2 = vaddq_s32(k2, k3);
+        k3 = vsubq_s32(vshlq_n_s32(k3, 1), k2);
+        k[2] = k2;
+        k[6] = vshlq_n_s32(k3, 1);
+        /* fdct_3 */
+        k1 = vmlaq_n_s32(round, vsubq_s32(k4, k6), 392);
+        k0 = vmlaq_n_s32(k1, k4, 554);
+        k1 = vmlaq_n_s32(k1, k6, 1338);
+        k4 = vshrq_n_s32(k0, FDCT_SHIFT);
+        k6 = vshrq_n_s32(k1, FDCT_SHIFT);
+        k5 = vaddq_s32(k5, k7);
+        k7 = vsubq_s32(vshlq_n_s32(k7, 1), k5);
+        k4 = vaddq_s32(k4, k7);
+        k7 = vsubq_s32(vshlq_n_s32(k7, 1), k4);
+        k5 = vaddq_s32(k5, k6);
+        k6 = vsubq_s32(k5, vshlq_n_s32(k6, 1));
+        k[5] = vshlq_n_s32(k4, 1);
+        k[1] = k5;
+        k[7] = vshlq_n_s32(k6, 2);
+        k[3] = k7;
+    }
+
+    /* r[] holds the 8 rows of residue (times 2), output goes to out[64...127]
+       like the C, with 0x7fff marking the columns below threshold */
+    static void BlockDCT_NEON(Short *out, int16x8_t r[8])
+    {
+        int32x4_t lo[8], hi[8];
+        int32x4_t ColTh = vdupq_n_s32(out[64]);
+        int32x4_t sum_lo, sum_hi;
+        uint16x8_t skip;
+        Int i;
+
+        Transpose8x8_NEON(r);
+        FDCTRow_NEON(r);
+        Transpose8x8_NEON(r);
+
+        for (i = 0; i < 8; i++)
+        {
+            lo[i] = vmovl_s16(vget_low_s16(r[i]));
+            hi[i] = vmovl_s16(vget_high_s16(r[i]));
+        }
+
+        /* deadzone thresholding for column, see sum_abs() */
+        sum_lo = veorq_s32(lo[0], vshrq_n_s32(lo[0], 31));
+        sum_hi = veorq_s32(hi[0], vshrq_n_s32(hi[0], 31));
+        for (i = 1; i < 8; i++)
+        {
+            sum_lo = vaddq_s32(sum_lo, vabsq_s32(lo[i]));
+            sum_hi = vaddq_s32(sum_hi, vabsq_s32(hi[i]));
+        }
+        skip = vcombine_u16(vmovn_u32(vcltq_s32(sum_lo, ColTh)), vmovn_u32(vcltq_s32(sum_hi, ColTh)));
+
+        FDCTCol_NEON(lo);
+        FDCTCol_NEON(hi);
+
+        out += 64;
+        vst1q_s16(out, vbslq_s16(skip, vdupq_n_s16(0x7fff),
+                                 vcombine_s16(vmovn_s32(lo[0]), vmovn_s32(hi[0]))));
+        for (i = 1; i < 8; i++)
+        {
+            vst1q_s16(out + (i << 3), vbslq_s16(skip, r[i],
+                                                vcombine_s16(vmovn_s32(lo[i]), vmovn_s32(hi[i]))));
+        }
+    }
+
+    Void BlockDCT_AANwSub_NEON(Short *out, UChar *cur, UChar *pred, Int width)
+    {
+        int16x8_t r[8];
+        Int i;
+
+        for (i = 0; i < 8; i++)
+        {
+            r[i] = vreinterpretq_s16_u16(vshlq_n_u16(vsubl_u8(vld1_u8(cur), vld1_u8(pred)), 1));
+            cur += width;
+            pred += 16;
+        }
+        BlockDCT_NEON(out, r);
+    }
+
+    Void BlockDCT_AANIntra_NEON(Short *out, UChar *cur, UChar *dummy2, Int width)
+    {
+        int16x8_t r[8];
+        Int i;
+
+        OSCL_UNUSED_ARG(dummy2);
+
+        for (i = 0; i < 8; i++)
+        {
+            r[i] = vreinterpretq_s16_u16(vshll_n_u8(vld1_u8(cur), 1));
+            cur += width;
+        }
+        BlockDCT_NEON(out, r);
+    }
+#endif /* M4VENC_NEON */
+
 #ifdef __cplusplus
 }
 #endif
-
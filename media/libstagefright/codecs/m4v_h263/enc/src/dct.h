@@ -18,6 +18,10 @@
 #ifndef _DCT_H_
 #define _DCT_H_
 
+#ifdef M4VENC_NEON
+#include <arm_neon.h>
+#endif
+
 const static Int ColThInter[32] = {0, 0x1C, 0x4C, 0x6C, 0x9C, 0xBC, 0xEC, 0x10C,
                                    0x13C, 0x15C, 0x18C, 0x1AC, 0x1DC, 0x1FC, 0x22C, 0x24C,
                                    0x27C, 0x29C, 0x2CC, 0x2EC, 0x31C, 0x33C, 0x36C, 0x38C,
@@ -183,9 +187,38 @@ extern "C"
     Void BlockDCT_AANIntra(Short *out, UChar *cur, UChar *dummy1, Int pitch_chroma);
     Void Block4x4DCT_AANIntra(Short *out, UChar *cur, UChar *dummy1, Int pitch_chroma);
     Void Block2x2DCT_AANIntra(Short *out, UChar *cur, UChar *dummy1, Int pitch_chroma);
+#ifdef M4VENC_NEON
+    /* same output as BlockDCT_AANwSub and BlockDCT_AANIntra */
+    Void BlockDCT_AANwSub_NEON(Short *out, UChar *cur, UChar *prev, Int pitch_chroma);
+    Void BlockDCT_AANIntra_NEON(Short *out, UChar *cur, UChar *dummy1, Int pitch_chroma);
+#endif
 
 #ifdef __cplusplus
 }
 #endif
 
+#ifdef M4VENC_NEON
+/* transposes the 8x8 block held as 8 rows */
+static inline void Transpose8x8_NEON(int16x8_t r[8])
+{
+    int16x8x2_t t0 = vtrnq_s16(r[0], r[1]);
+    int16x8x2_t t1 = vtrnq_s16(r[2], r[3]);
+    int16x8x2_t t2 = vtrnq_s16(r[4], r[5]);
+    int16x8x2_t t3 = vtrnq_s16(r[6], r[7]);
+    int32x4x2_t u0 = vtrnq_s32(vreinterpretq_s32_s16(t0.val[0]), vreinterpretq_s32_s16(t1.val[0]));
+    int32x4x2_t u1 = vtrnq_s32(vreinterpretq_s32_s16(t0.val[1]), vreinterpretq_s32_s16(t1.val[1]));
+    int32x4x2_t u2 = vtrnq_s32(vreinterpretq_s32_s16(t2.val[0]), vreinterpretq_s32_s16(t3.val[0]));
+    int32x4x2_t u3 = vtrnq_s32(vreinterpretq_s32_s16(t2.val[1]), vreinterpretq_s32_s16(t3.val[1]));
+
+    r[0] = vreinterpretq_s16_s32(vcombine_s32(vget_low_s32(u0.val[0]), vget_low_s32(u2.val[0])));
+    r[1] = vreinterpretq_s16_s32(vcombine_s32(vget_low_s32(u1.val[0]), vget_low_s32(u3.val[0])));
+    r[2] = vreinterpretq_s16_s32(vcombine_s32(vget_low_s32(u0.val[1]), vget_low_s32(u2.val[1])));
+    r[3] = vreinterpretq_s16_s32(vcombine_s32(vget_low_s32(u1.val[1]), vget_low_s32(u3.val[1])));
+    r[4] = vreinterpretq_s16_s32(vcombine_s32(vget_high_s32(u0.val[0]), vget_high_s32(u2.val[0])));
+    r[5] = vreinterpretq_s16_s32(vcombine_s32(vget_high_s32(u1.val[0]), vget_high_s32(u3.val[0])));
+    r[6] = vreinterpretq_s16_s32(vcombine_s32(vget_high_s32(u0.val[1]), vget_high_s32(u2.val[1])));
+    r[7] = vreinterpretq_s16_s32(vcombine_s32(vget_high_s32(u1.val[1]), vget_high_s32(u3.val[1])));
+}
+#endif
+
 #endif //_DCT_H_
@@ -99,8 +99,13 @@ PV_STATUS CodeMB_H263(VideoEncData *video, approxDCT *function, Int QP, Int ncoe
         BlockDCT1x1 = &Block1x1DCTIntra;
         BlockDCT2x2 = &Block2x2DCT_AANIntra;
         BlockDCT4x4 = &Block4x4DCT_AANIntra;
+#ifdef M4VENC_NEON
+        BlockDCT8x8 = &BlockDCT_AANIntra_NEON;
+        BlockQuantDequantH263 = &BlockQuantDequantH263Intra_NEON;
+#else
         BlockDCT8x8 = &BlockDCT_AANIntra;
         BlockQuantDequantH263 = &BlockQuantDequantH263Intra;
+#endif
         BlockQuantDequantH263DC = &BlockQuantDequantH263DCIntra;
         if (shortHeader)
         {
@@ -118,9 +123,13 @@ PV_STATUS CodeMB_H263(VideoEncData *video, approxDCT *function, Int QP, Int ncoe
         BlockDCT1x1 = &Block1x1DCTwSub;
         BlockDCT2x2 = &Block2x2DCT_AANwSub;
         BlockDCT4x4 = &Block4x4DCT_AANwSub;
+#ifdef M4VENC_NEON
+        BlockDCT8x8 = &BlockDCT_AANwSub_NEON;
+        BlockQuantDequantH263 = &BlockQuantDequantH263Inter_NEON;
+#else
         BlockDCT8x8 = &BlockDCT_AANwSub;
-
         BlockQuantDequantH263 = &BlockQuantDequantH263Inter;
+#endif
         BlockQuantDequantH263DC = &BlockQuantDequantH263DCInter;
         ColTh = ColThInter[QP];
         DctTh1 = (Int)(16 * QP);  //9*QP;
@@ -233,7 +242,11 @@ PV_STATUS CodeMB_H263(VideoEncData *video, approxDCT *function, Int QP, Int ncoe
             CBP |= (*BlockQuantDequantH263)(dataBlock, output, &QuantParam,
                                             bitmapcol, bitmaprow + k, bitmapzz, dctMode, k, dc_scaler, shortHeader);
         }
+#ifdef M4VENC_NEON
+        BlockIDCTMotionComp_NEON(dataBlock, bitmapcol, bitmaprow[k], dctMode, rec, pred, (lx << 1) | intra);
+#else
         BlockIDCTMotionComp(dataBlock, bitmapcol, bitmaprow[k], dctMode, rec, pred, (lx << 1) | intra);
+#endif
         output += 64;
         if (!(k&1))
         {
@@ -324,7 +337,11 @@ PV_STATUS CodeMB_MPEG(VideoEncData *video, approxDCT *function, Int QP, Int ncoe
         BlockDCT1x1 = &Block1x1DCTIntra;
         BlockDCT2x2 = &Block2x2DCT_AANIntra;
         BlockDCT4x4 = &Block4x4DCT_AANIntra;
+#ifdef M4VENC_NEON
+        BlockDCT8x8 = &BlockDCT_AANIntra_NEON;
+#else
         BlockDCT8x8 = &BlockDCT_AANIntra;
+#endif
 
         BlockQuantDequantMPEG = &BlockQuantDequantMPEGIntra;
         BlockQuantDequantMPEGDC = &BlockQuantDequantMPEGDCIntra;
@@ -341,7 +358,11 @@ PV_STATUS CodeMB_MPEG(VideoEncData *video, approxDCT *function, Int QP, Int ncoe
         BlockDCT1x1 = &Block1x1DCTwSub;
         BlockDCT2x2 = &Block2x2DCT_AANwSub;
         BlockDCT4x4 = &Block4x4DCT_AANwSub;
+#ifdef M4VENC_NEON
+        BlockDCT8x8 = &BlockDCT_AANwSub_NEON;
+#else
         BlockDCT8x8 = &BlockDCT_AANwSub;
+#endif
 
         BlockQuantDequantMPEG = &BlockQuantDequantMPEGInter;
         BlockQuantDequantMPEGDC = &BlockQuantDequantMPEGDCInter;
@@ -453,7 +474,11 @@ PV_STATUS CodeMB_MPEG(VideoEncData *video, approxDCT *function, Int QP, Int ncoe
                                             bitmapcol, bitmaprow + k, bitmapzz, dctMode, k, dc_scaler); //
         }
         dctMode = 8; /* for mismatch handle */
+#ifdef M4VENC_NEON
+        BlockIDCTMotionComp_NEON(dataBlock, bitmapcol, bitmaprow[k], dctMode, rec, pred, (lx << 1) | (intra));
+#else
         BlockIDCTMotionComp(dataBlock, bitmapcol, bitmaprow[k], dctMode, rec, pred, (lx << 1) | (intra));
+#endif
 
         output += 64;
         if (!(k&1))
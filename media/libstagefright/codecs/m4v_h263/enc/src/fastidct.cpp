@@ -2018,3 +2018,182 @@ void BlockIDCTMotionComp(Short *block, UChar *bitmapcol, UChar bitmaprow,
             idct_rowzmv(block, rec, pred, lx);
     }
 }
+
+#ifdef M4VENC_NEON
+/* ======================================================================== */
+/*  Function : BlockIDCTMotionComp_NEON                                     */
+/*  Purpose  : NEON version of BlockIDCTMotionComp for the full 8x8 case,   */
+/*              i.e. when some of columns 4 to 7 are non-zero, bit-exact    */
+/*              with idct_col() and idct_rowIntra()/idct_rowzmv(). The      */
+/*              reduced IDCTs are exact for their input so all 8 columns    */
+/*              go through the full one. The other cases use the C.         */
+/* ======================================================================== */
+
+/* first, second and third stages of idct_col() on 4 columns, in place */
+static inline void IDCTCol_NEON(int32x4_t x[8])
+{
+    int32x4_t x0, x1, x2, x3, x4, x5, x6, x7, x8;
+    int32x4_t round = vdupq_n_s32(128);
+
+    x1 = vshlq_n_s32(x[4], 11);
+    x2 = x[6];
+    x3 = x[2];
+    x4 = x[1];
+    x5 = x[7];
+    x6 = x[5];
+    x7 = x[3];
+    x0 = vaddq_s32(vshlq_n_s32(x[0], 11), round);
+
+    /* first stage */
+    x8 = vmulq_n_s32(vaddq_s32(x4, x5), W7);
+    x4 = vmlaq_n_s32(x8, x4, W1 - W7);
+    x5 = vmlsq_n_s32(x8, x5, W1 + W7);
+    x8 = vmulq_n_s32(vaddq_s32(x6, x7), W3);
+    x6 = vmlsq_n_s32(x8, x6, W3 - W5);
+    x7 = vmlsq_n_s32(x8, x7, W3 + W5);
+
+    /* second stage */
+    x8 = vaddq_s32(x0, x1);
+    x0 = vsubq_s32(x0, x1);
+    x1 = vmulq_n_s32(vaddq_s32(x3, x2), W6);
+    x2 = vmlsq_n_s32(x1, x2, W2 + W6);
+    x3 = vmlaq_n_s32(x1, x3, W2 - W6);
+    x1 = vaddq_s32(x4, x6);
+    x4 = vsubq_s32(x4, x6);
+    x6 = vaddq_s32(x5, x7);
+    x5 = vsubq_s32(x5, x7);
+
+    /* third stage */
+    x7 = vaddq_s32(x8, x3);
+    x8 = vsubq_s32(x8, x3);
+    x3 = vaddq_s32(x0, x2);
+    x0 = vsubq_s32(x0, x2);
+    x2 = vshrq_n_s32(vmlaq_n_s32(round, vaddq_s32(x4, x5), 181), 8);
+    x4 = vshrq_n_s32(vmlaq_n_s32(round, vsubq_s32(x4, x5), 181), 8);
+
+    /* fourth stage, without the final shift */
+    x[0] = vaddq_s32(x7, x1);
+    x[1] = vaddq_s32(x3, x2);
+    x[2] = vaddq_s32(x0, x4);
+    x[3] = vaddq_s32(x8, x6);
+    x[4] = vsubq_s32(x8, x6);
+    x[5] = vsubq_s32(x0, x4);
+    x[6] = vsubq_s32(x3, x2);
+    x[7] = vsubq_s32(x7, x1);
+}
+
+/* same as IDCTCol_NEON with the scaling of idct_rowIntra()/idct_rowzmv() */
+static inline void IDCTRow_NEON(int32x4_t x[8])
+{
+    int32x4_t x0, x1, x2, x3, x4, x5, x6, x7, x8;
+    int32x4_t four = vdupq_n_s32(4);
+
+    x1 = vshlq_n_s32(x[4], 8);
+    x2 = x[6];
+    x3 = x[2];
+    x4 = x[1];
+    x5 = x[7];
+    x6 = x[5];
+    x7 = x[3];
+    x0 = vaddq_s32(vshlq_n_s32(x[0], 8), vdupq_n_s32(8192));
+
+    /* first stage */
+    x8 = vmlaq_n_s32(four, vaddq_s32(x4, x5), W7);
+    x4 = vshrq_n_s32(vmlaq_n_s32(x8, x4, W1 - W7), 3);
+    x5 = vshrq_n_s32(vmlsq_n_s32(x8, x5, W1 + W7), 3);
+    x8 = vmlaq_n_s32(four, vaddq_s32(x6, x7), W3);
+    x6 = vshrq_n_s32(vmlsq_n_s32(x8, x6, W3 - W5), 3);
+    x7 = vshrq_n_s32(vmlsq_n_s32(x8, x7, W3 + W5), 3);
+
+    /* second stage */
+    x8 = vaddq_s32(x0, x1);
+    x0 = vsubq_s32(x0, x1);
+    x1 = vmlaq_n_s32(four, vaddq_s32(x3, x2), W6);
+    x2 = vshrq_n_s32(vmlsq_n_s32(x1, x2, W2 + W6), 3);
+    x3 = vshrq_n_s32(vmlaq_n_s32(x1, x3, W2 - W6), 3);
+    x1 = vaddq_s32(x4, x6);
+    x4 = vsubq_s32(x4, x6);
+    x6 = vaddq_s32(x5, x7);
+    x5 = vsubq_s32(x5, x7);
+
+    /* third stage */
+    x7 = vaddq_s32(x8, x3);
+    x8 = vsubq_s32(x8, x3);
+    x3 = vaddq_s32(x0, x2);
+    x0 = vsubq_s32(x0, x2);
+    x2 = vshrq_n_s32(vmlaq_n_s32(vdupq_n_s32(128), vaddq_s32(x4, x5), 181), 8);
+    x4 = vshrq_n_s32(vmlaq_n_s32(vdupq_n_s32(128), vsubq_s32(x4, x5), 181), 8);
+
+    /* fourth stage, without the final shift */
+    x[0] = vaddq_s32(x7, x1);
+    x[1] = vaddq_s32(x3, x2);
+    x[2] = vaddq_s32(x0, x4);
+    x[3] = vaddq_s32(x8, x6);
+    x[4] = vsubq_s32(x8, x6);
+    x[5] = vsubq_s32(x0, x4);
+    x[6] = vsubq_s32(x3, x2);
+    x[7] = vsubq_s32(x7, x1);
+}
+
+void BlockIDCTMotionComp_NEON(Short *block, UChar *bitmapcol, UChar bitmaprow,
+                              Int dctMode, UChar *rec, UChar *pred, Int lx_intra)
+{
+    int16x8_t r[8];
+    int32x4_t lo[8], hi[8];
+    Int i;
+    Int lx = lx_intra >> 1;
+    Int intra = (lx_intra & 1);
+
+    if (dctMode != 8 || (bitmaprow & 0xf) == 0)
+    {
+        BlockIDCTMotionComp(block, bitmapcol, bitmaprow, dctMode, rec, pred, lx_intra);
+        return ;
+    }
+
+    /* column IDCT, Short output like idct_col() */
+    for (i = 0; i < 8; i++)
+    {
+        r[i] = vld1q_s16(block + (i << 3));
+        lo[i] = vmovl_s16(vget_low_s16(r[i]));
+        hi[i] = vmovl_s16(vget_high_s16(r[i]));
+    }
+    IDCTCol_NEON(lo);
+    IDCTCol_NEON(hi);
+    for (i = 0; i < 8; i++)
+    {
+        r[i] = vcombine_s16(vshrn_n_s32(lo[i], 8), vshrn_n_s32(hi[i], 8));
+        vst1q_s16(block + (i << 3), vdupq_n_s16(0));
+    }
+
+    /* row IDCT on the transposed block */
+    Transpose8x8_NEON(r);
+    for (i = 0; i < 8; i++)
+    {
+        lo[i] = vmovl_s16(vget_low_s16(r[i]));
+        hi[i] = vmovl_s16(vget_high_s16(r[i]));
+    }
+    IDCTRow_NEON(lo);
+    IDCTRow_NEON(hi);
+    /* saturating to 16 bits does not change the clipped sums below */
+    for (i = 0; i < 8; i++)
+    {
+        r[i] = vcombine_s16(vqshrn_n_s32(lo[i], 14), vqshrn_n_s32(hi[i], 14));
+    }
+    Transpose8x8_NEON(r);
+
+    for (i = 0; i < 8; i++)
+    {
+        if (intra)
+        {
+            vst1_u8(rec, vqmovun_s16(r[i]));
+        }
+        else
+        {
+            int16x8_t p = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(pred)));
+            vst1_u8(rec, vqmovun_s16(vqaddq_s16(r[i], p)));
+            pred += 16;
+        }
+        rec += lx;
+    }
+}
+#endif /* M4VENC_NEON */
@@ -17,6 +17,9 @@
  */
 #include "mp4enc_lib.h"
 #include "fastquant_inline.h"
+#ifdef M4VENC_NEON
+#include <arm_neon.h>
+#endif
 
 #define siz 63
 #define LSL 18
@@ -525,6 +528,210 @@ Int BlockQuantDequantH263DCIntra(Short *rcoeff, Short *qcoeff, struct QPstruct *
     return 0;
 }
 
+#ifdef M4VENC_NEON
+/***********************************************************************
+ Function: BlockQuantDequantH263Inter_NEON, BlockQuantDequantH263Intra_NEON
+ Purpose:  NEON versions of BlockQuantDequantH263Inter/Intra for the full
+           8x8 DCT, bit-exact with the C. All 64 coefficients go through
+           the quantizer, the ones the C skips with the QPx2plus test
+           quantize to zero. Only the zigzag order of the INTER levels is
+           done in scalar code, for the non-zero ones.
+ ********************************************************************/
+const static UChar colbit[8] = {1, 2, 4, 8, 16, 32, 64, 128};
+
+/* one half row of aan_scale(), coeff_quant(), coeff_clip() and coeff_dequant() */
+static inline int32x4_t QuantDequant_NEON(int16x4_t coeff, int16x4_t scale, Int QPdiv2,
+        Int q_scale, Int shift, Int ac_clip, Int QPx2, Int Addition, int32x4_t *rec)
+{
+    int32x4_t q_value, val;
+    uint32x4_t neg;
+
+    val = vshrq_n_s32(vmlal_s16(vdupq_n_s32(1 << 15), coeff, scale), 16);
+    neg = vcltq_s32(val, vdupq_n_s32(0));
+    val = vbslq_s32(neg, vaddq_s32(val, vdupq_n_s32(QPdiv2)), vsubq_s32(val, vdupq_n_s32(QPdiv2)));
+
+    q_value = vshlq_s32(vmulq_n_s32(val, q_scale), vdupq_n_s32(-shift));
+    q_value = vsubq_s32(q_value, vshrq_n_s32(q_value, 31)); /* add one if negative */
+    q_value = vmaxq_s32(vminq_s32(q_value, vdupq_n_s32(ac_clip)), vdupq_n_s32(-ac_clip - 1));
+
+    val = vmulq_n_s32(q_value, QPx2);
+    neg = vcltq_s32(q_value, vdupq_n_s32(0));
+    *rec = vbslq_s32(neg, vmaxq_s32(vsubq_s32(val, vdupq_n_s32(Addition)), vdupq_n_s32(-2048)),
+                     vminq_s32(vaddq_s32(val, vdupq_n_s32(Addition)), vdupq_n_s32(2047)));
+    return q_value;
+}
+
+/* quantizes one row, returns the non-zero levels mask */
+static inline uint16x8_t QuantDequantRow_NEON(Short *rcoeff, const Short *scale, Int QPdiv2,
+        Int q_scale, Int shift, Int ac_clip, Int QPx2, Int Addition, int16x8_t *level, int16x8_t *rec)
+{
+    int16x8_t coeff = vld1q_s16(rcoeff);
+    int16x8_t aan = vld1q_s16(scale);
+    int32x4_t q_lo, q_hi, rec_lo, rec_hi;
+
+    q_lo = QuantDequant_NEON(vget_low_s16(coeff), vget_low_s16(aan), QPdiv2, q_scale, shift,
+                             ac_clip, QPx2, Addition, &rec_lo);
+    q_hi = QuantDequant_NEON(vget_high_s16(coeff), vget_high_s16(aan), QPdiv2, q_scale, shift,
+                             ac_clip, QPx2, Addition, &rec_hi);
+    *level = vcombine_s16(vmovn_s32(q_lo), vmovn_s32(q_hi));
+    *rec = vcombine_s16(vmovn_s32(rec_lo), vmovn_s32(rec_hi));
+    return vtstq_s16(*level, *level);
+}
+
+static inline UInt OrBytes_NEON(uint8x8_t bits)
+{
+    return (UInt)vget_lane_u64(vpaddl_u32(vpaddl_u16(vpaddl_u8(bits))), 0);
+}
+
+Int BlockQuantDequantH263Inter_NEON(Short *rcoeff, Short *qcoeff, struct QPstruct *QuantParam,
+                                    UChar bitmapcol[ ], UChar *bitmaprow, UInt *bitmapzz,
+                                    Int dctMode, Int comp, Int dummy, UChar shortHeader)
+{
+    Int i, zz;
+    UInt bits;
+    Short level_row[8];
+    Int q_scale = scaleArrayV[QuantParam->QP];
+    Int shift = 15 + (QuantParam->QPx2 >> 4);
+    Int ac_clip = shortHeader ? 126 : 2047;
+    int16x8_t level, rec;
+    uint16x8_t live, nz;
+    uint8x8_t col = vdup_n_u8(0);
+    uint8x8_t row;
+
+    if (dctMode != 8)
+    {
+        return BlockQuantDequantH263Inter(rcoeff, qcoeff, QuantParam, bitmapcol, bitmaprow,
+                                          bitmapzz, dctMode, comp, dummy, shortHeader);
+    }
+
+    bitmapzz[0] = bitmapzz[1] = 0;
+
+    /* columns below the DCT threshold are skipped */
+    live = vmvnq_u16(vceqq_s16(vld1q_s16(rcoeff + 64), vdupq_n_s16(0x7fff)));
+
+    for (i = 0; i < 8; i++)
+    {
+        nz = QuantDequantRow_NEON(rcoeff + 64 + (i << 3), AANScale + (i << 3), QuantParam->QPdiv2,
+                                  q_scale, shift, ac_clip, QuantParam->QPx2, QuantParam->Addition,
+                                  &level, &rec);
+        nz = vandq_u16(nz, live);
+        vst1q_s16(rcoeff + (i << 3), vbslq_s16(nz, rec, vld1q_s16(rcoeff + (i << 3))));
+
+        row = vmovn_u16(nz);
+        col = vorr_u8(col, vand_u8(row, vdup_n_u8(imask[i])));
+        bits = OrBytes_NEON(vand_u8(row, vld1_u8(colbit)));
+        if (bits)
+        {
+            vst1q_s16(level_row, level);
+            do
+            {
+                Int j = __builtin_ctz(bits);
+                bits &= bits - 1;
+
+                zz = ZZTab[(i << 3) + j] >> 1;
+                qcoeff[zz] = level_row[j];
+                if (zz > 31) bitmapzz[1] |= ((UInt)1 << (63 - zz));
+                else        bitmapzz[0] |= ((UInt)1 << (31 - zz));
+            }
+            while (bits);
+        }
+    }
+
+    vst1_u8(bitmapcol, col);
+    *bitmaprow = OrBytes_NEON(vand_u8(vtst_u8(col, col), vld1_u8(imask)));
+
+    if (*bitmaprow)
+        return 1;
+    else
+        return 0;
+}
+
+Int BlockQuantDequantH263Intra_NEON(Short *rcoeff, Short *qcoeff, struct QPstruct *QuantParam,
+                                    UChar bitmapcol[ ], UChar *bitmaprow, UInt *bitmapzz,
+                                    Int dctMode, Int comp, Int dc_scaler, UChar shortHeader)
+{
+    Int i;
+    Int coeff, q_value;
+    Int q_scale = scaleArrayV[QuantParam->QP];
+    Int shift = 15 + (QuantParam->QPx2 >> 4);
+    Int ac_clip = shortHeader ? 126 : 2047;
+    UInt dc = 0;
+    int16x8_t level, rec;
+    uint16x8_t live, nz;
+    uint8x8_t col = vdup_n_u8(0);
+
+    /* the C skips the rest of the first column, and the first row of the
+       next one, on a 0x7fff right below a coded DC, leave that to it */
+    if (dctMode != 8 || (rcoeff[64] != 0x7fff && rcoeff[72] == 0x7fff))
+    {
+        return BlockQuantDequantH263Intra(rcoeff, qcoeff, QuantParam, bitmapcol, bitmaprow,
+                                          bitmapzz, dctMode, comp, dc_scaler, shortHeader);
+    }
+
+    /* DC value, as in BlockQuantDequantH263Intra */
+    coeff = rcoeff[64];
+    if (coeff == 0x7fff)
+    {
+        if (shortHeader)
+        {
+            qcoeff[0] = 1; /* can't be zero */
+            rcoeff[0] = PV_MAX(-2048, PV_MIN(2047, dc_scaler));
+            dc = 128;
+        }
+    }
+    else
+    {
+        q_value = (1 << 15) + (coeff << 12);
+        coeff = q_value >> 16;
+        if (coeff >= 0) coeff += (dc_scaler >> 1) ;
+        else            coeff -= (dc_scaler >> 1) ;
+        q_value = scaleArrayV2[dc_scaler];
+        coeff = coeff * q_value;
+        coeff >>= (15 + (dc_scaler >> 4));
+        coeff += ((UInt)coeff >> 31);
+
+        if (shortHeader)
+            coeff = PV_MAX(1, PV_MIN(254, coeff));
+
+        if (coeff)
+        {
+            qcoeff[0] = coeff;
+            coeff = coeff * dc_scaler;
+            rcoeff[0] = PV_MAX(-2048, PV_MIN(2047, coeff));
+            dc = 128;
+        }
+    }
+
+    /* AC values, the whole first column goes with a skipped DC */
+    live = vmvnq_u16(vceqq_s16(vld1q_s16(rcoeff + 64), vdupq_n_s16(0x7fff)));
+
+    for (i = 0; i < 8; i++)
+    {
+        /* no dead zone for INTRA */
+        nz = QuantDequantRow_NEON(rcoeff + 64 + (i << 3), AANScale + (i << 3), 0, q_scale, shift,
+                                  ac_clip, QuantParam->QPx2, QuantParam->Addition, &level, &rec);
+        nz = vandq_u16(nz, live);
+        if (i == 0)
+        {
+            nz = vsetq_lane_u16(0, nz, 0);
+        }
+        vst1q_s16(rcoeff + (i << 3), vbslq_s16(nz, rec, vld1q_s16(rcoeff + (i << 3))));
+        vst1q_s16(qcoeff + (i << 3), vbslq_s16(nz, level, vld1q_s16(qcoeff + (i << 3))));
+
+        col = vorr_u8(col, vand_u8(vmovn_u16(nz), vdup_n_u8(imask[i])));
+    }
+    col = vorr_u8(col, vcreate_u8(dc));
+
+    vst1_u8(bitmapcol, col);
+    *bitmaprow = OrBytes_NEON(vand_u8(vtst_u8(col, col), vld1_u8(imask)));
+
+    if (((*bitmaprow)&127) || (bitmapcol[0]&127)) /* exclude DC */
+        return 1;
+    else
+        return 0;
+}
+#endif /* M4VENC_NEON */
+
 #ifndef NO_MPEG_QUANT
 /***********************************************************************
  Function: BlckQuantDequantMPEG
@@ -21,6 +21,10 @@
 #include "mp4def.h"     // typedef
 #include "mp4lib_int.h" // main video structure
 
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define M4VENC_NEON
+#endif
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -76,6 +80,17 @@ extern "C"
     Int BlockQuantDequantH263DCIntra(Short *rcoeff, Short *qcoeff, struct QPstruct *QuantParam,
                                      UChar *bitmaprow, UInt *bitmapzz, Int dc_scaler, UChar shortHeader);
 
+#ifdef M4VENC_NEON
+    /* same output as the C versions, full 8x8 blocks only (others use the C versions) */
+    Int BlockQuantDequantH263Inter_NEON(Short *rcoeff, Short *qcoeff, struct QPstruct *QuantParam,
+                                        UChar bitmapcol[ ], UChar *bitmaprow, UInt *bitmapzz,
+                                        Int dctMode, Int comp, Int dummy, UChar shortHeader);
+
+    Int BlockQuantDequantH263Intra_NEON(Short *rcoeff, Short *qcoeff, struct QPstruct *QuantParam,
+                                        UChar bitmapcol[ ], UChar *bitmaprow, UInt *bitmapzz,
+                                        Int dctMode, Int comp, Int dc_scaler, UChar shortHeader);
+#endif
+
 #ifndef NO_MPEG_QUANT
     Int BlockQuantDequantMPEGInter(Short *rcoeff, Short *qcoeff, Int QP, Int *qmat,
                                    UChar bitmapcol[ ], UChar *bitmaprow, UInt *bitmapzz,
@@ -95,6 +110,10 @@ extern "C"
     /*---- FastIDCT.c -----*/
     void BlockIDCTMotionComp(Short *block, UChar *bitmapcol, UChar bitmaprow,
                              Int dctMode, UChar *rec, UChar *prev, Int lx_intra_zeroMV);
+#ifdef M4VENC_NEON
+    void BlockIDCTMotionComp_NEON(Short *block, UChar *bitmapcol, UChar bitmaprow,
+                                  Int dctMode, UChar *rec, UChar *prev, Int lx_intra_zeroMV);
+#endif
 
 
     /* defined in motion_comp.c */
@@ -30,13 +30,24 @@ LOCAL_SRC_FILES := \
 
 ifeq ($(TARGET_ARCH),arm)
 LOCAL_SRC_FILES += \
-	src/asm/pvmp3_polyphase_filter_window_gcc.s \
  	src/asm/pvmp3_mdct_18_gcc.s \
  	src/asm/pvmp3_dct_9_gcc.s \
 	src/asm/pvmp3_dct_16_gcc.s
+# with NEON the polyphase filter window is the NEON one, built along with the
+# C one it is checked against, instead of the assembly
+ifeq ($(ARCH_ARM_HAVE_NEON),true)
+LOCAL_SRC_FILES += \
+ 	src/pvmp3_polyphase_filter_window.cpp \
+ 	src/pvmp3_polyphase_filter_window_neon.cpp
+LOCAL_ARM_NEON := true
+else
+LOCAL_SRC_FILES += \
+	src/asm/pvmp3_polyphase_filter_window_gcc.s
+endif
 else
 LOCAL_SRC_FILES += \
  	src/pvmp3_polyphase_filter_window.cpp \
+ 	src/pvmp3_polyphase_filter_window_neon.cpp \
  	src/pvmp3_mdct_18.cpp \
  	src/pvmp3_dct_9.cpp \
  	src/pvmp3_dct_16.cpp
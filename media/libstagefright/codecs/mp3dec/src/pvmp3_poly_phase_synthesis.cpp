@@ -87,6 +87,11 @@
 ; Define module specific macros here
 ----------------------------------------------------------------------------*/
 
+#ifdef PVMP3_NEON
+#define POLYPHASE_FILTER_WINDOW pvmp3_polyphase_filter_window_neon
+#else
+#define POLYPHASE_FILTER_WINDOW pvmp3_polyphase_filter_window
+#endif
 
 /*----------------------------------------------------------------------------
 ; DEFINES
@@ -150,9 +155,9 @@ void pvmp3_poly_phase_synthesis(tmp3dec_chan   *pChVars,
 
         pvmp3_merge_in_place_N32(inData);
 
-        pvmp3_polyphase_filter_window(inData,
-                                      ptr_out,
-                                      numChannels);
+        POLYPHASE_FILTER_WINDOW(inData,
+                                ptr_out,
+                                numChannels);
 
         inData  -= SUBBANDS_NUMBER;
 
@@ -167,9 +172,9 @@ void pvmp3_poly_phase_synthesis(tmp3dec_chan   *pChVars,
 
         pvmp3_merge_in_place_N32(inData);
 
-        pvmp3_polyphase_filter_window(inData,
-                                      ptr_out + (numChannels << 5),
-                                      numChannels);
+        POLYPHASE_FILTER_WINDOW(inData,
+                                ptr_out + (numChannels << 5),
+                                numChannels);
 
         ptr_out += (numChannels << 6);
 
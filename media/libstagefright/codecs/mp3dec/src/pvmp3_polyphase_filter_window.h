@@ -59,6 +59,10 @@
 ----------------------------------------------------------------------------*/
 #define MAX_16BITS_INT  0x7FFF
 
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define PVMP3_NEON
+#endif
+
 /*----------------------------------------------------------------------------
 ; EXTERNAL VARIABLES REFERENCES
 ; Declare variables used in this module but defined elsewhere
@@ -122,6 +126,13 @@ extern "C"
                                        int16 *outPcm,
                                        int32 numChannels);
 
+#ifdef PVMP3_NEON
+    /* same output as the C version, bit for bit, four window rows at a time */
+    void pvmp3_polyphase_filter_window_neon(int32 *synth_buffer,
+                                            int16 *outPcm,
+                                            int32 numChannels);
+#endif
+
 
 #ifdef __cplusplus
 }
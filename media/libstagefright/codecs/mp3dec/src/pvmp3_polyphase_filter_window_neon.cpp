@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+------------------------------------------------------------------------------
+ FUNCTION DESCRIPTION
+
+    NEON version of pvmp3_polyphase_filter_window(): the 15 pairs of output
+    samples j and 32 - j are computed four j at a time, the window rows of
+    pqmfSynthWin being transposed in registers. Every product is the exact
+    64-bit one shifted right by 32 and the sums wrap, as in fxp_mac32_Q32()
+    and fxp_msb32_Q32(), so the output is the same as the C version's.
+------------------------------------------------------------------------------
+*/
+
+#include "pvmp3_polyphase_filter_window.h"
+#include "pv_mp3dec_fxd_op.h"
+#include "pvmp3_dec_defs.h"
+#include "pvmp3_tables.h"
+
+#ifdef PVMP3_NEON
+
+#include <arm_neon.h>
+
+/* (int32)(((int64)a * b) >> 32) in each lane */
+static inline int32x4_t mul32_Q32(int32x4_t a, int32x4_t b)
+{
+    int64x2_t lo = vmull_s32(vget_low_s32(a), vget_low_s32(b));
+    int64x2_t hi = vmull_s32(vget_high_s32(a), vget_high_s32(b));
+    return vcombine_s32(vshrn_n_s64(lo, 32), vshrn_n_s64(hi, 32));
+}
+
+/* p[3], p[2], p[1], p[0] */
+static inline int32x4_t load_reversed(const int32 *p)
+{
+    int32x4_t v = vrev64q_s32(vld1q_s32(p));
+    return vcombine_s32(vget_high_s32(v), vget_low_s32(v));
+}
+
+static inline void store_pcm(int16 *outPcm, int32 pos, int32 step, int16x4_t v, int32 lanes)
+{
+    vst1_lane_s16(outPcm + pos, v, 0);
+    vst1_lane_s16(outPcm + pos + step, v, 1);
+    vst1_lane_s16(outPcm + pos + 2 * step, v, 2);
+    if (lanes > 3)
+    {
+        vst1_lane_s16(outPcm + pos + 3 * step, v, 3);
+    }
+}
+
+void pvmp3_polyphase_filter_window_neon(int32 *synth_buffer,
+                                        int16 *outPcm,
+                                        int32 numChannels)
+{
+    int32 sum1;
+    int32 sum2;
+    const int32 *winPtr = pqmfSynthWin;
+    int32 i;
+
+    /*
+     *  j = 1..16, the last lane is dropped: its window row is the start of
+     *  the j = 0 taps and its samples are within the buffer.
+     */
+    for (int32 j = 1; j < SUBBANDS_NUMBER / 2; j += 4)
+    {
+        int32x4_t vsum1 = vdupq_n_s32(0x00000020);
+        int32x4_t vsum2 = vdupq_n_s32(0x00000020);
+        const int32 *pt_1 = &synth_buffer[(SUBBANDS_NUMBER >> 1) + j];
+        const int32 *pt_2 = &synth_buffer[(SUBBANDS_NUMBER >> 1) - j - 3];
+
+        for (int32 g = 0; g < 4; g++)
+        {
+            /* window taps 4g..4g+3 of rows j..j+3 */
+            int32x4x2_t r01 = vtrnq_s32(vld1q_s32(winPtr + 4 * g),
+                                        vld1q_s32(winPtr + 4 * g + 16));
+            int32x4x2_t r23 = vtrnq_s32(vld1q_s32(winPtr + 4 * g + 32),
+                                        vld1q_s32(winPtr + 4 * g + 48));
+            int32x4_t w0 = vcombine_s32(vget_low_s32(r01.val[0]), vget_low_s32(r23.val[0]));
+            int32x4_t w1 = vcombine_s32(vget_low_s32(r01.val[1]), vget_low_s32(r23.val[1]));
+            int32x4_t w2 = vcombine_s32(vget_high_s32(r01.val[0]), vget_high_s32(r23.val[0]));
+            int32x4_t w3 = vcombine_s32(vget_high_s32(r01.val[1]), vget_high_s32(r23.val[1]));
+
+            int32x4_t temp1 = vld1q_s32(pt_1 + SUBBANDS_NUMBER * (2 * g));
+            int32x4_t temp3 = load_reversed(pt_2 + SUBBANDS_NUMBER * (15 - 2 * g));
+            int32x4_t temp2 = load_reversed(pt_2 + SUBBANDS_NUMBER * (2 * g + 1));
+            int32x4_t temp4 = vld1q_s32(pt_1 + SUBBANDS_NUMBER * (14 - 2 * g));
+
+            vsum1 = vaddq_s32(vsum1, mul32_Q32(temp1, w0));
+            vsum2 = vaddq_s32(vsum2, mul32_Q32(temp3, w0));
+            vsum2 = vaddq_s32(vsum2, mul32_Q32(temp1, w1));
+            vsum1 = vsubq_s32(vsum1, mul32_Q32(temp3, w1));
+            vsum1 = vaddq_s32(vsum1, mul32_Q32(temp2, w2));
+            vsum2 = vsubq_s32(vsum2, mul32_Q32(temp4, w2));
+            vsum2 = vaddq_s32(vsum2, mul32_Q32(temp2, w3));
+            vsum1 = vaddq_s32(vsum1, mul32_Q32(temp4, w3));
+        }
+
+        /* saturate16(sum >> 6) */
+        int16x4_t pcm1 = vqmovn_s32(vshrq_n_s32(vsum1, 6));
+        int16x4_t pcm2 = vqmovn_s32(vshrq_n_s32(vsum2, 6));
+        int32 lanes = (SUBBANDS_NUMBER / 2) - j;
+        int32 k = j << (numChannels - 1);
+        store_pcm(outPcm, k, numChannels, pcm1, lanes);
+        store_pcm(outPcm, (numChannels << 5) - k, -numChannels, pcm2, lanes);
+
+        winPtr += 64;
+    }
+
+    winPtr = &pqmfSynthWin[((SUBBANDS_NUMBER / 2) - 1) << 4];
+
+    sum1 = 0x00000020;
+    sum2 = 0x00000020;
+
+
+    for (i = 16; i < HAN_SIZE + 16; i += (SUBBANDS_NUMBER << 2))
+    {
+        int32 *pt_synth = &synth_buffer[i];
+        int32 temp1 = pt_synth[ 0                ];
+        int32 temp2 = pt_synth[ SUBBANDS_NUMBER  ];
+        int32 temp3 = pt_synth[ SUBBANDS_NUMBER/2];
+
+        sum1 = fxp_mac32_Q32(sum1, temp1, winPtr[0]) ;
+        sum1 = fxp_mac32_Q32(sum1, temp2, winPtr[1]) ;
+        sum2 = fxp_mac32_Q32(sum2, temp3, winPtr[2]) ;
+
+        temp1 = pt_synth[ SUBBANDS_NUMBER<<1 ];
+        temp2 = pt_synth[ 3*SUBBANDS_NUMBER  ];
+        temp3 = pt_synth[ SUBBANDS_NUMBER*5/2];
+
+        sum1 = fxp_mac32_Q32(sum1, temp1, winPtr[3]) ;
+        sum1 = fxp_mac32_Q32(sum1, temp2, winPtr[4]) ;
+        sum2 = fxp_mac32_Q32(sum2, temp3, winPtr[5]) ;
+
+        winPtr += 6;
+    }
+
+
+    outPcm[0] = saturate16(sum1 >> 6);
+    outPcm[(SUBBANDS_NUMBER/2)<<(numChannels-1)] = saturate16(sum2 >> 6);
+}
+
+#endif /* PVMP3_NEON */
@@ -17,6 +17,7 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "SoftVPX"
 #include <utils/Log.h>
+#include <cutils/properties.h>
 
 #include "SoftVPX.h"
 
@@ -26,6 +27,9 @@
 
 namespace android {
 
+/** Overrides the number of decoder threads when set to a positive value */
+#define PROP_NUM_THREADS "media.vpxdec.num_threads"
+
 SoftVPX::SoftVPX(
         const char *name,
         const char *componentRole,
@@ -40,6 +44,7 @@ SoftVPX::SoftVPX(
       mMode(codingType == OMX_VIDEO_CodingVP8 ? MODE_VP8 : MODE_VP9),
       mCtx(NULL),
       mImg(NULL) {
+    mSupportsSemiPlanarOutput = true;
     initPorts(kNumBuffers, 768 * 1024 /* inputBufferSize */,
             kNumBuffers,
             codingType == OMX_VIDEO_CodingVP8 ? MEDIA_MIMETYPE_VIDEO_VP8 : MEDIA_MIMETYPE_VIDEO_VP9);
@@ -66,12 +71,24 @@ static int GetCPUCoreCount() {
     return cpuCoreCount;
 }
 
+// VP9 decodes tile columns in parallel, up to one thread each, and VP8 decodes
+// macroblock rows in parallel; either way libvpx starts no more workers than
+// the stream can use, so one thread per online CPU is a safe default.
+static int GetNumThreads() {
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get(PROP_NUM_THREADS, value, NULL) && atoi(value) > 0) {
+        ALOGV("Number of decoder threads overridden to %d", atoi(value));
+        return atoi(value);
+    }
+    return GetCPUCoreCount();
+}
+
 status_t SoftVPX::initDecoder() {
     mCtx = new vpx_codec_ctx_t;
     vpx_codec_err_t vpx_err;
     vpx_codec_dec_cfg_t cfg;
     memset(&cfg, 0, sizeof(vpx_codec_dec_cfg_t));
-    cfg.threads = GetCPUCoreCount();
+    cfg.threads = GetNumThreads();
     if ((vpx_err = vpx_codec_dec_init(
                 (vpx_codec_ctx_t *)mCtx,
                  mMode == MODE_VP8 ? &vpx_codec_vp8_dx_algo : &vpx_codec_vp9_dx_algo,
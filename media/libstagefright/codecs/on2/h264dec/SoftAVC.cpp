@@ -64,6 +64,7 @@ SoftAVC::SoftAVC(
       mHeadersDecoded(false),
       mEOSStatus(INPUT_DATA_AVAILABLE),
       mSignalledError(false) {
+    mSupportsSemiPlanarOutput = true;
     initPorts(
             kNumInputBuffers, 8192 /* inputBufferSize */,
             kNumOutputBuffers, MEDIA_MIMETYPE_VIDEO_AVC);
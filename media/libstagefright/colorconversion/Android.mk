@@ -11,4 +11,11 @@ LOCAL_C_INCLUDES := \
 
 LOCAL_MODULE:= libstagefright_color_conversion
 
+# ColorConverter has NEON kernels for the YUV 4:2:0 formats
+ifeq ($(TARGET_ARCH),arm)
+  ifeq ($(ARCH_ARM_HAVE_NEON),true)
+    LOCAL_ARM_NEON := true
+  endif
+endif
+
 include $(BUILD_STATIC_LIBRARY)
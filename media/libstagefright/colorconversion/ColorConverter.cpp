@@ -22,13 +22,40 @@
 #include <media/stagefright/ColorConverter.h>
 #include <media/stagefright/MediaErrors.h>
 
+#include <unistd.h>
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define COLORCONVERTER_NEON
+#include <arm_neon.h>
+#endif
+
 namespace android {
 
+// Smaller frames are converted on the calling thread alone, for starting
+// threads would cost more than it saves.
+static const size_t kMinPixelsPerBand = 256 * 1024;
+static const size_t kMaxNumThreads = 4;
+
+static size_t GetCPUCoreCount() {
+    long cpuCoreCount = 1;
+#if defined(_SC_NPROCESSORS_ONLN)
+    cpuCoreCount = sysconf(_SC_NPROCESSORS_ONLN);
+#else
+    // _SC_NPROC_ONLN must be defined...
+    cpuCoreCount = sysconf(_SC_NPROC_ONLN);
+#endif
+    return cpuCoreCount < 1 ? 1 : (size_t)cpuCoreCount;
+}
+
 ColorConverter::ColorConverter(
         OMX_COLOR_FORMATTYPE from, OMX_COLOR_FORMATTYPE to)
     : mSrcFormat(from),
       mDstFormat(to),
-      mClip(NULL) {
+      mClip(NULL),
+      mNumThreads(GetCPUCoreCount()) {
+    if (mNumThreads > kMaxNumThreads) {
+        mNumThreads = kMaxNumThreads;
+    }
 }
 
 ColorConverter::~ColorConverter() {
@@ -37,13 +64,16 @@ ColorConverter::~ColorConverter() {
 }
 
 bool ColorConverter::isValid() const {
-    if (mDstFormat != OMX_COLOR_Format16bitRGB565) {
+    if (mDstFormat != OMX_COLOR_Format16bitRGB565
+            && mDstFormat != kColorFormat32bitRGBA8888) {
         return false;
     }
 
     switch (mSrcFormat) {
-        case OMX_COLOR_FormatYUV420Planar:
         case OMX_COLOR_FormatCbYCrY:
+            return mDstFormat == OMX_COLOR_Format16bitRGB565;
+
+        case OMX_COLOR_FormatYUV420Planar:
         case OMX_QCOM_COLOR_FormatYVU420SemiPlanar:
         case OMX_COLOR_FormatYUV420SemiPlanar:
         case OMX_TI_COLOR_FormatYUV420PackedSemiPlanar:
@@ -54,6 +84,10 @@ bool ColorConverter::isValid() const {
     }
 }
 
+bool ColorConverter::canDownscale() const {
+    return isValid() && mSrcFormat != OMX_COLOR_FormatCbYCrY;
+}
+
 ColorConverter::BitmapParams::BitmapParams(
         void *bits,
         size_t width, size_t height,
@@ -85,7 +119,7 @@ status_t ColorConverter::convert(
         size_t dstWidth, size_t dstHeight,
         size_t dstCropLeft, size_t dstCropTop,
         size_t dstCropRight, size_t dstCropBottom) {
-    if (mDstFormat != OMX_COLOR_Format16bitRGB565) {
+    if (!isValid()) {
         return ERROR_UNSUPPORTED;
     }
 
@@ -196,314 +230,567 @@ status_t ColorConverter::convertCbYCrY(
     return OK;
 }
 
-status_t ColorConverter::convertYUV420Planar(
-        const BitmapParams &src, const BitmapParams &dst) {
-    if (!((src.mCropLeft & 1) == 0
-            && src.cropWidth() == dst.cropWidth()
-            && src.cropHeight() == dst.cropHeight())) {
-        return ERROR_UNSUPPORTED;
-    }
-
-    uint8_t *kAdjustedClip = initClip();
-
-    uint16_t *dst_ptr = (uint16_t *)dst.mBits
-        + dst.mCropTop * dst.mWidth + dst.mCropLeft;
+// B = 1.164 * (Y - 16) + 2.018 * (U - 128)
+// G = 1.164 * (Y - 16) - 0.813 * (V - 128) - 0.391 * (U - 128)
+// R = 1.164 * (Y - 16) + 1.596 * (V - 128)
+
+// B = 298/256 * (Y - 16) + 517/256 * (U - 128)
+// G = .................. - 208/256 * (V - 128) - 100/256 * (U - 128)
+// R = .................. + 409/256 * (V - 128)
+
+// min_B = (298 * (- 16) + 517 * (- 128)) / 256 = -277
+// min_G = (298 * (- 16) - 208 * (255 - 128) - 100 * (255 - 128)) / 256 = -172
+// min_R = (298 * (- 16) + 409 * (- 128)) / 256 = -223
+
+// max_B = (298 * (255 - 16) + 517 * (255 - 128)) / 256 = 534
+// max_G = (298 * (255 - 16) - 208 * (- 128) - 100 * (- 128)) / 256 = 432
+// max_R = (298 * (255 - 16) + 409 * (255 - 128)) / 256 = 481
+
+// clip range -278 .. 535
+
+// Converts the pixels of a row from start on, start being even. Templated for
+// the per pixel choices to be made at compile time.
+template<size_t uvStep, bool swapRB, bool rgba>
+static void convertYUV420Pixels(
+        const uint8_t *kAdjustedClip,
+        const uint8_t *src_y, const uint8_t *src_u, const uint8_t *src_v,
+        void *dst_ptr, size_t start, size_t width) {
+    for (size_t x = start; x < width; x += 2) {
+        signed y1 = (signed)src_y[x] - 16;
+        signed y2 = (signed)src_y[x + 1] - 16;
+
+        signed u = (signed)src_u[(x / 2) * uvStep] - 128;
+        signed v = (signed)src_v[(x / 2) * uvStep] - 128;
+
+        signed u_b = u * 517;
+        signed u_g = -u * 100;
+        signed v_g = -v * 208;
+        signed v_r = v * 409;
+
+        signed tmp1 = y1 * 298;
+        signed b1 = (tmp1 + u_b) / 256;
+        signed g1 = (tmp1 + v_g + u_g) / 256;
+        signed r1 = (tmp1 + v_r) / 256;
+
+        signed tmp2 = y2 * 298;
+        signed b2 = (tmp2 + u_b) / 256;
+        signed g2 = (tmp2 + v_g + u_g) / 256;
+        signed r2 = (tmp2 + v_r) / 256;
+
+        if (swapRB) {
+            signed tmp = r1;
+            r1 = b1;
+            b1 = tmp;
+
+            tmp = r2;
+            r2 = b2;
+            b2 = tmp;
+        }
 
-    const uint8_t *src_y =
-        (const uint8_t *)src.mBits + src.mCropTop * src.mWidth + src.mCropLeft;
+        if (rgba) {
+            uint8_t *ptr = (uint8_t *)dst_ptr + x * 4;
 
-    const uint8_t *src_u =
-        (const uint8_t *)src_y + src.mWidth * src.mHeight
-        + src.mCropTop * (src.mWidth / 2) + src.mCropLeft / 2;
+            ptr[0] = kAdjustedClip[r1];
+            ptr[1] = kAdjustedClip[g1];
+            ptr[2] = kAdjustedClip[b1];
+            ptr[3] = 0xff;
 
-    const uint8_t *src_v =
-        src_u + (src.mWidth / 2) * (src.mHeight / 2);
+            if (x + 1 < width) {
+                ptr[4] = kAdjustedClip[r2];
+                ptr[5] = kAdjustedClip[g2];
+                ptr[6] = kAdjustedClip[b2];
+                ptr[7] = 0xff;
+            }
+            continue;
+        }
 
-    for (size_t y = 0; y < src.cropHeight(); ++y) {
-        for (size_t x = 0; x < src.cropWidth(); x += 2) {
-            // B = 1.164 * (Y - 16) + 2.018 * (U - 128)
-            // G = 1.164 * (Y - 16) - 0.813 * (V - 128) - 0.391 * (U - 128)
-            // R = 1.164 * (Y - 16) + 1.596 * (V - 128)
+        uint32_t rgb1 =
+            ((kAdjustedClip[r1] >> 3) << 11)
+            | ((kAdjustedClip[g1] >> 2) << 5)
+            | (kAdjustedClip[b1] >> 3);
+
+        uint32_t rgb2 =
+            ((kAdjustedClip[r2] >> 3) << 11)
+            | ((kAdjustedClip[g2] >> 2) << 5)
+            | (kAdjustedClip[b2] >> 3);
+
+        uint16_t *ptr = (uint16_t *)dst_ptr;
+        if (x + 1 < width) {
+            *(uint32_t *)(&ptr[x]) = (rgb2 << 16) | rgb1;
+        } else {
+            ptr[x] = rgb1;
+        }
+    }
+}
 
-            // B = 298/256 * (Y - 16) + 517/256 * (U - 128)
-            // G = .................. - 208/256 * (V - 128) - 100/256 * (U - 128)
-            // R = .................. + 409/256 * (V - 128)
+typedef void (*ConvertYUV420PixelsFunc)(
+        const uint8_t *kAdjustedClip,
+        const uint8_t *src_y, const uint8_t *src_u, const uint8_t *src_v,
+        void *dst_ptr, size_t start, size_t width);
+
+static ConvertYUV420PixelsFunc getConvertYUV420Pixels(
+        size_t uvStep, bool swapRB, bool rgba) {
+    if (uvStep == 1) {
+        // planar, never swapped
+        return rgba ? convertYUV420Pixels<1, false, true>
+                : convertYUV420Pixels<1, false, false>;
+    } else if (swapRB) {
+        return rgba ? convertYUV420Pixels<2, true, true>
+                : convertYUV420Pixels<2, true, false>;
+    }
+    return rgba ? convertYUV420Pixels<2, false, true>
+            : convertYUV420Pixels<2, false, false>;
+}
 
-            // min_B = (298 * (- 16) + 517 * (- 128)) / 256 = -277
-            // min_G = (298 * (- 16) - 208 * (255 - 128) - 100 * (255 - 128)) / 256 = -172
-            // min_R = (298 * (- 16) + 409 * (- 128)) / 256 = -223
+// Converts the pixels of a downscaled row from start on, src_y0 and src_y1
+// being the first two source rows of the blocks, and src_u and src_v the
+// chroma row of the first. Each luma sample is the average of the top left
+// 2x2 of its block, averaged across then down as the NEON code does.
+template<size_t uvStep, bool swapRB, bool rgba>
+static void convertYUV420ScaledPixels(
+        const uint8_t *kAdjustedClip,
+        const uint8_t *src_y0, const uint8_t *src_y1,
+        const uint8_t *src_u, const uint8_t *src_v,
+        size_t scale, void *dst_ptr, size_t start, size_t width) {
+    for (size_t x = start; x < width; ++x) {
+        size_t sx = x * scale;
+
+        signed avg0 = (src_y0[sx] + src_y0[sx + 1] + 1) >> 1;
+        signed avg1 = (src_y1[sx] + src_y1[sx + 1] + 1) >> 1;
+        signed y1 = ((avg0 + avg1 + 1) >> 1) - 16;
+
+        signed u = (signed)src_u[(sx / 2) * uvStep] - 128;
+        signed v = (signed)src_v[(sx / 2) * uvStep] - 128;
+
+        signed tmp1 = y1 * 298;
+        signed b1 = (tmp1 + u * 517) / 256;
+        signed g1 = (tmp1 - v * 208 - u * 100) / 256;
+        signed r1 = (tmp1 + v * 409) / 256;
+
+        if (swapRB) {
+            signed tmp = r1;
+            r1 = b1;
+            b1 = tmp;
+        }
 
-            // max_B = (298 * (255 - 16) + 517 * (255 - 128)) / 256 = 534
-            // max_G = (298 * (255 - 16) - 208 * (- 128) - 100 * (- 128)) / 256 = 432
-            // max_R = (298 * (255 - 16) + 409 * (255 - 128)) / 256 = 481
+        if (rgba) {
+            uint8_t *ptr = (uint8_t *)dst_ptr + x * 4;
 
-            // clip range -278 .. 535
+            ptr[0] = kAdjustedClip[r1];
+            ptr[1] = kAdjustedClip[g1];
+            ptr[2] = kAdjustedClip[b1];
+            ptr[3] = 0xff;
+            continue;
+        }
 
-            signed y1 = (signed)src_y[x] - 16;
-            signed y2 = (signed)src_y[x + 1] - 16;
+        ((uint16_t *)dst_ptr)[x] =
+            ((kAdjustedClip[r1] >> 3) << 11)
+            | ((kAdjustedClip[g1] >> 2) << 5)
+            | (kAdjustedClip[b1] >> 3);
+    }
+}
 
-            signed u = (signed)src_u[x / 2] - 128;
-            signed v = (signed)src_v[x / 2] - 128;
+typedef void (*ConvertYUV420ScaledPixelsFunc)(
+        const uint8_t *kAdjustedClip,
+        const uint8_t *src_y0, const uint8_t *src_y1,
+        const uint8_t *src_u, const uint8_t *src_v,
+        size_t scale, void *dst_ptr, size_t start, size_t width);
+
+static ConvertYUV420ScaledPixelsFunc getConvertYUV420ScaledPixels(
+        size_t uvStep, bool swapRB, bool rgba) {
+    if (uvStep == 1) {
+        return rgba ? convertYUV420ScaledPixels<1, false, true>
+                : convertYUV420ScaledPixels<1, false, false>;
+    } else if (swapRB) {
+        return rgba ? convertYUV420ScaledPixels<2, true, true>
+                : convertYUV420ScaledPixels<2, true, false>;
+    }
+    return rgba ? convertYUV420ScaledPixels<2, false, true>
+            : convertYUV420ScaledPixels<2, false, false>;
+}
 
-            signed u_b = u * 517;
-            signed u_g = -u * 100;
-            signed v_g = -v * 208;
-            signed v_r = v * 409;
+#ifdef COLORCONVERTER_NEON
 
-            signed tmp1 = y1 * 298;
-            signed b1 = (tmp1 + u_b) / 256;
-            signed g1 = (tmp1 + v_g + u_g) / 256;
-            signed r1 = (tmp1 + v_r) / 256;
+// One of B, G or R of 8 pixels from their luma and chroma terms: the clip
+// table maps any negative sum to 0, so shifting rather than dividing by 256,
+// which rounds towards zero, makes no difference.
+static inline uint8x8_t clipChannel(int32x4_t tmp0, int32x4_t tmp1, int32x4x2_t c) {
+    return vqmovun_s16(vcombine_s16(
+            vshrn_n_s32(vaddq_s32(tmp0, c.val[0]), 8),
+            vshrn_n_s32(vaddq_s32(tmp1, c.val[1]), 8)));
+}
 
-            signed tmp2 = y2 * 298;
-            signed b2 = (tmp2 + u_b) / 256;
-            signed g2 = (tmp2 + v_g + u_g) / 256;
-            signed r2 = (tmp2 + v_r) / 256;
+// 8 pixels, u and v being the chroma samples of each less 128.
+static inline void convertPixelsNEON(
+        uint8x8_t y, int16x8_t u, int16x8_t v, bool swapRB, bool rgba, void *dst) {
+    int16x8_t y16 = vreinterpretq_s16_u16(vsubl_u8(y, vdup_n_u8(16)));
+    int32x4_t tmp0 = vmull_n_s16(vget_low_s16(y16), 298);
+    int32x4_t tmp1 = vmull_n_s16(vget_high_s16(y16), 298);
+
+    int32x4x2_t u_b, uv_g, v_r;
+    u_b.val[0] = vmull_n_s16(vget_low_s16(u), 517);
+    u_b.val[1] = vmull_n_s16(vget_high_s16(u), 517);
+    uv_g.val[0] = vmlal_n_s16(
+            vmull_n_s16(vget_low_s16(u), -100), vget_low_s16(v), -208);
+    uv_g.val[1] = vmlal_n_s16(
+            vmull_n_s16(vget_high_s16(u), -100), vget_high_s16(v), -208);
+    v_r.val[0] = vmull_n_s16(vget_low_s16(v), 409);
+    v_r.val[1] = vmull_n_s16(vget_high_s16(v), 409);
+
+    uint8x8_t b = clipChannel(tmp0, tmp1, u_b);
+    uint8x8_t g = clipChannel(tmp0, tmp1, uv_g);
+    uint8x8_t r = clipChannel(tmp0, tmp1, v_r);
+
+    if (swapRB) {
+        uint8x8_t tmp = r;
+        r = b;
+        b = tmp;
+    }
 
-            uint32_t rgb1 =
-                ((kAdjustedClip[r1] >> 3) << 11)
-                | ((kAdjustedClip[g1] >> 2) << 5)
-                | (kAdjustedClip[b1] >> 3);
+    if (rgba) {
+        uint8x8x4_t rgbx;
+        rgbx.val[0] = r;
+        rgbx.val[1] = g;
+        rgbx.val[2] = b;
+        rgbx.val[3] = vdup_n_u8(0xff);
+        vst4_u8((uint8_t *)dst, rgbx);
+    } else {
+        uint16x8_t rgb = vshll_n_u8(r, 8);
+        rgb = vsriq_n_u16(rgb, vshll_n_u8(g, 8), 5);
+        rgb = vsriq_n_u16(rgb, vshll_n_u8(b, 8), 11);
+        vst1q_u16((uint16_t *)dst, rgb);
+    }
+}
 
-            uint32_t rgb2 =
-                ((kAdjustedClip[r2] >> 3) << 11)
-                | ((kAdjustedClip[g2] >> 2) << 5)
-                | (kAdjustedClip[b2] >> 3);
+// 8 pixels, u and v being their 4 chroma samples less 128.
+static inline void convertYUV420PixelsNEON(
+        uint8x8_t y, int16x4_t u, int16x4_t v, bool swapRB, bool rgba, void *dst) {
+    // each chroma sample twice, for both pixels of its pair
+    int16x4x2_t uu = vzip_s16(u, u);
+    int16x4x2_t vv = vzip_s16(v, v);
+    convertPixelsNEON(
+            y, vcombine_s16(uu.val[0], uu.val[1]),
+            vcombine_s16(vv.val[0], vv.val[1]), swapRB, rgba, dst);
+}
 
-            if (x + 1 < src.cropWidth()) {
-                *(uint32_t *)(&dst_ptr[x]) = (rgb2 << 16) | rgb1;
-            } else {
-                dst_ptr[x] = rgb1;
-            }
+// Converts the pixels of a row 16 at a time, the same as the C code does, and
+// returns how many it has converted.
+static size_t convertYUV420PixelsNEON(
+        const uint8_t *src_y, const uint8_t *src_u, const uint8_t *src_v,
+        size_t uvStep, bool swapRB, bool rgba,
+        void *dst_ptr, size_t width) {
+    const size_t bpp = rgba ? 4 : 2;
+    const uint8x8_t bias = vdup_n_u8(128);
+
+    size_t x = 0;
+    for (; x + 16 <= width; x += 16) {
+        uint8x16_t y = vld1q_u8(src_y + x);
+
+        uint8x8_t u, v;
+        if (uvStep == 1) {
+            u = vld1_u8(src_u + x / 2);
+            v = vld1_u8(src_v + x / 2);
+        } else {
+            uint8x8x2_t uv = vld2_u8((src_u < src_v ? src_u : src_v) + x);
+            u = uv.val[src_u < src_v ? 0 : 1];
+            v = uv.val[src_u < src_v ? 1 : 0];
         }
+        int16x8_t u16 = vreinterpretq_s16_u16(vsubl_u8(u, bias));
+        int16x8_t v16 = vreinterpretq_s16_u16(vsubl_u8(v, bias));
+
+        uint8_t *dst = (uint8_t *)dst_ptr + x * bpp;
+        convertYUV420PixelsNEON(
+                vget_low_u8(y), vget_low_s16(u16), vget_low_s16(v16),
+                swapRB, rgba, dst);
+        convertYUV420PixelsNEON(
+                vget_high_u8(y), vget_high_s16(u16), vget_high_s16(v16),
+                swapRB, rgba, dst + 8 * bpp);
+    }
 
-        src_y += src.mWidth;
+    return x;
+}
 
-        if (y & 1) {
-            src_u += src.mWidth / 2;
-            src_v += src.mWidth / 2;
+// Converts the pixels of a row downscaled by 2 8 at a time, the same as the C
+// code does, and returns how many it has converted: every other chroma
+// sample of the source is that of a destination pixel.
+static size_t convertYUV420HalvedPixelsNEON(
+        const uint8_t *src_y0, const uint8_t *src_y1,
+        const uint8_t *src_u, const uint8_t *src_v,
+        size_t uvStep, bool swapRB, bool rgba,
+        void *dst_ptr, size_t width) {
+    const size_t bpp = rgba ? 4 : 2;
+    const uint8x8_t bias = vdup_n_u8(128);
+
+    size_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        uint8x8x2_t y0 = vld2_u8(src_y0 + 2 * x);
+        uint8x8x2_t y1 = vld2_u8(src_y1 + 2 * x);
+        uint8x8_t y = vrhadd_u8(
+                vrhadd_u8(y0.val[0], y0.val[1]),
+                vrhadd_u8(y1.val[0], y1.val[1]));
+
+        uint8x8_t u, v;
+        if (uvStep == 1) {
+            u = vld1_u8(src_u + x);
+            v = vld1_u8(src_v + x);
+        } else {
+            uint8x8x2_t uv = vld2_u8((src_u < src_v ? src_u : src_v) + 2 * x);
+            u = uv.val[src_u < src_v ? 0 : 1];
+            v = uv.val[src_u < src_v ? 1 : 0];
         }
 
-        dst_ptr += dst.mWidth;
+        convertPixelsNEON(
+                y, vreinterpretq_s16_u16(vsubl_u8(u, bias)),
+                vreinterpretq_s16_u16(vsubl_u8(v, bias)),
+                swapRB, rgba, (uint8_t *)dst_ptr + x * bpp);
     }
 
-    return OK;
+    return x;
 }
 
-status_t ColorConverter::convertQCOMYUV420SemiPlanar(
-        const BitmapParams &src, const BitmapParams &dst) {
-    uint8_t *kAdjustedClip = initClip();
-
-    if (!((src.mCropLeft & 1) == 0
-            && src.cropWidth() == dst.cropWidth()
-            && src.cropHeight() == dst.cropHeight())) {
-        return ERROR_UNSUPPORTED;
-    }
+#endif  // COLORCONVERTER_NEON
 
-    uint16_t *dst_ptr = (uint16_t *)dst.mBits
-        + dst.mCropTop * dst.mWidth + dst.mCropLeft;
+status_t ColorConverter::convertYUV420Planar(
+        const BitmapParams &src, const BitmapParams &dst) {
+    YUV420Layout layout;
 
-    const uint8_t *src_y =
+    layout.mY =
         (const uint8_t *)src.mBits + src.mCropTop * src.mWidth + src.mCropLeft;
 
-    const uint8_t *src_u =
-        (const uint8_t *)src_y + src.mWidth * src.mHeight
-        + src.mCropTop * src.mWidth + src.mCropLeft;
-
-    for (size_t y = 0; y < src.cropHeight(); ++y) {
-        for (size_t x = 0; x < src.cropWidth(); x += 2) {
-            signed y1 = (signed)src_y[x] - 16;
-            signed y2 = (signed)src_y[x + 1] - 16;
-
-            signed u = (signed)src_u[x & ~1] - 128;
-            signed v = (signed)src_u[(x & ~1) + 1] - 128;
+    layout.mU =
+        layout.mY + src.mWidth * src.mHeight
+        + src.mCropTop * (src.mWidth / 2) + src.mCropLeft / 2;
 
-            signed u_b = u * 517;
-            signed u_g = -u * 100;
-            signed v_g = -v * 208;
-            signed v_r = v * 409;
+    layout.mV = layout.mU + (src.mWidth / 2) * (src.mHeight / 2);
 
-            signed tmp1 = y1 * 298;
-            signed b1 = (tmp1 + u_b) / 256;
-            signed g1 = (tmp1 + v_g + u_g) / 256;
-            signed r1 = (tmp1 + v_r) / 256;
+    layout.mYStride = src.mWidth;
+    layout.mUVStride = src.mWidth / 2;
+    layout.mUVStep = 1;
+    layout.mSwapRB = false;
+    layout.mClip = initClip();
 
-            signed tmp2 = y2 * 298;
-            signed b2 = (tmp2 + u_b) / 256;
-            signed g2 = (tmp2 + v_g + u_g) / 256;
-            signed r2 = (tmp2 + v_r) / 256;
-
-            uint32_t rgb1 =
-                ((kAdjustedClip[b1] >> 3) << 11)
-                | ((kAdjustedClip[g1] >> 2) << 5)
-                | (kAdjustedClip[r1] >> 3);
+    return convertYUV420(layout, src, dst);
+}
 
-            uint32_t rgb2 =
-                ((kAdjustedClip[b2] >> 3) << 11)
-                | ((kAdjustedClip[g2] >> 2) << 5)
-                | (kAdjustedClip[r2] >> 3);
+status_t ColorConverter::convertQCOMYUV420SemiPlanar(
+        const BitmapParams &src, const BitmapParams &dst) {
+    YUV420Layout layout;
 
-            if (x + 1 < src.cropWidth()) {
-                *(uint32_t *)(&dst_ptr[x]) = (rgb2 << 16) | rgb1;
-            } else {
-                dst_ptr[x] = rgb1;
-            }
-        }
+    layout.mY =
+        (const uint8_t *)src.mBits + src.mCropTop * src.mWidth + src.mCropLeft;
 
-        src_y += src.mWidth;
+    layout.mU =
+        layout.mY + src.mWidth * src.mHeight
+        + src.mCropTop * src.mWidth + src.mCropLeft;
 
-        if (y & 1) {
-            src_u += src.mWidth;
-        }
+    layout.mV = layout.mU + 1;
 
-        dst_ptr += dst.mWidth;
-    }
+    layout.mYStride = src.mWidth;
+    layout.mUVStride = src.mWidth;
+    layout.mUVStep = 2;
+    layout.mSwapRB = true;
+    layout.mClip = initClip();
 
-    return OK;
+    return convertYUV420(layout, src, dst);
 }
 
 status_t ColorConverter::convertYUV420SemiPlanar(
         const BitmapParams &src, const BitmapParams &dst) {
     // XXX Untested
 
-    uint8_t *kAdjustedClip = initClip();
-
-    if (!((src.mCropLeft & 1) == 0
-            && src.cropWidth() == dst.cropWidth()
-            && src.cropHeight() == dst.cropHeight())) {
-        return ERROR_UNSUPPORTED;
-    }
-
-    uint16_t *dst_ptr = (uint16_t *)dst.mBits
-        + dst.mCropTop * dst.mWidth + dst.mCropLeft;
+    YUV420Layout layout;
 
-    const uint8_t *src_y =
+    layout.mY =
         (const uint8_t *)src.mBits + src.mCropTop * src.mWidth + src.mCropLeft;
 
-    const uint8_t *src_u =
-        (const uint8_t *)src_y + src.mWidth * src.mHeight
+    layout.mV =
+        layout.mY + src.mWidth * src.mHeight
         + src.mCropTop * src.mWidth + src.mCropLeft;
 
-    for (size_t y = 0; y < src.cropHeight(); ++y) {
-        for (size_t x = 0; x < src.cropWidth(); x += 2) {
-            signed y1 = (signed)src_y[x] - 16;
-            signed y2 = (signed)src_y[x + 1] - 16;
-
-            signed v = (signed)src_u[x & ~1] - 128;
-            signed u = (signed)src_u[(x & ~1) + 1] - 128;
+    layout.mU = layout.mV + 1;
 
-            signed u_b = u * 517;
-            signed u_g = -u * 100;
-            signed v_g = -v * 208;
-            signed v_r = v * 409;
+    layout.mYStride = src.mWidth;
+    layout.mUVStride = src.mWidth;
+    layout.mUVStep = 2;
+    layout.mSwapRB = true;
+    layout.mClip = initClip();
 
-            signed tmp1 = y1 * 298;
-            signed b1 = (tmp1 + u_b) / 256;
-            signed g1 = (tmp1 + v_g + u_g) / 256;
-            signed r1 = (tmp1 + v_r) / 256;
-
-            signed tmp2 = y2 * 298;
-            signed b2 = (tmp2 + u_b) / 256;
-            signed g2 = (tmp2 + v_g + u_g) / 256;
-            signed r2 = (tmp2 + v_r) / 256;
-
-            uint32_t rgb1 =
-                ((kAdjustedClip[b1] >> 3) << 11)
-                | ((kAdjustedClip[g1] >> 2) << 5)
-                | (kAdjustedClip[r1] >> 3);
+    return convertYUV420(layout, src, dst);
+}
 
-            uint32_t rgb2 =
-                ((kAdjustedClip[b2] >> 3) << 11)
-                | ((kAdjustedClip[g2] >> 2) << 5)
-                | (kAdjustedClip[r2] >> 3);
+status_t ColorConverter::convertTIYUV420PackedSemiPlanar(
+        const BitmapParams &src, const BitmapParams &dst) {
+    YUV420Layout layout;
 
-            if (x + 1 < src.cropWidth()) {
-                *(uint32_t *)(&dst_ptr[x]) = (rgb2 << 16) | rgb1;
-            } else {
-                dst_ptr[x] = rgb1;
-            }
-        }
+    layout.mY = (const uint8_t *)src.mBits;
 
-        src_y += src.mWidth;
+    layout.mU = layout.mY + src.mWidth * (src.mHeight - src.mCropTop / 2);
 
-        if (y & 1) {
-            src_u += src.mWidth;
-        }
+    layout.mV = layout.mU + 1;
 
-        dst_ptr += dst.mWidth;
-    }
+    layout.mYStride = src.mWidth;
+    layout.mUVStride = src.mWidth;
+    layout.mUVStep = 2;
+    layout.mSwapRB = false;
+    layout.mClip = initClip();
 
-    return OK;
+    return convertYUV420(layout, src, dst);
 }
 
-status_t ColorConverter::convertTIYUV420PackedSemiPlanar(
+status_t ColorConverter::convertYUV420(
+        const YUV420Layout &layout,
         const BitmapParams &src, const BitmapParams &dst) {
-    uint8_t *kAdjustedClip = initClip();
+    if ((src.mCropLeft & 1) != 0
+            || dst.cropWidth() == 0 || src.cropWidth() % dst.cropWidth() != 0) {
+        return ERROR_UNSUPPORTED;
+    }
 
-    if (!((src.mCropLeft & 1) == 0
-            && src.cropWidth() == dst.cropWidth()
-            && src.cropHeight() == dst.cropHeight())) {
+    // the destination crop that of the source, or smaller by an integer
+    // factor in both directions
+    size_t scale = src.cropWidth() / dst.cropWidth();
+    if (src.cropHeight() != dst.cropHeight() * scale) {
         return ERROR_UNSUPPORTED;
     }
 
-    uint16_t *dst_ptr = (uint16_t *)dst.mBits
-        + dst.mCropTop * dst.mWidth + dst.mCropLeft;
+    YUV420Layout bandLayout = layout;
+    bandLayout.mScale = scale;
 
-    const uint8_t *src_y = (const uint8_t *)src.mBits;
+    // bands of an even number of rows, for them to start on a chroma row
+    size_t numRows = dst.cropHeight();
+    size_t numBands = dst.cropWidth() * numRows / kMinPixelsPerBand;
+    if (numBands > mNumThreads) {
+        numBands = mNumThreads;
+    }
+    if (numBands > numRows / 2) {
+        numBands = numRows / 2;
+    }
+    if (numBands < 2) {
+        convertYUV420Rows(bandLayout, dst, 0, numRows);
+        return OK;
+    }
 
-    const uint8_t *src_u =
-        (const uint8_t *)src_y + src.mWidth * (src.mHeight - src.mCropTop / 2);
+    size_t rowsPerBand = (numRows / numBands + 1) & ~1;
+
+    Band bands[kMaxNumThreads];
+    size_t numStarted = 0;
+    for (size_t i = 0; i < numBands; ++i) {
+        Band *band = &bands[i];
+        band->mConverter = this;
+        band->mLayout = &bandLayout;
+        band->mDst = &dst;
+        band->mFirstRow = i * rowsPerBand;
+        band->mNumRows = (i + 1 == numBands)
+            ? numRows - band->mFirstRow : rowsPerBand;
+
+        // the first band is this thread's
+        if (i == 0) {
+            continue;
+        }
 
-    for (size_t y = 0; y < src.cropHeight(); ++y) {
-        for (size_t x = 0; x < src.cropWidth(); x += 2) {
-            signed y1 = (signed)src_y[x] - 16;
-            signed y2 = (signed)src_y[x + 1] - 16;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+        int res = pthread_create(&band->mThread, &attr, ThreadWrapper, band);
+        pthread_attr_destroy(&attr);
+
+        if (res != 0) {
+            // do the rest here
+            ALOGW("could not start a color conversion thread (%d)", res);
+            band->mNumRows = numRows - band->mFirstRow;
+            convertYUV420Rows(bandLayout, dst, band->mFirstRow, band->mNumRows);
+            break;
+        }
+        ++numStarted;
+    }
 
-            signed u = (signed)src_u[x & ~1] - 128;
-            signed v = (signed)src_u[(x & ~1) + 1] - 128;
+    convertYUV420Rows(bandLayout, dst, bands[0].mFirstRow, bands[0].mNumRows);
 
-            signed u_b = u * 517;
-            signed u_g = -u * 100;
-            signed v_g = -v * 208;
-            signed v_r = v * 409;
+    for (size_t i = 1; i <= numStarted; ++i) {
+        void *dummy;
+        pthread_join(bands[i].mThread, &dummy);
+    }
 
-            signed tmp1 = y1 * 298;
-            signed b1 = (tmp1 + u_b) / 256;
-            signed g1 = (tmp1 + v_g + u_g) / 256;
-            signed r1 = (tmp1 + v_r) / 256;
+    return OK;
+}
 
-            signed tmp2 = y2 * 298;
-            signed b2 = (tmp2 + u_b) / 256;
-            signed g2 = (tmp2 + v_g + u_g) / 256;
-            signed r2 = (tmp2 + v_r) / 256;
+// static
+void *ColorConverter::ThreadWrapper(void *me) {
+    Band *band = static_cast<Band *>(me);
+    band->mConverter->convertYUV420Rows(
+            *band->mLayout, *band->mDst, band->mFirstRow, band->mNumRows);
+    return NULL;
+}
 
-            uint32_t rgb1 =
-                ((kAdjustedClip[r1] >> 3) << 11)
-                | ((kAdjustedClip[g1] >> 2) << 5)
-                | (kAdjustedClip[b1] >> 3);
+void ColorConverter::convertYUV420Rows(
+        const YUV420Layout &layout, const BitmapParams &dst,
+        size_t firstRow, size_t numRows) const {
+    if (layout.mScale > 1) {
+        convertYUV420ScaledRows(layout, dst, firstRow, numRows);
+        return;
+    }
 
-            uint32_t rgb2 =
-                ((kAdjustedClip[r2] >> 3) << 11)
-                | ((kAdjustedClip[g2] >> 2) << 5)
-                | (kAdjustedClip[b2] >> 3);
+    bool rgba = mDstFormat == kColorFormat32bitRGBA8888;
+    size_t bpp = rgba ? 4 : 2;
+    size_t width = dst.cropWidth();
+    ConvertYUV420PixelsFunc convertPixels =
+        getConvertYUV420Pixels(layout.mUVStep, layout.mSwapRB, rgba);
 
-            if (x + 1 < src.cropWidth()) {
-                *(uint32_t *)(&dst_ptr[x]) = (rgb2 << 16) | rgb1;
-            } else {
-                dst_ptr[x] = rgb1;
-            }
-        }
+    uint8_t *dst_ptr = (uint8_t *)dst.mBits
+        + ((dst.mCropTop + firstRow) * dst.mWidth + dst.mCropLeft) * bpp;
 
-        src_y += src.mWidth;
+    for (size_t y = firstRow; y < firstRow + numRows; ++y) {
+        const uint8_t *src_y = layout.mY + y * layout.mYStride;
+        const uint8_t *src_u = layout.mU + (y / 2) * layout.mUVStride;
+        const uint8_t *src_v = layout.mV + (y / 2) * layout.mUVStride;
 
-        if (y & 1) {
-            src_u += src.mWidth;
-        }
+        size_t x = 0;
+#ifdef COLORCONVERTER_NEON
+        x = convertYUV420PixelsNEON(
+                src_y, src_u, src_v, layout.mUVStep, layout.mSwapRB, rgba,
+                dst_ptr, width);
+#endif
 
-        dst_ptr += dst.mWidth;
+        convertPixels(layout.mClip, src_y, src_u, src_v, dst_ptr, x, width);
+
+        dst_ptr += dst.mWidth * bpp;
     }
+}
 
-    return OK;
+void ColorConverter::convertYUV420ScaledRows(
+        const YUV420Layout &layout, const BitmapParams &dst,
+        size_t firstRow, size_t numRows) const {
+    bool rgba = mDstFormat == kColorFormat32bitRGBA8888;
+    size_t bpp = rgba ? 4 : 2;
+    size_t width = dst.cropWidth();
+    size_t scale = layout.mScale;
+    ConvertYUV420ScaledPixelsFunc convertPixels =
+        getConvertYUV420ScaledPixels(layout.mUVStep, layout.mSwapRB, rgba);
+
+    uint8_t *dst_ptr = (uint8_t *)dst.mBits
+        + ((dst.mCropTop + firstRow) * dst.mWidth + dst.mCropLeft) * bpp;
+
+    for (size_t y = firstRow; y < firstRow + numRows; ++y) {
+        size_t sy = y * scale;
+        const uint8_t *src_y0 = layout.mY + sy * layout.mYStride;
+        const uint8_t *src_y1 = src_y0 + layout.mYStride;
+        const uint8_t *src_u = layout.mU + (sy / 2) * layout.mUVStride;
+        const uint8_t *src_v = layout.mV + (sy / 2) * layout.mUVStride;
+
+        size_t x = 0;
+#ifdef COLORCONVERTER_NEON
+        if (scale == 2) {
+            x = convertYUV420HalvedPixelsNEON(
+                    src_y0, src_y1, src_u, src_v,
+                    layout.mUVStep, layout.mSwapRB, rgba, dst_ptr, width);
+        }
+#endif
+
+        convertPixels(
+                layout.mClip, src_y0, src_y1, src_u, src_v, scale,
+                dst_ptr, x, width);
+
+        dst_ptr += dst.mWidth * bpp;
+    }
 }
 
 uint8_t *ColorConverter::initClip() {
@@ -26,6 +26,11 @@
 #include <ui/GraphicBufferMapper.h>
 #include <gui/IGraphicBufferProducer.h>
 
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define SOFTWARERENDERER_NEON
+#include <arm_neon.h>
+#endif
+
 namespace android {
 
 static bool runningInEmulator() {
@@ -107,8 +112,16 @@ void SoftwareRenderer::resetFormatIfChanged(const sp<AMessage> &format) {
         {
             if (!runningInEmulator()) {
                 halFormat = HAL_PIXEL_FORMAT_YV12;
-                bufWidth = (mCropWidth + 1) & ~1;
-                bufHeight = (mCropHeight + 1) & ~1;
+                if (mColorFormat == OMX_COLOR_FormatYUV420Planar) {
+                    // The whole decoded frame, the crop picking the picture
+                    // out of it, so that the buffer can share its layout and
+                    // frames be copied a plane at a time.
+                    bufWidth = (mWidth + 1) & ~1;
+                    bufHeight = (mHeight + 1) & ~1;
+                } else {
+                    bufWidth = (mCropWidth + 1) & ~1;
+                    bufHeight = (mCropHeight + 1) & ~1;
+                }
                 break;
             }
 
@@ -203,7 +216,7 @@ void SoftwareRenderer::render(
 
     GraphicBufferMapper &mapper = GraphicBufferMapper::get();
 
-    Rect bounds(mCropWidth, mCropHeight);
+    Rect bounds(buf->width, buf->height);
 
     void *dst;
     CHECK_EQ(0, mapper.lock(
@@ -229,21 +242,40 @@ void SoftwareRenderer::render(
         uint8_t *dst_v = dst_y + dst_y_size;
         uint8_t *dst_u = dst_v + dst_c_size;
 
-        for (int y = 0; y < mCropHeight; ++y) {
-            memcpy(dst_y, src_y, mCropWidth);
-
-            src_y += mWidth;
-            dst_y += buf->stride;
-        }
-
-        for (int y = 0; y < (mCropHeight + 1) / 2; ++y) {
-            memcpy(dst_u, src_u, (mCropWidth + 1) / 2);
-            memcpy(dst_v, src_v, (mCropWidth + 1) / 2);
+        if (buf->stride == mWidth && dst_c_stride == (size_t)mWidth / 2
+                && buf->height == mHeight) {
+            // The decoder's layout but for the order of the chroma planes.
+            memcpy(dst_y, src_y, mWidth * mHeight);
+            memcpy(dst_u, src_u, mWidth / 2 * mHeight / 2);
+            memcpy(dst_v, src_v, mWidth / 2 * mHeight / 2);
+        } else {
+            // Just the crop, where the crop of the buffer is.
+            src_y += mCropTop * mWidth + mCropLeft;
+            dst_y += mCropTop * buf->stride + mCropLeft;
+
+            for (int y = 0; y < mCropHeight; ++y) {
+                memcpy(dst_y, src_y, mCropWidth);
+
+                src_y += mWidth;
+                dst_y += buf->stride;
+            }
 
-            src_u += mWidth / 2;
-            src_v += mWidth / 2;
-            dst_u += dst_c_stride;
-            dst_v += dst_c_stride;
+            size_t offset = mCropTop / 2 * (mWidth / 2) + mCropLeft / 2;
+            src_u += offset;
+            src_v += offset;
+            offset = mCropTop / 2 * dst_c_stride + mCropLeft / 2;
+            dst_u += offset;
+            dst_v += offset;
+
+            for (int y = mCropTop / 2; y <= mCropBottom / 2; ++y) {
+                memcpy(dst_u, src_u, mCropRight / 2 - mCropLeft / 2 + 1);
+                memcpy(dst_v, src_v, mCropRight / 2 - mCropLeft / 2 + 1);
+
+                src_u += mWidth / 2;
+                src_v += mWidth / 2;
+                dst_u += dst_c_stride;
+                dst_v += dst_c_stride;
+            }
         }
     } else {
         CHECK_EQ(mColorFormat, OMX_TI_COLOR_FormatYUV420PackedSemiPlanar);
@@ -283,7 +315,15 @@ void SoftwareRenderer::render(
 
         for (int y = 0; y < (mCropHeight + 1) / 2; ++y) {
             size_t tmp = (mCropWidth + 1) / 2;
-            for (size_t x = 0; x < tmp; ++x) {
+            size_t x = 0;
+#ifdef SOFTWARERENDERER_NEON
+            for (; x + 16 <= tmp; x += 16) {
+                uint8x16x2_t uv = vld2q_u8(src_uv + 2 * x);
+                vst1q_u8(dst_u + x, uv.val[0]);
+                vst1q_u8(dst_v + x, uv.val[1]);
+            }
+#endif
+            for (; x < tmp; ++x) {
                 dst_u[x] = src_uv[2 * x];
                 dst_v[x] = src_uv[2 * x + 1];
             }
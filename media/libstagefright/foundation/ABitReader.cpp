@@ -16,10 +16,28 @@
 
 #include "ABitReader.h"
 
+#include <endian.h>
+#include <string.h>
+
 #include <media/stagefright/foundation/ADebug.h>
 
 namespace android {
 
+static inline uint64_t U64BE_AT(const uint8_t *ptr) {
+    uint64_t x;
+    memcpy(&x, ptr, sizeof(x));
+#if __BYTE_ORDER == __BIG_ENDIAN
+    return x;
+#else
+    return __builtin_bswap64(x);
+#endif
+}
+
+// nonzero iff one of the bytes of x is zero
+static inline uint64_t HasZeroByte(uint64_t x) {
+    return (x - 0x0101010101010101ull) & ~x & 0x8080808080808080ull;
+}
+
 ABitReader::ABitReader(const uint8_t *data, size_t size)
     : mData(data),
       mSize(size),
@@ -33,9 +51,17 @@ ABitReader::~ABitReader() {
 void ABitReader::fillReservoir() {
     CHECK_GT(mSize, 0u);
 
+    if (mSize >= 8) {
+        mReservoir = U64BE_AT(mData);
+        mData += 8;
+        mSize -= 8;
+        mNumBitsLeft = 64;
+        return;
+    }
+
     mReservoir = 0;
     size_t i;
-    for (i = 0; mSize > 0 && i < 4; ++i) {
+    for (i = 0; mSize > 0; ++i) {
         mReservoir = (mReservoir << 8) | *mData;
 
         ++mData;
@@ -43,13 +69,13 @@ void ABitReader::fillReservoir() {
     }
 
     mNumBitsLeft = 8 * i;
-    mReservoir <<= 32 - mNumBitsLeft;
+    mReservoir <<= 64 - mNumBitsLeft;
 }
 
-uint32_t ABitReader::getBits(size_t n) {
+uint32_t ABitReader::getBitsSlow(size_t n) {
     CHECK_LE(n, 32u);
 
-    uint32_t result = 0;
+    uint64_t result = 0;
     while (n > 0) {
         if (mNumBitsLeft == 0) {
             fillReservoir();
@@ -60,7 +86,7 @@ uint32_t ABitReader::getBits(size_t n) {
             m = mNumBitsLeft;
         }
 
-        result = (result << m) | (mReservoir >> (32 - m));
+        result = (result << m) | (mReservoir >> (64 - m));
         mReservoir <<= m;
         mNumBitsLeft -= m;
 
@@ -84,13 +110,17 @@ void ABitReader::skipBits(size_t n) {
 void ABitReader::putBits(uint32_t x, size_t n) {
     CHECK_LE(n, 32u);
 
-    while (mNumBitsLeft + n > 32) {
+    if (n == 0) {
+        return;
+    }
+
+    while (mNumBitsLeft + n > 64) {
         mNumBitsLeft -= 8;
         --mData;
         ++mSize;
     }
 
-    mReservoir = (mReservoir >> n) | (x << (32 - n));
+    mReservoir = (mReservoir >> n) | ((uint64_t)x << (64 - n));
     mNumBitsLeft += n;
 }
 
@@ -142,9 +172,24 @@ bool NALBitReader::atLeastNumBitsLeft(size_t n) const {
 void NALBitReader::fillReservoir() {
     CHECK_GT(mSize, 0u);
 
+    // Without a zero byte in the next 8 bytes, none of them can be an
+    // emulation_prevention_three_byte except for the first one, right after
+    // two zeros that came before.
+    if (mSize >= 8 && (mNumZeros < 2 || *mData != 3)) {
+        uint64_t x = U64BE_AT(mData);
+        if (!HasZeroByte(x)) {
+            mReservoir = x;
+            mData += 8;
+            mSize -= 8;
+            mNumBitsLeft = 64;
+            mNumZeros = 0;
+            return;
+        }
+    }
+
     mReservoir = 0;
     size_t i = 0;
-    while (mSize > 0 && i < 4) {
+    while (mSize > 0 && i < 8) {
         bool isEmulationPreventionByte = (mNumZeros >= 2 && *mData == 3);
 
         if (*mData == 0) {
@@ -164,7 +209,7 @@ void NALBitReader::fillReservoir() {
     }
 
     mNumBitsLeft = 8 * i;
-    mReservoir <<= 32 - mNumBitsLeft;
+    mReservoir <<= 64 - mNumBitsLeft;
 }
 
 }  // namespace android
@@ -18,6 +18,8 @@
 #define LOG_TAG "ALooper"
 #include <utils/Log.h>
 
+#include <stdint.h>
+#include <string.h>
 #include <sys/time.h>
 
 #include "ALooper.h"
@@ -67,7 +69,9 @@ int64_t ALooper::GetNowUs() {
 }
 
 ALooper::ALooper()
-    : mRunningLocally(false) {
+    : mNextSeq(0),
+      mRunningLocally(false) {
+    memset(&mStats, 0, sizeof(mStats));
     // clean up stale AHandlers. Doing it here instead of in the destructor avoids
     // the side effect of objects being deleted from the unregister function recursively.
     gLooperRoster.unregisterStaleHandlers();
@@ -78,6 +82,11 @@ ALooper::~ALooper() {
     // stale AHandlers are now cleaned up in the constructor of the next ALooper to come along
 }
 
+void ALooper::getStats(Stats *stats) {
+    Mutex::Autolock autoLock(mLock);
+    *stats = mStats;
+}
+
 void ALooper::setName(const char *name) {
     mName = name;
 }
@@ -158,30 +167,96 @@ status_t ALooper::stop() {
     return OK;
 }
 
-void ALooper::post(const sp<AMessage> &msg, int64_t delayUs) {
-    Mutex::Autolock autoLock(mLock);
+// static
+bool ALooper::isBefore(const Event &a, const Event &b) {
+    if (a.mWhenUs != b.mWhenUs) {
+        return a.mWhenUs < b.mWhenUs;
+    }
+    // sequence numbers wrap around
+    return (int32_t)(a.mSeq - b.mSeq) < 0;
+}
 
-    int64_t whenUs;
-    if (delayUs > 0) {
-        whenUs = GetNowUs() + delayUs;
-    } else {
-        whenUs = GetNowUs();
+void ALooper::pushTimerLocked(const Event &event) {
+    mTimerHeap.push();
+    Event *heap = mTimerHeap.editArray();
+    size_t i = mTimerHeap.size() - 1;
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+        if (!isBefore(event, heap[parent])) {
+            break;
+        }
+        heap[i] = heap[parent];
+        i = parent;
     }
+    heap[i] = event;
+}
 
-    List<Event>::iterator it = mEventQueue.begin();
-    while (it != mEventQueue.end() && (*it).mWhenUs <= whenUs) {
-        ++it;
+void ALooper::popTimerLocked(Event *event) {
+    Event *heap = mTimerHeap.editArray();
+    *event = heap[0];
+
+    size_t size = mTimerHeap.size() - 1;
+    if (size > 0) {
+        Event last = heap[size];
+        size_t i = 0;
+        for (;;) {
+            size_t child = 2 * i + 1;
+            if (child >= size) {
+                break;
+            }
+            if (child + 1 < size && isBefore(heap[child + 1], heap[child])) {
+                ++child;
+            }
+            if (!isBefore(heap[child], last)) {
+                break;
+            }
+            heap[i] = heap[child];
+            i = child;
+        }
+        heap[i] = last;
     }
+    mTimerHeap.removeAt(size);
+}
+
+const ALooper::Event *ALooper::nextEventLocked() const {
+    const Event *immediate = mImmediateQueue.empty() ? NULL : &*mImmediateQueue.begin();
+    const Event *timer = mTimerHeap.isEmpty() ? NULL : &mTimerHeap[0];
+    if (immediate == NULL) {
+        return timer;
+    }
+    if (timer == NULL) {
+        return immediate;
+    }
+    return isBefore(*timer, *immediate) ? timer : immediate;
+}
+
+void ALooper::post(const sp<AMessage> &msg, int64_t delayUs) {
+    Mutex::Autolock autoLock(mLock);
+
+    const Event *prevNext = nextEventLocked();
+    int64_t prevWhenUs = prevNext != NULL ? prevNext->mWhenUs : INT64_MAX;
 
     Event event;
-    event.mWhenUs = whenUs;
+    event.mWhenUs = GetNowUs();
+    event.mSeq = mNextSeq++;
     event.mMessage = msg;
 
-    if (it == mEventQueue.begin()) {
+    if (delayUs > 0) {
+        event.mWhenUs += delayUs;
+        pushTimerLocked(event);
+    } else {
+        mImmediateQueue.push_back(event);
+    }
+
+    // Only wake up the loop if it now has to deliver earlier than it would have
+    if (event.mWhenUs < prevWhenUs) {
         mQueueChangedCondition.signal();
     }
 
-    mEventQueue.insert(it, event);
+    size_t depth = mImmediateQueue.size() + mTimerHeap.size();
+    if (depth > mStats.mMaxQueueDepth) {
+        mStats.mMaxQueueDepth = depth;
+    }
 }
 
 bool ALooper::loop() {
@@ -192,11 +267,12 @@ bool ALooper::loop() {
         if (mThread == NULL && !mRunningLocally) {
             return false;
         }
-        if (mEventQueue.empty()) {
+        const Event *next = nextEventLocked();
+        if (next == NULL) {
             mQueueChangedCondition.wait(mLock);
             return true;
         }
-        int64_t whenUs = (*mEventQueue.begin()).mWhenUs;
+        int64_t whenUs = next->mWhenUs;
         int64_t nowUs = GetNowUs();
 
         if (whenUs > nowUs) {
@@ -206,8 +282,19 @@ bool ALooper::loop() {
             return true;
         }
 
-        event = *mEventQueue.begin();
-        mEventQueue.erase(mEventQueue.begin());
+        if (!mImmediateQueue.empty() && next == &*mImmediateQueue.begin()) {
+            event = *mImmediateQueue.begin();
+            mImmediateQueue.erase(mImmediateQueue.begin());
+        } else {
+            popTimerLocked(&event);
+        }
+
+        int64_t latencyUs = nowUs - whenUs;
+        ++mStats.mDelivered;
+        mStats.mTotalLatencyUs += latencyUs;
+        if (latencyUs > mStats.mMaxLatencyUs) {
+            mStats.mMaxLatencyUs = latencyUs;
+        }
     }
 
     gLooperRoster.deliverMessage(event.mMessage);
@@ -33,7 +33,7 @@ ALooperRoster::ALooperRoster()
 
 ALooper::handler_id ALooperRoster::registerHandler(
         const sp<ALooper> looper, const sp<AHandler> &handler) {
-    Mutex::Autolock autoLock(mLock);
+    RWLock::AutoWLock autoLock(mLock);
 
     if (handler->id() != 0) {
         CHECK(!"A handler must only be registered once.");
@@ -52,7 +52,7 @@ ALooper::handler_id ALooperRoster::registerHandler(
 }
 
 void ALooperRoster::unregisterHandler(ALooper::handler_id handlerID) {
-    Mutex::Autolock autoLock(mLock);
+    RWLock::AutoWLock autoLock(mLock);
 
     ssize_t index = mHandlers.indexOfKey(handlerID);
 
@@ -75,7 +75,7 @@ void ALooperRoster::unregisterStaleHandlers() {
 
     Vector<sp<ALooper> > activeLoopers;
     {
-        Mutex::Autolock autoLock(mLock);
+        RWLock::AutoWLock autoLock(mLock);
 
         for (size_t i = mHandlers.size(); i-- > 0;) {
             const HandlerInfo &info = mHandlers.valueAt(i);
@@ -113,7 +113,7 @@ void ALooperRoster::deliverMessage(const sp<AMessage> &msg) {
     sp<AHandler> handler;
 
     {
-        Mutex::Autolock autoLock(mLock);
+        RWLock::AutoRLock autoLock(mLock);
 
         ssize_t index = mHandlers.indexOfKey(msg->target());
 
@@ -124,39 +124,69 @@ void ALooperRoster::deliverMessage(const sp<AMessage> &msg) {
 
         const HandlerInfo &info = mHandlers.valueAt(index);
         handler = info.mHandler.promote();
+    }
 
-        if (handler == NULL) {
-            ALOGW("failed to deliver message. "
-                 "Target handler %d registered, but object gone.",
-                 msg->target());
+    if (handler == NULL) {
+        ALOGW("failed to deliver message. "
+             "Target handler %d registered, but object gone.",
+             msg->target());
 
-            mHandlers.removeItemsAt(index);
-            return;
-        }
+        removeStaleHandler(msg->target());
+        return;
     }
 
     handler->onMessageReceived(msg);
 }
 
 sp<ALooper> ALooperRoster::findLooper(ALooper::handler_id handlerID) {
-    Mutex::Autolock autoLock(mLock);
+    sp<ALooper> looper;
 
-    ssize_t index = mHandlers.indexOfKey(handlerID);
+    {
+        RWLock::AutoRLock autoLock(mLock);
 
-    if (index < 0) {
-        return NULL;
-    }
+        ssize_t index = mHandlers.indexOfKey(handlerID);
 
-    sp<ALooper> looper = mHandlers.valueAt(index).mLooper.promote();
+        if (index < 0) {
+            return NULL;
+        }
+
+        looper = mHandlers.valueAt(index).mLooper.promote();
+    }
 
     if (looper == NULL) {
-        mHandlers.removeItemsAt(index);
+        removeStaleHandler(handlerID);
         return NULL;
     }
 
     return looper;
 }
 
+void ALooperRoster::removeStaleHandler(ALooper::handler_id handlerID) {
+    sp<ALooper> looper;
+    sp<AHandler> handler;
+
+    {
+        RWLock::AutoWLock autoLock(mLock);
+
+        // It may have been removed, or even registered again, since it was
+        // found gone without the exclusive lock
+        ssize_t index = mHandlers.indexOfKey(handlerID);
+        if (index < 0) {
+            return;
+        }
+
+        const HandlerInfo &info = mHandlers.valueAt(index);
+        looper = info.mLooper.promote();
+        handler = info.mHandler.promote();
+        if (looper == NULL || handler == NULL) {
+            mHandlers.removeItemsAt(index);
+        }
+    }
+
+    // 'looper' and 'handler' go out of scope without the lock held, see
+    // unregisterStaleHandlers()
+}
+
 status_t ALooperRoster::postAndAwaitResponse(
         const sp<AMessage> &msg, sp<AMessage> *response) {
     sp<ALooper> looper = findLooper(msg->target());
@@ -169,7 +199,7 @@ status_t ALooperRoster::postAndAwaitResponse(
         return -ENOENT;
     }
 
-    Mutex::Autolock autoLock(mLock);
+    Mutex::Autolock autoLock(mRepliesLock);
 
     uint32_t replyID = mNextReplyID++;
 
@@ -179,7 +209,7 @@ status_t ALooperRoster::postAndAwaitResponse(
 
     ssize_t index;
     while ((index = mReplies.indexOfKey(replyID)) < 0) {
-        mRepliesCondition.wait(mLock);
+        mRepliesCondition.wait(mRepliesLock);
     }
 
     *response = mReplies.valueAt(index);
@@ -189,7 +219,7 @@ status_t ALooperRoster::postAndAwaitResponse(
 }
 
 void ALooperRoster::postReply(uint32_t replyID, const sp<AMessage> &reply) {
-    Mutex::Autolock autoLock(mLock);
+    Mutex::Autolock autoLock(mRepliesLock);
 
     CHECK(mReplies.indexOfKey(replyID) < 0);
     mReplies.add(replyID, reply);
@@ -65,8 +65,7 @@ ALooper::handler_id AMessage::target() const {
 void AMessage::clear() {
     for (size_t i = 0; i < mNumItems; ++i) {
         Item *item = &mItems[i];
-        delete[] item->mName;
-        item->mName = NULL;
+        item->freeName();
         freeItemValue(item);
     }
     mNumItems = 0;
@@ -125,13 +124,26 @@ static void reportStats() {
 }
 #endif
 
-inline size_t AMessage::findItemIndex(const char *name, size_t len) const {
+// static
+inline size_t AMessage::HashName(const char *name, uint32_t *hash) {
+    // FNV-1a, computed while looking for the end of the name
+    uint32_t h = 2166136261u;
+    const char *s = name;
+    for (; *s != '\0'; ++s) {
+        h = (h ^ (uint8_t)*s) * 16777619u;
+    }
+    *hash = h;
+    return s - name;
+}
+
+inline size_t AMessage::findItemIndex(
+        const char *name, size_t len, uint32_t hash) const {
 #ifdef DUMP_STATS
     size_t memchecks = 0;
 #endif
     size_t i = 0;
     for (; i < mNumItems; i++) {
-        if (len != mItems[i].mNameLength) {
+        if (hash != mItems[i].mNameHash || len != mItems[i].mNameLength) {
             continue;
         }
 #ifdef DUMP_STATS
@@ -154,16 +166,29 @@ inline size_t AMessage::findItemIndex(const char *name, size_t len) const {
     return i;
 }
 
-// assumes item's name was uninitialized or NULL
-void AMessage::Item::setName(const char *name, size_t len) {
+// assumes item's name was uninitialized or freed
+void AMessage::Item::setName(const char *name, size_t len, uint32_t hash) {
     mNameLength = len;
-    mName = new char[len + 1];
+    mNameHash = hash;
+    if (len <= kMaxInlineNameLength) {
+        mName = mNameBuffer;
+    } else {
+        mName = new char[len + 1];
+    }
     memcpy((void*)mName, name, len + 1);
 }
 
+void AMessage::Item::freeName() {
+    if (mName != mNameBuffer) {
+        delete[] mName;
+    }
+    mName = NULL;
+}
+
 AMessage::Item *AMessage::allocateItem(const char *name) {
-    size_t len = strlen(name);
-    size_t i = findItemIndex(name, len);
+    uint32_t hash;
+    size_t len = HashName(name, &hash);
+    size_t i = findItemIndex(name, len, hash);
     Item *item;
 
     if (i < mNumItems) {
@@ -173,7 +198,7 @@ AMessage::Item *AMessage::allocateItem(const char *name) {
         CHECK(mNumItems < kMaxNumItems);
         i = mNumItems++;
         item = &mItems[i];
-        item->setName(name, len);
+        item->setName(name, len, hash);
     }
 
     return item;
@@ -181,7 +206,9 @@ AMessage::Item *AMessage::allocateItem(const char *name) {
 
 const AMessage::Item *AMessage::findItem(
         const char *name, Type type) const {
-    size_t i = findItemIndex(name, strlen(name));
+    uint32_t hash;
+    size_t len = HashName(name, &hash);
+    size_t i = findItemIndex(name, len, hash);
     if (i < mNumItems) {
         const Item *item = &mItems[i];
         return item->mType == type ? item : NULL;
@@ -191,7 +218,9 @@ const AMessage::Item *AMessage::findItem(
 }
 
 bool AMessage::contains(const char *name) const {
-    size_t i = findItemIndex(name, strlen(name));
+    uint32_t hash;
+    size_t len = HashName(name, &hash);
+    size_t i = findItemIndex(name, len, hash);
     return i < mNumItems;
 }
 
@@ -364,7 +393,7 @@ sp<AMessage> AMessage::dup() const {
         const Item *from = &mItems[i];
         Item *to = &msg->mItems[i];
 
-        to->setName(from->mName, from->mNameLength);
+        to->setName(from->mName, from->mNameLength, from->mNameHash);
         to->mType = from->mType;
 
         switch (from->mType) {
@@ -539,7 +568,9 @@ sp<AMessage> AMessage::FromParcel(const Parcel &parcel) {
         Item *item = &msg->mItems[i];
 
         const char *name = parcel.readCString();
-        item->setName(name, strlen(name));
+        uint32_t hash;
+        size_t len = HashName(name, &hash);
+        item->setName(name, len, hash);
         item->mType = static_cast<Type>(parcel.readInt32());
 
         switch (item->mType) {
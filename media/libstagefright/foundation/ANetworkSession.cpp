@@ -23,10 +23,12 @@
 
 #include <arpa/inet.h>
 #include <fcntl.h>
+#include <linux/sockios.h>
 #include <linux/tcp.h>
 #include <net/if.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <sys/epoll.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
 
@@ -52,6 +54,14 @@ static uint64_t U64_AT(const uint8_t *ptr) {
 static const size_t kMaxUDPSize = 1500;
 static const int32_t kMaxUDPRetries = 200;
 
+// datagrams handed to sendmmsg() at once
+static const size_t kMaxDatagramBatch = 16;
+
+static const int kMaxEpollEvents = 16;
+
+// epoll data of the wakeup pipe, session ids start at 1
+static const uint32_t kPipeEventID = 0;
+
 struct ANetworkSession::NetworkThread : public Thread {
     NetworkThread(ANetworkSession *session);
 
@@ -106,6 +116,11 @@ struct ANetworkSession::Session : public RefBase {
 
     status_t switchToWebSocketMode();
 
+    uint32_t registeredEvents() const { return mRegisteredEvents; }
+    void setRegisteredEvents(uint32_t events) { mRegisteredEvents = events; }
+
+    void getStats(SessionStats *stats) const;
+
 protected:
     virtual ~Session();
 
@@ -133,6 +148,11 @@ private:
 
     int64_t mLastStallReportUs;
 
+    // what the socket is registered for with epoll, 0 if it is not
+    uint32_t mRegisteredEvents;
+
+    SessionStats mStats;
+
     void notifyError(bool send, status_t err, const char *detail);
     void notify(NotificationReason reason);
 
@@ -170,7 +190,10 @@ ANetworkSession::Session::Session(
       mSawReceiveFailure(false),
       mSawSendFailure(false),
       mUDPRetries(kMaxUDPRetries),
-      mLastStallReportUs(-1ll) {
+      mLastStallReportUs(-1ll),
+      mRegisteredEvents(0) {
+    memset(&mStats, 0, sizeof(mStats));
+
     if (mState == CONNECTED) {
         struct sockaddr_in localAddr;
         socklen_t localAddrLen = sizeof(localAddr);
@@ -254,6 +277,22 @@ bool ANetworkSession::Session::isTCPDatagramServer() const {
     return mState == LISTENING_TCP_DGRAMS;
 }
 
+void ANetworkSession::Session::getStats(SessionStats *stats) const {
+    *stats = mStats;
+
+    stats->mBytesQueued = 0;
+    for (List<Fragment>::const_iterator it = mOutFragments.begin();
+            it != mOutFragments.end(); ++it) {
+        stats->mBytesQueued += (*it).mBuffer->size();
+    }
+
+    int numBytesQueued;
+    if (mSocket >= 0 && ioctl(mSocket, SIOCOUTQ, &numBytesQueued) == 0
+            && numBytesQueued > 0) {
+        stats->mBytesQueued += numBytesQueued;
+    }
+}
+
 bool ANetworkSession::Session::wantsToRead() {
     return !mSawReceiveFailure && mState != CONNECTING;
 }
@@ -291,6 +330,9 @@ status_t ANetworkSession::Session::readMore() {
             } else {
                 buf->setRange(0, n);
 
+                mStats.mBytesReceived += n;
+                ++mStats.mPacketsReceived;
+
                 int64_t nowUs = ALooper::GetNowUs();
                 buf->meta()->setInt64("arrivalTimeUs", nowUs);
 
@@ -347,6 +389,9 @@ status_t ANetworkSession::Session::readMore() {
     if (n > 0) {
         mInBuffer.append(tmp, n);
 
+        mStats.mBytesReceived += n;
+        ++mStats.mPacketsReceived;
+
 #if 0
         ALOGI("in:");
         hexdump(tmp, n);
@@ -554,22 +599,42 @@ status_t ANetworkSession::Session::writeMore() {
 
         status_t err;
         do {
-            const Fragment &frag = *mOutFragments.begin();
-            const sp<ABuffer> &datagram = frag.mBuffer;
+            struct mmsghdr msgs[kMaxDatagramBatch];
+            struct iovec iovs[kMaxDatagramBatch];
+            memset(msgs, 0, sizeof(msgs));
+
+            size_t count = 0;
+            for (List<Fragment>::iterator it = mOutFragments.begin();
+                    it != mOutFragments.end() && count < kMaxDatagramBatch;
+                    ++it, ++count) {
+                const sp<ABuffer> &datagram = (*it).mBuffer;
+
+                iovs[count].iov_base = datagram->data();
+                iovs[count].iov_len = datagram->size();
+                msgs[count].msg_hdr.msg_iov = &iovs[count];
+                msgs[count].msg_hdr.msg_iovlen = 1;
+            }
 
             int n;
             do {
-                n = send(mSocket, datagram->data(), datagram->size(), 0);
+                n = sendmmsg(mSocket, msgs, count, 0);
             } while (n < 0 && errno == EINTR);
 
             err = OK;
 
             if (n > 0) {
-                if (frag.mFlags & FRAGMENT_FLAG_TIME_VALID) {
-                    dumpFragmentStats(frag);
-                }
+                for (int i = 0; i < n; ++i) {
+                    const Fragment &frag = *mOutFragments.begin();
+
+                    mStats.mBytesSent += msgs[i].msg_len;
+                    ++mStats.mPacketsSent;
 
-                mOutFragments.erase(mOutFragments.begin());
+                    if (frag.mFlags & FRAGMENT_FLAG_TIME_VALID) {
+                        dumpFragmentStats(frag);
+                    }
+
+                    mOutFragments.erase(mOutFragments.begin());
+                }
             } else if (n < 0) {
                 err = -errno;
             } else if (n == 0) {
@@ -635,6 +700,9 @@ status_t ANetworkSession::Session::writeMore() {
             break;
         }
 
+        mStats.mBytesSent += n;
+        ++mStats.mPacketsSent;
+
         frag.mBuffer->setRange(
                 frag.mBuffer->offset() + n, frag.mBuffer->size() - n);
 
@@ -798,7 +866,8 @@ void ANetworkSession::Session::notify(NotificationReason reason) {
 ////////////////////////////////////////////////////////////////////////////////
 
 ANetworkSession::ANetworkSession()
-    : mNextSessionID(1) {
+    : mNextSessionID(1),
+      mEpollFd(-1) {
     mPipeFd[0] = mPipeFd[1] = -1;
 }
 
@@ -817,12 +886,42 @@ status_t ANetworkSession::start() {
         return -errno;
     }
 
-    mThread = new NetworkThread(this);
+    status_t err = OK;
+
+    mEpollFd = epoll_create(kMaxEpollEvents);
+    if (mEpollFd < 0) {
+        err = -errno;
+    } else {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.u32 = kPipeEventID;
 
-    status_t err = mThread->run("ANetworkSession", ANDROID_PRIORITY_AUDIO);
+        if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mPipeFd[0], &event) < 0) {
+            err = -errno;
+        }
+    }
+
+    if (err == OK) {
+        Mutex::Autolock autoLock(mLock);
+
+        for (size_t i = 0; i < mSessions.size(); ++i) {
+            updateEventsLocked(mSessions.valueAt(i));
+        }
+    }
+
+    if (err == OK) {
+        mThread = new NetworkThread(this);
+
+        err = mThread->run("ANetworkSession", ANDROID_PRIORITY_AUDIO);
+
+        if (err != OK) {
+            mThread.clear();
+        }
+    }
 
     if (err != OK) {
-        mThread.clear();
+        closeEpoll();
 
         close(mPipeFd[0]);
         close(mPipeFd[1]);
@@ -845,6 +944,8 @@ status_t ANetworkSession::stop() {
 
     mThread.clear();
 
+    closeEpoll();
+
     close(mPipeFd[0]);
     close(mPipeFd[1]);
     mPipeFd[0] = mPipeFd[1] = -1;
@@ -852,6 +953,19 @@ status_t ANetworkSession::stop() {
     return OK;
 }
 
+void ANetworkSession::closeEpoll() {
+    Mutex::Autolock autoLock(mLock);
+
+    if (mEpollFd >= 0) {
+        close(mEpollFd);
+        mEpollFd = -1;
+    }
+
+    for (size_t i = 0; i < mSessions.size(); ++i) {
+        mSessions.valueAt(i)->setRegisteredEvents(0);
+    }
+}
+
 status_t ANetworkSession::createRTSPClient(
         const char *host, unsigned port, const sp<AMessage> &notify,
         int32_t *sessionID) {
@@ -937,10 +1051,9 @@ status_t ANetworkSession::destroySession(int32_t sessionID) {
         return -ENOENT;
     }
 
+    unregisterLocked(mSessions.valueAt(index));
     mSessions.removeItemsAt(index);
 
-    interrupt();
-
     return OK;
 }
 
@@ -1149,8 +1262,7 @@ status_t ANetworkSession::createClientOrServer(
     }
 
     mSessions.add(session->sessionID(), session);
-
-    interrupt();
+    updateEventsLocked(session);
 
     *sessionID = session->sessionID();
 
@@ -1217,7 +1329,7 @@ status_t ANetworkSession::sendRequest(
 
     status_t err = session->sendRequest(data, size, timeValid, timeUs);
 
-    interrupt();
+    updateEventsLocked(session);
 
     return err;
 }
@@ -1235,6 +1347,21 @@ status_t ANetworkSession::switchToWebSocketMode(int32_t sessionID) {
     return session->switchToWebSocketMode();
 }
 
+status_t ANetworkSession::getSessionStats(
+        int32_t sessionID, SessionStats *stats) {
+    Mutex::Autolock autoLock(mLock);
+
+    ssize_t index = mSessions.indexOfKey(sessionID);
+
+    if (index < 0) {
+        return -ENOENT;
+    }
+
+    mSessions.valueAt(index)->getStats(stats);
+
+    return OK;
+}
+
 void ANetworkSession::interrupt() {
     static const char dummy = 0;
 
@@ -1248,163 +1375,181 @@ void ANetworkSession::interrupt() {
     }
 }
 
-void ANetworkSession::threadLoop() {
-    fd_set rs, ws;
-    FD_ZERO(&rs);
-    FD_ZERO(&ws);
-
-    FD_SET(mPipeFd[0], &rs);
-    int maxFd = mPipeFd[0];
-
-    {
-        Mutex::Autolock autoLock(mLock);
+void ANetworkSession::updateEventsLocked(const sp<Session> &session) {
+    if (mEpollFd < 0 || session->socket() < 0) {
+        return;
+    }
 
-        for (size_t i = 0; i < mSessions.size(); ++i) {
-            const sp<Session> &session = mSessions.valueAt(i);
+    uint32_t events = (session->wantsToRead() ? EPOLLIN : 0)
+        | (session->wantsToWrite() ? EPOLLOUT : 0);
 
-            int s = session->socket();
+    uint32_t registered = session->registeredEvents();
+    if (events == registered) {
+        return;
+    }
 
-            if (s < 0) {
-                continue;
-            }
+    // A socket that is waited on for nothing is taken out altogether, epoll
+    // would keep reporting errors and hangups on it otherwise.
+    int op;
+    if (registered == 0) {
+        op = EPOLL_CTL_ADD;
+    } else if (events == 0) {
+        op = EPOLL_CTL_DEL;
+    } else {
+        op = EPOLL_CTL_MOD;
+    }
 
-            if (session->wantsToRead()) {
-                FD_SET(s, &rs);
-                if (s > maxFd) {
-                    maxFd = s;
-                }
-            }
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.u32 = session->sessionID();
 
-            if (session->wantsToWrite()) {
-                FD_SET(s, &ws);
-                if (s > maxFd) {
-                    maxFd = s;
-                }
-            }
-        }
+    if (epoll_ctl(mEpollFd, op, session->socket(), &event) < 0) {
+        ALOGE("epoll_ctl on socket %d failed w/ error %d (%s)",
+              session->socket(), errno, strerror(errno));
+        return;
     }
 
-    int res = select(maxFd + 1, &rs, &ws, NULL, NULL /* tv */);
+    session->setRegisteredEvents(events);
+}
 
-    if (res == 0) {
+void ANetworkSession::unregisterLocked(const sp<Session> &session) {
+    if (mEpollFd < 0 || session->registeredEvents() == 0) {
         return;
     }
 
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    epoll_ctl(mEpollFd, EPOLL_CTL_DEL, session->socket(), &event);
+
+    session->setRegisteredEvents(0);
+}
+
+void ANetworkSession::threadLoop() {
+    struct epoll_event events[kMaxEpollEvents];
+
+    int res = epoll_wait(mEpollFd, events, kMaxEpollEvents, -1 /* timeout */);
+
     if (res < 0) {
         if (errno == EINTR) {
             return;
         }
 
-        ALOGE("select failed w/ error %d (%s)", errno, strerror(errno));
+        ALOGE("epoll_wait failed w/ error %d (%s)", errno, strerror(errno));
         return;
     }
 
-    if (FD_ISSET(mPipeFd[0], &rs)) {
-        char c;
-        ssize_t n;
-        do {
-            n = read(mPipeFd[0], &c, 1);
-        } while (n < 0 && errno == EINTR);
+    Mutex::Autolock autoLock(mLock);
+
+    List<sp<Session> > sessionsToAdd;
+
+    for (int i = 0; i < res; ++i) {
+        if (events[i].data.u32 == kPipeEventID) {
+            char c[16];
+            ssize_t n;
+            do {
+                n = read(mPipeFd[0], c, sizeof(c));
+            } while (n < 0 && errno == EINTR);
 
-        if (n < 0) {
-            ALOGW("Error reading from pipe (%s)", strerror(errno));
+            if (n < 0) {
+                ALOGW("Error reading from pipe (%s)", strerror(errno));
+            }
+            continue;
         }
 
-        --res;
-    }
+        ssize_t index = mSessions.indexOfKey((int32_t)events[i].data.u32);
+        if (index < 0) {
+            // destroyed after the event was reported
+            continue;
+        }
 
-    {
-        Mutex::Autolock autoLock(mLock);
+        sp<Session> session = mSessions.valueAt(index);
 
-        List<sp<Session> > sessionsToAdd;
+        int s = session->socket();
 
-        for (size_t i = mSessions.size(); res > 0 && i-- > 0;) {
-            const sp<Session> &session = mSessions.valueAt(i);
+        // Like select() did, report errors and hangups as readiness for
+        // whatever the session waits for, its read or write will fail.
+        uint32_t ready = events[i].events;
+        if (ready & (EPOLLERR | EPOLLHUP)) {
+            ready |= session->registeredEvents();
+        }
 
-            int s = session->socket();
+        if ((ready & EPOLLIN) && session->wantsToRead()) {
+            if (session->isRTSPServer() || session->isTCPDatagramServer()) {
+                struct sockaddr_in remoteAddr;
+                socklen_t remoteAddrLen = sizeof(remoteAddr);
 
-            if (s < 0) {
-                continue;
-            }
+                int clientSocket = accept(
+                        s, (struct sockaddr *)&remoteAddr, &remoteAddrLen);
 
-            if (FD_ISSET(s, &rs) || FD_ISSET(s, &ws)) {
-                --res;
-            }
+                if (clientSocket >= 0) {
+                    status_t err = MakeSocketNonBlocking(clientSocket);
 
-            if (FD_ISSET(s, &rs)) {
-                if (session->isRTSPServer() || session->isTCPDatagramServer()) {
-                    struct sockaddr_in remoteAddr;
-                    socklen_t remoteAddrLen = sizeof(remoteAddr);
-
-                    int clientSocket = accept(
-                            s, (struct sockaddr *)&remoteAddr, &remoteAddrLen);
-
-                    if (clientSocket >= 0) {
-                        status_t err = MakeSocketNonBlocking(clientSocket);
-
-                        if (err != OK) {
-                            ALOGE("Unable to make client socket non blocking, "
-                                  "failed w/ error %d (%s)",
-                                  err, strerror(-err));
-
-                            close(clientSocket);
-                            clientSocket = -1;
-                        } else {
-                            in_addr_t addr = ntohl(remoteAddr.sin_addr.s_addr);
-
-                            ALOGI("incoming connection from %d.%d.%d.%d:%d "
-                                  "(socket %d)",
-                                  (addr >> 24),
-                                  (addr >> 16) & 0xff,
-                                  (addr >> 8) & 0xff,
-                                  addr & 0xff,
-                                  ntohs(remoteAddr.sin_port),
-                                  clientSocket);
-
-                            sp<Session> clientSession =
-                                new Session(
-                                        mNextSessionID++,
-                                        Session::CONNECTED,
-                                        clientSocket,
-                                        session->getNotificationMessage());
-
-                            clientSession->setMode(
-                                    session->isRTSPServer()
-                                        ? Session::MODE_RTSP
-                                        : Session::MODE_DATAGRAM);
-
-                            sessionsToAdd.push_back(clientSession);
-                        }
+                    if (err != OK) {
+                        ALOGE("Unable to make client socket non blocking, "
+                              "failed w/ error %d (%s)",
+                              err, strerror(-err));
+
+                        close(clientSocket);
+                        clientSocket = -1;
                     } else {
-                        ALOGE("accept returned error %d (%s)",
-                              errno, strerror(errno));
+                        in_addr_t addr = ntohl(remoteAddr.sin_addr.s_addr);
+
+                        ALOGI("incoming connection from %d.%d.%d.%d:%d "
+                              "(socket %d)",
+                              (addr >> 24),
+                              (addr >> 16) & 0xff,
+                              (addr >> 8) & 0xff,
+                              addr & 0xff,
+                              ntohs(remoteAddr.sin_port),
+                              clientSocket);
+
+                        sp<Session> clientSession =
+                            new Session(
+                                    mNextSessionID++,
+                                    Session::CONNECTED,
+                                    clientSocket,
+                                    session->getNotificationMessage());
+
+                        clientSession->setMode(
+                                session->isRTSPServer()
+                                    ? Session::MODE_RTSP
+                                    : Session::MODE_DATAGRAM);
+
+                        sessionsToAdd.push_back(clientSession);
                     }
                 } else {
-                    status_t err = session->readMore();
-                    if (err != OK) {
-                        ALOGE("readMore on socket %d failed w/ error %d (%s)",
-                              s, err, strerror(-err));
-                    }
+                    ALOGE("accept returned error %d (%s)",
+                          errno, strerror(errno));
                 }
-            }
-
-            if (FD_ISSET(s, &ws)) {
-                status_t err = session->writeMore();
+            } else {
+                status_t err = session->readMore();
                 if (err != OK) {
-                    ALOGE("writeMore on socket %d failed w/ error %d (%s)",
+                    ALOGE("readMore on socket %d failed w/ error %d (%s)",
                           s, err, strerror(-err));
                 }
             }
         }
 
-        while (!sessionsToAdd.empty()) {
-            sp<Session> session = *sessionsToAdd.begin();
-            sessionsToAdd.erase(sessionsToAdd.begin());
+        if ((ready & EPOLLOUT) && session->wantsToWrite()) {
+            status_t err = session->writeMore();
+            if (err != OK) {
+                ALOGE("writeMore on socket %d failed w/ error %d (%s)",
+                      s, err, strerror(-err));
+            }
+        }
 
-            mSessions.add(session->sessionID(), session);
+        updateEventsLocked(session);
+    }
 
-            ALOGI("added clientSession %d", session->sessionID());
-        }
+    while (!sessionsToAdd.empty()) {
+        sp<Session> session = *sessionsToAdd.begin();
+        sessionsToAdd.erase(sessionsToAdd.begin());
+
+        mSessions.add(session->sessionID(), session);
+        updateEventsLocked(session);
+
+        ALOGI("added clientSession %d", session->sessionID());
     }
 }
 
@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "AbrPolicy"
+#include <utils/Log.h>
+
+#include "AbrPolicy.h"
+
+#include <cutils/properties.h>
+
+#include <math.h>
+#include <string.h>
+
+namespace android {
+
+#define PROP_ABR_POLICY "media.httplive.abr"
+
+// Downloads this short measure the round trip more than the throughput.
+static const size_t kMinSegmentBytes = 16 * 1024;
+static const int64_t kMinDownloadTimeUs = 10000ll;
+
+// in seconds of download time
+static const double kFastHalfLifeSecs = 2.0;
+static const double kSlowHalfLifeSecs = 5.0;
+static const double kMinTotalWeightSecs = 0.5;
+
+// Highest variant with a bandwidth below that of the estimate, scaled down
+// for the estimate's error: more so to switch up, for the switch not to be
+// undone as soon as the estimate moves.
+static size_t indexBelow(
+        const unsigned long *bandwidthsBps, size_t numVariants,
+        ssize_t currentIndex, int32_t bandwidthBps) {
+    size_t index = numVariants - 1;
+    while (index > 0) {
+        unsigned long adjustedBandwidthBps = bandwidthBps;
+        if (currentIndex < 0 || index > (size_t)currentIndex) {
+            adjustedBandwidthBps = adjustedBandwidthBps * 7 / 10;
+        } else {
+            adjustedBandwidthBps = adjustedBandwidthBps * 8 / 10;
+        }
+        if (bandwidthsBps[index] <= adjustedBandwidthBps) {
+            break;
+        }
+        --index;
+    }
+    return index;
+}
+
+// static
+sp<AbrPolicy> AbrPolicy::Create() {
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get(PROP_ABR_POLICY, value, NULL) && !strcmp(value, "legacy")) {
+        ALOGI("using the legacy adaptation policy");
+        return new LegacyAbrPolicy;
+    }
+    return new DefaultAbrPolicy;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+const int64_t DefaultAbrPolicy::kMinBufferForUpSwitchUs = 10000000ll;
+const int64_t DefaultAbrPolicy::kHighBufferUs = 20000000ll;
+
+DefaultAbrPolicy::Ewma::Ewma(double halfLifeSecs)
+    : mAlpha(exp(log(0.5) / halfLifeSecs)),
+      mEstimate(0.0),
+      mTotalWeightSecs(0.0) {
+}
+
+void DefaultAbrPolicy::Ewma::add(double weightSecs, double value) {
+    double alpha = pow(mAlpha, weightSecs);
+    mEstimate = value * (1.0 - alpha) + alpha * mEstimate;
+    mTotalWeightSecs += weightSecs;
+}
+
+double DefaultAbrPolicy::Ewma::estimate() const {
+    return mEstimate / (1.0 - pow(mAlpha, mTotalWeightSecs));
+}
+
+DefaultAbrPolicy::DefaultAbrPolicy()
+    : mFast(kFastHalfLifeSecs),
+      mSlow(kSlowHalfLifeSecs),
+      mTotalWeightSecs(0.0) {
+}
+
+void DefaultAbrPolicy::onSegmentDownloaded(size_t bytes, int64_t downloadTimeUs) {
+    if (bytes < kMinSegmentBytes) {
+        ALOGV("leaving out %zu bytes in %lld us", bytes, (long long)downloadTimeUs);
+        return;
+    }
+    if (downloadTimeUs < kMinDownloadTimeUs) {
+        downloadTimeUs = kMinDownloadTimeUs;
+    }
+
+    double weightSecs = downloadTimeUs / 1E6;
+    double bandwidthBps = bytes * 8E6 / downloadTimeUs;
+    mFast.add(weightSecs, bandwidthBps);
+    mSlow.add(weightSecs, bandwidthBps);
+    mTotalWeightSecs += weightSecs;
+
+    ALOGV("segment at %.2f kbps, estimate %.2f kbps (fast) / %.2f kbps (slow)",
+            bandwidthBps / 1E3, mFast.estimate() / 1E3, mSlow.estimate() / 1E3);
+}
+
+bool DefaultAbrPolicy::estimateBandwidth(int32_t *bandwidthBps) const {
+    if (mTotalWeightSecs < kMinTotalWeightSecs) {
+        return false;
+    }
+
+    double estimate = mFast.estimate();
+    if (mSlow.estimate() < estimate) {
+        estimate = mSlow.estimate();
+    }
+    *bandwidthBps = estimate > 0x7fffffff ? 0x7fffffff : (int32_t)estimate;
+    return true;
+}
+
+size_t DefaultAbrPolicy::pickBandwidthIndex(
+        const unsigned long *bandwidthsBps, size_t numVariants,
+        ssize_t currentIndex, int32_t bandwidthBps,
+        int64_t bufferedDurationUs) {
+    size_t index = indexBelow(bandwidthsBps, numVariants, currentIndex, bandwidthBps);
+    if (currentIndex < 0 || index == (size_t)currentIndex) {
+        return index;
+    }
+
+    if (index > (size_t)currentIndex) {
+        if (bufferedDurationUs < kMinBufferForUpSwitchUs) {
+            return currentIndex;
+        }
+        return currentIndex + 1;
+    }
+
+    if (bufferedDurationUs > kHighBufferUs
+            && bandwidthsBps[currentIndex] <= (unsigned long)bandwidthBps) {
+        ALOGV("riding out the drop to %d bps on %lld us of buffer",
+                bandwidthBps, (long long)bufferedDurationUs);
+        return currentIndex;
+    }
+    return index;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void LegacyAbrPolicy::onSegmentDownloaded(
+        size_t /* bytes */, int64_t /* downloadTimeUs */) {
+}
+
+bool LegacyAbrPolicy::estimateBandwidth(int32_t * /* bandwidthBps */) const {
+    return false;
+}
+
+size_t LegacyAbrPolicy::pickBandwidthIndex(
+        const unsigned long *bandwidthsBps, size_t numVariants,
+        ssize_t currentIndex, int32_t bandwidthBps,
+        int64_t bufferedDurationUs) {
+    size_t index = indexBelow(bandwidthsBps, numVariants, currentIndex, bandwidthBps);
+    if (currentIndex >= 0 && index > (size_t)currentIndex
+            && bufferedDurationUs <= 10000000ll) {
+        return currentIndex;
+    }
+    return index;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+AbrMetrics::AbrMetrics()
+    : mNumSwitchesUp(0),
+      mNumSwitchesDown(0),
+      mNumRebuffers(0),
+      mRebufferDurationUs(0ll),
+      mRebufferStartUs(-1ll),
+      mBandwidthBps(0),
+      mSelectedAtUs(-1ll),
+      mBitsSelected(0.0),
+      mDurationSelectedUs(0ll) {
+}
+
+void AbrMetrics::onVariantSelected(unsigned long bandwidthBps, int64_t nowUs) {
+    Mutex::Autolock autoLock(mLock);
+
+    if (mSelectedAtUs >= 0) {
+        mBitsSelected += (double)mBandwidthBps * (nowUs - mSelectedAtUs) / 1E6;
+        mDurationSelectedUs += nowUs - mSelectedAtUs;
+    }
+    mBandwidthBps = bandwidthBps;
+    mSelectedAtUs = nowUs;
+}
+
+void AbrMetrics::onSwitch(bool up) {
+    Mutex::Autolock autoLock(mLock);
+
+    if (up) {
+        ++mNumSwitchesUp;
+    } else {
+        ++mNumSwitchesDown;
+    }
+}
+
+void AbrMetrics::onRebufferStart(int64_t nowUs) {
+    Mutex::Autolock autoLock(mLock);
+
+    ++mNumRebuffers;
+    mRebufferStartUs = nowUs;
+}
+
+void AbrMetrics::onRebufferEnd(int64_t nowUs) {
+    Mutex::Autolock autoLock(mLock);
+
+    if (mRebufferStartUs >= 0) {
+        mRebufferDurationUs += nowUs - mRebufferStartUs;
+        mRebufferStartUs = -1ll;
+    }
+}
+
+void AbrMetrics::log(int64_t nowUs) {
+    Mutex::Autolock autoLock(mLock);
+
+    double bits = mBitsSelected;
+    int64_t durationUs = mDurationSelectedUs;
+    if (mSelectedAtUs >= 0) {
+        bits += (double)mBandwidthBps * (nowUs - mSelectedAtUs) / 1E6;
+        durationUs += nowUs - mSelectedAtUs;
+    }
+
+    ALOGI("%zu switches up, %zu down, %zu rebuffers for %.2f s, "
+            "average bitrate %.2f kbps over %.2f s",
+            mNumSwitchesUp, mNumSwitchesDown, mNumRebuffers,
+            mRebufferDurationUs / 1E6,
+            durationUs > 0 ? bits * 1E6 / durationUs / 1E3 : 0.0,
+            durationUs / 1E6);
+}
+
+}  // namespace android
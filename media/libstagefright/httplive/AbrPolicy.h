@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ABR_POLICY_H_
+
+#define ABR_POLICY_H_
+
+#include <media/stagefright/foundation/ABase.h>
+#include <utils/RefBase.h>
+#include <utils/threads.h>
+
+namespace android {
+
+// Picks the variant of an HLS session to fetch next. LiveSession feeds it the
+// download of every media segment and asks it for a variant at the segment
+// boundaries. Called on the LiveSession looper only.
+struct AbrPolicy : public RefBase {
+    // The policy named by the media.httplive.abr property, "legacy" for the
+    // rules LiveSession used to have, the default otherwise.
+    static sp<AbrPolicy> Create();
+
+    virtual void onSegmentDownloaded(size_t bytes, int64_t downloadTimeUs) = 0;
+
+    // false until enough segments have been downloaded to tell.
+    virtual bool estimateBandwidth(int32_t *bandwidthBps) const = 0;
+
+    // bandwidthsBps are those of the variants in increasing order,
+    // currentIndex is -1 before the first one is picked, bufferedDurationUs is
+    // the media buffered ahead of playback.
+    virtual size_t pickBandwidthIndex(
+            const unsigned long *bandwidthsBps, size_t numVariants,
+            ssize_t currentIndex, int32_t bandwidthBps,
+            int64_t bufferedDurationUs) = 0;
+
+protected:
+    AbrPolicy() {}
+    virtual ~AbrPolicy() {}
+
+private:
+    DISALLOW_EVIL_CONSTRUCTORS(AbrPolicy);
+};
+
+// Throughput from two exponentially weighted moving averages of the segment
+// downloads, a fast and a slow one, the lower of the two being used: the
+// estimate drops as soon as the network does and recovers only once it has
+// been good for a while. Segments too small to measure throughput are left
+// out.
+//
+// The variant is then the highest one that fits in 80% of the estimate, or
+// 70% to switch up, with the buffer deciding when to act on it:
+//   - up switches wait for kMinBufferForUpSwitchUs of media, and go one
+//     variant at a time;
+//   - down switches wait while more than kHighBufferUs of media is buffered
+//     and the estimate still covers the current variant, for short dips not
+//     to cost a switch.
+struct DefaultAbrPolicy : public AbrPolicy {
+    static const int64_t kMinBufferForUpSwitchUs;
+    static const int64_t kHighBufferUs;
+
+    DefaultAbrPolicy();
+
+    virtual void onSegmentDownloaded(size_t bytes, int64_t downloadTimeUs);
+    virtual bool estimateBandwidth(int32_t *bandwidthBps) const;
+    virtual size_t pickBandwidthIndex(
+            const unsigned long *bandwidthsBps, size_t numVariants,
+            ssize_t currentIndex, int32_t bandwidthBps,
+            int64_t bufferedDurationUs);
+
+private:
+    // Weighted by download time, with the bias of the zero it starts from
+    // taken out.
+    struct Ewma {
+        Ewma(double halfLifeSecs);
+
+        void add(double weightSecs, double value);
+        double estimate() const;
+
+        double mAlpha;
+        double mEstimate;
+        double mTotalWeightSecs;
+    };
+
+    Ewma mFast;
+    Ewma mSlow;
+    double mTotalWeightSecs;
+
+    DISALLOW_EVIL_CONSTRUCTORS(DefaultAbrPolicy);
+};
+
+// What LiveSession did before: no estimate of its own, so the HTTPBase one,
+// averaged over all transfers, is used, the highest variant in 80% of it, or
+// 70% to switch up, and up switches once 10 s of media are buffered.
+struct LegacyAbrPolicy : public AbrPolicy {
+    LegacyAbrPolicy() {}
+
+    virtual void onSegmentDownloaded(size_t bytes, int64_t downloadTimeUs);
+    virtual bool estimateBandwidth(int32_t *bandwidthBps) const;
+    virtual size_t pickBandwidthIndex(
+            const unsigned long *bandwidthsBps, size_t numVariants,
+            ssize_t currentIndex, int32_t bandwidthBps,
+            int64_t bufferedDurationUs);
+
+private:
+    DISALLOW_EVIL_CONSTRUCTORS(LegacyAbrPolicy);
+};
+
+// Switches, rebuffers and the average bitrate of a session, logged when it
+// disconnects. Rebuffers are reported on the player thread, the rest on the
+// LiveSession looper.
+struct AbrMetrics {
+    AbrMetrics();
+
+    void onVariantSelected(unsigned long bandwidthBps, int64_t nowUs);
+    void onSwitch(bool up);
+    void onRebufferStart(int64_t nowUs);
+    void onRebufferEnd(int64_t nowUs);
+
+    void log(int64_t nowUs);
+
+private:
+    Mutex mLock;
+
+    size_t mNumSwitchesUp;
+    size_t mNumSwitchesDown;
+    size_t mNumRebuffers;
+    int64_t mRebufferDurationUs;
+    int64_t mRebufferStartUs;
+
+    // time-weighted bandwidth of the variants played
+    unsigned long mBandwidthBps;
+    int64_t mSelectedAtUs;
+    double mBitsSelected;
+    int64_t mDurationSelectedUs;
+
+    DISALLOW_EVIL_CONSTRUCTORS(AbrMetrics);
+};
+
+}  // namespace android
+
+#endif  // ABR_POLICY_H_
@@ -58,10 +58,10 @@ LiveSession::LiveSession(
       mInPreparationPhase(true),
       mHTTPDataSource(new MediaHTTP(mHTTPService->makeHTTPConnection())),
       mCurBandwidthIndex(-1),
+      mAbrPolicy(AbrPolicy::Create()),
       mStreamMask(0),
       mNewStreamMask(0),
       mSwapMask(0),
-      mCheckBandwidthGeneration(0),
       mSwitchGeneration(0),
       mSubtitleGeneration(0),
       mLastDequeuedTimeUs(0ll),
@@ -83,7 +83,9 @@ LiveSession::LiveSession(
         mPacketSources.add(indexToType(i), new AnotherPacketSource(NULL /* meta */));
         mPacketSources2.add(indexToType(i), new AnotherPacketSource(NULL /* meta */));
         mBuffering[i] = false;
+        mPlaying[i] = false;
     }
+    mRebuffering = false;
 }
 
 LiveSession::~LiveSession() {
@@ -115,10 +117,13 @@ status_t LiveSession::dequeueAccessUnit(
         return -EWOULDBLOCK;
     }
 
+    ssize_t idx = typeToIndex(stream);
+
     status_t finalResult;
     sp<AnotherPacketSource> discontinuityQueue  = mDiscontinuities.valueFor(stream);
     if (discontinuityQueue->hasBufferAvailable(&finalResult)) {
         discontinuityQueue->dequeueAccessUnit(accessUnit);
+        mPlaying[idx] = false;
         // seeking, track switching
         sp<AMessage> extra;
         int64_t timeUs;
@@ -135,9 +140,13 @@ status_t LiveSession::dequeueAccessUnit(
 
     sp<AnotherPacketSource> packetSource = mPacketSources.valueFor(stream);
 
-    ssize_t idx = typeToIndex(stream);
     if (!packetSource->hasBufferAvailable(&finalResult)) {
         if (finalResult == OK) {
+            if (mPlaying[idx] && !mRebuffering) {
+                mRebuffering = true;
+                mAbrMetrics.onRebufferStart(ALooper::GetNowUs());
+            }
+            mPlaying[idx] = false;
             mBuffering[idx] = true;
             return -EAGAIN;
         } else {
@@ -171,6 +180,17 @@ status_t LiveSession::dequeueAccessUnit(
         return -EAGAIN;
     }
 
+    if (mRebuffering) {
+        bool buffering = false;
+        for (size_t i = 0; i < kMaxStreams; ++i) {
+            buffering = buffering || mBuffering[i];
+        }
+        if (!buffering) {
+            mRebuffering = false;
+            mAbrMetrics.onRebufferEnd(ALooper::GetNowUs());
+        }
+    }
+
     // wait for counterpart
     sp<AnotherPacketSource> otherSource;
     uint32_t mask = mNewStreamMask & mStreamMask;
@@ -190,6 +210,8 @@ status_t LiveSession::dequeueAccessUnit(
     }
 
     status_t err = packetSource->dequeueAccessUnit(accessUnit);
+    // subtitles run dry all the time
+    mPlaying[idx] = err == OK && stream != STREAMTYPE_SUBTITLES;
 
     size_t streamIdx;
     const char *streamStr;
@@ -446,6 +468,12 @@ void LiveSession::onMessageReceived(const sp<AMessage> &msg) {
                     break;
                 }
 
+                case PlaylistFetcher::kWhatSegmentDownloaded:
+                {
+                    onSegmentDownloaded(msg);
+                    break;
+                }
+
                 case PlaylistFetcher::kWhatDurationUpdate:
                 {
                     AString uri;
@@ -559,19 +587,6 @@ void LiveSession::onMessageReceived(const sp<AMessage> &msg) {
             break;
         }
 
-        case kWhatCheckBandwidth:
-        {
-            int32_t generation;
-            CHECK(msg->findInt32("generation", &generation));
-
-            if (generation != mCheckBandwidthGeneration) {
-                break;
-            }
-
-            onCheckBandwidth(msg);
-            break;
-        }
-
         case kWhatChangeConfiguration:
         {
             onChangeConfiguration(msg);
@@ -733,9 +748,9 @@ void LiveSession::onConnect(const sp<AMessage> &msg) {
 }
 
 void LiveSession::finishDisconnect() {
-    // No reconfiguration is currently pending, make sure none will trigger
-    // during disconnection either.
-    cancelCheckBandwidthEvent();
+    // No reconfiguration is currently pending, and onSegmentDownloaded will
+    // start none now that mDisconnectReplyID is set.
+    mAbrMetrics.log(ALooper::GetNowUs());
 
     // Protect mPacketSources from a swapPacketSource race condition through disconnect.
     // (finishDisconnect, onFinishDisconnect2)
@@ -826,31 +841,11 @@ ssize_t LiveSession::fetchFile(
     }
 
     if (*source == NULL) {
-        if (!strncasecmp(url, "file://", 7)) {
-            *source = new FileSource(url + 7);
-        } else if (strncasecmp(url, "http://", 7)
-                && strncasecmp(url, "https://", 8)) {
-            return ERROR_UNSUPPORTED;
-        } else {
-            KeyedVector<String8, String8> headers = mExtraHeaders;
-            if (range_offset > 0 || range_length >= 0) {
-                headers.add(
-                        String8("Range"),
-                        String8(
-                            StringPrintf(
-                                "bytes=%lld-%s",
-                                range_offset,
-                                range_length < 0
-                                    ? "" : StringPrintf("%lld",
-                                            range_offset + range_length - 1).c_str()).c_str()));
-            }
-            status_t err = mHTTPDataSource->connect(url, &headers);
+        status_t err = openSource(
+                url, range_offset, range_length, mHTTPDataSource, source);
 
-            if (err != OK) {
-                return err;
-            }
-
-            *source = mHTTPDataSource;
+        if (err != OK) {
+            return err;
         }
     }
 
@@ -930,8 +925,45 @@ ssize_t LiveSession::fetchFile(
     return bytesRead;
 }
 
+status_t LiveSession::openSource(
+        const char *url, int64_t range_offset, int64_t range_length,
+        const sp<HTTPBase> &httpDataSource, sp<DataSource> *source) {
+    if (!strncasecmp(url, "file://", 7)) {
+        *source = new FileSource(url + 7);
+    } else if (strncasecmp(url, "http://", 7)
+            && strncasecmp(url, "https://", 8)) {
+        return ERROR_UNSUPPORTED;
+    } else {
+        KeyedVector<String8, String8> headers = mExtraHeaders;
+        if (range_offset > 0 || range_length >= 0) {
+            headers.add(
+                    String8("Range"),
+                    String8(
+                        StringPrintf(
+                            "bytes=%lld-%s",
+                            range_offset,
+                            range_length < 0
+                                ? "" : StringPrintf("%lld",
+                                        range_offset + range_length - 1).c_str()).c_str()));
+        }
+        status_t err = httpDataSource->connect(url, &headers);
+
+        if (err != OK) {
+            return err;
+        }
+
+        *source = httpDataSource;
+    }
+    return OK;
+}
+
+sp<HTTPBase> LiveSession::makeHTTPDataSource() {
+    return new MediaHTTP(mHTTPService->makeHTTPConnection());
+}
+
 sp<M3UParser> LiveSession::fetchPlaylist(
-        const char *url, uint8_t *curPlaylistHash, bool *unchanged) {
+        const char *url, uint8_t *curPlaylistHash, bool *unchanged,
+        const sp<M3UParser> &previous) {
     ALOGV("fetchPlaylist '%s'", url);
 
     *unchanged = false;
@@ -969,7 +1001,7 @@ sp<M3UParser> LiveSession::fetchPlaylist(
 #endif
 
     sp<M3UParser> playlist =
-        new M3UParser(actualUrl.string(), buffer->data(), buffer->size());
+        new M3UParser(actualUrl.string(), buffer->data(), buffer->size(), previous);
 
     if (playlist->initCheck() != OK) {
         ALOGE("failed to parse .m3u8 playlist");
@@ -1004,9 +1036,12 @@ size_t LiveSession::getBandwidthIndex() {
 
     if (index < 0) {
         int32_t bandwidthBps;
-        if (mHTTPDataSource != NULL
-                && mHTTPDataSource->estimateBandwidth(&bandwidthBps)) {
+        if (mAbrPolicy->estimateBandwidth(&bandwidthBps)) {
             ALOGV("bandwidth estimated at %.2f kbps", bandwidthBps / 1024.0f);
+        } else if (mHTTPDataSource != NULL
+                && mHTTPDataSource->estimateBandwidth(&bandwidthBps)) {
+            // from all transfers, playlists included
+            ALOGV("HTTP bandwidth estimated at %.2f kbps", bandwidthBps / 1024.0f);
         } else {
             ALOGV("no bandwidth estimate.");
             return 0;  // Pick the lowest bandwidth stream by default.
@@ -1024,24 +1059,14 @@ size_t LiveSession::getBandwidthIndex() {
             }
         }
 
-        // Pick the highest bandwidth stream below or equal to estimated bandwidth.
-
-        index = mBandwidthItems.size() - 1;
-        while (index > 0) {
-            // consider only 80% of the available bandwidth, but if we are switching up,
-            // be even more conservative (70%) to avoid overestimating and immediately
-            // switching back.
-            size_t adjustedBandwidthBps = bandwidthBps;
-            if (index > mCurBandwidthIndex) {
-                adjustedBandwidthBps = adjustedBandwidthBps * 7 / 10;
-            } else {
-                adjustedBandwidthBps = adjustedBandwidthBps * 8 / 10;
-            }
-            if (mBandwidthItems.itemAt(index).mBandwidth <= adjustedBandwidthBps) {
-                break;
-            }
-            --index;
+        Vector<unsigned long> bandwidthsBps;
+        for (size_t i = 0; i < mBandwidthItems.size(); ++i) {
+            bandwidthsBps.push(mBandwidthItems.itemAt(i).mBandwidth);
         }
+
+        index = mAbrPolicy->pickBandwidthIndex(
+                bandwidthsBps.array(), bandwidthsBps.size(), mCurBandwidthIndex,
+                bandwidthBps, getBufferedDurationUs());
     }
 #elif 0
     // Change bandwidth at random()
@@ -1182,17 +1207,22 @@ status_t LiveSession::selectTrack(size_t index, bool select) {
     return err;
 }
 
-bool LiveSession::canSwitchUp() {
-    // Allow upwards bandwidth switch when a stream has buffered at least 10 seconds.
-    status_t err = OK;
-    for (size_t i = 0; i < mPacketSources.size(); ++i) {
-        sp<AnotherPacketSource> source = mPacketSources.valueAt(i);
-        int64_t dur = source->getBufferedDurationUs(&err);
-        if (err == OK && dur > 10000000) {
-            return true;
+int64_t LiveSession::getBufferedDurationUs() {
+    // the least of the audio and video being played
+    int64_t minDurationUs = -1ll;
+    for (size_t i = 0; i < kMaxStreams; ++i) {
+        StreamType type = indexToType(i);
+        if (type == STREAMTYPE_SUBTITLES || !(mStreamMask & type)) {
+            continue;
+        }
+
+        status_t err = OK;
+        int64_t durationUs = mPacketSources.valueFor(type)->getBufferedDurationUs(&err);
+        if (err == OK && (minDurationUs < 0 || durationUs < minDurationUs)) {
+            minDurationUs = durationUs;
         }
     }
-    return false;
+    return minDurationUs < 0 ? 0ll : minDurationUs;
 }
 
 void LiveSession::changeConfiguration(
@@ -1204,14 +1234,22 @@ void LiveSession::changeConfiguration(
     CHECK(!mReconfigurationInProgress);
     mReconfigurationInProgress = true;
 
-    mCurBandwidthIndex = bandwidthIndex;
-
     ALOGV("changeConfiguration => timeUs:%" PRId64 " us, bwIndex:%zu, pickTrack:%d",
           timeUs, bandwidthIndex, pickTrack);
 
     CHECK_LT(bandwidthIndex, mBandwidthItems.size());
     const BandwidthItem &item = mBandwidthItems.itemAt(bandwidthIndex);
 
+    if (mCurBandwidthIndex < 0 || bandwidthIndex != (size_t)mCurBandwidthIndex) {
+        if (mCurBandwidthIndex >= 0) {
+            ALOGI("switching from %lu to %lu bps",
+                    mBandwidthItems.itemAt(mCurBandwidthIndex).mBandwidth, item.mBandwidth);
+            mAbrMetrics.onSwitch(bandwidthIndex > (size_t)mCurBandwidthIndex);
+        }
+        mAbrMetrics.onVariantSelected(item.mBandwidth, ALooper::GetNowUs());
+    }
+    mCurBandwidthIndex = bandwidthIndex;
+
     uint32_t streamMask = 0; // streams that should be fetched by the new fetcher
     uint32_t resumeMask = 0; // streams that should be fetched by the original fetcher
 
@@ -1546,9 +1584,6 @@ void LiveSession::onChangeConfiguration3(const sp<AMessage> &msg) {
     // All fetchers have now been started, the configuration change
     // has completed.
 
-    cancelCheckBandwidthEvent();
-    scheduleCheckBandwidthEvent();
-
     ALOGV("XXX configuration change completed.");
     mReconfigurationInProgress = false;
     if (switching) {
@@ -1665,16 +1700,6 @@ void LiveSession::tryToFinishBandwidthSwitch() {
     }
 }
 
-void LiveSession::scheduleCheckBandwidthEvent() {
-    sp<AMessage> msg = new AMessage(kWhatCheckBandwidth, id());
-    msg->setInt32("generation", mCheckBandwidthGeneration);
-    msg->post(10000000ll);
-}
-
-void LiveSession::cancelCheckBandwidthEvent() {
-    ++mCheckBandwidthGeneration;
-}
-
 void LiveSession::cancelBandwidthSwitch() {
     Mutex::Autolock lock(mSwapMutex);
     mSwitchGeneration++;
@@ -1713,24 +1738,28 @@ bool LiveSession::canSwitchBandwidthTo(size_t bandwidthIndex) {
         return true;
     }
 
-    if (bandwidthIndex == (size_t)mCurBandwidthIndex) {
-        return false;
-    } else if (bandwidthIndex > (size_t)mCurBandwidthIndex) {
-        return canSwitchUp();
-    } else {
-        return true;
-    }
+    // the policy has had its say on the buffer
+    return bandwidthIndex != (size_t)mCurBandwidthIndex;
 }
 
-void LiveSession::onCheckBandwidth(const sp<AMessage> &msg) {
+// Segment boundaries are where variants are switched: the estimate has just
+// taken in a whole segment, and a fetcher starting on another variant loses
+// nothing of the one being fetched.
+void LiveSession::onSegmentDownloaded(const sp<AMessage> &msg) {
+    size_t bytes;
+    int64_t downloadTimeUs;
+    CHECK(msg->findSize("bytes", &bytes));
+    CHECK(msg->findInt64("downloadTimeUs", &downloadTimeUs));
+
+    mAbrPolicy->onSegmentDownloaded(bytes, downloadTimeUs);
+
+    if (mDisconnectReplyID != 0 || mBandwidthItems.size() < 2) {
+        return;
+    }
+
     size_t bandwidthIndex = getBandwidthIndex();
     if (canSwitchBandwidthTo(bandwidthIndex)) {
         changeConfiguration(-1ll /* timeUs */, bandwidthIndex);
-    } else {
-        // Come back and check again 10 seconds later in case there is nothing to do now.
-        // If we DO change configuration, once that completes it'll schedule a new
-        // check bandwidth event with an incremented mCheckBandwidthGeneration.
-        msg->post(10000000ll);
     }
 }
 
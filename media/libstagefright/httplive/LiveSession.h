@@ -22,6 +22,8 @@
 
 #include <utils/String8.h>
 
+#include "AbrPolicy.h"
+
 namespace android {
 
 struct ABuffer;
@@ -96,13 +98,13 @@ protected:
 
 private:
     friend struct PlaylistFetcher;
+    friend struct SegmentPrefetcher;
 
     enum {
         kWhatConnect                    = 'conn',
         kWhatDisconnect                 = 'disc',
         kWhatSeek                       = 'seek',
         kWhatFetcherNotify              = 'notf',
-        kWhatCheckBandwidth             = 'bndw',
         kWhatChangeConfiguration        = 'chC0',
         kWhatChangeConfiguration2       = 'chC2',
         kWhatChangeConfiguration3       = 'chC3',
@@ -154,6 +156,10 @@ private:
 
     bool mInPreparationPhase;
     bool mBuffering[kMaxStreams];
+    // Whether a stream has played since the last discontinuity, for running
+    // out of data to count as a rebuffer. Player thread only, as mBuffering.
+    bool mPlaying[kMaxStreams];
+    bool mRebuffering;
 
     sp<HTTPBase> mHTTPDataSource;
     KeyedVector<String8, String8> mExtraHeaders;
@@ -163,6 +169,9 @@ private:
     Vector<BandwidthItem> mBandwidthItems;
     ssize_t mCurBandwidthIndex;
 
+    sp<AbrPolicy> mAbrPolicy;
+    AbrMetrics mAbrMetrics;
+
     sp<M3UParser> mPlaylist;
 
     KeyedVector<AString, FetcherInfo> mFetcherInfos;
@@ -187,7 +196,6 @@ private:
     // * a forced bandwidth switch termination in cancelSwitch on the live looper.
     Mutex mSwapMutex;
 
-    int32_t mCheckBandwidthGeneration;
     int32_t mSwitchGeneration;
     int32_t mSubtitleGeneration;
 
@@ -237,10 +245,24 @@ private:
             sp<DataSource> *source = NULL,
             String8 *actualUrl = NULL);
 
+    // Opens a file:// url as a FileSource, or connects httpDataSource to an
+    // http(s):// one for range_length bytes from range_offset, reading from 0
+    // either way. Callable from any thread.
+    status_t openSource(
+            const char *url, int64_t range_offset, int64_t range_length,
+            const sp<HTTPBase> &httpDataSource, sp<DataSource> *source);
+
+    // A connection of its own, for a SegmentPrefetcher.
+    sp<HTTPBase> makeHTTPDataSource();
+
+    // Given the playlist being refreshed, the segments both have are taken
+    // from it.
     sp<M3UParser> fetchPlaylist(
-            const char *url, uint8_t *curPlaylistHash, bool *unchanged);
+            const char *url, uint8_t *curPlaylistHash, bool *unchanged,
+            const sp<M3UParser> &previous = NULL);
 
     size_t getBandwidthIndex();
+    int64_t getBufferedDurationUs();
     int64_t latestMediaSegmentStartTimeUs();
 
     static int SortByBandwidth(const BandwidthItem *, const BandwidthItem *);
@@ -257,23 +279,19 @@ private:
     void onSwitchDown();
     void tryToFinishBandwidthSwitch();
 
-    void scheduleCheckBandwidthEvent();
-    void cancelCheckBandwidthEvent();
-
     // cancelBandwidthSwitch is atomic wrt swapPacketSource; call it to prevent packet sources
     // from being swapped out on stale discontinuities while manipulating
     // mPacketSources/mPacketSources2.
     void cancelBandwidthSwitch();
 
     bool canSwitchBandwidthTo(size_t bandwidthIndex);
-    void onCheckBandwidth(const sp<AMessage> &msg);
+    void onSegmentDownloaded(const sp<AMessage> &msg);
 
     void finishDisconnect();
 
     void postPrepared(status_t err);
 
     void swapPacketSource(StreamType stream);
-    bool canSwitchUp();
 
     DISALLOW_EVIL_CONSTRUCTORS(LiveSession);
 };
@@ -239,7 +239,8 @@ bool M3UParser::MediaGroup::getActiveURI(AString *uri) const {
 ////////////////////////////////////////////////////////////////////////////////
 
 M3UParser::M3UParser(
-        const char *baseURI, const void *data, size_t size)
+        const char *baseURI, const void *data, size_t size,
+        const sp<M3UParser> &previous)
     : mInitCheck(NO_INIT),
       mBaseURI(baseURI),
       mIsExtM3U(false),
@@ -248,7 +249,7 @@ M3UParser::M3UParser(
       mIsEvent(false),
       mDiscontinuitySeq(0),
       mSelectedIndex(-1) {
-    mInitCheck = parse(data, size);
+    mInitCheck = parse(data, size, previous);
 }
 
 M3UParser::~M3UParser() {
@@ -479,11 +480,47 @@ static bool MakeURL(const char *baseURL, const char *url, AString *out) {
     return true;
 }
 
-status_t M3UParser::parse(const void *_data, size_t size) {
+int32_t M3UParser::mediaSequence() const {
+    int32_t seq;
+    if (mMeta == NULL || !mMeta->findInt32("media-sequence", &seq)) {
+        seq = 0;
+    }
+    return seq;
+}
+
+// The item of the previous playlist with the sequence number of the next one
+// to be parsed, if it is a plain segment: an #EXTINF line its only tag.
+const M3UParser::Item *M3UParser::findPreviousItem(
+        const sp<M3UParser> &previous) const {
+    if (previous == NULL || !mIsExtM3U || mIsVariantPlaylist
+            || previous->mIsVariantPlaylist || !(mBaseURI == previous->mBaseURI)) {
+        return NULL;
+    }
+
+    int64_t index = (int64_t)mediaSequence() + mItems.size() - previous->mediaSequence();
+    if (index < 0 || index >= (int64_t)previous->mItems.size()) {
+        return NULL;
+    }
+
+    const Item *item = &previous->mItems.itemAt(index);
+    if (item->mMeta == NULL || item->mMeta->countEntries() != 1) {
+        return NULL;
+    }
+    return item;
+}
+
+status_t M3UParser::parse(
+        const void *_data, size_t size, const sp<M3UParser> &previous) {
     int32_t lineNo = 0;
 
     sp<AMessage> itemMeta;
 
+    // The #EXTINF line of a segment the previous playlist has, left unparsed
+    // until the URI shows whether the segment is the same.
+    const char *pendingInf = NULL;
+    size_t pendingInfLength = 0;
+    size_t numReused = 0;
+
     const char *data = (const char *)_data;
     size_t offset = 0;
     uint64_t segmentRangeOffset = 0;
@@ -493,20 +530,55 @@ status_t M3UParser::parse(const void *_data, size_t size) {
             ++offsetLF;
         }
 
-        AString line;
-        if (offsetLF > offset && data[offsetLF - 1] == '\r') {
-            line.setTo(&data[offset], offsetLF - offset - 1);
-        } else {
-            line.setTo(&data[offset], offsetLF - offset);
+        const char *lineStart = &data[offset];
+        size_t lineLength = offsetLF - offset;
+        if (lineLength > 0 && lineStart[lineLength - 1] == '\r') {
+            --lineLength;
         }
 
-        // ALOGI("#%s#", line.c_str());
+        if (lineLength == 0) {
+            offset = offsetLF + 1;
+            continue;
+        }
+
+        if (pendingInf == NULL && itemMeta == NULL && lineLength > 7
+                && !strncmp(lineStart, "#EXTINF", 7)
+                && findPreviousItem(previous) != NULL) {
+            pendingInf = lineStart;
+            pendingInfLength = lineLength;
 
-        if (line.empty()) {
             offset = offsetLF + 1;
+            ++lineNo;
             continue;
         }
 
+        if (pendingInf != NULL) {
+            const Item *item = findPreviousItem(previous);
+            if (lineStart[0] != '#' && item->mURI.size() >= lineLength
+                    && !memcmp(item->mURI.c_str() + item->mURI.size() - lineLength,
+                            lineStart, lineLength)) {
+                mItems.push(*item);
+                ++numReused;
+                pendingInf = NULL;
+
+                offset = offsetLF + 1;
+                ++lineNo;
+                continue;
+            }
+
+            // not the same segment after all, or more to it than a duration
+            status_t err = parseMetaDataDuration(
+                    AString(pendingInf, pendingInfLength), &itemMeta, "durationUs");
+            pendingInf = NULL;
+            if (err != OK) {
+                return err;
+            }
+        }
+
+        AString line(lineStart, lineLength);
+
+        // ALOGI("#%s#", line.c_str());
+
         if (lineNo == 0 && line == "#EXTM3U") {
             mIsExtM3U = true;
         }
@@ -608,6 +680,17 @@ status_t M3UParser::parse(const void *_data, size_t size) {
         ++lineNo;
     }
 
+    if (pendingInf != NULL) {
+        status_t err = parseMetaDataDuration(
+                AString(pendingInf, pendingInfLength), &itemMeta, "durationUs");
+        if (err != OK) {
+            return err;
+        }
+    }
+
+    ALOGV("%zu of %zu segments taken from the previous playlist",
+            numReused, mItems.size());
+
     return OK;
 }
 
@@ -26,7 +26,11 @@
 namespace android {
 
 struct M3UParser : public RefBase {
-    M3UParser(const char *baseURI, const void *data, size_t size);
+    // A refresh of a live playlist can be given the previous one, for the
+    // segments both have to be taken from it rather than parsed again.
+    M3UParser(
+            const char *baseURI, const void *data, size_t size,
+            const sp<M3UParser> &previous = NULL);
 
     status_t initCheck() const;
 
@@ -76,7 +80,10 @@ private:
     // Media groups keyed by group ID.
     KeyedVector<AString, sp<MediaGroup> > mMediaGroups;
 
-    status_t parse(const void *data, size_t size);
+    status_t parse(const void *data, size_t size, const sp<M3UParser> &previous);
+
+    int32_t mediaSequence() const;
+    const Item *findPreviousItem(const sp<M3UParser> &previous) const;
 
     static status_t parseMetaData(
             const AString &line, sp<AMessage> *meta, const char *key);
@@ -23,6 +23,7 @@
 #include "LiveDataSource.h"
 #include "LiveSession.h"
 #include "M3UParser.h"
+#include "SegmentPrefetcher.h"
 
 #include "include/avc_utils.h"
 #include "include/HTTPBase.h"
@@ -39,13 +40,21 @@
 #include <media/stagefright/MetaData.h>
 #include <media/stagefright/Utils.h>
 
+#include <cutils/properties.h>
+
 #include <ctype.h>
 #include <inttypes.h>
-#include <openssl/aes.h>
 #include <openssl/md5.h>
 
 namespace android {
 
+#define PROP_PREFETCH_SEGMENTS "media.httplive.prefetch"
+
+// Segments downloaded ahead of the one being parsed; each takes its size in
+// memory until it is.
+static const int32_t kDefaultNumPrefetchSegments = 2;
+static const int32_t kMaxNumPrefetchSegments = 8;
+
 // static
 const int64_t PlaylistFetcher::kMinBufferedDurationUs = 10000000ll;
 const int64_t PlaylistFetcher::kMaxMonitorDelayUs = 3000000ll;
@@ -61,6 +70,8 @@ PlaylistFetcher::PlaylistFetcher(
       mStartTimeUsNotify(notify->dup()),
       mSession(session),
       mURI(uri),
+      mPrefetcher(new SegmentPrefetcher(notify->dup(), session)),
+      mNumPrefetchSegments(kDefaultNumPrefetchSegments),
       mStreamTypeMask(0),
       mStartTimeUs(-1ll),
       mSegmentStartTimeUs(-1ll),
@@ -82,6 +93,16 @@ PlaylistFetcher::PlaylistFetcher(
     memset(mPlaylistHash, 0, sizeof(mPlaylistHash));
     mStartTimeUsNotify->setInt32("what", kWhatStartedAt);
     mStartTimeUsNotify->setInt32("streamMask", 0);
+
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get(PROP_PREFETCH_SEGMENTS, value, NULL)) {
+        mNumPrefetchSegments = atoi(value);
+        if (mNumPrefetchSegments < 0) {
+            mNumPrefetchSegments = 0;
+        } else if (mNumPrefetchSegments > kMaxNumPrefetchSegments) {
+            mNumPrefetchSegments = kMaxNumPrefetchSegments;
+        }
+    }
 }
 
 PlaylistFetcher::~PlaylistFetcher() {
@@ -182,32 +203,33 @@ int64_t PlaylistFetcher::delayUsToRefreshPlaylist() const {
     return delayUs > 0ll ? delayUs : 0ll;
 }
 
-status_t PlaylistFetcher::decryptBuffer(
-        size_t playlistIndex, const sp<ABuffer> &buffer,
-        bool first) {
+status_t PlaylistFetcher::getCipherInfo(
+        size_t playlistIndex, int32_t seqNumber, AString *method,
+        sp<ABuffer> *key, sp<ABuffer> *iv) {
+    key->clear();
+    iv->clear();
+
     sp<AMessage> itemMeta;
     bool found = false;
-    AString method;
 
     for (ssize_t i = playlistIndex; i >= 0; --i) {
         AString uri;
         CHECK(mPlaylist->itemAt(i, &uri, &itemMeta));
 
-        if (itemMeta->findString("cipher-method", &method)) {
+        if (itemMeta->findString("cipher-method", method)) {
             found = true;
             break;
         }
     }
 
     if (!found) {
-        method = "NONE";
+        method->setTo("NONE");
     }
-    buffer->meta()->setString("cipher-method", method.c_str());
 
-    if (method == "NONE") {
+    if (*method == "NONE") {
         return OK;
-    } else if (!(method == "AES-128")) {
-        ALOGE("Unsupported cipher method '%s'", method.c_str());
+    } else if (!(*method == "AES-128")) {
+        ALOGE("Unsupported cipher method '%s'", method->c_str());
         return ERROR_UNSUPPORTED;
     }
 
@@ -219,73 +241,56 @@ status_t PlaylistFetcher::decryptBuffer(
 
     ssize_t index = mAESKeyForURI.indexOfKey(keyURI);
 
-    sp<ABuffer> key;
     if (index >= 0) {
-        key = mAESKeyForURI.valueAt(index);
+        *key = mAESKeyForURI.valueAt(index);
     } else {
-        ssize_t err = mSession->fetchFile(keyURI.c_str(), &key);
+        ssize_t err = mSession->fetchFile(keyURI.c_str(), key);
 
         if (err < 0) {
             ALOGE("failed to fetch cipher key from '%s'.", keyURI.c_str());
+            key->clear();
             return ERROR_IO;
-        } else if (key->size() != 16) {
+        } else if ((*key)->size() != 16) {
             ALOGE("key file '%s' wasn't 16 bytes in size.", keyURI.c_str());
+            key->clear();
             return ERROR_MALFORMED;
         }
 
-        mAESKeyForURI.add(keyURI, key);
+        mAESKeyForURI.add(keyURI, *key);
     }
 
-    AES_KEY aes_key;
-    if (AES_set_decrypt_key(key->data(), 128, &aes_key) != 0) {
-        ALOGE("failed to set AES decryption key.");
-        return UNKNOWN_ERROR;
-    }
+    *iv = new ABuffer(16);
+    uint8_t *initVec = (*iv)->data();
 
-    size_t n = buffer->size();
-    if (!n) {
-        return OK;
-    }
-    CHECK(n % 16 == 0);
-
-    if (first) {
-        // If decrypting the first block in a file, read the iv from the manifest
-        // or derive the iv from the file's sequence number.
+    AString ivString;
+    if (itemMeta->findString("cipher-iv", &ivString)) {
+        if ((!ivString.startsWith("0x") && !ivString.startsWith("0X"))
+                || ivString.size() != 16 * 2 + 2) {
+            ALOGE("malformed cipher IV '%s'.", ivString.c_str());
+            return ERROR_MALFORMED;
+        }
 
-        AString iv;
-        if (itemMeta->findString("cipher-iv", &iv)) {
-            if ((!iv.startsWith("0x") && !iv.startsWith("0X"))
-                    || iv.size() != 16 * 2 + 2) {
-                ALOGE("malformed cipher IV '%s'.", iv.c_str());
+        memset(initVec, 0, 16);
+        for (size_t i = 0; i < 16; ++i) {
+            char c1 = tolower(ivString.c_str()[2 + 2 * i]);
+            char c2 = tolower(ivString.c_str()[3 + 2 * i]);
+            if (!isxdigit(c1) || !isxdigit(c2)) {
+                ALOGE("malformed cipher IV '%s'.", ivString.c_str());
                 return ERROR_MALFORMED;
             }
+            uint8_t nibble1 = isdigit(c1) ? c1 - '0' : c1 - 'a' + 10;
+            uint8_t nibble2 = isdigit(c2) ? c2 - '0' : c2 - 'a' + 10;
 
-            memset(mAESInitVec, 0, sizeof(mAESInitVec));
-            for (size_t i = 0; i < 16; ++i) {
-                char c1 = tolower(iv.c_str()[2 + 2 * i]);
-                char c2 = tolower(iv.c_str()[3 + 2 * i]);
-                if (!isxdigit(c1) || !isxdigit(c2)) {
-                    ALOGE("malformed cipher IV '%s'.", iv.c_str());
-                    return ERROR_MALFORMED;
-                }
-                uint8_t nibble1 = isdigit(c1) ? c1 - '0' : c1 - 'a' + 10;
-                uint8_t nibble2 = isdigit(c2) ? c2 - '0' : c2 - 'a' + 10;
-
-                mAESInitVec[i] = nibble1 << 4 | nibble2;
-            }
-        } else {
-            memset(mAESInitVec, 0, sizeof(mAESInitVec));
-            mAESInitVec[15] = mSeqNumber & 0xff;
-            mAESInitVec[14] = (mSeqNumber >> 8) & 0xff;
-            mAESInitVec[13] = (mSeqNumber >> 16) & 0xff;
-            mAESInitVec[12] = (mSeqNumber >> 24) & 0xff;
+            initVec[i] = nibble1 << 4 | nibble2;
         }
+    } else {
+        memset(initVec, 0, 16);
+        initVec[15] = seqNumber & 0xff;
+        initVec[14] = (seqNumber >> 8) & 0xff;
+        initVec[13] = (seqNumber >> 16) & 0xff;
+        initVec[12] = (seqNumber >> 24) & 0xff;
     }
 
-    AES_cbc_encrypt(
-            buffer->data(), buffer->data(), buffer->size(),
-            &aes_key, mAESInitVec, AES_DECRYPT);
-
     return OK;
 }
 
@@ -514,6 +519,7 @@ void PlaylistFetcher::onPause() {
 
 void PlaylistFetcher::onStop(const sp<AMessage> &msg) {
     cancelMonitorQueue();
+    mPrefetcher->reset();
 
     int32_t clear;
     CHECK(msg->findInt32("clear", &clear));
@@ -694,7 +700,7 @@ status_t PlaylistFetcher::refreshPlaylist() {
     if (delayUsToRefreshPlaylist() <= 0) {
         bool unchanged;
         sp<M3UParser> playlist = mSession->fetchPlaylist(
-                mURI.c_str(), mPlaylistHash, &unchanged);
+                mURI.c_str(), mPlaylistHash, &unchanged, mPlaylist);
 
         if (playlist == NULL) {
             if (unchanged) {
@@ -866,19 +872,49 @@ void PlaylistFetcher::onDownloadNext() {
 
     ALOGI("fetching '%s'", uri.c_str());
 
-    sp<DataSource> source;
     sp<ABuffer> buffer, tsBuffer;
-    // decrypt a junk buffer to prefetch key; since a session uses only one http connection,
-    // this avoids interleaved connections to the key and segment file.
-    {
-        sp<ABuffer> junk = new ABuffer(16);
-        junk->setRange(0, 16);
-        status_t err = decryptBuffer(mSeqNumber - firstSeqNumberInPlaylist, junk,
-                true /* first */);
-        if (err != OK) {
-            notifyError(err);
-            return;
+    // fetch the key first, on the session's http connection, which is then
+    // free for the next playlist refresh while the segment downloads.
+    AString method;
+    sp<ABuffer> key, iv;
+    status_t err = getCipherInfo(
+            mSeqNumber - firstSeqNumberInPlaylist, mSeqNumber, &method, &key, &iv);
+    if (err != OK) {
+        notifyError(err);
+        return;
+    }
+
+    // The segment downloads on the prefetcher's connection, the next ones
+    // after it, and is decrypted there and parsed here block by block as it
+    // arrives.
+    sp<DataSource> source = mPrefetcher->fetchSegment(
+            mSeqNumber, uri, range_offset, range_length, key, iv);
+    for (int32_t i = 1; i <= mNumPrefetchSegments
+            && mSeqNumber + i <= lastSeqNumberInPlaylist; ++i) {
+        AString nextURI;
+        sp<AMessage> nextItemMeta;
+        CHECK(mPlaylist->itemAt(
+                    mSeqNumber + i - firstSeqNumberInPlaylist,
+                    &nextURI,
+                    &nextItemMeta));
+
+        int64_t nextRangeOffset, nextRangeLength;
+        if (!nextItemMeta->findInt64("range-offset", &nextRangeOffset)
+                || !nextItemMeta->findInt64("range-length", &nextRangeLength)) {
+            nextRangeOffset = 0;
+            nextRangeLength = -1;
         }
+
+        AString nextMethod;
+        sp<ABuffer> nextKey, nextIV;
+        if (getCipherInfo(mSeqNumber + i - firstSeqNumberInPlaylist, mSeqNumber + i,
+                &nextMethod, &nextKey, &nextIV) != OK) {
+            // reported once the segment is the one fetched
+            break;
+        }
+        mPrefetcher->prefetchSegment(
+                mSeqNumber + i, nextURI, nextRangeOffset, nextRangeLength,
+                nextKey, nextIV);
     }
 
     // block-wise download
@@ -897,21 +933,6 @@ void PlaylistFetcher::onDownloadNext() {
 
         CHECK(buffer != NULL);
 
-        size_t size = buffer->size();
-        // Set decryption range.
-        buffer->setRange(size - bytesRead, bytesRead);
-        status_t err = decryptBuffer(mSeqNumber - firstSeqNumberInPlaylist, buffer,
-                buffer->offset() == 0 /* first */);
-        // Unset decryption range.
-        buffer->setRange(0, size);
-
-        if (err != OK) {
-            ALOGE("decryptBuffer failed w/ error %d", err);
-
-            notifyError(err);
-            return;
-        }
-
         if (startup || discontinuity) {
             // Signal discontinuity.
 
@@ -967,6 +988,8 @@ void PlaylistFetcher::onDownloadNext() {
 
     } while (bytesRead != 0);
 
+    buffer->meta()->setString("cipher-method", method.c_str());
+
     if (bufferStartsWithTsSyncByte(buffer)) {
         // If we still don't see a stream after fetching a full ts segment mark it as
         // nonexistent.
@@ -1001,7 +1024,7 @@ void PlaylistFetcher::onDownloadNext() {
         return;
     }
 
-    status_t err = OK;
+    err = OK;
     if (tsBuffer != NULL) {
         AString method;
         CHECK(buffer->meta()->findString("cipher-method", &method));
@@ -1172,16 +1195,14 @@ status_t PlaylistFetcher::extractAndQueueAccessUnitsFromTs(const sp<ABuffer> &bu
         mFirstPTSValid = false;
     }
 
-    size_t offset = 0;
-    while (offset + 188 <= buffer->size()) {
-        status_t err = mTSParser->feedTSPacket(buffer->data() + offset, 188);
-
-        if (err != OK) {
-            return err;
-        }
+    size_t offset;
+    status_t parseErr =
+        mTSParser->feedTSPackets(buffer->data(), buffer->size(), &offset);
 
-        offset += 188;
+    if (parseErr != OK) {
+        return parseErr;
     }
+
     // setRange to indicate consumed bytes.
     buffer->setRange(buffer->offset() + offset, buffer->size() - offset);
 
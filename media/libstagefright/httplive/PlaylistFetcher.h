@@ -31,6 +31,7 @@ struct DataSource;
 struct HTTPBase;
 struct LiveDataSource;
 struct M3UParser;
+struct SegmentPrefetcher;
 struct String8;
 
 struct PlaylistFetcher : public AHandler {
@@ -46,6 +47,7 @@ struct PlaylistFetcher : public AHandler {
         kWhatPrepared,
         kWhatPreparationFailed,
         kWhatStartedAt,
+        kWhatSegmentDownloaded,
     };
 
     PlaylistFetcher(
@@ -125,6 +127,10 @@ private:
 
     KeyedVector<AString, sp<ABuffer> > mAESKeyForURI;
 
+    // downloads the segments, and the next mNumPrefetchSegments ones ahead
+    sp<SegmentPrefetcher> mPrefetcher;
+    int32_t mNumPrefetchSegments;
+
     int64_t mLastPlaylistFetchTimeUs;
     sp<M3UParser> mPlaylist;
     int32_t mSeqNumber;
@@ -155,22 +161,13 @@ private:
     int64_t mAbsoluteTimeAnchorUs;
     sp<AnotherPacketSource> mVideoBuffer;
 
-    // Stores the initialization vector to decrypt the next block of cipher text, which can
-    // either be derived from the sequence number, read from the manifest, or copied from
-    // the last block of cipher text (cipher-block chaining).
-    unsigned char mAESInitVec[16];
-
-    // Set first to true if decrypting the first segment of a playlist segment. When
-    // first is true, reset the initialization vector based on the available
-    // information in the manifest; otherwise, use the initialization vector as
-    // updated by the last call to AES_cbc_encrypt.
-    //
-    // For the input to decrypt correctly, decryptBuffer must be called on
-    // consecutive byte ranges on block boundaries, e.g. 0..15, 16..47, 48..63,
-    // and so on.
-    status_t decryptBuffer(
-            size_t playlistIndex, const sp<ABuffer> &buffer,
-            bool first = true);
+    // The cipher method of the segment at playlistIndex, and for AES-128 the
+    // key, fetched unless it is cached, and the initialization vector, either
+    // read from the manifest or derived from seqNumber. The segment is then
+    // decrypted by mPrefetcher as it downloads.
+    status_t getCipherInfo(
+            size_t playlistIndex, int32_t seqNumber, AString *method,
+            sp<ABuffer> *key, sp<ABuffer> *iv);
     status_t checkDecryptPadding(const sp<ABuffer> &buffer);
 
     void postMonitorQueue(int64_t delayUs = 0, int64_t minDelayUs = 0);
@@ -0,0 +1,340 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "SegmentPrefetcher"
+#include <utils/Log.h>
+
+#include "SegmentPrefetcher.h"
+
+#include "LiveDataSource.h"
+#include "LiveSession.h"
+#include "PlaylistFetcher.h"
+
+#include "include/HTTPBase.h"
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/MediaErrors.h>
+
+namespace android {
+
+// Read from the network at a time, and queued to the segment's source.
+static const size_t kBlockSize = 65536;
+
+// A LiveDataSource that ends the way LiveSession::fetchFile expects, with 0.
+struct SegmentSource : public LiveDataSource {
+    SegmentSource() {}
+
+    virtual ssize_t readAt(off64_t offset, void *data, size_t size) {
+        ssize_t n = LiveDataSource::readAt(offset, data, size);
+        return n == ERROR_END_OF_STREAM ? 0 : n;
+    }
+
+private:
+    DISALLOW_EVIL_CONSTRUCTORS(SegmentSource);
+};
+
+SegmentPrefetcher::SegmentPrefetcher(
+        const sp<AMessage> &notify, const sp<LiveSession> &session)
+    : mNotify(notify),
+      mSession(session),
+      mReflector(new AHandlerReflector<SegmentPrefetcher>(this)),
+      mLooper(new ALooper),
+      mHTTPDataSource(session->makeHTTPDataSource()),
+      mLastSeqNumber(-1),
+      mFetching(false),
+      mOffset(0ll),
+      mStartUs(-1ll),
+      mCipher(EVP_CIPHER_CTX_new()),
+      mReadBuffer(new ABuffer(kBlockSize)),
+      mDecryptTimeUs(0ll),
+      mTotalDecryptTimeUs(0ll),
+      mTotalDecryptedBytes(0ll) {
+    mLooper->setName("SegmentPrefetcher");
+    mLooper->registerHandler(mReflector);
+
+    // IMediaHTTPConnection may call back into JAVA, see NuCachedSource2.
+    mLooper->start(false /* runOnCallingThread */, true /* canCallJava */);
+}
+
+SegmentPrefetcher::~SegmentPrefetcher() {
+    mLooper->stop();
+    mLooper->unregisterHandler(mReflector->id());
+
+    mHTTPDataSource->disconnect();
+
+    if (mTotalDecryptedBytes > 0) {
+        ALOGI("decrypted %lld bytes in %.2f ms",
+                (long long)mTotalDecryptedBytes, mTotalDecryptTimeUs / 1E3);
+    }
+    EVP_CIPHER_CTX_free(mCipher);
+}
+
+sp<DataSource> SegmentPrefetcher::fetchSegment(
+        int32_t seqNumber, const AString &uri,
+        int64_t rangeOffset, int64_t rangeLength,
+        const sp<ABuffer> &key, const sp<ABuffer> &iv) {
+    Mutex::Autolock autoLock(mLock);
+
+    // Done with the segment handed out last, whether it was read to the end
+    // or not, and with those prefetched before this one.
+    List<sp<Segment> >::iterator it = mSegments.begin();
+    while (it != mSegments.end()
+            && ((*it)->mHandedOut || (*it)->mSeqNumber < seqNumber)) {
+        drop_l(*it);
+        it = mSegments.erase(it);
+    }
+
+    if (it != mSegments.end()) {
+        sp<Segment> segment = *it;
+        if (segment->mSeqNumber == seqNumber && segment->mURI == uri
+                && segment->mRangeOffset == rangeOffset
+                && segment->mRangeLength == rangeLength) {
+            ALOGV("segment %d %s", seqNumber,
+                    segment->mDone ? "prefetched" : "being prefetched");
+            segment->mHandedOut = true;
+            if (segment->mDone) {
+                mSegments.erase(it);
+            }
+            return segment->mSource;
+        }
+
+        // the playlist changed under the segments prefetched
+        ALOGV("dropping the %zu segments prefetched", mSegments.size());
+        for (; it != mSegments.end(); ++it) {
+            drop_l(*it);
+        }
+        mSegments.clear();
+    }
+
+    sp<Segment> segment = queueSegment_l(
+            seqNumber, uri, rangeOffset, rangeLength, key, iv);
+    segment->mHandedOut = true;
+    return segment->mSource;
+}
+
+void SegmentPrefetcher::prefetchSegment(
+        int32_t seqNumber, const AString &uri,
+        int64_t rangeOffset, int64_t rangeLength,
+        const sp<ABuffer> &key, const sp<ABuffer> &iv) {
+    Mutex::Autolock autoLock(mLock);
+
+    if (mLastSeqNumber >= 0 && seqNumber == mLastSeqNumber + 1) {
+        queueSegment_l(seqNumber, uri, rangeOffset, rangeLength, key, iv);
+    }
+}
+
+void SegmentPrefetcher::reset() {
+    Mutex::Autolock autoLock(mLock);
+
+    for (List<sp<Segment> >::iterator it = mSegments.begin();
+            it != mSegments.end(); ++it) {
+        drop_l(*it);
+    }
+    mSegments.clear();
+    mLastSeqNumber = -1;
+}
+
+sp<SegmentPrefetcher::Segment> SegmentPrefetcher::queueSegment_l(
+        int32_t seqNumber, const AString &uri,
+        int64_t rangeOffset, int64_t rangeLength,
+        const sp<ABuffer> &key, const sp<ABuffer> &iv) {
+    sp<Segment> segment = new Segment;
+    segment->mSeqNumber = seqNumber;
+    segment->mURI = uri;
+    segment->mRangeOffset = rangeOffset;
+    segment->mRangeLength = rangeLength;
+    segment->mKey = key;
+    segment->mIV = iv;
+    segment->mSource = new SegmentSource;
+    segment->mHandedOut = false;
+    segment->mStarted = false;
+    segment->mDone = false;
+    segment->mDropped = false;
+
+    mSegments.push_back(segment);
+    mLastSeqNumber = seqNumber;
+
+    if (!mFetching) {
+        mFetching = true;
+        (new AMessage(kWhatFetchBlock, mReflector->id()))->post();
+    }
+    return segment;
+}
+
+void SegmentPrefetcher::drop_l(const sp<Segment> &segment) {
+    segment->mDropped = true;
+    segment->mSource->queueEOS(-ECANCELED);
+}
+
+void SegmentPrefetcher::onMessageReceived(const sp<AMessage> &msg) {
+    switch (msg->what()) {
+        case kWhatFetchBlock:
+        {
+            onFetchBlock();
+            break;
+        }
+
+        default:
+            TRESPASS();
+    }
+}
+
+void SegmentPrefetcher::onFetchBlock() {
+    {
+        Mutex::Autolock autoLock(mLock);
+
+        if (mSegment != NULL && mSegment->mDropped) {
+            ALOGV("segment %d dropped at %lld bytes",
+                    mSegment->mSeqNumber, (long long)mOffset);
+            mSegment.clear();
+            mSource.clear();
+        }
+
+        if (mSegment == NULL) {
+            List<sp<Segment> >::iterator it = mSegments.begin();
+            while (it != mSegments.end() && (*it)->mStarted) {
+                ++it;
+            }
+            if (it == mSegments.end()) {
+                mFetching = false;
+                return;
+            }
+            mSegment = *it;
+            mSegment->mStarted = true;
+        }
+    }
+
+    if (mSource == NULL) {
+        ALOGV("fetching segment %d", mSegment->mSeqNumber);
+
+        mOffset = 0ll;
+        mStartUs = ALooper::GetNowUs();
+        mDecryptTimeUs = 0ll;
+        status_t err = mSession->openSource(
+                mSegment->mURI.c_str(), mSegment->mRangeOffset,
+                mSegment->mRangeLength, mHTTPDataSource, &mSource);
+        if (err == OK && mSegment->mKey != NULL) {
+            // no padding removal, PlaylistFetcher checks it
+            if (!EVP_DecryptInit_ex(mCipher, EVP_aes_128_cbc(), NULL,
+                        mSegment->mKey->data(), mSegment->mIV->data())
+                    || !EVP_CIPHER_CTX_set_padding(mCipher, 0)) {
+                ALOGE("failed to set AES decryption key.");
+                err = UNKNOWN_ERROR;
+            }
+        }
+        if (err != OK) {
+            finishSegment(err);
+        }
+    }
+
+    if (mSource != NULL) {
+        size_t size = kBlockSize;
+        if (mSegment->mRangeLength >= 0
+                && mSegment->mRangeLength - mOffset < (int64_t)size) {
+            size = mSegment->mRangeLength - mOffset;
+        }
+
+        ssize_t n = size > 0 ? mSource->readAt(mOffset, mReadBuffer->data(), size) : 0;
+        if (n < 0) {
+            finishSegment(n);
+        } else if (n == 0) {
+            finishSegment(OK);
+        } else {
+            mOffset += n;
+
+            sp<ABuffer> buffer;
+            if (mSegment->mKey == NULL) {
+                buffer = new ABuffer(n);
+                memcpy(buffer->data(), mReadBuffer->data(), n);
+            } else {
+                // up to a block held back from the last read, as many
+                // whole blocks as there are
+                int64_t startUs = ALooper::GetNowUs();
+                int outSize = 0;
+                buffer = new ABuffer(n + EVP_MAX_BLOCK_LENGTH);
+                if (!EVP_DecryptUpdate(mCipher, buffer->data(), &outSize,
+                            mReadBuffer->data(), n)) {
+                    outSize = -1;
+                }
+                mDecryptTimeUs += ALooper::GetNowUs() - startUs;
+
+                if (outSize < 0) {
+                    finishSegment(ERROR_MALFORMED);
+                    buffer.clear();
+                } else {
+                    buffer->setRange(0, outSize);
+                }
+            }
+
+            if (buffer != NULL && buffer->size() > 0) {
+                mSegment->mSource->queueBuffer(buffer);
+            }
+        }
+    }
+
+    (new AMessage(kWhatFetchBlock, mReflector->id()))->post();
+}
+
+void SegmentPrefetcher::finishSegment(status_t err) {
+    if (err == OK && mSegment->mKey != NULL) {
+        int outSize = 0;
+        uint8_t block[EVP_MAX_BLOCK_LENGTH];
+        if (!EVP_DecryptFinal_ex(mCipher, block, &outSize)) {
+            ALOGE("segment %d is not a whole number of AES blocks.",
+                    mSegment->mSeqNumber);
+            err = ERROR_MALFORMED;
+        }
+
+        ALOGV("segment %d: %lld bytes decrypted in %.2f ms",
+                mSegment->mSeqNumber, (long long)mOffset, mDecryptTimeUs / 1E3);
+        mTotalDecryptTimeUs += mDecryptTimeUs;
+        mTotalDecryptedBytes += mOffset;
+    }
+
+    if (err == OK) {
+        mSegment->mSource->queueEOS(ERROR_END_OF_STREAM);
+
+        sp<AMessage> notify = mNotify->dup();
+        notify->setInt32("what", PlaylistFetcher::kWhatSegmentDownloaded);
+        notify->setSize("bytes", (size_t)mOffset);
+        notify->setInt64("downloadTimeUs", ALooper::GetNowUs() - mStartUs);
+        notify->post();
+    } else {
+        ALOGE("failed to fetch segment at url '%s'", mSegment->mURI.c_str());
+        mSegment->mSource->queueEOS(err);
+    }
+
+    Mutex::Autolock autoLock(mLock);
+
+    mSegment->mDone = true;
+    if (mSegment->mHandedOut) {
+        for (List<sp<Segment> >::iterator it = mSegments.begin();
+                it != mSegments.end(); ++it) {
+            if (*it == mSegment) {
+                mSegments.erase(it);
+                break;
+            }
+        }
+    }
+    mSegment.clear();
+    mSource.clear();
+}
+
+}  // namespace android
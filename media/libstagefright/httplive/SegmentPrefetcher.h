@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SEGMENT_PREFETCHER_H_
+
+#define SEGMENT_PREFETCHER_H_
+
+#include <media/stagefright/foundation/ABase.h>
+#include <media/stagefright/foundation/AHandlerReflector.h>
+#include <media/stagefright/foundation/AString.h>
+#include <utils/List.h>
+#include <utils/RefBase.h>
+#include <utils/threads.h>
+
+#include <openssl/evp.h>
+
+namespace android {
+
+struct ABuffer;
+struct ALooper;
+struct AMessage;
+struct DataSource;
+struct HTTPBase;
+struct LiveDataSource;
+struct LiveSession;
+
+// Downloads the media segments of a PlaylistFetcher on a looper and an HTTP
+// connection of its own, the one being fetched and then those queued after
+// it, one after another over the same connection. PlaylistFetcher reads a
+// segment from the DataSource returned by fetchSegment while it is being
+// downloaded, and parses the segments prefetched with prefetchSegment
+// without waiting on the network. The LiveSession looper that all fetchers
+// share is no longer blocked by their downloads either, save when a fetcher
+// has caught up with one.
+//
+// AES-128 segments are decrypted here too, as they download, through EVP,
+// which has OpenSSL use the CPU's AES instructions where it has them. The
+// time spent decrypting is logged for every segment.
+//
+// Every segment downloaded is reported to the session, as
+// PlaylistFetcher::kWhatSegmentDownloaded on notify.
+struct SegmentPrefetcher : public RefBase {
+    SegmentPrefetcher(const sp<AMessage> &notify, const sp<LiveSession> &session);
+
+    // The source to read segment seqNumber from, fetched unless it had been
+    // prefetched; it returns 0 at the end of the segment. The segments
+    // prefetched before it are dropped, and all of them unless seqNumber is
+    // the first one left. The segment is decrypted, its padding left in,
+    // given the AES-128 key and initialization vector, NULL if it is clear.
+    sp<DataSource> fetchSegment(
+            int32_t seqNumber, const AString &uri,
+            int64_t rangeOffset, int64_t rangeLength,
+            const sp<ABuffer> &key, const sp<ABuffer> &iv);
+
+    // Queues segment seqNumber after the last one fetched or prefetched,
+    // unless it is queued already or doesn't follow that one.
+    void prefetchSegment(
+            int32_t seqNumber, const AString &uri,
+            int64_t rangeOffset, int64_t rangeLength,
+            const sp<ABuffer> &key, const sp<ABuffer> &iv);
+
+    // Drops every segment, one being read included.
+    void reset();
+
+protected:
+    virtual ~SegmentPrefetcher();
+
+private:
+    friend struct AHandlerReflector<SegmentPrefetcher>;
+
+    enum {
+        kWhatFetchBlock = 'fblk',
+    };
+
+    struct Segment : public RefBase {
+        int32_t mSeqNumber;
+        AString mURI;
+        int64_t mRangeOffset;
+        int64_t mRangeLength;
+        sp<ABuffer> mKey;
+        sp<ABuffer> mIV;
+        sp<LiveDataSource> mSource;
+        bool mHandedOut;
+        bool mStarted;
+        bool mDone;
+        bool mDropped;
+    };
+
+    sp<AMessage> mNotify;
+    sp<LiveSession> mSession;
+    sp<AHandlerReflector<SegmentPrefetcher> > mReflector;
+    sp<ALooper> mLooper;
+    sp<HTTPBase> mHTTPDataSource;
+
+    Mutex mLock;
+    // in download order, until both downloaded and handed out
+    List<sp<Segment> > mSegments;
+    int32_t mLastSeqNumber;
+    bool mFetching;
+
+    // on the looper only
+    sp<Segment> mSegment;
+    sp<DataSource> mSource;
+    int64_t mOffset;
+    int64_t mStartUs;
+    EVP_CIPHER_CTX *mCipher;
+    sp<ABuffer> mReadBuffer;
+    int64_t mDecryptTimeUs;
+    int64_t mTotalDecryptTimeUs;
+    int64_t mTotalDecryptedBytes;
+
+    sp<Segment> queueSegment_l(
+            int32_t seqNumber, const AString &uri,
+            int64_t rangeOffset, int64_t rangeLength,
+            const sp<ABuffer> &key, const sp<ABuffer> &iv);
+    void drop_l(const sp<Segment> &segment);
+    void finishSegment(status_t err);
+
+    void onMessageReceived(const sp<AMessage> &msg);
+    void onFetchBlock();
+
+    DISALLOW_EVIL_CONSTRUCTORS(SegmentPrefetcher);
+};
+
+}  // namespace android
+
+#endif  // SEGMENT_PREFETCHER_H_
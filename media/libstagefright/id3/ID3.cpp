@@ -30,6 +30,10 @@ namespace android {
 
 static const size_t kMaxMetadataSize = 3 * 1024 * 1024;
 
+// Of the reads of tags parsed from a DataSource, but for the data of larger
+// frames.
+static const size_t kWindowSize = 4096;
+
 struct MemorySource : public DataSource {
     MemorySource(const uint8_t *data, size_t size)
         : mData(data),
@@ -60,10 +64,15 @@ ID3::ID3(const sp<DataSource> &source, bool ignoreV1, off64_t offset)
     : mIsValid(false),
       mData(NULL),
       mSize(0),
+      mDataOffset(0),
       mFirstFrameOffset(0),
       mVersion(ID3_UNKNOWN),
+      mWindow(NULL),
+      mWindowOffset(0),
+      mWindowSize(0),
+      mAlbumArt(NULL),
       mRawSize(0) {
-    mIsValid = parseV2(source, offset);
+    mIsValid = parseV2(source, offset, false /* inMemory */);
 
     if (!mIsValid && !ignoreV1) {
         mIsValid = parseV1(source);
@@ -74,12 +83,17 @@ ID3::ID3(const uint8_t *data, size_t size, bool ignoreV1)
     : mIsValid(false),
       mData(NULL),
       mSize(0),
+      mDataOffset(0),
       mFirstFrameOffset(0),
       mVersion(ID3_UNKNOWN),
+      mWindow(NULL),
+      mWindowOffset(0),
+      mWindowSize(0),
+      mAlbumArt(NULL),
       mRawSize(0) {
     sp<MemorySource> source = new MemorySource(data, size);
 
-    mIsValid = parseV2(source, 0);
+    mIsValid = parseV2(source, 0, true /* inMemory */);
 
     if (!mIsValid && !ignoreV1) {
         mIsValid = parseV1(source);
@@ -91,6 +105,12 @@ ID3::~ID3() {
         free(mData);
         mData = NULL;
     }
+
+    free(mWindow);
+    mWindow = NULL;
+
+    free(mAlbumArt);
+    mAlbumArt = NULL;
 }
 
 bool ID3::isValid() const {
@@ -115,7 +135,7 @@ bool ID3::ParseSyncsafeInteger(const uint8_t encoded[4], size_t *x) {
     return true;
 }
 
-bool ID3::parseV2(const sp<DataSource> &source, off64_t offset) {
+bool ID3::parseV2(const sp<DataSource> &source, off64_t offset, bool inMemory) {
 struct id3_header {
     char id[3];
     uint8_t version_major;
@@ -176,65 +196,53 @@ struct id3_header {
         return false;
     }
 
-    mData = (uint8_t *)malloc(size);
-
-    if (mData == NULL) {
-        return false;
-    }
-
     mSize = size;
     mRawSize = mSize + sizeof(header);
 
-    if (source->readAt(offset + sizeof(header), mData, mSize) != (ssize_t)mSize) {
-        free(mData);
-        mData = NULL;
-
-        return false;
+    // The frame headers of a tag unsynchronized as a whole are too, and only
+    // removing the unsynchronization of all of it tells where they are.
+    // ID3v2.4 unsynchronizes frame by frame.
+    if (header.version_major != 4 && (header.flags & 0x80)) {
+        inMemory = true;
     }
 
-    if (header.version_major == 4) {
-        void *copy = malloc(size);
-        memcpy(copy, mData, size);
-
-        bool success = removeUnsynchronizationV2_4(false /* iTunesHack */);
-        if (!success) {
-            memcpy(mData, copy, size);
-            mSize = size;
-
-            success = removeUnsynchronizationV2_4(true /* iTunesHack */);
+    if (inMemory) {
+        mData = (uint8_t *)malloc(size);
 
-            if (success) {
-                ALOGV("Had to apply the iTunes hack to parse this ID3 tag");
-            }
+        if (mData == NULL) {
+            return false;
         }
 
-        free(copy);
-        copy = NULL;
-
-        if (!success) {
+        if (source->readAt(offset + sizeof(header), mData, mSize) != (ssize_t)mSize) {
             free(mData);
             mData = NULL;
 
             return false;
         }
-    } else if (header.flags & 0x80) {
-        ALOGV("removing unsynchronization");
 
-        removeUnsynchronization();
+        if (header.version_major != 4 && (header.flags & 0x80)) {
+            ALOGV("removing unsynchronization");
+
+            removeUnsynchronization();
+        }
+    } else {
+        mSource = source;
+        mDataOffset = offset + sizeof(header);
     }
 
     mFirstFrameOffset = 0;
     if (header.version_major == 3 && (header.flags & 0x40)) {
         // Version 2.3 has an optional extended header.
 
-        if (mSize < 4) {
+        uint8_t extendedHeader[10];
+        if (!readTag(0, extendedHeader, 4)) {
             free(mData);
             mData = NULL;
 
             return false;
         }
 
-        size_t extendedHeaderSize = U32_AT(&mData[0]) + 4;
+        size_t extendedHeaderSize = U32_AT(&extendedHeader[0]) + 4;
 
         if (extendedHeaderSize > mSize) {
             free(mData);
@@ -247,10 +255,18 @@ struct id3_header {
 
         uint16_t extendedFlags = 0;
         if (extendedHeaderSize >= 6) {
-            extendedFlags = U16_AT(&mData[4]);
+            if (!readTag(4, &extendedHeader[4],
+                        extendedHeaderSize >= 10 ? 6 : 2)) {
+                free(mData);
+                mData = NULL;
+
+                return false;
+            }
+
+            extendedFlags = U16_AT(&extendedHeader[4]);
 
             if (extendedHeaderSize >= 10) {
-                size_t paddingSize = U32_AT(&mData[6]);
+                size_t paddingSize = U32_AT(&extendedHeader[6]);
 
                 if (mFirstFrameOffset + paddingSize > mSize) {
                     free(mData);
@@ -270,7 +286,8 @@ struct id3_header {
         // Version 2.4 has an optional extended header, that's different
         // from Version 2.3's...
 
-        if (mSize < 4) {
+        uint8_t extendedHeader[4];
+        if (!readTag(0, extendedHeader, 4)) {
             free(mData);
             mData = NULL;
 
@@ -278,7 +295,7 @@ struct id3_header {
         }
 
         size_t ext_size;
-        if (!ParseSyncsafeInteger(mData, &ext_size)) {
+        if (!ParseSyncsafeInteger(extendedHeader, &ext_size)) {
             free(mData);
             mData = NULL;
 
@@ -295,15 +312,35 @@ struct id3_header {
         mFirstFrameOffset = ext_size;
     }
 
+    Version version;
     if (header.version_major == 2) {
-        mVersion = ID3_V2_2;
+        version = ID3_V2_2;
     } else if (header.version_major == 3) {
-        mVersion = ID3_V2_3;
+        version = ID3_V2_3;
     } else {
         CHECK_EQ(header.version_major, 4);
-        mVersion = ID3_V2_4;
+        version = ID3_V2_4;
+    }
+
+    bool success = indexFrames(version, false /* iTunesHack */);
+    if (!success && version == ID3_V2_4) {
+        success = indexFrames(version, true /* iTunesHack */);
+
+        if (success) {
+            ALOGV("Had to apply the iTunes hack to parse this ID3 tag");
+        }
+    }
+
+    if (!success) {
+        free(mData);
+        mData = NULL;
+        mFrames.clear();
+
+        return false;
     }
 
+    mVersion = version;
+
     return true;
 }
 
@@ -316,78 +353,94 @@ void ID3::removeUnsynchronization() {
     }
 }
 
-static void WriteSyncsafeInteger(uint8_t *dst, size_t x) {
-    for (size_t i = 0; i < 4; ++i) {
-        dst[3 - i] = (x & 0x7f);
-        x >>= 7;
-    }
-}
+// Fails on the frames of an ID3v2.4 tag that pass its end or have a size that
+// is not syncsafe, sizes iTunes is known to write as plain integers.
+bool ID3::indexFrames(Version version, bool iTunesHack) {
+    mFrames.clear();
+
+    size_t headerSize = (version == ID3_V2_2) ? 6 : 10;
 
-bool ID3::removeUnsynchronizationV2_4(bool iTunesHack) {
-    size_t oldSize = mSize;
+    size_t offset = mFirstFrameOffset;
+    while (offset + headerSize <= mSize) {
+        uint8_t header[10];
+        if (!readTag(offset, header, headerSize)) {
+            return false;
+        }
 
-    size_t offset = 0;
-    while (offset + 10 <= mSize) {
-        if (!memcmp(&mData[offset], "\0\0\0\0", 4)) {
+        if (!memcmp(header, "\0\0\0\0", version == ID3_V2_2 ? 3 : 4)) {
             break;
         }
 
+        Frame frame;
         size_t dataSize;
-        if (iTunesHack) {
-            dataSize = U32_AT(&mData[offset + 4]);
-        } else if (!ParseSyncsafeInteger(&mData[offset + 4], &dataSize)) {
-            return false;
+        if (version == ID3_V2_2) {
+            memcpy(frame.mID, header, 3);
+            frame.mID[3] = '\0';
+            frame.mFlags = 0;
+
+            dataSize = (header[3] << 16) | (header[4] << 8) | header[5];
+        } else {
+            memcpy(frame.mID, header, 4);
+            frame.mID[4] = '\0';
+            frame.mFlags = U16_AT(&header[8]);
+
+            if (version == ID3_V2_3 || iTunesHack) {
+                dataSize = U32_AT(&header[4]);
+            } else if (!ParseSyncsafeInteger(&header[4], &dataSize)) {
+                return false;
+            }
         }
 
-        if (offset + dataSize + 10 > mSize) {
-            return false;
+        if (dataSize > mSize - offset - headerSize) {
+            ALOGV("partial frame at offset %zu (size = %zu, bytes-remaining = %zu)",
+                offset, dataSize, mSize - offset - headerSize);
+
+            return version != ID3_V2_4;
         }
 
-        uint16_t flags = U16_AT(&mData[offset + 8]);
-        uint16_t prevFlags = flags;
+        frame.mOffset = offset;
+        frame.mSize = dataSize;
+        mFrames.push(frame);
 
-        if (flags & 1) {
-            // Strip data length indicator
+        offset += headerSize + dataSize;
+    }
 
-            memmove(&mData[offset + 10], &mData[offset + 14], mSize - offset - 14);
-            mSize -= 4;
-            dataSize -= 4;
+    return true;
+}
 
-            flags &= ~1;
-        }
+bool ID3::readTag(size_t offset, void *data, size_t size) const {
+    if (offset > mSize || size > mSize - offset) {
+        return false;
+    }
 
-        if (flags & 2) {
-            // This file has "unsynchronization", so we have to replace occurrences
-            // of 0xff 0x00 with just 0xff in order to get the real data.
+    if (mData != NULL) {
+        memcpy(data, &mData[offset], size);
+        return true;
+    }
 
-            size_t readOffset = offset + 11;
-            size_t writeOffset = offset + 11;
-            for (size_t i = 0; i + 1 < dataSize; ++i) {
-                if (mData[readOffset - 1] == 0xff
-                        && mData[readOffset] == 0x00) {
-                    ++readOffset;
-                    --mSize;
-                    --dataSize;
-                }
-                mData[writeOffset++] = mData[readOffset++];
-            }
-            // move the remaining data following this frame
-            memmove(&mData[writeOffset], &mData[readOffset], oldSize - readOffset);
+    if (size > kWindowSize) {
+        return mSource->readAt(mDataOffset + offset, data, size) == (ssize_t)size;
+    }
 
-            flags &= ~2;
+    if (offset < mWindowOffset || offset + size > mWindowOffset + mWindowSize) {
+        if (mWindow == NULL) {
+            mWindow = (uint8_t *)malloc(kWindowSize);
+            if (mWindow == NULL) {
+                return false;
+            }
         }
 
-        if (flags != prevFlags || iTunesHack) {
-            WriteSyncsafeInteger(&mData[offset + 4], dataSize);
-            mData[offset + 8] = flags >> 8;
-            mData[offset + 9] = flags & 0xff;
-        }
+        mWindowOffset = offset;
+        mWindowSize = mSize - offset < kWindowSize ? mSize - offset : kWindowSize;
 
-        offset += 10 + dataSize;
+        if (mSource->readAt(mDataOffset + offset, mWindow, mWindowSize)
+                != (ssize_t)mWindowSize) {
+            mWindowSize = 0;
+            return false;
+        }
     }
 
-    memset(&mData[mSize], 0, oldSize - mSize);
-
+    memcpy(data, &mWindow[offset - mWindowOffset], size);
     return true;
 }
 
@@ -396,7 +449,12 @@ ID3::Iterator::Iterator(const ID3 &parent, const char *id)
       mID(NULL),
       mOffset(mParent.mFirstFrameOffset),
       mFrameData(NULL),
-      mFrameSize(0) {
+      mFrameSize(0),
+      mBuffer(NULL) {
+    if (mParent.mVersion != ID3_V1 && mParent.mVersion != ID3_V1_1) {
+        mOffset = 0;
+    }
+
     if (id) {
         mID = strdup(id);
     }
@@ -409,6 +467,9 @@ ID3::Iterator::~Iterator() {
         free(mID);
         mID = NULL;
     }
+
+    free(mBuffer);
+    mBuffer = NULL;
 }
 
 bool ID3::Iterator::done() const {
@@ -420,7 +481,11 @@ void ID3::Iterator::next() {
         return;
     }
 
-    mOffset += mFrameSize;
+    if (mParent.mVersion == ID3_V1 || mParent.mVersion == ID3_V1_1) {
+        mOffset += mFrameSize;
+    } else {
+        ++mOffset;
+    }
 
     findFrame();
 }
@@ -432,10 +497,9 @@ void ID3::Iterator::getID(String8 *id) const {
         return;
     }
 
-    if (mParent.mVersion == ID3_V2_2) {
-        id->setTo((const char *)&mParent.mData[mOffset], 3);
-    } else if (mParent.mVersion == ID3_V2_3 || mParent.mVersion == ID3_V2_4) {
-        id->setTo((const char *)&mParent.mData[mOffset], 4);
+    if (mParent.mVersion == ID3_V2_2
+            || mParent.mVersion == ID3_V2_3 || mParent.mVersion == ID3_V2_4) {
+        id->setTo(mParent.mFrames[mOffset].mID);
     } else {
         CHECK(mParent.mVersion == ID3_V1 || mParent.mVersion == ID3_V1_1);
 
@@ -616,97 +680,36 @@ void ID3::Iterator::findFrame() {
         mFrameData = NULL;
         mFrameSize = 0;
 
-        if (mParent.mVersion == ID3_V2_2) {
-            if (mOffset + 6 > mParent.mSize) {
-                return;
-            }
-
-            if (!memcmp(&mParent.mData[mOffset], "\0\0\0", 3)) {
-                return;
-            }
-
-            mFrameSize =
-                (mParent.mData[mOffset + 3] << 16)
-                | (mParent.mData[mOffset + 4] << 8)
-                | mParent.mData[mOffset + 5];
-
-            mFrameSize += 6;
+        free(mBuffer);
+        mBuffer = NULL;
 
-            if (mOffset + mFrameSize > mParent.mSize) {
-                ALOGV("partial frame at offset %zu (size = %zu, bytes-remaining = %zu)",
-                    mOffset, mFrameSize, mParent.mSize - mOffset - (size_t)6);
+        if (mParent.mVersion == ID3_V2_2
+                || mParent.mVersion == ID3_V2_3 || mParent.mVersion == ID3_V2_4) {
+            if (mOffset >= mParent.mFrames.size()) {
                 return;
             }
 
-            mFrameData = &mParent.mData[mOffset + 6];
+            const Frame &frame = mParent.mFrames[mOffset];
 
-            if (!mID) {
-                break;
-            }
-
-            char id[4];
-            memcpy(id, &mParent.mData[mOffset], 3);
-            id[3] = '\0';
-
-            if (!strcmp(id, mID)) {
-                break;
-            }
-        } else if (mParent.mVersion == ID3_V2_3
-                || mParent.mVersion == ID3_V2_4) {
-            if (mOffset + 10 > mParent.mSize) {
-                return;
-            }
-
-            if (!memcmp(&mParent.mData[mOffset], "\0\0\0\0", 4)) {
-                return;
-            }
-
-            size_t baseSize;
-            if (mParent.mVersion == ID3_V2_4) {
-                if (!ParseSyncsafeInteger(
-                            &mParent.mData[mOffset + 4], &baseSize)) {
-                    return;
-                }
-            } else {
-                baseSize = U32_AT(&mParent.mData[mOffset + 4]);
-            }
-
-            mFrameSize = 10 + baseSize;
-
-            if (mOffset + mFrameSize > mParent.mSize) {
-                ALOGV("partial frame at offset %zu (size = %zu, bytes-remaining = %zu)",
-                    mOffset, mFrameSize, mParent.mSize - mOffset - (size_t)10);
-                return;
-            }
-
-            uint16_t flags = U16_AT(&mParent.mData[mOffset + 8]);
-
-            if ((mParent.mVersion == ID3_V2_4 && (flags & 0x000c))
-                || (mParent.mVersion == ID3_V2_3 && (flags & 0x00c0))) {
+            if ((mParent.mVersion == ID3_V2_4 && (frame.mFlags & 0x000c))
+                || (mParent.mVersion == ID3_V2_3 && (frame.mFlags & 0x00c0))) {
                 // Compression or encryption are not supported at this time.
                 // Per-frame unsynchronization and data-length indicator
-                // have already been taken care of.
+                // are taken care of as the frame is read.
 
-                ALOGV("Skipping unsupported frame (compression, encryption "
-                     "or per-frame unsynchronization flagged");
+                ALOGV("Skipping unsupported frame (compression or encryption "
+                     "flagged)");
 
-                mOffset += mFrameSize;
+                ++mOffset;
                 continue;
             }
 
-            mFrameData = &mParent.mData[mOffset + 10];
-
-            if (!mID) {
+            if ((mID == NULL || !strcmp(frame.mID, mID)) && loadFrame()) {
                 break;
             }
 
-            char id[5];
-            memcpy(id, &mParent.mData[mOffset], 4);
-            id[4] = '\0';
-
-            if (!strcmp(id, mID)) {
-                break;
-            }
+            ++mOffset;
+            continue;
         } else {
             CHECK(mParent.mVersion == ID3_V1 || mParent.mVersion == ID3_V1_1);
 
@@ -759,6 +762,76 @@ void ID3::Iterator::findFrame() {
     }
 }
 
+// Reads the data of the ID3v2 frame at mOffset, less its data length indicator
+// and unsynchronization if any, and followed by two zero bytes for the
+// strings it has to be terminated.
+bool ID3::Iterator::loadFrame() {
+    const Frame &frame = mParent.mFrames[mOffset];
+    size_t headerLength = getHeaderLength();
+    size_t offset = frame.mOffset + headerLength;
+    size_t size = frame.mSize;
+
+    bool hasDataLength = mParent.mVersion == ID3_V2_4 && (frame.mFlags & 1);
+    bool unsynchronized = mParent.mVersion == ID3_V2_4 && (frame.mFlags & 2);
+
+    if (mParent.mData != NULL && !hasDataLength && !unsynchronized) {
+        mFrameData = &mParent.mData[offset];
+        mFrameSize = headerLength + size;
+        return true;
+    }
+
+    if (hasDataLength) {
+        if (size < 4) {
+            return false;
+        }
+
+        offset += 4;
+        size -= 4;
+    }
+
+    mBuffer = (uint8_t *)malloc(size + 2);
+    if (mBuffer == NULL) {
+        return false;
+    }
+
+    if (!mParent.readTag(offset, mBuffer, size)) {
+        ALOGV("could not read frame %s", frame.mID);
+
+        free(mBuffer);
+        mBuffer = NULL;
+
+        return false;
+    }
+
+    if (unsynchronized) {
+        // Replace occurrences of 0xff 0x00 with just 0xff in order to get
+        // the real data.
+        size_t n = 0;
+        uint8_t prev = 0;
+        for (size_t i = 0; i < size; ++i) {
+            uint8_t c = mBuffer[i];
+            if (prev != 0xff || c != 0x00) {
+                mBuffer[n++] = c;
+            }
+            prev = c;
+        }
+        size = n;
+    }
+
+    mBuffer[size] = 0;
+    mBuffer[size + 1] = 0;
+
+    mFrameData = mBuffer;
+    mFrameSize = headerLength + size;
+    return true;
+}
+
+uint8_t *ID3::Iterator::releaseBuffer() {
+    uint8_t *buffer = mBuffer;
+    mBuffer = NULL;
+    return buffer;
+}
+
 static size_t StringSize(const uint8_t *start, uint8_t encoding) {
     if (encoding == 0x00 || encoding == 0x03) {
         // ISO 8859-1 or UTF-8
@@ -806,6 +879,10 @@ ID3::getAlbumArt(size_t *length, String8 *mime) const {
 
             *length = size - 2 - mimeLen - descLen;
 
+            // the data read for the frame, if any, to outlive it
+            free(mAlbumArt);
+            mAlbumArt = it.releaseBuffer();
+
             return &data[2 + mimeLen + descLen];
         } else {
             uint8_t encoding = data[0];
@@ -833,6 +910,10 @@ ID3::getAlbumArt(size_t *length, String8 *mime) const {
 
             *length = size - 5 - descLen;
 
+            // the data read for the frame, if any, to outlive it
+            free(mAlbumArt);
+            mAlbumArt = it.releaseBuffer();
+
             return &data[5 + descLen];
         }
     }
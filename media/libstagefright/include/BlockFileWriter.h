@@ -0,0 +1,111 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BLOCK_FILE_WRITER_H_
+
+#define BLOCK_FILE_WRITER_H_
+
+#include <pthread.h>
+
+#include <media/stagefright/foundation/ABase.h>
+#include <utils/Errors.h>
+#include <utils/List.h>
+#include <utils/String8.h>
+#include <utils/threads.h>
+
+namespace android {
+
+// Collects small writes into large blocks, aligned to the block size within
+// the file, and writes them out on a thread of its own so that a slow
+// storage device stalls the caller only once all blocks are in flight.
+// Not thread-safe, the caller serializes its calls.
+struct BlockFileWriter {
+    // If syncIntervalBytes is not 0, the data is also synced to the device
+    // every that many bytes, rather than leaving the kernel to write back
+    // everything in one go.
+    BlockFileWriter(
+            int fd, off64_t offset, size_t blockSize, size_t numBlocks,
+            int64_t syncIntervalBytes);
+
+    // Writes out whatever is still buffered.
+    ~BlockFileWriter();
+
+    status_t initCheck() const;
+
+    // Writes at the end of the data appended so far.
+    void append(const void *data, size_t size);
+
+    // Where to append from now on.
+    void seekTo(off64_t offset);
+
+    // Overwrites data appended before, as box headers are.
+    void writeAt(off64_t offset, const void *data, size_t size);
+
+    // Waits until everything appended so far is written, returns the first
+    // error writing if any.
+    status_t flush();
+
+    void dump(String8 *result) const;
+
+private:
+    struct Block {
+        uint8_t *mData;
+        off64_t mOffset;
+        size_t mSize;
+        size_t mCapacity;
+    };
+
+    int mFd;
+    size_t mBlockSize;
+    int64_t mSyncIntervalBytes;
+    status_t mInitCheck;
+
+    pthread_t mThread;
+
+    mutable Mutex mLock;
+    Condition mBlockQueuedCondition;
+    Condition mBlockWrittenCondition;
+
+    List<Block *> mFreeBlocks;
+    List<Block *> mFullBlocks;
+    Block *mFilling;
+    off64_t mNextOffset;
+    bool mWriting;
+    bool mDone;
+    status_t mError;
+
+    // Stats.
+    int64_t mBytesWritten;
+    int64_t mNumWrites;
+    int64_t mTotalWriteTimeUs;
+    int64_t mMaxWriteTimeUs;
+    int64_t mNumStalls;
+    int64_t mTotalStallTimeUs;
+
+    void startFilling_l();
+    void queueFilling_l();
+    void waitForWrites_l();
+
+    static void *ThreadWrapper(void *me);
+    void threadFunc();
+    status_t writeBlock(const Block *block);
+
+    DISALLOW_EVIL_CONSTRUCTORS(BlockFileWriter);
+};
+
+}  // namespace android
+
+#endif  // BLOCK_FILE_WRITER_H_
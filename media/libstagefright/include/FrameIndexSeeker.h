@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef FRAME_INDEX_SEEKER_H_
+
+#define FRAME_INDEX_SEEKER_H_
+
+#include "include/MP3Seeker.h"
+
+#include <pthread.h>
+
+#include <utils/threads.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+struct DataSource;
+
+// For streams without a XING or VBRI table of contents. Reads through the
+// whole stream once in the background, noting down where every
+// kFramesPerEntry-th frame starts.
+struct FrameIndexSeeker : public MP3Seeker {
+    // Returns NULL unless the source is local, reading all of it would
+    // otherwise fill the cache or download the file.
+    static sp<FrameIndexSeeker> CreateFromSource(
+            const sp<DataSource> &source, off64_t first_frame_pos,
+            uint32_t fixed_header);
+
+    virtual bool getDuration(int64_t *durationUs);
+
+    // Fails for times the index has not reached yet.
+    virtual bool getOffsetForTime(int64_t *timeUs, off64_t *pos);
+
+protected:
+    virtual ~FrameIndexSeeker();
+
+private:
+    enum {
+        kFramesPerEntry = 32,
+    };
+
+    sp<DataSource> mDataSource;
+    off64_t mFirstFramePos;
+    uint32_t mFixedHeader;
+    int mSampleRate;
+    int mSamplesPerFrame;
+
+    pthread_t mThread;
+
+    Mutex mLock;
+    bool mStopping;
+    bool mDone;
+    int64_t mNumFrames;
+    Vector<off64_t> mOffsets;
+
+    FrameIndexSeeker(
+            const sp<DataSource> &source, off64_t first_frame_pos,
+            uint32_t fixed_header, int sample_rate, int samples_per_frame);
+
+    static void *ThreadWrapper(void *me);
+    void buildIndex();
+
+    int64_t framesToUs(int64_t numFrames) const;
+
+    DISALLOW_EVIL_CONSTRUCTORS(FrameIndexSeeker);
+};
+
+}  // namespace android
+
+#endif  // FRAME_INDEX_SEEKER_H_
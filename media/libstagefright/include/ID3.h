@@ -19,6 +19,7 @@
 #define ID3_H_
 
 #include <utils/RefBase.h>
+#include <utils/Vector.h>
 
 namespace android {
 
@@ -35,7 +36,10 @@ struct ID3 {
         ID3_V2_4,
     };
 
+    // Reads the frame headers of the tag only, and the data of a frame when
+    // an Iterator comes to it.
     ID3(const sp<DataSource> &source, bool ignoreV1 = false, off64_t offset = 0);
+    // Copies the tag.
     ID3(const uint8_t *data, size_t size, bool ignoreV1 = false);
     ~ID3();
 
@@ -43,6 +47,7 @@ struct ID3 {
 
     Version version() const;
 
+    // Valid until the next call, or for as long as the ID3.
     const void *getAlbumArt(size_t *length, String8 *mime) const;
 
     struct Iterator {
@@ -56,14 +61,24 @@ struct ID3 {
         void next();
 
     private:
+        friend struct ID3;
+
         const ID3 &mParent;
         char *mID;
+        // of the frame in mParent.mData for ID3v1, its index in
+        // mParent.mFrames otherwise
         size_t mOffset;
 
         const uint8_t *mFrameData;
         size_t mFrameSize;
 
+        // the frame's data when read or decoded, NULL when mFrameData
+        // points into mParent.mData
+        uint8_t *mBuffer;
+
         void findFrame();
+        bool loadFrame();
+        uint8_t *releaseBuffer();
 
         size_t getHeaderLength() const;
         void getstring(String8 *s, bool secondhalf) const;
@@ -75,20 +90,45 @@ struct ID3 {
     size_t rawSize() const { return mRawSize; }
 
 private:
+    // An ID3v2 frame as its header has it, offsets being from the end of the
+    // tag header.
+    struct Frame {
+        char mID[5];
+        uint16_t mFlags;
+        size_t mOffset;
+        // of the data as stored, the header excluded
+        size_t mSize;
+    };
+
     bool mIsValid;
+    // The tag less its header when held in memory, which ID3v1 tags, tags
+    // parsed from memory and those unsynchronized as a whole are. NULL for the
+    // others, which are read from mSource at mDataOffset as needed.
     uint8_t *mData;
     size_t mSize;
+    sp<DataSource> mSource;
+    off64_t mDataOffset;
     size_t mFirstFrameOffset;
     Version mVersion;
+    Vector<Frame> mFrames;
+
+    // The last bytes read from mSource, which frame headers and the short
+    // frames next to them mostly fall in.
+    mutable uint8_t *mWindow;
+    mutable size_t mWindowOffset;
+    mutable size_t mWindowSize;
+
+    mutable uint8_t *mAlbumArt;
 
     // size of the ID3 tag including header before any unsynchronization.
     // only valid for IDV2+
     size_t mRawSize;
 
     bool parseV1(const sp<DataSource> &source);
-    bool parseV2(const sp<DataSource> &source, off64_t offset);
+    bool parseV2(const sp<DataSource> &source, off64_t offset, bool inMemory);
     void removeUnsynchronization();
-    bool removeUnsynchronizationV2_4(bool iTunesHack);
+    bool indexFrames(Version version, bool iTunesHack);
+    bool readTag(size_t offset, void *data, size_t size) const;
 
     static bool ParseSyncsafeInteger(const uint8_t encoded[4], size_t *x);
 
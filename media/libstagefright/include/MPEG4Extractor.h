@@ -62,6 +62,10 @@ public:
     // for DRM
     virtual char* getDrmTrackInfo(size_t trackID, int *len);
 
+    // Leaves out the sample-to-chunk, time-to-sample, composition time and
+    // sync sample tables and the scan of every sample size.
+    virtual void setMetaDataOnly();
+
 protected:
     virtual ~MPEG4Extractor();
 
@@ -92,6 +96,7 @@ private:
     status_t mInitCheck;
     bool mHasVideo;
     uint32_t mHeaderTimescale;
+    bool mMoovCached;
 
     Track *mFirstTrack, *mLastTrack;
 
@@ -111,7 +116,7 @@ private:
     status_t updateAudioTrackInfoFromESDS_MPEG4Audio(
             const void *esds_data, size_t esds_size);
 
-    static status_t verifyTrack(Track *track);
+    status_t verifyTrack(Track *track);
 
     struct SINF {
         SINF *next;
@@ -124,6 +129,7 @@ private:
     SINF *mFirstSINF;
 
     bool mIsDrm;
+    bool mMetaDataOnly;
     status_t parseDrmSINF(off64_t *offset, off64_t data_offset);
 
     status_t parseTrackHeader(off64_t data_offset, off64_t data_size);
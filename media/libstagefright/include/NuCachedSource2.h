@@ -61,6 +61,19 @@ struct NuCachedSource2 : public DataSource {
     status_t getEstimatedBandwidthKbps(int32_t *kbps);
     status_t setCacheStatCollectFreq(int32_t freqMs);
 
+    // The share of readAt() calls served without waiting for the network,
+    // NOT_ENOUGH_DATA before the first one.
+    status_t getCacheHitRate(int32_t *percent);
+
+    // The bitrate of the stream, in bits/sec. Unless cache parameters were
+    // given explicitly, the watermarks are then sized to the stream and the
+    // measured bandwidth.
+    void setStreamBitrate(int64_t bitrate);
+
+    // How long until the cache runs dry at the current bandwidth, -1 if the
+    // network keeps up. NOT_ENOUGH_DATA if bitrate or bandwidth are unknown.
+    status_t getEstimatedUnderrunTimeUs(int64_t *timeUs);
+
     static void RemoveCacheSpecificHeaders(
             KeyedVector<String8, String8> *headers,
             String8 *cacheConfig,
@@ -80,9 +93,21 @@ private:
         kDefaultHighWaterThreshold      = 20 * 1024 * 1024,
         kDefaultLowWaterThreshold       = 4 * 1024 * 1024,
 
+        // What is kept of the ranges fetched before the last seeks.
+        kMaxInactiveBytes               = 8 * 1024 * 1024,
+        kMaxNumInactiveRanges           = 8,
+
         // Read data after a 15 sec timeout whether we're actively
         // fetching or not.
         kDefaultKeepAliveIntervalUs     = 15000000,
+
+        // Bounds of the watermarks sized from bitrate and bandwidth.
+        kMinLowWaterThreshold           = 256 * 1024,
+        // Larger reads are split up, they must fit the cache with the
+        // smallest watermarks.
+        kMaxReadSize                    = 512 * 1024,
+        kMinFetchSize                   = 8 * 1024,
+        kAdaptIntervalUs                = 1000000,
     };
 
     enum {
@@ -102,8 +127,22 @@ private:
     mutable Mutex mLock;
     Condition mCondition;
 
+    // The range being prefetched into.
     PageCache *mCache;
     off64_t mCacheOffset;
+
+    // Ranges fetched earlier, say the moov atom at the end of the file or
+    // the other end of a badly interleaved file, most recently used first.
+    struct CachedRange {
+        off64_t mOffset;
+        PageCache *mCache;
+    };
+    List<CachedRange> mInactiveRanges;
+    size_t mInactiveBytes;
+
+    size_t mNumReads;
+    size_t mNumCacheHits;
+
     status_t mFinalStatus;
     off64_t mLastAccessPos;
     sp<AMessage> mAsyncResult;
@@ -123,6 +162,16 @@ private:
 
     bool mDisconnectAtHighwatermark;
 
+    // False once cache parameters were set from a property or config string.
+    bool mAdaptCacheParams;
+    int64_t mStreamBitrate;
+    int32_t mBandwidthKbps;
+    int64_t mLastAdaptTimeUs;
+
+    // How much to read per fetch, less than a page on slow networks so that
+    // pending reads don't wait long for the looper.
+    size_t mFetchSize;
+
     void onMessageReceived(const sp<AMessage> &msg);
     void onFetch();
     void onRead(const sp<AMessage> &msg);
@@ -131,11 +180,17 @@ private:
     ssize_t readInternal(off64_t offset, void *data, size_t size);
     status_t seekInternal_l(off64_t offset);
 
+    bool readFromInactiveRanges_l(off64_t offset, void *data, size_t size);
+    bool switchToInactiveRange_l(off64_t offset);
+    void retireActiveRange_l();
+
     size_t approxDataRemaining_l(status_t *finalStatus) const;
 
     void restartPrefetcherIfNecessary_l(
             bool ignoreLowWaterThreshold = false, bool force = false);
 
+    void adaptCacheParams();
+
     void updateCacheParamsFromSystemProperty();
     void updateCacheParamsFromString(const char *s);
 
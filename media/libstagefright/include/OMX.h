@@ -20,6 +20,7 @@
 #include <media/IOMX.h>
 #include <utils/threads.h>
 #include <utils/KeyedVector.h>
+#include <utils/List.h>
 
 namespace android {
 
@@ -160,6 +161,25 @@ private:
     KeyedVector<node_id, OMXNodeInstance *> mNodeIDToInstance;
     KeyedVector<node_id, sp<CallbackDispatcher> > mDispatchers;
 
+    // Decoders their clients shut down cleanly, kept around for the next
+    // allocation of the same component, oldest first. Only used when
+    // media.stagefright.codec-pool is set to the number to keep.
+    struct ParkedNode {
+        OMXNodeInstance *mInstance;
+        int64_t mParkedTimeUs;
+    };
+
+    Mutex mParkLock;
+    size_t mMaxParkedNodes;
+    List<ParkedNode> mParkedNodes;
+
+    status_t allocateNewNode(
+            const char *name, const sp<IOMXObserver> &observer, node_id *node);
+
+    void parkNode(OMXNodeInstance *instance);
+    OMXNodeInstance *takeParkedNode(const char *name);
+    size_t releaseParkedNodes(bool expiredOnly);
+
     node_id makeNodeID(OMXNodeInstance *instance);
     OMXNodeInstance *findInstance(node_id node);
     sp<CallbackDispatcher> findDispatcher(node_id node);
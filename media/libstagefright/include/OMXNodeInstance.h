@@ -20,6 +20,7 @@
 
 #include "OMX.h"
 
+#include <media/stagefright/foundation/AString.h>
 #include <utils/RefBase.h>
 #include <utils/threads.h>
 
@@ -31,16 +32,26 @@ struct GraphicBufferSource;
 
 struct OMXNodeInstance {
     OMXNodeInstance(
-            OMX *owner, const sp<IOMXObserver> &observer);
+            OMX *owner, const sp<IOMXObserver> &observer, const char *name);
 
     void setHandle(OMX::node_id node_id, OMX_HANDLETYPE handle);
 
     OMX *owner();
     sp<IOMXObserver> observer();
     OMX::node_id nodeID();
+    const char *componentName() const;
 
     status_t freeNode(OMXMaster *master);
 
+    // Detaches a component its client left in the Loaded state so that the
+    // next allocation of the same component can skip creating it. Undoes
+    // the Android extensions the client turned on; returns false if the
+    // component may carry other state over and has to be freed instead.
+    bool park();
+
+    // Hands a parked component to a new client.
+    void reuse(OMX::node_id node_id, const sp<IOMXObserver> &observer);
+
     status_t sendCommand(OMX_COMMANDTYPE cmd, OMX_S32 param);
     status_t getParameter(OMX_INDEXTYPE index, void *params, size_t size);
 
@@ -114,7 +125,8 @@ struct OMXNodeInstance {
             const void *data,
             size_t size);
 
-    void onMessage(const omx_message &msg);
+    // Forwards the messages the observer needs to see in a single call.
+    void onMessages(const List<omx_message> &messages);
     void onObserverDied(OMXMaster *master);
     void onGetHandleFailed();
     void onEvent(OMX_EVENTTYPE event, OMX_U32 arg1, OMX_U32 arg2);
@@ -122,6 +134,12 @@ struct OMXNodeInstance {
     static OMX_CALLBACKTYPE kCallbacks;
 
 private:
+    enum {
+        kGraphicBuffers     = 1,
+        kMetaDataInBuffers  = 2,
+        kAdaptivePlayback   = 4,
+    };
+
     Mutex mLock;
 
     OMX *mOwner;
@@ -129,6 +147,12 @@ private:
     OMX_HANDLETYPE mHandle;
     sp<IOMXObserver> mObserver;
     bool mDying;
+    AString mComponentName;
+
+    // Whether park() can undo everything done to the component so far, and
+    // the extensions to undo on the input and output port.
+    bool mReusable;
+    uint32_t mPortModes[2];
 
     // Lock only covers mGraphicBufferSource.  We can't always use mLock
     // because of rare instances where we'd end up locking it recursively.
@@ -161,6 +185,12 @@ private:
     OMX::buffer_id findBufferID(OMX_BUFFERHEADERTYPE *bufferHeader);
     void invalidateBufferID(OMX::buffer_id buffer);
 
+    // Updates msg from the buffer header, returns true if the message was
+    // consumed here and must not reach the observer.
+    bool handleMessage(omx_message &msg);
+
+    void notePortMode(OMX_U32 portIndex, uint32_t mode, OMX_BOOL enable);
+
     status_t useGraphicBuffer2_l(
             OMX_U32 portIndex, const sp<GraphicBuffer> &graphicBuffer,
             OMX::buffer_id *buffer);
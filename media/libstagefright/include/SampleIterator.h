@@ -27,6 +27,8 @@ struct SampleIterator {
 
     uint32_t getChunkIndex() const { return mCurrentChunkIndex; }
     uint32_t getDescIndex() const { return mChunkDesc; }
+    off64_t getCurrentChunkOffset() const { return mCurrentChunkOffset; }
+    size_t getCurrentChunkSize() const { return mCurrentChunkSize; }
     off64_t getSampleOffset() const { return mCurrentSampleOffset; }
     size_t getSampleSize() const { return mCurrentSampleSize; }
     uint32_t getSampleTime() const { return mCurrentSampleTime; }
@@ -50,6 +52,7 @@ private:
 
     uint32_t mCurrentChunkIndex;
     off64_t mCurrentChunkOffset;
+    size_t mCurrentChunkSize;
     Vector<size_t> mCurrentChunkSampleSizes;
 
     uint32_t mTimeToSampleIndex;
@@ -67,6 +70,7 @@ private:
     void reset();
     status_t findChunkRange(uint32_t sampleIndex);
     status_t getChunkOffset(uint32_t chunk, off64_t *offset);
+    status_t readChunkSampleSizes(uint32_t firstSampleIndex);
     status_t findSampleTimeAndDuration(uint32_t sampleIndex, uint32_t *time, uint32_t *duration);
 
     SampleIterator(const SampleIterator &);
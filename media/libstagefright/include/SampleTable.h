@@ -69,6 +69,10 @@ public:
             bool *isSyncSample = NULL,
             uint32_t *sampleDuration = NULL);
 
+    // The file range of the chunk holding the sample.
+    status_t getChunkRangeForSample(
+            uint32_t sampleIndex, off64_t *offset, size_t *size);
+
     enum {
         kFlagBefore,
         kFlagAfter,
@@ -113,11 +117,33 @@ private:
     uint32_t mTimeToSampleCount;
     uint32_t *mTimeToSample;
 
-    struct SampleTimeEntry {
-        uint32_t mSampleIndex;
-        uint32_t mCompositionTime;
+    // Samples covered by the time to sample table, in decoding order they
+    // are grouped in regions of kSamplesPerRegion samples. Each region keeps
+    // the bounds of its composition times and where its first sample is in
+    // the time to sample table, seeking by time binary searches the regions
+    // and only looks at the samples of those that overlap the time.
+    enum {
+        kSamplesPerRegion = 1024
     };
-    SampleTimeEntry *mSampleTimeEntries;
+    struct SampleRegion {
+        uint32_t mMinTime;
+        uint32_t mMinTimeSample;
+        uint32_t mMaxTime;
+        uint32_t mMaxTimeSample;
+
+        // The time to sample entry of the first sample, and the index and
+        // decoding time of the first sample of that entry.
+        uint32_t mTTSEntry;
+        uint32_t mTTSSampleIndex;
+        uint32_t mTTSSampleTime;
+    };
+    uint32_t mNumTimedSamples;
+    uint32_t mNumSampleRegions;
+    SampleRegion *mSampleRegions;
+    // Region with the latest mMaxTime among regions [0, i].
+    uint32_t *mRegionMaxBefore;
+    // Region with the earliest mMinTime among regions [i, mNumSampleRegions).
+    uint32_t *mRegionMinAfter;
 
     uint32_t *mCompositionTimeDeltaEntries;
     size_t mNumCompositionTimeDeltaEntries;
@@ -140,18 +166,15 @@ private:
     friend struct SampleIterator;
 
     // normally we don't round
-    inline uint64_t getSampleTime(
-            size_t sample_index, uint64_t scale_num, uint64_t scale_den) const {
-        return (mSampleTimeEntries[sample_index].mCompositionTime
-            * scale_num) / scale_den;
+    inline uint64_t getScaledTime(
+            uint32_t compositionTime, uint64_t scale_num, uint64_t scale_den) const {
+        return (compositionTime * scale_num) / scale_den;
     }
 
     status_t getSampleSize_l(uint32_t sample_index, size_t *sample_size);
     uint32_t getCompositionTimeOffset(uint32_t sampleIndex);
 
-    static int CompareIncreasingTime(const void *, const void *);
-
-    void buildSampleEntriesTable();
+    void buildSampleRegions_l();
 
     SampleTable(const SampleTable &);
     SampleTable &operator=(const SampleTable &);
@@ -61,6 +61,7 @@ protected:
     enum {
         kStoreMetaDataExtensionIndex = OMX_IndexVendorStartUnused + 1,
         kPrepareForAdaptivePlaybackIndex,
+        kFramesPerBufferExtensionIndex,
     };
 
     void addPort(const OMX_PARAM_PORTDEFINITIONTYPE &def);
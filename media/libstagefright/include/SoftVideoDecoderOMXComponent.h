@@ -77,6 +77,8 @@ protected:
             bool *portWillReset, uint32_t width, uint32_t height,
             CropSettingsMode cropSettingsMode = kCropUnSet, bool fakeStride = false);
 
+    // Copies a decoded frame into an output buffer laid out for outputBufferWidth() x
+    // outputBufferHeight() in mOutputColorFormat, interleaving the chroma for NV12.
     void copyYV12FrameToOutputBuffer(
             uint8_t *dst, const uint8_t *srcY, const uint8_t *srcU, const uint8_t *srcV,
             size_t srcYStride, size_t srcUStride, size_t srcVStride);
@@ -92,6 +94,11 @@ protected:
     uint32_t mWidth, mHeight;
     uint32_t mCropLeft, mCropTop, mCropWidth, mCropHeight;
 
+    // Set by decoders that can output OMX_COLOR_FormatYUV420SemiPlanar as well, either
+    // through copyYV12FrameToOutputBuffer() or by checking mOutputColorFormat themselves.
+    bool mSupportsSemiPlanarOutput;
+    OMX_COLOR_FORMATTYPE mOutputColorFormat;
+
     enum {
         NONE,
         AWAITING_DISABLED,
@@ -40,6 +40,8 @@ struct StagefrightMetadataRetriever : public MediaMetadataRetrieverInterface {
     virtual status_t setDataSource(int fd, int64_t offset, int64_t length);
 
     virtual VideoFrame *getFrameAtTime(int64_t timeUs, int option);
+    virtual VideoFrame *getThumbnailAtTime(
+            int64_t timeUs, int option, int32_t width, int32_t height);
     virtual MediaAlbumArt *extractAlbumArt();
     virtual const char *extractMetadata(int keyCode);
 
@@ -47,6 +49,8 @@ private:
     OMXClient mClient;
     sp<DataSource> mSource;
     sp<MediaExtractor> mExtractor;
+    // mExtractor parses headers only, until a frame is asked for
+    bool mMetaDataOnly;
 
     bool mParsedMetaData;
     KeyedVector<int, String8> mMetaData;
@@ -54,6 +58,10 @@ private:
 
     void parseMetaData();
 
+    // width and height 0 for the frame as decoded
+    VideoFrame *extractFrame(
+            int64_t timeUs, int option, int32_t width, int32_t height);
+
     StagefrightMetadataRetriever(const StagefrightMetadataRetriever &);
 
     StagefrightMetadataRetriever &operator=(
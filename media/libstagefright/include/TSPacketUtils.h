@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TS_PACKET_UTILS_H_
+
+#define TS_PACKET_UTILS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace android {
+
+// Packet layout shared by the transport stream writers, MPEG2TSWriter and
+// the wifi-display TSPacketizer. Both lay out their packets back to back
+// into one buffer per access unit, using the helpers below.
+
+enum {
+    kTSPacketSize = 188,
+    kTSPacketHeaderSize = 4,
+    kTSMaxPayloadSize = kTSPacketSize - kTSPacketHeaderSize,
+};
+
+// Writes the 4-byte header of the packet at "packet", followed by an
+// adaptation field of numPaddingBytes stuffing the packet if its payload
+// does not fill it. Returns where the payload goes.
+uint8_t *WriteTSPacketHeader(
+        uint8_t *packet, unsigned PID, bool payloadUnitStart,
+        unsigned continuityCounter, size_t numPaddingBytes);
+
+// Lays out size (<= kTSMaxPayloadSize) bytes of payload as one packet,
+// stuffed as above.
+void WriteTSPacket(
+        uint8_t *packet, unsigned PID, bool payloadUnitStart,
+        unsigned continuityCounter, const uint8_t *payload, size_t size);
+
+// The number of packets continuing a PES packet that carries size bytes
+// of payload after the first packet, i.e. without alignment constraints.
+size_t NumTSContinuationPackets(size_t size);
+
+// CRC32 of a PSI section (ISO/IEC 13818-1 Annex A), as stored in network
+// byte order at its end.
+uint32_t TSSectionCRC32(const uint8_t *data, size_t size);
+
+}  // namespace android
+
+#endif  // TS_PACKET_UTILS_H_
@@ -20,9 +20,9 @@
 
 #include <pthread.h>
 
-#include <utils/List.h>
 #include <utils/RefBase.h>
 #include <utils/threads.h>
+#include <utils/Vector.h>
 #include <powermanager/IPowerManager.h>
 
 namespace android {
@@ -91,11 +91,17 @@ struct TimedEventQueue {
     event_id postEventToBack(const sp<Event> &event);
 
     // It is an error to post an event with a negative delay.
-    event_id postEventWithDelay(const sp<Event> &event, int64_t delay_us);
+    // An event posted with a slack may fire up to slack_us late, with
+    // whichever event wakes the queue up in that window, instead of waking
+    // it up on its own: polls that need not be punctual then ride on the
+    // wakeups of those that do.
+    event_id postEventWithDelay(
+            const sp<Event> &event, int64_t delay_us, int64_t slack_us = 0);
 
     // If the event is to be posted at a time that has already passed,
     // it will fire as soon as possible.
-    event_id postTimedEvent(const sp<Event> &event, int64_t realtime_us);
+    event_id postTimedEvent(
+            const sp<Event> &event, int64_t realtime_us, int64_t slack_us = 0);
 
     // Returns true iff event is currently in the queue and has been
     // successfully cancelled. In this case the event will have been
@@ -118,6 +124,10 @@ private:
     struct QueueItem {
         sp<Event> event;
         int64_t realtime_us;
+        // realtime_us plus the slack, what the heap is ordered by
+        int64_t deadline_us;
+        // breaks ties in posting order
+        uint32_t seq;
         bool has_wakelock;
     };
 
@@ -128,7 +138,9 @@ private:
     };
 
     pthread_t mThread;
-    List<QueueItem> mQueue;
+    // a binary min-heap on (deadline_us, seq)
+    Vector<QueueItem> mQueue;
+    uint32_t mNextSeq;
     Mutex mLock;
     Condition mQueueNotEmptyCondition;
     Condition mQueueHeadChangedCondition;
@@ -145,6 +157,15 @@ private:
     static void *ThreadWrapper(void *me);
     void threadEntry();
 
+    static bool Before(const QueueItem &a, const QueueItem &b);
+    void siftUp_l(size_t index);
+    void siftDown_l(size_t index);
+    void removeAt_l(size_t index);
+
+    // The index of the event to fire at now_us, -1 if there is none: the
+    // head once its deadline has come, else any event whose time has come.
+    ssize_t findDueEvent_l(int64_t now_us) const;
+
     sp<Event> removeEventFromQueue_l(event_id id, bool *wakeLocked);
 
     void acquireWakeLock_l();
@@ -56,7 +56,26 @@ typedef struct {
 
 struct DataSourceReader : public mkvparser::IMkvReader {
     DataSourceReader(const sp<DataSource> &source)
-        : mSource(source) {
+        : mSource(source),
+          mReadAheadBuffer(NULL),
+          mReadAheadOffset(0),
+          mReadAheadSize(0) {
+    }
+
+    virtual ~DataSourceReader() {
+        delete[] mReadAheadBuffer;
+        mReadAheadBuffer = NULL;
+    }
+
+    // mkvparser reads an element at a time, most of them a few bytes long.
+    // Serve small reads from a kReadAheadSize window read in one go, this
+    // turns the block reads of a cluster into large sequential reads.
+    void enableReadAhead() {
+        Mutex::Autolock autoLock(mLock);
+
+        if (mReadAheadBuffer == NULL) {
+            mReadAheadBuffer = new uint8_t[kReadAheadSize];
+        }
     }
 
     virtual int Read(long long position, long length, unsigned char* buffer) {
@@ -67,6 +86,26 @@ struct DataSourceReader : public mkvparser::IMkvReader {
             return 0;
         }
 
+        if (length < kReadAheadSize / 4) {
+            Mutex::Autolock autoLock(mLock);
+
+            if (mReadAheadBuffer != NULL) {
+                if (position < mReadAheadOffset
+                        || position + length > mReadAheadOffset + mReadAheadSize) {
+                    ssize_t n = mSource->readAt(
+                            position, mReadAheadBuffer, kReadAheadSize);
+
+                    mReadAheadOffset = position;
+                    mReadAheadSize = n > 0 ? n : 0;
+                }
+
+                if (position + length <= mReadAheadOffset + mReadAheadSize) {
+                    memcpy(buffer, &mReadAheadBuffer[position - mReadAheadOffset], length);
+                    return 0;
+                }
+            }
+        }
+
         ssize_t n = mSource->readAt(position, buffer, length);
 
         if (n <= 0) {
@@ -97,8 +136,17 @@ struct DataSourceReader : public mkvparser::IMkvReader {
     }
 
 private:
+    enum {
+        kReadAheadSize = 256 * 1024
+    };
+
     sp<DataSource> mSource;
 
+    Mutex mLock;
+    uint8_t *mReadAheadBuffer;
+    long long mReadAheadOffset;
+    size_t mReadAheadSize;
+
     DataSourceReader(const DataSourceReader &);
     DataSourceReader &operator=(const DataSourceReader &);
 };
@@ -130,6 +178,9 @@ private:
     long mBlockEntryIndex;
 
     void advance_l();
+    void seekWithoutCues_l(
+            int64_t seekTimeUs, int64_t seekTimeNs, bool isAudio,
+            int64_t *actualFrameTimeUs);
 
     BlockIterator(const BlockIterator &);
     BlockIterator &operator=(const BlockIterator &);
@@ -452,12 +503,14 @@ void BlockIterator::seek(
         }
 
         if (!pCues) {
-            ALOGE("No Cues in file");
+            ALOGV("No Cues in file, seeking by clusters");
+            seekWithoutCues_l(seekTimeUs, seekTimeNs, isAudio, actualFrameTimeUs);
             return;
         }
     }
     else if (!pSH) {
-        ALOGE("No SeekHead");
+        ALOGV("No SeekHead, seeking by clusters");
+        seekWithoutCues_l(seekTimeUs, seekTimeNs, isAudio, actualFrameTimeUs);
         return;
     }
 
@@ -533,6 +586,59 @@ void BlockIterator::seek(
     }
 }
 
+void BlockIterator::seekWithoutCues_l(
+        int64_t seekTimeUs, int64_t seekTimeNs, bool isAudio,
+        int64_t *actualFrameTimeUs) {
+    mkvparser::Segment* const pSegment = mExtractor->mSegment;
+
+    // The segment keeps every cluster it has loaded, in file order, which
+    // makes them the index to seek by. Load clusters past the last one
+    // until one starts after the seek time, this only reads their headers,
+    // the blocks are parsed when they are iterated.
+    const mkvparser::Cluster *cluster = pSegment->GetLast();
+    while (cluster != NULL && !cluster->EOS()
+            && cluster->GetTime() < seekTimeNs) {
+        const mkvparser::Cluster *nextCluster;
+        long long pos;
+        long len;
+        if (pSegment->ParseNext(cluster, nextCluster, pos, len) != 0) {
+            break;
+        }
+        cluster = nextCluster;
+    }
+
+    // The last loaded cluster starting at or before the seek time.
+    mCluster = pSegment->FindCluster(seekTimeNs);
+    if (mCluster == NULL || mCluster->EOS()) {
+        ALOGE("Did not locate a cluster for seeking");
+        mCluster = pSegment->GetFirst();
+    }
+
+    mBlockEntry = NULL;
+    mBlockEntryIndex = 0;
+
+    const mkvparser::Track *thisTrack =
+        pSegment->GetTracks()->GetTrackByIndex(mIndex);
+    bool isVideo = thisTrack != NULL && thisTrack->GetType() == 1;
+
+    for (;;) {
+        advance_l();
+
+        if (eos()) break;
+
+        if (isAudio || block()->IsKey()) {
+            // Accept the first key frame, past the seek time unless video
+            int64_t frameTimeUs = (block()->GetTime(mCluster) + 500LL) / 1000LL;
+            if (isVideo || frameTimeUs >= seekTimeUs) {
+                *actualFrameTimeUs = frameTimeUs;
+                ALOGV("Requested seek point: %" PRId64 " actual: %" PRId64,
+                      seekTimeUs, *actualFrameTimeUs);
+                break;
+            }
+        }
+    }
+}
+
 const mkvparser::Block *BlockIterator::block() const {
     CHECK(!eos());
 
@@ -776,6 +882,11 @@ MatroskaExtractor::MatroskaExtractor(const sp<DataSource> &source)
                 | DataSource::kIsCachingDataSource))
         && mDataSource->getSize(&size) != OK;
 
+    if (!mIsLiveStreaming) {
+        // A live stream would block in reading ahead for data to arrive.
+        mReader->enableReadAhead();
+    }
+
     mkvparser::EBMLHeader ebmlHeader;
     long long pos;
     if (ebmlHeader.Parse(mReader, pos) < 0) {
@@ -37,6 +37,7 @@
 #include <utils/KeyedVector.h>
 
 #include <inttypes.h>
+#include <string.h>
 
 namespace android {
 
@@ -80,6 +81,10 @@ struct ATSParser::Program : public RefBase {
         return mProgramMapPID;
     }
 
+    bool hasStream(unsigned pid) const {
+        return mStreams.indexOfKey(pid) >= 0;
+    }
+
     uint32_t parserFlags() const {
         return mParser->mFlags;
     }
@@ -935,6 +940,7 @@ ATSParser::ATSParser(uint32_t flags)
       mNumTSPacketsParsed(0),
       mNumPCRs(0) {
     mPSISections.add(0 /* PID */, new PSISection);
+    invalidatePIDTable();
 }
 
 ATSParser::~ATSParser() {
@@ -947,6 +953,42 @@ status_t ATSParser::feedTSPacket(const void *data, size_t size) {
     return parseTS(&br);
 }
 
+status_t ATSParser::feedTSPackets(
+        const void *data, size_t size, size_t *consumed) {
+    const uint8_t *ptr = (const uint8_t *)data;
+    size_t offset = 0;
+
+    status_t err = OK;
+    while (err == OK && offset + kTSPacketSize <= size) {
+        if (ptr[offset] != 0x47) {
+            // Resync on a sync byte that is followed by another one a packet
+            // later, or that starts the last packet of the data.
+            const uint8_t *sync = &ptr[offset];
+            while ((sync = (const uint8_t *)memchr(
+                            sync + 1, 0x47, &ptr[size] - (sync + 1))) != NULL) {
+                size_t next = (sync - ptr) + kTSPacketSize;
+                if (next >= size || ptr[next] == 0x47) {
+                    break;
+                }
+            }
+
+            size_t skipped = (sync != NULL ? sync - ptr : size) - offset;
+            ALOGW("skipped %zu bytes to resync on the transport stream", skipped);
+            offset += skipped;
+            continue;
+        }
+
+        ABitReader br(&ptr[offset], kTSPacketSize);
+        err = parseTS(&br);
+
+        offset += kTSPacketSize;
+    }
+
+    *consumed = offset;
+
+    return err;
+}
+
 void ATSParser::signalDiscontinuity(
         DiscontinuityType type, const sp<AMessage> &extra) {
     int64_t mediaTimeUs;
@@ -1048,11 +1090,50 @@ void ATSParser::parseProgramAssociationTable(ABitReader *br) {
     MY_LOGV("  CRC = 0x%08x", br->getBits(32));
 }
 
+uint8_t ATSParser::lookupPID(unsigned PID) {
+    if (mPSISections.indexOfKey(PID) >= 0) {
+        return kPIDSection;
+    }
+
+    for (size_t i = 0; i < mPrograms.size(); ++i) {
+        if (mPrograms.itemAt(i)->hasStream(PID)) {
+            // too many programs to record, look it up every time
+            return i <= 0xff - kPIDProgramBase ? kPIDProgramBase + i : kPIDUnknown;
+        }
+    }
+
+    return kPIDUnhandled;
+}
+
+void ATSParser::invalidatePIDTable() {
+    memset(mPIDTable, kPIDUnknown, sizeof(mPIDTable));
+}
+
 status_t ATSParser::parsePID(
         ABitReader *br, unsigned PID,
         unsigned continuity_counter,
         unsigned payload_unit_start_indicator) {
-    ssize_t sectionIndex = mPSISections.indexOfKey(PID);
+    uint8_t entry = mPIDTable[PID];
+    if (entry == kPIDUnknown) {
+        entry = lookupPID(PID);
+        mPIDTable[PID] = entry;
+    }
+
+    if (entry == kPIDUnhandled) {
+        ALOGV("PID 0x%04x not handled.", PID);
+        return OK;
+    }
+
+    if (entry >= kPIDProgramBase) {
+        status_t err;
+        CHECK(mPrograms.editItemAt(entry - kPIDProgramBase)->parsePID(
+                    PID, continuity_counter, payload_unit_start_indicator,
+                    br, &err));
+        return err;
+    }
+
+    ssize_t sectionIndex =
+        entry == kPIDSection ? mPSISections.indexOfKey(PID) : -1;
 
     if (sectionIndex >= 0) {
         sp<PSISection> section = mPSISections.valueAt(sectionIndex);
@@ -1077,6 +1158,9 @@ status_t ATSParser::parsePID(
 
         ABitReader sectionBits(section->data(), section->size());
 
+        // the section may add or move programs and streams
+        invalidatePIDTable();
+
         if (PID == 0) {
             parseProgramAssociationTable(&sectionBits);
         } else {
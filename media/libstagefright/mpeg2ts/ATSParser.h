@@ -65,6 +65,11 @@ struct ATSParser : public RefBase {
 
     status_t feedTSPacket(const void *data, size_t size);
 
+    // Feeds all the whole packets in "data", skipping ahead to the next sync
+    // byte wherever the stream is out of sync. Sets *consumed to the number
+    // of bytes parsed or skipped, the remainder is less than a packet.
+    status_t feedTSPackets(const void *data, size_t size, size_t *consumed);
+
     void signalDiscontinuity(
             DiscontinuityType type, const sp<AMessage> &extra);
 
@@ -119,6 +124,22 @@ private:
 
     size_t mNumTSPacketsParsed;
 
+    // What each PID carries, looked up on its first packet and forgotten
+    // whenever a PSI section may have changed the mapping. Elementary
+    // streams are recorded as kPIDProgramBase plus the index of their
+    // program in mPrograms.
+    enum {
+        kNumPIDs            = 8192,
+        kPIDUnknown         = 0,
+        kPIDSection         = 1,
+        kPIDUnhandled       = 2,
+        kPIDProgramBase     = 3,
+    };
+    uint8_t mPIDTable[kNumPIDs];
+
+    uint8_t lookupPID(unsigned PID);
+    void invalidatePIDTable();
+
     void parseProgramAssociationTable(ABitReader *br);
     void parseProgramMap(ABitReader *br);
     void parsePES(ABitReader *br);
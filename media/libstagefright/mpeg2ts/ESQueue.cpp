@@ -38,7 +38,9 @@ namespace android {
 
 ElementaryStreamQueue::ElementaryStreamQueue(Mode mode, uint32_t flags)
     : mMode(mode),
-      mFlags(flags) {
+      mFlags(flags),
+      mH264NALsSize(0),
+      mH264FoundSlice(false) {
 }
 
 sp<MetaData> ElementaryStreamQueue::getFormat() {
@@ -47,10 +49,11 @@ sp<MetaData> ElementaryStreamQueue::getFormat() {
 
 void ElementaryStreamQueue::clear(bool clearFormat) {
     if (mBuffer != NULL) {
-        mBuffer->setRange(0, 0);
+        consume(mBuffer->size());
     }
 
     mRangeInfos.clear();
+    resetH264Scan();
 
     if (clearFormat) {
         mFormat.clear();
@@ -407,8 +410,12 @@ status_t ElementaryStreamQueue::appendData(
     }
 
     size_t neededSize = (mBuffer == NULL ? 0 : mBuffer->size()) + size;
-    if (mBuffer == NULL || neededSize > mBuffer->capacity()) {
-        neededSize = (neededSize + 65535) & ~65535;
+    if (mBuffer == NULL
+            || mBuffer->offset() + neededSize > mBuffer->capacity()) {
+        // The access units dequeued so far may be slices of mBuffer, so it is
+        // replaced rather than compacted. Leave room for another 64 KB at
+        // least so that this does not happen on every append.
+        neededSize = (neededSize + 65536 + 65535) & ~65535;
 
         ALOGV("resizing buffer to size %zu", neededSize);
 
@@ -424,7 +431,7 @@ status_t ElementaryStreamQueue::appendData(
     }
 
     memcpy(mBuffer->data() + mBuffer->size(), data, size);
-    mBuffer->setRange(0, mBuffer->size() + size);
+    mBuffer->setRange(mBuffer->offset(), mBuffer->size() + size);
 
     RangeInfo info;
     info.mLength = size;
@@ -450,15 +457,10 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnit() {
         RangeInfo info = *mRangeInfos.begin();
         mRangeInfos.erase(mRangeInfos.begin());
 
-        sp<ABuffer> accessUnit = new ABuffer(info.mLength);
-        memcpy(accessUnit->data(), mBuffer->data(), info.mLength);
+        sp<ABuffer> accessUnit = ABuffer::CreateAsSlice(mBuffer, 0, info.mLength);
         accessUnit->meta()->setInt64("timeUs", info.mTimestampUs);
 
-        memmove(mBuffer->data(),
-                mBuffer->data() + info.mLength,
-                mBuffer->size() - info.mLength);
-
-        mBuffer->setRange(0, mBuffer->size() - info.mLength);
+        consume(info.mLength);
 
         if (mFormat == NULL) {
             mFormat = MakeAVCCodecSpecificData(accessUnit);
@@ -514,19 +516,14 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitAC3() {
         mFormat = format;
     }
 
-    sp<ABuffer> accessUnit = new ABuffer(syncStartPos + payloadSize);
-    memcpy(accessUnit->data(), mBuffer->data(), syncStartPos + payloadSize);
+    sp<ABuffer> accessUnit =
+        ABuffer::CreateAsSlice(mBuffer, 0, syncStartPos + payloadSize);
 
     int64_t timeUs = fetchTimestamp(syncStartPos + payloadSize);
     CHECK_GE(timeUs, 0ll);
     accessUnit->meta()->setInt64("timeUs", timeUs);
 
-    memmove(
-            mBuffer->data(),
-            mBuffer->data() + syncStartPos + payloadSize,
-            mBuffer->size() - syncStartPos - payloadSize);
-
-    mBuffer->setRange(0, mBuffer->size() - syncStartPos - payloadSize);
+    consume(syncStartPos + payloadSize);
 
     return accessUnit;
 }
@@ -563,8 +560,7 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitPCMAudio() {
         return NULL;
     }
 
-    sp<ABuffer> accessUnit = new ABuffer(payloadSize);
-    memcpy(accessUnit->data(), mBuffer->data() + 4, payloadSize);
+    sp<ABuffer> accessUnit = ABuffer::CreateAsSlice(mBuffer, 4, payloadSize);
 
     int64_t timeUs = fetchTimestamp(payloadSize + 4);
     CHECK_GE(timeUs, 0ll);
@@ -575,12 +571,7 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitPCMAudio() {
         ptr[i] = ntohs(ptr[i]);
     }
 
-    memmove(
-            mBuffer->data(),
-            mBuffer->data() + 4 + payloadSize,
-            mBuffer->size() - 4 - payloadSize);
-
-    mBuffer->setRange(0, mBuffer->size() - 4 - payloadSize);
+    consume(4 + payloadSize);
 
     return accessUnit;
 }
@@ -678,18 +669,18 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitAAC() {
 
     int64_t timeUs = fetchTimestampAAC(offset);
 
-    sp<ABuffer> accessUnit = new ABuffer(offset);
-    memcpy(accessUnit->data(), mBuffer->data(), offset);
-
-    memmove(mBuffer->data(), mBuffer->data() + offset,
-            mBuffer->size() - offset);
-    mBuffer->setRange(0, mBuffer->size() - offset);
+    sp<ABuffer> accessUnit = ABuffer::CreateAsSlice(mBuffer, 0, offset);
+    consume(offset);
 
     accessUnit->meta()->setInt64("timeUs", timeUs);
 
     return accessUnit;
 }
 
+void ElementaryStreamQueue::consume(size_t size) {
+    mBuffer->setRange(mBuffer->offset() + size, mBuffer->size() - size);
+}
+
 int64_t ElementaryStreamQueue::fetchTimestamp(size_t size) {
     int64_t timeUs = -1;
     bool first = true;
@@ -764,23 +755,31 @@ int64_t ElementaryStreamQueue::fetchTimestampAAC(size_t size) {
     return timeUs;
 }
 
-struct NALPosition {
-    size_t nalOffset;
-    size_t nalSize;
-};
+void ElementaryStreamQueue::resetH264Scan() {
+    mH264NALs.clear();
+    mH264NALsSize = 0;
+    mH264FoundSlice = false;
+}
 
 sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitH264() {
-    const uint8_t *data = mBuffer->data();
-
-    size_t size = mBuffer->size();
-    Vector<NALPosition> nals;
+    Vector<NALPosition> &nals = mH264NALs;
+    size_t &totalSize = mH264NALsSize;
+    bool &foundSlice = mH264FoundSlice;
+
+    // Resume the scan after the last complete nal unit, the startcode of
+    // the next one follows.
+    size_t scanOffset = 0;
+    if (!nals.isEmpty()) {
+        const NALPosition &last = nals.itemAt(nals.size() - 1);
+        scanOffset = last.nalOffset + last.nalSize;
+    }
 
-    size_t totalSize = 0;
+    const uint8_t *data = mBuffer->data() + scanOffset;
+    size_t size = mBuffer->size() - scanOffset;
 
     status_t err;
     const uint8_t *nalStart;
     size_t nalSize;
-    bool foundSlice = false;
     while ((err = getNextNALUnit(&data, &size, &nalStart, &nalSize)) == OK) {
         if (nalSize == 0) continue;
 
@@ -812,7 +811,26 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitH264() {
             // the current one, separated by 0x00 0x00 0x00 0x01 startcodes.
 
             size_t auSize = 4 * nals.size() + totalSize;
-            sp<ABuffer> accessUnit = new ABuffer(auSize);
+
+            // If every nal unit comes with a 4 byte startcode and nothing in
+            // between, the access unit is already laid out in mBuffer.
+            bool contiguous = nals.itemAt(0).nalOffset >= 4;
+            size_t expectedOffset = nals.itemAt(0).nalOffset;
+            for (size_t i = 0; contiguous && i < nals.size(); ++i) {
+                const NALPosition &pos = nals.itemAt(i);
+                contiguous = pos.nalOffset == expectedOffset
+                        && !memcmp(mBuffer->data() + pos.nalOffset - 4,
+                                   "\x00\x00\x00\x01", 4);
+                expectedOffset = pos.nalOffset + pos.nalSize + 4;
+            }
+
+            sp<ABuffer> accessUnit;
+            if (contiguous) {
+                accessUnit = ABuffer::CreateAsSlice(
+                        mBuffer, nals.itemAt(0).nalOffset - 4, auSize);
+            } else {
+                accessUnit = new ABuffer(auSize);
+            }
 
 #if !LOG_NDEBUG
             AString out;
@@ -825,8 +843,8 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitH264() {
                 unsigned nalType = mBuffer->data()[pos.nalOffset] & 0x1f;
 
                 if (nalType == 6) {
-                    sp<ABuffer> sei = new ABuffer(pos.nalSize);
-                    memcpy(sei->data(), mBuffer->data() + pos.nalOffset, pos.nalSize);
+                    sp<ABuffer> sei = ABuffer::CreateAsSlice(
+                            mBuffer, pos.nalOffset, pos.nalSize);
                     accessUnit->meta()->setBuffer("sei", sei);
                 }
 
@@ -839,11 +857,13 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitH264() {
                 out.append(tmp);
 #endif
 
-                memcpy(accessUnit->data() + dstOffset, "\x00\x00\x00\x01", 4);
+                if (!contiguous) {
+                    memcpy(accessUnit->data() + dstOffset, "\x00\x00\x00\x01", 4);
 
-                memcpy(accessUnit->data() + dstOffset + 4,
-                       mBuffer->data() + pos.nalOffset,
-                       pos.nalSize);
+                    memcpy(accessUnit->data() + dstOffset + 4,
+                           mBuffer->data() + pos.nalOffset,
+                           pos.nalSize);
+                }
 
                 dstOffset += pos.nalSize + 4;
             }
@@ -855,11 +875,8 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitH264() {
             const NALPosition &pos = nals.itemAt(nals.size() - 1);
             size_t nextScan = pos.nalOffset + pos.nalSize;
 
-            memmove(mBuffer->data(),
-                    mBuffer->data() + nextScan,
-                    mBuffer->size() - nextScan);
-
-            mBuffer->setRange(0, mBuffer->size() - nextScan);
+            resetH264Scan();
+            consume(nextScan);
 
             int64_t timeUs = fetchTimestamp(nextScan);
             CHECK_GE(timeUs, 0ll);
@@ -911,14 +928,8 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEGAudio() {
 
     unsigned layer = 4 - ((header >> 17) & 3);
 
-    sp<ABuffer> accessUnit = new ABuffer(frameSize);
-    memcpy(accessUnit->data(), data, frameSize);
-
-    memmove(mBuffer->data(),
-            mBuffer->data() + frameSize,
-            mBuffer->size() - frameSize);
-
-    mBuffer->setRange(0, mBuffer->size() - frameSize);
+    sp<ABuffer> accessUnit = ABuffer::CreateAsSlice(mBuffer, 0, frameSize);
+    consume(frameSize);
 
     int64_t timeUs = fetchTimestamp(frameSize);
     CHECK_GE(timeUs, 0ll);
@@ -1013,11 +1024,11 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEGVideo() {
         currentStartCode = data[offset + 3];
 
         if (currentStartCode == 0xb3 && mFormat == NULL) {
-            memmove(mBuffer->data(), mBuffer->data() + offset, size - offset);
+            consume(offset);
+            data = mBuffer->data();
             size -= offset;
             (void)fetchTimestamp(offset);
             offset = 0;
-            mBuffer->setRange(0, size);
         }
 
         if ((prevStartCode == 0xb3 && currentStartCode != 0xb5)
@@ -1040,14 +1051,10 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEGVideo() {
 
                 ALOGI("found MPEG2 video codec config (%d x %d)", width, height);
 
-                sp<ABuffer> csd = new ABuffer(offset);
-                memcpy(csd->data(), data, offset);
+                sp<ABuffer> csd = ABuffer::CreateAsSlice(mBuffer, 0, offset);
 
-                memmove(mBuffer->data(),
-                        mBuffer->data() + offset,
-                        mBuffer->size() - offset);
-
-                mBuffer->setRange(0, mBuffer->size() - offset);
+                consume(offset);
+                data = mBuffer->data();
                 size -= offset;
                 (void)fetchTimestamp(offset);
                 offset = 0;
@@ -1068,14 +1075,12 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEGVideo() {
             if (!sawPictureStart) {
                 sawPictureStart = true;
             } else {
-                sp<ABuffer> accessUnit = new ABuffer(offset);
-                memcpy(accessUnit->data(), data, offset);
-
-                memmove(mBuffer->data(),
-                        mBuffer->data() + offset,
-                        mBuffer->size() - offset);
+                sp<ABuffer> accessUnit =
+                    ABuffer::CreateAsSlice(mBuffer, 0, offset);
 
-                mBuffer->setRange(0, mBuffer->size() - offset);
+                consume(offset);
+                data = mBuffer->data();
+                size -= offset;
 
                 int64_t timeUs = fetchTimestamp(offset);
                 CHECK_GE(timeUs, 0ll);
@@ -1229,12 +1234,10 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEG4Video() {
                 if (chunkType == 0xb6) {
                     offset += chunkSize;
 
-                    sp<ABuffer> accessUnit = new ABuffer(offset);
-                    memcpy(accessUnit->data(), data, offset);
+                    sp<ABuffer> accessUnit =
+                        ABuffer::CreateAsSlice(mBuffer, 0, offset);
 
-                    memmove(data, &data[offset], size - offset);
-                    size -= offset;
-                    mBuffer->setRange(0, size);
+                    consume(offset);
 
                     int64_t timeUs = fetchTimestamp(offset);
                     CHECK_GE(timeUs, 0ll);
@@ -1263,10 +1266,10 @@ sp<ABuffer> ElementaryStreamQueue::dequeueAccessUnitMPEG4Video() {
 
         if (discard) {
             (void)fetchTimestamp(offset);
-            memmove(data, &data[offset], size - offset);
+            consume(offset);
+            data = mBuffer->data();
             size -= offset;
             offset = 0;
-            mBuffer->setRange(0, size);
         } else {
             offset += chunkSize;
         }
@@ -22,6 +22,7 @@
 #include <utils/Errors.h>
 #include <utils/List.h>
 #include <utils/RefBase.h>
+#include <utils/Vector.h>
 
 namespace android {
 
@@ -66,6 +67,18 @@ private:
 
     sp<MetaData> mFormat;
 
+    struct NALPosition {
+        size_t nalOffset;
+        size_t nalSize;
+    };
+
+    // Progress of dequeueAccessUnitH264() through the access unit at the
+    // front of mBuffer, so that appending data does not rescan what came
+    // before: the nal units found so far, relative to mBuffer->data().
+    Vector<NALPosition> mH264NALs;
+    size_t mH264NALsSize;
+    bool mH264FoundSlice;
+
     sp<ABuffer> dequeueAccessUnitH264();
     sp<ABuffer> dequeueAccessUnitAAC();
     sp<ABuffer> dequeueAccessUnitAC3();
@@ -74,6 +87,12 @@ private:
     sp<ABuffer> dequeueAccessUnitMPEG4Video();
     sp<ABuffer> dequeueAccessUnitPCMAudio();
 
+    // drop the first "size" bytes of mBuffer. They are never written to
+    // again, since the access units returned may be slices of them.
+    void consume(size_t size);
+
+    void resetH264Scan();
+
     // consume a logical (compressed) access unit of size "size",
     // returns its timestamp in us (or -1 if no time information).
     int64_t fetchTimestamp(size_t size);
@@ -35,6 +35,13 @@ LOCAL_SHARED_LIBRARIES :=               \
 
 LOCAL_MODULE:= libstagefright_omx
 
+# the NV12 chroma interleave in SoftVideoDecoderOMXComponent.cpp has a NEON path
+ifeq ($(TARGET_ARCH),arm)
+  ifeq ($(ARCH_ARM_HAVE_NEON),true)
+    LOCAL_ARM_NEON := true
+  endif
+endif
+
 include $(BUILD_SHARED_LIBRARY)
 
 ################################################################################
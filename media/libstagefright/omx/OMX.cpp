@@ -27,7 +27,9 @@
 #include "../include/OMXNodeInstance.h"
 
 #include <binder/IMemory.h>
+#include <cutils/properties.h>
 #include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
 #include <utils/threads.h>
 
 #include "OMXMaster.h"
@@ -36,6 +38,28 @@
 
 namespace android {
 
+// A parked component still holds its resources, hand them back eventually.
+static const int64_t kParkedNodeTimeoutUs = 10000000ll;
+
+static size_t GetMaxParkedNodes() {
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("media.stagefright.codec-pool", value, NULL)) {
+        int max = atoi(value);
+        if (max > 0) {
+            return max;
+        }
+    }
+    return 0;
+}
+
+// Only plain decoders: encoders have far more settings that might not be
+// reset by the next client, secure ones are too scarce to hold on to.
+static bool IsPoolable(const char *name) {
+    size_t len = strlen(name);
+    return strstr(name, ".decoder") != NULL
+            && (len < 7 || strcmp(name + len - 7, ".secure"));
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 
 // This provides the underlying Thread used by CallbackDispatcher.
@@ -77,7 +101,7 @@ private:
 
     sp<CallbackDispatcherThread> mThread;
 
-    void dispatch(const omx_message &msg);
+    void dispatch(const List<omx_message> &messages);
 
     CallbackDispatcher(const CallbackDispatcher &);
     CallbackDispatcher &operator=(const CallbackDispatcher &);
@@ -115,17 +139,19 @@ void OMX::CallbackDispatcher::post(const omx_message &msg) {
     mQueueChanged.signal();
 }
 
-void OMX::CallbackDispatcher::dispatch(const omx_message &msg) {
+void OMX::CallbackDispatcher::dispatch(const List<omx_message> &messages) {
     if (mOwner == NULL) {
         ALOGV("Would have dispatched a message to a node that's already gone.");
         return;
     }
-    mOwner->onMessage(msg);
+    mOwner->onMessages(messages);
 }
 
 bool OMX::CallbackDispatcher::loop() {
     for (;;) {
-        omx_message msg;
+        // Everything the component queued while the previous batch was being
+        // delivered goes out together.
+        List<omx_message> messages;
 
         {
             Mutex::Autolock autoLock(mLock);
@@ -137,11 +163,11 @@ bool OMX::CallbackDispatcher::loop() {
                 break;
             }
 
-            msg = *mQueue.begin();
-            mQueue.erase(mQueue.begin());
+            messages = mQueue;
+            mQueue.clear();
         }
 
-        dispatch(msg);
+        dispatch(messages);
     }
 
     return false;
@@ -157,10 +183,13 @@ bool OMX::CallbackDispatcherThread::threadLoop() {
 
 OMX::OMX()
     : mMaster(new OMXMaster),
-      mNodeCounter(0) {
+      mNodeCounter(0),
+      mMaxParkedNodes(GetMaxParkedNodes()) {
 }
 
 OMX::~OMX() {
+    releaseParkedNodes(false /* expiredOnly */);
+
     delete mMaster;
     mMaster = NULL;
 }
@@ -221,11 +250,38 @@ status_t OMX::listNodes(List<ComponentInfo> *list) {
 
 status_t OMX::allocateNode(
         const char *name, const sp<IOMXObserver> &observer, node_id *node) {
+    OMXNodeInstance *instance = takeParkedNode(name);
+    if (instance != NULL) {
+        ALOGV("reusing parked component '%s'", name);
+
+        Mutex::Autolock autoLock(mLock);
+
+        *node = makeNodeID(instance);
+        mDispatchers.add(*node, new CallbackDispatcher(instance));
+
+        instance->reuse(*node, observer);
+
+        mLiveNodes.add(observer->asBinder(), instance);
+        observer->asBinder()->linkToDeath(this);
+
+        return OK;
+    }
+
+    status_t err = allocateNewNode(name, observer, node);
+    if (err != OK && releaseParkedNodes(false /* expiredOnly */) > 0) {
+        // parked components may have been holding on to the hardware
+        err = allocateNewNode(name, observer, node);
+    }
+    return err;
+}
+
+status_t OMX::allocateNewNode(
+        const char *name, const sp<IOMXObserver> &observer, node_id *node) {
     Mutex::Autolock autoLock(mLock);
 
     *node = 0;
 
-    OMXNodeInstance *instance = new OMXNodeInstance(this, observer);
+    OMXNodeInstance *instance = new OMXNodeInstance(this, observer, name);
 
     OMX_COMPONENTTYPE *handle;
     OMX_ERRORTYPE err = mMaster->makeComponentInstance(
@@ -267,18 +323,97 @@ status_t OMX::freeNode(node_id node) {
 
     instance->observer()->asBinder()->unlinkToDeath(this);
 
-    status_t err = instance->freeNode(mMaster);
+    bool parked = mMaxParkedNodes > 0
+            && IsPoolable(instance->componentName()) && instance->park();
+
+    status_t err = parked ? OK : instance->freeNode(mMaster);
 
     {
         Mutex::Autolock autoLock(mLock);
         ssize_t index = mDispatchers.indexOfKey(node);
         CHECK(index >= 0);
         mDispatchers.removeItemsAt(index);
+
+        if (parked) {
+            invalidateNodeID_l(node);
+        }
+    }
+
+    // Only now that nothing from the old session can reach it.
+    if (parked) {
+        parkNode(instance);
     }
 
     return err;
 }
 
+void OMX::parkNode(OMXNodeInstance *instance) {
+    ParkedNode parked;
+    parked.mInstance = instance;
+    parked.mParkedTimeUs = ALooper::GetNowUs();
+
+    List<OMXNodeInstance *> evicted;
+    {
+        Mutex::Autolock autoLock(mParkLock);
+        mParkedNodes.push_back(parked);
+        while (mParkedNodes.size() > mMaxParkedNodes) {
+            evicted.push_back(mParkedNodes.begin()->mInstance);
+            mParkedNodes.erase(mParkedNodes.begin());
+        }
+    }
+
+    for (List<OMXNodeInstance *>::iterator it = evicted.begin();
+            it != evicted.end(); ++it) {
+        (*it)->freeNode(mMaster);
+    }
+}
+
+OMXNodeInstance *OMX::takeParkedNode(const char *name) {
+    if (mMaxParkedNodes == 0) {
+        return NULL;
+    }
+
+    releaseParkedNodes(true /* expiredOnly */);
+
+    Mutex::Autolock autoLock(mParkLock);
+
+    // the most recently parked one is the likeliest to stay warm
+    for (List<ParkedNode>::iterator it = mParkedNodes.end();
+            it != mParkedNodes.begin();) {
+        --it;
+        if (!strcmp(it->mInstance->componentName(), name)) {
+            OMXNodeInstance *instance = it->mInstance;
+            mParkedNodes.erase(it);
+            return instance;
+        }
+    }
+
+    return NULL;
+}
+
+size_t OMX::releaseParkedNodes(bool expiredOnly) {
+    List<OMXNodeInstance *> released;
+    {
+        Mutex::Autolock autoLock(mParkLock);
+
+        int64_t nowUs = ALooper::GetNowUs();
+        while (!mParkedNodes.empty()
+                && (!expiredOnly || nowUs - mParkedNodes.begin()->mParkedTimeUs
+                        >= kParkedNodeTimeoutUs)) {
+            released.push_back(mParkedNodes.begin()->mInstance);
+            mParkedNodes.erase(mParkedNodes.begin());
+        }
+    }
+
+    // freeing may take a while, not under the lock
+    for (List<OMXNodeInstance *>::iterator it = released.begin();
+            it != released.end(); ++it) {
+        (*it)->freeNode(mMaster);
+    }
+
+    return released.size();
+}
+
 status_t OMX::sendCommand(
         node_id node, OMX_COMMANDTYPE cmd, OMX_S32 param) {
     return findInstance(node)->sendCommand(cmd, param);
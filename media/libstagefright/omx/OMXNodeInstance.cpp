@@ -92,16 +92,19 @@ OMX_CALLBACKTYPE OMXNodeInstance::kCallbacks = {
 };
 
 OMXNodeInstance::OMXNodeInstance(
-        OMX *owner, const sp<IOMXObserver> &observer)
+        OMX *owner, const sp<IOMXObserver> &observer, const char *name)
     : mOwner(owner),
       mNodeID(0),
       mHandle(NULL),
       mObserver(observer),
-      mDying(false)
+      mDying(false),
+      mComponentName(name),
+      mReusable(true)
 #ifdef __LP64__
       , mBufferIDCount(0)
 #endif
 {
+    mPortModes[0] = mPortModes[1] = 0;
 }
 
 OMXNodeInstance::~OMXNodeInstance() {
@@ -137,6 +140,10 @@ OMX::node_id OMXNodeInstance::nodeID() {
     return mNodeID;
 }
 
+const char *OMXNodeInstance::componentName() const {
+    return mComponentName.c_str();
+}
+
 static status_t StatusFromOMXError(OMX_ERRORTYPE err) {
     switch (err) {
         case OMX_ErrorNone:
@@ -243,8 +250,11 @@ status_t OMXNodeInstance::freeNode(OMXMaster *master) {
         ALOGE("FreeHandle FAILED with error 0x%08x.", err);
     }
 
-    mOwner->invalidateNodeID(mNodeID);
-    mNodeID = 0;
+    // a parked node no longer has an ID
+    if (mNodeID != 0) {
+        mOwner->invalidateNodeID(mNodeID);
+        mNodeID = 0;
+    }
 
     ALOGV("OMXNodeInstance going away.");
     delete this;
@@ -252,6 +262,72 @@ status_t OMXNodeInstance::freeNode(OMXMaster *master) {
     return StatusFromOMXError(err);
 }
 
+bool OMXNodeInstance::park() {
+    if (!mReusable || mHandle == NULL || !mActiveBuffers.isEmpty()) {
+        return false;
+    }
+
+    OMX_STATETYPE state;
+    if (OMX_GetState(mHandle, &state) != OMX_ErrorNone
+            || state != OMX_StateLoaded) {
+        return false;
+    }
+
+    for (OMX_U32 portIndex = 0; portIndex < 2; ++portIndex) {
+        uint32_t modes = mPortModes[portIndex];
+        if (((modes & kGraphicBuffers)
+                    && enableGraphicBuffers(portIndex, OMX_FALSE) != OK)
+                || ((modes & kMetaDataInBuffers)
+                    && storeMetaDataInBuffers(portIndex, OMX_FALSE) != OK)
+                || ((modes & kAdaptivePlayback)
+                    && prepareForAdaptivePlayback(
+                            portIndex, OMX_FALSE, 0, 0) != OK)) {
+            return false;
+        }
+
+        // a port left disabled would confuse the next client
+        OMX_PARAM_PORTDEFINITIONTYPE def;
+        def.nSize = sizeof(def);
+        def.nVersion.s.nVersionMajor = 1;
+        def.nVersion.s.nVersionMinor = 0;
+        def.nVersion.s.nRevision = 0;
+        def.nVersion.s.nStep = 0;
+        def.nPortIndex = portIndex;
+        if (OMX_GetParameter(mHandle, OMX_IndexParamPortDefinition, &def)
+                    != OMX_ErrorNone
+                || !def.bEnabled) {
+            return false;
+        }
+    }
+
+    // drop anything the component still reports until it is reused
+    mDying = true;
+    mNodeID = 0;
+
+    return true;
+}
+
+void OMXNodeInstance::reuse(
+        OMX::node_id node_id, const sp<IOMXObserver> &observer) {
+    CHECK(mHandle != NULL && mNodeID == 0);
+    mNodeID = node_id;
+    mObserver = observer;
+    mDying = false;
+}
+
+void OMXNodeInstance::notePortMode(
+        OMX_U32 portIndex, uint32_t mode, OMX_BOOL enable) {
+    if (portIndex >= 2) {
+        if (enable) {
+            mReusable = false;
+        }
+    } else if (enable) {
+        mPortModes[portIndex] |= mode;
+    } else {
+        mPortModes[portIndex] &= ~mode;
+    }
+}
+
 status_t OMXNodeInstance::sendCommand(
         OMX_COMMANDTYPE cmd, OMX_S32 param) {
     const sp<GraphicBufferSource>& bufferSource(getGraphicBufferSource());
@@ -290,6 +366,11 @@ status_t OMXNodeInstance::setParameter(
         OMX_INDEXTYPE index, const void *params, size_t /* size */) {
     Mutex::Autolock autoLock(mLock);
 
+    // there is no telling how vendor settings would carry over
+    if (index >= OMX_IndexKhronosExtensions) {
+        mReusable = false;
+    }
+
     OMX_ERRORTYPE err = OMX_SetParameter(
             mHandle, index, const_cast<void *>(params));
     ALOGE_IF(err != OMX_ErrorNone, "setParameter(%d) ERROR: %#x", index, err);
@@ -308,6 +389,10 @@ status_t OMXNodeInstance::setConfig(
         OMX_INDEXTYPE index, const void *params, size_t /* size */) {
     Mutex::Autolock autoLock(mLock);
 
+    if (index >= OMX_IndexKhronosExtensions) {
+        mReusable = false;
+    }
+
     OMX_ERRORTYPE err = OMX_SetConfig(
             mHandle, index, const_cast<void *>(params));
 
@@ -357,6 +442,8 @@ status_t OMXNodeInstance::enableGraphicBuffers(
         return UNKNOWN_ERROR;
     }
 
+    notePortMode(portIndex, kGraphicBuffers, enable);
+
     return OK;
 }
 
@@ -401,9 +488,13 @@ status_t OMXNodeInstance::storeMetaDataInBuffers(
         OMX_U32 portIndex,
         OMX_BOOL enable) {
     Mutex::Autolock autolock(mLock);
-    return storeMetaDataInBuffers_l(
+    status_t err = storeMetaDataInBuffers_l(
             portIndex, enable,
             OMX_FALSE /* useGraphicBuffer */, NULL /* usingGraphicBufferInMetadata */);
+    if (err == OK) {
+        notePortMode(portIndex, kMetaDataInBuffers, enable);
+    }
+    return err;
 }
 
 status_t OMXNodeInstance::storeMetaDataInBuffers_l(
@@ -485,6 +576,7 @@ status_t OMXNodeInstance::prepareForAdaptivePlayback(
               "with error %d (0x%08x)", err, err);
         return UNKNOWN_ERROR;
     }
+    notePortMode(portIndex, kAdaptivePlayback, enable);
     return err;
 }
 
@@ -493,6 +585,8 @@ status_t OMXNodeInstance::configureVideoTunnelMode(
         native_handle_t **sidebandHandle) {
     Mutex::Autolock autolock(mLock);
 
+    mReusable = false;
+
     OMX_INDEXTYPE index;
     OMX_STRING name = const_cast<OMX_STRING>(
             "OMX.google.android.index.configureVideoTunnelMode");
@@ -705,6 +799,8 @@ status_t OMXNodeInstance::createInputSurface(
     Mutex::Autolock autolock(mLock);
     status_t err;
 
+    mReusable = false;
+
     const sp<GraphicBufferSource>& surfaceCheck = getGraphicBufferSource();
     if (surfaceCheck != NULL) {
         return ALREADY_EXISTS;
@@ -988,7 +1084,7 @@ status_t OMXNodeInstance::setInternalOption(
     }
 }
 
-void OMXNodeInstance::onMessage(const omx_message &msg) {
+bool OMXNodeInstance::handleMessage(omx_message &msg) {
     const sp<GraphicBufferSource>& bufferSource(getGraphicBufferSource());
 
     if (msg.type == omx_message::FILL_BUFFER_DONE) {
@@ -1004,10 +1100,7 @@ void OMXNodeInstance::onMessage(const omx_message &msg) {
             // fix up the buffer info (especially timestamp) if needed
             bufferSource->codecBufferFilled(buffer);
 
-            omx_message newMsg = msg;
-            newMsg.u.extended_buffer_data.timestamp = buffer->nTimeStamp;
-            mObserver->onMessage(newMsg);
-            return;
+            msg.u.extended_buffer_data.timestamp = buffer->nTimeStamp;
         }
     } else if (msg.type == omx_message::EMPTY_BUFFER_DONE) {
         if (bufferSource != NULL) {
@@ -1021,11 +1114,28 @@ void OMXNodeInstance::onMessage(const omx_message &msg) {
                 findBufferHeader(msg.u.buffer_data.buffer);
 
             bufferSource->codecBufferEmptied(buffer);
-            return;
+            return true;
         }
     }
 
-    mObserver->onMessage(msg);
+    return false;
+}
+
+void OMXNodeInstance::onMessages(const List<omx_message> &messages) {
+    List<omx_message> forward;
+    for (List<omx_message>::const_iterator it = messages.begin();
+            it != messages.end(); ++it) {
+        omx_message msg = *it;
+        if (!handleMessage(msg)) {
+            forward.push_back(msg);
+        }
+    }
+
+    if (forward.size() == 1) {
+        mObserver->onMessage(*forward.begin());
+    } else if (!forward.empty()) {
+        mObserver->onMessages(forward);
+    }
 }
 
 void OMXNodeInstance::onObserverDied(OMXMaster *master) {
@@ -1045,6 +1155,10 @@ void OMXNodeInstance::onEvent(
         OMX_EVENTTYPE event, OMX_U32 arg1, OMX_U32 arg2) {
     const sp<GraphicBufferSource>& bufferSource(getGraphicBufferSource());
 
+    if (event == OMX_EventError) {
+        mReusable = false;
+    }
+
     if (bufferSource != NULL
             && event == OMX_EventCmdComplete
             && arg1 == OMX_CommandStateSet
@@ -28,6 +28,10 @@
 #include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/MediaDefs.h>
 
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 namespace android {
 
 template<class T>
@@ -60,6 +64,8 @@ SoftVideoDecoderOMXComponent::SoftVideoDecoderOMXComponent(
         mCropTop(0),
         mCropWidth(width),
         mCropHeight(height),
+        mSupportsSemiPlanarOutput(false),
+        mOutputColorFormat(OMX_COLOR_FormatYUV420Planar),
         mOutputPortSettingsChange(NONE),
         mComponentRole(componentRole),
         mCodingType(codingType),
@@ -214,6 +220,48 @@ void SoftVideoDecoderOMXComponent::handlePortSettingsChange(
     }
 }
 
+// A plane without padding on either side is copied at once, which lets memcpy() use its
+// large copy path instead of restarting on every row.
+static void copyPlane(
+        uint8_t *dst, size_t dstStride, const uint8_t *src, size_t srcStride,
+        size_t width, size_t height) {
+    if (srcStride == width && dstStride == width) {
+        memcpy(dst, src, width * height);
+        return;
+    }
+
+    for (size_t i = 0; i < height; ++i) {
+        memcpy(dst, src, width);
+        src += srcStride;
+        dst += dstStride;
+    }
+}
+
+// Interleaves two chroma planes of width x height samples into one plane, U first.
+static void interleavePlanes(
+        uint8_t *dst, size_t dstStride,
+        const uint8_t *srcU, size_t srcUStride, const uint8_t *srcV, size_t srcVStride,
+        size_t width, size_t height) {
+    for (size_t i = 0; i < height; ++i) {
+        size_t x = 0;
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+        for (; x + 16 <= width; x += 16) {
+            uint8x16x2_t uv;
+            uv.val[0] = vld1q_u8(srcU + x);
+            uv.val[1] = vld1q_u8(srcV + x);
+            vst2q_u8(dst + 2 * x, uv);
+        }
+#endif
+        for (; x < width; ++x) {
+            dst[2 * x] = srcU[x];
+            dst[2 * x + 1] = srcV[x];
+        }
+        srcU += srcUStride;
+        srcV += srcVStride;
+        dst += dstStride;
+    }
+}
+
 void SoftVideoDecoderOMXComponent::copyYV12FrameToOutputBuffer(
         uint8_t *dst, const uint8_t *srcY, const uint8_t *srcU, const uint8_t *srcV,
         size_t srcYStride, size_t srcUStride, size_t srcVStride) {
@@ -222,25 +270,18 @@ void SoftVideoDecoderOMXComponent::copyYV12FrameToOutputBuffer(
     size_t dstHeight = outputBufferHeight();
     uint8_t *dstStart = dst;
 
-    for (size_t i = 0; i < mHeight; ++i) {
-         memcpy(dst, srcY, mWidth);
-         srcY += srcYStride;
-         dst += dstYStride;
-    }
+    copyPlane(dst, dstYStride, srcY, srcYStride, mWidth, mHeight);
 
     dst = dstStart + dstYStride * dstHeight;
-    for (size_t i = 0; i < mHeight / 2; ++i) {
-         memcpy(dst, srcU, mWidth / 2);
-         srcU += srcUStride;
-         dst += dstUVStride;
+    if (mOutputColorFormat == OMX_COLOR_FormatYUV420SemiPlanar) {
+        interleavePlanes(
+                dst, dstYStride, srcU, srcUStride, srcV, srcVStride, mWidth / 2, mHeight / 2);
+        return;
     }
+    copyPlane(dst, dstUVStride, srcU, srcUStride, mWidth / 2, mHeight / 2);
 
     dst = dstStart + (5 * dstYStride * dstHeight) / 4;
-    for (size_t i = 0; i < mHeight / 2; ++i) {
-         memcpy(dst, srcV, mWidth / 2);
-         srcV += srcVStride;
-         dst += dstUVStride;
-    }
+    copyPlane(dst, dstUVStride, srcV, srcVStride, mWidth / 2, mHeight / 2);
 }
 
 OMX_ERRORTYPE SoftVideoDecoderOMXComponent::internalGetParameter(
@@ -255,7 +296,11 @@ OMX_ERRORTYPE SoftVideoDecoderOMXComponent::internalGetParameter(
                 return OMX_ErrorUndefined;
             }
 
-            if (formatParams->nIndex != 0) {
+            // planar output comes first, it is what SoftwareRenderer shows without conversion
+            const OMX_U32 numFormats =
+                (formatParams->nPortIndex == kOutputPortIndex && mSupportsSemiPlanarOutput)
+                        ? 2 : 1;
+            if (formatParams->nIndex >= numFormats) {
                 return OMX_ErrorNoMore;
             }
 
@@ -267,7 +312,8 @@ OMX_ERRORTYPE SoftVideoDecoderOMXComponent::internalGetParameter(
                 CHECK_EQ(formatParams->nPortIndex, 1u);
 
                 formatParams->eCompressionFormat = OMX_VIDEO_CodingUnused;
-                formatParams->eColorFormat = OMX_COLOR_FormatYUV420Planar;
+                formatParams->eColorFormat = formatParams->nIndex == 0
+                        ? OMX_COLOR_FormatYUV420Planar : OMX_COLOR_FormatYUV420SemiPlanar;
                 formatParams->xFramerate = 0;
             }
 
@@ -327,6 +373,18 @@ OMX_ERRORTYPE SoftVideoDecoderOMXComponent::internalSetParameter(
                 return OMX_ErrorUndefined;
             }
 
+            if (formatParams->nPortIndex == kOutputPortIndex) {
+                if (formatParams->eColorFormat != OMX_COLOR_FormatYUV420Planar
+                        && (formatParams->eColorFormat != OMX_COLOR_FormatYUV420SemiPlanar
+                                || !mSupportsSemiPlanarOutput)) {
+                    return OMX_ErrorUnsupportedSetting;
+                }
+                mOutputColorFormat = formatParams->eColorFormat;
+                editPortInfo(kOutputPortIndex)->mDef.format.video.eColorFormat =
+                        mOutputColorFormat;
+                return OMX_ErrorNone;
+            }
+
             if (formatParams->nIndex != 0) {
                 return OMX_ErrorNoMore;
             }
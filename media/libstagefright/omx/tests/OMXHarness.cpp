@@ -21,6 +21,7 @@
 
 #include "OMXHarness.h"
 
+#include <pthread.h>
 #include <sys/time.h>
 
 #include <binder/ProcessState.h>
@@ -67,7 +68,8 @@ status_t Harness::initOMX() {
 void Harness::onMessage(const omx_message &msg) {
     Mutex::Autolock autoLock(mLock);
     mMessageQueue.push_back(msg);
-    mMessageAddedCondition.signal();
+    // the benchmark has a thread waiting for each of its nodes
+    mMessageAddedCondition.broadcast();
 }
 
 status_t Harness::dequeueMessageForNode(
@@ -785,12 +787,365 @@ status_t Harness::testAll() {
     return OK;
 }
 
+static void PrintTimes(const char *what, Vector<int64_t> *timesUs) {
+    if (timesUs->isEmpty()) {
+        printf("  %s: not measured\n", what);
+        return;
+    }
+
+    // insertion sort, there are only so many iterations
+    for (size_t i = 1; i < timesUs->size(); ++i) {
+        int64_t x = (*timesUs)[i];
+        size_t j = i;
+        while (j > 0 && (*timesUs)[j - 1] > x) {
+            timesUs->editItemAt(j) = (*timesUs)[j - 1];
+            --j;
+        }
+        timesUs->editItemAt(j) = x;
+    }
+
+    size_t n = timesUs->size();
+    printf("  %s: median %" PRId64 " us, 90%% %" PRId64 " us, max %" PRId64
+           " us (%zu runs)\n",
+           what, (*timesUs)[n / 2], (*timesUs)[(n * 9) / 10], (*timesUs)[n - 1], n);
+}
+
+status_t Harness::waitForCommandComplete(
+        IOMX::node_id node, OMX_COMMANDTYPE command, OMX_U32 data,
+        Vector<Buffer> *inputBuffers,
+        Vector<Buffer> *outputBuffers) {
+    for (;;) {
+        omx_message msg;
+        status_t err = dequeueMessageForNodeIgnoringBuffers(
+                node, inputBuffers, outputBuffers, &msg, DEFAULT_TIMEOUT);
+        if (err != OK) {
+            return err;
+        }
+        if (msg.type == omx_message::EVENT
+                && msg.u.event_data.event == OMX_EventCmdComplete
+                && msg.u.event_data.data1 == (OMX_U32)command
+                && msg.u.event_data.data2 == data) {
+            return OK;
+        }
+        if (msg.type == omx_message::EVENT
+                && msg.u.event_data.event == OMX_EventError) {
+            return UNKNOWN_ERROR;
+        }
+        // anything else, e.g. port settings changes, doesn't matter here
+    }
+}
+
+status_t Harness::startNode(
+        const sp<MemoryDealer> &dealer,
+        IOMX::node_id node, const char *componentRole,
+        Vector<Buffer> *inputBuffers,
+        Vector<Buffer> *outputBuffers) {
+    status_t err = setRole(node, componentRole);
+    EXPECT_SUCCESS(err, "setRole");
+
+    err = mOMX->sendCommand(node, OMX_CommandStateSet, OMX_StateIdle);
+    EXPECT_SUCCESS(err, "sendCommand(go-to-Idle)");
+
+    err = allocatePortBuffers(dealer, node, 0, inputBuffers);
+    EXPECT_SUCCESS(err, "allocatePortBuffers(input)");
+
+    err = allocatePortBuffers(dealer, node, 1, outputBuffers);
+    EXPECT_SUCCESS(err, "allocatePortBuffers(output)");
+
+    err = waitForCommandComplete(
+            node, OMX_CommandStateSet, OMX_StateIdle, NULL, NULL);
+    EXPECT_SUCCESS(err, "transition to idle");
+
+    err = mOMX->sendCommand(node, OMX_CommandStateSet, OMX_StateExecuting);
+    EXPECT_SUCCESS(err, "sendCommand(go-to-Executing)");
+
+    err = waitForCommandComplete(
+            node, OMX_CommandStateSet, OMX_StateExecuting, NULL, NULL);
+    EXPECT_SUCCESS(err, "transition to executing");
+
+    return OK;
+}
+
+status_t Harness::stopNode(
+        IOMX::node_id node,
+        Vector<Buffer> *inputBuffers,
+        Vector<Buffer> *outputBuffers) {
+    status_t err = mOMX->sendCommand(node, OMX_CommandStateSet, OMX_StateIdle);
+    EXPECT_SUCCESS(err, "sendCommand(go-to-Idle)");
+
+    err = waitForCommandComplete(
+            node, OMX_CommandStateSet, OMX_StateIdle,
+            inputBuffers, outputBuffers);
+    EXPECT_SUCCESS(err, "transition to idle");
+
+    err = mOMX->sendCommand(node, OMX_CommandStateSet, OMX_StateLoaded);
+    EXPECT_SUCCESS(err, "sendCommand(go-to-Loaded)");
+
+    for (size_t i = 0; i < inputBuffers->size(); ++i) {
+        err = mOMX->freeBuffer(node, 0, (*inputBuffers)[i].mID);
+        EXPECT_SUCCESS(err, "freeBuffer");
+    }
+    for (size_t i = 0; i < outputBuffers->size(); ++i) {
+        err = mOMX->freeBuffer(node, 1, (*outputBuffers)[i].mID);
+        EXPECT_SUCCESS(err, "freeBuffer");
+    }
+    inputBuffers->clear();
+    outputBuffers->clear();
+
+    err = waitForCommandComplete(
+            node, OMX_CommandStateSet, OMX_StateLoaded, NULL, NULL);
+    EXPECT_SUCCESS(err, "transition to loaded");
+
+    return mOMX->freeNode(node);
+}
+
+// Sends empty input buffers through an executing node one at a time, with
+// all of the output buffers given to the component for it not to hold the
+// input back for the lack of them.
+status_t Harness::measureRoundTrips(
+        IOMX::node_id node,
+        Vector<Buffer> *inputBuffers,
+        Vector<Buffer> *outputBuffers,
+        int iterations, Vector<int64_t> *timesUs) {
+    CHECK(!inputBuffers->isEmpty());
+
+    for (size_t i = 0; i < outputBuffers->size(); ++i) {
+        status_t err = mOMX->fillBuffer(node, (*outputBuffers)[i].mID);
+        EXPECT_SUCCESS(err, "fillBuffer");
+        outputBuffers->editItemAt(i).mFlags |= kBufferBusy;
+    }
+
+    IOMX::buffer_id id = (*inputBuffers)[0].mID;
+    for (int i = 0; i < iterations; ++i) {
+        int64_t startUs = ALooper::GetNowUs();
+        status_t err = mOMX->emptyBuffer(
+                node, id, 0 /* offset */, 0 /* length */, 0 /* flags */, 0 /* timestamp */);
+        EXPECT_SUCCESS(err, "emptyBuffer");
+
+        for (;;) {
+            omx_message msg;
+            err = dequeueMessageForNode(node, &msg, DEFAULT_TIMEOUT);
+            if (err != OK) {
+                // the component keeps empty input, nothing to measure
+                return err;
+            }
+            if (msg.type == omx_message::EMPTY_BUFFER_DONE
+                    && msg.u.buffer_data.buffer == id) {
+                timesUs->push(ALooper::GetNowUs() - startUs);
+                break;
+            }
+            if (msg.type == omx_message::FILL_BUFFER_DONE) {
+                err = mOMX->fillBuffer(node, msg.u.buffer_data.buffer);
+                EXPECT_SUCCESS(err, "fillBuffer");
+            }
+        }
+    }
+
+    return OK;
+}
+
+struct BenchmarkInstance {
+    sp<Harness> mHarness;
+    const char *mComponentName;
+    const char *mComponentRole;
+    int mIterations;
+    status_t mStatus;
+    pthread_t mThread;
+};
+
+// static
+void *Harness::BenchmarkInstanceThread(void *me) {
+    BenchmarkInstance *instance = static_cast<BenchmarkInstance *>(me);
+    Harness *harness = instance->mHarness.get();
+
+    sp<MemoryDealer> dealer = new MemoryDealer(16 * 1024 * 1024, "OMXHarness");
+    IOMX::node_id node;
+    instance->mStatus =
+        harness->mOMX->allocateNode(instance->mComponentName, harness, &node);
+    if (instance->mStatus != OK) {
+        return NULL;
+    }
+
+    NodeReaper reaper(harness, node);
+    Vector<Buffer> inputBuffers;
+    Vector<Buffer> outputBuffers;
+    Vector<int64_t> timesUs;
+    instance->mStatus = harness->startNode(
+            dealer, node, instance->mComponentRole, &inputBuffers, &outputBuffers);
+    if (instance->mStatus == OK) {
+        instance->mStatus = harness->measureRoundTrips(
+                node, &inputBuffers, &outputBuffers, instance->mIterations, &timesUs);
+    }
+    if (instance->mStatus == OK) {
+        instance->mStatus = harness->stopNode(node, &inputBuffers, &outputBuffers);
+        if (instance->mStatus == OK) {
+            reaper.disarm();
+        }
+    }
+    return NULL;
+}
+
+status_t Harness::benchmark(
+        const char *componentName, const char *componentRole,
+        int iterations, int maxInstances) {
+    if (strncmp(componentName, "OMX.", 4)) {
+        return OK;
+    }
+
+    printf("benchmarking %s [%s]\n", componentName, componentRole);
+    ALOGI("benchmarking %s [%s].", componentName, componentRole);
+
+    Vector<int64_t> timesUs;
+    for (int i = 0; i < iterations; ++i) {
+        int64_t startUs = ALooper::GetNowUs();
+        IOMX::node_id node;
+        status_t err = mOMX->allocateNode(componentName, this, &node);
+        EXPECT_SUCCESS(err, "allocateNode");
+        timesUs.push(ALooper::GetNowUs() - startUs);
+
+        err = mOMX->freeNode(node);
+        EXPECT_SUCCESS(err, "freeNode");
+    }
+    PrintTimes("allocateNode", &timesUs);
+
+    sp<MemoryDealer> dealer = new MemoryDealer(16 * 1024 * 1024, "OMXHarness");
+    IOMX::node_id node;
+    status_t err = mOMX->allocateNode(componentName, this, &node);
+    EXPECT_SUCCESS(err, "allocateNode");
+
+    NodeReaper reaper(this, node);
+
+    Vector<Buffer> inputBuffers;
+    Vector<Buffer> outputBuffers;
+    err = startNode(dealer, node, componentRole, &inputBuffers, &outputBuffers);
+    if (err != OK) {
+        return err;
+    }
+
+    // what a port settings change costs, less the component's own work
+    timesUs.clear();
+    for (int i = 0; i < iterations; ++i) {
+        int64_t startUs = ALooper::GetNowUs();
+        err = mOMX->sendCommand(node, OMX_CommandPortDisable, 1);
+        EXPECT_SUCCESS(err, "sendCommand(disable-output-port)");
+
+        for (size_t j = 0; j < outputBuffers.size(); ++j) {
+            err = mOMX->freeBuffer(node, 1, outputBuffers[j].mID);
+            EXPECT_SUCCESS(err, "freeBuffer");
+        }
+        outputBuffers.clear();
+
+        err = waitForCommandComplete(
+                node, OMX_CommandPortDisable, 1, &inputBuffers, NULL);
+        EXPECT_SUCCESS(err, "disabling the output port");
+
+        err = mOMX->sendCommand(node, OMX_CommandPortEnable, 1);
+        EXPECT_SUCCESS(err, "sendCommand(enable-output-port)");
+
+        err = allocatePortBuffers(dealer, node, 1, &outputBuffers);
+        EXPECT_SUCCESS(err, "allocatePortBuffers(output)");
+
+        err = waitForCommandComplete(
+                node, OMX_CommandPortEnable, 1, &inputBuffers, &outputBuffers);
+        EXPECT_SUCCESS(err, "enabling the output port");
+
+        timesUs.push(ALooper::GetNowUs() - startUs);
+    }
+    PrintTimes("output port reconfiguration", &timesUs);
+
+    // binder and OMXNodeInstance alone
+    timesUs.clear();
+    for (int i = 0; i < iterations; ++i) {
+        OMX_PARAM_PORTDEFINITIONTYPE def;
+        int64_t startUs = ALooper::GetNowUs();
+        err = getPortDefinition(node, 0, &def);
+        EXPECT_SUCCESS(err, "getPortDefinition");
+        timesUs.push(ALooper::GetNowUs() - startUs);
+    }
+    PrintTimes("getParameter round trip", &timesUs);
+
+    timesUs.clear();
+    if (measureRoundTrips(node, &inputBuffers, &outputBuffers, iterations, &timesUs) != OK) {
+        timesUs.clear();
+    }
+    PrintTimes("emptyBuffer round trip", &timesUs);
+
+    err = stopNode(node, &inputBuffers, &outputBuffers);
+    EXPECT_SUCCESS(err, "stopNode");
+    reaper.disarm();
+
+    // every instance sends its round trips from a thread of its own
+    for (int n = 1; n <= maxInstances; n *= 2) {
+        Vector<BenchmarkInstance> instances;
+        instances.resize(n);
+
+        int64_t startUs = ALooper::GetNowUs();
+        for (int i = 0; i < n; ++i) {
+            BenchmarkInstance *instance = &instances.editItemAt(i);
+            instance->mHarness = this;
+            instance->mComponentName = componentName;
+            instance->mComponentRole = componentRole;
+            instance->mIterations = iterations;
+            instance->mStatus = OK;
+            CHECK_EQ(pthread_create(&instance->mThread, NULL,
+                    BenchmarkInstanceThread, instance), 0);
+        }
+
+        status_t status = OK;
+        for (int i = 0; i < n; ++i) {
+            BenchmarkInstance *instance = &instances.editItemAt(i);
+            pthread_join(instance->mThread, NULL);
+            if (instance->mStatus != OK) {
+                status = instance->mStatus;
+            }
+        }
+        int64_t elapsedUs = ALooper::GetNowUs() - startUs;
+
+        if (status != OK) {
+            printf("  %d instances: failed (%d)\n", n, status);
+            break;
+        }
+        printf("  %d instances: %.1f round trips/sec in all, setup included\n",
+               n, (double)n * iterations * 1E6 / elapsedUs);
+    }
+
+    return OK;
+}
+
+status_t Harness::benchmarkAll(int iterations, int maxInstances) {
+    List<IOMX::ComponentInfo> componentInfos;
+    status_t err = mOMX->listNodes(&componentInfos);
+    EXPECT_SUCCESS(err, "listNodes");
+
+    for (List<IOMX::ComponentInfo>::iterator it = componentInfos.begin();
+         it != componentInfos.end(); ++it) {
+        const IOMX::ComponentInfo &info = *it;
+        const char *componentName = info.mName.string();
+
+        if (strncmp(componentName, "OMX.google.", 11)) {
+            continue;
+        }
+
+        // the first role is enough for the overhead of a component
+        if (!info.mRoles.empty()) {
+            benchmark(componentName, (*info.mRoles.begin()).string(),
+                      iterations, maxInstances);
+        }
+    }
+
+    return OK;
+}
+
 }  // namespace android
 
 static void usage(const char *me) {
     fprintf(stderr, "usage: %s\n"
                     "  -h(elp)  Show this information\n"
                     "  -s(eed)  Set the random seed\n"
+                    "  -b(enchmark) iterations  Time IOMX calls instead of "
+                    "testing the components\n"
+                    "  -n instances  Most nodes to run at once in the "
+                    "benchmark (default 4)\n"
                     "    [ component role ]\n\n"
                     "When launched without specifying a specific component "
                     "and role, tool will test all available OMX components "
@@ -811,9 +1166,11 @@ int main(int argc, char **argv) {
     const char *me = argv[0];
 
     unsigned long seed = 0xdeadbeef;
+    int benchmarkIterations = 0;
+    int maxInstances = 4;
 
     int res;
-    while ((res = getopt(argc, argv, "hs:")) >= 0) {
+    while ((res = getopt(argc, argv, "hs:b:n:")) >= 0) {
         switch (res) {
             case 's':
             {
@@ -829,6 +1186,25 @@ int main(int argc, char **argv) {
                 break;
             }
 
+            case 'b':
+            case 'n':
+            {
+                char *end;
+                long x = strtol(optarg, &end, 10);
+
+                if (*end != '\0' || end == optarg || x <= 0) {
+                    fprintf(stderr, "Malformed count.\n");
+                    return 1;
+                }
+
+                if (res == 'b') {
+                    benchmarkIterations = x;
+                } else {
+                    maxInstances = x;
+                }
+                break;
+            }
+
             case '?':
                 fprintf(stderr, "\n");
                 // fall through
@@ -854,6 +1230,15 @@ int main(int argc, char **argv) {
     sp<Harness> h = new Harness;
     CHECK_EQ(h->initCheck(), (status_t)OK);
 
+    if (benchmarkIterations > 0) {
+        if (argc == 0) {
+            h->benchmarkAll(benchmarkIterations, maxInstances);
+        } else if (argc == 2) {
+            h->benchmark(argv[0], argv[1], benchmarkIterations, maxInstances);
+        }
+        return 0;
+    }
+
     if (argc == 0) {
         h->testAll();
     } else if (argc == 2) {
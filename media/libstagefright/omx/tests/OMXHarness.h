@@ -74,6 +74,16 @@ struct Harness : public BnOMXObserver {
 
     status_t testAll();
 
+    // Times allocateNode, a disable/enable cycle of the output port, the
+    // round trip of an empty input buffer and of getParameter, and how the
+    // round trips scale with up to maxInstances nodes of the component
+    // running at once.
+    status_t benchmark(
+            const char *componentName, const char *componentRole,
+            int iterations, int maxInstances);
+
+    status_t benchmarkAll(int iterations, int maxInstances);
+
     virtual void onMessage(const omx_message &msg);
 
 protected:
@@ -91,6 +101,32 @@ private:
 
     status_t initOMX();
 
+    // Loaded -> Idle -> Executing, allocating the buffers of both ports.
+    status_t startNode(
+            const sp<MemoryDealer> &dealer,
+            IOMX::node_id node, const char *componentRole,
+            Vector<Buffer> *inputBuffers,
+            Vector<Buffer> *outputBuffers);
+
+    // Executing -> Idle -> Loaded, freeing the buffers, then the node.
+    status_t stopNode(
+            IOMX::node_id node,
+            Vector<Buffer> *inputBuffers,
+            Vector<Buffer> *outputBuffers);
+
+    status_t waitForCommandComplete(
+            IOMX::node_id node, OMX_COMMANDTYPE command, OMX_U32 data,
+            Vector<Buffer> *inputBuffers,
+            Vector<Buffer> *outputBuffers);
+
+    status_t measureRoundTrips(
+            IOMX::node_id node,
+            Vector<Buffer> *inputBuffers,
+            Vector<Buffer> *outputBuffers,
+            int iterations, Vector<int64_t> *timesUs);
+
+    static void *BenchmarkInstanceThread(void *me);
+
     bool handleBufferMessage(
             const omx_message &msg,
             Vector<Buffer> *inputBuffers,
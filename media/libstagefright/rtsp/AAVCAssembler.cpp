@@ -31,6 +31,13 @@
 
 namespace android {
 
+// Set on the fragments of a NAL unit that follow its first one in
+// mNALUnits, which take no start code.
+static bool ContinuesNALUnit(const sp<ABuffer> &piece) {
+    int32_t continued;
+    return piece->meta()->findInt32("fu-continued", &continued) && continued;
+}
+
 // static
 AAVCAssembler::AAVCAssembler(const sp<AMessage> &notify)
     : mNotifyMsg(notify),
@@ -159,8 +166,8 @@ bool AAVCAssembler::addSingleTimeAggregationPacket(const sp<ABuffer> &buffer) {
             return false;
         }
 
-        sp<ABuffer> unit = new ABuffer(nalSize);
-        memcpy(unit->data(), &data[2], nalSize);
+        sp<ABuffer> unit =
+            ABuffer::CreateAsSlice(buffer, &data[2] - buffer->data(), nalSize);
 
         CopyTimes(unit, buffer);
 
@@ -280,16 +287,9 @@ ARTPAssembler::AssemblyStatus AAVCAssembler::addFragmentedNALUnit(
 
     // We found all the fragments that make up the complete NAL unit.
 
-    // Leave room for the header. So far totalSize did not include the
-    // header byte.
-    ++totalSize;
-
-    sp<ABuffer> unit = new ABuffer(totalSize);
-    CopyTimes(unit, *queue->begin());
-
-    unit->data()[0] = (nri << 5) | nalType;
-
-    size_t offset = 1;
+    // They are kept as slices of their packets, the first one starting with
+    // the NAL unit header rebuilt over its FU header, and copied only once,
+    // into the access unit.
     List<sp<ABuffer> >::iterator it = queue->begin();
     for (size_t i = 0; i < totalCount; ++i) {
         const sp<ABuffer> &buffer = *it;
@@ -299,17 +299,27 @@ ARTPAssembler::AssemblyStatus AAVCAssembler::addFragmentedNALUnit(
         hexdump(buffer->data(), buffer->size());
 #endif
 
-        memcpy(unit->data() + offset, buffer->data() + 2, buffer->size() - 2);
-        offset += buffer->size() - 2;
+        if (i == 0) {
+            buffer->data()[1] = (nri << 5) | nalType;
 
-        it = queue->erase(it);
-    }
+            sp<ABuffer> piece =
+                ABuffer::CreateAsSlice(buffer, 1, buffer->size() - 1);
+            CopyTimes(piece, buffer);
 
-    unit->setRange(0, totalSize);
+            addSingleNALUnit(piece);
+        } else {
+            sp<ABuffer> piece =
+                ABuffer::CreateAsSlice(buffer, 2, buffer->size() - 2);
+            piece->meta()->setInt32("fu-continued", true);
 
-    addSingleNALUnit(unit);
+            mNALUnits.push_back(piece);
+        }
+
+        it = queue->erase(it);
+    }
 
-    ALOGV("successfully assembled a NAL unit from fragments.");
+    ALOGV("successfully assembled a NAL unit of %zu bytes from fragments.",
+         totalSize + 1);
 
     return OK;
 }
@@ -322,15 +332,20 @@ void AAVCAssembler::submitAccessUnit() {
     size_t totalSize = 0;
     for (List<sp<ABuffer> >::iterator it = mNALUnits.begin();
          it != mNALUnits.end(); ++it) {
-        totalSize += 4 + (*it)->size();
+        if (!ContinuesNALUnit(*it)) {
+            totalSize += 4;
+        }
+        totalSize += (*it)->size();
     }
 
     sp<ABuffer> accessUnit = new ABuffer(totalSize);
     size_t offset = 0;
     for (List<sp<ABuffer> >::iterator it = mNALUnits.begin();
          it != mNALUnits.end(); ++it) {
-        memcpy(accessUnit->data() + offset, "\x00\x00\x00\x01", 4);
-        offset += 4;
+        if (!ContinuesNALUnit(*it)) {
+            memcpy(accessUnit->data() + offset, "\x00\x00\x00\x01", 4);
+            offset += 4;
+        }
 
         sp<ABuffer> nal = *it;
         memcpy(accessUnit->data() + offset, nal->data(), nal->size());
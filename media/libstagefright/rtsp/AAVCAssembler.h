@@ -45,6 +45,7 @@ private:
     bool mNextExpectedSeqNoValid;
     uint32_t mNextExpectedSeqNo;
     bool mAccessUnitDamaged;
+    // NAL units of the access unit being assembled, or fragments of them
     List<sp<ABuffer> > mNALUnits;
 
     AssemblyStatus addNALUnit(const sp<ARTPSource> &source);
@@ -350,8 +350,9 @@ ARTPAssembler::AssemblyStatus AMPEG4ElementaryAssembler::addPacket(
                 return MALFORMED_PACKET;
             }
 
-            sp<ABuffer> accessUnit = new ABuffer(header.mSize);
-            memcpy(accessUnit->data(), buffer->data() + offset, header.mSize);
+            // copied once, by MakeADTSCompoundFromAACFrames
+            sp<ABuffer> accessUnit =
+                ABuffer::CreateAsSlice(buffer, offset, header.mSize);
 
             offset += header.mSize;
 
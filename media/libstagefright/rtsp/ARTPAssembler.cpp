@@ -16,6 +16,8 @@
 
 #include "ARTPAssembler.h"
 
+#include "ARTPSource.h"
+
 #include <media/stagefright/foundation/ABuffer.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/ALooper.h>
@@ -36,10 +38,12 @@ void ARTPAssembler::onPacketReceived(const sp<ARTPSource> &source) {
 
         if (status == WRONG_SEQUENCE_NUMBER) {
             if (mFirstFailureTimeUs >= 0) {
-                if (ALooper::GetNowUs() - mFirstFailureTimeUs > 10000ll) {
+                if (ALooper::GetNowUs() - mFirstFailureTimeUs
+                        > source->reorderDelayUs()) {
                     mFirstFailureTimeUs = -1;
 
                     // LOG(VERBOSE) << "waited too long for packet.";
+                    source->onPacketLost();
                     packetLost();
                     continue;
                 }
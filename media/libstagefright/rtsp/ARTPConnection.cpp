@@ -34,7 +34,9 @@
 #include <fcntl.h>
 #include <netdb.h>
 
+#include <sys/epoll.h>
 #include <sys/socket.h>
+#include <unistd.h>
 
 #include "include/ExtendedUtils.h"
 
@@ -42,6 +44,14 @@ namespace android {
 
 static const size_t kMaxUDPSize = 1500;
 
+// Packets read by one recvmmsg, each in a slot of the largest datagram.
+static const size_t kMaxReceiveBatch = 8;
+static const size_t kMaxDatagramSize = 65536;
+
+static const size_t kMaxPollEvents = 16;
+
+static const int64_t kStatsIntervalUs = 5000000ll;
+
 static uint16_t u16at(const uint8_t *data) {
     return data[0] << 8 | data[1];
 }
@@ -55,7 +65,7 @@ static uint64_t u64at(const uint8_t *data) {
 }
 
 // static
-const int64_t ARTPConnection::kSelectTimeoutUs = 1000ll;
+const int64_t ARTPConnection::kPollTimeoutUs = 1000ll;
 
 struct ARTPConnection::StreamInfo {
     int mRTPSocket;
@@ -67,8 +77,14 @@ struct ARTPConnection::StreamInfo {
 
     int64_t mNumRTCPPacketsReceived;
     int64_t mNumRTPPacketsReceived;
+    int64_t mNumRTPBytesReceived;
     struct sockaddr_in mRemoteRTCPAddr;
 
+    // at the start of the current stats interval
+    int64_t mStatsStartUs;
+    int64_t mStatsNumRTPPackets;
+    int64_t mStatsNumRTPBytes;
+
     bool mIsInjected;
 };
 
@@ -76,10 +92,15 @@ ARTPConnection::ARTPConnection(uint32_t flags)
     : mFlags(flags),
       mPollEventPending(false),
       mLastReceiverReportTimeUs(-1),
-      mIPVersion(IPV4) {
+      mIPVersion(IPV4),
+      mEpollFd(epoll_create1(EPOLL_CLOEXEC)),
+      mReceiveBuffer(new ABuffer(kMaxReceiveBatch * kMaxDatagramSize)) {
+    CHECK_GE(mEpollFd, 0);
 }
 
 ARTPConnection::~ARTPConnection() {
+    close(mEpollFd);
+    mEpollFd = -1;
 }
 
 void ARTPConnection::addStream(
@@ -226,13 +247,81 @@ void ARTPConnection::onAddStream(const sp<AMessage> &msg) {
 
     info->mNumRTCPPacketsReceived = 0;
     info->mNumRTPPacketsReceived = 0;
+    info->mNumRTPBytesReceived = 0;
     memset(&info->mRemoteRTCPAddr, 0, sizeof(info->mRemoteRTCPAddr));
 
+    info->mStatsStartUs = ALooper::GetNowUs();
+    info->mStatsNumRTPPackets = 0;
+    info->mStatsNumRTPBytes = 0;
+
     if (!injected) {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+
+        event.data.fd = info->mRTPSocket;
+        CHECK_EQ(epoll_ctl(mEpollFd, EPOLL_CTL_ADD, info->mRTPSocket, &event), 0);
+        event.data.fd = info->mRTCPSocket;
+        CHECK_EQ(epoll_ctl(mEpollFd, EPOLL_CTL_ADD, info->mRTCPSocket, &event), 0);
+
         postPollEvent();
     }
 }
 
+List<ARTPConnection::StreamInfo>::iterator ARTPConnection::eraseStream(
+        List<StreamInfo>::iterator it) {
+    if (!it->mIsInjected) {
+        // The sockets may be closed already, which took them out of the set.
+        epoll_ctl(mEpollFd, EPOLL_CTL_DEL, it->mRTPSocket, NULL);
+        epoll_ctl(mEpollFd, EPOLL_CTL_DEL, it->mRTCPSocket, NULL);
+    }
+
+    int64_t numExpected, numLost;
+    getLossCounts(&*it, &numExpected, &numLost);
+    ALOGI("stream %zu: %lld RTP packets (%lld bytes) received, "
+         "%lld of %lld lost",
+         it->mIndex, (long long)it->mNumRTPPacketsReceived,
+         (long long)it->mNumRTPBytesReceived,
+         (long long)numLost, (long long)numExpected);
+
+    return mStreams.erase(it);
+}
+
+void ARTPConnection::getLossCounts(
+        StreamInfo *s, int64_t *numExpected, int64_t *numLost) {
+    *numExpected = 0;
+    *numLost = 0;
+    for (size_t i = 0; i < s->mSources.size(); ++i) {
+        const sp<ARTPSource> &source = s->mSources.valueAt(i);
+        *numExpected += source->numPacketsExpected();
+        *numLost += source->numPacketsLost();
+    }
+}
+
+void ARTPConnection::onUpdateStats(int64_t nowUs) {
+    for (List<StreamInfo>::iterator it = mStreams.begin();
+         it != mStreams.end(); ++it) {
+        StreamInfo *s = &*it;
+
+        int64_t elapsedUs = nowUs - s->mStatsStartUs;
+        if (elapsedUs < kStatsIntervalUs) {
+            continue;
+        }
+
+        int64_t numExpected, numLost;
+        getLossCounts(s, &numExpected, &numLost);
+        ALOGV("stream %zu: %.1f packets/s, %.1f kbps, %lld of %lld lost",
+             s->mIndex,
+             (s->mNumRTPPacketsReceived - s->mStatsNumRTPPackets) * 1E6 / elapsedUs,
+             (s->mNumRTPBytesReceived - s->mStatsNumRTPBytes) * 8E3 / elapsedUs,
+             (long long)numLost, (long long)numExpected);
+
+        s->mStatsStartUs = nowUs;
+        s->mStatsNumRTPPackets = s->mNumRTPPacketsReceived;
+        s->mStatsNumRTPBytes = s->mNumRTPBytesReceived;
+    }
+}
+
 void ARTPConnection::onRemoveStream(const sp<AMessage> &msg) {
     int32_t rtpSocket, rtcpSocket;
     CHECK(msg->findInt32("rtp-socket", &rtpSocket));
@@ -248,7 +337,7 @@ void ARTPConnection::onRemoveStream(const sp<AMessage> &msg) {
         return;
     }
 
-    mStreams.erase(it);
+    eraseStream(it);
 }
 
 void ARTPConnection::postPollEvent() {
@@ -269,62 +358,47 @@ void ARTPConnection::onPollStreams() {
         return;
     }
 
-    struct timeval tv;
-    tv.tv_sec = 0;
-    tv.tv_usec = kSelectTimeoutUs;
-
-    fd_set rs;
-    FD_ZERO(&rs);
-
-    int maxSocket = -1;
+    bool polled = false;
     for (List<StreamInfo>::iterator it = mStreams.begin();
          it != mStreams.end(); ++it) {
-        if ((*it).mIsInjected) {
-            continue;
-        }
-
-        FD_SET(it->mRTPSocket, &rs);
-        FD_SET(it->mRTCPSocket, &rs);
-
-        if (it->mRTPSocket > maxSocket) {
-            maxSocket = it->mRTPSocket;
-        }
-        if (it->mRTCPSocket > maxSocket) {
-            maxSocket = it->mRTCPSocket;
+        if (!it->mIsInjected) {
+            polled = true;
+            break;
         }
     }
 
-    if (maxSocket == -1) {
+    if (!polled) {
         return;
     }
 
-    int res = select(maxSocket + 1, &rs, NULL, NULL, &tv);
+    struct epoll_event events[kMaxPollEvents];
+    int res;
+    do {
+        res = epoll_wait(mEpollFd, events, kMaxPollEvents, kPollTimeoutUs / 1000ll);
+    } while (res < 0 && errno == EINTR);
+
+    for (int i = 0; i < res; ++i) {
+        int fd = events[i].data.fd;
 
-    if (res > 0) {
         List<StreamInfo>::iterator it = mStreams.begin();
-        while (it != mStreams.end()) {
-            if ((*it).mIsInjected) {
-                ++it;
-                continue;
-            }
+        while (it != mStreams.end()
+                && (it->mIsInjected
+                    || (it->mRTPSocket != fd && it->mRTCPSocket != fd))) {
+            ++it;
+        }
 
-            status_t err = OK;
-            if (FD_ISSET(it->mRTPSocket, &rs)) {
-                err = receive(&*it, true);
-            }
-            if (err == OK && FD_ISSET(it->mRTCPSocket, &rs)) {
-                err = receive(&*it, false);
-            }
+        if (it == mStreams.end()) {
+            // gone with an earlier event
+            continue;
+        }
 
-            if (err == -ECONNRESET) {
-                // socket failure, this stream is dead, Jim.
+        status_t err = receive(&*it, it->mRTPSocket == fd);
 
-                ALOGW("failed to receive RTP/RTCP datagram.");
-                it = mStreams.erase(it);
-                continue;
-            }
+        if (err == -ECONNRESET) {
+            // socket failure, this stream is dead, Jim.
 
-            ++it;
+            ALOGW("failed to receive RTP/RTCP datagram.");
+            eraseStream(it);
         }
     }
 
@@ -363,33 +437,11 @@ void ARTPConnection::onPollStreams() {
             if (buffer->size() > 0) {
                 ALOGV("Sending RR...");
 
-                ssize_t n = 0;
-                do {
-                    if(mIPVersion == IPV4) {
-                        n = sendto(
-                            s->mRTCPSocket, buffer->data(), buffer->size(), 0,
-                            (const struct sockaddr *)&s->mRemoteRTCPAddr,
-                            sizeof(s->mRemoteRTCPAddr));
-                    } else if (mIPVersion == IPV6) {
-                        n = sendto(
-                            s->mRTCPSocket, buffer->data(), buffer->size(), 0,
-                            (const struct sockaddr *)&s->mRemoteRTCPAddr,
-                            sizeof(struct sockaddr_in6));
-                    } else {
-                        TRESPASS();
-                    }
-                } while (n < 0 && errno == EINTR);
-
-                if (n <= 0) {
-                    ALOGW("failed to send RTCP receiver report (%s).",
-                         n == 0 ? "connection gone" : strerror(errno));
-
-                    it = mStreams.erase(it);
+                if (sendRTCP(s, buffer) != OK) {
+                    it = eraseStream(it);
                     continue;
                 }
 
-                CHECK_EQ(n, (ssize_t)buffer->size());
-
                 mLastReceiverReportTimeUs = nowUs;
             }
 
@@ -397,46 +449,153 @@ void ARTPConnection::onPollStreams() {
         }
     }
 
+    onSendFeedback(nowUs);
+    onUpdateStats(nowUs);
+
     if (!mStreams.empty()) {
         postPollEvent();
     }
 }
 
+void ARTPConnection::onSendFeedback(int64_t nowUs) {
+    sp<ABuffer> buffer;
+    List<StreamInfo>::iterator it = mStreams.begin();
+    while (it != mStreams.end()) {
+        StreamInfo *s = &*it;
+
+        if (s->mIsInjected || s->mNumRTCPPacketsReceived == 0) {
+            ++it;
+            continue;
+        }
+
+        for (size_t i = 0; i < s->mSources.size(); ++i) {
+            sp<ARTPSource> source = s->mSources.valueAt(i);
+
+            if (!source->needsFeedback(nowUs)) {
+                continue;
+            }
+
+            if (buffer == NULL) {
+                buffer = new ABuffer(kMaxUDPSize);
+            }
+            if (buffer->size() == 0) {
+                // Feedback goes in a compound packet that starts with a
+                // report (RFC 4585).
+                source->addReceiverReport(buffer);
+            }
+            source->addNACK(buffer, nowUs);
+            source->addPLI(buffer, nowUs);
+        }
+
+        if (buffer != NULL && buffer->size() > 0) {
+            ALOGV("Sending feedback...");
+
+            status_t err = sendRTCP(s, buffer);
+            buffer->setRange(0, 0);
+
+            if (err != OK) {
+                it = eraseStream(it);
+                continue;
+            }
+        }
+
+        ++it;
+    }
+}
+
+status_t ARTPConnection::sendRTCP(StreamInfo *s, const sp<ABuffer> &buffer) {
+    ssize_t n = 0;
+    do {
+        if(mIPVersion == IPV4) {
+            n = sendto(
+                s->mRTCPSocket, buffer->data(), buffer->size(), 0,
+                (const struct sockaddr *)&s->mRemoteRTCPAddr,
+                sizeof(s->mRemoteRTCPAddr));
+        } else if (mIPVersion == IPV6) {
+            n = sendto(
+                s->mRTCPSocket, buffer->data(), buffer->size(), 0,
+                (const struct sockaddr *)&s->mRemoteRTCPAddr,
+                sizeof(struct sockaddr_in6));
+        } else {
+            TRESPASS();
+        }
+    } while (n < 0 && errno == EINTR);
+
+    if (n <= 0) {
+        ALOGW("failed to send RTCP packet (%s).",
+             n == 0 ? "connection gone" : strerror(errno));
+
+        return -ECONNRESET;
+    }
+
+    CHECK_EQ(n, (ssize_t)buffer->size());
+
+    return OK;
+}
+
 status_t ARTPConnection::receive(StreamInfo *s, bool receiveRTP) {
     ALOGV("receiving %s", receiveRTP ? "RTP" : "RTCP");
 
     CHECK(!s->mIsInjected);
 
-    sp<ABuffer> buffer = new ABuffer(65536);
+    // The first RTCP packet tells where to send ours, it is read alone.
+    bool findRemoteAddr = !receiveRTP && s->mNumRTCPPacketsReceived == 0;
+    size_t maxNumPackets = findRemoteAddr ? 1 : kMaxReceiveBatch;
+
+    struct mmsghdr msgs[kMaxReceiveBatch];
+    struct iovec iovs[kMaxReceiveBatch];
+    memset(msgs, 0, sizeof(msgs));
+    for (size_t i = 0; i < maxNumPackets; ++i) {
+        iovs[i].iov_base = mReceiveBuffer->data() + i * kMaxDatagramSize;
+        iovs[i].iov_len = kMaxDatagramSize;
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
 
-    socklen_t remoteAddrLen =
-        (!receiveRTP && s->mNumRTCPPacketsReceived == 0)
-            ? sizeof(s->mRemoteRTCPAddr) : 0;
+    if (findRemoteAddr) {
+        msgs[0].msg_hdr.msg_name = &s->mRemoteRTCPAddr;
+        msgs[0].msg_hdr.msg_namelen = sizeof(s->mRemoteRTCPAddr);
+    }
 
-    ssize_t nbytes;
+    int numPackets;
     do {
-        nbytes = recvfrom(
+        numPackets = recvmmsg(
             receiveRTP ? s->mRTPSocket : s->mRTCPSocket,
-            buffer->data(),
-            buffer->capacity(),
-            0,
-            remoteAddrLen > 0 ? (struct sockaddr *)&s->mRemoteRTCPAddr : NULL,
-            remoteAddrLen > 0 ? &remoteAddrLen : NULL);
-    } while (nbytes < 0 && errno == EINTR);
-
-    if (nbytes <= 0) {
+            msgs, maxNumPackets, MSG_DONTWAIT, NULL);
+    } while (numPackets < 0 && errno == EINTR);
+
+    if (numPackets < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return OK;
+    }
+
+    if (numPackets <= 0) {
         return -ECONNRESET;
     }
 
-    buffer->setRange(0, nbytes);
+    status_t err = OK;
+    for (int i = 0; i < numPackets; ++i) {
+        size_t nbytes = msgs[i].msg_len;
+        if (nbytes == 0) {
+            return -ECONNRESET;
+        }
 
-    // ALOGI("received %d bytes.", buffer->size());
+        // Copied out of the batch's slot, to a buffer the size of the
+        // packet, for the assemblers to hold on to.
+        sp<ABuffer> buffer = new ABuffer(nbytes);
+        memcpy(buffer->data(), iovs[i].iov_base, nbytes);
 
-    status_t err;
-    if (receiveRTP) {
-        err = parseRTP(s, buffer);
-    } else {
-        err = parseRTCP(s, buffer);
+        // ALOGI("received %d bytes.", buffer->size());
+
+        status_t packetErr;
+        if (receiveRTP) {
+            packetErr = parseRTP(s, buffer);
+        } else {
+            packetErr = parseRTCP(s, buffer);
+        }
+
+        if (err == OK) {
+            err = packetErr;
+        }
     }
 
     return err;
@@ -449,6 +608,8 @@ status_t ARTPConnection::parseRTP(StreamInfo *s, const sp<ABuffer> &buffer) {
         notify->post();
     }
 
+    s->mNumRTPBytesReceived += buffer->size();
+
     size_t size = buffer->size();
 
     if (size < 12) {
@@ -64,7 +64,7 @@ private:
         kWhatInjectPacket,
     };
 
-    static const int64_t kSelectTimeoutUs;
+    static const int64_t kPollTimeoutUs;
 
     uint32_t mFlags;
 
@@ -75,11 +75,23 @@ private:
     int64_t mLastReceiverReportTimeUs;
     int mIPVersion;
 
+    // on the sockets of the streams not injected
+    int mEpollFd;
+    // slots that received packets are copied out of
+    sp<ABuffer> mReceiveBuffer;
+
     void onAddStream(const sp<AMessage> &msg);
     void onRemoveStream(const sp<AMessage> &msg);
     void onPollStreams();
     void onInjectPacket(const sp<AMessage> &msg);
     void onSendReceiverReports();
+    void onSendFeedback(int64_t nowUs);
+    void onUpdateStats(int64_t nowUs);
+
+    List<StreamInfo>::iterator eraseStream(List<StreamInfo>::iterator it);
+    void getLossCounts(StreamInfo *s, int64_t *numExpected, int64_t *numLost);
+
+    status_t sendRTCP(StreamInfo *s, const sp<ABuffer> &buffer);
 
     status_t receive(StreamInfo *info, bool receiveRTP);
 
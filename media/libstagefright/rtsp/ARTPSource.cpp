@@ -33,10 +33,39 @@
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/AMessage.h>
 
+#include <stdio.h>
+
 namespace android {
 
 static const uint32_t kSourceID = 0xdeadbeef;
 
+// What the assemblers always waited for a missing packet, before the jitter
+// and retransmissions were accounted for.
+static const int64_t kMinReorderDelayUs = 10000ll;
+static const int64_t kMaxReorderDelayUs = 300000ll;
+// A round trip to the server for the packet NACKed to be resent.
+static const int64_t kRetransmitDelayUs = 100000ll;
+// Packets merely reordered are not NACKed for arriving this late.
+static const int64_t kMinNACKDelayUs = 5000ll;
+static const int64_t kMinPLIIntervalUs = 1000000ll;
+
+// Whether the session description has "a=rtcp-fb" for the payload type, or
+// for all of them, with the feedback type given.
+static bool OffersFeedback(
+        const sp<ASessionDescription> &sessionDesc, size_t index,
+        unsigned long PT, const char *type) {
+    char key[64];
+    AString value;
+
+    snprintf(key, sizeof(key), "a=rtcp-fb:%lu %s", PT, type);
+    if (sessionDesc->findAttribute(index, key, &value)) {
+        return true;
+    }
+
+    snprintf(key, sizeof(key), "a=rtcp-fb:* %s", type);
+    return sessionDesc->findAttribute(index, key, &value);
+}
+
 ARTPSource::ARTPSource(
         uint32_t id,
         const sp<ASessionDescription> &sessionDesc, size_t index,
@@ -44,12 +73,28 @@ ARTPSource::ARTPSource(
     : mID(id),
       mHighestSeqNumber(0),
       mNumBuffersReceived(0),
+      mBaseSeqNumber(0),
+      mExpectedPrior(0),
+      mReceivedPrior(0),
+      mClockRate(0),
+      mJitter(0.0),
+      mLastTransit(0),
       mLastNTPTime(0),
       mLastNTPTimeUpdateUs(0),
       mIssueFIRRequests(false),
       mLastFIRRequestUs(-1),
       mNextFIRSeqNo((rand() * 256.0) / RAND_MAX),
+      mIssueNACKs(false),
+      mIssuePLIs(false),
+      mPLIPending(false),
+      mLastPLIRequestUs(-1),
       mNotify(notify) {
+    for (size_t i = 0; i < kSeqWindow; ++i) {
+        mSlots[i].mSeqNumber = 0;
+        mSlots[i].mReceived = false;
+        mSlots[i].mMissingSinceUs = -1;
+    }
+
     unsigned long PT;
     AString desc;
     AString params;
@@ -79,6 +124,14 @@ ARTPSource::ARTPSource(
     } else {
         TRESPASS();
     }
+
+    int32_t numChannels;
+    ASessionDescription::ParseFormatDesc(desc.c_str(), &mClockRate, &numChannels);
+
+    mIssueNACKs = OffersFeedback(sessionDesc, index, PT, "nack");
+    mIssuePLIs = mIssueFIRRequests && OffersFeedback(sessionDesc, index, PT, "nack pli");
+    ALOGV("NACKs %s, PLIs %s",
+            mIssueNACKs ? "enabled" : "disabled", mIssuePLIs ? "enabled" : "disabled");
 }
 
 static uint32_t AbsDiff(uint32_t seq1, uint32_t seq2) {
@@ -107,6 +160,10 @@ bool ARTPSource::queuePacket(const sp<ABuffer> &buffer) {
 
     if (mNumBuffersReceived++ == 0) {
         mHighestSeqNumber = seqNum;
+        mBaseSeqNumber = seqNum;
+        mSlots[seqNum % kSeqWindow].mSeqNumber = seqNum;
+        mSlots[seqNum % kSeqWindow].mReceived = true;
+        updateJitter(buffer);
         mQueue.push_back(buffer);
         return true;
     }
@@ -138,15 +195,52 @@ bool ARTPSource::queuePacket(const sp<ABuffer> &buffer) {
         seqNum = seq3;
     }
 
+    buffer->setInt32Data(seqNum);
+
+    SeqSlot *slot = &mSlots[seqNum % kSeqWindow];
+    if (slot->mSeqNumber == seqNum && slot->mReceived) {
+        ALOGW("Discarding duplicate buffer");
+        return false;
+    }
+
     if (seqNum > mHighestSeqNumber) {
+        // The packets skipped are missing until they turn up, those that
+        // fell out of the window already given up on.
+        int64_t nowUs = ALooper::GetNowUs();
+        uint32_t first = mHighestSeqNumber + 1;
+        if (seqNum - first >= kSeqWindow) {
+            first = seqNum - kSeqWindow + 1;
+        }
+        for (uint32_t missing = first; missing < seqNum; ++missing) {
+            SeqSlot *missingSlot = &mSlots[missing % kSeqWindow];
+            missingSlot->mSeqNumber = missing;
+            missingSlot->mReceived = false;
+            missingSlot->mMissingSinceUs = nowUs;
+            if (mIssueNACKs) {
+                mMissing.push_back(missing);
+            }
+        }
+
         mHighestSeqNumber = seqNum;
     }
 
-    buffer->setInt32Data(seqNum);
+    if (seqNum + kSeqWindow > mHighestSeqNumber) {
+        slot->mSeqNumber = seqNum;
+        slot->mReceived = true;
+    }
 
-    List<sp<ABuffer> >::iterator it = mQueue.begin();
-    while (it != mQueue.end() && (uint32_t)(*it)->int32Data() < seqNum) {
-        ++it;
+    updateJitter(buffer);
+
+    // Packets mostly arrive in order, or nearly so: look for the place of
+    // this one from the end of the queue.
+    List<sp<ABuffer> >::iterator it = mQueue.end();
+    while (it != mQueue.begin()) {
+        List<sp<ABuffer> >::iterator prev = it;
+        --prev;
+        if ((uint32_t)(*prev)->int32Data() < seqNum) {
+            break;
+        }
+        it = prev;
     }
 
     if (it != mQueue.end() && (uint32_t)(*it)->int32Data() == seqNum) {
@@ -159,6 +253,49 @@ bool ARTPSource::queuePacket(const sp<ABuffer> &buffer) {
     return true;
 }
 
+void ARTPSource::updateJitter(const sp<ABuffer> &buffer) {
+    uint32_t rtpTime;
+    if (mClockRate <= 0
+            || !buffer->meta()->findInt32("rtp-time", (int32_t *)&rtpTime)) {
+        return;
+    }
+
+    uint32_t arrivalTime = (uint32_t)(ALooper::GetNowUs() * mClockRate / 1000000ll);
+    int32_t transit = (int32_t)(arrivalTime - rtpTime);
+
+    if (mNumBuffersReceived > 1) {
+        int32_t d = transit - mLastTransit;
+        if (d < 0) {
+            d = -d;
+        }
+        mJitter += (d - mJitter) / 16.0;
+    }
+    mLastTransit = transit;
+}
+
+int64_t ARTPSource::jitterUs() const {
+    return mClockRate > 0 ? (int64_t)(mJitter * 1E6 / mClockRate) : 0ll;
+}
+
+int64_t ARTPSource::nackDelayUs() const {
+    int64_t delayUs = 2 * jitterUs();
+    return delayUs > kMinNACKDelayUs ? delayUs : kMinNACKDelayUs;
+}
+
+int64_t ARTPSource::reorderDelayUs() const {
+    int64_t delayUs = kMinReorderDelayUs + 3 * jitterUs();
+    if (mIssueNACKs) {
+        delayUs += kRetransmitDelayUs;
+    }
+    return delayUs < kMaxReorderDelayUs ? delayUs : kMaxReorderDelayUs;
+}
+
+void ARTPSource::onPacketLost() {
+    if (mIssuePLIs) {
+        mPLIPending = true;
+    }
+}
+
 void ARTPSource::byeReceived() {
     mAssembler->onByeReceived();
 }
@@ -213,6 +350,14 @@ void ARTPSource::addFIR(const sp<ABuffer> &buffer) {
     ALOGV("Added FIR request.");
 }
 
+uint32_t ARTPSource::numPacketsExpected() const {
+    return mNumBuffersReceived > 0 ? mHighestSeqNumber - mBaseSeqNumber + 1 : 0;
+}
+
+int64_t ARTPSource::numPacketsLost() const {
+    return (int64_t)numPacketsExpected() - mNumBuffersReceived;
+}
+
 void ARTPSource::addReceiverReport(const sp<ABuffer> &buffer) {
     if (buffer->size() + 32 > buffer->capacity()) {
         ALOGW("RTCP buffer too small to accomodate RR.");
@@ -235,21 +380,43 @@ void ARTPSource::addReceiverReport(const sp<ABuffer> &buffer) {
     data[10] = (mID >> 8) & 0xff;
     data[11] = mID & 0xff;
 
-    data[12] = 0x00;  // fraction lost
+    // RFC 3550, appendix A.3
+    uint32_t expected = numPacketsExpected();
+    int64_t lost = numPacketsLost();
+    if (lost > 0x7fffff) {
+        lost = 0x7fffff;
+    } else if (lost < -0x800000) {
+        lost = -0x800000;
+    }
+
+    uint32_t expectedInterval = expected - mExpectedPrior;
+    int64_t lostInterval =
+        (int64_t)expectedInterval - (mNumBuffersReceived - mReceivedPrior);
+    uint8_t fraction = 0;
+    if (expectedInterval > 0 && lostInterval > 0) {
+        int64_t x = (lostInterval << 8) / expectedInterval;
+        fraction = x > 255 ? 255 : x;
+    }
+    mExpectedPrior = expected;
+    mReceivedPrior = mNumBuffersReceived;
+
+    uint32_t jitter = (uint32_t)mJitter;
+
+    data[12] = fraction;  // fraction lost
 
-    data[13] = 0x00;  // cumulative lost
-    data[14] = 0x00;
-    data[15] = 0x00;
+    data[13] = (lost >> 16) & 0xff;  // cumulative lost
+    data[14] = (lost >> 8) & 0xff;
+    data[15] = lost & 0xff;
 
     data[16] = mHighestSeqNumber >> 24;
     data[17] = (mHighestSeqNumber >> 16) & 0xff;
     data[18] = (mHighestSeqNumber >> 8) & 0xff;
     data[19] = mHighestSeqNumber & 0xff;
 
-    data[20] = 0x00;  // Interarrival jitter
-    data[21] = 0x00;
-    data[22] = 0x00;
-    data[23] = 0x00;
+    data[20] = jitter >> 24;  // Interarrival jitter
+    data[21] = (jitter >> 16) & 0xff;
+    data[22] = (jitter >> 8) & 0xff;
+    data[23] = jitter & 0xff;
 
     uint32_t LSR = 0;
     uint32_t DLSR = 0;
@@ -273,6 +440,134 @@ void ARTPSource::addReceiverReport(const sp<ABuffer> &buffer) {
     buffer->setRange(buffer->offset(), buffer->size() + 32);
 }
 
+bool ARTPSource::needsFeedback(int64_t nowUs) const {
+    if (mPLIPending
+            && (mLastPLIRequestUs < 0
+                || mLastPLIRequestUs + kMinPLIIntervalUs <= nowUs)) {
+        return true;
+    }
+
+    if (mMissing.empty()) {
+        return false;
+    }
+
+    // Those received since are dropped by addNACK.
+    const SeqSlot &slot = mSlots[*mMissing.begin() % kSeqWindow];
+    return slot.mMissingSinceUs + nackDelayUs() <= nowUs;
+}
+
+void ARTPSource::addNACK(const sp<ABuffer> &buffer, int64_t nowUs) {
+    if (mMissing.empty()) {
+        return;
+    }
+
+    if (buffer->size() + 16 > buffer->capacity()) {
+        ALOGW("RTCP buffer too small to accomodate NACK.");
+        return;
+    }
+
+    uint8_t *data = buffer->data() + buffer->size();
+    size_t maxNumFCIs = (buffer->capacity() - buffer->size() - 12) / 4;
+    size_t numFCIs = 0;
+    uint8_t *fci = NULL;
+    uint32_t PID = 0;
+
+    int64_t delayUs = nackDelayUs();
+    while (!mMissing.empty()) {
+        List<uint32_t>::iterator it = mMissing.begin();
+        uint32_t seqNum = *it;
+
+        const SeqSlot &slot = mSlots[seqNum % kSeqWindow];
+        if (slot.mSeqNumber != seqNum || slot.mReceived) {
+            // turned up, or too old to be worth it
+            mMissing.erase(it);
+            continue;
+        }
+
+        if (slot.mMissingSinceUs + delayUs > nowUs) {
+            break;
+        }
+
+        if (fci != NULL && seqNum - PID <= 16) {
+            // bitmask of following lost packets
+            uint16_t BLP = 1 << (seqNum - PID - 1);
+            fci[2] |= BLP >> 8;
+            fci[3] |= BLP & 0xff;
+        } else {
+            if (numFCIs == maxNumFCIs) {
+                break;
+            }
+
+            fci = &data[12 + 4 * numFCIs++];
+            PID = seqNum;
+            fci[0] = (PID >> 8) & 0xff;
+            fci[1] = PID & 0xff;
+            fci[2] = 0x00;
+            fci[3] = 0x00;
+        }
+
+        mMissing.erase(it);
+    }
+
+    if (numFCIs == 0) {
+        return;
+    }
+
+    data[0] = 0x80 | 1;  // Generic NACK
+    data[1] = 205;  // RTPFB
+    data[2] = 0;
+    data[3] = 2 + numFCIs;
+    data[4] = kSourceID >> 24;
+    data[5] = (kSourceID >> 16) & 0xff;
+    data[6] = (kSourceID >> 8) & 0xff;
+    data[7] = kSourceID & 0xff;
+
+    data[8] = mID >> 24;
+    data[9] = (mID >> 16) & 0xff;
+    data[10] = (mID >> 8) & 0xff;
+    data[11] = mID & 0xff;
+
+    buffer->setRange(buffer->offset(), buffer->size() + 12 + 4 * numFCIs);
+
+    ALOGV("Added NACK for %zu ranges of packets.", numFCIs);
+}
+
+void ARTPSource::addPLI(const sp<ABuffer> &buffer, int64_t nowUs) {
+    if (!mPLIPending
+            || (mLastPLIRequestUs >= 0
+                && mLastPLIRequestUs + kMinPLIIntervalUs > nowUs)) {
+        return;
+    }
+
+    if (buffer->size() + 12 > buffer->capacity()) {
+        ALOGW("RTCP buffer too small to accomodate PLI.");
+        return;
+    }
+
+    mPLIPending = false;
+    mLastPLIRequestUs = nowUs;
+
+    uint8_t *data = buffer->data() + buffer->size();
+
+    data[0] = 0x80 | 1;  // PLI
+    data[1] = 206;  // PSFB
+    data[2] = 0;
+    data[3] = 2;
+    data[4] = kSourceID >> 24;
+    data[5] = (kSourceID >> 16) & 0xff;
+    data[6] = (kSourceID >> 8) & 0xff;
+    data[7] = kSourceID & 0xff;
+
+    data[8] = mID >> 24;
+    data[9] = (mID >> 16) & 0xff;
+    data[10] = (mID >> 8) & 0xff;
+    data[11] = mID & 0xff;
+
+    buffer->setRange(buffer->offset(), buffer->size() + 12);
+
+    ALOGV("Added PLI request.");
+}
+
 }  // namespace android
 
 
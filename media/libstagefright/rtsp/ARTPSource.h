@@ -43,10 +43,38 @@ struct ARTPSource : public RefBase {
 
     List<sp<ABuffer> > *queue() { return &mQueue; }
 
+    // How long the assembler waits for a missing packet before giving up on
+    // it: longer the more packets jitter, and with room for a retransmission
+    // when losses are NACKed.
+    int64_t reorderDelayUs() const;
+    void onPacketLost();
+
+    // Since the first packet, the way receiver reports count them.
+    uint32_t numPacketsExpected() const;
+    int64_t numPacketsLost() const;
+
     void addReceiverReport(const sp<ABuffer> &buffer);
     void addFIR(const sp<ABuffer> &buffer);
 
+    // Generic NACKs and picture loss indications (RFC 4585), if the session
+    // description offers them. They are sent as they are needed rather than
+    // with the regular reports, hence needsFeedback.
+    bool needsFeedback(int64_t nowUs) const;
+    void addNACK(const sp<ABuffer> &buffer, int64_t nowUs);
+    void addPLI(const sp<ABuffer> &buffer, int64_t nowUs);
+
 private:
+    enum {
+        // Sequence numbers tracked back from the highest one received.
+        kSeqWindow = 1024,
+    };
+
+    struct SeqSlot {
+        uint32_t mSeqNumber;
+        bool mReceived;
+        int64_t mMissingSinceUs;
+    };
+
     uint32_t mID;
     uint32_t mHighestSeqNumber;
     int32_t mNumBuffersReceived;
@@ -54,6 +82,20 @@ private:
     List<sp<ABuffer> > mQueue;
     sp<ARTPAssembler> mAssembler;
 
+    // indexed by sequence number modulo kSeqWindow
+    SeqSlot mSlots[kSeqWindow];
+    // not received yet nor NACKed, in increasing order
+    List<uint32_t> mMissing;
+
+    uint32_t mBaseSeqNumber;
+    uint32_t mExpectedPrior;
+    int32_t mReceivedPrior;
+
+    // interarrival jitter (RFC 3550), in units of the RTP clock
+    int32_t mClockRate;
+    double mJitter;
+    int32_t mLastTransit;
+
     uint64_t mLastNTPTime;
     int64_t mLastNTPTimeUpdateUs;
 
@@ -61,9 +103,17 @@ private:
     int64_t mLastFIRRequestUs;
     uint8_t mNextFIRSeqNo;
 
+    bool mIssueNACKs;
+    bool mIssuePLIs;
+    bool mPLIPending;
+    int64_t mLastPLIRequestUs;
+
     sp<AMessage> mNotify;
 
     bool queuePacket(const sp<ABuffer> &buffer);
+    void updateJitter(const sp<ABuffer> &buffer);
+    int64_t jitterUs() const;
+    int64_t nackDelayUs() const;
 
     DISALLOW_EVIL_CONSTRUCTORS(ARTPSource);
 };
@@ -102,7 +102,12 @@ bool ASessionDescription::parse(const void *data, size_t size) {
                 } else {
                     key.setTo(line, 0, colonPos);
 
-                    if (key == "a=fmtp" || key == "a=rtpmap"
+                    if (key == "a=rtcp-fb") {
+                        // There may be several for one payload type, as in
+                        // "a=rtcp-fb:96 nack" and "a=rtcp-fb:96 nack pli".
+                        key = line;
+                        colonPos = line.size() - 1;
+                    } else if (key == "a=fmtp" || key == "a=rtpmap"
                             || key == "a=framesize") {
                         ssize_t spacePos = line.find(" ", colonPos + 1);
                         if (spacePos < 0) {
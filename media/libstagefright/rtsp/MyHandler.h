@@ -38,7 +38,9 @@
 #include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/ALooper.h>
 #include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/MediaDefs.h>
 #include <media/stagefright/MediaErrors.h>
+#include <media/stagefright/MetaData.h>
 #include <media/stagefright/Utils.h>
 
 #include <arpa/inet.h>
@@ -47,6 +49,7 @@
 
 #include "HTTPBase.h"
 #include "ExtendedUtils.h"
+#include "avc_utils.h"
 
 #if LOG_NDEBUG
 #define UNUSED_UNLESS_VERBOSE(x) (void)(x)
@@ -68,6 +71,12 @@ static int64_t kPauseDelayUs = 3000000ll;
 
 static int64_t kTearDownTimeoutUs = 3000000ll;
 
+// In low-latency mode, how often the timestamps are pulled towards the
+// arrival times, and by how much at most, small enough for frames to keep
+// their order.
+static int64_t kDriftWindowUs = 2000000ll;
+static int64_t kMaxDriftStepUs = 5000ll;
+
 namespace android {
 
 static bool GetAttribute(const char *s, const char *key, AString *value) {
@@ -113,10 +122,12 @@ struct MyHandler : public AHandler {
     MyHandler(
             const char *url,
             const sp<AMessage> &notify,
-            bool uidValid = false, uid_t uid = 0)
+            bool uidValid = false, uid_t uid = 0,
+            bool lowLatency = false)
         : mNotify(notify),
           mUIDValid(uidValid),
           mUID(uid),
+          mLowLatency(lowLatency),
           mNetLooper(new ALooper),
           mConn(new ARTSPConnection(mUIDValid, mUID)),
           mRTPConn(new ARTPConnection),
@@ -142,7 +153,12 @@ struct MyHandler : public AHandler {
           mKeepAliveGeneration(0),
           mPausing(false),
           mPauseGeneration(0),
-          mPlayResponseParsed(false) {
+          mPlayResponseParsed(false),
+          mHaveSRTimeOffset(false),
+          mSRTimeOffsetUs(0ll),
+          mDriftCorrectionUs(0ll),
+          mDriftWindowStartUs(-1ll),
+          mConnectTimeUs(-1ll) {
         mNetLooper->setName("rtsp net");
         mNetLooper->start(false /* runOnCallingThread */,
                           false /* canCallJava */,
@@ -177,9 +193,15 @@ struct MyHandler : public AHandler {
         mSessionHost = host;
         mAUTimeoutCheck = true;
         mIPVersion = IPV4;
+
+        if (mLowLatency) {
+            ALOGI("low-latency mode");
+        }
     }
 
     void connect() {
+        mConnectTimeUs = ALooper::GetNowUs();
+
         looper()->registerHandler(mConn);
         (1 ? mNetLooper : looper())->registerHandler(mRTPConn);
 
@@ -191,6 +213,8 @@ struct MyHandler : public AHandler {
     }
 
     void loadSDP(const sp<ASessionDescription>& desc) {
+        mConnectTimeUs = ALooper::GetNowUs();
+
         looper()->registerHandler(mConn);
         (1 ? mNetLooper : looper())->registerHandler(mRTPConn);
 
@@ -927,6 +951,9 @@ struct MyHandler : public AHandler {
                 mAllTracksHaveTime = false;
                 mNTPAnchorUs = -1;
                 mMediaAnchorUs = -1;
+                mHaveSRTimeOffset = false;
+                mDriftCorrectionUs = 0ll;
+                mDriftWindowStartUs = -1ll;
                 mNumAccessUnitsReceived = 0;
                 mReceivedFirstRTCPPacket = false;
                 mReceivedFirstRTPPacket = false;
@@ -1396,6 +1423,16 @@ struct MyHandler : public AHandler {
                     // posted at seek as well.
                     break;
                 }
+                if (mLowLatency && mReceivedFirstRTPPacket) {
+                    // The tracks are timed from RTP as their data arrives,
+                    // sender reports or not. Those that have none by now
+                    // will be timed that way when it does.
+                    if (!mAllTracksHaveTime) {
+                        ALOGW("No data on some tracks, starting without them.");
+                        mAllTracksHaveTime = true;
+                    }
+                    break;
+                }
                 if (!mReceivedFirstRTCPPacket) {
                     if (dataReceivedOnAllChannels() && !mTryFakeRTCP) {
                         ALOGW("We received RTP packets but no RTCP packets, "
@@ -1589,6 +1626,14 @@ private:
 
         sp<APacketSource> mPacketSource;
 
+        // Low-latency mode: H.264 is dropped until the first IDR, and the
+        // earliest each access unit arrived compared to its timestamp over
+        // kDriftWindowUs, INT64_MAX while there is none.
+        bool mIsAVC;
+        bool mSawIDR;
+        int64_t mMinLatenessUs;
+        int64_t mMaxLatenessUs;
+
         // Stores packets temporarily while no notion of time
         // has been established yet.
         List<sp<ABuffer> > mPackets;
@@ -1597,6 +1642,7 @@ private:
     sp<AMessage> mNotify;
     bool mUIDValid;
     uid_t mUID;
+    bool mLowLatency;
     sp<ALooper> mNetLooper;
     sp<ARTSPConnection> mConn;
     sp<ARTPConnection> mRTPConn;
@@ -1636,6 +1682,15 @@ private:
     bool mAUTimeoutCheck;
     int mIPVersion;
 
+    // Low-latency mode times the tracks on the local clock, with the sender
+    // reports mapped onto it: the offset is set by the first report, for the
+    // track it comes for not to jump, the drift correction is then added on.
+    bool mHaveSRTimeOffset;
+    int64_t mSRTimeOffsetUs;
+    int64_t mDriftCorrectionUs;
+    int64_t mDriftWindowStartUs;
+    int64_t mConnectTimeUs;
+
     void setupTrack(size_t index) {
         sp<APacketSource> source =
             new APacketSource(mSessionDesc, index);
@@ -1670,6 +1725,13 @@ private:
         info->mNormalPlayTimeRTP = 0;
         info->mNormalPlayTimeUs = 0ll;
 
+        const char *mime;
+        info->mIsAVC = source->getFormat()->findCString(kKeyMIMEType, &mime)
+                && !strcasecmp(mime, MEDIA_MIMETYPE_VIDEO_AVC);
+        info->mSawIDR = false;
+        info->mMinLatenessUs = INT64_MAX;
+        info->mMaxLatenessUs = INT64_MIN;
+
         unsigned long PT;
         AString formatDesc;
         AString formatParams;
@@ -1775,6 +1837,21 @@ private:
     }
 
     void fakeTimestamps() {
+        if (mLowLatency) {
+            // the tracks with data are timed on its arrival
+            int64_t nowUs = ALooper::GetNowUs();
+            for (size_t i = 0; i < mTracks.size(); ++i) {
+                TrackInfo *track = &mTracks.editItemAt(i);
+                if (track->mNTPAnchorUs < 0 && !track->mPackets.empty()) {
+                    uint32_t rtpTime;
+                    CHECK((*track->mPackets.begin())->meta()->findInt32(
+                                "rtp-time", (int32_t *)&rtpTime));
+                    onTimeAnchor(i, rtpTime, nowUs);
+                }
+            }
+            return;
+        }
+
         mNTPAnchorUs = -1ll;
         for (size_t i = 0; i < mTracks.size(); ++i) {
             onTimeUpdate(i, 0, 0ll);
@@ -1818,6 +1895,25 @@ private:
 
         int64_t ntpTimeUs = (int64_t)(ntpTime * 1E6 / (1ll << 32));
 
+        if (mLowLatency) {
+            const TrackInfo *track = &mTracks.itemAt(trackIndex);
+            if (!mHaveSRTimeOffset) {
+                int64_t localTimeUs = track->mNTPAnchorUs >= 0
+                    ? rtpToNTPTimeUs(track, rtpTime) : ALooper::GetNowUs();
+                mSRTimeOffsetUs = localTimeUs - mDriftCorrectionUs - ntpTimeUs;
+                mHaveSRTimeOffset = true;
+                ALOGI("sender reports now time the tracks on track %d",
+                      trackIndex);
+            }
+            ntpTimeUs += mSRTimeOffsetUs + mDriftCorrectionUs;
+        }
+
+        onTimeAnchor(trackIndex, rtpTime, ntpTimeUs);
+    }
+
+    // ntpTimeUs is the local time rtpTime was played out at in low-latency
+    // mode, the sender's otherwise.
+    void onTimeAnchor(int32_t trackIndex, uint32_t rtpTime, int64_t ntpTimeUs) {
         TrackInfo *track = &mTracks.editItemAt(trackIndex);
 
         track->mRTPAnchor = rtpTime;
@@ -1871,6 +1967,17 @@ private:
             int32_t trackIndex, const sp<ABuffer> &accessUnit) {
         ALOGV("onAccessUnitComplete track %d", trackIndex);
 
+        if (mLowLatency) {
+            TrackInfo *track = &mTracks.editItemAt(trackIndex);
+            if (track->mIsAVC && !track->mSawIDR) {
+                if (!IsIDR(accessUnit)) {
+                    ALOGV("dropping accessUnit ahead of the first IDR");
+                    return;
+                }
+                track->mSawIDR = true;
+            }
+        }
+
         if(!mPlayResponseParsed){
             ALOGI("play response is not parsed, storing accessunit");
             TrackInfo *track = &mTracks.editItemAt(trackIndex);
@@ -1882,6 +1989,16 @@ private:
 
         TrackInfo *track = &mTracks.editItemAt(trackIndex);
 
+        if (mLowLatency && track->mNTPAnchorUs < 0) {
+            // no waiting for a sender report: the oldest access unit held is
+            // played out as it arrives
+            const sp<ABuffer> &first =
+                track->mPackets.empty() ? accessUnit : *track->mPackets.begin();
+            uint32_t rtpTime;
+            CHECK(first->meta()->findInt32("rtp-time", (int32_t *)&rtpTime));
+            onTimeAnchor(trackIndex, rtpTime, ALooper::GetNowUs());
+        }
+
         if (!mAllTracksHaveTime) {
             ALOGV("storing accessUnit, no time established yet");
             track->mPackets.push_back(accessUnit);
@@ -1901,6 +2018,10 @@ private:
             postQueueAccessUnit(trackIndex, accessUnit);
         }
 
+        if (mLowLatency) {
+            correctDrift(trackIndex, accessUnit);
+        }
+
         if (track->mEOSReceived) {
             postQueueEOS(trackIndex, ERROR_END_OF_STREAM);
             track->mEOSReceived = false;
@@ -1916,11 +2037,7 @@ private:
         CHECK(accessUnit->meta()->findInt32(
                     "rtp-time", (int32_t *)&rtpTime));
 
-        int64_t relRtpTimeUs =
-            (((int64_t)rtpTime - (int64_t)track->mRTPAnchor) * 1000000ll)
-                / track->mTimeScale;
-
-        int64_t ntpTimeUs = track->mNTPAnchorUs + relRtpTimeUs;
+        int64_t ntpTimeUs = rtpToNTPTimeUs(track, rtpTime);
 
         int64_t mediaTimeUs = mMediaAnchorUs + ntpTimeUs - mNTPAnchorUs;
 
@@ -1941,6 +2058,90 @@ private:
         return true;
     }
 
+    int64_t rtpToNTPTimeUs(const TrackInfo *track, uint32_t rtpTime) const {
+        int64_t relRtpTimeUs =
+            (((int64_t)rtpTime - (int64_t)track->mRTPAnchor) * 1000000ll)
+                / track->mTimeScale;
+
+        return track->mNTPAnchorUs + relRtpTimeUs;
+    }
+
+    // Low-latency mode: the player keeps the latency it starts with only as
+    // long as the timestamps advance at the rate data arrives, which they
+    // don't if the sender's clock drifts from ours. Every kDriftWindowUs,
+    // the tracks are moved by up to kMaxDriftStepUs for the access unit that
+    // arrived the earliest compared to its timestamp to have arrived on
+    // time, all together for them to stay in sync. How late the others were
+    // is the jitter the player's buffer has to absorb.
+    void correctDrift(int32_t trackIndex, const sp<ABuffer> &accessUnit) {
+        int64_t nowUs = ALooper::GetNowUs();
+
+        TrackInfo *track = &mTracks.editItemAt(trackIndex);
+
+        uint32_t rtpTime;
+        CHECK(accessUnit->meta()->findInt32("rtp-time", (int32_t *)&rtpTime));
+
+        int64_t latenessUs = nowUs - rtpToNTPTimeUs(track, rtpTime);
+        if (latenessUs < track->mMinLatenessUs) {
+            track->mMinLatenessUs = latenessUs;
+        }
+        if (latenessUs > track->mMaxLatenessUs) {
+            track->mMaxLatenessUs = latenessUs;
+        }
+
+        if (mConnectTimeUs >= 0) {
+            ALOGI("first access unit out %.2f ms after connecting",
+                  (nowUs - mConnectTimeUs) / 1E3);
+            mConnectTimeUs = -1ll;
+        }
+
+        if (mDriftWindowStartUs < 0) {
+            mDriftWindowStartUs = nowUs;
+        }
+        if (nowUs - mDriftWindowStartUs < kDriftWindowUs) {
+            return;
+        }
+        mDriftWindowStartUs = nowUs;
+
+        int64_t minLatenessUs = INT64_MAX;
+        for (size_t i = 0; i < mTracks.size(); ++i) {
+            TrackInfo *info = &mTracks.editItemAt(i);
+            if (info->mMinLatenessUs == INT64_MAX) {
+                continue;
+            }
+
+            ALOGV("track %zu: access units %.2f to %.2f ms late",
+                  i, info->mMinLatenessUs / 1E3, info->mMaxLatenessUs / 1E3);
+
+            if (info->mMinLatenessUs < minLatenessUs) {
+                minLatenessUs = info->mMinLatenessUs;
+            }
+            info->mMinLatenessUs = INT64_MAX;
+            info->mMaxLatenessUs = INT64_MIN;
+        }
+
+        int64_t stepUs = minLatenessUs;
+        if (stepUs > kMaxDriftStepUs) {
+            stepUs = kMaxDriftStepUs;
+        } else if (stepUs < -kMaxDriftStepUs) {
+            stepUs = -kMaxDriftStepUs;
+        }
+        if (stepUs == 0) {
+            return;
+        }
+
+        for (size_t i = 0; i < mTracks.size(); ++i) {
+            TrackInfo *info = &mTracks.editItemAt(i);
+            if (info->mNTPAnchorUs >= 0) {
+                info->mNTPAnchorUs += stepUs;
+            }
+        }
+        mDriftCorrectionUs += stepUs;
+
+        ALOGV("timestamps moved by %lld us, %lld us in all",
+              (long long)stepUs, (long long)mDriftCorrectionUs);
+    }
+
     void postQueueAccessUnit(
             size_t trackIndex, const sp<ABuffer> &accessUnit) {
         sp<AMessage> msg = mNotify->dup();
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "ABitReader_test"
+
+#include <gtest/gtest.h>
+#include <utils/Log.h>
+#include <utils/Timers.h>
+
+#include <media/stagefright/foundation/ABitReader.h>
+
+namespace android {
+
+class ABitReaderTest : public ::testing::Test {
+};
+
+TEST_F(ABitReaderTest, TestGetBits) {
+    static const uint8_t kData[] = {
+        0x12, 0x34, 0x56, 0x78, 0x9a, 0xbc, 0xde, 0xf0, 0x0f, 0xed, 0xcb,
+    };
+    ABitReader br(kData, sizeof(kData));
+
+    ASSERT_EQ(88u, br.numBitsLeft());
+    ASSERT_EQ(0x1u, br.getBits(4));
+    ASSERT_EQ(0x23456u, br.getBits(20));
+    ASSERT_EQ(0x789abcdeu, br.getBits(32));
+    ASSERT_EQ(kData + 7, br.data());
+    // crosses the end of the first 8 bytes loaded
+    ASSERT_EQ(0xf00fedu, br.getBits(24));
+    br.putBits(0xed, 8);
+    ASSERT_EQ(0xedu, br.getBits(8));
+    br.skipBits(1);
+    ASSERT_EQ(0x4bu, br.getBits(7));
+    ASSERT_EQ(0u, br.numBitsLeft());
+}
+
+TEST_F(ABitReaderTest, TestEmulationPrevention) {
+    // 0x000003 loses its 0x03, a 0x03 elsewhere is data
+    static const uint8_t kData[] = {
+        0x11, 0x03, 0x22, 0x00, 0x00, 0x03, 0x01, 0x33, 0x44, 0x55, 0x66, 0x77,
+    };
+    NALBitReader br(kData, sizeof(kData));
+
+    ASSERT_TRUE(br.atLeastNumBitsLeft(88));
+    ASSERT_FALSE(br.atLeastNumBitsLeft(89));
+    ASSERT_EQ(0x110322u, br.getBits(24));
+    ASSERT_EQ(0x00000133u, br.getBits(32));
+    ASSERT_EQ(0x44556677u, br.getBits(32));
+}
+
+// Not a pass/fail test: reports the throughput of typical header parsing,
+// run with adb logcat -s ABitReader_test.
+TEST_F(ABitReaderTest, BenchmarkGetBits) {
+    static const size_t kSize = 64 * 1024;
+    static const int kIterations = 100;
+    uint8_t *data = new uint8_t[kSize];
+    for (size_t i = 0; i < kSize; ++i) {
+        data[i] = (uint8_t)(i * 7 + 1);
+    }
+
+    uint32_t sum = 0;
+    nsecs_t start = systemTime();
+    for (int i = 0; i < kIterations; ++i) {
+        ABitReader br(data, kSize);
+        while (br.numBitsLeft() >= 32) {
+            sum += br.getBits(1);
+            sum += br.getBits(3);
+            sum += br.getBits(12);
+            sum += br.getBits(16);
+        }
+    }
+    nsecs_t plain = systemTime() - start;
+
+    start = systemTime();
+    for (int i = 0; i < kIterations; ++i) {
+        NALBitReader br(data, kSize);
+        while (br.atLeastNumBitsLeft(32)) {
+            sum += br.getBits(1);
+            sum += br.getBits(3);
+            sum += br.getBits(12);
+            sum += br.getBits(16);
+        }
+    }
+    nsecs_t nal = systemTime() - start;
+
+    const double bits = 8.0 * kSize * kIterations;
+    ALOGI("ABitReader %.2f bits/ns, NALBitReader %.2f bits/ns (sum %u)",
+            bits / plain, bits / nal, sum);
+    delete[] data;
+    ASSERT_NE(0u, sum);
+}
+
+} // namespace android
@@ -0,0 +1,118 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "AMessage_test"
+
+#include <gtest/gtest.h>
+#include <utils/Log.h>
+#include <utils/Timers.h>
+
+#include <media/stagefright/foundation/ABuffer.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/foundation/AString.h>
+
+namespace android {
+
+class AMessageTest : public ::testing::Test {
+};
+
+TEST_F(AMessageTest, TestSetFind) {
+    sp<AMessage> msg = new AMessage('test');
+    msg->setInt32("int", 1);
+    msg->setInt64("timeUs", 1234567890123ll);
+    msg->setString("mime", "video/avc");
+    msg->setFloat("a-name-longer-than-the-inline-buffer", 0.5f);
+
+    int32_t int32Value;
+    int64_t int64Value;
+    float floatValue;
+    AString stringValue;
+    ASSERT_TRUE(msg->findInt32("int", &int32Value));
+    ASSERT_EQ(1, int32Value);
+    ASSERT_TRUE(msg->findInt64("timeUs", &int64Value));
+    ASSERT_EQ(1234567890123ll, int64Value);
+    ASSERT_TRUE(msg->findString("mime", &stringValue));
+    ASSERT_STREQ("video/avc", stringValue.c_str());
+    ASSERT_TRUE(msg->findFloat("a-name-longer-than-the-inline-buffer", &floatValue));
+    ASSERT_EQ(0.5f, floatValue);
+
+    // names are matched exactly, and so are types
+    ASSERT_FALSE(msg->contains("in"));
+    ASSERT_FALSE(msg->contains("intx"));
+    ASSERT_FALSE(msg->findInt64("int", &int64Value));
+
+    // setting an existing name replaces the item
+    msg->setInt32("int", 2);
+    ASSERT_EQ(4u, msg->countEntries());
+    ASSERT_TRUE(msg->findInt32("int", &int32Value));
+    ASSERT_EQ(2, int32Value);
+}
+
+TEST_F(AMessageTest, TestDup) {
+    sp<AMessage> msg = new AMessage('test');
+    sp<ABuffer> buffer = new ABuffer(16);
+    msg->setBuffer("buffer", buffer);
+    msg->setString("a-name-longer-than-the-inline-buffer", "value");
+
+    sp<AMessage> copy = msg->dup();
+    msg->clear();
+
+    sp<ABuffer> found;
+    AString stringValue;
+    ASSERT_TRUE(copy->findBuffer("buffer", &found));
+    ASSERT_EQ(buffer.get(), found.get());
+    ASSERT_TRUE(copy->findString("a-name-longer-than-the-inline-buffer", &stringValue));
+    ASSERT_STREQ("value", stringValue.c_str());
+
+    AMessage::Type type;
+    ASSERT_STREQ("buffer", copy->getEntryNameAt(0, &type));
+    ASSERT_EQ(AMessage::kTypeBuffer, type);
+}
+
+// Not a pass/fail test: reports the cost of the set/find/dup pattern of a
+// typical codec buffer message, run with adb logcat -s AMessage_test.
+TEST_F(AMessageTest, BenchmarkSetFindDup) {
+    static const int kIterations = 100000;
+    int64_t sum = 0;
+
+    nsecs_t start = systemTime();
+    for (int i = 0; i < kIterations; ++i) {
+        sp<AMessage> msg = new AMessage('buff');
+        msg->setInt32("what", i);
+        msg->setInt32("generation", 1);
+        msg->setInt32("buffer-id", i);
+        msg->setSize("offset", 0);
+        msg->setSize("size", 4096);
+        msg->setInt64("timeUs", i * 33333ll);
+        msg->setInt32("flags", 0);
+
+        sp<AMessage> copy = msg->dup();
+        int64_t timeUs;
+        int32_t bufferID;
+        if (copy->findInt64("timeUs", &timeUs) && copy->findInt32("buffer-id", &bufferID)) {
+            sum += timeUs + bufferID;
+        }
+    }
+    nsecs_t elapsed = systemTime() - start;
+
+    ALOGI("%d iterations in %lld us, %lld ns each (sum %lld)",
+            kIterations, (long long)(elapsed / 1000), (long long)(elapsed / kIterations),
+            (long long)sum);
+    ASSERT_NE(0, sum);
+}
+
+} // namespace android
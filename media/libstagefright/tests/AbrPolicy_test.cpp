@@ -0,0 +1,118 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "AbrPolicy_test"
+
+#include <gtest/gtest.h>
+#include <utils/Log.h>
+
+#include "AbrPolicy.h"
+
+namespace android {
+
+static const unsigned long kBandwidthsBps[] = {
+    300000, 800000, 1500000, 3000000, 6000000,
+};
+
+static const size_t kNumVariants = sizeof(kBandwidthsBps) / sizeof(kBandwidthsBps[0]);
+
+class AbrPolicyTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        mPolicy = new DefaultAbrPolicy;
+    }
+
+    // A segment of durationSecs at bandwidthBps, downloaded at networkBps.
+    void download(unsigned long bandwidthBps, unsigned long networkBps,
+            double durationSecs = 6.0) {
+        size_t bytes = bandwidthBps * durationSecs / 8;
+        mPolicy->onSegmentDownloaded(bytes, bytes * 8E6 / networkBps);
+    }
+
+    int32_t estimate() {
+        int32_t bandwidthBps = -1;
+        EXPECT_TRUE(mPolicy->estimateBandwidth(&bandwidthBps));
+        return bandwidthBps;
+    }
+
+    size_t pick(ssize_t currentIndex, int64_t bufferedDurationUs) {
+        return mPolicy->pickBandwidthIndex(
+                kBandwidthsBps, kNumVariants, currentIndex, estimate(), bufferedDurationUs);
+    }
+
+    sp<AbrPolicy> mPolicy;
+};
+
+TEST_F(AbrPolicyTest, TestEstimate) {
+    int32_t bandwidthBps;
+    EXPECT_FALSE(mPolicy->estimateBandwidth(&bandwidthBps));
+
+    // too short to count
+    mPolicy->onSegmentDownloaded(1000, 1000);
+    EXPECT_FALSE(mPolicy->estimateBandwidth(&bandwidthBps));
+
+    // a steady network is estimated as it is from the first segment on
+    download(800000, 4000000);
+    EXPECT_NEAR(4000000, estimate(), 4000);
+    for (int i = 0; i < 10; ++i) {
+        download(800000, 4000000);
+    }
+    EXPECT_NEAR(4000000, estimate(), 4000);
+
+    // a drop shows at once, through the fast average
+    download(800000, 1000000);
+    EXPECT_LT(estimate(), 2500000);
+
+    // a recovery takes a while, through the slow one
+    download(800000, 4000000);
+    EXPECT_LT(estimate(), 3000000);
+    for (int i = 0; i < 20; ++i) {
+        download(800000, 4000000);
+    }
+    EXPECT_GT(estimate(), 3800000);
+}
+
+TEST_F(AbrPolicyTest, TestSwitching) {
+    for (int i = 0; i < 10; ++i) {
+        download(800000, 5000000);
+    }
+
+    // the first pick has nothing to wait for
+    EXPECT_EQ(3u, pick(-1, 0ll));
+
+    // up one variant at a time, and only on enough buffer
+    EXPECT_EQ(1u, pick(1, DefaultAbrPolicy::kMinBufferForUpSwitchUs - 1));
+    EXPECT_EQ(2u, pick(1, DefaultAbrPolicy::kMinBufferForUpSwitchUs));
+    EXPECT_EQ(3u, pick(2, DefaultAbrPolicy::kMinBufferForUpSwitchUs));
+    EXPECT_EQ(3u, pick(3, DefaultAbrPolicy::kMinBufferForUpSwitchUs));
+
+    // a dip still above the current variant is ridden out on a large buffer,
+    // not on a small one
+    download(800000, 2000000, 5.5);
+    ASSERT_GT(estimate(), 3000000);
+    ASSERT_LT(estimate(), 3750000);
+    EXPECT_EQ(3u, pick(3, DefaultAbrPolicy::kHighBufferUs + 1));
+    EXPECT_EQ(2u, pick(3, DefaultAbrPolicy::kHighBufferUs));
+
+    // a drop below it never is
+    for (int i = 0; i < 3; ++i) {
+        download(3000000, 1200000);
+    }
+    EXPECT_EQ(1u, pick(3, DefaultAbrPolicy::kHighBufferUs + 1));
+}
+
+} // namespace android
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "CharacterEncodingDetector_test"
+
+#include <gtest/gtest.h>
+#include <utils/Log.h>
+
+#include <media/CharacterEncodingDetector.h>
+
+#include <string.h>
+
+namespace android {
+
+class CharacterEncodingDetectorTest : public ::testing::Test {
+protected:
+    static const char *getTag(CharacterEncodingDetector &detector, const char *wanted) {
+        for (size_t i = 0; i < detector.size(); ++i) {
+            const char *name;
+            const char *value;
+            if (detector.getTag(i, &name, &value) == OK && !strcmp(name, wanted)) {
+                return value;
+            }
+        }
+        return NULL;
+    }
+};
+
+TEST_F(CharacterEncodingDetectorTest, KeepsAsciiAndUtf8) {
+    static const char *kTags[][2] = {
+        { "title", "Hyperballad, a song of more than eight characters" },
+        { "artist", "Bj\xc3\xb6rk" },
+        { "album", "\xe3\x83\x9d\xe3\x82\xb9\xe3\x83\x88" },
+        { "composer", "\xf0\x9f\x8e\xb5 notes" },
+        { "year", "1995" },
+    };
+
+    CharacterEncodingDetector detector;
+    for (size_t i = 0; i < sizeof(kTags) / sizeof(kTags[0]); ++i) {
+        detector.addTag(kTags[i][0], kTags[i][1]);
+    }
+    detector.detectAndConvert();
+
+    ASSERT_EQ(sizeof(kTags) / sizeof(kTags[0]), detector.size());
+    for (size_t i = 0; i < sizeof(kTags) / sizeof(kTags[0]); ++i) {
+        const char *value = getTag(detector, kTags[i][0]);
+        ASSERT_TRUE(value != NULL) << kTags[i][0];
+        EXPECT_STREQ(kTags[i][1], value);
+    }
+}
+
+// Once a tag is not valid UTF-8, all of the combined ones are detected
+// together, the UTF-8 looking ones included.
+TEST_F(CharacterEncodingDetectorTest, ConvertsLatin1) {
+    CharacterEncodingDetector detector;
+    detector.addTag("title", "Caf\xe9 del Mar, la m\xfasica de la noche");
+    detector.addTag("artist", "Jos\xe9 Padilla y los \xe1ngeles");
+    detector.addTag("album", "Ca\xc3\xa9");
+    detector.detectAndConvert();
+
+    EXPECT_STREQ("Caf\xc3\xa9 del Mar, la m\xc3\xbasica de la noche",
+            getTag(detector, "title"));
+    EXPECT_STREQ("Jos\xc3\xa9 Padilla y los \xc3\xa1ngeles", getTag(detector, "artist"));
+    EXPECT_STREQ("Ca\xc3\x83\xc2\xa9", getTag(detector, "album"));
+}
+
+}  // namespace android
@@ -0,0 +1,262 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "ColorConverter_test"
+
+#include <gtest/gtest.h>
+#include <utils/Log.h>
+#include <utils/Timers.h>
+
+#include <media/stagefright/ColorConverter.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace android {
+
+static const OMX_COLOR_FORMATTYPE kSrcFormats[] = {
+    OMX_COLOR_FormatYUV420Planar,
+    OMX_QCOM_COLOR_FormatYVU420SemiPlanar,
+    OMX_COLOR_FormatYUV420SemiPlanar,
+    OMX_TI_COLOR_FormatYUV420PackedSemiPlanar,
+};
+
+static const size_t kNumSrcFormats = sizeof(kSrcFormats) / sizeof(kSrcFormats[0]);
+
+class ColorConverterTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        srand(1);
+    }
+
+    static uint8_t clip(signed x) {
+        return x < 0 ? 0 : x > 255 ? 255 : x;
+    }
+
+    // The pixel at (x, y) of the crop the way the C converters have always
+    // done it, their quirks included. Downscaled, the luma is the average of
+    // the top left 2x2 of the block, across then down, and the chroma that of
+    // its top left pixel.
+    static void referencePixel(
+            OMX_COLOR_FORMATTYPE format, const uint8_t *bits,
+            size_t width, size_t height, size_t cropLeft, size_t cropTop,
+            size_t scale, size_t x, size_t y, uint8_t *r, uint8_t *g, uint8_t *b) {
+        signed Y, U, V;
+        bool swapRB = false;
+
+        x *= scale;
+        y *= scale;
+
+        const uint8_t *src_y = bits + cropTop * width + cropLeft;
+        if (format == OMX_COLOR_FormatYUV420Planar) {
+            const uint8_t *src_u = src_y + width * height
+                + cropTop * (width / 2) + cropLeft / 2 + (y / 2) * (width / 2);
+            U = src_u[x / 2];
+            V = src_u[(width / 2) * (height / 2) + x / 2];
+        } else {
+            const uint8_t *src_uv = src_y + width * height + cropTop * width + cropLeft;
+            if (format == OMX_TI_COLOR_FormatYUV420PackedSemiPlanar) {
+                src_y = bits;
+                src_uv = bits + width * (height - cropTop / 2);
+            }
+            src_uv += (y / 2) * width + (x & ~1);
+
+            U = src_uv[0];
+            V = src_uv[1];
+            if (format == OMX_COLOR_FormatYUV420SemiPlanar) {
+                U = src_uv[1];
+                V = src_uv[0];
+            }
+            swapRB = format != OMX_TI_COLOR_FormatYUV420PackedSemiPlanar;
+        }
+        Y = src_y[y * width + x];
+        if (scale > 1) {
+            const uint8_t *row = &src_y[y * width + x];
+            signed avg0 = (row[0] + row[1] + 1) >> 1;
+            signed avg1 = (row[width] + row[width + 1] + 1) >> 1;
+            Y = (avg0 + avg1 + 1) >> 1;
+        }
+
+        signed tmp = (Y - 16) * 298;
+        *b = clip((tmp + (U - 128) * 517) / 256);
+        *g = clip((tmp - (V - 128) * 208 - (U - 128) * 100) / 256);
+        *r = clip((tmp + (V - 128) * 409) / 256);
+        if (swapRB) {
+            uint8_t t = *r;
+            *r = *b;
+            *b = t;
+        }
+    }
+
+    // Converts a random frame, cropped both ways and downscaled by scale, to
+    // RGB565 and RGBA8888 and checks every pixel.
+    static void testConversion(
+            OMX_COLOR_FORMATTYPE format, size_t width, size_t height,
+            size_t cropLeft, size_t cropTop, size_t cropWidth, size_t cropHeight,
+            size_t scale = 1) {
+        // the chroma of the semi-planar formats is offset by a row per crop row
+        size_t srcSize = width * height * 3;
+        uint8_t *src = new uint8_t[srcSize];
+        for (size_t i = 0; i < srcSize; ++i) {
+            src[i] = rand();
+        }
+
+        size_t srcCropWidth = cropWidth, srcCropHeight = cropHeight;
+        cropWidth /= scale;
+        cropHeight /= scale;
+
+        // the destination is cropped too, and must be left alone outside
+        size_t dstLeft = rand() % 3, dstTop = rand() % 3;
+        size_t dstWidth = cropWidth + dstLeft + 1, dstHeight = cropHeight + dstTop;
+        uint16_t *rgb565 = new uint16_t[dstWidth * dstHeight];
+        uint8_t *rgba = new uint8_t[dstWidth * dstHeight * 4];
+        memset(rgb565, 0x55, dstWidth * dstHeight * 2);
+        memset(rgba, 0x55, dstWidth * dstHeight * 4);
+
+        ColorConverter converter565(format, OMX_COLOR_Format16bitRGB565);
+        ColorConverter converter8888(format, kColorFormat32bitRGBA8888);
+        ASSERT_TRUE(converter565.isValid());
+        ASSERT_TRUE(converter8888.isValid());
+
+        ASSERT_EQ(OK, converter565.convert(
+                src, width, height, cropLeft, cropTop,
+                cropLeft + srcCropWidth - 1, cropTop + srcCropHeight - 1,
+                rgb565, dstWidth, dstHeight, dstLeft, dstTop,
+                dstLeft + cropWidth - 1, dstTop + cropHeight - 1));
+        ASSERT_EQ(OK, converter8888.convert(
+                src, width, height, cropLeft, cropTop,
+                cropLeft + srcCropWidth - 1, cropTop + srcCropHeight - 1,
+                rgba, dstWidth, dstHeight, dstLeft, dstTop,
+                dstLeft + cropWidth - 1, dstTop + cropHeight - 1));
+
+        for (size_t y = 0; y < dstHeight; ++y) {
+            for (size_t x = 0; x < dstWidth; ++x) {
+                size_t i = y * dstWidth + x;
+                uint16_t expected565 = 0x5555;
+                uint8_t expected8888[4] = { 0x55, 0x55, 0x55, 0x55 };
+
+                if (x >= dstLeft && x < dstLeft + cropWidth && y >= dstTop) {
+                    uint8_t r, g, b;
+                    referencePixel(
+                            format, src, width, height, cropLeft, cropTop,
+                            scale, x - dstLeft, y - dstTop, &r, &g, &b);
+                    expected565 = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+                    expected8888[0] = r;
+                    expected8888[1] = g;
+                    expected8888[2] = b;
+                    expected8888[3] = 0xff;
+                }
+
+                ASSERT_EQ(expected565, rgb565[i])
+                        << "format " << format << " " << width << "x" << height
+                        << " at " << x << "," << y;
+                ASSERT_EQ(0, memcmp(expected8888, &rgba[i * 4], 4))
+                        << "format " << format << " " << width << "x" << height
+                        << " at " << x << "," << y;
+            }
+        }
+
+        delete[] src;
+        delete[] rgb565;
+        delete[] rgba;
+    }
+};
+
+TEST_F(ColorConverterTest, TestSmallFrames) {
+    for (size_t i = 0; i < 400; ++i) {
+        size_t width = 2 + 2 * (rand() % 60);
+        size_t height = 2 + 2 * (rand() % 40);
+        size_t cropLeft = 2 * (rand() % (width / 4 + 1));
+        size_t cropTop = rand() % (height / 2);
+        // odd crop widths too, for the last pixel of each row to be alone
+        size_t cropWidth = 1 + rand() % (width - cropLeft);
+        size_t cropHeight = 1 + rand() % (height - cropTop);
+
+        testConversion(
+                kSrcFormats[i % kNumSrcFormats], width, height,
+                cropLeft, cropTop, cropWidth, cropHeight);
+    }
+}
+
+// Large enough to be converted in bands on several threads.
+TEST_F(ColorConverterTest, TestLargeFrames) {
+    for (size_t i = 0; i < kNumSrcFormats; ++i) {
+        testConversion(kSrcFormats[i], 1920, 1088, 0, 0, 1920, 1080);
+        testConversion(kSrcFormats[i], 1280, 736, 16, 9, 1250, 719);
+    }
+}
+
+// Downscaled by 2, which has NEON code of its own, and by more.
+TEST_F(ColorConverterTest, TestDownscaledFrames) {
+    for (size_t i = 0; i < 200; ++i) {
+        size_t scale = 2 + (i / kNumSrcFormats) % 3;
+        size_t width = 8 + 2 * (rand() % 80);
+        size_t height = 8 + 2 * (rand() % 40);
+        size_t cropLeft = 2 * (rand() % (width / 4 + 1));
+        size_t cropTop = rand() % (height / 2);
+        size_t cropWidth = scale * (1 + rand() % ((width - cropLeft) / scale));
+        size_t cropHeight = scale * (1 + rand() % ((height - cropTop) / scale));
+
+        testConversion(
+                kSrcFormats[i % kNumSrcFormats], width, height,
+                cropLeft, cropTop, cropWidth, cropHeight, scale);
+    }
+
+    testConversion(kSrcFormats[0], 3840, 2176, 0, 0, 3840, 2160, 2);
+    testConversion(kSrcFormats[1], 3840, 2176, 0, 0, 3840, 2160, 8);
+}
+
+// Not a pass/fail test: reports the time to convert a 1080p frame of each
+// source format to RGB565 and to RGBA8888, run with
+// adb logcat -s ColorConverter_test.
+TEST_F(ColorConverterTest, BenchmarkConversion) {
+    static const size_t kWidth = 1920;
+    static const size_t kHeight = 1088;
+    static const int kIterations = 50;
+
+    uint8_t *src = new uint8_t[kWidth * kHeight * 3 / 2];
+    for (size_t i = 0; i < kWidth * kHeight * 3 / 2; ++i) {
+        src[i] = rand();
+    }
+    uint8_t *dst = new uint8_t[kWidth * kHeight * 4];
+
+    for (size_t i = 0; i < kNumSrcFormats; ++i) {
+        nsecs_t elapsed[2];
+        for (int rgba = 0; rgba < 2; ++rgba) {
+            ColorConverter converter(
+                    kSrcFormats[i],
+                    rgba ? kColorFormat32bitRGBA8888 : OMX_COLOR_Format16bitRGB565);
+
+            nsecs_t start = systemTime();
+            for (int j = 0; j < kIterations; ++j) {
+                ASSERT_EQ(OK, converter.convert(
+                        src, kWidth, kHeight, 0, 0, kWidth - 1, 1079,
+                        dst, kWidth, 1080, 0, 0, kWidth - 1, 1079));
+            }
+            elapsed[rgba] = systemTime() - start;
+        }
+
+        ALOGI("format 0x%x: %.2f ms per frame to RGB565, %.2f ms to RGBA8888",
+                kSrcFormats[i], elapsed[0] / 1e6 / kIterations,
+                elapsed[1] / 1e6 / kIterations);
+    }
+
+    delete[] src;
+    delete[] dst;
+}
+
+} // namespace android
@@ -0,0 +1,184 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "FlacEncoder_test"
+
+#include <gtest/gtest.h>
+#include <utils/Log.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+#include <media/stagefright/foundation/AMessage.h>
+
+#include "ParallelFlacEncoder.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace android {
+
+static const unsigned kSampleRate = 44100;
+static const unsigned kNumChannels = 2;
+// as SoftFlacEncoder gets them
+static const size_t kFramesPerBuffer = 1152;
+
+class FlacEncoderTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        srand(1);
+    }
+
+    // Two tones and some noise, the left and right channels alike but not
+    // quite, so stereo decorrelation has something to do.
+    static int16_t *makeSignal(size_t numFrames) {
+        int16_t *pcm = new int16_t[numFrames * kNumChannels];
+        for (size_t i = 0; i < numFrames; ++i) {
+            double t = (double)i / kSampleRate;
+            double s = 8000 * sin(2 * M_PI * 440 * t) + 3000 * sin(2 * M_PI * 2637 * t);
+            pcm[2 * i] = (int16_t)(s + rand() % 200 - 100);
+            pcm[2 * i + 1] = (int16_t)(0.8 * s + rand() % 200 - 100);
+        }
+        return pcm;
+    }
+
+    // The frames of a single libFLAC encoder, the stream header left out.
+    static status_t encodeSingle(
+            const int16_t *pcm, size_t numFrames, unsigned level, Vector<uint8_t> *out) {
+        FLAC__StreamEncoder *encoder = FLAC__stream_encoder_new();
+        FLAC__bool ok = encoder != NULL;
+        ok = ok && FLAC__stream_encoder_set_channels(encoder, kNumChannels);
+        ok = ok && FLAC__stream_encoder_set_sample_rate(encoder, kSampleRate);
+        ok = ok && FLAC__stream_encoder_set_bits_per_sample(encoder, 16);
+        ok = ok && FLAC__stream_encoder_set_compression_level(encoder, level);
+        ok = ok && FLAC__stream_encoder_init_stream(
+                encoder, WriteCallback, NULL, NULL, NULL, out)
+                        == FLAC__STREAM_ENCODER_INIT_STATUS_OK;
+
+        FLAC__int32 buffer[kFramesPerBuffer * kNumChannels];
+        for (size_t offset = 0; ok && offset < numFrames; offset += kFramesPerBuffer) {
+            size_t n = numFrames - offset < kFramesPerBuffer ? numFrames - offset : kFramesPerBuffer;
+            for (size_t i = 0; i < n * kNumChannels; ++i) {
+                buffer[i] = pcm[offset * kNumChannels + i];
+            }
+            ok = FLAC__stream_encoder_process_interleaved(encoder, buffer, n);
+        }
+        ok = ok && FLAC__stream_encoder_finish(encoder);
+
+        if (encoder != NULL) {
+            FLAC__stream_encoder_delete(encoder);
+        }
+        return ok ? OK : UNKNOWN_ERROR;
+    }
+
+    static FLAC__StreamEncoderWriteStatus WriteCallback(
+            const FLAC__StreamEncoder * /* encoder */, const FLAC__byte buffer[],
+            size_t bytes, unsigned samples, unsigned /* current_frame */, void *client_data) {
+        if (samples != 0) {
+            static_cast<Vector<uint8_t> *>(client_data)->appendArray(buffer, bytes);
+        }
+        return FLAC__STREAM_ENCODER_WRITE_STATUS_OK;
+    }
+
+    // The frames of a ParallelFlacEncoder, checking their timestamps.
+    static status_t encodeParallel(
+            const int16_t *pcm, size_t numFrames, unsigned level, size_t numThreads,
+            Vector<uint8_t> *out) {
+        ParallelFlacEncoder encoder(numThreads);
+        status_t err = encoder.initCheck();
+        if (err == OK) {
+            err = encoder.configure(kNumChannels, kSampleRate, level);
+        }
+
+        int64_t frameIndex = 0;
+        bool eos = false;
+        for (size_t offset = 0; err == OK && !eos; offset += kFramesPerBuffer) {
+            if (offset < numFrames) {
+                size_t n = numFrames - offset < kFramesPerBuffer
+                        ? numFrames - offset : kFramesPerBuffer;
+                encoder.queueSamples(
+                        pcm + offset * kNumChannels, n, offset * 1000000ll / kSampleRate);
+            } else {
+                encoder.flush();
+                eos = true;
+            }
+
+            // as SoftFlacEncoder, without waiting but at the end
+            sp<ABuffer> frame;
+            while ((err = encoder.dequeueFrame(eos, &frame)) == OK) {
+                // off by the rounding of the input and frame offsets at most
+                int64_t timeUs;
+                int64_t expectedUs = frameIndex++ * encoder.blockSize() * 1000000ll / kSampleRate;
+                if (!frame->meta()->findInt64("timeUs", &timeUs)
+                        || timeUs < expectedUs - 2 || timeUs > expectedUs + 2) {
+                    return UNKNOWN_ERROR;
+                }
+                out->appendArray(frame->data(), frame->size());
+            }
+            if (err == WOULD_BLOCK) {
+                err = OK;
+            }
+        }
+        return err;
+    }
+};
+
+TEST_F(FlacEncoderTest, TestParallelMatchesSingle) {
+    // a short last frame, and frame numbers that take two bytes
+    static const size_t kNumFrames = 200 * 4096 + 1000;
+    int16_t *pcm = makeSignal(kNumFrames);
+
+    // levels 1 and 4 use loose mid-side stereo, which looks across frames
+    static const unsigned kLevels[] = { 0, 2, 5, 8 };
+    for (size_t i = 0; i < sizeof(kLevels) / sizeof(kLevels[0]); ++i) {
+        Vector<uint8_t> single, parallel;
+        ASSERT_EQ(OK, encodeSingle(pcm, kNumFrames, kLevels[i], &single));
+        ASSERT_EQ(OK, encodeParallel(pcm, kNumFrames, kLevels[i], 3, &parallel));
+        ASSERT_EQ(single.size(), parallel.size()) << "level " << kLevels[i];
+        ASSERT_EQ(0, memcmp(single.array(), parallel.array(), single.size()))
+                << "level " << kLevels[i];
+    }
+    delete[] pcm;
+}
+
+// Not a pass/fail test: reports the encoding time and the compression of each
+// level for 20 s of 44.1 kHz stereo, on one thread and on four, run with
+// adb logcat -s FlacEncoder_test.
+TEST_F(FlacEncoderTest, BenchmarkCompressionLevels) {
+    static const size_t kNumFrames = 20 * kSampleRate;
+    int16_t *pcm = makeSignal(kNumFrames);
+    const double durationMs = kNumFrames * 1000.0 / kSampleRate;
+
+    for (unsigned level = 0; level <= 8; ++level) {
+        Vector<uint8_t> single, parallel;
+
+        nsecs_t start = systemTime();
+        ASSERT_EQ(OK, encodeSingle(pcm, kNumFrames, level, &single));
+        nsecs_t singleNs = systemTime() - start;
+
+        start = systemTime();
+        ASSERT_EQ(OK, encodeParallel(pcm, kNumFrames, level, 4, &parallel));
+        nsecs_t parallelNs = systemTime() - start;
+
+        ALOGI("level %u: %.1f%% of the PCM size, %.2f ms per s on 1 thread, %.2f ms per s on 4",
+                level, 100.0 * single.size() / (kNumFrames * kNumChannels * 2),
+                singleNs / 1e6 / (durationMs / 1000), parallelNs / 1e6 / (durationMs / 1000));
+    }
+    delete[] pcm;
+}
+
+} // namespace android
@@ -0,0 +1,305 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "ID3_test"
+
+#include <gtest/gtest.h>
+#include <utils/Log.h>
+#include <utils/String8.h>
+
+#include <media/stagefright/DataSource.h>
+
+#include "include/ID3.h"
+
+#include <string.h>
+
+namespace android {
+
+static const size_t kMaxTagSize = 1024 * 1024;
+
+// A file in memory that counts what is read of it.
+struct CountingSource : public DataSource {
+    CountingSource(const uint8_t *data, size_t size)
+        : mData(data),
+          mSize(size),
+          mBytesRead(0) {
+    }
+
+    virtual status_t initCheck() const {
+        return OK;
+    }
+
+    virtual ssize_t readAt(off64_t offset, void *data, size_t size) {
+        if (offset < 0 || offset >= (off64_t)mSize) {
+            return 0;
+        }
+        if (size > mSize - offset) {
+            size = mSize - offset;
+        }
+        memcpy(data, mData + offset, size);
+        mBytesRead += size;
+        return size;
+    }
+
+    virtual status_t getSize(off64_t *size) {
+        *size = mSize;
+        return OK;
+    }
+
+    size_t bytesRead() const {
+        return mBytesRead;
+    }
+
+private:
+    const uint8_t *mData;
+    size_t mSize;
+    size_t mBytesRead;
+};
+
+class ID3Test : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        mTag = new uint8_t[kMaxTagSize];
+        mSize = 10;
+        mMajorVersion = 4;
+    }
+
+    virtual void TearDown() {
+        delete[] mTag;
+    }
+
+    static void writeSize(uint8_t *dst, size_t x, bool syncsafe) {
+        for (size_t i = 0; i < 4; ++i) {
+            if (syncsafe) {
+                dst[3 - i] = x & 0x7f;
+                x >>= 7;
+            } else {
+                dst[3 - i] = x & 0xff;
+                x >>= 8;
+            }
+        }
+    }
+
+    void append(const void *data, size_t size) {
+        ASSERT_LE(mSize + size, kMaxTagSize);
+        memcpy(&mTag[mSize], data, size);
+        mSize += size;
+    }
+
+    void startTag(uint8_t majorVersion) {
+        mMajorVersion = majorVersion;
+    }
+
+    // An ID3v2.3 or 2.4 frame, its flags 0x0001 for a data length indicator
+    // and 0x0002 for unsynchronization of ID3v2.4.
+    void addFrame(const char *id, const void *data, size_t size,
+            uint16_t flags = 0, bool iTunes = false) {
+        uint8_t *payload = new uint8_t[4 + 2 * size];
+        size_t payloadSize = 0;
+        if (flags & 1) {
+            writeSize(payload, size, true);
+            payloadSize = 4;
+        }
+        for (size_t i = 0; i < size; ++i) {
+            uint8_t c = ((const uint8_t *)data)[i];
+            payload[payloadSize++] = c;
+            if ((flags & 2) && c == 0xff) {
+                payload[payloadSize++] = 0x00;
+            }
+        }
+
+        uint8_t header[10];
+        memcpy(header, id, 4);
+        writeSize(&header[4], payloadSize, mMajorVersion == 4 && !iTunes);
+        header[8] = flags >> 8;
+        header[9] = flags & 0xff;
+        append(header, sizeof(header));
+        append(payload, payloadSize);
+        delete[] payload;
+    }
+
+    void addTextFrame(const char *id, const char *text, uint16_t flags = 0) {
+        uint8_t data[256];
+        data[0] = 0x03;  // UTF-8
+        memcpy(&data[1], text, strlen(text));
+        addFrame(id, data, 1 + strlen(text), flags);
+    }
+
+    // A large album art frame with bytes to be unsynchronized.
+    void addAlbumArt(size_t size, uint16_t flags = 0) {
+        uint8_t *data = new uint8_t[size];
+        static const char kHeader[] = "\0image/jpeg\0\x03\0";
+        memcpy(data, kHeader, sizeof(kHeader) - 1);
+        for (size_t i = sizeof(kHeader) - 1; i < size; ++i) {
+            data[i] = (i % 7 == 0) ? 0xff : (i % 7 == 1) ? 0x00 : i & 0xff;
+        }
+        addFrame("APIC", data, size, flags);
+        delete[] data;
+    }
+
+    void finishTag(uint8_t flags = 0) {
+        memcpy(mTag, "ID3", 3);
+        mTag[3] = mMajorVersion;
+        mTag[4] = 0;
+        mTag[5] = flags;
+        writeSize(&mTag[6], mSize - 10, true);
+    }
+
+    static String8 getText(const ID3 &tag, const char *id) {
+        String8 text;
+        ID3::Iterator it(tag, id);
+        if (!it.done()) {
+            it.getString(&text);
+        }
+        return text;
+    }
+
+    static void checkAlbumArt(const ID3 &tag, size_t size) {
+        size_t length;
+        String8 mime;
+        const uint8_t *data = (const uint8_t *)tag.getAlbumArt(&length, &mime);
+        ASSERT_TRUE(data != NULL);
+        EXPECT_STREQ("image/jpeg", mime.string());
+
+        // less the encoding, mime type, picture type and description
+        ASSERT_EQ(size - 14, length);
+        for (size_t i = 14; i < size; ++i) {
+            uint8_t expected = (i % 7 == 0) ? 0xff : (i % 7 == 1) ? 0x00 : i & 0xff;
+            ASSERT_EQ(expected, data[i - 14]) << "at " << i;
+        }
+    }
+
+    uint8_t *mTag;
+    size_t mSize;
+    uint8_t mMajorVersion;
+};
+
+// The frames asked for are read, the album art next to them is not.
+TEST_F(ID3Test, ReadsRequestedFramesOnly) {
+    static const size_t kAlbumArtSize = 512 * 1024;
+
+    startTag(3);
+    addTextFrame("TIT2", "title");
+    addAlbumArt(kAlbumArtSize);
+    addTextFrame("TPE1", "artist");
+    finishTag();
+
+    sp<CountingSource> source = new CountingSource(mTag, mSize);
+    ID3 tag(source, true /* ignoreV1 */);
+    ASSERT_TRUE(tag.isValid());
+    EXPECT_EQ(ID3::ID3_V2_3, tag.version());
+    EXPECT_EQ(mSize, tag.rawSize());
+
+    EXPECT_STREQ("title", getText(tag, "TIT2").string());
+    EXPECT_STREQ("artist", getText(tag, "TPE1").string());
+    EXPECT_STREQ("", getText(tag, "TALB").string());
+    EXPECT_LT(source->bytesRead(), kAlbumArtSize / 2);
+
+    checkAlbumArt(tag, kAlbumArtSize);
+}
+
+// Per frame unsynchronization and data length indicators of ID3v2.4 are
+// undone as the frames are read, from a source and from memory alike.
+TEST_F(ID3Test, DecodesV2_4Frames) {
+    static const size_t kAlbumArtSize = 100 * 1024;
+
+    addTextFrame("TIT2", "ti\xfftle", 0x0002);
+    addAlbumArt(kAlbumArtSize, 0x0003);
+    addTextFrame("TPE1", "artist", 0x0001);
+    finishTag();
+
+    sp<CountingSource> source = new CountingSource(mTag, mSize);
+    ID3 tag(source, true /* ignoreV1 */);
+    ID3 copy(mTag, mSize, true /* ignoreV1 */);
+
+    const ID3 *tags[] = { &tag, &copy };
+    for (size_t i = 0; i < 2; ++i) {
+        ASSERT_TRUE(tags[i]->isValid());
+        EXPECT_EQ(ID3::ID3_V2_4, tags[i]->version());
+        EXPECT_STREQ("ti\xfftle", getText(*tags[i], "TIT2").string());
+        EXPECT_STREQ("artist", getText(*tags[i], "TPE1").string());
+        checkAlbumArt(*tags[i], kAlbumArtSize);
+    }
+}
+
+// iTunes writes the frame sizes of ID3v2.4 tags as plain integers.
+TEST_F(ID3Test, AcceptsITunesFrameSizes) {
+    uint8_t data[300];
+    data[0] = 0x03;
+    memset(&data[1], 'a', sizeof(data) - 1);
+    addFrame("TIT2", data, sizeof(data), 0, true /* iTunes */);
+    addTextFrame("TPE1", "artist");
+    finishTag();
+
+    sp<CountingSource> source = new CountingSource(mTag, mSize);
+    ID3 tag(source, true /* ignoreV1 */);
+    ASSERT_TRUE(tag.isValid());
+    EXPECT_EQ(sizeof(data) - 1, getText(tag, "TIT2").length());
+    EXPECT_STREQ("artist", getText(tag, "TPE1").string());
+}
+
+// A tag unsynchronized as a whole, frame headers included.
+TEST_F(ID3Test, ReadsUnsynchronizedTag) {
+    startTag(3);
+    // the frame size that of the data before unsynchronization
+    uint8_t frame[] = { 'T', 'I', 'T', '2', 0, 0, 0, 5, 0, 0,
+                        0x00, 't', 0xff, 0x00, 0xe0, 'x' };
+    append(frame, sizeof(frame));
+    addTextFrame("TPE1", "artist");
+    finishTag(0x80);
+
+    sp<CountingSource> source = new CountingSource(mTag, mSize);
+    ID3 tag(source, true /* ignoreV1 */);
+    ASSERT_TRUE(tag.isValid());
+
+    ID3::Iterator it(tag, "TIT2");
+    ASSERT_FALSE(it.done());
+    size_t length;
+    const uint8_t *data = it.getData(&length);
+    ASSERT_EQ(5u, length);
+    EXPECT_EQ(0, memcmp(data, "\0t\xff\xe0x", 5));
+
+    EXPECT_STREQ("artist", getText(tag, "TPE1").string());
+}
+
+TEST_F(ID3Test, IteratesAllFrames) {
+    startTag(3);
+    addTextFrame("TIT2", "title");
+    addTextFrame("TALB", "album");
+    addTextFrame("TPE1", "artist");
+    // padding
+    static const uint8_t kPadding[32] = { 0 };
+    append(kPadding, sizeof(kPadding));
+    finishTag();
+
+    sp<CountingSource> source = new CountingSource(mTag, mSize);
+    ID3 tag(source, true /* ignoreV1 */);
+    ASSERT_TRUE(tag.isValid());
+
+    static const char *kIDs[] = { "TIT2", "TALB", "TPE1" };
+    size_t n = 0;
+    for (ID3::Iterator it(tag, NULL); !it.done(); it.next()) {
+        ASSERT_LT(n, 3u);
+        String8 id;
+        it.getID(&id);
+        EXPECT_STREQ(kIDs[n], id.string());
+        ++n;
+    }
+    EXPECT_EQ(3u, n);
+}
+
+}  // namespace android
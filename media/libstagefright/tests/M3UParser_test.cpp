@@ -0,0 +1,176 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "M3UParser_test"
+
+#include <gtest/gtest.h>
+#include <utils/Log.h>
+#include <utils/Timers.h>
+
+#include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/AMessage.h>
+#include <media/stagefright/foundation/AString.h>
+
+#include "M3UParser.h"
+
+#include <stdio.h>
+
+namespace android {
+
+static const char *kBaseURI = "http://example.com/live/index.m3u8";
+
+class M3UParserTest : public ::testing::Test {
+protected:
+    // A sliding window of a live playlist, a new key from keySeq on and a
+    // discontinuity at discontinuitySeq, -1 for none.
+    static AString makePlaylist(
+            int32_t firstSeq, int32_t numSegments,
+            int32_t keySeq = -1, int32_t discontinuitySeq = -1,
+            const char *prefix = "segment") {
+        char line[256];
+        AString playlist("#EXTM3U\n#EXT-X-TARGETDURATION:4\n");
+        snprintf(line, sizeof(line), "#EXT-X-MEDIA-SEQUENCE:%d\n", firstSeq);
+        playlist.append(line);
+
+        for (int32_t seq = firstSeq; seq < firstSeq + numSegments; ++seq) {
+            if (seq == keySeq) {
+                playlist.append("#EXT-X-KEY:METHOD=AES-128,URI=\"key.bin\"\r\n");
+            }
+            if (seq == discontinuitySeq) {
+                playlist.append("#EXT-X-DISCONTINUITY\n");
+            }
+            snprintf(line, sizeof(line), "#EXTINF:%d.%03d,\n%s%d.ts\n\n",
+                    3 + seq % 2, seq % 1000, prefix, seq);
+            playlist.append(line);
+        }
+        return playlist;
+    }
+
+    static sp<M3UParser> parse(
+            const AString &playlist, const sp<M3UParser> &previous = NULL) {
+        return new M3UParser(kBaseURI, playlist.c_str(), playlist.size(), previous);
+    }
+
+    // Checks the items of two parses of the same playlist are the same.
+    static void compareItems(const sp<M3UParser> &a, const sp<M3UParser> &b) {
+        EXPECT_EQ(OK, a->initCheck());
+        EXPECT_EQ(OK, b->initCheck());
+        EXPECT_EQ(a->size(), b->size());
+
+        for (size_t i = 0; i < a->size() && i < b->size(); ++i) {
+            AString uriA, uriB;
+            sp<AMessage> metaA, metaB;
+            EXPECT_TRUE(a->itemAt(i, &uriA, &metaA));
+            EXPECT_TRUE(b->itemAt(i, &uriB, &metaB));
+            EXPECT_STREQ(uriA.c_str(), uriB.c_str()) << "item " << i;
+
+            int64_t durationA, durationB;
+            EXPECT_TRUE(metaA->findInt64("durationUs", &durationA));
+            EXPECT_TRUE(metaB->findInt64("durationUs", &durationB));
+            EXPECT_EQ(durationA, durationB) << "item " << i;
+
+            int32_t discontinuityA = 0, discontinuityB = 0;
+            metaA->findInt32("discontinuity", &discontinuityA);
+            metaB->findInt32("discontinuity", &discontinuityB);
+            EXPECT_EQ(discontinuityA, discontinuityB) << "item " << i;
+
+            AString methodA, methodB;
+            metaA->findString("cipher-method", &methodA);
+            metaB->findString("cipher-method", &methodB);
+            EXPECT_STREQ(methodA.c_str(), methodB.c_str()) << "item " << i;
+        }
+    }
+
+    // The items of playlist taken from previous.
+    static size_t countReused(const sp<M3UParser> &playlist, const sp<M3UParser> &previous) {
+        size_t numReused = 0;
+        for (size_t i = 0; i < playlist->size(); ++i) {
+            AString uri;
+            sp<AMessage> meta;
+            CHECK(playlist->itemAt(i, &uri, &meta));
+            for (size_t j = 0; j < previous->size(); ++j) {
+                sp<AMessage> previousMeta;
+                CHECK(previous->itemAt(j, &uri, &previousMeta));
+                if (meta == previousMeta) {
+                    ++numReused;
+                }
+            }
+        }
+        return numReused;
+    }
+
+    // Parses playlist given previous, checks it against a parse on its own
+    // and returns how many items were taken from previous.
+    static size_t reparse(const AString &playlist, const sp<M3UParser> &previous) {
+        sp<M3UParser> reparsed = parse(playlist, previous);
+        compareItems(parse(playlist), reparsed);
+        return countReused(reparsed, previous);
+    }
+};
+
+TEST_F(M3UParserTest, TestRefreshMatchesFullParse) {
+    sp<M3UParser> previous = parse(makePlaylist(100, 10));
+
+    // two segments out, a key and a discontinuity among the three in
+    EXPECT_EQ(8u, reparse(makePlaylist(102, 11, 112, 111), previous));
+
+    // the key makes the segment it precedes parsed again
+    previous = parse(makePlaylist(100, 10, 104));
+    EXPECT_EQ(7u, reparse(makePlaylist(102, 10, 104), previous));
+
+    // and so does one that slid into the first place
+    previous = parse(makePlaylist(100, 10));
+    EXPECT_EQ(7u, reparse(makePlaylist(102, 10, 102), previous));
+}
+
+TEST_F(M3UParserTest, TestRefreshAfterRestart) {
+    // same sequence numbers, other segments
+    sp<M3UParser> previous = parse(makePlaylist(0, 10));
+    EXPECT_EQ(0u, reparse(makePlaylist(0, 10, -1, -1, "restart"), previous));
+
+    // the sequence number going back
+    previous = parse(makePlaylist(8, 10));
+    EXPECT_EQ(7u, reparse(makePlaylist(5, 10), previous));
+}
+
+// Not a pass/fail test: reports the time to parse the refresh of a two hour
+// window of 4 s segments on its own and given the previous one, run with
+// adb logcat -s M3UParser_test.
+TEST_F(M3UParserTest, BenchmarkRefresh) {
+    static const int32_t kNumSegments = 1800;
+    static const int kIterations = 20;
+
+    sp<M3UParser> previous = parse(makePlaylist(0, kNumSegments));
+    AString refresh = makePlaylist(1, kNumSegments);
+
+    nsecs_t start = systemTime();
+    for (int i = 0; i < kIterations; ++i) {
+        ASSERT_EQ(OK, parse(refresh)->initCheck());
+    }
+    nsecs_t fullNs = systemTime() - start;
+
+    start = systemTime();
+    for (int i = 0; i < kIterations; ++i) {
+        ASSERT_EQ(OK, parse(refresh, previous)->initCheck());
+    }
+    nsecs_t deltaNs = systemTime() - start;
+
+    ALOGI("%d segments: %.2f ms to parse, %.2f ms given the previous playlist",
+            kNumSegments, fullNs / 1e6 / kIterations, deltaNs / 1e6 / kIterations);
+}
+
+} // namespace android
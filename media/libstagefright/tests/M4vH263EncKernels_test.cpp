@@ -0,0 +1,257 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "M4vH263EncKernels_test"
+
+#include <gtest/gtest.h>
+#include <utils/Log.h>
+#include <utils/Timers.h>
+
+#include "mp4enc_lib.h"
+#include "dct.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace android {
+
+// The NEON kernels of the software MPEG4/H.263 encoder must give the same
+// output as the C ones, bit for bit, so that the bitstream does not depend
+// on the build. Nothing to compare on targets without NEON.
+#ifdef M4VENC_NEON
+
+static const int kWidth = 40;
+
+class M4vH263EncKernelsTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        srand(1);
+    }
+
+    // Fills an 8x8 block and its prediction with flat, noisy, saturated or
+    // random content, the first two being the usual case.
+    void fillBlock(UChar *cur, UChar *pred) {
+        int kind = rand() % 4;
+        int base = rand() % 256;
+        int amp = 1 << (rand() % 9);
+        for (int i = 0; i < 8 * kWidth; ++i) {
+            cur[i] = pixel(kind, base, amp);
+        }
+        for (int i = 0; i < 16 * 8; ++i) {
+            pred[i] = pixel(kind, base, amp);
+        }
+    }
+
+    static UChar pixel(int kind, int base, int amp) {
+        int v;
+        if (kind == 0) {
+            v = rand() % 256;
+        } else if (kind == 1) {
+            v = (rand() & 1) ? 255 : 0;
+        } else {
+            v = base + rand() % amp - amp / 2;
+        }
+        return v < 0 ? 0 : v > 255 ? 255 : v;
+    }
+
+    static void setQP(struct QPstruct *qp, int QP) {
+        qp->QPx2 = QP << 1;
+        qp->QP = QP;
+        qp->QPdiv2 = QP >> 1;
+        qp->QPx2plus = qp->QPx2 + qp->QPdiv2;
+        qp->Addition = QP - 1 + (QP & 0x1);
+    }
+};
+
+TEST_F(M4vH263EncKernelsTest, TestDCT) {
+    UChar cur[8 * kWidth], pred[16 * 8];
+    Short ref[128], out[128];
+
+    for (int i = 0; i < 20000; ++i) {
+        fillBlock(cur, pred);
+        memset(ref, 0, sizeof(ref));
+        ref[64] = (rand() % 8) ? ColThInter[1 + rand() % 31] : rand() % 3000;
+        memcpy(out, ref, sizeof(ref));
+
+        if (i & 1) {
+            BlockDCT_AANIntra(ref, cur, NULL, kWidth);
+            BlockDCT_AANIntra_NEON(out, cur, NULL, kWidth);
+        } else {
+            BlockDCT_AANwSub(ref, cur, pred, kWidth);
+            BlockDCT_AANwSub_NEON(out, cur, pred, kWidth);
+        }
+        ASSERT_EQ(0, memcmp(ref, out, sizeof(ref))) << "block " << i;
+    }
+}
+
+TEST_F(M4vH263EncKernelsTest, TestQuantDequant) {
+    UChar cur[8 * kWidth], pred[16 * 8];
+    Short ref[128], out[128];
+    Short qref[64], qout[64];
+    UChar colRef[8], colOut[8], rowRef, rowOut;
+    UInt zzRef[2], zzOut[2];
+    struct QPstruct qp;
+
+    for (int i = 0; i < 20000; ++i) {
+        int QP = 1 + rand() % 31;
+        bool intra = i & 1;
+        UChar shortHeader = (i >> 1) & 1;
+        int dc_scaler = shortHeader ? 8 : cal_dc_scalerENC(QP, 1 + rand() % 2);
+        setQP(&qp, QP);
+
+        memset(ref, 0, sizeof(ref));
+        if (rand() % 4) {
+            // real DCT output, with the skipped columns marked
+            fillBlock(cur, pred);
+            ref[64] = intra ? ColThIntra[QP] : ColThInter[QP];
+            BlockDCT_AANwSub(ref, cur, pred, kWidth);
+        } else {
+            for (int j = 64; j < 128; ++j) {
+                ref[j] = (rand() % 3) ? rand() % 2000 - 1000 : (Short)rand();
+            }
+            for (int j = 64; j < 72; ++j) {
+                if (rand() % 4 == 0) {
+                    ref[j] = 0x7fff;
+                }
+            }
+        }
+        memcpy(out, ref, sizeof(ref));
+        for (int j = 0; j < 64; ++j) {
+            qref[j] = qout[j] = rand();
+        }
+        rowRef = rowOut = 0;
+        zzRef[0] = zzRef[1] = zzOut[0] = zzOut[1] = 0;
+
+        int cbpRef, cbpOut;
+        if (intra) {
+            cbpRef = BlockQuantDequantH263Intra(
+                    ref, qref, &qp, colRef, &rowRef, zzRef, 8, 0, dc_scaler, shortHeader);
+            cbpOut = BlockQuantDequantH263Intra_NEON(
+                    out, qout, &qp, colOut, &rowOut, zzOut, 8, 0, dc_scaler, shortHeader);
+        } else {
+            cbpRef = BlockQuantDequantH263Inter(
+                    ref, qref, &qp, colRef, &rowRef, zzRef, 8, 0, 0, shortHeader);
+            cbpOut = BlockQuantDequantH263Inter_NEON(
+                    out, qout, &qp, colOut, &rowOut, zzOut, 8, 0, 0, shortHeader);
+            ASSERT_EQ(zzRef[0], zzOut[0]) << "block " << i;
+            ASSERT_EQ(zzRef[1], zzOut[1]) << "block " << i;
+        }
+        ASSERT_EQ(cbpRef, cbpOut) << "block " << i;
+        ASSERT_EQ(rowRef, rowOut) << "block " << i;
+        ASSERT_EQ(0, memcmp(colRef, colOut, sizeof(colRef))) << "block " << i;
+        ASSERT_EQ(0, memcmp(qref, qout, sizeof(qref))) << "block " << i;
+        ASSERT_EQ(0, memcmp(ref, out, sizeof(ref))) << "block " << i;
+    }
+}
+
+TEST_F(M4vH263EncKernelsTest, TestIDCTMotionComp) {
+    UChar cur[8 * kWidth], pred[16 * 8];
+    UChar recRef[8 * kWidth], recOut[8 * kWidth];
+    Short ref[64], out[64];
+    UChar bitmapcol[8], bitmaprow;
+
+    for (int i = 0; i < 20000; ++i) {
+        fillBlock(cur, pred);
+        memcpy(recRef, cur, sizeof(recRef));
+        memcpy(recOut, cur, sizeof(recOut));
+
+        // dequantized coefficients are within [-2048, 2047]
+        memset(bitmapcol, 0, sizeof(bitmapcol));
+        bitmaprow = 0;
+        for (int j = 0; j < 64; ++j) {
+            ref[j] = (rand() % 4) ? 0 : (rand() & 1) ? rand() % 4095 - 2048 : rand() % 41 - 20;
+            if (ref[j]) {
+                bitmapcol[j & 7] |= 128 >> (j >> 3);
+                bitmaprow |= 128 >> (j & 7);
+            }
+        }
+        memcpy(out, ref, sizeof(ref));
+
+        int lx_intra = (kWidth << 1) | (i & 1);
+        BlockIDCTMotionComp(ref, bitmapcol, bitmaprow, 8, recRef, pred, lx_intra);
+        BlockIDCTMotionComp_NEON(out, bitmapcol, bitmaprow, 8, recOut, pred, lx_intra);
+        ASSERT_EQ(0, memcmp(recRef, recOut, sizeof(recRef))) << "block " << i;
+        ASSERT_EQ(0, memcmp(ref, out, sizeof(ref))) << "block " << i;
+    }
+}
+
+// Not a pass/fail test: reports the time per 8x8 INTER block of each stage
+// of CodeMB_H263() for the C and the NEON kernels, run with
+// adb logcat -s M4vH263EncKernels_test.
+TEST_F(M4vH263EncKernelsTest, BenchmarkStages) {
+    static const int kBlocks = 256;
+    static const int kIterations = 200;
+    UChar *cur = new UChar[kBlocks * 8 * kWidth];
+    UChar *pred = new UChar[kBlocks * 16 * 8];
+    UChar rec[8 * kWidth];
+    Short block[128], qcoeff[64];
+    UChar bitmapcol[8], bitmaprow;
+    UInt bitmapzz[2];
+    struct QPstruct qp;
+    nsecs_t dct[2] = {0, 0}, quant[2] = {0, 0}, idct[2] = {0, 0};
+
+    for (int b = 0; b < kBlocks; ++b) {
+        fillBlock(cur + b * 8 * kWidth, pred + b * 16 * 8);
+    }
+    setQP(&qp, 8);
+    memset(block, 0, sizeof(block));
+
+    for (int neon = 0; neon < 2; ++neon) {
+        for (int i = 0; i < kIterations; ++i) {
+            for (int b = 0; b < kBlocks; ++b) {
+                UChar *c = cur + b * 8 * kWidth;
+                UChar *p = pred + b * 16 * 8;
+
+                block[64] = ColThInter[qp.QP];
+                nsecs_t t0 = systemTime();
+                if (neon) {
+                    BlockDCT_AANwSub_NEON(block, c, p, kWidth);
+                } else {
+                    BlockDCT_AANwSub(block, c, p, kWidth);
+                }
+                nsecs_t t1 = systemTime();
+                if (neon) {
+                    BlockQuantDequantH263Inter_NEON(
+                            block, qcoeff, &qp, bitmapcol, &bitmaprow, bitmapzz, 8, 0, 0, 0);
+                } else {
+                    BlockQuantDequantH263Inter(
+                            block, qcoeff, &qp, bitmapcol, &bitmaprow, bitmapzz, 8, 0, 0, 0);
+                }
+                nsecs_t t2 = systemTime();
+                if (neon) {
+                    BlockIDCTMotionComp_NEON(block, bitmapcol, bitmaprow, 8, rec, p, kWidth << 1);
+                } else {
+                    BlockIDCTMotionComp(block, bitmapcol, bitmaprow, 8, rec, p, kWidth << 1);
+                }
+                nsecs_t t3 = systemTime();
+                dct[neon] += t1 - t0;
+                quant[neon] += t2 - t1;
+                idct[neon] += t3 - t2;
+            }
+        }
+    }
+
+    const double n = (double)kBlocks * kIterations;
+    ALOGI("ns per block, C / NEON: DCT %.1f / %.1f, quant %.1f / %.1f, IDCT %.1f / %.1f",
+            dct[0] / n, dct[1] / n, quant[0] / n, quant[1] / n, idct[0] / n, idct[1] / n);
+    delete[] cur;
+    delete[] pred;
+}
+
+#endif  // M4VENC_NEON
+
+} // namespace android
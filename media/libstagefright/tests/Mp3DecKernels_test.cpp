@@ -0,0 +1,105 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "Mp3DecKernels_test"
+
+#include <gtest/gtest.h>
+#include <utils/Log.h>
+#include <utils/Timers.h>
+
+#include "pvmp3_polyphase_filter_window.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace android {
+
+// The NEON polyphase filter window of the software MP3 decoder must give the
+// same PCM as the C one, bit for bit. Nothing to compare on targets without
+// NEON.
+#ifdef PVMP3_NEON
+
+// the filter window reads synth_buffer[0..511]
+static const int kSynthSize = 512;
+
+class Mp3DecKernelsTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        srand(1);
+    }
+
+    // Fills the synthesis buffer with full scale, typical or saturated
+    // subband samples.
+    static void fillSynth(int32 *synth) {
+        int kind = rand() % 3;
+        for (int i = 0; i < kSynthSize; ++i) {
+            if (kind == 0) {
+                synth[i] = (int32)(((uint32_t)rand() << 16) ^ rand());
+            } else if (kind == 1) {
+                synth[i] = rand() % 2000000 - 1000000;
+            } else {
+                synth[i] = (rand() & 1) ? 0x7fffffff : (int32)0x80000000;
+            }
+        }
+    }
+};
+
+TEST_F(Mp3DecKernelsTest, TestPolyphaseFilterWindow) {
+    int32 synth[kSynthSize];
+    int16 ref[64], out[64];
+
+    for (int i = 0; i < 20000; ++i) {
+        fillSynth(synth);
+        int32 numChannels = 1 + (i & 1);
+        // mono output is 32 samples, the rest must be left alone
+        memset(ref, 0x55, sizeof(ref));
+        memset(out, 0x55, sizeof(out));
+
+        pvmp3_polyphase_filter_window(synth, ref, numChannels);
+        pvmp3_polyphase_filter_window_neon(synth, out, numChannels);
+        ASSERT_EQ(0, memcmp(ref, out, sizeof(ref))) << "iteration " << i;
+    }
+}
+
+// Not a pass/fail test: reports the time per 32 output samples of the C and
+// the NEON filter window, run with adb logcat -s Mp3DecKernels_test.
+TEST_F(Mp3DecKernelsTest, BenchmarkPolyphaseFilterWindow) {
+    static const int kIterations = 100000;
+    int32 synth[kSynthSize];
+    int16 pcm[64];
+    nsecs_t elapsed[2];
+
+    fillSynth(synth);
+    for (int neon = 0; neon < 2; ++neon) {
+        nsecs_t start = systemTime();
+        for (int i = 0; i < kIterations; ++i) {
+            if (neon) {
+                pvmp3_polyphase_filter_window_neon(synth, pcm, 2);
+            } else {
+                pvmp3_polyphase_filter_window(synth, pcm, 2);
+            }
+        }
+        elapsed[neon] = systemTime() - start;
+    }
+
+    ALOGI("ns per call, C / NEON: %.1f / %.1f",
+            (double)elapsed[0] / kIterations, (double)elapsed[1] / kIterations);
+}
+
+#endif  // PVMP3_NEON
+
+} // namespace android
@@ -0,0 +1,172 @@
+/*
+ * Copyright 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "WebmFrameSink_test"
+
+#include <gtest/gtest.h>
+#include <utils/Log.h>
+#include <utils/Timers.h>
+
+#include <media/stagefright/MediaBuffer.h>
+
+#include "webm/WebmConstants.h"
+#include "webm/WebmFrameThread.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace webm;
+
+namespace android {
+
+class WebmFrameSinkTest : public ::testing::Test {
+protected:
+    virtual void SetUp() {
+        strcpy(mPath, "/data/local/tmp/webm_sink_XXXXXX");
+        mFd = mkstemp(mPath);
+        ASSERT_GE(mFd, 0);
+    }
+
+    virtual void TearDown() {
+        close(mFd);
+        unlink(mPath);
+    }
+
+    // Queues numVideo frames at 30 fps with a key frame every second, interleaved audio frames
+    // every 20 ms, and runs the sink to EOS. Returns the time spent in the sink.
+    nsecs_t writeFrames(int numVideo, size_t videoSize, size_t audioSize, int *numFrames) {
+        LinkedBlockingQueue<const sp<WebmFrame> > video, audio;
+        MediaBuffer *videoBuffer = new MediaBuffer(videoSize);
+        MediaBuffer *audioBuffer = new MediaBuffer(audioSize);
+        memset(videoBuffer->data(), 0x5a, videoSize);
+        memset(audioBuffer->data(), 0xa5, audioSize);
+
+        *numFrames = 0;
+        uint64_t lastMs = numVideo * 1000ll / 30;
+        for (int i = 0; i < numVideo; ++i, ++*numFrames) {
+            video.push(new WebmFrame(kVideoType, i % 30 == 0, i * 1000ll / 30, videoBuffer));
+        }
+        for (uint64_t ms = 0; ms < lastMs; ms += 20, ++*numFrames) {
+            audio.push(new WebmFrame(kAudioType, true, ms, audioBuffer));
+        }
+        video.push(WebmFrame::EOS);
+        audio.push(WebmFrame::EOS);
+        videoBuffer->release();
+        audioBuffer->release();
+
+        uint64_t segmentDataStart = 0;
+        sp<WebmFrameSinkThread> sink =
+                new WebmFrameSinkThread(mFd, segmentDataStart, video, audio, mCues);
+        nsecs_t start = systemTime();
+        sink->start();
+        // run() stops by itself at EOS, stop() right away would not let it drain the queues
+        while (sink->running()) {
+            usleep(1000);
+        }
+        sink->stop();
+        return systemTime() - start;
+    }
+
+    char mPath[64];
+    int mFd;
+    EbmlBuffer mCues;
+};
+
+// Reads an EBML coded id (keeping its length descriptor) or size (dropping it).
+static uint64_t readCoded(const uint8_t *&p, bool keepDescriptor) {
+    int len = 1;
+    while (len <= 8 && !(p[0] & (0x80 >> (len - 1)))) {
+        ++len;
+    }
+    uint64_t u = keepDescriptor ? p[0] : p[0] & (0xff >> len);
+    for (int i = 1; i < len; ++i) {
+        u = (u << 8) | p[i];
+    }
+    p += len;
+    return u;
+}
+
+TEST_F(WebmFrameSinkTest, TestClustersAndCues) {
+    int numFrames;
+    writeFrames(95, 1000, 100, &numFrames);
+
+    off_t fileSize = lseek(mFd, 0, SEEK_END);
+    ASSERT_GT(fileSize, 0);
+    uint8_t *file = new uint8_t[fileSize];
+    ASSERT_EQ(fileSize, pread(mFd, file, fileSize, 0));
+
+    // clusters of known size back to back, covering the file
+    int numClusters = 0, numBlocks = 0;
+    const uint8_t *p = file;
+    while (p < file + fileSize) {
+        ASSERT_EQ((uint64_t) kMkvCluster, readCoded(p, true));
+        const uint8_t *end = p + readCoded(p, false);
+        ASSERT_LE(end, file + fileSize);
+        ASSERT_EQ((uint64_t) kMkvTimecode, readCoded(p, true));
+        p += readCoded(p, false);
+        while (p < end) {
+            ASSERT_EQ((uint64_t) kMkvSimpleBlock, readCoded(p, true));
+            p += readCoded(p, false);
+            ++numBlocks;
+        }
+        ASSERT_EQ(end, p);
+        ++numClusters;
+    }
+    ASSERT_EQ(numFrames, numBlocks);
+    ASSERT_EQ(4, numClusters);
+
+    // one cue point per flush, each pointing at a cluster
+    int numCuePoints = 0;
+    p = mCues.data();
+    while (p < mCues.data() + mCues.size()) {
+        ASSERT_EQ((uint64_t) kMkvCuePoint, readCoded(p, true));
+        const uint8_t *end = p + readCoded(p, false);
+        ASSERT_EQ((uint64_t) kMkvCueTime, readCoded(p, true));
+        p += readCoded(p, false);
+        ASSERT_EQ((uint64_t) kMkvCueTrackPositions, readCoded(p, true));
+        readCoded(p, false);
+        ASSERT_EQ((uint64_t) kMkvCueTrack, readCoded(p, true));
+        p += readCoded(p, false);
+        ASSERT_EQ((uint64_t) kMkvCueClusterPosition, readCoded(p, true));
+        size_t len = readCoded(p, false);
+        uint64_t off = 0;
+        for (size_t i = 0; i < len; ++i) {
+            off = (off << 8) | *p++;
+        }
+        ASSERT_EQ(end, p);
+        ASSERT_LT(off, (uint64_t) fileSize);
+        const uint8_t *cluster = file + off;
+        ASSERT_EQ((uint64_t) kMkvCluster, readCoded(cluster, true));
+        ++numCuePoints;
+    }
+    ASSERT_EQ(numClusters, numCuePoints);
+    delete[] file;
+}
+
+// Not a pass/fail test: reports the throughput of the cluster writer for a 2 Mbps recording,
+// run with adb logcat -s WebmFrameSink_test.
+TEST_F(WebmFrameSinkTest, BenchmarkWriteFrames) {
+    int numFrames;
+    nsecs_t elapsed = writeFrames(30 * 60, 2000000 / 8 / 30, 160, &numFrames);
+    ALOGI("%d frames in %lld us, %.0f frames/s",
+            numFrames, (long long)(elapsed / 1000), numFrames * 1e9 / elapsed);
+    ASSERT_GT(lseek(mFd, 0, SEEK_END), 0);
+}
+
+} // namespace android
@@ -32,16 +32,23 @@
 
 namespace android {
 
+const size_t TimedTextSRTSource::kBufferSize = 16384;
+
 TimedTextSRTSource::TimedTextSRTSource(const sp<DataSource>& dataSource)
         : mSource(dataSource),
           mMetaData(new MetaData),
-          mIndex(0) {
+          mIndex(0),
+          mBuffer(new char[kBufferSize]),
+          mBufferOffset(0),
+          mBufferSize(0) {
     // TODO: Need to detect the language, because SRT doesn't give language
     // information explicitly.
     mMetaData->setCString(kKeyMediaLanguage, "und");
 }
 
 TimedTextSRTSource::~TimedTextSRTSource() {
+    delete[] mBuffer;
+    mBuffer = NULL;
 }
 
 status_t TimedTextSRTSource::start() {
@@ -55,6 +62,7 @@ status_t TimedTextSRTSource::start() {
 void TimedTextSRTSource::reset() {
     mTextVector.clear();
     mIndex = 0;
+    mBufferSize = 0;
 }
 
 status_t TimedTextSRTSource::stop() {
@@ -179,7 +187,7 @@ status_t TimedTextSRTSource::readNextLine(off64_t *offset, AString *data) {
     while (true) {
         ssize_t readSize;
         char character;
-        if ((readSize = mSource->readAt(*offset, &character, 1)) < 1) {
+        if ((readSize = readAt(*offset, &character, 1)) < 1) {
             if (readSize == 0) {
                 return ERROR_END_OF_STREAM;
             }
@@ -192,7 +200,7 @@ status_t TimedTextSRTSource::readNextLine(off64_t *offset, AString *data) {
         if (character == 10) {
             break;
         } else if (character == 13) {
-            if ((readSize = mSource->readAt(*offset, &character, 1)) < 1) {
+            if ((readSize = readAt(*offset, &character, 1)) < 1) {
                 if (readSize == 0) {  // end of the stream
                     return OK;
                 }
@@ -210,6 +218,31 @@ status_t TimedTextSRTSource::readNextLine(off64_t *offset, AString *data) {
     return OK;
 }
 
+ssize_t TimedTextSRTSource::readAt(off64_t offset, void *data, size_t size) {
+    if (size > kBufferSize) {
+        return mSource->readAt(offset, data, size);
+    }
+
+    if (offset < mBufferOffset
+            || offset + (off64_t)size > mBufferOffset + (off64_t)mBufferSize) {
+        ssize_t n = mSource->readAt(offset, mBuffer, kBufferSize);
+        if (n < 0) {
+            mBufferSize = 0;
+            return n;
+        }
+        mBufferOffset = offset;
+        mBufferSize = n;
+    }
+
+    // short of size at the end of the file
+    size_t avail = mBufferOffset + mBufferSize - offset;
+    if (size > avail) {
+        size = avail;
+    }
+    memcpy(data, mBuffer + (offset - mBufferOffset), size);
+    return size;
+}
+
 status_t TimedTextSRTSource::getText(
         const MediaSource::ReadOptions *options,
         AString *text, int64_t *startTimeUs, int64_t *endTimeUs) {
@@ -257,7 +290,7 @@ status_t TimedTextSRTSource::getText(
     mIndex++;
 
     char *str = new char[info.textLen];
-    if (mSource->readAt(info.offset, str, info.textLen) < info.textLen) {
+    if (readAt(info.offset, str, info.textLen) < info.textLen) {
         delete[] str;
         return ERROR_IO;
     }
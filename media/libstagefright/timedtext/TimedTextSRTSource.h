@@ -59,7 +59,16 @@ private:
     size_t mIndex;
     KeyedVector<int64_t, TextInfo> mTextVector;
 
+    // The file is read through a buffer of kBufferSize bytes from
+    // mBufferOffset, the lines being scanned a character at a time and the
+    // texts read one after the other.
+    static const size_t kBufferSize;
+    char *mBuffer;
+    off64_t mBufferOffset;
+    size_t mBufferSize;
+
     void reset();
+    ssize_t readAt(off64_t offset, void *data, size_t size);
     status_t scanFile();
     status_t getNextSubtitleInfo(
             off64_t *offset, int64_t *startTimeUs, TextInfo *info);
@@ -220,5 +220,40 @@ TEST_F(TimedTextSRTSourceTest, checkEdgeCase) {
     CheckDataEquals(parcel, subtitle.c_str());
 }
 
+// Cues over several buffers of the file, read in order and after seeks.
+TEST_F(TimedTextSRTSourceTest, readLargeFile) {
+    static const int kNumCues = 2000;
+    AString srt;
+    for (int i = 0; i < kNumCues; i++) {
+        srt.append(StringPrintf("%d\n00:%02d:%02d,000 --> 00:%02d:%02d,500\ntext %d\n\n",
+                i + 1, i / 60, i % 60, i / 60, i % 60, i));
+    }
+    sp<DataSource> stub = new SRTDataSourceStub(srt.c_str(), srt.size());
+    sp<TimedTextSource> source = new TimedTextSRTSource(stub);
+    ASSERT_EQ(OK, source->start());
+
+    for (int i = 0; i < kNumCues; i++) {
+        err = source->read(&startTimeUs, &endTimeUs, &parcel);
+        ASSERT_EQ(OK, err);
+        EXPECT_EQ((int64_t)i * kSecToUsec, startTimeUs);
+        subtitle = StringPrintf("text %d\n\n", i);
+        CheckDataEquals(parcel, subtitle.c_str());
+    }
+    err = source->read(&startTimeUs, &endTimeUs, &parcel);
+    EXPECT_EQ(ERROR_END_OF_STREAM, err);
+
+    static const int kSeekCues[] = { 1500, 3, kNumCues - 1, 800 };
+    for (size_t i = 0; i < NELEM(kSeekCues); i++) {
+        MediaSource::ReadOptions options;
+        options.setSeekTo((int64_t)kSeekCues[i] * kSecToUsec + 100,
+                MediaSource::ReadOptions::SEEK_PREVIOUS_SYNC);
+        err = source->read(&startTimeUs, &endTimeUs, &parcel, &options);
+        ASSERT_EQ(OK, err);
+        EXPECT_EQ((int64_t)kSeekCues[i] * kSecToUsec, startTimeUs);
+        subtitle = StringPrintf("text %d\n\n", kSeekCues[i]);
+        CheckDataEquals(parcel, subtitle.c_str());
+    }
+}
+
 }  // namespace test
 }  // namespace android
@@ -21,14 +21,16 @@
 #include "WebmElement.h"
 #include "WebmConstants.h"
 
+#include <media/stagefright/MediaErrors.h>
 #include <media/stagefright/foundation/ADebug.h>
 #include <utils/Log.h>
 
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <fcntl.h>
-#include <sys/mman.h>
+#include <stdlib.h>
 
 using namespace android;
 using namespace webm;
@@ -109,25 +111,25 @@ uint8_t *WebmElement::serialize(uint64_t& size) {
 }
 
 int WebmElement::write(int fd, uint64_t& size) {
-    uint8_t buf[8];
-    size = totalSize();
-    off64_t off = ::lseek64(fd, (size - 1), SEEK_CUR) - (size - 1);
-    ::write(fd, buf, 1); // extend file
-
-    off64_t curOff = off + size;
-    off64_t alignedOff = off & ~(::sysconf(_SC_PAGE_SIZE) - 1);
-    off64_t mapSize = curOff - alignedOff;
-    off64_t pageOff = off - alignedOff;
-    void *dst = ::mmap64(NULL, mapSize, PROT_WRITE, MAP_SHARED, fd, alignedOff);
-    if (dst == MAP_FAILED) {
-        ALOGE("mmap64 failed; errno = %d", errno);
-        ALOGE("fd %d; flags: %o", fd, ::fcntl(fd, F_GETFL, 0));
-        return errno;
-    } else {
-        serializeInto((uint8_t*) dst + pageOff);
-        ::msync(dst, mapSize, MS_SYNC);
-        return ::munmap(dst, mapSize);
+    uint8_t *buf = serialize(size);
+    uint8_t *cur = buf;
+    uint64_t left = size;
+    while (left > 0) {
+        ssize_t n = ::write(fd, cur, left);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            int err = n < 0 ? errno : EIO;
+            ALOGE("write failed; errno = %d", err);
+            delete[] buf;
+            return err;
+        }
+        cur += n;
+        left -= n;
     }
+    delete[] buf;
+    return 0;
 }
 
 //=================================================================================================
@@ -364,4 +366,141 @@ sp<WebmElement> WebmElement::VideoTrackEntry(
     trackEntryFields.push_back(new WebmMaster(kMkvVideo, videoInfo));
     return new WebmMaster(kMkvTrackEntry, trackEntryFields);
 }
+
+//=================================================================================================
+
+EbmlBuffer::EbmlBuffer()
+    : mData(NULL),
+      mCapacity(0),
+      mSize(0) {
+}
+
+EbmlBuffer::~EbmlBuffer() {
+    free(mData);
+}
+
+void EbmlBuffer::reserve(uint64_t capacity) {
+    if (capacity <= mCapacity) {
+        return;
+    }
+    uint8_t *data = (uint8_t *) realloc(mData, capacity);
+    CHECK(data != NULL);
+    mData = data;
+    mCapacity = capacity;
+}
+
+uint8_t *EbmlBuffer::grow(uint64_t size) {
+    if (mSize + size > mCapacity) {
+        // double, so that a recording settles on its largest cluster after a few reallocations
+        uint64_t capacity = mCapacity ? mCapacity * 2 : 4096;
+        while (capacity < mSize + size) {
+            capacity *= 2;
+        }
+        reserve(capacity);
+    }
+    uint8_t *cur = mData + mSize;
+    mSize += size;
+    return cur;
+}
+
+void EbmlBuffer::append(const void *data, uint64_t size) {
+    memcpy(grow(size), data, size);
+}
+
+void EbmlBuffer::appendHeader(uint64_t id, uint64_t payloadSize) {
+    uint8_t *cur = grow(headerSize(id, payloadSize));
+    cur += serializeCodedUnsigned(id, cur);
+    serializeCodedUnsigned(encodeUnsigned(payloadSize), cur);
+}
+
+void EbmlBuffer::appendUnsigned(uint64_t id, uint64_t value) {
+    appendHeader(id, sizeOf(value));
+    serializeCodedUnsigned(value, grow(sizeOf(value)));
+}
+
+void EbmlBuffer::appendSimpleBlock(
+        int trackNum,
+        int16_t relTimecode,
+        bool key,
+        const uint8_t *data,
+        uint64_t dataSize) {
+    // same layout as WebmSimpleBlock::serializePayload
+    appendHeader(kMkvSimpleBlock, dataSize + 4);
+    uint8_t *cur = grow(dataSize + 4);
+    serializeCodedUnsigned(encodeUnsigned(trackNum), cur);
+    cur[1] = (relTimecode & 0xff00) >> 8;
+    cur[2] = relTimecode & 0xff;
+    cur[3] = key ? 0x80 : 0;
+    memcpy(cur + 4, data, dataSize);
+}
+
+void EbmlBuffer::appendCuePoint(uint64_t time, int track, uint64_t off) {
+    uint64_t positionsSize = unsignedSize(kMkvCueTrack, track)
+            + unsignedSize(kMkvCueClusterPosition, off);
+    uint64_t cuePointSize = unsignedSize(kMkvCueTime, time)
+            + headerSize(kMkvCueTrackPositions, positionsSize) + positionsSize;
+    appendHeader(kMkvCuePoint, cuePointSize);
+    appendUnsigned(kMkvCueTime, time);
+    appendHeader(kMkvCueTrackPositions, positionsSize);
+    appendUnsigned(kMkvCueTrack, track);
+    appendUnsigned(kMkvCueClusterPosition, off);
+}
+
+void EbmlBuffer::appendElement(const sp<WebmElement> &e) {
+    e->serializeInto(grow(e->totalSize()));
+}
+
+status_t EbmlBuffer::write(int fd) const {
+    const uint8_t *cur = mData;
+    uint64_t left = mSize;
+    while (left > 0) {
+        ssize_t n = ::write(fd, cur, left);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            ALOGE("write of %" PRIu64 " bytes failed; errno = %d", left, n < 0 ? errno : 0);
+            return n < 0 ? -errno : ERROR_IO;
+        }
+        cur += n;
+        left -= n;
+    }
+    return OK;
+}
+
+status_t EbmlBuffer::writeAt(int fd, off64_t off) const {
+    const uint8_t *cur = mData;
+    uint64_t left = mSize;
+    while (left > 0) {
+        ssize_t n = ::pwrite64(fd, cur, left, off);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            ALOGE("write of %" PRIu64 " bytes at %lld failed; errno = %d",
+                    left, (long long) off, n < 0 ? errno : 0);
+            return n < 0 ? -errno : ERROR_IO;
+        }
+        cur += n;
+        left -= n;
+        off += n;
+    }
+    return OK;
+}
+
+// static
+uint64_t EbmlBuffer::headerSize(uint64_t id, uint64_t payloadSize) {
+    return sizeOf(id) + sizeOf(encodeUnsigned(payloadSize));
+}
+
+// static
+uint64_t EbmlBuffer::unsignedSize(uint64_t id, uint64_t value) {
+    return headerSize(id, sizeOf(value)) + sizeOf(value);
+}
+
+// static
+uint64_t EbmlBuffer::simpleBlockSize(uint64_t dataSize) {
+    return headerSize(kMkvSimpleBlock, dataSize + 4) + dataSize + 4;
+}
+
 } /* namespace android */
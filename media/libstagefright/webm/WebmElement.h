@@ -20,8 +20,11 @@
 #include <media/stagefright/MediaBuffer.h>
 #include <media/stagefright/foundation/ABase.h>
 #include <media/stagefright/foundation/ABuffer.h>
+#include <utils/Errors.h>
 #include <utils/List.h>
 
+#include <sys/types.h>
+
 namespace android {
 
 struct WebmElement : public LightRefBase<WebmElement> {
@@ -123,5 +126,55 @@ struct WebmMaster : public WebmElement {
     void serializePayload(uint8_t *buf);
 };
 
+//=================================================================================================
+
+// A flat alternative to building WebmElement trees for the elements written per frame: the
+// elements are serialized back to back into one buffer whose sizes the caller computes up front,
+// and the whole buffer then goes out with a single write. The storage only grows and is kept
+// across clear(), so one buffer serves every cluster of a recording without reallocating.
+class EbmlBuffer {
+public:
+    EbmlBuffer();
+    ~EbmlBuffer();
+
+    const uint8_t *data() const { return mData; }
+    uint64_t size() const { return mSize; }
+    bool empty() const { return mSize == 0; }
+    void clear() { mSize = 0; }
+    void reserve(uint64_t capacity);
+
+    void append(const void *data, uint64_t size);
+    // id and coded size of an element whose payload of payloadSize bytes is appended next.
+    void appendHeader(uint64_t id, uint64_t payloadSize);
+    void appendUnsigned(uint64_t id, uint64_t value);
+    void appendSimpleBlock(
+            int trackNum,
+            int16_t relTimecode,
+            bool key,
+            const uint8_t *data,
+            uint64_t dataSize);
+    // the flat equivalent of WebmElement::CuePointEntry
+    void appendCuePoint(uint64_t time, int track, uint64_t off);
+    void appendElement(const sp<WebmElement> &e);
+
+    // Write the buffer at the current offset of fd, or at off; short writes are retried.
+    status_t write(int fd) const;
+    status_t writeAt(int fd, off64_t off) const;
+
+    static uint64_t headerSize(uint64_t id, uint64_t payloadSize);
+    static uint64_t unsignedSize(uint64_t id, uint64_t value);
+    static uint64_t simpleBlockSize(uint64_t dataSize);
+
+private:
+    uint8_t *mData;
+    uint64_t mCapacity;
+    uint64_t mSize;
+
+    // makes room for size more bytes and returns where they go
+    uint8_t *grow(uint64_t size);
+
+    DISALLOW_EVIL_CONSTRUCTORS(EbmlBuffer);
+};
+
 } /* namespace android */
 #endif /* WEBMELEMENT_H_ */
@@ -66,7 +66,7 @@ WebmFrameSinkThread::WebmFrameSinkThread(
         const uint64_t& off,
         sp<WebmFrameSourceThread> videoThread,
         sp<WebmFrameSourceThread> audioThread,
-        List<sp<WebmElement> >& cues)
+        EbmlBuffer& cues)
     : mFd(fd),
       mSegmentDataStart(off),
       mVideoFrames(videoThread->mSink),
@@ -80,7 +80,7 @@ WebmFrameSinkThread::WebmFrameSinkThread(
         const uint64_t& off,
         LinkedBlockingQueue<const sp<WebmFrame> >& videoSource,
         LinkedBlockingQueue<const sp<WebmFrame> >& audioSource,
-        List<sp<WebmElement> >& cues)
+        EbmlBuffer& cues)
     : mFd(fd),
       mSegmentDataStart(off),
       mVideoFrames(videoSource),
@@ -89,41 +89,39 @@ WebmFrameSinkThread::WebmFrameSinkThread(
       mDone(true) {
 }
 
-// Initializes a webm cluster with its starting timecode.
-//
-// frames:
-//   sequence of input audio/video frames received from the source.
+// Serializes a whole cluster into mCluster and writes it out with a single write; the size of
+// every element is known from the frames, so no element tree is built and nothing is patched.
 //
 // clusterTimecodeL:
 //   the starting timecode of the cluster; this is the timecode of the first
 //   frame since frames are ordered by timestamp.
 //
-// children:
-//   list to hold child elements in a webm cluster (start timecode and
-//   simple blocks).
-//
-// static
-void WebmFrameSinkThread::initCluster(
-    List<const sp<WebmFrame> >& frames,
-    uint64_t& clusterTimecodeL,
-    List<sp<WebmElement> >& children) {
-    CHECK(!frames.empty() && children.empty());
-
-    const sp<WebmFrame> f = *(frames.begin());
-    clusterTimecodeL = f->mAbsTimecode;
-    WebmUnsigned *clusterTimecode = new WebmUnsigned(kMkvTimecode, clusterTimecodeL);
-    children.clear();
-    children.push_back(clusterTimecode);
-}
-
-void WebmFrameSinkThread::writeCluster(List<sp<WebmElement> >& children) {
-    // children must contain at least one simpleblock and its timecode
-    CHECK_GE(children.size(), 2);
+// blocks:
+//   the frames to write as simple blocks, cleared on return.
+void WebmFrameSinkThread::writeCluster(
+        uint64_t clusterTimecodeL, List<const sp<WebmFrame> >& blocks) {
+    CHECK(!blocks.empty());
+
+    uint64_t payloadSize = EbmlBuffer::unsignedSize(kMkvTimecode, clusterTimecodeL);
+    for (List<const sp<WebmFrame> >::iterator it = blocks.begin(); it != blocks.end(); ++it) {
+        payloadSize += EbmlBuffer::simpleBlockSize((*it)->mData->size());
+    }
 
-    uint64_t size;
-    sp<WebmElement> cluster = new WebmMaster(kMkvCluster, children);
-    cluster->write(mFd, size);
-    children.clear();
+    mCluster.clear();
+    mCluster.reserve(EbmlBuffer::headerSize(kMkvCluster, payloadSize) + payloadSize);
+    mCluster.appendHeader(kMkvCluster, payloadSize);
+    mCluster.appendUnsigned(kMkvTimecode, clusterTimecodeL);
+    for (List<const sp<WebmFrame> >::iterator it = blocks.begin(); it != blocks.end(); ++it) {
+        const sp<WebmFrame> f = *it;
+        mCluster.appendSimpleBlock(
+                f->mType == kVideoType ? kVideoTrackNum : kAudioTrackNum,
+                f->mAbsTimecode - clusterTimecodeL,
+                f->mKey,
+                f->mData->data(),
+                f->mData->size());
+    }
+    mCluster.write(mFd);
+    blocks.clear();
 }
 
 // Write out (possibly multiple) webm cluster(s) from frames split on video key frames.
@@ -135,9 +133,8 @@ void WebmFrameSinkThread::flushFrames(List<const sp<WebmFrame> >& frames, bool l
         return;
     }
 
-    uint64_t clusterTimecodeL;
-    List<sp<WebmElement> > children;
-    initCluster(frames, clusterTimecodeL, children);
+    uint64_t clusterTimecodeL = (*frames.begin())->mAbsTimecode;
+    List<const sp<WebmFrame> > blocks;
 
     uint64_t cueTime = clusterTimecodeL;
     off_t fpos = ::lseek(mFd, 0, SEEK_CUR);
@@ -160,12 +157,12 @@ void WebmFrameSinkThread::flushFrames(List<const sp<WebmFrame> >& frames, bool l
         }
 
         if (f->mAbsTimecode - clusterTimecodeL > INT16_MAX) {
-            writeCluster(children);
-            initCluster(frames, clusterTimecodeL, children);
+            writeCluster(clusterTimecodeL, blocks);
+            clusterTimecodeL = f->mAbsTimecode;
         }
 
         frames.erase(frames.begin());
-        children.push_back(f->SimpleBlock(clusterTimecodeL));
+        blocks.push_back(f);
     }
 
     // equivalent to last==false
@@ -174,13 +171,12 @@ void WebmFrameSinkThread::flushFrames(List<const sp<WebmFrame> >& frames, bool l
         const sp<WebmFrame> secondLastFrame = *(frames.begin());
         if (secondLastFrame->mType == kVideoType) {
             frames.erase(frames.begin());
-            children.push_back(secondLastFrame->SimpleBlock(clusterTimecodeL));
+            blocks.push_back(secondLastFrame);
         }
     }
 
-    writeCluster(children);
-    sp<WebmElement> cuePoint = WebmElement::CuePointEntry(cueTime, 1, fpos - mSegmentDataStart);
-    mCues.push_back(cuePoint);
+    writeCluster(clusterTimecodeL, blocks);
+    mCues.appendCuePoint(cueTime, 1, fpos - mSegmentDataStart);
 }
 
 status_t WebmFrameSinkThread::start() {
@@ -61,14 +61,14 @@ public:
             const uint64_t& off,
             sp<WebmFrameSourceThread> videoThread,
             sp<WebmFrameSourceThread> audioThread,
-            List<sp<WebmElement> >& cues);
+            EbmlBuffer& cues);
 
     WebmFrameSinkThread(
             const int& fd,
             const uint64_t& off,
             LinkedBlockingQueue<const sp<WebmFrame> >& videoSource,
             LinkedBlockingQueue<const sp<WebmFrame> >& audioSource,
-            List<sp<WebmElement> >& cues);
+            EbmlBuffer& cues);
 
     void run();
     bool running() {
@@ -82,15 +82,14 @@ private:
     const uint64_t& mSegmentDataStart;
     LinkedBlockingQueue<const sp<WebmFrame> >& mVideoFrames;
     LinkedBlockingQueue<const sp<WebmFrame> >& mAudioFrames;
-    List<sp<WebmElement> >& mCues;
+    EbmlBuffer& mCues;
 
     volatile bool mDone;
 
-    static void initCluster(
-            List<const sp<WebmFrame> >& frames,
-            uint64_t& clusterTimecodeL,
-            List<sp<WebmElement> >& children);
-    void writeCluster(List<sp<WebmElement> >& children);
+    // reused for every cluster, see writeCluster
+    EbmlBuffer mCluster;
+
+    void writeCluster(uint64_t clusterTimecodeL, List<const sp<WebmFrame> >& blocks);
     void flushFrames(List<const sp<WebmFrame> >& frames, bool last);
 };
 
@@ -305,20 +305,25 @@ status_t WebmWriter::reset() {
         return err;
     }
 
-    sp<WebmElement> cues = new WebmMaster(kMkvCues, mCuePoints);
-    uint64_t cuesSize = cues->totalSize();
+    // The cues, and the void filling what is left of the space reserved for them, go out in one
+    // write; so do the seek head and its padding below.
+    EbmlBuffer out;
+    uint64_t cuesSize = EbmlBuffer::headerSize(kMkvCues, mCuePoints.size()) + mCuePoints.size();
+    out.reserve(cuesSize + kMaxMetaSeekSize);
+    out.appendHeader(kMkvCues, mCuePoints.size());
+    out.append(mCuePoints.data(), mCuePoints.size());
     // TRICKY Even when the cues do fit in the space we reserved, if they do not fit
     // perfectly, we still need to check if there is enough "extra space" to write an
     // EBML void element.
-    if (cuesSize != mEstimatedCuesSize && cuesSize > mEstimatedCuesSize - kMinEbmlVoidSize) {
-        mCuesOffset = ::lseek(mFd, 0, SEEK_CUR);
-        cues->write(mFd, cuesSize);
+    if (mEstimatedCuesSize == 0 || (cuesSize != mEstimatedCuesSize
+            && cuesSize + kMinEbmlVoidSize > mEstimatedCuesSize)) {
+        mCuesOffset = ::lseek(mFd, 0, SEEK_END);
+        out.writeAt(mFd, mCuesOffset);
     } else {
-        uint64_t spaceSize;
-        ::lseek(mFd, mCuesOffset, SEEK_SET);
-        cues->write(mFd, cuesSize);
-        sp<WebmElement> space = new EbmlVoid(mEstimatedCuesSize - cuesSize);
-        space->write(mFd, spaceSize);
+        if (cuesSize != mEstimatedCuesSize) {
+            out.appendElement(new EbmlVoid(mEstimatedCuesSize - cuesSize));
+        }
+        out.writeAt(mFd, mCuesOffset);
     }
 
     mCuePoints.clear();
@@ -328,20 +333,17 @@ status_t WebmWriter::reset() {
     uint8_t bary[sizeof(uint64_t)];
     uint64_t totalSize = ::lseek(mFd, 0, SEEK_END);
     uint64_t segmentSize = totalSize - mSegmentDataStart;
-    ::lseek(mFd, mSegmentOffset + sizeOf(kMkvSegment), SEEK_SET);
     uint64_t segmentSizeCoded = encodeUnsigned(segmentSize, sizeOf(kMkvUnknownLength));
     serializeCodedUnsigned(segmentSizeCoded, bary);
-    ::write(mFd, bary, sizeOf(kMkvUnknownLength));
+    ::pwrite64(mFd, bary, sizeOf(kMkvUnknownLength), mSegmentOffset + sizeOf(kMkvSegment));
 
-    uint64_t size;
     uint64_t durationOffset = mInfoOffset + sizeOf(kMkvInfo) + sizeOf(mInfoSize)
         + sizeOf(kMkvSegmentDuration) + sizeOf(sizeof(double));
     sp<WebmElement> duration = new WebmFloat(
             kMkvSegmentDuration,
             (double) (maxDurationUs * 1000 / mTimeCodeScale));
     duration->serializePayload(bary);
-    ::lseek(mFd, durationOffset, SEEK_SET);
-    ::write(mFd, bary, sizeof(double));
+    ::pwrite64(mFd, bary, sizeof(double), durationOffset);
 
     List<sp<WebmElement> > seekEntries;
     seekEntries.push_back(WebmElement::SeekEntry(kMkvInfo, mInfoOffset - mSegmentDataStart));
@@ -349,13 +351,10 @@ status_t WebmWriter::reset() {
     seekEntries.push_back(WebmElement::SeekEntry(kMkvCues, mCuesOffset - mSegmentDataStart));
     sp<WebmElement> seekHead = new WebmMaster(kMkvSeekHead, seekEntries);
 
-    uint64_t metaSeekSize;
-    ::lseek(mFd, mSegmentDataStart, SEEK_SET);
-    seekHead->write(mFd, metaSeekSize);
-
-    uint64_t spaceSize;
-    sp<WebmElement> space = new EbmlVoid(kMaxMetaSeekSize - metaSeekSize);
-    space->write(mFd, spaceSize);
+    out.clear();
+    out.appendElement(seekHead);
+    out.appendElement(new EbmlVoid(kMaxMetaSeekSize - out.size()));
+    out.writeAt(mFd, mSegmentDataStart);
 
     release();
     return err;
@@ -484,21 +483,30 @@ status_t WebmWriter::start(MetaData *params) {
         cues = new EbmlVoid(mEstimatedCuesSize);
     }
 
+    // Serialize the header elements into one buffer and write them out at once. The cue points
+    // collected while recording are kept flat as well; reserve for the estimate up front.
     sp<WebmElement> elems[] = { ebml, segment, seekHead, info, tracks, cues };
     size_t nElems = sizeof(elems) / sizeof(elems[0]);
     uint64_t offsets[nElems];
     uint64_t sizes[nElems];
+    uint64_t base = ::lseek(mFd, 0, SEEK_CUR);
+    EbmlBuffer header;
     for (uint32_t i = 0; i < nElems; i++) {
         WebmElement *e = elems[i].get();
+        offsets[i] = base + header.size();
         if (!e) {
+            sizes[i] = 0;
             continue;
         }
-
-        uint64_t size;
-        offsets[i] = ::lseek(mFd, 0, SEEK_CUR);
         sizes[i] = e->mSize;
-        e->write(mFd, size);
+        header.appendElement(e);
     }
+    status_t err = header.write(mFd);
+    if (err != OK) {
+        return err;
+    }
+    mCuePoints.clear();
+    mCuePoints.reserve(mEstimatedCuesSize);
 
     mSegmentOffset = offsets[1];
     mSegmentDataStart = offsets[2];
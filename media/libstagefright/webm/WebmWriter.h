@@ -73,7 +73,8 @@ private:
     uint64_t mEstimatedCuesSize;
 
     Mutex mLock;
-    List<sp<WebmElement> > mCuePoints;
+    // CuePoint elements serialized back to back by the sink thread as clusters are written
+    EbmlBuffer mCuePoints;
 
     enum {
         kAudioIndex     =  0,
@@ -6,6 +6,7 @@ LOCAL_SRC_FILES:= \
         MediaSender.cpp                 \
         Parameters.cpp                  \
         rtp/RTPSender.cpp               \
+        source/CongestionController.cpp \
         source/Converter.cpp            \
         source/MediaPuller.cpp          \
         source/PlaybackSession.cpp      \
@@ -74,6 +74,11 @@ ssize_t MediaSender::addTrack(const sp<AMessage> &format, uint32_t flags) {
     info.mFormat = format;
     info.mFlags = flags;
     info.mPacketizerTrackIndex = -1;
+    info.mNumLatencySamples = 0;
+    for (size_t i = 0; i < kNumLatencyStages; ++i) {
+        info.mTotalLatencyUs[i] = 0ll;
+        info.mMaxLatencyUs[i] = 0ll;
+    }
 
     AString mime;
     CHECK(format->findString("mime", &mime));
@@ -213,6 +218,15 @@ status_t MediaSender::queueAccessUnit(
 
     if (mMode == MODE_TRANSPORT_STREAM) {
         TrackInfo *info = &mTrackInfos.editItemAt(trackIndex);
+
+        // The slices of a frame after the first went ahead of them, the
+        // other tracks' access units interleaved with it already.
+        int32_t continued;
+        if (accessUnit->meta()->findInt32("continued-frame", &continued)
+                && continued && info->mAccessUnits.empty()) {
+            return sendTSAccessUnit(trackIndex, accessUnit);
+        }
+
         info->mAccessUnits.push_back(accessUnit);
 
         mTSPacketizer->extractCSDIfNecessary(info->mPacketizerTrackIndex);
@@ -248,24 +262,7 @@ status_t MediaSender::queueAccessUnit(
             sp<ABuffer> accessUnit = *info->mAccessUnits.begin();
             info->mAccessUnits.erase(info->mAccessUnits.begin());
 
-            sp<ABuffer> tsPackets;
-            status_t err = packetizeAccessUnit(
-                    minTrackIndex, accessUnit, &tsPackets);
-
-            if (err == OK) {
-                if (mLogFile != NULL) {
-                    fwrite(tsPackets->data(), 1, tsPackets->size(), mLogFile);
-                }
-
-                int64_t timeUs;
-                CHECK(accessUnit->meta()->findInt64("timeUs", &timeUs));
-                tsPackets->meta()->setInt64("timeUs", timeUs);
-
-                err = mTSSender->queueBuffer(
-                        tsPackets,
-                        33 /* packetType */,
-                        RTPSender::PACKETIZATION_TRANSPORT_STREAM);
-            }
+            status_t err = sendTSAccessUnit(minTrackIndex, accessUnit);
 
             if (err != OK) {
                 return err;
@@ -275,11 +272,88 @@ status_t MediaSender::queueAccessUnit(
 
     TrackInfo *info = &mTrackInfos.editItemAt(trackIndex);
 
-    return info->mSender->queueBuffer(
+    status_t err = info->mSender->queueBuffer(
             accessUnit,
             info->mIsAudio ? 96 : 97 /* packetType */,
             info->mIsAudio
                 ? RTPSender::PACKETIZATION_AAC : RTPSender::PACKETIZATION_H264);
+
+    if (err == OK) {
+        addLatencySample(trackIndex, accessUnit);
+    }
+
+    return err;
+}
+
+status_t MediaSender::sendTSAccessUnit(
+        size_t trackIndex, const sp<ABuffer> &accessUnit) {
+    sp<ABuffer> tsPackets;
+    status_t err = packetizeAccessUnit(trackIndex, accessUnit, &tsPackets);
+
+    if (err == OK) {
+        if (mLogFile != NULL) {
+            fwrite(tsPackets->data(), 1, tsPackets->size(), mLogFile);
+        }
+
+        int64_t timeUs;
+        CHECK(accessUnit->meta()->findInt64("timeUs", &timeUs));
+        tsPackets->meta()->setInt64("timeUs", timeUs);
+
+        err = mTSSender->queueBuffer(
+                tsPackets,
+                33 /* packetType */,
+                RTPSender::PACKETIZATION_TRANSPORT_STREAM);
+    }
+
+    if (err == OK) {
+        addLatencySample(trackIndex, accessUnit);
+    }
+
+    return err;
+}
+
+void MediaSender::addLatencySample(
+        size_t trackIndex, const sp<ABuffer> &accessUnit) {
+    TrackInfo *info = &mTrackInfos.editItemAt(trackIndex);
+
+    // PCM audio isn't encoded, and not every caller stamps "queuedUs"
+    int64_t stageUs[kNumLatencyStages + 1];
+    CHECK(accessUnit->meta()->findInt64("timeUs", &stageUs[0]));
+    if (!accessUnit->meta()->findInt64("encodedUs", &stageUs[1])) {
+        stageUs[1] = stageUs[0];
+    }
+    if (!accessUnit->meta()->findInt64("queuedUs", &stageUs[2])) {
+        stageUs[2] = stageUs[1];
+    }
+    stageUs[3] = ALooper::GetNowUs();
+
+    for (size_t i = 0; i < kNumLatencyStages; ++i) {
+        int64_t latencyUs = stageUs[i + 1] - stageUs[i];
+        info->mTotalLatencyUs[i] += latencyUs;
+        if (latencyUs > info->mMaxLatencyUs[i]) {
+            info->mMaxLatencyUs[i] = latencyUs;
+        }
+    }
+    ++info->mNumLatencySamples;
+}
+
+size_t MediaSender::takeLatencies(
+        size_t trackIndex, int64_t *avgUs, int64_t *maxUs) {
+    CHECK_LT(trackIndex, mTrackInfos.size());
+
+    TrackInfo *info = &mTrackInfos.editItemAt(trackIndex);
+
+    size_t numSamples = info->mNumLatencySamples;
+    for (size_t i = 0; i < kNumLatencyStages; ++i) {
+        avgUs[i] = numSamples > 0 ? info->mTotalLatencyUs[i] / numSamples : 0ll;
+        maxUs[i] = info->mMaxLatencyUs[i];
+
+        info->mTotalLatencyUs[i] = 0ll;
+        info->mMaxLatencyUs[i] = 0ll;
+    }
+    info->mNumLatencySamples = 0;
+
+    return numSamples;
 }
 
 void MediaSender::onMessageReceived(const sp<AMessage> &msg) {
@@ -334,16 +408,16 @@ void MediaSender::onSenderNotify(const sp<AMessage> &msg) {
             break;
         }
 
-        case kWhatNetworkStall:
+        case RTPSender::kWhatSendQueueDepth:
         {
             size_t numBytesQueued;
             CHECK(msg->findSize("numBytesQueued", &numBytesQueued));
 
-            notifyNetworkStall(numBytesQueued);
+            notifySendQueueDepth(numBytesQueued);
             break;
         }
 
-        case kWhatInformSender:
+        case RTPSender::kWhatInformSender:
         {
             int64_t avgLatencyUs;
             CHECK(msg->findInt64("avgLatencyUs", &avgLatencyUs));
@@ -359,6 +433,22 @@ void MediaSender::onSenderNotify(const sp<AMessage> &msg) {
             break;
         }
 
+        case RTPSender::kWhatReceiverReport:
+        {
+            float fractionLost;
+            CHECK(msg->findFloat("fractionLost", &fractionLost));
+
+            int64_t jitterUs;
+            CHECK(msg->findInt64("jitterUs", &jitterUs));
+
+            sp<AMessage> notify = mNotify->dup();
+            notify->setInt32("what", kWhatReceiverReport);
+            notify->setFloat("fractionLost", fractionLost);
+            notify->setInt64("jitterUs", jitterUs);
+            notify->post();
+            break;
+        }
+
         default:
             TRESPASS();
     }
@@ -378,9 +468,9 @@ void MediaSender::notifyError(status_t err) {
     notify->post();
 }
 
-void MediaSender::notifyNetworkStall(size_t numBytesQueued) {
+void MediaSender::notifySendQueueDepth(size_t numBytesQueued) {
     sp<AMessage> notify = mNotify->dup();
-    notify->setInt32("what", kWhatNetworkStall);
+    notify->setInt32("what", kWhatSendQueueDepth);
     notify->setSize("numBytesQueued", numBytesQueued);
     notify->post();
 }
@@ -397,9 +487,16 @@ status_t MediaSender::packetizeAccessUnit(
     uint64_t inputCTR;
     uint8_t HDCP_private_data[16];
 
+    int32_t continued;
+    if (accessUnit->meta()->findInt32("continued-frame", &continued)
+            && continued) {
+        flags |= TSPacketizer::CONTINUES_ACCESS_UNIT;
+    }
+
     bool manuallyPrependSPSPPS =
         !info.mIsAudio
         && (info.mFlags & FLAG_MANUALLY_PREPEND_SPS_PPS)
+        && !(flags & TSPacketizer::CONTINUES_ACCESS_UNIT)
         && IsIDR(accessUnit);
 
     if (mHDCP != NULL && !info.mIsAudio) {
@@ -38,12 +38,15 @@ struct TSPacketizer;
 // track to RTP channel or muxing all tracks into a single RTP channel and
 // using transport stream encapsulation.
 // Optionally the (video) data is encrypted using the provided hdcp object.
+// The congestion reports of the RTP channels are passed on as those of
+// RTPSender.
 struct MediaSender : public AHandler {
     enum {
         kWhatInitDone,
         kWhatError,
-        kWhatNetworkStall,
+        kWhatSendQueueDepth,
         kWhatInformSender,
+        kWhatReceiverReport,
     };
 
     MediaSender(
@@ -67,9 +70,25 @@ struct MediaSender : public AHandler {
             RTPSender::TransportMode rtcpMode,
             int32_t *localRTPPort);
 
+    // The slices of a frame are queued as they are encoded, all but the
+    // first with "continued-frame" set, all but the last "partial-frame".
     status_t queueAccessUnit(
             size_t trackIndex, const sp<ABuffer> &accessUnit);
 
+    // Where the latency of the access units goes, from their "timeUs" to
+    // their "encodedUs", to their "queuedUs" and to their being handed to
+    // the RTP sender, muxing included.
+    enum {
+        STAGE_ENCODE,
+        STAGE_DELIVER,
+        STAGE_SEND,
+        kNumLatencyStages,
+    };
+
+    // The time the access units sent on the track since the last call spent
+    // in each stage, on average and at most; returns how many there were.
+    size_t takeLatencies(size_t trackIndex, int64_t *avgUs, int64_t *maxUs);
+
 protected:
     virtual void onMessageReceived(const sp<AMessage> &msg);
     virtual ~MediaSender();
@@ -92,6 +111,10 @@ private:
         List<sp<ABuffer> > mAccessUnits;
         ssize_t mPacketizerTrackIndex;
         bool mIsAudio;
+
+        size_t mNumLatencySamples;
+        int64_t mTotalLatencyUs[kNumLatencyStages];
+        int64_t mMaxLatencyUs[kNumLatencyStages];
     };
 
     sp<ANetworkSession> mNetSession;
@@ -116,13 +139,17 @@ private:
 
     void notifyInitDone(status_t err);
     void notifyError(status_t err);
-    void notifyNetworkStall(size_t numBytesQueued);
+    void notifySendQueueDepth(size_t numBytesQueued);
 
     status_t packetizeAccessUnit(
             size_t trackIndex,
             sp<ABuffer> accessUnit,
             sp<ABuffer> *tsPackets);
 
+    status_t sendTSAccessUnit(size_t trackIndex, const sp<ABuffer> &accessUnit);
+
+    void addLatencySample(size_t trackIndex, const sp<ABuffer> &accessUnit);
+
     DISALLOW_EVIL_CONSTRUCTORS(MediaSender);
 };
 
@@ -22,6 +22,7 @@
 
 #include <media/stagefright/foundation/ABuffer.h>
 #include <media/stagefright/foundation/ADebug.h>
+#include <media/stagefright/foundation/ALooper.h>
 #include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/foundation/ANetworkSession.h>
 #include <media/stagefright/foundation/hexdump.h>
@@ -32,6 +33,8 @@
 
 namespace android {
 
+static const int64_t kQueueDepthReportIntervalUs = 100000ll;
+
 RTPSender::RTPSender(
         const sp<ANetworkSession> &netSession,
         const sp<AMessage> &notify)
@@ -49,6 +52,7 @@ RTPSender::RTPSender(
       mNumRTPOctetsSent(0),
       mNumSRsSent(0),
       mRTPSeqNo(0),
+      mLastQueueDepthReportUs(-1ll),
       mHistorySize(0) {
 }
 
@@ -202,9 +206,29 @@ status_t RTPSender::queueBuffer(
             TRESPASS();
     }
 
+    if (err == OK) {
+        reportSendQueueDepth();
+    }
+
     return err;
 }
 
+void RTPSender::reportSendQueueDepth() {
+    int64_t nowUs = ALooper::GetNowUs();
+    if (mLastQueueDepthReportUs >= 0ll
+            && nowUs < mLastQueueDepthReportUs + kQueueDepthReportIntervalUs) {
+        return;
+    }
+
+    ANetworkSession::SessionStats stats;
+    if (mNetSession->getSessionStats(mRTPSessionID, &stats) != OK) {
+        return;
+    }
+
+    mLastQueueDepthReportUs = nowUs;
+    notifySendQueueDepth(stats.mBytesQueued);
+}
+
 status_t RTPSender::queueRawPacket(
         const sp<ABuffer> &packet, uint8_t packetType) {
     CHECK_LE(packet->size(), kMaxUDPPacketSize - 12);
@@ -315,6 +339,12 @@ status_t RTPSender::queueAVCBuffer(
 
     uint32_t rtpTime = (timeUs * 9 / 100ll);
 
+    // the M-bit ends the frame, the last of its slices
+    int32_t partial;
+    if (!accessUnit->meta()->findInt32("partial-frame", &partial)) {
+        partial = false;
+    }
+
     List<sp<ABuffer> > packets;
 
     sp<ABuffer> out = new ABuffer(kMaxUDPPacketSize);
@@ -424,7 +454,7 @@ status_t RTPSender::queueAVCBuffer(
 
         out->setInt32Data(mRTPSeqNo);
 
-        bool last = packets.empty();
+        bool last = packets.empty() && !partial;
 
         uint8_t *dst = out->data();
 
@@ -603,7 +633,7 @@ void RTPSender::onNetNotify(bool isRTP, const sp<AMessage> &msg) {
             size_t numBytesQueued;
             CHECK(msg->findSize("numBytesQueued", &numBytesQueued));
 
-            notifyNetworkStall(numBytesQueued);
+            notifySendQueueDepth(numBytesQueued);
             break;
         }
 
@@ -686,11 +716,35 @@ status_t RTPSender::onRTCPData(const sp<ABuffer> &buffer) {
 }
 
 status_t RTPSender::parseReceiverReport(
-        const uint8_t *data, size_t /* size */) {
-    float fractionLost = data[12] / 256.0f;
+        const uint8_t *data, size_t size) {
+    // The report blocks follow the sender info in an SR.
+    size_t offset = (data[1] == 200) ? 28 : 8;
+    size_t reportCount = data[0] & 0x1f;
 
-    ALOGI("lost %.2f %% of packets during report interval.",
-          100.0f * fractionLost);
+    for (size_t i = 0; i < reportCount; ++i, offset += 24) {
+        if (offset + 24 > size) {
+            return ERROR_MALFORMED;
+        }
+
+        if (U32_AT(&data[offset]) != kSourceID) {
+            continue;
+        }
+
+        float fractionLost = data[offset + 4] / 256.0f;
+
+        // in units of the 90 kHz RTP clock
+        int64_t jitterUs = U32_AT(&data[offset + 12]) * 100ll / 9;
+
+        ALOGV("lost %.2f %% of packets during report interval, "
+              "jitter %lld us.",
+              100.0f * fractionLost, (long long)jitterUs);
+
+        sp<AMessage> notify = mNotify->dup();
+        notify->setInt32("what", kWhatReceiverReport);
+        notify->setFloat("fractionLost", fractionLost);
+        notify->setInt64("jitterUs", jitterUs);
+        notify->post();
+    }
 
     return OK;
 }
@@ -793,9 +847,9 @@ void RTPSender::notifyError(status_t err) {
     notify->post();
 }
 
-void RTPSender::notifyNetworkStall(size_t numBytesQueued) {
+void RTPSender::notifySendQueueDepth(size_t numBytesQueued) {
     sp<AMessage> notify = mNotify->dup();
-    notify->setInt32("what", kWhatNetworkStall);
+    notify->setInt32("what", kWhatSendQueueDepth);
     notify->setSize("numBytesQueued", numBytesQueued);
     notify->post();
 }
@@ -32,12 +32,18 @@ struct ANetworkSession;
 // on which "TransportMode" was chosen. In addition different RTP packetization
 // schemes are supported such as "Transport Stream Packets over RTP",
 // or "AVC/H.264 encapsulation as specified in RFC 3984 (non-interleaved mode)"
+//
+// What the network tells of congestion is passed on to notify: the bytes
+// waiting to be sent ("numBytesQueued") as kWhatSendQueueDepth, at most every
+// 100 ms while media is queued, and the "fractionLost" and the interarrival
+// "jitterUs" of every RTCP receiver report as kWhatReceiverReport.
 struct RTPSender : public RTPBase, public AHandler {
     enum {
         kWhatInitDone,
         kWhatError,
-        kWhatNetworkStall,
+        kWhatSendQueueDepth,
         kWhatInformSender,
+        kWhatReceiverReport,
     };
     RTPSender(
             const sp<ANetworkSession> &netSession,
@@ -89,6 +95,8 @@ private:
 
     uint32_t mRTPSeqNo;
 
+    int64_t mLastQueueDepthReportUs;
+
     List<sp<ABuffer> > mHistory;
     size_t mHistorySize;
 
@@ -111,7 +119,8 @@ private:
 
     void notifyInitDone(status_t err);
     void notifyError(status_t err);
-    void notifyNetworkStall(size_t numBytesQueued);
+    void notifySendQueueDepth(size_t numBytesQueued);
+    void reportSendQueueDepth();
 
     DISALLOW_EVIL_CONSTRUCTORS(RTPSender);
 };
@@ -0,0 +1,170 @@
+/*
+ * Copyright 2014, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//#define LOG_NDEBUG 0
+#define LOG_TAG "CongestionController"
+#include <utils/Log.h>
+
+#include "CongestionController.h"
+
+namespace android {
+
+// Losses below this much are those of the channel, not of congestion.
+static const float kCongestedFractionLost = 0.02f;
+static const float kHeavyFractionLost = 0.1f;
+static const float kIDRFractionLost = 0.2f;
+
+// how long the send queue takes to drain at the current bitrate
+static const int64_t kCongestedQueueDelayUs = 20000ll;
+static const int64_t kHighQueueDelayUs = 100000ll;
+static const int64_t kStalledQueueDelayUs = 400000ll;
+
+static const int64_t kMinJitterUs = 10000ll;
+
+static const int64_t kCongestedLatencyUs = 200000ll;
+static const int64_t kHighLatencyUs = 300000ll;
+
+static const int64_t kIncreaseIntervalUs = 1000000ll;
+static const double kIncreaseFactor = 1.05;
+
+const int64_t CongestionController::kDecreaseHoldOffUs = 500000ll;
+const int64_t CongestionController::kIncreaseHoldOffUs = 2000000ll;
+const int64_t CongestionController::kMinIDRIntervalUs = 1000000ll;
+const int32_t CongestionController::kBitrateStep = 100000;
+
+CongestionController::CongestionController(
+        int32_t initialBitrate, int32_t minBitrate, int32_t maxBitrate)
+    : mMinBitrate(minBitrate),
+      mMaxBitrate(maxBitrate),
+      mBitrate(initialBitrate),
+      mLastDecreaseUs(-1ll),
+      mLastCongestionUs(-1ll),
+      mLastIncreaseUs(-1ll),
+      mLastIDRUs(-1ll),
+      mIDRRequested(false),
+      mSmoothedJitterUs(-1ll) {
+    if (mBitrate < mMinBitrate) {
+        mBitrate = mMinBitrate;
+    } else if (mBitrate > mMaxBitrate) {
+        mBitrate = mMaxBitrate;
+    }
+}
+
+void CongestionController::onReceiverReport(
+        float fractionLost, int64_t jitterUs, int64_t nowUs) {
+    // Jitter well above what it has been means packets wait in a queue on
+    // the way, before any of them are lost.
+    bool jitterRising = mSmoothedJitterUs >= 0ll
+        && jitterUs > kMinJitterUs && jitterUs > 2 * mSmoothedJitterUs;
+
+    mSmoothedJitterUs = (mSmoothedJitterUs < 0ll)
+        ? jitterUs : (7 * mSmoothedJitterUs + jitterUs) / 8;
+
+    if (fractionLost >= kIDRFractionLost
+            && (mLastIDRUs < 0ll || nowUs >= mLastIDRUs + kMinIDRIntervalUs)) {
+        mIDRRequested = true;
+        mLastIDRUs = nowUs;
+    }
+
+    if (fractionLost >= kHeavyFractionLost) {
+        double factor = 1.0 - fractionLost / 2.0;
+        decrease(factor < 0.5 ? 0.5 : factor, nowUs, "loss");
+    } else if (jitterRising) {
+        decrease(0.9, nowUs, "jitter");
+    } else if (fractionLost >= kCongestedFractionLost) {
+        mLastCongestionUs = nowUs;
+    } else {
+        maybeIncrease(nowUs);
+    }
+}
+
+void CongestionController::onSendQueueDepth(
+        size_t numBytesQueued, int64_t nowUs) {
+    int64_t queueDelayUs = (int64_t)(numBytesQueued * 8E6 / mBitrate);
+
+    if (queueDelayUs >= kStalledQueueDelayUs) {
+        decrease(0.5, nowUs, "stall");
+    } else if (queueDelayUs >= kHighQueueDelayUs) {
+        decrease(0.8, nowUs, "queue");
+    } else if (queueDelayUs >= kCongestedQueueDelayUs) {
+        mLastCongestionUs = nowUs;
+    } else {
+        maybeIncrease(nowUs);
+    }
+}
+
+void CongestionController::onSinkLatency(int64_t avgLatencyUs, int64_t nowUs) {
+    if (avgLatencyUs > kHighLatencyUs) {
+        decrease(0.8, nowUs, "latency");
+    } else if (avgLatencyUs > kCongestedLatencyUs) {
+        mLastCongestionUs = nowUs;
+    }
+}
+
+int32_t CongestionController::bitrate() const {
+    int32_t bitrate = (int32_t)(mBitrate / kBitrateStep + 0.5) * kBitrateStep;
+
+    if (bitrate < mMinBitrate) {
+        return mMinBitrate;
+    } else if (bitrate > mMaxBitrate) {
+        return mMaxBitrate;
+    }
+    return bitrate;
+}
+
+bool CongestionController::takeIDRRequest() {
+    bool requested = mIDRRequested;
+    mIDRRequested = false;
+    return requested;
+}
+
+void CongestionController::decrease(
+        double factor, int64_t nowUs, const char *reason) {
+    mLastCongestionUs = nowUs;
+
+    if (mLastDecreaseUs >= 0ll && nowUs < mLastDecreaseUs + kDecreaseHoldOffUs) {
+        return;
+    }
+
+    mBitrate *= factor;
+    if (mBitrate < mMinBitrate) {
+        mBitrate = mMinBitrate;
+    }
+    mLastDecreaseUs = nowUs;
+
+    ALOGV("%s: bitrate down to %.0f bps", reason, mBitrate);
+}
+
+void CongestionController::maybeIncrease(int64_t nowUs) {
+    if (mLastCongestionUs >= 0ll
+            && nowUs < mLastCongestionUs + kIncreaseHoldOffUs) {
+        return;
+    }
+
+    if (mLastIncreaseUs >= 0ll && nowUs < mLastIncreaseUs + kIncreaseIntervalUs) {
+        return;
+    }
+
+    mBitrate *= kIncreaseFactor;
+    if (mBitrate > mMaxBitrate) {
+        mBitrate = mMaxBitrate;
+    }
+    mLastIncreaseUs = nowUs;
+
+    ALOGV("bitrate up to %.0f bps", mBitrate);
+}
+
+}  // namespace android
@@ -0,0 +1,84 @@
+/*
+ * Copyright 2014, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CONGESTION_CONTROLLER_H_
+
+#define CONGESTION_CONTROLLER_H_
+
+#include <media/stagefright/foundation/ABase.h>
+
+#include <sys/types.h>
+
+namespace android {
+
+// Picks the video bitrate of a wifi display session from what the network
+// tells of congestion: the loss and jitter of the sink's RTCP receiver
+// reports, the depth of the send queue and the latency the sink reports.
+//
+// The bitrate comes down as soon as one of them shows congestion, by as much
+// as the congestion is bad, and no more than once per kDecreaseHoldOffUs for
+// the signals of one congestion episode not to add up. It then goes back up
+// a little at a time, once there has been no sign of congestion for
+// kIncreaseHoldOffUs, instead of dropping frames on a stall and recovering
+// at once.
+//
+// Heavy losses also ask for an IDR frame, at most once per
+// kMinIDRIntervalUs, the frames that referenced the lost packets being
+// broken until then. Called on the PlaybackSession looper only.
+struct CongestionController {
+    static const int64_t kDecreaseHoldOffUs;
+    static const int64_t kIncreaseHoldOffUs;
+    static const int64_t kMinIDRIntervalUs;
+
+    CongestionController(
+            int32_t initialBitrate, int32_t minBitrate, int32_t maxBitrate);
+
+    void onReceiverReport(float fractionLost, int64_t jitterUs, int64_t nowUs);
+    void onSendQueueDepth(size_t numBytesQueued, int64_t nowUs);
+    void onSinkLatency(int64_t avgLatencyUs, int64_t nowUs);
+
+    // The bitrate to encode at, rounded to steps of kBitrateStep for small
+    // changes not to reconfigure the encoder.
+    int32_t bitrate() const;
+
+    // true once after the losses that call for an IDR frame.
+    bool takeIDRRequest();
+
+private:
+    static const int32_t kBitrateStep;
+
+    int32_t mMinBitrate;
+    int32_t mMaxBitrate;
+    double mBitrate;
+
+    int64_t mLastDecreaseUs;
+    int64_t mLastCongestionUs;
+    int64_t mLastIncreaseUs;
+    int64_t mLastIDRUs;
+    bool mIDRRequested;
+
+    // of the receiver reports, -1 until the first one
+    int64_t mSmoothedJitterUs;
+
+    void decrease(double factor, int64_t nowUs, const char *reason);
+    void maybeIncrease(int64_t nowUs);
+
+    DISALLOW_EVIL_CONSTRUCTORS(CongestionController);
+};
+
+}  // namespace android
+
+#endif  // CONGESTION_CONTROLLER_H_
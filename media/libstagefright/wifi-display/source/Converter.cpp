@@ -61,6 +61,8 @@ Converter::Converter(
       ,mPrevVideoBitrate(-1)
       ,mNumFramesToDrop(0)
       ,mEncodingSuspended(false)
+      ,mNumVideoSlices(0)
+      ,mInPartialFrame(false)
     {
     AString mime;
     CHECK(mOutputFormat->findString("mime", &mime));
@@ -189,6 +191,19 @@ status_t Converter::initEncoder() {
         // to recover from a lost/corrupted packet.
         mbs = (((width + 15) / 16) * ((height + 15) / 16) * 10) / 100;
         mOutputFormat->setInt32("intra-refresh-CIR-mbs", mbs);
+
+        mNumVideoSlices = GetInt32Property("media.wfd.video-slices", 0);
+        if (mIsH264 && mNumVideoSlices > 1) {
+            // in whole macroblock rows
+            int32_t mbRows = (height + 15) / 16;
+            int32_t sliceRows = (mbRows + mNumVideoSlices - 1) / mNumVideoSlices;
+
+            ALOGI("encoding %d slices of %d macroblock rows per frame",
+                  mNumVideoSlices, sliceRows);
+
+            mOutputFormat->setInt32("slice-mbs", sliceRows * ((width + 15) / 16));
+            mOutputFormat->setInt32("output-partial-frames", 1);
+        }
     }
 
     ALOGV("output format is '%s'", mOutputFormat->debugString(0).c_str());
@@ -660,6 +675,11 @@ sp<ABuffer> Converter::prependCSD(const sp<ABuffer> &accessUnit) const {
 
     dup->meta()->setInt64("timeUs", timeUs);
 
+    int64_t encodedUs;
+    CHECK(accessUnit->meta()->findInt64("encodedUs", &encodedUs));
+
+    dup->meta()->setInt64("encodedUs", encodedUs);
+
     return dup;
 }
 
@@ -746,6 +766,7 @@ status_t Converter::doMoreWork() {
             }
 
             buffer->meta()->setInt64("timeUs", timeUs);
+            buffer->meta()->setInt64("encodedUs", ALooper::GetNowUs());
 
             ALOGV("[%s] time %lld us (%.2f secs)",
                   mIsVideo ? "video" : "audio", timeUs, timeUs / 1E6);
@@ -760,13 +781,27 @@ status_t Converter::doMoreWork() {
                     mOutputFormat->setBuffer("csd-0", buffer);
                 }
             } else {
+                // The slices of a frame but the first one are continued, for
+                // the parameter sets and the PTS to go with the first only,
+                // those but the last one partial.
+                bool continued = mInPartialFrame;
+                mInPartialFrame = (flags & MediaCodec::BUFFER_FLAG_PARTIAL_FRAME);
+
                 if (mNeedToManuallyPrependSPSPPS
                         && mIsH264
                         && (mFlags & FLAG_PREPEND_CSD_IF_NECESSARY)
+                        && !continued
                         && IsIDR(buffer)) {
                     buffer = prependCSD(buffer);
                 }
 
+                if (continued) {
+                    buffer->meta()->setInt32("continued-frame", true);
+                }
+                if (mInPartialFrame) {
+                    buffer->meta()->setInt32("partial-frame", true);
+                }
+
                 sp<AMessage> notify = mNotify->dup();
                 notify->setInt32("what", kWhatAccessUnit);
                 notify->setBuffer("accessUnit", buffer);
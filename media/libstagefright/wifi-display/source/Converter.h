@@ -129,6 +129,12 @@ private:
     int32_t mNumFramesToDrop;
     bool mEncodingSuspended;
 
+    // media.wfd.video-slices: H.264 frames are encoded in as many slices,
+    // sent on as the encoder outputs them should it output partial frames,
+    // mInPartialFrame while the slices of a frame are.
+    int32_t mNumVideoSlices;
+    bool mInPartialFrame;
+
     status_t initEncoder();
     void releaseEncoder();
 
@@ -20,6 +20,7 @@
 
 #include "PlaybackSession.h"
 
+#include "CongestionController.h"
 #include "Converter.h"
 #include "MediaPuller.h"
 #include "RepeaterSource.h"
@@ -49,6 +50,8 @@
 
 namespace android {
 
+static const int64_t kLatencyLogIntervalUs = 5000000ll;
+
 struct WifiDisplaySource::PlaybackSession::Track : public AHandler {
     enum {
         kWhatStopped,
@@ -363,7 +366,9 @@ WifiDisplaySource::PlaybackSession::PlaybackSession(
       mPullExtractorPending(false),
       mPullExtractorGeneration(0),
       mFirstSampleTimeRealUs(-1ll),
-      mFirstSampleTimeUs(-1ll) {
+      mFirstSampleTimeUs(-1ll),
+      mLatenciesLoggedUs(-1ll),
+      mCongestionController(NULL) {
     if (path != NULL) {
         mMediaPath.setTo(path);
     }
@@ -423,6 +428,8 @@ status_t WifiDisplaySource::PlaybackSession::init(
 }
 
 WifiDisplaySource::PlaybackSession::~PlaybackSession() {
+    delete mCongestionController;
+    mCongestionController = NULL;
 }
 
 int32_t WifiDisplaySource::PlaybackSession::getRTPPort() const {
@@ -497,12 +504,23 @@ void WifiDisplaySource::PlaybackSession::onMessageReceived(
 
                 const sp<Track> &track = mTracks.valueFor(trackIndex);
 
+                int64_t nowUs = ALooper::GetNowUs();
+                accessUnit->meta()->setInt64("queuedUs", nowUs);
+
                 status_t err = mMediaSender->queueAccessUnit(
                         track->mediaSenderTrackIndex(),
                         accessUnit);
 
                 if (err != OK) {
                     notifySessionDead();
+                    break;
+                }
+
+                if (mLatenciesLoggedUs < 0) {
+                    mLatenciesLoggedUs = nowUs;
+                } else if (nowUs - mLatenciesLoggedUs >= kLatencyLogIntervalUs) {
+                    logLatencies();
+                    mLatenciesLoggedUs = nowUs;
                 }
                 break;
             } else if (what == Converter::kWhatEOS) {
@@ -551,18 +569,26 @@ void WifiDisplaySource::PlaybackSession::onMessageReceived(
                 }
             } else if (what == MediaSender::kWhatError) {
                 notifySessionDead();
-            } else if (what == MediaSender::kWhatNetworkStall) {
+            } else if (what == MediaSender::kWhatSendQueueDepth) {
                 size_t numBytesQueued;
                 CHECK(msg->findSize("numBytesQueued", &numBytesQueued));
 
-                if (mVideoTrackIndex >= 0) {
-                    const sp<Track> &videoTrack =
-                        mTracks.valueFor(mVideoTrackIndex);
+                if (mCongestionController != NULL) {
+                    mCongestionController->onSendQueueDepth(
+                            numBytesQueued, ALooper::GetNowUs());
+                    applyCongestionControl();
+                }
+            } else if (what == MediaSender::kWhatReceiverReport) {
+                float fractionLost;
+                CHECK(msg->findFloat("fractionLost", &fractionLost));
+
+                int64_t jitterUs;
+                CHECK(msg->findInt64("jitterUs", &jitterUs));
 
-                    sp<Converter> converter = videoTrack->converter();
-                    if (converter != NULL) {
-                        converter->dropAFrame();
-                    }
+                if (mCongestionController != NULL) {
+                    mCongestionController->onReceiverReport(
+                            fractionLost, jitterUs, ALooper::GetNowUs());
+                    applyCongestionControl();
                 }
             } else if (what == MediaSender::kWhatInformSender) {
                 onSinkFeedback(msg);
@@ -661,6 +687,36 @@ void WifiDisplaySource::PlaybackSession::onMessageReceived(
     }
 }
 
+// How long the access units took to be encoded, to get from the converters
+// to the session and to be muxed and handed to the RTP senders, the slices of
+// a frame one at a time when the encoder outputs them so.
+void WifiDisplaySource::PlaybackSession::logLatencies() {
+    for (size_t i = 0; i < mTracks.size(); ++i) {
+        const sp<Track> &track = mTracks.valueAt(i);
+        if (track->mediaSenderTrackIndex() < 0) {
+            continue;
+        }
+
+        int64_t avgUs[MediaSender::kNumLatencyStages];
+        int64_t maxUs[MediaSender::kNumLatencyStages];
+        size_t numAccessUnits = mMediaSender->takeLatencies(
+                track->mediaSenderTrackIndex(), avgUs, maxUs);
+        if (numAccessUnits == 0) {
+            continue;
+        }
+
+        ALOGI("[%s] %zu access units: encode %.2f ms (max %.2f ms), "
+              "deliver %.2f ms (max %.2f ms), send %.2f ms (max %.2f ms)",
+              track->isAudio() ? "audio" : "video", numAccessUnits,
+              avgUs[MediaSender::STAGE_ENCODE] / 1E3,
+              maxUs[MediaSender::STAGE_ENCODE] / 1E3,
+              avgUs[MediaSender::STAGE_DELIVER] / 1E3,
+              maxUs[MediaSender::STAGE_DELIVER] / 1E3,
+              avgUs[MediaSender::STAGE_SEND] / 1E3,
+              maxUs[MediaSender::STAGE_SEND] / 1E3);
+    }
+}
+
 void WifiDisplaySource::PlaybackSession::onSinkFeedback(const sp<AMessage> &msg) {
     int64_t avgLatencyUs;
     CHECK(msg->findInt64("avgLatencyUs", &avgLatencyUs));
@@ -672,41 +728,13 @@ void WifiDisplaySource::PlaybackSession::onSinkFeedback(const sp<AMessage> &msg)
           avgLatencyUs / 1000ll,
           maxLatencyUs / 1000ll);
 
+    if (mCongestionController != NULL) {
+        mCongestionController->onSinkLatency(avgLatencyUs, ALooper::GetNowUs());
+        applyCongestionControl();
+    }
+
     if (mVideoTrackIndex >= 0) {
         const sp<Track> &videoTrack = mTracks.valueFor(mVideoTrackIndex);
-        sp<Converter> converter = videoTrack->converter();
-
-        if (converter != NULL) {
-            int32_t videoBitrate =
-                Converter::GetInt32Property("media.wfd.video-bitrate", -1);
-
-            char val[PROPERTY_VALUE_MAX];
-            if (videoBitrate < 0
-                    && property_get("media.wfd.video-bitrate", val, NULL)
-                    && !strcasecmp("adaptive", val)) {
-                videoBitrate = converter->getVideoBitrate();
-
-                if (avgLatencyUs > 300000ll) {
-                    videoBitrate *= 0.6;
-                } else if (avgLatencyUs < 100000ll) {
-                    videoBitrate *= 1.1;
-                }
-            }
-
-            if (videoBitrate > 0) {
-                if (videoBitrate < 500000) {
-                    videoBitrate = 500000;
-                } else if (videoBitrate > 10000000) {
-                    videoBitrate = 10000000;
-                }
-
-                if (videoBitrate != converter->getVideoBitrate()) {
-                    ALOGI("setting video bitrate to %d bps", videoBitrate);
-
-                    converter->setVideoBitrate(videoBitrate);
-                }
-            }
-        }
 
         sp<RepeaterSource> repeaterSource = videoTrack->repeaterSource();
         if (repeaterSource != NULL) {
@@ -744,6 +772,24 @@ void WifiDisplaySource::PlaybackSession::onSinkFeedback(const sp<AMessage> &msg)
     }
 }
 
+void WifiDisplaySource::PlaybackSession::applyCongestionControl() {
+    const sp<Track> &videoTrack = mTracks.valueFor(mVideoTrackIndex);
+    sp<Converter> converter = videoTrack->converter();
+
+    int32_t videoBitrate = mCongestionController->bitrate();
+    if (videoBitrate != converter->getVideoBitrate()) {
+        ALOGI("setting video bitrate to %d bps", videoBitrate);
+
+        converter->setVideoBitrate(videoBitrate);
+    }
+
+    if (mCongestionController->takeIDRRequest()) {
+        ALOGI("requesting an IDR frame after heavy losses");
+
+        videoTrack->requestIDRFrame();
+    }
+}
+
 status_t WifiDisplaySource::PlaybackSession::setupMediaPacketizer(
         bool enableAudio, bool enableVideo) {
     DataSource::RegisterDefaultSniffers();
@@ -996,6 +1042,13 @@ status_t WifiDisplaySource::PlaybackSession::addSource(
 
     if (isVideo) {
         mVideoTrackIndex = trackIndex;
+
+        // Unless the property has the bitrate fixed.
+        if (Converter::GetInt32Property("media.wfd.video-bitrate", -1) < 0) {
+            mCongestionController = new CongestionController(
+                    converter->getVideoBitrate(),
+                    500000 /* minBitrate */, 10000000 /* maxBitrate */);
+        }
     }
 
     uint32_t flags = 0;
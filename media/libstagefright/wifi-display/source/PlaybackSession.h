@@ -25,6 +25,7 @@
 namespace android {
 
 struct ABuffer;
+struct CongestionController;
 struct IHDCP;
 struct IGraphicBufferProducer;
 struct MediaPuller;
@@ -124,6 +125,11 @@ private:
     int64_t mFirstSampleTimeRealUs;
     int64_t mFirstSampleTimeUs;
 
+    int64_t mLatenciesLoggedUs;
+
+    // of the video encoder, NULL if its bitrate is fixed
+    CongestionController *mCongestionController;
+
     status_t setupMediaPacketizer(bool enableAudio, bool enableVideo);
 
     status_t setupPacketizer(
@@ -161,6 +167,9 @@ private:
     void onPullExtractor();
 
     void onSinkFeedback(const sp<AMessage> &msg);
+    void applyCongestionControl();
+
+    void logLatencies();
 
     DISALLOW_EVIL_CONSTRUCTORS(PlaybackSession);
 };
@@ -12,6 +12,9 @@
 
 namespace android {
 
+const int64_t RepeaterSource::kStaticHoldUs = 500000ll;
+const int64_t RepeaterSource::kStaticRepeatIntervalUs = 200000ll;
+
 RepeaterSource::RepeaterSource(const sp<MediaSource> &source, double rateHz)
     : mStarted(false),
       mSource(source),
@@ -20,7 +23,12 @@ RepeaterSource::RepeaterSource(const sp<MediaSource> &source, double rateHz)
       mResult(OK),
       mLastBufferUpdateUs(-1ll),
       mStartTimeUs(-1ll),
-      mFrameCount(0) {
+      mFrameCount(0),
+      mBufferIsNew(false),
+      mLastDeliveredTimeUs(-1ll),
+      mNumFramesCaptured(0),
+      mNumFramesRepeated(0),
+      mNumFramesSkipped(0) {
 }
 
 RepeaterSource::~RepeaterSource() {
@@ -59,6 +67,11 @@ status_t RepeaterSource::start(MetaData *params) {
     mResult = OK;
     mStartTimeUs = -1ll;
     mFrameCount = 0;
+    mBufferIsNew = false;
+    mLastDeliveredTimeUs = -1ll;
+    mNumFramesCaptured = 0;
+    mNumFramesRepeated = 0;
+    mNumFramesSkipped = 0;
 
     mLooper = new ALooper;
     mLooper->setName("repeater_looper");
@@ -94,6 +107,8 @@ status_t RepeaterSource::stop() {
         mBuffer = NULL;
     }
 
+    ALOGI("%zu frames captured, %zu repeated, %zu repeats skipped",
+          mNumFramesCaptured, mNumFramesRepeated, mNumFramesSkipped);
 
     ALOGV("stopped");
 
@@ -137,6 +152,7 @@ status_t RepeaterSource::read(
         }
 
         bool stale = false;
+        bool skipped = false;
 
         {
             Mutex::Autolock autoLock(mLock);
@@ -145,21 +161,42 @@ status_t RepeaterSource::read(
                 return mResult;
             }
 
-#if SUSPEND_VIDEO_IF_IDLE
             int64_t nowUs = ALooper::GetNowUs();
+
+#if SUSPEND_VIDEO_IF_IDLE
             if (nowUs - mLastBufferUpdateUs > 1000000ll) {
                 mLastBufferUpdateUs = -1ll;
                 stale = true;
             } else
 #endif
-            {
+            if (!mBufferIsNew
+                    && mLastBufferUpdateUs >= 0ll
+                    && nowUs - mLastBufferUpdateUs > kStaticHoldUs
+                    && mLastDeliveredTimeUs >= 0ll
+                    && bufferTimeUs
+                        < mLastDeliveredTimeUs + kStaticRepeatIntervalUs) {
+                ++mFrameCount;
+                ++mNumFramesSkipped;
+                skipped = true;
+            } else {
                 mBuffer->add_ref();
                 *buffer = mBuffer;
                 (*buffer)->meta_data()->setInt64(kKeyTime, bufferTimeUs);
                 ++mFrameCount;
+
+                if (mBufferIsNew) {
+                    mBufferIsNew = false;
+                } else {
+                    ++mNumFramesRepeated;
+                }
+                mLastDeliveredTimeUs = bufferTimeUs;
             }
         }
 
+        if (skipped) {
+            continue;
+        }
+
         if (!stale) {
             break;
         }
@@ -194,6 +231,11 @@ void RepeaterSource::onMessageReceived(const sp<AMessage> &msg) {
             mResult = err;
             mLastBufferUpdateUs = ALooper::GetNowUs();
 
+            if (err == OK) {
+                mBufferIsNew = true;
+                ++mNumFramesCaptured;
+            }
+
             mCondition.broadcast();
 
             if (err == OK) {
@@ -210,6 +252,10 @@ void RepeaterSource::onMessageReceived(const sp<AMessage> &msg) {
 void RepeaterSource::wakeUp() {
     ALOGV("wakeUp");
     Mutex::Autolock autoLock(mLock);
+
+    // The next tick goes out even if the screen is static.
+    mLastDeliveredTimeUs = -1ll;
+
     if (mLastBufferUpdateUs < 0ll && mBuffer != NULL) {
         mLastBufferUpdateUs = ALooper::GetNowUs();
         mCondition.broadcast();
@@ -12,7 +12,17 @@ namespace android {
 
 // This MediaSource delivers frames at a constant rate by repeating buffers
 // if necessary.
+//
+// Once the screen has been static for kStaticHoldUs, that is once no new
+// frame has come from SurfaceFlinger for that long, the last one is only
+// repeated every kStaticRepeatIntervalUs instead of at the full rate, for
+// static content not to cost a fully encoded frame on every tick. The next
+// new frame, or a wakeUp, goes out on the next tick again. The frames
+// captured, repeated and skipped that way are logged when it stops.
 struct RepeaterSource : public MediaSource {
+    static const int64_t kStaticHoldUs;
+    static const int64_t kStaticRepeatIntervalUs;
+
     RepeaterSource(const sp<MediaSource> &source, double rateHz);
 
     virtual status_t start(MetaData *params);
@@ -57,6 +67,14 @@ private:
     int64_t mStartTimeUs;
     int32_t mFrameCount;
 
+    // mBuffer is a frame that was not delivered yet
+    bool mBufferIsNew;
+    int64_t mLastDeliveredTimeUs;
+
+    size_t mNumFramesCaptured;
+    size_t mNumFramesRepeated;
+    size_t mNumFramesSkipped;
+
     void postRead();
 
     DISALLOW_EVIL_CONSTRUCTORS(RepeaterSource);
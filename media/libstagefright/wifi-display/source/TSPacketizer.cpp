@@ -20,6 +20,7 @@
 
 #include "TSPacketizer.h"
 #include "include/avc_utils.h"
+#include "include/TSPacketUtils.h"
 
 #include <media/stagefright/foundation/ABuffer.h>
 #include <media/stagefright/foundation/ADebug.h>
@@ -346,8 +347,6 @@ TSPacketizer::TSPacketizer(uint32_t flags)
     : mFlags(flags),
       mPATContinuityCounter(0),
       mPMTContinuityCounter(0) {
-    initCrcTable();
-
     if (flags & (EMIT_HDCP20_DESCRIPTOR | EMIT_HDCP21_DESCRIPTOR)) {
         int32_t hdcpVersion;
         if (flags & EMIT_HDCP20_DESCRIPTOR) {
@@ -470,7 +469,9 @@ status_t TSPacketizer::packetize(
 
     const sp<Track> &track = mTracks.itemAt(trackIndex);
 
-    if (track->isH264() && (flags & PREPEND_SPS_PPS_TO_IDR_FRAMES)
+    if (flags & CONTINUES_ACCESS_UNIT) {
+        CHECK(track->isVideo());
+    } else if (track->isH264() && (flags & PREPEND_SPS_PPS_TO_IDR_FRAMES)
             && IsIDR(accessUnit)) {
         // prepend codec specific data, i.e. SPS and PPS.
         accessUnit = track->prependCSD(accessUnit);
@@ -513,6 +514,9 @@ status_t TSPacketizer::packetize(
     // PTS[14..0] = b??? ???? ???? ???? (15 bits)
     // reserved = b1
     // the first fragment of "buffer" follows
+    //
+    // With CONTINUES_ACCESS_UNIT, PTS_DTS_flags = b00 and the 5 bytes of PTS
+    // are left out.
 
     // Each transport packet (except for the last one contributing to the PES
     // payload) must contain a multiple of 16 bytes of payload per HDCP spec.
@@ -524,7 +528,7 @@ status_t TSPacketizer::packetize(
 
        4 bytes of TS header
        ... padding
-       14 bytes of static PES header
+       14 bytes of static PES header (9 without a PTS)
        PES_private_data_len + 1 bytes (only if PES_private_data_len > 0)
        numStuffingBytes bytes
 
@@ -538,7 +542,10 @@ status_t TSPacketizer::packetize(
        followed by the payload
     */
 
-    size_t PES_packet_length = accessUnit->size() + 8 + numStuffingBytes;
+    const size_t PTS_len = (flags & CONTINUES_ACCESS_UNIT) ? 0 : 5;
+
+    size_t PES_packet_length =
+        accessUnit->size() + 3 + PTS_len + numStuffingBytes;
     if (PES_private_data_len > 0) {
         PES_packet_length += PES_private_data_len + 1;
     }
@@ -547,7 +554,7 @@ status_t TSPacketizer::packetize(
 
     {
         // Make sure the PES header fits into a single TS packet:
-        size_t PES_header_size = 14 + numStuffingBytes;
+        size_t PES_header_size = 9 + PTS_len + numStuffingBytes;
         if (PES_private_data_len > 0) {
             PES_header_size += PES_private_data_len + 1;
         }
@@ -697,7 +704,7 @@ status_t TSPacketizer::packetize(
         *ptr++ = kPID_PMT & 0xff;
 
         CHECK_EQ(ptr - crcDataStart, 12);
-        uint32_t crc = htonl(crc32(crcDataStart, ptr - crcDataStart));
+        uint32_t crc = htonl(TSSectionCRC32(crcDataStart, ptr - crcDataStart));
         memcpy(ptr, &crc, 4);
         ptr += 4;
 
@@ -812,7 +819,7 @@ status_t TSPacketizer::packetize(
         crcDataStart[1] = 0xb0 | (section_length >> 8);
         crcDataStart[2] = section_length & 0xff;
 
-        crc = htonl(crc32(crcDataStart, ptr - crcDataStart));
+        crc = htonl(TSSectionCRC32(crcDataStart, ptr - crcDataStart));
         memcpy(ptr, &crc, 4);
         ptr += 4;
 
@@ -880,7 +887,7 @@ status_t TSPacketizer::packetize(
         PES_packet_length = 0;
     }
 
-    size_t sizeAvailableForPayload = 188 - 4 - 14 - numStuffingBytes;
+    size_t sizeAvailableForPayload = 188 - 4 - 9 - PTS_len - numStuffingBytes;
     if (PES_private_data_len > 0) {
         sizeAvailableForPayload -= PES_private_data_len + 1;
     }
@@ -897,22 +904,9 @@ status_t TSPacketizer::packetize(
 
     size_t numPaddingBytes = sizeAvailableForPayload - copy;
 
-    uint8_t *ptr = packetDataStart;
-    *ptr++ = 0x47;
-    *ptr++ = 0x40 | (track->PID() >> 8);
-    *ptr++ = track->PID() & 0xff;
-
-    *ptr++ = (numPaddingBytes > 0 ? 0x30 : 0x10)
-                | track->incrementContinuityCounter();
-
-    if (numPaddingBytes > 0) {
-        *ptr++ = numPaddingBytes - 1;
-        if (numPaddingBytes >= 2) {
-            *ptr++ = 0x00;
-            memset(ptr, 0xff, numPaddingBytes - 2);
-            ptr += numPaddingBytes - 2;
-        }
-    }
+    uint8_t *ptr = WriteTSPacketHeader(
+            packetDataStart, track->PID(), true /* payloadUnitStart */,
+            track->incrementContinuityCounter(), numPaddingBytes);
 
     *ptr++ = 0x00;
     *ptr++ = 0x00;
@@ -921,20 +915,22 @@ status_t TSPacketizer::packetize(
     *ptr++ = PES_packet_length >> 8;
     *ptr++ = PES_packet_length & 0xff;
     *ptr++ = 0x84;
-    *ptr++ = (PES_private_data_len > 0) ? 0x81 : 0x80;
+    *ptr++ = (PTS_len > 0 ? 0x80 : 0x00) | (PES_private_data_len > 0 ? 0x01 : 0x00);
 
-    size_t headerLength = 0x05 + numStuffingBytes;
+    size_t headerLength = PTS_len + numStuffingBytes;
     if (PES_private_data_len > 0) {
         headerLength += 1 + PES_private_data_len;
     }
 
     *ptr++ = headerLength;
 
-    *ptr++ = 0x20 | (((PTS >> 30) & 7) << 1) | 1;
-    *ptr++ = (PTS >> 22) & 0xff;
-    *ptr++ = (((PTS >> 15) & 0x7f) << 1) | 1;
-    *ptr++ = (PTS >> 7) & 0xff;
-    *ptr++ = ((PTS & 0x7f) << 1) | 1;
+    if (PTS_len > 0) {
+        *ptr++ = 0x20 | (((PTS >> 30) & 7) << 1) | 1;
+        *ptr++ = (PTS >> 22) & 0xff;
+        *ptr++ = (((PTS >> 15) & 0x7f) << 1) | 1;
+        *ptr++ = (PTS >> 7) & 0xff;
+        *ptr++ = ((PTS & 0x7f) << 1) | 1;
+    }
 
     if (PES_private_data_len > 0) {
         *ptr++ = 0x8e;  // PES_private_data_flag, reserved.
@@ -977,28 +973,10 @@ status_t TSPacketizer::packetize(
             }
         }
 
-        size_t numPaddingBytes = sizeAvailableForPayload - copy;
-
-        uint8_t *ptr = packetDataStart;
-        *ptr++ = 0x47;
-        *ptr++ = 0x00 | (track->PID() >> 8);
-        *ptr++ = track->PID() & 0xff;
-
-        *ptr++ = (numPaddingBytes > 0 ? 0x30 : 0x10)
-                    | track->incrementContinuityCounter();
-
-        if (numPaddingBytes > 0) {
-            *ptr++ = numPaddingBytes - 1;
-            if (numPaddingBytes >= 2) {
-                *ptr++ = 0x00;
-                memset(ptr, 0xff, numPaddingBytes - 2);
-                ptr += numPaddingBytes - 2;
-            }
-        }
-
-        memcpy(ptr, accessUnit->data() + offset, copy);
-        ptr += copy;
-        CHECK_EQ(ptr, packetDataStart + 188);
+        WriteTSPacket(
+                packetDataStart, track->PID(), false /* payloadUnitStart */,
+                track->incrementContinuityCounter(),
+                accessUnit->data() + offset, copy);
 
         offset += copy;
         packetDataStart += 188;
@@ -1011,29 +989,6 @@ status_t TSPacketizer::packetize(
     return OK;
 }
 
-void TSPacketizer::initCrcTable() {
-    uint32_t poly = 0x04C11DB7;
-
-    for (int i = 0; i < 256; i++) {
-        uint32_t crc = i << 24;
-        for (int j = 0; j < 8; j++) {
-            crc = (crc << 1) ^ ((crc & 0x80000000) ? (poly) : 0);
-        }
-        mCrcTable[i] = crc;
-    }
-}
-
-uint32_t TSPacketizer::crc32(const uint8_t *start, size_t size) const {
-    uint32_t crc = 0xFFFFFFFF;
-    const uint8_t *p;
-
-    for (p = start; p < start + size; ++p) {
-        crc = (crc << 8) ^ mCrcTable[((crc >> 24) ^ *p) & 0xFF];
-    }
-
-    return crc;
-}
-
 sp<ABuffer> TSPacketizer::prependCSD(
         size_t trackIndex, const sp<ABuffer> &accessUnit) const {
     CHECK_LT(trackIndex, mTracks.size());
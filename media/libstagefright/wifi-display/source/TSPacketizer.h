@@ -46,6 +46,9 @@ struct TSPacketizer : public RefBase {
         EMIT_PCR                        = 2,
         IS_ENCRYPTED                    = 4,
         PREPEND_SPS_PPS_TO_IDR_FRAMES   = 8,
+        // The access unit is the rest of the one packetized last on the
+        // track, a slice of the same frame: its PES packet has no PTS.
+        CONTINUES_ACCESS_UNIT           = 16,
     };
     status_t packetize(
             size_t trackIndex, const sp<ABuffer> &accessUnit,
@@ -80,11 +83,6 @@ private:
     unsigned mPATContinuityCounter;
     unsigned mPMTContinuityCounter;
 
-    uint32_t mCrcTable[256];
-
-    void initCrcTable();
-    uint32_t crc32(const uint8_t *start, size_t size) const;
-
     DISALLOW_EVIL_CONSTRUCTORS(TSPacketizer);
 };
 
@@ -35,6 +35,7 @@
 #include <endian.h>
 
 #include <usbhost/usbhost.h>
+#include <utils/Timers.h>
 
 namespace android {
 
@@ -179,7 +180,6 @@ MtpDevice::MtpDevice(struct usb_device* device, int interface,
     :   mDevice(device),
         mInterface(interface),
         mRequestIn1(NULL),
-        mRequestIn2(NULL),
         mRequestOut(NULL),
         mRequestIntr(NULL),
         mDeviceInfo(NULL),
@@ -188,7 +188,8 @@ MtpDevice::MtpDevice(struct usb_device* device, int interface,
         mReceivedResponse(false)
 {
     mRequestIn1 = usb_request_new(device, ep_in);
-    mRequestIn2 = usb_request_new(device, ep_in);
+    for (int i = 0; i < kNumDataRequests; i++)
+        mDataRequests[i] = usb_request_new(device, ep_in);
     mRequestOut = usb_request_new(device, ep_out);
     mRequestIntr = usb_request_new(device, ep_intr);
 }
@@ -198,7 +199,8 @@ MtpDevice::~MtpDevice() {
     for (size_t i = 0; i < mDeviceProperties.size(); i++)
         delete mDeviceProperties[i];
     usb_request_free(mRequestIn1);
-    usb_request_free(mRequestIn2);
+    for (int i = 0; i < kNumDataRequests; i++)
+        usb_request_free(mDataRequests[i]);
     usb_request_free(mRequestOut);
     usb_request_free(mRequestIntr);
 }
@@ -589,70 +591,9 @@ bool MtpDevice::readObject(MtpObjectHandle handle,
             goto fail;
         }
         length -= MTP_CONTAINER_HEADER_SIZE;
-        uint32_t remaining = length;
-        int offset = 0;
-
-        int initialDataLength = 0;
-        void* initialData = mData.getData(initialDataLength);
-        if (initialData) {
-            if (initialDataLength > 0) {
-                if (!callback(initialData, 0, initialDataLength, clientData))
-                    goto fail;
-                remaining -= initialDataLength;
-                offset += initialDataLength;
-            }
-            free(initialData);
-        }
-
-        // USB reads greater than 16K don't work
-        char buffer1[16384], buffer2[16384];
-        mRequestIn1->buffer = buffer1;
-        mRequestIn2->buffer = buffer2;
-        struct usb_request* req = mRequestIn1;
-        void* writeBuffer = NULL;
-        int writeLength = 0;
-
-        while (remaining > 0 || writeBuffer) {
-            if (remaining > 0) {
-                // queue up a read request
-                req->buffer_length = (remaining > sizeof(buffer1) ? sizeof(buffer1) : remaining);
-                if (mData.readDataAsync(req)) {
-                    ALOGE("readDataAsync failed");
-                    goto fail;
-                }
-            } else {
-                req = NULL;
-            }
-
-            if (writeBuffer) {
-                // write previous buffer
-                if (!callback(writeBuffer, offset, writeLength, clientData)) {
-                    ALOGE("write failed");
-                    // wait for pending read before failing
-                    if (req)
-                        mData.readDataWait(mDevice);
-                    goto fail;
-                }
-                offset += writeLength;
-                writeBuffer = NULL;
-            }
 
-            // wait for read to complete
-            if (req) {
-                int read = mData.readDataWait(mDevice);
-                if (read < 0)
-                    goto fail;
-
-                if (read > 0) {
-                    writeBuffer = req->buffer;
-                    writeLength = read;
-                    remaining -= read;
-                    req = (req == mRequestIn1 ? mRequestIn2 : mRequestIn1);
-                } else {
-                    writeBuffer = NULL;
-                }
-            }
-        }
+        if (!readObjectData(length, callback, clientData))
+            goto fail;
 
         MtpResponseCode response = readResponse();
         if (response == MTP_RESPONSE_OK)
@@ -664,6 +605,15 @@ fail:
 }
 
 
+static bool writeToFile(void* data, int /* offset */, int length, void* clientData) {
+    int fd = *(int *)clientData;
+    if (write(fd, data, length) != length) {
+        ALOGE("write failed");
+        return false;
+    }
+    return true;
+}
+
 // reads the object's data and writes it to the specified file path
 bool MtpDevice::readObject(MtpObjectHandle handle, const char* destPath, int group, int perm) {
     ALOGD("readObject: %s", destPath);
@@ -690,69 +640,9 @@ bool MtpDevice::readObject(MtpObjectHandle handle, const char* destPath, int gro
         if (length < MTP_CONTAINER_HEADER_SIZE)
             goto fail;
         length -= MTP_CONTAINER_HEADER_SIZE;
-        uint32_t remaining = length;
-
-        int initialDataLength = 0;
-        void* initialData = mData.getData(initialDataLength);
-        if (initialData) {
-            if (initialDataLength > 0) {
-                if (write(fd, initialData, initialDataLength) != initialDataLength) {
-                    free(initialData);
-                    goto fail;
-                }
-                remaining -= initialDataLength;
-            }
-            free(initialData);
-        }
-
-        // USB reads greater than 16K don't work
-        char buffer1[16384], buffer2[16384];
-        mRequestIn1->buffer = buffer1;
-        mRequestIn2->buffer = buffer2;
-        struct usb_request* req = mRequestIn1;
-        void* writeBuffer = NULL;
-        int writeLength = 0;
-
-        while (remaining > 0 || writeBuffer) {
-            if (remaining > 0) {
-                // queue up a read request
-                req->buffer_length = (remaining > sizeof(buffer1) ? sizeof(buffer1) : remaining);
-                if (mData.readDataAsync(req)) {
-                    ALOGE("readDataAsync failed");
-                    goto fail;
-                }
-            } else {
-                req = NULL;
-            }
 
-            if (writeBuffer) {
-                // write previous buffer
-                if (write(fd, writeBuffer, writeLength) != writeLength) {
-                    ALOGE("write failed");
-                    // wait for pending read before failing
-                    if (req)
-                        mData.readDataWait(mDevice);
-                    goto fail;
-                }
-                writeBuffer = NULL;
-            }
-
-            // wait for read to complete
-            if (req) {
-                int read = mData.readDataWait(mDevice);
-                if (read < 0)
-                    goto fail;
-
-                if (read > 0) {
-                    writeBuffer = req->buffer;
-                    writeLength = read;
-                    remaining -= read;
-                    req = (req == mRequestIn1 ? mRequestIn2 : mRequestIn1);
-                } else {
-                    writeBuffer = NULL;
-                }
-            }
-        }
+        if (!readObjectData(length, writeToFile, &fd))
+            goto fail;
 
         MtpResponseCode response = readResponse();
         if (response == MTP_RESPONSE_OK)
@@ -812,6 +702,90 @@ bool MtpDevice::writeDataHeader(MtpOperationCode operation, int dataLength) {
     return (!mData.writeDataHeader(mRequestOut, dataLength));
 }
 
+// Passes the data of the current data phase to callback, the part in mData
+// first. All of mDataRequests are kept queued, for the device to have
+// somewhere to send the data to while callback runs.
+bool MtpDevice::readObjectData(uint32_t length,
+        bool (* callback)(void* data, int offset, int length, void* clientData),
+        void* clientData) {
+    nsecs_t startTime = systemTime();
+    uint32_t unrequested = length;
+    int offset = 0;
+
+    int initialDataLength = 0;
+    void* initialData = mData.getData(initialDataLength);
+    if (initialData) {
+        bool written = true;
+        if (initialDataLength > 0) {
+            written = callback(initialData, 0, initialDataLength, clientData);
+            unrequested -= initialDataLength;
+            offset += initialDataLength;
+        }
+        free(initialData);
+        if (!written)
+            return false;
+    }
+
+    char* buffers = (char *)malloc(kNumDataRequests * kDataRequestSize);
+    if (!buffers) {
+        ALOGE("out of memory for %d data requests", kNumDataRequests);
+        return false;
+    }
+    for (int i = 0; i < kNumDataRequests; i++)
+        mDataRequests[i]->buffer = buffers + i * kDataRequestSize;
+
+    // requests complete in the order they were queued
+    int first = 0;
+    int queued = 0;
+    bool result = true;
+
+    while (result && (unrequested > 0 || queued > 0)) {
+        while (unrequested > 0 && queued < kNumDataRequests) {
+            struct usb_request* req = mDataRequests[(first + queued) % kNumDataRequests];
+            req->buffer_length = (unrequested > kDataRequestSize ? kDataRequestSize
+                    : unrequested);
+            if (mData.readDataAsync(req)) {
+                ALOGE("readDataAsync failed");
+                result = false;
+                break;
+            }
+            unrequested -= req->buffer_length;
+            queued++;
+        }
+        if (queued == 0)
+            break;
+
+        struct usb_request* req = mDataRequests[first];
+        first = (first + 1) % kNumDataRequests;
+        queued--;
+
+        int read = mData.readDataWait(mDevice);
+        if (read < 0) {
+            result = false;
+        } else {
+            // ask again for what a short read did not give
+            unrequested += req->buffer_length - read;
+            if (read > 0 && !callback(req->buffer, offset, read, clientData))
+                result = false;
+            offset += read;
+        }
+    }
+
+    // wait for pending reads before failing
+    while (queued-- > 0)
+        mData.readDataWait(mDevice);
+
+    free(buffers);
+
+    if (result) {
+        int64_t elapsedUs = ns2us(systemTime() - startTime);
+        ALOGV("read %u bytes in %lld ms, %lld KB/s", length,
+                (long long)(elapsedUs / 1000),
+                (long long)(elapsedUs > 0 ? length * 1000ll / elapsedUs : 0));
+    }
+    return result;
+}
+
 MtpResponseCode MtpDevice::readResponse() {
     ALOGV("readResponse\n");
     if (mReceivedResponse) {
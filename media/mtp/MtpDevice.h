@@ -36,10 +36,17 @@ class MtpStorageInfo;
 
 class MtpDevice {
 private:
+    // reads of object data kept queued at once, of at most
+    // kDataRequestSize bytes each, usbfs failing on larger ones
+    enum {
+        kNumDataRequests = 4,
+        kDataRequestSize = 16384,
+    };
+
     struct usb_device*      mDevice;
     int                     mInterface;
     struct usb_request*     mRequestIn1;
-    struct usb_request*     mRequestIn2;
+    struct usb_request*     mDataRequests[kNumDataRequests];
     struct usb_request*     mRequestOut;
     struct usb_request*     mRequestIntr;
     MtpDeviceInfo*          mDeviceInfo;
@@ -108,6 +115,10 @@ private:
     bool                    readData();
     bool                    writeDataHeader(MtpOperationCode operation, int dataLength);
     MtpResponseCode         readResponse();
+    bool                    readObjectData(uint32_t length,
+                                    bool (* callback)(void* data, int offset,
+                                            int length, void* clientData),
+                                    void* clientData);
 
 };
 
@@ -89,6 +89,9 @@ static const MtpOperationCode kSupportedOperationCodes[] = {
     MTP_OPERATION_END_EDIT_OBJECT,
 };
 
+// GetObjectHandles listings kept
+static const size_t kMaxObjectLists = 8;
+
 static const MtpEventCode kSupportedEventCodes[] = {
     MTP_EVENT_OBJECT_ADDED,
     MTP_EVENT_OBJECT_REMOVED,
@@ -109,7 +112,13 @@ MtpServer::MtpServer(int fd, MtpDatabase* database, bool ptp,
         mSessionOpen(false),
         mSendObjectHandle(kInvalidObjectHandle),
         mSendObjectFormat(0),
-        mSendObjectFileSize(0)
+        mSendObjectFileSize(0),
+        mSendObjectPending(false),
+        mSendObjectResult(MTP_RESPONSE_OK),
+        mPartialObjectHandle(kInvalidObjectHandle),
+        mPartialObjectLength(0),
+        mPartialObjectFormat(0),
+        mObjectListGeneration(0)
 {
 }
 
@@ -120,6 +129,7 @@ void MtpServer::addStorage(MtpStorage* storage) {
     Mutex::Autolock autoLock(mMutex);
 
     mStorages.push(storage);
+    invalidateObjectLists();
     sendStoreAdded(storage->getStorageID());
 }
 
@@ -129,6 +139,7 @@ void MtpServer::removeStorage(MtpStorage* storage) {
     for (size_t i = 0; i < mStorages.size(); i++) {
         if (mStorages[i] == storage) {
             mStorages.removeAt(i);
+            invalidateObjectLists();
             sendStoreRemoved(storage->getStorageID());
             break;
         }
@@ -158,6 +169,11 @@ void MtpServer::run() {
     ALOGV("MtpServer::run fd: %d\n", fd);
 
     while (1) {
+        // the database learns of the object received once the host has its
+        // response, instead of the host waiting on the media scanner
+        if (mSendObjectPending)
+            finishSendObject();
+
         int ret = mRequest.read(fd);
         if (ret < 0) {
             ALOGV("request read returned %d, errno: %d", ret, errno);
@@ -228,6 +244,9 @@ void MtpServer::run() {
         }
     }
 
+    if (mSendObjectPending)
+        finishSendObject();
+
     // commit any open edits
     int count = mObjectEditList.size();
     for (int i = 0; i < count; i++) {
@@ -245,11 +264,13 @@ void MtpServer::run() {
 
 void MtpServer::sendObjectAdded(MtpObjectHandle handle) {
     ALOGV("sendObjectAdded %d\n", handle);
+    invalidateObjectLists();
     sendEvent(MTP_EVENT_OBJECT_ADDED, handle);
 }
 
 void MtpServer::sendObjectRemoved(MtpObjectHandle handle) {
     ALOGV("sendObjectRemoved %d\n", handle);
+    invalidateObjectLists();
     sendEvent(MTP_EVENT_OBJECT_REMOVED, handle);
 }
 
@@ -319,6 +340,12 @@ bool MtpServer::handleRequest() {
 
     mResponse.reset();
 
+    if (operation != MTP_OPERATION_GET_PARTIAL_OBJECT
+            && operation != MTP_OPERATION_GET_PARTIAL_OBJECT_64) {
+        // anything else may change the object, look it up again
+        mPartialObjectHandle = kInvalidObjectHandle;
+    }
+
     if (mSendObjectHandle != kInvalidObjectHandle && operation != MTP_OPERATION_SEND_OBJECT) {
         // FIXME - need to delete mSendObjectHandle from the database
         ALOGE("expected SendObject after SendObjectInfo");
@@ -429,12 +456,79 @@ bool MtpServer::handleRequest() {
             break;
     }
 
+    switch (operation) {
+        case MTP_OPERATION_OPEN_SESSION:
+        case MTP_OPERATION_CLOSE_SESSION:
+        case MTP_OPERATION_SEND_OBJECT_INFO:
+        case MTP_OPERATION_DELETE_OBJECT:
+            // the database does not tell us of changes made for the host
+            invalidateObjectLists();
+            break;
+    }
+
     if (response == MTP_RESPONSE_TRANSACTION_CANCELLED)
         return false;
     mResponse.setResponseCode(response);
     return true;
 }
 
+void MtpServer::getObjectList(MtpStorageID storageID, MtpObjectFormat format,
+        MtpObjectHandle parent, MtpObjectHandleList& handles) {
+    if (findObjectList(storageID, format, parent, handles))
+        return;
+
+    uint32_t generation;
+    {
+        Mutex::Autolock autoLock(mObjectListLock);
+        generation = mObjectListGeneration;
+    }
+
+    MtpObjectHandleList* list = mDatabase->getObjectList(storageID, format, parent);
+    if (list) {
+        handles = *list;
+        delete list;
+    } else {
+        handles.clear();
+    }
+
+    Mutex::Autolock autoLock(mObjectListLock);
+    if (generation != mObjectListGeneration)
+        return;
+    if (mObjectLists.size() >= kMaxObjectLists)
+        mObjectLists.removeAt(0);
+    ObjectList entry;
+    entry.mStorageID = storageID;
+    entry.mFormat = format;
+    entry.mParent = parent;
+    entry.mHandles = handles;
+    mObjectLists.push(entry);
+}
+
+bool MtpServer::findObjectList(MtpStorageID storageID, MtpObjectFormat format,
+        MtpObjectHandle parent, MtpObjectHandleList& handles) {
+    Mutex::Autolock autoLock(mObjectListLock);
+    for (size_t i = 0; i < mObjectLists.size(); i++) {
+        const ObjectList& entry = mObjectLists[i];
+        if (entry.mStorageID == storageID && entry.mFormat == format
+                && entry.mParent == parent) {
+            handles = entry.mHandles;
+            if (i + 1 < mObjectLists.size()) {
+                ObjectList used = entry;
+                mObjectLists.removeAt(i);
+                mObjectLists.push(used);
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void MtpServer::invalidateObjectLists() {
+    Mutex::Autolock autoLock(mObjectListLock);
+    mObjectLists.clear();
+    mObjectListGeneration++;
+}
+
 MtpResponseCode MtpServer::doGetDeviceInfo() {
     MtpStringBuffer   string;
     char prop_value[PROPERTY_VALUE_MAX];
@@ -568,9 +662,9 @@ MtpResponseCode MtpServer::doGetObjectHandles() {
     if (!hasStorage(storageID))
         return MTP_RESPONSE_INVALID_STORAGE_ID;
 
-    MtpObjectHandleList* handles = mDatabase->getObjectList(storageID, format, parent);
-    mData.putAUInt32(handles);
-    delete handles;
+    MtpObjectHandleList handles;
+    getObjectList(storageID, format, parent, handles);
+    mData.putAUInt32(&handles);
     return MTP_RESPONSE_OK;
 }
 
@@ -584,7 +678,12 @@ MtpResponseCode MtpServer::doGetNumObjects() {
     if (!hasStorage(storageID))
         return MTP_RESPONSE_INVALID_STORAGE_ID;
 
-    int count = mDatabase->getNumObjects(storageID, format, parent);
+    int count;
+    MtpObjectHandleList handles;
+    if (findObjectList(storageID, format, parent, handles))
+        count = handles.size();
+    else
+        count = mDatabase->getNumObjects(storageID, format, parent);
     if (count >= 0) {
         mResponse.setParameter(1, count);
         return MTP_RESPONSE_OK;
@@ -746,6 +845,8 @@ MtpResponseCode MtpServer::doGetObject() {
     if (mfr.fd < 0) {
         return MTP_RESPONSE_GENERAL_ERROR;
     }
+    // for the page cache to read ahead of the driver's chunks
+    posix_fadvise(mfr.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
     mfr.offset = 0;
     mfr.length = fileLength;
     mfr.command = mRequest.getOperationCode();
@@ -796,21 +897,28 @@ MtpResponseCode MtpServer::doGetPartialObject(MtpOperationCode operation) {
         // standard GetPartialObject
         length = mRequest.getParameter(3);
     }
-    MtpString pathBuf;
-    int64_t fileLength;
-    MtpObjectFormat format;
-    int result = mDatabase->getObjectFilePath(handle, pathBuf, fileLength, format);
-    if (result != MTP_RESPONSE_OK)
-        return result;
+    // Hosts read big objects in many chunks in a row, look the object up for
+    // the first one only.
+    if (handle != mPartialObjectHandle) {
+        mPartialObjectHandle = kInvalidObjectHandle;
+        int result = mDatabase->getObjectFilePath(handle, mPartialObjectPath,
+                mPartialObjectLength, mPartialObjectFormat);
+        if (result != MTP_RESPONSE_OK)
+            return result;
+        mPartialObjectHandle = handle;
+    }
+    int64_t fileLength = mPartialObjectLength;
     if (offset + length > (uint64_t)fileLength)
         length = fileLength - offset;
 
-    const char* filePath = (const char *)pathBuf;
+    const char* filePath = (const char *)mPartialObjectPath;
     mtp_file_range  mfr;
     mfr.fd = open(filePath, O_RDONLY);
     if (mfr.fd < 0) {
+        mPartialObjectHandle = kInvalidObjectHandle;
         return MTP_RESPONSE_GENERAL_ERROR;
     }
+    posix_fadvise(mfr.fd, offset, length, POSIX_FADV_SEQUENTIAL);
     mfr.offset = offset;
     mfr.length = length;
     mfr.command = mRequest.getOperationCode();
@@ -996,11 +1104,22 @@ done:
     // reset so we don't attempt to send the data back
     mData.reset();
 
+    // finishSendObject() tells the database, after the response
+    mSendObjectResult = result;
+    mSendObjectPending = true;
+    return result;
+}
+
+void MtpServer::finishSendObject() {
+    Mutex::Autolock autoLock(mMutex);
+
     mDatabase->endSendObject(mSendObjectFilePath, mSendObjectHandle, mSendObjectFormat,
-            result == MTP_RESPONSE_OK);
+            mSendObjectResult == MTP_RESPONSE_OK);
     mSendObjectHandle = kInvalidObjectHandle;
     mSendObjectFormat = 0;
-    return result;
+    mSendObjectPending = false;
+    // a failed transfer takes the object out of the database
+    invalidateObjectLists();
 }
 
 static void deleteRecursive(const char* path) {
@@ -65,6 +65,15 @@ private:
     MtpObjectFormat     mSendObjectFormat;
     MtpString           mSendObjectFilePath;
     size_t              mSendObjectFileSize;
+    // SendObject done, the database not told yet
+    bool                mSendObjectPending;
+    MtpResponseCode     mSendObjectResult;
+
+    // object of the last GetPartialObject, kept for the next chunk
+    MtpObjectHandle     mPartialObjectHandle;
+    MtpString           mPartialObjectPath;
+    int64_t             mPartialObjectLength;
+    MtpObjectFormat     mPartialObjectFormat;
 
     Mutex               mMutex;
 
@@ -89,6 +98,21 @@ private:
     };
     Vector<ObjectEdit*>  mObjectEditList;
 
+    // a GetObjectHandles listing, hosts asking for the same ones over and
+    // over while browsing
+    struct ObjectList {
+        MtpStorageID        mStorageID;
+        MtpObjectFormat     mFormat;
+        MtpObjectHandle     mParent;
+        MtpObjectHandleList mHandles;
+    };
+    // most recently used last, all dropped whenever objects come or go
+    Vector<ObjectList>  mObjectLists;
+    // bumped as they are dropped, for a listing read meanwhile not to be kept
+    uint32_t            mObjectListGeneration;
+    // not mMutex, objects come and go from other threads during requests
+    Mutex               mObjectListLock;
+
 public:
                         MtpServer(int fd, MtpDatabase* database, bool ptp,
                                     int fileGroup, int filePerm, int directoryPerm);
@@ -117,6 +141,12 @@ private:
     void                removeEditObject(MtpObjectHandle handle);
     void                commitEdit(ObjectEdit* edit);
 
+    void                getObjectList(MtpStorageID storageID, MtpObjectFormat format,
+                                MtpObjectHandle parent, MtpObjectHandleList& handles);
+    bool                findObjectList(MtpStorageID storageID, MtpObjectFormat format,
+                                MtpObjectHandle parent, MtpObjectHandleList& handles);
+    void                invalidateObjectLists();
+
     bool                handleRequest();
 
     MtpResponseCode     doGetDeviceInfo();
@@ -141,6 +171,7 @@ private:
     MtpResponseCode     doGetPartialObject(MtpOperationCode operation);
     MtpResponseCode     doSendObjectInfo();
     MtpResponseCode     doSendObject();
+    void                finishSendObject();
     MtpResponseCode     doDeleteObject();
     MtpResponseCode     doGetObjectPropDesc();
     MtpResponseCode     doGetDevicePropDesc();
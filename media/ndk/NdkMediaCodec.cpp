@@ -28,6 +28,7 @@
 #include <utils/StrongPointer.h>
 #include <gui/Surface.h>
 
+#include <media/stagefright/foundation/ADebug.h>
 #include <media/stagefright/foundation/ALooper.h>
 #include <media/stagefright/foundation/AMessage.h>
 #include <media/stagefright/foundation/ABuffer.h>
@@ -52,6 +53,7 @@ enum {
     kWhatActivityNotify,
     kWhatRequestActivityNotifications,
     kWhatStopActivityNotifications,
+    kWhatAsyncNotify,
 };
 
 
@@ -74,6 +76,11 @@ struct AMediaCodec {
     bool mRequestedActivityNotification;
     OnCodecEvent mCallback;
     void *mCallbackUserData;
+
+    // set for the codec to run in async mode, MediaCodec then posts its
+    // buffer events to kWhatAsyncNotify instead of being polled
+    AMediaCodecOnAsyncNotifyCallback mAsyncCallback;
+    void *mAsyncCallbackUserData;
 };
 
 CodecHandler::CodecHandler(AMediaCodec *codec) {
@@ -127,6 +134,94 @@ void CodecHandler::onMessageReceived(const sp<AMessage> &msg) {
             break;
         }
 
+        case kWhatAsyncNotify:
+        {
+            int32_t cbID;
+            CHECK(msg->findInt32("callbackID", &cbID));
+
+            switch (cbID) {
+                case MediaCodec::CB_INPUT_AVAILABLE:
+                {
+                    int32_t index;
+                    CHECK(msg->findInt32("index", &index));
+
+                    if (mCodec->mAsyncCallback.onAsyncInputAvailable != NULL) {
+                        mCodec->mAsyncCallback.onAsyncInputAvailable(
+                                mCodec, mCodec->mAsyncCallbackUserData, index);
+                    }
+                    break;
+                }
+
+                case MediaCodec::CB_OUTPUT_AVAILABLE:
+                {
+                    int32_t index;
+                    size_t offset;
+                    size_t size;
+                    int64_t timeUs;
+                    int32_t flags;
+                    CHECK(msg->findInt32("index", &index));
+                    CHECK(msg->findSize("offset", &offset));
+                    CHECK(msg->findSize("size", &size));
+                    CHECK(msg->findInt64("timeUs", &timeUs));
+                    CHECK(msg->findInt32("flags", &flags));
+
+                    AMediaCodecBufferInfo bufferInfo = {
+                        (int32_t)offset,
+                        (int32_t)size,
+                        timeUs,
+                        (uint32_t)flags};
+
+                    if (mCodec->mAsyncCallback.onAsyncOutputAvailable != NULL) {
+                        mCodec->mAsyncCallback.onAsyncOutputAvailable(
+                                mCodec, mCodec->mAsyncCallbackUserData, index, &bufferInfo);
+                    }
+                    break;
+                }
+
+                case MediaCodec::CB_OUTPUT_FORMAT_CHANGED:
+                {
+                    sp<AMessage> format;
+                    CHECK(msg->findMessage("format", &format));
+
+                    if (mCodec->mAsyncCallback.onAsyncFormatChanged != NULL) {
+                        // MediaCodec keeps changing its own copy
+                        sp<AMessage> copy = format->dup();
+                        AMediaFormat *aMediaFormat = AMediaFormat_fromMsg(&copy);
+                        mCodec->mAsyncCallback.onAsyncFormatChanged(
+                                mCodec, mCodec->mAsyncCallbackUserData, aMediaFormat);
+                        AMediaFormat_delete(aMediaFormat);
+                    }
+                    break;
+                }
+
+                case MediaCodec::CB_ERROR:
+                {
+                    int32_t err;
+                    int32_t actionCode;
+                    AString detail;
+                    CHECK(msg->findInt32("err", &err));
+                    CHECK(msg->findInt32("actionCode", &actionCode));
+                    msg->findString("detail", &detail);
+                    ALOGE("Codec reported error(0x%x), actionCode(%d), detail(%s)",
+                          err, actionCode, detail.c_str());
+
+                    if (mCodec->mAsyncCallback.onAsyncError != NULL) {
+                        mCodec->mAsyncCallback.onAsyncError(
+                                mCodec, mCodec->mAsyncCallbackUserData,
+                                translate_error(err), actionCode, detail.c_str());
+                    }
+                    break;
+                }
+
+                default:
+                {
+                    ALOGE("kWhatAsyncNotify: callbackID(%d) is unexpected.", cbID);
+                    break;
+                }
+            }
+            break;
+        }
+
         default:
             ALOGE("shouldn't be here");
             break;
@@ -139,6 +234,13 @@ static void requestActivityNotification(AMediaCodec *codec) {
     (new AMessage(kWhatRequestActivityNotifications, codec->mHandler->id()))->post();
 }
 
+static bool isAsync(AMediaCodec *codec) {
+    return codec->mAsyncCallback.onAsyncInputAvailable != NULL
+            || codec->mAsyncCallback.onAsyncOutputAvailable != NULL
+            || codec->mAsyncCallback.onAsyncFormatChanged != NULL
+            || codec->mAsyncCallback.onAsyncError != NULL;
+}
+
 extern "C" {
 
 static AMediaCodec * createAMediaCodec(const char *name, bool name_is_type, bool encoder) {
@@ -160,6 +262,9 @@ static AMediaCodec * createAMediaCodec(const char *name, bool name_is_type, bool
     mData->mRequestedActivityNotification = false;
     mData->mCallback = NULL;
 
+    memset(&mData->mAsyncCallback, 0, sizeof(mData->mAsyncCallback));
+    mData->mAsyncCallbackUserData = NULL;
+
     return mData;
 }
 
@@ -219,6 +324,10 @@ media_status_t AMediaCodec_start(AMediaCodec *mData) {
     if (ret != OK) {
         return translate_error(ret);
     }
+    if (isAsync(mData)) {
+        // the buffers come to the callback, there is nothing to poll
+        return AMEDIA_OK;
+    }
     mData->mActivityNotification = new AMessage(kWhatActivityNotify, mData->mHandler->id());
     mData->mActivityNotification->setInt32("generation", mData->mGeneration);
     requestActivityNotification(mData);
@@ -335,6 +444,15 @@ AMediaFormat* AMediaCodec_getOutputFormat(AMediaCodec *mData) {
     return AMediaFormat_fromMsg(&format);
 }
 
+EXPORT
+AMediaFormat* AMediaCodec_getMetrics(AMediaCodec *mData) {
+    sp<AMessage> metrics;
+    if (mData->mCodec->getMetrics(&metrics) != OK) {
+        return NULL;
+    }
+    return AMediaFormat_fromMsg(&metrics);
+}
+
 EXPORT
 media_status_t AMediaCodec_releaseOutputBuffer(AMediaCodec *mData, size_t idx, bool render) {
     if (render) {
@@ -351,6 +469,26 @@ media_status_t AMediaCodec_releaseOutputBufferAtTime(
     return translate_error(mData->mCodec->renderOutputBufferAndRelease(idx, timestampNs));
 }
 
+EXPORT
+media_status_t AMediaCodec_setAsyncNotifyCallback(
+        AMediaCodec *mData,
+        AMediaCodecOnAsyncNotifyCallback callback,
+        void *userdata) {
+    mData->mAsyncCallback = callback;
+    mData->mAsyncCallbackUserData = userdata;
+
+    sp<AMessage> asyncNotify = NULL;
+    if (isAsync(mData)) {
+        asyncNotify = new AMessage(kWhatAsyncNotify, mData->mHandler->id());
+    }
+    status_t err = mData->mCodec->setCallback(asyncNotify);
+    if (err != OK) {
+        memset(&mData->mAsyncCallback, 0, sizeof(mData->mAsyncCallback));
+        mData->mAsyncCallbackUserData = NULL;
+    }
+    return translate_error(err);
+}
+
 //EXPORT
 media_status_t AMediaCodec_setNotificationCallback(AMediaCodec *mData, OnCodecEvent callback, void *userdata) {
     mData->mCallback = callback;
@@ -74,7 +74,7 @@ LOCAL_32_BIT_ONLY := true
 
 LOCAL_SRC_FILES += FastMixer.cpp FastMixerState.cpp AudioWatchdog.cpp
 LOCAL_SRC_FILES += FastThread.cpp FastThreadState.cpp
-LOCAL_SRC_FILES += FastCapture.cpp FastCaptureState.cpp
+LOCAL_SRC_FILES += FastCapture.cpp FastCaptureState.cpp EchoReference.cpp
 
 LOCAL_CFLAGS += -DSTATE_QUEUE_INSTANTIATIONS='"StateQueueInstantiations.cpp"'
 
@@ -123,7 +123,8 @@ LOCAL_SRC_FILES:= \
     AudioResampler.cpp.arm \
     AudioResamplerCubic.cpp.arm \
     AudioResamplerSinc.cpp.arm \
-    AudioResamplerDyn.cpp.arm
+    AudioResamplerDyn.cpp.arm \
+    AudioResamplerHalfBand.cpp.arm
 
 LOCAL_C_INCLUDES := \
     $(call include-path-for, audio-utils)
@@ -22,6 +22,7 @@
 
 #include "Configuration.h"
 #include <dirent.h>
+#include <inttypes.h>
 #include <math.h>
 #include <signal.h>
 #include <sys/time.h>
@@ -29,6 +30,7 @@
 
 #include <binder/IPCThreadState.h>
 #include <binder/IServiceManager.h>
+#include <binder/MemoryBase.h>
 #include <utils/Log.h>
 #include <utils/Trace.h>
 #include <binder/Parcel.h>
@@ -175,6 +177,7 @@ AudioFlinger::AudioFlinger()
       mMasterVolume(1.0f),
       mMasterMute(false),
       mNextUniqueId(1),
+      mEchoReferenceGen(0),
       mMode(AUDIO_MODE_INVALID),
       mBtNrecIsOff(false),
       mIsLowRamDevice(true),
@@ -1331,11 +1334,15 @@ size_t AudioFlinger::getInputBufferSize(uint32_t sampleRate, audio_format_t form
     memset(&config, 0, sizeof(config));
     config.sample_rate = sampleRate;
     config.channel_mask = channelMask;
-    config.format = format;
+    // float capture is converted by RecordThread, so size it as the 16-bit equivalent
+    config.format = format == AUDIO_FORMAT_PCM_FLOAT ? AUDIO_FORMAT_PCM_16_BIT : format;
 
     audio_hw_device_t *dev = mPrimaryHardwareDev->hwDevice();
     size_t size = dev->get_input_buffer_size(dev, &config);
     mHardwareStatus = AUDIO_HW_IDLE;
+    if (format == AUDIO_FORMAT_PCM_FLOAT) {
+        size = size / sizeof(int16_t) * sizeof(float);
+    }
     return size;
 }
 
@@ -1642,8 +1649,8 @@ sp<IAudioRecord> AudioFlinger::openRecord(
         goto Exit;
     }
 
-    // we don't yet support anything other than 16-bit PCM and compress formats
-    if (format != AUDIO_FORMAT_PCM_16_BIT &&
+    // we don't yet support anything other than 16-bit PCM, float and compress formats
+    if (format != AUDIO_FORMAT_PCM_16_BIT && format != AUDIO_FORMAT_PCM_FLOAT &&
             !audio_is_compress_voip_format(format) &&
             !audio_is_compress_capture_format(format)) {
         ALOGE("openRecord() invalid format %#x", format);
@@ -1878,6 +1885,103 @@ audio_hw_sync_t AudioFlinger::getAudioHwSyncForSession(audio_session_t sessionId
     return AUDIO_HW_SYNC_INVALID;
 }
 
+status_t AudioFlinger::setTrackParameters(const Vector<TrackParameter>& parameters)
+{
+    if (parameters.size() > kMaxTrackParameters) {
+        return BAD_VALUE;
+    }
+    // Resolve and check all the updates before applying any.  AudioFlinger::mLock is not needed:
+    // a track handle keeps its track alive, and the track knows its thread.
+    Vector< sp<PlaybackThread::Track> > tracks;
+    Vector< sp<ThreadBase> > threads;
+    tracks.setCapacity(parameters.size());
+    for (size_t i = 0; i < parameters.size(); i++) {
+        const TrackParameter& parameter = parameters[i];
+        // the only local IAudioTrack implementation is TrackHandle
+        if (parameter.mTrack == 0 || parameter.mTrack->asBinder()->localBinder() == NULL) {
+            return BAD_VALUE;
+        }
+        const sp<PlaybackThread::Track>& track =
+                static_cast<TrackHandle *>(parameter.mTrack.get())->track();
+        status_t status = track->checkParameter(parameter.mKey, parameter.mValue);
+        if (status != NO_ERROR) {
+            return status;
+        }
+        sp<ThreadBase> thread = track->thread().promote();
+        if (thread == 0) {
+            return DEAD_OBJECT;
+        }
+        tracks.add(track);
+        size_t j = 0;
+        while (j < threads.size() && threads[j] != thread) {
+            j++;
+        }
+        if (j == threads.size()) {
+            threads.add(thread);
+        }
+    }
+
+    // one lock per thread, so that the next mix cycle of each thread sees all its updates
+    for (size_t j = 0; j < threads.size(); j++) {
+        Mutex::Autolock _l(threads[j]->mLock);
+        for (size_t i = 0; i < tracks.size(); i++) {
+            if (tracks[i]->thread() == threads[j]) {
+                tracks[i]->setParameter_l(parameters[i].mKey, parameters[i].mValue);
+            }
+        }
+    }
+    return NO_ERROR;
+}
+
+sp<IMemory> AudioFlinger::shareStaticBuffer(const sp<IMemory>& buffer)
+{
+    if (buffer == 0 || buffer->pointer() == NULL || buffer->size() == 0 ||
+            buffer->size() > kMaxSharedStaticBufferSize) {
+        return 0;
+    }
+
+    // The copy is hashed and compared, not the client's buffer, which the client can still
+    // write to: what is shared is always the content it is found by.
+    size_t size = buffer->size();
+    sp<MemoryHeapBase> heap = new MemoryHeapBase(size, MemoryHeapBase::READ_ONLY,
+            "AudioFlinger::StaticBuffer");
+    if (heap->getHeapID() < 0) {
+        return 0;
+    }
+    const uint8_t *data = (const uint8_t *)heap->getBase();
+    memcpy(heap->getBase(), buffer->pointer(), size);
+
+    // 64 bit FNV-1a, content collisions are told apart by the comparison below
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= data[i];
+        hash *= 1099511628211ULL;
+    }
+
+    Mutex::Autolock _l(mStaticBuffersLock);
+    for (size_t i = mStaticBuffers.size(); i > 0; i--) {
+        if (mStaticBuffers.valueAt(i - 1).promote() == 0) {
+            mStaticBuffers.removeItemsAt(i - 1);
+        }
+    }
+    ssize_t index = mStaticBuffers.indexOfKey(hash);
+    if (index >= 0) {
+        sp<IMemory> shared = mStaticBuffers.valueAt(index).promote();
+        if (shared != 0 && shared->size() == size && memcmp(shared->pointer(), data, size) == 0) {
+            ALOGV("shareStaticBuffer() %zu bytes shared, hash %#" PRIx64, size, hash);
+            return shared;
+        }
+    }
+
+    sp<IMemory> shared = new MemoryBase(heap, 0, size);
+    // on a collision, the first buffer keeps the entry and this one is not shared
+    if (index < 0) {
+        mStaticBuffers.add(hash, shared);
+    }
+    ALOGV("shareStaticBuffer() %zu bytes copied, hash %#" PRIx64, size, hash);
+    return shared;
+}
+
 // ----------------------------------------------------------------------------
 
 
@@ -2247,9 +2351,12 @@ sp<AudioFlinger::RecordThread> AudioFlinger::openInput_l(audio_module_handle_t m
 
     // If the input could not be opened with the requested parameters and we can handle the
     // conversion internally, try to open again with the proposed parameters. The AudioFlinger can
-    // resample the input and do mono to stereo or stereo to mono conversions on 16 bit PCM inputs.
+    // resample the input and do mono to stereo or stereo to mono conversions on 16 bit PCM inputs,
+    // and deliver float from any linear PCM input but 8 bit.
     if (status == BAD_VALUE &&
-            config->format == halconfig.format && halconfig.format == AUDIO_FORMAT_PCM_16_BIT &&
+            ((config->format == halconfig.format && halconfig.format == AUDIO_FORMAT_PCM_16_BIT) ||
+             (config->format == AUDIO_FORMAT_PCM_FLOAT && audio_is_linear_pcm(halconfig.format) &&
+                     halconfig.format != AUDIO_FORMAT_PCM_8_BIT)) &&
         (halconfig.sample_rate <= 2 * config->sample_rate) &&
         (audio_channel_count_from_in_mask(halconfig.channel_mask) <= FCC_2) &&
         (audio_channel_count_from_in_mask(config->channel_mask) <= FCC_2)) {
@@ -2600,6 +2707,37 @@ audio_devices_t AudioFlinger::primaryOutputDevice_l() const
     return thread->outDevice();
 }
 
+void AudioFlinger::setEchoReference(const sp<EchoReference>& reference)
+{
+    Mutex::Autolock _l(mEchoReferenceLock);
+    if (reference != mEchoReference) {
+        ALOGW_IF(mEchoReference != 0 && reference != 0,
+                "setEchoReference() replaces the reference of another capture");
+        mEchoReference = reference;
+        android_atomic_inc(&mEchoReferenceGen);
+    }
+}
+
+void AudioFlinger::clearEchoReference(const sp<EchoReference>& reference)
+{
+    Mutex::Autolock _l(mEchoReferenceLock);
+    if (reference == mEchoReference) {
+        mEchoReference.clear();
+        android_atomic_inc(&mEchoReferenceGen);
+    }
+}
+
+bool AudioFlinger::echoReferenceChanged(int32_t *gen, sp<EchoReference> *reference)
+{
+    if (android_atomic_acquire_load(&mEchoReferenceGen) == *gen) {
+        return false;
+    }
+    Mutex::Autolock _l(mEchoReferenceLock);
+    *gen = mEchoReferenceGen;
+    *reference = mEchoReference;
+    return true;
+}
+
 sp<AudioFlinger::SyncEvent> AudioFlinger::createSyncEvent(AudioSystem::sync_event_t type,
                                     int triggerSession,
                                     int listenerSession,
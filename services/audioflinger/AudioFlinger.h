@@ -272,6 +272,10 @@ public:
     /* Get the HW synchronization source used for an audio session */
     virtual audio_hw_sync_t getAudioHwSyncForSession(audio_session_t sessionId);
 
+    virtual status_t setTrackParameters(const Vector<TrackParameter>& parameters);
+
+    virtual sp<IMemory> shareStaticBuffer(const sp<IMemory>& buffer);
+
     virtual     status_t    onTransact(
                                 uint32_t code,
                                 const Parcel& data,
@@ -291,12 +295,18 @@ public:
     sp<NBLog::Writer>   newWriter_l(size_t size, const char *name);
     void                unregisterWriter(const sp<NBLog::Writer>& writer);
 private:
-    static const size_t kLogMemorySize = 40 * 1024;
+    // each writer also needs NBLog::Timeline::sharedSize() overhead for its format strings
+    static const size_t kLogMemorySize = 48 * 1024;
     sp<MemoryDealer>    mLogMemoryDealer;   // == 0 when NBLog is disabled
     // When a log writer is unregistered, it is done lazily so that media.log can continue to see it
     // for as long as possible.  The memory is only freed when it is needed for another log writer.
     Vector< sp<NBLog::Writer> > mUnregisteredWriters;
     Mutex               mUnregisteredWritersLock;
+
+    // The buffers of shareStaticBuffer(), by hash of their content.  Only weak references are
+    // held: a buffer goes away with the last client or track that holds it.
+    KeyedVector< uint64_t, wp<IMemory> > mStaticBuffers;
+    Mutex               mStaticBuffersLock;
 public:
 
     class SyncEvent;
@@ -473,6 +483,7 @@ private:
     class OffloadThread;
     class DuplicatingThread;
     class AsyncCallbackThread;
+    class EffectsThread;
     class Track;
     class RecordTrack;
     class EffectModule;
@@ -526,6 +537,8 @@ private:
         virtual status_t onTransact(
             uint32_t code, const Parcel& data, Parcel* reply, uint32_t flags);
 
+                const sp<PlaybackThread::Track>& track() const { return mTrack; }
+
     private:
         const sp<PlaybackThread::Track> mTrack;
     };
@@ -705,6 +718,16 @@ private:
               PlaybackThread *primaryPlaybackThread_l() const;
               audio_devices_t primaryOutputDevice_l() const;
 
+              // Playback reference for echo cancellation hosted by a fast capture thread, set
+              // by the RecordThread and written by the primary output thread.  Only take
+              // mEchoReferenceLock, so they can be called from thread loops with any lock held.
+              void setEchoReference(const sp<EchoReference>& reference);
+              // clears the reference if it is still 'reference'
+              void clearEchoReference(const sp<EchoReference>& reference);
+              // returns true and the current reference if it changed since '*gen', which is
+              // then updated; otherwise only an atomic load
+              bool echoReferenceChanged(int32_t *gen, sp<EchoReference> *reference);
+
               sp<PlaybackThread> getEffectThread_l(int sessionId, int EffectId);
 
 
@@ -875,6 +898,11 @@ private:
                 DefaultKeyedVector< pid_t, sp<NotificationClient> >    mNotificationClients;
 
                 volatile int32_t                    mNextUniqueId;  // updated by android_atomic_inc
+
+                // see setEchoReference(), mEchoReferenceLock is taken last and alone
+                Mutex                               mEchoReferenceLock;
+                sp<EchoReference>                   mEchoReference;
+                volatile int32_t                    mEchoReferenceGen;  // incremented on change
                 // nextUniqueId() returns uint32_t, but this is declared int32_t
                 // because the atomic operations require an int32_t
 
@@ -28,8 +28,10 @@
 #include <utils/Errors.h>
 #include <utils/Log.h>
 
+#include <cutils/atomic.h>
 #include <cutils/bitops.h>
 #include <cutils/compiler.h>
+#include <cutils/properties.h>
 #include <utils/Debug.h>
 
 #include <system/audio.h>
@@ -43,6 +45,7 @@
 #include <audio_effects/effect_downmix.h>
 
 #include "AudioMixerOps.h"
+#include "AudioMixerOpsSimd.h"
 #include "AudioMixer.h"
 
 // The FCC_2 macro refers to the Fixed Channel Count of 2 for the legacy integer mixer.
@@ -373,6 +376,137 @@ void AudioMixer::ReformatBufferProvider::copyFrames(void *dst, const void *src,
     memcpy_by_audio_format(dst, mOutputFormat, src, mInputFormat, frames * mChannels);
 }
 
+// Fold coefficients are those of the downmix effect (see EffectDownmix.c):
+// each output channel is half the sum of its side of the input, and center and LFE
+// are attenuated by a further 3dB and sent to both sides.
+static const float kFoldGain = 0.5f;
+static const float kFoldCenterGain = 0.5f * M_SQRT1_2;
+
+static const uint32_t kFoldQuadSide = AUDIO_CHANNEL_OUT_FRONT_LEFT
+        | AUDIO_CHANNEL_OUT_FRONT_RIGHT | AUDIO_CHANNEL_OUT_SIDE_LEFT
+        | AUDIO_CHANNEL_OUT_SIDE_RIGHT;
+static const uint32_t kFold5Point1Side = AUDIO_CHANNEL_OUT_FRONT_LEFT
+        | AUDIO_CHANNEL_OUT_FRONT_RIGHT | AUDIO_CHANNEL_OUT_FRONT_CENTER
+        | AUDIO_CHANNEL_OUT_LOW_FREQUENCY | AUDIO_CHANNEL_OUT_SIDE_LEFT
+        | AUDIO_CHANNEL_OUT_SIDE_RIGHT;
+
+// Folds frames of channelBits layout to stereo float; src in position order.
+template <typename TI>
+static void foldToStereo(float *dst, const TI *src, size_t frames, uint32_t channelBits)
+{
+    switch (channelBits) {
+    case AUDIO_CHANNEL_OUT_QUAD:
+    case kFoldQuadSide:
+        // FL FR BL BR, or FL FR SL SR
+        for (; frames > 0; --frames, src += 4, dst += 2) {
+            dst[0] = MixMul<float, TI, float>(src[0], kFoldGain)
+                    + MixMul<float, TI, float>(src[2], kFoldGain);
+            dst[1] = MixMul<float, TI, float>(src[1], kFoldGain)
+                    + MixMul<float, TI, float>(src[3], kFoldGain);
+        }
+        break;
+    case AUDIO_CHANNEL_OUT_5POINT1:
+    case kFold5Point1Side:
+        // FL FR FC LFE BL BR, or FL FR FC LFE SL SR
+        for (; frames > 0; --frames, src += 6, dst += 2) {
+            const float center = MixMul<float, TI, float>(src[2], kFoldCenterGain)
+                    + MixMul<float, TI, float>(src[3], kFoldCenterGain);
+            dst[0] = MixMul<float, TI, float>(src[0], kFoldGain) + center
+                    + MixMul<float, TI, float>(src[4], kFoldGain);
+            dst[1] = MixMul<float, TI, float>(src[1], kFoldGain) + center
+                    + MixMul<float, TI, float>(src[5], kFoldGain);
+        }
+        break;
+    case AUDIO_CHANNEL_OUT_7POINT1:
+        // FL FR FC LFE BL BR SL SR
+        for (; frames > 0; --frames, src += 8, dst += 2) {
+            const float center = MixMul<float, TI, float>(src[2], kFoldCenterGain)
+                    + MixMul<float, TI, float>(src[3], kFoldCenterGain);
+            dst[0] = MixMul<float, TI, float>(src[0], kFoldGain) + center
+                    + MixMul<float, TI, float>(src[4], kFoldGain)
+                    + MixMul<float, TI, float>(src[6], kFoldGain);
+            dst[1] = MixMul<float, TI, float>(src[1], kFoldGain) + center
+                    + MixMul<float, TI, float>(src[5], kFoldGain)
+                    + MixMul<float, TI, float>(src[7], kFoldGain);
+        }
+        break;
+    default:
+        LOG_ALWAYS_FATAL("foldToStereo invalid channel bits %#x", channelBits);
+    }
+}
+
+AudioMixer::DownmixReformatBufferProvider::DownmixReformatBufferProvider(
+        audio_channel_mask_t inputChannelMask, audio_format_t inputFormat,
+        audio_format_t outputFormat, size_t bufferFrameCount) :
+        CopyBufferProvider(
+                audio_bytes_per_sample(inputFormat)
+                    * audio_channel_count_from_out_mask(inputChannelMask),
+                audio_bytes_per_sample(outputFormat) * FCC_2,
+                bufferFrameCount),
+        mInputChannelBits(audio_channel_mask_get_bits(inputChannelMask)),
+        mInputChannels(audio_channel_count_from_out_mask(inputChannelMask)),
+        mInputFormat(inputFormat)
+{
+    ALOGV("DownmixReformatBufferProvider(%p)(%#x, %#x, %#x)",
+            this, inputChannelMask, inputFormat, outputFormat);
+    LOG_ALWAYS_FATAL_IF(outputFormat != AUDIO_FORMAT_PCM_FLOAT,
+            "DownmixReformatBufferProvider output format %#x is not float", outputFormat);
+}
+
+void AudioMixer::DownmixReformatBufferProvider::copyFrames(void *dst, const void *src,
+        size_t frames)
+{
+    switch (mInputFormat) {
+    case AUDIO_FORMAT_PCM_16_BIT:
+        foldToStereo((float *)dst, (const int16_t *)src, frames, mInputChannelBits);
+        break;
+    case AUDIO_FORMAT_PCM_FLOAT:
+        foldToStereo((float *)dst, (const float *)src, frames, mInputChannelBits);
+        break;
+    default: {
+        // less common formats are widened to float on the stack a block at a time.
+        static const size_t kBlockFrames = 32;
+        float block[kBlockFrames * MAX_NUM_CHANNELS_TO_DOWNMIX];
+        const size_t inputFrameSize = mInputFrameSize;
+        while (frames > 0) {
+            const size_t count = min(frames, kBlockFrames);
+            memcpy_by_audio_format(block, AUDIO_FORMAT_PCM_FLOAT, src, mInputFormat,
+                    count * mInputChannels);
+            foldToStereo((float *)dst, block, count, mInputChannelBits);
+            src = (const uint8_t *)src + count * inputFrameSize;
+            dst = (float *)dst + count * FCC_2;
+            frames -= count;
+        }
+        } break;
+    }
+}
+
+/*static*/ bool AudioMixer::DownmixReformatBufferProvider::isSupported(
+        audio_channel_mask_t inputChannelMask, audio_channel_mask_t outputChannelMask,
+        audio_format_t inputFormat, audio_format_t outputFormat)
+{
+    if (outputFormat != AUDIO_FORMAT_PCM_FLOAT
+            || !audio_is_linear_pcm(inputFormat)
+            || inputFormat == AUDIO_FORMAT_PCM_8_BIT // expanded to 16 bit by AudioTrack
+            || audio_channel_mask_get_representation(inputChannelMask)
+                    != AUDIO_CHANNEL_REPRESENTATION_POSITION
+            || audio_channel_mask_get_representation(outputChannelMask)
+                    != AUDIO_CHANNEL_REPRESENTATION_POSITION
+            || audio_channel_mask_get_bits(outputChannelMask) != AUDIO_CHANNEL_OUT_STEREO) {
+        return false;
+    }
+    switch (audio_channel_mask_get_bits(inputChannelMask)) {
+    case AUDIO_CHANNEL_OUT_QUAD:
+    case kFoldQuadSide:
+    case AUDIO_CHANNEL_OUT_5POINT1:
+    case kFold5Point1Side:
+    case AUDIO_CHANNEL_OUT_7POINT1:
+        return true;
+    default:
+        return false;
+    }
+}
+
 // ----------------------------------------------------------------------------
 
 // Ensure mConfiguredNames bitmask is initialized properly on all architectures.
@@ -397,7 +531,8 @@ AudioMixer::AudioMixer(size_t frameCount, uint32_t sampleRate, uint32_t maxNumTr
     mState.outputTemp   = NULL;
     mState.resampleTemp = NULL;
     mState.mLog         = &mDummyLog;
-    // mState.reserved
+    mState.workers      = NULL;
+    mState.cost         = NULL;
 
     // FIXME Most of the following initialization is probably redundant since
     // tracks[i] should only be referenced if (mTrackNames & (1 << i)) != 0
@@ -423,6 +558,8 @@ AudioMixer::~AudioMixer()
     }
     delete [] mState.outputTemp;
     delete [] mState.resampleTemp;
+    delete mState.workers;
+    delete mState.cost;
 }
 
 void AudioMixer::setLog(NBLog::Writer *log)
@@ -430,6 +567,50 @@ void AudioMixer::setLog(NBLog::Writer *log)
     mState.mLog = log;
 }
 
+void AudioMixer::setWorkerCount(uint32_t count)
+{
+    delete mState.workers;
+    mState.workers = NULL;
+    if (count > MAX_NUM_WORKERS) {
+        count = MAX_NUM_WORKERS;
+    }
+    if (count > 0) {
+        mState.workers = new WorkerPool(count, mState.frameCount, mSampleRate);
+    }
+}
+
+void AudioMixer::setCostAccounting(bool enable)
+{
+    if (!enable) {
+        delete mState.cost;
+        mState.cost = NULL;
+    } else if (mState.cost == NULL) {
+        mState.cost = new CostAccounting();
+    }
+}
+
+bool AudioMixer::getTrackCost(int name, CentralTendencyStatistics* stats) const
+{
+    name -= TRACK0;
+    ALOG_ASSERT(uint32_t(name) < MAX_NUM_TRACKS, "bad track name %d", name);
+    const CostAccounting* cost = mState.cost;
+    if (cost == NULL) {
+        return false;
+    }
+    *stats = cost->mStats[name];
+    return true;
+}
+
+bool AudioMixer::getOverheadCost(CentralTendencyStatistics* stats) const
+{
+    const CostAccounting* cost = mState.cost;
+    if (cost == NULL) {
+        return false;
+    }
+    *stats = cost->mOverhead;
+    return true;
+}
+
 int AudioMixer::getTrackName(audio_channel_mask_t channelMask,
         audio_format_t format, int sessionId)
 {
@@ -492,6 +673,7 @@ int AudioMixer::getTrackName(audio_channel_mask_t channelMask,
         t->mInputBufferProvider = NULL;
         t->mReformatBufferProvider = NULL;
         t->downmixerBufferProvider = NULL;
+        t->mDownmixerReformats = false;
         t->mMixerFormat = AUDIO_FORMAT_PCM_16_BIT;
         t->mFormat = format;
         t->mMixerInFormat = kUseFloat && kUseNewMixer
@@ -507,9 +689,12 @@ int AudioMixer::getTrackName(audio_channel_mask_t channelMask,
         }
         // initTrackDownmix() may change the input format requirement.
         // If you desire floating point input to the mixer, it may change
-        // to integer because the downmixer requires integer to process.
+        // to integer if the downmixer effect only processes integer.
         ALOGVV("mMixerFormat:%#x  mMixerInFormat:%#x\n", t->mMixerFormat, t->mMixerInFormat);
         prepareTrackForReformat(t, n);
+        if (mState.cost != NULL) {
+            mState.cost->reset(n);
+        }
         mTrackNames |= 1 << n;
         return TRACK0 + n;
     }
@@ -559,10 +744,10 @@ bool AudioMixer::setChannelMasks(int name,
             "initTrackDownmix error %d, track channel mask %#x, mixer channel mask %#x",
             status, track.channelMask, track.mMixerChannelMask);
 
+    // because of downmixer, mixer input format may change, and the reformatter
+    // channel count follows the track channel mask, so always reconsider it.
     const bool mixerInFormatChanged = prevMixerInFormat != track.mMixerInFormat;
-    if (mixerInFormatChanged) {
-        prepareTrackForReformat(&track, name); // because of downmixer, track format may change!
-    }
+    prepareTrackForReformat(&track, name);
 
     if (track.resampler && (mixerInFormatChanged || mixerChannelCountChanged)) {
         // resampler input format or channels may have changed.
@@ -598,6 +783,7 @@ void AudioMixer::unprepareTrackForDownmix(track_t* pTrack, int trackName __unuse
         ALOGV(" deleting old downmixer");
         delete pTrack->downmixerBufferProvider;
         pTrack->downmixerBufferProvider = NULL;
+        pTrack->mDownmixerReformats = false;
         reconfigureBufferProviders(pTrack);
     } else {
         ALOGV(" nothing to do, no downmixer to delete");
@@ -610,14 +796,36 @@ status_t AudioMixer::prepareTrackForDownmix(track_t* pTrack, int trackName)
 
     // discard the previous downmixer if there was one
     unprepareTrackForDownmix(pTrack, trackName);
+
+    // Fold standard layouts to stereo and convert to the mixer input format in one pass,
+    // which keeps the track in float and skips the reformatter.
+    if (DownmixReformatBufferProvider::isSupported(pTrack->channelMask,
+            pTrack->mMixerChannelMask, pTrack->mFormat, pTrack->mMixerInFormat)) {
+        pTrack->downmixerBufferProvider = new DownmixReformatBufferProvider(
+                pTrack->channelMask, pTrack->mFormat, pTrack->mMixerInFormat,
+                kCopyBufferFrameCount);
+        pTrack->mDownmixerReformats = true;
+        reconfigureBufferProviders(pTrack);
+        return NO_ERROR;
+    }
+
     if (DownmixerBufferProvider::isMultichannelCapable()) {
+        // The framework downmixer mixes float directly, a downmixer that does not accept
+        // the mixer input format is retried in PCM 16 bit.
         DownmixerBufferProvider* pDbp = new DownmixerBufferProvider(pTrack->channelMask,
-                pTrack->mMixerChannelMask,
-                AUDIO_FORMAT_PCM_16_BIT /* TODO: use pTrack->mMixerInFormat, now only PCM 16 */,
+                pTrack->mMixerChannelMask, pTrack->mMixerInFormat,
                 pTrack->sampleRate, pTrack->sessionId, kCopyBufferFrameCount);
+        if (!pDbp->isValid() && pTrack->mMixerInFormat != AUDIO_FORMAT_PCM_16_BIT) {
+            delete pDbp;
+            pDbp = new DownmixerBufferProvider(pTrack->channelMask,
+                    pTrack->mMixerChannelMask, AUDIO_FORMAT_PCM_16_BIT,
+                    pTrack->sampleRate, pTrack->sessionId, kCopyBufferFrameCount);
+            if (pDbp->isValid()) {
+                pTrack->mMixerInFormat = AUDIO_FORMAT_PCM_16_BIT;
+            }
+        }
 
         if (pDbp->isValid()) { // if constructor completed properly
-            pTrack->mMixerInFormat = AUDIO_FORMAT_PCM_16_BIT; // PCM 16 bit required for downmix
             pTrack->downmixerBufferProvider = pDbp;
             reconfigureBufferProviders(pTrack);
             return NO_ERROR;
@@ -648,8 +856,9 @@ status_t AudioMixer::prepareTrackForReformat(track_t* pTrack, int trackName)
     ALOGV("AudioMixer::prepareTrackForReformat(%d) with format %#x", trackName, pTrack->mFormat);
     // discard the previous reformatter if there was one
     unprepareTrackForReformat(pTrack, trackName);
-    // only configure reformatter if needed
-    if (pTrack->mFormat != pTrack->mMixerInFormat) {
+    // only configure reformatter if needed, a DownmixReformatBufferProvider reads the
+    // track format directly.
+    if (pTrack->mFormat != pTrack->mMixerInFormat && !pTrack->mDownmixerReformats) {
         pTrack->mReformatBufferProvider = new ReformatBufferProvider(
                 audio_channel_count_from_out_mask(pTrack->channelMask),
                 pTrack->mFormat, pTrack->mMixerInFormat,
@@ -828,6 +1037,15 @@ void AudioMixer::setParameter(int name, int target, int param, void *value)
                 ALOG_ASSERT(audio_is_linear_pcm(format), "Invalid format %#x", format);
                 track.mFormat = format;
                 ALOGV("setParameter(TRACK, FORMAT, %#x)", format);
+                if (track.mDownmixerReformats) {
+                    // the downmixer converts from the track format, rebuild it.
+                    // It accepts every format that reaches the mixer, so the mixer
+                    // input format is not changed.
+                    ALOG_ASSERT(DownmixReformatBufferProvider::isSupported(track.channelMask,
+                            track.mMixerChannelMask, format, track.mMixerInFormat),
+                            "Unsupported downmix format %#x", format);
+                    prepareTrackForDownmix(&track, name);
+                }
                 prepareTrackForReformat(&track, name);
                 invalidateState(1 << name);
             }
@@ -1046,6 +1264,12 @@ void AudioMixer::setBufferProvider(int name, AudioBufferProvider* bufferProvider
 
 void AudioMixer::process(int64_t pts)
 {
+    if (CC_UNLIKELY(mState.cost != NULL)) {
+        mState.cost->begin();
+        mState.hook(&mState, pts);
+        mState.cost->end(mState.enabledTracks);
+        return;
+    }
     mState.hook(&mState, pts);
 }
 
@@ -1567,6 +1791,9 @@ void AudioMixer::process__genericNoResampling(state_t* state, int64_t pts)
         t.bufferProvider->getNextBuffer(&t.buffer, pts);
         t.frameCount = t.buffer.frameCount;
         t.in = t.buffer.raw;
+        if (CC_UNLIKELY(state->cost != NULL)) {
+            state->cost->charge(i);
+        }
     }
 
     e0 = enabledTracks;
@@ -1591,6 +1818,9 @@ void AudioMixer::process__genericNoResampling(state_t* state, int64_t pts)
         size_t numFrames = 0;
         do {
             memset(outTemp, 0, sizeof(outTemp));
+            if (CC_UNLIKELY(state->cost != NULL)) {
+                state->cost->chargeOverhead();
+            }
             e2 = e1;
             while (e2) {
                 const int i = 31 - __builtin_clz(e2);
@@ -1635,6 +1865,9 @@ void AudioMixer::process__genericNoResampling(state_t* state, int64_t pts)
                         t.frameCount = t.buffer.frameCount;
                     }
                 }
+                if (CC_UNLIKELY(state->cost != NULL)) {
+                    state->cost->charge(i);
+                }
             }
 
             convertMixerFormat(out, t1.mMixerFormat, outTemp, t1.mMixerInFormat,
@@ -1685,46 +1918,313 @@ void AudioMixer::process__genericResampling(state_t* state, int64_t pts)
         e0 &= ~(e1);
         int32_t *out = t1.mainBuffer;
         memset(outTemp, 0, sizeof(*outTemp) * t1.mMixerChannelCount * state->frameCount);
-        while (e1) {
-            const int i = 31 - __builtin_clz(e1);
-            e1 &= ~(1<<i);
-            track_t& t = state->tracks[i];
-            int32_t *aux = NULL;
-            if (CC_UNLIKELY(t.needs & NEEDS_AUX)) {
-                aux = t.auxBuffer;
+        if (state->workers != NULL && state->workers->isEnabled()) {
+            state->workers->mix(state, e1, outTemp, t1.mMixerChannelCount,
+                    t1.mMixerInFormat, pts);
+        } else {
+            if (CC_UNLIKELY(state->cost != NULL)) {
+                state->cost->chargeOverhead();
+            }
+            while (e1) {
+                const int i = 31 - __builtin_clz(e1);
+                e1 &= ~(1<<i);
+                process__genericResamplingTrack(state, state->tracks[i],
+                        outTemp, state->resampleTemp, pts);
+                if (CC_UNLIKELY(state->cost != NULL)) {
+                    state->cost->charge(i);
+                }
             }
+        }
+        convertMixerFormat(out, t1.mMixerFormat,
+                outTemp, t1.mMixerInFormat, numFrames * t1.mMixerChannelCount);
+    }
+}
 
-            // this is a little goofy, on the resampling case we don't
-            // acquire/release the buffers because it's done by
-            // the resampler.
-            if (t.needs & NEEDS_RESAMPLE) {
-                t.resampler->setPTS(pts);
-                t.hook(&t, outTemp, numFrames, state->resampleTemp, aux);
-            } else {
+// mix one track of process__genericResampling, accumulating into outTemp
+void AudioMixer::process__genericResamplingTrack(state_t* state, track_t& t,
+        int32_t* outTemp, int32_t* resampleTemp, int64_t pts)
+{
+    const size_t numFrames = state->frameCount;
+    int32_t *aux = NULL;
+    if (CC_UNLIKELY(t.needs & NEEDS_AUX)) {
+        aux = t.auxBuffer;
+    }
+
+    // this is a little goofy, on the resampling case we don't
+    // acquire/release the buffers because it's done by
+    // the resampler.
+    if (t.needs & NEEDS_RESAMPLE) {
+        t.resampler->setPTS(pts);
+        t.hook(&t, outTemp, numFrames, resampleTemp, aux);
+    } else {
 
-                size_t outFrames = 0;
+        size_t outFrames = 0;
 
-                while (outFrames < numFrames) {
-                    t.buffer.frameCount = numFrames - outFrames;
-                    int64_t outputPTS = calculateOutputPTS(t, pts, outFrames);
-                    t.bufferProvider->getNextBuffer(&t.buffer, outputPTS);
-                    t.in = t.buffer.raw;
-                    // t.in == NULL can happen if the track was flushed just after having
-                    // been enabled for mixing.
-                    if (t.in == NULL) break;
+        while (outFrames < numFrames) {
+            t.buffer.frameCount = numFrames - outFrames;
+            int64_t outputPTS = calculateOutputPTS(t, pts, outFrames);
+            t.bufferProvider->getNextBuffer(&t.buffer, outputPTS);
+            t.in = t.buffer.raw;
+            // t.in == NULL can happen if the track was flushed just after having
+            // been enabled for mixing.
+            if (t.in == NULL) break;
 
-                    if (CC_UNLIKELY(aux != NULL)) {
-                        aux += outFrames;
-                    }
-                    t.hook(&t, outTemp + outFrames * t.mMixerChannelCount, t.buffer.frameCount,
-                            state->resampleTemp, aux);
-                    outFrames += t.buffer.frameCount;
-                    t.bufferProvider->releaseBuffer(&t.buffer);
-                }
+            if (CC_UNLIKELY(aux != NULL)) {
+                aux += outFrames;
+            }
+            t.hook(&t, outTemp + outFrames * t.mMixerChannelCount, t.buffer.frameCount,
+                    resampleTemp, aux);
+            outFrames += t.buffer.frameCount;
+            t.bufferProvider->releaseBuffer(&t.buffer);
+        }
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+AudioMixer::CostAccounting::CostAccounting()
+    : mPendingOverhead(0.)
+{
+    for (uint32_t i = 0; i < MAX_NUM_TRACKS; i++) {
+        mPending[i] = 0.;
+    }
+}
+
+void AudioMixer::CostAccounting::end(uint32_t tracks)
+{
+    double ns;
+    if (mCpuUsage.sample(ns)) {
+        if (tracks != 0 && (tracks & (tracks - 1)) == 0) {
+            mPending[31 - __builtin_clz(tracks)] += ns;
+        } else {
+            mPendingOverhead += ns;
+        }
+    }
+    while (tracks) {
+        const int i = 31 - __builtin_clz(tracks);
+        tracks &= ~(1<<i);
+        mStats[i].sample(mPending[i]);
+        mPending[i] = 0.;
+    }
+    mOverhead.sample(mPendingOverhead);
+    mPendingOverhead = 0.;
+}
+
+// ----------------------------------------------------------------------------
+
+class AudioMixer::WorkerPool::Worker : public Thread {
+public:
+    Worker(WorkerPool* pool, size_t bufferSamples)
+        : Thread(false /*canCallJava*/),
+          mPool(pool),
+          mOutTemp(new int32_t[bufferSamples]),
+          mResampleTemp(new int32_t[bufferSamples]),
+          mGeneration(0),
+          mUsed(false)
+    {
+    }
+
+    virtual ~Worker()
+    {
+        delete [] mOutTemp;
+        delete [] mResampleTemp;
+    }
+
+    virtual bool threadLoop()
+    {
+        {
+            Mutex::Autolock _l(mPool->mLock);
+            while (mGeneration == mPool->mGeneration && !exitPending()) {
+                mPool->mWorkCond.wait(mPool->mLock);
+            }
+            if (exitPending()) {
+                return false;
+            }
+            mGeneration = mPool->mGeneration;
+        }
+        ThreadCpuUsage* usage = NULL;
+        if (mPool->mState->cost != NULL) {
+            // do not charge the wakeup to the first track
+            double ns;
+            (void) mCpuUsage.sampleAndEnable(ns);
+            usage = &mCpuUsage;
+        }
+        mUsed = mPool->runJobs(mOutTemp, mResampleTemp, true /*clear*/, usage);
+        Mutex::Autolock _l(mPool->mLock);
+        if (--mPool->mPending == 0) {
+            mPool->mDoneCond.signal();
+        }
+        return true;
+    }
+
+    WorkerPool* const   mPool;
+    int32_t* const      mOutTemp;       // partial accumulator
+    int32_t* const      mResampleTemp;
+    ThreadCpuUsage      mCpuUsage;      // for cost accounting of this worker's tracks
+    uint32_t            mGeneration;    // last mix generation run by this worker
+    bool                mUsed;          // true if mOutTemp holds tracks of the current mix
+};
+
+AudioMixer::WorkerPool::WorkerPool(uint32_t numWorkers, size_t frameCount, uint32_t sampleRate)
+    : mGeneration(0),
+      mPending(0),
+      mNumWorkers(numWorkers),
+      mBufferSamples(MAX_NUM_CHANNELS * frameCount),
+      mDeadlineNs((nsecs_t)frameCount * 1000000000LL / sampleRate / kDeadlineDivisor),
+      mDeadlineMisses(0),
+      mEnabled(true),
+      mState(NULL),
+      mPts(AudioBufferProvider::kInvalidPTS),
+      mSampleCount(0),
+      mNextJob(0),
+      mNumJobs(0)
+{
+    ALOG_ASSERT(numWorkers <= MAX_NUM_WORKERS, "numWorkers %u > MAX_NUM_WORKERS", numWorkers);
+    for (uint32_t i = 0; i < mNumWorkers; i++) {
+        mWorkers[i] = new Worker(this, mBufferSamples);
+        status_t status = mWorkers[i]->run("AudioMixerWorker", ANDROID_PRIORITY_URGENT_AUDIO);
+        if (status != NO_ERROR) {
+            ALOGE("AudioMixer worker %u failed to start: %d", i, status);
+            mEnabled = false;
+        }
+    }
+    ALOGV("AudioMixer worker pool: %u workers, deadline %lld ns",
+            mNumWorkers, (long long) mDeadlineNs);
+}
+
+AudioMixer::WorkerPool::~WorkerPool()
+{
+    for (uint32_t i = 0; i < mNumWorkers; i++) {
+        mWorkers[i]->requestExit();
+    }
+    {
+        Mutex::Autolock _l(mLock);
+        mWorkCond.broadcast();
+    }
+    for (uint32_t i = 0; i < mNumWorkers; i++) {
+        mWorkers[i]->requestExitAndWait();
+    }
+}
+
+bool AudioMixer::WorkerPool::runJobs(int32_t* outTemp, int32_t* resampleTemp, bool clear,
+        ThreadCpuUsage* usage)
+{
+    bool used = false;
+    for (;;) {
+        const int32_t job = android_atomic_inc(&mNextJob);
+        if (job >= mNumJobs) {
+            break;
+        }
+        if (clear && !used) {
+            memset(outTemp, 0, mSampleCount * sizeof(*outTemp));
+        }
+        used = true;
+        process__genericResamplingTrack(mState, mState->tracks[mJobs[job]],
+                outTemp, resampleTemp, mPts);
+        if (usage != NULL) {
+            mState->cost->charge(*usage, mJobs[job]);
+        }
+    }
+    return used;
+}
+
+void AudioMixer::WorkerPool::mix(state_t* state, uint32_t tracks, int32_t* outTemp,
+        uint32_t channelCount, audio_format_t mixerInFormat, int64_t pts)
+{
+    const nsecs_t deadline = systemTime() + mDeadlineNs;
+
+    // aux tracks stay on this thread, the others are claimed by index
+    uint32_t localTracks = 0;
+    mNumJobs = 0;
+    while (tracks) {
+        const int i = 31 - __builtin_clz(tracks);
+        tracks &= ~(1<<i);
+        if (state->tracks[i].needs & NEEDS_AUX) {
+            localTracks |= 1<<i;
+        } else {
+            mJobs[mNumJobs++] = i;
+        }
+    }
+    const bool parallel = mNumJobs > 1;
+    if (parallel) {
+        mState = state;
+        mPts = pts;
+        mSampleCount = channelCount * state->frameCount;
+        android_atomic_release_store(0, &mNextJob);
+        Mutex::Autolock _l(mLock);
+        mGeneration++;
+        mPending = mNumWorkers;
+        mWorkCond.broadcast();
+    } else {
+        for (int32_t j = 0; j < mNumJobs; j++) {
+            localTracks |= 1 << mJobs[j];
+        }
+        mNumJobs = 0;
+    }
+
+    CostAccounting* const cost = state->cost;
+    if (cost != NULL) {
+        cost->chargeOverhead();
+    }
+    while (localTracks) {
+        const int i = 31 - __builtin_clz(localTracks);
+        localTracks &= ~(1<<i);
+        process__genericResamplingTrack(state, state->tracks[i],
+                outTemp, state->resampleTemp, pts);
+        if (cost != NULL) {
+            cost->charge(i);
+        }
+    }
+    if (!parallel) {
+        return;
+    }
+    // the calling thread takes its share of the remaining tracks
+    (void) runJobs(outTemp, state->resampleTemp, false /*clear*/,
+            cost != NULL ? &cost->mCpuUsage : NULL);
+
+    // Wait for the workers. A worker cannot be interrupted in the middle of a track,
+    // so a missed deadline is only accounted, and the pool disables itself if the
+    // deadline is missed repeatedly.
+    bool late = false;
+    {
+        Mutex::Autolock _l(mLock);
+        while (mPending > 0) {
+            const nsecs_t remaining = deadline - systemTime();
+            if (remaining > 0) {
+                (void) mDoneCond.waitRelative(mLock, remaining);
+            } else {
+                late = true;
+                mDoneCond.wait(mLock);
+            }
+        }
+    }
+    if (late) {
+        if (++mDeadlineMisses >= kMaxDeadlineMisses) {
+            ALOGW("AudioMixer workers missed %u deadlines, reverting to serial mixing",
+                    mDeadlineMisses);
+            mEnabled = false;
+        }
+    } else {
+        mDeadlineMisses = 0;
+    }
+
+    // sum the partial accumulators
+    for (uint32_t w = 0; w < mNumWorkers; w++) {
+        if (!mWorkers[w]->mUsed) {
+            continue;
+        }
+        const int32_t* partial = mWorkers[w]->mOutTemp;
+        if (mixerInFormat == AUDIO_FORMAT_PCM_FLOAT) {
+            float* out = reinterpret_cast<float*>(outTemp);
+            const float* in = reinterpret_cast<const float*>(partial);
+            for (size_t k = 0; k < mSampleCount; k++) {
+                out[k] += in[k];
+            }
+        } else {
+            for (size_t k = 0; k < mSampleCount; k++) {
+                outTemp[k] += partial[k];
             }
         }
-        convertMixerFormat(out, t1.mMixerFormat,
-                outTemp, t1.mMixerInFormat, numFrames * t1.mMixerChannelCount);
     }
 }
 
@@ -1826,6 +2326,7 @@ int64_t AudioMixer::calculateOutputPTS(const track_t& t, int64_t basePTS,
 
 /*static*/ uint64_t AudioMixer::sLocalTimeFreq;
 /*static*/ pthread_once_t AudioMixer::sOnceControl = PTHREAD_ONCE_INIT;
+/*static*/ int AudioMixer::sSimdMode = SIMD_MODE_DISABLED;
 
 /*static*/ void AudioMixer::sInitRoutine()
 {
@@ -1833,6 +2334,26 @@ int64_t AudioMixer::calculateOutputPTS(const track_t& t, int64_t basePTS,
     sLocalTimeFreq = lc.getLocalFreq(); // for the resampler
 
     DownmixerBufferProvider::init(); // for the downmixer
+
+#if USE_MIXER_SIMD
+    // af.mixer.simd: 0 disables the SIMD hooks, 1 enables them (default),
+    // 2 restricts them to the kernels which are bit-exact with the scalar mixer.
+    sSimdMode = SIMD_MODE_ENABLED;
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("af.mixer.simd", value, NULL) > 0) {
+        char *endptr;
+        unsigned long l = strtoul(value, &endptr, 0);
+        if (*endptr == '\0' && l <= SIMD_MODE_BIT_EXACT) {
+            sSimdMode = (int) l;
+        }
+    }
+    ALOGV("SIMD mixer mode %d", sSimdMode);
+#endif
+}
+
+/*static*/ bool AudioMixer::useSimdHooks(uint32_t channelCount)
+{
+    return sSimdMode != SIMD_MODE_DISABLED && channelCount <= FCC_2;
 }
 
 /* TODO: consider whether this level of optimization is necessary.
@@ -1926,18 +2447,79 @@ static void volumeMulti(uint32_t channels, TO* out, size_t frameCount,
     }
 }
 
+#if USE_MIXER_SIMD
+/* SIMD mixing for mono and stereo output, see AudioMixerOpsSimd.h.
+ * Returns the number of frames processed, the remainder must be mixed by the caller.
+ */
+template <int MIXTYPE, typename TO, typename TI, typename TV>
+static size_t volumeRampMultiSimd(uint32_t channels, TO* out, size_t frameCount,
+        const TI* in, TV *vol, const TV *volinc)
+{
+    switch (channels) {
+    case 1:
+        return volumeRampMultiSimd<MIXTYPE, 1>(out, frameCount, in, vol, volinc);
+    case 2:
+        return volumeRampMultiSimd<MIXTYPE, 2>(out, frameCount, in, vol, volinc);
+    default:
+        return 0;
+    }
+}
+
+template <int MIXTYPE, typename TO, typename TI, typename TV>
+static size_t volumeMultiSimd(uint32_t channels, TO* out, size_t frameCount,
+        const TI* in, const TV *vol)
+{
+    switch (channels) {
+    case 1:
+        return volumeMultiSimd<MIXTYPE, 1>(out, frameCount, in, vol);
+    case 2:
+        return volumeMultiSimd<MIXTYPE, 2>(out, frameCount, in, vol);
+    default:
+        return 0;
+    }
+}
+#endif
+
 /* MIXTYPE     (see AudioMixerOps.h MIXTYPE_* enumeration)
  * USEFLOATVOL (set to true if float volume is used)
  * ADJUSTVOL   (set to true if volume ramp parameters needs adjustment afterwards)
+ * USESIMD     (set to true to use the SIMD kernels for mono and stereo output)
  * TO: int32_t (Q4.27) or float
  * TI: int32_t (Q4.27) or int16_t (Q0.15) or float
  * TA: int32_t (Q4.27)
  */
-template <int MIXTYPE, bool USEFLOATVOL, bool ADJUSTVOL,
+template <int MIXTYPE, bool USEFLOATVOL, bool ADJUSTVOL, bool USESIMD,
     typename TO, typename TI, typename TA>
 void AudioMixer::volumeMix(TO *out, size_t outFrames,
         const TI *in, TA *aux, bool ramp, AudioMixer::track_t *t)
 {
+#if USE_MIXER_SIMD
+    // The SIMD kernels handle the bulk of the frames without an aux buffer,
+    // the scalar code below completes any remaining frames.
+    if (USESIMD && aux == NULL) {
+        const uint32_t channels = t->mMixerChannelCount;
+        size_t frames;
+        if (USEFLOATVOL) {
+            frames = !ramp ? volumeMultiSimd<MIXTYPE>(channels, out, outFrames, in, t->mVolume)
+                    : sSimdMode == SIMD_MODE_BIT_EXACT ? 0
+                    : volumeRampMultiSimd<MIXTYPE>(channels,
+                            out, outFrames, in, t->mPrevVolume, t->mVolumeInc);
+        } else {
+            frames = !ramp ? volumeMultiSimd<MIXTYPE>(channels, out, outFrames, in, t->volume)
+                    : volumeRampMultiSimd<MIXTYPE>(channels,
+                            out, outFrames, in, t->prevVolume, t->volumeInc);
+        }
+        if (frames == outFrames) {
+            if (ramp && ADJUSTVOL) {
+                t->adjustVolumeRamp(false /* aux */, USEFLOATVOL);
+            }
+            return;
+        }
+        out += frames * channels;
+        in += frames * (MIXTYPE == MIXTYPE_MONOEXPAND ? 1 : channels);
+        outFrames -= frames;
+    }
+#endif
     if (USEFLOATVOL) {
         if (ramp) {
             volumeRampMulti<MIXTYPE>(t->mMixerChannelCount, out, outFrames, in, aux,
@@ -1968,11 +2550,12 @@ void AudioMixer::volumeMix(TO *out, size_t outFrames,
  * TODO: Update the hook selection: this can properly handle aux and ramp.
  *
  * MIXTYPE     (see AudioMixerOps.h MIXTYPE_* enumeration)
+ * USESIMD     (set to true to use the SIMD kernels for mono and stereo output)
  * TO: int32_t (Q4.27) or float
  * TI: int32_t (Q4.27) or int16_t (Q0.15) or float
  * TA: int32_t (Q4.27)
  */
-template <int MIXTYPE, typename TO, typename TI, typename TA>
+template <int MIXTYPE, bool USESIMD, typename TO, typename TI, typename TA>
 void AudioMixer::process_NoResampleOneTrack(state_t* state, int64_t pts)
 {
     ALOGVV("process_NoResampleOneTrack\n");
@@ -2005,7 +2588,7 @@ void AudioMixer::process_NoResampleOneTrack(state_t* state, int64_t pts)
         }
 
         const size_t outFrames = b.frameCount;
-        volumeMix<MIXTYPE, is_same<TI, float>::value, false> (
+        volumeMix<MIXTYPE, is_same<TI, float>::value, false, USESIMD> (
                 out, outFrames, in, aux, ramp, t);
 
         out += outFrames * channels;
@@ -2026,11 +2609,12 @@ void AudioMixer::process_NoResampleOneTrack(state_t* state, int64_t pts)
  * pulling from the track's upstream AudioBufferProvider.
  *
  * MIXTYPE     (see AudioMixerOps.h MIXTYPE_* enumeration)
+ * USESIMD     (set to true to use the SIMD kernels for mono and stereo output)
  * TO: int32_t (Q4.27) or float
  * TI: int32_t (Q4.27) or int16_t (Q0.15) or float
  * TA: int32_t (Q4.27)
  */
-template <int MIXTYPE, typename TO, typename TI, typename TA>
+template <int MIXTYPE, bool USESIMD, typename TO, typename TI, typename TA>
 void AudioMixer::track__Resample(track_t* t, TO* out, size_t outFrameCount, TO* temp, TA* aux)
 {
     ALOGVV("track__Resample\n");
@@ -2044,7 +2628,7 @@ void AudioMixer::track__Resample(track_t* t, TO* out, size_t outFrameCount, TO*
         memset(temp, 0, outFrameCount * t->mMixerChannelCount * sizeof(TO));
         t->resampler->resample((int32_t*)temp, outFrameCount, t->bufferProvider);
 
-        volumeMix<MIXTYPE, is_same<TI, float>::value, true>(
+        volumeMix<MIXTYPE, is_same<TI, float>::value, true, USESIMD>(
                 out, outFrameCount, temp, aux, ramp, t);
 
     } else { // constant volume gain
@@ -2057,18 +2641,19 @@ void AudioMixer::track__Resample(track_t* t, TO* out, size_t outFrameCount, TO*
  * The input buffer should be present in t->in.
  *
  * MIXTYPE     (see AudioMixerOps.h MIXTYPE_* enumeration)
+ * USESIMD     (set to true to use the SIMD kernels for mono and stereo output)
  * TO: int32_t (Q4.27) or float
  * TI: int32_t (Q4.27) or int16_t (Q0.15) or float
  * TA: int32_t (Q4.27)
  */
-template <int MIXTYPE, typename TO, typename TI, typename TA>
+template <int MIXTYPE, bool USESIMD, typename TO, typename TI, typename TA>
 void AudioMixer::track__NoResample(track_t* t, TO* out, size_t frameCount,
         TO* temp __unused, TA* aux)
 {
     ALOGVV("track__NoResample\n");
     const TI *in = static_cast<const TI *>(t->in);
 
-    volumeMix<MIXTYPE, is_same<TI, float>::value, true>(
+    volumeMix<MIXTYPE, is_same<TI, float>::value, true, USESIMD>(
             out, frameCount, in, aux, t->needsRamp(), t);
 
     // MIXTYPE_MONOEXPAND reads a single input channel and expands to NCHAN output channels.
@@ -2139,17 +2724,23 @@ AudioMixer::hook_t AudioMixer::getTrackHook(int trackType, uint32_t channelCount
         }
     }
     LOG_ALWAYS_FATAL_IF(channelCount > MAX_NUM_CHANNELS);
+    const bool useSimd = useSimdHooks(channelCount);
     switch (trackType) {
     case TRACKTYPE_NOP:
         return track__nop;
     case TRACKTYPE_RESAMPLE:
         switch (mixerInFormat) {
         case AUDIO_FORMAT_PCM_FLOAT:
-            return (AudioMixer::hook_t)
-                    track__Resample<MIXTYPE_MULTI, float /*TO*/, float /*TI*/, int32_t /*TA*/>;
+            return useSimd ? (AudioMixer::hook_t)
+                    track__Resample<MIXTYPE_MULTI, true /*USESIMD*/,
+                            float /*TO*/, float /*TI*/, int32_t /*TA*/>
+                    : (AudioMixer::hook_t)
+                    track__Resample<MIXTYPE_MULTI, false, float, float, int32_t>;
         case AUDIO_FORMAT_PCM_16_BIT:
-            return (AudioMixer::hook_t)\
-                    track__Resample<MIXTYPE_MULTI, int32_t, int16_t, int32_t>;
+            return useSimd ? (AudioMixer::hook_t)
+                    track__Resample<MIXTYPE_MULTI, true, int32_t, int16_t, int32_t>
+                    : (AudioMixer::hook_t)
+                    track__Resample<MIXTYPE_MULTI, false, int32_t, int16_t, int32_t>;
         default:
             LOG_ALWAYS_FATAL("bad mixerInFormat: %#x", mixerInFormat);
             break;
@@ -2158,11 +2749,15 @@ AudioMixer::hook_t AudioMixer::getTrackHook(int trackType, uint32_t channelCount
     case TRACKTYPE_NORESAMPLEMONO:
         switch (mixerInFormat) {
         case AUDIO_FORMAT_PCM_FLOAT:
-            return (AudioMixer::hook_t)
-                    track__NoResample<MIXTYPE_MONOEXPAND, float, float, int32_t>;
+            return useSimd ? (AudioMixer::hook_t)
+                    track__NoResample<MIXTYPE_MONOEXPAND, true, float, float, int32_t>
+                    : (AudioMixer::hook_t)
+                    track__NoResample<MIXTYPE_MONOEXPAND, false, float, float, int32_t>;
         case AUDIO_FORMAT_PCM_16_BIT:
-            return (AudioMixer::hook_t)
-                    track__NoResample<MIXTYPE_MONOEXPAND, int32_t, int16_t, int32_t>;
+            return useSimd ? (AudioMixer::hook_t)
+                    track__NoResample<MIXTYPE_MONOEXPAND, true, int32_t, int16_t, int32_t>
+                    : (AudioMixer::hook_t)
+                    track__NoResample<MIXTYPE_MONOEXPAND, false, int32_t, int16_t, int32_t>;
         default:
             LOG_ALWAYS_FATAL("bad mixerInFormat: %#x", mixerInFormat);
             break;
@@ -2171,11 +2766,15 @@ AudioMixer::hook_t AudioMixer::getTrackHook(int trackType, uint32_t channelCount
     case TRACKTYPE_NORESAMPLE:
         switch (mixerInFormat) {
         case AUDIO_FORMAT_PCM_FLOAT:
-            return (AudioMixer::hook_t)
-                    track__NoResample<MIXTYPE_MULTI, float, float, int32_t>;
+            return useSimd ? (AudioMixer::hook_t)
+                    track__NoResample<MIXTYPE_MULTI, true, float, float, int32_t>
+                    : (AudioMixer::hook_t)
+                    track__NoResample<MIXTYPE_MULTI, false, float, float, int32_t>;
         case AUDIO_FORMAT_PCM_16_BIT:
-            return (AudioMixer::hook_t)
-                    track__NoResample<MIXTYPE_MULTI, int32_t, int16_t, int32_t>;
+            return useSimd ? (AudioMixer::hook_t)
+                    track__NoResample<MIXTYPE_MULTI, true, int32_t, int16_t, int32_t>
+                    : (AudioMixer::hook_t)
+                    track__NoResample<MIXTYPE_MULTI, false, int32_t, int16_t, int32_t>;
         default:
             LOG_ALWAYS_FATAL("bad mixerInFormat: %#x", mixerInFormat);
             break;
@@ -2206,14 +2805,18 @@ AudioMixer::process_hook_t AudioMixer::getProcessHook(int processType, uint32_t
         return process__OneTrack16BitsStereoNoResampling;
     }
     LOG_ALWAYS_FATAL_IF(channelCount > MAX_NUM_CHANNELS);
+    // Only float output has a SIMD kernel for MIXTYPE_MULTI_SAVEONLY.
+    const bool useSimd = useSimdHooks(channelCount);
     switch (mixerInFormat) {
     case AUDIO_FORMAT_PCM_FLOAT:
         switch (mixerOutFormat) {
         case AUDIO_FORMAT_PCM_FLOAT:
-            return process_NoResampleOneTrack<MIXTYPE_MULTI_SAVEONLY,
-                    float /*TO*/, float /*TI*/, int32_t /*TA*/>;
+            return useSimd ? process_NoResampleOneTrack<MIXTYPE_MULTI_SAVEONLY, true /*USESIMD*/,
+                            float /*TO*/, float /*TI*/, int32_t /*TA*/>
+                    : process_NoResampleOneTrack<MIXTYPE_MULTI_SAVEONLY, false,
+                            float, float, int32_t>;
         case AUDIO_FORMAT_PCM_16_BIT:
-            return process_NoResampleOneTrack<MIXTYPE_MULTI_SAVEONLY,
+            return process_NoResampleOneTrack<MIXTYPE_MULTI_SAVEONLY, false,
                     int16_t, float, int32_t>;
         default:
             LOG_ALWAYS_FATAL("bad mixerOutFormat: %#x", mixerOutFormat);
@@ -2223,10 +2826,10 @@ AudioMixer::process_hook_t AudioMixer::getProcessHook(int processType, uint32_t
     case AUDIO_FORMAT_PCM_16_BIT:
         switch (mixerOutFormat) {
         case AUDIO_FORMAT_PCM_FLOAT:
-            return process_NoResampleOneTrack<MIXTYPE_MULTI_SAVEONLY,
+            return process_NoResampleOneTrack<MIXTYPE_MULTI_SAVEONLY, false,
                     float, int16_t, int32_t>;
         case AUDIO_FORMAT_PCM_16_BIT:
-            return process_NoResampleOneTrack<MIXTYPE_MULTI_SAVEONLY,
+            return process_NoResampleOneTrack<MIXTYPE_MULTI_SAVEONLY, false,
                     int16_t, int16_t, int32_t>;
         default:
             LOG_ALWAYS_FATAL("bad mixerOutFormat: %#x", mixerOutFormat);
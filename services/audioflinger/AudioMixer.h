@@ -23,6 +23,8 @@
 
 #include <utils/threads.h>
 
+#include <cpustats/CentralTendencyStatistics.h>
+#include <cpustats/ThreadCpuUsage.h>
 #include <media/AudioBufferProvider.h>
 #include "AudioResampler.h"
 
@@ -126,6 +128,24 @@ public:
 
     size_t      getUnreleasedFrames(int name) const;
 
+    // Set the number of worker threads used to mix tracks in parallel when resampling,
+    // up to MAX_NUM_WORKERS. 0 (the default) mixes all tracks on the calling thread.
+    // Must not be called concurrently with process().
+    void        setWorkerCount(uint32_t count);
+
+    static const uint32_t MAX_NUM_WORKERS = 4;
+
+    // Enable or disable accounting of the thread CPU time spent by process() on each track.
+    // Must not be called concurrently with process().
+    void        setCostAccounting(bool enable);
+
+    // Copy the statistics of the thread CPU ns spent per process() call on the track name.
+    // Time that cannot be attributed to a track is reported by getOverheadCost().
+    // Returns false if cost accounting is disabled.  Intended for dumps, as a copy taken
+    // concurrently with process() may be slightly inconsistent.
+    bool        getTrackCost(int name, CentralTendencyStatistics* stats) const;
+    bool        getOverheadCost(CentralTendencyStatistics* stats) const;
+
     static inline bool isValidPcmTrackFormat(audio_format_t format) {
         return format == AUDIO_FORMAT_PCM_16_BIT ||
                 format == AUDIO_FORMAT_PCM_24_BIT_PACKED ||
@@ -155,6 +175,8 @@ private:
     struct state_t;
     struct track_t;
     class CopyBufferProvider;
+    class WorkerPool;
+    class CostAccounting;
 
     typedef void (*hook_t)(track_t* t, int32_t* output, size_t numOutFrames, int32_t* temp,
                            int32_t* aux);
@@ -229,6 +251,7 @@ private:
         // 16-byte boundary
         audio_channel_mask_t mMixerChannelMask;
         uint32_t             mMixerChannelCount;
+        bool                 mDownmixerReformats; // downmixerBufferProvider reads mFormat
 
         bool        needsRamp() { return (volumeInc[0] | volumeInc[1] | auxInc) != 0; }
         bool        setResampler(uint32_t trackSampleRate, uint32_t devSampleRate);
@@ -250,7 +273,8 @@ private:
         int32_t         *outputTemp;
         int32_t         *resampleTemp;
         NBLog::Writer*  mLog;
-        int32_t         reserved[1];
+        WorkerPool*     workers; // NULL unless parallel mixing is enabled
+        CostAccounting* cost;    // NULL unless cost accounting is enabled
         // FIXME allocate dynamically to save some memory when maxNumTracks < MAX_NUM_TRACKS
         track_t         tracks[MAX_NUM_TRACKS] __attribute__((aligned(32)));
     };
@@ -361,6 +385,120 @@ private:
         const audio_format_t mOutputFormat;
     };
 
+    // DownmixReformatBufferProvider wraps a track AudioBufferProvider to fold a quad, 5.1
+    // or 7.1 track down to stereo and convert it to float in a single pass.  It replaces
+    // the ReformatBufferProvider and DownmixerBufferProvider pair, and with them one
+    // intermediate buffer and one pass over the track data.
+    class DownmixReformatBufferProvider : public CopyBufferProvider {
+    public:
+        DownmixReformatBufferProvider(audio_channel_mask_t inputChannelMask,
+                audio_format_t inputFormat, audio_format_t outputFormat,
+                size_t bufferFrameCount);
+        virtual void copyFrames(void *dst, const void *src, size_t frames);
+
+        // returns true if the conversion can be done by this provider.
+        static bool isSupported(audio_channel_mask_t inputChannelMask,
+                audio_channel_mask_t outputChannelMask,
+                audio_format_t inputFormat, audio_format_t outputFormat);
+
+    protected:
+        const uint32_t       mInputChannelBits;
+        const uint32_t       mInputChannels;
+        const audio_format_t mInputFormat;
+    };
+
+    // CostAccounting attributes the thread CPU time spent in process() to tracks.
+    // The time since the previous sample on the thread mixing a track is charged to the track
+    // after each unit of its work, and the per-track sums of a process() call are then added
+    // to the statistics.  Time between tracks is charged to the mixer overhead, except when
+    // a single track is enabled, as the one track process hooks do not sample.
+    class CostAccounting {
+    public:
+        CostAccounting();
+
+        // called by the mixer thread around the process hook
+        void begin() { double ns; (void) mCpuUsage.sampleAndEnable(ns); }
+        void end(uint32_t tracks);
+
+        // charge the time since the previous sample of usage to track i, or to the overhead
+        void charge(ThreadCpuUsage& usage, int i) {
+            double ns;
+            if (usage.sample(ns)) {
+                mPending[i] += ns;
+            }
+        }
+        void charge(int i) { charge(mCpuUsage, i); }
+        void chargeOverhead() {
+            double ns;
+            if (mCpuUsage.sample(ns)) {
+                mPendingOverhead += ns;
+            }
+        }
+
+        void reset(int i) { mStats[i].reset(); mPending[i] = 0.; }
+
+        ThreadCpuUsage              mCpuUsage;                  // of the mixer thread
+        double                      mPending[MAX_NUM_TRACKS];   // ns in current process()
+        double                      mPendingOverhead;
+        CentralTendencyStatistics   mStats[MAX_NUM_TRACKS];     // ns per process() call
+        CentralTendencyStatistics   mOverhead;
+    };
+
+    // WorkerPool mixes the tracks of process__genericResampling() in parallel.
+    // Each worker accumulates the tracks it claims into a private buffer, and the calling
+    // thread, which also claims tracks, sums those buffers into the mixer output.
+    // Tracks with an aux buffer are always mixed by the calling thread, since several
+    // tracks may send to the same aux buffer.
+    class WorkerPool {
+    public:
+        WorkerPool(uint32_t numWorkers, size_t frameCount, uint32_t sampleRate);
+        ~WorkerPool();
+
+        // false once the workers repeatedly missed the mix deadline
+        bool isEnabled() const { return mEnabled; }
+
+        // Mix the tracks in the 'tracks' bitmask into outTemp, which holds
+        // state->frameCount frames of channelCount channels in mixerInFormat.
+        void mix(state_t* state, uint32_t tracks, int32_t* outTemp,
+                uint32_t channelCount, audio_format_t mixerInFormat, int64_t pts);
+
+    private:
+        class Worker;
+        friend class Worker;
+
+        // Claim and mix tracks until none are left. Returns true if any track was mixed.
+        // If clear is true, outTemp is cleared before the first track is mixed into it.
+        // If cost accounting is enabled, each track is charged using the calling thread's
+        // usage, which must have been sampled before.
+        bool runJobs(int32_t* outTemp, int32_t* resampleTemp, bool clear,
+                ThreadCpuUsage* usage);
+
+        // the calling thread waits for workers at most this fraction of the mix period
+        static const uint32_t kDeadlineDivisor = 2;
+        // consecutive missed deadlines before falling back to serial mixing
+        static const uint32_t kMaxDeadlineMisses = 8;
+
+        Mutex               mLock;
+        Condition           mWorkCond;      // signaled when a new mix is started
+        Condition           mDoneCond;      // signaled when the last worker is done
+        uint32_t            mGeneration;    // incremented for each new mix
+        uint32_t            mPending;       // workers still running the current mix
+        sp<Worker>          mWorkers[MAX_NUM_WORKERS];
+        const uint32_t      mNumWorkers;
+        const size_t        mBufferSamples;
+        const nsecs_t       mDeadlineNs;
+        uint32_t            mDeadlineMisses;
+        bool                mEnabled;
+
+        // parameters of the current mix, stable while workers are running
+        state_t*            mState;
+        int64_t             mPts;
+        size_t              mSampleCount;   // samples in the output of the current mix
+        volatile int32_t    mNextJob;
+        int32_t             mNumJobs;
+        int                 mJobs[MAX_NUM_TRACKS];
+    };
+
     // bitmask of allocated track names, where bit 0 corresponds to TRACK0 etc.
     uint32_t        mTrackNames;
 
@@ -407,6 +545,8 @@ private:
     static void process__nop(state_t* state, int64_t pts);
     static void process__genericNoResampling(state_t* state, int64_t pts);
     static void process__genericResampling(state_t* state, int64_t pts);
+    static void process__genericResamplingTrack(state_t* state, track_t& t,
+            int32_t* outTemp, int32_t* resampleTemp, int64_t pts);
     static void process__OneTrack16BitsStereoNoResampling(state_t* state,
                                                           int64_t pts);
 
@@ -417,30 +557,40 @@ private:
     static pthread_once_t   sOnceControl;
     static void             sInitRoutine();
 
+    // SIMD hook selection, set from the af.mixer.simd property (see AudioMixerOpsSimd.h).
+    enum {
+        SIMD_MODE_DISABLED,
+        SIMD_MODE_ENABLED,
+        SIMD_MODE_BIT_EXACT,    // only kernels which are bit-exact with the scalar path
+    };
+    static int              sSimdMode;
+    static bool             useSimdHooks(uint32_t channelCount);
+
     /* multi-format volume mixing function (calls template functions
      * in AudioMixerOps.h).  The template parameters are as follows:
      *
      *   MIXTYPE     (see AudioMixerOps.h MIXTYPE_* enumeration)
      *   USEFLOATVOL (set to true if float volume is used)
      *   ADJUSTVOL   (set to true if volume ramp parameters needs adjustment afterwards)
+     *   USESIMD     (set to true to use the SIMD kernels for mono and stereo output)
      *   TO: int32_t (Q4.27) or float
      *   TI: int32_t (Q4.27) or int16_t (Q0.15) or float
      *   TA: int32_t (Q4.27)
      */
-    template <int MIXTYPE, bool USEFLOATVOL, bool ADJUSTVOL,
+    template <int MIXTYPE, bool USEFLOATVOL, bool ADJUSTVOL, bool USESIMD,
         typename TO, typename TI, typename TA>
     static void volumeMix(TO *out, size_t outFrames,
             const TI *in, TA *aux, bool ramp, AudioMixer::track_t *t);
 
     // multi-format process hooks
-    template <int MIXTYPE, typename TO, typename TI, typename TA>
+    template <int MIXTYPE, bool USESIMD, typename TO, typename TI, typename TA>
     static void process_NoResampleOneTrack(state_t* state, int64_t pts);
 
     // multi-format track hooks
-    template <int MIXTYPE, typename TO, typename TI, typename TA>
+    template <int MIXTYPE, bool USESIMD, typename TO, typename TI, typename TA>
     static void track__Resample(track_t* t, TO* out, size_t frameCount,
             TO* temp __unused, TA* aux);
-    template <int MIXTYPE, typename TO, typename TI, typename TA>
+    template <int MIXTYPE, bool USESIMD, typename TO, typename TI, typename TA>
     static void track__NoResample(track_t* t, TO* out, size_t frameCount,
             TO* temp __unused, TA* aux);
 
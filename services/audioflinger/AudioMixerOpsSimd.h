@@ -0,0 +1,371 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_MIXER_OPS_SIMD_H
+#define ANDROID_AUDIO_MIXER_OPS_SIMD_H
+
+// depends on AudioMixerOps.h
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define USE_MIXER_SIMD (true)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#define USE_MIXER_SIMD (true)
+#include <emmintrin.h>
+#else
+#define USE_MIXER_SIMD (false)
+#endif
+
+namespace android {
+
+#if USE_MIXER_SIMD
+
+/*
+ * Minimal 4-lane vector layer used by the SIMD mix kernels below.
+ * Only operations whose result is identical to the scalar MixMul/MixAccum
+ * equivalent are exposed (no fused multiply-add), so that the kernels can be
+ * checked for bit-exactness against volumeMulti() and volumeRampMulti().
+ *
+ * The int16 multiply-accumulate requires each volume lane to be within the
+ * int16 range, which holds for U4.12 volumes and the top half of U4.28 volumes.
+ */
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+
+typedef float32x4_t mixer_f32x4_t;
+typedef int32x4_t   mixer_s32x4_t;
+
+static inline mixer_f32x4_t mixer_ld_f32(const float *p) { return vld1q_f32(p); }
+static inline void mixer_st_f32(float *p, mixer_f32x4_t v) { vst1q_f32(p, v); }
+static inline mixer_f32x4_t mixer_add_f32(mixer_f32x4_t a, mixer_f32x4_t b) {
+    return vaddq_f32(a, b);
+}
+static inline mixer_f32x4_t mixer_mul_f32(mixer_f32x4_t a, mixer_f32x4_t b) {
+    return vmulq_f32(a, b);
+}
+static inline mixer_f32x4_t mixer_set_f32(float a, float b, float c, float d) {
+    const float v[4] = { a, b, c, d };
+    return vld1q_f32(v);
+}
+static inline float mixer_lane0_f32(mixer_f32x4_t v) { return vgetq_lane_f32(v, 0); }
+static inline float mixer_lane1_f32(mixer_f32x4_t v) { return vgetq_lane_f32(v, 1); }
+// returns { p[0], p[0], p[1], p[1] }
+static inline mixer_f32x4_t mixer_ld_dup2_f32(const float *p) {
+    const float32x2_t v = vld1_f32(p);
+    const float32x2x2_t z = vzip_f32(v, v);
+    return vcombine_f32(z.val[0], z.val[1]);
+}
+
+static inline mixer_s32x4_t mixer_ld_s32(const int32_t *p) { return vld1q_s32(p); }
+static inline void mixer_st_s32(int32_t *p, mixer_s32x4_t v) { vst1q_s32(p, v); }
+static inline mixer_s32x4_t mixer_add_s32(mixer_s32x4_t a, mixer_s32x4_t b) {
+    return vaddq_s32(a, b);
+}
+static inline mixer_s32x4_t mixer_set_s32(int32_t a, int32_t b, int32_t c, int32_t d) {
+    const int32_t v[4] = { a, b, c, d };
+    return vld1q_s32(v);
+}
+static inline mixer_s32x4_t mixer_shr16_s32(mixer_s32x4_t v) { return vshrq_n_s32(v, 16); }
+static inline int32_t mixer_lane0_s32(mixer_s32x4_t v) { return vgetq_lane_s32(v, 0); }
+static inline int32_t mixer_lane1_s32(mixer_s32x4_t v) { return vgetq_lane_s32(v, 1); }
+// returns acc + { p[0], p[1], p[2], p[3] } * vol
+static inline mixer_s32x4_t mixer_mla_s16(mixer_s32x4_t acc, const int16_t *p,
+        mixer_s32x4_t vol) {
+    return vmlaq_s32(acc, vmovl_s16(vld1_s16(p)), vol);
+}
+// returns acc + { p[0], p[0], p[1], p[1] } * vol
+static inline mixer_s32x4_t mixer_mla_dup2_s16(mixer_s32x4_t acc, const int16_t *p,
+        mixer_s32x4_t vol) {
+    int16x4_t v = vdup_n_s16(p[0]);
+    v = vset_lane_s16(p[1], v, 2);
+    v = vset_lane_s16(p[1], v, 3);
+    return vmlaq_s32(acc, vmovl_s16(v), vol);
+}
+
+#else // __SSE2__
+
+typedef __m128  mixer_f32x4_t;
+typedef __m128i mixer_s32x4_t;
+
+static inline mixer_f32x4_t mixer_ld_f32(const float *p) { return _mm_loadu_ps(p); }
+static inline void mixer_st_f32(float *p, mixer_f32x4_t v) { _mm_storeu_ps(p, v); }
+static inline mixer_f32x4_t mixer_add_f32(mixer_f32x4_t a, mixer_f32x4_t b) {
+    return _mm_add_ps(a, b);
+}
+static inline mixer_f32x4_t mixer_mul_f32(mixer_f32x4_t a, mixer_f32x4_t b) {
+    return _mm_mul_ps(a, b);
+}
+static inline mixer_f32x4_t mixer_set_f32(float a, float b, float c, float d) {
+    return _mm_setr_ps(a, b, c, d);
+}
+static inline float mixer_lane0_f32(mixer_f32x4_t v) { return _mm_cvtss_f32(v); }
+static inline float mixer_lane1_f32(mixer_f32x4_t v) {
+    return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+}
+// returns { p[0], p[0], p[1], p[1] }
+static inline mixer_f32x4_t mixer_ld_dup2_f32(const float *p) {
+    const __m128 v = _mm_castpd_ps(_mm_load_sd(reinterpret_cast<const double *>(p)));
+    return _mm_unpacklo_ps(v, v);
+}
+
+static inline mixer_s32x4_t mixer_ld_s32(const int32_t *p) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+static inline void mixer_st_s32(int32_t *p, mixer_s32x4_t v) {
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v);
+}
+static inline mixer_s32x4_t mixer_add_s32(mixer_s32x4_t a, mixer_s32x4_t b) {
+    return _mm_add_epi32(a, b);
+}
+static inline mixer_s32x4_t mixer_set_s32(int32_t a, int32_t b, int32_t c, int32_t d) {
+    return _mm_setr_epi32(a, b, c, d);
+}
+static inline mixer_s32x4_t mixer_shr16_s32(mixer_s32x4_t v) { return _mm_srai_epi32(v, 16); }
+static inline int32_t mixer_lane0_s32(mixer_s32x4_t v) { return _mm_cvtsi128_si32(v); }
+static inline int32_t mixer_lane1_s32(mixer_s32x4_t v) {
+    return _mm_cvtsi128_si32(_mm_shuffle_epi32(v, _MM_SHUFFLE(1, 1, 1, 1)));
+}
+// SSE2 has no 32-bit multiply, so both operands are placed in the low half of each
+// 32-bit lane with a zero high half and multiplied exactly with pmaddwd.
+static inline mixer_s32x4_t mixer_madd_s16(mixer_s32x4_t acc, __m128i in16,
+        mixer_s32x4_t vol) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lo16 = _mm_set1_epi32(0xffff);
+    return _mm_add_epi32(acc,
+            _mm_madd_epi16(_mm_unpacklo_epi16(in16, zero), _mm_and_si128(vol, lo16)));
+}
+// returns acc + { p[0], p[1], p[2], p[3] } * vol
+static inline mixer_s32x4_t mixer_mla_s16(mixer_s32x4_t acc, const int16_t *p,
+        mixer_s32x4_t vol) {
+    return mixer_madd_s16(acc, _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p)), vol);
+}
+// returns acc + { p[0], p[0], p[1], p[1] } * vol
+static inline mixer_s32x4_t mixer_mla_dup2_s16(mixer_s32x4_t acc, const int16_t *p,
+        mixer_s32x4_t vol) {
+    const __m128i v = _mm_set_epi16(0, 0, 0, 0, p[1], p[1], p[0], p[0]);
+    return mixer_madd_s16(acc, v, vol);
+}
+
+#endif
+
+/* Bit-exact SIMD counterparts of volumeMulti() and volumeRampMulti() in AudioMixerOps.h
+ * for MIXTYPE_MULTI, MIXTYPE_MONOEXPAND and MIXTYPE_MULTI_SAVEONLY with one or two
+ * channels and no aux buffer. Four frames are processed per iteration.
+ *
+ * Each function returns the number of frames processed, which is a multiple of 4 and
+ * may be 0. The caller completes the remaining frames with the scalar functions.
+ * Unsupported MIXTYPE, NCHAN, or type combinations process no frames.
+ *
+ * The ramp functions leave vol[] at the value for the first unprocessed frame.
+ * The integer ramps are bit-exact. The float ramp evaluates the volume as
+ * vol + k * volinc for a block of k frames rather than by repeated addition,
+ * so it can differ from the scalar path in the last bits of the volume.
+ */
+
+template <int MIXTYPE, int NCHAN, typename TO, typename TI, typename TV>
+inline size_t volumeMultiSimd(TO* out __unused, size_t frameCount __unused,
+        const TI* in __unused, const TV *vol __unused)
+{
+    return 0;
+}
+
+template <int MIXTYPE, int NCHAN, typename TO, typename TI, typename TV>
+inline size_t volumeRampMultiSimd(TO* out __unused, size_t frameCount __unused,
+        const TI* in __unused, TV *vol __unused, const TV *volinc __unused)
+{
+    return 0;
+}
+
+// Store or accumulate a vector of output samples according to MIXTYPE.
+template <int MIXTYPE>
+inline void mixerOutF32(float *out, mixer_f32x4_t v)
+{
+    if (MIXTYPE == MIXTYPE_MULTI_SAVEONLY) {
+        mixer_st_f32(out, v);
+    } else {
+        mixer_st_f32(out, mixer_add_f32(mixer_ld_f32(out), v));
+    }
+}
+
+// Mix 4 frames of float input with the volume vectors v01 (frames 0, 1) and v23 (frames 2, 3).
+// For NCHAN == 1 only v01 is used, holding the volumes of frames 0 to 3.
+template <int MIXTYPE, int NCHAN>
+inline void mixerFrames4F32(float *out, const float *in, mixer_f32x4_t v01, mixer_f32x4_t v23)
+{
+    if (NCHAN == 1) {
+        mixerOutF32<MIXTYPE>(out, mixer_mul_f32(mixer_ld_f32(in), v01));
+    } else if (MIXTYPE == MIXTYPE_MONOEXPAND) {
+        mixerOutF32<MIXTYPE>(out, mixer_mul_f32(mixer_ld_dup2_f32(in), v01));
+        mixerOutF32<MIXTYPE>(out + 4, mixer_mul_f32(mixer_ld_dup2_f32(in + 2), v23));
+    } else {
+        mixerOutF32<MIXTYPE>(out, mixer_mul_f32(mixer_ld_f32(in), v01));
+        mixerOutF32<MIXTYPE>(out + 4, mixer_mul_f32(mixer_ld_f32(in + 4), v23));
+    }
+}
+
+// Mix 4 frames of int16 input into Q4.27 output, volume vectors as in mixerFrames4F32().
+template <int MIXTYPE, int NCHAN>
+inline void mixerFrames4S16(int32_t *out, const int16_t *in, mixer_s32x4_t v01,
+        mixer_s32x4_t v23)
+{
+    if (NCHAN == 1) {
+        mixer_st_s32(out, mixer_mla_s16(mixer_ld_s32(out), in, v01));
+    } else if (MIXTYPE == MIXTYPE_MONOEXPAND) {
+        mixer_st_s32(out, mixer_mla_dup2_s16(mixer_ld_s32(out), in, v01));
+        mixer_st_s32(out + 4, mixer_mla_dup2_s16(mixer_ld_s32(out + 4), in + 2, v23));
+    } else {
+        mixer_st_s32(out, mixer_mla_s16(mixer_ld_s32(out), in, v01));
+        mixer_st_s32(out + 4, mixer_mla_s16(mixer_ld_s32(out + 4), in + 4, v23));
+    }
+}
+
+template <int MIXTYPE, int NCHAN>
+inline bool mixerSimdSupported(bool saveOnlyAllowed)
+{
+    return (NCHAN == 1 || NCHAN == 2)
+            && (MIXTYPE == MIXTYPE_MULTI || MIXTYPE == MIXTYPE_MONOEXPAND
+                    || (saveOnlyAllowed && MIXTYPE == MIXTYPE_MULTI_SAVEONLY));
+}
+
+template <int MIXTYPE, int NCHAN>
+inline size_t volumeMultiSimd(float* out, size_t frameCount,
+        const float* in, const float *vol)
+{
+    if (!mixerSimdSupported<MIXTYPE, NCHAN>(true /* saveOnlyAllowed */)) {
+        return 0;
+    }
+    const size_t inStride = MIXTYPE == MIXTYPE_MONOEXPAND ? 1 : NCHAN;
+    const mixer_f32x4_t v = NCHAN == 1 ? mixer_set_f32(vol[0], vol[0], vol[0], vol[0])
+            : mixer_set_f32(vol[0], vol[1], vol[0], vol[1]);
+    const size_t frames = frameCount & ~3;
+    for (size_t i = 0; i < frames; i += 4) {
+        mixerFrames4F32<MIXTYPE, NCHAN>(out, in, v, v);
+        out += 4 * NCHAN;
+        in += 4 * inStride;
+    }
+    return frames;
+}
+
+template <int MIXTYPE, int NCHAN>
+inline size_t volumeRampMultiSimd(float* out, size_t frameCount,
+        const float* in, float *vol, const float *volinc)
+{
+    if (!mixerSimdSupported<MIXTYPE, NCHAN>(true /* saveOnlyAllowed */)) {
+        return 0;
+    }
+    const size_t inStride = MIXTYPE == MIXTYPE_MONOEXPAND ? 1 : NCHAN;
+    const size_t frames = frameCount & ~3;
+    if (frames == 0) {
+        return 0;
+    }
+    if (NCHAN == 1) {
+        mixer_f32x4_t v = mixer_set_f32(vol[0], vol[0] + volinc[0],
+                vol[0] + 2 * volinc[0], vol[0] + 3 * volinc[0]);
+        const mixer_f32x4_t inc = mixer_set_f32(4 * volinc[0], 4 * volinc[0],
+                4 * volinc[0], 4 * volinc[0]);
+        for (size_t i = 0; i < frames; i += 4) {
+            mixerFrames4F32<MIXTYPE, NCHAN>(out, in, v, v);
+            v = mixer_add_f32(v, inc);
+            out += 4;
+            in += 4 * inStride;
+        }
+        vol[0] = mixer_lane0_f32(v);
+    } else {
+        mixer_f32x4_t v01 = mixer_set_f32(vol[0], vol[1], vol[0] + volinc[0], vol[1] + volinc[1]);
+        const mixer_f32x4_t inc = mixer_set_f32(4 * volinc[0], 4 * volinc[1],
+                4 * volinc[0], 4 * volinc[1]);
+        const mixer_f32x4_t inc2 = mixer_set_f32(2 * volinc[0], 2 * volinc[1],
+                2 * volinc[0], 2 * volinc[1]);
+        for (size_t i = 0; i < frames; i += 4) {
+            mixerFrames4F32<MIXTYPE, NCHAN>(out, in, v01, mixer_add_f32(v01, inc2));
+            v01 = mixer_add_f32(v01, inc);
+            out += 8;
+            in += 4 * inStride;
+        }
+        vol[0] = mixer_lane0_f32(v01);
+        vol[1] = mixer_lane1_f32(v01);
+    }
+    return frames;
+}
+
+template <int MIXTYPE, int NCHAN>
+inline size_t volumeMultiSimd(int32_t* out, size_t frameCount,
+        const int16_t* in, const int16_t *vol)
+{
+    if (!mixerSimdSupported<MIXTYPE, NCHAN>(false /* saveOnlyAllowed */)) {
+        return 0;
+    }
+    const size_t inStride = MIXTYPE == MIXTYPE_MONOEXPAND ? 1 : NCHAN;
+    const mixer_s32x4_t v = NCHAN == 1 ? mixer_set_s32(vol[0], vol[0], vol[0], vol[0])
+            : mixer_set_s32(vol[0], vol[1], vol[0], vol[1]);
+    const size_t frames = frameCount & ~3;
+    for (size_t i = 0; i < frames; i += 4) {
+        mixerFrames4S16<MIXTYPE, NCHAN>(out, in, v, v);
+        out += 4 * NCHAN;
+        in += 4 * inStride;
+    }
+    return frames;
+}
+
+// U4.28 volume ramp, applied as (vol >> 16) like MixMul<int32_t, int16_t, int32_t>.
+template <int MIXTYPE, int NCHAN>
+inline size_t volumeRampMultiSimd(int32_t* out, size_t frameCount,
+        const int16_t* in, int32_t *vol, const int32_t *volinc)
+{
+    if (!mixerSimdSupported<MIXTYPE, NCHAN>(false /* saveOnlyAllowed */)) {
+        return 0;
+    }
+    const size_t inStride = MIXTYPE == MIXTYPE_MONOEXPAND ? 1 : NCHAN;
+    const size_t frames = frameCount & ~3;
+    if (frames == 0) {
+        return 0;
+    }
+    if (NCHAN == 1) {
+        mixer_s32x4_t v = mixer_set_s32(vol[0], vol[0] + volinc[0],
+                vol[0] + 2 * volinc[0], vol[0] + 3 * volinc[0]);
+        const mixer_s32x4_t inc = mixer_set_s32(4 * volinc[0], 4 * volinc[0],
+                4 * volinc[0], 4 * volinc[0]);
+        for (size_t i = 0; i < frames; i += 4) {
+            const mixer_s32x4_t v16 = mixer_shr16_s32(v);
+            mixerFrames4S16<MIXTYPE, NCHAN>(out, in, v16, v16);
+            v = mixer_add_s32(v, inc);
+            out += 4;
+            in += 4 * inStride;
+        }
+        vol[0] = mixer_lane0_s32(v);
+    } else {
+        mixer_s32x4_t v01 = mixer_set_s32(vol[0], vol[1], vol[0] + volinc[0], vol[1] + volinc[1]);
+        const mixer_s32x4_t inc = mixer_set_s32(4 * volinc[0], 4 * volinc[1],
+                4 * volinc[0], 4 * volinc[1]);
+        const mixer_s32x4_t inc2 = mixer_set_s32(2 * volinc[0], 2 * volinc[1],
+                2 * volinc[0], 2 * volinc[1]);
+        for (size_t i = 0; i < frames; i += 4) {
+            mixerFrames4S16<MIXTYPE, NCHAN>(out, in, mixer_shr16_s32(v01),
+                    mixer_shr16_s32(mixer_add_s32(v01, inc2)));
+            v01 = mixer_add_s32(v01, inc);
+            out += 8;
+            in += 4 * inStride;
+        }
+        vol[0] = mixer_lane0_s32(v01);
+        vol[1] = mixer_lane1_s32(v01);
+    }
+    return frames;
+}
+
+#endif // USE_MIXER_SIMD
+
+}; // namespace android
+
+#endif /* ANDROID_AUDIO_MIXER_OPS_SIMD_H */
@@ -22,6 +22,7 @@
 #include <stdlib.h>
 #include <dlfcn.h>
 #include <math.h>
+#include <pthread.h>
 
 #include <cutils/compiler.h>
 #include <cutils/properties.h>
@@ -29,9 +30,10 @@
 #include <utils/Log.h>
 #include <audio_utils/primitives.h>
 
-#include "AudioResamplerFirOps.h" // USE_NEON and USE_INLINE_ASSEMBLY defined here
+#include "AudioResamplerFirOps.h" // USE_NEON, USE_SSE and USE_INLINE_ASSEMBLY defined here
 #include "AudioResamplerFirProcess.h"
 #include "AudioResamplerFirProcessNeon.h"
+#include "AudioResamplerFirProcessSSE.h"
 #include "AudioResamplerFirGen.h" // requires math.h
 #include "AudioResamplerDyn.h"
 
@@ -167,7 +169,8 @@ AudioResamplerDyn<TC, TI, TO>::AudioResamplerDyn(
         int inChannelCount, int32_t sampleRate, src_quality quality)
     : AudioResampler(inChannelCount, sampleRate, quality),
       mResampleFunc(0), mFilterSampleRate(0), mFilterQuality(DEFAULT_QUALITY),
-    mCoefBuffer(NULL)
+    mCoefBuffer(NULL), mStageIn(NULL), mStageFloat(NULL),
+    mStageOut(NULL), mStageOutFrames(0), mStageOutIndex(0)
 {
     mVolumeSimd[0] = mVolumeSimd[1] = 0;
     // The AudioResampler base class assumes we are always ready for 1:1 resampling.
@@ -180,7 +183,10 @@ AudioResamplerDyn<TC, TI, TO>::AudioResamplerDyn(
 template<typename TC, typename TI, typename TO>
 AudioResamplerDyn<TC, TI, TO>::~AudioResamplerDyn()
 {
-    free(mCoefBuffer);
+    releaseFir(mCoefBuffer);
+    free(mStageIn);
+    free(mStageFloat);
+    free(mStageOut);
 }
 
 template<typename TC, typename TI, typename TO>
@@ -188,6 +194,104 @@ void AudioResamplerDyn<TC, TI, TO>::init()
 {
     mFilterSampleRate = 0; // always trigger new filter generation
     mInBuffer.init();
+    mDecimator.reset();
+    mInterpolator.reset();
+    mStageOutFrames = 0;
+}
+
+template<typename TC, typename TI, typename TO>
+AudioResamplerDyn<TC, TI, TO>::DecimatingProvider::DecimatingProvider()
+    : mProvider(NULL), mChannelCount(0), mIn(NULL), mDecimated(NULL), mOut(NULL),
+      mOutFrames(0), mOutIndex(0)
+{
+}
+
+template<typename TC, typename TI, typename TO>
+AudioResamplerDyn<TC, TI, TO>::DecimatingProvider::~DecimatingProvider()
+{
+    free(mIn);
+    free(mDecimated);
+    free(mOut);
+}
+
+template<typename TC, typename TI, typename TO>
+void AudioResamplerDyn<TC, TI, TO>::DecimatingProvider::configure(int channelCount, int stages)
+{
+    if (stages > 0 && mIn == NULL) {
+        const size_t samples = AudioHalfBandCascade::kMaxFrames * channelCount;
+        mIn = (float*) malloc(samples * sizeof(float));
+        mDecimated = (float*) malloc(samples * sizeof(float));
+        mOut = (TI*) malloc(samples * sizeof(TI));
+    }
+    mChannelCount = channelCount;
+    mCascade.configure(channelCount, stages, true /*decimate*/);
+    mOutFrames = 0;
+    mOutIndex = 0;
+}
+
+template<typename TC, typename TI, typename TO>
+void AudioResamplerDyn<TC, TI, TO>::DecimatingProvider::reset()
+{
+    mCascade.reset();
+    mOutFrames = 0;
+    mOutIndex = 0;
+}
+
+template<typename TC, typename TI, typename TO>
+status_t AudioResamplerDyn<TC, TI, TO>::DecimatingProvider::getNextBuffer(Buffer* buffer,
+        int64_t pts)
+{
+    if (mOutFrames == 0) {
+        // read the input for the frames requested, in one block at most
+        const int stages = mCascade.getStages();
+        size_t inFrames = buffer->frameCount << stages;
+        if (inFrames > AudioHalfBandCascade::kMaxFrames) {
+            inFrames = AudioHalfBandCascade::kMaxFrames;
+        }
+        size_t readFrames = 0;
+        while (readFrames < inFrames) {
+            Buffer in;
+            in.frameCount = inFrames - readFrames;
+            mProvider->getNextBuffer(&in, pts);
+            if (in.raw == NULL) {
+                break;
+            }
+            float* dst = mIn + readFrames * mChannelCount;
+            if (is_same<TI, float>::value) {
+                memcpy(dst, in.raw, in.frameCount * mChannelCount * sizeof(float));
+            } else {
+                memcpy_to_float_from_i16(dst, in.i16, in.frameCount * mChannelCount);
+            }
+            readFrames += in.frameCount;
+            mProvider->releaseBuffer(&in);
+        }
+        mOutFrames = mCascade.decimate(mDecimated, mIn, readFrames);
+        mOutIndex = 0;
+        if (is_same<TI, float>::value) {
+            memcpy(mOut, mDecimated, mOutFrames * mChannelCount * sizeof(float));
+        } else {
+            memcpy_to_i16_from_float(reinterpret_cast<int16_t*>(mOut), mDecimated,
+                    mOutFrames * mChannelCount);
+        }
+        if (mOutFrames == 0) {
+            buffer->raw = NULL;
+            buffer->frameCount = 0;
+            return NOT_ENOUGH_DATA;
+        }
+    }
+    if (buffer->frameCount > mOutFrames) {
+        buffer->frameCount = mOutFrames;
+    }
+    buffer->raw = mOut + mOutIndex * mChannelCount;
+    return NO_ERROR;
+}
+
+template<typename TC, typename TI, typename TO>
+void AudioResamplerDyn<TC, TI, TO>::DecimatingProvider::releaseBuffer(Buffer* buffer)
+{
+    mOutIndex += buffer->frameCount;
+    mOutFrames -= buffer->frameCount;
+    buffer->frameCount = 0;
 }
 
 template<typename TC, typename TI, typename TO>
@@ -205,6 +309,109 @@ void AudioResamplerDyn<TC, TI, TO>::setVolume(float left, float right)
     }
 }
 
+/*
+ * Process-wide cache of polyphase filter banks.
+ *
+ * A filter bank is fully determined by the input and output sample rates, the
+ * resampler quality and the coefficient type, so resamplers doing identical conversions
+ * share one immutable coefficient table instead of each generating its own in
+ * setSampleRate(). Entries are reference counted and freed with the last user,
+ * except for the most common 44.1 kHz <-> 48 kHz conversions, which stay resident
+ * once generated so that tracks created and destroyed in sequence do not
+ * regenerate them every time.
+ */
+struct FirCacheKey {
+    int32_t inSampleRate;
+    int32_t outSampleRate;
+    int     quality;
+    int     coefType;       // CoefType<TC>::value
+    int     L;              // redundant with the above, checked for safety
+    int     halfNumCoefs;
+
+    bool operator==(const FirCacheKey& other) const {
+        return inSampleRate == other.inSampleRate
+                && outSampleRate == other.outSampleRate
+                && quality == other.quality
+                && coefType == other.coefType
+                && L == other.L
+                && halfNumCoefs == other.halfNumCoefs;
+    }
+};
+
+struct FirCacheEntry {
+    FirCacheEntry* next;
+    FirCacheKey    key;
+    void*          coefs;
+    int            refCount;
+};
+
+static pthread_mutex_t sFirCacheLock = PTHREAD_MUTEX_INITIALIZER;
+static FirCacheEntry* sFirCache = NULL;
+
+template<typename TC> struct CoefType;
+template<> struct CoefType<int16_t> { static const int value = 0; };
+template<> struct CoefType<int32_t> { static const int value = 1; };
+template<> struct CoefType<float>   { static const int value = 2; };
+
+static bool isResidentFir(const FirCacheKey& key)
+{
+    return (key.inSampleRate == 44100 && key.outSampleRate == 48000)
+            || (key.inSampleRate == 48000 && key.outSampleRate == 44100);
+}
+
+// Returns the filter bank for key, generating it if it is not in the cache.
+// The caller holds a reference which must be given back with releaseFir().
+template<typename TC>
+static const TC* acquireFir(const FirCacheKey& key,
+        double stopBandAtten, double fcr, double atten)
+{
+    pthread_mutex_lock(&sFirCacheLock);
+    for (FirCacheEntry* entry = sFirCache; entry != NULL; entry = entry->next) {
+        if (entry->key == key) {
+            entry->refCount++;
+            pthread_mutex_unlock(&sFirCacheLock);
+            return static_cast<const TC*>(entry->coefs);
+        }
+    }
+    // Generating under the lock prevents concurrent creation of the same filter.
+    TC* buf = NULL;
+    (void)posix_memalign(reinterpret_cast<void**>(&buf), 32,
+            (key.L+1)*key.halfNumCoefs*sizeof(TC));
+    firKaiserGen(buf, key.L, key.halfNumCoefs, stopBandAtten, fcr, atten);
+    FirCacheEntry* entry = new FirCacheEntry;
+    entry->key = key;
+    entry->coefs = buf;
+    entry->refCount = 1;
+    entry->next = sFirCache;
+    sFirCache = entry;
+    ALOGV("FIR cache: new filter %d->%d quality %d L:%d hnc:%d",
+            key.inSampleRate, key.outSampleRate, key.quality, key.L, key.halfNumCoefs);
+    pthread_mutex_unlock(&sFirCacheLock);
+    return buf;
+}
+
+static void releaseFir(const void* coefs)
+{
+    if (coefs == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&sFirCacheLock);
+    for (FirCacheEntry** link = &sFirCache; *link != NULL; link = &(*link)->next) {
+        FirCacheEntry* entry = *link;
+        if (entry->coefs == coefs) {
+            if (--entry->refCount == 0 && !isResidentFir(entry->key)) {
+                *link = entry->next;
+                free(entry->coefs);
+                delete entry;
+            }
+            pthread_mutex_unlock(&sFirCacheLock);
+            return;
+        }
+    }
+    pthread_mutex_unlock(&sFirCacheLock);
+    ALOGE("FIR cache: releasing unknown filter %p", coefs);
+}
+
 template<typename T> T max(T a, T b) {return a > b ? a : b;}
 
 template<typename T> T absdiff(T a, T b) {return a > b ? a - b : b - a;}
@@ -213,23 +420,26 @@ template<typename TC, typename TI, typename TO>
 void AudioResamplerDyn<TC, TI, TO>::createKaiserFir(Constants &c,
         double stopBandAtten, int inSampleRate, int outSampleRate, double tbwCheat)
 {
-    TC* buf = NULL;
     static const double atten = 0.9998;   // to avoid ripple overflow
     double fcr;
     double tbw = firKaiserTbw(c.mHalfNumCoefs, stopBandAtten);
 
-    (void)posix_memalign(reinterpret_cast<void**>(&buf), 32, (c.mL+1)*c.mHalfNumCoefs*sizeof(TC));
     if (inSampleRate < outSampleRate) { // upsample
         fcr = max(0.5*tbwCheat - tbw/2, tbw/2);
     } else { // downsample
         fcr = max(0.5*tbwCheat*outSampleRate/inSampleRate - tbw/2, tbw/2);
     }
-    // create and set filter
-    firKaiserGen(buf, c.mL, c.mHalfNumCoefs, stopBandAtten, fcr, atten);
+    // get the shared filter, creating it if needed
+    FirCacheKey key;
+    key.inSampleRate = inSampleRate;
+    key.outSampleRate = outSampleRate;
+    key.quality = mFilterQuality;
+    key.coefType = CoefType<TC>::value;
+    key.L = c.mL;
+    key.halfNumCoefs = c.mHalfNumCoefs;
+    const TC* buf = acquireFir<TC>(key, stopBandAtten, fcr, atten);
     c.mFirCoefs = buf;
-    if (mCoefBuffer) {
-        free(mCoefBuffer);
-    }
+    releaseFir(mCoefBuffer);
     mCoefBuffer = buf;
 #ifdef DEBUG_RESAMPLER
     // print basic filter stats
@@ -281,18 +491,43 @@ void AudioResamplerDyn<TC, TI, TO>::setSampleRate(int32_t inSampleRate)
     if (mInSampleRate == inSampleRate) {
         return;
     }
-    int32_t oldSampleRate = mInSampleRate;
+    int32_t oldFilterInSampleRate = mInSampleRate >> mDecimator.getStages();
     int32_t oldHalfNumCoefs = mConstants.mHalfNumCoefs;
     uint32_t oldPhaseWrapLimit = mConstants.mL << mConstants.mShift;
     bool useS32 = false;
 
     mInSampleRate = inSampleRate;
 
+    // select the half-band stages, and reconfigure them if they change
+    bool decimate;
+    int32_t filterInSampleRate;
+    int32_t filterOutSampleRate;
+    const int stages = selectStages(inSampleRate, &decimate,
+            &filterInSampleRate, &filterOutSampleRate);
+    const int decimateStages = decimate ? stages : 0;
+    const int interpolateStages = decimate ? 0 : stages;
+    const int outChannels = mChannelCount < 2 ? 2 : mChannelCount;
+    if (decimateStages != mDecimator.getStages()) {
+        mDecimator.configure(mChannelCount, decimateStages);
+        mFilterSampleRate = 0; // the filter input rate changes
+    }
+    if (interpolateStages != mInterpolator.getStages()) {
+        if (interpolateStages > 0 && mStageIn == NULL) {
+            const size_t samples = AudioHalfBandCascade::kMaxFrames * outChannels;
+            mStageIn = (TO*) malloc(samples * sizeof(TO));
+            mStageFloat = (float*) malloc(samples * sizeof(float));
+            mStageOut = (float*) malloc(samples * sizeof(float));
+        }
+        mInterpolator.configure(outChannels, interpolateStages, false /*decimate*/);
+        mStageOutFrames = 0;
+        mFilterSampleRate = 0; // the filter output rate changes
+    }
     // TODO: Add precalculated Equiripple filters
 
     if (mFilterQuality != getQuality() ||
-            !isClose(inSampleRate, oldSampleRate, mFilterSampleRate, mSampleRate)) {
-        mFilterSampleRate = inSampleRate;
+            !isClose(filterInSampleRate, oldFilterInSampleRate, mFilterSampleRate,
+                    filterOutSampleRate)) {
+        mFilterSampleRate = filterInSampleRate;
         mFilterQuality = getQuality();
 
         // Begin Kaiser Filter computation
@@ -311,9 +546,9 @@ void AudioResamplerDyn<TC, TI, TO>::setSampleRate(int32_t inSampleRate)
             // 32b coefficients, 64 length
             useS32 = true;
             stopBandAtten = 98.;
-            if (inSampleRate >= mSampleRate * 4) {
+            if (filterInSampleRate >= filterOutSampleRate * 4) {
                 halfLength = 48;
-            } else if (inSampleRate >= mSampleRate * 2) {
+            } else if (filterInSampleRate >= filterOutSampleRate * 2) {
                 halfLength = 40;
             } else {
                 halfLength = 32;
@@ -322,14 +557,14 @@ void AudioResamplerDyn<TC, TI, TO>::setSampleRate(int32_t inSampleRate)
             // 16b coefficients, 16-32 length
             useS32 = false;
             stopBandAtten = 80.;
-            if (inSampleRate >= mSampleRate * 4) {
+            if (filterInSampleRate >= filterOutSampleRate * 4) {
                 halfLength = 24;
-            } else if (inSampleRate >= mSampleRate * 2) {
+            } else if (filterInSampleRate >= filterOutSampleRate * 2) {
                 halfLength = 16;
             } else {
                 halfLength = 8;
             }
-            if (inSampleRate <= mSampleRate) {
+            if (filterInSampleRate <= filterOutSampleRate) {
                 tbwCheat = 1.05;
             } else {
                 tbwCheat = 1.03;
@@ -339,14 +574,14 @@ void AudioResamplerDyn<TC, TI, TO>::setSampleRate(int32_t inSampleRate)
             // note: > 64 length filters with 16b coefs can have quantization noise problems
             useS32 = false;
             stopBandAtten = 84.;
-            if (inSampleRate >= mSampleRate * 4) {
+            if (filterInSampleRate >= filterOutSampleRate * 4) {
                 halfLength = 32;
-            } else if (inSampleRate >= mSampleRate * 2) {
+            } else if (filterInSampleRate >= filterOutSampleRate * 2) {
                 halfLength = 24;
             } else {
                 halfLength = 16;
             }
-            if (inSampleRate <= mSampleRate) {
+            if (filterInSampleRate <= filterOutSampleRate) {
                 tbwCheat = 1.03;
             } else {
                 tbwCheat = 1.01;
@@ -359,7 +594,7 @@ void AudioResamplerDyn<TC, TI, TO>::setSampleRate(int32_t inSampleRate)
         //
         // We are a bit more lax on this.
 
-        int phases = mSampleRate / gcd(mSampleRate, inSampleRate);
+        int phases = filterOutSampleRate / gcd(filterOutSampleRate, filterInSampleRate);
 
         // TODO: Once dynamic sample rate change is an option, the code below
         // should be modified to execute only when dynamic sample rate change is enabled.
@@ -380,9 +615,9 @@ void AudioResamplerDyn<TC, TI, TO>::setSampleRate(int32_t inSampleRate)
         }
 
         // create the filter
-        mConstants.set(phases, halfLength, inSampleRate, mSampleRate);
+        mConstants.set(phases, halfLength, filterInSampleRate, filterOutSampleRate);
         createKaiserFir(mConstants, stopBandAtten,
-                inSampleRate, mSampleRate, tbwCheat);
+                filterInSampleRate, filterOutSampleRate, tbwCheat);
     } // End Kaiser filter
 
     // update phase and state based on the new filter.
@@ -394,7 +629,7 @@ void AudioResamplerDyn<TC, TI, TO>::setSampleRate(int32_t inSampleRate)
             * phaseWrapLimit / oldPhaseWrapLimit;
     mPhaseFraction %= phaseWrapLimit; // should not do anything, but just in case.
     mPhaseIncrement = static_cast<uint32_t>(static_cast<uint64_t>(phaseWrapLimit)
-            * inSampleRate / mSampleRate);
+            * filterInSampleRate / filterOutSampleRate);
 
     // determine which resampler to use
     // check if locked phase (works only if mPhaseIncrement has no "fractional phase bits")
@@ -413,7 +648,7 @@ void AudioResamplerDyn<TC, TI, TO>::setSampleRate(int32_t inSampleRate)
     LOG_ALWAYS_FATAL_IF(stride < 16, "Resampler stride must be 16 or more");
     LOG_ALWAYS_FATAL_IF(mChannelCount < 1 || mChannelCount > 8,
             "Resampler channels(%d) must be between 1 to 8", mChannelCount);
-    // stride 16 (falls back to stride 2 for machines that do not support NEON)
+    // stride 16 (falls back to stride 2 for machines that do not support NEON or SSE4.1)
     if (locked) {
         switch (mChannelCount) {
         case 1:
@@ -476,11 +711,108 @@ void AudioResamplerDyn<TC, TI, TO>::setSampleRate(int32_t inSampleRate)
 #endif
 }
 
+template<typename TC, typename TI, typename TO>
+int AudioResamplerDyn<TC, TI, TO>::selectStages(int32_t inSampleRate, bool* decimate,
+        int32_t* filterInSampleRate, int32_t* filterOutSampleRate) const
+{
+    // Each half-band stage halves the rate on the high side of the polyphase filter, as long
+    // as it stays at least twice the rate on the low side: the signal within the cascade then
+    // occupies at most a quarter of the band, which the half-band filters are designed for.
+    int32_t filterIn = inSampleRate;
+    int32_t filterOut = mSampleRate;
+    int stages = 0;
+    if (inSampleRate > 0 && filterOut >= inSampleRate * 4) {
+        while (stages < AudioHalfBandCascade::kMaxStages
+                && (filterOut & 1) == 0 && filterOut / 2 >= inSampleRate * 2) {
+            filterOut /= 2;
+            stages++;
+        }
+    } else if (inSampleRate >= filterOut * 4) {
+        while (stages < AudioHalfBandCascade::kMaxStages
+                && (filterIn & 1) == 0 && filterIn / 2 >= filterOut * 2) {
+            filterIn /= 2;
+            stages++;
+        }
+    }
+    *decimate = filterIn != inSampleRate;
+    *filterInSampleRate = filterIn;
+    *filterOutSampleRate = filterOut;
+    return stages;
+}
+
 template<typename TC, typename TI, typename TO>
 void AudioResamplerDyn<TC, TI, TO>::resample(int32_t* out, size_t outFrameCount,
             AudioBufferProvider* provider)
 {
-    (this->*mResampleFunc)(reinterpret_cast<TO*>(out), outFrameCount, provider);
+    if (mDecimator.getStages() > 0) {
+        mDecimator.setProvider(provider);
+        provider = &mDecimator;
+    }
+    if (mInterpolator.getStages() > 0) {
+        resampleInterpolated(reinterpret_cast<TO*>(out), outFrameCount, provider);
+    } else {
+        (this->*mResampleFunc)(reinterpret_cast<TO*>(out), outFrameCount, provider);
+    }
+}
+
+template<typename TC, typename TI, typename TO>
+void AudioResamplerDyn<TC, TI, TO>::resampleInterpolated(TO* out, size_t outFrameCount,
+        AudioBufferProvider* provider)
+{
+    const bool isFloat = is_same<TO, float>::value;
+    const int channels = mChannelCount < 2 ? 2 : mChannelCount;
+    const int stages = mInterpolator.getStages();
+    // the volume is applied after interpolation, the same way as fir() does
+    float volume[2];
+    for (int i = 0; i < 2; i++) {
+        volume[i] = isFloat ? static_cast<float>(mVolumeSimd[i])
+                : static_cast<float>(mVolumeSimd[i]) / (1 << 28);
+    }
+
+    while (outFrameCount > 0) {
+        if (mStageOutFrames == 0) {
+            // run the polyphase filter for the frames requested only, so that the input is not
+            // read ahead by more than one frame at the lower rate
+            size_t frames = (outFrameCount + (1 << stages) - 1) >> stages;
+            if (frames > (AudioHalfBandCascade::kMaxFrames >> stages)) {
+                frames = AudioHalfBandCascade::kMaxFrames >> stages;
+            }
+            memset(mStageIn, 0, frames * channels * sizeof(TO));
+            const TO volumeSimd[2] = { mVolumeSimd[0], mVolumeSimd[1] };
+            mVolumeSimd[0] = mVolumeSimd[1] = isFloat ? static_cast<TO>(UNITY_GAIN_FLOAT)
+                    : static_cast<TO>(u4_28_from_float(UNITY_GAIN_FLOAT));
+            (this->*mResampleFunc)(mStageIn, frames, provider);
+            mVolumeSimd[0] = volumeSimd[0];
+            mVolumeSimd[1] = volumeSimd[1];
+            if (isFloat) {
+                memcpy(mStageFloat, mStageIn, frames * channels * sizeof(float));
+            } else {
+                memcpy_to_float_from_q4_27(mStageFloat,
+                        reinterpret_cast<const int32_t*>(mStageIn), frames * channels);
+            }
+            mInterpolator.interpolate(mStageOut, mStageFloat, frames);
+            mStageOutFrames = frames << stages;
+            mStageOutIndex = 0;
+        }
+        size_t frames = outFrameCount < mStageOutFrames ? outFrameCount : mStageOutFrames;
+        const float* in = mStageOut + mStageOutIndex * channels;
+        for (size_t i = 0; i < frames; i++) {
+            for (int c = 0; c < channels; c++) {
+                // more than two channels all take the left volume
+                const float sample = in[c] * volume[channels > 2 || c == 0 ? 0 : 1];
+                if (isFloat) {
+                    out[c] += static_cast<TO>(sample);
+                } else {
+                    out[c] += static_cast<TO>(clampq4_27_from_float(sample));
+                }
+            }
+            out += channels;
+            in += channels;
+        }
+        mStageOutIndex += frames;
+        mStageOutFrames -= frames;
+        outFrameCount -= frames;
+    }
 }
 
 template<typename TC, typename TI, typename TO>
@@ -22,6 +22,7 @@
 #include <cutils/log.h>
 
 #include "AudioResampler.h"
+#include "AudioResamplerHalfBand.h"
 
 namespace android {
 
@@ -36,6 +37,11 @@ namespace android {
  *
  * For integer input data types TI, the coefficient type TC is either int16_t or int32_t.
  * For float input data types TI, the coefficient type TC is float.
+ *
+ * For rate ratios of 4 and more, the polyphase filter is cascaded with 2x half-band
+ * stages: decimators between the provider and the filter when downsampling, or
+ * interpolators after the filter when upsampling, so that the polyphase filter only
+ * converts a ratio between 2 and 4 and runs at the lower rate.
  */
 
 template<typename TC, typename TI, typename TO>
@@ -107,6 +113,38 @@ private:
         size_t mStateCount; // size of state in units of TI.
     };
 
+    // Provider of the input decimated by the half-band stages, in the input format.
+    class DecimatingProvider : public AudioBufferProvider {
+    public:
+        DecimatingProvider();
+        ~DecimatingProvider();
+
+        void configure(int channelCount, int stages);
+        void reset();
+        int getStages() const { return mCascade.getStages(); }
+        void setProvider(AudioBufferProvider* provider) { mProvider = provider; }
+
+        virtual status_t getNextBuffer(Buffer* buffer, int64_t pts);
+        virtual void releaseBuffer(Buffer* buffer);
+
+    private:
+        AudioBufferProvider* mProvider; // provider of the input at the full rate
+        AudioHalfBandCascade mCascade;
+        int     mChannelCount;
+        float*  mIn;            // input converted to float
+        float*  mDecimated;     // output of mCascade
+        TI*     mOut;           // output converted to TI
+        size_t  mOutFrames;     // frames available in mOut
+        size_t  mOutIndex;      // first frame available in mOut
+    };
+
+    // determines the half-band stages for inSampleRate, and the rates of the polyphase filter
+    int selectStages(int32_t inSampleRate, bool* decimate,
+            int32_t* filterInSampleRate, int32_t* filterOutSampleRate) const;
+
+    // runs the polyphase filter at the lower rate, and interpolates its output
+    void resampleInterpolated(TO* out, size_t outFrameCount, AudioBufferProvider* provider);
+
     void createKaiserFir(Constants &c, double stopBandAtten,
             int inSampleRate, int outSampleRate, double tbwCheat);
 
@@ -124,7 +162,16 @@ private:
      resample_ABP_t mResampleFunc;     // called function for resampling
             int32_t mFilterSampleRate; // designed filter sample rate.
         src_quality mFilterQuality;    // designed filter quality.
-              void* mCoefBuffer;       // if a filter is created, this is not null
+        const void* mCoefBuffer;       // shared filter from the FIR cache, or null
+
+    // multi-stage conversion
+    DecimatingProvider mDecimator;     // decimation stages, if downsampling
+    AudioHalfBandCascade mInterpolator; // interpolation stages, if upsampling
+                 TO* mStageIn;         // polyphase filter output at the lower rate
+              float* mStageFloat;      // mStageIn converted to float
+              float* mStageOut;        // interpolated output
+             size_t mStageOutFrames;   // frames of mStageOut not yet returned
+             size_t mStageOutIndex;    // first frame of mStageOut not yet returned
 };
 
 }; // namespace android
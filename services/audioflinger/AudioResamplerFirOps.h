@@ -32,6 +32,20 @@ namespace android {
 #define USE_NEON (false)
 #endif
 
+// x86 SIMD is enabled by the target arch variant flags (e.g. -msse4.1 -mavx2).
+// The intrinsic headers are included by AudioResamplerFirProcessSSE.h.
+#if !USE_NEON && defined(__SSE4_1__)
+#define USE_SSE (true)
+#else
+#define USE_SSE (false)
+#endif
+
+#if USE_SSE && defined(__AVX2__)
+#define USE_AVX2 (true)
+#else
+#define USE_AVX2 (false)
+#endif
+
 template<typename T, typename U>
 struct is_same
 {
@@ -0,0 +1,765 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_RESAMPLER_FIR_PROCESS_SSE_H
+#define ANDROID_AUDIO_RESAMPLER_FIR_PROCESS_SSE_H
+
+// depends on AudioResamplerFirOps.h, AudioResamplerFirProcess.h
+
+#if USE_SSE
+#include <smmintrin.h>
+#if USE_AVX2
+#include <immintrin.h>
+#endif
+
+namespace android {
+
+//
+// SSE4.1 specializations are enabled for Process() and ProcessL()
+// with stride 16, for mono and stereo input.  The float variants use AVX2
+// (and FMA, if available) when the target supports it.
+//
+// The integer variants are bit-exact with the generic C++ ProcessBase():
+// the products and the coefficient interpolation are truncated identically
+// and integer accumulation is modular, so the order of the dot product
+// does not matter.  The float variants accumulate in a different order
+// and may differ from ProcessBase() in the least significant bits.
+//
+// The filter bank is only guaranteed to be 16 byte aligned when created
+// by AudioResamplerDyn, and the samples are never aligned, so all loads
+// are unaligned.  This costs nothing on current x86 cores for aligned data.
+//
+// The most recent input frame (the last sample of the negative half) has
+// usually just been stored by AudioResamplerDyn::InBuffer::readAgain().
+// x86 cannot forward a narrow store to a wider load, and a vector load
+// covering it stalls until the store retires, which costs more than the
+// whole dot product for short filters.  The last negative block is therefore
+// loaded with loadHeadSse(), which fetches the newest frame separately.
+
+static inline __m128i loadSse(const int16_t* p)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+static inline __m128i loadSse(const int32_t* p)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+// reverses 8 int16_t mono samples.
+static inline __m128i reverseMonoS16Sse(__m128i samples)
+{
+    const __m128i reverse = _mm_setr_epi8(
+            14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1);
+    return _mm_shuffle_epi8(samples, reverse);
+}
+
+// loads the vector at p whose last frame is the newest input frame, see above.
+template <int CHANNELS>
+static inline __m128i loadHeadSse(const int16_t* p)
+{
+    __m128i v = _mm_srli_si128(loadSse(p - CHANNELS), CHANNELS * sizeof(int16_t));
+    v = _mm_insert_epi16(v, p[8 - CHANNELS], 8 - CHANNELS);
+    if (CHANNELS == 2) {
+        v = _mm_insert_epi16(v, p[7], 7);
+    }
+    return v;
+}
+
+template <int CHANNELS>
+static inline __m128 loadHeadSse(const float* p)
+{
+    __m128 v = _mm_castsi128_ps(_mm_srli_si128(
+            _mm_castps_si128(_mm_loadu_ps(p - CHANNELS)), CHANNELS * sizeof(float)));
+    v = _mm_insert_ps(v, _mm_load_ss(p + 4 - CHANNELS), (4 - CHANNELS) << 4);
+    if (CHANNELS == 2) {
+        v = _mm_insert_ps(v, _mm_load_ss(p + 3), 3 << 4);
+    }
+    return v;
+}
+
+#if USE_AVX2
+template <int CHANNELS>
+static inline __m256 loadHeadAvx(const float* p)
+{
+    const __m256i rotate = CHANNELS == 1
+            ? _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0)
+            : _mm256_setr_epi32(2, 3, 4, 5, 6, 7, 0, 1);
+    __m256 v = _mm256_permutevar8x32_ps(_mm256_loadu_ps(p - CHANNELS), rotate);
+    v = _mm256_blend_ps(v, _mm256_broadcast_ss(p + 8 - CHANNELS), 1 << (8 - CHANNELS));
+    if (CHANNELS == 2) {
+        v = _mm256_blend_ps(v, _mm256_broadcast_ss(p + 7), 0x80);
+    }
+    return v;
+}
+#endif
+
+// splits 8 int16_t stereo frames (in 2 vectors) into 8 left and 8 right samples,
+// reversing the frame order if REVERSE is true (for the positive half).
+template <bool REVERSE>
+static inline void deinterleaveS16Sse(__m128i first, __m128i second,
+        __m128i& left, __m128i& right)
+{
+    const __m128i split = REVERSE
+            ? _mm_setr_epi8(12, 13, 8, 9, 4, 5, 0, 1, 14, 15, 10, 11, 6, 7, 2, 3)
+            : _mm_setr_epi8(0, 1, 4, 5, 8, 9, 12, 13, 2, 3, 6, 7, 10, 11, 14, 15);
+    first = _mm_shuffle_epi8(first, split);   // L L L L R R R R
+    second = _mm_shuffle_epi8(second, split); // L L L L R R R R
+    if (REVERSE) {
+        left = _mm_unpacklo_epi64(second, first);
+        right = _mm_unpackhi_epi64(second, first);
+    } else {
+        left = _mm_unpacklo_epi64(first, second);
+        right = _mm_unpackhi_epi64(first, second);
+    }
+}
+
+// horizontal sum of 4 int32_t.
+static inline int32_t sumS32Sse(__m128i accum)
+{
+    accum = _mm_add_epi32(accum, _mm_shuffle_epi32(accum, _MM_SHUFFLE(1, 0, 3, 2)));
+    accum = _mm_add_epi32(accum, _mm_shuffle_epi32(accum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(accum);
+}
+
+// horizontal sum of the low 32 bits of 2 int64_t, see macS32Sse().
+static inline int32_t sumS64LowSse(__m128i accum)
+{
+    return static_cast<int32_t>(static_cast<uint32_t>(_mm_cvtsi128_si32(accum))
+            + static_cast<uint32_t>(_mm_extract_epi32(accum, 2)));
+}
+
+// accum += (coefs * samples) >> 16 for 4 int32_t coefs and 4 int32_t (S16 sign extended)
+// samples, matching mulAdd(int16_t, int32_t, int32_t).
+// Each product is accumulated in one of 2 int64_t lanes; only the low 32 bits of each
+// lane are significant, which is sufficient as the C++ version wraps at 32 bits as well.
+static inline __m128i macS32Sse(__m128i accum, __m128i coefs, __m128i samples)
+{
+    __m128i even = _mm_srli_epi64(_mm_mul_epi32(coefs, samples), 16);
+    __m128i odd = _mm_srli_epi64(_mm_mul_epi32(
+            _mm_srli_epi64(coefs, 32), _mm_srli_epi64(samples, 32)), 16);
+    return _mm_add_epi64(accum, _mm_add_epi64(even, odd));
+}
+
+/* class scope for passing in functions into templates, see InterpNull and InterpCompute */
+struct InterpNullSse {
+    template <typename TC, typename TL>
+    static inline TL interpolatep(const TC* coefs0, const TC* coefs1 __unused,
+            TL lerp __unused) {
+        return load(coefs0, lerp);
+    }
+
+    template <typename TC, typename TL>
+    static inline TL interpolaten(const TC* coefs0 __unused, const TC* coefs1,
+            TL lerp __unused) {
+        return load(coefs1, lerp);
+    }
+
+    template <typename TC>
+    static inline __m128i load(const TC* coefs, __m128i lerp __unused) {
+        return loadSse(coefs);
+    }
+
+    static inline __m128 load(const float* coefs, __m128 lerp __unused) {
+        return _mm_loadu_ps(coefs);
+    }
+
+#if USE_AVX2
+    static inline __m256 load(const float* coefs, __m256 lerp __unused) {
+        return _mm256_loadu_ps(coefs);
+    }
+#endif
+};
+
+struct InterpComputeSse {
+    template <typename TC, typename TL>
+    static inline TL interpolatep(const TC* coefs0, const TC* coefs1, TL lerp) {
+        return interpolate(coefs0, coefs1, lerp);
+    }
+
+    template <typename TC, typename TL>
+    static inline TL interpolaten(const TC* coefs0, const TC* coefs1, TL lerp) {
+        return interpolate(coefs0, coefs1, lerp);
+    }
+
+    // 8 coefs, see interpolate<int16_t, uint32_t>().
+    // The low 16 bits of (product >> 15) are assembled from the low and high product halves.
+    static inline __m128i interpolate(const int16_t* coefs0, const int16_t* coefs1,
+            __m128i lerp) {
+        __m128i c0 = loadSse(coefs0);
+        __m128i diff = _mm_sub_epi16(loadSse(coefs1), c0);
+        __m128i lo = _mm_mullo_epi16(diff, lerp);
+        __m128i hi = _mm_mulhi_epi16(diff, lerp);
+        return _mm_add_epi16(_mm_or_si128(_mm_srli_epi16(lo, 15), _mm_slli_epi16(hi, 1)), c0);
+    }
+
+    // 4 coefs, see interpolate<int32_t, uint32_t>().
+    static inline __m128i interpolate(const int32_t* coefs0, const int32_t* coefs1,
+            __m128i lerp) {
+        __m128i c0 = loadSse(coefs0);
+        __m128i diff = _mm_sub_epi32(loadSse(coefs1), c0);
+        __m128i even = _mm_srli_epi64(_mm_mul_epi32(diff, lerp), 31);
+        __m128i odd = _mm_slli_epi64(_mm_srli_epi64(
+                _mm_mul_epi32(_mm_srli_epi64(diff, 32), lerp), 31), 32);
+        return _mm_add_epi32(_mm_blend_epi16(even, odd, 0xcc), c0);
+    }
+
+    static inline __m128 interpolate(const float* coefs0, const float* coefs1, __m128 lerp) {
+        __m128 c0 = _mm_loadu_ps(coefs0);
+        return _mm_add_ps(_mm_mul_ps(lerp, _mm_sub_ps(_mm_loadu_ps(coefs1), c0)), c0);
+    }
+
+#if USE_AVX2
+    static inline __m256 interpolate(const float* coefs0, const float* coefs1, __m256 lerp) {
+        __m256 c0 = _mm256_loadu_ps(coefs0);
+        return _mm256_add_ps(_mm256_mul_ps(lerp, _mm256_sub_ps(_mm256_loadu_ps(coefs1), c0)), c0);
+    }
+#endif
+};
+
+#if USE_AVX2
+static inline __m256 macAvx(__m256 accum, __m256 a, __m256 b)
+{
+#ifdef __FMA__
+    return _mm256_fmadd_ps(a, b, accum);
+#else
+    return _mm256_add_ps(accum, _mm256_mul_ps(a, b));
+#endif
+}
+#endif
+
+/*
+ * The ProcessSse*() functions below follow ProcessBase(): 8 coefficients of each half
+ * of the filter are processed per loop iteration, so count must be a multiple of 8.
+ * sP has already been moved back to the lowest address of the 8 positive frames.
+ */
+
+// int16_t coefs, int16_t samples, int32_t output.
+
+template <typename TFUNC>
+static inline
+void ProcessSseMono(int32_t* const out,
+        int count,
+        const int16_t* coefsP,
+        const int16_t* coefsN,
+        const int16_t* coefsP1,
+        const int16_t* coefsN1,
+        const int16_t* sP,
+        const int16_t* sN,
+        uint32_t lerpP,
+        const int32_t* const volumeLR)
+{
+    const __m128i lerp = _mm_set1_epi16(static_cast<int16_t>(lerpP));
+    __m128i accum = _mm_setzero_si128();
+    do {
+        __m128i posCoefs = TFUNC::interpolatep(coefsP, coefsP1, lerp);
+        __m128i negCoefs = TFUNC::interpolaten(coefsN1, coefsN, lerp);
+        accum = _mm_add_epi32(accum, _mm_madd_epi16(reverseMonoS16Sse(loadSse(sP)), posCoefs));
+        __m128i negSamples = count > 8 ? loadSse(sN) : loadHeadSse<1>(sN);
+        accum = _mm_add_epi32(accum, _mm_madd_epi16(negSamples, negCoefs));
+        coefsP += 8;
+        coefsP1 += 8;
+        coefsN += 8;
+        coefsN1 += 8;
+        sP -= 8;
+        sN += 8;
+        count -= 8;
+    } while (count > 0);
+    int32_t l = sumS32Sse(accum);
+    out[0] += volumeAdjust(l, volumeLR[0]);
+    out[1] += volumeAdjust(l, volumeLR[1]);
+}
+
+template <typename TFUNC>
+static inline
+void ProcessSseStereo(int32_t* const out,
+        int count,
+        const int16_t* coefsP,
+        const int16_t* coefsN,
+        const int16_t* coefsP1,
+        const int16_t* coefsN1,
+        const int16_t* sP,
+        const int16_t* sN,
+        uint32_t lerpP,
+        const int32_t* const volumeLR)
+{
+    const __m128i lerp = _mm_set1_epi16(static_cast<int16_t>(lerpP));
+    __m128i accumL = _mm_setzero_si128();
+    __m128i accumR = _mm_setzero_si128();
+    do {
+        __m128i left, right;
+        __m128i posCoefs = TFUNC::interpolatep(coefsP, coefsP1, lerp);
+        __m128i negCoefs = TFUNC::interpolaten(coefsN1, coefsN, lerp);
+        deinterleaveS16Sse<true>(loadSse(sP), loadSse(sP + 8), left, right);
+        accumL = _mm_add_epi32(accumL, _mm_madd_epi16(left, posCoefs));
+        accumR = _mm_add_epi32(accumR, _mm_madd_epi16(right, posCoefs));
+        deinterleaveS16Sse<false>(loadSse(sN),
+                count > 8 ? loadSse(sN + 8) : loadHeadSse<2>(sN + 8), left, right);
+        accumL = _mm_add_epi32(accumL, _mm_madd_epi16(left, negCoefs));
+        accumR = _mm_add_epi32(accumR, _mm_madd_epi16(right, negCoefs));
+        coefsP += 8;
+        coefsP1 += 8;
+        coefsN += 8;
+        coefsN1 += 8;
+        sP -= 16;
+        sN += 16;
+        count -= 8;
+    } while (count > 0);
+    out[0] += volumeAdjust(sumS32Sse(accumL), volumeLR[0]);
+    out[1] += volumeAdjust(sumS32Sse(accumR), volumeLR[1]);
+}
+
+// int32_t coefs, int16_t samples, int32_t output.
+
+template <typename TFUNC>
+static inline
+void ProcessSseMono(int32_t* const out,
+        int count,
+        const int32_t* coefsP,
+        const int32_t* coefsN,
+        const int32_t* coefsP1,
+        const int32_t* coefsN1,
+        const int16_t* sP,
+        const int16_t* sN,
+        uint32_t lerpP,
+        const int32_t* const volumeLR)
+{
+    const __m128i lerp = _mm_set1_epi32(static_cast<int32_t>(lerpP));
+    __m128i accum = _mm_setzero_si128();
+    do {
+        __m128i samples = reverseMonoS16Sse(loadSse(sP));
+        accum = macS32Sse(accum, TFUNC::interpolatep(coefsP, coefsP1, lerp),
+                _mm_cvtepi16_epi32(samples));
+        accum = macS32Sse(accum, TFUNC::interpolatep(coefsP + 4, coefsP1 + 4, lerp),
+                _mm_cvtepi16_epi32(_mm_srli_si128(samples, 8)));
+        samples = count > 8 ? loadSse(sN) : loadHeadSse<1>(sN);
+        accum = macS32Sse(accum, TFUNC::interpolaten(coefsN1, coefsN, lerp),
+                _mm_cvtepi16_epi32(samples));
+        accum = macS32Sse(accum, TFUNC::interpolaten(coefsN1 + 4, coefsN + 4, lerp),
+                _mm_cvtepi16_epi32(_mm_srli_si128(samples, 8)));
+        coefsP += 8;
+        coefsP1 += 8;
+        coefsN += 8;
+        coefsN1 += 8;
+        sP -= 8;
+        sN += 8;
+        count -= 8;
+    } while (count > 0);
+    int32_t l = sumS64LowSse(accum);
+    out[0] += volumeAdjust(l, volumeLR[0]);
+    out[1] += volumeAdjust(l, volumeLR[1]);
+}
+
+template <typename TFUNC>
+static inline
+void ProcessSseStereo(int32_t* const out,
+        int count,
+        const int32_t* coefsP,
+        const int32_t* coefsN,
+        const int32_t* coefsP1,
+        const int32_t* coefsN1,
+        const int16_t* sP,
+        const int16_t* sN,
+        uint32_t lerpP,
+        const int32_t* const volumeLR)
+{
+    const __m128i lerp = _mm_set1_epi32(static_cast<int32_t>(lerpP));
+    __m128i accumL = _mm_setzero_si128();
+    __m128i accumR = _mm_setzero_si128();
+    do {
+        __m128i left, right;
+        __m128i coefs0 = TFUNC::interpolatep(coefsP, coefsP1, lerp);
+        __m128i coefs4 = TFUNC::interpolatep(coefsP + 4, coefsP1 + 4, lerp);
+        deinterleaveS16Sse<true>(loadSse(sP), loadSse(sP + 8), left, right);
+        accumL = macS32Sse(accumL, coefs0, _mm_cvtepi16_epi32(left));
+        accumL = macS32Sse(accumL, coefs4, _mm_cvtepi16_epi32(_mm_srli_si128(left, 8)));
+        accumR = macS32Sse(accumR, coefs0, _mm_cvtepi16_epi32(right));
+        accumR = macS32Sse(accumR, coefs4, _mm_cvtepi16_epi32(_mm_srli_si128(right, 8)));
+        coefs0 = TFUNC::interpolaten(coefsN1, coefsN, lerp);
+        coefs4 = TFUNC::interpolaten(coefsN1 + 4, coefsN + 4, lerp);
+        deinterleaveS16Sse<false>(loadSse(sN),
+                count > 8 ? loadSse(sN + 8) : loadHeadSse<2>(sN + 8), left, right);
+        accumL = macS32Sse(accumL, coefs0, _mm_cvtepi16_epi32(left));
+        accumL = macS32Sse(accumL, coefs4, _mm_cvtepi16_epi32(_mm_srli_si128(left, 8)));
+        accumR = macS32Sse(accumR, coefs0, _mm_cvtepi16_epi32(right));
+        accumR = macS32Sse(accumR, coefs4, _mm_cvtepi16_epi32(_mm_srli_si128(right, 8)));
+        coefsP += 8;
+        coefsP1 += 8;
+        coefsN += 8;
+        coefsN1 += 8;
+        sP -= 16;
+        sN += 16;
+        count -= 8;
+    } while (count > 0);
+    out[0] += volumeAdjust(sumS64LowSse(accumL), volumeLR[0]);
+    out[1] += volumeAdjust(sumS64LowSse(accumR), volumeLR[1]);
+}
+
+// float coefs, float samples, float output.
+
+template <typename TFUNC>
+static inline
+void ProcessSseMono(float* const out,
+        int count,
+        const float* coefsP,
+        const float* coefsN,
+        const float* coefsP1,
+        const float* coefsN1,
+        const float* sP,
+        const float* sN,
+        float lerpP,
+        const float* const volumeLR)
+{
+#if USE_AVX2
+    const __m256 lerp = _mm256_set1_ps(lerpP);
+    const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+    __m256 accum = _mm256_setzero_ps();
+    do {
+        accum = macAvx(accum, TFUNC::interpolatep(coefsP, coefsP1, lerp),
+                _mm256_permutevar8x32_ps(_mm256_loadu_ps(sP), reverse));
+        accum = macAvx(accum, TFUNC::interpolaten(coefsN1, coefsN, lerp),
+                count > 8 ? _mm256_loadu_ps(sN) : loadHeadAvx<1>(sN));
+        coefsP += 8;
+        coefsP1 += 8;
+        coefsN += 8;
+        coefsN1 += 8;
+        sP -= 8;
+        sN += 8;
+        count -= 8;
+    } while (count > 0);
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(accum), _mm256_extractf128_ps(accum, 1));
+#else
+    const __m128 lerp = _mm_set1_ps(lerpP);
+    __m128 sum = _mm_setzero_ps();
+    do {
+        __m128 samples = _mm_loadu_ps(sP + 4);
+        samples = _mm_shuffle_ps(samples, samples, _MM_SHUFFLE(0, 1, 2, 3));
+        sum = _mm_add_ps(sum, _mm_mul_ps(TFUNC::interpolatep(coefsP, coefsP1, lerp), samples));
+        samples = _mm_loadu_ps(sP);
+        samples = _mm_shuffle_ps(samples, samples, _MM_SHUFFLE(0, 1, 2, 3));
+        sum = _mm_add_ps(sum, _mm_mul_ps(
+                TFUNC::interpolatep(coefsP + 4, coefsP1 + 4, lerp), samples));
+        sum = _mm_add_ps(sum, _mm_mul_ps(
+                TFUNC::interpolaten(coefsN1, coefsN, lerp), _mm_loadu_ps(sN)));
+        sum = _mm_add_ps(sum, _mm_mul_ps(TFUNC::interpolaten(coefsN1 + 4, coefsN + 4, lerp),
+                count > 8 ? _mm_loadu_ps(sN + 4) : loadHeadSse<1>(sN + 4)));
+        coefsP += 8;
+        coefsP1 += 8;
+        coefsN += 8;
+        coefsN1 += 8;
+        sP -= 8;
+        sN += 8;
+        count -= 8;
+    } while (count > 0);
+#endif
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 1, 1, 1)));
+    float l = _mm_cvtss_f32(sum);
+    out[0] += volumeAdjust(l, volumeLR[0]);
+    out[1] += volumeAdjust(l, volumeLR[1]);
+}
+
+template <typename TFUNC>
+static inline
+void ProcessSseStereo(float* const out,
+        int count,
+        const float* coefsP,
+        const float* coefsN,
+        const float* coefsP1,
+        const float* coefsN1,
+        const float* sP,
+        const float* sN,
+        float lerpP,
+        const float* const volumeLR)
+{
+#if USE_AVX2
+    // the accumulator holds interleaved L R L R L R L R partial sums.
+    const __m256 lerp = _mm256_set1_ps(lerpP);
+    const __m256i dupReverseLo = _mm256_setr_epi32(3, 3, 2, 2, 1, 1, 0, 0);
+    const __m256i dupReverseHi = _mm256_setr_epi32(7, 7, 6, 6, 5, 5, 4, 4);
+    const __m256i dupLo = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+    const __m256i dupHi = _mm256_setr_epi32(4, 4, 5, 5, 6, 6, 7, 7);
+    __m256 accum = _mm256_setzero_ps();
+    do {
+        __m256 coefs = TFUNC::interpolatep(coefsP, coefsP1, lerp);
+        accum = macAvx(accum, _mm256_permutevar8x32_ps(coefs, dupReverseLo),
+                _mm256_loadu_ps(sP + 8));
+        accum = macAvx(accum, _mm256_permutevar8x32_ps(coefs, dupReverseHi),
+                _mm256_loadu_ps(sP));
+        coefs = TFUNC::interpolaten(coefsN1, coefsN, lerp);
+        accum = macAvx(accum, _mm256_permutevar8x32_ps(coefs, dupLo),
+                _mm256_loadu_ps(sN));
+        accum = macAvx(accum, _mm256_permutevar8x32_ps(coefs, dupHi),
+                count > 8 ? _mm256_loadu_ps(sN + 8) : loadHeadAvx<2>(sN + 8));
+        coefsP += 8;
+        coefsP1 += 8;
+        coefsN += 8;
+        coefsN1 += 8;
+        sP -= 16;
+        sN += 16;
+        count -= 8;
+    } while (count > 0);
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(accum), _mm256_extractf128_ps(accum, 1));
+#else
+    // the accumulator holds interleaved L R L R partial sums.
+    const __m128 lerp = _mm_set1_ps(lerpP);
+    __m128 sum = _mm_setzero_ps();
+    do {
+        for (int i = 0; i < 2; ++i) {
+            __m128 coefs = TFUNC::interpolatep(coefsP, coefsP1, lerp);
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_shuffle_ps(coefs, coefs, _MM_SHUFFLE(0, 0, 1, 1)),
+                    _mm_loadu_ps(sP + 12)));
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_shuffle_ps(coefs, coefs, _MM_SHUFFLE(2, 2, 3, 3)),
+                    _mm_loadu_ps(sP + 8)));
+            coefs = TFUNC::interpolaten(coefsN1, coefsN, lerp);
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_unpacklo_ps(coefs, coefs), _mm_loadu_ps(sN)));
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_unpackhi_ps(coefs, coefs),
+                    count > 8 || i == 0 ? _mm_loadu_ps(sN + 4) : loadHeadSse<2>(sN + 4)));
+            coefsP += 4;
+            coefsP1 += 4;
+            coefsN += 4;
+            coefsN1 += 4;
+            sP -= 8;
+            sN += 8;
+        }
+        count -= 8;
+    } while (count > 0);
+#endif
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    out[0] += volumeAdjust(_mm_cvtss_f32(sum), volumeLR[0]);
+    out[1] += volumeAdjust(_mm_cvtss_f32(_mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 1, 1, 1))),
+            volumeLR[1]);
+}
+
+/*
+ * Process() and ProcessL() specializations.
+ */
+
+template <>
+inline void ProcessL<1, 16>(int32_t* const out,
+        int count,
+        const int16_t* coefsP,
+        const int16_t* coefsN,
+        const int16_t* sP,
+        const int16_t* sN,
+        const int32_t* const volumeLR)
+{
+    const int CHANNELS = 1; // template specialization does not preserve params
+    const int STRIDE = 16;
+    sP -= CHANNELS*((STRIDE>>1)-1);
+    ProcessSseMono<InterpNullSse>(out, count, coefsP, coefsN, coefsP + count, coefsN + count,
+            sP, sN, 0, volumeLR);
+}
+
+template <>
+inline void ProcessL<2, 16>(int32_t* const out,
+        int count,
+        const int16_t* coefsP,
+        const int16_t* coefsN,
+        const int16_t* sP,
+        const int16_t* sN,
+        const int32_t* const volumeLR)
+{
+    const int CHANNELS = 2; // template specialization does not preserve params
+    const int STRIDE = 16;
+    sP -= CHANNELS*((STRIDE>>1)-1);
+    ProcessSseStereo<InterpNullSse>(out, count, coefsP, coefsN, coefsP + count, coefsN + count,
+            sP, sN, 0, volumeLR);
+}
+
+template <>
+inline void Process<1, 16>(int32_t* const out,
+        int count,
+        const int16_t* coefsP,
+        const int16_t* coefsN,
+        const int16_t* coefsP1,
+        const int16_t* coefsN1,
+        const int16_t* sP,
+        const int16_t* sN,
+        uint32_t lerpP,
+        const int32_t* const volumeLR)
+{
+    const int CHANNELS = 1; // template specialization does not preserve params
+    const int STRIDE = 16;
+    sP -= CHANNELS*((STRIDE>>1)-1);
+    ProcessSseMono<InterpComputeSse>(out, count, coefsP, coefsN, coefsP1, coefsN1,
+            sP, sN, lerpP, volumeLR);
+}
+
+template <>
+inline void Process<2, 16>(int32_t* const out,
+        int count,
+        const int16_t* coefsP,
+        const int16_t* coefsN,
+        const int16_t* coefsP1,
+        const int16_t* coefsN1,
+        const int16_t* sP,
+        const int16_t* sN,
+        uint32_t lerpP,
+        const int32_t* const volumeLR)
+{
+    const int CHANNELS = 2; // template specialization does not preserve params
+    const int STRIDE = 16;
+    sP -= CHANNELS*((STRIDE>>1)-1);
+    ProcessSseStereo<InterpComputeSse>(out, count, coefsP, coefsN, coefsP1, coefsN1,
+            sP, sN, lerpP, volumeLR);
+}
+
+template <>
+inline void ProcessL<1, 16>(int32_t* const out,
+        int count,
+        const int32_t* coefsP,
+        const int32_t* coefsN,
+        const int16_t* sP,
+        const int16_t* sN,
+        const int32_t* const volumeLR)
+{
+    const int CHANNELS = 1; // template specialization does not preserve params
+    const int STRIDE = 16;
+    sP -= CHANNELS*((STRIDE>>1)-1);
+    ProcessSseMono<InterpNullSse>(out, count, coefsP, coefsN, coefsP + count, coefsN + count,
+            sP, sN, 0, volumeLR);
+}
+
+template <>
+inline void ProcessL<2, 16>(int32_t* const out,
+        int count,
+        const int32_t* coefsP,
+        const int32_t* coefsN,
+        const int16_t* sP,
+        const int16_t* sN,
+        const int32_t* const volumeLR)
+{
+    const int CHANNELS = 2; // template specialization does not preserve params
+    const int STRIDE = 16;
+    sP -= CHANNELS*((STRIDE>>1)-1);
+    ProcessSseStereo<InterpNullSse>(out, count, coefsP, coefsN, coefsP + count, coefsN + count,
+            sP, sN, 0, volumeLR);
+}
+
+template <>
+inline void Process<1, 16>(int32_t* const out,
+        int count,
+        const int32_t* coefsP,
+        const int32_t* coefsN,
+        const int32_t* coefsP1,
+        const int32_t* coefsN1,
+        const int16_t* sP,
+        const int16_t* sN,
+        uint32_t lerpP,
+        const int32_t* const volumeLR)
+{
+    const int CHANNELS = 1; // template specialization does not preserve params
+    const int STRIDE = 16;
+    sP -= CHANNELS*((STRIDE>>1)-1);
+    ProcessSseMono<InterpComputeSse>(out, count, coefsP, coefsN, coefsP1, coefsN1,
+            sP, sN, lerpP, volumeLR);
+}
+
+template <>
+inline void Process<2, 16>(int32_t* const out,
+        int count,
+        const int32_t* coefsP,
+        const int32_t* coefsN,
+        const int32_t* coefsP1,
+        const int32_t* coefsN1,
+        const int16_t* sP,
+        const int16_t* sN,
+        uint32_t lerpP,
+        const int32_t* const volumeLR)
+{
+    const int CHANNELS = 2; // template specialization does not preserve params
+    const int STRIDE = 16;
+    sP -= CHANNELS*((STRIDE>>1)-1);
+    ProcessSseStereo<InterpComputeSse>(out, count, coefsP, coefsN, coefsP1, coefsN1,
+            sP, sN, lerpP, volumeLR);
+}
+
+template <>
+inline void ProcessL<1, 16>(float* const out,
+        int count,
+        const float* coefsP,
+        const float* coefsN,
+        const float* sP,
+        const float* sN,
+        const float* const volumeLR)
+{
+    const int CHANNELS = 1; // template specialization does not preserve params
+    const int STRIDE = 16;
+    sP -= CHANNELS*((STRIDE>>1)-1);
+    ProcessSseMono<InterpNullSse>(out, count, coefsP, coefsN, coefsP + count, coefsN + count,
+            sP, sN, 0.f, volumeLR);
+}
+
+template <>
+inline void ProcessL<2, 16>(float* const out,
+        int count,
+        const float* coefsP,
+        const float* coefsN,
+        const float* sP,
+        const float* sN,
+        const float* const volumeLR)
+{
+    const int CHANNELS = 2; // template specialization does not preserve params
+    const int STRIDE = 16;
+    sP -= CHANNELS*((STRIDE>>1)-1);
+    ProcessSseStereo<InterpNullSse>(out, count, coefsP, coefsN, coefsP + count, coefsN + count,
+            sP, sN, 0.f, volumeLR);
+}
+
+template <>
+inline void Process<1, 16>(float* const out,
+        int count,
+        const float* coefsP,
+        const float* coefsN,
+        const float* coefsP1,
+        const float* coefsN1,
+        const float* sP,
+        const float* sN,
+        float lerpP,
+        const float* const volumeLR)
+{
+    const int CHANNELS = 1; // template specialization does not preserve params
+    const int STRIDE = 16;
+    sP -= CHANNELS*((STRIDE>>1)-1);
+    ProcessSseMono<InterpComputeSse>(out, count, coefsP, coefsN, coefsP1, coefsN1,
+            sP, sN, lerpP, volumeLR);
+}
+
+template <>
+inline void Process<2, 16>(float* const out,
+        int count,
+        const float* coefsP,
+        const float* coefsN,
+        const float* coefsP1,
+        const float* coefsN1,
+        const float* sP,
+        const float* sN,
+        float lerpP,
+        const float* const volumeLR)
+{
+    const int CHANNELS = 2; // template specialization does not preserve params
+    const int STRIDE = 16;
+    sP -= CHANNELS*((STRIDE>>1)-1);
+    ProcessSseStereo<InterpComputeSse>(out, count, coefsP, coefsN, coefsP1, coefsN1,
+            sP, sN, lerpP, volumeLR);
+}
+
+}; // namespace android
+
+#endif //USE_SSE
+
+#endif /*ANDROID_AUDIO_RESAMPLER_FIR_PROCESS_SSE_H*/
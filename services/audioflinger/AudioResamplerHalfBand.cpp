@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "AudioResamplerHalfBand"
+//#define LOG_NDEBUG 0
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cutils/compiler.h>
+#include <cutils/log.h>
+
+#include "AudioResamplerFirOps.h"
+#include "AudioResamplerFirGen.h" // requires math.h
+#include "AudioResamplerHalfBand.h"
+
+namespace android {
+
+float AudioHalfBandCascade::sCoefs[kHalfTaps];
+
+static pthread_once_t sCoefsOnce = PTHREAD_ONCE_INIT;
+
+// Kaiser windowed sinc, about 100 dB of stop band attenuation for the 31 taps
+void AudioHalfBandCascade::initCoefs()
+{
+    static const double beta = 10.;
+    const double halfSpan = 2. * kHalfTaps;
+    double sum = 0.;
+    double coefs[kHalfTaps];
+    for (int i = 0; i < kHalfTaps; i++) {
+        double n = 2. * i + 1.;
+        double x = M_PI * n / 2.;
+        coefs[i] = 0.5 * sin(x) / x * I0(beta * sqrt(1. - sqr(n / halfSpan))) / I0(beta);
+        sum += coefs[i];
+    }
+    // unity gain at DC: the center coefficient is 0.5, and each side adds up to 0.25
+    for (int i = 0; i < kHalfTaps; i++) {
+        sCoefs[i] = coefs[i] * 0.25 / sum;
+    }
+}
+
+AudioHalfBandCascade::AudioHalfBandCascade()
+    : mChannelCount(0), mStages(0), mDecimate(false)
+{
+    pthread_once(&sCoefsOnce, initCoefs);
+    for (int i = 0; i < kMaxStages; i++) {
+        mWork[i] = NULL;
+        mWorkFrames[i] = 0;
+    }
+}
+
+AudioHalfBandCascade::~AudioHalfBandCascade()
+{
+    configure(0, 0, false);
+}
+
+void AudioHalfBandCascade::configure(int channelCount, int stages, bool decimate)
+{
+    LOG_ALWAYS_FATAL_IF(stages < 0 || stages > kMaxStages, "invalid stage count %d", stages);
+    if (channelCount != mChannelCount || stages != mStages) {
+        for (int i = 0; i < kMaxStages; i++) {
+            free(mWork[i]);
+            mWork[i] = NULL;
+        }
+        for (int i = 0; i < stages; i++) {
+            mWork[i] = (float*) malloc((kMaxFrames + kDecimateSpan) * channelCount * sizeof(float));
+        }
+    }
+    mChannelCount = channelCount;
+    mStages = stages;
+    mDecimate = decimate;
+    reset();
+}
+
+void AudioHalfBandCascade::reset()
+{
+    // start with silence as history, so that output starts right away
+    const size_t history = mDecimate ? kDecimateSpan - 1 : kInterpolateHistory;
+    for (int i = 0; i < mStages; i++) {
+        memset(mWork[i], 0, history * mChannelCount * sizeof(float));
+        mWorkFrames[i] = history;
+    }
+}
+
+size_t AudioHalfBandCascade::decimate(float* out, const float* in, size_t inFrames)
+{
+    const int channels = mChannelCount;
+    memcpy(mWork[0] + mWorkFrames[0] * channels, in, inFrames * channels * sizeof(float));
+    size_t frames = inFrames;
+    for (int s = 0; s < mStages; s++) {
+        float* work = mWork[s];
+        const size_t total = mWorkFrames[s] + frames;
+        const size_t outFrames = total >= (size_t) kDecimateSpan ?
+                (total - kDecimateSpan) / 2 + 1 : 0;
+        float* dst = s + 1 < mStages ? mWork[s + 1] + mWorkFrames[s + 1] * channels : out;
+        for (size_t m = 0; m < outFrames; m++) {
+            const float* center = work + (2 * m + 2 * kHalfTaps - 1) * channels;
+            for (int c = 0; c < channels; c++) {
+                float acc = 0.5f * center[c];
+                for (int i = 0; i < kHalfTaps; i++) {
+                    const int offset = (2 * i + 1) * channels;
+                    acc += sCoefs[i] * (center[c - offset] + center[c + offset]);
+                }
+                *dst++ = acc;
+            }
+        }
+        // keep what the next outputs need
+        const size_t consumed = 2 * outFrames;
+        memmove(work, work + consumed * channels, (total - consumed) * channels * sizeof(float));
+        mWorkFrames[s] = total - consumed;
+        frames = outFrames;
+    }
+    return frames;
+}
+
+void AudioHalfBandCascade::interpolate(float* out, const float* in, size_t inFrames)
+{
+    const int channels = mChannelCount;
+    LOG_ALWAYS_FATAL_IF((inFrames << mStages) > kMaxFrames, "interpolate() of %zu frames",
+            inFrames);
+    memcpy(mWork[0] + kInterpolateHistory * channels, in, inFrames * channels * sizeof(float));
+    size_t frames = inFrames;
+    for (int s = 0; s < mStages; s++) {
+        float* work = mWork[s];
+        float* dst = s + 1 < mStages ? mWork[s + 1] + kInterpolateHistory * channels : out;
+        for (size_t m = 0; m < frames; m++) {
+            // the even output is the input delayed, the odd one lies halfway to the next input
+            const float* center = work + (m + kHalfTaps - 1) * channels;
+            for (int c = 0; c < channels; c++) {
+                dst[c] = center[c];
+                float acc = 0.f;
+                for (int i = 0; i < kHalfTaps; i++) {
+                    acc += sCoefs[i] * (center[c - i * channels] + center[c + (i + 1) * channels]);
+                }
+                dst[channels + c] = 2.f * acc;
+            }
+            dst += 2 * channels;
+        }
+        memmove(work, work + frames * channels, kInterpolateHistory * channels * sizeof(float));
+        frames *= 2;
+    }
+}
+
+}; // namespace android
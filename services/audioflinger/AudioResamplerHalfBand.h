@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_RESAMPLER_HALF_BAND_H
+#define ANDROID_AUDIO_RESAMPLER_HALF_BAND_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace android {
+
+/* AudioHalfBandCascade
+ *
+ * A cascade of 2x decimation or interpolation stages on interleaved float frames,
+ * used by AudioResamplerDyn for rate ratios of 4 and more, so that its polyphase
+ * filter only converts the remaining ratio, between 2 and 4.
+ *
+ * Each stage is a half-band FIR: every other coefficient but the center one is zero
+ * and the rest are symmetric, so a stage costs kHalfTaps multiplies per channel and
+ * output frame of a decimator, or per channel and pair of output frames of an
+ * interpolator. The filter passes up to 1/8 of the higher rate and rejects from 3/8,
+ * which is enough as long as the signal within the cascade is band limited to a
+ * quarter of the lower rate of each stage, which the stage count selection ensures.
+ */
+class AudioHalfBandCascade {
+public:
+    // maximum frames at the higher rate of the cascade per decimate() or interpolate()
+    static const size_t kMaxFrames = 1024;
+    static const int kMaxStages = 6;
+
+    AudioHalfBandCascade();
+    ~AudioHalfBandCascade();
+
+    // Sets the number of stages, 0 disables, and clears the filter state.
+    void configure(int channelCount, int stages, bool decimate);
+    void reset();
+    int getStages() const { return mStages; }
+
+    // Decimates inFrames <= kMaxFrames frames, returns the number of frames written to out.
+    // Input frames that do not make a whole output frame are kept for the next call.
+    size_t decimate(float* out, const float* in, size_t inFrames);
+
+    // Interpolates inFrames frames into inFrames << stages <= kMaxFrames frames.
+    void interpolate(float* out, const float* in, size_t inFrames);
+
+private:
+    // non-zero coefficients on each side of the center
+    static const int kHalfTaps = 8;
+    // input frames spanned by one decimator output, and input history of an interpolator
+    static const int kDecimateSpan = 4 * kHalfTaps - 1;
+    static const int kInterpolateHistory = 2 * kHalfTaps - 1;
+
+    static void initCoefs();
+    static float sCoefs[kHalfTaps];     // coefficients at center offsets 1, 3, 5...
+
+    // prevent copying
+    AudioHalfBandCascade(const AudioHalfBandCascade&);
+    AudioHalfBandCascade& operator=(const AudioHalfBandCascade&);
+
+    int     mChannelCount;
+    int     mStages;
+    bool    mDecimate;
+    float*  mWork[kMaxStages];          // per stage history followed by the stage input
+    size_t  mWorkFrames[kMaxStages];    // frames of history in mWork
+};
+
+}; // namespace android
+
+#endif /*ANDROID_AUDIO_RESAMPLER_HALF_BAND_H*/
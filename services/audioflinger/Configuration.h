@@ -33,9 +33,6 @@
 #define FAST_MIXER_STATISTICS
 // FIXME rename to FAST_THREAD_STATISTICS
 
-// uncomment for debugging timing problems related to StateQueue::push()
-//#define STATE_QUEUE_DUMP
-
 // uncomment to allow tee sink debugging to be enabled by property
 //#define TEE_SINK
 
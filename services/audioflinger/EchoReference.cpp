@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "EchoReference"
+//#define LOG_NDEBUG 0
+
+#include <stdlib.h>
+#include <utils/Log.h>
+#include <media/AudioBufferProvider.h>
+#include <audio_utils/primitives.h>
+#include "EchoReference.h"
+
+namespace android {
+
+EchoReference::EchoReference(uint32_t sampleRate, uint32_t channelCount, size_t frameCount)
+    : mSampleRate(sampleRate), mChannelCount(channelCount),
+      mConvertBuffer(NULL),
+      mTimestampMutator(&mTimestampShared),
+      mTimestampObserver(&mTimestampShared),
+      mTimestampValid(false),
+      mMaxWriteFrames(0)
+{
+    ALOG_ASSERT(channelCount == 1 || channelCount == 2);
+    const NBAIO_Format format = Format_from_SR_C(sampleRate, channelCount, AUDIO_FORMAT_PCM_16_BIT);
+    mPipe = new MonoPipe(frameCount, format, false /*writeCanBlock*/);
+    const NBAIO_Format offers[1] = {format};
+    size_t numCounterOffers = 0;
+    ssize_t index = mPipe->negotiate(offers, 1, NULL, numCounterOffers);
+    ALOG_ASSERT(index == 0);
+    mReader = new MonoPipeReader(mPipe.get());
+    numCounterOffers = 0;
+    index = mReader->negotiate(offers, 1, NULL, numCounterOffers);
+    ALOG_ASSERT(index == 0);
+    mConvertBuffer = (int16_t *) malloc(kConvertFrames * channelCount * sizeof(int16_t));
+}
+
+EchoReference::~EchoReference()
+{
+    free(mConvertBuffer);
+}
+
+void EchoReference::write(const void *buffer, audio_format_t format, uint32_t channelCount,
+        size_t frames, int64_t renderNs)
+{
+    if (format != AUDIO_FORMAT_PCM_16_BIT && format != AUDIO_FORMAT_PCM_FLOAT) {
+        return;
+    }
+    AudioTimestamp timestamp;
+    timestamp.mPosition = (uint32_t) mPipe->framesWritten();
+    timestamp.mTime.tv_sec = renderNs / 1000000000LL;
+    timestamp.mTime.tv_nsec = renderNs % 1000000000LL;
+    mTimestampMutator.push(timestamp);
+    if (frames > (size_t) mMaxWriteFrames) {
+        android_atomic_release_store((int32_t) frames, &mMaxWriteFrames);
+    }
+
+    // Keep the first two channels, and fold them for a mono capture.  Only the channels that
+    // reach the loudspeaker matter, and the primary output is stereo in practice.
+    const int16_t *src16 = (const int16_t *) buffer;
+    const float *srcFloat = (const float *) buffer;
+    const uint32_t right = channelCount > 1 ? 1 : 0;
+    while (frames > 0) {
+        const size_t count = frames < kConvertFrames ? frames : kConvertFrames;
+        int16_t *dst = mConvertBuffer;
+        for (size_t i = 0; i < count; i++) {
+            int32_t l, r;
+            if (format == AUDIO_FORMAT_PCM_16_BIT) {
+                l = src16[0];
+                r = src16[right];
+                src16 += channelCount;
+            } else {
+                l = clamp16_from_float(srcFloat[0]);
+                r = clamp16_from_float(srcFloat[right]);
+                srcFloat += channelCount;
+            }
+            if (mChannelCount == 1) {
+                *dst++ = (l + r) >> 1;
+            } else {
+                *dst++ = l;
+                *dst++ = r;
+            }
+        }
+        ssize_t written = mPipe->write(mConvertBuffer, count);
+        if (written < (ssize_t) count) {
+            // the reader is behind, what follows would not line up with the timestamp either
+            ALOGV("dropped %zu frames", frames - (written > 0 ? written : 0));
+            break;
+        }
+        frames -= count;
+    }
+}
+
+ssize_t EchoReference::read(int16_t *buffer, size_t frames, int64_t *renderNs)
+{
+    if (mTimestampObserver.poll(mTimestamp)) {
+        mTimestampValid = true;
+    }
+    const uint32_t position = (uint32_t) mReader->framesRead();
+    const ssize_t framesRead = mReader->read(buffer, frames, AudioBufferProvider::kInvalidPTS);
+    if (!mTimestampValid) {
+        *renderNs = -1;
+    } else {
+        // the difference of positions is signed, the frame read may precede the timestamp
+        const int32_t delta = (int32_t) (position - mTimestamp.mPosition);
+        *renderNs = mTimestamp.mTime.tv_sec * 1000000000LL + mTimestamp.mTime.tv_nsec +
+                (delta * 1000000000LL) / mSampleRate;
+    }
+    return framesRead;
+}
+
+void EchoReference::discard(size_t keepFrames)
+{
+    int16_t scratch[kConvertFrames * 2];
+    ssize_t available = mReader->availableToRead();
+    while (available > (ssize_t) keepFrames) {
+        size_t count = available - keepFrames;
+        if (count > kConvertFrames) {
+            count = kConvertFrames;
+        }
+        ssize_t framesRead = mReader->read(scratch, count, AudioBufferProvider::kInvalidPTS);
+        if (framesRead <= 0) {
+            break;
+        }
+        available -= framesRead;
+    }
+}
+
+}   // namespace android
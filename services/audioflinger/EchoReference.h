@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUDIO_ECHO_REFERENCE_H
+#define ANDROID_AUDIO_ECHO_REFERENCE_H
+
+#include <cutils/atomic.h>
+#include <system/audio.h>
+#include <utils/RefBase.h>
+#include <media/nbaio/MonoPipe.h>
+#include <media/nbaio/MonoPipeReader.h>
+
+namespace android {
+
+// The playback reference for echo cancellation hosted by AudioFlinger, see
+// FastCapture::processEchoReference().  The primary playback thread writes each mix period,
+// converted to 16-bit PCM at the channel count of the capture, together with the time at which
+// the period will be rendered; the fast capture thread reads it and passes it to the reverse
+// stream of the pre-processing engines.
+//
+// Like MonoPipe there is a single writer and a single reader, which can be different threads,
+// and neither side blocks: the writer drops what does not fit, the reader gets what is there.
+class EchoReference : public RefBase {
+public:
+    EchoReference(uint32_t sampleRate, uint32_t channelCount, size_t frameCount);
+    virtual ~EchoReference();
+
+    uint32_t    sampleRate() const { return mSampleRate; }
+    uint32_t    channelCount() const { return mChannelCount; }
+
+    // Writer side.  Writes 'frames' frames of 'buffer', in 'format' with 'channelCount'
+    // channels at sampleRate(); 'renderNs' is the CLOCK_MONOTONIC time at which the first
+    // of them is expected to be rendered.  Only 16-bit and float PCM are supported.
+    void        write(const void *buffer, audio_format_t format, uint32_t channelCount,
+                        size_t frames, int64_t renderNs);
+
+    // Reader side.  Reads at most 'frames' frames into 'buffer', and sets '*renderNs' to the
+    // expected render time of the first frame read, or -1 if the writer has not told yet.
+    // Returns the number of frames read.
+    ssize_t     read(int16_t *buffer, size_t frames, int64_t *renderNs);
+    ssize_t     availableToRead() { return mReader->availableToRead(); }
+    // Drops frames so that no more than 'keepFrames' remain available to read.
+    void        discard(size_t keepFrames);
+    // Largest number of frames written at once, an estimate of the writer's burst size.
+    size_t      maxWriteFrames() const
+                        { return (size_t) android_atomic_acquire_load(&mMaxWriteFrames); }
+
+private:
+    // frames converted per pass by write(), bounds mConvertBuffer
+    static const size_t kConvertFrames = 256;
+
+    const uint32_t      mSampleRate;
+    const uint32_t      mChannelCount;
+    sp<MonoPipe>        mPipe;
+    sp<MonoPipeReader>  mReader;
+
+    // accessed by the writer only
+    int16_t             *mConvertBuffer;    // kConvertFrames frames, see write()
+
+    // Position of a frame in frames written, and its render time, pushed by the writer on
+    // each write and observed by the reader to time the frames it reads.
+    AudioTimestampSingleStateQueue::Shared      mTimestampShared;
+    AudioTimestampSingleStateQueue::Mutator     mTimestampMutator;
+    AudioTimestampSingleStateQueue::Observer    mTimestampObserver;
+    AudioTimestamp      mTimestamp;         // last observed by the reader
+    bool                mTimestampValid;    // accessed by the reader only
+
+    volatile int32_t    mMaxWriteFrames;
+};
+
+}   // namespace android
+
+#endif  // ANDROID_AUDIO_ECHO_REFERENCE_H
@@ -70,6 +70,8 @@ AudioFlinger::EffectModule::EffectModule(ThreadBase *thread,
       // mMaxDisableWaitCnt is set by configure() and not used before then
       // mDisableWaitCnt is set by process() and updateState() and not used before then
       mSuspended(false),
+      mAddedToHal(false),
+      mFloatRejected(false),
 #ifdef QCOM_DIRECTTRACK
       mAudioFlinger(thread->mAudioFlinger),
       mIsForLPA(false)
@@ -304,10 +306,18 @@ void AudioFlinger::EffectModule::process()
         sp<EffectChain> chain = mChain.promote();
         if (chain != 0 && chain->activeTrackCnt() != 0) {
             size_t frameCnt = mConfig.inputCfg.buffer.frameCount * 2;  //always stereo here
-            int16_t *in = mConfig.inputCfg.buffer.s16;
-            int16_t *out = mConfig.outputCfg.buffer.s16;
-            for (size_t i = 0; i < frameCnt; i++) {
-                out[i] = clamp16((int32_t)out[i] + (int32_t)in[i]);
+            if (mConfig.outputCfg.format == AUDIO_FORMAT_PCM_FLOAT) {
+                float *in = (float *) mConfig.inputCfg.buffer.raw;
+                float *out = (float *) mConfig.outputCfg.buffer.raw;
+                for (size_t i = 0; i < frameCnt; i++) {
+                    out[i] += in[i];
+                }
+            } else {
+                int16_t *in = mConfig.inputCfg.buffer.s16;
+                int16_t *out = mConfig.outputCfg.buffer.s16;
+                for (size_t i = 0; i < frameCnt; i++) {
+                    out[i] = clamp16((int32_t)out[i] + (int32_t)in[i]);
+                }
             }
         }
     }
@@ -330,8 +340,10 @@ status_t AudioFlinger::EffectModule::configure()
     status_t status;
     status_t cmdStatus = 0;
     sp<ThreadBase> thread;
+    sp<EffectChain> chain;
     uint32_t size;
     audio_channel_mask_t channelMask;
+    audio_format_t format;
 #ifdef QCOM_DIRECTTRACK
     uint32_t channels;
 #endif
@@ -364,8 +376,16 @@ status_t AudioFlinger::EffectModule::configure()
         mConfig.inputCfg.channels = channelMask;
     }
     mConfig.outputCfg.channels = channelMask;
-    mConfig.inputCfg.format = AUDIO_FORMAT_PCM_16_BIT;
-    mConfig.outputCfg.format = AUDIO_FORMAT_PCM_16_BIT;
+    // Insert effects follow a float chain unless they already refused float once
+    chain = mChain.promote();
+    if (chain != 0 && chain->bufferFormat() == AUDIO_FORMAT_PCM_FLOAT && !mFloatRejected &&
+            (mDescriptor.flags & EFFECT_FLAG_TYPE_MASK) == EFFECT_FLAG_TYPE_INSERT) {
+        format = AUDIO_FORMAT_PCM_FLOAT;
+    } else {
+        format = AUDIO_FORMAT_PCM_16_BIT;
+    }
+    mConfig.inputCfg.format = format;
+    mConfig.outputCfg.format = format;
 #ifdef QCOM_DIRECTTRACK
     if(isForLPA){
         mConfig.inputCfg.samplingRate = sampleRate;
@@ -423,6 +443,23 @@ status_t AudioFlinger::EffectModule::configure()
     if (status == 0) {
         status = cmdStatus;
     }
+    if (status != 0 && format == AUDIO_FORMAT_PCM_FLOAT) {
+        // the engine is 16-bit only: remember so that the chain falls back to 16-bit
+        ALOGV("configure() %p effect %s refused float", this, mDescriptor.name);
+        mFloatRejected = true;
+        mConfig.inputCfg.format = AUDIO_FORMAT_PCM_16_BIT;
+        mConfig.outputCfg.format = AUDIO_FORMAT_PCM_16_BIT;
+        size = sizeof(int);
+        status = (*mEffectInterface)->command(mEffectInterface,
+                                                       EFFECT_CMD_SET_CONFIG,
+                                                       sizeof(effect_config_t),
+                                                       &mConfig,
+                                                       &size,
+                                                       &cmdStatus);
+        if (status == 0) {
+            status = cmdStatus;
+        }
+    }
 
     if (status == 0 &&
             (memcmp(&mDescriptor.type, SL_IID_VISUALIZATION, sizeof(effect_uuid_t)) == 0)) {
@@ -483,9 +520,16 @@ void AudioFlinger::EffectModule::addEffectToHal_l()
          (mDescriptor.flags & EFFECT_FLAG_TYPE_MASK) == EFFECT_FLAG_TYPE_POST_PROC) {
         sp<ThreadBase> thread = mThread.promote();
         if (thread != 0) {
+            // pre-processing hosted by the fast capture thread is applied by the RecordThread,
+            // which calls back here if the fast capture can no longer afford it
+            if ((mDescriptor.flags & EFFECT_FLAG_TYPE_MASK) == EFFECT_FLAG_TYPE_PRE_PROC &&
+                    thread->preProcessingOnFastCapture()) {
+                return;
+            }
             audio_stream_t *stream = thread->stream();
             if (stream != NULL) {
                 stream->add_audio_effect(stream, mEffectInterface);
+                mAddedToHal = true;
             }
         }
     }
@@ -566,6 +610,7 @@ status_t AudioFlinger::EffectModule::remove_effect_from_hal_l()
             audio_stream_t *stream = thread->stream();
             if (stream != NULL) {
                 stream->remove_audio_effect(stream, mEffectInterface);
+                mAddedToHal = false;
             }
         }
     }
@@ -1060,6 +1105,13 @@ void AudioFlinger::EffectModule::dump(int fd, const Vector<String16>& args __unu
             formatToString((audio_format_t)mConfig.outputCfg.format));
     result.append(buffer);
 
+    if (mCost.n() > 0) {
+        snprintf(buffer, SIZE, "\t\t- CPU cost in us per process: mean %.1f stddev %.1f"
+                " max %.1f (%u calls)\n",
+                mCost.mean() * .001, mCost.stddev() * .001, mCost.maximum() * .001, mCost.n());
+        result.append(buffer);
+    }
+
     snprintf(buffer, SIZE, "\t\t%zu Clients:\n", mHandles.size());
     result.append(buffer);
     result.append("\t\t\t  Pid Priority Ctrl Locked client server\n");
@@ -1405,7 +1457,8 @@ void AudioFlinger::EffectHandle::dumpToBuffer(char* buffer, size_t size)
 AudioFlinger::EffectChain::EffectChain(ThreadBase *thread,
                                         int sessionId)
     : mThread(thread), mSessionId(sessionId), mActiveTrackCnt(0), mTrackCnt(0), mTailBufferCount(0),
-      mOwnInBuffer(false), mVolumeCtrlIdx(-1), mLeftVolume(UINT_MAX), mRightVolume(UINT_MAX),
+      mOwnInBuffer(false), mBufferFormat(AUDIO_FORMAT_PCM_16_BIT),
+      mVolumeCtrlIdx(-1), mLeftVolume(UINT_MAX), mRightVolume(UINT_MAX),
 #ifdef QCOM_DIRECTTRACK
       mNewLeftVolume(UINT_MAX), mNewRightVolume(UINT_MAX), mForceVolume(false), mIsForLPATrack(false)
 #else
@@ -1456,7 +1509,6 @@ sp<AudioFlinger::EffectModule> AudioFlinger::EffectChain::getEffectFromId_l(int
     return 0;
 }
 
-#ifdef QCOM_DIRECTTRACK
 sp<AudioFlinger::EffectModule> AudioFlinger::EffectChain::getEffectFromIndex_l(int idx)
 {
     sp<EffectModule> effect = NULL;
@@ -1468,7 +1520,6 @@ sp<AudioFlinger::EffectModule> AudioFlinger::EffectChain::getEffectFromIndex_l(i
     }
     return effect;
 }
-#endif
 
 // getEffectFromType_l() must be called with ThreadBase::mLock held
 sp<AudioFlinger::EffectModule> AudioFlinger::EffectChain::getEffectFromType_l(
@@ -1503,12 +1554,49 @@ void AudioFlinger::EffectChain::clearInputBuffer_l(sp<ThreadBase> thread)
     // Currently effects processing is only available for stereo, AUDIO_FORMAT_PCM_16_BIT
     // (4 bytes frame size)
     const size_t frameSize =
-            audio_bytes_per_sample(AUDIO_FORMAT_PCM_16_BIT) * min(FCC_2, thread->channelCount());
+            audio_bytes_per_sample(mBufferFormat) * min(FCC_2, thread->channelCount());
     memset(mInBuffer, 0, thread->frameCount() * frameSize);
 }
 
+// setBufferFormat_l() must be called with ThreadBase::mLock held
+void AudioFlinger::EffectChain::setBufferFormat_l(audio_format_t format)
+{
+    Mutex::Autolock _l(mLock);
+    if (format == mBufferFormat) {
+        return;
+    }
+    ALOGV("setBufferFormat_l() chain %p session %d format %#x", this, mSessionId, format);
+    mBufferFormat = format;
+    for (size_t i = 0; i < mEffects.size(); i++) {
+        mEffects[i]->configure();
+    }
+}
+
+// supportsFloat_l() must be called with ThreadBase::mLock held
+bool AudioFlinger::EffectChain::supportsFloat_l()
+{
+    Mutex::Autolock _l(mLock);
+    for (size_t i = 0; i < mEffects.size(); i++) {
+        if ((mEffects[i]->desc().flags & EFFECT_FLAG_TYPE_MASK) != EFFECT_FLAG_TYPE_INSERT ||
+                mEffects[i]->floatRejected()) {
+            return false;
+        }
+    }
+    return true;
+}
+
 // Must be called with EffectChain::mLock locked
 void AudioFlinger::EffectChain::process_l()
+{
+    sp<ThreadBase> thread = mThread.promote();
+    if (thread == 0) {
+        ALOGW("process_l(): cannot promote mixer thread");
+        return;
+    }
+    process_l(thread->costCpuUsage());
+}
+
+void AudioFlinger::EffectChain::process_l(ThreadCpuUsage* usage)
 {
     sp<ThreadBase> thread = mThread.promote();
     if (thread == 0) {
@@ -1546,8 +1634,15 @@ void AudioFlinger::EffectChain::process_l()
 #else
     if (doProcess) {
 #endif
+        double ns;
+        if (usage != NULL) {
+            (void) usage->sampleAndEnable(ns);
+        }
         for (size_t i = 0; i < size; i++) {
             mEffects[i]->process();
+            if (usage != NULL && usage->sample(ns)) {
+                mEffects[i]->sampleCost(ns);
+            }
         }
     }
     for (size_t i = 0; i < size; i++) {
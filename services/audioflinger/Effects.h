@@ -128,6 +128,11 @@ public:
     status_t         setOffloaded(bool offloaded, audio_io_handle_t io);
     bool             isOffloaded() const;
     void             addEffectToHal_l();
+    bool             isAddedToHal_l() const { return mAddedToHal; }
+    // true once the engine refused a float configuration, see configure()
+    bool             floatRejected() const { return mFloatRejected; }
+    // effect engine, for pre-processing hosted by the fast capture thread
+    effect_handle_t  effectInterface() const { return mEffectInterface; }
 #ifdef QCOM_DIRECTTRACK
     bool             isOnLPA() { return mIsForLPA;}
     void             setLPAFlag(bool isForLPA) {mIsForLPA = isForLPA; }
@@ -135,6 +140,9 @@ public:
 
     void             dump(int fd, const Vector<String16>& args);
 
+    // add a sample of the thread CPU ns spent in process(), see EffectChain::process_l()
+    void             sampleCost(double ns) { mCost.sample(ns); }
+
 protected:
     friend class AudioFlinger;      // for mHandles
     bool                mPinned;
@@ -166,10 +174,13 @@ mutable Mutex               mLock;      // mutex for process, commands and handl
     uint32_t mDisableWaitCnt;       // current process() calls count during disable period.
     bool     mSuspended;            // effect is suspended: temporarily disabled by framework
     bool     mOffloaded;            // effect is currently offloaded to the audio DSP
+    bool     mAddedToHal;           // effect was added to the HAL stream and not removed since
+    bool     mFloatRejected;        // engine refused AUDIO_FORMAT_PCM_FLOAT buffers
     wp<AudioFlinger>    mAudioFlinger;
 #ifdef QCOM_DIRECTTRACK
     bool     mIsForLPA;
 #endif
+    CentralTendencyStatistics mCost; // thread CPU ns per process() call, if accounted
 };
 
 // The EffectHandle class implements the IEffect interface. It provides resources
@@ -270,6 +281,9 @@ public:
     static const int        kProcessTailDurationMs = 1000;
 
     void process_l();
+    // Same as process_l(), for a caller other than the chain's thread, see EffectsThread:
+    // the effect costs are sampled from 'usage', which may be NULL.
+    void process_l(ThreadCpuUsage* usage);
 
     void lock() {
         mLock.lock();
@@ -280,9 +294,7 @@ public:
 
     status_t addEffect_l(const sp<EffectModule>& handle);
     size_t removeEffect_l(const sp<EffectModule>& handle);
-#ifdef QCOM_DIRECTTRACK
     size_t getNumEffects() { return mEffects.size(); }
-#endif
 
     int sessionId() const { return mSessionId; }
     void setSessionId(int sessionId) { mSessionId = sessionId; }
@@ -290,9 +302,7 @@ public:
     sp<EffectModule> getEffectFromDesc_l(effect_descriptor_t *descriptor);
     sp<EffectModule> getEffectFromId_l(int id);
     sp<EffectModule> getEffectFromType_l(const effect_uuid_t *type);
-#ifdef QCOM_DIRECTTRACK
     sp<EffectModule> getEffectFromIndex_l(int idx);
-#endif
 
     // FIXME use float to improve the dynamic range
     bool setVolume_l(uint32_t *left, uint32_t *right);
@@ -314,6 +324,14 @@ public:
         return mOutBuffer;
     }
 
+    // Format of the chain buffers and of the effect engines in the chain, set by the thread:
+    // AUDIO_FORMAT_PCM_16_BIT, or AUDIO_FORMAT_PCM_FLOAT when every effect can process float
+    // in place, see PlaybackThread::updateEffectBufferFormat_l().
+    audio_format_t bufferFormat() const { return mBufferFormat; }
+    void setBufferFormat_l(audio_format_t format);
+    // true if all effects are insert effects that have not refused float
+    bool supportsFloat_l();
+
     void incTrackCnt() { android_atomic_inc(&mTrackCnt); }
     void decTrackCnt() { android_atomic_dec(&mTrackCnt); }
     int32_t trackCnt() const { return android_atomic_acquire_load(&mTrackCnt); }
@@ -399,6 +417,7 @@ protected:
     int32_t mTailBufferCount;   // current effect tail buffer count
     int32_t mMaxTailBuffers;    // maximum effect tail buffers
     bool mOwnInBuffer;          // true if the chain owns its input buffer
+    audio_format_t mBufferFormat; // format of mInBuffer and mOutBuffer
     int mVolumeCtrlIdx;         // index of insert effect having control over volume
     uint32_t mLeftVolume;       // previous volume on left channel
     uint32_t mRightVolume;      // previous volume on right channel
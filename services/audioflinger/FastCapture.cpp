@@ -23,19 +23,31 @@
 #include <linux/futex.h>
 #include <sys/syscall.h>
 #include <media/AudioBufferProvider.h>
+#include <audio_effects/effect_aec.h>
 #include <utils/Log.h>
 #include <utils/Trace.h>
 #include "FastCapture.h"
 
 namespace android {
 
+// Pre-processing effects hosted by fast capture may use this percentage of each period.
+static const unsigned kEffectBudgetPercent = 50;
+
+// Number of consecutive periods over budget after which the effects are bypassed.
+static const unsigned kEffectOverBudgetCycles = 8;
+
+// Periods of playback reference missing after which the echo delay is measured again.
+static const size_t kEchoReferenceDeficitPeriods = 4;
+
 /*static*/ const FastCaptureState FastCapture::initial;
 
 FastCapture::FastCapture() : FastThread(),
     inputSource(NULL), inputSourceGen(0), pipeSink(NULL), pipeSinkGen(0),
     readBuffer(NULL), readBufferState(-1), format(Format_Invalid), sampleRate(0),
     // dummyDumpState
-    totalNativeFramesRead(0)
+    totalNativeFramesRead(0),
+    effectsGen(0), effectOverBudgetCycles(0), effectsBypassed(false),
+    echoReference(NULL), referenceBuffer(NULL), referenceDeficit(0), echoDelayUs(-1)
 {
     previous = &initial;
     current = &initial;
@@ -127,6 +139,8 @@ void FastCapture::onStateChange()
         // FIXME to avoid priority inversion, don't delete here
         delete[] readBuffer;
         readBuffer = NULL;
+        delete[] referenceBuffer;
+        referenceBuffer = NULL;
         if (frameCount > 0 && sampleRate > 0) {
             // FIXME new may block for unbounded time at internal mutex of the heap
             //       implementation; it would be better to have normal capture thread allocate for
@@ -134,6 +148,7 @@ void FastCapture::onStateChange()
             unsigned channelCount = Format_channelCount(format);
             // FIXME frameSize
             readBuffer = new short[frameCount * channelCount];
+            referenceBuffer = new short[2 * frameCount * channelCount];
             periodNs = (frameCount * 1000000000LL) / sampleRate;    // 1.00
             underrunNs = (frameCount * 1750000000LL) / sampleRate;  // 1.75
             overrunNs = (frameCount * 500000000LL) / sampleRate;    // 0.50
@@ -150,6 +165,19 @@ void FastCapture::onStateChange()
         dumpState->mFrameCount = frameCount;
     }
 
+    // check for change in pre-processing effects
+    if (current->mEffectsGen != effectsGen) {
+        effectsGen = current->mEffectsGen;
+        effectOverBudgetCycles = 0;
+        effectsBypassed = false;
+        dumpState->mEffectCount = current->mEffectCount;
+        if (current->mEchoReference != echoReference) {
+            echoReference = current->mEchoReference;
+            echoDelayUs = -1;
+            dumpState->mEchoDelayUs = -1;
+        }
+    }
+
 }
 
 void FastCapture::onWork()
@@ -173,6 +201,9 @@ void FastCapture::onWork()
             totalNativeFramesRead += framesRead;
             dumpState->mFramesRead = totalNativeFramesRead;
             readBufferState = framesRead;
+            if (framesRead > 0 && current->mEffectCount > 0 && !effectsBypassed) {
+                processEffects(framesRead);
+            }
         } else {
             dumpState->mReadErrors++;
             readBufferState = 0;
@@ -210,8 +241,124 @@ void FastCapture::onWork()
     }
 }
 
+// Applies the pre-processing effects in place to the frames just read, and bypasses them
+// if they repeatedly exceed their share of the period.
+void FastCapture::processEffects(size_t frameCount)
+{
+    const FastCaptureState * const current = (const FastCaptureState *) this->current;
+    FastCaptureDumpState * const dumpState = (FastCaptureDumpState *) this->dumpState;
+
+    ATRACE_BEGIN("effects");
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (echoReference != NULL) {
+        processEchoReference(frameCount, start.tv_sec * 1000000000LL + start.tv_nsec);
+    }
+    audio_buffer_t buffer;
+    buffer.frameCount = frameCount;
+    buffer.s16 = readBuffer;
+    for (unsigned i = 0; i < current->mEffectCount; ++i) {
+        effect_handle_t effect = current->mEffects[i];
+        (void) (*effect)->process(effect, &buffer, &buffer);
+    }
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    ATRACE_END();
+
+    const nsecs_t ns = (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+    dumpState->mEffectNs = (uint32_t) ns;
+    if (ns * 100 > periodNs * kEffectBudgetPercent) {
+        if (++effectOverBudgetCycles >= kEffectOverBudgetCycles) {
+            effectsBypassed = true;
+            dumpState->mEffectFallbacks++;
+        }
+    } else {
+        effectOverBudgetCycles = 0;
+    }
+}
+
+// Passes the playback reference to the engines that have a reverse stream, as many frames as
+// were captured, so that the two streams advance together.  The first time the reference
+// flows, the echo delay is measured once from the render time of the reference and the
+// capture time of the input, which have just been read: as both streams then keep their
+// relative position, the delay holds until the reference is interrupted.
+void FastCapture::processEchoReference(size_t frameCount, int64_t captureNs)
+{
+    const FastCaptureState * const current = (const FastCaptureState *) this->current;
+    FastCaptureDumpState * const dumpState = (FastCaptureDumpState *) this->dumpState;
+
+    if (echoDelayUs < 0) {
+        // start one playback period behind the most recent frame, so that the reads that
+        // follow do not run dry between two writes of the playback thread
+        echoReference->discard(echoReference->maxWriteFrames());
+        referenceDeficit = 0;
+    }
+    size_t wanted = frameCount + referenceDeficit;
+    if (wanted > 2 * frameCount) {
+        wanted = 2 * frameCount;
+    }
+    int64_t renderNs;
+    ssize_t framesRead = echoReference->read(referenceBuffer, wanted, &renderNs);
+    if (framesRead < 0) {
+        framesRead = 0;
+    }
+    referenceDeficit = referenceDeficit + frameCount - framesRead;
+    if (referenceDeficit > kEchoReferenceDeficitPeriods * frameCount) {
+        // playback stopped or was interrupted, align again when it resumes
+        echoDelayUs = -1;
+        dumpState->mEchoDelayUs = -1;
+        referenceDeficit = 0;
+    }
+    if (framesRead == 0) {
+        return;
+    }
+
+    const unsigned channelCount = echoReference->channelCount();
+    for (unsigned i = 0; i < current->mEffectCount; ++i) {
+        effect_handle_t effect = current->mEffects[i];
+        if ((*effect)->process_reverse == NULL) {
+            continue;
+        }
+        // the engine may take less than offered, up to the end of its own processing block
+        size_t done = 0;
+        while (done < (size_t) framesRead) {
+            audio_buffer_t buffer;
+            buffer.frameCount = framesRead - done;
+            buffer.s16 = referenceBuffer + done * channelCount;
+            if ((*effect)->process_reverse(effect, &buffer, NULL) != 0 || buffer.frameCount == 0) {
+                break;
+            }
+            done += buffer.frameCount;
+        }
+    }
+
+    if (echoDelayUs < 0 && renderNs >= 0) {
+        // the last frame read is analyzed together with the last frame captured
+        int64_t delayNs = renderNs + ((framesRead - 1) * 1000000000LL) / sampleRate - captureNs;
+        echoDelayUs = delayNs > 0 ? (int32_t) (delayNs / 1000) : 0;
+        dumpState->mEchoDelayUs = echoDelayUs;
+        uint32_t buf[sizeof(effect_param_t) / sizeof(uint32_t) + 2];
+        effect_param_t *param = (effect_param_t *) buf;
+        param->psize = sizeof(uint32_t);
+        param->vsize = sizeof(uint32_t);
+        *(uint32_t *) param->data = AEC_PARAM_ECHO_DELAY;
+        *((uint32_t *) param->data + 1) = echoDelayUs;
+        for (unsigned i = 0; i < current->mEffectCount; ++i) {
+            effect_handle_t effect = current->mEffects[i];
+            if ((*effect)->process_reverse == NULL) {
+                continue;
+            }
+            int32_t reply;
+            uint32_t replySize = sizeof(reply);
+            (void) (*effect)->command(effect, EFFECT_CMD_SET_PARAM, sizeof(buf), param,
+                    &replySize, &reply);
+        }
+    }
+}
+
 FastCaptureDumpState::FastCaptureDumpState() : FastThreadDumpState(),
-    mReadSequence(0), mFramesRead(0), mReadErrors(0), mSampleRate(0), mFrameCount(0)
+    mReadSequence(0), mFramesRead(0), mReadErrors(0), mSampleRate(0), mFrameCount(0),
+    mEffectCount(0), mEffectNs(0), mEffectFallbacks(0), mEchoDelayUs(-1)
 {
 }
 
@@ -35,6 +35,11 @@ struct FastCaptureDumpState : FastThreadDumpState {
     uint32_t mReadErrors;       // total number of read() errors
     uint32_t mSampleRate;
     size_t   mFrameCount;
+    uint32_t mEffectCount;      // number of pre-processing effects hosted
+    uint32_t mEffectNs;         // wall clock time of the most recent effect processing
+    uint32_t mEffectFallbacks;  // incremented each time the effects exceeded their CPU budget
+                                // and were bypassed; the RecordThread then hands them back
+    int32_t  mEchoDelayUs;      // echo delay set on the engines with a reverse stream, or -1
 };
 
 class FastCapture : public FastThread {
@@ -56,6 +61,8 @@ private:
     virtual bool isSubClassCommand(FastThreadState::Command command);
     virtual void onStateChange();
     virtual void onWork();
+            void processEffects(size_t frameCount);
+            void processEchoReference(size_t frameCount, int64_t captureNs);
 
     static const FastCaptureState initial;
     FastCaptureState preIdle; // copy of state before we went into idle
@@ -70,6 +77,13 @@ private:
     unsigned sampleRate;
     FastCaptureDumpState dummyDumpState;
     uint32_t totalNativeFramesRead; // copied to dumpState->mFramesRead
+    int effectsGen;
+    unsigned effectOverBudgetCycles;    // consecutive cycles over kEffectBudgetPercent
+    bool effectsBypassed;       // effects exceeded their budget and are no longer processed
+    EchoReference *echoReference;
+    short *referenceBuffer;     // 2 * frameCount frames of the playback reference
+    size_t referenceDeficit;    // reference frames owed to the engines by previous cycles
+    int32_t echoDelayUs;        // echo delay set on the engines, or -1 until aligned
 
 };  // class FastCapture
 
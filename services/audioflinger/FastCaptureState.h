@@ -18,7 +18,9 @@
 #define ANDROID_AUDIO_FAST_CAPTURE_STATE_H
 
 #include <media/nbaio/NBAIO.h>
+#include <hardware/audio_effect.h>
 #include "FastThreadState.h"
+#include "EchoReference.h"
 #include <private/media/AudioTrackShared.h>
 
 namespace android {
@@ -37,6 +39,17 @@ struct FastCaptureState : FastThreadState {
     size_t          mFrameCount;        // number of frames per fast capture buffer
     audio_track_cblk_t  *mCblk;         // control block for the single fast client, or NULL
 
+    // Pre-processing effect engines applied in place, in order, after each read.
+    // Engines are owned by the RecordThread's EffectModules and must not be released until
+    // a state without them has been acknowledged.
+    static const unsigned kMaxEffects = 4;
+    effect_handle_t mEffects[kMaxEffects];
+    unsigned        mEffectCount;       // number of valid entries in mEffects
+    int             mEffectsGen;        // increment when mEffects or mEffectCount change
+    // Playback reference passed to the engines that have a reverse stream, or NULL;
+    // changes along with mEffects
+    EchoReference   *mEchoReference;
+
     // Extends FastThreadState::Command
     static const Command
         // The following commands also process configuration changes, and can be "or"ed:
@@ -227,7 +227,7 @@ void FastMixer::onStateChange()
         unsigned removedTracks = previousTrackMask & ~currentTrackMask;
         while (removedTracks != 0) {
             int i = __builtin_ctz(removedTracks);
-            removedTracks &= ~(1 << i);
+            removedTracks &= ~(1u << i);
             const FastTrack* fastTrack = &current->mFastTracks[i];
             ALOG_ASSERT(fastTrack->mBufferProvider == NULL);
             if (mixer != NULL) {
@@ -246,7 +246,7 @@ void FastMixer::onStateChange()
         unsigned addedTracks = currentTrackMask & ~previousTrackMask;
         while (addedTracks != 0) {
             int i = __builtin_ctz(addedTracks);
-            addedTracks &= ~(1 << i);
+            addedTracks &= ~(1u << i);
             const FastTrack* fastTrack = &current->mFastTracks[i];
             AudioBufferProvider *bufferProvider = fastTrack->mBufferProvider;
             ALOG_ASSERT(bufferProvider != NULL && fastTrackNames[i] == -1);
@@ -279,7 +279,7 @@ void FastMixer::onStateChange()
         unsigned modifiedTracks = currentTrackMask & previousTrackMask;
         while (modifiedTracks != 0) {
             int i = __builtin_ctz(modifiedTracks);
-            modifiedTracks &= ~(1 << i);
+            modifiedTracks &= ~(1u << i);
             const FastTrack* fastTrack = &current->mFastTracks[i];
             if (fastTrack->mGeneration != generations[i]) {
                 // this track was actually modified
@@ -331,7 +331,7 @@ void FastMixer::onWork()
         unsigned currentTrackMask = current->mTrackMask;
         while (currentTrackMask != 0) {
             int i = __builtin_ctz(currentTrackMask);
-            currentTrackMask &= ~(1 << i);
+            currentTrackMask &= ~(1u << i);
             const FastTrack* fastTrack = &current->mFastTracks[i];
 
             // Refresh the per-track timestamp
@@ -487,6 +487,52 @@ void FastMixerDumpState::increaseSamplingN(uint32_t samplingN)
 #endif
     mSamplingN = samplingN;
 }
+
+uint32_t FastMixerDumpState::recentMeanLoadNs(uint32_t cycles) const
+{
+    uint32_t bounds = mBounds;
+    uint32_t newestOpen = bounds & 0xFFFF;
+    uint32_t oldestClosed = bounds >> 16;
+    uint32_t n = (newestOpen - oldestClosed) & 0xFFFF;
+    uint32_t samplingN = mSamplingN;
+    if (n > samplingN) {
+        n = samplingN;
+    }
+    if (n > cycles) {
+        n = cycles;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    uint64_t totalNs = 0;
+    for (uint32_t j = 1; j <= n; ++j) {
+        totalNs += mLoadNs[(newestOpen - j) & (samplingN - 1)];
+    }
+    return (uint32_t) (totalNs / n);
+}
+
+uint32_t FastMixerDumpState::recentMaxCycleNs(uint32_t cycles) const
+{
+    uint32_t bounds = mBounds;
+    uint32_t newestOpen = bounds & 0xFFFF;
+    uint32_t oldestClosed = bounds >> 16;
+    uint32_t n = (newestOpen - oldestClosed) & 0xFFFF;
+    uint32_t samplingN = mSamplingN;
+    if (n > samplingN) {
+        n = samplingN;
+    }
+    if (n > cycles) {
+        n = cycles;
+    }
+    uint32_t maxNs = 0;
+    for (uint32_t j = 1; j <= n; ++j) {
+        uint32_t ns = mMonotonicNs[(newestOpen - j) & (samplingN - 1)];
+        if (ns > maxNs) {
+            maxNs = ns;
+        }
+    }
+    return maxNs;
+}
 #endif
 
 FastMixerDumpState::~FastMixerDumpState()
@@ -507,6 +553,13 @@ static int compare_uint32_t(const void *pa, const void *pb)
     }
 }
 
+// the sample that the given fraction of the n sorted samples are at or below
+static uint32_t percentile(const uint32_t *sorted, uint32_t n, double fraction)
+{
+    uint32_t i = (uint32_t) (fraction * n);
+    return sorted[i < n ? i : n - 1];
+}
+
 void FastMixerDumpState::dump(int fd) const
 {
     if (mCommand == FastMixerState::INITIAL) {
@@ -552,6 +605,8 @@ void FastMixerDumpState::dump(int fd) const
                  mNumTracks, mWriteErrors, mUnderruns, mOverruns,
                  mSampleRate, mFrameCount, measuredWarmupMs, mWarmupCycles,
                  mixPeriodSec * 1e3);
+    mStateQueueObserver.dump(fd);
+    mStateQueueMutator.dump(fd);
 #ifdef FAST_MIXER_STATISTICS
     // find the interval of valid samples
     uint32_t bounds = mBounds;
@@ -573,7 +628,9 @@ void FastMixerDumpState::dump(int fd) const
     // the mean account for 99.73% of the population.  So if we take each tail to be 1/1000 of the
     // sample set, we get 99.8% combined, or close to three standard deviations.
     static const uint32_t kTailDenominator = 1000;
-    uint32_t *tail = n >= kTailDenominator ? new uint32_t[n] : NULL;
+    // the samples sorted below, for their percentiles and tails
+    uint32_t *tail = n > 0 ? new uint32_t[n] : NULL;
+    uint32_t *sortedLoadNs = n > 0 ? new uint32_t[n] : NULL;
     // loop over all the samples
     for (uint32_t j = 0; j < n; ++j) {
         size_t i = oldestClosed++ & (mSamplingN - 1);
@@ -583,6 +640,9 @@ void FastMixerDumpState::dump(int fd) const
         }
         wall.sample(wallNs);
         uint32_t sampleLoadNs = mLoadNs[i];
+        if (sortedLoadNs != NULL) {
+            sortedLoadNs[j] = sampleLoadNs;
+        }
         loadNs.sample(sampleLoadNs);
 #ifdef CPU_FREQUENCY_STATISTICS
         uint32_t sampleCpukHz = mCpukHz[i];
@@ -621,7 +681,22 @@ void FastMixerDumpState::dump(int fd) const
                 loadMHz.mean(), loadMHz.minimum(), loadMHz.maximum(), loadMHz.stddev());
 #endif
     if (tail != NULL) {
+        // a couple of ms at the most, on the dumpsys thread and not the fast one
         qsort(tail, n, sizeof(uint32_t), compare_uint32_t);
+        qsort(sortedLoadNs, n, sizeof(uint32_t), compare_uint32_t);
+        // the mean and stddev hide the rare long cycles that are heard as glitches
+        dprintf(fd, "  Percentiles of wall clock time in ms per mix cycle:\n"
+                    "    50%%=%.2f 90%%=%.2f 99%%=%.2f 99.9%%=%.2f\n",
+                    percentile(tail, n, 0.5)*1e-6, percentile(tail, n, 0.9)*1e-6,
+                    percentile(tail, n, 0.99)*1e-6, percentile(tail, n, 0.999)*1e-6);
+        dprintf(fd, "  Percentiles of raw CPU load in us per mix cycle:\n"
+                    "    50%%=%.0f 90%%=%.0f 99%%=%.0f 99.9%%=%.0f\n",
+                    percentile(sortedLoadNs, n, 0.5)*1e-3, percentile(sortedLoadNs, n, 0.9)*1e-3,
+                    percentile(sortedLoadNs, n, 0.99)*1e-3,
+                    percentile(sortedLoadNs, n, 0.999)*1e-3);
+        delete[] sortedLoadNs;
+    }
+    if (tail != NULL && n >= kTailDenominator) {
         // assume same number of tail samples on each side, left and right
         uint32_t count = n / kTailDenominator;
         CentralTendencyStatistics left, right;
@@ -635,8 +710,8 @@ void FastMixerDumpState::dump(int fd) const
                     left.mean()*1e-6, left.minimum()*1e-6, left.maximum()*1e-6, left.stddev()*1e-6,
                     right.mean()*1e-6, right.minimum()*1e-6, right.maximum()*1e-6,
                     right.stddev()*1e-6);
-        delete[] tail;
     }
+    delete[] tail;
 #endif
     // The active track mask and track states are updated non-atomically.
     // So if we relied on isActive to decide whether to display,
@@ -651,6 +726,12 @@ void FastMixerDumpState::dump(int fd) const
         bool isActive = trackMask & 1;
         const FastTrackDump *ftDump = &mTracks[i];
         const FastTrackUnderruns& underruns = ftDump->mUnderruns;
+        // skip the slots that have never been used, the table is large
+        if (!isActive && ftDump->mFramesReady == 0 &&
+                (underruns.mBitFields.mFull | underruns.mBitFields.mPartial |
+                 underruns.mBitFields.mEmpty) == 0) {
+            continue;
+        }
         const char *mostRecent;
         switch (underruns.mBitFields.mMostRecent) {
         case UNDERRUN_FULL:
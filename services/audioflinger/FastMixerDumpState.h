@@ -18,6 +18,7 @@
 #define ANDROID_AUDIO_FAST_MIXER_DUMP_STATE_H
 
 #include "Configuration.h"
+#include "StateQueue.h"
 
 namespace android {
 
@@ -81,12 +82,23 @@ struct FastMixerDumpState : FastThreadDumpState {
     uint32_t mTrackMask;        // mask of active tracks
     FastTrackDump   mTracks[FastMixerState::kMaxFastTracks];
 
+    // statistics of the state queue between the normal mixer and the fast mixer;
+    // the observer part is written by the fast mixer, the mutator part by the normal mixer
+    StateQueueObserverDump mStateQueueObserver;
+    StateQueueMutatorDump  mStateQueueMutator;
+
 #ifdef FAST_MIXER_STATISTICS
     // Compile-time constant for a "low RAM device", must be a power of 2 <= kSamplingN.
     // This value was chosen such that each array uses 1 small page (4 Kbytes).
     static const uint32_t kSamplingNforLowRamDevice = 0x400;
     // Increase sampling window after construction, must be a power of 2 <= kSamplingN
     void    increaseSamplingN(uint32_t samplingN);
+    // Mean CPU load in ns per mix cycle over at most the given number of most recent cycles,
+    // or 0 if there are no samples.  May be called on the original, the result is an estimate.
+    uint32_t recentMeanLoadNs(uint32_t cycles) const;
+    // Longest wall clock time in ns of one mix cycle over at most the given number of most
+    // recent cycles, or 0 if there are no samples.  Same caveats as recentMeanLoadNs().
+    uint32_t recentMaxCycleNs(uint32_t cycles) const;
 #endif
 };
 
@@ -54,7 +54,10 @@ struct FastMixerState : FastThreadState {
                 FastMixerState();
     /*virtual*/ ~FastMixerState();
 
-    static const unsigned kMaxFastTracks = 8;   // must be between 2 and 32 inclusive
+    // Capacity of the fast track table; must be between 2 and 32 inclusive, as the active
+    // tracks are represented by a 32-bit mask.  The number of fast tracks actually admitted
+    // is limited by the fast mixer CPU load, see MixerThread::canAdmitFastTrack_l().
+    static const unsigned kMaxFastTracks = 32;
 
     // all pointer fields use raw pointers; objects are owned and ref-counted by the normal mixer
     FastTrack   mFastTracks[kMaxFastTracks];
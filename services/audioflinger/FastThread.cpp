@@ -30,6 +30,7 @@
 #define FAST_HOT_IDLE_NS     1000000L   // 1 ms: time to sleep while hot idling
 #define MIN_WARMUP_CYCLES          2    // minimum number of loop cycles to wait for warmup
 #define MAX_WARMUP_CYCLES         10    // maximum number of loop cycles to wait for warmup
+#define CPU_KHZ_CYCLES            16    // loop cycles between CPU clock frequency reads
 
 namespace android {
 
@@ -54,6 +55,11 @@ FastThread::FastThread() : Thread(false /*canCallJava*/),
     bounds(0),
     full(false),
     // tcu
+#ifdef CPU_FREQUENCY_STATISTICS
+    lastCpuNum(-1),
+    lastCpukHz(0),
+    cpukHzCycles(0),
+#endif
 #endif
     coldGen(0),
     isWarm(false),
@@ -221,7 +227,8 @@ bool FastThread::threadLoop()
                 // To avoid an initial underrun on fast tracks after exiting standby,
                 // do not start pulling data from tracks and mixing until warmup is complete.
                 // Warmup is considered complete after the earlier of:
-                //      MIN_WARMUP_CYCLES write() attempts and last one blocks for at least warmupNs
+                //      MIN_WARMUP_CYCLES + mExtraWarmupCycles write() attempts and last one
+                //      blocks for at least warmupNs
                 //      MAX_WARMUP_CYCLES write() attempts.
                 // This is overly conservative, but to get better accuracy requires a new HAL API.
                 if (!isWarm && attemptedWrite) {
@@ -232,7 +239,11 @@ bool FastThread::threadLoop()
                         measuredWarmupTs.tv_nsec -= 1000000000;
                     }
                     ++warmupCycles;
-                    if ((nsec > warmupNs && warmupCycles >= MIN_WARMUP_CYCLES) ||
+                    uint32_t minWarmupCycles = MIN_WARMUP_CYCLES + current->mExtraWarmupCycles;
+                    if (minWarmupCycles > MAX_WARMUP_CYCLES) {
+                        minWarmupCycles = MAX_WARMUP_CYCLES;
+                    }
+                    if ((nsec > warmupNs && warmupCycles >= minWarmupCycles) ||
                             (warmupCycles >= MAX_WARMUP_CYCLES)) {
                         isWarm = true;
                         dumpState->mMeasuredWarmupTs = measuredWarmupTs;
@@ -307,9 +318,15 @@ bool FastThread::threadLoop()
                     }
 #ifdef CPU_FREQUENCY_STATISTICS
                     // get the absolute value of CPU clock frequency in kHz
+                    // reading it is a sysfs read, that would weigh on the very cycle
+                    // being measured, so only on a move to another CPU or now and then
                     int cpuNum = sched_getcpu();
-                    uint32_t kHz = tcu.getCpukHz(cpuNum);
-                    kHz = (kHz << 4) | (cpuNum & 0xF);
+                    if (cpuNum != lastCpuNum || ++cpukHzCycles >= CPU_KHZ_CYCLES) {
+                        lastCpukHz = tcu.getCpukHz(cpuNum);
+                        lastCpuNum = cpuNum;
+                        cpukHzCycles = 0;
+                    }
+                    uint32_t kHz = (lastCpukHz << 4) | (cpuNum & 0xF);
 #endif
                     // save values in FIFO queues for dumpsys
                     // these stores #1, #2, #3 are not atomic with respect to each other,
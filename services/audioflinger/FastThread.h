@@ -69,6 +69,9 @@ protected:
     bool full;          // whether we have collected at least mSamplingN samples
 #ifdef CPU_FREQUENCY_STATISTICS
     ThreadCpuUsage tcu;     // for reading the current CPU clock frequency in kHz
+    int lastCpuNum;         // CPU of the last frequency read, -1 if none yet
+    uint32_t lastCpukHz;    // frequency read then, reused until the next read
+    uint32_t cpukHzCycles;  // cycles since then
 #endif
 #endif
     unsigned coldGen;   // last observed mColdGen
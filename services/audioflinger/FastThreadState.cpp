@@ -20,7 +20,8 @@
 namespace android {
 
 FastThreadState::FastThreadState() :
-    mCommand(INITIAL), mColdFutexAddr(NULL), mColdGen(0), mDumpState(NULL), mNBLogWriter(NULL)
+    mCommand(INITIAL), mColdFutexAddr(NULL), mColdGen(0), mExtraWarmupCycles(0),
+    mDumpState(NULL), mNBLogWriter(NULL)
 
 {
 }
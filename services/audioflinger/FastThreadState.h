@@ -41,6 +41,8 @@ struct FastThreadState {
     Command     mCommand;       // current command
     int32_t*    mColdFutexAddr; // for COLD_IDLE only, pointer to the associated futex
     unsigned    mColdGen;       // increment when COLD_IDLE is requested so it's only performed once
+    uint32_t    mExtraWarmupCycles; // loop cycles to wait for warmup after COLD_IDLE in addition
+                                    // to the minimum, for example after underruns
 
     // This might be a one-time configuration rather than per-state
     FastThreadDumpState* mDumpState; // if non-NULL, then update dump state periodically
@@ -20,12 +20,20 @@
 //#define LOG_NDEBUG 0
 
 #include "Configuration.h"
+#include <stdlib.h>
+#include <unistd.h>
+#include <cutils/properties.h>
 #include <utils/Log.h>
 #include <audio_utils/primitives.h>
 
 #include "AudioFlinger.h"
 #include "ServiceUtilities.h"
 #include <media/AudioParameter.h>
+#include <media/nbaio/AudioStreamInSource.h>
+#include <media/nbaio/AudioStreamOutSink.h>
+#include <media/nbaio/MonoPipe.h>
+#include <media/nbaio/MonoPipeReader.h>
+#include <media/nbaio/roundup.h>
 
 // ----------------------------------------------------------------------------
 
@@ -111,8 +119,16 @@ status_t AudioFlinger::setAudioPortConfig(const struct audio_port_config *config
 
 
 AudioFlinger::PatchPanel::PatchPanel(const sp<AudioFlinger>& audioFlinger)
-                                   : mAudioFlinger(audioFlinger)
+                                   : mAudioFlinger(audioFlinger), mSoftwarePatchEnabled(false)
 {
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("af.patch.software", value, NULL) > 0) {
+        char *endptr;
+        unsigned long enabled = strtoul(value, &endptr, 0);
+        if (*endptr == '\0') {
+            mSoftwarePatchEnabled = enabled != 0;
+        }
+    }
 }
 
 AudioFlinger::PatchPanel::~PatchPanel()
@@ -216,6 +232,14 @@ status_t AudioFlinger::PatchPanel::createAudioPatch(const struct audio_patch *pa
                     status = INVALID_OPERATION;
                     goto exit;
                 }
+                if (patch->num_sources == 1 && mSoftwarePatchEnabled) {
+                    status = createSoftwarePatch(newPatch, patch);
+                    if (status == NO_ERROR) {
+                        break;
+                    }
+                    ALOGW("createAudioPatch() software patch failed %d, using threads", status);
+                    status = NO_ERROR;
+                }
                 // special case num sources == 2 -=> reuse an exiting output mix to connect to the
                 // sink
                 if (patch->num_sources == 2) {
@@ -527,6 +551,11 @@ void AudioFlinger::PatchPanel::clearPatchConnections(Patch *patch)
     ALOGV("clearPatchConnections() patch->mRecordPatchHandle %d patch->mPlaybackPatchHandle %d",
           patch->mRecordPatchHandle, patch->mPlaybackPatchHandle);
 
+    if (patch->mSoftwarePatch != 0) {
+        patch->mSoftwarePatch->stop();
+        patch->mSoftwarePatch.clear();
+    }
+
     if (patch->mPatchRecord != 0) {
         patch->mPatchRecord->stop();
     }
@@ -722,4 +751,288 @@ status_t AudioFlinger::PatchPanel::setAudioPortConfig(const struct audio_port_co
 }
 
 
+status_t AudioFlinger::PatchPanel::createSoftwarePatch(Patch *patch,
+                                                       const struct audio_patch *audioPatch)
+{
+    sp<AudioFlinger> audioflinger = mAudioFlinger.promote();
+    if (audioflinger == 0) {
+        return NO_INIT;
+    }
+    ssize_t inIndex = audioflinger->mAudioHwDevs.indexOfKey(
+                                                    audioPatch->sources[0].ext.device.hw_module);
+    ssize_t outIndex = audioflinger->mAudioHwDevs.indexOfKey(
+                                                    audioPatch->sinks[0].ext.device.hw_module);
+    if (inIndex < 0 || outIndex < 0) {
+        return BAD_VALUE;
+    }
+    sp<SoftwarePatch> softwarePatch = new SoftwarePatch(
+                                                audioflinger->mAudioHwDevs.valueAt(inIndex),
+                                                audioflinger->mAudioHwDevs.valueAt(outIndex));
+    status_t status = softwarePatch->open(&audioPatch->sources[0], &audioPatch->sinks[0],
+                                          audioflinger->nextUniqueId(),
+                                          audioflinger->nextUniqueId());
+    if (status == NO_ERROR) {
+        status = softwarePatch->start();
+    }
+    if (status == NO_ERROR) {
+        patch->mSoftwarePatch = softwarePatch;
+    }
+    return status;
+}
+
+// ----------------------------------------------------------------------------
+//      SoftwarePatch
+// ----------------------------------------------------------------------------
+
+// time to wait after a HAL read or write error before retrying
+static const useconds_t kSoftwarePatchErrorSleepUs = 5000;
+
+AudioFlinger::PatchPanel::SoftwarePatch::SoftwarePatch(AudioHwDevice *inHwDev,
+                                                       AudioHwDevice *outHwDev)
+    : mInHwDev(inHwDev), mOutHwDev(outHwDev), mInStream(NULL), mOutStream(NULL),
+      mResampler(NULL), mProvider(this), mInSampleRate(0), mOutSampleRate(0), mChannelCount(0),
+      mInFrameCount(0), mOutFrameCount(0), mInBuffer(NULL), mOutBuffer(NULL),
+      mResampleBuffer(NULL), mProviderBuffer(NULL), mUnderrunFrames(0), mOverrunFrames(0)
+{
+}
+
+AudioFlinger::PatchPanel::SoftwarePatch::~SoftwarePatch()
+{
+    stop();
+    // the NBAIO wrappers must not outlive the streams they point to
+    mSource.clear();
+    mSink.clear();
+    if (mInStream != NULL) {
+        audio_hw_device_t *hwDevice = mInHwDev->hwDevice();
+        hwDevice->close_input_stream(hwDevice, mInStream);
+    }
+    if (mOutStream != NULL) {
+        audio_hw_device_t *hwDevice = mOutHwDev->hwDevice();
+        hwDevice->close_output_stream(hwDevice, mOutStream);
+    }
+    delete mResampler;
+    delete[] mInBuffer;
+    delete[] mOutBuffer;
+    delete[] mResampleBuffer;
+    delete[] mProviderBuffer;
+}
+
+status_t AudioFlinger::PatchPanel::SoftwarePatch::open(const struct audio_port_config *source,
+                                                       const struct audio_port_config *sink,
+                                                       audio_io_handle_t input,
+                                                       audio_io_handle_t output)
+{
+    // the output is opened first with the HAL default configuration, the input is asked to
+    // match it and resampled if it cannot
+    audio_config_t config = AUDIO_CONFIG_INITIALIZER;
+    audio_hw_device_t *outHal = mOutHwDev->hwDevice();
+    status_t status = outHal->open_output_stream(outHal, output, sink->ext.device.type,
+                                                 AUDIO_OUTPUT_FLAG_NONE, &config, &mOutStream,
+                                                 sink->ext.device.address);
+    if (status != NO_ERROR || mOutStream == NULL) {
+        ALOGW("SoftwarePatch::open() cannot open output stream for device %#x: %d",
+              sink->ext.device.type, status);
+        mOutStream = NULL;
+        return status != NO_ERROR ? status : NO_INIT;
+    }
+    mOutSampleRate = mOutStream->common.get_sample_rate(&mOutStream->common);
+    mChannelCount = audio_channel_count_from_out_mask(
+                                        mOutStream->common.get_channels(&mOutStream->common));
+    if (mOutStream->common.get_format(&mOutStream->common) != AUDIO_FORMAT_PCM_16_BIT ||
+            mChannelCount == 0 || mChannelCount > FCC_2) {
+        ALOGW("SoftwarePatch::open() unsupported output configuration");
+        return INVALID_OPERATION;
+    }
+
+    config = AUDIO_CONFIG_INITIALIZER;
+    config.sample_rate = mOutSampleRate;
+    config.channel_mask = audio_channel_in_mask_from_count(mChannelCount);
+    config.format = AUDIO_FORMAT_PCM_16_BIT;
+    audio_hw_device_t *inHal = mInHwDev->hwDevice();
+    status = inHal->open_input_stream(inHal, input, source->ext.device.type, &config,
+                                      &mInStream, AUDIO_INPUT_FLAG_NONE,
+                                      source->ext.device.address, AUDIO_SOURCE_MIC);
+    // accept another rate proposed by the HAL, not another format or channel count
+    if (status == BAD_VALUE && config.format == AUDIO_FORMAT_PCM_16_BIT &&
+            audio_channel_count_from_in_mask(config.channel_mask) == mChannelCount) {
+        mInStream = NULL;
+        status = inHal->open_input_stream(inHal, input, source->ext.device.type, &config,
+                                          &mInStream, AUDIO_INPUT_FLAG_NONE,
+                                          source->ext.device.address, AUDIO_SOURCE_MIC);
+    }
+    if (status != NO_ERROR || mInStream == NULL) {
+        ALOGW("SoftwarePatch::open() cannot open input stream for device %#x: %d",
+              source->ext.device.type, status);
+        mInStream = NULL;
+        return status != NO_ERROR ? status : NO_INIT;
+    }
+    mInSampleRate = mInStream->common.get_sample_rate(&mInStream->common);
+    if (mInStream->common.get_format(&mInStream->common) != AUDIO_FORMAT_PCM_16_BIT ||
+            audio_channel_count_from_in_mask(mInStream->common.get_channels(&mInStream->common))
+                    != mChannelCount ||
+            mInSampleRate == 0) {
+        ALOGW("SoftwarePatch::open() unsupported input configuration");
+        return INVALID_OPERATION;
+    }
+
+    const NBAIO_Format inFormat = Format_from_SR_C(mInSampleRate, mChannelCount,
+                                                   AUDIO_FORMAT_PCM_16_BIT);
+    const NBAIO_Format outFormat = Format_from_SR_C(mOutSampleRate, mChannelCount,
+                                                    AUDIO_FORMAT_PCM_16_BIT);
+    size_t numCounterOffers = 0;
+    mSource = new AudioStreamInSource(mInStream);
+    ssize_t index = mSource->negotiate(&inFormat, 1, NULL, numCounterOffers);
+    ALOG_ASSERT(index == 0);
+    numCounterOffers = 0;
+    mSink = new AudioStreamOutSink(mOutStream);
+    index = mSink->negotiate(&outFormat, 1, NULL, numCounterOffers);
+    ALOG_ASSERT(index == 0);
+    mInFrameCount = mSource->availableToRead();
+    mOutFrameCount = mSink->availableToWrite();
+    if (mInFrameCount == 0 || mOutFrameCount == 0) {
+        return NO_INIT;
+    }
+
+    // room for two periods of the slowest side, at the input rate: a fuller pipe only adds
+    // latency, so the capture side drops what does not fit
+    size_t outFramesAtInRate = (mOutFrameCount * mInSampleRate + mOutSampleRate - 1) /
+                                    mOutSampleRate;
+    size_t pipeFrames = roundup(2 * (mInFrameCount > outFramesAtInRate ?
+                                         mInFrameCount : outFramesAtInRate));
+    MonoPipe *pipe = new MonoPipe(pipeFrames, inFormat, false /*writeCanBlock*/);
+    numCounterOffers = 0;
+    index = pipe->negotiate(&inFormat, 1, NULL, numCounterOffers);
+    ALOG_ASSERT(index == 0);
+    mPipeSink = pipe;
+    MonoPipeReader *pipeReader = new MonoPipeReader(pipe);
+    numCounterOffers = 0;
+    index = pipeReader->negotiate(&inFormat, 1, NULL, numCounterOffers);
+    ALOG_ASSERT(index == 0);
+    mPipeSource = pipeReader;
+
+    mInBuffer = new int16_t[mInFrameCount * mChannelCount];
+    // stereo even for mono as ditherAndClamp() always produces stereo
+    mOutBuffer = new int16_t[mOutFrameCount * FCC_2];
+    if (mInSampleRate != mOutSampleRate) {
+        mResampler = AudioResampler::create(AUDIO_FORMAT_PCM_16_BIT, mChannelCount,
+                                            mOutSampleRate);
+        mResampler->setSampleRate(mInSampleRate);
+        mResampler->setVolume(1.0f, 1.0f);
+        mResampleBuffer = new int32_t[mOutFrameCount * FCC_2];
+        mProviderBuffer = new int16_t[mInFrameCount * mChannelCount];
+    }
+    ALOGV("SoftwarePatch::open() in %u Hz %zu frames, out %u Hz %zu frames, %u channels, "
+          "pipe %zu frames", mInSampleRate, mInFrameCount, mOutSampleRate, mOutFrameCount,
+          mChannelCount, pipeFrames);
+    return NO_ERROR;
+}
+
+status_t AudioFlinger::PatchPanel::SoftwarePatch::start()
+{
+    mCaptureThread = new Worker(this, true /*capture*/);
+    status_t status = mCaptureThread->run("SoftwarePatchCapture", ANDROID_PRIORITY_URGENT_AUDIO);
+    if (status != NO_ERROR) {
+        mCaptureThread.clear();
+        return status;
+    }
+    mRenderThread = new Worker(this, false /*capture*/);
+    status = mRenderThread->run("SoftwarePatchRender", ANDROID_PRIORITY_URGENT_AUDIO);
+    if (status != NO_ERROR) {
+        mRenderThread.clear();
+        stop();
+    }
+    return status;
+}
+
+void AudioFlinger::PatchPanel::SoftwarePatch::stop()
+{
+    // both threads exit after their current HAL read or write
+    if (mCaptureThread != 0) {
+        mCaptureThread->requestExit();
+    }
+    if (mRenderThread != 0) {
+        mRenderThread->requestExit();
+    }
+    if (mCaptureThread != 0) {
+        mCaptureThread->requestExitAndWait();
+        mCaptureThread.clear();
+    }
+    if (mRenderThread != 0) {
+        mRenderThread->requestExitAndWait();
+        mRenderThread.clear();
+    }
+    ALOGV("SoftwarePatch::stop() overrun %zu frames, underrun %zu frames",
+          mOverrunFrames, mUnderrunFrames);
+}
+
+bool AudioFlinger::PatchPanel::SoftwarePatch::captureLoop()
+{
+    ssize_t frames = mSource->read(mInBuffer, mInFrameCount, AudioBufferProvider::kInvalidPTS);
+    if (frames <= 0) {
+        usleep(kSoftwarePatchErrorSleepUs);
+        return true;
+    }
+    ssize_t written = mPipeSink->write(mInBuffer, frames);
+    if (written < frames) {
+        mOverrunFrames += frames - (written > 0 ? written : 0);
+    }
+    return true;
+}
+
+void AudioFlinger::PatchPanel::SoftwarePatch::readPipe(int16_t *buffer, size_t count)
+{
+    ssize_t frames = mPipeSource->read(buffer, count, AudioBufferProvider::kInvalidPTS);
+    if (frames < 0) {
+        frames = 0;
+    }
+    if ((size_t)frames < count) {
+        // keep the output running at its own pace rather than blocking on the input
+        memset(buffer + frames * mChannelCount, 0,
+               (count - frames) * mChannelCount * sizeof(int16_t));
+        mUnderrunFrames += count - frames;
+    }
+}
+
+bool AudioFlinger::PatchPanel::SoftwarePatch::renderLoop()
+{
+    if (mResampler != NULL) {
+        // the resampler accumulates stereo Q4.27 samples
+        memset(mResampleBuffer, 0, mOutFrameCount * FCC_2 * sizeof(int32_t));
+        mResampler->resample(mResampleBuffer, mOutFrameCount, &mProvider);
+        ditherAndClamp((int32_t *)mOutBuffer, mResampleBuffer, mOutFrameCount);
+        if (mChannelCount == 1) {
+            for (size_t i = 0; i < mOutFrameCount; i++) {
+                mOutBuffer[i] = mOutBuffer[i * FCC_2];
+            }
+        }
+    } else {
+        readPipe(mOutBuffer, mOutFrameCount);
+    }
+    ssize_t written = mSink->write(mOutBuffer, mOutFrameCount);
+    if (written <= 0) {
+        usleep(kSoftwarePatchErrorSleepUs);
+    }
+    return true;
+}
+
+status_t AudioFlinger::PatchPanel::SoftwarePatch::PipeProvider::getNextBuffer(Buffer* buffer,
+                                                                      int64_t pts __unused)
+{
+    size_t count = buffer->frameCount;
+    if (count > mPatch->mInFrameCount) {
+        count = mPatch->mInFrameCount;
+    }
+    mPatch->readPipe(mPatch->mProviderBuffer, count);
+    buffer->raw = mPatch->mProviderBuffer;
+    buffer->frameCount = count;
+    return NO_ERROR;
+}
+
+void AudioFlinger::PatchPanel::SoftwarePatch::PipeProvider::releaseBuffer(Buffer* buffer)
+{
+    buffer->raw = NULL;
+    buffer->frameCount = 0;
+}
+
+
 }; // namespace android
@@ -51,6 +51,77 @@ public:
     status_t createPatchConnections(Patch *patch,
                                     const struct audio_patch *audioPatch);
     void clearPatchConnections(Patch *patch);
+    // connects the source and sink devices of a patch across HW modules with a SoftwarePatch,
+    // returns an error if the HAL streams cannot be opened in a configuration it supports
+    status_t createSoftwarePatch(Patch *patch, const struct audio_patch *audioPatch);
+
+    // Device to device patch across HW modules that moves audio from a HAL input stream to a
+    // HAL output stream through a MonoPipe, resampling if their rates differ. Unlike the
+    // connection made by createPatchConnections() it does not go through a RecordThread and a
+    // PlaybackThread, their tracks and their mixer, which removes a mixer period of latency
+    // and the associated processing.
+    class SoftwarePatch : public RefBase {
+    public:
+        SoftwarePatch(AudioHwDevice *inHwDev, AudioHwDevice *outHwDev);
+        virtual ~SoftwarePatch();
+
+        status_t open(const struct audio_port_config *source,
+                      const struct audio_port_config *sink,
+                      audio_io_handle_t input, audio_io_handle_t output);
+        status_t start();
+        void stop();
+
+    private:
+        class Worker : public Thread {
+        public:
+            Worker(SoftwarePatch *patch, bool capture) :
+                Thread(false /*canCallJava*/), mPatch(patch), mCapture(capture) {}
+            virtual bool threadLoop()
+                { return mCapture ? mPatch->captureLoop() : mPatch->renderLoop(); }
+        private:
+            SoftwarePatch * const mPatch;
+            const bool mCapture;
+        };
+
+        // feeds the resampler from the pipe, with silence when the pipe is empty
+        class PipeProvider : public AudioBufferProvider {
+        public:
+            PipeProvider(SoftwarePatch *patch) : mPatch(patch) {}
+            virtual status_t getNextBuffer(Buffer* buffer, int64_t pts);
+            virtual void releaseBuffer(Buffer* buffer);
+        private:
+            SoftwarePatch * const mPatch;
+        };
+
+        bool captureLoop();
+        bool renderLoop();
+        // reads count frames from the pipe to buffer, filling the missing frames with silence
+        void readPipe(int16_t *buffer, size_t count);
+
+        AudioHwDevice * const       mInHwDev;
+        AudioHwDevice * const       mOutHwDev;
+        audio_stream_in_t           *mInStream;
+        audio_stream_out_t          *mOutStream;
+        sp<NBAIO_Source>            mSource;        // AudioStreamInSource
+        sp<NBAIO_Sink>              mSink;          // AudioStreamOutSink
+        sp<NBAIO_Sink>              mPipeSink;      // MonoPipe, written by the capture thread
+        sp<NBAIO_Source>            mPipeSource;    // MonoPipeReader, read by the render thread
+        sp<Worker>                  mCaptureThread;
+        sp<Worker>                  mRenderThread;
+        AudioResampler              *mResampler;    // NULL when the rates match
+        PipeProvider                mProvider;
+        uint32_t                    mInSampleRate;
+        uint32_t                    mOutSampleRate;
+        uint32_t                    mChannelCount;
+        size_t                      mInFrameCount;  // frames per HAL read
+        size_t                      mOutFrameCount; // frames per HAL write
+        int16_t                     *mInBuffer;
+        int16_t                     *mOutBuffer;
+        int32_t                     *mResampleBuffer;   // stereo Q4.27 resampler output
+        int16_t                     *mProviderBuffer;
+        size_t                      mUnderrunFrames;    // render side, for the log
+        size_t                      mOverrunFrames;     // capture side, for the log
+    };
 
     class Patch {
     public:
@@ -69,10 +140,12 @@ public:
         sp<RecordThread::PatchRecord>   mPatchRecord;
         audio_patch_handle_t            mRecordPatchHandle;
         audio_patch_handle_t            mPlaybackPatchHandle;
+        sp<SoftwarePatch>               mSoftwarePatch;
 
     };
 
 private:
     const wp<AudioFlinger>      mAudioFlinger;
     SortedVector <Patch *>      mPatches;
+    bool                        mSoftwarePatchEnabled;  // af.patch.software
 };
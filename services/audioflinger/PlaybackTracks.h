@@ -58,6 +58,10 @@ public:
             bool        isOffloaded() const { return (mFlags & IAudioFlinger::TRACK_OFFLOAD) != 0; }
             bool        isDirect() const { return (mFlags & IAudioFlinger::TRACK_DIRECT) != 0; }
             status_t    setParameters(const String8& keyValuePairs);
+            // Updates of IAudioFlinger::setTrackParameters(): all the updates of a call are
+            // checked first, then applied with the thread lock held.
+            status_t    checkParameter(IAudioFlinger::TrackParameter::Key key, float value) const;
+            void        setParameter_l(IAudioFlinger::TrackParameter::Key key, float value);
             status_t    attachAuxEffect(int EffectId);
             void        setAuxBuffer(int EffectId, int32_t *buffer);
             int32_t     *auxBuffer() const { return mAuxBuffer; }
@@ -279,7 +283,10 @@ public:
             bool        write(int16_t* data, uint32_t frames);
             bool        bufferQueueEmpty() const { return mBufferQueue.size() == 0; }
             bool        isActive() const { return mActive; }
-    const wp<ThreadBase>& thread() const { return mThread; }
+            // Frames of silence added ahead of the data at the next start, to align this output
+            // with a slower one of the same DuplicatingThread; applied by write().
+            void        setStartDelay(uint32_t frames) { mStartDelayFrames = frames; }
+            uint32_t    startDelay() const { return mStartDelayFrames; }
 
 private:
 
@@ -293,6 +300,7 @@ private:
     Vector < Buffer* >          mBufferQueue;
     AudioBufferProvider::Buffer mOutBuffer;
     bool                        mActive;
+    uint32_t                    mStartDelayFrames;
     DuplicatingThread* const mSourceThread; // for waitTimeMs() in write()
     AudioTrackClientProxy*      mClientProxy;
 };  // end of OutputTrack
@@ -69,7 +69,8 @@ private:
            // updated by RecordThread::readInputParameters_l()
             AudioResampler                      *mResampler;
 
-            // interleaved stereo pairs of fixed-point Q4.27
+            // interleaved stereo pairs of fixed-point Q4.27, or of float if the thread's
+            // mRsmpInFormat is float; also scratch for RecordThread::convertForTrack()
             int32_t                             *mRsmpOutBuffer;
             // current allocated frame count for the above, which may be larger than needed
             size_t                              mRsmpOutFrameCount;
@@ -18,69 +18,92 @@
 //#define LOG_NDEBUG 0
 
 #include "Configuration.h"
+#include <limits.h>
 #include <time.h>
 #include <cutils/atomic.h>
+#include <utils/Debug.h>
 #include <utils/Log.h>
 #include "StateQueue.h"
 
 namespace android {
 
-#ifdef STATE_QUEUE_DUMP
-void StateQueueObserverDump::dump(int fd)
+void StateQueueObserverDump::dump(int fd) const
 {
-    dprintf(fd, "State queue observer: stateChanges=%u\n", mStateChanges);
+    dprintf(fd, "  State queue observer: stateChanges=%u statesSkipped=%u\n",
+            mStateChanges, mStatesSkipped);
 }
 
-void StateQueueMutatorDump::dump(int fd)
+void StateQueueMutatorDump::dump(int fd) const
 {
-    dprintf(fd, "State queue mutator: pushDirty=%u pushAck=%u blockedSequence=%u\n",
-            mPushDirty, mPushAck, mBlockedSequence);
+    dprintf(fd, "  State queue mutator: pushDirty=%u pushAck=%u blockedSequence=%u\n"
+                "                       pushBlocked=%u maxBlocked=%u us\n",
+            mPushDirty, mPushAck, mBlockedSequence, mPushBlocked, mMaxBlockedUs);
 }
-#endif
 
 // Constructor and destructor
 
-template<typename T> StateQueue<T>::StateQueue() :
-    mAck(NULL), mCurrent(NULL),
-    mMutating(&mStates[0]), mExpecting(NULL),
-    mInMutation(false), mIsDirty(false), mIsInitialized(false)
-#ifdef STATE_QUEUE_DUMP
-    , mObserverDump(&mObserverDummyDump), mMutatorDump(&mMutatorDummyDump)
-#endif
+template<typename T, unsigned N, unsigned NObservers> StateQueue<T, N, NObservers>::StateQueue() :
+    mMutating(&mStates[0]), mExpecting(NULL), mExpectingSequence(0),
+    mInMutation(false), mIsDirty(false), mIsInitialized(false),
+    mMutatorDump(&mMutatorDummyDump)
 {
+    COMPILE_TIME_ASSERT_FUNCTION_SCOPE(N >= 4 && NObservers >= 1 && N >= NObservers + 2);
     atomic_init(&mNext, 0);
+    for (unsigned i = 0; i < kN; ++i) {
+        mSequences[i] = 0;
+    }
+    for (unsigned i = 0; i < kObservers; ++i) {
+        atomic_init(&mAck[i], 0);
+        atomic_init(&mPrevious[i], 0);
+        mCurrent[i] = NULL;
+        mCurrentSequence[i] = 0;
+        mObserverDump[i] = &mObserverDummyDump[i];
+    }
 }
 
-template<typename T> StateQueue<T>::~StateQueue()
+template<typename T, unsigned N, unsigned NObservers> StateQueue<T, N, NObservers>::~StateQueue()
 {
 }
 
 // Observer APIs
 
-template<typename T> const T* StateQueue<T>::poll()
+template<typename T, unsigned N, unsigned NObservers>
+const T* StateQueue<T, N, NObservers>::poll(unsigned observer)
 {
+    ALOG_ASSERT(observer < kObservers, "poll() called by unknown observer %u", observer);
     const T *next = (const T *) atomic_load_explicit(&mNext, memory_order_acquire);
 
-    if (next != mCurrent) {
-        mAck = next;    // no additional barrier needed
-        mCurrent = next;
-#ifdef STATE_QUEUE_DUMP
-        mObserverDump->mStateChanges++;
-#endif
+    if (next != mCurrent[observer]) {
+        // next was pushed after our current state, so its slot can't be reused until we
+        // acknowledge a later one, and its sequence number is stable
+        const uint32_t sequence = mSequences[next - mStates];
+        StateQueueObserverDump *dump = mObserverDump[observer];
+        if (mCurrent[observer] != NULL) {
+            dump->mStatesSkipped += sequence - mCurrentSequence[observer] - 1;
+        }
+        // our current state becomes the previous one, and the old previous one is released.
+        // The mutator reads mAck before mPrevious, so publish mPrevious first.
+        atomic_store_explicit(&mPrevious[observer], mCurrentSequence[observer],
+                memory_order_release);
+        atomic_store_explicit(&mAck[observer], sequence, memory_order_release);
+        mCurrent[observer] = next;
+        mCurrentSequence[observer] = sequence;
+        dump->mStateChanges++;
     }
     return next;
 }
 
 // Mutator APIs
 
-template<typename T> T* StateQueue<T>::begin()
+template<typename T, unsigned N, unsigned NObservers> T* StateQueue<T, N, NObservers>::begin()
 {
     ALOG_ASSERT(!mInMutation, "begin() called when in a mutation");
     mInMutation = true;
     return mMutating;
 }
 
-template<typename T> void StateQueue<T>::end(bool didModify)
+template<typename T, unsigned N, unsigned NObservers>
+void StateQueue<T, N, NObservers>::end(bool didModify)
 {
     ALOG_ASSERT(mInMutation, "end() called when not in a mutation");
     ALOG_ASSERT(mIsInitialized || didModify, "first end() must modify for initialization");
@@ -91,7 +114,53 @@ template<typename T> void StateQueue<T>::end(bool didModify)
     mInMutation = false;
 }
 
-template<typename T> bool StateQueue<T>::push(StateQueue<T>::block_t block)
+template<typename T, unsigned N, unsigned NObservers>
+T* StateQueue<T, N, NObservers>::reusable() const
+{
+    uint32_t acks[kObservers], previous[kObservers];
+    for (unsigned i = 0; i < kObservers; ++i) {
+        acks[i] = atomic_load_explicit(&mAck[i], memory_order_acquire);
+        previous[i] = atomic_load_explicit(&mPrevious[i], memory_order_acquire);
+    }
+    // search in circular order starting after mMutating, so that the states are
+    // recycled in FIFO order when observers keep up
+    const unsigned mutating = mMutating - mStates;
+    for (unsigned j = 1; j < kN; ++j) {
+        const unsigned slot = (mutating + j) % kN;
+        const uint32_t sequence = mSequences[slot];
+        if (sequence == 0) {
+            // never pushed, so never seen by an observer
+            return const_cast<T *>(&mStates[slot]);
+        }
+        bool referenced = false;
+        for (unsigned i = 0; i < kObservers; ++i) {
+            // sequence numbers wrap, so compare the difference
+            if (acks[i] == 0 || (int32_t) (sequence - acks[i]) >= 0 || sequence == previous[i]) {
+                referenced = true;
+                break;
+            }
+        }
+        if (!referenced) {
+            return const_cast<T *>(&mStates[slot]);
+        }
+    }
+    return NULL;
+}
+
+template<typename T, unsigned N, unsigned NObservers>
+bool StateQueue<T, N, NObservers>::isAcked() const
+{
+    for (unsigned i = 0; i < kObservers; ++i) {
+        const uint32_t ack = atomic_load_explicit(&mAck[i], memory_order_acquire);
+        if (ack == 0 || (int32_t) (ack - mExpectingSequence) < 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename T, unsigned N, unsigned NObservers>
+bool StateQueue<T, N, NObservers>::push(StateQueue<T, N, NObservers>::block_t block)
 {
 #define PUSH_BLOCK_ACK_NS    3000000L   // 3 ms: time between checks for ack in push()
                                         //       FIXME should be configurable
@@ -99,56 +168,36 @@ template<typename T> bool StateQueue<T>::push(StateQueue<T>::block_t block)
 
     ALOG_ASSERT(!mInMutation, "push() called when in a mutation");
 
-#ifdef STATE_QUEUE_DUMP
     if (block == BLOCK_UNTIL_ACKED) {
         mMutatorDump->mPushAck++;
     }
-#endif
 
     if (mIsDirty) {
 
-#ifdef STATE_QUEUE_DUMP
         mMutatorDump->mPushDirty++;
-#endif
 
-        // wait for prior push to be acknowledged
-        if (mExpecting != NULL) {
-#ifdef STATE_QUEUE_DUMP
-            unsigned count = 0;
-#endif
-            for (;;) {
-                const T *ack = (const T *) mAck;    // no additional barrier needed
-                if (ack == mExpecting) {
-                    // unnecessary as we're about to rewrite
-                    //mExpecting = NULL;
-                    break;
-                }
-                if (block == BLOCK_NEVER) {
-                    return false;
-                }
-#ifdef STATE_QUEUE_DUMP
-                if (count == 1) {
-                    mMutatorDump->mBlockedSequence++;
-                }
-                ++count;
-#endif
-                nanosleep(&req, NULL);
-            }
-#ifdef STATE_QUEUE_DUMP
-            if (count > 1) {
-                mMutatorDump->mBlockedSequence++;
+        // wait for observers to release a slot to be mutated after this push
+        if (!isReusable()) {
+            mMutatorDump->mPushBlocked++;
+            if (block == BLOCK_NEVER) {
+                return false;
             }
-#endif
+            waitFor(&StateQueue::isReusable, req);
         }
 
-        // publish
+        // publish, skipping the reserved sequence number 0 on wraparound
+        uint32_t sequence = mExpectingSequence + 1;
+        if (sequence == 0) {
+            sequence = 1;
+        }
+        mSequences[mMutating - mStates] = sequence;
         atomic_store_explicit(&mNext, (uintptr_t)mMutating, memory_order_release);
         mExpecting = mMutating;
+        mExpectingSequence = sequence;
 
-        // copy with circular wraparound
-        if (++mMutating >= &mStates[kN]) {
-            mMutating = &mStates[0];
-        }
+        // copy to the reusable slot; observers can only release more slots meanwhile
+        mMutating = reusable();
+        ALOG_ASSERT(mMutating != NULL, "no reusable slot after push()");
         *mMutating = *mExpecting;
         mIsDirty = false;
 
@@ -157,34 +206,43 @@ template<typename T> bool StateQueue<T>::push(StateQueue<T>::block_t block)
     // optionally wait for this push or a prior push to be acknowledged
     if (block == BLOCK_UNTIL_ACKED) {
         if (mExpecting != NULL) {
-#ifdef STATE_QUEUE_DUMP
-            unsigned count = 0;
-#endif
-            for (;;) {
-                const T *ack = (const T *) mAck;    // no additional barrier needed
-                if (ack == mExpecting) {
-                    mExpecting = NULL;
-                    break;
-                }
-#ifdef STATE_QUEUE_DUMP
-                if (count == 1) {
-                    mMutatorDump->mBlockedSequence++;
-                }
-                ++count;
-#endif
-                nanosleep(&req, NULL);
-            }
-#ifdef STATE_QUEUE_DUMP
-            if (count > 1) {
-                mMutatorDump->mBlockedSequence++;
+            if (!isAcked()) {
+                mMutatorDump->mPushBlocked++;
+                waitFor(&StateQueue::isAcked, req);
             }
-#endif
+            mExpecting = NULL;
         }
     }
 
     return true;
 }
 
+template<typename T, unsigned N, unsigned NObservers>
+void StateQueue<T, N, NObservers>::waitFor(bool (StateQueue::*condition)() const,
+        const struct timespec& req)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    unsigned count = 0;
+    do {
+        if (count == 1) {
+            mMutatorDump->mBlockedSequence++;
+        }
+        ++count;
+        nanosleep(&req, NULL);
+    } while (!(this->*condition)());
+    if (count > 1) {
+        mMutatorDump->mBlockedSequence++;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const int64_t blockedUs = (now.tv_sec - start.tv_sec) * 1000000LL +
+            (now.tv_nsec - start.tv_nsec) / 1000;
+    if (blockedUs > (int64_t) mMutatorDump->mMaxBlockedUs) {
+        mMutatorDump->mMaxBlockedUs = blockedUs > UINT_MAX ? UINT_MAX : (unsigned) blockedUs;
+    }
+}
+
 }   // namespace android
 
 // hack for gcc
@@ -18,6 +18,7 @@
 #define ANDROID_AUDIO_STATE_QUEUE_H
 
 #include <stdatomic.h>
+#include <time.h>
 
 // The state queue template class was originally driven by this use case / requirements:
 //  There are two threads: a fast mixer, and a normal mixer, and they share state.
@@ -68,7 +69,9 @@
 
 // Solution:
 //  Let's call the fast mixer thread the "observer" and normal mixer thread the "mutator".
-//  We assume there is only a single observer and a single mutator; this is critical.
+//  We assume there is only a single mutator; this is critical.
+//  There may be several observers, but their number is fixed at compile time and each of them
+//  must keep polling, as the mutator can only recycle a state after all observers moved past it.
 //  Each state is of type <T>, and should contain only POD (Plain Old Data) and raw pointers, as
 //  memcpy() may be used to copy state, and the destructors are run in unpredictable order.
 //  The states in chronological order are: previous, current, next, and mutating:
@@ -90,12 +93,20 @@
 //  effectively in random order, that is the observer should not do address
 //  arithmetic on the state pointers.  However to the mutator, the state pointers
 //  are in a definite circular order.
+//  Each pushed state is tagged with a non-zero sequence number.  Each observer publishes the
+//  sequence numbers of its previous and current states.  The mutator may reuse a slot for
+//  mutating only if, for every observer, the state last pushed from that slot is neither its
+//  previous state nor its current state nor a state pushed after its current one (which the
+//  observer could be about to pick up).  With the default depth of 4 and a single observer,
+//  this means each push waits for the prior push to be acknowledged; a deeper queue lets the
+//  mutator run several pushes ahead of the slowest observer, which may then skip states.
+//  The depth must be at least the number of observers + 2, so that a slot is always available
+//  once all observers have caught up.
 
 #include "Configuration.h"
 
 namespace android {
 
-#ifdef STATE_QUEUE_DUMP
 // The StateQueueObserverDump and StateQueueMutatorDump keep
 // a cache of StateQueue statistics that can be logged by dumpsys.
 // Each individual native word-sized field is accessed atomically.  But the
@@ -105,26 +116,32 @@ namespace android {
 // It has a different lifetime than the StateQueue, and so it can't be a member of StateQueue.
 
 struct StateQueueObserverDump {
-    StateQueueObserverDump() : mStateChanges(0) { }
+    StateQueueObserverDump() : mStateChanges(0), mStatesSkipped(0) { }
     /*virtual*/ ~StateQueueObserverDump() { }
     unsigned    mStateChanges;    // incremented each time poll() detects a state change
-    void        dump(int fd);
+    unsigned    mStatesSkipped;   // number of pushed states that poll() never returned,
+                                  // because the observer lagged behind the mutator
+    void        dump(int fd) const;
 };
 
 struct StateQueueMutatorDump {
-    StateQueueMutatorDump() : mPushDirty(0), mPushAck(0), mBlockedSequence(0) { }
+    StateQueueMutatorDump() : mPushDirty(0), mPushAck(0), mBlockedSequence(0),
+            mPushBlocked(0), mMaxBlockedUs(0) { }
     /*virtual*/ ~StateQueueMutatorDump() { }
     unsigned    mPushDirty;       // incremented each time push() is called with a dirty state
     unsigned    mPushAck;         // incremented each time push(BLOCK_UNTIL_ACKED) is called
     unsigned    mBlockedSequence; // incremented before and after each time that push()
                                   // blocks for more than one PUSH_BLOCK_ACK_NS;
                                   // if odd, then mutator is currently blocked inside push()
-    void        dump(int fd);
+    unsigned    mPushBlocked;     // incremented each time push() finds no free slot or
+                                  // has to wait for an acknowledgement
+    unsigned    mMaxBlockedUs;    // longest time spent waiting on observers inside push()
+    void        dump(int fd) const;
 };
-#endif
 
-// manages a FIFO queue of states
-template<typename T> class StateQueue {
+// manages a FIFO queue of states, with a configurable number of slots (at least 4, and at least
+// the number of observers + 2), shared by one mutator and a fixed number of observers
+template<typename T, unsigned N = 4, unsigned NObservers = 1> class StateQueue {
 
 public:
             StateQueue();
@@ -138,7 +155,8 @@ public:
     // then the returned pointer will be unchanged.
     // The previous state pointer is guaranteed to still be valid;
     // this allows the observer to diff the previous and new states.
-    const T* poll();
+    // Each observer must pass its own index in [0, NObservers) and must keep polling.
+    const T* poll(unsigned observer = 0);
 
     // Mutator APIs
 
@@ -155,58 +173,71 @@ public:
     // Does not automatically push the new state onto the state queue.
     void    end(bool didModify = true);
 
-    // Push a new state, if any, out to the observer via the state queue.
+    // Push a new state, if any, out to the observers via the state queue.
     // For BLOCK_NEVER, returns:
     //      true if not dirty, or dirty and pushed successfully
     //      false if dirty and not pushed because that would block; remains dirty
     // For BLOCK_UNTIL_PUSHED and BLOCK_UNTIL_ACKED, always returns true.
     // No-op if there are no pending modifications (not dirty), except
-    //      for BLOCK_UNTIL_ACKED it will wait until a prior push has been acknowledged.
+    //      for BLOCK_UNTIL_ACKED it will wait until a prior push has been acknowledged
+    //      by all observers.
     // Must not be called in the middle of a mutation.
     enum block_t {
         BLOCK_NEVER,        // do not block
         BLOCK_UNTIL_PUSHED, // block until there's a slot available for the push
-        BLOCK_UNTIL_ACKED,  // also block until the push is acknowledged by the observer
+        BLOCK_UNTIL_ACKED,  // also block until the push is acknowledged by the observers
     };
     bool    push(block_t block = BLOCK_NEVER);
 
     // Return whether the current state is dirty (modified and not pushed).
     bool    isDirty() const { return mIsDirty; }
 
-#ifdef STATE_QUEUE_DUMP
     // Register location of observer dump area
-    void    setObserverDump(StateQueueObserverDump *dump)
-            { mObserverDump = dump != NULL ? dump : &mObserverDummyDump; }
+    void    setObserverDump(StateQueueObserverDump *dump, unsigned observer = 0)
+            { mObserverDump[observer] = dump != NULL ? dump : &mObserverDummyDump[observer]; }
 
     // Register location of mutator dump area
     void    setMutatorDump(StateQueueMutatorDump *dump)
             { mMutatorDump = dump != NULL ? dump : &mMutatorDummyDump; }
-#endif
 
 private:
-    static const unsigned kN = 4;       // values < 4 are not supported by this code
+    static const unsigned kN = N;       // values < 4 are not supported by this code
+    static const unsigned kObservers = NObservers;
+
+    // returns a slot other than mMutating that no observer references or may pick up,
+    // or NULL if there is none
+    T*      reusable() const;
+    bool    isReusable() const { return reusable() != NULL; }
+    // returns whether all observers have acknowledged the state pushed as mExpectingSequence
+    bool    isAcked() const;
+    // sleeps until condition is true, and updates the blocking statistics
+    void    waitFor(bool (StateQueue::*condition)() const, const struct timespec& req);
+
     T                 mStates[kN];      // written by mutator, read by observer
+    uint32_t          mSequences[kN];   // sequence number of the state last pushed from each slot,
+                                        // or 0 if never pushed; written by mutator before mNext
 
-    // "volatile" is meaningless with SMP, but here it indicates that we're using atomic ops
     atomic_uintptr_t  mNext; // written by mutator to advance next, read by observer
-    volatile const T* mAck;  // written by observer to acknowledge advance of next, read by mutator
+    // written by each observer to acknowledge advance of next, read by mutator
+    atomic_uint_least32_t mAck[kObservers];      // sequence number of current state, or 0
+    atomic_uint_least32_t mPrevious[kObservers]; // sequence number of previous state, or 0
 
     // only used by observer
-    const T*          mCurrent;         // most recent value returned by poll()
+    const T*          mCurrent[kObservers];         // most recent value returned by poll()
+    uint32_t          mCurrentSequence[kObservers]; // sequence number of mCurrent
 
     // only used by mutator
     T*                mMutating;        // where updates by mutator are done in place
     const T*          mExpecting;       // what the mutator expects mAck to be set to
+    uint32_t          mExpectingSequence;   // sequence number of mExpecting
     bool              mInMutation;      // whether we're currently in the middle of a mutation
     bool              mIsDirty;         // whether mutating state has been modified since last push
     bool              mIsInitialized;   // whether mutating state has been initialized yet
 
-#ifdef STATE_QUEUE_DUMP
-    StateQueueObserverDump  mObserverDummyDump; // default area for observer dump if not set
-    StateQueueObserverDump* mObserverDump;      // pointer to active observer dump, always non-NULL
+    StateQueueObserverDump  mObserverDummyDump[kObservers]; // default areas for observer dump
+    StateQueueObserverDump* mObserverDump[kObservers];      // active observer dumps, non-NULL
     StateQueueMutatorDump   mMutatorDummyDump;  // default area for mutator dump if not set
     StateQueueMutatorDump*  mMutatorDump;       // pointer to active mutator dump, always non-NULL
-#endif
 
 };  // class StateQueue
 
@@ -125,6 +125,33 @@ static const uint32_t kMaxNormalSinkBufferSizeMs = 24;
 // Offloaded output thread standby delay: allows track transition without going to standby
 static const nsecs_t kOffloadStandbyDelayNs = seconds(1);
 
+// Maximum number of HAL buffers written at once by an OffloadThread, specified per-device via
+// property af.offload.write_periods. It must be lower than the number of buffers the DSP
+// holds, as the write that follows a full HAL buffer is then deferred until that many buffers
+// are free. 1 writes one HAL buffer per wakeup.
+static const uint32_t kMaxOffloadWritePeriods = 8;
+
+static uint32_t sOffloadWritePeriods = 1;
+
+static pthread_once_t sOffloadWritePeriodsOnce = PTHREAD_ONCE_INIT;
+
+static void sOffloadWritePeriodsInit()
+{
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("af.offload.write_periods", value, NULL) > 0) {
+        char *endptr;
+        unsigned long ul = strtoul(value, &endptr, 0);
+        if (*endptr == '\0' && 1 <= ul && ul <= kMaxOffloadWritePeriods) {
+            sOffloadWritePeriods = (uint32_t) ul;
+        }
+    }
+}
+
+// Weight of a new sample in the average DSP consumption rate of an OffloadThread
+static const double kOffloadRateWeight = 0.25;
+// Bound on a deferred offload write, in case the consumption rate is underestimated
+static const nsecs_t kMaxOffloadWriteDeferralNs = seconds(5);
+
 // Whether to use fast mixer
 static const enum {
     FastMixer_Never,    // never initialize or use: for debugging only
@@ -153,6 +180,7 @@ static const enum {
 static const int kPriorityAudioApp = 2;
 static const int kPriorityFastMixer = 3;
 static const int kPriorityFastCapture = 3;
+static const int kPriorityEffects = 2;
 
 // IAudioFlinger::createTrack() reports back to client the total size of shared memory area
 // for the track.  The client then sub-divides this into smaller buffers for its use.
@@ -172,6 +200,49 @@ static const int kFastTrackMultiplierMax = 2;
 // The actual value to use, which can be specified per-device via property af.fast_track_multiplier.
 static int sFastTrackMultiplier = kFastTrackMultiplier;
 
+// Fast tracks are admitted while the fast mixer CPU load, plus the estimated cost of the new
+// track, stays within this percentage of the fast mixer period.
+static const uint32_t kFastMixerCpuBudgetPercent = 50;
+
+// Number of most recent fast mixer cycles used to estimate its CPU load.
+static const uint32_t kFastMixerLoadCycles = 128;
+
+// Maximum number of fast track slots in use, including the normal mixer's submix, when the fast
+// mixer load has not been measured.  This was the former fixed capacity of the fast track table.
+static const unsigned kFastTracksUnmeasured = 8;
+
+// Maximum number of normal mix periods by which a MixerThread may raise the depth of the pipe
+// feeding its fast mixer after underruns, specified per-device via property
+// af.fast_mixer.adaptive. 0 keeps the fixed depth.
+static const uint32_t kMaxFastMixerLatencyLevels = 4;
+
+static uint32_t sFastMixerLatencyLevels = 0;
+
+static pthread_once_t sFastMixerLatencyLevelsOnce = PTHREAD_ONCE_INIT;
+
+static void sFastMixerLatencyLevelsInit()
+{
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("af.fast_mixer.adaptive", value, NULL) > 0) {
+        char *endptr;
+        unsigned long ul = strtoul(value, &endptr, 0);
+        if (*endptr == '\0' && ul <= kMaxFastMixerLatencyLevels) {
+            sFastMixerLatencyLevels = (uint32_t) ul;
+        }
+    }
+}
+
+// Interval at which the fast mixer underruns are checked to adapt the pipe depth.
+static const nsecs_t kFastMixerLatencyCheckNs = seconds(1);
+
+// Number of consecutive checks without underruns, and with the longest recent cycle below
+// kFastMixerHeadroomPercent of the underrun threshold, before the pipe depth is lowered again.
+static const uint32_t kFastMixerLatencyQuietChecks = 30;
+static const uint32_t kFastMixerHeadroomPercent = 75;
+
+// Additional fast mixer warmup cycles required after cold idle, per latency level.
+static const uint32_t kFastMixerWarmupCyclesPerLevel = 2;
+
 // See Thread::readOnlyHeap().
 // Initially this heap is used to allocate client buffers for "fast" AudioRecord.
 // Eventually it will be the single buffer that FastCapture writes into via HAL read(),
@@ -194,6 +265,154 @@ static void sFastTrackMultiplierInit()
     }
 }
 
+// Number of AudioMixer worker threads used by each MixerThread to mix resampled tracks
+// in parallel, specified per-device via property af.mixer.workers. 0 disables parallel mixing.
+static uint32_t sMixerWorkerCount = 0;
+
+static pthread_once_t sMixerWorkerCountOnce = PTHREAD_ONCE_INIT;
+
+static void sMixerWorkerCountInit()
+{
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("af.mixer.workers", value, NULL) > 0) {
+        char *endptr;
+        unsigned long ul = strtoul(value, &endptr, 0);
+        if (*endptr == '\0' && ul <= AudioMixer::MAX_NUM_WORKERS) {
+            sMixerWorkerCount = (uint32_t) ul;
+        }
+    }
+}
+
+// Whether threads account the CPU time spent on each normal mixer track and each effect,
+// for display by dumpsys, specified per-device via property af.cost_accounting.
+static bool sCostAccounting = false;
+
+static pthread_once_t sCostAccountingOnce = PTHREAD_ONCE_INIT;
+
+static void sCostAccountingInit()
+{
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("af.cost_accounting", value, NULL) > 0) {
+        char *endptr;
+        unsigned long ul = strtoul(value, &endptr, 0);
+        if (*endptr == '\0') {
+            sCostAccounting = ul != 0;
+        }
+    }
+}
+
+// Maximum number of normal mix periods mixed and written at once by a MixerThread on a deep
+// buffer output when all its tracks have enough data, specified per-device via property
+// af.mixer.batch. 1 disables batching.
+static const uint32_t kMaxBatchPeriods = 4;
+
+static uint32_t sMixerBatchPeriods = 1;
+
+static pthread_once_t sMixerBatchPeriodsOnce = PTHREAD_ONCE_INIT;
+
+static void sMixerBatchPeriodsInit()
+{
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("af.mixer.batch", value, NULL) > 0) {
+        char *endptr;
+        unsigned long ul = strtoul(value, &endptr, 0);
+        if (*endptr == '\0' && 1 <= ul && ul <= kMaxBatchPeriods) {
+            sMixerBatchPeriods = (uint32_t) ul;
+        }
+    }
+}
+
+// Whether RecordThreads with a fast capture apply the enabled pre-processing effects on the
+// fast capture thread instead of registering them with the HAL input stream, specified
+// per-device via property af.fast_capture.effects.
+static bool sFastCaptureEffects = false;
+
+static pthread_once_t sFastCaptureEffectsOnce = PTHREAD_ONCE_INIT;
+
+static void sFastCaptureEffectsInit()
+{
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("af.fast_capture.effects", value, NULL) > 0) {
+        char *endptr;
+        unsigned long ul = strtoul(value, &endptr, 0);
+        if (*endptr == '\0') {
+            sFastCaptureEffects = ul != 0;
+        }
+    }
+}
+
+// Whether deep buffer MixerThreads run their global effect chains one period behind the mix
+// on an EffectsThread, specified per-device via property af.effects.pipeline.
+static bool sEffectsPipeline = false;
+
+static pthread_once_t sEffectsPipelineOnce = PTHREAD_ONCE_INIT;
+
+static void sEffectsPipelineInit()
+{
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("af.effects.pipeline", value, NULL) > 0) {
+        char *endptr;
+        unsigned long ul = strtoul(value, &endptr, 0);
+        if (*endptr == '\0') {
+            sEffectsPipeline = ul != 0;
+        }
+    }
+}
+
+// Whether RecordThread may read from the HAL straight into a client buffer, see threadLoop()
+static bool sRecordDirect = true;
+
+static pthread_once_t sRecordDirectOnce = PTHREAD_ONCE_INIT;
+
+static void sRecordDirectInit()
+{
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("af.record.direct", value, NULL) > 0) {
+        char *endptr;
+        unsigned long ul = strtoul(value, &endptr, 0);
+        if (*endptr == '\0') {
+            sRecordDirect = ul != 0;
+        }
+    }
+}
+
+// Whether RecordThread runs its pipeline in float even for a 16-bit HAL, see
+// readInputParameters_l().  HALs delivering other linear PCM formats always use float.
+static bool sRecordFloat = false;
+
+static pthread_once_t sRecordFloatOnce = PTHREAD_ONCE_INIT;
+
+static void sRecordFloatInit()
+{
+    char value[PROPERTY_VALUE_MAX];
+    if (property_get("af.record.float", value, NULL) > 0) {
+        char *endptr;
+        unsigned long ul = strtoul(value, &endptr, 0);
+        if (*endptr == '\0') {
+            sRecordFloat = ul != 0;
+        }
+    }
+}
+
+// float counterparts of upmix_to_stereo_i16_from_mono_i16() and
+// downmix_to_mono_i16_from_stereo_i16(); in place is permitted for the downmix only
+static void upmixToStereoFloatFromMonoFloat(float *dst, const float *src, size_t count)
+{
+    while (count--) {
+        dst[0] = *src;
+        dst[1] = *src++;
+        dst += 2;
+    }
+}
+
+static void downmixToMonoFloatFromStereoFloat(float *dst, const float *src, size_t count)
+{
+    while (count--) {
+        *dst++ = (src[0] + src[1]) * 0.5f;
+        src += 2;
+    }
+}
+
 // ----------------------------------------------------------------------------
 
 #ifdef ADD_BATTERY_DATA
@@ -334,6 +553,8 @@ AudioFlinger::ThreadBase::ThreadBase(const sp<AudioFlinger>& audioFlinger, audio
         // mName will be set by concrete (non-virtual) subclass
         mDeathRecipient(new PMDeathRecipient(this))
 {
+    pthread_once(&sCostAccountingOnce, sCostAccountingInit);
+    mCostAccounting = sCostAccounting;
 }
 
 AudioFlinger::ThreadBase::~ThreadBase()
@@ -1114,6 +1335,7 @@ status_t AudioFlinger::ThreadBase::addEffect_l(const sp<EffectModule>& effect)
     effect->setDevice(mInDevice);
     effect->setMode(mAudioFlinger->getMode());
     effect->setAudioSource(mAudioSource);
+    updateEffectBufferFormat_l();
     return NO_ERROR;
 }
 
@@ -1130,6 +1352,8 @@ void AudioFlinger::ThreadBase::removeEffect_l(const sp<EffectModule>& effect) {
         // remove effect chain if removing last effect
         if (chain->removeEffect_l(effect) == 0) {
             removeEffectChain_l(chain);
+        } else {
+            updateEffectBufferFormat_l();
         }
     } else {
         ALOGW("removeEffect_l() %p cannot promote chain for effect %p", this, effect.get());
@@ -1201,7 +1425,7 @@ AudioFlinger::PlaybackThread::PlaybackThread(const sp<AudioFlinger>& audioFlinge
                                              audio_devices_t device,
                                              type_t type)
     :   ThreadBase(audioFlinger, id, device, AUDIO_DEVICE_NONE, type),
-        mNormalFrameCount(0), mSinkBuffer(NULL),
+        mNormalFrameCount(0), mSinkBuffer(NULL), mSinkBufferPeriods(1),
         mMixerBufferEnabled(AudioFlinger::kEnableExtendedPrecision),
         mMixerBuffer(NULL),
         mMixerBufferSize(0),
@@ -1213,9 +1437,12 @@ AudioFlinger::PlaybackThread::PlaybackThread(const sp<AudioFlinger>& audioFlinge
         mEffectBufferFormat(AUDIO_FORMAT_INVALID),
         mEffectBufferValid(false),
         mSuspended(0), mBytesWritten(0),
+        mEchoReferenceGen(0),
         mActiveTracksGeneration(0),
         // mStreamTypes[] initialized in constructor body
         mOutput(output),
+        mVolumeSequence(0), mLatchedVolumeSequence(0),
+        mHalMasterVolume(false), mHalMasterMute(false),
         mLastWriteTime(0), mNumWrites(0), mNumDelayedWrites(0), mInWrite(false),
         mMixerStatus(MIXER_IDLE),
         mMixerStatusIgnoringFastTracks(MIXER_IDLE),
@@ -1227,8 +1454,10 @@ AudioFlinger::PlaybackThread::PlaybackThread(const sp<AudioFlinger>& audioFlinge
         mDrainSequence(0),
         mSignalPending(false),
         mScreenState(AudioFlinger::mScreenState),
+        mLatencyLevel(0),
         // index 0 is reserved for normal mixer's submix
-        mFastTrackAvailMask(((1 << FastMixerState::kMaxFastTracks) - 1) & ~1),
+        mFastTrackAvailMask((FastMixerState::kMaxFastTracks == 32 ? ~0u :
+                (1u << FastMixerState::kMaxFastTracks) - 1) & ~1u),
         // mLatchD, mLatchQ,
         mLatchDValid(false), mLatchQValid(false)
 {
@@ -1245,11 +1474,13 @@ AudioFlinger::PlaybackThread::PlaybackThread(const sp<AudioFlinger>& audioFlinge
     mMasterVolume = audioFlinger->masterVolume_l();
     mMasterMute = audioFlinger->masterMute_l();
     if (mOutput && mOutput->audioHwDev) {
-        if (mOutput->audioHwDev->canSetMasterVolume()) {
+        mHalMasterVolume = mOutput->audioHwDev->canSetMasterVolume();
+        mHalMasterMute = mOutput->audioHwDev->canSetMasterMute();
+        if (mHalMasterVolume) {
             mMasterVolume = 1.0;
         }
 
-        if (mOutput->audioHwDev->canSetMasterMute()) {
+        if (mHalMasterMute) {
             mMasterMute = false;
         }
     }
@@ -1265,6 +1496,10 @@ AudioFlinger::PlaybackThread::PlaybackThread(const sp<AudioFlinger>& audioFlinge
     }
     // mStreamTypes[AUDIO_STREAM_CNT] exists but isn't explicitly initialized here,
     // because mAudioFlinger doesn't have one to copy from
+
+    mVolumeSnapshot.masterVolume = mMasterVolume;
+    mVolumeSnapshot.masterMute = mMasterMute;
+    memcpy(mVolumeSnapshot.streamTypes, mStreamTypes, sizeof(mStreamTypes));
 }
 
 AudioFlinger::PlaybackThread::~PlaybackThread()
@@ -1345,6 +1580,8 @@ void AudioFlinger::PlaybackThread::dumpTracks(int fd, const Vector<String16>& ar
     }
 
     write(fd, result.string(), result.size());
+
+    dumpTrackCosts(fd);
 }
 
 void AudioFlinger::PlaybackThread::dumpInternals(int fd, const Vector<String16>& args)
@@ -1358,7 +1595,12 @@ void AudioFlinger::PlaybackThread::dumpInternals(int fd, const Vector<String16>&
     dprintf(fd, "  Suspend count: %d\n", mSuspended);
     dprintf(fd, "  Sink buffer : %p\n", mSinkBuffer);
     dprintf(fd, "  Mixer buffer: %p\n", mMixerBuffer);
-    dprintf(fd, "  Effect buffer: %p\n", mEffectBuffer);
+    dprintf(fd, "  Effect buffer: %p (%s)\n", mEffectBuffer,
+            mEffectBuffer != NULL ? formatToString(mEffectBufferFormat) : "none");
+    if (mEffectsThread != 0) {
+        dprintf(fd, "  Effects pipeline: %u periods, %u late\n",
+                mEffectsThread->periods(), mEffectsThread->latePeriods());
+    }
     dprintf(fd, "  Fast track availMask=%#x\n", mFastTrackAvailMask);
 
     dumpBase(fd, args);
@@ -1430,7 +1672,9 @@ sp<AudioFlinger::PlaybackThread::Track> AudioFlinger::PlaybackThread::createTrac
             // normal mixer has an associated fast mixer
             hasFastMixer() &&
             // there are sufficient fast track slots available
-            (mFastTrackAvailMask != 0)
+            (mFastTrackAvailMask != 0) &&
+            // and the fast mixer can afford the CPU cost of one more track
+            canAdmitFastTrack_l()
             // FIXME test that MixerThread for this fast track has a capable output HAL
             // FIXME add a permission test also?
         ) {
@@ -1601,48 +1845,113 @@ uint32_t AudioFlinger::PlaybackThread::latency_l() const
     }
 }
 
+// The volume setters below are called from binder threads.  They only take mVolumeLock,
+// so they never wait for prepareTracks_l() to release mLock; the new values are picked up
+// by latchVolumes_l() at the start of the next mix cycle.
+
+void AudioFlinger::PlaybackThread::beginVolumeUpdate_l()
+{
+    // odd sequence: mVolumeSnapshot is being updated
+    android_atomic_inc(&mVolumeSequence);
+}
+
+void AudioFlinger::PlaybackThread::endVolumeUpdate_l()
+{
+    // even sequence: mVolumeSnapshot is consistent again
+    android_atomic_inc(&mVolumeSequence);
+}
+
 void AudioFlinger::PlaybackThread::setMasterVolume(float value)
 {
-    Mutex::Autolock _l(mLock);
     // Don't apply master volume in SW if our HAL can do it for us.
-    if (mOutput && mOutput->audioHwDev &&
-        mOutput->audioHwDev->canSetMasterVolume()) {
-        mMasterVolume = 1.0;
-    } else {
-        mMasterVolume = value;
+    if (mHalMasterVolume) {
+        value = 1.0;
     }
+    Mutex::Autolock _l(mVolumeLock);
+    beginVolumeUpdate_l();
+    mVolumeSnapshot.masterVolume = value;
+    endVolumeUpdate_l();
 }
 
 void AudioFlinger::PlaybackThread::setMasterMute(bool muted)
 {
-    Mutex::Autolock _l(mLock);
     // Don't apply master mute in SW if our HAL can do it for us.
-    if (mOutput && mOutput->audioHwDev &&
-        mOutput->audioHwDev->canSetMasterMute()) {
-        mMasterMute = false;
-    } else {
-        mMasterMute = muted;
+    if (mHalMasterMute) {
+        muted = false;
     }
+    Mutex::Autolock _l(mVolumeLock);
+    beginVolumeUpdate_l();
+    mVolumeSnapshot.masterMute = muted;
+    endVolumeUpdate_l();
+}
+
+// called by threadLoop with mLock held
+void AudioFlinger::PlaybackThread::setMasterMute_l(bool muted)
+{
+    {
+        Mutex::Autolock _l(mVolumeLock);
+        beginVolumeUpdate_l();
+        mVolumeSnapshot.masterMute = muted;
+        endVolumeUpdate_l();
+    }
+    mMasterMute = muted;
 }
 
 void AudioFlinger::PlaybackThread::setStreamVolume(audio_stream_type_t stream, float value)
 {
-    Mutex::Autolock _l(mLock);
-    mStreamTypes[stream].volume = value;
-    broadcast_l();
+    {
+        Mutex::Autolock _l(mVolumeLock);
+        beginVolumeUpdate_l();
+        mVolumeSnapshot.streamTypes[stream].volume = value;
+        endVolumeUpdate_l();
+    }
+    // Wake the thread if it is waiting for work.  If mLock is busy the thread is
+    // running and will latch the new volume at its next cycle.
+    if (mLock.tryLock() == NO_ERROR) {
+        broadcast_l();
+        mLock.unlock();
+    }
 }
 
 void AudioFlinger::PlaybackThread::setStreamMute(audio_stream_type_t stream, bool muted)
 {
-    Mutex::Autolock _l(mLock);
-    mStreamTypes[stream].mute = muted;
-    broadcast_l();
+    {
+        Mutex::Autolock _l(mVolumeLock);
+        beginVolumeUpdate_l();
+        mVolumeSnapshot.streamTypes[stream].mute = muted;
+        endVolumeUpdate_l();
+    }
+    if (mLock.tryLock() == NO_ERROR) {
+        broadcast_l();
+        mLock.unlock();
+    }
 }
 
 float AudioFlinger::PlaybackThread::streamVolume(audio_stream_type_t stream) const
 {
-    Mutex::Autolock _l(mLock);
-    return mStreamTypes[stream].volume;
+    // a single aligned float is read atomically, no need to check mVolumeSequence
+    android_memory_barrier();
+    return mVolumeSnapshot.streamTypes[stream].volume;
+}
+
+// latchVolumes_l() must be called with ThreadBase::mLock held, by threadLoop only
+void AudioFlinger::PlaybackThread::latchVolumes_l()
+{
+    const int32_t sequence = android_atomic_acquire_load(&mVolumeSequence);
+    if (sequence == mLatchedVolumeSequence || (sequence & 1)) {
+        // unchanged, or an update is in progress and will be latched at the next cycle
+        return;
+    }
+    volume_snapshot_t snapshot = mVolumeSnapshot;
+    android_memory_barrier();
+    if (android_atomic_acquire_load(&mVolumeSequence) != sequence) {
+        // torn copy, retry at the next cycle rather than waiting for the writer
+        return;
+    }
+    mMasterVolume = snapshot.masterVolume;
+    mMasterMute = snapshot.masterMute;
+    memcpy(mStreamTypes, snapshot.streamTypes, sizeof(mStreamTypes));
+    mLatchedVolumeSequence = sequence;
 }
 
 // addTrack_l() must be called with ThreadBase::mLock held
@@ -1726,8 +2035,8 @@ void AudioFlinger::PlaybackThread::removeTrack_l(const sp<Track>& track)
     if (track->isFastTrack()) {
         int index = track->mFastIndex;
         ALOG_ASSERT(0 < index && index < (int)FastMixerState::kMaxFastTracks);
-        ALOG_ASSERT(!(mFastTrackAvailMask & (1 << index)));
-        mFastTrackAvailMask |= 1 << index;
+        ALOG_ASSERT(!(mFastTrackAvailMask & (1u << index)));
+        mFastTrackAvailMask |= 1u << index;
         // redundant as track is about to be destroyed, for dumpsys only
         track->mFastIndex = -1;
     }
@@ -1932,7 +2241,7 @@ void AudioFlinger::PlaybackThread::readOutputParameters_l()
     mSinkBuffer = NULL;
     // For sink buffer size, we use the frame size from the downstream sink to avoid problems
     // with non PCM formats for compressed music, e.g. AAC, and Offload threads.
-    const size_t sinkBufferSize = mNormalFrameCount * mFrameSize;
+    const size_t sinkBufferSize = mNormalFrameCount * mFrameSize * mSinkBufferPeriods;
     (void)posix_memalign(&mSinkBuffer, 32, sinkBufferSize);
 
     // We resize the mMixerBuffer according to the requirements of the sink buffer which
@@ -1948,10 +2257,22 @@ void AudioFlinger::PlaybackThread::readOutputParameters_l()
     free(mEffectBuffer);
     mEffectBuffer = NULL;
     if (mEffectBufferEnabled) {
-        mEffectBufferFormat = AUDIO_FORMAT_PCM_16_BIT; // Note: Effects support 16b only
+        // 16 bit until the effect chains agree on float, see updateEffectBufferFormat_l()
+        mEffectBufferFormat = AUDIO_FORMAT_PCM_16_BIT;
         mEffectBufferSize = mNormalFrameCount * mChannelCount
                 * audio_bytes_per_sample(mEffectBufferFormat);
-        (void)posix_memalign(&mEffectBuffer, 32, mEffectBufferSize);
+        (void)posix_memalign(&mEffectBuffer, 32, mNormalFrameCount * mChannelCount
+                * audio_bytes_per_sample(AUDIO_FORMAT_PCM_FLOAT));
+    }
+    if (mEffectBufferEnabled && mType == MIXER &&
+            (mOutput->flags & AUDIO_OUTPUT_FLAG_DEEP_BUFFER)) {
+        pthread_once(&sEffectsPipelineOnce, sEffectsPipelineInit);
+        if (sEffectsPipeline) {
+            if (mEffectsThread == 0) {
+                mEffectsThread = new AudioFlinger::EffectsThread();
+            }
+            mEffectsThread->setBufferSamples(mNormalFrameCount * mChannelCount);
+        }
     }
 
     // force reconfiguration of effect chains and engines to take new buffer size and audio
@@ -2145,8 +2466,7 @@ ssize_t AudioFlinger::PlaybackThread::threadLoop_write()
             mScreenState = screenState;
             MonoPipe *pipe = (MonoPipe *)mPipeSink.get();
             if (pipe != NULL) {
-                pipe->setAvgFrames((mScreenState & 1) ?
-                        (pipe->maxFrames() * 7) / 8 : mNormalFrameCount * 2);
+                pipe->setAvgFrames(pipeSetpoint(pipe->maxFrames()));
             }
         }
         ssize_t framesWritten = mNormalSink->write((char *)mSinkBuffer + offset, count);
@@ -2165,6 +2485,10 @@ ssize_t AudioFlinger::PlaybackThread::threadLoop_write()
                 mLatchDValid = true;
             }
         }
+        if (framesWritten > 0 && mType == MIXER && (mOutput->flags & AUDIO_OUTPUT_FLAG_PRIMARY)) {
+            writeEchoReference((char *)mSinkBuffer + offset, framesWritten,
+                    status == NO_ERROR ? &mLatchD.mTimestamp : NULL);
+        }
     // otherwise use the HAL / AudioStreamOut directly
     } else {
         // Direct output and offload threads
@@ -2213,7 +2537,10 @@ void AudioFlinger::PlaybackThread::threadLoop_drain()
 
 void AudioFlinger::PlaybackThread::threadLoop_exit()
 {
-    // Default implementation has nothing to do
+    if (mEffectsThread != 0) {
+        mEffectsThread->exit();
+        mEffectsThread->join();
+    }
 }
 
 /*
@@ -2309,10 +2636,15 @@ status_t AudioFlinger::PlaybackThread::addEffectChain_l(const sp<EffectChain>& c
             }
         }
     }
+    int16_t* outBuffer = reinterpret_cast<int16_t*>(mEffectBufferEnabled
+            ? mEffectBuffer : mSinkBuffer);
+    if (session <= AUDIO_SESSION_OUTPUT_MIX && mEffectsThread != 0) {
+        // the global sessions are processed in place on the effects thread, see threadLoop()
+        buffer = outBuffer = mEffectsThread->buffer();
+    }
     chain->setThread(this);
     chain->setInBuffer(buffer, ownsBuffer);
-    chain->setOutBuffer(reinterpret_cast<int16_t*>(mEffectBufferEnabled
-            ? mEffectBuffer : mSinkBuffer));
+    chain->setOutBuffer(outBuffer);
     // Effect chain for session AUDIO_SESSION_OUTPUT_STAGE is inserted at end of effect
     // chains list in order to be processed last as it contains output stage effects
     // Effect chain for session AUDIO_SESSION_OUTPUT_MIX is inserted before
@@ -2332,10 +2664,57 @@ status_t AudioFlinger::PlaybackThread::addEffectChain_l(const sp<EffectChain>& c
     }
     mEffectChains.insertAt(chain, i);
     checkSuspendOnAddEffectChain_l(chain);
+    updateEffectBufferFormat_l();
 
     return NO_ERROR;
 }
 
+// Runs the effect buffer, and the chains on it, in float when all of them can process float
+// in place: only the global sessions qualify, as other session chains and auxiliary effects
+// accumulate 16 bit into it.  This removes the conversions to and from 16 bit around the
+// effects when the mixer runs in float.
+// The chains are reconfigured under their own lock, so that threadLoop() sees the new format
+// only from the next cycle on.
+void AudioFlinger::PlaybackThread::updateEffectBufferFormat_l()
+{
+    if (!mEffectBufferEnabled) {
+        return;
+    }
+    audio_format_t format = AUDIO_FORMAT_PCM_16_BIT;
+    if (mMixerBufferEnabled && (mType == MIXER || mType == DUPLICATING) &&
+            !mEffectChains.isEmpty()) {
+        format = AUDIO_FORMAT_PCM_FLOAT;
+        for (size_t i = 0; i < mEffectChains.size(); i++) {
+            if (mEffectChains[i]->sessionId() > AUDIO_SESSION_OUTPUT_MIX ||
+                    !mEffectChains[i]->supportsFloat_l()) {
+                format = AUDIO_FORMAT_PCM_16_BIT;
+                break;
+            }
+        }
+    }
+    for (size_t i = 0; i < mEffectChains.size(); i++) {
+        mEffectChains[i]->setBufferFormat_l(format);
+    }
+    if (format == AUDIO_FORMAT_PCM_FLOAT) {
+        // an effect configured for the first time may only now have refused float
+        for (size_t i = 0; i < mEffectChains.size(); i++) {
+            if (!mEffectChains[i]->supportsFloat_l()) {
+                format = AUDIO_FORMAT_PCM_16_BIT;
+                for (size_t j = 0; j < mEffectChains.size(); j++) {
+                    mEffectChains[j]->setBufferFormat_l(format);
+                }
+                break;
+            }
+        }
+    }
+    if (format != mEffectBufferFormat) {
+        ALOGV("updateEffectBufferFormat_l() thread %p format %#x", this, format);
+        mEffectBufferFormat = format;
+        mEffectBufferSize = mNormalFrameCount * mChannelCount
+                * audio_bytes_per_sample(mEffectBufferFormat);
+    }
+}
+
 size_t AudioFlinger::PlaybackThread::removeEffectChain_l(const sp<EffectChain>& chain)
 {
     int session = chain->sessionId();
@@ -2345,6 +2724,11 @@ size_t AudioFlinger::PlaybackThread::removeEffectChain_l(const sp<EffectChain>&
     for (size_t i = 0; i < mEffectChains.size(); i++) {
         if (chain == mEffectChains[i]) {
             mEffectChains.removeAt(i);
+            // back to the default format; this waits for the chain to be unlocked by
+            // threadLoop(), so that it does not see the buffer format change mid-cycle
+            if (mEffectBufferEnabled) {
+                chain->setBufferFormat_l(AUDIO_FORMAT_PCM_16_BIT);
+            }
             // detach all active tracks from the chain
             for (size_t i = 0 ; i < mActiveTracks.size() ; ++i) {
                 sp<Track> track = mActiveTracks[i].promote();
@@ -2369,6 +2753,7 @@ size_t AudioFlinger::PlaybackThread::removeEffectChain_l(const sp<EffectChain>&
             break;
         }
     }
+    updateEffectBufferFormat_l();
     return mEffectChains.size();
 }
 
@@ -2446,11 +2831,16 @@ bool AudioFlinger::PlaybackThread::threadLoop()
 
     checkSilentMode_l();
 
+    // whether the last period mixed went through the effects thread, see mEffectsThread
+    bool effectsPipelined = false;
+
     while (!exitPending())
     {
         cpuStats.sample(myName);
 
         Vector< sp<EffectChain> > effectChains;
+        // whether this cycle queued a period to the effects thread
+        bool effectsQueued = false;
 
         { // scope for mLock
 
@@ -2494,7 +2884,7 @@ bool AudioFlinger::PlaybackThread::threadLoop()
                 mWakeLockUids.clear();
                 mActiveTracksGeneration++;
                 ALOGV("wait async completion");
-                mWaitWorkCV.wait(mLock);
+                waitAsyncCallback_l();
                 ALOGV("async completion/wake");
                 acquireWakeLock_l();
                 standbyTime = systemTime() + standbyDelay;
@@ -2546,6 +2936,8 @@ bool AudioFlinger::PlaybackThread::threadLoop()
                     continue;
                 }
             }
+            latchVolumes_l();
+
             // mMixerStatusIgnoringFastTracks is also updated internally
             mMixerStatus = prepareTracks_l(&tracksToRemove);
 
@@ -2581,8 +2973,8 @@ bool AudioFlinger::PlaybackThread::threadLoop()
             // Merge mMixerBuffer data into mEffectBuffer (if any effects are valid)
             // or mSinkBuffer (if there are no effects).
             //
-            // This is done pre-effects computation; if effects change to
-            // support higher precision, this needs to move.
+            // This is done pre-effects computation; when the effects run in float,
+            // see updateEffectBufferFormat_l(), it is a plain copy.
             //
             // mMixerBufferValid is only set true by MixerThread::prepareTracks_l().
             // TODO use sleepTime == 0 as an additional condition.
@@ -2604,7 +2996,14 @@ bool AudioFlinger::PlaybackThread::threadLoop()
 
             // only process effects if we're going to write
             if (sleepTime == 0 && mType != OFFLOAD) {
+                // the global sessions have their own buffer when pipelined, see addEffectChain_l()
+                effectsPipelined = false;
                 for (size_t i = 0; i < effectChains.size(); i ++) {
+                    if (mEffectsThread != 0 &&
+                            effectChains[i]->sessionId() <= AUDIO_SESSION_OUTPUT_MIX) {
+                        effectsPipelined = true;
+                        continue;
+                    }
 #ifdef QCOM_DIRECTTRACK
                     if (effectChains[i] != mAudioFlinger->mLPAEffectChain) {
 #endif
@@ -2613,6 +3012,18 @@ bool AudioFlinger::PlaybackThread::threadLoop()
                   }
 #endif
                }
+                if (effectsPipelined) {
+                    if (mEffectBufferValid) {
+                        effectsQueued = true;
+                    } else {
+                        // nothing was routed to the effects, only run their state machines
+                        for (size_t i = 0; i < effectChains.size(); i ++) {
+                            if (effectChains[i]->sessionId() <= AUDIO_SESSION_OUTPUT_MIX) {
+                                effectChains[i]->process_l();
+                            }
+                        }
+                    }
+                }
             }
         }
         // Process effect chains for offloaded thread even if no audio
@@ -2628,15 +3039,23 @@ bool AudioFlinger::PlaybackThread::threadLoop()
         // Only if the Effects buffer is enabled and there is data in the
         // Effects buffer (buffer valid), we need to
         // copy into the sink buffer.
+        // When the global effects are pipelined, the sink buffer instead gets the previous
+        // period from the effects thread, which processes this one during the write below;
+        // the sink buffer is left alone while the same period is being written.
         // TODO use sleepTime == 0 as an additional condition.
-        if (mEffectBufferValid) {
+        if (effectsQueued) {
+            mEffectsThread->queue(mSinkBuffer, mFormat, mEffectBuffer, mEffectBufferFormat,
+                    mNormalFrameCount * mChannelCount, effectChains, mCostAccounting);
+        } else if (mEffectBufferValid && !effectsPipelined) {
             //ALOGV("writing effect buffer to sink buffer format %#x", mFormat);
             memcpy_by_audio_format(mSinkBuffer, mFormat, mEffectBuffer, mEffectBufferFormat,
                     mNormalFrameCount * mChannelCount);
         }
 
-        // enable changes in effect chain
-        unlockEffectChains(effectChains);
+        // enable changes in effect chain, unless the effects thread is still processing them
+        if (!effectsQueued) {
+            unlockEffectChains(effectChains);
+        }
 
         if (!waitingAsyncCallback()) {
             // sleepTime == 0 means we must write to audio hardware
@@ -2673,6 +3092,11 @@ bool AudioFlinger::PlaybackThread::threadLoop()
             }
         }
 
+        if (effectsQueued) {
+            mEffectsThread->wait();
+            unlockEffectChains(effectChains);
+        }
+
         // Finally let go of removed track(s), without the lock held
         // since we can't guarantee the destructors won't acquire that
         // same lock.  This will also mutate and push a new fast mixer state.
@@ -2732,6 +3156,33 @@ void AudioFlinger::PlaybackThread::removeTracks_l(const Vector< sp<Track> >& tra
 
 }
 
+// Passes the frames just written to the echo reference, if a capture hosts echo cancellation,
+// with the time at which the first of them will be rendered.
+void AudioFlinger::PlaybackThread::writeEchoReference(const void *buffer, size_t frames,
+        const AudioTimestamp *timestamp)
+{
+    if (mAudioFlinger->echoReferenceChanged(&mEchoReferenceGen, &mEchoReference)) {
+        ALOGW_IF(mEchoReference != 0 && mEchoReference->sampleRate() != mSampleRate,
+                "%s: no echo reference, capture at %u Hz but output at %u Hz", mName,
+                mEchoReference->sampleRate(), mSampleRate);
+    }
+    if (mEchoReference == 0 || mEchoReference->sampleRate() != mSampleRate) {
+        return;
+    }
+    int64_t renderNs;
+    if (timestamp != NULL) {
+        // frames are presented in order from the timestamp position
+        const int32_t framesAhead =
+                (int32_t) (mNormalSink->framesWritten() - frames - timestamp->mPosition);
+        renderNs = timestamp->mTime.tv_sec * 1000000000LL + timestamp->mTime.tv_nsec +
+                (framesAhead * 1000000000LL) / mSampleRate;
+    } else {
+        // assume the frames written last fill the output latency
+        renderNs = systemTime() + latency_l() * 1000000LL - (frames * 1000000000LL) / mSampleRate;
+    }
+    mEchoReference->write(buffer, mFormat, mChannelCount, frames, renderNs);
+}
+
 status_t AudioFlinger::PlaybackThread::getTimestamp_l(AudioTimestamp& timestamp)
 {
     if (mNormalSink != 0) {
@@ -2816,7 +3267,11 @@ AudioFlinger::MixerThread::MixerThread(const sp<AudioFlinger>& audioFlinger, Aud
     :   PlaybackThread(audioFlinger, output, id, device, type),
         // mAudioMixer below
         // mFastMixer below
-        mFastMixerFutex(0)
+        mFastMixerFutex(0),
+        mBatchPeriods(1),
+        mLatencyUnderruns(0),
+        mLatencyQuietChecks(0),
+        mLatencyCheckTime(0)
         // mOutputSink below
         // mPipeSink below
         // mNormalSink below
@@ -2827,6 +3282,9 @@ AudioFlinger::MixerThread::MixerThread(const sp<AudioFlinger>& audioFlinger, Aud
             mSampleRate, mChannelMask, mChannelCount, mFormat, mFrameSize, mFrameCount,
             mNormalFrameCount);
     mAudioMixer = new AudioMixer(mNormalFrameCount, mSampleRate);
+    pthread_once(&sMixerWorkerCountOnce, sMixerWorkerCountInit);
+    mAudioMixer->setWorkerCount(sMixerWorkerCount);
+    mAudioMixer->setCostAccounting(mCostAccounting);
 
     // create an NBAIO sink for the HAL output stream, and negotiate
     mOutputSink = new AudioStreamOutSink(output->stream);
@@ -2875,13 +3333,15 @@ AudioFlinger::MixerThread::MixerThread(const sp<AudioFlinger>& audioFlinger, Aud
         // This pipe depth compensates for scheduling latency of the normal mixer thread.
         // When it wakes up after a maximum latency, it runs a few cycles quickly before
         // finally blocking.  Note the pipe implementation rounds up the request to a power of 2.
-        MonoPipe *monoPipe = new MonoPipe(mNormalFrameCount * 4, format, true /*writeCanBlock*/);
+        // It has room for the additional periods the setpoint may be raised by after underruns.
+        pthread_once(&sFastMixerLatencyLevelsOnce, sFastMixerLatencyLevelsInit);
+        MonoPipe *monoPipe = new MonoPipe(mNormalFrameCount * (4 + sFastMixerLatencyLevels),
+                format, true /*writeCanBlock*/);
         const NBAIO_Format offers[1] = {format};
         size_t numCounterOffers = 0;
         ssize_t index = monoPipe->negotiate(offers, 1, NULL, numCounterOffers);
         ALOG_ASSERT(index == 0);
-        monoPipe->setAvgFrames((mScreenState & 1) ?
-                (monoPipe->maxFrames() * 7) / 8 : mNormalFrameCount * 2);
+        monoPipe->setAvgFrames(pipeSetpoint(monoPipe->maxFrames()));
         mPipeSink = monoPipe;
 
 #ifdef TEE_SINK
@@ -2904,10 +3364,8 @@ AudioFlinger::MixerThread::MixerThread(const sp<AudioFlinger>& audioFlinger, Aud
         // create fast mixer and configure it initially with just one fast track for our submix
         mFastMixer = new FastMixer();
         FastMixerStateQueue *sq = mFastMixer->sq();
-#ifdef STATE_QUEUE_DUMP
-        sq->setObserverDump(&mStateQueueObserverDump);
-        sq->setMutatorDump(&mStateQueueMutatorDump);
-#endif
+        sq->setObserverDump(&mFastMixerDumpState.mStateQueueObserver);
+        sq->setMutatorDump(&mFastMixerDumpState.mStateQueueMutator);
         FastMixerState *state = sq->begin();
         FastTrack *fastTrack = &state->mFastTracks[0];
         // wrap the source side of the MonoPipe to make it an AudioBufferProvider
@@ -2972,6 +3430,19 @@ AudioFlinger::MixerThread::MixerThread(const sp<AudioFlinger>& audioFlinger, Aud
         mNormalSink = initFastMixer ? mPipeSink : mOutputSink;
         break;
     }
+
+    // Batched mixing needs a sink buffer of several periods, written directly to the HAL.
+    // It is limited to deep buffer outputs, which are not latency sensitive.
+    pthread_once(&sMixerBatchPeriodsOnce, sMixerBatchPeriodsInit);
+    if (sMixerBatchPeriods > 1 && type == MIXER && mFastMixer == 0 && mMixerBufferEnabled &&
+            (output->flags & AUDIO_OUTPUT_FLAG_DEEP_BUFFER)) {
+        mSinkBufferPeriods = sMixerBatchPeriods;
+        free(mSinkBuffer);
+        mSinkBuffer = NULL;
+        (void)posix_memalign(&mSinkBuffer, 32,
+                mNormalFrameCount * mFrameSize * mSinkBufferPeriods);
+        ALOGI("MixerThread %d mixes up to %u periods per write", id, mSinkBufferPeriods);
+    }
 }
 
 AudioFlinger::MixerThread::~MixerThread()
@@ -3088,6 +3559,10 @@ void AudioFlinger::MixerThread::threadLoop_standby()
             sq->end(false /*didModify*/);
         }
     }
+    // do not resume with a period processed before standby
+    if (mEffectsThread != 0) {
+        mEffectsThread->flush();
+    }
     PlaybackThread::threadLoop_standby();
 }
 
@@ -3107,6 +3582,11 @@ bool AudioFlinger::PlaybackThread::waitingAsyncCallback()
     return waitingAsyncCallback_l();
 }
 
+void AudioFlinger::PlaybackThread::waitAsyncCallback_l()
+{
+    mWaitWorkCV.wait(mLock);
+}
+
 // shared by MIXER and DIRECT, overridden by DUPLICATING
 void AudioFlinger::PlaybackThread::threadLoop_standby()
 {
@@ -3145,8 +3625,22 @@ void AudioFlinger::MixerThread::threadLoop_mix()
     }
 
     // mix buffers...
-    mAudioMixer->process(pts);
-    mCurrentWriteLength = mSinkBufferSize;
+    if (mBatchPeriods > 1) {
+        // Mix the whole batch into successive periods of the sink buffer.  Batching excludes
+        // effects and timed tracks, so only the sink buffer needs advancing and the
+        // presentation timestamp is not used.  mMixerBuffer is consumed here, so that
+        // threadLoop() does not merge it again.
+        for (uint32_t i = 0; i < mBatchPeriods; i++) {
+            mAudioMixer->process(pts);
+            memcpy_by_audio_format((uint8_t *)mSinkBuffer + i * mSinkBufferSize, mFormat,
+                    mMixerBuffer, mMixerBufferFormat, mNormalFrameCount * mChannelCount);
+        }
+        mMixerBufferValid = false;
+        mCurrentWriteLength = mSinkBufferSize * mBatchPeriods;
+    } else {
+        mAudioMixer->process(pts);
+        mCurrentWriteLength = mSinkBufferSize;
+    }
     // increase sleep time progressively when application underrun condition clears.
     // Only increase sleep time if the mixer is ready for two consecutive times to avoid
     // that a steady state of alternating ready/not ready conditions keeps the sleep time
@@ -3207,7 +3701,9 @@ AudioFlinger::PlaybackThread::mixer_state AudioFlinger::MixerThread::prepareTrac
     size_t tracksWithEffect = 0;
     // counts only _active_ fast tracks
     size_t fastTracks = 0;
-    uint32_t resetMask = 0; // bit mask of fast tracks that need to be reset
+    uint32_t resetMask = 0; // bit mask of fast track indices that need to be reset
+    // whether all tracks are ready for a batch of mSinkBufferPeriods periods
+    bool batchReady = mSinkBufferPeriods > 1;
 
     float masterVolume = mMasterVolume;
     bool masterMute = mMasterMute;
@@ -3232,6 +3728,7 @@ AudioFlinger::PlaybackThread::mixer_state AudioFlinger::MixerThread::prepareTrac
     if (mFastMixer != 0) {
         sq = mFastMixer->sq();
         state = sq->begin();
+        adaptFastMixerLatency_l(state);
     }
 
     mMixerBufferValid = false;  // mMixerBuffer has no valid data until appropriate tracks found.
@@ -3257,7 +3754,7 @@ AudioFlinger::PlaybackThread::mixer_state AudioFlinger::MixerThread::prepareTrac
             // is impossible because the slot isn't marked available until the end of each cycle.
             int j = track->mFastIndex;
             ALOG_ASSERT(0 < j && j < (int)FastMixerState::kMaxFastTracks);
-            ALOG_ASSERT(!(mFastTrackAvailMask & (1 << j)));
+            ALOG_ASSERT(!(mFastTrackAvailMask & (1u << j)));
             FastTrack *fastTrack = &state->mFastTracks[j];
 
             // Determine whether the track is currently in underrun condition,
@@ -3349,7 +3846,7 @@ AudioFlinger::PlaybackThread::mixer_state AudioFlinger::MixerThread::prepareTrac
                     // Can't reset directly, as fast mixer is still polling this track
                     //   track->reset();
                     // So instead mark this track as needing to be reset after push with ack
-                    resetMask |= 1 << i;
+                    resetMask |= 1u << j;
                 }
                 isActive = false;
                 break;
@@ -3360,7 +3857,7 @@ AudioFlinger::PlaybackThread::mixer_state AudioFlinger::MixerThread::prepareTrac
 
             if (isActive) {
                 // was it previously inactive?
-                if (!(state->mTrackMask & (1 << j))) {
+                if (!(state->mTrackMask & (1u << j))) {
                     ExtendedAudioBufferProvider *eabp = track;
                     VolumeProvider *vp = track;
                     fastTrack->mBufferProvider = eabp;
@@ -3368,7 +3865,7 @@ AudioFlinger::PlaybackThread::mixer_state AudioFlinger::MixerThread::prepareTrac
                     fastTrack->mChannelMask = track->mChannelMask;
                     fastTrack->mFormat = track->mFormat;
                     fastTrack->mGeneration++;
-                    state->mTrackMask |= 1 << j;
+                    state->mTrackMask |= 1u << j;
                     didModify = true;
                     // no acknowledgement required for newly active tracks
                 }
@@ -3378,10 +3875,10 @@ AudioFlinger::PlaybackThread::mixer_state AudioFlinger::MixerThread::prepareTrac
                 ++fastTracks;
             } else {
                 // was it previously active?
-                if (state->mTrackMask & (1 << j)) {
+                if (state->mTrackMask & (1u << j)) {
                     fastTrack->mBufferProvider = NULL;
                     fastTrack->mGeneration++;
-                    state->mTrackMask &= ~(1 << j);
+                    state->mTrackMask &= ~(1u << j);
                     didModify = true;
                     // If any fast tracks were removed, we must wait for acknowledgement
                     // because we're about to decrement the last sp<> on those tracks.
@@ -3439,6 +3936,23 @@ AudioFlinger::PlaybackThread::mixer_state AudioFlinger::MixerThread::prepareTrac
 
             mixedTracks++;
 
+            // let the proxy learn the client's fill pattern and warn it of a likely underrun
+            if (track->sharedBuffer() == 0 && track->mState == TrackBase::ACTIVE) {
+                track->mAudioTrackServerProxy->observeFramesReady(framesReady, desiredFrames);
+            }
+
+            if (batchReady) {
+                // each additional period needs at most one more period of track frames,
+                // plus one for rounding when resampling
+                const size_t periodFrames = sr == mSampleRate ? mNormalFrameCount :
+                        (mNormalFrameCount * sr) / mSampleRate + 1;
+                if (track->sharedBuffer() != 0 || track->isTimedTrack() ||
+                        track->isStopping() || track->isPausing() ||
+                        framesReady < desiredFrames + (mSinkBufferPeriods - 1) * periodFrames) {
+                    batchReady = false;
+                }
+            }
+
             // track->mainBuffer() != mSinkBuffer or mMixerBuffer means
             // there is an effect chain connected to the track
             chain.clear();
@@ -3620,6 +4134,7 @@ AudioFlinger::PlaybackThread::mixer_state AudioFlinger::MixerThread::prepareTrac
                 mixerStatus = MIXER_TRACKS_READY;
             }
         } else {
+            batchReady = false;
             if (framesReady < desiredFrames && !track->isStopped() && !track->isPaused()) {
                 track->mAudioTrackServerProxy->tallyUnderrunFrames(desiredFrames);
             }
@@ -3701,16 +4216,15 @@ track_is_ready: ;
 #endif
 
     // Now perform the deferred reset on fast tracks that have stopped
-    while (resetMask != 0) {
-        size_t i = __builtin_ctz(resetMask);
-        ALOG_ASSERT(i < count);
-        resetMask &= ~(1 << i);
+    // The mask is indexed by fast track index, as there can be more active tracks than bits.
+    for (size_t i = 0; resetMask != 0 && i < count; ++i) {
         sp<Track> t = mActiveTracks[i].promote();
-        if (t == 0) {
+        if (t == 0 || !t->isFastTrack() || !(resetMask & (1u << t->mFastIndex))) {
             continue;
         }
         Track* track = t.get();
-        ALOG_ASSERT(track->isFastTrack() && track->isStopped());
+        resetMask &= ~(1u << track->mFastIndex);
+        ALOG_ASSERT(track->isStopped());
         track->reset();
     }
 
@@ -3748,6 +4262,15 @@ track_is_ready: ;
         memset(mSinkBuffer, 0, mNormalFrameCount * mFrameSize);
     }
 
+    // Batch only plain mixing into mMixerBuffer: effects process one period at a time, and
+    // fast tracks are paced by the fast mixer.
+    mBatchPeriods = 1;
+    if (batchReady && mixerStatus == MIXER_TRACKS_READY && fastTracks == 0 &&
+            mixedTracks != 0 && tracksWithEffect == 0 && mMixerBufferValid &&
+            !mEffectBufferValid && mEffectChains.isEmpty() && !isSuspended()) {
+        mBatchPeriods = mSinkBufferPeriods;
+    }
+
     // if any fast tracks, then status is ready
     mMixerStatusIgnoringFastTracks = mixerStatus;
     if (fastTracks > 0) {
@@ -3872,6 +4395,8 @@ bool AudioFlinger::MixerThread::checkForNewParameter_l(const String8& keyValuePa
             readOutputParameters_l();
             delete mAudioMixer;
             mAudioMixer = new AudioMixer(mNormalFrameCount, mSampleRate);
+            mAudioMixer->setWorkerCount(sMixerWorkerCount);
+            mAudioMixer->setCostAccounting(mCostAccounting);
             for (size_t i = 0; i < mTracks.size() ; i++) {
                 int name = getTrackName_l(mTracks[i]->mChannelMask,
                         mTracks[i]->mFormat, mTracks[i]->mSessionId);
@@ -3898,6 +4423,131 @@ bool AudioFlinger::MixerThread::checkForNewParameter_l(const String8& keyValuePa
 }
 
 
+// Estimates the fast mixer CPU load and the cost of one more fast track, in ns per fast mixer
+// cycle, from the recent fast mixer statistics.  Returns false if there are no measurements.
+bool AudioFlinger::MixerThread::estimateFastTrackCost(uint32_t *loadNs, uint32_t *costNs,
+        uint32_t *budgetNs) const
+{
+#ifdef FAST_MIXER_STATISTICS
+    const uint32_t sampleRate = mFastMixerDumpState.mSampleRate;
+    const uint32_t tracks = popcount(mFastMixerDumpState.mTrackMask);
+    const uint32_t load = mFastMixerDumpState.recentMeanLoadNs(kFastMixerLoadCycles);
+    if (sampleRate == 0 || tracks == 0 || load == 0) {
+        return false;
+    }
+    // The load also includes the fixed cost of each cycle, so dividing it among the active
+    // tracks over-estimates the cost of each track, which errs on the side of caution.
+    *loadNs = load;
+    *costNs = load / tracks;
+    *budgetNs = (uint32_t) (((uint64_t) mFastMixerDumpState.mFrameCount * 1000000000LL *
+            kFastMixerCpuBudgetPercent) / ((uint64_t) sampleRate * 100));
+    return true;
+#else
+    (void) loadNs;
+    (void) costNs;
+    (void) budgetNs;
+    return false;
+#endif
+}
+
+size_t AudioFlinger::PlaybackThread::pipeSetpoint(size_t maxFrames) const
+{
+    // when the screen is off, latency matters less than the number of wakeups
+    const size_t limit = (maxFrames * 7) / 8;
+    if (mScreenState & 1) {
+        return limit;
+    }
+    const size_t setpoint = mNormalFrameCount * (2 + mLatencyLevel);
+    return setpoint < limit ? setpoint : limit;
+}
+
+// Adapts the depth of the pipe feeding the fast mixer, and the fast mixer warmup, to the underruns
+// counted by the fast mixer and the audio watchdog, so that a device short of CPU time, for
+// example while thermally throttled, stops glitching without always paying for the worst case.
+// Each check that finds new underruns raises the pipe setpoint by one normal period, up to
+// sFastMixerLatencyLevels; a run of checks without underruns, and with headroom in the recent
+// fast mixer cycle times, lowers it again by one period.
+void AudioFlinger::MixerThread::adaptFastMixerLatency_l(FastMixerState *state)
+{
+    if (sFastMixerLatencyLevels == 0) {
+        return;
+    }
+    const nsecs_t now = systemTime();
+    if (now - mLatencyCheckTime < kFastMixerLatencyCheckNs) {
+        return;
+    }
+    mLatencyCheckTime = now;
+
+    // the dump state counters are updated by other threads, each read is a snapshot
+    uint32_t underruns = mFastMixerDumpState.mUnderruns;
+#ifdef AUDIO_WATCHDOG
+    underruns += mAudioWatchdogDump.mUnderruns;
+#endif
+    const uint32_t newUnderruns = underruns - mLatencyUnderruns;
+    mLatencyUnderruns = underruns;
+    // an idle fast mixer neither underruns nor shows that it has headroom
+    if (state->mCommand != FastMixerState::MIX_WRITE) {
+        mLatencyQuietChecks = 0;
+        return;
+    }
+
+    uint32_t level = mLatencyLevel;
+    if (newUnderruns > 0) {
+        mLatencyQuietChecks = 0;
+        if (level < sFastMixerLatencyLevels) {
+            ++level;
+        }
+    } else if (level > 0 && ++mLatencyQuietChecks >= kFastMixerLatencyQuietChecks) {
+        mLatencyQuietChecks = 0;
+        bool headroom = true;
+#ifdef FAST_MIXER_STATISTICS
+        const uint32_t sampleRate = mFastMixerDumpState.mSampleRate;
+        if (sampleRate != 0) {
+            // fast mixer underrun threshold is 1.75 cycles
+            const uint64_t underrunNs = (mFastMixerDumpState.mFrameCount * 1750000000LL) /
+                    sampleRate;
+            headroom = (uint64_t) mFastMixerDumpState.recentMaxCycleNs(kFastMixerLoadCycles) *
+                    100 < underrunNs * kFastMixerHeadroomPercent;
+        }
+#endif
+        if (headroom) {
+            --level;
+        }
+    }
+    if (level == mLatencyLevel) {
+        return;
+    }
+    mLatencyLevel = level;
+    MonoPipe *pipe = (MonoPipe *)mPipeSink.get();
+    pipe->setAvgFrames(pipeSetpoint(pipe->maxFrames()));
+    // only used when leaving cold idle, so it is published with that state change
+    state->mExtraWarmupCycles = level * kFastMixerWarmupCyclesPerLevel;
+    if (newUnderruns > 0) {
+        ALOGW("%s: %u fast mixer underruns, pipe setpoint raised to %zu frames", mName,
+                newUnderruns, pipe->getAvgFrames());
+    } else {
+        ALOGV("%s: pipe setpoint lowered to %zu frames", mName, pipe->getAvgFrames());
+    }
+}
+
+// canAdmitFastTrack_l() must be called with ThreadBase::mLock held
+bool AudioFlinger::MixerThread::canAdmitFastTrack_l()
+{
+    uint32_t loadNs, costNs, budgetNs;
+    if (!estimateFastTrackCost(&loadNs, &costNs, &budgetNs)) {
+        // not measured yet, so fall back to the former fixed limit
+        return FastMixerState::kMaxFastTracks - popcount(mFastTrackAvailMask) <
+                kFastTracksUnmeasured;
+    }
+    if (loadNs + costNs > budgetNs) {
+        ALOGW("AUDIO_OUTPUT_FLAG_FAST denied on %s: fast mixer load %u us per cycle, "
+                "estimated cost %u us per track, budget %u us",
+                mName, loadNs / 1000, costNs / 1000, budgetNs / 1000);
+        return false;
+    }
+    return true;
+}
+
 void AudioFlinger::MixerThread::dumpInternals(int fd, const Vector<String16>& args)
 {
     const size_t SIZE = 256;
@@ -3907,19 +4557,32 @@ void AudioFlinger::MixerThread::dumpInternals(int fd, const Vector<String16>& ar
     PlaybackThread::dumpInternals(fd, args);
 
     dprintf(fd, "  AudioMixer tracks: 0x%08x\n", mAudioMixer->trackNames());
+    if (mSinkBufferPeriods > 1) {
+        dprintf(fd, "  Batched mixing: %u of up to %u periods per write\n",
+                mBatchPeriods, mSinkBufferPeriods);
+    }
+
+    if (mFastMixer != 0) {
+        uint32_t loadNs, costNs, budgetNs;
+        if (estimateFastTrackCost(&loadNs, &costNs, &budgetNs)) {
+            dprintf(fd, "  Fast track admission: load=%u us cost=%u us per track budget=%u us\n",
+                    loadNs / 1000, costNs / 1000, budgetNs / 1000);
+        } else {
+            dprintf(fd, "  Fast track admission: not measured, limited to %u tracks\n",
+                    kFastTracksUnmeasured);
+        }
+        if (sFastMixerLatencyLevels > 0) {
+            MonoPipe *pipe = (MonoPipe *)mPipeSink.get();
+            dprintf(fd, "  Adaptive fast mixer latency: level %u of %u, pipe setpoint %zu "
+                    "frames, %u extra warmup cycles\n", mLatencyLevel, sFastMixerLatencyLevels,
+                    pipe->getAvgFrames(), mLatencyLevel * kFastMixerWarmupCyclesPerLevel);
+        }
+    }
 
     // Make a non-atomic copy of fast mixer dump state so it won't change underneath us
     const FastMixerDumpState copy(mFastMixerDumpState);
     copy.dump(fd);
 
-#ifdef STATE_QUEUE_DUMP
-    // Similar for state queue
-    StateQueueObserverDump observerCopy = mStateQueueObserverDump;
-    observerCopy.dump(fd);
-    StateQueueMutatorDump mutatorCopy = mStateQueueMutatorDump;
-    mutatorCopy.dump(fd);
-#endif
-
 #ifdef TEE_SINK
     // Write the tee output to a .wav file
     dumpTee(fd, mTeeSource, mId);
@@ -3934,6 +4597,35 @@ void AudioFlinger::MixerThread::dumpInternals(int fd, const Vector<String16>& ar
 #endif
 }
 
+void AudioFlinger::MixerThread::dumpTrackCosts(int fd)
+{
+    CentralTendencyStatistics stats;
+    if (!mAudioMixer->getOverheadCost(&stats)) {
+        return;
+    }
+    // statistics are copied while the mixer may be running, so they may be slightly inconsistent
+    dprintf(fd, "  Normal mixer CPU cost in us per mix:\n");
+    dprintf(fd, "    Name Session     Mean   Stddev      Max        N\n");
+    for (size_t i = 0; i < mTracks.size(); ++i) {
+        sp<Track> track = mTracks[i];
+        // fast tracks are normally mixed by the fast mixer
+        if (track == 0 || track->isFastTrack() || track->name() < AudioMixer::TRACK0) {
+            continue;
+        }
+        if (mAudioMixer->getTrackCost(track->name(), &stats)) {
+            dprintf(fd, "    %4d %7d %8.1f %8.1f %8.1f %8u\n",
+                    track->name() - AudioMixer::TRACK0, track->sessionId(),
+                    stats.mean() * .001, stats.stddev() * .001, stats.maximum() * .001,
+                    stats.n());
+        }
+    }
+    if (mAudioMixer->getOverheadCost(&stats)) {
+        dprintf(fd, "    overhead     %8.1f %8.1f %8.1f %8u\n",
+                stats.mean() * .001, stats.stddev() * .001, stats.maximum() * .001,
+                stats.n());
+    }
+}
+
 uint32_t AudioFlinger::MixerThread::idleSleepTimeUs() const
 {
     return (uint32_t)(((mNormalFrameCount * 1000) / mSampleRate) * 1000) / 2;
@@ -4139,7 +4831,7 @@ AudioFlinger::PlaybackThread::mixer_state AudioFlinger::DirectOutputThread::prep
 
 void AudioFlinger::DirectOutputThread::threadLoop_mix()
 {
-    size_t frameCount = mFrameCount;
+    size_t frameCount = mFrameCount * mSinkBufferPeriods;
     int8_t *curBuf = (int8_t *)mSinkBuffer;
     // output audio to hardware
     while (frameCount) {
@@ -4391,6 +5083,132 @@ void AudioFlinger::AsyncCallbackThread::resetDraining()
     }
 }
 
+// ----------------------------------------------------------------------------
+
+AudioFlinger::EffectsThread::EffectsThread()
+    :   Thread(false /*canCallJava*/),
+        mBuffer(NULL),
+        mBufferSamples(0),
+        mFormat(AUDIO_FORMAT_PCM_16_BIT),
+        mValid(false),
+        mCostAccounting(false),
+        mQueued(0),
+        mDone(0),
+        mPeriods(0),
+        mLatePeriods(0)
+{
+}
+
+AudioFlinger::EffectsThread::~EffectsThread()
+{
+    free(mBuffer);
+}
+
+void AudioFlinger::EffectsThread::onFirstRef()
+{
+    run("AudioEffects", ANDROID_PRIORITY_URGENT_AUDIO);
+    pid_t tid = getTid();
+    int err = requestPriority(getpid_cached, tid, kPriorityEffects);
+    if (err != 0) {
+        ALOGW("Policy SCHED_FIFO priority %d is unavailable for pid %d tid %d; error %d",
+                kPriorityEffects, getpid_cached, tid, err);
+    }
+}
+
+bool AudioFlinger::EffectsThread::threadLoop()
+{
+    // only this thread increments mDone
+    const int32_t done = mDone;
+    for (;;) {
+        const int32_t queued = android_atomic_acquire_load(&mQueued);
+        if (queued != done) {
+            break;
+        }
+        (void) syscall(__NR_futex, &mQueued, FUTEX_WAIT_PRIVATE, queued, NULL);
+    }
+    if (exitPending()) {
+        return false;
+    }
+    ATRACE_BEGIN("effects");
+    ThreadCpuUsage* usage = NULL;
+    if (mCostAccounting) {
+        double ns;
+        (void) mCpuUsage.sampleAndEnable(ns);
+        usage = &mCpuUsage;
+    }
+    for (size_t i = 0; i < mChains.size(); i++) {
+        mChains[i]->process_l(usage);
+    }
+    ATRACE_END();
+    android_atomic_inc(&mDone);
+    (void) syscall(__NR_futex, &mDone, FUTEX_WAKE_PRIVATE, 1);
+    return true;
+}
+
+void AudioFlinger::EffectsThread::exit()
+{
+    ALOGV("EffectsThread::exit");
+    requestExit();
+    // a change of mQueued is needed to wake up the thread reliably, it then sees exitPending()
+    android_atomic_inc(&mQueued);
+    (void) syscall(__NR_futex, &mQueued, FUTEX_WAKE_PRIVATE, 1);
+}
+
+void AudioFlinger::EffectsThread::setBufferSamples(size_t samples)
+{
+    ALOG_ASSERT(mChains.isEmpty(), "setBufferSamples() with a period queued");
+    free(mBuffer);
+    mBuffer = NULL;
+    (void)posix_memalign(&mBuffer, 32, samples * audio_bytes_per_sample(AUDIO_FORMAT_PCM_FLOAT));
+    memset(mBuffer, 0, samples * audio_bytes_per_sample(AUDIO_FORMAT_PCM_FLOAT));
+    mBufferSamples = samples;
+    mValid = false;
+}
+
+void AudioFlinger::EffectsThread::queue(void *out, audio_format_t outFormat,
+        const void *in, audio_format_t format, size_t samples,
+        const Vector< sp<EffectChain> >& chains, bool costAccounting)
+{
+    ALOG_ASSERT(mChains.isEmpty(), "queue() while a period is queued");
+    ALOG_ASSERT(samples <= mBufferSamples, "queue() %zu samples > %zu", samples, mBufferSamples);
+    if (mValid) {
+        memcpy_by_audio_format(out, outFormat, mBuffer, mFormat, samples);
+    } else {
+        memset(out, 0, samples * audio_bytes_per_sample(outFormat));
+    }
+    memcpy(mBuffer, in, samples * audio_bytes_per_sample(format));
+    mFormat = format;
+    mValid = true;
+    mChains = chains;
+    mCostAccounting = costAccounting;
+    mPeriods++;
+    // publishes the above to threadLoop()
+    android_atomic_inc(&mQueued);
+    (void) syscall(__NR_futex, &mQueued, FUTEX_WAKE_PRIVATE, 1);
+}
+
+void AudioFlinger::EffectsThread::wait()
+{
+    if (mChains.isEmpty()) {
+        return;
+    }
+    // only the caller increments mQueued
+    const int32_t queued = mQueued;
+    bool late = false;
+    for (;;) {
+        const int32_t done = android_atomic_acquire_load(&mDone);
+        if (done == queued) {
+            break;
+        }
+        late = true;
+        (void) syscall(__NR_futex, &mDone, FUTEX_WAIT_PRIVATE, done, NULL);
+    }
+    if (late) {
+        mLatePeriods++;
+    }
+    mChains.clear();
+}
+
 
 // ----------------------------------------------------------------------------
 AudioFlinger::OffloadThread::OffloadThread(const sp<AudioFlinger>& audioFlinger,
@@ -4398,10 +5216,30 @@ AudioFlinger::OffloadThread::OffloadThread(const sp<AudioFlinger>& audioFlinger,
     :   DirectOutputThread(audioFlinger, output, id, device, OFFLOAD),
         mHwPaused(false),
         mFlushPending(false),
-        mPausedBytesRemaining(0)
+        mPausedBytesRemaining(0),
+        mLastWritePartial(false),
+        mWriteDeferredUntilNs(0),
+        mFullAckNs(0),
+        mFullAckBytes(0),
+        mConsumedBytesPerNs(0),
+        mWakeups(0),
+        mDeferredWrites(0),
+        mLastWriteNs(0),
+        mPlaybackNs(0)
 {
     //FIXME: mStandby should be set to true by ThreadBase constructor
     mStandby = true;
+
+    // Deferring writes needs the write ack callback, the sink buffer is resized accordingly.
+    pthread_once(&sOffloadWritePeriodsOnce, sOffloadWritePeriodsInit);
+    if (sOffloadWritePeriods > 1 && mUseAsyncWrite) {
+        mSinkBufferPeriods = sOffloadWritePeriods;
+        free(mSinkBuffer);
+        mSinkBuffer = NULL;
+        (void)posix_memalign(&mSinkBuffer, 32,
+                mNormalFrameCount * mFrameSize * mSinkBufferPeriods);
+        ALOGI("OffloadThread %d writes up to %u HAL buffers per wakeup", id, mSinkBufferPeriods);
+    }
 }
 
 void AudioFlinger::OffloadThread::threadLoop_exit()
@@ -4475,6 +5313,9 @@ AudioFlinger::PlaybackThread::mixer_state AudioFlinger::OffloadThread::prepareTr
                 mPausedWriteLength = mCurrentWriteLength;
                 mPausedBytesRemaining = mBytesRemaining;
                 mBytesRemaining = 0;    // stop writing
+                mWriteDeferredUntilNs = 0;
+                mFullAckNs = 0;
+                mLastWriteNs = 0;
             }
             tracksToRemove->add(track);
         } else if (track->isFlushPending()) {
@@ -4516,8 +5357,13 @@ AudioFlinger::PlaybackThread::mixer_state AudioFlinger::OffloadThread::prepareTr
                 sp<Track> previousTrack = mPreviousTrack.promote();
                 if (previousTrack != 0) {
                     if (track != previousTrack.get()) {
-                        // Flush any data still being written from last track
-                        mBytesRemaining = 0;
+                        // Flush any data still being written from last track, unless the
+                        // next track of the same session follows it: the stream is then
+                        // contiguous, and the tail of the last track is written first.
+                        if (mPausedBytesRemaining ||
+                                previousTrack->sessionId() != track->sessionId()) {
+                            mBytesRemaining = 0;
+                        }
                         if (mPausedBytesRemaining) {
                             // Last track was paused so we also need to flush saved
                             // mixbuffer state and invalidate track so that it will
@@ -4628,12 +5474,81 @@ bool AudioFlinger::OffloadThread::waitingAsyncCallback_l()
 {
     ALOGVV("waitingAsyncCallback_l mWriteAckSequence %d mDrainSequence %d",
           mWriteAckSequence, mDrainSequence);
-    if (mUseAsyncWrite && ((mWriteAckSequence & 1) || (mDrainSequence & 1))) {
+    if (mUseAsyncWrite && ((mWriteAckSequence & 1) || (mDrainSequence & 1) ||
+            mWriteDeferredUntilNs != 0)) {
         return true;
     }
     return false;
 }
 
+// must be called with thread mutex locked
+void AudioFlinger::OffloadThread::waitAsyncCallback_l()
+{
+    if (mWriteDeferredUntilNs != 0) {
+        // Any other event, such as a pause or a new track, ends the deferral early.
+        const nsecs_t delay = mWriteDeferredUntilNs - systemTime();
+        if (delay <= 0 || mWaitWorkCV.waitRelative(mLock, delay) != NO_ERROR) {
+            mDeferredWrites++;
+        }
+        mWriteDeferredUntilNs = 0;
+        mWakeups++;
+        return;
+    }
+
+    const bool writeBlocked = (mWriteAckSequence & 1) != 0;
+    mWaitWorkCV.wait(mLock);
+    mWakeups++;
+    if (!writeBlocked || (mWriteAckSequence & 1) || !mLastWritePartial) {
+        return;
+    }
+
+    // The HAL buffer was full at this ack and at the previous one, so the bytes written in
+    // between are what the DSP consumed meanwhile.
+    const nsecs_t now = systemTime();
+    if (mFullAckNs != 0 && now > mFullAckNs && mBytesWritten > mFullAckBytes) {
+        const double rate = (double)(mBytesWritten - mFullAckBytes) / (now - mFullAckNs);
+        mConsumedBytesPerNs = mConsumedBytesPerNs == 0 ? rate :
+                mConsumedBytesPerNs + kOffloadRateWeight * (rate - mConsumedBytesPerNs);
+    }
+    mFullAckNs = now;
+    mFullAckBytes = mBytesWritten;
+
+    // one HAL buffer is free, wait until the others are
+    if (mSinkBufferPeriods > 1 && mConsumedBytesPerNs > 0) {
+        const double delay = (mSinkBufferPeriods - 1) * mBufferSize / mConsumedBytesPerNs;
+        mWriteDeferredUntilNs = now + (delay < kMaxOffloadWriteDeferralNs ?
+                (nsecs_t)delay : kMaxOffloadWriteDeferralNs);
+    }
+}
+
+ssize_t AudioFlinger::OffloadThread::threadLoop_write()
+{
+    const nsecs_t now = systemTime();
+    if (mStandby) {
+        mFullAckNs = 0;
+    } else if (mLastWriteNs != 0) {
+        mPlaybackNs += now - mLastWriteNs;
+    }
+    mLastWriteNs = now;
+
+    const size_t bytes = mBytesRemaining;
+    const ssize_t bytesWritten = DirectOutputThread::threadLoop_write();
+    mLastWritePartial = bytesWritten >= 0 && (size_t)bytesWritten < bytes;
+    return bytesWritten;
+}
+
+void AudioFlinger::OffloadThread::dumpInternals(int fd, const Vector<String16>& args)
+{
+    DirectOutputThread::dumpInternals(fd, args);
+
+    dprintf(fd, "  Offload: up to %u HAL buffers of %zu bytes per write\n",
+            mSinkBufferPeriods, mBufferSize);
+    const double minutes = mPlaybackNs / 60e9;
+    dprintf(fd, "  Offload wakeups: %u, %.1f per minute of playback, %u deferred writes\n",
+            mWakeups, minutes > 0 ? mWakeups / minutes : 0.0, mDeferredWrites);
+    dprintf(fd, "  Offload consumption: %.1f kB/s\n", mConsumedBytesPerNs * 1e9 / 1024);
+}
+
 // must be called with thread mutex locked
 bool AudioFlinger::OffloadThread::shouldStandby_l()
 {
@@ -4664,6 +5579,10 @@ void AudioFlinger::OffloadThread::flushHw_l()
     mPausedWriteLength = 0;
     mPausedBytesRemaining = 0;
     mHwPaused = false;
+    mLastWritePartial = false;
+    mWriteDeferredUntilNs = 0;
+    mFullAckNs = 0;
+    mLastWriteNs = 0;
 
     if (mUseAsyncWrite) {
         // discard any pending drain or write ack by incrementing sequence
@@ -4753,15 +5672,18 @@ void AudioFlinger::DuplicatingThread::threadLoop_sleepTime()
 
 ssize_t AudioFlinger::DuplicatingThread::threadLoop_write()
 {
+    // We convert the duplicating thread format to AUDIO_FORMAT_PCM_16_BIT
+    // for delivery downstream as needed, once for all output tracks. This in-place
+    // conversion is safe as AUDIO_FORMAT_PCM_16_BIT is smaller than any other supported
+    // format (AUDIO_FORMAT_PCM_8_BIT is not allowed here).
+    if (mFormat != AUDIO_FORMAT_PCM_16_BIT) {
+        memcpy_by_audio_format(mSinkBuffer, AUDIO_FORMAT_PCM_16_BIT,
+                mSinkBuffer, mFormat, writeFrames * mChannelCount);
+    }
+    if (writeFrames != 0) {
+        updateStartDelays();
+    }
     for (size_t i = 0; i < outputTracks.size(); i++) {
-        // We convert the duplicating thread format to AUDIO_FORMAT_PCM_16_BIT
-        // for delivery downstream as needed. This in-place conversion is safe as
-        // AUDIO_FORMAT_PCM_16_BIT is smaller than any other supported format
-        // (AUDIO_FORMAT_PCM_8_BIT is not allowed here).
-        if (mFormat != AUDIO_FORMAT_PCM_16_BIT) {
-            memcpy_by_audio_format(mSinkBuffer, AUDIO_FORMAT_PCM_16_BIT,
-                    mSinkBuffer, mFormat, writeFrames * mChannelCount);
-        }
         outputTracks[i]->write(reinterpret_cast<int16_t*>(mSinkBuffer), writeFrames);
     }
     mStandby = false;
@@ -4868,6 +5790,51 @@ uint32_t AudioFlinger::DuplicatingThread::activeSleepTimeUs() const
     return (mWaitTimeMs * 1000) / 2;
 }
 
+void AudioFlinger::DuplicatingThread::updateStartDelays()
+{
+    // Outputs are aligned when they start together, typically on exit from standby, by delaying
+    // each by its latency difference to the slowest one, e.g. speaker behind A2DP.  An output
+    // joining while others run only gets delayed if it is the faster one.
+    bool starting = false;
+    for (size_t i = 0; i < outputTracks.size(); i++) {
+        if (!outputTracks[i]->isActive()) {
+            starting = true;
+            break;
+        }
+    }
+    if (!starting) {
+        return;
+    }
+    Vector<uint32_t> latencyMs;
+    uint32_t maxLatencyMs = 0;
+    for (size_t i = 0; i < outputTracks.size(); i++) {
+        sp<ThreadBase> thread = outputTracks[i]->thread().promote();
+        latencyMs.add(thread != 0 ? ((PlaybackThread *) thread.get())->latency() : 0);
+        if (latencyMs[i] > maxLatencyMs) {
+            maxLatencyMs = latencyMs[i];
+        }
+    }
+    for (size_t i = 0; i < outputTracks.size(); i++) {
+        if (!outputTracks[i]->isActive()) {
+            outputTracks[i]->setStartDelay(
+                    (uint32_t) (((uint64_t) (maxLatencyMs - latencyMs[i]) * mSampleRate) / 1000));
+        }
+    }
+}
+
+void AudioFlinger::DuplicatingThread::dumpInternals(int fd, const Vector<String16>& args)
+{
+    MixerThread::dumpInternals(fd, args);
+
+    // not protected by lock
+    for (size_t i = 0; i < mOutputTracks.size(); i++) {
+        const sp<OutputTrack>& outputTrack = mOutputTracks[i];
+        dprintf(fd, "  Output track %zu: thread %p, %s, start delay %u frames\n", i,
+                outputTrack->thread().unsafe_get(), outputTrack->isActive() ? "active" : "idle",
+                outputTrack->startDelay());
+    }
+}
+
 void AudioFlinger::DuplicatingThread::cacheParameters_l()
 {
     // updateWaitTime_l() sets mWaitTimeMs, which affects activeSleepTimeUs(), so call it first
@@ -4893,6 +5860,8 @@ AudioFlinger::RecordThread::RecordThread(const sp<AudioFlinger>& audioFlinger,
     mInput(input), mActiveTracksGen(0), mRsmpInBuffer(NULL),
     // mRsmpInFrames and mRsmpInFramesP2 are set by readInputParameters_l()
     mRsmpInRear(0)
+    // mRsmpInFormat and mRsmpInFrameSize are set by readInputParameters_l()
+    , mReadBuffer(NULL)
 #ifdef TEE_SINK
     , mTeeSink(teeSink)
 #endif
@@ -4907,10 +5876,24 @@ AudioFlinger::RecordThread::RecordThread(const sp<AudioFlinger>& audioFlinger,
     // mPipeMemory
     // mFastCaptureNBLogWriter
     , mFastTrackAvail(false)
+    , mFastCaptureEffects(false)
+    , mRecordDirect(false)
+    , mReads(0)
+    , mDirectReads(0)
 {
     snprintf(mName, kNameLength, "AudioIn_%X", id);
     mNBLogWriter = audioFlinger->newWriter_l(kLogSize, mName);
 
+    int ok = pthread_once(&sRecordDirectOnce, sRecordDirectInit);
+    if (ok != 0) {
+        ALOGE("%s pthread_once failed: %d", __func__, ok);
+    }
+    mRecordDirect = sRecordDirect;
+    ok = pthread_once(&sRecordFloatOnce, sRecordFloatInit);
+    if (ok != 0) {
+        ALOGE("%s pthread_once failed: %d", __func__, ok);
+    }
+
     readInputParameters_l();
 
     // create an NBAIO source for the HAL input stream, and negotiate
@@ -4981,9 +5964,7 @@ AudioFlinger::RecordThread::RecordThread(const sp<AudioFlinger>& audioFlinger,
         // create fast capture
         mFastCapture = new FastCapture();
         FastCaptureStateQueue *sq = mFastCapture->sq();
-#ifdef STATE_QUEUE_DUMP
-        // FIXME
-#endif
+        // FIXME StateQueue observer and mutator dump
         FastCaptureState *state = sq->begin();
         state->mCblk = NULL;
         state->mInputSource = mInputSource.get();
@@ -5005,6 +5986,12 @@ AudioFlinger::RecordThread::RecordThread(const sp<AudioFlinger>& audioFlinger,
         sq->end();
         sq->push(FastCaptureStateQueue::BLOCK_UNTIL_PUSHED);
 
+        int ok = pthread_once(&sFastCaptureEffectsOnce, sFastCaptureEffectsInit);
+        if (ok != 0) {
+            ALOGE("%s pthread_once failed: %d", __func__, ok);
+        }
+        mFastCaptureEffects = sFastCaptureEffects;
+
         // start the fast capture
         mFastCapture->run("FastCapture", ANDROID_PRIORITY_URGENT_AUDIO);
         pid_t tid = mFastCapture->getTid();
@@ -5043,9 +6030,13 @@ AudioFlinger::RecordThread::~RecordThread()
         mFastCapture->join();
         mFastCapture.clear();
     }
+    if (mEchoReference != 0) {
+        mAudioFlinger->clearEchoReference(mEchoReference);
+    }
     mAudioFlinger->unregisterWriter(mFastCaptureNBLogWriter);
     mAudioFlinger->unregisterWriter(mNBLogWriter);
-    delete[] mRsmpInBuffer;
+    free(mRsmpInBuffer);
+    free(mReadBuffer);
 }
 
 void AudioFlinger::RecordThread::onFirstRef()
@@ -5224,6 +6215,23 @@ reacquire_wakelock:
             FastCaptureState *state = sq->begin();
             bool didModify = false;
             FastCaptureStateQueue::block_t block = FastCaptureStateQueue::BLOCK_UNTIL_PUSHED;
+            Vector< sp<EffectModule> > effectsToRelease;
+            sp<EchoReference> referenceToRelease;
+            if (mFastCaptureEffects || !mFastCaptureEffectModules.isEmpty()) {
+                if (mFastCaptureEffects && mFastCaptureDumpState.mEffectFallbacks != 0) {
+                    ALOGW("%s: pre-processing exceeds the fast capture CPU budget, "
+                            "moving it to the HAL input stream", mName);
+                    mFastCaptureEffects = false;
+                }
+                if (updateFastCaptureEffects(state, effectChains, &effectsToRelease,
+                        &referenceToRelease)) {
+                    if (!effectsToRelease.isEmpty() || referenceToRelease != 0) {
+                        // the engines must not be used by fast capture once released
+                        block = FastCaptureStateQueue::BLOCK_UNTIL_ACKED;
+                    }
+                    didModify = true;
+                }
+            }
             if (state->mCommand != FastCaptureState::READ_WRITE /* FIXME &&
                     (kUseFastMixer != FastMixer_Dynamic || state->mTrackMask > 1)*/) {
                 if (state->mCommand == FastCaptureState::COLD_IDLE) {
@@ -5258,6 +6266,19 @@ reacquire_wakelock:
                 }
 #endif
             }
+            // After a fallback, the effects that are still enabled are now applied by the HAL.
+            // This is done under the effect lock so that it can't race with the effect being
+            // enabled, which also checks preProcessingOnFastCapture().
+            if (!mFastCaptureEffects) {
+                for (size_t i = 0; i < effectsToRelease.size(); i++) {
+                    const sp<EffectModule>& effect = effectsToRelease[i];
+                    effect->lock();
+                    if (effect->isEnabled() && !effect->isAddedToHal_l()) {
+                        effect->addEffectToHal_l();
+                    }
+                    effect->unlock();
+                }
+            }
         }
 
         // now run the fast track destructor with thread mutex unlocked
@@ -5276,10 +6297,59 @@ reacquire_wakelock:
         int32_t rear = mRsmpInRear % mRsmpInFramesP2;
         ssize_t framesRead;
 
+        // Direct capture: when the only client is a normal track at the native rate, channel
+        // count and format, with nothing left to consume in mRsmpInBuffer and no frames to drop,
+        // read from the HAL straight into the client's buffer and skip the copy below.
+        // mRsmpInRear does not advance, so the client's mRsmpInFront stays in sync with it.
+        // If the client buffer cannot take a whole HAL period contiguously, e.g. at wrap
+        // or because the client is late, fall back to reading into mRsmpInBuffer.
+        if (mPipeSource == 0) {
+            mReads++;
+        }
+        if (mRecordDirect && mPipeSource == 0 && activeTracks.size() == 1) {
+            activeTrack = activeTracks[0];
+            if (!activeTrack->isFastTrack() && activeTrack->mResampler == NULL &&
+                    activeTrack->mChannelCount == mChannelCount &&
+                    activeTrack->mFormat == mFormat &&
+                    activeTrack->mFrameSize == mFrameSize &&
+                    activeTrack->mFramesToDrop == 0 &&
+                    activeTrack->mRsmpInFront == mRsmpInRear) {
+                size_t framesToRead = mBufferSize / mFrameSize;
+                activeTrack->mSink.frameCount = framesToRead;
+                status_t status = activeTrack->getNextBuffer(&activeTrack->mSink);
+                if (status == OK && activeTrack->mSink.frameCount == framesToRead) {
+                    ssize_t bytesRead = mInput->stream->read(mInput->stream,
+                            activeTrack->mSink.raw, mBufferSize);
+                    framesRead = bytesRead > 0 ? bytesRead / mFrameSize : 0;
+                    if (framesRead > 0 && mTeeSink != 0) {
+                        (void) mTeeSink->write(activeTrack->mSink.raw, framesRead);
+                    }
+                    // release what was actually read, possibly nothing
+                    activeTrack->mSink.frameCount = framesRead;
+                    activeTrack->releaseBuffer(&activeTrack->mSink);
+                    if (framesRead == 0) {
+                        ALOGE("read failed: bytesRead=%d", bytesRead);
+                        // Force input into standby so that it tries to recover at next read
+                        inputStandBy();
+                        sleepUs = kRecordThreadSleepUs;
+                        goto unlock;
+                    }
+                    mDirectReads++;
+                    activeTrack->clearOverflow();
+                    goto unlock;
+                }
+                // the obtained buffer is simply re-obtained by the copy path below
+            }
+        }
+
+        // Read straight into mRsmpInBuffer unless the data needs conversion from the HAL format
+        void *readBuffer = mReadBuffer != NULL ? mReadBuffer :
+                (int8_t *) mRsmpInBuffer + rear * mRsmpInFrameSize;
+
         // If an NBAIO source is present, use it to read the normal capture's data
         if (mPipeSource != 0) {
             size_t framesToRead = mBufferSize / mFrameSize;
-            framesRead = mPipeSource->read(&mRsmpInBuffer[rear * mChannelCount],
+            framesRead = mPipeSource->read(readBuffer,
                     framesToRead, AudioBufferProvider::kInvalidPTS);
             if (framesRead == 0) {
                 // since pipe is non-blocking, simulate blocking input
@@ -5287,8 +6357,7 @@ reacquire_wakelock:
             }
         // otherwise use the HAL / AudioStreamIn directly
         } else {
-            ssize_t bytesRead = mInput->stream->read(mInput->stream,
-                    &mRsmpInBuffer[rear * mChannelCount], mBufferSize);
+            ssize_t bytesRead = mInput->stream->read(mInput->stream, readBuffer, mBufferSize);
             if (bytesRead < 0) {
                 framesRead = bytesRead;
             } else {
@@ -5308,14 +6377,20 @@ reacquire_wakelock:
         ALOG_ASSERT(framesRead > 0);
 
         if (mTeeSink != 0) {
-            (void) mTeeSink->write(&mRsmpInBuffer[rear * mChannelCount], framesRead);
+            (void) mTeeSink->write(readBuffer, framesRead);
+        }
+        if (mReadBuffer != NULL) {
+            // the only conversion from the HAL format, shared by all clients
+            memcpy_by_audio_format((int8_t *) mRsmpInBuffer + rear * mRsmpInFrameSize,
+                    mRsmpInFormat, mReadBuffer, mFormat, framesRead * mChannelCount);
         }
         // If destination is non-contiguous, we now correct for reading past end of buffer.
         {
             size_t part1 = mRsmpInFramesP2 - rear;
             if ((size_t) framesRead > part1) {
-                memcpy(mRsmpInBuffer, &mRsmpInBuffer[mRsmpInFramesP2 * mChannelCount],
-                        (framesRead - part1) * mFrameSize);
+                memcpy(mRsmpInBuffer,
+                        (int8_t *) mRsmpInBuffer + mRsmpInFramesP2 * mRsmpInFrameSize,
+                        (framesRead - part1) * mRsmpInFrameSize);
             }
         }
         rear = mRsmpInRear += framesRead;
@@ -5384,18 +6459,9 @@ reacquire_wakelock:
                         if (part1 > framesIn) {
                             part1 = framesIn;
                         }
-                        int8_t *src = (int8_t *)mRsmpInBuffer + (front * mFrameSize);
-                        if (mChannelCount == activeTrack->mChannelCount ||
-                                audio_is_compress_capture_format(mFormat) ||
-                                audio_is_compress_voip_format(mFormat)) {
-                            memcpy(dst, src, part1 * mFrameSize);
-                        } else if (mChannelCount == 1) {
-                            upmix_to_stereo_i16_from_mono_i16((int16_t *)dst, (const int16_t *)src,
-                                    part1);
-                        } else {
-                            downmix_to_mono_i16_from_stereo_i16((int16_t *)dst, (const int16_t *)src,
-                                    part1);
-                        }
+                        int8_t *src = (int8_t *)mRsmpInBuffer + (front * mRsmpInFrameSize);
+                        convertForTrack(activeTrack.get(), dst, src, mRsmpInFormat,
+                                mChannelCount, part1);
                         dst += part1 * activeTrack->mFrameSize;
                         front += part1;
                         framesIn -= part1;
@@ -5458,9 +6524,21 @@ reacquire_wakelock:
                             // FIXME how about having activeTrack implement this interface itself?
                             activeTrack->mResamplerBufferProvider
                             /*this*/ /* AudioBufferProvider* */);
+                    if (mRsmpInFormat == AUDIO_FORMAT_PCM_FLOAT) {
+                        // float stereo out of the resampler, converted once for the client
+                        convertForTrack(activeTrack.get(), activeTrack->mSink.raw,
+                                activeTrack->mRsmpOutBuffer, AUDIO_FORMAT_PCM_FLOAT, FCC_2,
+                                framesOut);
+                    } else if (activeTrack->mFormat == AUDIO_FORMAT_PCM_FLOAT) {
+                        // temporarily type pun mRsmpOutBuffer from Q4.27 to int16_t
+                        ditherAndClamp(activeTrack->mRsmpOutBuffer, activeTrack->mRsmpOutBuffer,
+                                framesOut);
+                        convertForTrack(activeTrack.get(), activeTrack->mSink.raw,
+                                activeTrack->mRsmpOutBuffer, AUDIO_FORMAT_PCM_16_BIT, FCC_2,
+                                framesOut);
                     // ditherAndClamp() works as long as all buffers returned by
                     // activeTrack->getNextBuffer() are 32 bit aligned which should be always true.
-                    if (activeTrack->mChannelCount == 1) {
+                    } else if (activeTrack->mChannelCount == 1) {
                         // temporarily type pun mRsmpOutBuffer from Q4.27 to int16_t
                         ditherAndClamp(activeTrack->mRsmpOutBuffer, activeTrack->mRsmpOutBuffer,
                                 framesOut);
@@ -5901,6 +6979,106 @@ void AudioFlinger::RecordThread::dump(int fd, const Vector<String16>& args)
     dumpEffectChains(fd, args);
 }
 
+// Returns whether the set of pre-processing effect engines in the fast capture state changed.
+// Called by threadLoop with the effect chains locked.
+bool AudioFlinger::RecordThread::updateFastCaptureEffects(FastCaptureState *state,
+        const Vector< sp<EffectChain> >& effectChains,
+        Vector< sp<EffectModule> > *effectsToRelease,
+        sp<EchoReference> *referenceToRelease)
+{
+    Vector< sp<EffectModule> > effects;
+    if (mFastCaptureEffects) {
+        for (size_t i = 0; i < effectChains.size(); i++) {
+            const sp<EffectChain>& chain = effectChains[i];
+            for (size_t j = 0; j < chain->getNumEffects(); j++) {
+                sp<EffectModule> effect = chain->getEffectFromIndex_l(j);
+                if (effect == 0 || !effect->isEnabled() ||
+                        (effect->desc().flags & EFFECT_FLAG_TYPE_MASK) !=
+                                EFFECT_FLAG_TYPE_PRE_PROC) {
+                    continue;
+                }
+                if (effects.size() >= FastCaptureState::kMaxEffects) {
+                    ALOGW("%s: only %u pre-processing effects can run on fast capture",
+                            mName, FastCaptureState::kMaxEffects);
+                    break;
+                }
+                effects.add(effect);
+            }
+        }
+    }
+
+    bool changed = effects.size() != mFastCaptureEffectModules.size();
+    for (size_t i = 0; !changed && i < effects.size(); i++) {
+        changed = effects[i] != mFastCaptureEffectModules[i];
+    }
+    if (!changed) {
+        return false;
+    }
+
+    bool needsReference = false;
+    for (size_t i = 0; i < mFastCaptureEffectModules.size(); i++) {
+        bool kept = false;
+        for (size_t j = 0; !kept && j < effects.size(); j++) {
+            kept = effects[j] == mFastCaptureEffectModules[i];
+        }
+        if (!kept) {
+            effectsToRelease->add(mFastCaptureEffectModules[i]);
+        }
+    }
+    for (size_t i = 0; i < effects.size(); i++) {
+        effect_handle_t engine = effects[i]->effectInterface();
+        if ((*engine)->process_reverse == NULL) {
+            continue;
+        }
+        // the reverse stream of an engine newly hosted is set to the format of the reference
+        bool added = true;
+        for (size_t j = 0; added && j < mFastCaptureEffectModules.size(); j++) {
+            added = effects[i] != mFastCaptureEffectModules[j];
+        }
+        if (added) {
+            effect_config_t config;
+            memset(&config, 0, sizeof(config));
+            config.inputCfg.samplingRate = mSampleRate;
+            config.inputCfg.channels = audio_channel_out_mask_from_count(mChannelCount);
+            config.inputCfg.format = AUDIO_FORMAT_PCM_16_BIT;
+            config.inputCfg.accessMode = EFFECT_BUFFER_ACCESS_READ;
+            config.inputCfg.mask = EFFECT_CONFIG_SMP_RATE | EFFECT_CONFIG_CHANNELS |
+                    EFFECT_CONFIG_FORMAT | EFFECT_CONFIG_ACC_MODE;
+            config.outputCfg = config.inputCfg;
+            int32_t reply = 0;
+            uint32_t size = sizeof(reply);
+            status_t status = effects[i]->command(EFFECT_CMD_SET_CONFIG_REVERSE, sizeof(config),
+                    &config, &size, &reply);
+            ALOGW_IF(status != NO_ERROR || reply != 0,
+                    "%s: effect %s refused the echo reference format: %d", mName,
+                    effects[i]->desc().name, status != NO_ERROR ? status : reply);
+        }
+        needsReference = true;
+    }
+    if (needsReference && mEchoReference == 0) {
+        // holds a few periods of the primary output in any case
+        size_t frames = mFrameCount;
+        if (frames < kEchoReferenceMinFrames) {
+            frames = kEchoReferenceMinFrames;
+        }
+        mEchoReference = new EchoReference(mSampleRate, mChannelCount, 4 * frames);
+        mAudioFlinger->setEchoReference(mEchoReference);
+    } else if (!needsReference && mEchoReference != 0) {
+        mAudioFlinger->clearEchoReference(mEchoReference);
+        *referenceToRelease = mEchoReference;
+        mEchoReference.clear();
+    }
+
+    for (size_t i = 0; i < effects.size(); i++) {
+        state->mEffects[i] = effects[i]->effectInterface();
+    }
+    state->mEffectCount = effects.size();
+    state->mEchoReference = mEchoReference.get();
+    state->mEffectsGen++;
+    mFastCaptureEffectModules = effects;
+    return true;
+}
+
 void AudioFlinger::RecordThread::dumpInternals(int fd, const Vector<String16>& args)
 {
     dprintf(fd, "\nInput thread %p:\n", this);
@@ -5910,7 +7088,30 @@ void AudioFlinger::RecordThread::dumpInternals(int fd, const Vector<String16>& a
     } else {
         dprintf(fd, "  No active record clients\n");
     }
+    dprintf(fd, "  HAL format: %s, pipeline format: %s\n", formatToString(mFormat),
+            formatToString(mRsmpInFormat));
     dprintf(fd, "  Fast capture thread: %s\n", hasFastCapture() ? "yes" : "no");
+    if (hasFastCapture()) {
+        // fields are not guaranteed to be consistent, see FastCaptureDumpState
+        dprintf(fd, "  Fast capture pre-processing: %s, %u effects, last %u us, fallbacks %u\n",
+                mFastCaptureEffects ? "hosted" : "HAL", mFastCaptureDumpState.mEffectCount,
+                mFastCaptureDumpState.mEffectNs / 1000, mFastCaptureDumpState.mEffectFallbacks);
+        if (mFastCaptureDumpState.mEchoDelayUs >= 0) {
+            dprintf(fd, "  Echo reference aligned, echo delay %d us\n",
+                    mFastCaptureDumpState.mEchoDelayUs);
+        }
+        Pipe::ReaderStats stats[Pipe::kMaxReaderStats];
+        size_t count = ((Pipe *) mPipeSink.get())->getReaderStats(stats, Pipe::kMaxReaderStats);
+        for (size_t i = 0; i < count; i++) {
+            dprintf(fd, "  Pipe reader %zu: lag %zu max %zu of %zu frames, "
+                    "overruns %zu (%zu frames)%s\n", i, stats[i].mLag, stats[i].mMaxLag,
+                    mPipeFramesP2, stats[i].mOverruns, stats[i].mFramesOverrun,
+                    stats[i].mLowestLatency ? ", lowest latency" : "");
+        }
+    } else {
+        dprintf(fd, "  Direct capture: %s, %u of %u HAL reads into client buffer\n",
+                mRecordDirect ? "enabled" : "disabled", mDirectReads, mReads);
+    }
     dprintf(fd, "  Fast track available: %s\n", mFastTrackAvail ? "yes" : "no");
 
     dumpBase(fd, args);
@@ -5999,7 +7200,8 @@ status_t AudioFlinger::RecordThread::ResamplerBufferProvider::getNextBuffer(
         return NOT_ENOUGH_DATA;
     }
 
-    buffer->raw = recordThread->mRsmpInBuffer + front * recordThread->mChannelCount;
+    buffer->raw = (int8_t *) recordThread->mRsmpInBuffer +
+            front * recordThread->mRsmpInFrameSize;
     buffer->frameCount = part1;
     activeTrack->mRsmpInUnrel = part1;
     return NO_ERROR;
@@ -6171,6 +7373,56 @@ void AudioFlinger::RecordThread::audioConfigChanged(int event, int param __unuse
     mAudioFlinger->audioConfigChanged(event, mId, param2);
 }
 
+void AudioFlinger::RecordThread::convertForTrack(RecordTrack *track, void *dst, const void *src,
+        audio_format_t srcFormat, uint32_t srcChannelCount, size_t frames)
+{
+    if (!audio_is_linear_pcm(srcFormat)) {
+        // compress formats are passed through unchanged
+        memcpy(dst, src, frames * track->mFrameSize);
+        return;
+    }
+    if (track->mChannelCount == srcChannelCount) {
+        if (track->mFormat == srcFormat) {
+            memcpy(dst, src, frames * track->mFrameSize);
+        } else {
+            memcpy_by_audio_format(dst, track->mFormat, src, srcFormat,
+                    frames * srcChannelCount);
+        }
+        return;
+    }
+
+    // Only mono <-> stereo remains.  If the format changes too, first convert the channels into
+    // the track's scratch buffer in the source format, which may already be where src is.
+    void *mixed = dst;
+    if (track->mFormat != srcFormat) {
+        if (src != track->mRsmpOutBuffer && track->mRsmpOutFrameCount < frames) {
+            delete[] track->mRsmpOutBuffer;
+            track->mRsmpOutBuffer = new int32_t[frames * FCC_2];
+            track->mRsmpOutFrameCount = frames;
+        }
+        mixed = track->mRsmpOutBuffer;
+    }
+    if (srcFormat == AUDIO_FORMAT_PCM_FLOAT) {
+        if (srcChannelCount == 1) {
+            upmixToStereoFloatFromMonoFloat((float *) mixed, (const float *) src, frames);
+        } else {
+            downmixToMonoFloatFromStereoFloat((float *) mixed, (const float *) src, frames);
+        }
+    } else {
+        ALOG_ASSERT(srcFormat == AUDIO_FORMAT_PCM_16_BIT);
+        if (srcChannelCount == 1) {
+            upmix_to_stereo_i16_from_mono_i16((int16_t *) mixed, (const int16_t *) src, frames);
+        } else {
+            downmix_to_mono_i16_from_stereo_i16((int16_t *) mixed, (const int16_t *) src,
+                    frames);
+        }
+    }
+    if (mixed != dst) {
+        memcpy_by_audio_format(dst, track->mFormat, mixed, srcFormat,
+                frames * track->mChannelCount);
+    }
+}
+
 void AudioFlinger::RecordThread::readInputParameters_l()
 {
     mSampleRate = mInput->stream->common.get_sample_rate(&mInput->stream->common);
@@ -6178,12 +7430,22 @@ void AudioFlinger::RecordThread::readInputParameters_l()
     mChannelCount = audio_channel_count_from_in_mask(mChannelMask);
     mHALFormat = mInput->stream->common.get_format(&mInput->stream->common);
     mFormat = mHALFormat;
-    if (mFormat != AUDIO_FORMAT_PCM_16_BIT &&
+    if ((!audio_is_linear_pcm(mFormat) || mFormat == AUDIO_FORMAT_PCM_8_BIT) &&
             !audio_is_compress_voip_format(mFormat) &&
             !audio_is_compress_capture_format(mFormat)) {
         ALOGE("HAL format %#x not supported;", mFormat);
     }
     mFrameSize = audio_stream_in_frame_size(mInput->stream);
+    // Run the pipeline in float if the HAL has more resolution than 16-bit, so that it is kept
+    // through resampling and reaches float clients; a 16-bit HAL stays in 16-bit by default,
+    // as then the common case needs no conversion at all.
+    if (audio_is_linear_pcm(mFormat) && (mFormat != AUDIO_FORMAT_PCM_16_BIT || sRecordFloat)) {
+        mRsmpInFormat = AUDIO_FORMAT_PCM_FLOAT;
+        mRsmpInFrameSize = mChannelCount * sizeof(float);
+    } else {
+        mRsmpInFormat = mFormat;
+        mRsmpInFrameSize = mFrameSize;
+    }
     mBufferSize = mInput->stream->common.get_buffer_size(&mInput->stream->common);
     mFrameCount = mBufferSize / mFrameSize;
     // This is the formula for calculating the temporary buffer size.
@@ -6200,7 +7462,10 @@ void AudioFlinger::RecordThread::readInputParameters_l()
         mRsmpInFrames = mFrameCount * 7;
         mRsmpInFramesP2 = roundup(mRsmpInFrames);
     }
-    delete[] mRsmpInBuffer;
+    free(mRsmpInBuffer);
+    mRsmpInBuffer = NULL;
+    free(mReadBuffer);
+    mReadBuffer = NULL;
 
     // TODO optimize audio capture buffer sizes ...
     // Here we calculate the size of the sliding buffer used as a source
@@ -6210,7 +7475,11 @@ void AudioFlinger::RecordThread::readInputParameters_l()
     // The current value is higher than necessary.  However it should not add to latency.
 
     // Over-allocate beyond mRsmpInFramesP2 to permit a HAL read past end of buffer
-    mRsmpInBuffer = new int16_t[(mRsmpInFramesP2 + mFrameCount - 1) * mChannelCount];
+    (void)posix_memalign(&mRsmpInBuffer, 32,
+            (mRsmpInFramesP2 + mFrameCount - 1) * mRsmpInFrameSize);
+    if (mRsmpInFormat != mFormat) {
+        (void)posix_memalign(&mReadBuffer, 32, mBufferSize);
+    }
 
     // AudioRecord mSampleRate and mChannelCount are constant due to AudioRecord API constraints.
     // But if thread's mSampleRate or mChannelCount changes, how will that affect active tracks?
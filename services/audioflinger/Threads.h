@@ -232,6 +232,10 @@ public:
                 type_t      type() const { return mType; }
                 audio_io_handle_t id() const { return mId;}
 
+                // Thread CPU usage for the cost accounting of effects, or NULL if disabled.
+                // Must only be called by the thread itself.
+                ThreadCpuUsage* costCpuUsage() { return mCostAccounting ? &mCostCpuUsage : NULL; }
+
                 // dynamic externally-visible
                 uint32_t    sampleRate() const { return mSampleRate; }
                 audio_channel_mask_t channelMask() const { return mChannelMask; }
@@ -278,6 +282,9 @@ public:
                 audio_devices_t inDevice() const { return mInDevice; }
 
     virtual     audio_stream_t* stream() const = 0;
+                // whether enabled pre-processing effects are applied by a fast capture thread
+                // rather than by the HAL stream, see RecordThread::updateFastCaptureEffects()
+    virtual     bool        preProcessingOnFastCapture() const { return false; }
 
                 sp<EffectHandle> createEffect_l(
                                     const sp<AudioFlinger::Client>& client,
@@ -304,6 +311,8 @@ public:
     virtual     status_t addEffectChain_l(const sp<EffectChain>& chain) = 0;
                 // remove an effect chain from the chain list (mEffectChains)
     virtual     size_t removeEffectChain_l(const sp<EffectChain>& chain) = 0;
+                // re-negotiate the effect buffer format after effects were added or removed
+    virtual     void updateEffectBufferFormat_l() { }
                 // lock all effect chains Mutexes. Must be called before releasing the
                 // ThreadBase mutex before processing the mixer and effects. This guarantees the
                 // integrity of the chains during the process.
@@ -444,6 +453,10 @@ protected:
                                         mSuspendedSessions;
                 static const size_t     kLogSize = 4 * 1024;
                 sp<NBLog::Writer>       mNBLogWriter;
+
+                // CPU cost accounting of tracks and effects, see costCpuUsage()
+                bool                    mCostAccounting;
+                ThreadCpuUsage          mCostCpuUsage;
 };
 
 // --- PlaybackThread ---
@@ -506,6 +519,8 @@ protected:
 
     virtual     bool        waitingAsyncCallback();
     virtual     bool        waitingAsyncCallback_l();
+                // waits on mWaitWorkCV while waitingAsyncCallback_l() is true
+    virtual     void        waitAsyncCallback_l();
     virtual     bool        shouldStandby_l();
     virtual     void        onAddNewTrack_l();
 
@@ -577,6 +592,7 @@ public:
 
                 virtual status_t addEffectChain_l(const sp<EffectChain>& chain);
                 virtual size_t removeEffectChain_l(const sp<EffectChain>& chain);
+                virtual void updateEffectBufferFormat_l();
                 virtual uint32_t hasAudioSession(int sessionId) const;
                 virtual uint32_t getStrategyForSession_l(int sessionId);
 
@@ -605,6 +621,8 @@ protected:
     size_t                          mNormalFrameCount;  // normal mixer and effects
 
     void*                           mSinkBuffer;         // frame size aligned sink buffer
+    uint32_t                        mSinkBufferPeriods;  // capacity of mSinkBuffer in normal
+                                                         // mix periods, see MixerThread
 
     // TODO:
     // Rearrange the buffer info into a struct/class with
@@ -652,9 +670,12 @@ protected:
     void*                           mEffectBuffer;
 
     // Size of mEffectsBuffer in bytes: mNormalFrameCount * #channels * sampsize.
+    // Storage is allocated for float, so the format can change without reallocation.
     size_t                          mEffectBufferSize;
 
-    // The audio format of mEffectsBuffer. Set to AUDIO_FORMAT_PCM_16_BIT only.
+    // The audio format of mEffectsBuffer. Set to AUDIO_FORMAT_PCM_16_BIT, or
+    // AUDIO_FORMAT_PCM_FLOAT by updateEffectBufferFormat_l() when every effect chain on it
+    // processes float in place.
     audio_format_t                  mEffectBufferFormat;
 
     // An internal flag set to true by MixerThread::prepareTracks_l()
@@ -664,6 +685,11 @@ protected:
     // for any processing (including output processing).
     bool                            mEffectBufferValid;
 
+    // If set, runs the effect chains of the global sessions one period behind the mix,
+    // on their own buffer, see threadLoop().  Only for deep buffer mixer threads, when
+    // enabled by property af.effects.pipeline.
+    sp<EffectsThread>               mEffectsThread;
+
     // suspend count, > 0 means suspended.  While suspended, the thread continues to pull from
     // tracks and mix, but doesn't write to HAL.  A2DP and SCO HAL implementations can't handle
     // concurrent use of both of them, so Audio Policy Service suspends one of the threads to
@@ -674,12 +700,19 @@ protected:
     // FIXME overflows every 6+ hours at 44.1 kHz stereo 16-bit samples
     // mFramesWritten would be better, or 64-bit even better
     size_t                          mBytesWritten;
+
+    // Echo reference of a capture hosting echo cancellation, fed by the primary mixer output
+    // after each write, see AudioFlinger::setEchoReference(); accessed by the thread loop only.
+    sp<EchoReference>               mEchoReference;
+    int32_t                         mEchoReferenceGen;
+                void        writeEchoReference(const void *buffer, size_t frames,
+                                               const AudioTimestamp *timestamp);
 private:
     // mMasterMute is in both PlaybackThread and in AudioFlinger.  When a
     // PlaybackThread needs to find out if master-muted, it checks it's local
     // copy rather than the one in AudioFlinger.  This optimization saves a lock.
     bool                            mMasterMute;
-                void        setMasterMute_l(bool muted) { mMasterMute = muted; }
+                void        setMasterMute_l(bool muted);
 protected:
     SortedVector< wp<Track> >       mActiveTracks;  // FIXME check if this could be sp<>
     SortedVector<int>               mWakeLockUids;
@@ -731,6 +764,8 @@ private:
 
     virtual void dumpInternals(int fd, const Vector<String16>& args);
     void        dumpTracks(int fd, const Vector<String16>& args);
+    // dump the CPU cost of each track, if accounted by the thread
+    virtual void dumpTrackCosts(int fd __unused) { }
 
     SortedVector< sp<Track> >       mTracks;
     // mStreamTypes[] uses 1 additional stream type internally for the OutputTrack used by
@@ -739,6 +774,26 @@ private:
     AudioStreamOut                  *mOutput;
 
     float                           mMasterVolume;
+
+    // Volume and mute state written by binder threads without taking mLock.
+    // Writers serialize on mVolumeLock and make mVolumeSequence odd while they update
+    // mVolumeSnapshot; threadLoop copies the latest consistent snapshot into mMasterVolume,
+    // mMasterMute and mStreamTypes before each prepareTracks_l(), see latchVolumes_l().
+    struct volume_snapshot_t {
+        float           masterVolume;
+        bool            masterMute;
+        stream_type_t   streamTypes[AUDIO_STREAM_CNT + 1];
+    };
+                void        beginVolumeUpdate_l();
+                void        endVolumeUpdate_l();
+                void        latchVolumes_l();
+    Mutex                           mVolumeLock;
+    volatile int32_t                mVolumeSequence;
+    volume_snapshot_t               mVolumeSnapshot;    // protected by mVolumeSequence
+    int32_t                         mLatchedVolumeSequence; // only accessed by threadLoop
+    bool                            mHalMasterVolume;   // HAL applies master volume
+    bool                            mHalMasterMute;     // HAL applies master mute
+
     nsecs_t                         mLastWriteTime;
     int                             mNumWrites;
     int                             mNumDelayedWrites;
@@ -807,10 +862,17 @@ private:
     sp<NBAIO_Source>        mTeeSource;
 #endif
     uint32_t                mScreenState;   // cached copy of gScreenState
+    // normal periods added to the pipe setpoint after fast mixer underruns, see
+    // MixerThread::adaptFastMixerLatency_l()
+    uint32_t                mLatencyLevel;
+    // pipe setpoint for the screen state and latency level, given the pipe capacity
+    size_t                  pipeSetpoint(size_t maxFrames) const;
     static const size_t     kFastMixerLogSize = 4 * 1024;
     sp<NBLog::Writer>       mFastMixerNBLogWriter;
 public:
     virtual     bool        hasFastMixer() const = 0;
+                // whether the fast mixer has enough CPU headroom for one more fast track
+    virtual     bool        canAdmitFastTrack_l() { return true; }
     virtual     FastTrackUnderruns getFastTrackUnderruns(size_t fastIndex __unused) const
                                 { FastTrackUnderruns dummy; return dummy; }
 
@@ -849,6 +911,7 @@ public:
     virtual     void        dumpInternals(int fd, const Vector<String16>& args);
 
 protected:
+    virtual     void        dumpTrackCosts(int fd);
     virtual     mixer_state prepareTracks_l(Vector< sp<Track> > *tracksToRemove);
     virtual     int         getTrackName_l(audio_channel_mask_t channelMask,
                                            audio_format_t format, int sessionId);
@@ -872,19 +935,30 @@ private:
                 sp<AudioWatchdog> mAudioWatchdog; // non-0 if there is an audio watchdog thread
 
                 // contents are not guaranteed to be consistent, no locks required
-                FastMixerDumpState mFastMixerDumpState;
-#ifdef STATE_QUEUE_DUMP
-                StateQueueObserverDump mStateQueueObserverDump;
-                StateQueueMutatorDump  mStateQueueMutatorDump;
-#endif
+                FastMixerDumpState mFastMixerDumpState; // includes the state queue statistics
                 AudioWatchdogDump mAudioWatchdogDump;
 
                 // accessible only within the threadLoop(), no locks required
                 //          mFastMixer->sq()    // for mutating and pushing state
                 int32_t     mFastMixerFutex;    // for cold idle
 
+                // Batched mixing on deep buffer outputs: when every active track is ready for
+                // mSinkBufferPeriods periods, they are all mixed and written at once.
+                uint32_t    mBatchPeriods;      // normal periods mixed in the current cycle
+
+                // Adaptive depth of the pipe feeding the fast mixer, see adaptFastMixerLatency_l()
+                uint32_t    mLatencyUnderruns;  // underruns counted at the last check
+                uint32_t    mLatencyQuietChecks; // consecutive checks without underruns
+                nsecs_t     mLatencyCheckTime;  // time of the last check
+                void        adaptFastMixerLatency_l(FastMixerState *state);
+
+                // fast mixer load and estimated cost of one more fast track, in ns per cycle
+                bool        estimateFastTrackCost(uint32_t *loadNs, uint32_t *costNs,
+                                                  uint32_t *budgetNs) const;
+
 public:
     virtual     bool        hasFastMixer() const { return mFastMixer != 0; }
+    virtual     bool        canAdmitFastTrack_l();
     virtual     FastTrackUnderruns getFastTrackUnderruns(size_t fastIndex) const {
                               ALOG_ASSERT(fastIndex < FastMixerState::kMaxFastTracks);
                               return mFastMixerDumpState.mTracks[fastIndex].mUnderruns;
@@ -945,19 +1019,38 @@ protected:
     // threadLoop snippets
     virtual     mixer_state prepareTracks_l(Vector< sp<Track> > *tracksToRemove);
     virtual     void        threadLoop_exit();
+    virtual     ssize_t     threadLoop_write();
 
     virtual     bool        waitingAsyncCallback();
     virtual     bool        waitingAsyncCallback_l();
+    virtual     void        waitAsyncCallback_l();
     virtual     bool        shouldStandby_l();
     virtual     void        onAddNewTrack_l();
     virtual     void        onFatalError();
 
+    virtual     void        dumpInternals(int fd, const Vector<String16>& args);
+
 private:
     bool        mHwPaused;
     bool        mFlushPending;
     size_t      mPausedWriteLength;     // length in bytes of write interrupted by pause
     size_t      mPausedBytesRemaining;  // bytes still waiting in mixbuffer after resume
     wp<Track>   mPreviousTrack;         // used to detect track switch
+
+    // When the sink buffer holds several HAL buffers, see af.offload.write_periods, the write
+    // following a write the HAL could not take entirely is deferred by the time the DSP takes
+    // to consume the extra HAL buffers, so that each wakeup refills several of them at once.
+    bool        mLastWritePartial;      // the HAL buffer was full after the last write
+    nsecs_t     mWriteDeferredUntilNs;  // 0 if the next write is not deferred
+    nsecs_t     mFullAckNs;             // time of the last write ack with the HAL buffer full
+    size_t      mFullAckBytes;          // mBytesWritten at mFullAckNs
+    double      mConsumedBytesPerNs;    // average DSP consumption rate, 0 until measured
+
+    // wakeup statistics reported by dump
+    uint32_t    mWakeups;               // returns from waitAsyncCallback_l()
+    uint32_t    mDeferredWrites;
+    nsecs_t     mLastWriteNs;           // 0 after standby or pause
+    nsecs_t     mPlaybackNs;            // time between consecutive writes, ie. while playing
 };
 
 class AsyncCallbackThread : public Thread {
@@ -993,6 +1086,66 @@ private:
     Mutex                      mLock;
 };
 
+// EffectsThread processes the global effect chains of a PlaybackThread one period behind
+// the mix: each cycle, the PlaybackThread queues the period it just mixed and gets back the
+// one queued by the previous cycle, which the effects processed while it was writing to
+// the HAL.  The effect chains stay locked by the PlaybackThread meanwhile.
+// The single period slot is handed over with atomic counters and futexes, so neither
+// thread ever waits on a lock held by the other.
+class EffectsThread : public Thread {
+public:
+
+    EffectsThread();
+
+    virtual             ~EffectsThread();
+
+    // Thread virtuals
+    virtual bool        threadLoop();
+
+    // RefBase
+    virtual void        onFirstRef();
+
+            void        exit();
+
+            // (Re)allocate the period buffer, for up to 'samples' samples of any format.
+            // Must not be called while a period is queued.
+            void        setBufferSamples(size_t samples);
+            // the buffer processed in place by the effect chains, see
+            // PlaybackThread::addEffectChain_l()
+            int16_t*    buffer() const { return reinterpret_cast<int16_t*>(mBuffer); }
+
+            // Copy the previously queued period, processed, into 'out' in 'outFormat', or
+            // silence if there is none, then queue the 'samples' samples of 'in' in 'format'
+            // for processing by 'chains'.  The chains must stay locked until wait() returns.
+            void        queue(void *out, audio_format_t outFormat,
+                              const void *in, audio_format_t format, size_t samples,
+                              const Vector< sp<EffectChain> >& chains, bool costAccounting);
+            // Wait for the queued period to be processed
+            void        wait();
+            // Drop the processed period, so that the next queue() returns silence
+            void        flush() { mValid = false; }
+
+            uint32_t    periods() const { return mPeriods; }
+            // number of periods that were not processed when wait() was called
+            uint32_t    latePeriods() const { return mLatePeriods; }
+
+private:
+    void*                       mBuffer;
+    size_t                      mBufferSamples;
+    audio_format_t              mFormat;        // of the period in mBuffer
+    bool                        mValid;         // whether mBuffer holds a queued period
+    // set by queue() and cleared by wait(), so that the chains are released on the caller
+    Vector< sp<EffectChain> >   mChains;
+    bool                        mCostAccounting;
+    ThreadCpuUsage              mCpuUsage;      // for cost accounting of the effects
+    // futex words: number of periods queued, incremented by queue() and exit(),
+    // and number of periods processed, incremented by threadLoop()
+    volatile int32_t            mQueued;
+    volatile int32_t            mDone;
+    uint32_t                    mPeriods;
+    uint32_t                    mLatePeriods;
+};
+
 class DuplicatingThread : public MixerThread {
 public:
     DuplicatingThread(const sp<AudioFlinger>& audioFlinger, MixerThread* mainThread,
@@ -1015,10 +1168,13 @@ protected:
     virtual     ssize_t     threadLoop_write();
     virtual     void        threadLoop_standby();
     virtual     void        cacheParameters_l();
+    virtual     void        dumpInternals(int fd, const Vector<String16>& args);
 
 private:
     // called from threadLoop, addOutputTrack, removeOutputTrack
     virtual     void        updateWaitTime_l();
+    // called from threadLoop_write() without lock, for output tracks about to start
+                void        updateStartDelays();
 protected:
     virtual     void        saveOutputTracks();
     virtual     void        clearOutputTracks();
@@ -1107,6 +1263,7 @@ public:
             void        dump(int fd, const Vector<String16>& args);
             AudioStreamIn* clearInput();
             virtual audio_stream_t* stream() const;
+    virtual bool        preProcessingOnFastCapture() const { return mFastCaptureEffects; }
 
 
     virtual bool        checkForNewParameter_l(const String8& keyValuePair,
@@ -1159,13 +1316,23 @@ private:
             Condition                           mStartStopCond;
 
             // resampler converts input at HAL Hz to output at AudioRecord client Hz
-            int16_t                             *mRsmpInBuffer; // see new[] for details on the size
+            void                                *mRsmpInBuffer; // see posix_memalign() for size
             size_t                              mRsmpInFrames;  // size of resampler input in frames
             size_t                              mRsmpInFramesP2;// size rounded up to a power-of-2
 
             // rolling index that is never cleared
             int32_t                             mRsmpInRear;    // last filled frame + 1
 
+            // The audio format of mRsmpInBuffer, set by readInputParameters_l().
+            // AUDIO_FORMAT_PCM_FLOAT when the HAL delivers linear PCM other than 16-bit, or when
+            // forced by property; otherwise the HAL format.  Conversion from the HAL format
+            // happens once per read, and to each client's format once per client.
+            audio_format_t                      mRsmpInFormat;
+            size_t                              mRsmpInFrameSize;
+            // If mRsmpInFormat differs from mFormat, the HAL or pipe reads land here before
+            // conversion into mRsmpInBuffer, otherwise NULL.  mBufferSize bytes.
+            void                                *mReadBuffer;
+
             // For dumpsys
             const sp<NBAIO_Sink>                mTeeSink;
 
@@ -1177,9 +1344,7 @@ private:
 
             // contents are not guaranteed to be consistent, no locks required
             FastCaptureDumpState                mFastCaptureDumpState;
-#ifdef STATE_QUEUE_DUMP
             // FIXME StateQueue observer and mutator dump fields
-#endif
             // FIXME audio watchdog dump
 
             // accessible only within the threadLoop(), no locks required
@@ -1206,4 +1371,37 @@ private:
             sp<NBLog::Writer>                   mFastCaptureNBLogWriter;
 
             bool                                mFastTrackAvail;    // true if fast track available
+
+            // Pre-processing hosted by the fast capture thread.  Set at construction if enabled
+            // by property and cleared, for good, the first time the effects exceed the fast
+            // capture CPU budget; read without lock by EffectModule::addEffectToHal_l().
+            volatile bool                       mFastCaptureEffects;
+            // accessible only within the threadLoop(), no locks required
+            // effect modules whose engines are in the fast capture state, keeps them alive
+            Vector< sp<EffectModule> >          mFastCaptureEffectModules;
+            // Playback reference for the hosted engines that have a reverse stream, registered
+            // with AudioFlinger for the primary output to write, or 0
+            sp<EchoReference>                   mEchoReference;
+            // minimum number of frames of which mEchoReference holds four
+            static const size_t                 kEchoReferenceMinFrames = 1024;
+            // returns whether state was modified; effects no longer hosted are moved to
+            // effectsToRelease, and a reference no longer needed to referenceToRelease, to be
+            // released once the new state has been acknowledged
+            bool        updateFastCaptureEffects(FastCaptureState *state,
+                                const Vector< sp<EffectChain> >& effectChains,
+                                Vector< sp<EffectModule> > *effectsToRelease,
+                                sp<EchoReference> *referenceToRelease);
+
+            // Converts frames from srcFormat and srcChannelCount to the format and channel count
+            // of track into dst; may use the track's mRsmpOutBuffer as scratch.
+            void        convertForTrack(RecordTrack *track, void *dst, const void *src,
+                                audio_format_t srcFormat, uint32_t srcChannelCount,
+                                size_t frames);
+
+            // Set at construction from property; when true, a lone normal client that needs no
+            // conversion is captured straight into its own buffer, bypassing mRsmpInBuffer.
+            bool                                mRecordDirect;
+            // accessible only within the threadLoop(), read without lock by dump
+            uint32_t                            mReads;         // normal thread HAL reads
+            uint32_t                            mDirectReads;   // of which into a client buffer
 };
@@ -78,6 +78,7 @@ public:
             audio_track_cblk_t* cblk() const { return mCblk; }
             int         sessionId() const { return mSessionId; }
             int         uid() const { return mUid; }
+    const wp<ThreadBase>& thread() const { return mThread; }
     virtual status_t    setSyncEvent(const sp<SyncEvent>& event);
 
             sp<IMemory> getBuffers() const { return mBufferMemory; }
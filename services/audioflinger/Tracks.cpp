@@ -25,6 +25,7 @@
 #include <utils/Log.h>
 
 #include <private/media/AudioTrackShared.h>
+#include <media/AudioResamplerPublic.h>
 
 #include <common_time/cc_helper.h>
 #include <common_time/local_clock.h>
@@ -445,7 +446,7 @@ AudioFlinger::PlaybackThread::Track::Track(
         mFastIndex = i;
         // Read the initial underruns because this field is never cleared by the fast mixer
         mObservedUnderruns = thread->getFastTrackUnderruns(i);
-        thread->mFastTrackAvailMask &= ~(1 << i);
+        thread->mFastTrackAvailMask &= ~(1u << i);
     }
 }
 
@@ -890,6 +891,66 @@ status_t AudioFlinger::PlaybackThread::Track::setParameters(const String8& keyVa
     }
 }
 
+status_t AudioFlinger::PlaybackThread::Track::checkParameter(
+        IAudioFlinger::TrackParameter::Key key, float value) const
+{
+    if (mCblk == NULL) {
+        return NO_INIT;
+    }
+    switch (key) {
+    case IAudioFlinger::TrackParameter::VOLUME_LEFT:
+    case IAudioFlinger::TrackParameter::VOLUME_RIGHT:
+    case IAudioFlinger::TrackParameter::SEND_LEVEL:
+        if (!(value >= 0.0f && value <= GAIN_FLOAT_UNITY)) {
+            return BAD_VALUE;
+        }
+        return NO_ERROR;
+    case IAudioFlinger::TrackParameter::SAMPLE_RATE: {
+        // same restrictions as AudioTrack::setSampleRate()
+        if (isFastTrack() || isOffloaded() || isDirect() || isTimedTrack()) {
+            return INVALID_OPERATION;
+        }
+        sp<ThreadBase> thread = mThread.promote();
+        if (thread == 0) {
+            return DEAD_OBJECT;
+        }
+        if (!(value >= 1.0f &&
+                value <= (float) thread->sampleRate() * AUDIO_RESAMPLER_DOWN_RATIO_MAX)) {
+            return BAD_VALUE;
+        }
+        return NO_ERROR;
+        }
+    default:
+        return BAD_VALUE;
+    }
+}
+
+void AudioFlinger::PlaybackThread::Track::setParameter_l(
+        IAudioFlinger::TrackParameter::Key key, float value)
+{
+    // written to the control block like the client proxy does, so that the next mix cycle,
+    // which reads it with the thread lock held, sees all the updates of the batch at once
+    gain_minifloat_packed_t vlr;
+    switch (key) {
+    case IAudioFlinger::TrackParameter::VOLUME_LEFT:
+        vlr = mCblk->mVolumeLR;
+        mCblk->mVolumeLR = gain_minifloat_pack(gain_from_float(value),
+                gain_minifloat_unpack_right(vlr));
+        break;
+    case IAudioFlinger::TrackParameter::VOLUME_RIGHT:
+        vlr = mCblk->mVolumeLR;
+        mCblk->mVolumeLR = gain_minifloat_pack(gain_minifloat_unpack_left(vlr),
+                gain_from_float(value));
+        break;
+    case IAudioFlinger::TrackParameter::SEND_LEVEL:
+        mCblk->mSendLevel = uint16_t(value * 0x1000);
+        break;
+    case IAudioFlinger::TrackParameter::SAMPLE_RATE:
+        mCblk->mSampleRate = (uint32_t) value;
+        break;
+    }
+}
+
 status_t AudioFlinger::PlaybackThread::Track::getTimestamp(AudioTimestamp& timestamp)
 {
     // Client should implement this using SSQ; the unpresented frame count in latch is irrelevant
@@ -1672,7 +1733,7 @@ AudioFlinger::PlaybackThread::OutputTrack::OutputTrack(
             int uid)
     :   Track(playbackThread, NULL, AUDIO_STREAM_CNT, sampleRate, format, channelMask, frameCount,
                 NULL, 0, 0, uid, IAudioFlinger::TRACK_DEFAULT, TYPE_OUTPUT),
-    mActive(false), mSourceThread(sourceThread), mClientProxy(NULL)
+    mActive(false), mStartDelayFrames(0), mSourceThread(sourceThread), mClientProxy(NULL)
 {
 
     if (mCblk != NULL) {
@@ -1738,9 +1799,15 @@ bool AudioFlinger::PlaybackThread::OutputTrack::write(int16_t* data, uint32_t fr
         sp<ThreadBase> thread = mThread.promote();
         if (thread != 0) {
             MixerThread *mixerThread = (MixerThread *)thread.get();
-            if (mFrameCount > frames) {
+            // The start delay stays in the overflow queue for as long as the output runs, next
+            // to one buffer per write, so leave room for those and the initial fill.
+            uint32_t startDelay = mStartDelayFrames;
+            if (startDelay > (kMaxOverFlowBuffers - 2) * frames) {
+                startDelay = (kMaxOverFlowBuffers - 2) * frames;
+            }
+            uint32_t startFrames = (mFrameCount > frames ? mFrameCount - frames : 0) + startDelay;
+            if (startFrames > 0) {
                 if (mBufferQueue.size() < kMaxOverFlowBuffers) {
-                    uint32_t startFrames = (mFrameCount - frames);
                     pInBuffer = new Buffer;
                     pInBuffer->mBuffer = new int16_t[startFrames * channelCount];
                     pInBuffer->frameCount = startFrames;
@@ -2023,8 +2090,11 @@ AudioFlinger::RecordThread::RecordTrack::RecordTrack(
     if (thread->mSampleRate != sampleRate && thread->mChannelCount <= FCC_2 &&
             channelCount <= FCC_2) {
         // sink SR
-        mResampler = AudioResampler::create(AUDIO_FORMAT_PCM_16_BIT,
-                thread->mChannelCount, sampleRate);
+        // the float resampler is only provided by the dynamic implementation
+        mResampler = AudioResampler::create(thread->mRsmpInFormat,
+                thread->mChannelCount, sampleRate,
+                thread->mRsmpInFormat == AUDIO_FORMAT_PCM_FLOAT ?
+                        AudioResampler::DYN_MED_QUALITY : AudioResampler::DEFAULT_QUALITY);
         // source SR
         mResampler->setSampleRate(thread->mSampleRate);
         mResampler->setVolume(AudioMixer::UNITY_GAIN_FLOAT, AudioMixer::UNITY_GAIN_FLOAT);
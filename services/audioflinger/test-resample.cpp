@@ -21,10 +21,12 @@
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <errno.h>
 #include <inttypes.h>
 #include <time.h>
 #include <math.h>
+#include <linux/perf_event.h>
 #include <audio_utils/primitives.h>
 #include <audio_utils/sndfile.h>
 #include <utils/Vector.h>
@@ -41,6 +43,9 @@ static int usage(const char* name) {
                    " [-i input-sample-rate] [-o output-sample-rate]"
                    " [-O csv] [-P csv] [<input-file>]"
                    " <output-file>\n", name);
+    fprintf(stderr,"       %s -b [-c channels] [-q quality] [<output-csv-file>]\n", name);
+    fprintf(stderr,"    -b    benchmark sweep of qualities, rates, channels and formats,\n");
+    fprintf(stderr,"          written as CSV (to stdout by default), restricted by -c and -q\n");
     fprintf(stderr,"    -p    enable profiling\n");
     fprintf(stderr,"    -f    enable filter profiling\n");
     fprintf(stderr,"    -F    enable floating point -q {dlq|dmq|dhq} only");
@@ -101,11 +106,362 @@ int parseCSV(const char *string, Vector<int>& values)
     }
 }
 
+class Provider: public AudioBufferProvider {
+    const void*     mAddr;      // base address
+    const size_t    mNumFrames; // total frames
+    const size_t    mFrameSize; // size of each frame in bytes
+    size_t          mNextFrame; // index of next frame to provide
+    size_t          mUnrel;     // number of frames not yet released
+    const Vector<int> mPvalues; // number of frames provided per call
+    size_t          mNextPidx;  // index of next entry in mPvalues to use
+public:
+    Provider(const void* addr, size_t frames, size_t frameSize, const Vector<int>& Pvalues)
+      : mAddr(addr),
+        mNumFrames(frames),
+        mFrameSize(frameSize),
+        mNextFrame(0), mUnrel(0), mPvalues(Pvalues), mNextPidx(0) {
+    }
+    virtual status_t getNextBuffer(Buffer* buffer,
+            int64_t pts = kInvalidPTS) {
+        (void)pts; // suppress warning
+        size_t requestedFrames = buffer->frameCount;
+        if (requestedFrames > mNumFrames - mNextFrame) {
+            buffer->frameCount = mNumFrames - mNextFrame;
+        }
+        if (!mPvalues.isEmpty()) {
+            size_t provided = mPvalues[mNextPidx++];
+            printf("mPvalue[%zu]=%zu not %zu\n", mNextPidx-1, provided, buffer->frameCount);
+            if (provided < buffer->frameCount) {
+                buffer->frameCount = provided;
+            }
+            if (mNextPidx >= mPvalues.size()) {
+                mNextPidx = 0;
+            }
+        }
+        if (gVerbose) {
+            printf("getNextBuffer() requested %zu frames out of %zu frames available,"
+                    " and returned %zu frames\n",
+                    requestedFrames, (size_t) (mNumFrames - mNextFrame), buffer->frameCount);
+        }
+        mUnrel = buffer->frameCount;
+        if (buffer->frameCount > 0) {
+            buffer->raw = (char *)mAddr + mFrameSize * mNextFrame;
+            return NO_ERROR;
+        } else {
+            buffer->raw = NULL;
+            return NOT_ENOUGH_DATA;
+        }
+    }
+    virtual void releaseBuffer(Buffer* buffer) {
+        if (buffer->frameCount > mUnrel) {
+            fprintf(stderr, "ERROR releaseBuffer() released %zu frames but only %zu available "
+                    "to release\n", buffer->frameCount, mUnrel);
+            mNextFrame += mUnrel;
+            mUnrel = 0;
+        } else {
+            if (gVerbose) {
+                printf("releaseBuffer() released %zu frames out of %zu frames available "
+                        "to release\n", buffer->frameCount, mUnrel);
+            }
+            mNextFrame += buffer->frameCount;
+            mUnrel -= buffer->frameCount;
+        }
+        buffer->frameCount = 0;
+        buffer->raw = NULL;
+    }
+    void reset() {
+        mNextFrame = 0;
+    }
+};
+
+// ----------------------------------------------------------------------------
+// Benchmark sweep (-b)
+//
+// Sweeps every resampler quality over a matrix of sample rate pairs, channel counts
+// and (for the dynamic resamplers) sample formats, and writes one CSV row per
+// configuration with the throughput and the quality of the conversion:
+//
+// ns_per_frame      best of several trials, per output frame
+// cycles_per_frame  user space CPU cycles from the perf cycle counter, per output frame
+//                   (empty if the kernel does not provide the counter)
+// thdn_db           THD+N of a -6dBFS 997Hz sine, i.e. the energy of the output minus
+//                   the best fit sine relative to the energy of the sine
+// ripple_db         peak to peak gain variation over kNumRippleTones sines spread up to
+//                   kPassbandFraction of the lower Nyquist frequency
+
+static const struct {
+    AudioResampler::src_quality quality;
+    const char* name;
+} kBenchmarkQualities[] = {
+    { AudioResampler::DEFAULT_QUALITY, "dq" },
+    { AudioResampler::LOW_QUALITY, "lq" },
+    { AudioResampler::MED_QUALITY, "mq" },
+    { AudioResampler::HIGH_QUALITY, "hq" },
+    { AudioResampler::VERY_HIGH_QUALITY, "vhq" },
+    { AudioResampler::DYN_LOW_QUALITY, "dlq" },
+    { AudioResampler::DYN_MED_QUALITY, "dmq" },
+    { AudioResampler::DYN_HIGH_QUALITY, "dhq" },
+};
+
+static const int kBenchmarkRates[][2] = {
+    { 44100, 48000 },
+    { 48000, 44100 },
+    { 48000, 32000 },
+    { 32000, 48000 },
+    { 16000, 48000 },
+    { 8000, 48000 },
+    { 96000, 48000 },
+    { 48000, 96000 },
+};
+
+static const int kBenchmarkChannels[] = { 1, 2, 6, 8 };
+
+static const double kToneFreq = 997.;        // Hz, not harmonically related to sample rates
+static const double kToneAmplitude = 0.5;    // -6dBFS
+static const int kNumRippleTones = 8;
+static const double kPassbandFraction = 0.8; // of the lower Nyquist frequency
+static const int kSpeedTrials = 4;
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#endif
+
+static int64_t monotonicNs()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Counts the user space CPU cycles of the calling thread through perf events.
+class CycleCounter {
+public:
+    CycleCounter() {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        mFd = syscall(__NR_perf_event_open, &attr, 0 /*pid*/, -1 /*cpu*/, -1 /*group_fd*/, 0);
+    }
+    ~CycleCounter() {
+        if (mFd >= 0) {
+            close(mFd);
+        }
+    }
+    bool isValid() const {
+        return mFd >= 0;
+    }
+    // returns the current cycle count, or -1 if not available.
+    int64_t cycles() const {
+        uint64_t value;
+        if (mFd < 0 || read(mFd, &value, sizeof(value)) != sizeof(value)) {
+            return -1;
+        }
+        return value;
+    }
+private:
+    int mFd;
+};
+
+// Returns a malloc'd buffer of frames of a sine wave, in int16_t or float.
+static void* createSine(bool useFloat, int channels, int sampleRate, double freq,
+        size_t frames)
+{
+    const size_t sampleSize = useFloat ? sizeof(float) : sizeof(int16_t);
+    void* buffer = malloc(frames * channels * sampleSize);
+    for (size_t i = 0; i < frames; i++) {
+        double y = kToneAmplitude * sin(2. * M_PI * freq * i / sampleRate);
+        for (int j = 0; j < channels; j++) {
+            if (useFloat) {
+                ((float*) buffer)[i * channels + j] = y;
+            } else {
+                ((int16_t*) buffer)[i * channels + j] = floor(y * 32767.0 + 0.5);
+            }
+        }
+    }
+    return buffer;
+}
+
+// Fits a sine of normalized angular frequency w to the first output channel
+// by least squares over [first, first + count), returning its amplitude.
+// The mean square error of the fit is returned in noise.
+static double fitSine(const void* output, bool useFloat, int outputChannels,
+        size_t first, size_t count, double w, double* noise)
+{
+    double ss = 0., sc = 0., cc = 0., ys = 0., yc = 0.;
+    for (size_t i = first; i < first + count; i++) {
+        double y = useFloat ? ((const float*) output)[i * outputChannels]
+                : ((const int32_t*) output)[i * outputChannels] / (double) (1 << 27); // Q4.27
+        double s = sin(w * i);
+        double c = cos(w * i);
+        ss += s * s;
+        sc += s * c;
+        cc += c * c;
+        ys += y * s;
+        yc += y * c;
+    }
+    double det = ss * cc - sc * sc;
+    double a = (ys * cc - yc * sc) / det;
+    double b = (yc * ss - ys * sc) / det;
+    double error = 0.;
+    for (size_t i = first; i < first + count; i++) {
+        double y = useFloat ? ((const float*) output)[i * outputChannels]
+                : ((const int32_t*) output)[i * outputChannels] / (double) (1 << 27);
+        double e = y - a * sin(w * i) - b * cos(w * i);
+        error += e * e;
+    }
+    *noise = error / count;
+    return sqrt(a * a + b * b);
+}
+
+// Resamples half a second of a sine of freq Hz, returning the gain and the THD+N in dB.
+static void measureTone(AudioResampler::src_quality quality, bool useFloat, int channels,
+        int inputRate, int outputRate, double freq, double* gainDb, double* thdnDb)
+{
+    const size_t inputFrames = inputRate / 2;
+    void* input = createSine(useFloat, channels, inputRate, freq, inputFrames);
+    Provider provider(input, inputFrames,
+            channels * (useFloat ? sizeof(float) : sizeof(int16_t)), Vector<int>());
+
+    const int outputChannels = channels > 2 ? channels : 2;
+    const size_t outputFrames = ((int64_t) inputFrames * outputRate) / inputRate;
+    void* output = calloc(outputFrames * outputChannels, sizeof(int32_t));
+
+    AudioResampler* resampler = AudioResampler::create(
+            useFloat ? AUDIO_FORMAT_PCM_FLOAT : AUDIO_FORMAT_PCM_16_BIT,
+            channels, outputRate, quality);
+    resampler->setSampleRate(inputRate);
+    resampler->setVolume(AudioResampler::UNITY_GAIN_FLOAT, AudioResampler::UNITY_GAIN_FLOAT);
+    resampler->resample((int32_t*) output, outputFrames, &provider);
+    delete resampler;
+
+    // skip the filter transients at the start and end of the signal
+    const size_t skip = outputFrames / 8;
+    double noise;
+    double amplitude = fitSine(output, useFloat, outputChannels, skip, outputFrames - 2 * skip,
+            2. * M_PI * freq / outputRate, &noise);
+    *gainDb = 20. * log10(amplitude / kToneAmplitude);
+    *thdnDb = 10. * log10(noise / (amplitude * amplitude / 2.));
+    free(output);
+    free(input);
+}
+
+// Measures the best time and cycle count to resample one second of input.
+static void measureSpeed(AudioResampler::src_quality quality, bool useFloat, int channels,
+        int inputRate, int outputRate, const CycleCounter& counter,
+        double* nsPerFrame, double* cyclesPerFrame)
+{
+    const size_t inputFrames = inputRate;
+    void* input = createSine(useFloat, channels, inputRate, kToneFreq, inputFrames);
+    Provider provider(input, inputFrames,
+            channels * (useFloat ? sizeof(float) : sizeof(int16_t)), Vector<int>());
+
+    const int outputChannels = channels > 2 ? channels : 2;
+    const size_t outputFrames = ((int64_t) inputFrames * outputRate) / inputRate;
+    void* output = calloc(outputFrames * outputChannels, sizeof(int32_t));
+
+    AudioResampler* resampler = AudioResampler::create(
+            useFloat ? AUDIO_FORMAT_PCM_FLOAT : AUDIO_FORMAT_PCM_16_BIT,
+            channels, outputRate, quality);
+    resampler->setSampleRate(inputRate);
+    resampler->setVolume(AudioResampler::UNITY_GAIN_FLOAT, AudioResampler::UNITY_GAIN_FLOAT);
+
+    int64_t bestNs = -1;
+    int64_t bestCycles = -1;
+    for (int n = 0; n < kSpeedTrials; ++n) {
+        provider.reset();
+        resampler->reset();
+        const int64_t startCycles = counter.cycles();
+        const int64_t startNs = monotonicNs();
+        resampler->resample((int32_t*) output, outputFrames, &provider);
+        const int64_t ns = monotonicNs() - startNs;
+        const int64_t cycles = counter.cycles() - startCycles;
+        if (bestNs < 0 || ns < bestNs) {
+            bestNs = ns;
+        }
+        if (startCycles >= 0 && (bestCycles < 0 || cycles < bestCycles)) {
+            bestCycles = cycles;
+        }
+    }
+    delete resampler;
+    *nsPerFrame = (double) bestNs / outputFrames;
+    *cyclesPerFrame = bestCycles < 0 ? -1. : (double) bestCycles / outputFrames;
+    free(output);
+    free(input);
+}
+
+// Runs the benchmark sweep, restricted to one quality and/or channel count if not negative.
+static int benchmarkSweep(FILE* csv, int onlyQuality, int onlyChannels)
+{
+    CycleCounter counter;
+    if (!counter.isValid()) {
+        fprintf(stderr, "cycle counter not available, cycles_per_frame will be empty\n");
+    }
+    fprintf(csv, "quality,format,channels,input_rate,output_rate,"
+            "ns_per_frame,cycles_per_frame,thdn_db,ripple_db\n");
+    for (size_t q = 0; q < ARRAY_SIZE(kBenchmarkQualities); ++q) {
+        const AudioResampler::src_quality quality = kBenchmarkQualities[q].quality;
+        if (onlyQuality >= 0 && quality != onlyQuality) {
+            continue;
+        }
+        const bool dynamic = quality >= AudioResampler::DYN_LOW_QUALITY;
+        for (int useFloat = 0; useFloat <= (dynamic ? 1 : 0); ++useFloat) {
+            for (size_t c = 0; c < ARRAY_SIZE(kBenchmarkChannels); ++c) {
+                const int channels = kBenchmarkChannels[c];
+                if ((onlyChannels >= 0 && channels != onlyChannels)
+                        || channels > (dynamic ? 8 : 2)) {
+                    continue;
+                }
+                for (size_t r = 0; r < ARRAY_SIZE(kBenchmarkRates); ++r) {
+                    const int inputRate = kBenchmarkRates[r][0];
+                    const int outputRate = kBenchmarkRates[r][1];
+                    double nsPerFrame, cyclesPerFrame, gainDb, thdnDb;
+                    measureSpeed(quality, useFloat, channels, inputRate, outputRate, counter,
+                            &nsPerFrame, &cyclesPerFrame);
+                    measureTone(quality, useFloat, channels, inputRate, outputRate,
+                            kToneFreq, &gainDb, &thdnDb);
+
+                    const double passband = kPassbandFraction
+                            * (inputRate < outputRate ? inputRate : outputRate) / 2.;
+                    double minGainDb = 0., maxGainDb = 0.;
+                    for (int i = 0; i < kNumRippleTones; ++i) {
+                        double toneThdnDb;
+                        measureTone(quality, useFloat, channels, inputRate, outputRate,
+                                passband * (i + 1) / kNumRippleTones, &gainDb, &toneThdnDb);
+                        if (i == 0 || gainDb < minGainDb) {
+                            minGainDb = gainDb;
+                        }
+                        if (i == 0 || gainDb > maxGainDb) {
+                            maxGainDb = gainDb;
+                        }
+                    }
+
+                    fprintf(csv, "%s,%s,%d,%d,%d,%.2f,", kBenchmarkQualities[q].name,
+                            useFloat ? "float" : "s16", channels, inputRate, outputRate,
+                            nsPerFrame);
+                    if (cyclesPerFrame >= 0.) {
+                        fprintf(csv, "%.1f", cyclesPerFrame);
+                    }
+                    fprintf(csv, ",%.2f,%.3f\n", thdnDb, maxGainDb - minGainDb);
+                    fflush(csv);
+                }
+            }
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
 int main(int argc, char* argv[]) {
     const char* const progname = argv[0];
     bool profileResample = false;
     bool profileFilter = false;
     bool useFloat = false;
+    bool benchmark = false;
+    bool haveChannels = false;
+    bool haveQuality = false;
     int channels = 1;
     int input_freq = 0;
     int output_freq = 0;
@@ -114,8 +470,11 @@ int main(int argc, char* argv[]) {
     Vector<int> Pvalues;
 
     int ch;
-    while ((ch = getopt(argc, argv, "pfFvc:q:i:o:O:P:")) != -1) {
+    while ((ch = getopt(argc, argv, "pfFvbc:q:i:o:O:P:")) != -1) {
         switch (ch) {
+        case 'b':
+            benchmark = true;
+            break;
         case 'p':
             profileResample = true;
             break;
@@ -130,8 +489,10 @@ int main(int argc, char* argv[]) {
             break;
         case 'c':
             channels = atoi(optarg);
+            haveChannels = true;
             break;
         case 'q':
+            haveQuality = true;
             if (!strcmp(optarg, "dq"))
                 quality = AudioResampler::DEFAULT_QUALITY;
             else if (!strcmp(optarg, "lq"))
@@ -179,7 +540,7 @@ int main(int argc, char* argv[]) {
     }
 
     if (channels < 1
-            || channels > (quality < AudioResampler::DYN_LOW_QUALITY ? 2 : 8)) {
+            || channels > (quality < AudioResampler::DYN_LOW_QUALITY && !benchmark ? 2 : 8)) {
         fprintf(stderr, "invalid number of audio channels %d\n", channels);
         return -1;
     }
@@ -191,6 +552,26 @@ int main(int argc, char* argv[]) {
     argc -= optind;
     argv += optind;
 
+    if (benchmark) {
+        FILE* csv = stdout;
+        if (argc == 1) {
+            csv = fopen(argv[0], "w");
+            if (csv == NULL) {
+                perror(argv[0]);
+                return EXIT_FAILURE;
+            }
+        } else if (argc != 0) {
+            usage(progname);
+            return -1;
+        }
+        int status = benchmarkSweep(csv, haveQuality ? quality : -1,
+                haveChannels ? channels : -1);
+        if (csv != stdout) {
+            fclose(csv);
+        }
+        return status;
+    }
+
     const char* file_in = NULL;
     const char* file_out = NULL;
     if (argc == 1) {
@@ -257,73 +638,7 @@ int main(int argc, char* argv[]) {
 
     // ----------------------------------------------------------
 
-    class Provider: public AudioBufferProvider {
-        const void*     mAddr;      // base address
-        const size_t    mNumFrames; // total frames
-        const size_t    mFrameSize; // size of each frame in bytes
-        size_t          mNextFrame; // index of next frame to provide
-        size_t          mUnrel;     // number of frames not yet released
-        const Vector<int> mPvalues; // number of frames provided per call
-        size_t          mNextPidx;  // index of next entry in mPvalues to use
-    public:
-        Provider(const void* addr, size_t frames, size_t frameSize, const Vector<int>& Pvalues)
-          : mAddr(addr),
-            mNumFrames(frames),
-            mFrameSize(frameSize),
-            mNextFrame(0), mUnrel(0), mPvalues(Pvalues), mNextPidx(0) {
-        }
-        virtual status_t getNextBuffer(Buffer* buffer,
-                int64_t pts = kInvalidPTS) {
-            (void)pts; // suppress warning
-            size_t requestedFrames = buffer->frameCount;
-            if (requestedFrames > mNumFrames - mNextFrame) {
-                buffer->frameCount = mNumFrames - mNextFrame;
-            }
-            if (!mPvalues.isEmpty()) {
-                size_t provided = mPvalues[mNextPidx++];
-                printf("mPvalue[%zu]=%zu not %zu\n", mNextPidx-1, provided, buffer->frameCount);
-                if (provided < buffer->frameCount) {
-                    buffer->frameCount = provided;
-                }
-                if (mNextPidx >= mPvalues.size()) {
-                    mNextPidx = 0;
-                }
-            }
-            if (gVerbose) {
-                printf("getNextBuffer() requested %zu frames out of %zu frames available,"
-                        " and returned %zu frames\n",
-                        requestedFrames, (size_t) (mNumFrames - mNextFrame), buffer->frameCount);
-            }
-            mUnrel = buffer->frameCount;
-            if (buffer->frameCount > 0) {
-                buffer->raw = (char *)mAddr + mFrameSize * mNextFrame;
-                return NO_ERROR;
-            } else {
-                buffer->raw = NULL;
-                return NOT_ENOUGH_DATA;
-            }
-        }
-        virtual void releaseBuffer(Buffer* buffer) {
-            if (buffer->frameCount > mUnrel) {
-                fprintf(stderr, "ERROR releaseBuffer() released %zu frames but only %zu available "
-                        "to release\n", buffer->frameCount, mUnrel);
-                mNextFrame += mUnrel;
-                mUnrel = 0;
-            } else {
-                if (gVerbose) {
-                    printf("releaseBuffer() released %zu frames out of %zu frames available "
-                            "to release\n", buffer->frameCount, mUnrel);
-                }
-                mNextFrame += buffer->frameCount;
-                mUnrel -= buffer->frameCount;
-            }
-            buffer->frameCount = 0;
-            buffer->raw = NULL;
-        }
-        void reset() {
-            mNextFrame = 0;
-        }
-    } provider(input_vaddr, input_frames, input_framesize, Pvalues);
+    Provider provider(input_vaddr, input_frames, input_framesize, Pvalues);
 
     if (gVerbose) {
         printf("%zu input frames\n", input_frames);
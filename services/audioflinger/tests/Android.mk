@@ -34,6 +34,34 @@ LOCAL_MODULE_TAGS := tests
 
 include $(BUILD_EXECUTABLE)
 
+#
+# resampler throughput benchmark
+#
+include $(CLEAR_VARS)
+
+LOCAL_SHARED_LIBRARIES := \
+	liblog \
+	libutils \
+	libcutils \
+	libstlport \
+	libaudioutils \
+	libaudioresampler
+
+LOCAL_C_INCLUDES := \
+	bionic \
+	bionic/libstdc++/include \
+	external/stlport/stlport \
+	$(call include-path-for, audio-utils) \
+	frameworks/av/services/audioflinger
+
+LOCAL_SRC_FILES := \
+	resampler_benchmark.cpp
+
+LOCAL_MODULE := resampler_benchmark
+LOCAL_MODULE_TAGS := tests
+
+include $(BUILD_EXECUTABLE)
+
 #
 # audio mixer test tool
 #
@@ -61,6 +89,7 @@ LOCAL_SHARED_LIBRARIES := \
 	libcommon_time_client \
 	libaudioresampler \
 	libaudioutils \
+	libcpustats \
 	libdl \
 	libcutils \
 	libutils \
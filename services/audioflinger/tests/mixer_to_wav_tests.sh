@@ -104,6 +104,14 @@ function createwav() {
         sine:6,1000,32000
     adb pull /sdcard/tm32000nrot.wav $2
 
+# Test:
+# process__genericResampling
+# Downmixer (quad and 7.1 with resampling)
+    adb shell test-mixer $1 -s 48000 \
+        -o /sdcard/tm48000grd.wav \
+        sine:4,1000,44100 chirp:8,44100
+    adb pull /sdcard/tm48000grd.wav $2
+
 # Test:
 # process__NoResampleOneTrack / OneTrack16BitsStereoNoResampling
 # Aux buffer
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Resampler throughput benchmark.
+ *
+ * Measures the time to resample a fixed length sine wave for the dynamic
+ * resampler qualities, for mono and stereo, integer and float, and for both
+ * a locked phase (48000 to 32000) and an interpolated phase (44100 to 48000)
+ * conversion.  The best of several runs is reported as ns per output frame
+ * and as a multiple of real time.
+ *
+ * usage: resampler_benchmark [-r runs] [-s seconds]
+ */
+
+#define LOG_TAG "audioflinger_resampler_benchmark"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <math.h>
+#include <vector>
+#include <cutils/log.h>
+#include <media/AudioBufferProvider.h>
+#include "AudioResampler.h"
+#include "test_utils.h"
+
+static int64_t systemTimeNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// returns the best elapsed time in ns over the given number of runs.
+template <typename TI>
+static int64_t benchmark(size_t channels, unsigned inputFreq, unsigned outputFreq,
+        double seconds, int runs, enum android::AudioResampler::src_quality quality,
+        size_t* outputFrames)
+{
+    SignalProvider provider;
+    provider.setSine<TI>(channels, 1000., inputFreq, seconds);
+
+    android::AudioResampler* resampler = android::AudioResampler::create(
+            is_same<TI, int16_t>::value ? AUDIO_FORMAT_PCM_16_BIT : AUDIO_FORMAT_PCM_FLOAT,
+            channels, outputFreq, quality);
+    resampler->setSampleRate(inputFreq);
+    resampler->setVolume(android::AudioResampler::UNITY_GAIN_FLOAT,
+            android::AudioResampler::UNITY_GAIN_FLOAT);
+
+    // the resampler produces at least stereo output, see AudioResampler::resample().
+    const size_t frames = ((int64_t) provider.getNumFrames() * outputFreq) / inputFreq;
+    const size_t outputChannels = channels < 2 ? 2 : channels;
+    std::vector<int32_t> output(frames * outputChannels);
+
+    int64_t best = -1;
+    for (int i = 0; i < runs; ++i) {
+        provider.reset();
+        resampler->reset();
+        memset(&output[0], 0, output.size() * sizeof(output[0]));
+        const int64_t start = systemTimeNs();
+        resampler->resample(&output[0], frames, &provider);
+        const int64_t elapsed = systemTimeNs() - start;
+        if (best < 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    delete resampler;
+    *outputFrames = frames;
+    return best;
+}
+
+int main(int argc, char* argv[])
+{
+    int runs = 5;
+    double seconds = 10.;
+    int ch;
+    while ((ch = getopt(argc, argv, "r:s:")) != -1) {
+        switch (ch) {
+        case 'r':
+            runs = atoi(optarg);
+            break;
+        case 's':
+            seconds = atof(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-r runs] [-s seconds]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (runs < 1 || seconds <= 0.) {
+        fprintf(stderr, "runs and seconds must be positive\n");
+        return EXIT_FAILURE;
+    }
+
+    static const struct {
+        enum android::AudioResampler::src_quality quality;
+        const char* name;
+    } kQualities[] = {
+        { android::AudioResampler::DYN_LOW_QUALITY, "dyn_low" },
+        { android::AudioResampler::DYN_MED_QUALITY, "dyn_med" },
+        { android::AudioResampler::DYN_HIGH_QUALITY, "dyn_high" },
+    };
+    static const unsigned kRates[][2] = {
+        { 48000, 32000 }, // locked phase
+        { 44100, 48000 }, // interpolated phase
+    };
+
+    printf("%-9s %-5s %-3s %-13s %10s %10s\n",
+            "quality", "input", "ch", "conversion", "ns/frame", "realtime");
+    for (size_t q = 0; q < ARRAY_SIZE(kQualities); ++q) {
+        for (int useFloat = 0; useFloat < 2; ++useFloat) {
+            for (size_t channels = 1; channels <= 2; ++channels) {
+                for (size_t r = 0; r < ARRAY_SIZE(kRates); ++r) {
+                    size_t frames;
+                    int64_t ns = useFloat
+                            ? benchmark<float>(channels, kRates[r][0], kRates[r][1],
+                                    seconds, runs, kQualities[q].quality, &frames)
+                            : benchmark<int16_t>(channels, kRates[r][0], kRates[r][1],
+                                    seconds, runs, kQualities[q].quality, &frames);
+                    printf("%-9s %-5s %-3zu %6u->%-6u %10.2f %9.1fx\n",
+                            kQualities[q].name, useFloat ? "float" : "s16", channels,
+                            kRates[r][0], kRates[r][1], (double) ns / frames,
+                            frames * 1e9 / ((double) ns * kRates[r][1]));
+                }
+            }
+        }
+    }
+    return EXIT_SUCCESS;
+}
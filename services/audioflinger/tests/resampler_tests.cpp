@@ -135,6 +135,49 @@ void testBufferIncrement(size_t channels, bool useFloat,
     delete resampler;
 }
 
+/* Checks that resamplers with identical conversions produce identical output,
+ * regardless of whether their filter was generated or shared with another
+ * resampler that is still alive or has already been deleted.
+ */
+void testSharedFilter(size_t channels, unsigned inputFreq, unsigned outputFreq,
+        enum android::AudioResampler::src_quality quality)
+{
+    std::vector<int> inputIncr;
+    SignalProvider provider;
+    provider.setChirp<int16_t>(channels,
+            0., outputFreq/2., outputFreq, outputFreq/2000.);
+    provider.setIncr(inputIncr);
+
+    size_t outputFrames = ((int64_t) provider.getNumFrames() * outputFreq) / inputFreq;
+    size_t outputFrameSize = channels * sizeof(int32_t);
+    std::vector<size_t> refIncr;
+    refIncr.push_back(outputFrames);
+
+    android::AudioResampler* resampler[3];
+    void* output[3];
+    for (size_t i = 0; i < ARRAY_SIZE(resampler); ++i) {
+        resampler[i] = android::AudioResampler::create(AUDIO_FORMAT_PCM_16_BIT,
+                channels, outputFreq, quality);
+        resampler[i]->setSampleRate(inputFreq);
+        resampler[i]->setVolume(android::AudioResampler::UNITY_GAIN_FLOAT,
+                android::AudioResampler::UNITY_GAIN_FLOAT);
+        output[i] = calloc(outputFrames, outputFrameSize);
+        provider.reset();
+        resample(channels, output[i], outputFrames, refIncr, &provider, resampler[i]);
+        if (i == 1) {
+            // the third resampler gets the filter still held by the second one
+            delete resampler[0];
+            resampler[0] = NULL;
+        }
+    }
+    buffercmp(output[0], output[1], outputFrameSize, outputFrames);
+    buffercmp(output[0], output[2], outputFrameSize, outputFrames);
+    for (size_t i = 0; i < ARRAY_SIZE(resampler); ++i) {
+        delete resampler[i];
+        free(output[i]);
+    }
+}
+
 template <typename T>
 inline double sqr(T v)
 {
@@ -291,6 +334,24 @@ TEST(audioflinger_resampler, bufferincrement_interpolatedphase_multi_float) {
     }
 }
 
+/* Shared filter test
+ *
+ * Dynamic resamplers doing the same conversion share one filter bank.
+ * Uses both a resident (44.1 kHz to 48 kHz) and a reference counted conversion.
+ */
+TEST(audioflinger_resampler, sharedfilter) {
+    static const enum android::AudioResampler::src_quality kQualityArray[] = {
+            android::AudioResampler::DYN_LOW_QUALITY,
+            android::AudioResampler::DYN_MED_QUALITY,
+            android::AudioResampler::DYN_HIGH_QUALITY,
+    };
+
+    for (size_t i = 0; i < ARRAY_SIZE(kQualityArray); ++i) {
+        testSharedFilter(2, 44100, 48000, kQualityArray[i]);
+        testSharedFilter(2, 22050, 48000, kQualityArray[i]);
+    }
+}
+
 /* Simple aliasing test
  *
  * This checks stopband response of the chirp signal to make sure frequencies
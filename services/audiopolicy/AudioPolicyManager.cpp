@@ -1697,6 +1697,7 @@ void AudioPolicyManager::releaseOutput(audio_io_handle_t output)
         if (outputDesc->isActive()) {
             mpClientInterface->closeOutput(output);
             mOutputs.removeItem(output);
+            mOutputsGeneration++;
             mTestOutputs[testIndex] = 0;
         }
         return;
@@ -2469,6 +2470,10 @@ status_t AudioPolicyManager::dump(int fd)
     snprintf(buffer, SIZE, " Force use for hdmi system audio %d\n",
             mForceUse[AUDIO_POLICY_FORCE_FOR_HDMI_SYSTEM_AUDIO]);
     result.append(buffer);
+    snprintf(buffer, SIZE, " Routing cache: strategy device hits %u misses %u,"
+             " outputs for device hits %u misses %u\n",
+             mRoutingCacheHits, mRoutingCacheMisses, mOutputsCacheHits, mOutputsCacheMisses);
+    result.append(buffer);
 
     snprintf(buffer, SIZE, " Available output devices:\n");
     result.append(buffer);
@@ -3373,6 +3378,15 @@ AudioPolicyManager::AudioPolicyManager(AudioPolicyClientInterface *clientInterfa
         mForceUse[i] = AUDIO_POLICY_FORCE_NONE;
     }
 
+    memset(&mRoutingState, 0, sizeof(mRoutingState));
+    mRoutingCacheValid = 0;
+    mRoutingCacheHits = 0;
+    mRoutingCacheMisses = 0;
+    mOutputsGeneration = 0;
+    mOutputsForDeviceGeneration = 0;
+    mOutputsCacheHits = 0;
+    mOutputsCacheMisses = 0;
+
     mDefaultOutputDevice = new DeviceDescriptor(String8(""), AUDIO_DEVICE_OUT_SPEAKER);
     if (loadAudioPolicyConfig(AUDIO_POLICY_VENDOR_CONFIG_FILE) != NO_ERROR) {
         if (loadAudioPolicyConfig(AUDIO_POLICY_CONFIG_FILE) != NO_ERROR) {
@@ -3600,6 +3614,7 @@ AudioPolicyManager::~AudioPolicyManager()
    mAvailableOutputDevices.clear();
    mAvailableInputDevices.clear();
    mOutputs.clear();
+   mOutputsGeneration++;
    mInputs.clear();
    mHwModules.clear();
 }
@@ -3711,6 +3726,7 @@ bool AudioPolicyManager::threadLoop()
                 audio_module_handle_t moduleHandle = outputDesc->mModule->mHandle;
 
                 mOutputs.removeItem(mPrimaryOutput);
+                mOutputsGeneration++;
 
                 sp<AudioOutputDescriptor> outputDesc = new AudioOutputDescriptor(NULL);
                 outputDesc->mDevice = AUDIO_DEVICE_OUT_SPEAKER;
@@ -3773,6 +3789,7 @@ void AudioPolicyManager::addOutput(audio_io_handle_t output, sp<AudioOutputDescr
     outputDesc->mIoHandle = output;
     outputDesc->mId = nextUniqueId();
     mOutputs.add(output, outputDesc);
+    mOutputsGeneration++;
     nextAudioPortGeneration();
 }
 
@@ -4011,6 +4028,7 @@ status_t AudioPolicyManager::checkOutputsForDevice(const sp<DeviceDescriptor> de
                                     mPrimaryOutput, output);
                             mpClientInterface->closeOutput(output);
                             mOutputs.removeItem(output);
+                            mOutputsGeneration++;
                             nextAudioPortGeneration();
                             output = AUDIO_IO_HANDLE_NONE;
                         }
@@ -4315,6 +4333,7 @@ void AudioPolicyManager::closeOutput(audio_io_handle_t output)
 
             mpClientInterface->closeOutput(duplicatedOutput);
             mOutputs.removeItem(duplicatedOutput);
+            mOutputsGeneration++;
         }
     }
 
@@ -4334,6 +4353,7 @@ void AudioPolicyManager::closeOutput(audio_io_handle_t output)
 
     mpClientInterface->closeOutput(output);
     mOutputs.removeItem(output);
+    mOutputsGeneration++;
     mPreviousOutputs = mOutputs;
 }
 
@@ -4362,10 +4382,25 @@ void AudioPolicyManager::closeInput(audio_io_handle_t input)
 }
 
 SortedVector<audio_io_handle_t> AudioPolicyManager::getOutputsForDevice(audio_devices_t device,
-                        DefaultKeyedVector<audio_io_handle_t, sp<AudioOutputDescriptor> > openOutputs)
+                        const DefaultKeyedVector<audio_io_handle_t, sp<AudioOutputDescriptor> >& openOutputs)
 {
     SortedVector<audio_io_handle_t> outputs;
 
+    // the devices supported by an output do not change while it is open
+    bool memoize = &openOutputs == &mOutputs;
+    if (memoize) {
+        if (mOutputsForDeviceGeneration != mOutputsGeneration) {
+            mOutputsForDevice.clear();
+            mOutputsForDeviceGeneration = mOutputsGeneration;
+        }
+        ssize_t index = mOutputsForDevice.indexOfKey(device);
+        if (index >= 0) {
+            mOutputsCacheHits++;
+            return mOutputsForDevice.valueAt(index);
+        }
+        mOutputsCacheMisses++;
+    }
+
     ALOGVV("getOutputsForDevice() device %04x", device);
     for (size_t i = 0; i < openOutputs.size(); i++) {
         ALOGVV("output %d isDuplicated=%d device=%04x",
@@ -4375,6 +4410,9 @@ SortedVector<audio_io_handle_t> AudioPolicyManager::getOutputsForDevice(audio_de
             outputs.add(openOutputs.keyAt(i));
         }
     }
+    if (memoize) {
+        mOutputsForDevice.add(device, outputs);
+    }
     return outputs;
 }
 
@@ -4708,16 +4746,54 @@ void AudioPolicyManager::handleNotificationRoutingForStream(audio_stream_type_t
     }
 }
 
+void AudioPolicyManager::checkRoutingCache()
+{
+    RoutingState state;
+    memset(&state, 0, sizeof(state));
+    state.mAvailableOutputDevices = mAvailableOutputDevices.types();
+    state.mAvailableInputDevices = mAvailableInputDevices.types();
+    state.mPhoneState = mPhoneState;
+    memcpy(state.mForceUse, mForceUse, sizeof(state.mForceUse));
+    state.mA2dpSuspended = mA2dpSuspended;
+    // follows the routed devices of the outputs, not only mOutputs
+    state.mA2dpOutput = getA2dpOutput() != 0;
+    state.mPrimaryOutput = mPrimaryOutput;
+    state.mOutputsGeneration = mOutputsGeneration;
+    if (memcmp(&state, &mRoutingState, sizeof(state)) != 0) {
+        ALOGVV("checkRoutingCache() routing state changed");
+        // copied with the padding, which takes part in the comparison
+        memcpy(&mRoutingState, &state, sizeof(state));
+        mRoutingCacheValid = 0;
+    }
+}
+
 audio_devices_t AudioPolicyManager::getDeviceForStrategy(routing_strategy strategy,
                                                              bool fromCache)
 {
-    uint32_t device = AUDIO_DEVICE_NONE;
-
     if (fromCache) {
         ALOGVV("getDeviceForStrategy() from cache strategy %d, device %x",
               strategy, mDeviceForStrategy[strategy]);
         return mDeviceForStrategy[strategy];
     }
+    if (strategy == STRATEGY_SONIFICATION_RESPECTFUL || strategy >= NUM_STRATEGIES) {
+        return computeDeviceForStrategy(strategy);
+    }
+    checkRoutingCache();
+    if (mRoutingCacheValid & (1 << strategy)) {
+        mRoutingCacheHits++;
+        return mRoutingCache[strategy];
+    }
+    mRoutingCacheMisses++;
+    audio_devices_t device = computeDeviceForStrategy(strategy);
+    mRoutingCache[strategy] = device;
+    mRoutingCacheValid |= 1 << strategy;
+    return device;
+}
+
+audio_devices_t AudioPolicyManager::computeDeviceForStrategy(routing_strategy strategy)
+{
+    uint32_t device = AUDIO_DEVICE_NONE;
+
     audio_devices_t availableOutputDeviceTypes = mAvailableOutputDevices.types();
     switch (strategy) {
 
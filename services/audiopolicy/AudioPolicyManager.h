@@ -562,6 +562,10 @@ protected:
         //  before updateDevicesAndOutputs() is called.
         virtual audio_devices_t getDeviceForStrategy(routing_strategy strategy,
                                                      bool fromCache);
+        // evaluates the routing rules for getDeviceForStrategy(strategy, false)
+        audio_devices_t computeDeviceForStrategy(routing_strategy strategy);
+        // drops the memoized devices of getDeviceForStrategy() when the routing state changed
+        void checkRoutingCache();
 
         // change the route of the specified output. Returns the number of ms we have slept to
         // allow new routing to take effect in certain cases.
@@ -699,8 +703,9 @@ protected:
         // extract one device relevant for volume control from multiple device selection
         static audio_devices_t getDeviceForVolume(audio_devices_t device);
 
+        // the result for mOutputs is memoized until an output is opened or closed
         SortedVector<audio_io_handle_t> getOutputsForDevice(audio_devices_t device,
-                        DefaultKeyedVector<audio_io_handle_t, sp<AudioOutputDescriptor> > openOutputs);
+                        const DefaultKeyedVector<audio_io_handle_t, sp<AudioOutputDescriptor> >& openOutputs);
         bool vectorsEqual(SortedVector<audio_io_handle_t>& outputs1,
                                            SortedVector<audio_io_handle_t>& outputs2);
 
@@ -781,6 +786,33 @@ protected:
         StreamDescriptor mStreams[AUDIO_STREAM_CNT];           // stream descriptors for volume control
         bool    mLimitRingtoneVolume;                                       // limit ringtone volume to music volume if headset connected
         audio_devices_t mDeviceForStrategy[NUM_STRATEGIES];
+
+        // State the routing rules of getDeviceForStrategy() depend on. The devices it returns
+        // when not reading from mDeviceForStrategy[] are memoized in mRoutingCache[] until this
+        // state changes, except for STRATEGY_SONIFICATION_RESPECTFUL that also depends on
+        // recent stream activity.
+        struct RoutingState {
+            audio_devices_t mAvailableOutputDevices;
+            audio_devices_t mAvailableInputDevices;
+            int mPhoneState;
+            audio_policy_forced_cfg_t mForceUse[AUDIO_POLICY_FORCE_USE_CNT];
+            bool mA2dpSuspended;
+            bool mA2dpOutput;
+            audio_io_handle_t mPrimaryOutput;
+            uint32_t mOutputsGeneration;
+        };
+        RoutingState mRoutingState;
+        uint32_t mRoutingCacheValid;                 // one bit per strategy in mRoutingCache[]
+        audio_devices_t mRoutingCache[NUM_STRATEGIES];
+        uint32_t mRoutingCacheHits;
+        uint32_t mRoutingCacheMisses;
+        // incremented when an output is added to or removed from mOutputs
+        uint32_t mOutputsGeneration;
+        // getOutputsForDevice() results for mOutputs at mOutputsForDeviceGeneration
+        KeyedVector<audio_devices_t, SortedVector<audio_io_handle_t> > mOutputsForDevice;
+        uint32_t mOutputsForDeviceGeneration;
+        uint32_t mOutputsCacheHits;
+        uint32_t mOutputsCacheMisses;
         float   mLastVoiceVolume;                                           // last voice volume value sent to audio HAL
 
         // Maximum CPU load allocated to audio effects in 0.1 MIPS (ARMv5TE, 0 WS memory) units
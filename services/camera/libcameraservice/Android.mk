@@ -52,6 +52,8 @@ LOCAL_SRC_FILES:=               \
     device3/StatusTracker.cpp \
     gui/RingBufferConsumer.cpp \
     utils/CameraTraces.cpp \
+    utils/CameraMetadataPool.cpp \
+    utils/CameraFrameTimeline.cpp \
 
 LOCAL_SHARED_LIBRARIES:= \
     libui \
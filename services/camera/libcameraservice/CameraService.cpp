@@ -141,6 +141,18 @@ void CameraService::onFirstRef()
             setUpVendorTags();
         }
 
+        // Cache the static characteristics of HAL3 devices so that the first
+        // open doesn't pay for them; a HAL1 shim would need to open the
+        // device, so its metadata is still built on first use
+        if (mModule->common.module_api_version >= CAMERA_MODULE_API_VERSION_2_0) {
+            for (int i = 0; i < mNumberOfCameras; i++) {
+                if (getDeviceVersion(i, /*facing*/NULL) > CAMERA_DEVICE_API_VERSION_2_1) {
+                    CameraMetadata info;
+                    getCameraCharacteristics(i, &info);
+                }
+            }
+        }
+
         CameraDeviceFactory::registerService(this);
     }
 }
@@ -173,6 +185,11 @@ void CameraService::onDeviceStatusChanged(int cameraId,
         return;
     }
 
+    {
+        Mutex::Autolock al(mCharacteristicsLock);
+        mCameraCharacteristics.removeItem(cameraId);
+    }
+
     /* don't do this in updateStatus
        since it is also called from connect and we could get into a deadlock */
     if (newStatus == CAMERA_DEVICE_STATUS_NOT_PRESENT) {
@@ -345,6 +362,15 @@ status_t CameraService::getCameraCharacteristics(int cameraId,
         return BAD_VALUE;
     }
 
+    {
+        Mutex::Autolock l(mCharacteristicsLock);
+        ssize_t index = mCameraCharacteristics.indexOfKey(cameraId);
+        if (index >= 0) {
+            *cameraInfo = mCameraCharacteristics[index];
+            return OK;
+        }
+    }
+
     int facing;
     status_t ret = OK;
     if (mModule->common.module_api_version < CAMERA_MODULE_API_VERSION_2_0 ||
@@ -369,9 +395,17 @@ status_t CameraService::getCameraCharacteristics(int cameraId,
          */
         struct camera_info info;
         ret = filterGetInfoErrorCode(mModule->get_camera_info(cameraId, &info));
+        if (ret != OK) {
+            return ret;
+        }
         *cameraInfo = info.static_camera_characteristics;
     }
 
+    if (ret == OK) {
+        Mutex::Autolock l(mCharacteristicsLock);
+        mCameraCharacteristics.add(cameraId, *cameraInfo);
+    }
+
     return ret;
 }
 
@@ -424,6 +424,15 @@ private:
      */
     KeyedVector<int, CameraParameters>    mShimParams;
 
+    /**
+     * A mapping of camera ids to the CameraCharacteristics metadata returned
+     * by getCameraCharacteristics, either static metadata of the HAL or that
+     * generated by the HAL1 shim. Entries are dropped when the device status
+     * changes.
+     */
+    Mutex                                 mCharacteristicsLock;
+    KeyedVector<int, CameraMetadata>      mCameraCharacteristics; // protected by mCharacteristicsLock
+
     /**
      * Initialize and cache the metadata used by the HAL1 shim for a given cameraId.
      *
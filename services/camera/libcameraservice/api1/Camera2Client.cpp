@@ -1449,6 +1449,12 @@ status_t Camera2Client::setParameters(const String8& params) {
 
     SharedParameters::Lock l(mParameters);
 
+    // The requests already reflect these parameters, no need to submit them again
+    if (l.mParameters.isUnchanged(params)) {
+        ALOGV("%s: Camera %d: Parameters unchanged", __FUNCTION__, mCameraId);
+        return OK;
+    }
+
     Parameters::focusMode_t focusModeBefore = l.mParameters.focusMode;
     res = l.mParameters.set(params);
     if (res != OK) return res;
@@ -17,6 +17,8 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "Camera2-BurstCapture"
 
+#include <unistd.h>
+
 #include <utils/Log.h>
 #include <utils/Trace.h>
 
@@ -74,34 +76,113 @@ bool BurstCapture::threadLoop() {
     return true;
 }
 
-CpuConsumer::LockedBuffer* BurstCapture::jpegEncode(
-    CpuConsumer::LockedBuffer *imgBuffer,
-    int /*quality*/)
+CpuConsumer::LockedBuffer* BurstCapture::newEncodedBuffer(
+    const CpuConsumer::LockedBuffer *imgBuffer)
 {
-    ALOGV("%s", __FUNCTION__);
-
     CpuConsumer::LockedBuffer *imgEncoded = new CpuConsumer::LockedBuffer;
     uint8_t *data = new uint8_t[ANDROID_JPEG_MAX_SIZE];
     imgEncoded->data = data;
     imgEncoded->width = imgBuffer->width;
     imgEncoded->height = imgBuffer->height;
     imgEncoded->stride = imgBuffer->stride;
+    return imgEncoded;
+}
 
-    Vector<CpuConsumer::LockedBuffer*> buffers;
-    buffers.push_back(imgBuffer);
-    buffers.push_back(imgEncoded);
+void BurstCapture::deleteEncodedBuffer(CpuConsumer::LockedBuffer *imgEncoded)
+{
+    if (imgEncoded == NULL) return;
+    delete [] imgEncoded->data;
+    delete imgEncoded;
+}
 
-    sp<JpegCompressor> jpeg = new JpegCompressor();
-    jpeg->start(buffers, 1);
+CpuConsumer::LockedBuffer* BurstCapture::jpegEncode(
+    CpuConsumer::LockedBuffer *imgBuffer,
+    int quality)
+{
+    ALOGV("%s", __FUNCTION__);
 
-    bool success = jpeg->waitForDone(10 * 1e9);
-    if(success) {
-        return buffers[1];
-    }
-    else {
-        ALOGE("%s: JPEG encode timed out", __FUNCTION__);
+    Vector<CpuConsumer::LockedBuffer*> imgBuffers;
+    Vector<CpuConsumer::LockedBuffer*> imgEncoded;
+    imgBuffers.push_back(imgBuffer);
+
+    status_t res = jpegEncodeBurst(imgBuffers, quality, &imgEncoded);
+    if (res != OK) {
         return NULL;  // TODO: maybe change function return value to status_t
     }
+    return imgEncoded[0];
+}
+
+status_t BurstCapture::jpegEncodeBurst(
+    const Vector<CpuConsumer::LockedBuffer*> &imgBuffers,
+    int /*quality*/,
+    Vector<CpuConsumer::LockedBuffer*> *imgEncoded)
+{
+    ATRACE_CALL();
+    ALOGV("%s: Encoding %zu frames", __FUNCTION__, imgBuffers.size());
+
+    // One compressor thread per core, with at most that many frames in
+    // flight; the caller is held here until the last one is done, which
+    // in turn keeps it from returning more buffers to the producer
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t maxEncoders = kMaxEncoders;
+    if (cores > 0 && (size_t)cores < maxEncoders) {
+        maxEncoders = cores;
+    }
+
+    const size_t count = imgBuffers.size();
+    imgEncoded->clear();
+    imgEncoded->insertAt(NULL, 0, count);
+
+    Vector<sp<JpegCompressor> > running;
+    Vector<size_t> runningIndex;
+    size_t next = 0;
+    status_t res = OK;
+
+    while (next < count || !running.isEmpty()) {
+        while (next < count && running.size() < maxEncoders && res == OK) {
+            CpuConsumer::LockedBuffer *encoded =
+                    newEncodedBuffer(imgBuffers[next]);
+            Vector<CpuConsumer::LockedBuffer*> buffers;
+            buffers.push_back(imgBuffers[next]);
+            buffers.push_back(encoded);
+
+            sp<JpegCompressor> jpeg = new JpegCompressor();
+            res = jpeg->start(buffers, 1);
+            if (res != OK) {
+                ALOGE("%s: Unable to start JPEG encode of frame %zu: %s (%d)",
+                        __FUNCTION__, next, strerror(-res), res);
+                deleteEncodedBuffer(encoded);
+                break;
+            }
+            imgEncoded->editItemAt(next) = encoded;
+            running.push_back(jpeg);
+            runningIndex.push_back(next);
+            next++;
+        }
+        if (res != OK) {
+            // Let the encodes in flight finish, don't queue any more
+            next = count;
+        }
+        if (running.isEmpty()) break;
+
+        // Frames are similar in cost, so the oldest one finishes first
+        if (!running[0]->waitForDone(kEncodeTimeout)) {
+            ALOGE("%s: JPEG encode of frame %zu timed out", __FUNCTION__,
+                    runningIndex[0]);
+            running[0]->cancel();
+            res = TIMED_OUT;
+        }
+        running.removeAt(0);
+        runningIndex.removeAt(0);
+    }
+
+    if (res != OK) {
+        for (size_t i = 0; i < count; i++) {
+            deleteEncodedBuffer(imgEncoded->itemAt(i));
+        }
+        imgEncoded->clear();
+    }
+    return res;
 }
 
 status_t BurstCapture::processFrameAvailable(sp<Camera2Client> &/*client*/) {
@@ -59,11 +59,25 @@ protected:
         CpuConsumer::LockedBuffer *imgBuffer,
         int quality);
 
+    // Encodes every buffer of imgBuffers, spread over up to one compressor
+    // thread per core. On success imgEncoded holds the JPEG of each input in
+    // the same order, to be freed with deleteEncodedBuffer().
+    status_t jpegEncodeBurst(
+        const Vector<CpuConsumer::LockedBuffer*> &imgBuffers,
+        int quality,
+        Vector<CpuConsumer::LockedBuffer*> *imgEncoded);
+
+    static CpuConsumer::LockedBuffer* newEncodedBuffer(
+        const CpuConsumer::LockedBuffer *imgBuffer);
+    static void deleteEncodedBuffer(CpuConsumer::LockedBuffer *imgEncoded);
+
     virtual status_t processFrameAvailable(sp<Camera2Client> &client);
 
 private:
     virtual bool threadLoop();
     static const nsecs_t kWaitDuration = 10000000; // 10 ms
+    static const nsecs_t kEncodeTimeout = 10000000000LL; // 10 s
+    static const size_t kMaxEncoders = 4;
 };
 
 } // namespace camera2
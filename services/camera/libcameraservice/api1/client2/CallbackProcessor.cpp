@@ -26,6 +26,11 @@
 #include "api1/Camera2Client.h"
 #include "api1/client2/CallbackProcessor.h"
 
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+#include <arm_neon.h>
+#define USE_NEON
+#endif
+
 #define ALIGN(x, mask) ( ((x) + (mask) - 1) & ~((mask) - 1) )
 
 namespace android {
@@ -38,7 +43,9 @@ CallbackProcessor::CallbackProcessor(sp<Camera2Client> client):
         mId(client->getCameraId()),
         mCallbackAvailable(false),
         mCallbackToApp(false),
-        mCallbackStreamId(NO_STREAM) {
+        mCallbackStreamId(NO_STREAM),
+        mCallbackHeapHead(0),
+        mCallbackHeapFree(kCallbackHeapCount) {
 }
 
 CallbackProcessor::~CallbackProcessor() {
@@ -201,6 +208,7 @@ status_t CallbackProcessor::deleteStream() {
         Mutex::Autolock l(mInputMutex);
 
         mCallbackHeap.clear();
+        mCallbackHeapPool.clear();
         mCallbackWindow.clear();
         mCallbackConsumer.clear();
 
@@ -372,18 +380,11 @@ status_t CallbackProcessor::processNewCallback(sp<Camera2Client> &client) {
         size_t currentBufferSize = (mCallbackHeap == 0) ?
                 0 : (mCallbackHeap->mHeap->getSize() / kCallbackHeapCount);
         if (bufferSize != currentBufferSize) {
-            mCallbackHeap.clear();
-            mCallbackHeap = new Camera2Heap(bufferSize, kCallbackHeapCount,
-                    "Camera2Client::CallbackHeap");
-            if (mCallbackHeap->mHeap->getSize() == 0) {
-                ALOGE("%s: Camera %d: Unable to allocate memory for callbacks",
-                        __FUNCTION__, mId);
+            res = switchCallbackHeapLocked(bufferSize);
+            if (res != OK) {
                 mCallbackConsumer->unlockBuffer(imgBuffer);
-                return INVALID_OPERATION;
+                return res;
             }
-
-            mCallbackHeapHead = 0;
-            mCallbackHeapFree = kCallbackHeapCount;
         }
 
         if (mCallbackHeapFree == 0) {
@@ -395,7 +396,7 @@ status_t CallbackProcessor::processNewCallback(sp<Camera2Client> &client) {
 
         heapIdx = mCallbackHeapHead;
 
-        mCallbackHeapHead = (mCallbackHeapHead + 1) & kCallbackHeapCount;
+        mCallbackHeapHead = (mCallbackHeapHead + 1) % kCallbackHeapCount;
         mCallbackHeapFree--;
 
         // TODO: Get rid of this copy by passing the gralloc queue all the way
@@ -449,6 +450,120 @@ status_t CallbackProcessor::processNewCallback(sp<Camera2Client> &client) {
     return OK;
 }
 
+status_t CallbackProcessor::switchCallbackHeapLocked(size_t bufferSize) {
+    // Keep the heap being replaced around, preview size toggles between a
+    // small set of sizes and reallocating ashmem for each switch is costly
+    if (mCallbackHeap != 0) {
+        if (mCallbackHeapPool.size() >= kCallbackHeapPoolSize) {
+            mCallbackHeapPool.removeAt(0);
+        }
+        mCallbackHeapPool.push_back(mCallbackHeap);
+        mCallbackHeap.clear();
+    }
+
+    for (size_t i = 0; i < mCallbackHeapPool.size(); i++) {
+        if (mCallbackHeapPool[i]->mBufSize == bufferSize) {
+            ALOGV("%s: Camera %d: Reusing callback heap of %zu byte buffers",
+                    __FUNCTION__, mId, bufferSize);
+            mCallbackHeap = mCallbackHeapPool[i];
+            mCallbackHeapPool.removeAt(i);
+            break;
+        }
+    }
+
+    if (mCallbackHeap == 0) {
+        mCallbackHeap = new Camera2Heap(bufferSize, kCallbackHeapCount,
+                "Camera2Client::CallbackHeap");
+        if (mCallbackHeap->mHeap->getSize() == 0) {
+            ALOGE("%s: Camera %d: Unable to allocate memory for callbacks",
+                    __FUNCTION__, mId);
+            mCallbackHeap.clear();
+            return INVALID_OPERATION;
+        }
+    }
+
+    mCallbackHeapHead = 0;
+    mCallbackHeapFree = kCallbackHeapCount;
+    return OK;
+}
+
+// Copies a plane of rows bytes wide, as a single copy when the strides match
+static void copyPlane(uint8_t *dst, size_t dstStride,
+        const uint8_t *src, size_t srcStride, size_t width, size_t rows) {
+    if (rows == 0) return;
+    if (dstStride == srcStride) {
+        memcpy(dst, src, dstStride * (rows - 1) + width);
+        return;
+    }
+    for (size_t row = 0; row < rows; row++) {
+        memcpy(dst, src, width);
+        src += srcStride;
+        dst += dstStride;
+    }
+}
+
+// Writes count pairs of (first, second) samples to dst, reading both
+// sources with a sample step of step bytes
+static void interleaveChromaRow(uint8_t *dst, const uint8_t *first,
+        const uint8_t *second, size_t step, size_t count) {
+    size_t col = 0;
+#ifdef USE_NEON
+    if (step == 1) {
+        for (; col + 16 <= count; col += 16) {
+            uint8x16x2_t pair;
+            pair.val[0] = vld1q_u8(first + col);
+            pair.val[1] = vld1q_u8(second + col);
+            vst2q_u8(dst + 2 * col, pair);
+        }
+    } else if (step == 2 && second + 1 == first) {
+        // Semiplanar source with the samples in the opposite order
+        for (; col + 16 <= count; col += 16) {
+            uint8x16x2_t pair = vld2q_u8(second + 2 * col);
+            uint8x16_t tmp = pair.val[0];
+            pair.val[0] = pair.val[1];
+            pair.val[1] = tmp;
+            vst2q_u8(dst + 2 * col, pair);
+        }
+    }
+#endif
+    first += col * step;
+    second += col * step;
+    dst += 2 * col;
+    for (; col < count; col++) {
+        *(dst++) = *first;
+        *(dst++) = *second;
+        first += step;
+        second += step;
+    }
+}
+
+// Splits count samples of first and second, read with a sample step of step
+// bytes, into the planar rows firstDst and secondDst
+static void deinterleaveChromaRow(uint8_t *firstDst, uint8_t *secondDst,
+        const uint8_t *first, const uint8_t *second, size_t step,
+        size_t count) {
+    size_t col = 0;
+#ifdef USE_NEON
+    if (step == 2 && (first + 1 == second || second + 1 == first)) {
+        const bool firstLow = first < second;
+        const uint8_t *base = firstLow ? first : second;
+        for (; col + 16 <= count; col += 16) {
+            uint8x16x2_t pair = vld2q_u8(base + 2 * col);
+            vst1q_u8(firstDst + col, pair.val[firstLow ? 0 : 1]);
+            vst1q_u8(secondDst + col, pair.val[firstLow ? 1 : 0]);
+        }
+    }
+#endif
+    first += col * step;
+    second += col * step;
+    for (; col < count; col++) {
+        firstDst[col] = *first;
+        secondDst[col] = *second;
+        first += step;
+        second += step;
+    }
+}
+
 status_t CallbackProcessor::convertFromFlexibleYuv(int32_t previewFormat,
         uint8_t *dst,
         const CpuConsumer::LockedBuffer &src,
@@ -463,22 +578,14 @@ status_t CallbackProcessor::convertFromFlexibleYuv(int32_t previewFormat,
     }
 
     // Copy Y plane, adjusting for stride
-    const uint8_t *ySrc = src.data;
-    uint8_t *yDst = dst;
-    for (size_t row = 0; row < src.height; row++) {
-        memcpy(yDst, ySrc, src.width);
-        ySrc += src.stride;
-        yDst += dstYStride;
-    }
+    copyPlane(dst, dstYStride, src.data, src.stride, src.width, src.height);
+    uint8_t *yDst = dst + dstYStride * src.height;
 
     // Copy/swizzle chroma planes, 4:2:0 subsampling
     const uint8_t *cbSrc = src.dataCb;
     const uint8_t *crSrc = src.dataCr;
     size_t chromaHeight = src.height / 2;
     size_t chromaWidth = src.width / 2;
-    ssize_t chromaGap = src.chromaStride -
-            (chromaWidth * src.chromaStep);
-    size_t dstChromaGap = dstCStride - chromaWidth;
 
     if (previewFormat == HAL_PIXEL_FORMAT_YCrCb_420_SP) {
         // Flexible YUV chroma to NV21 chroma
@@ -487,23 +594,16 @@ status_t CallbackProcessor::convertFromFlexibleYuv(int32_t previewFormat,
         if (cbSrc == crSrc + 1 && src.chromaStep == 2) {
             ALOGV("%s: Fast NV21->NV21", __FUNCTION__);
             // Source has semiplanar CrCb chroma layout, can copy by rows
-            for (size_t row = 0; row < chromaHeight; row++) {
-                memcpy(crcbDst, crSrc, src.width);
-                crcbDst += src.width;
-                crSrc += src.chromaStride;
-            }
+            copyPlane(crcbDst, src.width, crSrc, src.chromaStride,
+                    src.width, chromaHeight);
         } else {
             ALOGV("%s: Generic->NV21", __FUNCTION__);
-            // Generic copy, always works but not very efficient
             for (size_t row = 0; row < chromaHeight; row++) {
-                for (size_t col = 0; col < chromaWidth; col++) {
-                    *(crcbDst++) = *crSrc;
-                    *(crcbDst++) = *cbSrc;
-                    crSrc += src.chromaStep;
-                    cbSrc += src.chromaStep;
-                }
-                crSrc += chromaGap;
-                cbSrc += chromaGap;
+                interleaveChromaRow(crcbDst, crSrc, cbSrc, src.chromaStep,
+                        chromaWidth);
+                crcbDst += src.width;
+                crSrc += src.chromaStride;
+                cbSrc += src.chromaStride;
             }
         }
     } else {
@@ -515,30 +615,19 @@ status_t CallbackProcessor::convertFromFlexibleYuv(int32_t previewFormat,
         if (src.chromaStep == 1) {
             ALOGV("%s: Fast YV12->YV12", __FUNCTION__);
             // Source has planar chroma layout, can copy by row
-            for (size_t row = 0; row < chromaHeight; row++) {
-                memcpy(crDst, crSrc, chromaWidth);
-                crDst += dstCStride;
-                crSrc += src.chromaStride;
-            }
-            for (size_t row = 0; row < chromaHeight; row++) {
-                memcpy(cbDst, cbSrc, chromaWidth);
-                cbDst += dstCStride;
-                cbSrc += src.chromaStride;
-            }
+            copyPlane(crDst, dstCStride, crSrc, src.chromaStride,
+                    chromaWidth, chromaHeight);
+            copyPlane(cbDst, dstCStride, cbSrc, src.chromaStride,
+                    chromaWidth, chromaHeight);
         } else {
             ALOGV("%s: Generic->YV12", __FUNCTION__);
-            // Generic copy, always works but not very efficient
             for (size_t row = 0; row < chromaHeight; row++) {
-                for (size_t col = 0; col < chromaWidth; col++) {
-                    *(crDst++) = *crSrc;
-                    *(cbDst++) = *cbSrc;
-                    crSrc += src.chromaStep;
-                    cbSrc += src.chromaStep;
-                }
-                crSrc += chromaGap;
-                cbSrc += chromaGap;
-                crDst += dstChromaGap;
-                cbDst += dstChromaGap;
+                deinterleaveChromaRow(crDst, cbDst, crSrc, cbSrc,
+                        src.chromaStep, chromaWidth);
+                crSrc += src.chromaStride;
+                cbSrc += src.chromaStride;
+                crDst += dstCStride;
+                cbDst += dstCStride;
             }
         }
     }
@@ -77,12 +77,18 @@ class CallbackProcessor:
     sp<Camera2Heap>    mCallbackHeap;
     int mCallbackHeapId;
     size_t mCallbackHeapHead, mCallbackHeapFree;
+    // Heaps of the most recent other buffer sizes, see switchCallbackHeapLocked
+    static const size_t kCallbackHeapPoolSize = 2;
+    Vector<sp<Camera2Heap> > mCallbackHeapPool;
 
     virtual bool threadLoop();
 
     status_t processNewCallback(sp<Camera2Client> &client);
     // Used when shutting down
     status_t discardNewCallback();
+    // Make mCallbackHeap hold buffers of bufferSize bytes, from the pool if
+    // possible
+    status_t switchCallbackHeapLocked(size_t bufferSize);
 
     // Convert from flexible YUV to NV21 or YV12
     status_t convertFromFlexibleYuv(int32_t previewFormat,
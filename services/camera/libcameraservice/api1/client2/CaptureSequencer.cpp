@@ -51,6 +51,8 @@ CaptureSequencer::CaptureSequencer(wp<Camera2Client> client):
         mCaptureId(Camera2Client::kCaptureRequestIdStart),
         mMsgType(0) {
     ALOGV("%s", __FUNCTION__);
+    // Parameters::updateRequest() updates dozens of tags for each capture
+    mCaptureRequest.setIndexed(true);
 }
 
 CaptureSequencer::~CaptureSequencer() {
@@ -43,7 +43,9 @@ JpegProcessor::JpegProcessor(
         mSequencer(sequencer),
         mId(client->getCameraId()),
         mCaptureAvailable(false),
-        mCaptureStreamId(NO_STREAM) {
+        mCaptureStreamId(NO_STREAM),
+        mCaptureHeapSize(0),
+        mNextCaptureHeap(0) {
 }
 
 JpegProcessor::~JpegProcessor() {
@@ -92,24 +94,28 @@ status_t JpegProcessor::updateStream(const Parameters &params) {
     }
 
     // Since ashmem heaps are rounded up to page size, don't reallocate if
-    // the capture heap isn't exactly the same size as the required JPEG buffer
+    // the capture heaps aren't exactly the same size as the required JPEG buffer
     const size_t HEAP_SLACK_FACTOR = 2;
-    if (mCaptureHeap == 0 ||
-            (mCaptureHeap->getSize() < static_cast<size_t>(maxJpegSize)) ||
-            (mCaptureHeap->getSize() >
+    if (mCaptureHeaps.isEmpty() ||
+            (mCaptureHeaps[0]->getSize() < static_cast<size_t>(maxJpegSize)) ||
+            (mCaptureHeaps[0]->getSize() >
                     static_cast<size_t>(maxJpegSize) * HEAP_SLACK_FACTOR) ) {
-        // Create memory for API consumption
-        mCaptureHeap.clear();
-        mCaptureHeap =
+        // Create memory for API consumption; more heaps are added on demand
+        // by processNewCapture() while the client holds on to the earlier ones
+        mCaptureHeaps.clear();
+        mNextCaptureHeap = 0;
+        sp<MemoryHeapBase> heap =
                 new MemoryHeapBase(maxJpegSize, 0, "Camera2Client::CaptureHeap");
-        if (mCaptureHeap->getSize() == 0) {
+        if (heap->getSize() == 0) {
             ALOGE("%s: Camera %d: Unable to allocate memory for capture",
                     __FUNCTION__, mId);
             return NO_MEMORY;
         }
+        mCaptureHeaps.push_back(heap);
+        mCaptureHeapSize = maxJpegSize;
     }
-    ALOGV("%s: Camera %d: JPEG capture heap now %d bytes; requested %d bytes",
-            __FUNCTION__, mId, mCaptureHeap->getSize(), maxJpegSize);
+    ALOGV("%s: Camera %d: JPEG capture heaps now %d bytes; requested %d bytes",
+            __FUNCTION__, mId, mCaptureHeaps[0]->getSize(), maxJpegSize);
 
     if (mCaptureStreamId != NO_STREAM) {
         // Check if stream parameters have to change
@@ -171,7 +177,7 @@ status_t JpegProcessor::deleteStream() {
 
         device->deleteStream(mCaptureStreamId);
 
-        mCaptureHeap.clear();
+        mCaptureHeaps.clear();
         mCaptureWindow.clear();
         mCaptureConsumer.clear();
 
@@ -250,7 +256,12 @@ status_t JpegProcessor::processNewCapture() {
         if (jpegSize == 0) { // failed to find size, default to whole buffer
             jpegSize = imgBuffer.width;
         }
-        size_t heapSize = mCaptureHeap->getSize();
+        sp<MemoryHeapBase> heap = getCaptureHeapLocked();
+        if (heap == 0) {
+            mCaptureConsumer->unlockBuffer(imgBuffer);
+            return NO_MEMORY;
+        }
+        size_t heapSize = heap->getSize();
         if (jpegSize > heapSize) {
             ALOGW("%s: JPEG image is larger than expected, truncating "
                     "(got %zu, expected at most %zu bytes)",
@@ -258,10 +269,10 @@ status_t JpegProcessor::processNewCapture() {
             jpegSize = heapSize;
         }
 
-        // TODO: Optimize this to avoid memcopy
-        captureBuffer = new MemoryBase(mCaptureHeap, 0, jpegSize);
-        void* captureMemory = mCaptureHeap->getBase();
-        memcpy(captureMemory, imgBuffer.data, jpegSize);
+        // The BLOB buffer goes back to the HAL, so the image is copied once
+        // into a heap the client can map; the heap itself is never copied
+        captureBuffer = new MemoryBase(heap, 0, jpegSize);
+        memcpy(heap->getBase(), imgBuffer.data, jpegSize);
 
         mCaptureConsumer->unlockBuffer(imgBuffer);
     }
@@ -274,6 +285,42 @@ status_t JpegProcessor::processNewCapture() {
     return OK;
 }
 
+sp<MemoryHeapBase> JpegProcessor::getCaptureHeapLocked() {
+    // A heap is free once the ring holds the only reference to it, that is
+    // when neither a MemoryBase of an earlier capture nor a client mapping of
+    // it is alive anymore
+    size_t count = mCaptureHeaps.size();
+    for (size_t i = 0; i < count; i++) {
+        size_t index = (mNextCaptureHeap + i) % count;
+        if (mCaptureHeaps[index]->getStrongCount() == 1) {
+            mNextCaptureHeap = (index + 1) % count;
+            return mCaptureHeaps[index];
+        }
+    }
+
+    if (count < kMaxCaptureHeaps) {
+        sp<MemoryHeapBase> heap = new MemoryHeapBase(mCaptureHeapSize, 0,
+                "Camera2Client::CaptureHeap");
+        if (heap->getSize() != 0) {
+            ALOGV("%s: Camera %d: Adding capture heap %zu", __FUNCTION__, mId,
+                    count);
+            mCaptureHeaps.push_back(heap);
+            mNextCaptureHeap = 0;
+            return heap;
+        }
+        ALOGW("%s: Camera %d: Unable to allocate another capture heap",
+                __FUNCTION__, mId);
+        if (count == 0) return NULL;
+    }
+
+    // All heaps are in use, overwrite the least recently filled one
+    ALOGW("%s: Camera %d: All %zu capture heaps are in use, reusing one",
+            __FUNCTION__, mId, count);
+    size_t index = mNextCaptureHeap;
+    mNextCaptureHeap = (index + 1) % count;
+    return mCaptureHeaps[index];
+}
+
 /*
  * JPEG FILE FORMAT OVERVIEW.
  * http://www.jpeg.org/public/jfif.pdf
@@ -71,11 +71,18 @@ class JpegProcessor:
     int mCaptureStreamId;
     sp<CpuConsumer>    mCaptureConsumer;
     sp<ANativeWindow>  mCaptureWindow;
-    sp<MemoryHeapBase>    mCaptureHeap;
+
+    // Ring of capture heaps, so that a burst does not overwrite a JPEG the
+    // client is still reading; see getCaptureHeapLocked()
+    static const size_t kMaxCaptureHeaps = 4;
+    Vector<sp<MemoryHeapBase> > mCaptureHeaps;
+    size_t mCaptureHeapSize;
+    size_t mNextCaptureHeap;
 
     virtual bool threadLoop();
 
     status_t processNewCapture();
+    sp<MemoryHeapBase> getCaptureHeapLocked();
     size_t findJpegSize(uint8_t* jpegBuffer, size_t maxSize);
 
 };
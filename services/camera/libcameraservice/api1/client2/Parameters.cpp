@@ -1149,9 +1149,25 @@ camera_metadata_ro_entry_t Parameters::staticInfo(uint32_t tag,
     return entry;
 }
 
+bool Parameters::isUnchanged(const String8& paramString) const {
+    // An autofocus sweep in a continuous mode runs in FOCUS_MODE_AUTO, which
+    // set() reverts to the mode in the string; see shadowFocusMode.
+    if (shadowFocusMode != FOCUS_MODE_INVALID) return false;
+
+    // set() stores the string it validated, overrides included, so validating
+    // the same string again gives the same result.
+    return paramString == paramsFlattened;
+}
+
 status_t Parameters::set(const String8& paramString) {
     status_t res;
 
+    // Apps commonly set the parameters back as they got them
+    if (isUnchanged(paramString)) {
+        ALOGV("%s: Parameters unchanged", __FUNCTION__);
+        return OK;
+    }
+
     CameraParameters2 newParams(paramString);
 
     // TODO: Currently ignoring any changes to supposedly read-only parameters
@@ -252,6 +252,10 @@ struct Parameters {
     // Validate and update camera parameters based on new settings
     status_t set(const String8 &paramString);
 
+    // Whether set(paramString) would leave the parameters as they are: the string
+    // is the one get() returns, and no internal override of it is in effect.
+    bool isUnchanged(const String8 &paramString) const;
+
     // Retrieve the current settings
     String8 get() const;
 
@@ -52,6 +52,9 @@ StreamingProcessor::StreamingProcessor(sp<Camera2Client> client):
         mRecordingHeapCount(kDefaultRecordingHeapCount),
         mRecordingHeapFree(kDefaultRecordingHeapCount)
 {
+    // Parameters::updateRequest() updates dozens of tags on each change
+    mPreviewRequest.setIndexed(true);
+    mRecordingRequest.setIndexed(true);
 }
 
 StreamingProcessor::~StreamingProcessor() {
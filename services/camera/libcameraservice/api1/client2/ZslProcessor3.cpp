@@ -88,6 +88,7 @@ ZslProcessor3::ZslProcessor3(
 
     mZslQueue.insertAt(0, mBufferQueueDepth);
     mFrameList.insertAt(0, mFrameListDepth);
+    mFrameTimestamps.insertAt(-1, 0, mFrameListDepth);
     sp<CaptureSequencer> captureSequencer = mSequencer.promote();
     if (captureSequencer != 0) captureSequencer->setZslProcessor(this);
 }
@@ -123,7 +124,18 @@ void ZslProcessor3::onResultAvailable(const CaptureResult &result) {
     // Corresponding buffer has been cleared. No need to push into mFrameList
     if (timestamp <= mLatestClearedBufferTimestamp) return;
 
+    // Drop the frame being overwritten from the candidate index
+    nsecs_t evictedTimestamp = mFrameTimestamps[mFrameListHead];
+    ssize_t evicted = mCandidateFrames.indexOfKey(evictedTimestamp);
+    if (evicted >= 0 && mCandidateFrames.valueAt(evicted) == mFrameListHead) {
+        mCandidateFrames.removeItemsAt(evicted);
+    }
+
     mFrameList.editItemAt(mFrameListHead) = result.mMetadata;
+    mFrameTimestamps.editItemAt(mFrameListHead) = timestamp;
+    if (isCandidateFrameLocked(result.mMetadata)) {
+        mCandidateFrames.add(timestamp, mFrameListHead);
+    }
     mFrameListHead = (mFrameListHead + 1) % mFrameListDepth;
 }
 
@@ -451,6 +463,9 @@ void ZslProcessor3::clearZslResultQueueLocked() {
     mFrameList.clear();
     mFrameListHead = 0;
     mFrameList.insertAt(0, mFrameListDepth);
+    mFrameTimestamps.clear();
+    mFrameTimestamps.insertAt(-1, 0, mFrameListDepth);
+    mCandidateFrames.clear();
 }
 
 void ZslProcessor3::dump(int fd, const Vector<String16>& /*args*/) const {
@@ -521,88 +536,83 @@ bool ZslProcessor3::isFixedFocusMode(uint8_t afMode) const {
     }
 }
 
-nsecs_t ZslProcessor3::getCandidateTimestampLocked(size_t* metadataIdx) const {
+bool ZslProcessor3::isCandidateFrameLocked(const CameraMetadata &frame) const {
     /**
-     * Find the smallest timestamp we know about so far
-     * - ensure that aeState is either converged or locked
+     * A frame can be reprocessed if its aeState is either converged or
+     * locked, and it is in focus on devices with a focuser
      */
+    camera_metadata_ro_entry_t entry;
+    entry = frame.find(ANDROID_CONTROL_AE_STATE);
+    if (entry.count == 0) {
+        /**
+         * This is most likely a HAL bug. The aeState field is
+         * mandatory, so it should always be in a metadata packet.
+         */
+        ALOGW("%s: ZSL queue frame has no AE state field!",
+                __FUNCTION__);
+        return false;
+    }
+    if (entry.data.u8[0] != ANDROID_CONTROL_AE_STATE_CONVERGED &&
+            entry.data.u8[0] != ANDROID_CONTROL_AE_STATE_LOCKED) {
+        ALOGVV("%s: ZSL queue frame AE state is %d, need "
+               "full capture",  __FUNCTION__, entry.data.u8[0]);
+        return false;
+    }
 
-    size_t idx = 0;
-    nsecs_t minTimestamp = -1;
+    entry = frame.find(ANDROID_CONTROL_AF_MODE);
+    if (entry.count == 0) {
+        ALOGW("%s: ZSL queue frame has no AF mode field!",
+                __FUNCTION__);
+        return false;
+    }
+    uint8_t afMode = entry.data.u8[0];
+    if (afMode == ANDROID_CONTROL_AF_MODE_OFF) {
+        // Skip all the ZSL buffer for manual AF mode, as we don't really
+        // know the af state.
+        return false;
+    }
+
+    // Check AF state if device has focuser and focus mode isn't fixed
+    if (mHasFocuser && !isFixedFocusMode(afMode)) {
+        // Make sure the candidate frame has good focus.
+        entry = frame.find(ANDROID_CONTROL_AF_STATE);
+        if (entry.count == 0) {
+            ALOGW("%s: ZSL queue frame has no AF state field!",
+                    __FUNCTION__);
+            return false;
+        }
+        uint8_t afState = entry.data.u8[0];
+        if (afState != ANDROID_CONTROL_AF_STATE_PASSIVE_FOCUSED &&
+                afState != ANDROID_CONTROL_AF_STATE_FOCUSED_LOCKED &&
+                afState != ANDROID_CONTROL_AF_STATE_NOT_FOCUSED_LOCKED) {
+            ALOGW("%s: ZSL queue frame AF state is %d is not good for capture, skip it",
+                    __FUNCTION__, afState);
+            return false;
+        }
+    }
 
-    size_t emptyCount = mFrameList.size();
+    return true;
+}
 
-    for (size_t j = 0; j < mFrameList.size(); j++) {
-        const CameraMetadata &frame = mFrameList[j];
-        if (!frame.isEmpty()) {
+nsecs_t ZslProcessor3::getCandidateTimestampLocked(size_t* metadataIdx) const {
+    /**
+     * Find the smallest timestamp we know about so far among the frames
+     * that passed isCandidateFrameLocked() when they arrived; the index is
+     * sorted by timestamp, so that is its first entry
+     */
 
-            emptyCount--;
+    size_t idx = 0;
+    nsecs_t minTimestamp = -1;
+    size_t emptyCount = 0;
 
-            camera_metadata_ro_entry_t entry;
-            entry = frame.find(ANDROID_SENSOR_TIMESTAMP);
-            if (entry.count == 0) {
-                ALOGE("%s: Can't find timestamp in frame!",
-                        __FUNCTION__);
-                continue;
-            }
-            nsecs_t frameTimestamp = entry.data.i64[0];
-            if (minTimestamp > frameTimestamp || minTimestamp == -1) {
-
-                entry = frame.find(ANDROID_CONTROL_AE_STATE);
-
-                if (entry.count == 0) {
-                    /**
-                     * This is most likely a HAL bug. The aeState field is
-                     * mandatory, so it should always be in a metadata packet.
-                     */
-                    ALOGW("%s: ZSL queue frame has no AE state field!",
-                            __FUNCTION__);
-                    continue;
-                }
-                if (entry.data.u8[0] != ANDROID_CONTROL_AE_STATE_CONVERGED &&
-                        entry.data.u8[0] != ANDROID_CONTROL_AE_STATE_LOCKED) {
-                    ALOGVV("%s: ZSL queue frame AE state is %d, need "
-                           "full capture",  __FUNCTION__, entry.data.u8[0]);
-                    continue;
-                }
-
-                entry = frame.find(ANDROID_CONTROL_AF_MODE);
-                if (entry.count == 0) {
-                    ALOGW("%s: ZSL queue frame has no AF mode field!",
-                            __FUNCTION__);
-                    continue;
-                }
-                uint8_t afMode = entry.data.u8[0];
-                if (afMode == ANDROID_CONTROL_AF_MODE_OFF) {
-                    // Skip all the ZSL buffer for manual AF mode, as we don't really
-                    // know the af state.
-                    continue;
-                }
-
-                // Check AF state if device has focuser and focus mode isn't fixed
-                if (mHasFocuser && !isFixedFocusMode(afMode)) {
-                    // Make sure the candidate frame has good focus.
-                    entry = frame.find(ANDROID_CONTROL_AF_STATE);
-                    if (entry.count == 0) {
-                        ALOGW("%s: ZSL queue frame has no AF state field!",
-                                __FUNCTION__);
-                        continue;
-                    }
-                    uint8_t afState = entry.data.u8[0];
-                    if (afState != ANDROID_CONTROL_AF_STATE_PASSIVE_FOCUSED &&
-                            afState != ANDROID_CONTROL_AF_STATE_FOCUSED_LOCKED &&
-                            afState != ANDROID_CONTROL_AF_STATE_NOT_FOCUSED_LOCKED) {
-                        ALOGW("%s: ZSL queue frame AF state is %d is not good for capture, skip it",
-                                __FUNCTION__, afState);
-                        continue;
-                    }
-                }
-
-                minTimestamp = frameTimestamp;
-                idx = j;
-            }
+    if (!mCandidateFrames.isEmpty()) {
+        minTimestamp = mCandidateFrames.keyAt(0);
+        idx = mCandidateFrames.valueAt(0);
+    }
 
-            ALOGVV("%s: Saw timestamp %" PRId64, __FUNCTION__, frameTimestamp);
+    for (size_t j = 0; j < mFrameTimestamps.size(); j++) {
+        if (mFrameTimestamps[j] == -1) {
+            emptyCount++;
         }
     }
 
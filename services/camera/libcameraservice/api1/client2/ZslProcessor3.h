@@ -20,6 +20,7 @@
 #include <utils/Thread.h>
 #include <utils/String16.h>
 #include <utils/Vector.h>
+#include <utils/KeyedVector.h>
 #include <utils/Mutex.h>
 #include <utils/Condition.h>
 #include <gui/BufferItemConsumer.h>
@@ -113,6 +114,10 @@ class ZslProcessor3 :
     size_t mFrameListDepth;
     Vector<CameraMetadata> mFrameList;
     size_t mFrameListHead;
+    // Sensor timestamp of each mFrameList entry, -1 if empty
+    Vector<nsecs_t> mFrameTimestamps;
+    // Timestamp to mFrameList index of the frames good for reprocessing
+    KeyedVector<nsecs_t, size_t> mCandidateFrames;
 
     ZslPair mNextPair;
 
@@ -132,6 +137,8 @@ class ZslProcessor3 :
 
     void dumpZslQueue(int id) const;
 
+    bool isCandidateFrameLocked(const CameraMetadata &frame) const;
+
     nsecs_t getCandidateTimestampLocked(size_t* metadataIdx) const;
 
     bool isFixedFocusMode(uint8_t afMode) const;
@@ -27,4 +27,10 @@ CameraDeviceBase::~CameraDeviceBase() {
 CameraDeviceBase::NotificationListener::~NotificationListener() {
 }
 
+void CameraDeviceBase::releaseResultMetadata(camera_metadata_t *buffer) {
+    if (buffer != NULL) {
+        free_camera_metadata(buffer);
+    }
+}
+
 } // namespace android
@@ -226,6 +226,13 @@ class CameraDeviceBase : public virtual RefBase {
      */
     virtual status_t getNextResult(CaptureResult *frame) = 0;
 
+    /**
+     * Give back the metadata buffer of a capture result obtained from
+     * getNextResult, once the caller is done with it, so that the device can
+     * reuse it for later results. The default implementation frees it.
+     */
+    virtual void releaseResultMetadata(camera_metadata_t *buffer);
+
     /**
      * Trigger auto-focus. The latest ID used in a trigger autofocus or cancel
      * autofocus call will be returned by the HAL in all subsequent AF
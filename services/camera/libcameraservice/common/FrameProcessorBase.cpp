@@ -144,8 +144,14 @@ void FrameProcessorBase::processNewFrames(const sp<CameraDeviceBase> &device) {
         }
 
         if (!result.mMetadata.isEmpty()) {
-            Mutex::Autolock al(mLastFrameMutex);
-            mLastFrame.acquire(result.mMetadata);
+            camera_metadata_t *lastFrame;
+            {
+                Mutex::Autolock al(mLastFrameMutex);
+                lastFrame = mLastFrame.release();
+                mLastFrame.acquire(result.mMetadata);
+            }
+            // Listeners are done with the frame before last, the device can reuse it
+            device->releaseResultMetadata(lastFrame);
         }
     }
     if (res != NOT_ENOUGH_DATA) {
@@ -123,6 +123,8 @@ status_t Camera2Device::initialize(camera_module_t *module)
     }
 
     mDeviceInfo = info.static_camera_characteristics;
+    // Looked up all the time by the clients, and never changes
+    mDeviceInfo.setIndexed(true);
     mHal2Device = device;
     mDeviceVersion = device->common.version;
 
@@ -39,6 +39,7 @@
 
 #include <inttypes.h>
 
+#include <cutils/atomic.h>
 #include <utils/Log.h>
 #include <utils/Trace.h>
 #include <utils/Timers.h>
@@ -63,7 +64,9 @@ Camera3Device::Camera3Device(int id):
         mNumPartialResults(1),
         mNextResultFrameNumber(0),
         mNextShutterFrameNumber(0),
-        mListener(NULL)
+        mListener(NULL),
+        mInFlightCount(0),
+        mFrameTimeline(new CameraFrameTimeline())
 {
     ATRACE_CALL();
     camera3_callback_ops::notify = &sNotify;
@@ -165,7 +168,7 @@ status_t Camera3Device::initialize(camera_module_t *module)
 
     /** Start up request queue thread */
 
-    mRequestThread = new RequestThread(this, mStatusTracker, device);
+    mRequestThread = new RequestThread(this, mStatusTracker, device, mFrameTimeline);
     res = mRequestThread->run(String8::format("C3Dev-%d-ReqQueue", mId).string());
     if (res != OK) {
         SET_ERR_L("Unable to start request queue thread: %s (%d)",
@@ -179,6 +182,8 @@ status_t Camera3Device::initialize(camera_module_t *module)
 
     mDeviceVersion = device->common.version;
     mDeviceInfo = info.static_camera_characteristics;
+    // Looked up all the time by the clients, and never changes
+    mDeviceInfo.setIndexed(true);
     mHal3Device = device;
     mStatus = STATUS_UNCONFIGURED;
     mNextStreamId = 0;
@@ -419,20 +424,42 @@ status_t Camera3Device::dump(int fd, const Vector<String16> &args) {
         mOutputStreams[i]->dump(fd,args);
     }
 
-    lines = String8("    In-flight requests:\n");
-    if (mInFlightMap.size() == 0) {
+    lines = String8("    Last stream configuration timing:\n");
+    if (mConfigureTimings.configureCount == 0) {
         lines.append("      None\n");
     } else {
-        for (size_t i = 0; i < mInFlightMap.size(); i++) {
-            InFlightRequest r = mInFlightMap.valueAt(i);
-            lines.appendFormat("      Frame %d |  Timestamp: %" PRId64 ", metadata"
-                    " arrived: %s, buffers left: %d\n", mInFlightMap.keyAt(i),
-                    r.captureTimestamp, r.haveResultMetadata ? "true" : "false",
-                    r.numBuffersLeft);
-        }
+        const ConfigureTimings &t = mConfigureTimings;
+        lines.appendFormat("      Configuration %u, %zu streams: total %.2f ms\n",
+                t.configureCount, t.streamCount, t.totalDuration / 1e6);
+        lines.appendFormat("      Start %.2f ms, HAL configure_streams %.2f ms, "
+                "finish (buffer registration) %.2f ms, teardown %.2f ms\n",
+                t.startDuration / 1e6, t.halDuration / 1e6,
+                t.finishDuration / 1e6, t.teardownDuration / 1e6);
+    }
+    write(fd, lines.string(), lines.size());
+
+    lines = String8("    In-flight requests:\n");
+    bool haveInFlight = false;
+    for (size_t i = 0; i < kInFlightCapacity; i++) {
+        InFlightSlot &slot = mInFlightSlots[i];
+        Mutex::Autolock l(slot.lock);
+        if (!slot.inUse) continue;
+        const InFlightRequest &r = slot.request;
+        lines.appendFormat("      Frame %d |  Timestamp: %" PRId64 ", metadata"
+                " arrived: %s, buffers left: %d\n", slot.frameNumber,
+                r.captureTimestamp, r.haveResultMetadata ? "true" : "false",
+                r.numBuffersLeft);
+        haveInFlight = true;
+    }
+    if (!haveInFlight) {
+        lines.append("      None\n");
     }
     write(fd, lines.string(), lines.size());
 
+    lines = String8("    Frame timeline:\n");
+    write(fd, lines.string(), lines.size());
+    mFrameTimeline->dump(fd, /*indentation*/6);
+
     {
         lines = String8("    Last request sent:\n");
         write(fd, lines.string(), lines.size());
@@ -1212,6 +1239,10 @@ status_t Camera3Device::getNextResult(CaptureResult *frame) {
     return OK;
 }
 
+void Camera3Device::releaseResultMetadata(camera_metadata_t *buffer) {
+    mResultMetadataPool.release(buffer);
+}
+
 status_t Camera3Device::triggerAutofocus(uint32_t id) {
     ATRACE_CALL();
     Mutex::Autolock il(mInterfaceLock);
@@ -1438,6 +1469,8 @@ status_t Camera3Device::configureStreamsLocked() {
         return OK;
     }
 
+    nsecs_t configureStart = systemTime();
+
     // Workaround for device HALv3.2 or older spec bug - zero streams requires
     // adding a dummy stream instead.
     // TODO: Bug: 17321404 for fixing the HAL spec and removing this workaround.
@@ -1490,9 +1523,11 @@ status_t Camera3Device::configureStreamsLocked() {
 
     // Do the HAL configuration; will potentially touch stream
     // max_buffers, usage, priv fields.
+    nsecs_t halStart = systemTime();
     ATRACE_BEGIN("camera3->configure_streams");
     res = mHal3Device->ops->configure_streams(mHal3Device, &config);
     ATRACE_END();
+    nsecs_t finishStart = systemTime();
 
     if (res == BAD_VALUE) {
         // HAL rejected this set of streams as unsupported, clean up config
@@ -1578,7 +1613,17 @@ status_t Camera3Device::configureStreamsLocked() {
     ALOGV("%s: Camera %d: Stream configuration complete", __FUNCTION__, mId);
 
     // tear down the deleted streams after configure streams.
+    nsecs_t teardownStart = systemTime();
     mDeletedStreams.clear();
+    nsecs_t configureEnd = systemTime();
+
+    mConfigureTimings.startDuration = halStart - configureStart;
+    mConfigureTimings.halDuration = finishStart - halStart;
+    mConfigureTimings.finishDuration = teardownStart - finishStart;
+    mConfigureTimings.teardownDuration = configureEnd - teardownStart;
+    mConfigureTimings.totalDuration = configureEnd - configureStart;
+    mConfigureTimings.streamCount = config.num_streams;
+    mConfigureTimings.configureCount++;
 
     return OK;
 }
@@ -1701,15 +1746,29 @@ void Camera3Device::setErrorStateLockedV(const char *fmt, va_list args) {
 status_t Camera3Device::registerInFlight(uint32_t frameNumber,
         int32_t numBuffers, CaptureResultExtras resultExtras, bool hasInput) {
     ATRACE_CALL();
-    Mutex::Autolock l(mInFlightLock);
+    InFlightSlot &slot = inFlightSlot(frameNumber);
+    Mutex::Autolock l(slot.lock);
 
-    ssize_t res;
-    res = mInFlightMap.add(frameNumber, InFlightRequest(numBuffers, resultExtras, hasInput));
-    if (res < 0) return res;
+    if (slot.inUse) {
+        ALOGE("%s: Camera %d: Frame %d still in flight, %d frames later",
+                __FUNCTION__, mId, slot.frameNumber, frameNumber - slot.frameNumber);
+        return NO_MEMORY;
+    }
+    slot.inUse = true;
+    slot.frameNumber = frameNumber;
+    slot.request = InFlightRequest(numBuffers, resultExtras, hasInput);
+    android_atomic_inc(&mInFlightCount);
 
     return OK;
 }
 
+void Camera3Device::removeInFlightLocked(InFlightSlot &slot) {
+    slot.inUse = false;
+    // Drop any collected partial metadata now rather than on reuse
+    slot.request = InFlightRequest();
+    android_atomic_dec(&mInFlightCount);
+}
+
 /**
  * Check if all 3A fields are ready, and send off a partial 3A-only result
  * to the output frame queue
@@ -1772,13 +1831,13 @@ bool Camera3Device::processPartial3AResult(
 
     Mutex::Autolock l(mOutputLock);
 
-    CaptureResult captureResult;
-    captureResult.mResultExtras = resultExtras;
-    captureResult.mMetadata = CameraMetadata(kMinimal3AResultEntries, /*dataCapacity*/ 0);
     // TODO: change this to sp<CaptureResult>. This will need other changes, including,
     // but not limited to CameraDeviceBase::getNextResult
     CaptureResult& min3AResult =
-            *mResultQueue.insert(mResultQueue.end(), captureResult);
+            *mResultQueue.insert(mResultQueue.end(), CaptureResult());
+    min3AResult.mResultExtras = resultExtras;
+    min3AResult.mMetadata.acquire(
+            mResultMetadataPool.obtain(kMinimal3AResultEntries, /*dataCapacity*/ 0));
 
     if (!insert3AResult(min3AResult.mMetadata, ANDROID_REQUEST_FRAME_COUNT,
             // TODO: This is problematic casting. Need to fix CameraMetadata.
@@ -1920,14 +1979,14 @@ void Camera3Device::processCaptureResult(const camera3_capture_result *result) {
     // all result data has been received.
     nsecs_t timestamp = 0;
     {
-        Mutex::Autolock l(mInFlightLock);
-        ssize_t idx = mInFlightMap.indexOfKey(frameNumber);
-        if (idx == NAME_NOT_FOUND) {
+        InFlightSlot &slot = inFlightSlot(frameNumber);
+        Mutex::Autolock l(slot.lock);
+        if (!slot.inUse || slot.frameNumber != frameNumber) {
             SET_ERR("Unknown frame number for capture result: %d",
                     frameNumber);
             return;
         }
-        InFlightRequest &request = mInFlightMap.editValueAt(idx);
+        InFlightRequest &request = slot.request;
         ALOGVV("%s: got InFlightRequest requestId = %" PRId32 ", frameNumber = %" PRId64
                 ", burstId = %" PRId32,
                 __FUNCTION__, request.resultExtras.requestId, request.resultExtras.frameNumber,
@@ -2031,17 +2090,23 @@ void Camera3Device::processCaptureResult(const camera3_capture_result *result) {
         if ((request.requestStatus != OK) ||
                 (request.haveResultMetadata && request.numBuffersLeft == 0)) {
             ATRACE_ASYNC_END("frame capture", frameNumber);
-            mInFlightMap.removeItemsAt(idx, 1);
+            removeInFlightLocked(slot);
         }
 
         // Sanity check - if we have too many in-flight frames, something has
         // likely gone wrong
-        if (mInFlightMap.size() > kInFlightWarnLimit) {
-            CLOGE("In-flight list too large: %zu", mInFlightMap.size());
+        int32_t inFlightCount = android_atomic_acquire_load(&mInFlightCount);
+        if (inFlightCount > (int32_t) kInFlightWarnLimit) {
+            CLOGE("In-flight list too large: %d", inFlightCount);
         }
 
     }
 
+    if (result->result != NULL) {
+        mFrameTimeline->record(isPartialResult ? CameraFrameTimeline::PARTIAL_RESULT :
+                CameraFrameTimeline::RESULT, frameNumber);
+    }
+
     // Process the result metadata, if provided
     bool gotResult = false;
     if (result->result != NULL && !isPartialResult) {
@@ -2058,9 +2123,22 @@ void Camera3Device::processCaptureResult(const camera3_capture_result *result) {
         }
         mNextResultFrameNumber = frameNumber + 1;
 
+        // Room for the result, the frame count and the partials, so that
+        // filling in the pooled buffer does not reallocate it
+        size_t entryCapacity = get_camera_metadata_entry_count(result->result) + 1;
+        size_t dataCapacity = get_camera_metadata_data_count(result->result);
+        if (mUsePartialResult && !collectedPartialResult.isEmpty()) {
+            const camera_metadata_t *partial = collectedPartialResult.getAndLock();
+            entryCapacity += get_camera_metadata_entry_count(partial);
+            dataCapacity += get_camera_metadata_data_count(partial);
+            collectedPartialResult.unlock(partial);
+        }
+
         CaptureResult captureResult;
         captureResult.mResultExtras = resultExtras;
-        captureResult.mMetadata = result->result;
+        captureResult.mMetadata.acquire(
+                mResultMetadataPool.obtain(entryCapacity, dataCapacity));
+        captureResult.mMetadata.append(result->result);
 
         if (captureResult.mMetadata.update(ANDROID_REQUEST_FRAME_COUNT,
                 (int32_t*)&frameNumber, 1) != OK) {
@@ -2095,9 +2173,11 @@ void Camera3Device::processCaptureResult(const camera3_capture_result *result) {
         }
 
         if (gotResult) {
-            // Valid result, insert into queue
+            // Valid result, move it into the queue without copying the metadata
             List<CaptureResult>::iterator queuedResult =
-                    mResultQueue.insert(mResultQueue.end(), CaptureResult(captureResult));
+                    mResultQueue.insert(mResultQueue.end(), CaptureResult());
+            queuedResult->mResultExtras = captureResult.mResultExtras;
+            queuedResult->mMetadata.acquire(captureResult.mMetadata);
             ALOGVV("%s: result requestId = %" PRId32 ", frameNumber = %" PRId64
                    ", burstId = %" PRId32, __FUNCTION__,
                    queuedResult->mResultExtras.requestId,
@@ -2111,6 +2191,8 @@ void Camera3Device::processCaptureResult(const camera3_capture_result *result) {
     for (size_t i = 0; i < result->num_output_buffers; i++) {
         Camera3Stream *stream =
                 Camera3Stream::cast(result->output_buffers[i].stream);
+        mFrameTimeline->record(CameraFrameTimeline::BUFFER_RETURNED, frameNumber,
+                stream->getId());
         res = stream->returnBuffer(result->output_buffers[i], timestamp);
         // Note: stream may be deallocated at this point, if this buffer was the
         // last reference to it.
@@ -2220,10 +2302,10 @@ void Camera3Device::notifyError(const camera3_error_msg_t &msg,
         case ICameraDeviceCallbacks::ERROR_CAMERA_RESULT:
         case ICameraDeviceCallbacks::ERROR_CAMERA_BUFFER:
             {
-                Mutex::Autolock l(mInFlightLock);
-                ssize_t idx = mInFlightMap.indexOfKey(msg.frame_number);
-                if (idx >= 0) {
-                    InFlightRequest &r = mInFlightMap.editValueAt(idx);
+                InFlightSlot &slot = inFlightSlot(msg.frame_number);
+                Mutex::Autolock l(slot.lock);
+                if (slot.inUse && slot.frameNumber == msg.frame_number) {
+                    InFlightRequest &r = slot.request;
                     r.requestStatus = msg.error_code;
                     resultExtras = r.resultExtras;
                 } else {
@@ -2248,7 +2330,8 @@ void Camera3Device::notifyError(const camera3_error_msg_t &msg,
 
 void Camera3Device::notifyShutter(const camera3_shutter_msg_t &msg,
         NotificationListener *listener) {
-    ssize_t idx;
+    bool found = false;
+    mFrameTimeline->record(CameraFrameTimeline::SHUTTER, msg.frame_number);
     // Verify ordering of shutter notifications
     {
         Mutex::Autolock l(mOutputLock);
@@ -2267,15 +2350,16 @@ void Camera3Device::notifyShutter(const camera3_shutter_msg_t &msg,
     // Set timestamp for the request in the in-flight tracking
     // and get the request ID to send upstream
     {
-        Mutex::Autolock l(mInFlightLock);
-        idx = mInFlightMap.indexOfKey(msg.frame_number);
-        if (idx >= 0) {
-            InFlightRequest &r = mInFlightMap.editValueAt(idx);
+        InFlightSlot &slot = inFlightSlot(msg.frame_number);
+        Mutex::Autolock l(slot.lock);
+        if (slot.inUse && slot.frameNumber == msg.frame_number) {
+            InFlightRequest &r = slot.request;
             r.captureTimestamp = msg.timestamp;
             resultExtras = r.resultExtras;
+            found = true;
         }
     }
-    if (idx < 0) {
+    if (!found) {
         SET_ERR("Shutter notification for non-existent frame number %d",
                 msg.frame_number);
         return;
@@ -2309,11 +2393,13 @@ CameraMetadata Camera3Device::getLatestRequestLocked() {
 
 Camera3Device::RequestThread::RequestThread(wp<Camera3Device> parent,
         sp<StatusTracker> statusTracker,
-        camera3_device_t *hal3Device) :
+        camera3_device_t *hal3Device,
+        sp<CameraFrameTimeline> frameTimeline) :
         Thread(false),
         mParent(parent),
         mStatusTracker(statusTracker),
         mHal3Device(hal3Device),
+        mFrameTimeline(frameTimeline),
         mId(getId(parent)),
         mReconfigured(false),
         mDoPause(false),
@@ -2507,6 +2593,13 @@ status_t Camera3Device::RequestThread::waitUntilRequestProcessed(
     return OK;
 }
 
+Camera3Device::RequestThread::~RequestThread() {
+    for (size_t i = 0; i < mBufferFetchThreads.size(); i++) {
+        mBufferFetchThreads[i]->requestExit();
+        mBufferFetchThreads[i]->join();
+    }
+}
+
 void Camera3Device::RequestThread::requestExit() {
     // Call parent to set up shutdown
     Thread::requestExit();
@@ -2530,6 +2623,8 @@ bool Camera3Device::RequestThread::threadLoop() {
     if (nextRequest == NULL) {
         return true;
     }
+    mFrameTimeline->record(CameraFrameTimeline::REQUEST_STARTED,
+            nextRequest->mResultExtras.frameNumber);
 
     // Create request to HAL
     camera3_capture_request_t request = camera3_capture_request_t();
@@ -2563,7 +2658,8 @@ bool Camera3Device::RequestThread::threadLoop() {
     bool triggersMixedIn = (triggerCount > 0 || mPrevTriggers > 0);
 
     // If the request is the same as last, or we had triggers last time
-    if (mPrevRequest != nextRequest || triggersMixedIn) {
+    bool settingsChanged = mPrevRequest != nextRequest || triggersMixedIn;
+    if (settingsChanged) {
         /**
          * HAL workaround:
          * Insert a dummy trigger ID if a trigger is set but no trigger ID is
@@ -2582,6 +2678,19 @@ bool Camera3Device::RequestThread::threadLoop() {
          *   are O(logn). Sidenote, sorting a sorted metadata is nop.
          */
         nextRequest->mSettings.sort();
+
+        /**
+         * A different request may still carry the same settings, as the
+         * requests of a repeating burst that only differ by their output
+         * streams do; the HAL then reuses the ones it was last given.
+         */
+        if (!triggersMixedIn && mPrevRequest != NULL &&
+                isSameSettings(mPrevRequest->mSettings, nextRequest->mSettings)) {
+            mPrevRequest = nextRequest;
+            settingsChanged = false;
+        }
+    }
+    if (settingsChanged) {
         request.settings = nextRequest->mSettings.getAndLock();
         mPrevRequest = nextRequest;
         ALOGVV("%s: Request settings are NEW", __FUNCTION__);
@@ -2637,25 +2746,26 @@ bool Camera3Device::RequestThread::threadLoop() {
     outputBuffers.insertAt(camera3_stream_buffer_t(), 0,
             nextRequest->mOutputStreams.size());
     request.output_buffers = outputBuffers.array();
-    for (size_t i = 0; i < nextRequest->mOutputStreams.size(); i++) {
-        res = nextRequest->mOutputStreams.editItemAt(i)->
-                getBuffer(&outputBuffers.editItemAt(i));
-        if (res != OK) {
-            // Can't get output buffer from gralloc queue - this could be due to
-            // abandoned queue or other consumer misbehavior, so not a fatal
-            // error
-            ALOGE("RequestThread: Can't get output buffer, skipping request:"
-                    " %s (%d)", strerror(-res), res);
-            Mutex::Autolock l(mRequestLock);
-            if (mListener != NULL) {
-                mListener->notifyError(
-                        ICameraDeviceCallbacks::ERROR_CAMERA_REQUEST,
-                        nextRequest->mResultExtras);
-            }
-            cleanUpFailedRequest(request, nextRequest, outputBuffers);
-            return true;
+    res = getOutputBuffers(nextRequest, outputBuffers);
+    if (res != OK) {
+        // Can't get output buffer from gralloc queue - this could be due to
+        // abandoned queue or other consumer misbehavior, so not a fatal
+        // error
+        ALOGE("RequestThread: Can't get output buffer, skipping request:"
+                " %s (%d)", strerror(-res), res);
+        Mutex::Autolock l(mRequestLock);
+        if (mListener != NULL) {
+            mListener->notifyError(
+                    ICameraDeviceCallbacks::ERROR_CAMERA_REQUEST,
+                    nextRequest->mResultExtras);
         }
-        request.num_output_buffers++;
+        cleanUpFailedRequest(request, nextRequest, outputBuffers);
+        return true;
+    }
+    request.num_output_buffers = outputBuffers.size();
+    for (size_t i = 0; i < nextRequest->mOutputStreams.size(); i++) {
+        mFrameTimeline->record(CameraFrameTimeline::BUFFER_DEQUEUED, request.frame_number,
+                nextRequest->mOutputStreams[i]->getId());
     }
     totalNumBuffers += request.num_output_buffers;
 
@@ -2683,8 +2793,10 @@ bool Camera3Device::RequestThread::threadLoop() {
         return false;
     }
 
-    // Inform waitUntilRequestProcessed thread of a new request ID
-    {
+    // Inform waitUntilRequestProcessed thread of a new request ID. This thread is the
+    // only writer of mLatestRequestId, so it can read it without the lock; all frames
+    // of a repeating request or burst share an ID, so a new one is rare.
+    if (mLatestRequestId != requestId) {
         Mutex::Autolock al(mLatestRequestMutex);
 
         mLatestRequestId = requestId;
@@ -2693,6 +2805,7 @@ bool Camera3Device::RequestThread::threadLoop() {
 
     // Submit request and block until ready for next one
     ATRACE_ASYNC_BEGIN("frame capture", request.frame_number);
+    mFrameTimeline->record(CameraFrameTimeline::REQUEST_SUBMITTED, request.frame_number);
     ATRACE_BEGIN("camera3->process_capture_request");
     res = mHal3Device->ops->process_capture_request(mHal3Device, &request);
     ATRACE_END();
@@ -2732,6 +2845,95 @@ bool Camera3Device::RequestThread::threadLoop() {
     return true;
 }
 
+bool Camera3Device::RequestThread::isSameSettings(CameraMetadata &a, CameraMetadata &b) {
+    size_t entryCount = a.entryCount();
+    if (entryCount != b.entryCount()) {
+        return false;
+    }
+
+    // Both are sorted, so equal settings have their entries in the same order
+    const camera_metadata_t *bufferA = a.getAndLock();
+    const camera_metadata_t *bufferB = b.getAndLock();
+    bool same = true;
+    for (size_t i = 0; same && i < entryCount; i++) {
+        camera_metadata_ro_entry_t entryA, entryB;
+        if (get_camera_metadata_ro_entry(bufferA, i, &entryA) != OK ||
+                get_camera_metadata_ro_entry(bufferB, i, &entryB) != OK) {
+            same = false;
+        } else {
+            same = entryA.tag == entryB.tag && entryA.type == entryB.type &&
+                    entryA.count == entryB.count &&
+                    memcmp(entryA.data.u8, entryB.data.u8,
+                            entryA.count * camera_metadata_type_size[entryA.type]) == 0;
+        }
+    }
+    a.unlock(bufferA);
+    b.unlock(bufferB);
+    return same;
+}
+
+status_t Camera3Device::RequestThread::getOutputBuffers(
+        const sp<CaptureRequest> &request,
+        Vector<camera3_stream_buffer_t> &outputBuffers) {
+    ATRACE_CALL();
+    size_t numStreams = request->mOutputStreams.size();
+    if (numStreams == 0) {
+        return OK;
+    }
+
+    // Each stream queue may block until its consumer frees a buffer, hand all
+    // streams but the first one to the helpers so that those waits overlap
+    while (mBufferFetchThreads.size() < numStreams - 1) {
+        sp<BufferFetchThread> fetchThread = new BufferFetchThread();
+        status_t res = fetchThread->run(String8::format("C3Dev-%d-BufFetch-%zu",
+                mId, mBufferFetchThreads.size()).string());
+        if (res != OK) {
+            ALOGE("%s: Unable to start buffer fetch thread: %s (%d)",
+                    __FUNCTION__, strerror(-res), res);
+            break;
+        }
+        mBufferFetchThreads.push_back(fetchThread);
+    }
+    size_t numFetched = numStreams - 1;
+    if (numFetched > mBufferFetchThreads.size()) {
+        numFetched = mBufferFetchThreads.size();
+    }
+    for (size_t i = 0; i < numFetched; i++) {
+        mBufferFetchThreads[i]->fetch(request->mOutputStreams[i + 1],
+                &outputBuffers.editItemAt(i + 1));
+    }
+
+    Vector<status_t> results;
+    results.insertAt(OK, 0, numStreams);
+    results.editItemAt(0) = request->mOutputStreams.editItemAt(0)->
+            getBuffer(&outputBuffers.editItemAt(0));
+    // Without enough helpers, the remaining streams are served in turn
+    for (size_t i = numFetched + 1; i < numStreams; i++) {
+        results.editItemAt(i) = request->mOutputStreams.editItemAt(i)->
+                getBuffer(&outputBuffers.editItemAt(i));
+    }
+    for (size_t i = 0; i < numFetched; i++) {
+        results.editItemAt(i + 1) = mBufferFetchThreads[i]->waitForBuffer();
+    }
+
+    status_t res = OK;
+    for (size_t i = 0; i < numStreams; i++) {
+        if (results[i] != OK) {
+            res = results[i];
+        }
+    }
+    if (res != OK) {
+        for (size_t i = 0; i < numStreams; i++) {
+            if (results[i] == OK) {
+                outputBuffers.editItemAt(i).status = CAMERA3_BUFFER_STATUS_ERROR;
+                request->mOutputStreams.editItemAt(i)->returnBuffer(
+                        outputBuffers[i], 0);
+            }
+        }
+    }
+    return res;
+}
+
 CameraMetadata Camera3Device::RequestThread::getLatestRequest() const {
     Mutex::Autolock al(mLatestRequestMutex);
 
@@ -3087,6 +3289,62 @@ status_t Camera3Device::RequestThread::addDummyTriggerIds(
     return OK;
 }
 
+/**
+ * BufferFetchThread inner class methods
+ */
+
+Camera3Device::BufferFetchThread::BufferFetchThread() :
+        Thread(false),
+        mBuffer(NULL),
+        mPending(false),
+        mResult(OK) {
+}
+
+void Camera3Device::BufferFetchThread::fetch(
+        const sp<camera3::Camera3OutputStreamInterface> &stream,
+        camera3_stream_buffer_t *buffer) {
+    Mutex::Autolock l(mLock);
+    mStream = stream;
+    mBuffer = buffer;
+    mPending = true;
+    mFetchSignal.signal();
+}
+
+status_t Camera3Device::BufferFetchThread::waitForBuffer() {
+    Mutex::Autolock l(mLock);
+    while (mPending) {
+        mDoneSignal.wait(mLock);
+    }
+    return mResult;
+}
+
+void Camera3Device::BufferFetchThread::requestExit() {
+    Thread::requestExit();
+    mFetchSignal.signal();
+}
+
+bool Camera3Device::BufferFetchThread::threadLoop() {
+    sp<camera3::Camera3OutputStreamInterface> stream;
+    camera3_stream_buffer_t *buffer;
+    {
+        Mutex::Autolock l(mLock);
+        while (mStream == NULL) {
+            mFetchSignal.waitRelative(mLock, kWaitTimeout);
+            if (exitPending()) return false;
+        }
+        stream = mStream;
+        buffer = mBuffer;
+        mStream.clear();
+    }
+
+    status_t res = stream->getBuffer(buffer);
+
+    Mutex::Autolock l(mLock);
+    mResult = res;
+    mPending = false;
+    mDoneSignal.signal();
+    return true;
+}
 
 /**
  * Static callback forwarding methods from HAL to instance
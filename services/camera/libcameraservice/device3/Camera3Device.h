@@ -29,6 +29,8 @@
 
 #include "common/CameraDeviceBase.h"
 #include "device3/StatusTracker.h"
+#include "utils/CameraFrameTimeline.h"
+#include "utils/CameraMetadataPool.h"
 
 /**
  * Function pointer types with C calling convention to
@@ -125,6 +127,7 @@ class Camera3Device :
     virtual bool     willNotify3A();
     virtual status_t waitForNextFrame(nsecs_t timeout);
     virtual status_t getNextResult(CaptureResult *frame);
+    virtual void     releaseResultMetadata(camera_metadata_t *buffer);
 
     virtual status_t triggerAutofocus(uint32_t id);
     virtual status_t triggerCancelAutofocus(uint32_t id);
@@ -209,6 +212,24 @@ class Camera3Device :
     // Need to hold on to stream references until configure completes.
     Vector<sp<camera3::Camera3StreamInterface> > mDeletedStreams;
 
+    // Duration of each phase of the last successful stream configuration,
+    // see configureStreamsLocked(). Shown in dump().
+    struct ConfigureTimings {
+        nsecs_t  startDuration;     // startConfiguration() of all streams
+        nsecs_t  halDuration;       // HAL configure_streams()
+        nsecs_t  finishDuration;    // finishConfiguration(), registers buffers
+        nsecs_t  teardownDuration;  // destruction of the deleted streams
+        nsecs_t  totalDuration;
+        size_t   streamCount;
+        uint32_t configureCount;    // successful configurations so far
+
+        ConfigureTimings() :
+                startDuration(0), halDuration(0), finishDuration(0),
+                teardownDuration(0), totalDuration(0), streamCount(0),
+                configureCount(0) {}
+    };
+    ConfigureTimings           mConfigureTimings;
+
     // Whether the HAL will send partial result
     bool                       mUsePartialResult;
 
@@ -352,6 +373,48 @@ class Camera3Device :
         }
     };
 
+    /**
+     * Helper thread of the request thread, getting the buffer of one output
+     * stream of a request while the request thread gets another's, so that
+     * the buffer queues of the streams are waited on at the same time.
+     */
+    class BufferFetchThread : public Thread {
+
+      public:
+
+        BufferFetchThread();
+
+        /**
+         * Start getting a buffer from the stream into *buffer.
+         */
+        void     fetch(const sp<camera3::Camera3OutputStreamInterface> &stream,
+                       camera3_stream_buffer_t *buffer);
+
+        /**
+         * Wait until the buffer started by fetch() is here, and return the
+         * result of Camera3OutputStreamInterface::getBuffer().
+         */
+        status_t waitForBuffer();
+
+        virtual void requestExit();
+
+      protected:
+
+        virtual bool threadLoop();
+
+      private:
+
+        static const nsecs_t kWaitTimeout = 50e6; // 50 ms
+
+        Mutex              mLock;
+        Condition          mFetchSignal;
+        Condition          mDoneSignal;
+        sp<camera3::Camera3OutputStreamInterface> mStream;
+        camera3_stream_buffer_t *mBuffer;
+        bool               mPending;
+        status_t           mResult;
+    };
+
     /**
      * Thread for managing capture request submission to HAL device.
      */
@@ -361,7 +424,9 @@ class Camera3Device :
 
         RequestThread(wp<Camera3Device> parent,
                 sp<camera3::StatusTracker> statusTracker,
-                camera3_device_t *hal3Device);
+                camera3_device_t *hal3Device,
+                sp<camera3::CameraFrameTimeline> frameTimeline);
+        ~RequestThread();
 
         void     setNotifyCallback(NotificationListener *listener);
 
@@ -445,6 +510,16 @@ class Camera3Device :
         // a trigger does
         status_t          addDummyTriggerIds(const sp<CaptureRequest> &request);
 
+        // Get the output buffers of a request, in parallel for several streams.
+        // On failure, the buffers that were obtained are returned to their
+        // streams in the error state.
+        status_t           getOutputBuffers(const sp<CaptureRequest> &request,
+                                            Vector<camera3_stream_buffer_t> &outputBuffers);
+
+        // Whether the sorted settings a and b hold the same entries, so that a
+        // request with settings b can reuse the settings a last given to the HAL
+        static bool        isSameSettings(CameraMetadata &a, CameraMetadata &b);
+
         static const nsecs_t kRequestTimeout = 50e6; // 50 ms
 
         // Waits for a request, or returns NULL if times out.
@@ -471,6 +546,7 @@ class Camera3Device :
         wp<Camera3Device>  mParent;
         wp<camera3::StatusTracker>  mStatusTracker;
         camera3_device_t  *mHal3Device;
+        sp<camera3::CameraFrameTimeline> mFrameTimeline;
 
         NotificationListener *mListener;
 
@@ -512,6 +588,10 @@ class Camera3Device :
         uint32_t           mCurrentPreCaptureTriggerId;
 
         int64_t            mRepeatingLastFrameNumber;
+
+        // Helpers for all output streams of a request but the first one,
+        // only used by the request thread
+        Vector<sp<BufferFetchThread> > mBufferFetchThreads;
     };
     sp<RequestThread> mRequestThread;
 
@@ -544,7 +624,7 @@ class Camera3Device :
             }
         } partialResult;
 
-        // Default constructor needed by KeyedVector
+        // Default constructor needed by InFlightSlot
         InFlightRequest() :
                 captureTimestamp(0),
                 requestStatus(OK),
@@ -579,11 +659,36 @@ class Camera3Device :
                 hasInputBuffer(hasInput){
         }
 };
-    // Map from frame number to the in-flight request state
-    typedef KeyedVector<uint32_t, InFlightRequest> InFlightMap;
+    /**
+     * In-flight request state by frame number. A frame can only be in the slot
+     * of its frame number modulo kInFlightCapacity, so finding it takes no
+     * search, and the HAL callbacks for different frames never wait on each
+     * other. The slot lock only serializes the callbacks of one frame, which
+     * the HAL may make from several threads at once.
+     */
+    static const uint32_t  kInFlightCapacity = 128;
+
+    struct InFlightSlot {
+        Mutex           lock;       // Protects the fields below
+        bool            inUse;
+        uint32_t        frameNumber;
+        InFlightRequest request;
+
+        InFlightSlot() :
+                inUse(false),
+                frameNumber(0) {
+        }
+    };
 
-    Mutex                  mInFlightLock; // Protects mInFlightMap
-    InFlightMap            mInFlightMap;
+    InFlightSlot           mInFlightSlots[kInFlightCapacity];
+    volatile int32_t       mInFlightCount;
+
+    InFlightSlot& inFlightSlot(uint32_t frameNumber) {
+        return mInFlightSlots[frameNumber & (kInFlightCapacity - 1)];
+    }
+
+    // Mark the slot free, with the slot lock held
+    void removeInFlightLocked(InFlightSlot &slot);
 
     status_t registerInFlight(uint32_t frameNumber,
             int32_t numBuffers, CaptureResultExtras resultExtras, bool hasInput);
@@ -626,6 +731,12 @@ class Camera3Device :
 
     /**** End scope for mOutputLock ****/
 
+    // Metadata buffers of the results, recycled by releaseResultMetadata
+    camera3::CameraMetadataPool mResultMetadataPool;
+
+    // Stage times of the latest frames, for the latency statistics of dump()
+    sp<camera3::CameraFrameTimeline> mFrameTimeline;
+
     /**
      * Callback functions from HAL device
      */
@@ -269,19 +269,36 @@ status_t Camera3OutputStream::configureQueueLocked() {
     status_t res;
 
     mTraceFirstBuffer = true;
-    if ((res = Camera3IOStreamBase::configureQueueLocked()) != OK) {
-        return res;
+
+    /**
+     * When reconfiguring, stay connected to the consumer. Disconnecting frees
+     * all the buffers of its queue, and the stream size and format can't
+     * change, so across a preview/video mode switch the same buffers would
+     * just be allocated again. A change of usage only reallocates the buffers
+     * that don't fit it, when they are next dequeued.
+     */
+    bool reconnect = (mState != STATE_IN_RECONFIG);
+    if (reconnect) {
+        if ((res = Camera3IOStreamBase::configureQueueLocked()) != OK) {
+            return res;
+        }
+    } else if (mHandoutTotalBufferCount > 0) {
+        ALOGE("%s: Can't reconfigure stream %d with %zu buffers still dequeued!",
+                __FUNCTION__, mId, mHandoutTotalBufferCount);
+        return INVALID_OPERATION;
     }
 
     ALOG_ASSERT(mConsumer != 0, "mConsumer should never be NULL");
 
     // Configure consumer-side ANativeWindow interface
-    res = native_window_api_connect(mConsumer.get(),
-            NATIVE_WINDOW_API_CAMERA);
-    if (res != OK) {
-        ALOGE("%s: Unable to connect to native window for stream %d",
-                __FUNCTION__, mId);
-        return res;
+    if (reconnect) {
+        res = native_window_api_connect(mConsumer.get(),
+                NATIVE_WINDOW_API_CAMERA);
+        if (res != OK) {
+            ALOGE("%s: Unable to connect to native window for stream %d",
+                    __FUNCTION__, mId);
+            return res;
+        }
     }
 
     res = native_window_set_usage(mConsumer.get(), camera3_stream::usage);
@@ -340,17 +357,22 @@ status_t Camera3OutputStream::configureQueueLocked() {
         return INVALID_OPERATION;
     }
 
-    mTotalBufferCount = maxConsumerBuffers + camera3_stream::max_buffers;
+    size_t totalBufferCount = maxConsumerBuffers + camera3_stream::max_buffers;
+    bool countChanged = (totalBufferCount != mTotalBufferCount);
+    mTotalBufferCount = totalBufferCount;
     mHandoutTotalBufferCount = 0;
     mFrameCount = 0;
     mLastTimestamp = 0;
 
-    res = native_window_set_buffer_count(mConsumer.get(),
-            mTotalBufferCount);
-    if (res != OK) {
-        ALOGE("%s: Unable to set buffer count for stream %d",
-                __FUNCTION__, mId);
-        return res;
+    // Setting the buffer count frees all buffers as well, skip it if unchanged
+    if (reconnect || countChanged) {
+        res = native_window_set_buffer_count(mConsumer.get(),
+                mTotalBufferCount);
+        if (res != OK) {
+            ALOGE("%s: Unable to set buffer count for stream %d",
+                    __FUNCTION__, mId);
+            return res;
+        }
     }
 
     res = native_window_set_buffers_transform(mConsumer.get(),
@@ -30,6 +30,7 @@ namespace android {
 namespace camera3 {
 
 StatusTracker::StatusTracker(wp<Camera3Device> parent) :
+        mActiveCount(0),
         mComponentsChanged(false),
         mParent(parent),
         mNextComponentId(0),
@@ -42,19 +43,17 @@ StatusTracker::~StatusTracker() {
 
 int StatusTracker::addComponent() {
     int id;
-    ssize_t err;
     {
         Mutex::Autolock l(mLock);
         id = mNextComponentId++;
-        ALOGV("%s: Adding new component %d", __FUNCTION__, id);
-
-        err = mStates.add(id, IDLE);
-        ALOGE_IF(err < 0, "%s: Can't add new component %d: %s (%zd)",
-                __FUNCTION__, id, strerror(-err), err);
     }
+    ALOGV("%s: Adding new component %d", __FUNCTION__, id);
 
+    Mutex::Autolock pl(mPendingLock);
+    ssize_t err = mStates.add(id, IDLE);
+    ALOGE_IF(err < 0, "%s: Can't add new component %d: %s (%zd)",
+            __FUNCTION__, id, strerror(-err), err);
     if (err >= 0) {
-        Mutex::Autolock pl(mPendingLock);
         mComponentsChanged = true;
         mPendingChangeSignal.signal();
     }
@@ -63,20 +62,19 @@ int StatusTracker::addComponent() {
 }
 
 void StatusTracker::removeComponent(int id) {
-    ssize_t idx;
-    {
-        Mutex::Autolock l(mLock);
-        ALOGV("%s: Removing component %d", __FUNCTION__, id);
-        idx = mStates.removeItem(id);
+    Mutex::Autolock pl(mPendingLock);
+    ALOGV("%s: Removing component %d", __FUNCTION__, id);
+    ssize_t idx = mStates.indexOfKey(id);
+    if (idx < 0) {
+        return;
     }
-
-    if (idx >= 0) {
-        Mutex::Autolock pl(mPendingLock);
-        mComponentsChanged = true;
-        mPendingChangeSignal.signal();
+    if (mStates.valueAt(idx) == ACTIVE && --mActiveCount == 0) {
+        mPendingEdges.add(IDLE);
     }
+    mStates.removeItemsAt(idx);
 
-    return;
+    mComponentsChanged = true;
+    mPendingChangeSignal.signal();
 }
 
 
@@ -94,14 +92,33 @@ void StatusTracker::markComponent(int id, ComponentState state,
             state == IDLE ? "idle" : "active");
     Mutex::Autolock l(mPendingLock);
 
-    StateChange newState = {
-        id,
-        state,
-        componentFence
-    };
+    ssize_t idx = mStates.indexOfKey(id);
+    // Ignore notices for unknown components
+    if (idx < 0) {
+        return;
+    }
+
+    bool wake = false;
+    if (componentFence != NULL && componentFence != Fence::NO_FENCE) {
+        mPendingFences.add(componentFence);
+        wake = mPendingFences.size() >= kMaxPendingFences;
+    }
 
-    mPendingChangeQueue.add(newState);
-    mPendingChangeSignal.signal();
+    // Streams go idle and active again with every frame, while the device as a
+    // whole stays active; only wake up the thread when all components become
+    // idle, or one of them becomes active while all were idle.
+    if (mStates.valueAt(idx) != state) {
+        mStates.replaceValueAt(idx, state);
+        bool edge = (state == ACTIVE) ? (mActiveCount++ == 0) : (--mActiveCount == 0);
+        if (edge) {
+            mPendingEdges.add(state);
+            wake = true;
+        }
+    }
+
+    if (wake) {
+        mPendingChangeSignal.signal();
+    }
 }
 
 void StatusTracker::requestExit() {
@@ -112,13 +129,14 @@ void StatusTracker::requestExit() {
 }
 
 StatusTracker::ComponentState StatusTracker::getDeviceStateLocked() {
-    for (size_t i = 0; i < mStates.size(); i++) {
-        if (mStates.valueAt(i) == ACTIVE) {
-            ALOGV("%s: Component %d not idle", __FUNCTION__,
-                    mStates.keyAt(i));
-            return ACTIVE;
-        }
+    if (mActiveCount > 0) {
+        ALOGV("%s: %zu components not idle", __FUNCTION__, mActiveCount);
+        return ACTIVE;
     }
+    return getFenceStateLocked();
+}
+
+StatusTracker::ComponentState StatusTracker::getFenceStateLocked() {
     // - If not yet signaled, getSignalTime returns INT64_MAX
     // - If invalid fence or error, returns -1
     // - Otherwise returns time of signalling.
@@ -138,7 +156,8 @@ bool StatusTracker::threadLoop() {
     // Wait for state updates
     {
         Mutex::Autolock pl(mPendingLock);
-        while (mPendingChangeQueue.size() == 0 && !mComponentsChanged) {
+        while (mPendingEdges.size() == 0 && !mComponentsChanged &&
+                mPendingFences.size() < kMaxPendingFences) {
             res = mPendingChangeSignal.waitRelative(mPendingLock,
                     kWaitDuration);
             if (exitPending()) return false;
@@ -161,35 +180,36 @@ bool StatusTracker::threadLoop() {
         Mutex::Autolock pl(mPendingLock);
         Mutex::Autolock l(mLock);
 
-        // Collect all pending state updates and see if the device
-        // collectively transitions between idle and active for each one
+        for (size_t i = 0; i < mPendingFences.size(); i++) {
+            mIdleFence = Fence::merge(String8("idleFence"),
+                    mIdleFence, mPendingFences[i]);
+        }
+        mPendingFences.clear();
+
+        // Each pending edge is a point where all components went idle, or one
+        // of them went active with all others idle; in between, the device
+        // state did not change. Collect the device transitions from those.
 
         // First pass for changed components or fence completions
-        ComponentState prevState = getDeviceStateLocked();
+        ComponentState prevState;
+        if (mPendingEdges.size() == 0) {
+            prevState = getDeviceStateLocked();
+        } else {
+            prevState = (mPendingEdges[0] == ACTIVE) ? getFenceStateLocked() : ACTIVE;
+        }
         if (prevState != mDeviceState) {
             // Only collect changes to overall device state
             mStateTransitions.add(prevState);
         }
-        // For each pending component state update, check if we've transitioned
-        // to a new overall device state
-        for (size_t i = 0; i < mPendingChangeQueue.size(); i++) {
-            const StateChange &newState = mPendingChangeQueue[i];
-            ssize_t idx = mStates.indexOfKey(newState.id);
-            // Ignore notices for unknown components
-            if (idx >= 0) {
-                // Update single component state
-                mStates.replaceValueAt(idx, newState.state);
-                mIdleFence = Fence::merge(String8("idleFence"),
-                        mIdleFence, newState.fence);
-                // .. and see if overall device state has changed
-                ComponentState newState = getDeviceStateLocked();
-                if (newState != prevState) {
-                    mStateTransitions.add(newState);
-                }
-                prevState = newState;
+        for (size_t i = 0; i < mPendingEdges.size(); i++) {
+            ComponentState newState = (mPendingEdges[i] == ACTIVE) ?
+                    ACTIVE : getFenceStateLocked();
+            if (newState != prevState) {
+                mStateTransitions.add(newState);
             }
+            prevState = newState;
         }
-        mPendingChangeQueue.clear();
+        mPendingEdges.clear();
         mComponentsChanged = false;
 
         // Store final state after all pending state changes are done with
@@ -82,18 +82,21 @@ class StatusTracker: public Thread {
     void markComponent(int id, ComponentState state,
             const sp<Fence>& componentFence);
 
-    // Guards mPendingChange, mPendingStates, mComponentsChanged
+    // Guards mStates, mActiveCount, mPendingFences, mPendingEdges,
+    // mComponentsChanged
     Mutex mPendingLock;
 
     Condition mPendingChangeSignal;
 
-    struct StateChange {
-        int id;
-        ComponentState state;
-        sp<Fence> fence;
-    };
-    // A queue of yet-to-be-processed state changes to components
-    Vector<StateChange> mPendingChangeQueue;
+    // Current component states, and the number of active components
+    KeyedVector<int, ComponentState> mStates;
+    size_t mActiveCount;
+    // Fences given by components since the last pass of threadLoop
+    Vector<sp<Fence> > mPendingFences;
+    // Collective component states since the last pass of threadLoop: ACTIVE
+    // when a component became active with all others idle, IDLE when all
+    // of them became idle. Only these wake up threadLoop.
+    Vector<ComponentState> mPendingEdges;
     bool mComponentsChanged;
 
     wp<Camera3Device> mParent;
@@ -103,8 +106,6 @@ class StatusTracker: public Thread {
 
     int mNextComponentId;
 
-    // Current component states
-    KeyedVector<int, ComponentState> mStates;
     // Merged fence for all processed state changes
     sp<Fence> mIdleFence;
     // Current overall device state
@@ -117,10 +118,14 @@ class StatusTracker: public Thread {
     // - All components are currently IDLE
     // - The merged fence for all component updates has signalled
     ComponentState getDeviceStateLocked();
+    // The device state once all components are idle, from the merged fence
+    ComponentState getFenceStateLocked();
 
     Vector<ComponentState> mStateTransitions;
 
     static const nsecs_t kWaitDuration = 250000000LL; // 250 ms
+    // Fences held before waking up threadLoop to merge them
+    static const size_t kMaxPendingFences = 16;
 };
 
 } // namespace camera3
@@ -117,6 +117,47 @@ sp<PinnedBufferItem> RingBufferConsumer::pinSelectedBuffer(
     return pinnedBuffer;
 }
 
+sp<PinnedBufferItem> RingBufferConsumer::pinBufferByTimestamp(
+        nsecs_t timestamp,
+        bool waitForFence) {
+
+    sp<PinnedBufferItem> pinnedBuffer;
+
+    {
+        Mutex::Autolock _l(mMutex);
+
+        size_t count = mTimestampIndex.size();
+        if (count == 0) {
+            return NULL;
+        }
+
+        size_t idx = lowerBoundLocked(timestamp);
+        if (idx == count || (mTimestampIndex[idx]->mTimestamp != timestamp &&
+                idx > 0)) {
+            // No exact match, prefer the closest lower timestamp
+            idx--;
+        }
+
+        RingBufferItem& item = *mTimestampIndex[idx];
+        pinnedBuffer = new PinnedBufferItem(this, item);
+        item.mPinCount++;
+        BI_LOGV("Pinned buffer (frame %" PRIu64 ", timestamp %" PRId64 ")",
+                item.mFrameNumber, item.mTimestamp);
+
+    } // end scope of mMutex autolock
+
+    if (waitForFence) {
+        status_t err = pinnedBuffer->getBufferItem().mFence->waitForever(
+                "RingBufferConsumer::pinBufferByTimestamp");
+        if (err != OK) {
+            BI_LOGE("Failed to wait for fence of acquired buffer: %s (%d)",
+                    strerror(-err), err);
+        }
+    }
+
+    return pinnedBuffer;
+}
+
 status_t RingBufferConsumer::clear() {
 
     status_t err;
@@ -161,6 +202,42 @@ nsecs_t RingBufferConsumer::getLatestTimestamp() {
     return mLatestTimestamp;
 }
 
+size_t RingBufferConsumer::lowerBoundLocked(nsecs_t timestamp) const {
+    size_t lo = 0;
+    size_t hi = mTimestampIndex.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (mTimestampIndex[mid]->mTimestamp < timestamp) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+void RingBufferConsumer::indexBufferLocked(const RingBufferItemIterator& it) {
+    // Timestamps normally increase, so this is almost always an append
+    size_t idx = mTimestampIndex.size();
+    while (idx > 0 && mTimestampIndex[idx - 1]->mTimestamp > it->mTimestamp) {
+        idx--;
+    }
+    mTimestampIndex.insertAt(it, idx);
+}
+
+void RingBufferConsumer::unindexBufferLocked(const RingBufferItemIterator& it) {
+    for (size_t idx = lowerBoundLocked(it->mTimestamp);
+            idx < mTimestampIndex.size(); idx++) {
+        if (mTimestampIndex[idx] == it) {
+            mTimestampIndex.removeAt(idx);
+            return;
+        }
+    }
+    BI_LOGE("Buffer (timestamp %" PRId64 ", framenumber %" PRIu64 ") "
+            "missing from the timestamp index", it->mTimestamp,
+            it->mFrameNumber);
+}
+
 void RingBufferConsumer::pinBufferLocked(const BufferItem& item) {
     List<RingBufferItem>::iterator it, end;
 
@@ -187,13 +264,12 @@ void RingBufferConsumer::pinBufferLocked(const BufferItem& item) {
 status_t RingBufferConsumer::releaseOldestBufferLocked(size_t* pinnedFrames) {
     status_t err = OK;
 
-    List<RingBufferItem>::iterator it, end, accIt;
+    List<RingBufferItem>::iterator accIt, end;
 
-    it = mBufferItemList.begin();
     end = mBufferItemList.end();
     accIt = end;
 
-    if (it == end) {
+    if (mTimestampIndex.isEmpty()) {
         /**
          * This is fine. We really care about being able to acquire a buffer
          * successfully after this function completes, not about it releasing
@@ -204,10 +280,11 @@ status_t RingBufferConsumer::releaseOldestBufferLocked(size_t* pinnedFrames) {
         return NOT_ENOUGH_DATA;
     }
 
-    for (; it != end; ++it) {
-        RingBufferItem& find = *it;
+    // The oldest non-pinned buffer is the first one in the timestamp index
+    for (size_t idx = 0; idx < mTimestampIndex.size(); idx++) {
+        const RingBufferItemIterator& it = mTimestampIndex[idx];
 
-        if (find.mPinCount > 0) {
+        if (it->mPinCount > 0) {
             if (pinnedFrames != NULL) {
                 ++(*pinnedFrames);
             }
@@ -215,9 +292,8 @@ status_t RingBufferConsumer::releaseOldestBufferLocked(size_t* pinnedFrames) {
             continue;
         }
 
-        if (find.mTimestamp < accIt->mTimestamp || accIt == end) {
-            accIt = it;
-        }
+        accIt = it;
+        break;
     }
 
     if (accIt != end) {
@@ -257,6 +333,7 @@ status_t RingBufferConsumer::releaseOldestBufferLocked(size_t* pinnedFrames) {
                 item.mTimestamp, item.mFrameNumber);
 
         size_t currentSize = mBufferItemList.size();
+        unindexBufferLocked(accIt);
         mBufferItemList.erase(accIt);
         assert(mBufferItemList.size() == currentSize - 1);
     } else {
@@ -290,8 +367,9 @@ void RingBufferConsumer::onFrameAvailable() {
             // we could've locked but didn't because there was no space
         }
 
-        RingBufferItem& item = *mBufferItemList.insert(mBufferItemList.end(),
-                                                       RingBufferItem());
+        RingBufferItemIterator itemIt = mBufferItemList.insert(
+                mBufferItemList.end(), RingBufferItem());
+        RingBufferItem& item = *itemIt;
 
         /**
          * Acquire new frame
@@ -319,6 +397,7 @@ void RingBufferConsumer::onFrameAvailable() {
         mLatestTimestamp = item.mTimestamp;
 
         item.mGraphicBuffer = mSlots[item.mBuf].mGraphicBuffer;
+        indexBufferLocked(itemIt);
     } // end of mMutex lock
 
     ConsumerBase::onFrameAvailable();
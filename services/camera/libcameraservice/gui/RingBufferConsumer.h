@@ -156,6 +156,16 @@ class RingBufferConsumer : public ConsumerBase,
     sp<PinnedBufferItem> pinSelectedBuffer(const RingBufferComparator& filter,
                                            bool waitForFence = true);
 
+    // Find the buffer best matching timestamp, then pin it before returning
+    // it. In order of preference this is the buffer with that timestamp, the
+    // one with the closest lower timestamp, or the one with the closest
+    // higher timestamp. Returns NULL if the ring buffer is empty.
+    //
+    // Unlike pinSelectedBuffer this is a binary search on the timestamp index
+    // and doesn't need to visit every buffer.
+    sp<PinnedBufferItem> pinBufferByTimestamp(nsecs_t timestamp,
+                                              bool waitForFence = true);
+
     // Release all the non-pinned buffers in the ring buffer
     status_t clear();
 
@@ -180,8 +190,18 @@ class RingBufferConsumer : public ConsumerBase,
         int mPinCount;
     };
 
+    typedef List<RingBufferItem>::iterator RingBufferItemIterator;
+
+    // Index of the first entry of mTimestampIndex with a timestamp that is
+    // not lower than timestamp
+    size_t lowerBoundLocked(nsecs_t timestamp) const;
+    void indexBufferLocked(const RingBufferItemIterator& it);
+    void unindexBufferLocked(const RingBufferItemIterator& it);
+
     // List of acquired buffers in our ring buffer
     List<RingBufferItem>       mBufferItemList;
+    // The same buffers sorted by timestamp, oldest first
+    Vector<RingBufferItemIterator> mTimestampIndex;
     const int                  mBufferCount;
 
     // Timestamp of latest buffer
@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "CameraFrameTimeline"
+//#define LOG_NDEBUG 0
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <cutils/atomic.h>
+#include <utils/KeyedVector.h>
+#include <utils/Log.h>
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+#include "utils/CameraFrameTimeline.h"
+
+namespace android {
+namespace camera3 {
+
+namespace {
+
+// Times of one frame, 0 for the stages it didn't reach
+struct FrameTimes {
+    nsecs_t submitted;
+    nsecs_t shutter;
+    nsecs_t result;
+    nsecs_t lastBufferReturned;
+};
+
+// Latencies between two stages of the frames, in ns
+struct Latency {
+    const char *name;
+    Vector<nsecs_t> values;
+};
+
+int compareLatency(const nsecs_t *a, const nsecs_t *b) {
+    return *a < *b ? -1 : (*a > *b ? 1 : 0);
+}
+
+void addLatency(Latency &latency, nsecs_t from, nsecs_t to) {
+    if (from != 0 && to != 0) {
+        latency.values.push_back(to - from);
+    }
+}
+
+} // anonymous namespace
+
+CameraFrameTimeline::CameraFrameTimeline() :
+        mWriteCount(0) {
+    memset(mEvents, 0, sizeof(mEvents));
+}
+
+void CameraFrameTimeline::record(Stage stage, uint32_t frameNumber, int streamId) {
+    int32_t count = android_atomic_inc(&mWriteCount) + 1;
+    Event &event = mEvents[(uint32_t) count & (kCapacity - 1)];
+    // A reader catching the event while it is written sees a sequence of 0
+    // or a different one, and drops it
+    android_atomic_release_store(0, &event.sequence);
+    android_memory_barrier();
+    event.frameNumber = frameNumber;
+    event.stage = stage;
+    event.streamId = streamId;
+    event.time = systemTime();
+    android_atomic_release_store(count, &event.sequence);
+}
+
+const char* CameraFrameTimeline::stageName(int32_t stage) {
+    switch (stage) {
+        case REQUEST_STARTED:   return "started";
+        case BUFFER_DEQUEUED:   return "buffer dequeued";
+        case REQUEST_SUBMITTED: return "submitted";
+        case SHUTTER:           return "shutter";
+        case PARTIAL_RESULT:    return "partial result";
+        case RESULT:            return "result";
+        case BUFFER_RETURNED:   return "buffer returned";
+        default:                return "unknown";
+    }
+}
+
+void CameraFrameTimeline::dump(int fd, int indentation) const {
+    // Copy the events that are complete, oldest first
+    int32_t writeCount = android_atomic_acquire_load(&mWriteCount);
+    uint32_t numEvents = writeCount;
+    if (numEvents > kCapacity) {
+        numEvents = kCapacity;
+    }
+    Vector<Event> events;
+    events.setCapacity(numEvents);
+    for (uint32_t i = 0; i < numEvents; i++) {
+        const Event &event =
+                mEvents[((uint32_t) writeCount - numEvents + 1 + i) & (kCapacity - 1)];
+        Event copy;
+        copy.sequence = android_atomic_acquire_load(&event.sequence);
+        copy.frameNumber = event.frameNumber;
+        copy.stage = event.stage;
+        copy.streamId = event.streamId;
+        copy.time = event.time;
+        android_memory_barrier();
+        if (copy.sequence != 0 &&
+                copy.sequence == android_atomic_acquire_load(&event.sequence)) {
+            events.push_back(copy);
+        }
+    }
+
+    KeyedVector<uint32_t, FrameTimes> frames;
+    for (size_t i = 0; i < events.size(); i++) {
+        const Event &event = events[i];
+        ssize_t index = frames.indexOfKey(event.frameNumber);
+        if (index < 0) {
+            FrameTimes times = FrameTimes();
+            index = frames.add(event.frameNumber, times);
+        }
+        FrameTimes &times = frames.editValueAt(index);
+        switch (event.stage) {
+            case REQUEST_SUBMITTED: times.submitted = event.time; break;
+            case SHUTTER:           times.shutter = event.time; break;
+            case RESULT:            times.result = event.time; break;
+            case BUFFER_RETURNED:
+                if (event.time > times.lastBufferReturned) {
+                    times.lastBufferReturned = event.time;
+                }
+                break;
+            default: break;
+        }
+    }
+
+    Latency latencies[4];
+    latencies[0].name = "submit to shutter";
+    latencies[1].name = "shutter to result";
+    latencies[2].name = "submit to result";
+    latencies[3].name = "submit to last buffer";
+    for (size_t i = 0; i < frames.size(); i++) {
+        const FrameTimes &times = frames.valueAt(i);
+        addLatency(latencies[0], times.submitted, times.shutter);
+        addLatency(latencies[1], times.shutter, times.result);
+        addLatency(latencies[2], times.submitted, times.result);
+        addLatency(latencies[3], times.submitted, times.lastBufferReturned);
+    }
+
+    String8 lines;
+    lines.appendFormat("%*sFrame latencies over %zu frames, in ms (median / 90%% / max):\n",
+            indentation, "", frames.size());
+    for (size_t i = 0; i < sizeof(latencies) / sizeof(latencies[0]); i++) {
+        Vector<nsecs_t> &values = latencies[i].values;
+        if (values.isEmpty()) {
+            lines.appendFormat("%*s  %s: none\n", indentation, "", latencies[i].name);
+            continue;
+        }
+        values.sort(compareLatency);
+        lines.appendFormat("%*s  %s: %.2f / %.2f / %.2f (%zu frames)\n", indentation, "",
+                latencies[i].name,
+                values[values.size() / 2] / 1e6,
+                values[values.size() * 9 / 10] / 1e6,
+                values[values.size() - 1] / 1e6,
+                values.size());
+    }
+
+    // The newest frames in full, relative to their start
+    size_t firstFrame = frames.size() > kDumpFrames ? frames.size() - kDumpFrames : 0;
+    lines.appendFormat("%*sLatest frames, in ms from the first event of the frame:\n",
+            indentation, "");
+    for (size_t f = firstFrame; f < frames.size(); f++) {
+        uint32_t frameNumber = frames.keyAt(f);
+        nsecs_t start = 0;
+        lines.appendFormat("%*s  Frame %" PRIu32 ":", indentation, "", frameNumber);
+        for (size_t i = 0; i < events.size(); i++) {
+            const Event &event = events[i];
+            if (event.frameNumber != frameNumber) continue;
+            if (start == 0) start = event.time;
+            lines.appendFormat(" %s", stageName(event.stage));
+            if (event.streamId >= 0) {
+                lines.appendFormat(" (stream %d)", event.streamId);
+            }
+            lines.appendFormat(" %.2f,", (event.time - start) / 1e6);
+        }
+        lines.append("\n");
+    }
+    write(fd, lines.string(), lines.size());
+}
+
+}; // namespace camera3
+}; // namespace android
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SERVERS_CAMERA_FRAME_TIMELINE_H_
+#define ANDROID_SERVERS_CAMERA_FRAME_TIMELINE_H_
+
+#include <stdint.h>
+#include <utils/RefBase.h>
+#include <utils/Timers.h>
+
+namespace android {
+namespace camera3 {
+
+/**
+ * Records when each frame of a camera device goes through the stages of its
+ * capture, for the latency statistics of Camera3Device::dump.
+ *
+ * Events go into a fixed ring of the latest kCapacity events without locking,
+ * so any thread of the capture pipeline can record them; a dump only uses the
+ * events that were not being overwritten while it read them.
+ */
+class CameraFrameTimeline : public virtual RefBase {
+  public:
+    enum Stage {
+        // The request thread took the request and gave it its frame number
+        REQUEST_STARTED,
+        // A buffer for the request was dequeued from an output stream, which
+        // is when the stream learns that its consumer released it
+        BUFFER_DEQUEUED,
+        // The request was passed to process_capture_request
+        REQUEST_SUBMITTED,
+        SHUTTER,
+        PARTIAL_RESULT,
+        RESULT,
+        // A filled buffer was queued to its output stream's consumer
+        BUFFER_RETURNED,
+        NUM_STAGES
+    };
+
+    CameraFrameTimeline();
+
+    /**
+     * Record that the frame reached the stage now. streamId is the stream
+     * for the buffer stages, -1 otherwise.
+     */
+    void record(Stage stage, uint32_t frameNumber, int streamId = -1);
+
+    /**
+     * Print the latency distributions between stages over the recorded
+     * frames, and the timeline of the latest ones.
+     *
+     * <p>Each line is indented by indentation spaces.</p>
+     */
+    void dump(int fd, int indentation) const;
+
+  private:
+    // Events kept, a power of 2; a few seconds at high frame rates
+    static const uint32_t kCapacity = 4096;
+    // Frames printed in full by dump()
+    static const size_t kDumpFrames = 8;
+
+    struct Event {
+        // Write count at which the event was written, 0 while being written;
+        // accessed with the atomic operations only
+        int32_t  sequence;
+        uint32_t frameNumber;
+        int32_t  stage;
+        int32_t  streamId;
+        nsecs_t  time;
+    };
+
+    static const char* stageName(int32_t stage);
+
+    volatile int32_t mWriteCount;
+    Event mEvents[kCapacity];
+};
+
+}; // namespace camera3
+}; // namespace android
+
+#endif
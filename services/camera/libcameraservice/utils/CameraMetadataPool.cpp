@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "CameraMetadataPool"
+//#define LOG_NDEBUG 0
+
+#include <utils/Log.h>
+
+#include "utils/CameraMetadataPool.h"
+
+namespace android {
+namespace camera3 {
+
+CameraMetadataPool::CameraMetadataPool() :
+        mEntryCapacity(0),
+        mDataCapacity(0) {
+}
+
+CameraMetadataPool::~CameraMetadataPool() {
+    for (size_t i = 0; i < mBuffers.size(); i++) {
+        free_camera_metadata(mBuffers[i]);
+    }
+}
+
+camera_metadata_t* CameraMetadataPool::obtain(size_t entryCapacity,
+        size_t dataCapacity) {
+    Mutex::Autolock l(mLock);
+
+    if (entryCapacity > mEntryCapacity) mEntryCapacity = entryCapacity;
+    if (dataCapacity > mDataCapacity) mDataCapacity = dataCapacity;
+
+    while (!mBuffers.isEmpty()) {
+        camera_metadata_t *buffer = mBuffers.top();
+        mBuffers.pop();
+        size_t bufferEntryCapacity = get_camera_metadata_entry_capacity(buffer);
+        size_t bufferDataCapacity = get_camera_metadata_data_capacity(buffer);
+        if (bufferEntryCapacity >= mEntryCapacity &&
+                bufferDataCapacity >= mDataCapacity) {
+            // Clear the buffer in place, keeping its capacity
+            return place_camera_metadata(buffer,
+                    get_camera_metadata_size(buffer),
+                    bufferEntryCapacity, bufferDataCapacity);
+        }
+        free_camera_metadata(buffer);
+    }
+    ALOGV("%s: New buffer for %zu entries, %zu bytes of data", __FUNCTION__,
+            mEntryCapacity, mDataCapacity);
+    return allocate_camera_metadata(mEntryCapacity, mDataCapacity);
+}
+
+void CameraMetadataPool::release(camera_metadata_t *buffer) {
+    if (buffer == NULL) return;
+
+    Mutex::Autolock l(mLock);
+
+    // A buffer that had to grow tells the size of the results to expect
+    size_t entryCount = get_camera_metadata_entry_count(buffer);
+    size_t dataCount = get_camera_metadata_data_count(buffer);
+    if (entryCount > mEntryCapacity) mEntryCapacity = entryCount;
+    if (dataCount > mDataCapacity) mDataCapacity = dataCount;
+
+    if (mBuffers.size() < kMaxBuffers &&
+            get_camera_metadata_entry_capacity(buffer) >= mEntryCapacity &&
+            get_camera_metadata_data_capacity(buffer) >= mDataCapacity) {
+        mBuffers.push(buffer);
+    } else {
+        free_camera_metadata(buffer);
+    }
+}
+
+}; // namespace camera3
+}; // namespace android
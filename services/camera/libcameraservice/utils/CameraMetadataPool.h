@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2014 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SERVERS_CAMERA_METADATA_POOL_H_
+#define ANDROID_SERVERS_CAMERA_METADATA_POOL_H_
+
+#include <utils/Mutex.h>
+#include <utils/Vector.h>
+#include <system/camera_metadata.h>
+
+namespace android {
+namespace camera3 {
+
+/**
+ * A pool of camera_metadata_t buffers, so that a stream of capture results
+ * does not allocate and grow a new buffer for each result.
+ *
+ * Buffers are sized for the largest result seen so far, and a buffer that
+ * comes back smaller than that is freed rather than kept. The buffers are
+ * plain camera_metadata_t allocations: one that is never released to the pool
+ * can be freed with free_camera_metadata() as usual.
+ */
+class CameraMetadataPool {
+  public:
+    CameraMetadataPool();
+    ~CameraMetadataPool();
+
+    /**
+     * Get an empty buffer with room for at least entryCapacity entries and
+     * dataCapacity bytes of data, as well as for the largest buffer released
+     * so far. The caller owns the buffer.
+     */
+    camera_metadata_t* obtain(size_t entryCapacity, size_t dataCapacity);
+
+    /**
+     * Give a buffer back to the pool, which takes ownership of it.
+     */
+    void release(camera_metadata_t *buffer);
+
+  private:
+    // Buffers kept for reuse, enough for the results between the device and
+    // the frame processor
+    static const size_t kMaxBuffers = 8;
+
+    CameraMetadataPool(const CameraMetadataPool&);
+    CameraMetadataPool& operator=(const CameraMetadataPool&);
+
+    Mutex mLock;
+    Vector<camera_metadata_t*> mBuffers;
+    size_t mEntryCapacity;
+    size_t mDataCapacity;
+};
+
+}; // namespace camera3
+}; // namespace android
+
+#endif
@@ -17,7 +17,14 @@
 #define LOG_TAG "MediaLog"
 //#define LOG_NDEBUG 0
 
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
+#include <unistd.h>
+#include <cutils/properties.h>
 #include <utils/Log.h>
 #include <binder/PermissionCache.h>
 #include <media/nbaio/NBLog.h>
@@ -26,6 +33,51 @@
 
 namespace android {
 
+MediaLogService::MediaLogService()
+    : BnMediaLogService(), mHistoryFront(0), mRingFileSize(0), mRingFd(-1), mRingWritten(0)
+{
+}
+
+MediaLogService::~MediaLogService()
+{
+    if (mMergeThread != 0) {
+        mMergeThread->requestExitAndWait();
+    }
+    if (mRingFd >= 0) {
+        close(mRingFd);
+    }
+}
+
+void MediaLogService::onFirstRef()
+{
+    char value[PROPERTY_VALUE_MAX];
+    uint32_t periodMs = 500;
+    if (property_get("medialog.merge_period_ms", value, NULL) > 0) {
+        periodMs = strtoul(value, NULL, 0);
+    }
+    if (property_get("medialog.ring_file", value, NULL) > 0) {
+        mRingPath = value;
+        mRingFileSize = 1024 * 1024;
+        if (property_get("medialog.ring_file_size", value, NULL) > 0) {
+            mRingFileSize = strtoul(value, NULL, 0);
+        }
+        Mutex::Autolock _l(mLock);
+        (void) openRingFile_l();
+    }
+    if (periodMs > 0) {
+        mMergeThread = new MergeThread(*this, periodMs);
+        mMergeThread->run("MediaLogMerge", PRIORITY_BACKGROUND);
+    }
+}
+
+bool MediaLogService::MergeThread::threadLoop()
+{
+    usleep(mPeriodMs * 1000);
+    Mutex::Autolock _l(mService.mLock);
+    mService.merge_l();
+    return true;
+}
+
 void MediaLogService::registerWriter(const sp<IMemory>& shared, size_t size, const char *name)
 {
     if (IPCThreadState::self()->getCallingUid() != AID_MEDIA || shared == 0 ||
@@ -34,8 +86,8 @@ void MediaLogService::registerWriter(const sp<IMemory>& shared, size_t size, con
         return;
     }
     sp<NBLog::Reader> reader(new NBLog::Reader(size, shared));
-    NamedReader namedReader(reader, name);
     Mutex::Autolock _l(mLock);
+    NamedReader namedReader(reader, name, writerIndex_l(name));
     mNamedReaders.add(namedReader);
 }
 
@@ -45,6 +97,8 @@ void MediaLogService::unregisterWriter(const sp<IMemory>& shared)
         return;
     }
     Mutex::Autolock _l(mLock);
+    // keep whatever the writer logged since the last merge
+    merge_l();
     for (size_t i = 0; i < mNamedReaders.size(); ) {
         if (mNamedReaders[i].reader()->isIMemory(shared)) {
             mNamedReaders.removeAt(i);
@@ -54,7 +108,170 @@ void MediaLogService::unregisterWriter(const sp<IMemory>& shared)
     }
 }
 
-status_t MediaLogService::dump(int fd, const Vector<String16>& args __unused)
+uint8_t MediaLogService::writerIndex_l(const char *name)
+{
+    for (size_t i = 0; i < mWriterNames.size(); i++) {
+        if (mWriterNames[i] == name) {
+            return i;
+        }
+    }
+    if (mWriterNames.size() < kMaxWriters - 1) {
+        mWriterNames.add(String8(name));
+        return mWriterNames.size() - 1;
+    }
+    if (mWriterNames.size() < kMaxWriters) {
+        mWriterNames.add(String8("(other)"));
+    }
+    return kMaxWriters - 1;
+}
+
+void MediaLogService::mergeReader_l(const NamedReader& namedReader, Vector<MergedLine>& merged)
+{
+    Vector<NBLog::Reader::Line> lines;
+    namedReader.reader()->read(lines);
+    if (lines.isEmpty()) {
+        return;
+    }
+    // Each writer's lines are already in timestamp order, so merge them into the lines
+    // of the previous writers.  This is quadratic in the worst case, but the number of writers
+    // is small and the lines of different writers are mostly in disjoint time ranges.
+    Vector<MergedLine> result;
+    result.setCapacity(merged.size() + lines.size());
+    size_t i = 0, j = 0;
+    while (i < merged.size() || j < lines.size()) {
+        if (j >= lines.size() ||
+                (i < merged.size() && merged[i].mTimestampNs <= lines[j].mTimestampNs)) {
+            result.add(merged[i++]);
+        } else {
+            MergedLine line;
+            line.mTimestampNs = lines[j].mTimestampNs;
+            line.mWriter = namedReader.writer();
+            line.mBody = lines[j++].mBody;
+            result.add(line);
+        }
+    }
+    merged = result;
+}
+
+void MediaLogService::merge_l()
+{
+    Vector<MergedLine> merged;
+    for (size_t i = 0; i < mNamedReaders.size(); i++) {
+        mergeReader_l(mNamedReaders[i], merged);
+    }
+    // Lines are ordered within each merge, but a writer that is late to log a timestamp can
+    // still produce lines older than those of a previous merge.
+    for (size_t i = 0; i < merged.size(); i++) {
+        if (mHistory.size() < kMaxHistory) {
+            mHistory.add(merged[i]);
+        } else {
+            mHistory.editItemAt(mHistoryFront) = merged[i];
+            if (++mHistoryFront >= kMaxHistory) {
+                mHistoryFront = 0;
+            }
+        }
+        appendToRingFile_l(merged[i]);
+    }
+}
+
+/*static*/
+bool MediaLogService::writeRecord(int fd, uint8_t type, const void *payload, size_t length)
+{
+    if (length > UINT16_MAX) {
+        length = UINT16_MAX;
+    }
+    uint8_t header[3];
+    header[0] = type;
+    header[1] = length & 0xFF;
+    header[2] = length >> 8;
+    return write(fd, header, sizeof(header)) == (ssize_t) sizeof(header) &&
+            write(fd, payload, length) == (ssize_t) length;
+}
+
+/*static*/
+bool MediaLogService::writeHeader(int fd)
+{
+    const uint32_t header[2] = {kBinaryMagic, kBinaryVersion};
+    return write(fd, header, sizeof(header)) == (ssize_t) sizeof(header);
+}
+
+/*static*/
+bool MediaLogService::writeLine(int fd, const MergedLine& line)
+{
+    // body is at most 255 bytes plus an occasional warning, see NBLog::Reader
+    uint8_t payload[sizeof(int64_t) + 1 + 1024];
+    size_t length = line.mBody.length();
+    if (length > sizeof(payload) - sizeof(int64_t) - 1) {
+        length = sizeof(payload) - sizeof(int64_t) - 1;
+    }
+    memcpy(payload, &line.mTimestampNs, sizeof(int64_t));
+    payload[sizeof(int64_t)] = line.mWriter;
+    memcpy(&payload[sizeof(int64_t) + 1], line.mBody.string(), length);
+    return writeRecord(fd, kRecordLine, payload, sizeof(int64_t) + 1 + length);
+}
+
+bool MediaLogService::openRingFile_l()
+{
+    if (mRingFd >= 0) {
+        close(mRingFd);
+        mRingFd = -1;
+    }
+    // keep the previous half of the ring, which at startup is the end of the previous run
+    String8 previous(mRingPath);
+    previous.append(".1");
+    if (rename(mRingPath.string(), previous.string()) != 0 && errno != ENOENT) {
+        ALOGW("rename %s failed: %s", mRingPath.string(), strerror(errno));
+    }
+    mRingFd = open(mRingPath.string(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+    if (mRingFd < 0) {
+        ALOGE("open %s failed: %s", mRingPath.string(), strerror(errno));
+        return false;
+    }
+    if (!writeHeader(mRingFd)) {
+        close(mRingFd);
+        mRingFd = -1;
+        return false;
+    }
+    mRingWritten = 2 * sizeof(uint32_t);
+    mRingNamed.clear();
+    return true;
+}
+
+void MediaLogService::appendToRingFile_l(const MergedLine& line)
+{
+    if (mRingFd < 0) {
+        return;
+    }
+    // each of the two files holds at most half of the configured size
+    if (mRingWritten >= mRingFileSize / 2 && !openRingFile_l()) {
+        return;
+    }
+    while (mRingNamed.size() <= line.mWriter) {
+        mRingNamed.add(false);
+    }
+    bool ok = true;
+    if (!mRingNamed[line.mWriter]) {
+        const String8& name = mWriterNames[line.mWriter];
+        uint8_t payload[1 + 256];
+        size_t length = name.length() < 256 ? name.length() : 256;
+        payload[0] = line.mWriter;
+        memcpy(&payload[1], name.string(), length);
+        ok = writeRecord(mRingFd, kRecordName, payload, 1 + length);
+        mRingWritten += 3 + 1 + length;
+        mRingNamed.editItemAt(line.mWriter) = true;
+    }
+    if (ok) {
+        ok = writeLine(mRingFd, line);
+        mRingWritten += 3 + sizeof(int64_t) + 1 + line.mBody.length();
+    }
+    if (!ok) {
+        ALOGE("write %s failed, disabling ring file", mRingPath.string());
+        close(mRingFd);
+        mRingFd = -1;
+    }
+}
+
+status_t MediaLogService::dump(int fd, const Vector<String16>& args)
 {
     // FIXME merge with similar but not identical code at services/audioflinger/ServiceUtilities.cpp
     static const String16 sDump("android.permission.DUMP");
@@ -66,19 +283,54 @@ status_t MediaLogService::dump(int fd, const Vector<String16>& args __unused)
         return NO_ERROR;
     }
 
-    Vector<NamedReader> namedReaders;
+    bool binary = false;
+    for (size_t i = 0; i < args.size(); i++) {
+        if (args[i] == String16("--binary")) {
+            binary = true;
+        }
+    }
+
+    // copy so that a slow reader of fd does not block registerWriter()
+    Vector<MergedLine> history;
+    Vector<String8> writerNames;
     {
         Mutex::Autolock _l(mLock);
-        namedReaders = mNamedReaders;
+        merge_l();
+        for (size_t i = 0; i < mHistory.size(); i++) {
+            history.add(mHistory[(mHistoryFront + i) % mHistory.size()]);
+        }
+        writerNames = mWriterNames;
+    }
+    if (binary) {
+        if (fd < 0 || !writeHeader(fd)) {
+            return NO_ERROR;
+        }
+        for (size_t i = 0; i < writerNames.size(); i++) {
+            uint8_t payload[1 + 256];
+            size_t length = writerNames[i].length() < 256 ? writerNames[i].length() : 256;
+            payload[0] = i;
+            memcpy(&payload[1], writerNames[i].string(), length);
+            if (!writeRecord(fd, kRecordName, payload, 1 + length)) {
+                return NO_ERROR;
+            }
+        }
+        for (size_t i = 0; i < history.size(); i++) {
+            if (!writeLine(fd, history[i])) {
+                break;
+            }
+        }
+        return NO_ERROR;
     }
-    for (size_t i = 0; i < namedReaders.size(); i++) {
-        const NamedReader& namedReader = namedReaders[i];
+    for (size_t i = 0; i < history.size(); i++) {
+        const MergedLine& line = history[i];
+        const char *name = writerNames[line.mWriter].string();
+        int sec = line.mTimestampNs / 1000000000LL;
+        int usec = (line.mTimestampNs % 1000000000LL) / 1000;
         if (fd >= 0) {
-            dprintf(fd, "\n%s:\n", namedReader.name());
+            dprintf(fd, "[%d.%06d] %s: %s\n", sec, usec, name, line.mBody.string());
         } else {
-            ALOGI("%s:", namedReader.name());
+            ALOGI("[%d.%06d] %s: %s", sec, usec, name, line.mBody.string());
         }
-        namedReader.reader()->dump(fd, 0 /*indent*/);
     }
     return NO_ERROR;
 }
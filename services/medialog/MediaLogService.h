@@ -20,16 +20,39 @@
 #include <binder/BinderService.h>
 #include <media/IMediaLogService.h>
 #include <media/nbaio/NBLog.h>
+#include <utils/Thread.h>
 
 namespace android {
 
+// MediaLogService drains all registered writers into a single history ordered by timestamp,
+// periodically so that entries survive the wraparound of the writers' shared memory.
+// If configured, the merged lines are also appended to a pair of rotating files on disk,
+// in the same compact binary format as "dumpsys media.log --binary":
+//
+//  uint32_t    kBinaryMagic
+//  uint32_t    kBinaryVersion
+//  then records, each consisting of
+//  uint8_t     type, one of kRecordName or kRecordLine
+//  uint16_t    payload length in bytes
+//  payload:
+//      kRecordName:    uint8_t writer index, followed by the writer's name
+//      kRecordLine:    int64_t CLOCK_MONOTONIC time in ns, uint8_t writer index,
+//                      followed by the formatted text
+//
+// All integers are little-endian, and strings are not NUL-terminated.  A writer's name record
+// precedes its first line in each file and each export.
+//
+// Properties:
+//  medialog.merge_period_ms    period of merging in ms, 0 to merge only on dump, default 500
+//  medialog.ring_file          path of the file on disk, empty to disable, which is the default
+//  medialog.ring_file_size     maximum size in bytes of the file and its ".1" predecessor
 class MediaLogService : public BinderService<MediaLogService>, public BnMediaLogService
 {
     friend class BinderService<MediaLogService>;    // for MediaLogService()
 public:
-    MediaLogService() : BnMediaLogService() { }
-    virtual ~MediaLogService() { }
-    virtual void onFirstRef() { }
+    MediaLogService();
+    virtual ~MediaLogService();
+    virtual void onFirstRef();
 
     static const char*  getServiceName() { return "media.log"; }
 
@@ -42,22 +65,79 @@ public:
     virtual status_t    onTransact(uint32_t code, const Parcel& data, Parcel* reply,
                                 uint32_t flags);
 
+    static const uint32_t kBinaryMagic = 0x4d4c424e;   // "NBLM"
+    static const uint32_t kBinaryVersion = 1;
+    static const uint8_t kRecordName = 1;
+    static const uint8_t kRecordLine = 2;
+
 private:
     Mutex               mLock;
     class NamedReader {
     public:
-        NamedReader() : mReader(0) { mName[0] = '\0'; } // for Vector
-        NamedReader(const sp<NBLog::Reader>& reader, const char *name) : mReader(reader)
+        NamedReader() : mReader(0), mWriter(0) { mName[0] = '\0'; } // for Vector
+        NamedReader(const sp<NBLog::Reader>& reader, const char *name, uint8_t writer)
+            : mReader(reader), mWriter(writer)
             { strlcpy(mName, name, sizeof(mName)); }
         ~NamedReader() { }
         const sp<NBLog::Reader>&  reader() const { return mReader; }
         const char*               name() const { return mName; }
+        uint8_t                   writer() const { return mWriter; }
     private:
         sp<NBLog::Reader>   mReader;
+        uint8_t             mWriter;    // index in mWriterNames
         static const size_t kMaxName = 32;
         char                mName[kMaxName];
     };
     Vector<NamedReader> mNamedReaders;
+
+    class MergedLine {
+    public:
+        int64_t         mTimestampNs;
+        uint8_t         mWriter;        // index in mWriterNames
+        String8         mBody;
+    };
+
+    // Read all new lines from the writers, and append them in timestamp order to mHistory
+    // and to the ring file
+    void                merge_l();
+    void                mergeReader_l(const NamedReader& namedReader,
+                                Vector<MergedLine>& merged);
+    uint8_t             writerIndex_l(const char *name);
+
+    // binary format, see above
+    static bool         writeRecord(int fd, uint8_t type, const void *payload, size_t length);
+    static bool         writeHeader(int fd);
+    static bool         writeLine(int fd, const MergedLine& line);
+    void                appendToRingFile_l(const MergedLine& line);
+    bool                openRingFile_l();
+
+    // Writer names are never forgotten, so that the history can still refer to them after the
+    // writer is unregistered.  Index kMaxWriters - 1 is shared by any further names.
+    static const size_t kMaxWriters = 255;
+    Vector<String8>     mWriterNames;
+
+    // circular buffer of the most recent merged lines
+    static const size_t kMaxHistory = 2048;
+    Vector<MergedLine>  mHistory;
+    size_t              mHistoryFront;  // index of oldest line once mHistory is full
+
+    // ring file on disk
+    String8             mRingPath;
+    size_t              mRingFileSize;
+    int                 mRingFd;        // -1 if disabled or failed
+    size_t              mRingWritten;   // bytes written to current file
+    Vector<bool>        mRingNamed;     // whether each writer's name is in the current file
+
+    class MergeThread : public Thread {
+    public:
+        MergeThread(MediaLogService& service, uint32_t periodMs)
+            : Thread(false /*canCallJava*/), mService(service), mPeriodMs(periodMs) { }
+        virtual bool threadLoop();
+    private:
+        MediaLogService&    mService;
+        const uint32_t      mPeriodMs;
+    };
+    sp<MergeThread>     mMergeThread;
 };
 
 }   // namespace android
@@ -47,7 +47,8 @@ public:
         data.writeStrongBinder(eventMemory->asBinder());
         remote()->transact(ON_RECOGNITION_EVENT,
                            data,
-                           &reply);
+                           &reply,
+                           IBinder::FLAG_ONEWAY);
     }
 
     virtual void onSoundModelEvent(const sp<IMemory>& eventMemory)
@@ -57,7 +58,8 @@ public:
         data.writeStrongBinder(eventMemory->asBinder());
         remote()->transact(ON_SOUNDMODEL_EVENT,
                            data,
-                           &reply);
+                           &reply,
+                           IBinder::FLAG_ONEWAY);
     }
     virtual void onServiceStateChange(const sp<IMemory>& eventMemory)
     {
@@ -66,7 +68,8 @@ public:
         data.writeStrongBinder(eventMemory->asBinder());
         remote()->transact(ON_SERVICE_STATE_CHANGE,
                            data,
-                           &reply);
+                           &reply,
+                           IBinder::FLAG_ONEWAY);
     }
 };
 